@@ -532,10 +532,6 @@ static int lines_refresh(struct cfdisk *cf)
 			*p = '\0';
 			p++;
 		}
-		cf->lines[i].extra = scols_new_table();
-		scols_table_enable_noheadings(cf->lines[i].extra, 1);
-		scols_table_new_column(cf->lines[i].extra, NULL, 0, SCOLS_FL_RIGHT);
-		scols_table_new_column(cf->lines[i].extra, NULL, 0, SCOLS_FL_TRUNC);
 	}
 
 	return 0;
@@ -1455,7 +1451,15 @@ static int ui_draw_extra(struct cfdisk *cf)
 
 	DBG(UI, ul_debug("draw extra"));
 
-	assert(ln->extra);
+	/* allocated on demand, the table is rebuilt after every change */
+	if (!ln->extra) {
+		ln->extra = scols_new_table();
+		if (!ln->extra)
+			return -ENOMEM;
+		scols_table_enable_noheadings(ln->extra, 1);
+		scols_table_new_column(ln->extra, NULL, 0, SCOLS_FL_RIGHT);
+		scols_table_new_column(ln->extra, NULL, 0, SCOLS_FL_TRUNC);
+	}
 
 	if (cf->act_win) {
 		wclear(cf->act_win);
@@ -1776,7 +1780,9 @@ static int ui_refresh(struct cfdisk *cf)
 	lb = fdisk_get_label(cf->cxt, NULL);
 	assert(lb);
 
-	clear();
+	/* don't use clear(), curses sends only the changed screen cells then
+	 * (full repaint is forced by resize() for ^L and SIGWINCH) */
+	erase();
 
 	/* header */
 	attron(A_BOLD);
@@ -1,6 +1,7 @@
 #include <libfdisk.h>
 #include <libsmartcols.h>
 #include <assert.h>
+#include <sys/wait.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -22,6 +23,10 @@ static int *fields_ids;
 static size_t fields_nids;
 static const struct fdisk_label *fields_label;
 
+/* see set_list_jobs() */
+static size_t list_jobs;
+static size_t list_termwidth;	/* terminal width of the parent process */
+
 static int is_ide_cdrom_or_tape(char *device)
 {
 	int fd, ret;
@@ -131,6 +136,11 @@ void list_disklabel(struct fdisk_context *cxt)
 		scols_table_enable_colors(out, 1);
 		bold = color_scheme_get_sequence("header", UL_COLOR_BOLD);
 	}
+	if (list_termwidth) {
+		/* listed by child process to a temporary file */
+		scols_table_set_termforce(out, SCOLS_TERMFORCE_ALWAYS);
+		scols_table_set_termwidth(out, list_termwidth);
+	}
 
 	lb = fdisk_get_label(cxt, NULL);
 	assert(lb);
@@ -252,6 +262,11 @@ void list_freespace(struct fdisk_context *cxt)
 		scols_table_enable_colors(out, 1);
 		bold = color_scheme_get_sequence("header", UL_COLOR_BOLD);
 	}
+	if (list_termwidth) {
+		/* listed by child process to a temporary file */
+		scols_table_set_termforce(out, SCOLS_TERMFORCE_ALWAYS);
+		scols_table_set_termwidth(out, list_termwidth);
+	}
 
 	for (i = 0; i < ARRAY_SIZE(colnames); i++) {
 		struct libscols_column *co = scols_table_new_column(out, _(colnames[i]), 5, SCOLS_FL_RIGHT);
@@ -400,30 +415,197 @@ int print_device_freespace(struct fdisk_context *cxt, char *device, int warnme,
 	return 0;
 }
 
-void print_all_devices_pt(struct fdisk_context *cxt, int verify)
+/*
+ * Sets number of devices listed in parallel by print_devices_pt() and
+ * print_devices_freespace(). The default is the number of online CPUs.
+ */
+void set_list_jobs(size_t jobs)
 {
-	FILE *f = NULL;
-	int sep = 0;
-	char *dev;
+	list_jobs = jobs;
+}
 
-	while ((dev = next_proc_partition(&f))) {
-		print_device_pt(cxt, dev, 0, verify, sep);
-		free(dev);
-		sep = 1;
+struct list_dev {
+	char	*name;
+	FILE	*out;		/* stdout of the child */
+	FILE	*err;		/* stderr of the child */
+	pid_t	pid;
+	int	status;
+	unsigned int done : 1;
+};
+
+static int list_device(struct fdisk_context *cxt, char *device, int warnme,
+		       int verify, int freespace, int separator)
+{
+	if (freespace)
+		return print_device_freespace(cxt, device, warnme, separator);
+	return print_device_pt(cxt, device, warnme, verify, separator);
+}
+
+static void list_replay(FILE *from, FILE *to)
+{
+	char buf[BUFSIZ];
+	size_t n;
+
+	rewind(from);
+	while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+		fwrite(buf, 1, n, to);
+	fclose(from);
+}
+
+static void list_start(struct fdisk_context *cxt, struct list_dev *dev,
+		       int warnme, int verify, int freespace, int separator)
+{
+	dev->out = tmpfile();
+	dev->err = tmpfile();
+	if (!dev->out || !dev->err)
+		err(EXIT_FAILURE, _("cannot create temporary file"));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	dev->pid = fork();
+	if (dev->pid < 0)
+		err(EXIT_FAILURE, _("fork failed"));
+	if (dev->pid == 0) {
+		int rc;
+
+		if (dup2(fileno(dev->out), STDOUT_FILENO) < 0
+		    || dup2(fileno(dev->err), STDERR_FILENO) < 0)
+			_exit(EXIT_FAILURE);
+
+		rc = list_device(cxt, dev->name, warnme, verify, freespace, separator);
+		exit(rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 	}
 }
 
-void print_all_devices_freespace(struct fdisk_context *cxt)
+/*
+ * The devices are listed by child processes (every process opens and reads
+ * one device) and the output is buffered in temporary files and printed in
+ * order of the devices. The number of the buffered devices is limited to keep
+ * the number of open files small.
+ */
+static int list_devices(struct fdisk_context *cxt, char **devs, size_t ndevs,
+			int warnme, int verify, int freespace)
+{
+	struct list_dev *ls;
+	size_t jobs = list_jobs, next = 0, printed = 0, running = 0, i;
+	int fail = 0;
+
+	if (!jobs) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = n > 0 ? (size_t) n : 1;
+	}
+
+	if (jobs <= 1 || ndevs <= 1) {
+		for (i = 0; i < ndevs; i++) {
+			if (list_device(cxt, devs[i], warnme, verify, freespace, i) != 0)
+				fail++;
+		}
+		return fail;
+	}
+
+	if (isatty(STDOUT_FILENO))
+		list_termwidth = get_terminal_width(80);
+
+	ls = xcalloc(ndevs, sizeof(*ls));
+	for (i = 0; i < ndevs; i++)
+		ls[i].name = devs[i];
+
+	while (printed < ndevs) {
+		int status;
+		pid_t pid;
+
+		if (next < ndevs && running < jobs && next < printed + jobs * 4) {
+			list_start(cxt, &ls[next], warnme, verify, freespace, next);
+			next++;
+			running++;
+			continue;
+		}
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, _("waitpid failed"));
+		}
+		for (i = printed; i < next; i++) {
+			if (ls[i].pid == pid) {
+				ls[i].status = status;
+				ls[i].done = 1;
+				running--;
+				break;
+			}
+		}
+
+		/* print finished devices in order */
+		for (; printed < next && ls[printed].done; printed++) {
+			struct list_dev *dev = &ls[printed];
+
+			fflush(stdout);
+			list_replay(dev->err, stderr);
+			list_replay(dev->out, stdout);
+
+			if (!WIFEXITED(dev->status) || WEXITSTATUS(dev->status) != 0)
+				fail++;
+		}
+	}
+
+	list_termwidth = 0;
+	free(ls);
+	return fail;
+}
+
+int print_devices_pt(struct fdisk_context *cxt, char **devs, size_t ndevs,
+		     int warnme, int verify)
+{
+	return list_devices(cxt, devs, ndevs, warnme, verify, 0);
+}
+
+int print_devices_freespace(struct fdisk_context *cxt, char **devs, size_t ndevs,
+			    int warnme)
+{
+	return list_devices(cxt, devs, ndevs, warnme, 0, 1);
+}
+
+static char **get_all_devices(size_t *ndevs)
 {
 	FILE *f = NULL;
-	int sep = 0;
-	char *dev;
+	char **devs = NULL, *dev;
+	size_t n = 0;
 
 	while ((dev = next_proc_partition(&f))) {
-		print_device_freespace(cxt, dev, 0, sep);
-		free(dev);
-		sep = 1;
+		devs = xrealloc(devs, (n + 1) * sizeof(char *));
+		devs[n++] = dev;
 	}
+	*ndevs = n;
+	return devs;
+}
+
+static void free_devices(char **devs, size_t ndevs)
+{
+	size_t i;
+
+	for (i = 0; i < ndevs; i++)
+		free(devs[i]);
+	free(devs);
+}
+
+void print_all_devices_pt(struct fdisk_context *cxt, int verify)
+{
+	size_t ndevs = 0;
+	char **devs = get_all_devices(&ndevs);
+
+	list_devices(cxt, devs, ndevs, 0, verify, 0);
+	free_devices(devs, ndevs);
+}
+
+void print_all_devices_freespace(struct fdisk_context *cxt)
+{
+	size_t ndevs = 0;
+	char **devs = get_all_devices(&ndevs);
+
+	list_devices(cxt, devs, ndevs, 0, 0, 1);
+	free_devices(devs, ndevs);
 }
 
 /* usable for example in usage() */
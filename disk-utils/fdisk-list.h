@@ -10,8 +10,12 @@ extern char *next_proc_partition(FILE **f);
 extern int print_device_pt(struct fdisk_context *cxt, char *device, int warnme, int verify, int separator);
 extern int print_device_freespace(struct fdisk_context *cxt, char *device, int warnme, int separator);
 
+extern int print_devices_pt(struct fdisk_context *cxt, char **devs, size_t ndevs, int warnme, int verify);
+extern int print_devices_freespace(struct fdisk_context *cxt, char **devs, size_t ndevs, int warnme);
+
 extern void print_all_devices_pt(struct fdisk_context *cxt, int verify);
 extern void print_all_devices_freespace(struct fdisk_context *cxt);
+extern void set_list_jobs(size_t jobs);
 
 extern void list_available_columns(FILE *out);
 extern int *init_fields(struct fdisk_context *cxt, const char *str, size_t *n);
@@ -864,6 +864,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	        "                                 %s\n", USAGE_COLORS_DEFAULT);
 	fputs(_(" -l, --list                    display partitions and exit\n"), out);
 	fputs(_(" -x, --list-details            like --list but with more details\n"), out);
+	fputs(_("     --jobs <num>              number of devices to list in parallel\n"), out);
 
 	fputs(_(" -n, --noauto-pt               don't create default partition table on empty devices\n"), out);
 	fputs(_(" -o, --output <list>           output columns\n"), out);
@@ -909,7 +910,8 @@ int main(int argc, char **argv)
 	const char *devname, *lockmode = NULL;
 	enum {
 		OPT_BYTES	= CHAR_MAX + 1,
-		OPT_LOCK
+		OPT_LOCK,
+		OPT_JOBS
 	};
 	static const struct option longopts[] = {
 		{ "bytes",          no_argument,       NULL, OPT_BYTES },
@@ -920,6 +922,7 @@ int main(int argc, char **argv)
 		{ "sectors",        required_argument, NULL, 'S' },
 		{ "getsz",          no_argument,       NULL, 's' },
 		{ "help",           no_argument,       NULL, 'h' },
+		{ "jobs",           required_argument, NULL, OPT_JOBS },
 		{ "list",           no_argument,       NULL, 'l' },
 		{ "list-details",   no_argument,       NULL, 'x' },
 		{ "lock",           optional_argument, NULL, OPT_LOCK },
@@ -1059,6 +1062,9 @@ int main(int argc, char **argv)
 		case OPT_BYTES:
 			fdisk_set_size_unit(cxt, FDISK_SIZEUNIT_BYTES);
 			break;
+		case OPT_JOBS:
+			set_list_jobs(strtou32_or_err(optarg, _("invalid number of jobs")));
+			break;
 		case OPT_LOCK:
 			lockmode = "1";
 			if (optarg) {
@@ -1090,11 +1096,7 @@ int main(int argc, char **argv)
 		init_fields(cxt, outarg, NULL);
 
 		if (argc > optind) {
-			int k;
-
-			for (rc = 0, k = optind; k < argc; k++)
-				rc += print_device_pt(cxt, argv[k], 1, 0, k != optind);
-
+			rc = print_devices_pt(cxt, argv + optind, argc - optind, 1, 0);
 			if (rc)
 				return EXIT_FAILURE;
 		} else
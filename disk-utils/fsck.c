@@ -55,6 +55,8 @@
 #include "fileutils.h"
 #include "monotonic.h"
 #include "strutils.h"
+#include "all-io.h"
+#include "jsonwrt.h"
 
 #define XALLOC_EXIT_CODE	FSCK_EX_ERROR
 #include "xalloc.h"
@@ -95,9 +97,27 @@ struct fsck_fs_data
 {
 	const char	*device;
 	dev_t		disk;
-	unsigned int	stacked:1,
-			done:1,
-			eval_device:1;
+	size_t		*spindles;	/* indexes to spindles[] */
+	size_t		nspindles;
+	unsigned int	done:1,
+			eval_device:1,
+			eval_spindles:1;
+};
+
+/*
+ * Physical disk below file systems. The stacked devices (MD, DM) are
+ * resolved to their slaves. Checks on the same rotational disk are
+ * serialized, checks on non-rotational disks (SSD, NVMe) may run in
+ * parallel.
+ */
+struct fsck_spindle
+{
+	dev_t		devno;
+	char		*name;
+	int		running;	/* number of running checks */
+	int		nchecks;	/* number of finished checks */
+	struct timeval	busy;		/* sum of the checks real time */
+	unsigned int	nonrot:1;
 };
 
 /*
@@ -124,6 +144,20 @@ struct fsck_instance {
 #define FLAG_DONE 1
 #define FLAG_PROGRESS 2
 
+/*
+ * Statistics of the finished instances for --timings
+ */
+struct fsck_timing {
+	char	*device;
+	char	*target;
+	char	*type;
+	int	exit_status;
+
+	struct timeval start;	/* since fsck start */
+	struct timeval real;
+	struct rusage rusage;
+};
+
 /*
  * Global variables for options
  */
@@ -154,6 +188,15 @@ static int kill_sent;
 static char *fstype;
 static struct fsck_instance *instance_list;
 
+static struct fsck_spindle *spindles;
+static size_t nspindles;
+
+static int timings;
+static char *timings_path;		/* --timings=<file> or NULL for stdout */
+static struct timeval fsck_start_time;
+static struct fsck_timing *timings_list;
+static size_t ntimings;
+
 #define FSCK_DEFAULT_PATH "/sbin"
 static char *fsck_path;
 
@@ -162,7 +205,7 @@ static char *fsck_path;
 static struct libmnt_table *fstab, *mtab;
 static struct libmnt_cache *mntcache;
 
-static int count_slaves(dev_t disk);
+static int is_irrotational_disk(dev_t disk);
 
 static int string_to_int(const char *s)
 {
@@ -277,19 +320,138 @@ static dev_t fs_get_disk(struct libmnt_fs *fs, int check)
 	data = fs_create_data(fs);
 
 	if (!stat(device, &st) &&
-	    !blkid_devno_to_wholedisk(st.st_rdev, NULL, 0, &data->disk)) {
-
-		if (data->disk)
-			data->stacked = count_slaves(data->disk) > 0 ? 1 : 0;
+	    !blkid_devno_to_wholedisk(st.st_rdev, NULL, 0, &data->disk))
 		return data->disk;
-	}
 	return 0;
 }
 
-static int fs_is_stacked(struct libmnt_fs *fs)
+static size_t get_spindle(dev_t disk)
 {
-	struct fsck_fs_data *data = mnt_fs_get_userdata(fs);
-	return data ? data->stacked : 0;
+	struct fsck_spindle *sp;
+	char name[PATH_MAX];
+	size_t i;
+
+	for (i = 0; i < nspindles; i++) {
+		if (spindles[i].devno == disk)
+			return i;
+	}
+
+	spindles = xrealloc(spindles, (nspindles + 1) * sizeof(*spindles));
+	sp = &spindles[nspindles];
+	memset(sp, 0, sizeof(*sp));
+
+	sp->devno = disk;
+	sp->nonrot = is_irrotational_disk(disk) ? 1 : 0;
+	if (blkid_devno_to_wholedisk(disk, name, sizeof(name), NULL) == 0)
+		sp->name = xstrdup(name);
+	else
+		xasprintf(&sp->name, "%u:%u", major(disk), minor(disk));
+
+	return nspindles++;
+}
+
+static void fs_add_spindle(struct fsck_fs_data *data, dev_t disk)
+{
+	size_t i, idx = get_spindle(disk);
+
+	for (i = 0; i < data->nspindles; i++) {
+		if (data->spindles[i] == idx)
+			return;
+	}
+	data->spindles = xrealloc(data->spindles,
+				(data->nspindles + 1) * sizeof(size_t));
+	data->spindles[data->nspindles++] = idx;
+}
+
+/* adds @disk or all whole disks below @disk if it is a stacked device */
+static void fs_add_spindles(struct fsck_fs_data *data, dev_t disk, int depth)
+{
+	DIR *dir;
+	struct dirent *dp;
+	char dirname[PATH_MAX];
+	int count = 0;
+
+	snprintf(dirname, sizeof(dirname),
+			"/sys/dev/block/%u:%u/slaves/",
+			major(disk), minor(disk));
+
+	if (depth < 8 && (dir = opendir(dirname))) {
+		while ((dp = readdir(dir)) != NULL) {
+			char path[NAME_MAX + sizeof("/dev")], buf[64];
+			unsigned int maj, min;
+			dev_t slave;
+			ssize_t sz;
+			int fd;
+
+			if (dp->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/dev", dp->d_name);
+			fd = openat(dirfd(dir), path, O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				continue;
+			sz = read_all(fd, buf, sizeof(buf) - 1);
+			close(fd);
+			if (sz <= 0)
+				continue;
+			buf[sz] = '\0';
+			if (sscanf(buf, "%u:%u", &maj, &min) != 2 ||
+			    blkid_devno_to_wholedisk(makedev(maj, min), NULL, 0, &slave) != 0)
+				continue;
+
+			fs_add_spindles(data, slave, depth + 1);
+			count++;
+		}
+		closedir(dir);
+	}
+
+	if (!count)
+		fs_add_spindle(data, disk);
+}
+
+/*
+ * Returns the number of physical disks below the filesystem, and the
+ * indexes to spindles[] by @idx. Returns 0 if the disks are unknown.
+ */
+static size_t fs_get_spindles(struct libmnt_fs *fs, size_t **idx)
+{
+	struct fsck_fs_data *data;
+	dev_t disk = fs_get_disk(fs, 1);
+
+	if (!disk)
+		return 0;
+
+	data = fs_create_data(fs);
+	if (!data->eval_spindles) {
+		data->eval_spindles = 1;
+		fs_add_spindles(data, disk, 0);
+	}
+	if (idx)
+		*idx = data->spindles;
+	return data->nspindles;
+}
+
+/* updates the disks statistics when the instance is started or finished */
+static void account_spindles(struct fsck_instance *inst, int start)
+{
+	size_t *idx, n, i;
+	struct timeval delta = { 0 };
+
+	n = fs_get_spindles(inst->fs, &idx);
+
+	if (!start && !noexecute)
+		timersub(&inst->end_time, &inst->start_time, &delta);
+
+	for (i = 0; i < n; i++) {
+		struct fsck_spindle *sp = &spindles[idx[i]];
+
+		if (start) {
+			sp->running++;
+			continue;
+		}
+		sp->running--;
+		sp->nchecks++;
+		timeradd(&sp->busy, &delta, &sp->busy);
+	}
 }
 
 static int fs_is_done(struct libmnt_fs *fs)
@@ -625,6 +787,137 @@ static void print_stats(struct fsck_instance *inst)
 			(int64_t)inst->rusage.ru_stime.tv_usec);
 }
 
+/*
+ * Print the number of checks and the time spent on each physical disk.
+ */
+static void print_spindle_stats(void)
+{
+	size_t i;
+
+	if (!report_stats || report_stats_file || noexecute)
+		return;
+
+	for (i = 0; i < nspindles; i++) {
+		struct fsck_spindle *sp = &spindles[i];
+
+		if (!sp->nchecks)
+			continue;
+		fprintf(stdout, "%s: %s, checks %d, real %"PRId64".%06"PRId64"\n",
+			sp->name,
+			sp->nonrot ? _("non-rotational") : _("rotational"),
+			sp->nchecks,
+			(int64_t)sp->busy.tv_sec, (int64_t)sp->busy.tv_usec);
+	}
+}
+
+/* remember statistics of the finished instance for --timings */
+static void add_timing(struct fsck_instance *inst)
+{
+	struct fsck_timing *t;
+	const char *tgt;
+
+	if (!timings || noexecute)
+		return;
+
+	timings_list = xrealloc(timings_list, (ntimings + 1) * sizeof(*timings_list));
+	t = &timings_list[ntimings++];
+	memset(t, 0, sizeof(*t));
+
+	t->device = xstrdup(fs_get_device(inst->fs));
+	tgt = mnt_fs_get_target(inst->fs);
+	t->target = tgt ? xstrdup(tgt) : NULL;
+	t->type = xstrdup(inst->type);
+	t->exit_status = inst->exit_status;
+	timersub(&inst->start_time, &fsck_start_time, &t->start);
+	timersub(&inst->end_time, &inst->start_time, &t->real);
+	memcpy(&t->rusage, &inst->rusage, sizeof(struct rusage));
+}
+
+static void timing_value_time(struct ul_jsonwrt *js, const char *name,
+			      const struct timeval *tv)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "%"PRId64".%06"PRId64,
+			(int64_t) tv->tv_sec, (int64_t) tv->tv_usec);
+	ul_jsonwrt_value_raw(js, name, buf);
+}
+
+/*
+ * Print JSON summary of all the checks and the physical disks. The blocks
+ * read and written by the checker are from the rusage (the same counters
+ * as read_bytes and write_bytes in /proc/<pid>/io), in bytes.
+ */
+static void print_timings(void)
+{
+	struct ul_jsonwrt js;
+	FILE *out = stdout;
+	size_t i;
+
+	if (!timings || noexecute)
+		return;
+
+	if (timings_path) {
+		out = fopen(timings_path, "w" UL_CLOEXECSTR);
+		if (!out) {
+			warn(_("cannot open %s"), timings_path);
+			return;
+		}
+	}
+
+	ul_jsonwrt_init(&js, out, 0);
+	ul_jsonwrt_root_open(&js);
+
+	ul_jsonwrt_array_open(&js, "checks");
+	for (i = 0; i < ntimings; i++) {
+		struct fsck_timing *t = &timings_list[i];
+
+		ul_jsonwrt_object_open(&js, NULL);
+		ul_jsonwrt_value_s(&js, "device", t->device);
+		if (t->target)
+			ul_jsonwrt_value_s(&js, "target", t->target);
+		else
+			ul_jsonwrt_value_null(&js, "target");
+		ul_jsonwrt_value_s(&js, "type", t->type);
+		ul_jsonwrt_value_u64(&js, "status", t->exit_status);
+		timing_value_time(&js, "start", &t->start);
+		timing_value_time(&js, "real", &t->real);
+		timing_value_time(&js, "user", &t->rusage.ru_utime);
+		timing_value_time(&js, "sys", &t->rusage.ru_stime);
+		ul_jsonwrt_value_u64(&js, "maxrss", t->rusage.ru_maxrss);
+		ul_jsonwrt_value_u64(&js, "read", (uint64_t) t->rusage.ru_inblock * 512);
+		ul_jsonwrt_value_u64(&js, "written", (uint64_t) t->rusage.ru_oublock * 512);
+		ul_jsonwrt_object_close(&js);
+	}
+	ul_jsonwrt_array_close(&js);
+
+	ul_jsonwrt_array_open(&js, "disks");
+	for (i = 0; i < nspindles; i++) {
+		struct fsck_spindle *sp = &spindles[i];
+
+		if (!sp->nchecks)
+			continue;
+		ul_jsonwrt_object_open(&js, NULL);
+		ul_jsonwrt_value_s(&js, "name", sp->name);
+		ul_jsonwrt_value_boolean(&js, "rotational", !sp->nonrot);
+		ul_jsonwrt_value_u64(&js, "checks", sp->nchecks);
+		timing_value_time(&js, "real", &sp->busy);
+		ul_jsonwrt_object_close(&js);
+	}
+	ul_jsonwrt_array_close(&js);
+
+	ul_jsonwrt_root_close(&js);
+
+	if (timings_path && close_stream(out) != 0)
+		warn(_("cannot write %s"), timings_path);
+}
+
+static void print_summary(void)
+{
+	print_spindle_stats();
+	print_timings();
+}
+
 /*
  * Execute a particular fsck program, and link it into the list of
  * child processes we are waiting for.
@@ -716,6 +1009,7 @@ static int execute(const char *progname, const char *progpath,
 	else
 		instance_list = inst;
 
+	account_spindles(inst, 1);
 	return 0;
 }
 
@@ -853,6 +1147,8 @@ ret_inst:
 		instance_list = inst->next;
 
 	print_stats(inst);
+	account_spindles(inst, 0);
+	add_timing(inst);
 
 	if (verbose > 1)
 		printf(_("Finished with %s (exit status %d)\n"),
@@ -1175,68 +1471,37 @@ static int ignore(struct libmnt_fs *fs)
 	return 0;
 }
 
-static int count_slaves(dev_t disk)
-{
-	DIR *dir;
-	struct dirent *dp;
-	char dirname[PATH_MAX];
-	int count = 0;
-
-	snprintf(dirname, sizeof(dirname),
-			"/sys/dev/block/%u:%u/slaves/",
-			major(disk), minor(disk));
-
-	if (!(dir = opendir(dirname)))
-		return -1;
-
-	while ((dp = readdir(dir)) != NULL) {
-#ifdef _DIRENT_HAVE_D_TYPE
-		if (dp->d_type != DT_UNKNOWN && dp->d_type != DT_LNK)
-			continue;
-#endif
-		if (dp->d_name[0] == '.' &&
-		    ((dp->d_name[1] == 0) ||
-		     ((dp->d_name[1] == '.') && (dp->d_name[2] == 0))))
-			continue;
-
-		count++;
-	}
-
-	closedir(dir);
-	return count;
-}
-
 /*
- * Returns TRUE if a partition on the same disk is already being
- * checked.
+ * Returns TRUE if a filesystem on the same rotational disk is already
+ * being checked.
  */
 static int disk_already_active(struct libmnt_fs *fs)
 {
 	struct fsck_instance *inst;
-	dev_t disk;
+	size_t *idx, n, i;
 
 	if (force_all_parallel)
 		return 0;
 
-	if (instance_list && fs_is_stacked(instance_list->fs))
-		/* any instance for a stacked device is already running */
-		return 1;
-
-	disk = fs_get_disk(fs, 1);
+	n = fs_get_spindles(fs, &idx);
 
 	/*
-	 * If we don't know the base device, assume that the device is
+	 * If we don't know the physical disks, assume that the device is
 	 * already active if there are any fsck instances running.
-	 *
-	 * Don't check a stacked device with any other disk too.
 	 */
-	if (!disk || fs_is_stacked(fs))
+	if (!n)
 		return (instance_list != NULL);
 
+	/* ... and the same for the running instances */
 	for (inst = instance_list; inst; inst = inst->next) {
-		dev_t idisk = fs_get_disk(inst->fs, 0);
+		if (!fs_get_spindles(inst->fs, NULL))
+			return 1;
+	}
 
-		if (!idisk || disk == idisk)
+	for (i = 0; i < n; i++) {
+		struct fsck_spindle *sp = &spindles[idx[i]];
+
+		if (sp->running && !sp->nonrot)
 			return 1;
 	}
 
@@ -1257,6 +1522,10 @@ static int check_all(void)
 	if (!itr)
 		err(FSCK_EX_ERROR, _("failed to allocate iterator"));
 
+	/* evaluate all LABEL=, UUID=, etc. at once, see fs_get_device() */
+	if (mntcache)
+		mnt_cache_resolve_tags(mntcache, fstab);
+
 	/*
 	 * Do an initial scan over the filesystem; mark filesystems
 	 * which should be ignored as done, and resolve any "auto"
@@ -1284,6 +1553,7 @@ static int check_all(void)
 				status |= fsck_device(fs, 1);
 				status |= wait_many(FLAG_WAIT_ALL);
 				if (status > FSCK_EX_NONDESTRUCT) {
+					print_summary();
 					mnt_free_iter(itr);
 					return status;
 				}
@@ -1379,6 +1649,7 @@ static int check_all(void)
 	}
 
 	status |= wait_many(FLAG_WAIT_ATLEAST_ONE);
+	print_summary();
 	mnt_free_iter(itr);
 	return status;
 }
@@ -1408,6 +1679,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -t <type>  specify filesystem types to be checked;\n"
 		"            <type> is allowed to be a comma-separated list\n"), out);
 	fputs(_(" -V         explain what is being done\n"), out);
+	fputs(_("     --timings[=<file>]\n"
+		"            print JSON summary of the checks times and I/O\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf( " -?, --help     %s\n", USAGE_OPTSTR_HELP);
@@ -1455,6 +1728,13 @@ static void parse_argv(int argc, char *argv[])
 			usage();
 		if (!opts_for_fsck && !strcmp(arg, "--version"))
 			print_version(FSCK_EX_OK);
+		if (!opts_for_fsck && !strncmp(arg, "--timings", 9)
+		    && (!arg[9] || arg[9] == '=')) {
+			timings = 1;
+			if (arg[9] == '=' && arg[10])
+				timings_path = arg + 10;
+			continue;
+		}
 
 		if ((arg[0] == '/' && !opts_for_fsck) || strchr(arg, '=')) {
 			if (num_devices >= MAX_DEVICES)
@@ -1629,6 +1909,7 @@ int main(int argc, char *argv[])
 	mntcache = mnt_new_cache();	/* no fatal error if failed */
 
 	parse_argv(argc, argv);
+	gettime_monotonic(&fsck_start_time);
 
 	if (!notitle)
 		printf(UTIL_LINUX_VERSION);
@@ -1687,6 +1968,7 @@ int main(int argc, char *argv[])
 		}
 	}
 	status |= wait_many(FLAG_WAIT_ALL);
+	print_summary();
 	free(fsck_path);
 	mnt_unref_cache(mntcache);
 	mnt_unref_table(fstab);
@@ -43,8 +43,10 @@
 #include <string.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <pthread.h>
 
-/* We don't use our include/crc32.h, but crc32 from zlib!
+/* The crc32 from zlib is used unless the CPU has CRC32 instructions, see
+ * cramfs_crc32().
  *
  * The zlib implementation performs pre/post-conditioning. The util-linux
  * imlemenation requires post-conditioning (xor) in the applications.
@@ -63,6 +65,8 @@
 #include "exitcodes.h"
 #include "strutils.h"
 #include "closestream.h"
+#include "all-io.h"
+#include "crc32.h"
 
 #define XALLOC_EXIT_CODE FSCK_EX_ERROR
 #include "xalloc.h"
@@ -74,6 +78,7 @@ static int cramfs_is_big_endian = 0;	/* source is big endian */
 static int opt_verbose = 0;	/* 1 = verbose (-v), 2+ = very verbose (-vv) */
 static int opt_extract = 0;	/* extract cramfs (-x) */
 static char *extract_dir = "";		/* optional extraction directory (-x) */
+static unsigned int jobs = 0;		/* decompression threads (-j), default online CPUs */
 
 #define PAD_SIZE 512
 
@@ -125,6 +130,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -y                       for compatibility only, ignored\n"), out);
 	fputs(_(" -b, --blocksize <size>   use this blocksize, defaults to page size\n"), out);
 	fputs(_("     --extract[=<dir>]    test uncompression, optionally extract into <dir>\n"), out);
+	fputs(_(" -j, --jobs <num>         number of decompression threads\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(26));
 
@@ -217,6 +223,17 @@ static void test_super(int *start, size_t * length)
 		warnx(_("old cramfs format"));
 }
 
+/*
+ * The zlib crc32() is faster than the portable ul_crc32() (slicing-by-8),
+ * our code is used only if the CPU has CRC32 instructions.
+ */
+static uint32_t cramfs_crc32(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	if (ul_crc32_has_hw())
+		return ~ul_crc32_hw(~crc, buf, len);
+	return crc32(crc, buf, len);
+}
+
 static void test_crc(int start)
 {
 	void *buf;
@@ -250,7 +267,7 @@ static void test_crc(int start)
 	if (buf != MAP_FAILED) {
 		((struct cramfs_super *)((unsigned char *) buf + start))->fsid.crc =
 		    crc32(0L, NULL, 0);
-		crc = crc32(crc, (unsigned char *) buf + start, super.size - start);
+		crc = cramfs_crc32(crc, (unsigned char *) buf + start, super.size - start);
 		munmap(buf, super.size);
 	} else {
 		int retval;
@@ -270,12 +287,12 @@ static void test_crc(int start)
 				    crc32(0L, NULL, 0);
 			length += retval;
 			if (length > (super.size - start)) {
-				crc = crc32(crc, buf,
+				crc = cramfs_crc32(crc, buf,
 					  retval - (length -
 						    (super.size - start)));
 				break;
 			}
-			crc = crc32(crc, buf, retval);
+			crc = cramfs_crc32(crc, buf, retval);
 		}
 		free(buf);
 	}
@@ -444,6 +461,365 @@ static void change_file_status(char *path, struct cramfs_inode *i)
 		err(FSCK_EX_ERROR, _("utimes failed: %s"), path);
 }
 
+/*
+ * Parallel decompression
+ *
+ * The inode tree is walked first, the regular files are only recorded by
+ * do_file(). The symbolic links are recorded too, because chown() follows the
+ * link and the target may be a file extracted later. The files are split to jobs of up to UNCOMPRESS_JOB_BLOCKS
+ * blocks, the jobs are decompressed by worker threads from the mmap-ed image
+ * and write_files() (the main thread) checks and writes them in the original
+ * order. The workers are at most UNCOMPRESS_AHEAD jobs per thread ahead of
+ * the writer, so the memory use does not depend on the image size.
+ */
+#define UNCOMPRESS_JOB_BLOCKS	64
+#define UNCOMPRESS_AHEAD	4
+
+enum {
+	UNCOMPRESS_OK = 0,
+	UNCOMPRESS_TOO_LARGE,		/* data block too large */
+	UNCOMPRESS_ZERROR,		/* inflate() failed */
+	UNCOMPRESS_NON_BLOCK,		/* full block expected */
+	UNCOMPRESS_NON_SIZE		/* the rest of the file expected */
+};
+
+struct uncompress_file {
+	char		*path;
+	char		*target;	/* symbolic link or NULL */
+	struct cramfs_inode inode;
+	unsigned long	offset;		/* of the block pointers */
+};
+
+struct uncompress_job {
+	size_t		file;		/* index to files[] */
+	unsigned long	first;		/* first block */
+	unsigned long	nblocks;
+	unsigned char	*data;		/* uncompressed blocks */
+	size_t		len;		/* valid data in data[] */
+	unsigned long	end_data;	/* the highest block pointer */
+
+	int		error;		/* UNCOMPRESS_* */
+	int		zerr;		/* for UNCOMPRESS_ZERROR */
+	unsigned long	out, size;	/* for UNCOMPRESS_NON_* */
+
+	unsigned int	done : 1;
+};
+
+struct uncompress_queue {
+	unsigned char	*image;		/* mmap-ed image */
+	size_t		length;
+
+	struct uncompress_file *files;
+	size_t		nfiles;
+	size_t		files_alloc;
+
+	struct uncompress_job *jobs;
+	size_t		njobs;
+	size_t		jobs_alloc;
+	size_t		next;		/* next job to uncompress */
+	size_t		written;	/* next job to write */
+	size_t		window;		/* max. jobs uncompressed ahead */
+
+	pthread_t	*threads;
+	size_t		nthreads;
+	pthread_mutex_t	lock;
+	pthread_cond_t	done_cond;	/* signaled when a job is done */
+	pthread_cond_t	space_cond;	/* signaled when a job is written */
+};
+
+static struct uncompress_queue *queue;
+
+/* data out of the image are zeros, the same as beyond EOF for read() */
+static void image_read(struct uncompress_queue *q, void *buf,
+		       unsigned long offset, size_t len)
+{
+	size_t n = 0;
+
+	if (offset < q->length)
+		n = min(len, q->length - offset);
+	if (n)
+		memcpy(buf, q->image + offset, n);
+	if (n < len)
+		memset((char *) buf + n, 0, len - n);
+}
+
+static struct uncompress_file *add_uncompress_file(struct uncompress_queue *q,
+				char *path, struct cramfs_inode *i, unsigned long offset)
+{
+	struct uncompress_file *f;
+	unsigned long blocks, first;
+
+	if (q->nfiles == q->files_alloc) {
+		q->files_alloc = q->files_alloc ? q->files_alloc * 2 : 1024;
+		q->files = xrealloc(q->files, q->files_alloc * sizeof(*f));
+	}
+	f = &q->files[q->nfiles];
+	f->path = xstrdup(path);
+	f->target = NULL;
+	f->inode = *i;
+	f->offset = offset;
+
+	blocks = S_ISREG(i->mode) ? (i->size + blksize - 1) / blksize : 0;
+	for (first = 0; first < blocks; first += UNCOMPRESS_JOB_BLOCKS) {
+		struct uncompress_job *job;
+
+		if (q->njobs == q->jobs_alloc) {
+			q->jobs_alloc = q->jobs_alloc ? q->jobs_alloc * 2 : 1024;
+			q->jobs = xrealloc(q->jobs, q->jobs_alloc * sizeof(*job));
+		}
+		job = &q->jobs[q->njobs++];
+		memset(job, 0, sizeof(*job));
+		job->file = q->nfiles;
+		job->first = first;
+		job->nblocks = min(blocks - first, (unsigned long) UNCOMPRESS_JOB_BLOCKS);
+	}
+	return &q->files[q->nfiles++];
+}
+
+/* The same checks as do_uncompress(), the result is reported by write_files(). */
+static void uncompress_job(struct uncompress_queue *q, struct uncompress_job *job,
+			   z_stream *zs, unsigned char *inbuf)
+{
+	struct uncompress_file *f = &q->files[job->file];
+	unsigned long blocks = (f->inode.size + blksize - 1) / blksize;
+	unsigned long size = f->inode.size - job->first * blksize;
+	unsigned long offset = f->offset + 4 * job->first;
+	unsigned long curr, b;
+	uint32_t ptr;
+
+	job->data = xmalloc((job->nblocks + 1) * blksize);
+
+	if (job->first) {
+		image_read(q, &ptr, offset - 4, sizeof(ptr));
+		curr = u32_toggle_endianness(cramfs_is_big_endian, ptr);
+	} else
+		curr = f->offset + 4 * blocks;
+
+	for (b = 0; b < job->nblocks; b++) {
+		unsigned long out = blksize, next;
+		unsigned char *dest = job->data + job->len;
+
+		image_read(q, &ptr, offset, sizeof(ptr));
+		next = u32_toggle_endianness(cramfs_is_big_endian, ptr);
+		if (next > job->end_data)
+			job->end_data = next;
+		offset += 4;
+
+		if (curr == next) {
+			if (size < blksize)
+				out = size;
+			memset(dest, 0x00, out);
+		} else {
+			int err;
+
+			if (next - curr > blksize * 2) {
+				job->error = UNCOMPRESS_TOO_LARGE;
+				return;
+			}
+			image_read(q, inbuf, curr, next - curr);
+
+			zs->next_in = inbuf;
+			zs->avail_in = next - curr;
+			zs->next_out = dest;
+			zs->avail_out = blksize * 2;
+			inflateReset(zs);
+
+			err = inflate(zs, Z_FINISH);
+			if (err != Z_STREAM_END) {
+				job->error = UNCOMPRESS_ZERROR;
+				job->zerr = err;
+				return;
+			}
+			out = zs->total_out;
+		}
+		if (size >= blksize ? out != blksize : out != size) {
+			job->error = size >= blksize ? UNCOMPRESS_NON_BLOCK :
+						       UNCOMPRESS_NON_SIZE;
+			job->out = out;
+			job->size = size;
+			return;
+		}
+		size -= out;
+		job->len += out;
+		curr = next;
+	}
+}
+
+static void *uncompress_worker(void *data)
+{
+	struct uncompress_queue *q = data;
+	unsigned char *inbuf = xmalloc(blksize * 2);
+	z_stream zs = { .next_in = NULL };
+
+	inflateInit(&zs);
+
+	for (;;) {
+		struct uncompress_job *job;
+
+		pthread_mutex_lock(&q->lock);
+		while (q->next < q->njobs && q->next >= q->written + q->window)
+			pthread_cond_wait(&q->space_cond, &q->lock);
+		if (q->next >= q->njobs) {
+			pthread_mutex_unlock(&q->lock);
+			break;
+		}
+		job = &q->jobs[q->next++];
+		pthread_mutex_unlock(&q->lock);
+
+		uncompress_job(q, job, &zs, inbuf);
+
+		pthread_mutex_lock(&q->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&q->done_cond);
+		pthread_mutex_unlock(&q->lock);
+	}
+
+	inflateEnd(&zs);
+	free(inbuf);
+	return NULL;
+}
+
+static struct uncompress_queue *new_uncompress_queue(size_t length)
+{
+	struct uncompress_queue *q;
+	void *image;
+
+	/* the workers need the image without romfs_read() */
+	image = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED)
+		return NULL;
+
+	q = xcalloc(1, sizeof(*q));
+	q->image = image;
+	q->length = length;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->done_cond, NULL);
+	pthread_cond_init(&q->space_cond, NULL);
+	return q;
+}
+
+static void start_uncompress(struct uncompress_queue *q, size_t nthreads)
+{
+	if (nthreads > q->njobs)
+		nthreads = q->njobs;
+
+	q->window = nthreads * UNCOMPRESS_AHEAD;
+	q->threads = xcalloc(nthreads ? nthreads : 1, sizeof(pthread_t));
+	for (; q->nthreads < nthreads; q->nthreads++) {
+		if (pthread_create(&q->threads[q->nthreads], NULL,
+				   uncompress_worker, q) != 0)
+			break;
+	}
+	if (!q->nthreads) {
+		/* no thread, write_files() does not wait */
+		q->window = q->njobs;
+		uncompress_worker(q);
+	}
+}
+
+static struct uncompress_job *wait_uncompress_job(struct uncompress_queue *q,
+						  size_t i)
+{
+	struct uncompress_job *job = &q->jobs[i];
+
+	pthread_mutex_lock(&q->lock);
+	while (!job->done)
+		pthread_cond_wait(&q->done_cond, &q->lock);
+	pthread_mutex_unlock(&q->lock);
+	return job;
+}
+
+static void write_job(struct uncompress_file *f, int outfd,
+		      struct uncompress_job *job)
+{
+	if (job->end_data > end_data)
+		end_data = job->end_data;
+
+	if (*extract_dir != '\0' && job->len
+	    && write_all(outfd, job->data, job->len) != 0)
+		err(FSCK_EX_ERROR, _("write failed: %s"), f->path);
+
+	switch (job->error) {
+	case UNCOMPRESS_TOO_LARGE:
+		errx(FSCK_EX_UNCORRECTED, _("data block too large"));
+	case UNCOMPRESS_ZERROR:
+		errx(FSCK_EX_UNCORRECTED, _("decompression error: %s"),
+		     zError(job->zerr));
+	case UNCOMPRESS_NON_BLOCK:
+		errx(FSCK_EX_UNCORRECTED,
+		     _("non-block (%ld) bytes"), job->out);
+	case UNCOMPRESS_NON_SIZE:
+		errx(FSCK_EX_UNCORRECTED,
+		     _("non-size (%ld vs %ld) bytes"), job->out,
+		     job->size);
+	default:
+		break;
+	}
+}
+
+/*
+ * The second half of do_file() and do_symlink(), the files are written in the
+ * walk order.
+ */
+static void write_files(struct uncompress_queue *q)
+{
+	size_t i, j = 0;
+
+	for (i = 0; i < q->nfiles; i++) {
+		struct uncompress_file *f = &q->files[i];
+		int outfd = 0;
+
+		if (f->target) {
+			if (symlink(f->target, f->path) < 0)
+				err(FSCK_EX_ERROR, _("symlink failed: %s"), f->path);
+			change_file_status(f->path, &f->inode);
+			continue;
+		}
+		if (*extract_dir != '\0') {
+			outfd = open(f->path, O_WRONLY | O_CREAT | O_TRUNC, f->inode.mode);
+			if (outfd < 0)
+				err(FSCK_EX_ERROR, _("cannot open %s"), f->path);
+		}
+		for (; j < q->njobs && q->jobs[j].file == i; j++) {
+			struct uncompress_job *job = wait_uncompress_job(q, j);
+
+			write_job(f, outfd, job);
+			free(job->data);
+			job->data = NULL;
+
+			pthread_mutex_lock(&q->lock);
+			q->written = j + 1;
+			pthread_cond_broadcast(&q->space_cond);
+			pthread_mutex_unlock(&q->lock);
+		}
+		if (*extract_dir != '\0') {
+			if (close_fd(outfd) != 0)
+				err(FSCK_EX_ERROR, _("write failed: %s"), f->path);
+			change_file_status(f->path, &f->inode);
+		}
+	}
+}
+
+static void free_uncompress_queue(struct uncompress_queue *q)
+{
+	size_t i;
+
+	for (i = 0; i < q->nthreads; i++)
+		pthread_join(q->threads[i], NULL);
+	for (i = 0; i < q->nfiles; i++) {
+		free(q->files[i].path);
+		free(q->files[i].target);
+	}
+	free(q->threads);
+	free(q->files);
+	free(q->jobs);
+	munmap(q->image, q->length);
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->done_cond);
+	pthread_cond_destroy(&q->space_cond);
+	free(q);
+}
+
 static void do_directory(char *path, struct cramfs_inode *i)
 {
 	int pathlen = strlen(path);
@@ -515,6 +891,11 @@ static void do_file(char *path, struct cramfs_inode *i)
 		start_data = offset;
 	if (opt_verbose)
 		print_node('f', i, path);
+	if (queue) {
+		/* uncompressed and written by write_files() */
+		add_uncompress_file(queue, path, i, offset);
+		return;
+	}
 	if (*extract_dir != '\0') {
 		outfd = open(path, O_WRONLY | O_CREAT | O_TRUNC, i->mode);
 		if (outfd < 0)
@@ -562,7 +943,10 @@ static void do_symlink(char *path, struct cramfs_inode *i)
 			       curr, next, next - curr);
 		free(str);
 	}
-	if (*extract_dir != '\0') {
+	if (*extract_dir != '\0' && queue) {
+		/* created by write_files() */
+		add_uncompress_file(queue, path, i, offset)->target = xstrdup(outbuffer);
+	} else if (*extract_dir != '\0') {
 		if (symlink(outbuffer, path) < 0)
 			err(FSCK_EX_ERROR, _("symlink failed: %s"), path);
 		change_file_status(path, i);
@@ -622,7 +1006,7 @@ static void expand_fs(char *path, struct cramfs_inode *inode)
 		do_special_inode(path, inode);
 }
 
-static void test_fs(int start)
+static void test_fs(int start, size_t length)
 {
 	struct cramfs_inode *root;
 
@@ -632,7 +1016,19 @@ static void test_fs(int start)
 	stream.next_in = NULL;
 	stream.avail_in = 0;
 	inflateInit(&stream);
+
+	/* -vv prints the blocks in the tree walk order */
+	if (jobs > 1 && opt_verbose < 2)
+		queue = new_uncompress_queue(length);
+
 	expand_fs(extract_dir, root);
+
+	if (queue) {
+		start_uncompress(queue, jobs);
+		write_files(queue);
+		free_uncompress_queue(queue);
+		queue = NULL;
+	}
 	inflateEnd(&stream);
 	if (start_data != ~0UL) {
 		if (start_data < (sizeof(struct cramfs_super) + start))
@@ -662,6 +1058,7 @@ int main(int argc, char **argv)
 		{"help",      no_argument,       NULL, 'h'},
 		{"blocksize", required_argument, NULL, 'b'},
 		{"extract",   optional_argument, NULL, 'x'},
+		{"jobs",      required_argument, NULL, 'j'},
 		{NULL, 0, NULL, 0},
 	};
 
@@ -674,7 +1071,7 @@ int main(int argc, char **argv)
 	strutils_set_exitcode(FSCK_EX_USAGE);
 
 	/* command line options */
-	while ((c = getopt_long(argc, argv, "ayvVhb:", longopts, NULL)) != EOF)
+	while ((c = getopt_long(argc, argv, "ayvVhb:j:", longopts, NULL)) != EOF)
 		switch (c) {
 		case 'a':		/* ignore */
 		case 'y':
@@ -695,6 +1092,9 @@ int main(int argc, char **argv)
 		case 'b':
 			blksize = strtou32_or_err(optarg, _("invalid blocksize argument"));
 			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		default:
 			errtryhelp(FSCK_EX_USAGE);
 		}
@@ -721,9 +1121,15 @@ int main(int argc, char **argv)
 			rombufbits++;
 		rombufmask = rombufsize - 1;
 
+		if (jobs == 0) {
+			long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+			jobs = ncpus > 0 ? ncpus : 1;
+		}
+
 		outbuffer = xmalloc(blksize * 2);
 		read_buffer = xmalloc(rombufsize * 2);
-		test_fs(start);
+		test_fs(start, length);
 	}
 
 	if (opt_verbose)
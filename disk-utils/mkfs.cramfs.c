@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <string.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <zconf.h>
 
 /* We don't use our include/crc32.h, but crc32 from zlib!
@@ -66,6 +67,7 @@ static unsigned int blksize = 0; /* settable via -b option, default page size */
 static long total_blocks = 0, total_nodes = 1; /* pre-count the root node */
 static int image_length = 0;
 static int cramfs_is_big_endian = 0; /* target is big endian */
+static unsigned int jobs = 0; /* settable via -j option, default online CPUs */
 
 /*
  * If opt_holes is set, then mkcramfs can create explicit holes in the
@@ -125,7 +127,7 @@ struct entry {
 static void __attribute__((__noreturn__)) usage(void)
 {
 	fputs(USAGE_HEADER, stdout);
-	printf(_(" %s [-h] [-v] [-b blksize] [-e edition] [-N endian] [-i file] [-n name] dirname outfile\n"),
+	printf(_(" %s [-h] [-v] [-b blksize] [-e edition] [-N endian] [-i file] [-n name] [-j jobs] dirname outfile\n"),
 		program_invocation_short_name);
 	fputs(USAGE_SEPARATOR, stdout);
 	puts(_("Make compressed ROM file system."));
@@ -137,6 +139,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	printf(_(" -N endian      set cramfs endianness (%s|%s|%s), default %s\n"), "big", "little", "host", "host");
 	puts(_(  " -i file        insert a file image into the filesystem"));
 	puts(_(  " -n name        set name of cramfs filesystem"));
+	puts(_(  " -j jobs        number of compression threads"));
 	printf(_(" -p             pad by %d bytes for boot code\n"), PAD_SIZE);
 	puts(_(  " -s             sort directory entries (old option, ignored)"));
 	puts(_(  " -z             make explicit holes"));
@@ -244,38 +247,101 @@ identical_file(struct entry *e1, struct entry *e2){
  */
 #define MAX_INPUT_NAMELEN 255
 
-static int find_identical_file(struct entry *orig, struct entry *new, loff_t *fslen_ub)
+/*
+ * Duplicate files are found by sorting all files by size, the MD5 sums are
+ * computed only for the files with the same size. The files with the same
+ * size and MD5 are compared and the duplicate points to the first identical
+ * file in the tree order.
+ */
+struct dupfile {
+	struct entry *entry;
+	size_t order;		/* in the tree */
+};
+
+static size_t collect_files(struct entry *e, struct dupfile **files,
+			    size_t nfiles, size_t *nalloc)
 {
-	if (orig == new)
-		return 1;
-	if (!orig)
-		return 0;
-	if (orig->size == new->size && orig->path) {
-		if (!orig->flags)
-			mdfile(orig);
-		if (!new->flags)
-			mdfile(new);
-
-		if ((orig->flags & CRAMFS_EFLAG_MD5) &&
-		    (new->flags & CRAMFS_EFLAG_MD5) &&
-		    !memcmp(orig->md5sum, new->md5sum, UL_MD5LENGTH) &&
-		    identical_file(orig, new)) {
-			new->same = orig;
-			*fslen_ub -= new->size;
-			return 1;
+	for (; e; e = e->next) {
+		if (e->size && e->path) {
+			if (nfiles == *nalloc) {
+				*nalloc = *nalloc ? *nalloc * 2 : 1024;
+				*files = xrealloc(*files, *nalloc * sizeof(struct dupfile));
+			}
+			(*files)[nfiles].entry = e;
+			(*files)[nfiles].order = nfiles;
+			nfiles++;
 		}
+		nfiles = collect_files(e->child, files, nfiles, nalloc);
 	}
-	return find_identical_file(orig->child, new, fslen_ub) ||
-		   find_identical_file(orig->next, new, fslen_ub);
+	return nfiles;
+}
+
+static int cmp_dupfiles(const void *a0, const void *b0)
+{
+	const struct dupfile *a = a0, *b = b0;
+	int rc = cmp_numbers(a->entry->size, b->entry->size);
+
+	/* MD5 is available (or invalid) for all the files of the same size */
+	if (!rc)
+		rc = cmp_numbers(a->entry->flags, b->entry->flags);
+	if (!rc && (a->entry->flags & CRAMFS_EFLAG_MD5))
+		rc = memcmp(a->entry->md5sum, b->entry->md5sum, UL_MD5LENGTH);
+	if (!rc)
+		rc = cmp_numbers(a->order, b->order);
+	return rc;
 }
 
-static void eliminate_doubles(struct entry *root, struct entry *orig, loff_t *fslen_ub) {
-	if (orig) {
-		if (orig->size && orig->path)
-			find_identical_file(root,orig, fslen_ub);
-		eliminate_doubles(root,orig->child, fslen_ub);
-		eliminate_doubles(root,orig->next, fslen_ub);
+static void eliminate_doubles(struct entry *root, loff_t *fslen_ub)
+{
+	struct dupfile *files = NULL;
+	size_t nfiles, nalloc = 0, i, j;
+
+	nfiles = collect_files(root, &files, 0, &nalloc);
+	if (nfiles < 2)
+		goto done;
+
+	/* sort by size and compute MD5 for the files with the same size */
+	qsort(files, nfiles, sizeof(struct dupfile), cmp_dupfiles);
+	for (i = 0; i < nfiles; i = j) {
+		for (j = i + 1; j < nfiles
+		     && files[j].entry->size == files[i].entry->size; j++)
+			;
+		if (j - i > 1) {
+			size_t k;
+
+			for (k = i; k < j; k++)
+				mdfile(files[k].entry);
+		}
+	}
+
+	/* sort by size, MD5 and order; the first of the group is the original */
+	qsort(files, nfiles, sizeof(struct dupfile), cmp_dupfiles);
+	for (i = 0; i < nfiles; i = j) {
+		struct entry *orig = files[i].entry;
+
+		for (j = i + 1; j < nfiles; j++) {
+			struct entry *new = files[j].entry;
+			size_t k;
+
+			if (!(orig->flags & CRAMFS_EFLAG_MD5)
+			    || new->size != orig->size
+			    || new->flags != orig->flags
+			    || memcmp(new->md5sum, orig->md5sum, UL_MD5LENGTH) != 0)
+				break;
+
+			/* the same MD5 almost certainly means the same content */
+			for (k = i; k < j; k++) {
+				if (!files[k].entry->same
+				    && identical_file(files[k].entry, new)) {
+					new->same = files[k].entry;
+					*fslen_ub -= new->size;
+					break;
+				}
+			}
+		}
 	}
+done:
+	free(files);
 }
 
 /*
@@ -554,6 +620,45 @@ static int is_zero(unsigned char const *begin, unsigned len)
 	return 0;
 }
 
+/* Returns size of the compressed block, 0 for a hole. */
+static uLongf compress_block(Bytef *dest, const Bytef *src, uLongf input)
+{
+	uLongf len = 2 * blksize;
+
+	if (is_zero(src, input))
+		return 0;
+
+	compress(dest, &len, src, input);
+	if (len > blksize*2) {
+		/* (I don't think this can happen with zlib.) */
+		printf(_("AIEEE: block \"compressed\" to > "
+			 "2*blocklength (%ld)\n"),
+		       len);
+		exit(MKFS_EX_ERROR);
+	}
+	return len;
+}
+
+static unsigned int finish_compress(unsigned char const *name,
+			unsigned long original_offset,
+			unsigned long original_size, unsigned long curr)
+{
+	unsigned long new_size;
+	long change;
+
+	curr = (curr + 3) & ~3;
+	new_size = curr - original_offset;
+	/* TODO: Arguably, original_size in these 2 lines should be
+	   st_blocks * 512.  But if you say that, then perhaps
+	   administrative data should also be included in both. */
+	change = new_size - original_size;
+	if (verbose)
+		printf(_("%6.2f%% (%+ld bytes)\t%s\n"),
+		       (change * 100) / (double) original_size, change, name);
+
+	return curr;
+}
+
 /*
  * One 4-byte pointer per block and then the actual blocked
  * output. The first block does not need an offset pointer,
@@ -568,8 +673,7 @@ static unsigned int
 do_compress(char *base, unsigned int offset, unsigned char const *name,
 	    char *path, unsigned int size, unsigned int mode)
 {
-	unsigned long original_size, original_offset, new_size, blocks, curr;
-	long change;
+	unsigned long original_size, original_offset, blocks, curr;
 	char *start;
 	Bytef *p;
 
@@ -587,44 +691,221 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
 	total_blocks += blocks;
 
 	do {
-		uLongf len = 2 * blksize;
+		uLongf len;
 		uLongf input = size;
 		if (input > blksize)
 			input = blksize;
 		size -= input;
-		if (!is_zero (p, input)) {
-			compress((Bytef *)(base + curr), &len, p, input);
-			curr += len;
-		}
+		len = compress_block((Bytef *)(base + curr), p, input);
+		curr += len;
 		p += input;
 
-		if (len > blksize*2) {
-			/* (I don't think this can happen with zlib.) */
-			printf(_("AIEEE: block \"compressed\" to > "
-				 "2*blocklength (%ld)\n"),
-			       len);
-			exit(MKFS_EX_ERROR);
-		}
-
 		*(uint32_t *) (base + offset) = u32_toggle_endianness(cramfs_is_big_endian, curr);
 		offset += 4;
 	} while (size);
 
 	do_munmap(start, original_size, mode);
 
-	curr = (curr + 3) & ~3;
-	new_size = curr - original_offset;
-	/* TODO: Arguably, original_size in these 2 lines should be
-	   st_blocks * 512.  But if you say that, then perhaps
-	   administrative data should also be included in both. */
-	change = new_size - original_size;
-	if (verbose)
-		printf(_("%6.2f%% (%+ld bytes)\t%s\n"),
-		       (change * 100) / (double) original_size, change, name);
+	return finish_compress(name, original_offset, original_size, curr);
+}
 
-	return curr;
+
+/*
+ * Parallel compression
+ *
+ * The files are split to jobs of up to COMPRESS_JOB_BLOCKS blocks, the jobs
+ * are compressed by worker threads to private buffers and write_data() (the
+ * main thread) copies them to the image in the original order.
+ */
+#define COMPRESS_JOB_BLOCKS	64
+
+struct compress_job {
+	struct entry	*entry;
+	unsigned int	first;		/* first block */
+	unsigned int	nblocks;
+	unsigned char	*data;		/* compressed blocks */
+	uLongf		*lens;		/* per block, 0 for a hole */
+
+	unsigned int	done : 1,
+			failed : 1;	/* cannot read the file */
+};
+
+struct compress_queue {
+	struct compress_job *jobs;
+	size_t		njobs;
+	size_t		next;		/* next job to compress, atomic */
+	size_t		written;	/* next job to write */
+
+	pthread_t	*threads;
+	size_t		nthreads;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;		/* signaled when a job is done */
+};
+
+static size_t add_compress_jobs(struct compress_queue *q, struct entry *entry,
+				size_t nalloc)
+{
+	struct entry *e;
+
+	for (e = entry; e; e = e->next) {
+		if (e->path && !e->same && e->size) {
+			unsigned int blocks = (e->size - 1) / blksize + 1, first;
+
+			for (first = 0; first < blocks; first += COMPRESS_JOB_BLOCKS) {
+				struct compress_job *job;
+
+				if (q->njobs == nalloc) {
+					nalloc = nalloc ? nalloc * 2 : 1024;
+					q->jobs = xrealloc(q->jobs, nalloc * sizeof(*job));
+				}
+				job = &q->jobs[q->njobs++];
+				memset(job, 0, sizeof(*job));
+				job->entry = e;
+				job->first = first;
+				job->nblocks = min(blocks - first, (unsigned int) COMPRESS_JOB_BLOCKS);
+			}
+		} else if (!e->path && e->child)
+			nalloc = add_compress_jobs(q, e->child, nalloc);
+	}
+	return nalloc;
+}
+
+static void compress_job(struct compress_job *job)
+{
+	struct entry *e = job->entry;
+	unsigned long pos = (unsigned long) job->first * blksize;
+	unsigned long size = e->size - pos, used = 0;
+	char *start;
+	unsigned int i;
+
+	start = do_mmap(e->path, e->size, e->mode);
+	if (!start) {
+		job->failed = 1;
+		return;
+	}
+
+	job->data = xmalloc((size_t) job->nblocks * 2 * blksize);
+	job->lens = xmalloc(job->nblocks * sizeof(uLongf));
+
+	for (i = 0; i < job->nblocks; i++) {
+		uLongf input = min(size, (unsigned long) blksize);
+
+		job->lens[i] = compress_block(job->data + used,
+					(Bytef *) start + pos, input);
+		used += job->lens[i];
+		pos += input;
+		size -= input;
+	}
+
+	do_munmap(start, e->size, e->mode);
+}
+
+static void *compress_worker(void *data)
+{
+	struct compress_queue *q = data;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->njobs) {
+		struct compress_job *job = &q->jobs[i];
+
+		compress_job(job);
+
+		pthread_mutex_lock(&q->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&q->cond);
+		pthread_mutex_unlock(&q->lock);
+	}
+	return NULL;
+}
+
+static void start_compress(struct compress_queue *q, struct entry *root,
+			   size_t nthreads)
+{
+	memset(q, 0, sizeof(*q));
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->cond, NULL);
+
+	add_compress_jobs(q, root, 0);
+	if (nthreads > q->njobs)
+		nthreads = q->njobs;
+
+	q->threads = xcalloc(nthreads ? nthreads : 1, sizeof(pthread_t));
+	for (; q->nthreads < nthreads; q->nthreads++) {
+		if (pthread_create(&q->threads[q->nthreads], NULL,
+				   compress_worker, q) != 0)
+			break;
+	}
+	if (!q->nthreads)
+		compress_worker(q);	/* no thread, do it now */
+}
+
+static void finish_compress_queue(struct compress_queue *q)
+{
+	size_t i;
+
+	for (i = 0; i < q->nthreads; i++)
+		pthread_join(q->threads[i], NULL);
+	free(q->threads);
+	free(q->jobs);
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->cond);
+}
+
+static struct compress_job *wait_compress_job(struct compress_queue *q, size_t i)
+{
+	struct compress_job *job = &q->jobs[i];
+
+	pthread_mutex_lock(&q->lock);
+	while (!job->done)
+		pthread_cond_wait(&q->cond, &q->lock);
+	pthread_mutex_unlock(&q->lock);
+	return job;
 }
 
+/* The same as do_compress(), but the data are compressed by the workers. */
+static unsigned int
+write_compressed(struct compress_queue *q, struct entry *e, char *base,
+		 unsigned int offset)
+{
+	unsigned long original_offset = offset, curr;
+	unsigned int blocks = (e->size - 1) / blksize + 1;
+	size_t first = q->written, end, i;
+	int failed = 0;
+
+	/* all jobs of the file have to be done to know if the file is readable */
+	for (end = first; end < q->njobs && q->jobs[end].entry == e; end++)
+		failed |= wait_compress_job(q, end)->failed;
+	q->written = end;
+
+	if (!failed) {
+		curr = offset + 4 * blocks;
+		total_blocks += blocks;
+
+		for (i = first; i < end; i++) {
+			struct compress_job *job = &q->jobs[i];
+			unsigned long used = 0;
+			unsigned int b;
+
+			for (b = 0; b < job->nblocks; b++) {
+				memcpy(base + curr, job->data + used, job->lens[b]);
+				used += job->lens[b];
+				curr += job->lens[b];
+
+				*(uint32_t *) (base + offset) = u32_toggle_endianness(cramfs_is_big_endian, curr);
+				offset += 4;
+			}
+		}
+	}
+
+	for (i = first; i < end; i++) {
+		free(q->jobs[i].data);
+		free(q->jobs[i].lens);
+	}
+
+	if (failed)
+		return original_offset;
+	return finish_compress(e->name, original_offset, e->size, curr);
+}
 
 /*
  * Traverse the entry tree, writing data for every item that has
@@ -632,7 +913,8 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
  * regfile).
  */
 static unsigned int
-write_data(struct entry *entry, char *base, unsigned int offset) {
+write_data(struct entry *entry, char *base, unsigned int offset,
+	   struct compress_queue *q) {
 	struct entry *e;
 
 	for (e = entry; e; e = e->next) {
@@ -643,11 +925,14 @@ write_data(struct entry *entry, char *base, unsigned int offset) {
 			} else if (e->size) {
 				set_data_offset(e, base, offset);
 				e->offset = offset;
-				offset = do_compress(base, offset, e->name,
+				if (q)
+					offset = write_compressed(q, e, base, offset);
+				else
+					offset = do_compress(base, offset, e->name,
 						     e->path, e->size,e->mode);
 			}
 		} else if (e->child)
-			offset = write_data(e->child, base, offset);
+			offset = write_data(e->child, base, offset, q);
 	}
 	return offset;
 }
@@ -730,7 +1015,7 @@ int main(int argc, char **argv)
 	strutils_set_exitcode(MKFS_EX_USAGE);
 
 	/* command line options */
-	while ((c = getopt(argc, argv, "hb:Ee:i:n:N:psVvz")) != EOF) {
+	while ((c = getopt(argc, argv, "hb:Ee:i:j:n:N:psVvz")) != EOF) {
 		switch (c) {
 		case 'h':
 			usage();
@@ -761,6 +1046,9 @@ int main(int argc, char **argv)
 			image_length = st.st_size; /* may be padded later */
 			fslen_ub += (image_length + 3); /* 3 is for padding */
 			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case 'n':
 			opt_name = optarg;
 			break;
@@ -793,6 +1081,11 @@ int main(int argc, char **argv)
 
 	if (blksize == 0)
 		blksize = getpagesize();
+	if (jobs == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		jobs = ncpus > 0 ? ncpus : 1;
+	}
 
 	if (stat(dirname, &st) < 0)
 		err(MKFS_EX_USAGE, _("stat of %s failed"), dirname);
@@ -808,7 +1101,7 @@ int main(int argc, char **argv)
 	root_entry->size = parse_directory(root_entry, dirname, &root_entry->child, &fslen_ub);
 
 	/* find duplicate files */
-	eliminate_doubles(root_entry,root_entry, &fslen_ub);
+	eliminate_doubles(root_entry, &fslen_ub);
 
 	/* always allocate a multiple of blksize bytes because that's
 	   what we're going to write later on */
@@ -860,7 +1153,14 @@ int main(int argc, char **argv)
 	if (verbose)
 		printf(_("Directory data: %zd bytes\n"), offset);
 
-	offset = write_data(root_entry, rom_image, offset);
+	if (jobs > 1) {
+		struct compress_queue q;
+
+		start_compress(&q, root_entry, jobs);
+		offset = write_data(root_entry, rom_image, offset, &q);
+		finish_compress_queue(&q);
+	} else
+		offset = write_data(root_entry, rom_image, offset, NULL);
 
 	/* We always write a multiple of blksize bytes, so that
 	   losetup works. */
@@ -42,6 +42,7 @@
 #include "closestream.h"
 #include "ismounted.h"
 #include "optutils.h"
+#include "jobs.h"
 
 #ifdef HAVE_LIBUUID
 # include <uuid.h>
@@ -53,6 +54,10 @@
 
 #define MIN_GOODPAGES	10
 
+/* check_blocks() reads by O_DIRECT in large chunks from more threads */
+#define CHECK_CHUNK_SIZE	(8 * 1024 * 1024)
+#define CHECK_MAX_JOBS		8
+
 #define SELINUX_SWAPFILE_TYPE	"swapfile_t"
 
 struct mkswap_control {
@@ -75,7 +80,10 @@ struct mkswap_control {
 
 	size_t			nbad_extents;
 
+	unsigned long long	filesz;		/* --size */
+
 	unsigned int		check:1,	/* --check */
+				file:1,		/* --file */
 				verbose:1,      /* --verbose */
 				quiet:1,        /* --quiet */
 				force:1;	/* --force */
@@ -167,6 +175,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -c, --check               check bad blocks before creating the swap area\n"), out);
 	fputs(_(" -f, --force               allow swap size area be larger than device\n"), out);
+	fputs(_(" -F, --file                create or preallocate a swap file\n"), out);
+	fputs(_(" -s, --size SIZE           size of the swap file (with --file)\n"), out);
 	fputs(_(" -q, --quiet               suppress output and warning messages\n"), out);
 	fputs(_(" -p, --pagesize SIZE       specify page size in bytes\n"), out);
 	fputs(_(" -L, --label LABEL         specify label\n"), out);
@@ -195,40 +205,111 @@ static void page_bad(struct mkswap_control *ctl, unsigned int page)
 	ctl->nbadpages++;
 }
 
+struct check_blocks {
+	int		fd;		/* O_DIRECT if possible */
+	size_t		chunksz;	/* multiple of the page size */
+	uint64_t	size;		/* bytes to check */
+
+	size_t		nchunks;
+	size_t		next;		/* next chunk to read */
+	unsigned char	*failed;	/* per chunk, read error */
+};
+
+static void *check_blocks_worker(void *data)
+{
+	struct check_blocks *cb = data;
+	void *buf = NULL;
+	size_t i;
+
+	if (posix_memalign(&buf, getpagesize(), cb->chunksz) != 0)
+		errx(EXIT_FAILURE, _("cannot allocate %zu bytes"), cb->chunksz);
+
+	while ((i = __atomic_fetch_add(&cb->next, 1, __ATOMIC_RELAXED)) < cb->nchunks) {
+		uint64_t off = (uint64_t) i * cb->chunksz;
+		size_t len = min((uint64_t) cb->chunksz, cb->size - off), done = 0;
+
+		while (done < len) {
+			ssize_t rc = pread(cb->fd, (char *) buf + done,
+					   len - done, off + done);
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+			done += rc;
+		}
+		if (done < len)
+			cb->failed[i] = 1;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+/*
+ * The whole area is read in large chunks by more threads, the chunks with
+ * a read error are read again page by page to find the bad pages. The
+ * O_DIRECT reads bypass the page cache, the area is usually much larger
+ * than the memory.
+ */
 static void check_blocks(struct mkswap_control *ctl)
 {
-	unsigned int current_page = 0;
-	int do_seek = 1;
+	struct check_blocks cb = { .chunksz = CHECK_CHUNK_SIZE };
+	size_t i, jobs;
+	long ncpus;
 	char *buffer;
 
 	assert(ctl);
 	assert(ctl->fd > -1);
 
+	if (cb.chunksz < (size_t) ctl->pagesize)
+		cb.chunksz = ctl->pagesize;
+	cb.size = ctl->npages * ctl->pagesize;
+	cb.nchunks = (cb.size + cb.chunksz - 1) / cb.chunksz;
+	cb.failed = xcalloc(cb.nchunks, 1);
+
+	cb.fd = open(ctl->devname, O_RDONLY | O_DIRECT | O_CLOEXEC);
+	if (cb.fd < 0)
+		cb.fd = ctl->fd;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	jobs = ncpus > 0 ? (size_t) ncpus : 1;
+	jobs = min(jobs, (size_t) CHECK_MAX_JOBS);
+	jobs = min(jobs, cb.nchunks);
+
+	ul_run_jobs(jobs, check_blocks_worker, &cb, 0);
+
+	if (cb.fd != ctl->fd)
+		close(cb.fd);
+
 	buffer = xmalloc(ctl->pagesize);
-	while (current_page < ctl->npages) {
-		ssize_t rc;
-		off_t offset = (off_t) current_page * ctl->pagesize;
-
-		if (do_seek && lseek(ctl->fd, offset, SEEK_SET) != offset)
-			errx(EXIT_FAILURE, _("seek failed in check_blocks"));
-
-		rc = read(ctl->fd, buffer, ctl->pagesize);
-		do_seek = (rc < 0 || rc != ctl->pagesize);
-		if (do_seek)
-			page_bad(ctl, current_page);
-		current_page++;
+	for (i = 0; i < cb.nchunks; i++) {
+		unsigned int page, end;
+
+		if (!cb.failed[i])
+			continue;
+
+		page = (uint64_t) i * cb.chunksz / ctl->pagesize;
+		end = min((uint64_t) (i + 1) * cb.chunksz, cb.size) / ctl->pagesize;
+
+		for (; page < end; page++) {
+			off_t offset = (off_t) page * ctl->pagesize;
+
+			if (pread(ctl->fd, buffer, ctl->pagesize, offset) != ctl->pagesize)
+				page_bad(ctl, page);
+		}
 	}
 
 	if (!ctl->quiet)
 		printf(P_("%lu bad page\n", "%lu bad pages\n", ctl->nbadpages), ctl->nbadpages);
 	free(buffer);
+	free(cb.failed);
 }
 
 
 #ifdef HAVE_LINUX_FIEMAP_H
 static void warn_extent(struct mkswap_control *ctl, const char *msg, uint64_t off)
 {
-	if (ctl->nbad_extents == 0) {
+	if (!ctl->quiet && ctl->nbad_extents == 0) {
 		fputc('\n', stderr);
 		fprintf(stderr, _(
 
@@ -243,7 +324,7 @@ static void warn_extent(struct mkswap_control *ctl, const char *msg, uint64_t of
 	"        Use --verbose for more details.\n"));
 
 	}
-	if (ctl->verbose) {
+	if (!ctl->quiet && ctl->verbose) {
 		fputs(" - ", stderr);
 		fprintf(stderr, msg, off);
 		fputc('\n', stderr);
@@ -309,11 +390,85 @@ static void check_extents(struct mkswap_control *ctl)
 		warn_extent(ctl, _("hole detected at offset %ju"),
 				(uintmax_t) last_logical);
 done:
-	if (ctl->nbad_extents)
+	if (ctl->nbad_extents && !ctl->quiet)
 		fputc('\n', stderr);
 }
+
+/* btrfs swap files have to be NOCOW, the flag works for empty files only */
+static void set_nocow(int fd)
+{
+	int attr;
+
+	if (ioctl(fd, FS_IOC_GETFLAGS, &attr) == 0 && !(attr & FS_NOCOW_FL)) {
+		attr |= FS_NOCOW_FL;
+		ignore_result( ioctl(fd, FS_IOC_SETFLAGS, &attr) );
+	}
+}
 #endif /* HAVE_LINUX_FIEMAP_H */
 
+/*
+ * --file: creates the file if it does not exist and allocates all its blocks
+ * by fallocate(), so there are no holes. The extents are validated later by
+ * check_extents().
+ */
+static void create_swap_file(struct mkswap_control *ctl)
+{
+	struct stat st;
+	int fd, rc;
+
+	fd = open(ctl->devname, O_RDWR | O_CLOEXEC | (ctl->filesz ? O_CREAT : 0), 0600);
+	if (fd < 0 && errno == ENOENT && !ctl->filesz)
+		errx(EXIT_FAILURE, _("%s: swap file size not specified"), ctl->devname);
+	if (fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->devname);
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat of %s failed"), ctl->devname);
+	if (!S_ISREG(st.st_mode))
+		errx(EXIT_FAILURE, _("%s: not a regular file"), ctl->devname);
+
+	if (!ctl->filesz) {
+		if (st.st_size == 0)
+			errx(EXIT_FAILURE, _("%s: swap file size not specified"),
+					ctl->devname);
+		ctl->filesz = st.st_size;
+	}
+
+#ifdef HAVE_LINUX_FIEMAP_H
+	if (st.st_size == 0)
+		set_nocow(fd);
+#endif
+	if ((unsigned long long) st.st_size > ctl->filesz
+	    && ftruncate(fd, ctl->filesz) != 0)
+		err(EXIT_FAILURE, _("%s: cannot truncate"), ctl->devname);
+
+#ifdef HAVE_POSIX_FALLOCATE
+	rc = posix_fallocate(fd, 0, ctl->filesz);
+	if (rc) {
+		errno = rc;
+		err(EXIT_FAILURE, _("%s: cannot allocate %llu bytes"),
+				ctl->devname, ctl->filesz);
+	}
+#else
+	{
+		char *buf = xcalloc(1, CHECK_CHUNK_SIZE);
+		unsigned long long off;
+
+		for (off = 0; off < ctl->filesz; off += CHECK_CHUNK_SIZE) {
+			size_t sz = min(ctl->filesz - off, (unsigned long long) CHECK_CHUNK_SIZE);
+
+			if (lseek(fd, off, SEEK_SET) != (off_t) off
+			    || write_all(fd, buf, sz) != 0)
+				err(EXIT_FAILURE, _("%s: cannot allocate %llu bytes"),
+						ctl->devname, ctl->filesz);
+		}
+		free(buf);
+	}
+#endif
+	rc = close_fd(fd);
+	if (rc != 0)
+		err(EXIT_FAILURE, _("write failed"));
+}
+
 /* return size in pages */
 static unsigned long long get_size(const struct mkswap_control *ctl)
 {
@@ -474,6 +629,8 @@ int main(int argc, char **argv)
 	static const struct option longopts[] = {
 		{ "check",       no_argument,       NULL, 'c' },
 		{ "force",       no_argument,       NULL, 'f' },
+		{ "file",        no_argument,       NULL, 'F' },
+		{ "size",        required_argument, NULL, 's' },
 		{ "quiet",       no_argument,       NULL, 'q' },
 		{ "pagesize",    required_argument, NULL, 'p' },
 		{ "label",       required_argument, NULL, 'L' },
@@ -497,7 +654,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while((c = getopt_long(argc, argv, "cfp:qL:v:U:Vh", longopts, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "cfFp:qL:s:v:U:Vh", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -508,6 +665,12 @@ int main(int argc, char **argv)
 		case 'f':
 			ctl.force = 1;
 			break;
+		case 'F':
+			ctl.file = 1;
+			break;
+		case 's':
+			ctl.filesz = strtosize_or_err(optarg, _("invalid size argument"));
+			break;
 		case 'p':
 			ctl.user_pagesize = strtou32_or_err(optarg, _("parsing page size failed"));
 			break;
@@ -560,6 +723,10 @@ int main(int argc, char **argv)
 		warnx(_("only one device argument is currently supported"));
 		errtryhelp(EXIT_FAILURE);
 	}
+	if (ctl.filesz && !ctl.file) {
+		warnx(_("--size requires --file"));
+		errtryhelp(EXIT_FAILURE);
+	}
 
 #ifdef HAVE_LIBUUID
 	if(opt_uuid) {
@@ -582,6 +749,8 @@ int main(int argc, char **argv)
 		warnx(_("error: Nowhere to set up swap on?"));
 		errtryhelp(EXIT_FAILURE);
 	}
+	if (ctl.file)
+		create_swap_file(&ctl);
 	if (block_count) {
 		/* this silly user specified the number of blocks explicitly */
 		uint64_t blks = strtou64_or_err(block_count,
@@ -630,8 +799,11 @@ int main(int argc, char **argv)
 	if (ctl.check)
 		check_blocks(&ctl);
 #ifdef HAVE_LINUX_FIEMAP_H
-	if (!ctl.quiet && S_ISREG(ctl.devstat.st_mode))
+	if ((!ctl.quiet || ctl.file) && S_ISREG(ctl.devstat.st_mode))
 		check_extents(&ctl);
+	if (ctl.file && ctl.nbad_extents)
+		errx(EXIT_FAILURE, _("%s: the swap file contains unsupported extents"),
+				ctl.devname);
 #endif
 
 	wipe_device(&ctl);
@@ -268,6 +268,106 @@ dflt:
 	return SLICES_MAX;
 }
 
+/* partition as known by kernel, see get_kernel_parts() */
+struct kernel_part {
+	uintmax_t start;
+	uintmax_t size;
+	unsigned int used : 1,
+		     removed : 1;	/* by upd_parts() */
+};
+
+static int read_sysfs_number(int dirfd, const char *name, const char *attr,
+			     uintmax_t *res)
+{
+	char path[PATH_MAX];
+	FILE *f;
+	int fd, rc = -1;
+
+	snprintf(path, sizeof(path), "%s/%s", name, attr);
+
+	fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	f = fdopen(fd, "r");
+	if (!f) {
+		close(fd);
+		return -1;
+	}
+	if (fscanf(f, "%ju", res) == 1)
+		rc = 0;
+	fclose(f);
+	return rc;
+}
+
+/*
+ * Returns array indexed by partition number with start and size (in 512-byte
+ * sectors) of the partitions in /sys, or NULL if /sys is not available.
+ */
+static struct kernel_part *get_kernel_parts(const char *disk, dev_t devno,
+					    int *maxpartno)
+{
+	char path[PATH_MAX], *parent;
+	struct kernel_part *kp;
+	struct stat st;
+	struct dirent *d;
+	DIR *dir;
+	int nalloc = SLICES_MAX + 1;
+
+	*maxpartno = 0;
+
+	if (!devno && !stat(disk, &st))
+		devno = st.st_rdev;
+	if (!devno)
+		return NULL;
+	parent = strrchr(disk, '/');
+	if (!parent)
+		return NULL;
+	parent++;
+
+	snprintf(path, sizeof(path), _PATH_SYS_DEVBLOCK "/%d:%d/",
+			major(devno), minor(devno));
+
+	dir = opendir(path);
+	if (!dir)
+		return NULL;
+
+	kp = xcalloc(nalloc, sizeof(*kp));
+
+	while ((d = readdir(dir))) {
+		uintmax_t partno, start, size;
+
+		if (!strcmp(d->d_name, ".") ||
+		    !strcmp(d->d_name, ".."))
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+			continue;
+#endif
+		if (strncmp(parent, d->d_name, strlen(parent)) != 0)
+			continue;
+		if (read_sysfs_number(dirfd(dir), d->d_name, "partition", &partno) != 0
+		    || partno == 0 || partno > INT_MAX
+		    || read_sysfs_number(dirfd(dir), d->d_name, "start", &start) != 0
+		    || read_sysfs_number(dirfd(dir), d->d_name, "size", &size) != 0)
+			continue;
+
+		if (partno >= (uintmax_t) nalloc) {
+			int old = nalloc;
+
+			nalloc = partno + 1;
+			kp = xrealloc(kp, nalloc * sizeof(*kp));
+			memset(kp + old, 0, (nalloc - old) * sizeof(*kp));
+		}
+		kp[partno].start = start;
+		kp[partno].size = size;
+		kp[partno].used = 1;
+		*maxpartno = max(*maxpartno, (int) partno);
+	}
+
+	closedir(dir);
+	return kp;
+}
+
 static int recount_range_by_pt(blkid_partlist ls, int *lower, int *upper)
 {
 	int n = 0, i, nparts = blkid_partlist_numof_partitions(ls);
@@ -450,24 +550,47 @@ static void upd_parts_warnx(const char *device, int first, int last)
 				device, first, last);
 }
 
+/* merges failed partitions to ranges, see upd_parts_warnx() */
+static void upd_parts_record_error(const char *device, int n,
+				   int *errfirst, int *errlast)
+{
+	if (!*errfirst)
+		*errlast = *errfirst = n;
+	else if (*errlast + 1 == n)
+		(*errlast)++;
+	else {
+		upd_parts_warnx(device, *errfirst, *errlast);
+		*errlast = *errfirst = n;
+	}
+}
+
+/*
+ * The partitions are compared with the kernel view in /sys and only the
+ * necessary BLKPG operations are called: unchanged partitions are skipped,
+ * partitions with the same start are resized, partitions not on disk are
+ * removed. Without /sys all the partitions are re-added.
+ */
 static int upd_parts(int fd, const char *device, dev_t devno,
 		     blkid_partlist ls, int lower, int upper)
 {
-	int n, nparts, rc = 0, errfirst = 0, errlast = 0, err;
+	int n, nparts, rc = 0, errfirst = 0, errlast = 0, err, kmax = 0;
 	blkid_partition par;
 	uintmax_t start, size;
+	struct kernel_part *kparts;
 
 	assert(fd >= 0);
 	assert(device);
 	assert(ls);
 
+	kparts = get_kernel_parts(device, devno, &kmax);
+
 	/* recount range by information in /sys, if on disk number of
 	 * partitions is greater than in /sys the use on-disk limit */
 	nparts = blkid_partlist_numof_partitions(ls);
 	if (!lower)
 		lower = 1;
 	if (!upper || lower < 0 || upper < 0) {
-		n = get_max_partno(device, devno);
+		n = kparts ? kmax : SLICES_MAX;
 		if (!upper)
 			upper = n > nparts ? n : nparts;
 		else if (upper < 0)
@@ -478,13 +601,45 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 	if (lower > upper) {
 		warnx(_("specified range <%d:%d> "
 			"does not make sense"), lower, upper);
+		free(kparts);
 		return -1;
 	}
 
+	/*
+	 * Remove partitions which are not on disk or which have been moved
+	 * first, the new or enlarged partitions may overlap with them.
+	 */
+	for (n = lower; kparts && n <= upper && n <= kmax; n++) {
+		if (!kparts[n].used)
+			continue;
+		par = blkid_partlist_get_partition_by_partno(ls, n);
+		if (par && (uintmax_t) blkid_partition_get_start(par)
+							== kparts[n].start)
+			continue;
+
+		if (partx_del_partition(fd, n) == 0) {
+			kparts[n].used = 0;
+			kparts[n].removed = 1;
+			if (verbose)
+				printf(_("%s: partition #%d removed\n"), device, n);
+			continue;
+		}
+		if (par)
+			continue;	/* moved, try again below */
+
+		rc = -1;
+		if (verbose)
+			warn(_("%s: updating partition #%d failed"), device, n);
+		upd_parts_record_error(device, n, &errfirst, &errlast);
+	}
+
 	for (n = lower; n <= upper; n++) {
+		struct kernel_part *kp = kparts && n <= kmax && kparts[n].used ?
+						&kparts[n] : NULL;
+
 		par = blkid_partlist_get_partition_by_partno(ls, n);
 		if (!par) {
-			if (verbose)
+			if (verbose && !(kparts && n <= kmax && kparts[n].removed))
 				warn(_("%s: no partition #%d"), device, n);
 			continue;
 		}
@@ -498,10 +653,23 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 			 */
 			size = min(size, (uintmax_t) 2);
 
-		err = partx_del_partition(fd, n);
-		if (err == -1 && errno == ENXIO)
-			err = 0; /* good, it already doesn't exist */
-		if (err == -1 && errno == EBUSY)
+		if (kp && kp->start == start && kp->size == size) {
+			if (verbose)
+				printf(_("%s: partition #%d unchanged\n"), device, n);
+			continue;
+		}
+		if (kparts && !kp) {
+			/* not in kernel (or removed above) */
+			if (partx_add_partition(fd, n, start, size) == 0) {
+				if (verbose)
+					printf(_("%s: partition #%d added\n"), device, n);
+				continue;
+			}
+			goto failed;
+		}
+
+		err = kp ? -1 : partx_del_partition(fd, n);
+		if (err == -1 && (kp || errno == EBUSY))
 		{
 			/* try to resize */
 			err = partx_resize_partition(fd, n, start, size);
@@ -510,6 +678,8 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 			if (err == 0)
 				continue;
 		}
+		if (err == -1 && errno == ENXIO)
+			err = 0; /* good, it already doesn't exist */
 		if (err == 0 && partx_add_partition(fd, n, start, size) == 0) {
 			if (verbose)
 				printf(_("%s: partition #%d added\n"), device, n);
@@ -518,21 +688,16 @@ static int upd_parts(int fd, const char *device, dev_t devno,
 
 		if (err == 0)
 			continue;
+failed:
 		rc = -1;
 		if (verbose)
 			warn(_("%s: updating partition #%d failed"), device, n);
-		if (!errfirst)
-			errlast = errfirst = n;
-		else if (errlast + 1 == n)
-			errlast++;
-		else {
-			upd_parts_warnx(device, errfirst, errlast);
-			errlast = errfirst = n;
-		}
+		upd_parts_record_error(device, n, &errfirst, &errlast);
 	}
 
 	if (errfirst)
 		upd_parts_warnx(device, errfirst, errlast);
+	free(kparts);
 	return rc;
 }
 
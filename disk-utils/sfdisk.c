@@ -37,7 +37,9 @@
 # include <readline/readline.h>
 #endif
 #include <libgen.h>
+#include <signal.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -106,6 +108,8 @@ struct sfdisk {
 
 	struct fdisk_context	*cxt;		/* libfdisk context */
 	struct fdisk_partition  *orig_pa;	/* -N <partno> before the change */
+	struct fdisk_table	*orig_tb;	/* --batch: partitions before the change */
+	size_t			jobs;		/* --batch --jobs <num> */
 
 	unsigned int verify : 1,	/* call fdisk_verify_disklabel() */
 		     quiet  : 1,	/* suppress extra messages */
@@ -120,6 +124,7 @@ struct sfdisk {
 		     movedata: 1,	/* move data after resize */
 		     movefsync: 1,	/* use fsync() after each write() */
 		     notell : 1,	/* don't tell kernel aout new PT */
+		     batch  : 1,	/* apply the script to more devices */
 		     noact  : 1;	/* do not write to device */
 };
 
@@ -259,6 +264,7 @@ static int sfdisk_deinit(struct sfdisk *sf)
 	}
 
 	fdisk_unref_context(sf->cxt);
+	fdisk_unref_table(sf->orig_tb);
 	free(sf->prompt);
 
 	memset(sf, 0, sizeof(*sf));
@@ -659,7 +665,10 @@ static int write_changes(struct sfdisk *sf)
 
 	if (!sf->noact && !rc) {
 		fdisk_info(sf->cxt, _("\nThe partition table has been altered."));
-		if (!sf->notell) {
+		if (!sf->notell && sf->orig_tb) {
+			/* --batch, BLKPG for the modified partitions only */
+			fdisk_reread_changes(sf->cxt, sf->orig_tb);
+		} else if (!sf->notell) {
 			/* Let's wait a little bit. It's possible that our
 			 * system is still busy with a previous re-read
 			 * ioctl (on sfdisk start) or with another task
@@ -670,9 +679,10 @@ static int write_changes(struct sfdisk *sf)
 		}
 	}
 
+	/* --batch calls sync() only once for all the devices */
 	if (!rc)
 		rc = fdisk_deassign_device(sf->cxt,
-				sf->noact || sf->notell);	/* no-sync */
+				sf->noact || sf->notell || sf->batch);	/* no-sync */
 	return rc;
 }
 
@@ -683,14 +693,11 @@ static int command_list_partitions(struct sfdisk *sf, int argc, char **argv)
 {
 	int fail = 0;
 	fdisk_enable_listonly(sf->cxt, 1);
+	set_list_jobs(sf->jobs);
 
-	if (argc) {
-		int i;
-
-		for (i = 0; i < argc; i++)
-			if (print_device_pt(sf->cxt, argv[i], 1, sf->verify, i) != 0)
-				fail++;
-	} else
+	if (argc)
+		fail = print_devices_pt(sf->cxt, argv, argc, 1, sf->verify);
+	else
 		print_all_devices_pt(sf->cxt, sf->verify);
 
 	return fail;
@@ -703,14 +710,11 @@ static int command_list_freespace(struct sfdisk *sf, int argc, char **argv)
 {
 	int fail = 0;
 	fdisk_enable_listonly(sf->cxt, 1);
+	set_list_jobs(sf->jobs);
 
-	if (argc) {
-		int i;
-
-		for (i = 0; i < argc; i++)
-			if (print_device_freespace(sf->cxt, argv[i], 1, i) != 0)
-				fail++;
-	} else
+	if (argc)
+		fail = print_devices_freespace(sf->cxt, argv, argc, 1);
+	else
 		print_all_devices_freespace(sf->cxt);
 
 	return fail;
@@ -1755,6 +1759,14 @@ static int command_fdisk(struct sfdisk *sf, int argc, char **argv)
 
 	assign_device(sf, devname, 0);
 
+	/* --batch, remember the original layout for fdisk_reread_changes() */
+	if (sf->batch && !sf->noact && !sf->notell
+	    && (!fdisk_has_label(sf->cxt)
+		|| fdisk_get_partitions(sf->cxt, &sf->orig_tb) != 0)) {
+		fdisk_unref_table(sf->orig_tb);
+		sf->orig_tb = fdisk_new_table();
+	}
+
 	dp = fdisk_new_script(sf->cxt);
 	if (!dp)
 		err(EXIT_FAILURE, _("failed to allocate script handler"));
@@ -2030,6 +2042,183 @@ static int command_fdisk(struct sfdisk *sf, int argc, char **argv)
 	return rc;
 }
 
+/*
+ * sfdisk --batch [--jobs <num>] <dev> ...
+ *
+ * The script from stdin is applied to all the devices, every device by a
+ * child process. The output of the children is collected in temporary files
+ * and printed in order of the devices when all is done.
+ */
+struct sfdisk_batch_dev {
+	const char	*name;
+	FILE		*out;		/* output of the child */
+	pid_t		pid;
+	int		status;		/* from waitpid() */
+	int		lockfd;		/* locked by the parent or -1 */
+};
+
+static char *read_script(size_t *sz)
+{
+	size_t bufsz = BUFSIZ;
+	char *buf = xmalloc(bufsz);
+	ssize_t rc;
+
+	*sz = 0;
+	while ((rc = read_all(STDIN_FILENO, buf + *sz, bufsz - *sz)) > 0) {
+		*sz += rc;
+		if (*sz < bufsz)
+			break;		/* EOF */
+		bufsz *= 2;
+		buf = xrealloc(buf, bufsz);
+	}
+	if (rc < 0)
+		err(EXIT_FAILURE, _("cannot read script"));
+	return buf;
+}
+
+static pid_t batch_start(struct sfdisk *sf, struct sfdisk_batch_dev *dev,
+			 const char *script, size_t scriptsz)
+{
+	int pipefd[2];
+	pid_t pid;
+
+	dev->out = tmpfile();
+	if (!dev->out)
+		err(EXIT_FAILURE, _("cannot create temporary file"));
+	if (pipe(pipefd) != 0)
+		err(EXIT_FAILURE, _("cannot create pipe"));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, _("fork failed"));
+	if (pid == 0) {
+		char *devname = (char *) dev->name;
+
+		close(pipefd[1]);
+		if (dup2(pipefd[0], STDIN_FILENO) < 0
+		    || dup2(fileno(dev->out), STDOUT_FILENO) < 0
+		    || dup2(fileno(dev->out), STDERR_FILENO) < 0)
+			_exit(EXIT_FAILURE);
+		close(pipefd[0]);
+
+		sf->interactive = 0;
+		if (dev->lockfd >= 0)
+			sf->lockmode = "no";	/* already locked by parent */
+
+		exit(command_fdisk(sf, 1, &devname) == 0 ?
+				EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(pipefd[0]);
+	write_all(pipefd[1], script, scriptsz);	/* EPIPE if child failed */
+	close(pipefd[1]);
+
+	return pid;
+}
+
+static int command_batch(struct sfdisk *sf, int argc, char **argv)
+{
+	struct sfdisk_batch_dev *devs;
+	char *script;
+	size_t scriptsz, i, next = 0, running = 0, jobs = sf->jobs;
+	int rc = 0;
+
+	if (!argc)
+		errx(EXIT_FAILURE, _("no disk device specified"));
+	if (sf->partno >= 0 || sf->movedata)
+		errx(EXIT_FAILURE, _("--batch cannot be used with -N or --move-data"));
+
+	script = read_script(&scriptsz);
+	devs = xcalloc(argc, sizeof(*devs));
+
+	for (i = 0; i < (size_t) argc; i++) {
+		devs[i].name = argv[i];
+		devs[i].lockfd = -1;
+
+		/*
+		 * Lock all the devices by the parent for all the time, so
+		 * udevd does not process the devices until all is done.
+		 */
+		if (sf->lockmode && !sf->noact) {
+			devs[i].lockfd = open(argv[i], O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+			if (devs[i].lockfd < 0)
+				err(EXIT_FAILURE, _("cannot open %s"), argv[i]);
+			if (blkdev_lock(devs[i].lockfd, argv[i], sf->lockmode) != 0)
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (!jobs) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = n > 0 ? (size_t) n : 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	while (next < (size_t) argc || running) {
+		int status;
+		pid_t pid;
+
+		if (next < (size_t) argc && running < jobs) {
+			devs[next].pid = batch_start(sf, &devs[next], script, scriptsz);
+			next++;
+			running++;
+			continue;
+		}
+
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, _("waitpid failed"));
+		}
+		for (i = 0; i < next; i++) {
+			if (devs[i].pid == pid) {
+				devs[i].status = status;
+				running--;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < (size_t) argc; i++) {
+		struct sfdisk_batch_dev *dev = &devs[i];
+		char buf[BUFSIZ];
+		size_t n;
+
+		fflush(stdout);
+		rewind(dev->out);
+		while ((n = fread(buf, 1, sizeof(buf), dev->out)) > 0)
+			fwrite(buf, 1, n, stdout);
+		fclose(dev->out);
+
+		if (!WIFEXITED(dev->status) || WEXITSTATUS(dev->status) != 0) {
+			fflush(stdout);
+			warnx(_("%s: failed to apply the script"), dev->name);
+			rc = -EINVAL;
+		}
+	}
+
+	if (!sf->noact && !sf->notell) {
+		if (!sf->quiet)
+			fputs(_("Syncing disks.\n"), stdout);
+		sync();
+	}
+
+	/* unlock after sync(), udevd sees the final state */
+	for (i = 0; i < (size_t) argc; i++) {
+		if (devs[i].lockfd >= 0)
+			close(devs[i].lockfd);
+	}
+
+	free(devs);
+	free(script);
+	return rc;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -2037,6 +2226,7 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fprintf(out,
 	      _(" %1$s [options] <dev> [[-N] <part>]\n"
+		" %1$s [options] --batch <dev> ...\n"
 		" %1$s [options] <command>\n"), program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -2074,6 +2264,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -a, --append              append partitions to existing partition table\n"), out);
 	fputs(_(" -b, --backup              backup partition table sectors (see -O)\n"), out);
+	fputs(_("     --batch               apply the script from stdin to all specified devices\n"), out);
 	fputs(_("     --bytes               print SIZE in bytes rather than in human readable format\n"), out);
 	fputs(_("     --move-data[=<typescript>] move partition data after relocation (requires -N)\n"), out);
 	fputs(_("     --move-use-fsync      use fsync after each write when move data\n"), out);
@@ -2083,6 +2274,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	      _("     --color[=<when>]      colorize output (%s, %s or %s)\n"), "auto", "always", "never");
 	fprintf(out,
 	        "                             %s\n", USAGE_COLORS_DEFAULT);
+	fputs(_("     --jobs <num>          number of devices to list or modify (--batch) in parallel\n"), out);
 	fprintf(out,
 	      _("     --lock[=<mode>]       use exclusive device lock (%s, %s or %s)\n"), "yes", "no", "nonblock");
 	fputs(_(" -N, --partno <num>        specify partition number\n"), out);
@@ -2144,6 +2336,8 @@ int main(int argc, char *argv[])
 		OPT_NOTELL,
 		OPT_RELOCATE,
 		OPT_LOCK,
+		OPT_BATCH,
+		OPT_JOBS,
 	};
 
 	static const struct option longopts[] = {
@@ -2152,6 +2346,8 @@ int main(int argc, char *argv[])
 		{ "backup-pt-sectors", no_argument,   NULL, 'B' },
 		{ "backup",  no_argument,       NULL, 'b' },
 		{ "backup-file", required_argument, NULL, 'O' },
+		{ "batch",   no_argument,       NULL, OPT_BATCH },
+		{ "jobs",    required_argument, NULL, OPT_JOBS },
 		{ "bytes",   no_argument,	NULL, OPT_BYTES },
 		{ "color",   optional_argument, NULL, OPT_COLOR },
 		{ "lock",    optional_argument, NULL, OPT_LOCK },
@@ -2364,6 +2560,12 @@ int main(int argc, char *argv[])
 		case OPT_RELOCATE:
 			sf->act = ACT_RELOCATE;
 			break;
+		case OPT_BATCH:
+			sf->batch = 1;
+			break;
+		case OPT_JOBS:
+			sf->jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case OPT_LOCK:
 			sf->lockmode = "1";
 			if (optarg) {
@@ -2393,6 +2595,8 @@ int main(int argc, char *argv[])
 
 	if (sf->movedata && !(sf->act == ACT_FDISK && sf->partno >= 0))
 		errx(EXIT_FAILURE, _("--movedata requires -N"));
+	if (sf->batch && sf->act != ACT_FDISK)
+		errx(EXIT_FAILURE, _("--batch cannot be combined with other commands"));
 
 	switch (sf->act) {
 	case ACT_ACTIVATE:
@@ -2420,7 +2624,10 @@ int main(int argc, char *argv[])
 		break;
 
 	case ACT_FDISK:
-		rc = command_fdisk(sf, argc - optind, argv + optind);
+		if (sf->batch)
+			rc = command_batch(sf, argc - optind, argv + optind);
+		else
+			rc = command_fdisk(sf, argc - optind, argv + optind);
 		break;
 
 	case ACT_DUMP:
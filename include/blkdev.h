@@ -64,6 +64,16 @@
 #  define BLKDISCARDZEROES _IO(0x12,124)
 # endif
 
+/* zero a range of the device, introduced in 3.7 */
+# ifndef BLKZEROOUT
+#  define BLKZEROOUT _IO(0x12,127)
+# endif
+
+/* disk sequence number, introduced in 5.15 (commit 7957d93b) */
+# ifndef BLKGETDISKSEQ
+#  define BLKGETDISKSEQ _IOR(0x12,128,__u64)
+# endif
+
 /* filesystem freeze, introduced in 2.6.29 (commit fcccf502) */
 # ifndef FIFREEZE
 #  define FIFREEZE   _IOWR('X', 119, int)    /* Freeze */
@@ -0,0 +1,49 @@
+/*
+ * Definitions used by the blkidd daemon and libblkid
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * The blkidd protocol.
+ *
+ * Client:
+ * | operation type (1 byte) | data length (4 bytes) | data (NAME=value) |
+ *
+ * Server:
+ * | reply length (4 bytes) | reply (NUL terminated string) |
+ *
+ * The reply length is zero when the tag has not been found, and -errno when
+ * the request has been refused (INVALIDATE is allowed for root only).
+ *
+ * EVALUATE_ALL data is a list of NUL terminated NAME=value tags, the reply is
+ * a list of NUL terminated device names in the same order; the name is empty
+ * if the tag has not been found.
+ */
+#ifndef UTIL_LINUX_BLKIDD_H
+#define UTIL_LINUX_BLKIDD_H
+
+#include <stdint.h>
+
+#define BLKIDD_DIR		_PATH_RUNSTATEDIR "/blkidd"
+#define BLKIDD_SOCKET_PATH	BLKIDD_DIR "/request"
+#define BLKIDD_PIDFILE_PATH	BLKIDD_DIR "/blkidd.pid"
+
+#define BLKIDD_OP_GETPID	0	/* returns PID of the daemon */
+#define BLKIDD_OP_EVALUATE	1	/* returns device name for NAME=value */
+#define BLKIDD_OP_INVALIDATE	2	/* drops all cached results */
+#define BLKIDD_OP_EVALUATE_ALL	3	/* returns device names for more tags */
+#define BLKIDD_MAX_OP		BLKIDD_OP_EVALUATE_ALL
+
+#define BLKIDD_MAX_DATA		4096	/* max. request and reply data length */
+
+/* timeout (in seconds) for the clients to send the request */
+#define BLKIDD_CLIENT_TIMEOUT	5
+
+/* timeout (in milliseconds) used by libblkid, it evaluates the tags itself
+ * if the daemon does not reply in time */
+#define BLKIDD_LIBRARY_TIMEOUT	50
+
+typedef uint8_t	blkidd_prot_op_t;	/* client operation field */
+typedef int32_t	blkidd_prot_len_t;	/* request or reply data length */
+
+#endif /* UTIL_LINUX_BLKIDD_H */
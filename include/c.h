@@ -302,6 +302,30 @@ static inline __attribute__((const)) int is_power_of_2(unsigned long num)
 	return (num != 0 && ((num & (num - 1)) == 0));
 }
 
+/* returns offset of the first non-zero byte in @buf, or @sz */
+static inline size_t ul_nonzero_offset(const void *buf, size_t sz)
+{
+	const unsigned char *p = buf;
+	size_t i = 0;
+
+	for (; i < sz && ((uintptr_t) (p + i) % sizeof(uint64_t)); i++) {
+		if (p[i])
+			return i;
+	}
+	/* no branch per word, the compiler vectorizes this loop */
+	for (; i + 8 * sizeof(uint64_t) <= sz; i += 8 * sizeof(uint64_t)) {
+		const uint64_t *w = (const uint64_t *) (p + i);
+
+		if (w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7])
+			break;
+	}
+	for (; i < sz; i++) {
+		if (p[i])
+			return i;
+	}
+	return sz;
+}
+
 #ifndef HAVE_LOFF_T
 typedef int64_t loff_t;
 #endif
@@ -19,6 +19,7 @@ extern char *canonicalize_path(const char *path);
 extern char *canonicalize_path_restricted(const char *path);
 extern char *canonicalize_dm_name(const char *ptname);
 extern char *__canonicalize_dm_name(const char *prefix, const char *ptname);
+extern void ul_canonicalize_cache_stats(size_t *hits, size_t *misses);
 
 extern char *absolute_path(const char *path);
 
@@ -0,0 +1,27 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_CPUTOPO_H
+#define UTIL_LINUX_CPUTOPO_H
+
+#include <sys/types.h>
+
+#include "cpuset.h"
+
+/* levels of the CPU topology, from the smallest groups */
+enum {
+	CPUTOPO_CORE = 0,	/* SMT siblings */
+	CPUTOPO_CACHE,		/* CPUs sharing the last level cache */
+	CPUTOPO_NODE,		/* NUMA node */
+	CPUTOPO_SOCKET		/* physical package */
+};
+
+extern int cputopo_name_to_level(const char *name);
+
+extern ssize_t cputopo_split(const char *prefix, int level,
+			     cpu_set_t *set, int maxcpus,
+			     cpu_set_t ***groups);
+extern void cputopo_free_groups(cpu_set_t **groups, size_t ngroups);
+
+#endif /* UTIL_LINUX_CPUTOPO_H */
@@ -8,5 +8,11 @@ extern uint32_t ul_crc32(uint32_t seed, const unsigned char *buf, size_t len);
 extern uint32_t ul_crc32_exclude_offset(uint32_t seed, const unsigned char *buf, size_t len,
 		                              size_t exclude_off, size_t exclude_len);
 
+/* ul_crc32() uses the best of the implementations below */
+extern uint32_t ul_crc32_bytewise(uint32_t seed, const unsigned char *buf, size_t len);
+extern uint32_t ul_crc32_slice8(uint32_t seed, const unsigned char *buf, size_t len);
+extern uint32_t ul_crc32_hw(uint32_t seed, const unsigned char *buf, size_t len);
+extern int ul_crc32_has_hw(void);
+
 #endif
 
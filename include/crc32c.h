@@ -6,4 +6,10 @@
 
 extern uint32_t crc32c(uint32_t crc, const void *buf, size_t size);
 
+/* crc32c() uses the best of the implementations below */
+extern uint32_t crc32c_bytewise(uint32_t crc, const void *buf, size_t size);
+extern uint32_t crc32c_slice8(uint32_t crc, const void *buf, size_t size);
+extern uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t size);
+extern int crc32c_has_hw(void);
+
 #endif /* UL_NG_CRC32C_H */
@@ -18,6 +18,8 @@ struct ul_fileeq_data {
 	unsigned char *blocks;
 	size_t nblocks;
 	size_t maxblocks;
+	unsigned char *map;	/* UL_FILEEQ_MMAP mapping */
+	size_t mapsiz;
 	int fd;
 	const char *name;
 	bool is_eof;
@@ -32,7 +34,7 @@ struct ul_fileeq {
 	uint64_t blocksmax;
 	const struct ul_fileeq_method *method;
 
-	/* UL_FILEEQ_MEMCMP buffers */
+	/* UL_FILEEQ_MEMCMP and userspace digest buffers */
 	unsigned char *buf_a;
 	unsigned char *buf_b;
 	unsigned char *buf_last;
@@ -54,4 +56,22 @@ extern size_t ul_fileeq_set_size(struct ul_fileeq *eq, uint64_t filesiz,
 extern int ul_fileeq(struct ul_fileeq *eq,
               struct ul_fileeq_data *a, struct ul_fileeq_data *b);
 
+/* Already read data of the file, may be saved and restored later for the
+ * same unmodified file. See ul_fileeq_data_get_digests(). */
+struct ul_fileeq_digests {
+	const unsigned char *intro;	/* UL_FILEEQ_INTROSIZ bytes */
+	const unsigned char *digests;	/* ndigests * digsiz bytes */
+	size_t ndigests;
+	size_t digsiz;
+	size_t readsiz;
+	bool is_eof;
+};
+
+extern int ul_fileeq_data_get_digests(struct ul_fileeq *eq,
+				      struct ul_fileeq_data *data,
+				      struct ul_fileeq_digests *dg);
+extern int ul_fileeq_data_set_digests(struct ul_fileeq *eq,
+				      struct ul_fileeq_data *data,
+				      const struct ul_fileeq_digests *dg);
+
 #endif /* UTIL_LINUX_FILEEQ */
@@ -9,18 +9,27 @@
 struct identry {
 	unsigned long int	id;
 	char			*name;
-	struct identry		*next;
+	int			width;		/* name width */
+	struct identry		*next;		/* all entries */
+	struct identry		*hnext;		/* hash bucket */
 };
 
 struct idcache {
 	struct identry	*ent;	/* first entry */
 	int		width;	/* name width */
+
+	struct identry	**hash;	/* entries by id */
+	size_t		nbuckets;
+	size_t		nents;
+	unsigned int	nmisses;	/* getpwuid() or getgrgid() calls */
 };
 
 
 extern struct idcache *new_idcache(void);
 extern void add_gid(struct idcache *cache, unsigned long int id);
 extern void add_uid(struct idcache *cache, unsigned long int id);
+extern struct identry *add_identry(struct idcache *ic, unsigned long int id,
+				   const char *name);
 
 extern void free_idcache(struct idcache *ic);
 extern struct identry *get_id(struct idcache *ic, unsigned long int id);
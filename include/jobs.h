@@ -0,0 +1,16 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_JOBS_H
+#define UTIL_LINUX_JOBS_H
+
+#include <stddef.h>
+
+/* ul_run_jobs() flags */
+#define UL_JOBS_SYNCSTART	(1 << 0)	/* start all the jobs at once */
+
+extern size_t ul_run_jobs(size_t njobs, void *(*fn)(void *), void *data,
+			  int flags);
+
+#endif /* UTIL_LINUX_JOBS_H */
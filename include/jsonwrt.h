@@ -11,10 +11,14 @@ struct ul_jsonwrt {
 	FILE *out;
 	int indent;
 
-	unsigned int after_close :1;
+	unsigned int after_close :1,
+		     cbor :1,		/* binary CBOR output */
+		     compact :1;	/* one line per root object */
 };
 
 void ul_jsonwrt_init(struct ul_jsonwrt *fmt, FILE *out, int indent);
+void ul_jsonwrt_init_cbor(struct ul_jsonwrt *fmt, FILE *out);
+void ul_jsonwrt_init_compact(struct ul_jsonwrt *fmt, FILE *out);
 int ul_jsonwrt_is_ready(struct ul_jsonwrt *fmt);
 void ul_jsonwrt_indent(struct ul_jsonwrt *fmt);
 void ul_jsonwrt_open(struct ul_jsonwrt *fmt, const char *name, int type);
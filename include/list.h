@@ -167,6 +167,27 @@ _INLINE_ void list_splice(struct list_head *list, struct list_head *head)
 	}
 }
 
+/**
+ * list_splice_tail - join two lists, each list being a queue
+ * @list:	the new list to add.
+ * @head:	the place to add it in the first list (before @head).
+ */
+_INLINE_ void list_splice_tail(struct list_head *list, struct list_head *head)
+{
+	struct list_head *first = list->next;
+
+	if (first != list) {
+		struct list_head *last = list->prev;
+		struct list_head *at = head->prev;
+
+		first->prev = at;
+		at->next = first;
+
+		last->next = head;
+		head->prev = last;
+	}
+}
+
 /**
  * list_entry - get the struct for this entry
  * @ptr:	the &struct list_head pointer.
@@ -101,6 +101,28 @@ enum {
 	LOOPITER_FL_USED	= (1 << 1)
 };
 
+/*
+ * used loop device in struct loopdev_index
+ */
+struct loopdev_ient {
+	char		name[16];	/* loop<N> */
+	char		*backing_file;	/* from /sys */
+	ino_t		sysfs_ino;	/* of loop/backing_file, new for each attach */
+	dev_t		backing_dev;	/* from LOOP_GET_STATUS64 */
+	ino_t		backing_ino;
+
+	unsigned int	has_inode:1;	/* backing_{dev,ino} are valid */
+	unsigned int	seen:1;		/* found by the last refresh */
+};
+
+/*
+ * index of the used loop devices, see loopdev_refresh_index()
+ */
+struct loopdev_index {
+	struct loopdev_ient	*ents;	/* sorted by backing devno and inode */
+	size_t			nents;
+};
+
 /*
  * handler for work with loop devices
  */
@@ -117,9 +139,13 @@ struct loopdev_cxt {
 	unsigned int	info_failed:1;	/* LOOP_GET_STATUS ioctl failed */
 	unsigned int    control_ok:1;	/* /dev/loop-control success */
 
+	unsigned int	setup_attempts;	/* loopcxt_setup_device() calls */
+	unsigned int	setup_retries;	/* see loopcxt_retry_setup() */
+
 	struct path_cxt		*sysfs; /* pointer to /sys/dev/block/<maj:min>/ */
 	struct loop_config 	config;	/* for GET/SET ioctl */
 	struct loopdev_iter	iter;	/* scans /sys or /dev for used/free devices */
+	struct loopdev_index	*index;	/* not owned, see loopcxt_set_index() */
 };
 
 #define UL_LOOPDEVCXT_EMPTY { .fd = -1  }
@@ -156,6 +182,10 @@ extern int loopcxt_find_unused(struct loopdev_cxt *lc);
 extern int loopdev_delete(const char *device);
 extern int loopdev_count_by_backing_file(const char *filename, char **loopdev);
 
+extern struct loopdev_index *loopdev_new_index(void);
+extern void loopdev_free_index(struct loopdev_index *idx);
+extern int loopdev_refresh_index(struct loopdev_index *idx);
+
 /*
  * Low-level
  */
@@ -177,8 +207,10 @@ extern int loopcxt_set_fd(struct loopdev_cxt *lc, int fd, int mode);
 extern int loopcxt_init_iterator(struct loopdev_cxt *lc, int flags);
 extern int loopcxt_deinit_iterator(struct loopdev_cxt *lc);
 extern int loopcxt_next(struct loopdev_cxt *lc);
+extern void loopcxt_set_index(struct loopdev_cxt *lc, struct loopdev_index *idx);
 
 extern int loopcxt_setup_device(struct loopdev_cxt *lc);
+extern int loopcxt_retry_setup(struct loopdev_cxt *lc);
 extern int loopcxt_delete_device(struct loopdev_cxt *lc);
 
 extern int loopcxt_ioctl_status(struct loopdev_cxt *lc);
@@ -0,0 +1,271 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * statmount(2) and listmount(2) (Linux 6.8+) and fsopen(2), fsconfig(2),
+ * fsmount(2), move_mount(2), open_tree(2) and mount_setattr(2) (Linux 5.12+)
+ * definitions. The structs and the constants are defined here with the ul_
+ * prefix, because <linux/mount.h> is not always available and it may collide
+ * with <sys/mount.h> on older systems.
+ */
+#ifndef UTIL_LINUX_MOUNT_API_UTILS
+#define UTIL_LINUX_MOUNT_API_UTILS
+
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <stdint.h>
+# include <fcntl.h>
+
+# if !defined(SYS_statmount) && defined(__NR_statmount)
+#  define SYS_statmount	__NR_statmount
+# endif
+# if !defined(SYS_listmount) && defined(__NR_listmount)
+#  define SYS_listmount	__NR_listmount
+# endif
+
+/* fallback only for the architectures where the numbers are known; x32
+ * and mips add an offset to the unified syscall table numbers */
+# if !defined(SYS_statmount)
+#  if defined(__alpha__)
+#   define SYS_statmount	567
+#   define SYS_listmount	568
+#  elif (defined(__x86_64__) && !defined(__ILP32__)) || defined(__i386__) || \
+	defined(__aarch64__) || defined(__arm__) || defined(__riscv) || \
+	defined(__powerpc__) || defined(__s390__) || defined(__loongarch__)
+#   define SYS_statmount	457
+#   define SYS_listmount	458
+#  endif
+# endif
+
+# ifndef MOUNT_ATTR_RDONLY
+#  define MOUNT_ATTR_RDONLY		0x00000001	/* Mount read-only */
+#  define MOUNT_ATTR_NOSUID		0x00000002	/* Ignore suid and sgid bits */
+#  define MOUNT_ATTR_NODEV		0x00000004	/* Disallow access to device special files */
+#  define MOUNT_ATTR_NOEXEC		0x00000008	/* Disallow program execution */
+#  define MOUNT_ATTR__ATIME		0x00000070	/* Setting on how atime should be updated */
+#  define MOUNT_ATTR_RELATIME		0x00000000	/* - Update atime relative to mtime/ctime. */
+#  define MOUNT_ATTR_NOATIME		0x00000010	/* - Do not update access times. */
+#  define MOUNT_ATTR_STRICTATIME	0x00000020	/* - Always perform atime updates */
+#  define MOUNT_ATTR_NODIRATIME	0x00000080	/* Do not update directory access times */
+# endif
+# ifndef MOUNT_ATTR_IDMAP
+#  define MOUNT_ATTR_IDMAP		0x00100000	/* Idmap mount to @userns_fd in struct mount_attr. */
+# endif
+# ifndef MOUNT_ATTR_NOSYMFOLLOW
+#  define MOUNT_ATTR_NOSYMFOLLOW	0x00200000	/* Do not follow symlinks */
+# endif
+
+# if defined(SYS_statmount) && defined(SYS_listmount)
+
+struct ul_mnt_id_req {
+	uint32_t size;
+	uint32_t spare;
+	uint64_t mnt_id;
+	uint64_t param;
+};
+
+#  define UL_MNT_ID_REQ_SIZE_VER0	24	/* sizeof first published struct */
+
+struct ul_statmount {
+	uint32_t size;			/* Total size, including strings */
+	uint32_t mnt_opts;		/* [str] Options (comma separated, escaped) */
+	uint64_t mask;			/* What results were written */
+	uint32_t sb_dev_major;		/* Device ID */
+	uint32_t sb_dev_minor;
+	uint64_t sb_magic;		/* ..._SUPER_MAGIC */
+	uint32_t sb_flags;		/* SB_{RDONLY,SYNCHRONOUS,DIRSYNC,LAZYTIME} */
+	uint32_t fs_type;		/* [str] Filesystem type */
+	uint64_t mnt_id;		/* Unique ID of mount */
+	uint64_t mnt_parent_id;		/* Unique ID of parent (for root == mnt_id) */
+	uint32_t mnt_id_old;		/* Reused IDs used in proc/.../mountinfo */
+	uint32_t mnt_parent_id_old;
+	uint64_t mnt_attr;		/* MOUNT_ATTR_... */
+	uint64_t mnt_propagation;	/* MS_{SHARED,SLAVE,PRIVATE,UNBINDABLE} */
+	uint64_t mnt_peer_group;	/* ID of shared peer group */
+	uint64_t mnt_master;		/* Mount receives propagation from this ID */
+	uint64_t propagate_from;	/* Propagation from in current namespace */
+	uint32_t mnt_root;		/* [str] Root of mount relative to root of fs */
+	uint32_t mnt_point;		/* [str] Mountpoint relative to current root */
+	uint64_t mnt_ns_id;		/* ID of the mount namespace */
+	uint32_t fs_subtype;		/* [str] Subtype of fs_type (if any) */
+	uint32_t sb_source;		/* [str] Source string of the mount */
+	uint32_t opt_num;		/* Number of fs options */
+	uint32_t opt_array;		/* [str] Array of nul terminated fs options */
+	uint32_t opt_sec_num;		/* Number of security options */
+	uint32_t opt_sec_array;		/* [str] Array of nul terminated security options */
+	uint64_t supported_mask;	/* Mask flags that this kernel supports */
+	uint32_t mnt_uidmap_num;
+	uint32_t mnt_uidmap;
+	uint32_t mnt_gidmap_num;
+	uint32_t mnt_gidmap;
+	uint64_t __spare2[43];
+	char str[];			/* Variable size part containing strings */
+};
+
+#  ifndef STATMOUNT_SB_BASIC
+#   define STATMOUNT_SB_BASIC		0x00000001U	/* Want/got sb_... */
+#   define STATMOUNT_MNT_BASIC		0x00000002U	/* Want/got mnt_... */
+#   define STATMOUNT_PROPAGATE_FROM	0x00000004U	/* Want/got propagate_from */
+#   define STATMOUNT_MNT_ROOT		0x00000008U	/* Want/got mnt_root  */
+#   define STATMOUNT_MNT_POINT		0x00000010U	/* Want/got mnt_point */
+#   define STATMOUNT_FS_TYPE		0x00000020U	/* Want/got fs_type */
+#  endif
+#  ifndef STATMOUNT_MNT_NS_ID
+#   define STATMOUNT_MNT_NS_ID		0x00000040U	/* Want/got mnt_ns_id */
+#  endif
+#  ifndef STATMOUNT_MNT_OPTS
+#   define STATMOUNT_MNT_OPTS		0x00000080U	/* Want/got mnt_opts */
+#  endif
+#  ifndef STATMOUNT_FS_SUBTYPE
+#   define STATMOUNT_FS_SUBTYPE		0x00000100U	/* Want/got fs_subtype */
+#   define STATMOUNT_SB_SOURCE		0x00000200U	/* Want/got sb_source */
+#   define STATMOUNT_OPT_ARRAY		0x00000400U	/* Want/got opt_... */
+#   define STATMOUNT_OPT_SEC_ARRAY	0x00000800U	/* Want/got opt_sec... */
+#   define STATMOUNT_SUPPORTED_MASK	0x00001000U	/* Want/got supported mask flags */
+#  endif
+
+#  ifndef LSMT_ROOT
+#   define LSMT_ROOT			0xffffffffffffffffULL	/* root mount */
+#  endif
+#  ifndef LISTMOUNT_REVERSE
+#   define LISTMOUNT_REVERSE		(1 << 0)	/* List later mounts first */
+#  endif
+
+static inline int ul_statmount(uint64_t mnt_id, uint64_t mask,
+			       struct ul_statmount *buf, size_t bufsize,
+			       unsigned int flags)
+{
+	struct ul_mnt_id_req req = {
+		.size = UL_MNT_ID_REQ_SIZE_VER0,
+		.mnt_id = mnt_id,
+		.param = mask
+	};
+
+	return syscall(SYS_statmount, &req, buf, bufsize, flags);
+}
+
+static inline ssize_t ul_listmount(uint64_t mnt_id, uint64_t last_mnt_id,
+				   uint64_t list[], size_t num,
+				   unsigned int flags)
+{
+	struct ul_mnt_id_req req = {
+		.size = UL_MNT_ID_REQ_SIZE_VER0,
+		.mnt_id = mnt_id,
+		.param = last_mnt_id
+	};
+
+	return syscall(SYS_listmount, &req, list, num, flags);
+}
+
+#  define UL_HAVE_STATMOUNT 1
+
+# endif /* SYS_statmount && SYS_listmount */
+
+# if !defined(SYS_open_tree) && defined(__NR_open_tree)
+#  define SYS_open_tree		__NR_open_tree
+# endif
+# if !defined(SYS_move_mount) && defined(__NR_move_mount)
+#  define SYS_move_mount	__NR_move_mount
+# endif
+# if !defined(SYS_fsopen) && defined(__NR_fsopen)
+#  define SYS_fsopen		__NR_fsopen
+# endif
+# if !defined(SYS_fsconfig) && defined(__NR_fsconfig)
+#  define SYS_fsconfig		__NR_fsconfig
+# endif
+# if !defined(SYS_fsmount) && defined(__NR_fsmount)
+#  define SYS_fsmount		__NR_fsmount
+# endif
+# if !defined(SYS_mount_setattr) && defined(__NR_mount_setattr)
+#  define SYS_mount_setattr	__NR_mount_setattr
+# endif
+
+# if !defined(SYS_mount_setattr) && !defined(__mips__) && !defined(__ia64__)
+#  ifdef __alpha__
+#   define SYS_open_tree	538
+#   define SYS_move_mount	539
+#   define SYS_fsopen		540
+#   define SYS_fsconfig		541
+#   define SYS_fsmount		542
+#   define SYS_mount_setattr	552
+#  else
+#   define SYS_open_tree	428
+#   define SYS_move_mount	429
+#   define SYS_fsopen		430
+#   define SYS_fsconfig		431
+#   define SYS_fsmount		432
+#   define SYS_mount_setattr	442
+#  endif
+# endif
+
+# if defined(SYS_fsopen) && defined(SYS_fsconfig) && defined(SYS_fsmount) && \
+     defined(SYS_move_mount) && defined(SYS_open_tree) && defined(SYS_mount_setattr)
+
+#  define UL_FSOPEN_CLOEXEC		0x00000001
+#  define UL_FSMOUNT_CLOEXEC		0x00000001
+
+/* enum fsconfig_command */
+#  define UL_FSCONFIG_SET_FLAG		0	/* Set parameter, supplying no value */
+#  define UL_FSCONFIG_SET_STRING	1	/* Set parameter, supplying a string value */
+#  define UL_FSCONFIG_CMD_CREATE	6	/* Create new or reuse existing superblock */
+
+#  define UL_MOVE_MOUNT_F_EMPTY_PATH	0x00000004	/* Empty from path permitted */
+
+#  define UL_OPEN_TREE_CLONE		1		/* Clone the target tree and attach the clone */
+#  define UL_OPEN_TREE_CLOEXEC		O_CLOEXEC	/* Close the file on execve() */
+
+#  ifndef AT_RECURSIVE
+#   define AT_RECURSIVE			0x8000	/* Apply to the entire subtree */
+#  endif
+#  ifndef AT_EMPTY_PATH
+#   define AT_EMPTY_PATH		0x1000
+#  endif
+
+struct ul_mount_attr {
+	uint64_t attr_set;
+	uint64_t attr_clr;
+	uint64_t propagation;
+	uint64_t userns_fd;
+};
+
+static inline int ul_fsopen(const char *fsname, unsigned int flags)
+{
+	return syscall(SYS_fsopen, fsname, flags);
+}
+
+static inline int ul_fsconfig(int fd, unsigned int cmd, const char *key,
+			      const void *value, int aux)
+{
+	return syscall(SYS_fsconfig, fd, cmd, key, value, aux);
+}
+
+static inline int ul_fsmount(int fd, unsigned int flags, unsigned int attr_flags)
+{
+	return syscall(SYS_fsmount, fd, flags, attr_flags);
+}
+
+static inline int ul_move_mount(int from_dirfd, const char *from_path,
+				int to_dirfd, const char *to_path,
+				unsigned int flags)
+{
+	return syscall(SYS_move_mount, from_dirfd, from_path,
+				       to_dirfd, to_path, flags);
+}
+
+static inline int ul_open_tree(int dirfd, const char *path, unsigned int flags)
+{
+	return syscall(SYS_open_tree, dirfd, path, flags);
+}
+
+static inline int ul_mount_setattr(int dirfd, const char *path, unsigned int flags,
+				   struct ul_mount_attr *attr)
+{
+	return syscall(SYS_mount_setattr, dirfd, path, flags, attr, sizeof(*attr));
+}
+
+#  define UL_HAVE_MOUNT_API 1
+
+# endif /* SYS_fsopen ... SYS_mount_setattr */
+#endif /* HAVE_SYS_SYSCALL_H */
+#endif /* UTIL_LINUX_MOUNT_API_UTILS */
@@ -89,6 +89,16 @@ int ul_path_read_buffer(struct path_cxt *pc, char *buf, size_t bufsz, const char
 int ul_path_readf_buffer(struct path_cxt *pc, char *buf, size_t bufsz, const char *path, ...)
 				__attribute__ ((__format__ (__printf__, 4, 5)));
 
+/* see ul_path_read_many() */
+struct ul_path_attr {
+	const char	*path;		/* relative to the context directory */
+	char		*data;		/* the content in the arena or NULL */
+	int		rc;		/* length of the content or -errno */
+};
+
+int ul_path_read_many(struct path_cxt *pc, struct ul_path_attr *attrs, size_t nattrs,
+		      char *arena, size_t arenasz);
+
 int ul_path_scanf(struct path_cxt *pc, const char *path, const char *fmt, ...)
 				__attribute__ ((__format__ (__scanf__, 3, 4)));
 int ul_path_scanff(struct path_cxt *pc, const char *path, va_list ap, const char *fmt, ...)
@@ -84,6 +84,9 @@
 
 #define _PATH_SD_UNITSLOAD	_PATH_RUNSTATEDIR "/systemd/systemd-units-load"
 
+#define _PATH_UL_RUNSTATEDIR	_PATH_RUNSTATEDIR "/util-linux"
+#define _PATH_UL_PROCSNAP	_PATH_UL_RUNSTATEDIR "/procsnap"
+
 /* misc paths */
 #define _PATH_WORDS             "/usr/share/dict/words"
 #define _PATH_WORDS_ALT         "/usr/share/dict/web2"
@@ -112,6 +115,7 @@
 #define _PATH_PROC_ATTR_CURRENT	"/proc/self/attr/current"
 #define _PATH_PROC_ATTR_EXEC	"/proc/self/attr/exec"
 #define _PATH_PROC_CAPLASTCAP	"/proc/sys/kernel/cap_last_cap"
+#define _PATH_PROC_BOOT_ID	"/proc/sys/kernel/random/boot_id"
 
 
 #define _PATH_SYS_BLOCK		"/sys/block"
@@ -119,8 +123,10 @@
 #define _PATH_SYS_DEVCHAR	"/sys/dev/char"
 #define _PATH_SYS_CLASS		"/sys/class"
 #define _PATH_SYS_SCSI		"/sys/bus/scsi"
+#define _PATH_SYS_MODULE	"/sys/module"
 
 #define _PATH_SYS_SELINUX	"/sys/fs/selinux"
+#define _PATH_SYS_CGROUP	"/sys/fs/cgroup"
 #define _PATH_SYS_APPARMOR	"/sys/kernel/security/apparmor"
 
 #ifndef _PATH_MOUNTED
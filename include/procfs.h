@@ -56,6 +56,38 @@ extern int procfs_dirent_match_uid(DIR *procfs, struct dirent *d, uid_t uid);
 extern int procfs_dirent_get_name(DIR *procfs, struct dirent *d, char *buf, size_t bufsz);
 extern int procfs_dirent_match_name(DIR *procfs, struct dirent *d, const char *name);
 
+/*
+ * Scanner of the processes in /proc, see procfs_scan_next()
+ */
+struct procfs_scan {
+	int		dirfd;		/* the /proc directory */
+	DIR		*dir;		/* used if getdents64() is unavailable */
+	char		*buf;		/* getdents64() buffer */
+	size_t		bufsz;
+	size_t		len;		/* bytes in the buffer */
+	size_t		pos;		/* the next entry in the buffer */
+	const char	*name;		/* the current entry */
+};
+
+extern int procfs_scan_open(struct procfs_scan *sc, const char *path);
+extern int procfs_scan_next(struct procfs_scan *sc, pid_t *pid);
+extern void procfs_scan_close(struct procfs_scan *sc);
+extern int procfs_scan_get_uid(struct procfs_scan *sc, uid_t *uid);
+extern int procfs_scan_match_uid(struct procfs_scan *sc, uid_t uid);
+extern int procfs_scan_get_name(struct procfs_scan *sc, char *buf, size_t bufsz);
+extern int procfs_scan_match_name(struct procfs_scan *sc, const char *name);
+
+static inline int procfs_scan_get_dirfd(struct procfs_scan *sc)
+{
+	return sc->dirfd;
+}
+
+/* the name of the current entry, the PID as a string */
+static inline const char *procfs_scan_get_pidstr(struct procfs_scan *sc)
+{
+	return sc->name;
+}
+
 extern int fd_is_procfs(int fd);
 extern char *pid_get_cmdname(pid_t pid);
 extern char *pid_get_cmdline(pid_t pid);
@@ -0,0 +1,12 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_PROCSNAP_H
+#define UTIL_LINUX_PROCSNAP_H
+
+#include <stdio.h>
+
+extern FILE *ul_procsnap_fopen(const char *path);
+
+#endif /* UTIL_LINUX_PROCSNAP_H */
@@ -87,6 +87,7 @@ struct ul_pty {
 		size_t size, cursor;
 		unsigned int final_input:1;	/* drain child before writing */
 	} *child_buffer_head, *child_buffer_tail, *free_buffers;
+	size_t		child_buffer_size;	/* bytes queued for the child */
 
 	unsigned int isterm:1,		/* is stdin terminal? */
 		     slave_echo:1;	/* keep ECHO on pty slave */
@@ -0,0 +1,12 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_REGEXUTILS_H
+#define UTIL_LINUX_REGEXUTILS_H
+
+#include <stddef.h>
+
+extern size_t ul_regex_literal(const char *pattern, char *buf, size_t bufsz);
+
+#endif /* UTIL_LINUX_REGEXUTILS_H */
@@ -19,6 +19,8 @@ typedef struct
 } UL_SHA1_CTX;
 
 void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64]);
+void ul_SHA1Transform_generic(uint32_t state[5], const unsigned char buffer[64]);
+int ul_SHA1_has_hw(void);
 void ul_SHA1Init(UL_SHA1_CTX *context);
 void ul_SHA1Update(UL_SHA1_CTX *context, const unsigned char *data, uint32_t len);
 void ul_SHA1Final(unsigned char digest[UL_SHA1LENGTH], UL_SHA1_CTX *context);
@@ -19,6 +19,10 @@ extern int parse_size(const char *str, uintmax_t *res, int *power);
 extern int strtosize(const char *str, uintmax_t *res);
 extern uintmax_t strtosize_or_err(const char *str, const char *errmesg);
 
+extern int ul_parse_u64(const char *str, uint64_t *num, const char **end);
+extern int ul_parse_s64(const char *str, int64_t *num, const char **end);
+extern int ul_parse_x64(const char *str, uint64_t *num, const char **end);
+
 extern int ul_strtos64(const char *str, int64_t *num, int base);
 extern int ul_strtou64(const char *str, uint64_t *num, int base);
 extern int ul_strtos32(const char *str, int32_t *num, int base);
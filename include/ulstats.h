@@ -0,0 +1,60 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_ULSTATS_H
+#define UTIL_LINUX_ULSTATS_H
+
+/*
+ * Counters for the --stats option of the tools
+ *
+ * The calls of the lib/path.c functions (sysfs and procfs access) are counted
+ * by category, the wall time is measured per phase of the program:
+ *
+ *	ul_stats_init(UL_STATS_TEXT);
+ *	ul_stats_phase("collect");
+ *	...
+ *	ul_stats_phase("print");
+ *
+ * The result is printed to stderr at exit, together with the read/write
+ * syscalls from /proc/self/io and the CPU time. If ul_stats_init() is not
+ * called, the cost is one load and a not taken branch per counted call.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+enum {
+	UL_STATS_OPEN,
+	UL_STATS_READ,
+	UL_STATS_STAT,
+	UL_STATS_READLINK,
+	UL_STATS_OPENDIR,
+
+	UL_STATS_NCALLS
+};
+
+enum {
+	UL_STATS_TEXT,
+	UL_STATS_JSON
+};
+
+extern int ul_stats_enabled;
+extern uint64_t ul_stats_calls[UL_STATS_NCALLS];
+extern uint64_t ul_stats_bytes;
+
+/* @bytes is the number of bytes read, or <= 0 */
+static inline void ul_stats_count(int call, ssize_t bytes)
+{
+	if (__builtin_expect(ul_stats_enabled, 0)) {
+		__atomic_fetch_add(&ul_stats_calls[call], 1, __ATOMIC_RELAXED);
+		if (bytes > 0)
+			__atomic_fetch_add(&ul_stats_bytes, bytes, __ATOMIC_RELAXED);
+	}
+}
+
+extern int ul_stats_parse_format(const char *str);
+extern void ul_stats_init(int format);
+extern void ul_stats_phase(const char *name);
+
+#endif /* UTIL_LINUX_ULSTATS_H */
@@ -0,0 +1,83 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ */
+#ifndef UTIL_LINUX_ULTRACE_H
+#define UTIL_LINUX_ULTRACE_H
+
+/*
+ * Low-overhead tracing of the hot operations
+ *
+ * Unlike the debug messages (see debug.h), the trace does not print anything
+ * while the code is running. The spans are recorded to a per-thread ring
+ * buffer and written at exit to the file specified by ULTRACE= environment
+ * variable, in the Chrome trace event format (JSON array of "X" events),
+ * usable by chrome://tracing or https://ui.perfetto.dev.
+ *
+ * In the code:
+ *
+ *	struct ul_trace_span sp;
+ *
+ *	ul_trace_begin(&sp, "blkid:probe");
+ *	...
+ *	ul_trace_end(&sp);
+ *
+ * The span name has to be a static string. If ULTRACE= is not set, the cost
+ * is one load and a not taken branch for each begin and end.
+ *
+ * If built with USDT support (HAVE_USDT), the begin and end are also USDT
+ * probes (util_linux:span__begin and util_linux:span__end with the name as
+ * the argument), usable by perf, bpftrace or systemtap without ULTRACE=.
+ *
+ * UL_PROBE*() are the plain USDT probes with arguments, for the places where
+ * a span is not enough:
+ *
+ *	UL_PROBE2(libblkid, read__buffer, off, len);
+ *
+ * The probes are nop instructions, and nothing at all without HAVE_USDT.
+ */
+
+#include <stdint.h>
+
+#ifdef HAVE_USDT
+# include <sys/sdt.h>
+# define UL_PROBE(prov, probe)			DTRACE_PROBE(prov, probe)
+# define UL_PROBE1(prov, probe, a)		DTRACE_PROBE1(prov, probe, a)
+# define UL_PROBE2(prov, probe, a, b)		DTRACE_PROBE2(prov, probe, a, b)
+# define UL_PROBE3(prov, probe, a, b, c)	DTRACE_PROBE3(prov, probe, a, b, c)
+#else
+# define UL_PROBE(prov, probe)			do { } while (0)
+# define UL_PROBE1(prov, probe, a)		do { } while (0)
+# define UL_PROBE2(prov, probe, a, b)		do { } while (0)
+# define UL_PROBE3(prov, probe, a, b, c)	do { } while (0)
+#endif
+
+#define UL_TRACE_PROBE(probe, name)	UL_PROBE1(util_linux, probe, name)
+
+struct ul_trace_span {
+	const char	*name;
+	uint64_t	start;		/* nanoseconds, 0 if not traced */
+};
+
+/* 0 = disabled, 1 = enabled, -1 = not initialized yet */
+extern int ul_trace_enabled;
+
+extern uint64_t ul_trace_start(void);
+extern void ul_trace_record(const char *name, uint64_t start);
+
+static inline void ul_trace_begin(struct ul_trace_span *sp, const char *name)
+{
+	UL_TRACE_PROBE(span__begin, name);
+	sp->name = name;
+	sp->start = __builtin_expect(ul_trace_enabled != 0, 0) ?
+				ul_trace_start() : 0;
+}
+
+static inline void ul_trace_end(struct ul_trace_span *sp)
+{
+	UL_TRACE_PROBE(span__end, sp->name);
+	if (__builtin_expect(sp->start != 0, 0))
+		ul_trace_record(sp->name, sp->start);
+}
+
+#endif /* UTIL_LINUX_ULTRACE_H */
@@ -0,0 +1,11 @@
+#ifndef UTIL_LINUX_XXHASH_H
+#define UTIL_LINUX_XXHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UL_XXH64LENGTH	8
+
+extern uint64_t ul_xxh64(const void *buf, size_t len, uint64_t seed);
+
+#endif /* UTIL_LINUX_XXHASH_H */
@@ -20,17 +20,122 @@
 #include "pathnames.h"
 #include "all-io.h"
 
+#ifdef HAVE_TLS
+# define THREAD_LOCAL static __thread
+#else
+# define THREAD_LOCAL static
+#endif
+
+/*
+ * Per-thread cache of the canonicalized device paths and DM names. The
+ * entries are verified by stat(), a path which is still the same device is
+ * expected to have the same canonical name. The cache is small, the oldest
+ * entry is replaced when full.
+ */
+#define CANON_CACHE_SIZE	32
+
+struct canon_entry {
+	unsigned int	hash;
+	char		*key;		/* absolute path or "dm-N" */
+	char		*res;		/* canonical path */
+	dev_t		devno;
+};
+
+struct canon_cache {
+	struct canon_entry ents[CANON_CACHE_SIZE];
+	size_t	next;			/* the entry to replace */
+	size_t	hits;
+	size_t	misses;
+};
+
+THREAD_LOCAL struct canon_cache path_cache, dm_cache;
+
+static unsigned int canon_hash(const char *key)
+{
+	unsigned int h = 5381;
+
+	while (*key)
+		h = h * 33 + (unsigned char) *key++;
+	return h;
+}
+
+static int is_devno(const char *path, dev_t devno)
+{
+	struct stat sb;
+
+	return stat(path, &sb) == 0 && S_ISBLK(sb.st_mode) && sb.st_rdev == devno;
+}
+
+/*
+ * Returns a copy of the cached result if the result (and @path if not NULL)
+ * is still the same device.
+ */
+static char *canon_cache_get(struct canon_cache *cache, const char *key,
+			     const char *path)
+{
+	unsigned int h = canon_hash(key);
+	size_t i;
+
+	for (i = 0; i < CANON_CACHE_SIZE; i++) {
+		struct canon_entry *e = &cache->ents[i];
+
+		if (!e->key || e->hash != h || strcmp(e->key, key) != 0)
+			continue;
+		if ((!path || is_devno(path, e->devno)) && is_devno(e->res, e->devno)) {
+			cache->hits++;
+			return strdup(e->res);
+		}
+		break;
+	}
+	cache->misses++;
+	return NULL;
+}
+
+static void canon_cache_add(struct canon_cache *cache, const char *key,
+			    const char *res, dev_t devno)
+{
+	struct canon_entry *e = &cache->ents[cache->next];
+	char *k = strdup(key), *r = strdup(res);
+
+	if (!k || !r) {
+		free(k);
+		free(r);
+		return;
+	}
+	free(e->key);
+	free(e->res);
+	e->key = k;
+	e->res = r;
+	e->hash = canon_hash(key);
+	e->devno = devno;
+	cache->next = (cache->next + 1) % CANON_CACHE_SIZE;
+}
+
+/*
+ * Returns the number of the cache hits and misses of canonicalize_path() and
+ * canonicalize_dm_name() in the current thread.
+ */
+void ul_canonicalize_cache_stats(size_t *hits, size_t *misses)
+{
+	if (hits)
+		*hits = path_cache.hits + dm_cache.hits;
+	if (misses)
+		*misses = path_cache.misses + dm_cache.misses;
+}
+
 /*
- * Converts private "dm-N" names to "/dev/mapper/<name>"
+ * Converts private "dm-N" names to "/dev/mapper/<name>", the device number of
+ * the result is returned in @devno if there is no @prefix.
  *
  * Since 2.6.29 (patch 784aae735d9b0bba3f8b9faef4c8b30df3bf0128) kernel sysfs
  * provides the real DM device names in /sys/block/<ptname>/dm/name
  */
-char *__canonicalize_dm_name(const char *prefix, const char *ptname)
+static char *read_dm_name(const char *prefix, const char *ptname, dev_t *devno)
 {
 	FILE	*f;
 	size_t	sz;
 	char	path[256], name[sizeof(path) - sizeof(_PATH_DEV_MAPPER)], *res = NULL;
+	struct stat sb;
 
 	if (!ptname || !*ptname)
 		return NULL;
@@ -47,21 +152,44 @@ char *__canonicalize_dm_name(const char *prefix, const char *ptname)
 		name[sz - 1] = '\0';
 		snprintf(path, sizeof(path), _PATH_DEV_MAPPER "/%s", name);
 
-		if ((prefix && *prefix) || access(path, F_OK) == 0)
+		if (*prefix)
+			res = strdup(path);
+		else if (stat(path, &sb) == 0) {
 			res = strdup(path);
+			*devno = sb.st_rdev;
+		}
 	}
 	fclose(f);
 	return res;
 }
 
+char *__canonicalize_dm_name(const char *prefix, const char *ptname)
+{
+	dev_t devno = 0;
+	char *res;
+
+	if (prefix && *prefix)
+		return read_dm_name(prefix, ptname, &devno);
+	if (!ptname || !*ptname)
+		return NULL;
+
+	res = canon_cache_get(&dm_cache, ptname, NULL);
+	if (res)
+		return res;
+
+	res = read_dm_name(NULL, ptname, &devno);
+	if (res && devno)
+		canon_cache_add(&dm_cache, ptname, res, devno);
+	return res;
+}
+
 char *canonicalize_dm_name(const char *ptname)
 {
 	return __canonicalize_dm_name(NULL, ptname);
 }
 
-static int is_dm_devname(char *canonical, char **name)
+static int is_dm_devname(char *canonical, char **name, struct stat *sb)
 {
-	struct stat sb;
 	char *p = strrchr(canonical, '/');
 
 	*name = NULL;
@@ -69,8 +197,8 @@ static int is_dm_devname(char *canonical, char **name)
 	if (!p
 	    || strncmp(p, "/dm-", 4) != 0
 	    || !isdigit(*(p + 4))
-	    || stat(canonical, &sb) != 0
-	    || !S_ISBLK(sb.st_mode))
+	    || stat(canonical, sb) != 0
+	    || !S_ISBLK(sb->st_mode))
 		return 0;
 
 	*name = p + 1;
@@ -118,25 +246,43 @@ char *absolute_path(const char *path)
 	return res;
 }
 
+/*
+ * The device paths (the result is in /dev) are cached, the cache is used for
+ * absolute paths only.
+ */
 char *canonicalize_path(const char *path)
 {
 	char *canonical, *dmname;
+	struct stat sb;
+	int cached;
 
 	if (!path || !*path)
 		return NULL;
 
+	cached = *path == '/';
+
+	if (cached) {
+		canonical = canon_cache_get(&path_cache, path, path);
+		if (canonical)
+			return canonical;
+	}
+
 	canonical = realpath(path, NULL);
 	if (!canonical)
 		return strdup(path);
 
-	if (is_dm_devname(canonical, &dmname)) {
+	if (is_dm_devname(canonical, &dmname, &sb)) {
 		char *dm = canonicalize_dm_name(dmname);
 		if (dm) {
 			free(canonical);
-			return dm;
+			canonical = dm;
 		}
-	}
+	} else if (!cached || !startswith(canonical, "/dev/")
+		   || stat(canonical, &sb) != 0 || !S_ISBLK(sb.st_mode))
+		cached = 0;
 
+	if (cached)
+		canon_cache_add(&path_cache, path, canonical, sb.st_rdev);
 	return canonical;
 }
 
@@ -174,10 +320,12 @@ char *canonicalize_path_restricted(const char *path)
 			canonical = NULL;	/* failed */
 		else {
 			char *dmname = NULL;
+			struct stat sb;
 
+			/* no cache, the permissions are checked */
 			canonical = realpath(path, NULL);
-			if (canonical && is_dm_devname(canonical, &dmname)) {
-				char *dm = canonicalize_dm_name(dmname);
+			if (canonical && is_dm_devname(canonical, &dmname, &sb)) {
+				char *dm = read_dm_name(NULL, dmname, &sb.st_rdev);
 				if (dm) {
 					free(canonical);
 					canonical = dm;
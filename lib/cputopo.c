@@ -0,0 +1,237 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * cputopo_split() splits a CPU set to groups of CPUs which share a core,
+ * the last level cache, a NUMA node or a socket. The topology is read from
+ * /sys/devices/system, the groups are usable to place the tasks close to
+ * each other (or far from each other) without a knowledge of the topology.
+ */
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "c.h"
+#include "cputopo.h"
+#include "path.h"
+#include "strutils.h"
+#include "xalloc.h"
+
+#define _PATH_SYS_SYSTEM	"/sys/devices/system"
+
+static const char *const level_names[] = {
+	[CPUTOPO_CORE]   = "core",
+	[CPUTOPO_CACHE]  = "cache",
+	[CPUTOPO_NODE]   = "node",
+	[CPUTOPO_SOCKET] = "socket"
+};
+
+int cputopo_name_to_level(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(level_names); i++) {
+		if (strcmp(name, level_names[i]) == 0)
+			return i;
+	}
+	return -EINVAL;
+}
+
+/* the last level cache is the shared one with the highest level */
+static cpu_set_t *read_cache_group(struct path_cxt *sys, int cpu, int maxcpus)
+{
+	cpu_set_t *set = NULL;
+	int i, maxlevel = -1, maxidx = -1;
+
+	for (i = 0; ul_path_accessf(sys, F_OK,
+				"cpu/cpu%d/cache/index%d", cpu, i) == 0; i++) {
+		int level;
+
+		if (ul_path_readf_s32(sys, &level,
+				"cpu/cpu%d/cache/index%d/level", cpu, i) == 0
+		    && level > maxlevel) {
+			maxlevel = level;
+			maxidx = i;
+		}
+	}
+	if (maxidx >= 0)
+		ul_path_readf_cpulist(sys, &set, maxcpus,
+				"cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, maxidx);
+	return set;
+}
+
+/* the node is linked from the CPU directory as "nodeN" */
+static cpu_set_t *read_node_group(struct path_cxt *sys, int cpu, int maxcpus)
+{
+	cpu_set_t *set = NULL;
+	struct dirent *d;
+	char name[sizeof("cpu/cpu") + sizeof(stringify_value(INT_MAX))];
+	DIR *dir = NULL;
+
+	snprintf(name, sizeof(name), "cpu/cpu%d", cpu);
+
+	while (ul_path_next_dirent(sys, &dir, name, &d) == 0) {
+		if (strncmp(d->d_name, "node", 4) != 0
+		    || !isdigit_string(d->d_name + 4))
+			continue;
+		ul_path_readf_cpuset(sys, &set, maxcpus,
+				"node/%s/cpumap", d->d_name);
+		closedir(dir);
+		break;
+	}
+	return set;
+}
+
+static cpu_set_t *read_group(struct path_cxt *sys, int level, int cpu, int maxcpus)
+{
+	cpu_set_t *set = NULL;
+
+	switch (level) {
+	case CPUTOPO_CORE:
+		ul_path_readf_cpulist(sys, &set, maxcpus,
+				"cpu/cpu%d/topology/thread_siblings_list", cpu);
+		break;
+	case CPUTOPO_CACHE:
+		set = read_cache_group(sys, cpu, maxcpus);
+		break;
+	case CPUTOPO_NODE:
+		set = read_node_group(sys, cpu, maxcpus);
+		break;
+	case CPUTOPO_SOCKET:
+		ul_path_readf_cpulist(sys, &set, maxcpus,
+				"cpu/cpu%d/topology/core_siblings_list", cpu);
+		break;
+	}
+	return set;
+}
+
+/**
+ * cputopo_split:
+ * @prefix: path to /sys snapshot or NULL
+ * @level: CPUTOPO_* level
+ * @set: CPUs to split
+ * @maxcpus: size of @set as used for cpuset_alloc()
+ * @groups: returns array of the groups
+ *
+ * Splits the @set to groups of CPUs sharing the @level. The groups are
+ * ordered by the lowest CPU number. A CPU without the topology information
+ * (e.g. offline) is a group on its own.
+ *
+ * Returns: number of the groups or negative number in case of error.
+ */
+ssize_t cputopo_split(const char *prefix, int level,
+		      cpu_set_t *set, int maxcpus,
+		      cpu_set_t ***groups)
+{
+	struct path_cxt *sys;
+	cpu_set_t *done;
+	size_t setsize, ngroups = 0;
+	int cpu;
+
+	if (level < 0 || (size_t) level >= ARRAY_SIZE(level_names))
+		return -EINVAL;
+
+	sys = ul_new_path(_PATH_SYS_SYSTEM);
+	if (!sys)
+		return -ENOMEM;
+	if (ul_path_set_prefix(sys, prefix) != 0) {
+		ul_unref_path(sys);
+		return -ENOMEM;
+	}
+	/* open the directory now, with a prefix the lazy open in the first
+	 * ul_path_readf_*() call would overwrite the formatted path */
+	ul_path_get_dirfd(sys);
+
+	done = cpuset_alloc(maxcpus, &setsize, NULL);
+	if (!done) {
+		ul_unref_path(sys);
+		return -ENOMEM;
+	}
+	CPU_ZERO_S(setsize, done);
+	*groups = NULL;
+
+	for (cpu = 0; cpu < maxcpus; cpu++) {
+		cpu_set_t *sys_grp, *grp;
+		int i;
+
+		if (!CPU_ISSET_S(cpu, setsize, set) || CPU_ISSET_S(cpu, setsize, done))
+			continue;
+
+		grp = cpuset_alloc(maxcpus, NULL, NULL);
+		if (!grp)
+			err_oom();
+		CPU_ZERO_S(setsize, grp);
+
+		/* only the requested and not yet used CPUs, the CPU itself is
+		 * always in the group */
+		sys_grp = read_group(sys, level, cpu, maxcpus);
+		for (i = cpu; i < maxcpus; i++) {
+			if (!CPU_ISSET_S(i, setsize, set) || CPU_ISSET_S(i, setsize, done))
+				continue;
+			if (i != cpu && !(sys_grp && CPU_ISSET_S(i, setsize, sys_grp)))
+				continue;
+			CPU_SET_S(i, setsize, grp);
+			CPU_SET_S(i, setsize, done);
+		}
+		cpuset_free(sys_grp);
+
+		if (ngroups % 16 == 0)
+			*groups = xrealloc(*groups,
+					(ngroups + 16) * sizeof(cpu_set_t *));
+		(*groups)[ngroups++] = grp;
+	}
+
+	cpuset_free(done);
+	ul_unref_path(sys);
+	return ngroups;
+}
+
+void cputopo_free_groups(cpu_set_t **groups, size_t ngroups)
+{
+	size_t i;
+
+	for (i = 0; i < ngroups; i++)
+		cpuset_free(groups[i]);
+	free(groups);
+}
+
+#ifdef TEST_PROGRAM_CPUTOPO
+int main(int argc, char *argv[])
+{
+	cpu_set_t *set, **groups;
+	size_t setsize, buflen, nbits;
+	ssize_t i, ngroups;
+	char *buf;
+	int level, ncpus = 2048;
+
+	if (argc < 3 || argc > 4) {
+		fprintf(stderr, "usage: %s core|cache|node|socket <list> [<prefix>]\n",
+				program_invocation_short_name);
+		return EXIT_FAILURE;
+	}
+
+	level = cputopo_name_to_level(argv[1]);
+	if (level < 0)
+		errx(EXIT_FAILURE, "unsupported level: %s", argv[1]);
+
+	set = cpuset_alloc(ncpus, &setsize, &nbits);
+	if (!set)
+		err(EXIT_FAILURE, "failed to allocate cpu set");
+	if (cpulist_parse(argv[2], set, setsize, 0))
+		errx(EXIT_FAILURE, "failed to parse string: %s", argv[2]);
+
+	ngroups = cputopo_split(argc == 4 ? argv[3] : NULL, level, set, ncpus, &groups);
+	if (ngroups < 0)
+		errx(EXIT_FAILURE, "failed to split the set");
+
+	buflen = 7 * nbits;
+	buf = xmalloc(buflen);
+	for (i = 0; i < ngroups; i++)
+		printf("%zd: %s\n", i, cpulist_create(buf, buflen, groups[i], setsize));
+
+	cputopo_free_groups(groups, ngroups);
+	cpuset_free(set);
+	free(buf);
+	return EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_CPUTOPO */
@@ -20,10 +20,19 @@
  *  * memcmp method: always read data to userspace, nothing is cached, compare
  *  directly files content; fast for small sets of the small files.
  *
+ *  * mmap method: like memcmp, but the files are mapped to the memory and
+ *  compared without copying to the userspace buffers; the mapping is advised
+ *  as sequential to get aggressive read-ahead. Fast for large files. The
+ *  files must not be truncated during comparison (SIGBUS).
+ *
  *  * Linux crypto API: zero-copy method based on sendfile(), data blocks are
  *  send to the kernel hash functions (sha1, ...), and only hash digest is read
  *  and cached in usersapce. Fast for large set of (large) files.
  *
+ *  * xxhash method: like the crypto API methods, but the digests (XXH64) are
+ *  calculated in userspace, no system call round-trips for each block and
+ *  independent on kernel crypto support.
+ *
  *
  * No copyright is claimed.  This code is in the public domain; do with
  * it what you wish.
@@ -35,6 +44,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 /* Linux crypto */
@@ -48,6 +58,7 @@
 #include "c.h"
 #include "all-io.h"
 #include "fileeq.h"
+#include "xxhash.h"
 #include "debug.h"
 
 static UL_DEBUG_DEFINE_MASK(ulfileeq);
@@ -73,6 +84,8 @@ static void ul_fileeq_init_debug(void)
 
 enum {
 	UL_FILEEQ_MEMCMP,
+	UL_FILEEQ_MMAP,
+	UL_FILEEQ_XXHASH,
 	UL_FILEEQ_SHA1,
 	UL_FILEEQ_SHA256,
 	UL_FILEEQ_CRC32
@@ -89,6 +102,13 @@ static const struct ul_fileeq_method ul_eq_methods[] = {
 	[UL_FILEEQ_MEMCMP] = {
 		.id = UL_FILEEQ_MEMCMP, .name = "memcmp"
 	},
+	[UL_FILEEQ_MMAP] = {
+		.id = UL_FILEEQ_MMAP, .name = "mmap"
+	},
+	[UL_FILEEQ_XXHASH] = {
+		.id = UL_FILEEQ_XXHASH, .name = "xxhash",
+		.digsiz = UL_XXH64LENGTH
+	},
 #ifdef USE_FILEEQ_CRYPTOAPI
 	[UL_FILEEQ_SHA1] = {
 		.id = UL_FILEEQ_SHA1, .name = "sha1",
@@ -176,7 +196,7 @@ int ul_fileeq_init(struct ul_fileeq *eq, const char *method)
 	if (!eq->method)
 		return -1;
 #ifdef USE_FILEEQ_CRYPTOAPI
-	if (eq->method->id != UL_FILEEQ_MEMCMP
+	if (eq->method->kname
 	    && init_crypto_api(eq) != 0)
 		return -1;
 #endif
@@ -200,6 +220,12 @@ void ul_fileeq_data_close_file(struct ul_fileeq_data *data)
 {
 	assert(data);
 
+	if (data->map) {
+		DBG(DATA, ul_debugobj(data, "unmap"));
+		munmap(data->map, data->mapsiz);
+		data->map = NULL;
+		data->mapsiz = 0;
+	}
 	if (data->fd >= 0) {
 		DBG(DATA, ul_debugobj(data, "close"));
 		close(data->fd);
@@ -256,6 +282,7 @@ size_t ul_fileeq_set_size(struct ul_fileeq *eq, uint64_t filesiz,
 
 	switch (eq->method->id) {
 	case UL_FILEEQ_MEMCMP:
+	case UL_FILEEQ_MMAP:
 		/* align file size */
 		filesiz = (filesiz + readsiz) / readsiz * readsiz;
 		break;
@@ -388,7 +415,109 @@ static ssize_t read_block(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 	return rsz;
 }
 
+static ssize_t map_block(struct ul_fileeq *eq, struct ul_fileeq_data *data,
+				size_t n, unsigned char **block)
+{
+	off_t off;
+	size_t sz;
+
+	if (data->is_eof || n > eq->blocksmax)
+		return 0;
+
+	if (!data->map) {
+		struct stat st;
+		int fd = get_fd(eq, data, NULL);
+
+		if (fd < 0)
+			return fd;
+
+		/* don't map behind EOF, the access would be killed by SIGBUS */
+		if (fstat(fd, &st) != 0 || (uint64_t) st.st_size != eq->filesiz) {
+			DBG(DATA, ul_debugobj(data, " size changed"));
+			return -1;
+		}
+		if (eq->filesiz == 0) {
+			data->is_eof = 1;
+			return 0;
+		}
+
+		data->map = mmap(NULL, eq->filesiz, PROT_READ, MAP_SHARED, fd, 0);
+		if (data->map == MAP_FAILED) {
+			data->map = NULL;
+			return -errno;
+		}
+		data->mapsiz = eq->filesiz;
+#ifdef MADV_SEQUENTIAL
+		ignore_result( madvise(data->map, data->mapsiz, MADV_SEQUENTIAL) );
+#endif
+		DBG(DATA, ul_debugobj(data, " mapped %zu bytes", data->mapsiz));
+
+		/* the mapping does not need the file descriptor */
+		close(data->fd);
+		data->fd = -1;
+	}
+
+	off = get_cached_offset(eq, data);
+	if ((uint64_t) off >= data->mapsiz) {
+		data->is_eof = 1;
+		return 0;
+	}
+
+	sz = min(eq->readsiz, data->mapsiz - (size_t) off);
+	*block = data->map + off;
+	data->nblocks++;
+
+	if ((uint64_t) off + sz >= data->mapsiz)
+		data->is_eof = 1;	/* keep mapped, the block is still in use */
+
+	DBG(DATA, ul_debugobj(data, " map block off=%ju sz=%zu", (uintmax_t) off, sz));
+	return sz;
+}
+
+/* calculate the digest of the next @eq->readsiz bytes from the file */
+static ssize_t calc_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
+				off_t *off, unsigned char *digest)
+{
+	unsigned char *buf;
+	ssize_t rsz;
+
 #ifdef USE_FILEEQ_CRYPTOAPI
+	if (eq->method->kname) {
+		rsz = sendfile(eq->fd_cip, data->fd, NULL, eq->readsiz);
+		DBG(DATA, ul_debugobj(data, "  sent %zu [%zu wanted] to cipher", rsz, eq->readsiz));
+
+		if (rsz < 0)
+			return rsz;
+
+		*off += rsz;
+		return read_all(eq->fd_cip, (char *) digest, eq->method->digsiz);
+	}
+#endif
+	buf = get_buffer(eq);
+	if (!buf)
+		return -ENOMEM;
+
+	rsz = read_all(data->fd, (char *) buf, eq->readsiz);
+	if (rsz < 0)
+		return rsz;
+
+	*off += rsz;
+
+	switch (eq->method->id) {
+	case UL_FILEEQ_XXHASH:
+	{
+		uint64_t h = ul_xxh64(buf, rsz, 0);
+
+		memcpy(digest, &h, sizeof(h));
+		break;
+	}
+	default:
+		return -EINVAL;
+	}
+
+	return eq->method->digsiz;
+}
+
 static ssize_t get_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 				size_t n, unsigned char **block)
 {
@@ -431,17 +560,11 @@ static ssize_t get_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 
 	assert(n <= eq->blocksmax);
 
-	rsz = sendfile(eq->fd_cip, data->fd, NULL, eq->readsiz);
-	DBG(DATA, ul_debugobj(data, "  sent %zu [%zu wanted] to cipher", rsz, eq->readsiz));
-
-	if (rsz < 0)
-		return rsz;
-
-	off += rsz;
-
 	/* get block digest (note 1st block is data->intro */
 	*block = data->blocks + (n * eq->method->digsiz);
-	rsz = read_all(eq->fd_cip, (char *) *block, sz);
+	rsz = calc_digest(eq, data, &off, *block);
+	if (rsz < 0)
+		return rsz;
 
 	if (rsz > 0)
 		data->nblocks++;
@@ -452,7 +575,6 @@ static ssize_t get_digest(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 	DBG(DATA, ul_debugobj(data, "  get %zuB digest", rsz));
 	return rsz;
 }
-#endif
 
 static ssize_t get_intro(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 				unsigned char **block)
@@ -486,14 +608,12 @@ static ssize_t get_cmp_data(struct ul_fileeq *eq, struct ul_fileeq_data *data,
 	switch (eq->method->id) {
 	case UL_FILEEQ_MEMCMP:
 		return read_block(eq, data, blockno, block);
+	case UL_FILEEQ_MMAP:
+		return map_block(eq, data, blockno, block);
 	default:
 		break;
 	}
-#ifdef USE_FILEEQ_CRYPTOAPI
 	return get_digest(eq, data, blockno, block);
-#else
-	return -1;
-#endif
 }
 
 #define CMP(a, b) ((a) > (b) ? 1 : ((a) < (b) ? -1 : 0))
@@ -506,7 +626,7 @@ int ul_fileeq(struct ul_fileeq *eq,
 
 	DBG(EQ, ul_debugobj(eq, "--> compare %s %s", a->name, b->name));
 
-	if (eq->method->id == UL_FILEEQ_MEMCMP) {
+	if (!eq->method->digsiz) {
 		memcmp_reset(eq, a);
 		memcmp_reset(eq, b);
 	}
@@ -545,6 +665,81 @@ done:
 	return 0;
 }
 
+/*
+ * Returns the intro and digests of the file read so far. The intro is returned
+ * for all methods, the digests for the checksum based methods only. The result is
+ * valid until the next operation with @data.
+ *
+ * Returns: 0 on success, 1 if nothing has been read yet.
+ */
+int ul_fileeq_data_get_digests(struct ul_fileeq *eq,
+			       struct ul_fileeq_data *data,
+			       struct ul_fileeq_digests *dg)
+{
+	assert(eq);
+	assert(data);
+	assert(dg);
+
+	if (data->nblocks == 0)
+		return 1;
+
+	memset(dg, 0, sizeof(*dg));
+	dg->intro = data->intro;
+	dg->readsiz = eq->readsiz;
+
+	if (eq->method->digsiz && data->blocks) {
+		dg->digests = data->blocks;
+		dg->ndigests = get_cached_nblocks(data);
+		dg->digsiz = eq->method->digsiz;
+		dg->is_eof = data->is_eof;
+	}
+
+	DBG(DATA, ul_debugobj(data, "get %zu digests", dg->ndigests));
+	return 0;
+}
+
+/*
+ * Restores data returned by ul_fileeq_data_get_digests() for the same file.
+ * It has to be called after ul_fileeq_data_set_file() and ul_fileeq_set_size()
+ * and before the first ul_fileeq(). The digests are ignored if they have been
+ * calculated with another read size or for another method.
+ *
+ * Returns: 0 on success, <0 on error.
+ */
+int ul_fileeq_data_set_digests(struct ul_fileeq *eq,
+			       struct ul_fileeq_data *data,
+			       const struct ul_fileeq_digests *dg)
+{
+	size_t n = dg->ndigests;
+
+	assert(eq);
+	assert(data);
+	assert(dg);
+	assert(data->nblocks == 0);
+
+	memcpy(data->intro, dg->intro, sizeof(data->intro));
+	data->nblocks = 1;
+
+	if (!eq->method->digsiz
+	    || !dg->digests || !n
+	    || dg->digsiz != (size_t) eq->method->digsiz
+	    || dg->readsiz != eq->readsiz)
+		goto done;
+
+	if (n > eq->blocksmax)
+		n = eq->blocksmax;
+
+	data->blocks = malloc(eq->blocksmax * dg->digsiz);
+	if (!data->blocks)
+		return -ENOMEM;
+	memcpy(data->blocks, dg->digests, n * dg->digsiz);
+	data->nblocks += n;
+	data->is_eof = n == dg->ndigests ? dg->is_eof : 0;
+done:
+	DBG(DATA, ul_debugobj(data, "set %zu digests", data->nblocks - 1));
+	return 0;
+}
+
 #ifdef TEST_PROGRAM_FILEEQ
 # include <getopt.h>
 # include <err.h>
@@ -570,7 +765,7 @@ int main(int argc, char *argv[])
 			break;
 		case 'h':
 			printf("usage: %s [options] <file> <file>\n"
-				" -m, --method <memcmp|sha1|crc32>    compare method\n",
+				" -m, --method <memcmp|mmap|xxhash|sha1|crc32>    compare method\n",
 				program_invocation_short_name);
 			return EXIT_FAILURE;
 		}
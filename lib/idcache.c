@@ -12,14 +12,30 @@
 #include "c.h"
 #include "idcache.h"
 
+/*
+ * The unknown ids are cached too (with the number as the name), so every id
+ * is looked up by getpwuid() or getgrgid() only once. After
+ * IDCACHE_PREFETCH_MISSES lookups the whole passwd (or group) database is
+ * read by one getpwent() (or getgrent()) loop, that's cheaper than a
+ * lookup per id with LDAP or SSSD. The ids not found by the loop (e.g.
+ * enumeration disabled in SSSD) are still looked up one by one.
+ */
+#define IDCACHE_PREFETCH_MISSES	64
+
+static inline size_t id_bucket(const struct idcache *ic, unsigned long int id)
+{
+	/* Fibonacci hashing, the ids are often sequential */
+	return (size_t) ((id * 11400714819323198485ULL) >> 32) & (ic->nbuckets - 1);
+}
+
 struct identry *get_id(struct idcache *ic, unsigned long int id)
 {
 	struct identry *ent;
 
-	if (!ic)
+	if (!ic || !ic->hash)
 		return NULL;
 
-	for (ent = ic->ent; ent; ent = ent->next) {
+	for (ent = ic->hash[id_bucket(ic, id)]; ent; ent = ent->hnext) {
 		if (ent->id == id)
 			return ent;
 	}
@@ -43,18 +59,71 @@ void free_idcache(struct idcache *ic)
 		ent = next;
 	}
 
+	free(ic->hash);
 	free(ic);
 }
 
-static void add_id(struct idcache *ic, char *name, unsigned long int id)
+static int grow_hash(struct idcache *ic)
 {
-	struct identry *ent, *x;
-	int w = 0;
+	size_t nbuckets = ic->nbuckets ? ic->nbuckets * 2 : 64;
+	struct identry **hash, *ent;
+
+	hash = calloc(nbuckets, sizeof(struct identry *));
+	if (!hash)
+		return -ENOMEM;
+
+	free(ic->hash);
+	ic->hash = hash;
+	ic->nbuckets = nbuckets;
+
+	for (ent = ic->ent; ent; ent = ent->next) {
+		size_t i = id_bucket(ic, ent->id);
+
+		ent->hnext = hash[i];
+		hash[i] = ent;
+	}
+	return 0;
+}
+
+/*
+ * Adds the entry @id with @name to the cache, the name is not checked. The
+ * caller is responsible for not adding the same @id twice.
+ */
+struct identry *add_identry(struct idcache *ic, unsigned long int id,
+			    const char *name)
+{
+	struct identry *ent;
+	size_t i;
+
+	if (ic->nents >= ic->nbuckets && grow_hash(ic) != 0 && !ic->hash)
+		return NULL;
 
 	ent = calloc(1, sizeof(struct identry));
 	if (!ent)
-		return;
+		return NULL;
 	ent->id = id;
+	ent->name = strdup(name);
+	if (!ent->name) {
+		free(ent);
+		return NULL;
+	}
+
+	ent->next = ic->ent;
+	ic->ent = ent;
+
+	i = id_bucket(ic, id);
+	ent->hnext = ic->hash[i];
+	ic->hash[i] = ent;
+	ic->nents++;
+
+	return ent;
+}
+
+static struct identry *add_id(struct idcache *ic, char *name, unsigned long int id)
+{
+	struct identry *ent;
+	char buf[sizeof(unsigned long int) * 3 + 1];
+	int w = 0;
 
 	if (name) {
 #ifdef HAVE_WIDECHAR
@@ -70,48 +139,75 @@ static void add_id(struct idcache *ic, char *name, unsigned long int id)
 	}
 
 	/* note, we ignore names with non-printable widechars */
-	if (w > 0) {
-		ent->name = strdup(name);
-		if (!ent->name) {
-			free(ent);
-			return;
-		}
-	} else {
-		if (asprintf(&ent->name, "%lu", id) < 0) {
-			free(ent);
-			return;
-		}
+	if (w <= 0) {
+		snprintf(buf, sizeof(buf), "%lu", id);
+		name = buf;
 	}
 
-	for (x = ic->ent; x && x->next; x = x->next);
-
-	if (x)
-		x->next = ent;
-	else
-		ic->ent = ent;
+	ent = add_identry(ic, id, name);
+	if (!ent)
+		return NULL;
 
 	if (w <= 0)
-		w = ent->name ? strlen(ent->name) : 0;
-	ic->width = ic->width < w ? w : ic->width;
+		w = strlen(ent->name);
+	ent->width = w;
+	return ent;
+}
+
+static void prefetch_uids(struct idcache *cache)
+{
+	struct passwd *pw;
+
+	setpwent();
+	while ((pw = getpwent())) {
+		if (!get_id(cache, pw->pw_uid))
+			add_id(cache, pw->pw_name, pw->pw_uid);
+	}
+	endpwent();
+}
+
+static void prefetch_gids(struct idcache *cache)
+{
+	struct group *gr;
+
+	setgrent();
+	while ((gr = getgrent())) {
+		if (!get_id(cache, gr->gr_gid))
+			add_id(cache, gr->gr_name, gr->gr_gid);
+	}
+	endgrent();
 }
 
 void add_uid(struct idcache *cache, unsigned long int id)
 {
 	struct identry *ent = get_id(cache, id);
 
+	if (!ent && ++cache->nmisses == IDCACHE_PREFETCH_MISSES) {
+		prefetch_uids(cache);
+		ent = get_id(cache, id);
+	}
 	if (!ent) {
 		struct passwd *pw = getpwuid((uid_t) id);
-		add_id(cache, pw ? pw->pw_name : NULL, id);
+		ent = add_id(cache, pw ? pw->pw_name : NULL, id);
 	}
+	/* the prefetched names don't count until they are used */
+	if (ent && cache->width < ent->width)
+		cache->width = ent->width;
 }
 
 void add_gid(struct idcache *cache, unsigned long int id)
 {
 	struct identry *ent = get_id(cache, id);
 
+	if (!ent && ++cache->nmisses == IDCACHE_PREFETCH_MISSES) {
+		prefetch_gids(cache);
+		ent = get_id(cache, id);
+	}
 	if (!ent) {
 		struct group *gr = getgrgid((gid_t) id);
-		add_id(cache, gr ? gr->gr_name : NULL, id);
+		ent = add_id(cache, gr ? gr->gr_name : NULL, id);
 	}
+	/* the prefetched names don't count until they are used */
+	if (ent && cache->width < ent->width)
+		cache->width = ent->width;
 }
-
@@ -0,0 +1,95 @@
+/*
+ * Please, don't add this file to libcommon because pthreads require
+ * -lpthread on systems with old libc.
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Pool of threads for the --jobs options. All the jobs run the same
+ * function on the same data, the function takes the work items from the data
+ * (usually by an atomic counter) and returns when there is nothing left.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "c.h"
+#include "jobs.h"
+
+struct jobs_ctl {
+	void		*(*fn)(void *);
+	void		*data;
+
+	pthread_mutex_t	lock;		/* protects @go */
+	pthread_cond_t	cond;
+	int		go;
+	unsigned int	sync : 1;	/* UL_JOBS_SYNCSTART */
+};
+
+static void jobs_wait_go(struct jobs_ctl *ctl)
+{
+	pthread_mutex_lock(&ctl->lock);
+	while (!ctl->go)
+		pthread_cond_wait(&ctl->cond, &ctl->lock);
+	pthread_mutex_unlock(&ctl->lock);
+}
+
+static void *jobs_thread(void *data)
+{
+	struct jobs_ctl *ctl = data;
+
+	if (ctl->sync)
+		jobs_wait_go(ctl);
+	return ctl->fn(ctl->data);
+}
+
+/*
+ * Runs @fn(@data) by @njobs jobs and waits for them, the current thread is
+ * one of the jobs. If threads can't be created, fewer jobs are used, so
+ * @fn() always runs at least once.
+ *
+ * With UL_JOBS_SYNCSTART the jobs wait until all the threads are created and
+ * then start at once.
+ *
+ * Returns the number of the jobs.
+ */
+size_t ul_run_jobs(size_t njobs, void *(*fn)(void *), void *data, int flags)
+{
+	struct jobs_ctl ctl = {
+		.fn = fn,
+		.data = data,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.sync = flags & UL_JOBS_SYNCSTART ? 1 : 0
+	};
+	pthread_t *threads = NULL;
+	size_t i, nthreads;
+
+	nthreads = njobs > 1 ? njobs - 1 : 0;
+	if (nthreads)
+		threads = calloc(nthreads, sizeof(pthread_t));
+	if (!threads)
+		nthreads = 0;
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, jobs_thread, &ctl) != 0)
+			break;
+	}
+	nthreads = i;
+
+	if (ctl.sync) {
+		pthread_mutex_lock(&ctl.lock);
+		ctl.go = 1;
+		pthread_cond_broadcast(&ctl.cond);
+		pthread_mutex_unlock(&ctl.lock);
+	}
+
+	fn(data);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_cond_destroy(&ctl.cond);
+	pthread_mutex_destroy(&ctl.lock);
+	return nthreads + 1;
+}
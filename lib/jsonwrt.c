@@ -7,6 +7,9 @@
  * Written by Karel Zak <kzak@redhat.com>
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <ctype.h>
 #include <cctype.h>
@@ -26,14 +29,60 @@
  *	}
  * }
  */
+#define JSON_ONES	((uint64_t) 0x0101010101010101ULL)
+#define JSON_HIGHS	((uint64_t) 0x8080808080808080ULL)
+
+/* non-zero if any byte of @x is zero */
+#define json_has_zero(x)	(((x) - JSON_ONES) & ~(x) & JSON_HIGHS)
+
+/*
+ * Returns length of the @data prefix without chars to escape. The string is
+ * scanned by 8 bytes words; a word with a control char, double-quote or
+ * backslash is checked byte by byte.
+ */
+static size_t json_safe_span(const char *data, size_t len)
+{
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t x;
+
+		memcpy(&x, data + i, sizeof(x));
+		if (((x - JSON_ONES * 0x20) & ~x & JSON_HIGHS)	/* < 0x20 */
+		    || json_has_zero(x ^ (JSON_ONES * '"'))
+		    || json_has_zero(x ^ (JSON_ONES * '\\')))
+			break;
+	}
+	for (; i < len; i++) {
+		const unsigned char c = (unsigned char) data[i];
+
+		if (c < 0x20 || c == '"' || c == '\\')
+			break;
+	}
+	return i;
+}
+
 static void fputs_quoted_case_json(const char *data, FILE *out, int dir)
 {
-	const char *p;
+	const char *p, *end = data ? data + strlen(data) : NULL;
 
 	fputc('"', out);
 	for (p = data; p && *p; p++) {
 
-		const unsigned int c = (unsigned int) *p;
+		unsigned int c;
+
+		/* write chars without escaping and without case swap at once */
+		if (dir == 0) {
+			size_t n = json_safe_span(p, end - p);
+
+			if (n) {
+				fwrite(p, 1, n, out);
+				p += n;
+				if (!*p)
+					break;
+			}
+		}
+		c = (unsigned int) *p;
 
 		/* From http://www.json.org
 		 *
@@ -107,6 +156,131 @@ void ul_jsonwrt_init(struct ul_jsonwrt *fmt, FILE *out, int indent)
 	fmt->out = out;
 	fmt->indent = indent;
 	fmt->after_close = 0;
+	fmt->cbor = 0;
+	fmt->compact = 0;
+}
+
+/*
+ * Compact output without whitespace, every root object is terminated by
+ * a newline, so a sequence of root objects is newline-delimited JSON.
+ */
+void ul_jsonwrt_init_compact(struct ul_jsonwrt *fmt, FILE *out)
+{
+	ul_jsonwrt_init(fmt, out, 0);
+	fmt->compact = 1;
+}
+
+/*
+ * CBOR (RFC 8949) output. The data model is the same as for JSON, the
+ * objects and arrays are encoded as indefinite-length maps and arrays
+ * (terminated by the "break" byte), strings and numbers are length-prefixed.
+ */
+#define CBOR_UINT	0
+#define CBOR_NEGINT	1
+#define CBOR_TEXT	3
+#define CBOR_ARRAY	4
+#define CBOR_MAP	5
+
+#define CBOR_FALSE	0xf4
+#define CBOR_TRUE	0xf5
+#define CBOR_NULL	0xf6
+#define CBOR_FLOAT64	0xfb
+#define CBOR_BREAK	0xff
+#define CBOR_INDEFINITE	31
+
+void ul_jsonwrt_init_cbor(struct ul_jsonwrt *fmt, FILE *out)
+{
+	ul_jsonwrt_init(fmt, out, 0);
+	fmt->cbor = 1;
+}
+
+static void cbor_head(FILE *out, int major, uint64_t val)
+{
+	unsigned char buf[9];
+	size_t i, sz;
+
+	if (val < 24) {
+		buf[0] = (major << 5) | val;
+		sz = 0;
+	} else if (val <= UINT8_MAX) {
+		buf[0] = (major << 5) | 24;
+		sz = 1;
+	} else if (val <= UINT16_MAX) {
+		buf[0] = (major << 5) | 25;
+		sz = 2;
+	} else if (val <= UINT32_MAX) {
+		buf[0] = (major << 5) | 26;
+		sz = 4;
+	} else {
+		buf[0] = (major << 5) | 27;
+		sz = 8;
+	}
+	for (i = 0; i < sz; i++)
+		buf[1 + i] = val >> (8 * (sz - 1 - i));	/* big-endian */
+
+	fwrite(buf, 1, sz + 1, out);
+}
+
+static void cbor_text(FILE *out, const char *data, int lower)
+{
+	size_t len = strlen(data);
+
+	cbor_head(out, CBOR_TEXT, len);
+	if (!lower)
+		fwrite(data, 1, len, out);
+	else {
+		const char *p;
+
+		for (p = data; *p; p++)
+			fputc(c_tolower(*p), out);
+	}
+}
+
+/* integers and floats are encoded as numbers, anything else as string */
+static void cbor_number(FILE *out, const char *data)
+{
+	char *end = NULL;
+
+	errno = 0;
+	if (*data == '-') {
+		long long x = strtoll(data, &end, 10);
+
+		if (!errno && end && !*end && end > data + 1) {
+			if (x < 0)
+				cbor_head(out, CBOR_NEGINT, (uint64_t) -(x + 1));
+			else
+				cbor_head(out, CBOR_UINT, x);	/* "-0" */
+			return;
+		}
+	} else if (isdigit((unsigned char) *data)) {
+		unsigned long long x = strtoull(data, &end, 10);
+
+		if (!errno && end && !*end) {
+			cbor_head(out, CBOR_UINT, x);
+			return;
+		}
+	}
+
+	errno = 0;
+	end = NULL;
+	{
+		double d = strtod(data, &end);
+
+		if (!errno && end && end > data && !*end) {
+			unsigned char buf[9];
+			uint64_t x;
+			size_t i;
+
+			memcpy(&x, &d, sizeof(x));
+			buf[0] = CBOR_FLOAT64;
+			for (i = 0; i < 8; i++)
+				buf[1 + i] = x >> (8 * (7 - i));
+			fwrite(buf, 1, sizeof(buf), out);
+			return;
+		}
+	}
+
+	cbor_text(out, data, 0);
 }
 
 int ul_jsonwrt_is_ready(struct ul_jsonwrt *fmt)
@@ -124,6 +298,35 @@ void ul_jsonwrt_indent(struct ul_jsonwrt *fmt)
 
 void ul_jsonwrt_open(struct ul_jsonwrt *fmt, const char *name, int type)
 {
+	if (fmt->cbor) {
+		if (name)
+			cbor_text(fmt->out, name, 1);
+		if (type == UL_JSON_OBJECT)
+			fputc((CBOR_MAP << 5) | CBOR_INDEFINITE, fmt->out);
+		else if (type == UL_JSON_ARRAY)
+			fputc((CBOR_ARRAY << 5) | CBOR_INDEFINITE, fmt->out);
+		if (type != UL_JSON_VALUE)
+			fmt->indent++;
+		return;
+	}
+
+	if (fmt->compact) {
+		if (fmt->after_close)
+			fputc(',', fmt->out);
+		if (name) {
+			fputs_quoted_json_lower(name, fmt->out);
+			fputc(':', fmt->out);
+		}
+		if (type == UL_JSON_OBJECT)
+			fputc('{', fmt->out);
+		else if (type == UL_JSON_ARRAY)
+			fputc('[', fmt->out);
+		if (type != UL_JSON_VALUE)
+			fmt->indent++;
+		fmt->after_close = 0;
+		return;
+	}
+
 	if (name) {
 		if (fmt->after_close)
 			fputs(",\n", fmt->out);
@@ -154,6 +357,29 @@ void ul_jsonwrt_open(struct ul_jsonwrt *fmt, const char *name, int type)
 
 void ul_jsonwrt_close(struct ul_jsonwrt *fmt, int type)
 {
+	if (fmt->cbor) {
+		if (type != UL_JSON_VALUE) {
+			assert(fmt->indent > 0);
+			fputc(CBOR_BREAK, fmt->out);
+			fmt->indent--;
+		}
+		return;
+	}
+
+	if (fmt->compact) {
+		if (type != UL_JSON_VALUE) {
+			assert(fmt->indent > 0);
+			fputc(type == UL_JSON_OBJECT ? '}' : ']', fmt->out);
+			fmt->indent--;
+		}
+		if (fmt->indent == 0) {
+			fputc('\n', fmt->out);
+			fmt->after_close = 0;
+		} else
+			fmt->after_close = 1;
+		return;
+	}
+
 	if (fmt->indent == 1) {
 		fputs("\n}\n", fmt->out);
 		fmt->indent--;
@@ -186,7 +412,12 @@ void ul_jsonwrt_value_raw(struct ul_jsonwrt *fmt,
 			const char *name, const char *data)
 {
 	ul_jsonwrt_value_open(fmt, name);
-	if (data && *data)
+	if (fmt->cbor) {
+		if (data && *data)
+			cbor_number(fmt->out, data);
+		else
+			fputc(CBOR_NULL, fmt->out);
+	} else if (data && *data)
 		fputs(data, fmt->out);
 	else
 		fputs("null", fmt->out);
@@ -197,7 +428,12 @@ void ul_jsonwrt_value_s(struct ul_jsonwrt *fmt,
 			const char *name, const char *data)
 {
 	ul_jsonwrt_value_open(fmt, name);
-	if (data && *data)
+	if (fmt->cbor) {
+		if (data && *data)
+			cbor_text(fmt->out, data, 0);
+		else
+			fputc(CBOR_NULL, fmt->out);
+	} else if (data && *data)
 		fputs_quoted_json(data, fmt->out);
 	else
 		fputs("null", fmt->out);
@@ -208,7 +444,10 @@ void ul_jsonwrt_value_u64(struct ul_jsonwrt *fmt,
 			const char *name, uint64_t data)
 {
 	ul_jsonwrt_value_open(fmt, name);
-	fprintf(fmt->out, "%"PRIu64, data);
+	if (fmt->cbor)
+		cbor_head(fmt->out, CBOR_UINT, data);
+	else
+		fprintf(fmt->out, "%"PRIu64, data);
 	ul_jsonwrt_value_close(fmt);
 }
 
@@ -216,7 +455,10 @@ void ul_jsonwrt_value_boolean(struct ul_jsonwrt *fmt,
 			const char *name, int data)
 {
 	ul_jsonwrt_value_open(fmt, name);
-	fputs(data ? "true" : "false", fmt->out);
+	if (fmt->cbor)
+		fputc(data ? CBOR_TRUE : CBOR_FALSE, fmt->out);
+	else
+		fputs(data ? "true" : "false", fmt->out);
 	ul_jsonwrt_value_close(fmt);
 }
 
@@ -224,6 +466,9 @@ void ul_jsonwrt_value_null(struct ul_jsonwrt *fmt,
 			const char *name)
 {
 	ul_jsonwrt_value_open(fmt, name);
-	fputs("null", fmt->out);
+	if (fmt->cbor)
+		fputc(CBOR_NULL, fmt->out);
+	else
+		fputs("null", fmt->out);
 	ul_jsonwrt_value_close(fmt);
 }
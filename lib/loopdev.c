@@ -42,9 +42,16 @@
 #include "blkdev.h"
 #include "debug.h"
 #include "fileutils.h"
+#include "randutils.h"
+#include "strutils.h"
 
 #define LOOPDEV_MAX_TRIES	10
 
+/* loopcxt_retry_setup() limits */
+#define LOOPDEV_SETUP_MAX_RETRIES	64
+#define LOOPDEV_SETUP_MIN_DELAY		1000	/* usec */
+#define LOOPDEV_SETUP_MAX_DELAY		200000	/* usec */
+
 /*
  * Debug stuff (based on include/debug.h)
  */
@@ -1193,6 +1200,7 @@ int loopcxt_set_backing_file(struct loopdev_cxt *lc, const char *filename)
 	if (!lc)
 		return -EINVAL;
 
+	free(lc->filename);
 	lc->filename = canonicalize_path(filename);
 	if (!lc->filename)
 		return -errno;
@@ -1322,7 +1330,9 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 	if (!lc || !*lc->device || !lc->filename)
 		return -EINVAL;
 
-	DBG(SETUP, ul_debugobj(lc, "device setup requested"));
+	lc->setup_attempts++;
+	DBG(SETUP, ul_debugobj(lc, "device setup requested [attempt=%u]",
+				lc->setup_attempts));
 
 	/*
 	 * Open backing file and device
@@ -1392,6 +1402,9 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 	if (rc != 0) {
 		errsv = errno;
 		if (errno != EINVAL && errno != ENOTTY && errno != ENOSYS) {
+			/* -EBUSY: the device has been configured by another
+			 * process, don't clear it on error */
+			rc = -errsv;
 			DBG(SETUP, ul_debugobj(lc, "LOOP_CONFIGURE failed: %m"));
 			goto err;
 		}
@@ -1435,7 +1448,8 @@ int loopcxt_setup_device(struct loopdev_cxt *lc)
 	lc->has_info = 0;
 	lc->info_failed = 0;
 
-	DBG(SETUP, ul_debugobj(lc, "success [rc=0]"));
+	DBG(SETUP, ul_debugobj(lc, "success [rc=0, attempts=%u, retries=%u]",
+				lc->setup_attempts, lc->setup_retries));
 	return 0;
 err:
 	if (file_fd >= 0)
@@ -1449,6 +1463,45 @@ err:
 	return rc;
 }
 
+/*
+ * @lc: context
+ *
+ * The device returned by loopcxt_find_unused() is not reserved, a concurrent
+ * process may configure the same device and loopcxt_setup_device() fails
+ * with EBUSY. Call this function before the next loopcxt_find_unused(); it
+ * sleeps for an exponentially growing time with a random jitter, so the
+ * processes do not collide again on the next free device.
+ *
+ * Returns: 0 if the setup should be retried, -EBUSY when the maximal number
+ *          of retries has been reached.
+ */
+int loopcxt_retry_setup(struct loopdev_cxt *lc)
+{
+	unsigned int delay, jitter = 0;
+
+	if (!lc)
+		return -EINVAL;
+	if (lc->setup_retries >= LOOPDEV_SETUP_MAX_RETRIES) {
+		DBG(SETUP, ul_debugobj(lc, "retry: giving up [attempts=%u, retries=%u]",
+					lc->setup_attempts, lc->setup_retries));
+		return -EBUSY;
+	}
+
+	delay = LOOPDEV_SETUP_MIN_DELAY << min(lc->setup_retries, 8U);
+	if (delay > LOOPDEV_SETUP_MAX_DELAY)
+		delay = LOOPDEV_SETUP_MAX_DELAY;
+
+	/* sleep delay/2 .. delay */
+	ul_random_get_bytes(&jitter, sizeof(jitter));
+	delay = delay / 2 + jitter % (delay / 2 + 1);
+
+	lc->setup_retries++;
+	DBG(SETUP, ul_debugobj(lc, "retry #%u after %u usec",
+				lc->setup_retries, delay));
+	xusleep(delay);
+	return 0;
+}
+
 
 /*
  * @lc: context
@@ -1735,6 +1788,248 @@ int loopdev_delete(const char *device)
 	return rc;
 }
 
+/*
+ * Index of the used loop devices
+ *
+ * The loop devices are found in /sys/block, the backing file devno and inode
+ * are read by LOOP_GET_STATUS64 only once per attached device. The
+ * loop<N>/loop/ sysfs directory is created for each attach, so the inode
+ * number of loop<N>/loop/backing_file is enough to detect detached and
+ * re-attached devices on the next refresh, the loop device nodes are not
+ * opened again.
+ *
+ * loopcxt_find_by_backing_file() and loopcxt_find_overlap() check only the
+ * indexed candidates if the index is set by loopcxt_set_index().
+ */
+struct loopdev_index *loopdev_new_index(void)
+{
+	loopdev_init_debug();
+	return calloc(1, sizeof(struct loopdev_index));
+}
+
+void loopdev_free_index(struct loopdev_index *idx)
+{
+	size_t i;
+
+	if (!idx)
+		return;
+	for (i = 0; i < idx->nents; i++)
+		free(idx->ents[i].backing_file);
+	free(idx->ents);
+	free(idx);
+}
+
+/* entries with inode first, sorted by devno and inode */
+static int cmp_index_entries(const void *a0, const void *b0)
+{
+	const struct loopdev_ient *a = a0, *b = b0;
+	int rc = cmp_numbers(!a->has_inode, !b->has_inode);
+
+	if (!rc)
+		rc = cmp_numbers(a->backing_dev, b->backing_dev);
+	if (!rc)
+		rc = cmp_numbers(a->backing_ino, b->backing_ino);
+	return rc;
+}
+
+static void loopdev_index_read_inode(struct loopdev_ient *ent)
+{
+	struct loopdev_cxt lc;
+	dev_t dev = 0;
+	ino_t ino = 0;
+
+	if (loopcxt_init(&lc, 0) || loopcxt_set_device(&lc, ent->name))
+		return;
+
+	if (loopcxt_get_backing_devno(&lc, &dev) == 0
+	    && loopcxt_get_backing_inode(&lc, &ino) == 0) {
+		ent->backing_dev = dev;
+		ent->backing_ino = ino;
+		ent->has_inode = 1;
+	}
+	loopcxt_deinit(&lc);
+}
+
+/*
+ * @idx: index
+ *
+ * Rescans /sys/block and updates the index.
+ *
+ * Returns: <0 on error, 0 on success
+ */
+int loopdev_refresh_index(struct loopdev_index *idx)
+{
+	struct path_cxt *pc;
+	struct dirent *d;
+	size_t i, n;
+	DIR *dir;
+
+	if (!idx)
+		return -EINVAL;
+
+	pc = ul_new_path(_PATH_SYS_BLOCK);
+	if (!pc)
+		return -ENOMEM;
+	dir = ul_path_opendir(pc, NULL);
+	if (!dir) {
+		ul_unref_path(pc);
+		return -errno;
+	}
+
+	DBG(CXT, ul_debugobj(idx, "refreshing index [%zu entries]", idx->nents));
+
+	for (i = 0; i < idx->nents; i++)
+		idx->ents[i].seen = 0;
+
+	while ((d = readdir(dir))) {
+		struct loopdev_ient *ent = NULL;
+		char name[NAME_MAX + 18 + 1], *backing = NULL;
+		struct stat st;
+
+		if (strncmp(d->d_name, "loop", 4) != 0
+		    || !isdigit((unsigned char) d->d_name[4])
+		    || strlen(d->d_name) >= sizeof(ent->name))
+			continue;
+
+		/* unused device has no backing_file */
+		snprintf(name, sizeof(name), "%s/loop/backing_file", d->d_name);
+		if (fstatat(dirfd(dir), name, &st, 0) != 0)
+			continue;
+
+		for (i = 0; i < idx->nents; i++) {
+			if (strcmp(idx->ents[i].name, d->d_name) == 0) {
+				ent = &idx->ents[i];
+				break;
+			}
+		}
+		if (ent && ent->sysfs_ino == st.st_ino) {
+			ent->seen = 1;		/* the same attachment */
+			continue;
+		}
+
+		if (ul_path_read_string(pc, &backing, name) <= 0) {
+			free(backing);
+			continue;
+		}
+
+		if (!ent) {
+			struct loopdev_ient *tmp = realloc(idx->ents,
+					(idx->nents + 1) * sizeof(*tmp));
+			if (!tmp) {
+				free(backing);
+				break;
+			}
+			idx->ents = tmp;
+			ent = &idx->ents[idx->nents++];
+			memset(ent, 0, sizeof(*ent));
+			xstrncpy(ent->name, d->d_name, sizeof(ent->name));
+		}
+
+		DBG(CXT, ul_debugobj(idx, "index: %s backed by %s", ent->name, backing));
+		free(ent->backing_file);
+		ent->backing_file = backing;
+		ent->sysfs_ino = st.st_ino;
+		ent->has_inode = 0;
+		ent->seen = 1;
+		loopdev_index_read_inode(ent);
+	}
+
+	closedir(dir);
+	ul_unref_path(pc);
+
+	/* remove detached devices */
+	for (i = 0, n = 0; i < idx->nents; i++) {
+		if (!idx->ents[i].seen) {
+			free(idx->ents[i].backing_file);
+			continue;
+		}
+		if (i != n)
+			idx->ents[n] = idx->ents[i];
+		n++;
+	}
+	idx->nents = n;
+
+	if (idx->nents)
+		qsort(idx->ents, idx->nents, sizeof(struct loopdev_ient),
+				cmp_index_entries);
+	return 0;
+}
+
+/*
+ * @lc: context
+ * @idx: index or NULL
+ *
+ * The index is not owned by the context, it's refreshed and used by
+ * loopcxt_find_by_backing_file() and loopcxt_find_overlap().
+ */
+void loopcxt_set_index(struct loopdev_cxt *lc, struct loopdev_index *idx)
+{
+	if (lc)
+		lc->index = idx;
+}
+
+/* the first entry with has_inode and not less than @st */
+static size_t loopdev_index_lookup(struct loopdev_index *idx, const struct stat *st)
+{
+	size_t lo = 0, hi = idx->nents;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct loopdev_ient *ent = &idx->ents[mid];
+
+		if (ent->has_inode
+		    && (ent->backing_dev < st->st_dev
+			|| (ent->backing_dev == st->st_dev
+			    && ent->backing_ino < st->st_ino)))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Sets @lc to the next indexed device which may be backed by @st or
+ * @filename, the device has to be verified by loopcxt_is_used(). The @pos
+ * has to be zero for the first call.
+ *
+ * Returns: 0 on success, <0 on error, 1 at the end
+ */
+static int loopcxt_next_from_index(struct loopdev_cxt *lc, struct stat *st,
+				   const char *filename, size_t *pos)
+{
+	struct loopdev_index *idx = lc->index;
+	size_t i = *pos;
+
+	if (st && i == 0)
+		i = loopdev_index_lookup(idx, st);
+
+	for (; i < idx->nents; i++) {
+		struct loopdev_ient *ent = &idx->ents[i];
+
+		if (st && ent->has_inode) {
+			if (ent->backing_dev == st->st_dev
+			    && ent->backing_ino == st->st_ino)
+				break;
+			/* skip to the entries without inode */
+			while (i + 1 < idx->nents && idx->ents[i + 1].has_inode)
+				i++;
+			continue;
+		}
+		if (strcmp(ent->backing_file, filename) == 0)
+			break;
+	}
+
+	*pos = i + 1;
+	if (i >= idx->nents) {
+		ignore_result( loopcxt_set_device(lc, NULL) );
+		return 1;
+	}
+
+	DBG(CXT, ul_debugobj(lc, "index: candidate %s", idx->ents[i].name));
+	return loopcxt_set_device(lc, idx->ents[i].name);
+}
+
 /*
  * Returns: 0 = success, < 0 error, 1 not found
  */
@@ -1749,6 +2044,18 @@ int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
 
 	hasst = !stat(filename, &st);
 
+	if (lc->index && loopdev_refresh_index(lc->index) == 0) {
+		size_t pos = 0;
+
+		while ((rc = loopcxt_next_from_index(lc, hasst ? &st : NULL,
+						     filename, &pos)) == 0) {
+			if (loopcxt_is_used(lc, hasst ? &st : NULL,
+					    filename, offset, sizelimit, flags))
+				break;
+		}
+		return rc;
+	}
+
 	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
 	if (rc)
 		return rc;
@@ -1764,6 +2071,61 @@ int loopcxt_find_by_backing_file(struct loopdev_cxt *lc, const char *filename,
 	return rc;
 }
 
+/*
+ * Checks the current device of @lc for overlap with @filename, @offset and
+ * @sizelimit.
+ *
+ * Returns: 0 = no overlap, 1 overlap, 2 full size and offset match
+ */
+static int loopcxt_check_overlap(struct loopdev_cxt *lc, struct stat *st,
+			   const char *filename, uint64_t offset, uint64_t sizelimit)
+{
+	uint64_t lc_sizelimit, lc_offset;
+	int rc;
+
+	rc = loopcxt_is_used(lc, st, filename, offset, sizelimit, 0);
+	/*
+	 * Either the loopdev is unused or we've got an error which can
+	 * happen when we are racing with device autoclear. Just ignore
+	 * this loopdev...
+	 */
+	if (rc <= 0)
+		return 0;
+
+	DBG(CXT, ul_debugobj(lc, "found %s backed by %s",
+		loopcxt_get_device(lc), filename));
+
+	rc = loopcxt_get_offset(lc, &lc_offset);
+	if (rc) {
+		DBG(CXT, ul_debugobj(lc, "failed to get offset for device %s",
+			loopcxt_get_device(lc)));
+		return 0;
+	}
+	rc = loopcxt_get_sizelimit(lc, &lc_sizelimit);
+	if (rc) {
+		DBG(CXT, ul_debugobj(lc, "failed to get sizelimit for device %s",
+			loopcxt_get_device(lc)));
+		return 0;
+	}
+
+	/* full match */
+	if (lc_sizelimit == sizelimit && lc_offset == offset) {
+		DBG(CXT, ul_debugobj(lc, "overlapping loop device %s (full match)",
+					loopcxt_get_device(lc)));
+		return 2;
+	}
+
+	/* overlap */
+	if (lc_sizelimit != 0 && offset >= lc_offset + lc_sizelimit)
+		return 0;
+	if (sizelimit != 0 && offset + sizelimit <= lc_offset)
+		return 0;
+
+	DBG(CXT, ul_debugobj(lc, "overlapping loop device %s",
+		loopcxt_get_device(lc)));
+	return 1;
+}
+
 /*
  * Returns: 0 = not found, < 0 error, 1 found, 2 found full size and offset match
  */
@@ -1779,56 +2141,29 @@ int loopcxt_find_overlap(struct loopdev_cxt *lc, const char *filename,
 	DBG(CXT, ul_debugobj(lc, "find_overlap requested"));
 	hasst = !stat(filename, &st);
 
+	if (lc->index && loopdev_refresh_index(lc->index) == 0) {
+		size_t pos = 0;
+
+		while ((rc = loopcxt_next_from_index(lc, hasst ? &st : NULL,
+						     filename, &pos)) == 0) {
+			rc = loopcxt_check_overlap(lc, hasst ? &st : NULL,
+						   filename, offset, sizelimit);
+			if (rc)
+				goto found;
+		}
+		if (rc == 1)
+			rc = 0;	/* not found */
+		goto found;
+	}
+
 	rc = loopcxt_init_iterator(lc, LOOPITER_FL_USED);
 	if (rc)
 		return rc;
 
 	while ((rc = loopcxt_next(lc)) == 0) {
-		uint64_t lc_sizelimit, lc_offset;
-
-		rc = loopcxt_is_used(lc, hasst ? &st : NULL,
-				     filename, offset, sizelimit, 0);
-		/*
-		 * Either the loopdev is unused or we've got an error which can
-		 * happen when we are racing with device autoclear. Just ignore
-		 * this loopdev...
-		 */
-		if (rc <= 0)
-			continue;
-
-		DBG(CXT, ul_debugobj(lc, "found %s backed by %s",
-			loopcxt_get_device(lc), filename));
-
-		rc = loopcxt_get_offset(lc, &lc_offset);
-		if (rc) {
-			DBG(CXT, ul_debugobj(lc, "failed to get offset for device %s",
-				loopcxt_get_device(lc)));
-			continue;
-		}
-		rc = loopcxt_get_sizelimit(lc, &lc_sizelimit);
-		if (rc) {
-			DBG(CXT, ul_debugobj(lc, "failed to get sizelimit for device %s",
-				loopcxt_get_device(lc)));
-			continue;
-		}
-
-		/* full match */
-		if (lc_sizelimit == sizelimit && lc_offset == offset) {
-			DBG(CXT, ul_debugobj(lc, "overlapping loop device %s (full match)",
-						loopcxt_get_device(lc)));
-			rc = 2;
-			goto found;
-		}
-
-		/* overlap */
-		if (lc_sizelimit != 0 && offset >= lc_offset + lc_sizelimit)
-			continue;
-		if (sizelimit != 0 && offset + sizelimit <= lc_offset)
-			continue;
-
-		DBG(CXT, ul_debugobj(lc, "overlapping loop device %s",
-			loopcxt_get_device(lc)));
-			rc = 1;
+		rc = loopcxt_check_overlap(lc, hasst ? &st : NULL,
+					   filename, offset, sizelimit);
+		if (rc)
 			goto found;
 	}
 
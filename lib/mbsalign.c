@@ -28,6 +28,42 @@
 #include "strutils.h"
 #include "widechar.h"
 
+static inline int is_ascii_print(unsigned char c, int nobs)
+{
+	return c >= 0x20 && c <= 0x7e && !(nobs && c == '\\');
+}
+
+/*
+ * Returns the number of leading printable ASCII bytes in @p, at most @n.
+ * With @nobs the backslash ends the run too (it starts "\x" sequence).
+ *
+ * Such bytes are one cell wide and encoded as they are in all the supported
+ * locales, so the run does not need mbrtowc() and wcwidth(). The bytes are
+ * checked by blocks without a branch per byte, the compiler vectorizes it.
+ */
+static size_t ascii_prefix(const char *p, size_t n, int nobs)
+{
+	const unsigned char *s = (const unsigned char *) p;
+	size_t i = 0, k;
+
+	if (!n || !is_ascii_print(*s, nobs))
+		return 0;
+
+	for (; i + 16 <= n; i += 16) {
+		unsigned char bad = 0;
+
+		for (k = 0; k < 16; k++) {
+			bad |= (unsigned char) (s[i + k] - 0x20) > 0x5e;
+			bad |= nobs & (s[i + k] == '\\');
+		}
+		if (bad)
+			break;
+	}
+	while (i < n && is_ascii_print(s[i], nobs))
+		i++;
+	return i;
+}
+
 /*
  * Counts number of cells in multibyte string. All control and
  * non-printable chars are ignored.
@@ -47,6 +83,13 @@ size_t mbs_nwidth(const char *buf, size_t bufsz)
 		last = p + (bufsz - 1);
 
 	while (p && *p && p <= last) {
+		size_t n = ascii_prefix(p, last - p + 1, 0);
+
+		if (n) {
+			width += n;
+			p += n;
+			continue;
+		}
 		if (iscntrl((unsigned char) *p)) {
 			p++;
 
@@ -110,6 +153,13 @@ size_t mbs_safe_nwidth(const char *buf, size_t bufsz, size_t *sz)
 		last = p + (bufsz - 1);
 
 	while (p && *p && p <= last) {
+		size_t n = ascii_prefix(p, last - p + 1, 1);
+
+		if (n) {
+			width += n, bytes += n;
+			p += n;
+			continue;
+		}
 		if ((p < last && *p == '\\' && *(p + 1) == 'x')
 		    || iscntrl((unsigned char) *p)) {
 			width += 4, bytes += 4;		/* *p encoded to \x?? */
@@ -187,6 +237,14 @@ char *mbs_safe_encode_to_buffer(const char *s, size_t *width, char *buf, const c
 	*width = 0;
 
 	while (p && *p) {
+		size_t n = ascii_prefix(p, sz - (p - s), 1);
+
+		if (n) {
+			memcpy(r, p, n);
+			r += n, p += n;
+			*width += n;
+			continue;
+		}
 		if (safechars && strchr(safechars, *p)) {
 			*r++ = *p++;
 			continue;
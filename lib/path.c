@@ -26,6 +26,7 @@
 #include "path.h"
 #include "debug.h"
 #include "strutils.h"
+#include "ulstats.h"
 
 /*
  * Debug stuff (based on include/debug.h)
@@ -307,6 +308,7 @@ int ul_path_access(struct path_cxt *pc, int mode, const char *path)
 
 	if (!pc) {
 		rc = access(path, mode);
+		ul_stats_count(UL_STATS_STAT, 0);
 		DBG(CXT, ul_debug("access '%s' [no context, rc=%d]", path, rc));
 	} else {
 		int dir = ul_path_get_dirfd(pc);
@@ -316,6 +318,7 @@ int ul_path_access(struct path_cxt *pc, int mode, const char *path)
 			path++;
 
 		rc = faccessat(dir, path, mode, 0);
+		ul_stats_count(UL_STATS_STAT, 0);
 
 		if (rc && errno == ENOENT
 		    && pc->redirect_on_enoent
@@ -343,6 +346,7 @@ int ul_path_stat(struct path_cxt *pc, struct stat *sb, int flags, const char *pa
 {
 	int rc;
 
+	ul_stats_count(UL_STATS_STAT, 0);
 	if (!pc) {
 		rc = path ? stat(path, sb) : -EINVAL;
 		DBG(CXT, ul_debug("stat '%s' [no context, rc=%d]", path, rc));
@@ -375,6 +379,7 @@ int ul_path_open(struct path_cxt *pc, int flags, const char *path)
 
 	if (!path)
 		return -EINVAL;
+	ul_stats_count(UL_STATS_OPEN, 0);
 	if (!pc) {
 		fd = open(path, flags);
 		DBG(CXT, ul_debug("opening '%s' [no context]", path));
@@ -490,6 +495,7 @@ DIR *ul_path_opendir(struct path_cxt *pc, const char *path)
 	DIR *dir;
 	int fd = -1;
 
+	ul_stats_count(UL_STATS_OPENDIR, 0);
 	if (path)
 		fd = ul_path_open(pc, O_RDONLY|O_CLOEXEC, path);
 	else if (pc->dir_path) {
@@ -550,6 +556,7 @@ ssize_t ul_path_readlink(struct path_cxt *pc, char *buf, size_t bufsiz, const ch
 	int dirfd;
 	ssize_t ssz;
 
+	ul_stats_count(UL_STATS_READLINK, 0);
 	if (!path) {
 		const char *p = get_absdir(pc);
 		if (!p)
@@ -597,6 +604,7 @@ int ul_path_read(struct path_cxt *pc, char *buf, size_t len, const char *path)
 
 	DBG(CXT, ul_debug(" reading '%s'", path));
 	rc = read_all(fd, buf, len);
+	ul_stats_count(UL_STATS_READ, rc);
 
 	errsv = errno;
 	close(fd);
@@ -699,6 +707,67 @@ int ul_path_readf_buffer(struct path_cxt *pc, char *buf, size_t bufsz, const cha
 	return !p ? -errno : ul_path_read_buffer(pc, buf, bufsz, p);
 }
 
+/*
+ * Reads all the @attrs into @arena. The files are opened relative to the
+ * context directory and read by one read(2) call, as usual for sysfs
+ * attributes. The content of every attribute is terminated by '\0' and the
+ * tailing newline is removed (see ul_path_read_buffer()).
+ *
+ * The result for the attribute is in attrs[].rc (length of the content or
+ * -errno, -ENOSPC if the arena is full) and attrs[].data.
+ *
+ * Returns: number of successfully read attributes.
+ */
+int ul_path_read_many(struct path_cxt *pc, struct ul_path_attr *attrs, size_t nattrs,
+		      char *arena, size_t arenasz)
+{
+	size_t i, used = 0;
+	int count = 0;
+
+	for (i = 0; i < nattrs; i++) {
+		struct ul_path_attr *a = &attrs[i];
+		char *buf = arena + used;
+		ssize_t rc;
+		int fd, errsv;
+
+		a->data = NULL;
+		if (used + 1 >= arenasz) {
+			a->rc = -ENOSPC;
+			continue;
+		}
+
+		fd = ul_path_open(pc, O_RDONLY|O_CLOEXEC, a->path);
+		if (fd < 0) {
+			a->rc = -errno;
+			continue;
+		}
+
+		DBG(CXT, ul_debug(" reading '%s'", a->path));
+		do {
+			rc = read(fd, buf, arenasz - used - 1);
+		} while (rc < 0 && (errno == EINTR || errno == EAGAIN));
+		ul_stats_count(UL_STATS_READ, rc);
+
+		errsv = errno;
+		close(fd);
+
+		if (rc < 0) {
+			a->rc = -errsv;
+			continue;
+		}
+		if (rc > 0 && buf[rc - 1] == '\n')
+			rc--;
+		buf[rc] = '\0';
+
+		a->data = buf;
+		a->rc = rc;
+		used += rc + 1;
+		count++;
+	}
+
+	return count;
+}
+
 int ul_path_scanf(struct path_cxt *pc, const char *path, const char *fmt, ...)
 {
 	FILE *f;
@@ -714,6 +783,7 @@ int ul_path_scanf(struct path_cxt *pc, const char *path, const char *fmt, ...)
 	va_start(fmt_ap, fmt);
 	rc = vfscanf(f, fmt, fmt_ap);
 	va_end(fmt_ap);
+	ul_stats_count(UL_STATS_READ, ftell(f));
 
 	fclose(f);
 	return rc;
@@ -732,19 +802,29 @@ int ul_path_scanff(struct path_cxt *pc, const char *path, va_list ap, const char
 	va_start(fmt_ap, fmt);
 	rc = vfscanf(f, fmt, fmt_ap);
 	va_end(fmt_ap);
+	ul_stats_count(UL_STATS_READ, ftell(f));
 
 	fclose(f);
 	return rc;
 }
 
 
+/*
+ * The numeric attributes are read by one read(2) and parsed by the
+ * ul_parse_*() functions; sscanf() is used only for unusual content (leading
+ * white space, '+' sign, ...), the result is the same as from fscanf().
+ */
+#define PATH_NUMBUF_SIZE	64
+
 int ul_path_read_s64(struct path_cxt *pc, int64_t *res, const char *path)
 {
+	char buf[PATH_NUMBUF_SIZE];
 	int64_t x = 0;
-	int rc;
 
-	rc = ul_path_scanf(pc, path, "%"SCNd64, &x);
-	if (rc != 1)
+	if (ul_path_read_buffer(pc, buf, sizeof(buf), path) <= 0)
+		return -1;
+	if (ul_parse_s64(buf, &x, NULL) != 0
+	    && sscanf(buf, "%"SCNd64, &x) != 1)
 		return -1;
 	if (res)
 		*res = x;
@@ -765,11 +845,13 @@ int ul_path_readf_s64(struct path_cxt *pc, int64_t *res, const char *path, ...)
 
 int ul_path_read_u64(struct path_cxt *pc, uint64_t *res, const char *path)
 {
+	char buf[PATH_NUMBUF_SIZE];
 	uint64_t x = 0;
-	int rc;
 
-	rc = ul_path_scanf(pc, path, "%"SCNu64, &x);
-	if (rc != 1)
+	if (ul_path_read_buffer(pc, buf, sizeof(buf), path) <= 0)
+		return -1;
+	if (ul_parse_u64(buf, &x, NULL) != 0
+	    && sscanf(buf, "%"SCNu64, &x) != 1)
 		return -1;
 	if (res)
 		*res = x;
@@ -790,10 +872,15 @@ int ul_path_readf_u64(struct path_cxt *pc, uint64_t *res, const char *path, ...)
 
 int ul_path_read_s32(struct path_cxt *pc, int *res, const char *path)
 {
-	int rc, x = 0;
+	char buf[PATH_NUMBUF_SIZE];
+	int64_t num;
+	int x = 0;
 
-	rc = ul_path_scanf(pc, path, "%d", &x);
-	if (rc != 1)
+	if (ul_path_read_buffer(pc, buf, sizeof(buf), path) <= 0)
+		return -1;
+	if (ul_parse_s64(buf, &num, NULL) == 0 && num >= INT_MIN && num <= INT_MAX)
+		x = num;
+	else if (sscanf(buf, "%d", &x) != 1)
 		return -1;
 	if (res)
 		*res = x;
@@ -814,11 +901,15 @@ int ul_path_readf_s32(struct path_cxt *pc, int *res, const char *path, ...)
 
 int ul_path_read_u32(struct path_cxt *pc, unsigned int *res, const char *path)
 {
-	int rc;
+	char buf[PATH_NUMBUF_SIZE];
+	uint64_t num;
 	unsigned int x = 0;
 
-	rc = ul_path_scanf(pc, path, "%u", &x);
-	if (rc != 1)
+	if (ul_path_read_buffer(pc, buf, sizeof(buf), path) <= 0)
+		return -1;
+	if (ul_parse_u64(buf, &num, NULL) == 0 && num <= UINT_MAX)
+		x = num;
+	else if (sscanf(buf, "%u", &x) != 1)
 		return -1;
 	if (res)
 		*res = x;
@@ -1099,6 +1190,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(" read-string <file>         read string  from file\n", stdout);
 	fputs(" read-majmin <file>         read devno from file\n", stdout);
 	fputs(" read-link <file>           read symlink\n", stdout);
+	fputs(" read-many <file> ...       read more files at once\n", stdout);
 	fputs(" write-string <file> <str>  write string from file\n", stdout);
 	fputs(" write-u64 <file> <str>     write uint64_t from file\n", stdout);
 
@@ -1251,6 +1343,28 @@ int main(int argc, char *argv[])
 			err(EXIT_FAILURE, "readf symlink failed");
 		printf("readf: %s: %s\n", file, res);
 
+	} else if (strcmp(command, "read-many") == 0) {
+		struct ul_path_attr *attrs;
+		char arena[BUFSIZ];
+		size_t i, n = argc - optind;
+
+		if (!n)
+			errx(EXIT_FAILURE, "<file> not defined");
+		attrs = calloc(n, sizeof(*attrs));
+		if (!attrs)
+			err(EXIT_FAILURE, "cannot allocate attributes");
+		for (i = 0; i < n; i++)
+			attrs[i].path = argv[optind++];
+
+		ul_path_read_many(pc, attrs, n, arena, sizeof(arena));
+		for (i = 0; i < n; i++) {
+			if (attrs[i].rc < 0)
+				printf("read:  %s: %s\n", attrs[i].path, strerror(-attrs[i].rc));
+			else
+				printf("read:  %s: %s\n", attrs[i].path, attrs[i].data);
+		}
+		free(attrs);
+
 	} else if (strcmp(command, "write-string") == 0) {
 		char *str;
 
@@ -7,6 +7,8 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
 
 #ifdef HAVE_SYS_VFS_H
 # include <sys/vfs.h>
@@ -304,39 +306,37 @@ int procfs_dirent_match_uid(DIR *procfs, struct dirent *d, uid_t uid)
 	return 0;
 }
 
-/* "name" of process; may be truncated, see prctl(2) and PR_SET_NAME.
- * The minimal of the @buf has to be 32 bytes. */
-int procfs_dirent_get_name(DIR *procfs, struct dirent *d, char *buf, size_t bufsz)
+/*
+ * Reads "name" from @dirfd/@pidstr/comm. The name is the same as in the
+ * stat file, but the kernel does not need to compose the whole stat line.
+ * The leading '(' and anything after ')' are ignored for compatibility with
+ * the former parser of the stat file.
+ */
+static int read_comm_name(int dirfd, const char *pidstr, char *buf, size_t bufsz)
 {
-	FILE *f;
 	size_t sz;
-	char tmp[1024], *p, *end = NULL;
-
-	if (bufsz < 32)
-		return -EINVAL;
-	if (!procfs_dirent_is_process(d))
-		return -EINVAL;
-
-	snprintf(tmp, sizeof(tmp), "%s/stat", d->d_name);
-	f = fopen_at(dirfd(procfs), tmp, O_CLOEXEC|O_RDONLY, "r");
-	if (!f)
-		return -errno;
+	ssize_t rc;
+	char tmp[64], *p, *end;
+	int fd;
 
-	p = fgets(tmp, sizeof(tmp), f);
-	fclose(f);
-	if (!p)
+	snprintf(tmp, sizeof(tmp), "%s/comm", pidstr);
+	fd = openat(dirfd, tmp, O_CLOEXEC|O_RDONLY);
+	if (fd < 0)
 		return -errno;
 
-	/* skip PID */
-	while (*p && *p != '(')
-		p++;
+	rc = read_all(fd, tmp, sizeof(tmp) - 1);
+	close(fd);
+	if (rc <= 0)
+		return rc < 0 ? -errno : -EINVAL;
+	tmp[rc] = '\0';
 
 	/* skip extra '(' */
+	p = tmp;
 	while (*p && *p == '(')
 		p++;
 
 	end = p;
-	while (*end && *end != ')')
+	while (*end && *end != ')' && *end != '\n')
 		end++;
 
 	sz = end - p;
@@ -349,6 +349,18 @@ int procfs_dirent_get_name(DIR *procfs, struct dirent *d, char *buf, size_t bufs
 	return 0;
 }
 
+/* "name" of process; may be truncated, see prctl(2) and PR_SET_NAME.
+ * The minimal of the @buf has to be 32 bytes. */
+int procfs_dirent_get_name(DIR *procfs, struct dirent *d, char *buf, size_t bufsz)
+{
+	if (bufsz < 32)
+		return -EINVAL;
+	if (!procfs_dirent_is_process(d))
+		return -EINVAL;
+
+	return read_comm_name(dirfd(procfs), d->d_name, buf, bufsz);
+}
+
 int procfs_dirent_match_name(DIR *procfs, struct dirent *d, const char *name)
 {
 	char buf[33];
@@ -359,6 +371,190 @@ int procfs_dirent_match_name(DIR *procfs, struct dirent *d, const char *name)
 	return 0;
 }
 
+/*
+ * The /proc scanner reads the directory by getdents64() to a large buffer, so
+ * a system with many processes needs only a few syscalls. The entries which
+ * are not processes are skipped without any conversion.
+ *
+ * Example:
+ *
+ * struct procfs_scan sc;
+ * pid_t pid;
+ *
+ * if (procfs_scan_open(&sc, NULL) == 0) {
+ *	while (procfs_scan_next(&sc, &pid) == 0)
+ *		printf("process: %d", (int) pid);
+ *	procfs_scan_close(&sc);
+ * }
+ */
+#define PROCFS_SCAN_BUFSZ	(256 * 1024)
+
+#ifdef SYS_getdents64
+struct procfs_dirent64 {
+	uint64_t	d_ino;
+	int64_t		d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char		d_name[];
+};
+#endif
+
+/* @path is NULL for /proc */
+int procfs_scan_open(struct procfs_scan *sc, const char *path)
+{
+	memset(sc, 0, sizeof(*sc));
+
+	sc->dirfd = open(path ? path : _PATH_PROC,
+			 O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (sc->dirfd < 0)
+		return -errno;
+#ifdef SYS_getdents64
+	sc->bufsz = PROCFS_SCAN_BUFSZ;
+	sc->buf = malloc(sc->bufsz);
+	if (sc->buf)
+		return 0;
+#endif
+	/* fallback to readdir() */
+	sc->dir = fdopendir(dup(sc->dirfd));
+	if (!sc->dir) {
+		int rc = -errno;
+
+		procfs_scan_close(sc);
+		return rc;
+	}
+	return 0;
+}
+
+void procfs_scan_close(struct procfs_scan *sc)
+{
+	if (sc->dir)
+		closedir(sc->dir);
+	if (sc->dirfd >= 0)
+		close(sc->dirfd);
+	free(sc->buf);
+
+	memset(sc, 0, sizeof(*sc));
+	sc->dirfd = -1;
+}
+
+/* converts the name to PID, returns 0 if the name is not a PID */
+static pid_t procfs_scan_name_to_pid(const char *name)
+{
+	uint64_t num = 0;
+	const char *p;
+
+	for (p = name; *p; p++) {
+		if (!isdigit((unsigned char) *p))
+			return 0;
+		num = num * 10 + (*p - '0');
+		if (num > INT32_MAX)
+			return 0;
+	}
+	return (pid_t) num;
+}
+
+/*
+ * Returns: <0 on error, 0 on success, 1 done
+ */
+int procfs_scan_next(struct procfs_scan *sc, pid_t *pid)
+{
+	if (sc->dir) {
+		struct dirent *d;
+
+		while ((d = xreaddir(sc->dir))) {
+			if (!procfs_dirent_is_process(d))
+				continue;
+			*pid = procfs_scan_name_to_pid(d->d_name);
+			if (*pid > 0) {
+				sc->name = d->d_name;
+				return 0;
+			}
+		}
+		sc->name = NULL;
+		return 1;
+	}
+
+#ifdef SYS_getdents64
+	for (;;) {
+		while (sc->pos < sc->len) {
+			struct procfs_dirent64 *d =
+				(struct procfs_dirent64 *) (sc->buf + sc->pos);
+
+			sc->pos += d->d_reclen;
+
+			if ((d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+			    || !isdigit((unsigned char) *d->d_name))
+				continue;
+			*pid = procfs_scan_name_to_pid(d->d_name);
+			if (*pid > 0) {
+				sc->name = d->d_name;
+				return 0;
+			}
+		}
+
+		do {
+			errno = 0;
+			sc->len = syscall(SYS_getdents64, sc->dirfd, sc->buf, sc->bufsz);
+		} while ((ssize_t) sc->len < 0 && errno == EINTR);
+
+		sc->pos = 0;
+		sc->name = NULL;
+		if ((ssize_t) sc->len < 0) {
+			int rc = -errno;
+
+			sc->len = 0;
+			return rc;
+		}
+		if (sc->len == 0)
+			return 1;
+	}
+#endif
+	return 1;
+}
+
+/* the owner of the current process */
+int procfs_scan_get_uid(struct procfs_scan *sc, uid_t *uid)
+{
+	struct stat st;
+
+	if (!sc->name)
+		return -EINVAL;
+	if (fstatat(sc->dirfd, sc->name, &st, 0))
+		return -errno;
+
+	*uid = st.st_uid;
+	return 0;
+}
+
+int procfs_scan_match_uid(struct procfs_scan *sc, uid_t uid)
+{
+	uid_t x = 0;
+
+	if (procfs_scan_get_uid(sc, &x) == 0)
+		return x == uid;
+
+	return 0;
+}
+
+/* "name" of the current process, see procfs_dirent_get_name() */
+int procfs_scan_get_name(struct procfs_scan *sc, char *buf, size_t bufsz)
+{
+	if (bufsz < 32 || !sc->name)
+		return -EINVAL;
+
+	return read_comm_name(sc->dirfd, sc->name, buf, bufsz);
+}
+
+int procfs_scan_match_name(struct procfs_scan *sc, const char *name)
+{
+	char buf[33];
+
+	if (procfs_scan_get_name(sc, buf, sizeof(buf)) == 0)
+		return strcmp(name, buf) == 0;
+
+	return 0;
+}
+
 #ifdef HAVE_SYS_VFS_H
 /* checks if fd is file in a procfs;
  * returns 1 if true, 0 if false or couldn't determine */
@@ -468,36 +664,31 @@ static int test_fds(int argc, char *argv[])
 
 static int test_processes(int argc, char *argv[])
 {
-	DIR *dir;
-	struct dirent *d;
+	struct procfs_scan sc;
 	char *name = NULL;
 	uid_t uid = (uid_t) -1;
 	char buf[128];
+	pid_t pid;
 
 	if (argc >= 3 && strcmp(argv[1], "--name") == 0)
 		name = argv[2];
 	if (argc >= 3 && strcmp(argv[1], "--uid") == 0)
 		uid = (uid_t) atol(argv[2]);
 
-	dir = opendir(_PATH_PROC);
-	if (!dir)
+	if (procfs_scan_open(&sc, NULL) != 0)
 		err(EXIT_FAILURE, "cannot open proc");
 
-	while ((d = xreaddir(dir))) {
-		pid_t pid = 0;
-
-		if (procfs_dirent_get_pid(d, &pid) != 0)
-			continue;
-		if (name && !procfs_dirent_match_name(dir, d, name))
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		if (name && !procfs_scan_match_name(&sc, name))
 			continue;
-		if (uid != (uid_t) -1 && !procfs_dirent_match_uid(dir, d, uid))
+		if (uid != (uid_t) -1 && !procfs_scan_match_uid(&sc, uid))
 			continue;
-		procfs_dirent_get_name(dir, d, buf, sizeof(buf));
+		procfs_scan_get_name(&sc, buf, sizeof(buf));
 		printf(" %d [%s]", pid, buf);
 	}
 
 	fputc('\n', stdout);
-	closedir(dir);
+	procfs_scan_close(&sc);
 	return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,363 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Snapshot of small and mostly static kernel files shared by all tools and
+ * libraries.
+ *
+ * /proc/devices and /proc/filesystems change only when a driver or filesystem
+ * registers itself, which in practice means module (un)load. The first root
+ * process which asks for one of the files after boot or after a module change
+ * writes all of them to _PATH_UL_PROCSNAP; everyone else gets the content by
+ * one read(2) of the snapshot rather than by formatting of the files in
+ * kernel.
+ *
+ * The snapshot is valid for the boot ID and the /sys/module directory (link
+ * count and mtime) recorded when the snapshot was written. The procfs files
+ * have no usable mtime, /sys/module is the nearest thing to a generation
+ * counter. The boot ID does not need to be read if the snapshot lives on
+ * tmpfs as such file cannot survive reboot.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include "c.h"
+#include "all-io.h"
+#include "fileutils.h"
+#include "pathnames.h"
+#include "procsnap.h"
+#include "statfs_magic.h"
+#include "xxhash.h"
+
+#define PROCSNAP_MAGIC		"ULPSNAP1"
+#define PROCSNAP_MAXSZ		(64 * 1024)
+#define PROCSNAP_BOOTIDSZ	40
+
+static const char *const procsnap_files[] = {
+	_PATH_PROC_DEVICES,
+	_PATH_PROC_FILESYSTEMS
+};
+
+struct procsnap_head {
+	char		magic[8];		/* PROCSNAP_MAGIC */
+	char		boot_id[PROCSNAP_BOOTIDSZ];
+	uint64_t	mod_nlink;		/* /sys/module link count */
+	int64_t		mod_sec;		/* /sys/module mtime */
+	int64_t		mod_nsec;
+	uint64_t	checksum;		/* xxh64 of data after header */
+	uint32_t	nfiles;
+	uint32_t	datasz;			/* entries + file contents */
+};
+
+struct procsnap_entry {
+	uint64_t	hash;			/* xxh64 of the path */
+	uint32_t	offset;			/* relative to the end of entries */
+	uint32_t	size;
+};
+
+static int is_snapshot_file(const char *path)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(procsnap_files); i++) {
+		if (strcmp(path, procsnap_files[i]) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static uint64_t path_hash(const char *path)
+{
+	return ul_xxh64(path, strlen(path), 0);
+}
+
+static int get_modgen(struct procsnap_head *hd)
+{
+	struct stat st;
+
+	if (stat(_PATH_SYS_MODULE, &st) != 0)
+		return -errno;
+
+	hd->mod_nlink = st.st_nlink;
+	hd->mod_sec = st.st_mtim.tv_sec;
+	hd->mod_nsec = st.st_mtim.tv_nsec;
+	return 0;
+}
+
+static int get_boot_id(char *buf)
+{
+	ssize_t rc;
+	int fd;
+
+	fd = open(_PATH_PROC_BOOT_ID, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	rc = read_all(fd, buf, PROCSNAP_BOOTIDSZ - 1);
+	close(fd);
+	if (rc <= 0)
+		return -EINVAL;
+
+	buf[rc] = '\0';
+	return 0;
+}
+
+/*
+ * Returns a private stream with a copy of @data. The extra byte is for the
+ * terminator written by fmemopen() after the data.
+ */
+static FILE *mem_fopen(const char *data, size_t sz)
+{
+	FILE *f;
+
+	if (!sz)
+		return NULL;
+
+	f = fmemopen(NULL, sz + 1, "w+");
+	if (!f)
+		return NULL;
+	if (fwrite(data, 1, sz, f) != sz || fseek(f, 0, SEEK_SET) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+static FILE *snapshot_fopen(const char *path)
+{
+	struct procsnap_head hd, cur;
+	struct procsnap_entry *ent;
+	struct statfs sfs;
+	struct stat st;
+	char *buf = NULL, *data;
+	FILE *f = NULL;
+	size_t i;
+	int fd;
+
+	fd = open(_PATH_UL_PROCSNAP, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	/* only root-owned snapshot is trustworthy */
+	if (fstat(fd, &st) != 0
+	    || !S_ISREG(st.st_mode)
+	    || st.st_uid != 0
+	    || (st.st_mode & (S_IWGRP | S_IWOTH))
+	    || st.st_size < (off_t) sizeof(hd)
+	    || st.st_size > PROCSNAP_MAXSZ)
+		goto done;
+
+	buf = malloc(st.st_size);
+	if (!buf || read_all(fd, buf, st.st_size) != st.st_size)
+		goto done;
+
+	memcpy(&hd, buf, sizeof(hd));
+	if (memcmp(hd.magic, PROCSNAP_MAGIC, sizeof(hd.magic)) != 0
+	    || (off_t) sizeof(hd) + hd.datasz != st.st_size
+	    || (uint64_t) hd.nfiles * sizeof(*ent) > hd.datasz
+	    || ul_xxh64(buf + sizeof(hd), hd.datasz, 0) != hd.checksum)
+		goto done;
+
+	if (get_modgen(&cur) != 0
+	    || cur.mod_nlink != hd.mod_nlink
+	    || cur.mod_sec != hd.mod_sec
+	    || cur.mod_nsec != hd.mod_nsec)
+		goto done;
+
+	if (fstatfs(fd, &sfs) != 0
+	    || (sfs.f_type != STATFS_TMPFS_MAGIC
+		&& sfs.f_type != STATFS_RAMFS_MAGIC)) {
+		if (get_boot_id(cur.boot_id) != 0
+		    || strncmp(cur.boot_id, hd.boot_id, sizeof(hd.boot_id)) != 0)
+			goto done;
+	}
+
+	ent = (struct procsnap_entry *) (buf + sizeof(hd));
+	data = (char *) (ent + hd.nfiles);
+
+	for (i = 0; i < hd.nfiles; i++) {
+		uint64_t hash = path_hash(path);
+		size_t end = (size_t) ent[i].offset + ent[i].size;
+
+		if (ent[i].hash != hash)
+			continue;
+		if (end <= hd.datasz - hd.nfiles * sizeof(*ent))
+			f = mem_fopen(data + ent[i].offset, ent[i].size);
+		break;
+	}
+done:
+	free(buf);
+	close(fd);
+	return f;
+}
+
+static int read_procfile(const char *path, char **buf, size_t *sz)
+{
+	size_t len = 0, bufsz = 4096;
+	char *p = NULL;
+	int fd, rc = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	do {
+		ssize_t ret;
+		char *tmp = realloc(p, bufsz);
+
+		if (!tmp) {
+			rc = -ENOMEM;
+			break;
+		}
+		p = tmp;
+
+		ret = read_all(fd, p + len, bufsz - len);
+		if (ret < 0) {
+			rc = -errno;
+			break;
+		}
+		len += ret;
+		if (len < bufsz)
+			break;
+		bufsz *= 2;
+	} while (bufsz <= PROCSNAP_MAXSZ);
+
+	close(fd);
+
+	if (!rc && len == bufsz)
+		rc = -EFBIG;
+	if (rc) {
+		free(p);
+		return rc;
+	}
+	*buf = p;
+	*sz = len;
+	return 0;
+}
+
+/*
+ * Reads all the snapshot files, writes a new snapshot and returns stream for
+ * @path. The snapshot is not written if a module has been (un)loaded while
+ * the files were read.
+ */
+static FILE *snapshot_update(const char *path)
+{
+	struct procsnap_entry ent[ARRAY_SIZE(procsnap_files)];
+	char *content[ARRAY_SIZE(procsnap_files)] = { NULL };
+	struct procsnap_head hd, cur;
+	char *buf = NULL, *tmpname = NULL;
+	size_t i, sz = 0, datasz = 0, bufsz;
+	FILE *f = NULL;
+	int fd, rc;
+
+	memset(&hd, 0, sizeof(hd));
+	memcpy(hd.magic, PROCSNAP_MAGIC, sizeof(hd.magic));
+
+	if (get_modgen(&hd) != 0 || get_boot_id(hd.boot_id) != 0)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(procsnap_files); i++) {
+		if (read_procfile(procsnap_files[i], &content[i], &sz) != 0)
+			goto done;
+		ent[i].hash = path_hash(procsnap_files[i]);
+		ent[i].offset = datasz;
+		ent[i].size = sz;
+		datasz += sz;
+
+		if (strcmp(path, procsnap_files[i]) == 0)
+			f = mem_fopen(content[i], sz);
+	}
+
+	memset(&cur, 0, sizeof(cur));
+	if (get_modgen(&cur) != 0
+	    || cur.mod_nlink != hd.mod_nlink
+	    || cur.mod_sec != hd.mod_sec
+	    || cur.mod_nsec != hd.mod_nsec)
+		goto done;
+
+	datasz += sizeof(ent);
+	bufsz = sizeof(hd) + datasz;
+	if (bufsz > PROCSNAP_MAXSZ)
+		goto done;
+
+	buf = malloc(bufsz);
+	if (!buf)
+		goto done;
+
+	memcpy(buf + sizeof(hd), ent, sizeof(ent));
+	for (i = 0, sz = sizeof(hd) + sizeof(ent);
+	     i < ARRAY_SIZE(procsnap_files); sz += ent[i].size, i++)
+		memcpy(buf + sz, content[i], ent[i].size);
+
+	hd.nfiles = ARRAY_SIZE(procsnap_files);
+	hd.datasz = datasz;
+	hd.checksum = ul_xxh64(buf + sizeof(hd), datasz, 0);
+	memcpy(buf, &hd, sizeof(hd));
+
+	if (ul_mkdir_p(_PATH_UL_RUNSTATEDIR, 0755) != 0)
+		goto done;
+
+	fd = xmkstemp(&tmpname, _PATH_UL_RUNSTATEDIR, "procsnap");
+	if (fd < 0)
+		goto done;
+
+	rc = fchmod(fd, 0644) == 0 && write_all(fd, buf, bufsz) == 0;
+	if (close(fd) != 0)
+		rc = 0;
+	if (!rc || rename(tmpname, _PATH_UL_PROCSNAP) != 0)
+		unlink(tmpname);
+done:
+	for (i = 0; i < ARRAY_SIZE(procsnap_files); i++)
+		free(content[i]);
+	free(tmpname);
+	free(buf);
+	return f;
+}
+
+/*
+ * Opens @path for reading. The snapshot files are served from the snapshot if
+ * it's valid, anything else (and everything on error) is opened by fopen().
+ */
+FILE *ul_procsnap_fopen(const char *path)
+{
+	FILE *f = NULL;
+
+	if (is_snapshot_file(path)) {
+		f = snapshot_fopen(path);
+		if (!f && geteuid() == 0)
+			f = snapshot_update(path);
+	}
+	if (!f)
+		f = fopen(path, "r" UL_CLOEXECSTR);
+	return f;
+}
+
+#ifdef TEST_PROGRAM_PROCSNAP
+int main(int argc, char *argv[])
+{
+	FILE *f;
+	int c;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	f = ul_procsnap_fopen(argv[1]);
+	if (!f)
+		err(EXIT_FAILURE, "cannot open %s", argv[1]);
+
+	while ((c = fgetc(f)) != EOF)
+		putchar(c);
+
+	fclose(f);
+	return EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_PROCSNAP */
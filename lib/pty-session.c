@@ -43,6 +43,9 @@ UL_DEBUG_DEFINE_MASKNAMES(ulpty) = UL_DEBUG_EMPTY_MASKNAMES;
 #define UL_DEBUG_CURRENT_MASK   UL_DEBUG_MASK(ulpty)
 #include "debugobj.h"
 
+/* stdin is not read when the child does not read so much queued data */
+#define PTY_CHILD_BUFFER_MAX	(64 * BUFSIZ)
+
 void ul_pty_init_debug(int mask)
 {
 	if (ulpty_debug_mask)
@@ -321,6 +324,7 @@ static int schedule_child_write(struct ul_pty *pty, char *buf, size_t bufsz, int
 	memcpy(stash->buf, buf, bufsz);
 	stash->size = bufsz;
 	stash->final_input = final ? 1 : 0;
+	pty->child_buffer_size += bufsz;
 
 	if (pty->child_buffer_head)
 		pty->child_buffer_tail = pty->child_buffer_tail->next = stash;
@@ -385,6 +389,7 @@ static int flush_child_buffers(struct ul_pty *pty, int *anything)
 		DBG(IO, ul_debugobj(hd, "   wrote %zd", ret));
 		any = 1;
 		hd->cursor += ret;
+		pty->child_buffer_size -= ret;
 
 		if (hd->cursor == hd->size) {
 			pty->child_buffer_head = hd->next;
@@ -595,7 +600,7 @@ static int handle_signal(struct ul_pty *pty, int fd)
 /* loop in parent */
 int ul_pty_proxy_master(struct ul_pty *pty)
 {
-	int rc = 0, ret, eof = 0;
+	int rc = 0, ret, eof = 0, stdin_closed = 0;
 	enum {
 		POLLFD_SIGNAL = 0,
 		POLLFD_MASTER,
@@ -649,6 +654,11 @@ int ul_pty_proxy_master(struct ul_pty *pty)
 		else
 			pfd[POLLFD_MASTER].events &= ~POLLOUT;
 
+		/* don't read stdin faster than the child reads its input */
+		if (!stdin_closed)
+			pfd[POLLFD_STDIN].fd = pty->child_buffer_size < PTY_CHILD_BUFFER_MAX ?
+						STDIN_FILENO : -1;
+
 		/* wait for input, signal or timeout */
 		DBG(IO, ul_debugobj(pty, "calling poll() [timeout=%dms]", timeout));
 		ret = poll(pfd, ARRAY_SIZE(pfd), timeout);
@@ -724,6 +734,7 @@ int ul_pty_proxy_master(struct ul_pty *pty)
 				DBG(IO, ul_debugobj(pty, " ignore FD"));
 				if (i == POLLFD_STDIN) {
 					pfd[i].fd = -1;
+					stdin_closed = 1;
 					ul_pty_write_eof_to_child(pty);
 				} else /* i == POLLFD_MASTER */
 					pfd[i].revents &= ~POLLIN;
@@ -0,0 +1,184 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * ul_regex_literal() returns a string which is part of every text matched by
+ * a regular expression, so the text which does not contain the string may be
+ * skipped without regexec(). It's usable for the basic regular expressions
+ * (regcomp() without REG_EXTENDED and REG_ICASE) in UTF-8 or single-byte
+ * encoding.
+ */
+#include <string.h>
+
+#include "c.h"
+#include "regexutils.h"
+
+/* removes the last (multibyte) char from the string of @len bytes */
+static size_t remove_last_char(const char *s, size_t len)
+{
+	while (len > 0 && ((unsigned char) s[len - 1] & 0xC0) == 0x80)
+		len--;
+	return len ? len - 1 : 0;
+}
+
+/* returns position after the bracket expression which starts at @p */
+static const char *skip_bracket(const char *p)
+{
+	p++;				/* '[' */
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	while (*p && *p != ']') {
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			char end = p[1];
+
+			for (p += 2; *p && !(*p == end && p[1] == ']'); p++);
+			if (*p)
+				p += 2;
+			continue;
+		}
+		p++;
+	}
+	return *p ? p + 1 : p;
+}
+
+/**
+ * ul_regex_literal:
+ * @pattern: basic regular expression
+ * @buf: buffer for the result
+ * @bufsz: size of the buffer
+ *
+ * Finds the longest string which has to be in every match of the @pattern.
+ * The string is written to @buf (truncated if necessary).
+ *
+ * Returns: length of the string or 0 if there is none.
+ */
+size_t ul_regex_literal(const char *pattern, char *buf, size_t bufsz)
+{
+	const char *p = pattern;
+	size_t runsz = 0, bestsz = 0;
+	const char *best = NULL;
+	char run[256];
+	int depth = 0;
+	int atstart = 1;	/* at the begin of the (sub)expression */
+	int lastchar = 0;	/* the previous atom is the last char of run[] */
+
+#define END_RUN() do { \
+		if (runsz > bestsz) { \
+			memcpy(buf, run, min(runsz, bufsz - 1)); \
+			bestsz = runsz; \
+			best = buf; \
+		} \
+		runsz = 0; \
+		lastchar = 0; \
+	} while (0)
+
+	if (!bufsz)
+		return 0;
+
+	while (*p) {
+		int lit = -1;
+
+		if (*p == '\\') {
+			p++;
+			switch (*p) {
+			case '\0':
+				return 0;
+			case '|':
+				if (depth == 0)
+					return 0;
+				END_RUN();
+				atstart = 1;
+				p++;
+				continue;
+			case '(':
+				depth++;
+				END_RUN();
+				atstart = 1;
+				p++;
+				continue;
+			case ')':
+				depth--;
+				END_RUN();
+				break;
+			case '?':
+			case '{':
+				/* the previous atom is optional */
+				if (lastchar)
+					runsz = remove_last_char(run, runsz);
+				END_RUN();
+				if (*p == '{') {
+					while (*p && !(*p == '\\' && p[1] == '}'))
+						p++;
+					if (!*p)
+						return 0;
+					p++;
+				}
+				break;
+			case '.': case '[': case ']': case '*':
+			case '^': case '$': case '\\': case '/':
+				lit = *p;
+				break;
+			default:
+				/* back-references, \+, \w, \b, ... */
+				END_RUN();
+				break;
+			}
+			p++;
+		} else if (*p == '[') {
+			END_RUN();
+			p = skip_bracket(p);
+		} else if (*p == '.') {
+			END_RUN();
+			p++;
+		} else if (*p == '*' && !atstart) {
+			if (lastchar)
+				runsz = remove_last_char(run, runsz);
+			END_RUN();
+			p++;
+		} else if (*p == '^' && atstart) {
+			p++;
+			continue;		/* still at start for '*' */
+		} else if (*p == '$' && (!p[1] || (p[1] == '\\'
+				&& (p[2] == ')' || p[2] == '|')))) {
+			END_RUN();
+			p++;
+		} else
+			lit = (unsigned char) *p++;
+
+		atstart = 0;
+		if (lit < 0)
+			continue;
+		if (depth > 0)
+			continue;	/* the group may be optional */
+		if (runsz + 1 < sizeof(run)) {
+			run[runsz++] = lit;
+			lastchar = 1;
+		} else
+			END_RUN();
+	}
+	END_RUN();
+#undef END_RUN
+
+	if (!best)
+		return 0;
+	bestsz = min(bestsz, bufsz - 1);
+	buf[bestsz] = '\0';
+	return bestsz;
+}
+
+#ifdef TEST_PROGRAM_REGEXUTILS
+int main(int argc, char *argv[])
+{
+	char buf[256];
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		size_t sz = ul_regex_literal(argv[i], buf, sizeof(buf));
+
+		printf("%s: '%s'\n", argv[i], sz ? buf : "");
+	}
+	return EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_REGEXUTILS */
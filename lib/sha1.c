@@ -16,6 +16,16 @@
 
 #include "sha1.h"
 
+#if defined(__x86_64__) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <immintrin.h>
+# define UL_SHA1_X86	1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2) && \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# include <arm_neon.h>
+# define UL_SHA1_ARM	1
+#endif
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
 /* blk0() and blk() perform the initial expand. */
@@ -38,7 +48,7 @@
 
 /* Hash a single 512-bit block. This is the core of the algorithm. */
 
-void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
+void ul_SHA1Transform_generic(uint32_t state[5], const unsigned char buffer[64])
 {
 	uint32_t a, b, c, d, e;
 
@@ -159,6 +169,395 @@ void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
 #endif
 }
 
+#if defined(UL_SHA1_X86)
+/* SHA-NI (SHA extensions) kernel, selected at runtime */
+static void __attribute__((target("sha,sse4.1")))
+sha1_transform_shani(uint32_t state[5], const unsigned char buffer[64])
+{
+	__m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+	__m128i MSG0, MSG1, MSG2, MSG3;
+	const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL,
+					    0x08090a0b0c0d0e0fULL);
+
+	ABCD = _mm_loadu_si128((const __m128i *) state);
+	E0 = _mm_set_epi32(state[4], 0, 0, 0);
+	ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+
+	ABCD_SAVE = ABCD;
+	E0_SAVE = E0;
+
+	MSG0 = _mm_loadu_si128((const __m128i *) buffer);
+	MSG0 = _mm_shuffle_epi8(MSG0, MASK);
+
+	/* Rounds 0-3 */
+	E0 = _mm_add_epi32(E0, MSG0);
+	E1 = ABCD;
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+	/* Rounds 4-7 */
+	MSG1 = _mm_loadu_si128((const __m128i *) (buffer + 16));
+	MSG1 = _mm_shuffle_epi8(MSG1, MASK);
+	E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	E0 = ABCD;
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+	MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+
+	/* Rounds 8-11 */
+	MSG2 = _mm_loadu_si128((const __m128i *) (buffer + 32));
+	MSG2 = _mm_shuffle_epi8(MSG2, MASK);
+	E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	E1 = ABCD;
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+	MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+	/* Rounds 12-15 */
+	MSG3 = _mm_loadu_si128((const __m128i *) (buffer + 48));
+	MSG3 = _mm_shuffle_epi8(MSG3, MASK);
+	E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	E0 = ABCD;
+	MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
+	MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+	/* Rounds 16-19 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	E1 = ABCD;
+	MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+	MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+	/* Rounds 20-23 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	E0 = ABCD;
+	MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+	MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+	/* Rounds 24-27 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	E1 = ABCD;
+	MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+	MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+	/* Rounds 28-31 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	E0 = ABCD;
+	MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+	MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+	/* Rounds 32-35 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	E1 = ABCD;
+	MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 1);
+	MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+	/* Rounds 36-39 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	E0 = ABCD;
+	MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 1);
+	MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+	/* Rounds 40-43 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	E1 = ABCD;
+	MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+	MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+	/* Rounds 44-47 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	E0 = ABCD;
+	MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+	MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+	/* Rounds 48-51 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	E1 = ABCD;
+	MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+	MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+	/* Rounds 52-55 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	E0 = ABCD;
+	MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 2);
+	MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+	/* Rounds 56-59 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	E1 = ABCD;
+	MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 2);
+	MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+	/* Rounds 60-63 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	E0 = ABCD;
+	MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+	MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+	MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+	/* Rounds 64-67 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG0);
+	E1 = ABCD;
+	MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+	MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+	MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+	/* Rounds 68-71 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG1);
+	E0 = ABCD;
+	MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+	MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+	/* Rounds 72-75 */
+	E0 = _mm_sha1nexte_epu32(E0, MSG2);
+	E1 = ABCD;
+	MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 3);
+
+	/* Rounds 76-79 */
+	E1 = _mm_sha1nexte_epu32(E1, MSG3);
+	E0 = ABCD;
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 3);
+
+	/* Add the working vars back into state[] */
+	E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+	ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+
+	ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+	_mm_storeu_si128((__m128i *) state, ABCD);
+	state[4] = _mm_extract_epi32(E0, 3);
+}
+
+int ul_SHA1_has_hw(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sha") &&
+	       __builtin_cpu_supports("sse4.1");
+}
+
+#elif defined(UL_SHA1_ARM)
+/* ARMv8 crypto extension (enabled at compile time by -march=...+crypto) */
+static void sha1_transform_armv8(uint32_t state[5], const unsigned char buffer[64])
+{
+	const uint32_t K0 = 0x5A827999, K1 = 0x6ED9EBA1,
+		       K2 = 0x8F1BBCDC, K3 = 0xCA62C1D6;
+	uint32x4_t ABCD, ABCD_SAVE, TMP0, TMP1;
+	uint32x4_t MSG0, MSG1, MSG2, MSG3;
+	uint32_t E0, E0_SAVE, E1;
+
+	ABCD = vld1q_u32(&state[0]);
+	E0 = state[4];
+
+	ABCD_SAVE = ABCD;
+	E0_SAVE = E0;
+
+	MSG0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer)));
+	MSG1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer + 16)));
+	MSG2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer + 32)));
+	MSG3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buffer + 48)));
+
+	TMP0 = vaddq_u32(MSG0, vdupq_n_u32(K0));
+	TMP1 = vaddq_u32(MSG1, vdupq_n_u32(K0));
+
+	/* Rounds 0-3 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG2, vdupq_n_u32(K0));
+	MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+	/* Rounds 4-7 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG3, vdupq_n_u32(K0));
+	MSG0 = vsha1su1q_u32(MSG0, MSG3);
+	MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+	/* Rounds 8-11 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG0, vdupq_n_u32(K0));
+	MSG1 = vsha1su1q_u32(MSG1, MSG0);
+	MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+	/* Rounds 12-15 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1cq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG1, vdupq_n_u32(K1));
+	MSG2 = vsha1su1q_u32(MSG2, MSG1);
+	MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+	/* Rounds 16-19 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1cq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG2, vdupq_n_u32(K1));
+	MSG3 = vsha1su1q_u32(MSG3, MSG2);
+	MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+	/* Rounds 20-23 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG3, vdupq_n_u32(K1));
+	MSG0 = vsha1su1q_u32(MSG0, MSG3);
+	MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+	/* Rounds 24-27 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG0, vdupq_n_u32(K1));
+	MSG1 = vsha1su1q_u32(MSG1, MSG0);
+	MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+	/* Rounds 28-31 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG1, vdupq_n_u32(K1));
+	MSG2 = vsha1su1q_u32(MSG2, MSG1);
+	MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+	/* Rounds 32-35 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG2, vdupq_n_u32(K2));
+	MSG3 = vsha1su1q_u32(MSG3, MSG2);
+	MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+	/* Rounds 36-39 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG3, vdupq_n_u32(K2));
+	MSG0 = vsha1su1q_u32(MSG0, MSG3);
+	MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+	/* Rounds 40-43 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG0, vdupq_n_u32(K2));
+	MSG1 = vsha1su1q_u32(MSG1, MSG0);
+	MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+	/* Rounds 44-47 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG1, vdupq_n_u32(K2));
+	MSG2 = vsha1su1q_u32(MSG2, MSG1);
+	MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+	/* Rounds 48-51 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG2, vdupq_n_u32(K2));
+	MSG3 = vsha1su1q_u32(MSG3, MSG2);
+	MSG0 = vsha1su0q_u32(MSG0, MSG1, MSG2);
+
+	/* Rounds 52-55 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1mq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG3, vdupq_n_u32(K3));
+	MSG0 = vsha1su1q_u32(MSG0, MSG3);
+	MSG1 = vsha1su0q_u32(MSG1, MSG2, MSG3);
+
+	/* Rounds 56-59 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1mq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG0, vdupq_n_u32(K3));
+	MSG1 = vsha1su1q_u32(MSG1, MSG0);
+	MSG2 = vsha1su0q_u32(MSG2, MSG3, MSG0);
+
+	/* Rounds 60-63 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG1, vdupq_n_u32(K3));
+	MSG2 = vsha1su1q_u32(MSG2, MSG1);
+	MSG3 = vsha1su0q_u32(MSG3, MSG0, MSG1);
+
+	/* Rounds 64-67 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+	TMP0 = vaddq_u32(MSG2, vdupq_n_u32(K3));
+	MSG3 = vsha1su1q_u32(MSG3, MSG2);
+
+	/* Rounds 68-71 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+	TMP1 = vaddq_u32(MSG3, vdupq_n_u32(K3));
+
+	/* Rounds 72-75 */
+	E1 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E0, TMP0);
+
+	/* Rounds 76-79 */
+	E0 = vsha1h_u32(vgetq_lane_u32(ABCD, 0));
+	ABCD = vsha1pq_u32(ABCD, E1, TMP1);
+
+	/* Add the working vars back into state[] */
+	E0 += E0_SAVE;
+	ABCD = vaddq_u32(ABCD_SAVE, ABCD);
+
+	vst1q_u32(&state[0], ABCD);
+	state[4] = E0;
+}
+
+int ul_SHA1_has_hw(void)
+{
+	return 1;
+}
+
+#else
+int ul_SHA1_has_hw(void)
+{
+	return 0;
+}
+#endif
+
+typedef void (*sha1_transform_fn)(uint32_t state[5], const unsigned char buffer[64]);
+
+static sha1_transform_fn sha1_get_transform(void)
+{
+	static sha1_transform_fn fn;
+
+	if (!fn) {
+		fn = ul_SHA1Transform_generic;
+#if defined(UL_SHA1_X86)
+		if (ul_SHA1_has_hw())
+			fn = sha1_transform_shani;
+#elif defined(UL_SHA1_ARM)
+		fn = sha1_transform_armv8;
+#endif
+	}
+	return fn;
+}
+
+/* Hash a single 512-bit block by the best available implementation. */
+
+void ul_SHA1Transform(uint32_t state[5], const unsigned char buffer[64])
+{
+	sha1_get_transform()(state, buffer);
+}
+
 /* SHA1Init - Initialize new context */
 
 void ul_SHA1Init(UL_SHA1_CTX *context)
@@ -180,6 +579,8 @@ void ul_SHA1Update(UL_SHA1_CTX *context, const unsigned char *data, uint32_t len
 
 	uint32_t j;
 
+	sha1_transform_fn transform = sha1_get_transform();
+
 	j = context->count[0];
 	if ((context->count[0] += len << 3) < j)
 		context->count[1]++;
@@ -187,9 +588,9 @@ void ul_SHA1Update(UL_SHA1_CTX *context, const unsigned char *data, uint32_t len
 	j = (j >> 3) & 63;
 	if ((j + len) > 63) {
 		memcpy(&context->buffer[j], data, (i = 64 - j));
-		ul_SHA1Transform(context->state, context->buffer);
+		transform(context->state, context->buffer);
 		for (; i + 63 < len; i += 64) {
-			ul_SHA1Transform(context->state, &data[i]);
+			transform(context->state, &data[i]);
 		}
 		j = 0;
 	} else
@@ -96,7 +96,18 @@ int parse_size(const char *str, uintmax_t *res, int *power)
 	}
 
 	errno = 0, end = NULL;
-	x = strtoumax(str, &end, 0);
+	if (*str >= '1' && *str <= '9') {
+		/* decimal number, octal and hex need the "0" prefix */
+		uint64_t num;
+		const char *e;
+
+		if (ul_parse_u64(str, &num, &e) == 0) {
+			x = num;
+			end = (char *) e;
+		} else
+			x = strtoumax(str, &end, 0);
+	} else
+		x = strtoumax(str, &end, 0);
 
 	if (end == str ||
 	    (errno != 0 && (x == UINTMAX_MAX || x == 0))) {
@@ -319,16 +330,130 @@ char *strndup(const char *s, size_t n)
 }
 #endif
 
+/*
+ * Locale independent parsers for machine generated numbers (/proc, sysfs,
+ * mountinfo, ...). Only plain ASCII digits are accepted; no leading white
+ * space, no '+' sign and no "0x" prefix. The parsers do not touch errno.
+ *
+ * Returns 0 and sets @end (if not NULL) to the first unparsed character,
+ * -EINVAL if there is no digit at @str or -ERANGE on overflow.
+ */
+static inline int is_ddigit(unsigned char c)
+{
+	return (unsigned char) (c - '0') < 10;
+}
+
+static inline int xdigit_value(unsigned char c)
+{
+	if (is_ddigit(c))
+		return c - '0';
+	c |= 0x20;				/* tolower() for letters */
+	if ((unsigned char) (c - 'a') < 6)
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* converts 8 validated decimal digits at once */
+static inline uint64_t parse_8digits(const char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	v = le64_to_cpu(v);
+	v = (v & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+	v = (v & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+	return (v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32;
+}
+
+int ul_parse_u64(const char *str, uint64_t *num, const char **end)
+{
+	const char *p = str, *digits;
+	uint64_t x = 0;
+	size_t n, m;
+
+	if (!is_ddigit(*p))
+		return -EINVAL;
+	while (*p == '0')
+		p++;
+	for (digits = p; is_ddigit(*p); p++);
+
+	n = p - digits;
+	if (n > 20)
+		return -ERANGE;
+
+	/* the first 19 digits cannot overflow */
+	for (m = min(n, (size_t) 19); m >= 8; m -= 8, digits += 8)
+		x = x * 100000000 + parse_8digits(digits);
+	while (m--)
+		x = x * 10 + (*digits++ - '0');
+	if (n == 20) {
+		unsigned int d = *digits - '0';
+
+		if (x > (UINT64_MAX - d) / 10)
+			return -ERANGE;
+		x = x * 10 + d;
+	}
+
+	*num = x;
+	if (end)
+		*end = p;
+	return 0;
+}
+
+int ul_parse_s64(const char *str, int64_t *num, const char **end)
+{
+	uint64_t x;
+	int neg = *str == '-';
+	int rc;
+
+	rc = ul_parse_u64(str + neg, &x, end);
+	if (rc)
+		return rc;
+	if (x > (uint64_t) INT64_MAX + neg)
+		return -ERANGE;
+
+	*num = neg ? (int64_t) -x : (int64_t) x;
+	return 0;
+}
+
+int ul_parse_x64(const char *str, uint64_t *num, const char **end)
+{
+	const char *p = str;
+	uint64_t x = 0;
+	int d;
+
+	if (xdigit_value(*p) < 0)
+		return -EINVAL;
+	while (*p == '0')
+		p++;
+	for (; (d = xdigit_value(*p)) >= 0; p++) {
+		if (x >> 60)
+			return -ERANGE;
+		x = (x << 4) | d;
+	}
+
+	*num = x;
+	if (end)
+		*end = p;
+	return 0;
+}
+
 /*
  * convert strings to numbers; returns <0 on error, and 0 on success
  */
 int ul_strtos64(const char *str, int64_t *num, int base)
 {
 	char *end = NULL;
+	const char *p;
 
 	if (str == NULL || *str == '\0')
 		return -(errno = EINVAL);
 
+	/* fast path for plain decimal numbers, the rest (white space,
+	 * prefixes, errors) is up to libc */
+	if (base == 10 && ul_parse_s64(str, num, &p) == 0 && !*p)
+		return 0;
+
 	errno = 0;
 	*num = (int64_t) strtoimax(str, &end, base);
 
@@ -342,11 +467,19 @@ int ul_strtos64(const char *str, int64_t *num, int base)
 int ul_strtou64(const char *str, uint64_t *num, int base)
 {
 	char *end = NULL;
+	const char *p;
 	int64_t tmp;
 
 	if (str == NULL || *str == '\0')
 		return -(errno = EINVAL);
 
+	if (base == 10 || base == 16) {
+		int rc = base == 10 ? ul_parse_u64(str, num, &p) :
+				      ul_parse_x64(str, num, &p);
+		if (rc == 0 && !*p)
+			return 0;
+	}
+
 	/* we need to ignore negative numbers, note that for invalid negative
 	 * number strtoimax() returns negative number too, so we do not
 	 * need to check errno here */
@@ -0,0 +1,212 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * The --stats output of the tools, see include/ulstats.h.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "c.h"
+#include "nls.h"
+#include "ulstats.h"
+
+#define UL_STATS_MAXPHASES	8
+
+struct ul_stats_phase {
+	const char	*name;
+	double		msec;
+};
+
+int ul_stats_enabled;
+uint64_t ul_stats_calls[UL_STATS_NCALLS];
+uint64_t ul_stats_bytes;
+
+static const char *const call_names[] = {
+	[UL_STATS_OPEN]     = "open",
+	[UL_STATS_READ]     = "read",
+	[UL_STATS_STAT]     = "stat",
+	[UL_STATS_READLINK] = "readlink",
+	[UL_STATS_OPENDIR]  = "opendir"
+};
+
+static struct ul_stats_phase phases[UL_STATS_MAXPHASES];
+static size_t nphases;
+static struct ul_stats_phase *cur_phase;
+static double start_msec, phase_start_msec;
+static int stats_format;
+
+/* from /proc/self/io */
+struct ul_stats_io {
+	uint64_t	rchar, wchar, syscr, syscw;
+};
+
+static double get_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double timeval_to_msec(const struct timeval *tv)
+{
+	return tv->tv_sec * 1e3 + tv->tv_usec / 1e3;
+}
+
+static int read_proc_io(struct ul_stats_io *io)
+{
+	char name[16];
+	uint64_t val;
+	FILE *f;
+
+	memset(io, 0, sizeof(*io));
+
+	f = fopen("/proc/self/io", "r" UL_CLOEXECSTR);
+	if (!f)
+		return -errno;
+	while (fscanf(f, "%15[^:]: %"SCNu64"\n", name, &val) == 2) {
+		if (strcmp(name, "rchar") == 0)
+			io->rchar = val;
+		else if (strcmp(name, "wchar") == 0)
+			io->wchar = val;
+		else if (strcmp(name, "syscr") == 0)
+			io->syscr = val;
+		else if (strcmp(name, "syscw") == 0)
+			io->syscw = val;
+	}
+	fclose(f);
+	return 0;
+}
+
+static void print_text(FILE *out, double total, const struct ul_stats_io *io,
+		       int have_io, const struct rusage *ru)
+{
+	size_t i;
+
+	fputs(_("Phases:\n"), out);
+	for (i = 0; i < nphases; i++)
+		fprintf(out, "  %-12s %10.3f ms\n", phases[i].name, phases[i].msec);
+	fprintf(out, "  %-12s %10.3f ms\n", _("total"), total);
+
+	fputs(_("sysfs/procfs calls:\n"), out);
+	for (i = 0; i < UL_STATS_NCALLS; i++)
+		fprintf(out, "  %-12s %10"PRIu64"\n", call_names[i], ul_stats_calls[i]);
+	fprintf(out, "  %-12s %10"PRIu64"\n", _("bytes read"), ul_stats_bytes);
+
+	if (have_io) {
+		fputs(_("Process I/O:\n"), out);
+		fprintf(out, _("  read         %10"PRIu64" calls, %"PRIu64" bytes\n"),
+				io->syscr, io->rchar);
+		fprintf(out, _("  write        %10"PRIu64" calls, %"PRIu64" bytes\n"),
+				io->syscw, io->wchar);
+	}
+
+	fputs(_("CPU time:\n"), out);
+	fprintf(out, "  %-12s %10.3f ms\n", _("user"), timeval_to_msec(&ru->ru_utime));
+	fprintf(out, "  %-12s %10.3f ms\n", _("system"), timeval_to_msec(&ru->ru_stime));
+}
+
+/* the names are static ASCII strings, no escaping needed */
+static void print_json(FILE *out, double total, const struct ul_stats_io *io,
+		       int have_io, const struct rusage *ru)
+{
+	size_t i;
+
+	fputs("{\"stats\": {\"phases\": {", out);
+	for (i = 0; i < nphases; i++)
+		fprintf(out, "\"%s\": %.3f, ", phases[i].name, phases[i].msec);
+	fprintf(out, "\"total\": %.3f}, \"calls\": {", total);
+
+	for (i = 0; i < UL_STATS_NCALLS; i++)
+		fprintf(out, "\"%s\": %"PRIu64", ", call_names[i], ul_stats_calls[i]);
+	fprintf(out, "\"bytes\": %"PRIu64"}, ", ul_stats_bytes);
+
+	if (have_io)
+		fprintf(out, "\"io\": {\"syscr\": %"PRIu64", \"rchar\": %"PRIu64", "
+			     "\"syscw\": %"PRIu64", \"wchar\": %"PRIu64"}, ",
+			     io->syscr, io->rchar, io->syscw, io->wchar);
+
+	fprintf(out, "\"cpu\": {\"user\": %.3f, \"system\": %.3f}}}\n",
+			timeval_to_msec(&ru->ru_utime),
+			timeval_to_msec(&ru->ru_stime));
+}
+
+static void stats_print(void)
+{
+	struct ul_stats_io io;
+	struct rusage ru;
+	double total;
+	int have_io;
+
+	ul_stats_phase(NULL);
+	total = get_msec() - start_msec;
+	ul_stats_enabled = 0;
+
+	have_io = read_proc_io(&io) == 0;
+	getrusage(RUSAGE_SELF, &ru);
+
+	fflush(stdout);
+	if (stats_format == UL_STATS_JSON)
+		print_json(stderr, total, &io, have_io, &ru);
+	else
+		print_text(stderr, total, &io, have_io, &ru);
+}
+
+/* "text" or "json", NULL is "text" */
+int ul_stats_parse_format(const char *str)
+{
+	if (!str || strcmp(str, "text") == 0)
+		return UL_STATS_TEXT;
+	if (strcmp(str, "json") == 0)
+		return UL_STATS_JSON;
+	return -EINVAL;
+}
+
+/* enables the counters, the statistics are printed at exit */
+void ul_stats_init(int format)
+{
+	if (ul_stats_enabled)
+		return;
+	stats_format = format;
+	start_msec = phase_start_msec = get_msec();
+	ul_stats_enabled = 1;
+	atexit(stats_print);
+}
+
+/*
+ * Ends the current phase and starts the phase @name, the time of the same
+ * phase is summed. NULL ends the current phase only.
+ */
+void ul_stats_phase(const char *name)
+{
+	double now;
+	size_t i;
+
+	if (!ul_stats_enabled)
+		return;
+
+	now = get_msec();
+	if (cur_phase)
+		cur_phase->msec += now - phase_start_msec;
+	phase_start_msec = now;
+	cur_phase = NULL;
+
+	if (!name)
+		return;
+	for (i = 0; i < nphases; i++) {
+		if (strcmp(phases[i].name, name) == 0) {
+			cur_phase = &phases[i];
+			return;
+		}
+	}
+	if (nphases < UL_STATS_MAXPHASES) {
+		cur_phase = &phases[nphases++];
+		cur_phase->name = name;
+	}
+}
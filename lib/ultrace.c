@@ -0,0 +1,209 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * The recorder for the ultrace.h spans. Every thread has its own ring buffer
+ * of the latest events, so the recording does not need any lock. The buffers
+ * are written at exit, appended to the ULTRACE= file. The libraries and the
+ * program have their own copy of this code, they all append to the same file;
+ * every write() contains complete lines only and the final "]" of the JSON
+ * array is optional in the trace event format.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "c.h"
+#include "all-io.h"
+#include "env.h"
+#include "ultrace.h"
+
+#define UL_TRACE_NEVENTS	4096	/* the latest events kept per thread */
+
+struct ul_trace_event {
+	const char	*name;
+	uint64_t	start;
+	uint64_t	end;
+};
+
+struct ul_trace_buf {
+	struct ul_trace_event	events[UL_TRACE_NEVENTS];
+	uint64_t		nevents;	/* all the recorded events */
+	pid_t			pid;		/* owner, the buffers are inherited by fork() */
+	pid_t			tid;
+	struct ul_trace_buf	*next;
+};
+
+int ul_trace_enabled = -1;
+
+static char *trace_file;
+static struct ul_trace_buf *trace_bufs;		/* all the threads */
+static __thread struct ul_trace_buf *thread_buf;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int open_trace_file(void)
+{
+	int fd;
+
+	/* the first writer starts the JSON array */
+	fd = open(trace_file, O_WRONLY|O_CREAT|O_EXCL|O_APPEND|O_CLOEXEC, 0644);
+	if (fd >= 0) {
+		if (write_all(fd, "[\n", 2) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+	if (errno != EEXIST)
+		return -1;
+	return open(trace_file, O_WRONLY|O_APPEND|O_CLOEXEC);
+}
+
+static void trace_dump(void)
+{
+	struct ul_trace_buf *buf;
+	char out[BUFSIZ];
+	size_t len = 0;
+	pid_t pid = getpid();
+	int fd;
+
+	__atomic_store_n(&ul_trace_enabled, 0, __ATOMIC_RELAXED);
+
+	fd = open_trace_file();
+	if (fd < 0)
+		return;
+
+	for (buf = __atomic_load_n(&trace_bufs, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+		uint64_t i = buf->nevents > UL_TRACE_NEVENTS ?
+				buf->nevents - UL_TRACE_NEVENTS : 0;
+
+		if (buf->pid != pid)
+			continue;
+
+		for (; i < buf->nevents; i++) {
+			struct ul_trace_event *ev = &buf->events[i % UL_TRACE_NEVENTS];
+			uint64_t dur = ev->end - ev->start;
+			int rc;
+
+			if (sizeof(out) - len < 256 + strlen(ev->name)) {
+				if (write_all(fd, out, len) != 0)
+					goto done;
+				len = 0;
+			}
+			/* the timestamps are in microseconds */
+			rc = snprintf(out + len, sizeof(out) - len,
+				"{\"name\":\"%s\",\"ph\":\"X\","
+				"\"ts\":%"PRIu64".%03u,\"dur\":%"PRIu64".%03u,"
+				"\"pid\":%d,\"tid\":%d},\n",
+				ev->name,
+				ev->start / 1000, (unsigned int) (ev->start % 1000),
+				dur / 1000, (unsigned int) (dur % 1000),
+				(int) buf->pid, (int) buf->tid);
+			if (rc > 0 && (size_t) rc < sizeof(out) - len)
+				len += rc;
+		}
+	}
+	if (len)
+		write_all(fd, out, len);
+done:
+	close(fd);
+}
+
+static void trace_init(void)
+{
+	static int initializing;
+	const char *fn;
+
+	/* the other thread does the initialization, don't trace meanwhile */
+	if (__atomic_exchange_n(&initializing, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	/* safe_getenv(), the file is created with the effective UID */
+	fn = safe_getenv("ULTRACE");
+	if (fn && *fn) {
+		trace_file = strdup(fn);
+		if (trace_file && atexit(trace_dump) == 0) {
+			__atomic_store_n(&ul_trace_enabled, 1, __ATOMIC_RELEASE);
+			return;
+		}
+	}
+	__atomic_store_n(&ul_trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+/* returns the start of the span, or 0 if the tracing is disabled */
+uint64_t ul_trace_start(void)
+{
+	if (ul_trace_enabled < 0)
+		trace_init();
+	return ul_trace_enabled > 0 ? now_ns() : 0;
+}
+
+void ul_trace_record(const char *name, uint64_t start)
+{
+	struct ul_trace_buf *buf = thread_buf;
+	struct ul_trace_event *ev;
+	pid_t pid = getpid();
+
+	if (!buf) {
+		buf = calloc(1, sizeof(*buf));
+		if (!buf)
+			return;
+		buf->next = __atomic_load_n(&trace_bufs, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&trace_bufs, &buf->next, buf, 1,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+		thread_buf = buf;
+	}
+	if (buf->pid != pid) {
+		/* new buffer, or the events of the parent process */
+		buf->pid = pid;
+#ifdef SYS_gettid
+		buf->tid = (pid_t) syscall(SYS_gettid);
+#else
+		buf->tid = pid;
+#endif
+		buf->nevents = 0;
+	}
+
+	ev = &buf->events[buf->nevents++ % UL_TRACE_NEVENTS];
+	ev->name = name;
+	ev->start = start;
+	ev->end = now_ns();
+}
+
+#ifdef TEST_PROGRAM_ULTRACE
+static void traced_sleep(const char *name, useconds_t usec)
+{
+	struct ul_trace_span sp;
+
+	ul_trace_begin(&sp, name);
+	usleep(usec);
+	ul_trace_end(&sp);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ul_trace_span sp;
+	int i, n = argc > 1 ? atoi(argv[1]) : 3;
+
+	ul_trace_begin(&sp, "test:main");
+	for (i = 0; i < n; i++)
+		traced_sleep("test:sleep", 1000);
+	ul_trace_end(&sp);
+
+	return EXIT_SUCCESS;
+}
+#endif /* TEST_PROGRAM_ULTRACE */
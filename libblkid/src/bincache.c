@@ -0,0 +1,497 @@
+/*
+ * bincache.c - binary (mmap-able) version of the cache file
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The binary cache is written next to the text cache file (as
+ * <cachefile>.bin) when BINARY_CACHE=yes is specified in blkid.conf. The
+ * text file is still the primary (compatible) format; the binary file is
+ * used only if it describes the current version of the text file.
+ *
+ * The file is host private (usually in /run) and uses native byte order:
+ *
+ *	header
+ *	devices[ndevs]		- sorted as in the text file
+ *	tags[ntags]		- tags of the same device are stored together
+ *	buckets[nbuckets]	- hash of "NAME=value" -> first tag index
+ *	strings[strs_size]	- NUL terminated strings
+ *
+ * All references are indexes or offsets relative to the begin of the
+ * section, so the file could be queried directly from the mmap()ed area.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "all-io.h"
+#include "fileutils.h"
+
+#include "blkidP.h"
+
+#define BLKID_BINCACHE_MAGIC	"BLKIDBC"	/* 8 bytes including \0 */
+#define BLKID_BINCACHE_VERSION	1
+#define BLKID_BINCACHE_SUFFIX	".bin"
+#define BLKID_BINCACHE_END	UINT32_MAX	/* end of the hash chain */
+
+struct bincache_header {
+	char		magic[8];	/* BLKID_BINCACHE_MAGIC */
+	uint32_t	version;	/* BLKID_BINCACHE_VERSION */
+	uint32_t	size;		/* size of the whole file */
+	int64_t		ftime;		/* mtime of the text cache file (in nsec) */
+	uint64_t	fsize;		/* size of the text cache file */
+
+	uint32_t	ndevs;
+	uint32_t	ntags;
+	uint32_t	nbuckets;
+	uint32_t	strs_size;
+
+	uint32_t	devs_off;
+	uint32_t	tags_off;
+	uint32_t	buckets_off;
+	uint32_t	strs_off;
+};
+
+struct bincache_dev {
+	uint32_t	name;		/* offset in strings */
+	uint32_t	tags;		/* index of the first tag */
+	uint32_t	ntags;		/* number of tags */
+	int32_t		pri;
+	uint64_t	devno;
+	int64_t		time;
+	int64_t		utime;
+};
+
+struct bincache_tag {
+	uint32_t	name;		/* offset in strings */
+	uint32_t	value;		/* offset in strings */
+	uint32_t	dev;		/* index of the device */
+	uint32_t	hash;		/* blkid_tag_hash() of NAME=value */
+	uint32_t	next;		/* next tag in the same bucket */
+};
+
+struct blkid_bincache {
+	void				*map;
+	size_t				mapsz;
+
+	const struct bincache_header	*hdr;
+	const struct bincache_dev	*devs;
+	const struct bincache_tag	*tags;
+	const uint32_t			*buckets;
+	const char			*strs;
+};
+
+static char *bincache_filename(const char *filename)
+{
+	size_t len = strlen(filename) + sizeof(BLKID_BINCACHE_SUFFIX);
+	char *bin = malloc(len);
+
+	if (bin)
+		snprintf(bin, len, "%s" BLKID_BINCACHE_SUFFIX, filename);
+	return bin;
+}
+
+static int64_t file_mtime(const struct stat *st)
+{
+	return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static int is_saved_dev(blkid_dev dev)
+{
+	return dev->bid_name[0] == '/' && dev->bid_type &&
+	       !(dev->bid_flags & BLKID_BID_FL_REMOVABLE);
+}
+
+/*
+ * Writes binary version of the @cache to <filename>.bin. The @filename is
+ * the already written text cache file.
+ *
+ * Returns: 0 on success, <0 on error.
+ */
+int blkid_save_bincache(blkid_cache cache, const char *filename)
+{
+	struct bincache_header *hdr;
+	struct bincache_dev *devs;
+	struct bincache_tag *tags;
+	uint32_t *buckets;
+	char *strs, *buf = NULL, *bin = NULL, *tmp = NULL;
+	size_t ndevs = 0, ntags = 0, nbuckets, strs_size = 0, size;
+	size_t d, t, s;
+	struct list_head *p, *q;
+	struct stat st;
+	int fd = -1, rc = -ENOMEM;
+
+	if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+		return 0;
+
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (!is_saved_dev(dev))
+			continue;
+		ndevs++;
+		strs_size += strlen(dev->bid_name) + 1;
+
+		list_for_each(q, &dev->bid_tags) {
+			blkid_tag tag = list_entry(q, struct blkid_struct_tag, bit_tags);
+
+			ntags++;
+			strs_size += strlen(tag->bit_name) + strlen(tag->bit_val) + 2;
+		}
+	}
+
+	nbuckets = ntags ? ntags | 1 : 1;
+	size = sizeof(*hdr)
+		+ ndevs * sizeof(*devs)
+		+ ntags * sizeof(*tags)
+		+ nbuckets * sizeof(*buckets)
+		+ strs_size;
+	if (size > UINT32_MAX)
+		return -E2BIG;
+
+	buf = calloc(1, size);
+	if (!buf)
+		goto done;
+
+	hdr = (struct bincache_header *) buf;
+	memcpy(hdr->magic, BLKID_BINCACHE_MAGIC, sizeof(hdr->magic));
+	hdr->version = BLKID_BINCACHE_VERSION;
+	hdr->size = size;
+	hdr->ftime = file_mtime(&st);
+	hdr->fsize = st.st_size;
+	hdr->ndevs = ndevs;
+	hdr->ntags = ntags;
+	hdr->nbuckets = nbuckets;
+	hdr->strs_size = strs_size;
+	hdr->devs_off = sizeof(*hdr);
+	hdr->tags_off = hdr->devs_off + ndevs * sizeof(*devs);
+	hdr->buckets_off = hdr->tags_off + ntags * sizeof(*tags);
+	hdr->strs_off = hdr->buckets_off + nbuckets * sizeof(*buckets);
+
+	devs = (struct bincache_dev *) (buf + hdr->devs_off);
+	tags = (struct bincache_tag *) (buf + hdr->tags_off);
+	buckets = (uint32_t *) (buf + hdr->buckets_off);
+	strs = buf + hdr->strs_off;
+
+	for (s = 0; s < nbuckets; s++)
+		buckets[s] = BLKID_BINCACHE_END;
+
+	d = t = s = 0;
+	list_for_each(p, &cache->bic_devs) {
+		blkid_dev dev = list_entry(p, struct blkid_struct_dev, bid_devs);
+
+		if (!is_saved_dev(dev))
+			continue;
+
+		devs[d].name = s;
+		s += sprintf(strs + s, "%s", dev->bid_name) + 1;
+		devs[d].tags = t;
+		devs[d].pri = dev->bid_pri;
+		devs[d].devno = dev->bid_devno;
+		devs[d].time = dev->bid_time;
+		devs[d].utime = dev->bid_utime;
+
+		list_for_each(q, &dev->bid_tags) {
+			blkid_tag tag = list_entry(q, struct blkid_struct_tag, bit_tags);
+			uint32_t b;
+
+			tags[t].name = s;
+			s += sprintf(strs + s, "%s", tag->bit_name) + 1;
+			tags[t].value = s;
+			s += sprintf(strs + s, "%s", tag->bit_val) + 1;
+			tags[t].dev = d;
+			tags[t].hash = blkid_tag_hash(tag->bit_name, tag->bit_val);
+
+			b = tags[t].hash % nbuckets;
+			tags[t].next = buckets[b];
+			buckets[b] = t;
+			t++;
+		}
+		devs[d].ntags = t - devs[d].tags;
+		d++;
+	}
+
+	bin = bincache_filename(filename);
+	if (!bin)
+		goto done;
+	tmp = malloc(strlen(bin) + 8);
+	if (!tmp)
+		goto done;
+	sprintf(tmp, "%s-XXXXXX", bin);
+
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0) {
+		rc = -errno;
+		DBG(SAVE, ul_debug("%s: cannot create temporary file", bin));
+		goto done;
+	}
+	if (fchmod(fd, 0644) != 0 || write_all(fd, buf, size) != 0) {
+		rc = -errno;
+		unlink(tmp);
+		DBG(SAVE, ul_debug("%s: write failed", tmp));
+		goto done;
+	}
+	if (close(fd) != 0 || rename(tmp, bin) != 0) {
+		fd = -1;
+		rc = -errno;
+		unlink(tmp);
+		DBG(SAVE, ul_debug("can't rename %s to %s", tmp, bin));
+		goto done;
+	}
+	fd = -1;
+	rc = 0;
+	DBG(SAVE, ul_debug("binary cache %s written (%zu devices, %zu tags)",
+				bin, ndevs, ntags));
+done:
+	if (fd >= 0)
+		close(fd);
+	free(tmp);
+	free(bin);
+	free(buf);
+	return rc;
+}
+
+static int bincache_is_string(const struct blkid_bincache *bc, uint32_t off)
+{
+	return off < bc->hdr->strs_size;
+}
+
+static int bincache_verify(struct blkid_bincache *bc)
+{
+	const struct bincache_header *hdr = bc->hdr;
+	uint32_t i;
+
+	if (bc->mapsz < sizeof(*hdr)
+	    || memcmp(hdr->magic, BLKID_BINCACHE_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->version != BLKID_BINCACHE_VERSION
+	    || hdr->size != bc->mapsz
+	    || hdr->nbuckets == 0)
+		return -EINVAL;
+
+	if (hdr->devs_off != sizeof(*hdr)
+	    || hdr->tags_off != hdr->devs_off + (uint64_t) hdr->ndevs * sizeof(struct bincache_dev)
+	    || hdr->buckets_off != hdr->tags_off + (uint64_t) hdr->ntags * sizeof(struct bincache_tag)
+	    || hdr->strs_off != hdr->buckets_off + (uint64_t) hdr->nbuckets * sizeof(uint32_t)
+	    || (uint64_t) hdr->strs_off + hdr->strs_size != hdr->size)
+		return -EINVAL;
+
+	bc->devs = (const struct bincache_dev *) ((char *) bc->map + hdr->devs_off);
+	bc->tags = (const struct bincache_tag *) ((char *) bc->map + hdr->tags_off);
+	bc->buckets = (const uint32_t *) ((char *) bc->map + hdr->buckets_off);
+	bc->strs = (const char *) bc->map + hdr->strs_off;
+
+	/* all strings are terminated by the last byte */
+	if (hdr->strs_size && bc->strs[hdr->strs_size - 1] != '\0')
+		return -EINVAL;
+
+	for (i = 0; i < hdr->ndevs; i++) {
+		const struct bincache_dev *dev = &bc->devs[i];
+
+		if (!bincache_is_string(bc, dev->name)
+		    || (uint64_t) dev->tags + dev->ntags > hdr->ntags)
+			return -EINVAL;
+	}
+	for (i = 0; i < hdr->ntags; i++) {
+		const struct bincache_tag *tag = &bc->tags[i];
+
+		if (!bincache_is_string(bc, tag->name)
+		    || !bincache_is_string(bc, tag->value)
+		    || tag->dev >= hdr->ndevs
+		    || (tag->next != BLKID_BINCACHE_END && tag->next >= hdr->ntags))
+			return -EINVAL;
+	}
+	for (i = 0; i < hdr->nbuckets; i++) {
+		if (bc->buckets[i] != BLKID_BINCACHE_END
+		    && bc->buckets[i] >= hdr->ntags)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static void bincache_close(struct blkid_bincache *bc)
+{
+	if (!bc)
+		return;
+	if (bc->map)
+		munmap(bc->map, bc->mapsz);
+	free(bc);
+}
+
+/*
+ * Maps binary version of the text cache @filename. The @st is stat of the
+ * text file; the binary file is ignored if it does not match the text file.
+ *
+ * Returns: new handler or NULL if the binary cache is not usable.
+ */
+static struct blkid_bincache *bincache_open(const char *filename,
+					    const struct stat *st)
+{
+	struct blkid_bincache *bc = NULL;
+	struct stat bst;
+	char *bin;
+	int fd;
+
+	bin = bincache_filename(filename);
+	if (!bin)
+		return NULL;
+
+	fd = open(bin, O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		goto done;
+	if (fstat(fd, &bst) != 0 || !S_ISREG(bst.st_mode) || bst.st_size <= 0)
+		goto done;
+
+	bc = calloc(1, sizeof(*bc));
+	if (!bc)
+		goto done;
+
+	bc->mapsz = bst.st_size;
+	bc->map = mmap(NULL, bc->mapsz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (bc->map == MAP_FAILED) {
+		bc->map = NULL;
+		goto fail;
+	}
+	bc->hdr = (const struct bincache_header *) bc->map;
+
+	if (bincache_verify(bc) != 0) {
+		DBG(READ, ul_debug("%s: invalid binary cache", bin));
+		goto fail;
+	}
+	if (st && (bc->hdr->ftime != file_mtime(st)
+		   || bc->hdr->fsize != (uint64_t) st->st_size)) {
+		DBG(READ, ul_debug("%s: binary cache is out of date", bin));
+		goto fail;
+	}
+	DBG(READ, ul_debug("%s: mapped binary cache", bin));
+	goto done;
+fail:
+	bincache_close(bc);
+	bc = NULL;
+done:
+	if (fd >= 0)
+		close(fd);
+	free(bin);
+	return bc;
+}
+
+/*
+ * Returns: name of the device with the tag @type=@value (the device with the
+ * highest priority, as blkid_find_dev_with_tag()); the string is within the
+ * mapped area (no allocation). NULL if not found.
+ */
+static const char *bincache_find(struct blkid_bincache *bc,
+				 const char *type, const char *value)
+{
+	const struct bincache_dev *dev = NULL;
+	uint32_t h, i, n;
+
+	h = blkid_tag_hash(type, value);
+	i = bc->buckets[h % bc->hdr->nbuckets];
+
+	/* @n protects against loops in corrupted files */
+	for (n = 0; i != BLKID_BINCACHE_END && n < bc->hdr->ntags; n++) {
+		const struct bincache_tag *tag = &bc->tags[i];
+
+		if (tag->hash == h
+		    && strcmp(bc->strs + tag->name, type) == 0
+		    && strcmp(bc->strs + tag->value, value) == 0
+		    && (!dev || bc->devs[tag->dev].pri > dev->pri))
+			dev = &bc->devs[tag->dev];
+		i = tag->next;
+	}
+	return dev ? bc->strs + dev->name : NULL;
+}
+
+/*
+ * Looks up @type=@value in the binary version of the cache file (if enabled
+ * by BINARY_CACHE= in @conf, or in blkid.conf if @conf is NULL) without
+ * reading the cache. The binary file is used only if it matches the current
+ * text file; the device is probed to verify it still has the tag.
+ *
+ * Returns: allocated device name, or NULL if the caller has to read the
+ * cache.
+ */
+char *blkid_bincache_get_devname(struct blkid_config *conf, const char *type,
+				 const char *value)
+{
+	struct blkid_config *cf = conf ? conf : blkid_read_config(NULL);
+	struct blkid_bincache *bc = NULL;
+	char *filename = NULL, *res = NULL;
+	const char *name;
+	struct stat st;
+
+	if (!cf || !cf->bincache)
+		goto done;
+	filename = blkid_get_cache_filename(cf);
+	if (!filename || stat(filename, &st) != 0)
+		goto done;
+	bc = bincache_open(filename, &st);
+	if (!bc)
+		goto done;
+
+	name = bincache_find(bc, type, value);
+	if (name && blkid_verify_devname_tag(NULL, name, type, value))
+		res = strdup(name);
+
+	DBG(READ, ul_debug("binary cache %s=%s: %s", type, value,
+				res ? res : "not found"));
+done:
+	bincache_close(bc);
+	free(filename);
+	if (cf != conf)
+		blkid_free_config(cf);
+	return res;
+}
+
+/*
+ * Reads devices from the binary version of the text cache file into
+ * the @cache. The @st is stat of the text file.
+ *
+ * Returns: 0 on success, 1 if the binary cache is not usable.
+ */
+int blkid_read_bincache(blkid_cache cache, const struct stat *st)
+{
+	struct blkid_bincache *bc;
+	uint32_t i, t;
+
+	bc = bincache_open(cache->bic_filename, st);
+	if (!bc)
+		return 1;
+
+	for (i = 0; i < bc->hdr->ndevs; i++) {
+		const struct bincache_dev *bdev = &bc->devs[i];
+		blkid_dev dev;
+
+		dev = blkid_get_dev(cache, bc->strs + bdev->name, BLKID_DEV_CREATE);
+		if (!dev)
+			break;
+
+		dev->bid_pri = bdev->pri;
+		dev->bid_devno = bdev->devno;
+		dev->bid_time = bdev->time;
+		dev->bid_utime = bdev->utime;
+
+		for (t = bdev->tags; t < bdev->tags + bdev->ntags; t++) {
+			const struct bincache_tag *tag = &bc->tags[t];
+			const char *val = bc->strs + tag->value;
+
+			blkid_set_tag(dev, bc->strs + tag->name, val, strlen(val));
+		}
+		if (dev->bid_type == NULL) {
+			DBG(READ, ul_debug("blkid: device %s has no TYPE", dev->bid_name));
+			blkid_free_dev(dev);
+		}
+	}
+
+	DBG(READ, ul_debug("read %u devices from binary cache", i));
+	bincache_close(bc);
+	return 0;
+}
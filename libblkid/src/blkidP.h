@@ -57,11 +57,13 @@ struct blkid_struct_dev
 	unsigned int		bid_flags;	/* Device status bitflags */
 	char			*bid_label;	/* Shortcut to device LABEL */
 	char			*bid_uuid;	/* Shortcut to binary UUID */
+	struct list_head	bid_pending;	/* Devices waiting for (parallel) probing */
 };
 
 #define BLKID_BID_FL_VERIFIED	0x0001	/* Device data validated from disk */
 #define BLKID_BID_FL_INVALID	0x0004	/* Device is invalid */
 #define BLKID_BID_FL_REMOVABLE	0x0008	/* Device added by blkid_probe_all_removable() */
+#define BLKID_BID_FL_PENDING	0x0010	/* Device in cache->bic_pending list */
 
 /*
  * Each tag defines a NAME=value pair for a particular device.  The tags
@@ -77,6 +79,8 @@ struct blkid_struct_tag
 	char			*bit_name;	/* NAME of tag (shared) */
 	char			*bit_val;	/* value of tag */
 	blkid_dev		bit_dev;	/* pointer to device */
+	struct list_head	bit_hash;	/* Tags in the same cache->bic_hash bucket */
+	unsigned int		bit_hashval;	/* hash of NAME=value */
 };
 typedef struct blkid_struct_tag *blkid_tag;
 
@@ -181,11 +185,35 @@ struct blkid_idinfo
  */
 #define BLKID_IDINFO_TOLERANT	(1 << 1)
 
+/*
+ * Size of the read-ahead windows at the begin and end of the probing area.
+ * Almost all superblocks and partition tables live within these areas, so
+ * one read() per window replaces many small reads.
+ */
+#define BLKID_PREFETCH_SIZE	(1024 * 1024)
+
+/*
+ * The buffers for the prefetch windows are kept by the prober after
+ * blkid_probe_reset_buffers(), so probing more devices by one prober (see
+ * blkid_probe_set_device()) does not allocate them again.
+ */
+#define BLKID_NSPARES		2
+#define BLKID_SPARE_BUFSZ	(BLKID_PREFETCH_SIZE + 4096)
+
 struct blkid_bufinfo {
 	unsigned char		*data;
 	uint64_t		off;
 	uint64_t		len;
-	struct list_head	bufs;	/* list of buffers */
+	uint64_t		maxend;	/* max. end of this and all previous buffers */
+	uint64_t		bufsz;	/* allocated data area */
+};
+
+/*
+ * Signature area remembered by blkid_do_wipe() in the batch mode
+ */
+struct blkid_wipe_range {
+	uint64_t		off;	/* from the begin of the device */
+	uint64_t		len;
 };
 
 /*
@@ -211,6 +239,7 @@ struct blkid_struct_probe
 	unsigned int		blkssz;		/* sector size (BLKSSZGET ioctl) */
 	mode_t			mode;		/* struct stat.sb_mode */
 	uint64_t		zone_size;	/* zone size (BLKGETZONESZ ioctl) */
+	struct blk_zone_report	*zones;		/* cached BLKREPORTZONE result */
 
 	int			flags;		/* private library flags */
 	int			prob_flags;	/* always zeroized by blkid_do_*() */
@@ -219,14 +248,27 @@ struct blkid_struct_probe
 	uint64_t		wipe_size;	/* size of the wiped area */
 	struct blkid_chain	*wipe_chain;	/* superblock, partition, ... */
 
-	struct list_head	buffers;	/* list of buffers */
+	struct blkid_bufinfo	**buffers;	/* array of buffers sorted by offset */
+	size_t			nbuffers;	/* number of used items in buffers[] */
+	size_t			buffers_max;	/* allocated items in buffers[] */
+	uint64_t		nbuf_hits;	/* requests served from buffers */
+	uint64_t		nbuf_reads;	/* read() calls for buffers */
+	struct blkid_bufinfo	*spares[BLKID_NSPARES];	/* unused window buffers */
+	size_t			nspares;
 	struct list_head	hints;
 
+	struct blkid_wipe_range	*wipes;		/* not yet written wipes */
+	size_t			nwipes;
+	size_t			wipes_max;
+
 	struct blkid_chain	chains[BLKID_NCHAINS];	/* array of chains */
 	struct blkid_chain	*cur_chain;		/* current chain */
 
 	struct list_head	values;		/* results */
 
+	int			io_method;	/* BLKID_IO_* */
+	struct blkid_uring	*uring;		/* for BLKID_IO_URING */
+
 	struct blkid_struct_probe *parent;	/* for clones */
 	struct blkid_struct_probe *disk_probe;	/* whole-disk probing */
 };
@@ -237,6 +279,9 @@ struct blkid_struct_probe
 #define BLKID_FL_CDROM_DEV	(1 << 3)	/* is a CD/DVD drive */
 #define BLKID_FL_NOSCAN_DEV	(1 << 4)	/* do not scan this device */
 #define BLKID_FL_MODIF_BUFF	(1 << 5)	/* cached buffers has been modified */
+#define BLKID_FL_PREFETCH_HEAD	(1 << 6)	/* begin of the area already prefetched */
+#define BLKID_FL_PREFETCH_TAIL	(1 << 7)	/* end of the area already prefetched */
+#define BLKID_FL_WIPE_BATCH	(1 << 8)	/* see blkid_probe_set_wipe_batch() */
 
 /* private per-probing flags */
 #define BLKID_PROBE_FL_IGNORE_PT (1 << 1)	/* ignore partition table */
@@ -262,6 +307,7 @@ struct blkid_config {
 	int nevals;			/* number of elems in eval array */
 	int uevent;			/* SEND_UEVENT=<yes|not> option */
 	char *cachefile;		/* CACHE_FILE=<path> option */
+	int bincache;			/* BINARY_CACHE=<yes|no> option */
 };
 
 extern struct blkid_config *blkid_read_config(const char *filename)
@@ -297,10 +343,17 @@ struct blkid_struct_cache
 	unsigned int		bic_flags;	/* Status flags of the cache */
 	char			*bic_filename;	/* filename of cache */
 	blkid_probe		probe;		/* low-level probing stuff */
+	struct list_head	bic_pending;	/* Devices to probe by blkid_probe_all_parallel() */
+	struct list_head	*bic_hash;	/* Tags hashed by NAME=value */
+	size_t			bic_nbuckets;	/* Size of bic_hash array */
+	size_t			bic_nhashed;	/* Number of tags in bic_hash */
 };
 
 #define BLKID_BIC_FL_PROBED	0x0002	/* We probed /proc/partition devices */
 #define BLKID_BIC_FL_CHANGED	0x0004	/* Cache has changed from disk */
+#define BLKID_BIC_FL_DEFER	0x0008	/* Don't probe in blkid_verify(), add to bic_pending */
+#define BLKID_BIC_FL_BINARY	0x0010	/* Read/write also binary version of the cache file */
+#define BLKID_BIC_FL_NOHASH	0x0020	/* Tags hash unusable, use bic_tags lists */
 
 /* config file */
 #define BLKID_CONFIG_FILE	"/etc/blkid.conf"
@@ -369,6 +422,9 @@ extern void blkid__scan_dir(char *, dev_t, struct dir_list **, char **)
 extern int blkid_driver_has_major(const char *drvname, int drvmaj)
 			__attribute__((warn_unused_result));
 
+/* devname.c */
+extern int blkid__probe_all_new(blkid_cache cache, int nthreads);
+
 /* read.c */
 extern void blkid_read_cache(blkid_cache cache)
 			__attribute__((nonnull));
@@ -377,6 +433,15 @@ extern void blkid_read_cache(blkid_cache cache)
 extern int blkid_flush_cache(blkid_cache cache)
 			__attribute__((nonnull));
 
+/* bincache.c */
+extern int blkid_save_bincache(blkid_cache cache, const char *filename)
+			__attribute__((nonnull));
+extern int blkid_read_bincache(blkid_cache cache, const struct stat *st)
+			__attribute__((nonnull));
+extern char *blkid_bincache_get_devname(struct blkid_config *conf,
+					const char *type, const char *value)
+			__attribute__((nonnull(2,3)));
+
 /* cache */
 extern char *blkid_safe_getenv(const char *arg)
 			__attribute__((nonnull))
@@ -388,6 +453,8 @@ extern char *blkid_get_cache_filename(struct blkid_config *conf)
  * Functions to create and find a specific tag type: tag.c
  */
 extern void blkid_free_tag(blkid_tag tag);
+extern unsigned int blkid_tag_hash(const char *name, const char *value)
+			__attribute__((nonnull));
 extern blkid_tag blkid_find_tag_dev(blkid_dev dev, const char *type)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
@@ -396,6 +463,10 @@ extern int blkid_set_tag(blkid_dev dev, const char *name,
 			 const char *value, const int vlength)
 			__attribute__((nonnull(1,2)));
 
+extern blkid_dev blkid_find_cached_dev_with_tag(blkid_cache cache,
+			const char *type, const char *value)
+			__attribute__((warn_unused_result));
+
 /*
  * Functions to create and find a specific tag type: dev.c
  */
@@ -403,6 +474,37 @@ extern blkid_dev blkid_new_dev(void)
 			__attribute__((warn_unused_result));
 extern void blkid_free_dev(blkid_dev dev);
 
+/* uring.c */
+#ifdef HAVE_IO_URING_SUPPORT
+#define BLKID_URING_ENTRIES	4
+
+struct blkid_uring;
+
+struct blkid_uring_req {
+	uint64_t	off;
+	uint64_t	len;
+	unsigned char	*data;
+	int		res;		/* bytes or -errno */
+};
+
+extern struct blkid_uring *blkid_new_uring(unsigned int entries)
+			__attribute__((warn_unused_result));
+extern void blkid_free_uring(struct blkid_uring *ur);
+extern int blkid_uring_read(struct blkid_uring *ur, int fd,
+			struct blkid_uring_req *reqs, size_t nreqs)
+			__attribute__((nonnull));
+#endif
+
+/* verify.c */
+extern int blkid_verify_probe(blkid_probe pr, blkid_dev dev, int *fd)
+			__attribute__((nonnull));
+extern blkid_dev blkid_verify_finish(blkid_cache cache, blkid_dev dev,
+			blkid_probe pr, struct stat *st, int fd, int rc)
+			__attribute__((nonnull(1,2,4)));
+extern int blkid_verify_devname_tag(blkid_cache cache, const char *devname,
+			const char *type, const char *value)
+			__attribute__((nonnull(2,3,4)));
+
 /* probe.c */
 extern int blkid_probe_is_tiny(blkid_probe pr)
 			__attribute__((nonnull))
@@ -419,6 +521,17 @@ extern unsigned char *blkid_probe_get_buffer(blkid_probe pr,
 extern unsigned char *blkid_probe_get_sector(blkid_probe pr, unsigned int sector)
 			__attribute__((nonnull))
 			__attribute__((warn_unused_result));
+extern size_t blkid_probe_prefetch_sectors(blkid_probe pr, const uint64_t *sectors,
+				size_t nsectors)
+			__attribute__((nonnull));
+
+struct blk_zone;
+extern struct blk_zone *blkid_probe_get_zones(blkid_probe pr,
+			uint64_t offset, uint32_t nzones)
+			__attribute__((nonnull))
+			__attribute__((warn_unused_result));
+extern void blkid_probe_reset_zones(blkid_probe pr)
+			__attribute__((nonnull));
 
 extern int blkid_probe_get_dimension(blkid_probe pr,
 	                uint64_t *off, uint64_t *size)
@@ -93,6 +93,7 @@ char *blkid_get_cache_filename(struct blkid_config *conf)
 int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
 {
 	blkid_cache cache;
+	struct blkid_config *conf;
 
 	if (!ret_cache)
 		return -BLKID_ERR_PARAM;
@@ -105,13 +106,19 @@ int blkid_get_cache(blkid_cache *ret_cache, const char *filename)
 	DBG(CACHE, ul_debugobj(cache, "alloc (from %s)", filename ? filename : "default cache"));
 	INIT_LIST_HEAD(&cache->bic_devs);
 	INIT_LIST_HEAD(&cache->bic_tags);
+	INIT_LIST_HEAD(&cache->bic_pending);
 
 	if (filename && !*filename)
 		filename = NULL;
+
+	conf = blkid_read_config(NULL);
 	if (filename)
 		cache->bic_filename = strdup(filename);
 	else
-		cache->bic_filename = blkid_get_cache_filename(NULL);
+		cache->bic_filename = blkid_get_cache_filename(conf);
+	if (conf && conf->bincache)
+		cache->bic_flags |= BLKID_BIC_FL_BINARY;
+	blkid_free_config(conf);
 
 	blkid_read_cache(cache);
 	*ret_cache = cache;
@@ -162,6 +169,7 @@ void blkid_put_cache(blkid_cache cache)
 
 	blkid_free_probe(cache->probe);
 
+	free(cache->bic_hash);
 	free(cache->bic_filename);
 	free(cache);
 }
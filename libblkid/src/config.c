@@ -100,6 +100,12 @@ static int parse_next(FILE *fd, struct blkid_config *conf)
 			conf->cachefile = strdup(s);
 		else
 			conf->cachefile = NULL;
+	} else if (!strncmp(s, "BINARY_CACHE=", 13)) {
+		s += 13;
+		if (*s && !strcasecmp(s, "yes"))
+			conf->bincache = TRUE;
+		else if (*s)
+			conf->bincache = FALSE;
 	} else if (!strncmp(s, "EVALUATE=", 9)) {
 		s += 9;
 		if (*s && parse_evaluate(conf, s) == -1)
@@ -194,6 +200,7 @@ int main(int argc, char *argv[])
 
 	printf("SEND UEVENT: %s\n", conf->uevent ? "TRUE" : "FALSE");
 	printf("CACHE_FILE:  %s\n", conf->cachefile);
+	printf("BINARY CACHE: %s\n", conf->bincache ? "TRUE" : "FALSE");
 
 	blkid_free_config(conf);
 	return EXIT_SUCCESS;
@@ -40,6 +40,7 @@ blkid_dev blkid_new_dev(void)
 	DBG(DEV, ul_debugobj(dev, "alloc"));
 	INIT_LIST_HEAD(&dev->bid_devs);
 	INIT_LIST_HEAD(&dev->bid_tags);
+	INIT_LIST_HEAD(&dev->bid_pending);
 
 	return dev;
 }
@@ -52,6 +53,8 @@ void blkid_free_dev(blkid_dev dev)
 	DBG(DEV, ul_debugobj(dev, "freeing (%s)", dev->bid_name));
 
 	list_del(&dev->bid_devs);
+	if (dev->bid_flags & BLKID_BID_FL_PENDING)
+		list_del(&dev->bid_pending);
 	while (!list_empty(&dev->bid_tags)) {
 		blkid_tag tag = list_entry(dev->bid_tags.next,
 					   struct blkid_struct_tag,
@@ -33,6 +33,7 @@
 #include <errno.h>
 #endif
 #include <time.h>
+#include <pthread.h>
 
 #include "blkidP.h"
 
@@ -41,6 +42,39 @@
 #include "sysfs.h"
 #include "fileutils.h"
 
+/*
+ * If the device is verified, then search the blkid cache for any entries that
+ * match on the type, uuid, and label, and verify them; if a cache entry can
+ * not be verified, then it's stale and so we remove it.
+ */
+static void remove_stale_devs(blkid_cache cache, blkid_dev dev)
+{
+	struct list_head *p, *pnext;
+
+	list_for_each_safe(p, pnext, &cache->bic_devs) {
+		blkid_dev dev2 = list_entry(p, struct blkid_struct_dev, bid_devs);
+		if (dev2->bid_flags & BLKID_BID_FL_VERIFIED)
+			continue;
+		if (!dev->bid_type || !dev2->bid_type ||
+		    strcmp(dev->bid_type, dev2->bid_type) != 0)
+			continue;
+		if (dev->bid_label && dev2->bid_label &&
+		    strcmp(dev->bid_label, dev2->bid_label) != 0)
+			continue;
+		if (dev->bid_uuid && dev2->bid_uuid &&
+		    strcmp(dev->bid_uuid, dev2->bid_uuid) != 0)
+			continue;
+		if ((dev->bid_label && !dev2->bid_label) ||
+		    (!dev->bid_label && dev2->bid_label) ||
+		    (dev->bid_uuid && !dev2->bid_uuid) ||
+		    (!dev->bid_uuid && dev2->bid_uuid))
+			continue;
+		dev2 = blkid_verify(cache, dev2);
+		if (dev2 && !(dev2->bid_flags & BLKID_BID_FL_VERIFIED))
+			blkid_free_dev(dev2);
+	}
+}
+
 /*
  * Find a dev struct in the cache by device name, if available.
  *
@@ -50,7 +84,7 @@
 blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 {
 	blkid_dev dev = NULL, tmp;
-	struct list_head *p, *pnext;
+	struct list_head *p;
 	char *cn = NULL;
 
 	if (!cache || !devname)
@@ -109,35 +143,7 @@ blkid_dev blkid_get_dev(blkid_cache cache, const char *devname, int flags)
 		dev = blkid_verify(cache, dev);
 		if (!dev || !(dev->bid_flags & BLKID_BID_FL_VERIFIED))
 			goto done;
-		/*
-		 * If the device is verified, then search the blkid
-		 * cache for any entries that match on the type, uuid,
-		 * and label, and verify them; if a cache entry can
-		 * not be verified, then it's stale and so we remove
-		 * it.
-		 */
-		list_for_each_safe(p, pnext, &cache->bic_devs) {
-			blkid_dev dev2 = list_entry(p, struct blkid_struct_dev, bid_devs);
-			if (dev2->bid_flags & BLKID_BID_FL_VERIFIED)
-				continue;
-			if (!dev->bid_type || !dev2->bid_type ||
-			    strcmp(dev->bid_type, dev2->bid_type) != 0)
-				continue;
-			if (dev->bid_label && dev2->bid_label &&
-			    strcmp(dev->bid_label, dev2->bid_label) != 0)
-				continue;
-			if (dev->bid_uuid && dev2->bid_uuid &&
-			    strcmp(dev->bid_uuid, dev2->bid_uuid) != 0)
-				continue;
-			if ((dev->bid_label && !dev2->bid_label) ||
-			    (!dev->bid_label && dev2->bid_label) ||
-			    (dev->bid_uuid && !dev2->bid_uuid) ||
-			    (!dev->bid_uuid && dev2->bid_uuid))
-				continue;
-			dev2 = blkid_verify(cache, dev2);
-			if (dev2 && !(dev2->bid_flags & BLKID_BID_FL_VERIFIED))
-				blkid_free_dev(dev2);
-		}
+		remove_stale_devs(cache, dev);
 	}
 done:
 	if (dev)
@@ -188,7 +194,8 @@ static void probe_one(blkid_cache cache, const char *ptname,
 			if (only_if_new && !access(tmp->bid_name, F_OK))
 				return;
 			dev = blkid_verify(cache, tmp);
-			if (dev && (dev->bid_flags & BLKID_BID_FL_VERIFIED))
+			if (dev && (dev->bid_flags & (BLKID_BID_FL_VERIFIED |
+						      BLKID_BID_FL_PENDING)))
 				break;
 			dev = NULL;
 		}
@@ -520,10 +527,124 @@ sysfs_probe_all(blkid_cache cache, int only_if_new, int only_removable)
 	return 0;
 }
 
+struct pending_ctl {
+	blkid_cache	cache;
+	pthread_mutex_t	lock;		/* protects cache and verified[] */
+	blkid_dev	*verified;	/* devices verified by the threads */
+	int		nverified;
+};
+
+/*
+ * Probing thread -- takes devices from cache->bic_pending, probes them by
+ * the thread's own prober and merges results to the cache under the lock.
+ */
+static void *probe_pending_thread(void *data)
+{
+	struct pending_ctl *ctl = (struct pending_ctl *) data;
+	blkid_cache cache = ctl->cache;
+	blkid_probe pr = blkid_new_probe();
+
+	/* don't take devices, probe_pending() keeps the rest unverified */
+	if (!pr)
+		return NULL;
+
+	while (1) {
+		blkid_dev dev;
+		struct stat st;
+		int fd = -1, rc;
+
+		pthread_mutex_lock(&ctl->lock);
+		if (list_empty(&cache->bic_pending)) {
+			pthread_mutex_unlock(&ctl->lock);
+			break;
+		}
+		dev = list_entry(cache->bic_pending.next,
+				 struct blkid_struct_dev, bid_pending);
+		list_del_init(&dev->bid_pending);
+		dev->bid_flags &= ~BLKID_BID_FL_PENDING;
+		pthread_mutex_unlock(&ctl->lock);
+
+		/* the device is not accessible from other threads now */
+		if (stat(dev->bid_name, &st) < 0)
+			rc = -errno;
+		else
+			rc = blkid_verify_probe(pr, dev, &fd);
+
+		pthread_mutex_lock(&ctl->lock);
+		dev = blkid_verify_finish(cache, dev, pr, &st, fd, rc);
+		if (dev && (dev->bid_flags & BLKID_BID_FL_VERIFIED) && ctl->verified)
+			ctl->verified[ctl->nverified++] = dev;
+		pthread_mutex_unlock(&ctl->lock);
+	}
+
+	blkid_free_probe(pr);
+	return NULL;
+}
+
+/*
+ * Probe all devices scheduled by blkid_verify() in BLKID_BIC_FL_DEFER mode
+ * by @nthreads threads.
+ */
+static void probe_pending(blkid_cache cache, int nthreads)
+{
+	struct pending_ctl ctl = { .cache = cache };
+	pthread_t *threads;
+	struct list_head *p;
+	int i, n = 0, npending = 0;
+
+	list_for_each(p, &cache->bic_pending)
+		npending++;
+	if (!npending)
+		return;
+	if (nthreads > npending)
+		nthreads = npending;
+
+	DBG(PROBE, ul_debug("probing %d devices by %d threads", npending, nthreads));
+
+	pthread_mutex_init(&ctl.lock, NULL);
+	ctl.verified = calloc(npending, sizeof(blkid_dev));
+
+	threads = calloc(nthreads, sizeof(pthread_t));
+	for (i = 0; threads && i < nthreads; i++) {
+		if (pthread_create(&threads[n], NULL, probe_pending_thread, &ctl) != 0)
+			break;
+		n++;
+	}
+
+	/* no thread available -- probe in this thread */
+	if (!n)
+		probe_pending_thread(&ctl);
+
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], NULL);
+
+	/* not probed (no memory for the probers) -- keep the cached data the
+	 * same way blkid_verify() does if it cannot read the device */
+	while (!list_empty(&cache->bic_pending)) {
+		blkid_dev dev = list_entry(cache->bic_pending.next,
+				 struct blkid_struct_dev, bid_pending);
+
+		DBG(PROBE, ul_debug("returning unverified data for %s",
+					dev->bid_name));
+		list_del_init(&dev->bid_pending);
+		dev->bid_flags &= ~BLKID_BID_FL_PENDING;
+	}
+
+	/* the same as blkid_get_dev() does for every verified device in the
+	 * serial mode; the verified devices are never removed here */
+	for (i = 0; i < ctl.nverified; i++)
+		remove_stale_devs(cache, ctl.verified[i]);
+
+	free(ctl.verified);
+	free(threads);
+	pthread_mutex_destroy(&ctl.lock);
+}
+
 /*
  * Read the device data for all available block devices in the system.
  */
-static int probe_all(blkid_cache cache, int only_if_new, int update_interval)
+static int probe_all(blkid_cache cache, int only_if_new, int update_interval,
+		     int nthreads)
 {
 	int rc;
 
@@ -537,6 +658,10 @@ static int probe_all(blkid_cache cache, int only_if_new, int update_interval)
 	}
 
 	blkid_read_cache(cache);
+
+	/* collect devices, probe all later by threads */
+	if (nthreads > 1)
+		cache->bic_flags |= BLKID_BIC_FL_DEFER;
 #ifdef VG_DIR
 	lvm_probe_all(cache, only_if_new);
 #endif
@@ -544,6 +669,11 @@ static int probe_all(blkid_cache cache, int only_if_new, int update_interval)
 
 	rc = sysfs_probe_all(cache, only_if_new, 0);
 
+	if (nthreads > 1) {
+		cache->bic_flags &= ~BLKID_BIC_FL_DEFER;
+		probe_pending(cache, nthreads);
+	}
+
 	/* Don't mark the change as "probed" if /sys not avalable */
 	if (update_interval && rc == 0) {
 		cache->bic_time = time(NULL);
@@ -567,11 +697,46 @@ int blkid_probe_all(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, ul_debug("Begin blkid_probe_all()"));
-	ret = probe_all(cache, 0, 1);
+	ret = probe_all(cache, 0, 1, 0);
 	DBG(PROBE, ul_debug("End blkid_probe_all() [rc=%d]", ret));
 	return ret;
 }
 
+/**
+ * blkid_probe_all_parallel:
+ * @cache: cache handler
+ * @nthreads: number of probing threads, or 0 for number of online CPUs
+ *
+ * The same as blkid_probe_all(), but the devices are probed by @nthreads
+ * concurrent threads, every thread uses its own low-level prober. This is
+ * useful on systems with many devices where the probing is dominated by
+ * I/O latency.
+ *
+ * Note that the @cache is modified by the threads (locked internally), but
+ * the caller must not use the @cache from another thread before the function
+ * returns.
+ *
+ * Returns: 0 on success, or number less than zero in case of error.
+ *
+ * Since: 2.39
+ */
+int blkid_probe_all_parallel(blkid_cache cache, int nthreads)
+{
+	int ret;
+
+	if (nthreads < 0)
+		return -BLKID_ERR_PARAM;
+	if (nthreads == 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = n > 0 ? (int) n : 1;
+	}
+
+	DBG(PROBE, ul_debug("Begin blkid_probe_all_parallel() [threads=%d]", nthreads));
+	ret = probe_all(cache, 0, 1, nthreads);
+	DBG(PROBE, ul_debug("End blkid_probe_all_parallel() [rc=%d]", ret));
+	return ret;
+}
+
 /**
  * blkid_probe_all_new:
  * @cache: cache handler
@@ -585,11 +750,31 @@ int blkid_probe_all_new(blkid_cache cache)
 	int ret;
 
 	DBG(PROBE, ul_debug("Begin blkid_probe_all_new()"));
-	ret = probe_all(cache, 1, 0);
+	ret = probe_all(cache, 1, 0, 0);
 	DBG(PROBE, ul_debug("End blkid_probe_all_new() [rc=%d]", ret));
 	return ret;
 }
 
+/*
+ * The same as blkid_probe_all_new(), but the new devices are probed by
+ * @nthreads threads (0 for number of online CPUs), see
+ * blkid_probe_all_parallel().
+ */
+int blkid__probe_all_new(blkid_cache cache, int nthreads)
+{
+	int ret;
+
+	if (nthreads <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = n > 0 ? (int) n : 1;
+	}
+
+	DBG(PROBE, ul_debug("Begin blkid__probe_all_new() [threads=%d]", nthreads));
+	ret = probe_all(cache, 1, 0, nthreads);
+	DBG(PROBE, ul_debug("End blkid__probe_all_new() [rc=%d]", ret));
+	return ret;
+}
+
 /**
  * blkid_probe_all_removable:
  * @cache: cache handler
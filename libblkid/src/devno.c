@@ -34,6 +34,7 @@
 
 #include "blkidP.h"
 #include "pathnames.h"
+#include "procsnap.h"
 #include "sysfs.h"
 
 static char *blkid_strconcat(const char *a, const char *b, const char *c)
@@ -295,7 +296,7 @@ int blkid_driver_has_major(const char *drvname, int drvmaj)
 	char buf[128];
 	int match = 0;
 
-	f = fopen(_PATH_PROC_DEVICES, "r" UL_CLOEXECSTR);
+	f = ul_procsnap_fopen(_PATH_PROC_DEVICES);
 	if (!f)
 		return 0;
 
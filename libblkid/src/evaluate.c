@@ -22,9 +22,17 @@
 #include <stdint.h>
 #include <stdarg.h>
 
+#ifdef HAVE_BLKIDD
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <sys/time.h>
+#endif
+
 #include "pathnames.h"
 #include "canonicalize.h"
 #include "closestream.h"
+#include "strutils.h"
+#include "blkidd.h"
 
 #include "blkidP.h"
 
@@ -42,9 +50,16 @@
  * /etc/blkid.conf config file. The default is to try "udev" and then "scan"
  * method.
  *
+ * If the blkidd(8) daemon is running, then the "scan" method asks the daemon
+ * first, so the cache file does not have to be read by every process.
+ *
  * The blkid_evaluate_tag() also automatically informs udevd when an obsolete
  * /dev/disk/by-* symlink is detected.
  *
+ * If more tags have to be evaluated (e.g. all fstab entries), then
+ * blkid_evaluate_tags() reads and verifies the cache only once and the
+ * devices missing in the cache are probed once and in parallel.
+ *
  * If you are not sure how translate LABEL or UUID to the device name use this
  * API.
  */
@@ -190,17 +205,154 @@ failed:
 	return NULL;
 }
 
+#ifdef HAVE_BLKIDD
+/*
+ * Sends one request to blkidd daemon (if running) and reads the reply to
+ * @buf. The daemon is not waited for longer than BLKIDD_LIBRARY_TIMEOUT, the
+ * caller evaluates the tags itself if the daemon is busy.
+ *
+ * Returns: reply length (the reply is NUL terminated), or -1 on error.
+ */
+static blkidd_prot_len_t call_blkidd(blkidd_prot_op_t op, const char *data,
+				     blkidd_prot_len_t len, char *buf)
+{
+	struct sockaddr_un srv_addr;
+	struct timeval tv = { .tv_usec = BLKIDD_LIBRARY_TIMEOUT * 1000 };
+	char req[sizeof(op) + sizeof(len) + BLKIDD_MAX_DATA];
+	blkidd_prot_len_t reply_len = -1;
+	size_t sz;
+	int s;
+
+	if (sizeof(BLKIDD_SOCKET_PATH) > sizeof(srv_addr.sun_path)
+	    || len < 0 || len > BLKIDD_MAX_DATA)
+		return -1;
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+
+	/* connect() waits for the full backlog by SO_SNDTIMEO too */
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	srv_addr.sun_family = AF_UNIX;
+	xstrncpy(srv_addr.sun_path, BLKIDD_SOCKET_PATH, sizeof(srv_addr.sun_path));
+
+	if (connect(s, (const struct sockaddr *) &srv_addr,
+		    sizeof(struct sockaddr_un)) < 0)
+		goto done;
+
+	/* the request is sent at once, it's smaller than the socket buffer */
+	memcpy(req, &op, sizeof(op));
+	memcpy(req + sizeof(op), &len, sizeof(len));
+	memcpy(req + sizeof(op) + sizeof(len), data, len);
+	sz = sizeof(op) + sizeof(len) + len;
+
+	if (send(s, req, sz, MSG_NOSIGNAL) != (ssize_t) sz
+	    || recv(s, &reply_len, sizeof(reply_len), MSG_WAITALL) != sizeof(reply_len)
+	    || reply_len <= 0 || reply_len > BLKIDD_MAX_DATA
+	    || recv(s, buf, reply_len, MSG_WAITALL) != reply_len
+	    || buf[reply_len - 1] != '\0')
+		reply_len = -1;
+done:
+	if (reply_len < 0)
+		DBG(EVALUATE, ul_debug("blkidd not available (%m)"));
+	close(s);
+	return reply_len;
+}
+
+/*
+ * Ask blkidd daemon (if running) for the device; the daemon keeps probing
+ * results in memory, so we don't need to read the cache or scan devices.
+ */
+static char *evaluate_by_daemon(blkid_cache cache, const char *token,
+				const char *value)
+{
+	char data[BLKIDD_MAX_DATA + 1], buf[BLKIDD_MAX_DATA + 1];
+	int len;
+
+	len = snprintf(data, sizeof(data), "%s=%s", token, value);
+	if (len < 0 || len > BLKIDD_MAX_DATA)
+		return NULL;
+
+	DBG(EVALUATE, ul_debug("evaluating by blkidd %s=%s", token, value));
+
+	if (call_blkidd(BLKIDD_OP_EVALUATE, data, len, buf) > 0
+	    && blkid_verify_devname_tag(cache, buf, token, value))
+		return strdup(buf);
+	return NULL;
+}
+
+/*
+ * The same as evaluate_by_daemon() for all the unresolved tags by one
+ * request. The tags which don't fit into one request are left to the caller.
+ */
+static void evaluate_by_daemon_all(blkid_cache cache, char **tokens,
+				   char **values, char **results, size_t ntags)
+{
+	char data[BLKIDD_MAX_DATA + 1], buf[BLKIDD_MAX_DATA + 1];
+	size_t *idx, i, n = 0, off = 0;
+	blkidd_prot_len_t len;
+
+	idx = malloc(ntags * sizeof(size_t));
+	if (!idx)
+		return;
+
+	for (i = 0; i < ntags; i++) {
+		int rc;
+
+		if (results[i] || !values[i])
+			continue;
+		rc = snprintf(data + off, sizeof(data) - off, "%s=%s",
+				tokens[i], values[i]);
+		if (rc < 0 || off + rc + 1 > BLKIDD_MAX_DATA)
+			continue;
+		off += rc + 1;		/* NUL terminated */
+		idx[n++] = i;
+	}
+	if (!n)
+		goto done;
+
+	DBG(EVALUATE, ul_debug("evaluating by blkidd %zu tags", n));
+
+	len = call_blkidd(BLKIDD_OP_EVALUATE_ALL, data, off, buf);
+	for (i = 0, off = 0; len > 0 && i < n && off < (size_t) len; i++) {
+		const char *devname = buf + off;
+		size_t k = idx[i];
+
+		off += strlen(devname) + 1;
+		if (*devname && blkid_verify_devname_tag(cache, devname,
+						tokens[k], values[k]))
+			results[k] = strdup(devname);
+	}
+done:
+	free(idx);
+}
+#endif /* HAVE_BLKIDD */
+
 static char *evaluate_by_scan(const char *token, const char *value,
 		blkid_cache *cache, struct blkid_config *conf)
 {
 	blkid_cache c = cache ? *cache : NULL;
 	char *res;
 
+#ifdef HAVE_BLKIDD
+	res = evaluate_by_daemon(c, token, value);
+	if (res)
+		return res;
+#endif
 	DBG(EVALUATE, ul_debug("evaluating by blkid scan %s=%s", token, value));
 
 	if (!c) {
-		char *cachefile = blkid_get_cache_filename(conf);
-		int rc = blkid_get_cache(&c, cachefile);
+		char *cachefile;
+		int rc;
+
+		/* don't read the cache if the binary cache knows the device */
+		res = blkid_bincache_get_devname(conf, token, value);
+		if (res)
+			return res;
+
+		cachefile = blkid_get_cache_filename(conf);
+		rc = blkid_get_cache(&c, cachefile);
 		free(cachefile);
 		if (rc < 0)
 			return NULL;
@@ -305,6 +457,160 @@ char *blkid_evaluate_spec(const char *spec, blkid_cache *cache)
 	return res;
 }
 
+/*
+ * All the tags not resolved yet by the previous methods are looked up in the
+ * cache, the missing devices are probed at most twice (new devices, then all
+ * devices) for all the tags together.
+ */
+static void evaluate_by_scan_all(char **tokens, char **values, char **results,
+		size_t ntags, blkid_cache *cache, struct blkid_config *conf)
+{
+	blkid_cache c = cache ? *cache : NULL;
+	size_t i, nmiss = 0;
+	int round;
+
+#ifdef HAVE_BLKIDD
+	evaluate_by_daemon_all(c, tokens, values, results, ntags);
+#endif
+	for (i = 0; i < ntags; i++) {
+		if (!results[i] && values[i])
+			nmiss++;
+	}
+	if (!nmiss)
+		return;
+
+	if (!c) {
+		char *cachefile = blkid_get_cache_filename(conf);
+		int rc = blkid_get_cache(&c, cachefile);
+		free(cachefile);
+		if (rc < 0)
+			return;
+	}
+	if (!c)
+		return;
+
+	blkid_read_cache(c);
+
+	for (round = 0; nmiss && round < 3; round++) {
+		if (round == 1 && blkid__probe_all_new(c, 0) < 0)
+			break;
+		if (round == 2) {
+			if (c->bic_flags & BLKID_BIC_FL_PROBED)
+				break;
+			if (blkid_probe_all_parallel(c, 0) < 0)
+				break;
+		}
+
+		DBG(EVALUATE, ul_debug("evaluating by blkid scan %zu tags [round=%d]",
+					nmiss, round));
+		nmiss = 0;
+		for (i = 0; i < ntags; i++) {
+			blkid_dev dev;
+
+			if (results[i] || !values[i])
+				continue;
+			dev = blkid_find_cached_dev_with_tag(c, tokens[i], values[i]);
+			if (dev && dev->bid_name)
+				results[i] = strdup(dev->bid_name);
+			else
+				nmiss++;
+		}
+	}
+
+	if (cache)
+		*cache = c;
+	else
+		blkid_put_cache(c);
+}
+
+/**
+ * blkid_evaluate_tags:
+ * @cache: pointer to cache (or NULL when you don't want to re-use the cache)
+ * @tags: array of unparsed tags (e.g. "LABEL=foo")
+ * @ntags: number of tags
+ * @results: array of @ntags results
+ *
+ * The same as blkid_evaluate_tag() for all the @tags, but the cache is read
+ * and verified only once and the devices which are not in the cache are
+ * probed only once for all the tags and in parallel. This is more efficient
+ * than blkid_evaluate_tag() in a loop, for example for all fstab entries.
+ *
+ * The @results are set to allocated strings with a device name, or NULL
+ * if the tag is not found.
+ *
+ * Returns: number of found tags, or number less than zero in case of error.
+ *
+ * Since: 2.39
+ */
+int blkid_evaluate_tags(blkid_cache *cache, const char *tags[], size_t ntags,
+			char *results[])
+{
+	struct blkid_config *conf = NULL;
+	char **tokens = NULL, **values = NULL;
+	size_t i;
+	int rc = 0, e;
+
+	if (!tags || !results)
+		return -BLKID_ERR_PARAM;
+
+	if (!cache || !*cache)
+		blkid_init_debug(0);
+
+	memset(results, 0, ntags * sizeof(char *));
+	if (!ntags)
+		return 0;
+
+	tokens = calloc(ntags, sizeof(char *));
+	values = calloc(ntags, sizeof(char *));
+	if (!tokens || !values) {
+		rc = -BLKID_ERR_MEM;
+		goto out;
+	}
+
+	DBG(EVALUATE, ul_debug("evaluating %zu tags", ntags));
+
+	for (i = 0; i < ntags; i++) {
+		if (!tags[i])
+			continue;
+		if (!strchr(tags[i], '='))
+			results[i] = strdup(tags[i]);
+		else
+			blkid_parse_tag_string(tags[i], &tokens[i], &values[i]);
+	}
+
+	conf = blkid_read_config(NULL);
+	if (!conf) {
+		rc = -BLKID_ERR_MEM;
+		goto out;
+	}
+
+	for (e = 0; e < conf->nevals; e++) {
+		if (conf->eval[e] == BLKID_EVAL_UDEV) {
+			for (i = 0; i < ntags; i++) {
+				if (!results[i] && values[i])
+					results[i] = evaluate_by_udev(tokens[i],
+							values[i], conf->uevent);
+			}
+		} else if (conf->eval[e] == BLKID_EVAL_SCAN)
+			evaluate_by_scan_all(tokens, values, results, ntags,
+					     cache, conf);
+	}
+
+	for (i = 0; i < ntags; i++) {
+		if (results[i])
+			rc++;
+		DBG(EVALUATE, ul_debug("%s evaluated as %s", tags[i], results[i]));
+	}
+out:
+	blkid_free_config(conf);
+	for (i = 0; tokens && i < ntags; i++)
+		free(tokens[i]);
+	for (i = 0; values && i < ntags; i++)
+		free(values[i]);
+	free(tokens);
+	free(values);
+	return rc;
+}
 
 #ifdef TEST_PROGRAM
 int main(int argc, char *argv[])
@@ -313,12 +619,31 @@ int main(int argc, char *argv[])
 	char *res;
 
 	if (argc < 2) {
-		fprintf(stderr, "usage: %s <tag> | <spec>\n", argv[0]);
+		fprintf(stderr, "usage: %s <tag> | <spec> | <tag> <tag> ...\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
 	blkid_init_debug(0);
 
+	if (argc > 2) {
+		/* more tags, evaluate all together */
+		char **results = calloc(argc - 1, sizeof(char *));
+		int i, rc;
+
+		if (!results)
+			return EXIT_FAILURE;
+		rc = blkid_evaluate_tags(&cache, (const char **) &argv[1],
+					 argc - 1, results);
+		for (i = 0; i < argc - 1; i++) {
+			printf("%s: %s\n", argv[i + 1], results[i] ? : "<not found>");
+			free(results[i]);
+		}
+		free(results);
+		if (cache)
+			blkid_put_cache(cache);
+		return rc == argc - 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
 	res = blkid_evaluate_spec(argv[1], &cache);
 	if (res)
 		printf("%s\n", res);
@@ -39,6 +39,33 @@ static inline int is_extended(struct dos_partition *p)
 		p->sys_ind == MBR_LINUX_EXTENDED_PARTITION);
 }
 
+/* number of EBRs read ahead by one batch */
+#define DOS_EBR_PREFETCH	4
+
+/*
+ * The EBR announces the next EBR only, so the chain can't be read by one
+ * batch. Tools usually create the logical partitions of the same size one
+ * after another, so guess the following EBRs by the distance between the
+ * current and the next EBR. The wrong guess costs a few sectors, the next
+ * EBR not found in the buffers triggers a new batch.
+ */
+static void prefetch_ebrs(blkid_probe pr, uint32_t cur, uint32_t next,
+			  uint32_t ex_end)
+{
+	uint64_t sectors[DOS_EBR_PREFETCH];
+	uint32_t step = next > cur ? next - cur : 0;
+	size_t n = 0;
+
+	while (n < ARRAY_SIZE(sectors) && next < ex_end) {
+		sectors[n++] = next;
+		if (!step || next > UINT32_MAX - step)
+			break;
+		next += step;
+	}
+	if (n)
+		blkid_probe_prefetch_sectors(pr, sectors, n);
+}
+
 static int parse_dos_extended(blkid_probe pr, blkid_parttable tab,
 		uint32_t ex_start, uint32_t ex_size, int ssf)
 {
@@ -140,6 +167,7 @@ static int parse_dos_extended(blkid_probe pr, blkid_parttable tab,
 		if (i == 4)
 			goto leave;
 
+		prefetch_ebrs(pr, cur_start, ex_start + start, ex_start + ex_size);
 		cur_start = ex_start + start;
 		cur_size = size;
 	}
@@ -117,6 +117,7 @@
 #include "strutils.h"
 #include "list.h"
 #include "fileutils.h"
+#include "ultrace.h"
 
 /*
  * All supported chains
@@ -152,7 +153,6 @@ blkid_probe blkid_new_probe(void)
 		pr->chains[i].flags = chains_drvs[i]->dflt_flags;
 		pr->chains[i].enabled = chains_drvs[i]->dflt_enabled;
 	}
-	INIT_LIST_HEAD(&pr->buffers);
 	INIT_LIST_HEAD(&pr->values);
 	INIT_LIST_HEAD(&pr->hints);
 	return pr;
@@ -185,9 +185,11 @@ blkid_probe blkid_clone_probe(blkid_probe parent)
 	pr->blkssz = parent->blkssz;
 	pr->flags = parent->flags;
 	pr->zone_size = parent->zone_size;
+	pr->io_method = parent->io_method;
 	pr->parent = parent;
 
 	pr->flags &= ~BLKID_FL_PRIVATE_FD;
+	pr->flags &= ~(BLKID_FL_PREFETCH_HEAD | BLKID_FL_PREFETCH_TAIL);
 
 	return pr;
 }
@@ -257,6 +259,16 @@ void blkid_free_probe(blkid_probe pr)
 	if ((pr->flags & BLKID_FL_PRIVATE_FD) && pr->fd >= 0)
 		close(pr->fd);
 	blkid_probe_reset_buffers(pr);
+	while (pr->nspares)
+		free(pr->spares[--pr->nspares]);
+	free(pr->buffers);
+	free(pr->zones);
+	if (pr->nwipes)
+		DBG(LOWPROBE, ul_debug("%zu not flushed wipes discarded", pr->nwipes));
+	free(pr->wipes);
+#ifdef HAVE_IO_URING_SUPPORT
+	blkid_free_uring(pr->uring);
+#endif
 	blkid_probe_reset_values(pr);
 	blkid_probe_reset_hints(pr);
 	blkid_free_probe(pr->disk_probe);
@@ -367,6 +379,20 @@ static const char *blkid_probe_get_probername(blkid_probe pr)
 	return NULL;
 }
 
+/* all the chains are probed here, a span for ULTRACE= */
+static int probe_chain(blkid_probe pr, struct blkid_chain *chn, int safe)
+{
+	struct ul_trace_span sp;
+	int rc;
+
+	ul_trace_begin(&sp, chn->driver->name);
+	UL_PROBE1(libblkid, probe__begin, chn->driver->name);
+	rc = safe ? chn->driver->safeprobe(pr, chn) : chn->driver->probe(pr, chn);
+	UL_PROBE2(libblkid, probe__end, chn->driver->name, rc);
+	ul_trace_end(&sp);
+	return rc;
+}
+
 void *blkid_probe_get_binary_data(blkid_probe pr, struct blkid_chain *chn)
 {
 	int rc, org_prob_flags;
@@ -383,7 +409,7 @@ void *blkid_probe_get_binary_data(blkid_probe pr, struct blkid_chain *chn)
 	chn->binary = TRUE;
 	blkid_probe_chain_reset_position(chn);
 
-	rc = chn->driver->probe(pr, chn);
+	rc = probe_chain(pr, chn, 0);
 
 	chn->binary = FALSE;
 	blkid_probe_chain_reset_position(chn);
@@ -541,15 +567,12 @@ int __blkid_probe_filter_types(blkid_probe pr, int chain, int flag, char *names[
 	return 0;
 }
 
-static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint64_t len)
-{
-	ssize_t ret;
-	struct blkid_bufinfo *bf = NULL;
+static int insert_buffer(blkid_probe pr, struct blkid_bufinfo *bf);
 
-	if (lseek(pr->fd, real_off, SEEK_SET) == (off_t) -1) {
-		errno = 0;
-		return NULL;
-	}
+static struct blkid_bufinfo *new_buffer(blkid_probe pr, uint64_t real_off, uint64_t len)
+{
+	struct blkid_bufinfo *bf;
+	uint64_t bufsz = len;
 
 	/* someone trying to overflow some buffers? */
 	if (len > ULONG_MAX - sizeof(struct blkid_bufinfo)) {
@@ -557,22 +580,46 @@ static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint
 		return NULL;
 	}
 
-	/* allocate info and space for data by one malloc call */
-	bf = calloc(1, sizeof(struct blkid_bufinfo) + len);
+	/* window sized buffers are shared by all windows, see reset */
+	if (len > BLKID_SPARE_BUFSZ / 2 && len <= BLKID_SPARE_BUFSZ) {
+		if (pr->nspares) {
+			bf = pr->spares[--pr->nspares];
+			goto done;
+		}
+		bufsz = BLKID_SPARE_BUFSZ;
+	}
+
+	/* allocate info and space for data by one malloc call, the data
+	 * area is always completely overwritten by read() */
+	bf = malloc(sizeof(struct blkid_bufinfo) + bufsz);
 	if (!bf) {
 		errno = ENOMEM;
 		return NULL;
 	}
 
 	bf->data = ((unsigned char *) bf) + sizeof(struct blkid_bufinfo);
+	bf->bufsz = bufsz;
+done:
 	bf->len = len;
 	bf->off = real_off;
-	INIT_LIST_HEAD(&bf->bufs);
+	bf->maxend = real_off + len;
+	return bf;
+}
+
+static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint64_t len)
+{
+	ssize_t ret;
+	struct blkid_bufinfo *bf = new_buffer(pr, real_off, len);
+
+	if (!bf)
+		return NULL;
 
 	DBG(LOWPROBE, ul_debug("\tread: off=%"PRIu64" len=%"PRIu64"",
 	                       real_off, len));
 
-	ret = read(pr->fd, bf->data, len);
+	pr->nbuf_reads++;
+	UL_PROBE2(libblkid, read__buffer, real_off, len);
+	ret = pread(pr->fd, bf->data, len, real_off);
 	if (ret != (ssize_t) len) {
 		DBG(LOWPROBE, ul_debug("\tread failed: %m"));
 		free(bf);
@@ -587,19 +634,257 @@ static struct blkid_bufinfo *read_buffer(blkid_probe pr, uint64_t real_off, uint
 	return bf;
 }
 
+/*
+ * Returns the read-ahead window at the begin (BLKID_FL_PREFETCH_HEAD) or at
+ * the end (BLKID_FL_PREFETCH_TAIL) of the probing area.
+ */
+static int get_prefetch_window(blkid_probe pr, int flag, uint64_t *woff, uint64_t *wlen)
+{
+	uint64_t end = pr->off + pr->size;
+
+	if (flag == BLKID_FL_PREFETCH_HEAD) {
+		*woff = pr->off;
+		*wlen = min(pr->size, (uint64_t) BLKID_PREFETCH_SIZE);
+		return 0;
+	}
+
+	if (pr->size <= BLKID_PREFETCH_SIZE)
+		return -1;	/* covered by the head window */
+
+	/* align to 4K from the begin of the device */
+	*woff = (end - BLKID_PREFETCH_SIZE) & ~((uint64_t) 4095);
+	if (*woff < pr->off + BLKID_PREFETCH_SIZE)
+		*woff = pr->off + BLKID_PREFETCH_SIZE;
+	*wlen = end - *woff;
+	return 0;
+}
+
+#ifdef HAVE_IO_URING_SUPPORT
+/*
+ * Reads all not yet prefetched windows by one io_uring submission. The window
+ * with the requested range is returned, the others are added to the buffers.
+ *
+ * Sets @done to zero if io_uring is not usable; the caller is expected to
+ * use the classic read() then.
+ */
+static int get_uring(blkid_probe pr)
+{
+	if (pr->uring)
+		return 0;
+
+	pr->uring = blkid_new_uring(BLKID_URING_ENTRIES);
+	if (!pr->uring) {
+		DBG(LOWPROBE, ul_debug("io_uring unavailable, fallback to read()"));
+		pr->io_method = BLKID_IO_PREAD;
+		errno = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/* broken ring, don't use it anymore */
+static void drop_uring(blkid_probe pr)
+{
+	blkid_free_uring(pr->uring);
+	pr->uring = NULL;
+	pr->io_method = BLKID_IO_PREAD;
+	errno = 0;
+}
+
+static struct blkid_bufinfo *prefetch_uring(blkid_probe pr, uint64_t real_off,
+					    uint64_t len, int *done)
+{
+	static const int flags[] = { BLKID_FL_PREFETCH_HEAD, BLKID_FL_PREFETCH_TAIL };
+	struct blkid_uring_req reqs[ARRAY_SIZE(flags)];
+	struct blkid_bufinfo *bufs[ARRAY_SIZE(flags)], *res = NULL;
+	int reqflags = 0;
+	size_t i, n = 0;
+
+	*done = 0;
+
+	if (get_uring(pr) != 0)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(flags); i++) {
+		uint64_t woff, wlen;
+
+		if ((pr->flags & flags[i])
+		    || get_prefetch_window(pr, flags[i], &woff, &wlen) != 0)
+			continue;
+
+		bufs[n] = new_buffer(pr, woff, wlen);
+		if (!bufs[n])
+			break;
+		reqs[n].off = woff;
+		reqs[n].len = wlen;
+		reqs[n].data = bufs[n]->data;
+		reqflags |= flags[i];
+
+		DBG(LOWPROBE, ul_debug("\tprefetch %s (io_uring): off=%"PRIu64" len=%"PRIu64,
+				flags[i] == BLKID_FL_PREFETCH_HEAD ? "head" : "tail",
+				woff, wlen));
+		n++;
+	}
+
+	if (n && blkid_uring_read(pr->uring, pr->fd, reqs, n) != 0) {
+		drop_uring(pr);
+		for (i = 0; i < n; i++)
+			free(bufs[i]);
+		return NULL;
+	}
+
+	pr->flags |= reqflags;
+	pr->nbuf_reads += n;
+	*done = 1;
+
+	for (i = 0; i < n; i++) {
+		struct blkid_bufinfo *bf = bufs[i];
+
+		if (reqs[i].res < 0 || (uint64_t) reqs[i].res != bf->len) {
+			DBG(LOWPROBE, ul_debug("\tio_uring read failed: off=%"PRIu64" rc=%d",
+						bf->off, reqs[i].res));
+			free(bf);
+		} else if (!res && real_off >= bf->off
+			   && real_off + len <= bf->off + bf->len)
+			res = bf;
+		else if (insert_buffer(pr, bf) != 0)
+			free(bf);
+	}
+
+	errno = 0;
+	return res;
+}
+#endif
+
+/*
+ * Read the whole read-ahead window (begin or end of the probing area) which
+ * contains the requested range. The window is read only once per buffers
+ * life-cycle; returns NULL if the range is outside the windows, if the window
+ * has been already read or on read error -- the caller is expected to
+ * fallback to read_buffer() for the requested range only.
+ */
+static struct blkid_bufinfo *prefetch_buffer(blkid_probe pr, uint64_t real_off, uint64_t len)
+{
+	struct blkid_bufinfo *bf;
+	uint64_t end = pr->off + pr->size;
+	uint64_t woff, wlen;
+	int flag;
+
+	if (S_ISCHR(pr->mode) || blkid_probe_is_cdrom(pr))
+		return NULL;
+
+	if (real_off < pr->off || real_off + len > end)
+		return NULL;
+
+	if (real_off + len <= pr->off + BLKID_PREFETCH_SIZE
+	    || pr->size <= BLKID_PREFETCH_SIZE)
+		flag = BLKID_FL_PREFETCH_HEAD;
+	else if (real_off >= end - BLKID_PREFETCH_SIZE)
+		flag = BLKID_FL_PREFETCH_TAIL;
+	else
+		return NULL;
+
+	if (pr->flags & flag)
+		return NULL;
+
+#ifdef HAVE_IO_URING_SUPPORT
+	if (pr->io_method == BLKID_IO_URING) {
+		int done;
+
+		bf = prefetch_uring(pr, real_off, len, &done);
+		if (done)
+			return bf;
+	}
+#endif
+	pr->flags |= flag;
+
+	if (get_prefetch_window(pr, flag, &woff, &wlen) != 0
+	    || real_off < woff || real_off + len > woff + wlen)
+		return NULL;
+
+	DBG(LOWPROBE, ul_debug("\tprefetch %s: off=%"PRIu64" len=%"PRIu64,
+				flag == BLKID_FL_PREFETCH_HEAD ? "head" : "tail",
+				woff, wlen));
+	bf = read_buffer(pr, woff, wlen);
+	if (!bf)
+		errno = 0;	/* non-fatal, try the range only */
+	return bf;
+}
+
+/*
+ * Returns number of buffers which start at or before @real_off, it's also
+ * index of the first buffer behind @real_off in the sorted pr->buffers[].
+ */
+static size_t count_buffers_before(blkid_probe pr, uint64_t real_off)
+{
+	size_t lo = 0, hi = pr->nbuffers;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (pr->buffers[mid]->off <= real_off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Add a new buffer to pr->buffers[]. The array is sorted by offset and
+ * every item knows the maximal end of all the previous buffers, so
+ * the lookup is binary search and short walk back over buffers which may
+ * overlap the requested range.
+ */
+static int insert_buffer(blkid_probe pr, struct blkid_bufinfo *bf)
+{
+	size_t i, idx;
+	uint64_t maxend;
+
+	if (pr->nbuffers == pr->buffers_max) {
+		size_t sz = pr->buffers_max + 16;
+		struct blkid_bufinfo **tmp;
+
+		tmp = realloc(pr->buffers, sz * sizeof(struct blkid_bufinfo *));
+		if (!tmp)
+			return -ENOMEM;
+		pr->buffers = tmp;
+		pr->buffers_max = sz;
+	}
+
+	idx = count_buffers_before(pr, bf->off);
+	if (idx < pr->nbuffers)
+		memmove(&pr->buffers[idx + 1], &pr->buffers[idx],
+			(pr->nbuffers - idx) * sizeof(struct blkid_bufinfo *));
+	pr->buffers[idx] = bf;
+	pr->nbuffers++;
+
+	/* update maximal ends for the new and all following buffers */
+	maxend = idx ? pr->buffers[idx - 1]->maxend : 0;
+	for (i = idx; i < pr->nbuffers; i++) {
+		struct blkid_bufinfo *x = pr->buffers[i];
+
+		maxend = max(maxend, x->off + x->len);
+		x->maxend = maxend;
+	}
+	return 0;
+}
+
 /*
  * Search in buffers we already have in memory
  */
 static struct blkid_bufinfo *get_cached_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 {
 	uint64_t real_off = pr->off + off;
-	struct list_head *p;
+	size_t i = count_buffers_before(pr, real_off);
 
-	list_for_each(p, &pr->buffers) {
-		struct blkid_bufinfo *x =
-				list_entry(p, struct blkid_bufinfo, bufs);
+	while (i > 0) {
+		struct blkid_bufinfo *x = pr->buffers[--i];
 
-		if (real_off >= x->off && real_off + len <= x->off + x->len) {
+		if (x->maxend < real_off + len)
+			break;	/* no previous buffer is large enough */
+
+		if (real_off + len <= x->off + x->len) {
 			DBG(BUFFER, ul_debug("\treuse: off=%"PRIu64" len=%"PRIu64" (for off=%"PRIu64" len=%"PRIu64")",
 						x->off, x->len, real_off, len));
 			return x;
@@ -618,7 +903,7 @@ static struct blkid_bufinfo *get_cached_buffer(blkid_probe pr, uint64_t off, uin
 static int hide_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 {
 	uint64_t real_off = pr->off + off;
-	struct list_head *p;
+	size_t i;
 	int ct = 0;
 
 	if (UINT64_MAX - len < off) {
@@ -626,15 +911,17 @@ static int hide_buffer(blkid_probe pr, uint64_t off, uint64_t len)
 		return -EINVAL;
 	}
 
-	list_for_each(p, &pr->buffers) {
-		struct blkid_bufinfo *x =
-			list_entry(p, struct blkid_bufinfo, bufs);
+	i = count_buffers_before(pr, real_off);
+	while (i > 0) {
+		struct blkid_bufinfo *x = pr->buffers[--i];
 		unsigned char *data;
 
-		if (real_off >= x->off && real_off + len <= x->off + x->len) {
+		if (x->maxend < real_off + len)
+			break;
+
+		if (real_off + len <= x->off + x->len) {
 
 			assert(x->off <= real_off);
-			assert(x->off + x->len >= real_off + len);
 
 			data = real_off ? x->data + (real_off - x->off) : x->data;
 
@@ -696,12 +983,20 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 
 	/* try buffers we already have in memory or read from device */
 	bf = get_cached_buffer(pr, off, len);
-	if (!bf) {
-		bf = read_buffer(pr, real_off, len);
+	if (bf)
+		pr->nbuf_hits++;
+	else {
+		bf = prefetch_buffer(pr, real_off, len);
+		if (!bf)
+			bf = read_buffer(pr, real_off, len);
 		if (!bf)
 			return NULL;
 
-		list_add_tail(&bf->bufs, &pr->buffers);
+		if (insert_buffer(pr, bf) != 0) {
+			free(bf);
+			errno = ENOMEM;
+			return NULL;
+		}
 	}
 
 	assert(bf->off <= real_off);
@@ -711,6 +1006,98 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 	return real_off ? bf->data + (real_off - bf->off) : bf->data;
 }
 
+/*
+ * Reads the 512-byte @sectors (relative to the probing area) by one io_uring
+ * submission and keeps them in the buffers for the later
+ * blkid_probe_get_sector() calls. The sectors are usually a guess of the
+ * caller, so it's a hint only: nothing is read without io_uring, or if the
+ * first sector is already in the buffers (the previous guess was good).
+ * The sectors out of the probing area are ignored.
+ *
+ * Returns: number of the read sectors.
+ */
+size_t blkid_probe_prefetch_sectors(blkid_probe pr, const uint64_t *sectors,
+				    size_t nsectors)
+{
+#ifdef HAVE_IO_URING_SUPPORT
+	struct blkid_uring_req reqs[BLKID_URING_ENTRIES];
+	struct blkid_bufinfo *bufs[BLKID_URING_ENTRIES];
+	size_t i, n = 0, nread = 0;
+
+	if (!nsectors || pr->size == 0 || S_ISCHR(pr->mode))
+		return 0;
+
+	if (pr->parent &&
+	    pr->parent->devno == pr->devno &&
+	    pr->parent->off <= pr->off &&
+	    pr->parent->off + pr->parent->size >= pr->off + pr->size) {
+		/* cloned prober, see blkid_probe_get_buffer() */
+		uint64_t tmp[BLKID_URING_ENTRIES], shift = pr->off - pr->parent->off;
+
+		if (shift % 0x200)
+			return 0;
+		nsectors = min(nsectors, ARRAY_SIZE(tmp));
+		for (i = 0; i < nsectors; i++)
+			tmp[i] = sectors[i] + (shift >> 9);
+		return blkid_probe_prefetch_sectors(pr->parent, tmp, nsectors);
+	}
+
+	if (pr->io_method != BLKID_IO_URING
+	    || blkid_probe_is_cdrom(pr)
+	    || get_cached_buffer(pr, sectors[0] << 9, 0x200))
+		return 0;
+	if (get_uring(pr) != 0)
+		return 0;
+
+	for (i = 0; i < nsectors && n < ARRAY_SIZE(reqs); i++) {
+		uint64_t off = sectors[i] << 9;
+
+		if (sectors[i] > UINT64_MAX >> 9
+		    || off + 0x200 > pr->size
+		    || get_cached_buffer(pr, off, 0x200))
+			continue;
+
+		bufs[n] = new_buffer(pr, pr->off + off, 0x200);
+		if (!bufs[n])
+			break;
+		reqs[n].off = bufs[n]->off;
+		reqs[n].len = 0x200;
+		reqs[n].data = bufs[n]->data;
+		n++;
+	}
+
+	if (!n)
+		goto done;
+
+	DBG(LOWPROBE, ul_debug("\tprefetch %zu sectors (io_uring)", n));
+
+	if (blkid_uring_read(pr->uring, pr->fd, reqs, n) != 0) {
+		drop_uring(pr);
+		for (i = 0; i < n; i++)
+			free(bufs[i]);
+		return 0;
+	}
+	pr->nbuf_reads += n;
+
+	for (i = 0; i < n; i++) {
+		if (reqs[i].res != 0x200 || insert_buffer(pr, bufs[i]) != 0) {
+			free(bufs[i]);
+			continue;
+		}
+		UL_PROBE2(libblkid, read__buffer, reqs[i].off, reqs[i].len);
+		nread++;
+	}
+done:
+	errno = 0;
+	return nread;
+#else
+	(void) pr;
+	(void) sectors;
+	(void) nsectors;
+	return 0;
+#endif
+}
+
 /**
  * blkid_probe_reset_buffers:
  * @pr: prober
@@ -727,34 +1114,82 @@ unsigned char *blkid_probe_get_buffer(blkid_probe pr, uint64_t off, uint64_t len
 int blkid_probe_reset_buffers(blkid_probe pr)
 {
 	uint64_t ct = 0, len = 0;
+	size_t i;
 
-	pr->flags &= ~BLKID_FL_MODIF_BUFF;
+	pr->flags &= ~(BLKID_FL_MODIF_BUFF | BLKID_FL_PREFETCH_HEAD
+					   | BLKID_FL_PREFETCH_TAIL);
 
-	if (list_empty(&pr->buffers))
+	if (!pr->nbuffers) {
+		pr->nbuf_hits = pr->nbuf_reads = 0;
 		return 0;
+	}
 
 	DBG(BUFFER, ul_debug("Resetting probing buffers"));
 
-	while (!list_empty(&pr->buffers)) {
-		struct blkid_bufinfo *bf = list_entry(pr->buffers.next,
-						struct blkid_bufinfo, bufs);
+	for (i = 0; i < pr->nbuffers; i++) {
+		struct blkid_bufinfo *bf = pr->buffers[i];
+
 		ct++;
 		len += bf->len;
-		list_del(&bf->bufs);
 
 		DBG(BUFFER, ul_debug(" remove buffer: [off=%"PRIu64", len=%"PRIu64"]",
 		                     bf->off, bf->len));
-		free(bf);
+		if (bf->bufsz == BLKID_SPARE_BUFSZ && pr->nspares < BLKID_NSPARES)
+			pr->spares[pr->nspares++] = bf;
+		else
+			free(bf);
 	}
 
-	DBG(LOWPROBE, ul_debug(" buffers summary: %"PRIu64" bytes by %"PRIu64" read() calls",
-			len, ct));
+	DBG(LOWPROBE, ul_debug(" buffers summary: %"PRIu64" bytes by %"PRIu64" read() calls, "
+			"%"PRIu64" hits, %"PRIu64" misses",
+			len, ct, pr->nbuf_hits, pr->nbuf_reads));
 
-	INIT_LIST_HEAD(&pr->buffers);
+	pr->nbuf_hits = pr->nbuf_reads = 0;
+	pr->nbuffers = 0;
 
 	return 0;
 }
 
+/**
+ * blkid_probe_set_io_method:
+ * @pr: prober
+ * @method: BLKID_IO_PREAD or BLKID_IO_URING
+ *
+ * Sets the way how the library reads data from the device. The default is
+ * BLKID_IO_PREAD (classic pread(2) calls). BLKID_IO_URING submits the reads of
+ * the begin and the end of the device by one io_uring submission. If io_uring
+ * is not available at runtime (old kernel, seccomp, ...) the library silently
+ * falls back to pread(2).
+ *
+ * Since: 2.39
+ *
+ * Returns: 0 on success, -ENOTSUP if the method is not supported by the
+ * library build, or -EINVAL.
+ */
+int blkid_probe_set_io_method(blkid_probe pr, int method)
+{
+	switch (method) {
+	case BLKID_IO_PREAD:
+#ifdef HAVE_IO_URING_SUPPORT
+		blkid_free_uring(pr->uring);
+		pr->uring = NULL;
+#endif
+		break;
+	case BLKID_IO_URING:
+#ifndef HAVE_IO_URING_SUPPORT
+		return -ENOTSUP;
+#endif
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	DBG(LOWPROBE, ul_debug("I/O method set to %s",
+			method == BLKID_IO_URING ? "io_uring" : "pread"));
+	pr->io_method = method;
+	return 0;
+}
+
 /**
  * blkid_probe_hide_range:
  * @pr: prober
@@ -897,6 +1332,12 @@ int blkid_probe_set_device(blkid_probe pr, int fd,
 	blkid_reset_probe(pr);
 	blkid_probe_reset_buffers(pr);
 
+	/* the batched wipes are usable with the same file descriptor only */
+	if (pr->nwipes && (fd != pr->fd || (pr->flags & BLKID_FL_PRIVATE_FD))) {
+		DBG(LOWPROBE, ul_debug("%zu not flushed wipes discarded", pr->nwipes));
+		pr->nwipes = 0;
+	}
+
 	if ((pr->flags & BLKID_FL_PRIVATE_FD) && pr->fd >= 0)
 		close(pr->fd);
 
@@ -920,6 +1361,7 @@ int blkid_probe_set_device(blkid_probe pr, int fd,
 	pr->wipe_size = 0;
 	pr->wipe_chain = NULL;
 	pr->zone_size = 0;
+	blkid_probe_reset_zones(pr);
 
 	if (fd < 0)
 		return 1;
@@ -1287,37 +1729,118 @@ int blkid_do_probe(blkid_probe pr)
 			continue;
 
 		/* rc: -1 = error, 0 = success, 1 = no result */
-		rc = chn->driver->probe(pr, chn);
+		rc = probe_chain(pr, chn, 0);
 
 	} while (rc == 1);
 
 	return rc;
 }
 
+/* number of zones requested by one BLKREPORTZONE in blkid_probe_get_zones() */
+#define BLKID_ZONES_PER_REPORT	16
+
+/*
+ * blkid_probe_get_zones:
+ * @pr: prober
+ * @offset: offset in bytes from the begin of the device
+ * @nzones: number of zones
+ *
+ * Returns @nzones consecutive zones, the first one contains @offset. The zones
+ * are reported by one BLKREPORTZONE ioctl (by BLKID_ZONES_PER_REPORT at least)
+ * and cached in the probe, the clones use the cache of the parent. This way
+ * the superblock probers and blkid_do_wipe() do not repeat the ioctl for
+ * the same zones.
+ *
+ * Returns: pointer to the zones, or NULL on error or if not zoned device.
+ */
+#ifdef HAVE_LINUX_BLKZONED_H
+struct blk_zone *blkid_probe_get_zones(blkid_probe pr, uint64_t offset,
+				       uint32_t nzones)
+{
+	struct blk_zone_report *rep;
+	uint64_t sector, zone_sectors;
+	uint32_t n;
+
+	if (pr->parent)
+		return blkid_probe_get_zones(pr->parent, offset, nzones);
+
+	if (!pr->zone_size || !nzones || pr->fd < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	zone_sectors = pr->zone_size >> 9;
+	sector = (offset & ~(pr->zone_size - 1)) >> 9;
+
+	rep = pr->zones;
+	if (rep && rep->nr_zones && sector >= rep->zones[0].start) {
+		uint64_t i = (sector - rep->zones[0].start) / zone_sectors;
+
+		if (i + nzones <= rep->nr_zones && rep->zones[i].start == sector) {
+			DBG(LOWPROBE, ul_debug("\treuse zones: sector=%"PRIu64" n=%u",
+						sector, nzones));
+			return &rep->zones[i];
+		}
+	}
+
+	blkid_probe_reset_zones(pr);
+
+	n = max(nzones, (uint32_t) BLKID_ZONES_PER_REPORT);
+	rep = calloc(1, sizeof(struct blk_zone_report) + n * sizeof(struct blk_zone));
+	if (!rep)
+		return NULL;
+
+	rep->sector = sector;
+	rep->nr_zones = n;
+
+	DBG(LOWPROBE, ul_debug("\treport zones: sector=%"PRIu64" n=%u", sector, n));
+
+	if (ioctl(pr->fd, BLKREPORTZONE, rep) != 0) {
+		free(rep);
+		return NULL;
+	}
+	if (rep->nr_zones < nzones || rep->zones[0].start != sector) {
+		free(rep);
+		errno = EIO;
+		return NULL;
+	}
+
+	pr->zones = rep;
+	return &rep->zones[0];
+}
+#else
+struct blk_zone *blkid_probe_get_zones(blkid_probe pr __attribute__((__unused__)),
+				       uint64_t offset __attribute__((__unused__)),
+				       uint32_t nzones __attribute__((__unused__)))
+{
+	errno = ENOTSUP;
+	return NULL;
+}
+#endif
+
+/* drops the cached zones, must be called after zone state modification */
+void blkid_probe_reset_zones(blkid_probe pr)
+{
+	if (pr->parent)
+		blkid_probe_reset_zones(pr->parent);
+
+	free(pr->zones);
+	pr->zones = NULL;
+}
+
 #ifdef HAVE_LINUX_BLKZONED_H
 static int is_conventional(blkid_probe pr, uint64_t offset)
 {
-	struct blk_zone_report *rep = NULL;
-	int ret;
-	uint64_t zone_mask;
+	struct blk_zone *zone;
 
 	if (!pr->zone_size)
 		return 1;
 
-	zone_mask = ~(pr->zone_size - 1);
-	rep = blkdev_get_zonereport(blkid_probe_get_fd(pr),
-				    (offset & zone_mask) >> 9, 1);
-	if (!rep)
+	zone = blkid_probe_get_zones(pr, offset, 1);
+	if (!zone)
 		return -1;
 
-	if (rep->zones[0].type == BLK_ZONE_TYPE_CONVENTIONAL)
-		ret = 1;
-	else
-		ret = 0;
-
-	free(rep);
-
-	return ret;
+	return zone->type == BLK_ZONE_TYPE_CONVENTIONAL ? 1 : 0;
 }
 #else
 static inline int is_conventional(blkid_probe pr __attribute__((__unused__)),
@@ -1327,6 +1850,159 @@ static inline int is_conventional(blkid_probe pr __attribute__((__unused__)),
 }
 #endif
 
+static int add_wipe_range(blkid_probe pr, uint64_t off, uint64_t len)
+{
+	if (pr->nwipes == pr->wipes_max) {
+		size_t sz = pr->wipes_max + 16;
+		struct blkid_wipe_range *tmp;
+
+		tmp = realloc(pr->wipes, sz * sizeof(struct blkid_wipe_range));
+		if (!tmp)
+			return -ENOMEM;
+		pr->wipes = tmp;
+		pr->wipes_max = sz;
+	}
+
+	DBG(LOWPROBE, ul_debug("do_wipe: batched [offset=%"PRIu64", len=%"PRIu64"]",
+				off, len));
+	pr->wipes[pr->nwipes].off = off;
+	pr->wipes[pr->nwipes].len = len;
+	pr->nwipes++;
+	return 0;
+}
+
+static int cmp_wipe_ranges(const void *a, const void *b)
+{
+	const struct blkid_wipe_range *x = a, *y = b;
+
+	if (x->off != y->off)
+		return x->off < y->off ? -1 : 1;
+	return 0;
+}
+
+/* zeroize the @wipes within the sector aligned region @start..@end */
+static int write_wipe_region(blkid_probe pr, uint64_t start, uint64_t end,
+			     struct blkid_wipe_range *wipes, size_t nwipes)
+{
+	unsigned char *buf;
+	uint64_t covered = start;
+	size_t i;
+	int rc = 0;
+
+	/* the signatures cover the whole region, no read-modify-write */
+	for (i = 0; i < nwipes && wipes[i].off <= covered; i++)
+		covered = max(covered, wipes[i].off + wipes[i].len);
+
+	if (covered >= end && S_ISBLK(pr->mode)) {
+		uint64_t range[2] = { start, end - start };
+
+		if (ioctl(pr->fd, BLKZEROOUT, range) == 0) {
+			DBG(LOWPROBE, ul_debug("flush wipes: zeroed out [%"PRIu64"..%"PRIu64"]",
+						start, end));
+			return 0;
+		}
+	}
+
+	buf = malloc(end - start);
+	if (!buf)
+		return -ENOMEM;
+
+	if (pread(pr->fd, buf, end - start, start) != (ssize_t) (end - start)) {
+		rc = errno ? -errno : -EIO;
+		goto done;
+	}
+	for (i = 0; i < nwipes; i++)
+		memset(buf + (wipes[i].off - start), 0, wipes[i].len);
+
+	DBG(LOWPROBE, ul_debug("flush wipes: write [%"PRIu64"..%"PRIu64"], %zu signatures",
+				start, end, nwipes));
+	if (pwrite(pr->fd, buf, end - start, start) != (ssize_t) (end - start))
+		rc = errno ? -errno : -EIO;
+done:
+	free(buf);
+	return rc;
+}
+
+/**
+ * blkid_probe_set_wipe_batch:
+ * @pr: prober
+ * @enable: TRUE or FALSE
+ *
+ * In the batch mode blkid_do_wipe() does not write to the device. The
+ * signature is erased from in-memory cached data only (like dryrun) and its
+ * area is remembered. All the areas are written by blkid_probe_flush_wipes()
+ * later: the areas within the same sectors are merged, every region is
+ * written by one write(2) call and the device is synced once. The wipes on
+ * sequential zones of zoned devices are not batched.
+ *
+ * The not flushed wipes are discarded by blkid_free_probe(), or by
+ * blkid_probe_set_device() with another file descriptor.
+ *
+ * Since: 2.39
+ *
+ * Returns: 0 on success, or <0 in case of error.
+ */
+int blkid_probe_set_wipe_batch(blkid_probe pr, int enable)
+{
+	if (enable)
+		pr->flags |= BLKID_FL_WIPE_BATCH;
+	else
+		pr->flags &= ~BLKID_FL_WIPE_BATCH;
+	return 0;
+}
+
+/**
+ * blkid_probe_flush_wipes:
+ * @pr: prober
+ *
+ * Writes all the signature areas remembered by blkid_do_wipe() in the batch
+ * mode (see blkid_probe_set_wipe_batch()) and syncs the device. All
+ * in-memory cached data from the device are reset.
+ *
+ * Since: 2.39
+ *
+ * Returns: 0 on success, or <0 in case of error.
+ */
+int blkid_probe_flush_wipes(blkid_probe pr)
+{
+	uint64_t ssz;
+	size_t i, n;
+	int rc = 0;
+
+	if (!pr->nwipes)
+		return 0;
+	if (pr->fd < 0)
+		return -EINVAL;
+
+	ssz = blkid_probe_get_sectorsize(pr);
+	qsort(pr->wipes, pr->nwipes, sizeof(struct blkid_wipe_range),
+			cmp_wipe_ranges);
+
+	for (i = 0; rc == 0 && i < pr->nwipes; i = n) {
+		uint64_t start = pr->wipes[i].off / ssz * ssz;
+		uint64_t end = pr->wipes[i].off + pr->wipes[i].len;
+
+		/* merge the signatures within the same or adjacent sectors */
+		for (n = i + 1; n < pr->nwipes; n++) {
+			if (pr->wipes[n].off / ssz * ssz > (end + ssz - 1) / ssz * ssz)
+				break;
+			end = max(end, pr->wipes[n].off + pr->wipes[n].len);
+		}
+		end = (end + ssz - 1) / ssz * ssz;
+
+		rc = write_wipe_region(pr, start, end, &pr->wipes[i], n - i);
+	}
+
+	if (rc == 0 && fsync(pr->fd) != 0)
+		rc = -errno;
+
+	DBG(LOWPROBE, ul_debug("flush wipes: %zu signatures [rc=%d]", pr->nwipes, rc));
+	pr->nwipes = 0;
+	pr->flags &= ~BLKID_FL_MODIF_BUFF;
+	blkid_probe_reset_buffers(pr);
+	return rc;
+}
+
 /**
  * blkid_do_wipe:
  * @pr: prober
@@ -1357,7 +2033,8 @@ static inline int is_conventional(blkid_probe pr __attribute__((__unused__)),
  * </example>
  *
  * See also blkid_probe_step_back() if you cannot use this built-in wipe
- * function, but you want to use libblkid probing as a source for wiping.
+ * function, but you want to use libblkid probing as a source for wiping, and
+ * blkid_probe_set_wipe_batch() to write all the wipes at once.
  *
  * Returns: 0 on success, and -1 in case of error.
  */
@@ -1415,6 +2092,14 @@ int blkid_do_wipe(blkid_probe pr, int dryrun)
 	    "do_wipe [offset=0x%"PRIx64" (%"PRIu64"), len=%zu, chain=%s, idx=%d, dryrun=%s]\n",
 	    offset, offset, len, chn->driver->name, chn->idx, dryrun ? "yes" : "not"));
 
+	if (!dryrun && len && conventional && (pr->flags & BLKID_FL_WIPE_BATCH)) {
+		/* write later by blkid_probe_flush_wipes() */
+		if (add_wipe_range(pr, offset, len) != 0)
+			return -1;
+		blkid_probe_hide_range(pr, magoff, len);
+		return blkid_probe_step_back(pr);
+	}
+
 	if (lseek(fd, offset, SEEK_SET) == (off_t) -1)
 		return -1;
 
@@ -1436,6 +2121,7 @@ int blkid_do_wipe(blkid_probe pr, int dryrun)
 			};
 
 			rc = ioctl(fd, BLKRESETZONE, &range);
+			blkid_probe_reset_zones(pr);	/* write pointer moved */
 			if (rc < 0)
 				return -1;
 #else
@@ -1590,7 +2276,7 @@ int blkid_do_safeprobe(blkid_probe pr)
 
 		blkid_probe_chain_reset_position(chn);
 
-		rc = chn->driver->safeprobe(pr, chn);
+		rc = probe_chain(pr, chn, 1);
 
 		blkid_probe_chain_reset_position(chn);
 
@@ -1644,7 +2330,7 @@ int blkid_do_fullprobe(blkid_probe pr)
 
 		blkid_probe_chain_reset_position(chn);
 
-		rc = chn->driver->probe(pr, chn);
+		rc = probe_chain(pr, chn, 0);
 
 		blkid_probe_chain_reset_position(chn);
 
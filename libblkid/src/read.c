@@ -391,6 +391,12 @@ void blkid_read_cache(blkid_cache cache)
 		goto errout;
 	}
 
+	if ((cache->bic_flags & BLKID_BIC_FL_BINARY) &&
+	    blkid_read_bincache(cache, &st) == 0) {
+		close(fd);
+		goto done;
+	}
+
 	DBG(CACHE, ul_debug("reading cache file %s",
 				cache->bic_filename));
 
@@ -419,7 +425,7 @@ void blkid_read_cache(blkid_cache cache)
 		}
 	}
 	fclose(file);
-
+done:
 	/*
 	 * Initially we do not need to write out the cache file.
 	 */
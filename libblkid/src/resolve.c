@@ -65,8 +65,8 @@ char *blkid_get_devname(blkid_cache cache, const char *token,
 
 	if (!token)
 		return NULL;
-	if (!cache && blkid_get_cache(&c, NULL) < 0)
-		return NULL;
+	if (!cache)
+		blkid_init_debug(0);
 
 	DBG(TAG, ul_debug("looking for %s%s%s %s", token, value ? "=" : "",
 		   value ? value : "", cache ? "in cache" : "from disk"));
@@ -82,6 +82,13 @@ char *blkid_get_devname(blkid_cache cache, const char *token,
 		value = v;
 	}
 
+	if (!cache) {
+		/* don't read the cache if the binary cache knows the device */
+		ret = blkid_bincache_get_devname(NULL, token, value);
+		if (ret || blkid_get_cache(&c, NULL) < 0)
+			goto out;
+	}
+
 	dev = blkid_find_dev_with_tag(c, token, value);
 	if (!dev)
 		goto out;
@@ -201,6 +201,9 @@ int blkid_flush_cache(blkid_cache cache)
 		}
 	}
 
+	if (ret == 1 && (cache->bic_flags & BLKID_BIC_FL_BINARY))
+		blkid_save_bincache(cache, filename);
+
 errout:
 	free(tmp);
 	if (filename != cache->bic_filename)
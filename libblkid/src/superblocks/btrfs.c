@@ -152,22 +152,15 @@ static int sb_write_pointer(blkid_probe pr, struct blk_zone *zones, uint64_t *wp
 
 static int sb_log_offset(blkid_probe pr, uint64_t *bytenr_ret)
 {
-	uint32_t zone_num = 0;
-	uint32_t zone_size_sector;
-	struct blk_zone_report *rep;
 	struct blk_zone *zones;
 	int ret;
 	int i;
 	uint64_t wp;
 
-
-	zone_size_sector = pr->zone_size >> SECTOR_SHIFT;
-	rep = blkdev_get_zonereport(pr->fd, zone_num * zone_size_sector, 2);
-	if (!rep) {
-		ret = -errno;
-		goto out;
-	}
-	zones = (struct blk_zone *)(rep + 1);
+	/* the zones are cached in the probe, don't free */
+	zones = blkid_probe_get_zones(pr, 0, BTRFS_NR_SB_LOG_ZONES);
+	if (!zones)
+		return -errno;
 
 	/*
 	 * Use the head of the first conventional zone, if the zones
@@ -177,16 +170,13 @@ static int sb_log_offset(blkid_probe pr, uint64_t *bytenr_ret)
 		if (zones[i].type == BLK_ZONE_TYPE_CONVENTIONAL) {
 			DBG(LOWPROBE, ul_debug("(btrfs) checking conventional zone"));
 			*bytenr_ret = zones[i].start << SECTOR_SHIFT;
-			ret = 0;
-			goto out;
+			return 0;
 		}
 	}
 
 	ret = sb_write_pointer(pr, zones, &wp);
-	if (ret != -ENOENT && ret) {
-		ret = 1;
-		goto out;
-	}
+	if (ret != -ENOENT && ret)
+		return 1;
 	if (ret != -ENOENT) {
 		if (wp == zones[0].start << SECTOR_SHIFT)
 			wp = (zones[1].start + zones[1].len) << SECTOR_SHIFT;
@@ -194,11 +184,7 @@ static int sb_log_offset(blkid_probe pr, uint64_t *bytenr_ret)
 	}
 	*bytenr_ret = wp;
 
-	ret = 0;
-out:
-	free(rep);
-
-	return ret;
+	return 0;
 }
 #endif
 
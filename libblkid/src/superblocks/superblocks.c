@@ -85,6 +85,7 @@
 
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn);
 static int superblocks_safeprobe(blkid_probe pr, struct blkid_chain *chn);
+static void superblocks_free_data(blkid_probe pr, void *data);
 
 static int blkid_probe_set_usage(blkid_probe pr, int usage);
 
@@ -190,6 +191,28 @@ const struct blkid_chaindrv superblocks_drv = {
 	.has_fltr     = TRUE,
 	.probe        = superblocks_probe,
 	.safeprobe    = superblocks_safeprobe,
+	.free_data    = superblocks_free_data
+};
+
+/*
+ * Magic strings index -- all magic strings at fixed offsets (no hints, no
+ * zones) sorted by offset of the 1KiB buffer where the magic is expected.
+ * It's used to evaluate all the magic strings by one pass over the buffers
+ * before the probing loop, then probers without matching magic are skipped
+ * without blkid_probe_get_idmag().
+ */
+struct sb_magic_ref {
+	uint64_t		off;	/* offset of the 1KiB buffer */
+	const struct blkid_idmag *mag;
+	size_t			idx;	/* index in idinfos[] */
+};
+
+struct sb_chaindata {
+	struct sb_magic_ref	*refs;
+	size_t			nrefs;
+
+	unsigned long		*indexed;	/* all magics of the idinfo in refs[] */
+	unsigned long		*candidates;	/* idinfos with possible magic match */
 };
 
 /**
@@ -344,8 +367,175 @@ int blkid_superblocks_get_name(size_t idx, const char **name, int *usage)
 /*
  * The blkid_do_probe() backend.
  */
+static void superblocks_free_data(blkid_probe pr __attribute__((__unused__)),
+				 void *data)
+{
+	struct sb_chaindata *sb = (struct sb_chaindata *) data;
+
+	if (!sb)
+		return;
+	free(sb->refs);
+	free(sb->indexed);
+	free(sb->candidates);
+	free(sb);
+}
+
+static int cmp_magic_refs(const void *a, const void *b)
+{
+	const struct sb_magic_ref *ra = a, *rb = b;
+
+	if (ra->off != rb->off)
+		return ra->off < rb->off ? -1 : 1;
+	/* keep order of the idinfos[] for the same buffer */
+	if (ra->idx != rb->idx)
+		return ra->idx < rb->idx ? -1 : 1;
+	return ra->mag < rb->mag ? -1 : ra->mag > rb->mag;
+}
+
+static struct sb_chaindata *superblocks_get_index(struct blkid_chain *chn)
+{
+	struct sb_chaindata *sb;
+	size_t i, n = 0;
+
+	if (chn->data)
+		return (struct sb_chaindata *) chn->data;
+
+	sb = calloc(1, sizeof(*sb));
+	if (!sb)
+		return NULL;
+
+	sb->indexed = calloc(1, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+	sb->candidates = calloc(1, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+	if (!sb->indexed || !sb->candidates)
+		goto err;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag;
+
+		for (mag = &idinfos[i]->magics[0]; mag->magic; mag++)
+			n++;
+	}
+
+	sb->refs = calloc(n ? n : 1, sizeof(struct sb_magic_ref));
+	if (!sb->refs)
+		goto err;
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		const struct blkid_idmag *mag = &idinfos[i]->magics[0];
+		size_t first = sb->nrefs;
+
+		if (!mag->magic)
+			continue;	/* probing function only */
+
+		for ( ; mag->magic; mag++) {
+			struct sb_magic_ref *ref;
+
+			if (mag->hoff || mag->is_zoned)
+				break;	/* offset unknown in advance */
+
+			ref = &sb->refs[sb->nrefs++];
+			ref->off = ((uint64_t) mag->kboff + (mag->sboff >> 10)) << 10;
+			ref->mag = mag;
+			ref->idx = i;
+		}
+
+		if (mag->magic)
+			sb->nrefs = first;	/* not usable for the index */
+		else
+			blkid_bmp_set_item(sb->indexed, i);
+	}
+
+	qsort(sb->refs, sb->nrefs, sizeof(struct sb_magic_ref), cmp_magic_refs);
+
+	DBG(LOWPROBE, ul_debug("superblocks: magic index initialized (%zu magics)",
+				sb->nrefs));
+	chn->data = (void *) sb;
+	return sb;
+err:
+	superblocks_free_data(NULL, sb);
+	return NULL;
+}
+
+/*
+ * Returns 1 if the prober is not usable for the current device (or
+ * filtered out by user).
+ */
+static int superblocks_skip_idinfo(blkid_probe pr, struct blkid_chain *chn, size_t i)
+{
+	const struct blkid_idinfo *id = idinfos[i];
+
+	if (chn->fltr && blkid_bmp_get_item(chn->fltr, i))
+		return 1;
+
+	if (id->minsz && (unsigned)id->minsz > pr->size)
+		return 1;	/* the device is too small */
+
+	/* don't probe for RAIDs, swap or journal on CD/DVDs */
+	if ((id->usage & (BLKID_USAGE_RAID | BLKID_USAGE_OTHER)) &&
+	    blkid_probe_is_cdrom(pr))
+		return 1;
+
+	/* don't probe for RAIDs on floppies */
+	if ((id->usage & BLKID_USAGE_RAID) && blkid_probe_is_tiny(pr))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Evaluates all indexed magic strings and marks probers which may be
+ * detected on the device. The buffers are requested in ascending order and
+ * only once for all magics within the same 1KiB.
+ *
+ * Read errors are not reported here; the prober is marked as candidate and
+ * the error is returned later by blkid_probe_get_idmag() in the probing
+ * loop (so the result is the same as without the index).
+ */
+static void superblocks_eval_index(blkid_probe pr, struct blkid_chain *chn,
+				   struct sb_chaindata *sb)
+{
+	unsigned char *buf = NULL;
+	uint64_t bufoff = 0;
+	int bufok = 0;
+	size_t i;
+
+	memset(sb->candidates, 0, blkid_bmp_nbytes(ARRAY_SIZE(idinfos)));
+
+	for (i = 0; i < ARRAY_SIZE(idinfos); i++) {
+		if (!blkid_bmp_get_item(sb->indexed, i))
+			blkid_bmp_set_item(sb->candidates, i);
+	}
+
+	for (i = 0; i < sb->nrefs; i++) {
+		const struct sb_magic_ref *ref = &sb->refs[i];
+
+		if (blkid_bmp_get_item(sb->candidates, ref->idx))
+			continue;	/* already matched by another magic */
+		if (superblocks_skip_idinfo(pr, chn, ref->idx))
+			continue;
+
+		if (!bufok || bufoff != ref->off) {
+			buf = blkid_probe_get_buffer(pr, ref->off, 1024);
+			bufoff = ref->off;
+			bufok = 1;
+			if (!buf && errno) {
+				/* report the error by the probing loop */
+				blkid_bmp_set_item(sb->candidates, ref->idx);
+				errno = 0;
+				bufok = 0;
+				continue;
+			}
+		}
+
+		if (buf && !memcmp(ref->mag->magic,
+				   buf + (ref->mag->sboff & 0x3ff), ref->mag->len))
+			blkid_bmp_set_item(sb->candidates, ref->idx);
+	}
+}
+
 static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 {
+	struct sb_chaindata *sb;
 	size_t i;
 	int rc = BLKID_PROBE_NONE;
 
@@ -370,6 +560,11 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 	DBG(LOWPROBE, ul_debug("--> starting probing loop [SUBLKS idx=%d]",
 		chn->idx));
 
+	/* evaluate magic strings for all probers at the begin of the loop */
+	sb = superblocks_get_index(chn);
+	if (sb && chn->idx < 0)
+		superblocks_eval_index(pr, chn, sb);
+
 	i = chn->idx < 0 ? 0 : chn->idx + 1U;
 
 	for ( ; i < ARRAY_SIZE(idinfos); i++) {
@@ -406,6 +601,11 @@ static int superblocks_probe(blkid_probe pr, struct blkid_chain *chn)
 
 		DBG(LOWPROBE, ul_debug("[%zd] %s:", i, id->name));
 
+		if (sb && !blkid_bmp_get_item(sb->candidates, i)) {
+			rc = BLKID_PROBE_NONE;
+			continue;	/* magic not found (see the index) */
+		}
+
 		rc = blkid_probe_get_idmag(pr, id, &off, &mag);
 		if (rc < 0)
 			break;
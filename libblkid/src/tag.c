@@ -27,10 +27,94 @@ static blkid_tag blkid_new_tag(void)
 	DBG(TAG, ul_debugobj(tag, "alloc"));
 	INIT_LIST_HEAD(&tag->bit_tags);
 	INIT_LIST_HEAD(&tag->bit_names);
+	INIT_LIST_HEAD(&tag->bit_hash);
 
 	return tag;
 }
 
+/* FNV-1a of "NAME=value" */
+unsigned int blkid_tag_hash(const char *name, const char *value)
+{
+	uint32_t h = 2166136261U;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *) name; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	h = (h ^ '=') * 16777619U;
+	for (p = (const unsigned char *) value; *p; p++)
+		h = (h ^ *p) * 16777619U;
+	return h;
+}
+
+#define BLKID_HASH_MINSIZE	64
+
+/*
+ * Resize the cache hash table; the table is kept at least as large as
+ * the number of tags, so the chains are short.
+ */
+static int resize_hash(blkid_cache cache, size_t nbuckets)
+{
+	struct list_head *hash;
+	size_t i;
+
+	hash = malloc(nbuckets * sizeof(struct list_head));
+	if (!hash)
+		return -BLKID_ERR_MEM;
+	for (i = 0; i < nbuckets; i++)
+		INIT_LIST_HEAD(&hash[i]);
+
+	for (i = 0; i < cache->bic_nbuckets; i++) {
+		struct list_head *p, *pnext;
+
+		list_for_each_safe(p, pnext, &cache->bic_hash[i]) {
+			blkid_tag tag = list_entry(p, struct blkid_struct_tag, bit_hash);
+
+			list_del(&tag->bit_hash);
+			list_add_tail(&tag->bit_hash,
+				      &hash[tag->bit_hashval % nbuckets]);
+		}
+	}
+
+	DBG(TAG, ul_debug("tags hash resized to %zu buckets", nbuckets));
+	free(cache->bic_hash);
+	cache->bic_hash = hash;
+	cache->bic_nbuckets = nbuckets;
+	return 0;
+}
+
+static void unhash_tag(blkid_tag tag)
+{
+	if (list_empty(&tag->bit_hash))
+		return;
+	list_del_init(&tag->bit_hash);
+	tag->bit_dev->bid_cache->bic_nhashed--;
+}
+
+/*
+ * Adds @tag to the cache hash table. If the table cannot be allocated then
+ * the hash is disabled and we fallback to the tag lists.
+ */
+static void hash_tag(blkid_cache cache, blkid_tag tag)
+{
+	if (cache->bic_flags & BLKID_BIC_FL_NOHASH)
+		return;
+
+	if (cache->bic_nhashed >= cache->bic_nbuckets) {
+		size_t sz = cache->bic_nbuckets ? cache->bic_nbuckets * 2 :
+						  BLKID_HASH_MINSIZE;
+		if (resize_hash(cache, sz) != 0 && !cache->bic_nbuckets) {
+			DBG(TAG, ul_debug("cannot allocate tags hash"));
+			cache->bic_flags |= BLKID_BIC_FL_NOHASH;
+			return;
+		}
+	}
+
+	tag->bit_hashval = blkid_tag_hash(tag->bit_name, tag->bit_val);
+	list_add_tail(&tag->bit_hash,
+		      &cache->bic_hash[tag->bit_hashval % cache->bic_nbuckets]);
+	cache->bic_nhashed++;
+}
+
 void blkid_free_tag(blkid_tag tag)
 {
 	if (!tag)
@@ -40,6 +124,7 @@ void blkid_free_tag(blkid_tag tag)
 
 	list_del(&tag->bit_tags);	/* list of tags for this device */
 	list_del(&tag->bit_names);	/* list of tags with this type */
+	unhash_tag(tag);		/* cache->bic_hash */
 
 	free(tag->bit_name);
 	free(tag->bit_val);
@@ -139,8 +224,11 @@ int blkid_set_tag(blkid_dev dev, const char *name,
 			return 0;
 		}
 		DBG(TAG, ul_debugobj(t, "update (%s) '%s' -> '%s'", t->bit_name, t->bit_val, val));
+		unhash_tag(t);
 		free(t->bit_val);
 		t->bit_val = val;
+		if (dev->bid_cache)
+			hash_tag(dev->bid_cache, t);
 	} else {
 		/* Existing tag not present, add to device */
 		if (!(t = blkid_new_tag()))
@@ -168,6 +256,7 @@ int blkid_set_tag(blkid_dev dev, const char *name,
 					      &dev->bid_cache->bic_tags);
 			}
 			list_add_tail(&t->bit_names, &head->bit_names);
+			hash_tag(dev->bid_cache, t);
 		}
 	}
 
@@ -313,12 +402,10 @@ void blkid_tag_iterate_end(blkid_tag_iterate iter)
 }
 
 /*
- * This function returns a device which matches a particular
- * type/value pair.  If there is more than one device that matches the
- * search specification, it returns the one with the highest priority
- * value.  This allows us to give preference to EVMS or LVM devices.
+ * Returns a device from the cache which matches the type/value pair, the
+ * device is verified but nothing new is probed. See blkid_find_dev_with_tag().
  */
-blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
+blkid_dev blkid_find_cached_dev_with_tag(blkid_cache cache,
 					 const char *type,
 					 const char *value)
 {
@@ -326,21 +413,31 @@ blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
 	blkid_dev	dev;
 	int		pri;
 	struct list_head *p;
-	int		probe_new = 0, probe_all = 0;
 
 	if (!cache || !type || !value)
 		return NULL;
 
-	blkid_read_cache(cache);
-
-	DBG(TAG, ul_debug("looking for tag %s=%s in cache", type, value));
-
 try_again:
 	pri = -1;
 	dev = NULL;
-	head = blkid_find_head_cache(cache, type);
 
-	if (head) {
+	if (cache->bic_hash && !(cache->bic_flags & BLKID_BIC_FL_NOHASH)) {
+		unsigned int h = blkid_tag_hash(type, value);
+
+		list_for_each(p, &cache->bic_hash[h % cache->bic_nbuckets]) {
+			blkid_tag tmp = list_entry(p, struct blkid_struct_tag,
+						   bit_hash);
+
+			if (tmp->bit_hashval == h &&
+			    !strcmp(tmp->bit_name, type) &&
+			    !strcmp(tmp->bit_val, value) &&
+			    (tmp->bit_dev->bid_pri > pri) &&
+			    !access(tmp->bit_dev->bid_name, F_OK)) {
+				dev = tmp->bit_dev;
+				pri = dev->bid_pri;
+			}
+		}
+	} else if ((head = blkid_find_head_cache(cache, type))) {
 		list_for_each(p, &head->bit_names) {
 			blkid_tag tmp = list_entry(p, struct blkid_struct_tag,
 						   bit_names);
@@ -358,20 +455,38 @@ try_again:
 		if (!dev || dev->bid_flags & BLKID_BID_FL_VERIFIED)
 			goto try_again;
 	}
+	return dev;
+}
+
+/*
+ * This function returns a device which matches a particular
+ * type/value pair.  If there is more than one device that matches the
+ * search specification, it returns the one with the highest priority
+ * value.  This allows us to give preference to EVMS or LVM devices.
+ */
+blkid_dev blkid_find_dev_with_tag(blkid_cache cache,
+					 const char *type,
+					 const char *value)
+{
+	blkid_dev	dev;
 
-	if (!dev && !probe_new) {
+	if (!cache || !type || !value)
+		return NULL;
+
+	blkid_read_cache(cache);
+
+	DBG(TAG, ul_debug("looking for tag %s=%s in cache", type, value));
+
+	dev = blkid_find_cached_dev_with_tag(cache, type, value);
+	if (!dev) {
 		if (blkid_probe_all_new(cache) < 0)
 			return NULL;
-		probe_new++;
-		goto try_again;
+		dev = blkid_find_cached_dev_with_tag(cache, type, value);
 	}
-
-	if (!dev && !probe_all
-	    && !(cache->bic_flags & BLKID_BIC_FL_PROBED)) {
+	if (!dev && !(cache->bic_flags & BLKID_BIC_FL_PROBED)) {
 		if (blkid_probe_all(cache) < 0)
 			return NULL;
-		probe_all++;
-		goto try_again;
+		dev = blkid_find_cached_dev_with_tag(cache, type, value);
 	}
 	return dev;
 }
@@ -16,7 +16,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/ioctl.h>
 
+#include "blkdev.h"
 #include "sysfs.h"
 #include "topology.h"
 
@@ -32,87 +34,154 @@ static struct topology_val {
 	int (*set_ulong)(blkid_probe, unsigned long);
 	int (*set_int)(blkid_probe, int);
 
+	/* the attribute is in the whole-disk directory only */
+	int wholedisk;
+
 } topology_vals[] = {
-	{ "alignment_offset", NULL, blkid_topology_set_alignment_offset },
-	{ "queue/minimum_io_size", blkid_topology_set_minimum_io_size },
-	{ "queue/optimal_io_size", blkid_topology_set_optimal_io_size },
-	{ "queue/physical_block_size", blkid_topology_set_physical_sector_size },
-	{ "queue/dax", blkid_topology_set_dax },
+	{ "alignment_offset", NULL, blkid_topology_set_alignment_offset, 0 },
+	{ "queue/minimum_io_size", blkid_topology_set_minimum_io_size, NULL, 1 },
+	{ "queue/optimal_io_size", blkid_topology_set_optimal_io_size, NULL, 1 },
+	{ "queue/physical_block_size", blkid_topology_set_physical_sector_size, NULL, 1 },
+	{ "queue/dax", blkid_topology_set_dax, NULL, 1 },
 };
 
-static int probe_sysfs_tp(blkid_probe pr,
-		const struct blkid_idmag *mag __attribute__((__unused__)))
+#define TOPOLOGY_NVALS	ARRAY_SIZE(topology_vals)
+
+struct topology_data {
+	unsigned int	have;			/* bitmask of topology_vals[] */
+	int64_t		data[TOPOLOGY_NVALS];
+};
+
+/*
+ * The partitions share the queue limits of the whole-disk. The values of the
+ * last whole-disk are kept for the next partitions, the disk sequence number
+ * (since Linux 5.15) detects a different disk with the same devno.
+ */
+static __thread struct topology_disk {
+	dev_t			devno;
+	uint64_t		diskseq;
+	struct topology_data	tp;
+} last_disk;
+
+static uint64_t get_diskseq(blkid_probe pr)
+{
+	uint64_t seq = 0;
+
+	if (ioctl(pr->fd, BLKGETDISKSEQ, &seq) != 0)
+		return 0;
+	return seq;
+}
+
+/* reads the values from @dev directory, @wholedisk attributes only if @disk */
+static int read_topology(dev_t dev, int disk, struct topology_data *tp)
 {
-	dev_t dev;
-	int rc, set_parent = 1;
 	struct path_cxt *pc;
-	size_t i, count = 0;
+	size_t i;
 
-	dev = blkid_probe_get_devno(pr);
-	if (!dev)
-		return 1;
 	pc = ul_new_sysfs_path(dev, NULL, NULL);
 	if (!pc)
-		return 1;
-
-	rc = 1;		/* nothing (default) */
+		return -ENOMEM;
 
-	for (i = 0; i < ARRAY_SIZE(topology_vals); i++) {
+	for (i = 0; i < TOPOLOGY_NVALS; i++) {
 		struct topology_val *val = &topology_vals[i];
-		int ok = ul_path_access(pc, F_OK, val->attr) == 0;
 
-		rc = 1;	/* nothing */
+		if (val->wholedisk && !disk)
+			continue;
+		if (val->set_ulong) {
+			uint64_t data;
 
-		if (!ok && set_parent) {
-			dev_t disk = blkid_probe_get_wholedisk_devno(pr);
-			set_parent = 0;
+			if (ul_path_read_u64(pc, &data, val->attr) != 0)
+				continue;
+			tp->data[i] = (int64_t) data;
+		} else {
+			if (ul_path_read_s64(pc, &tp->data[i], val->attr) != 0)
+				continue;
+		}
+		tp->have |= 1 << i;
+	}
 
-			/*
-			 * Read attributes from "disk" if the current device is
-			 * a partition. Note that sysfs ul_path_* API is able
-			 * to redirect requests to attributes if parent is set.
-			 */
-			if (disk && disk != dev) {
-				struct path_cxt *parent = ul_new_sysfs_path(disk, NULL, NULL);
-				if (!parent)
-					goto done;
+	ul_unref_path(pc);
+	return 0;
+}
 
-				sysfs_blkdev_set_parent(pc, parent);
-				ul_unref_path(parent);
+static int read_wholedisk_topology(blkid_probe pr, dev_t disk,
+				   struct topology_data *tp)
+{
+	uint64_t seq = get_diskseq(pr);
+	int rc;
+
+	if (seq && last_disk.devno == disk && last_disk.diskseq == seq) {
+		DBG(LOWPROBE, ul_debug("topology: cached whole-disk %u:%u",
+				major(disk), minor(disk)));
+		*tp = last_disk.tp;
+		return 0;
+	}
 
-				/* try it again */
-				ok = ul_path_access(pc, F_OK, val->attr) == 0;
+	memset(tp, 0, sizeof(*tp));
+	rc = read_topology(disk, 1, tp);
+	if (rc == 0 && seq) {
+		last_disk.devno = disk;
+		last_disk.diskseq = seq;
+		last_disk.tp = *tp;
+	}
+	return rc;
+}
+
+static int probe_sysfs_tp(blkid_probe pr,
+		const struct blkid_idmag *mag __attribute__((__unused__)))
+{
+	struct topology_data tp = { .have = 0 };
+	dev_t dev, disk;
+	int rc = 1;	/* nothing (default) */
+	size_t i, count = 0;
+
+	dev = blkid_probe_get_devno(pr);
+	if (!dev)
+		return 1;
+	disk = blkid_probe_get_wholedisk_devno(pr);
+
+	if (!disk || disk == dev) {
+		if (read_topology(dev, 1, &tp) != 0)
+			return 1;
+	} else {
+		struct topology_data part = { .have = 0 };
+
+		/*
+		 * Partition -- the own attributes (alignment offset) and the
+		 * rest from the whole-disk.
+		 */
+		if (read_wholedisk_topology(pr, disk, &tp) != 0
+		    || read_topology(dev, 0, &part) != 0)
+			return 1;
+
+		for (i = 0; i < TOPOLOGY_NVALS; i++) {
+			if (part.have & (1 << i)) {
+				tp.data[i] = part.data[i];
+				tp.have |= 1 << i;
 			}
 		}
-		if (!ok)
-			continue;	/* attribute does not exist */
-
-		if (val->set_ulong) {
-			uint64_t data;
+	}
 
-			if (ul_path_read_u64(pc, &data, val->attr) != 0)
-				continue;
-			rc = val->set_ulong(pr, (unsigned long) data);
+	for (i = 0; i < TOPOLOGY_NVALS; i++) {
+		struct topology_val *val = &topology_vals[i];
 
-		} else if (val->set_int) {
-			int64_t data;
+		if (!(tp.have & (1 << i)))
+			continue;	/* attribute does not exist */
 
-			if (ul_path_read_s64(pc, &data, val->attr) != 0)
-				continue;
-			rc = val->set_int(pr, (int) data);
-		}
+		if (val->set_ulong)
+			rc = val->set_ulong(pr, (unsigned long) tp.data[i]);
+		else
+			rc = val->set_int(pr, (int) tp.data[i]);
 
 		if (rc < 0)
-			goto done;	/* error */
+			return rc;	/* error */
 		if (rc == 0)
 			count++;
 	}
 
-done:
-	ul_unref_path(pc);		/* unref pc and parent */
 	if (count)
 		return 0;		/* success */
-	return rc;			/* error or nothing */
+	return rc;			/* nothing */
 }
 
 const struct blkid_idinfo sysfs_tp_idinfo =
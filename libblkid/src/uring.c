@@ -0,0 +1,246 @@
+/*
+ * uring.c - io_uring based reads for the low-level probing
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ *
+ * The ring is used to submit more reads (e.g. begin and end of the device)
+ * by one syscall. It's intentionally minimal and does not depend on liburing.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "blkidP.h"
+
+#ifdef HAVE_IO_URING_SUPPORT
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct blkid_uring {
+	int			fd;		/* ring file descriptor */
+	unsigned int		entries;	/* number of SQ entries */
+
+	void			*sq_ring;
+	void			*cq_ring;
+	size_t			sq_ring_sz;
+	size_t			cq_ring_sz;
+
+	struct io_uring_sqe	*sqes;
+	size_t			sqes_sz;
+
+	unsigned int		*sq_tail;
+	unsigned int		*sq_mask;
+	unsigned int		*sq_array;
+
+	unsigned int		*cq_head;
+	unsigned int		*cq_tail;
+	unsigned int		*cq_mask;
+	struct io_uring_cqe	*cqes;
+};
+
+#if defined(SYS_io_uring_setup) && defined(SYS_io_uring_enter)
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags)
+{
+	return syscall(SYS_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+#else
+static int sys_io_uring_setup(unsigned int entries __attribute__((__unused__)),
+			      struct io_uring_params *p __attribute__((__unused__)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static int sys_io_uring_enter(int fd __attribute__((__unused__)),
+			      unsigned int to_submit __attribute__((__unused__)),
+			      unsigned int min_complete __attribute__((__unused__)),
+			      unsigned int flags __attribute__((__unused__)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
+void blkid_free_uring(struct blkid_uring *ur)
+{
+	if (!ur)
+		return;
+	if (ur->sqes && ur->sqes != MAP_FAILED)
+		munmap(ur->sqes, ur->sqes_sz);
+	if (ur->cq_ring && ur->cq_ring != MAP_FAILED && ur->cq_ring != ur->sq_ring)
+		munmap(ur->cq_ring, ur->cq_ring_sz);
+	if (ur->sq_ring && ur->sq_ring != MAP_FAILED)
+		munmap(ur->sq_ring, ur->sq_ring_sz);
+	if (ur->fd >= 0)
+		close(ur->fd);
+	free(ur);
+}
+
+struct blkid_uring *blkid_new_uring(unsigned int entries)
+{
+	struct io_uring_params p;
+	struct blkid_uring *ur;
+	int single = 0;
+
+	ur = calloc(1, sizeof(*ur));
+	if (!ur)
+		return NULL;
+
+	memset(&p, 0, sizeof(p));
+	ur->fd = sys_io_uring_setup(entries, &p);
+	if (ur->fd < 0) {
+		DBG(LOWPROBE, ul_debug("io_uring setup failed: %m"));
+		free(ur);
+		return NULL;
+	}
+	ur->entries = p.sq_entries;
+
+	ur->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ur->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		single = 1;
+		ur->sq_ring_sz = ur->cq_ring_sz = max(ur->sq_ring_sz, ur->cq_ring_sz);
+	}
+#endif
+	ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+	if (ur->sq_ring == MAP_FAILED)
+		goto err;
+
+	if (single)
+		ur->cq_ring = ur->sq_ring;
+	else {
+		ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+		if (ur->cq_ring == MAP_FAILED)
+			goto err;
+	}
+
+	ur->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED)
+		goto err;
+
+	ur->sq_tail  = (unsigned int *) ((char *) ur->sq_ring + p.sq_off.tail);
+	ur->sq_mask  = (unsigned int *) ((char *) ur->sq_ring + p.sq_off.ring_mask);
+	ur->sq_array = (unsigned int *) ((char *) ur->sq_ring + p.sq_off.array);
+
+	ur->cq_head  = (unsigned int *) ((char *) ur->cq_ring + p.cq_off.head);
+	ur->cq_tail  = (unsigned int *) ((char *) ur->cq_ring + p.cq_off.tail);
+	ur->cq_mask  = (unsigned int *) ((char *) ur->cq_ring + p.cq_off.ring_mask);
+	ur->cqes     = (struct io_uring_cqe *) ((char *) ur->cq_ring + p.cq_off.cqes);
+
+	DBG(LOWPROBE, ul_debug("io_uring initialized (entries=%u)", ur->entries));
+	return ur;
+err:
+	DBG(LOWPROBE, ul_debug("io_uring mmap failed: %m"));
+	blkid_free_uring(ur);
+	return NULL;
+}
+
+/* reads the available completions, returns their number */
+static unsigned int uring_reap(struct blkid_uring *ur,
+			       struct blkid_uring_req *reqs, size_t nreqs)
+{
+	unsigned int head, ctail, n = 0;
+
+	head = *ur->cq_head;
+	ctail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != ctail) {
+		struct io_uring_cqe *cqe = &ur->cqes[head & *ur->cq_mask];
+
+		if (cqe->user_data < nreqs)
+			reqs[cqe->user_data].res = cqe->res;
+		head++;
+		n++;
+	}
+	__atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+/*
+ * Submits all @reqs by one io_uring_enter() call (if possible) and waits
+ * for all completions. The result of every request (number of bytes or
+ * -errno) is in reqs[].res.
+ *
+ * Returns: 0 on success or -errno if the ring is not usable anymore. The
+ * function always returns after all the submitted reads are completed, so the
+ * caller may free the buffers and the ring.
+ */
+int blkid_uring_read(struct blkid_uring *ur, int fd,
+		     struct blkid_uring_req *reqs, size_t nreqs)
+{
+	struct iovec iov[BLKID_URING_ENTRIES];
+	unsigned int tail, i, n, submitted = 0, done = 0;
+
+	if (nreqs > BLKID_URING_ENTRIES || nreqs > ur->entries)
+		return -EINVAL;
+	n = nreqs;
+
+	tail = *ur->sq_tail;
+	for (i = 0; i < n; i++) {
+		unsigned int idx = tail & *ur->sq_mask;
+		struct io_uring_sqe *sqe = &ur->sqes[idx];
+
+		iov[i].iov_base = reqs[i].data;
+		iov[i].iov_len = reqs[i].len;
+		reqs[i].res = -EIO;
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = fd;
+		sqe->off = reqs[i].off;
+		sqe->addr = (uintptr_t) &iov[i];
+		sqe->len = 1;
+		sqe->user_data = i;
+
+		ur->sq_array[idx] = idx;
+		tail++;
+	}
+	__atomic_store_n(ur->sq_tail, tail, __ATOMIC_RELEASE);
+
+	while (done < n) {
+		int rc;
+
+		rc = sys_io_uring_enter(ur->fd, n - submitted, 1,
+					IORING_ENTER_GETEVENTS);
+		if (rc < 0) {
+			rc = -errno;
+			if (rc == -EINTR)
+				continue;
+			DBG(LOWPROBE, ul_debug("io_uring enter failed: %m"));
+
+			/* the submitted reads may be still in flight, wait
+			 * for them; the rest is dropped with the ring */
+			while (done < submitted) {
+				sys_io_uring_enter(ur->fd, 0, 1,
+						IORING_ENTER_GETEVENTS);
+				done += uring_reap(ur, reqs, n);
+			}
+			return rc;
+		}
+		submitted += rc;
+		done += uring_reap(ur, reqs, n);
+	}
+
+	return 0;
+}
+#endif /* HAVE_IO_URING_SUPPORT */
@@ -60,15 +60,16 @@ static void blkid_probe_to_tags(blkid_probe pr, blkid_dev dev)
  */
 blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 {
-	blkid_tag_iterate iter;
-	const char *type, *value;
 	struct stat st;
 	time_t diff, now;
-	int fd;
+	int fd, rc;
 
 	if (!dev || !cache)
 		return NULL;
 
+	if (dev->bid_flags & BLKID_BID_FL_PENDING)
+		return dev;		/* already scheduled for probing */
+
 	now = time(NULL);
 	diff = (uintmax_t)now - dev->bid_time;
 
@@ -76,15 +77,7 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		DBG(PROBE, ul_debug("blkid_verify: error %s (%d) while "
 			   "trying to stat %s", strerror(errno), errno,
 			   dev->bid_name));
-	open_err:
-		if ((errno == EPERM) || (errno == EACCES) || (errno == ENOENT)) {
-			/* We don't have read permission, just return cache data. */
-			DBG(PROBE, ul_debug("returning unverified data for %s",
-						dev->bid_name));
-			return dev;
-		}
-		blkid_free_dev(dev);
-		return NULL;
+		return blkid_verify_finish(cache, dev, NULL, &st, -1, -errno);
 	}
 
 	if (now >= dev->bid_time &&
@@ -118,6 +111,15 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		blkid_free_dev(dev);
 		return NULL;
 	}
+
+	if (cache->bic_flags & BLKID_BIC_FL_DEFER) {
+		/* will be probed later, see blkid_probe_all_parallel() */
+		DBG(PROBE, ul_debug("%s: scheduled for probing", dev->bid_name));
+		dev->bid_flags |= BLKID_BID_FL_PENDING;
+		list_add_tail(&dev->bid_pending, &cache->bic_pending);
+		return dev;
+	}
+
 	if (!cache->probe) {
 		cache->probe = blkid_new_probe();
 		if (!cache->probe) {
@@ -126,47 +128,83 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 		}
 	}
 
-	fd = open(dev->bid_name, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
-	if (fd < 0) {
+	rc = blkid_verify_probe(cache->probe, dev, &fd);
+	return blkid_verify_finish(cache, dev, cache->probe, &st, fd, rc);
+}
+
+/*
+ * Opens the device and probes it by @pr. This is the I/O part of the
+ * verification and it does not modify the cache and @dev, so it's possible
+ * to probe more devices in parallel (every thread with its own prober).
+ *
+ * Returns: 0 on success (@fd is open and results are in @pr), 1 if nothing
+ * found or the device is not readable, or -errno if open() failed.
+ */
+int blkid_verify_probe(blkid_probe pr, blkid_dev dev, int *fd)
+{
+	*fd = open(dev->bid_name, O_RDONLY|O_CLOEXEC|O_NONBLOCK);
+	if (*fd < 0) {
+		int rc = -errno;
+
 		DBG(PROBE, ul_debug("blkid_verify: error %s (%d) while "
 					"opening %s", strerror(errno), errno,
 					dev->bid_name));
-		goto open_err;
+		return rc;
 	}
 
-	if (blkid_probe_set_device(cache->probe, fd, 0, 0)) {
+	if (blkid_probe_set_device(pr, *fd, 0, 0)) {
 		/* failed to read the device */
-		close(fd);
-		blkid_free_dev(dev);
-		return NULL;
+		close(*fd);
+		*fd = -1;
+		return 1;
 	}
 
-	/* remove old cache info */
-	iter = blkid_tag_iterate_begin(dev);
-	while (blkid_tag_next(iter, &type, &value) == 0)
-		blkid_set_tag(dev, type, NULL, 0);
-	blkid_tag_iterate_end(iter);
-
 	/* enable superblocks probing */
-	blkid_probe_enable_superblocks(cache->probe, TRUE);
-	blkid_probe_set_superblocks_flags(cache->probe,
+	blkid_probe_enable_superblocks(pr, TRUE);
+	blkid_probe_set_superblocks_flags(pr,
 		BLKID_SUBLKS_LABEL | BLKID_SUBLKS_UUID |
 		BLKID_SUBLKS_TYPE | BLKID_SUBLKS_SECTYPE);
 
 	/* enable partitions probing */
-	blkid_probe_enable_partitions(cache->probe, TRUE);
-	blkid_probe_set_partitions_flags(cache->probe, BLKID_PARTS_ENTRY_DETAILS);
+	blkid_probe_enable_partitions(pr, TRUE);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
 
 	/* probe */
-	if (blkid_do_safeprobe(cache->probe)) {
-		/* found nothing or error */
+	return blkid_do_safeprobe(pr) ? 1 : 0;
+}
+
+/*
+ * Applies result from blkid_verify_probe() to @dev, resets the prober and
+ * closes @fd. Returns @dev or NULL if the device has been removed from the
+ * cache.
+ */
+blkid_dev blkid_verify_finish(blkid_cache cache, blkid_dev dev, blkid_probe pr,
+			      struct stat *st, int fd, int rc)
+{
+	if (rc < 0) {
+		if (rc == -EPERM || rc == -EACCES || rc == -ENOENT) {
+			/* We don't have read permission, just return cache data. */
+			DBG(PROBE, ul_debug("returning unverified data for %s",
+						dev->bid_name));
+			return dev;
+		}
 		blkid_free_dev(dev);
-		dev = NULL;
+		return NULL;
 	}
 
-	if (dev) {
+	if (rc == 0) {
+		blkid_tag_iterate iter;
+		const char *type, *value;
 #ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
 		struct timeval tv;
+#endif
+		/* remove old cache info */
+		iter = blkid_tag_iterate_begin(dev);
+		while (blkid_tag_next(iter, &type, &value) == 0)
+			blkid_set_tag(dev, type, NULL, 0);
+		blkid_tag_iterate_end(iter);
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
 		if (!gettimeofday(&tv, NULL)) {
 			dev->bid_time = tv.tv_sec;
 			dev->bid_utime = tv.tv_usec;
@@ -174,24 +212,62 @@ blkid_dev blkid_verify(blkid_cache cache, blkid_dev dev)
 #endif
 			dev->bid_time = time(NULL);
 
-		dev->bid_devno = st.st_rdev;
+		dev->bid_devno = st->st_rdev;
 		dev->bid_flags |= BLKID_BID_FL_VERIFIED;
 		cache->bic_flags |= BLKID_BIC_FL_CHANGED;
 
-		blkid_probe_to_tags(cache->probe, dev);
+		blkid_probe_to_tags(pr, dev);
 
 		DBG(PROBE, ul_debug("%s: devno 0x%04llx, type %s",
-			   dev->bid_name, (long long)st.st_rdev, dev->bid_type));
+			   dev->bid_name, (long long)st->st_rdev, dev->bid_type));
+	} else {
+		/* found nothing or error */
+		blkid_free_dev(dev);
+		dev = NULL;
 	}
 
-	/* reset prober */
-	blkid_probe_reset_superblocks_filter(cache->probe);
-	blkid_probe_set_device(cache->probe, -1, 0, 0);
-	close(fd);
+	if (fd >= 0) {
+		/* reset prober */
+		blkid_probe_reset_superblocks_filter(pr);
+		blkid_probe_set_device(pr, -1, 0, 0);
+		close(fd);
+	}
 
 	return dev;
 }
 
+/*
+ * Verifies that @devname (found by blkidd or in the binary cache) has the tag
+ * @type=@value now. The device is probed by @cache only if the cache has
+ * been already read, otherwise by an in-memory cache; a device added to an
+ * unread cache would make blkid_read_cache() skip the cache file.
+ *
+ * Returns: 1 if the device has the tag, 0 otherwise.
+ */
+int blkid_verify_devname_tag(blkid_cache cache, const char *devname,
+			     const char *type, const char *value)
+{
+	blkid_cache c = cache;
+	blkid_dev dev;
+	int rc = 0;
+
+	if ((!c || list_empty(&c->bic_devs))
+	    && blkid_get_cache(&c, "/dev/null") != 0)
+		return 0;
+
+	dev = blkid_get_dev(c, devname, BLKID_DEV_CREATE);
+	if (dev)
+		dev = blkid_verify(c, dev);
+	if (dev)
+		rc = blkid_dev_has_tag(dev, type, value);
+
+	DBG(PROBE, ul_debug("%s: %s=%s %s", devname, type, value,
+				rc ? "verified" : "does not match"));
+	if (c != cache)
+		blkid_put_cache(c);
+	return rc;
+}
+
 #ifdef TEST_PROGRAM
 int main(int argc, char **argv)
 {
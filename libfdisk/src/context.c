@@ -7,6 +7,7 @@
 # include "partx.h"
 #endif
 #include "loopdev.h"
+#include "bitops.h"
 #include "fdiskP.h"
 
 #include "strutils.h"
@@ -568,6 +569,7 @@ static void reset_context(struct fdisk_context *cxt)
 	cxt->label = NULL;
 
 	fdisk_free_wipe_areas(cxt);
+	fdisk_reset_partition_changes(cxt);
 }
 
 /* fdisk_assign_device() body */
@@ -830,6 +832,95 @@ int fdisk_reassign_device(struct fdisk_context *cxt)
 	return rc;
 }
 
+/*
+ * Called by the partitioning functions to track modified partitions, see
+ * fdisk_is_partition_changed().
+ */
+void fdisk_mark_partition_changed(struct fdisk_context *cxt, size_t partno)
+{
+	size_t sz = partno / NBBY + 1;
+
+	if (cxt->changed_all)
+		return;
+
+	if (sz > cxt->changed_parts_sz) {
+		unsigned char *bm;
+
+		if (cxt->label && sz < cxt->label->nparts_max / NBBY + 1)
+			sz = cxt->label->nparts_max / NBBY + 1;
+
+		bm = realloc(cxt->changed_parts, sz);
+		if (!bm) {
+			fdisk_mark_all_changed(cxt);
+			return;
+		}
+		memset(bm + cxt->changed_parts_sz, 0, sz - cxt->changed_parts_sz);
+		cxt->changed_parts = bm;
+		cxt->changed_parts_sz = sz;
+	}
+
+	DBG(CXT, ul_debugobj(cxt, "partition %zu changed", partno));
+	setbit(cxt->changed_parts, partno);
+}
+
+void fdisk_mark_all_changed(struct fdisk_context *cxt)
+{
+	DBG(CXT, ul_debugobj(cxt, "all partitions changed"));
+	cxt->changed_all = 1;
+}
+
+/**
+ * fdisk_is_partition_changed:
+ * @cxt: context
+ * @partno: partition number (0 is the first partition)
+ *
+ * The library tracks partitions modified by fdisk_add_partition(),
+ * fdisk_set_partition(), fdisk_delete_partition() and the other partitioning
+ * functions since the device has been assigned or since
+ * fdisk_reset_partition_changes(). The operations with the whole disklabel
+ * (e.g. fdisk_create_disklabel() or fdisk_reorder_partitions()) mark all
+ * partitions as modified.
+ *
+ * This allows to update only the modified entries in UI or in kernel, see also
+ * fdisk_reread_changes().
+ *
+ * Returns: 1 if the partition has been (or may be) modified, 0 if not, <0 on error.
+ *
+ * Since: 2.39
+ */
+int fdisk_is_partition_changed(struct fdisk_context *cxt, size_t partno)
+{
+	if (!cxt)
+		return -EINVAL;
+	if (cxt->changed_all)
+		return 1;
+	if (partno / NBBY >= cxt->changed_parts_sz)
+		return 0;
+	return isset(cxt->changed_parts, partno) ? 1 : 0;
+}
+
+/**
+ * fdisk_reset_partition_changes:
+ * @cxt: context
+ *
+ * Forget all tracked partition changes, see fdisk_is_partition_changed().
+ *
+ * Returns: 0 on success, <0 on error.
+ *
+ * Since: 2.39
+ */
+int fdisk_reset_partition_changes(struct fdisk_context *cxt)
+{
+	if (!cxt)
+		return -EINVAL;
+
+	free(cxt->changed_parts);
+	cxt->changed_parts = NULL;
+	cxt->changed_parts_sz = 0;
+	cxt->changed_all = 0;
+	return 0;
+}
+
 /**
  * fdisk_reread_partition_table:
  * @cxt: context
@@ -899,9 +990,38 @@ static inline int add_to_partitions_array(
  * The function behaves like fdisk_reread_partition_table() on systems where
  * are no available BLKPG_* ioctls.
  *
+ * Since v2.39 only the partitions modified since the device has been assigned
+ * (see fdisk_is_partition_changed()) are compared with @org, so @org is
+ * expected to be the layout read after fdisk_assign_device().
+ *
  * Returns: <0 on error, or 0.
  */
 #ifdef __linux__
+
+/* returns table with the current setting of the modified partitions */
+static int get_changed_partitions(struct fdisk_context *cxt, struct fdisk_table **tb)
+{
+	size_t i;
+	int rc = 0;
+
+	*tb = fdisk_new_table();
+	if (!*tb)
+		return -ENOMEM;
+
+	for (i = 0; rc == 0 && i < cxt->changed_parts_sz * NBBY; i++) {
+		struct fdisk_partition *pa = NULL;
+
+		if (!isset(cxt->changed_parts, i)
+		    || !fdisk_is_partition_used(cxt, i))
+			continue;
+		rc = fdisk_get_partition(cxt, i, &pa);
+		if (!rc)
+			rc = fdisk_table_add_partition(*tb, pa);
+		fdisk_unref_partition(pa);
+	}
+	return rc;
+}
+
 int fdisk_reread_changes(struct fdisk_context *cxt, struct fdisk_table *org)
 {
 	struct fdisk_table *tb = NULL;
@@ -917,13 +1037,21 @@ int fdisk_reread_changes(struct fdisk_context *cxt, struct fdisk_table *org)
 	fdisk_reset_iter(&itr, FDISK_ITER_FORWARD);
 
 	/* the current layout */
-	fdisk_get_partitions(cxt, &tb);
+	if (cxt->changed_all)
+		fdisk_get_partitions(cxt, &tb);
+	else if (get_changed_partitions(cxt, &tb) != 0)
+		goto done;
+
 	/* maximal number of partitions */
 	nparts = max(fdisk_table_get_nents(tb), fdisk_table_get_nents(org));
 
 	while (fdisk_diff_tables(org, tb, &itr, &pa, &change) == 0) {
 		if (change == FDISK_DIFF_UNCHANGED)
 			continue;
+		/* not in @tb as not modified */
+		if (change == FDISK_DIFF_REMOVED && !cxt->changed_all
+		    && !fdisk_is_partition_changed(cxt, pa->partno))
+			continue;
 		switch (change) {
 		case FDISK_DIFF_REMOVED:
 			rc = add_to_partitions_array(&rem, pa, &nrems, nparts);
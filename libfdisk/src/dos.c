@@ -166,8 +166,10 @@ static void partition_set_changed(
 				changed ? "changed" : "unchanged"));
 
 	pe->changed = changed ? 1 : 0;
-	if (changed)
+	if (changed) {
 		fdisk_label_set_changed(cxt->label, 1);
+		fdisk_mark_partition_changed(cxt, i);
+	}
 }
 
 static fdisk_sector_t get_abs_partition_start(struct pte *pe)
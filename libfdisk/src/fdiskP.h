@@ -411,6 +411,10 @@ struct fdisk_context {
 	char *collision;			/* name of already existing FS/PT */
 	struct list_head wipes;			/* list of areas to wipe before write */
 
+	unsigned char *changed_parts;		/* bitmap of modified partitions */
+	size_t changed_parts_sz;		/* bitmap size in bytes */
+	unsigned int changed_all : 1;		/* all (or unknown) partitions modified */
+
 	int sizeunit;				/* SIZE fields, FDISK_SIZEUNIT_* */
 
 	/* alignment */
@@ -459,6 +463,8 @@ extern void fdisk_debug_print_table(struct fdisk_table *tb);
 extern int __fdisk_switch_label(struct fdisk_context *cxt,
 				    struct fdisk_label *lb);
 extern int fdisk_missing_geometry(struct fdisk_context *cxt);
+extern void fdisk_mark_partition_changed(struct fdisk_context *cxt, size_t partno);
+extern void fdisk_mark_all_changed(struct fdisk_context *cxt);
 
 /* alignment.c */
 fdisk_sector_t fdisk_scround(struct fdisk_context *cxt, fdisk_sector_t num);
@@ -186,7 +186,8 @@ struct fdisk_gpt_label {
 	unsigned char *ents;			/* entries (partitions) */
 
 	unsigned int no_relocate :1,		/* do not fix backup location */
-		     minimize :1;
+		     minimize :1,
+		     crc_stale :1;		/* CRCs not updated after change */
 };
 
 static void gpt_deinit(struct fdisk_label *lb);
@@ -991,14 +992,32 @@ static uint64_t last_lba(struct fdisk_context *cxt)
 	return sectors;
 }
 
-static ssize_t read_lba(struct fdisk_context *cxt, uint64_t lba,
+/* reads @bytes from @offset by pread(), returns 0 on success */
+static int gpt_pread(struct fdisk_context *cxt, off_t offset,
 			void *buffer, const size_t bytes)
 {
-	off_t offset = lba * cxt->sector_size;
+	unsigned char *p = buffer;
+	size_t done = 0;
 
-	if (lseek(cxt->dev_fd, offset, SEEK_SET) == (off_t) -1)
-		return -1;
-	return (size_t)read(cxt->dev_fd, buffer, bytes) != bytes;
+	while (done < bytes) {
+		ssize_t rc = pread(cxt->dev_fd, p + done, bytes - done,
+				   offset + done);
+		if (rc < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -errno;
+		}
+		if (rc == 0)
+			return -EIO;	/* short read */
+		done += rc;
+	}
+	return 0;
+}
+
+static ssize_t read_lba(struct fdisk_context *cxt, uint64_t lba,
+			void *buffer, const size_t bytes)
+{
+	return gpt_pread(cxt, (off_t) lba * cxt->sector_size, buffer, bytes) != 0;
 }
 
 
@@ -1007,7 +1026,6 @@ static unsigned char *gpt_read_entries(struct fdisk_context *cxt,
 					 struct gpt_header *header)
 {
 	size_t sz = 0;
-	ssize_t ssz;
 
 	unsigned char *ret = NULL;
 	off_t offset;
@@ -1030,11 +1048,8 @@ static unsigned char *gpt_read_entries(struct fdisk_context *cxt,
 	offset = (off_t) le64_to_cpu(header->partition_entry_lba) *
 		       cxt->sector_size;
 
-	if (offset != lseek(cxt->dev_fd, offset, SEEK_SET))
-		goto fail;
-
-	ssz = read(cxt->dev_fd, ret, sz);
-	if (ssz < 0 || (size_t) ssz != sz)
+	/* whole array by one pread() */
+	if (gpt_pread(cxt, offset, ret, sz) != 0)
 		goto fail;
 
 	return ret;
@@ -1085,6 +1100,25 @@ static void gpt_recompute_crc(struct gpt_header *header, unsigned char *ents)
 	header->crc32 = cpu_to_le32( gpt_header_count_crc32(header) );
 }
 
+/*
+ * The entry array CRC is expensive for large arrays, so the changes only mark
+ * the CRCs as stale and they are recomputed on write or verify.
+ */
+static inline void gpt_invalidate_crc(struct fdisk_gpt_label *gpt)
+{
+	gpt->crc_stale = 1;
+}
+
+static void gpt_update_crc(struct fdisk_gpt_label *gpt)
+{
+	if (!gpt->crc_stale)
+		return;
+
+	gpt_recompute_crc(gpt->pheader, gpt->ents);
+	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt->crc_stale = 0;
+}
+
 /*
  * Compute the 32bit CRC checksum of the partition table header.
  * Returns 1 if it is valid, otherwise 0.
@@ -1454,57 +1488,107 @@ static uint32_t check_overlap_partitions(struct fdisk_gpt_label *gpt)
 	return 0;
 }
 
+/* Range of sectors, used or free */
+struct gpt_extent {
+	uint64_t start;
+	uint64_t end;
+};
+
+static int cmp_extents(const void *a, const void *b)
+{
+	const struct gpt_extent *ae = (const struct gpt_extent *) a,
+				*be = (const struct gpt_extent *) b;
+
+	return cmp_numbers(ae->start, be->start);
+}
+
 /*
- * Find the first available block after the starting point; returns 0 if
- * there are no available blocks left, or error. From gdisk.
+ * Returns the free areas between the first usable LBA (or @start if greater)
+ * and the last usable LBA in ascending order. The used entries are sorted by
+ * start once, so the areas are found in one pass rather than by rescanning
+ * the entries array for every area (gdisk way), which is quadratic for large
+ * tables. The result has to be deallocated by free().
  */
-static uint64_t find_first_available(struct fdisk_gpt_label *gpt, uint64_t start)
+static int get_free_segments(struct fdisk_gpt_label *gpt, uint64_t start,
+			     struct gpt_extent **segs, size_t *nsegs)
 {
-	int first_moved = 0;
-	uint64_t first;
-	uint64_t fu, lu;
+	struct gpt_extent *ext, *res;
+	uint64_t pos, lu;
+	size_t i, n = 0, nres = 0;
 
 	assert(gpt);
 	assert(gpt->pheader);
 	assert(gpt->ents);
 
-	fu = le64_to_cpu(gpt->pheader->first_usable_lba);
-	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
+	*segs = NULL;
+	*nsegs = 0;
 
-	/*
-	 * Begin from the specified starting point or from the first usable
-	 * LBA, whichever is greater...
-	 */
-	first = start < fu ? fu : start;
+	ext = malloc((gpt_get_nentries(gpt) + 1) * sizeof(struct gpt_extent));
+	if (!ext)
+		return -ENOMEM;
 
-	/*
-	 * Now search through all partitions; if first is within an
-	 * existing partition, move it to the next sector after that
-	 * partition and repeat. If first was moved, set firstMoved
-	 * flag; repeat until firstMoved is not set, so as to catch
-	 * cases where partitions are out of sequential order....
-	 */
-	do {
-		size_t i;
+	for (i = 0; i < gpt_get_nentries(gpt); i++) {
+		struct gpt_entry *e = gpt_get_entry(gpt, i);
 
-		first_moved = 0;
-		for (i = 0; i < gpt_get_nentries(gpt); i++) {
-			struct gpt_entry *e = gpt_get_entry(gpt, i);
+		if (!gpt_entry_is_used(e))
+			continue;
+		ext[n].start = gpt_partition_start(e);
+		ext[n].end = gpt_partition_end(e);
+		n++;
+	}
+	qsort(ext, n, sizeof(struct gpt_extent), cmp_extents);
 
-			if (!gpt_entry_is_used(e))
-				continue;
-			if (first < gpt_partition_start(e))
-				continue;
-			if (first <= gpt_partition_end(e)) {
-				first = gpt_partition_end(e) + 1;
-				first_moved = 1;
-			}
+	res = malloc((n + 1) * sizeof(struct gpt_extent));
+	if (!res) {
+		free(ext);
+		return -ENOMEM;
+	}
+
+	pos = le64_to_cpu(gpt->pheader->first_usable_lba);
+	lu = le64_to_cpu(gpt->pheader->last_usable_lba);
+	if (start > pos)
+		pos = start;
+
+	for (i = 0; i < n && pos <= lu; i++) {
+		if (ext[i].start <= pos) {
+			/* pos is used, skip the partition */
+			if (ext[i].end >= pos)
+				pos = ext[i].end + 1;
+			continue;
 		}
-	} while (first_moved == 1);
+		res[nres].start = pos;
+		res[nres].end = min(ext[i].start - 1, lu);
+		nres++;
 
-	if (first > lu)
-		first = 0;
+		/* end before start (broken entry) splits the area only, as
+		 * in find_last_free() */
+		pos = max(ext[i].end, ext[i].start - 1) + 1;
+	}
+	if (pos <= lu) {
+		res[nres].start = pos;
+		res[nres].end = lu;
+		nres++;
+	}
+
+	free(ext);
+	*segs = res;
+	*nsegs = nres;
+	return 0;
+}
+
+/*
+ * Find the first available block after the starting point; returns 0 if
+ * there are no available blocks left, or error.
+ */
+static uint64_t find_first_available(struct fdisk_gpt_label *gpt, uint64_t start)
+{
+	struct gpt_extent *segs;
+	uint64_t first = 0;
+	size_t nsegs;
 
+	if (get_free_segments(gpt, start, &segs, &nsegs) == 0 && nsegs)
+		first = segs[0].start;
+	free(segs);
 	return first;
 }
 
@@ -1532,102 +1616,73 @@ static uint64_t find_last_free(struct fdisk_gpt_label *gpt, uint64_t start)
 	return nearest_start;
 }
 
-/* Returns the last free sector on the disk. From gdisk. */
+/* Returns the last free sector on the disk, or 0. */
 static uint64_t find_last_free_sector(struct fdisk_gpt_label *gpt)
 {
-	int last_moved;
+	struct gpt_extent *segs;
 	uint64_t last = 0;
+	size_t nsegs;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
-	/* start by assuming the last usable LBA is available */
-	last = le64_to_cpu(gpt->pheader->last_usable_lba);
-	do {
-		size_t i;
-
-		last_moved = 0;
-		for (i = 0; i < gpt_get_nentries(gpt); i++) {
-			struct gpt_entry *e = gpt_get_entry(gpt, i);
-
-			if (last >= gpt_partition_start(e) &&
-			    last <= gpt_partition_end(e)) {
-				last = gpt_partition_start(e) - 1ULL;
-				last_moved = 1;
-			}
-		}
-	} while (last_moved == 1);
-
+	if (get_free_segments(gpt, 0, &segs, &nsegs) == 0 && nsegs)
+		last = segs[nsegs - 1].end;
+	free(segs);
 	return last;
 }
 
 /*
  * Finds the first available sector in the largest block of unallocated
  * space on the disk. Returns 0 if there are no available blocks left.
- * From gdisk.
  */
 static uint64_t find_first_in_largest(struct fdisk_gpt_label *gpt)
 {
-	uint64_t start = 0, first_sect, last_sect;
-	uint64_t segment_size, selected_size = 0, selected_segment = 0;
+	struct gpt_extent *segs;
+	uint64_t selected_size = 0, selected_segment = 0;
+	size_t i, nsegs;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
+	if (get_free_segments(gpt, 0, &segs, &nsegs) != 0)
+		return 0;
 
-	do {
-		first_sect = find_first_available(gpt, start);
-		if (first_sect != 0) {
-			last_sect = find_last_free(gpt, first_sect);
-			segment_size = last_sect - first_sect + 1ULL;
+	for (i = 0; i < nsegs; i++) {
+		uint64_t segment_size = segs[i].end - segs[i].start + 1ULL;
 
-			if (segment_size > selected_size) {
-				selected_size = segment_size;
-				selected_segment = first_sect;
-			}
-			start = last_sect + 1ULL;
+		if (segment_size > selected_size) {
+			selected_size = segment_size;
+			selected_segment = segs[i].start;
 		}
-	} while (first_sect != 0);
-
+	}
+	free(segs);
 	return selected_segment;
 }
 
 /*
  * Find the total number of free sectors, the number of segments in which
- * they reside, and the size of the largest of those segments. From gdisk.
+ * they reside, and the size of the largest of those segments.
  */
 static uint64_t get_free_sectors(struct fdisk_context *cxt,
 				 struct fdisk_gpt_label *gpt,
 				 uint32_t *nsegments,
 				 uint64_t *largest_segment)
 {
+	struct gpt_extent *segs = NULL;
 	uint32_t num = 0;
-	uint64_t first_sect, last_sect;
 	uint64_t largest_seg = 0, segment_sz;
-	uint64_t totfound = 0, start = 0; /* starting point for each search */
+	uint64_t totfound = 0;
+	size_t i, nsegs = 0;
 
 	if (!cxt->total_sectors)
 		goto done;
+	if (get_free_segments(gpt, 0, &segs, &nsegs) != 0)
+		goto done;
 
-	assert(gpt);
-	assert(gpt->pheader);
-	assert(gpt->ents);
-
-	do {
-		first_sect = find_first_available(gpt, start);
-		if (first_sect) {
-			last_sect = find_last_free(gpt, first_sect);
-			segment_sz = last_sect - first_sect + 1;
-
-			if (segment_sz > largest_seg)
-				largest_seg = segment_sz;
-			totfound += segment_sz;
-			num++;
-			start = last_sect + 1ULL;
-		}
-	} while (first_sect);
+	for (i = 0; i < nsegs; i++) {
+		segment_sz = segs[i].end - segs[i].start + 1;
 
+		if (segment_sz > largest_seg)
+			largest_seg = segment_sz;
+		totfound += segment_sz;
+		num++;
+	}
+	free(segs);
 done:
 	if (nsegments)
 		*nsegments = num;
@@ -2017,8 +2072,7 @@ static int gpt_set_partition(struct fdisk_context *cxt, size_t n,
 		}
 		e->lba_end = cpu_to_le64(end);
 	}
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 
 	fdisk_label_set_changed(cxt->label, 1);
 	return rc;
@@ -2182,6 +2236,7 @@ static int gpt_write_disklabel(struct fdisk_context *cxt)
 	/* recompute CRCs for both headers */
 	gpt_recompute_crc(gpt->pheader, gpt->ents);
 	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt->crc_stale = 0;
 
 	/*
 	 * UEFI requires writing in this specific order:
@@ -2238,6 +2293,8 @@ static int gpt_verify_disklabel(struct fdisk_context *cxt)
 	if (!gpt)
 		return -EINVAL;
 
+	gpt_update_crc(gpt);
+
 	if (!gpt->bheader) {
 		nerror++;
 		fdisk_warnx(cxt, _("Disk does not contain a valid backup header."));
@@ -2363,8 +2420,7 @@ static int gpt_delete_partition(struct fdisk_context *cxt,
 	/* hasta la vista, baby! */
 	gpt_zeroize_entry(gpt, partnum);
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 	cxt->label->nparts_cur--;
 	fdisk_label_set_changed(cxt->label, 1);
 
@@ -2641,8 +2697,7 @@ static int gpt_add_partition(
 				gpt_partition_end(e),
 				gpt_partition_size(e)));
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 
 	/* report result */
 	{
@@ -2725,8 +2780,7 @@ static int gpt_create_disklabel(struct fdisk_context *cxt)
 		rc = -ENOMEM;
 		goto done;
 	}
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 
 	cxt->label->nparts_max = gpt_get_nentries(gpt);
 	cxt->label->nparts_cur = 0;
@@ -2776,8 +2830,7 @@ static int gpt_set_disklabel_id(struct fdisk_context *cxt, const char *str)
 	gpt->pheader->disk_guid = uuid;
 	gpt->bheader->disk_guid = uuid;
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 
 	new = gpt_get_header_id(gpt->pheader);
 
@@ -2912,8 +2965,7 @@ int fdisk_gpt_set_npartitions(struct fdisk_context *cxt, uint32_t nents)
 	gpt_mknew_header_common(cxt, gpt->bheader, le64_to_cpu(gpt->pheader->alternative_lba));
 
 	/* CRCs will have changed */
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 
 	/* update library info */
 	cxt->label->nparts_max = gpt_get_nentries(gpt);
@@ -3031,8 +3083,8 @@ int fdisk_gpt_set_partition_attrs(
 	fdisk_info(cxt, _("The attributes on partition %zu changed to 0x%016" PRIx64 "."),
 			partnum + 1, attrs);
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	fdisk_mark_partition_changed(cxt, partnum);
+	gpt_invalidate_crc(gpt);
 	fdisk_label_set_changed(cxt->label, 1);
 	return 0;
 }
@@ -3115,8 +3167,7 @@ static int gpt_toggle_partition_flag(
 			_("The %s flag on partition %zu is disabled now."),
 			name, i + 1);
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 	fdisk_label_set_changed(cxt->label, 1);
 	return 0;
 }
@@ -3162,8 +3213,7 @@ static int gpt_reorder(struct fdisk_context *cxt)
 	qsort(gpt->ents, nparts, sizeof(struct gpt_entry),
 			gpt_entry_cmp_start);
 
-	gpt_recompute_crc(gpt->pheader, gpt->ents);
-	gpt_recompute_crc(gpt->bheader, gpt->ents);
+	gpt_invalidate_crc(gpt);
 	fdisk_label_set_changed(cxt->label, 1);
 
 	return 0;
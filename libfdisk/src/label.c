@@ -1,5 +1,6 @@
 
 #include "fdiskP.h"
+#include "ultrace.h"
 
 
 /**
@@ -28,6 +29,7 @@
 
 int fdisk_probe_labels(struct fdisk_context *cxt)
 {
+	struct ul_trace_span sp;
 	size_t i;
 
 	cxt->label = NULL;
@@ -46,7 +48,9 @@ int fdisk_probe_labels(struct fdisk_context *cxt)
 		DBG(CXT, ul_debugobj(cxt, "probing for %s", lb->name));
 
 		cxt->label = lb;
+		ul_trace_begin(&sp, lb->name);
 		rc = lb->op->probe(cxt);
+		ul_trace_end(&sp);
 		cxt->label = org;
 
 		if (rc != 1) {
@@ -254,13 +258,19 @@ const struct fdisk_field *fdisk_label_get_field_by_name(
  */
 int fdisk_write_disklabel(struct fdisk_context *cxt)
 {
+	struct ul_trace_span sp;
+	int rc;
+
 	if (!cxt || !cxt->label || cxt->readonly)
 		return -EINVAL;
 	if (!cxt->label->op->write)
 		return -ENOSYS;
 
+	ul_trace_begin(&sp, "fdisk:write");
 	fdisk_do_wipe(cxt);
-	return cxt->label->op->write(cxt);
+	rc = cxt->label->op->write(cxt);
+	ul_trace_end(&sp);
+	return rc;
 }
 
 /**
@@ -382,6 +392,7 @@ int fdisk_create_disklabel(struct fdisk_context *cxt, const char *name)
 		fdisk_reset_device_properties(cxt);
 
 	DBG(CXT, ul_debugobj(cxt, "create a new %s label", lb->name));
+	fdisk_mark_all_changed(cxt);
 	return lb->op->create(cxt);
 }
 
@@ -540,6 +551,8 @@ int fdisk_set_partition_type(struct fdisk_context *cxt,
 
 		DBG(CXT, ul_debugobj(cxt, "partition: %zd: set type", partnum));
 		rc = cxt->label->op->set_part(cxt, partnum, pa);
+		if (!rc)
+			fdisk_mark_partition_changed(cxt, partnum);
 		fdisk_unref_partition(pa);
 		return rc;
 	}
@@ -568,6 +581,8 @@ int fdisk_toggle_partition_flag(struct fdisk_context *cxt,
 		return -ENOSYS;
 
 	rc = cxt->label->op->part_toggle_flag(cxt, partnum, flag);
+	if (!rc)
+		fdisk_mark_partition_changed(cxt, partnum);
 
 	DBG(CXT, ul_debugobj(cxt, "partition: %zd: toggle: 0x%04lx [rc=%d]", partnum, flag, rc));
 	return rc;
@@ -594,6 +609,7 @@ int fdisk_reorder_partitions(struct fdisk_context *cxt)
 
 	switch (rc) {
 	case 0:
+		fdisk_mark_all_changed(cxt);
 		fdisk_info(cxt, _("Partitions order fixed."));
 		break;
 	case 1:
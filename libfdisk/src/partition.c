@@ -1428,6 +1428,8 @@ int fdisk_set_partition(struct fdisk_context *cxt, size_t partno,
 
 	/* call label driver */
 	rc = cxt->label->op->set_part(cxt, partno, xpa);
+	if (!rc)
+		fdisk_mark_partition_changed(cxt, partno);
 
 	/* enable wipe for new offset/size */
 	if (!rc && wipe)
@@ -1510,6 +1512,7 @@ int fdisk_add_partition(struct fdisk_context *cxt,
 			struct fdisk_partition *pa,
 			size_t *partno)
 {
+	size_t n = 0;
 	int rc;
 
 	if (!cxt || !cxt->label)
@@ -1536,7 +1539,12 @@ int fdisk_add_partition(struct fdisk_context *cxt,
 	} else
 		DBG(CXT, ul_debugobj(cxt, "adding partition"));
 
-	rc = cxt->label->op->add_part(cxt, pa, partno);
+	rc = cxt->label->op->add_part(cxt, pa, &n);
+	if (!rc) {
+		fdisk_mark_partition_changed(cxt, n);
+		if (partno)
+			*partno = n;
+	}
 
 	DBG(CXT, ul_debugobj(cxt, "add partition done (rc=%d)", rc));
 	return rc;
@@ -1553,6 +1561,8 @@ int fdisk_add_partition(struct fdisk_context *cxt,
  */
 int fdisk_delete_partition(struct fdisk_context *cxt, size_t partno)
 {
+	int rc;
+
 	if (!cxt || !cxt->label)
 		return -EINVAL;
 	if (!cxt->label->op->del_part)
@@ -1562,7 +1572,18 @@ int fdisk_delete_partition(struct fdisk_context *cxt, size_t partno)
 
 	DBG(CXT, ul_debugobj(cxt, "deleting %s partition number %zd",
 				cxt->label->name, partno));
-	return cxt->label->op->del_part(cxt, partno);
+	rc = cxt->label->op->del_part(cxt, partno);
+	if (!rc) {
+		size_t i;
+
+		/* MBR logical partitions are renumbered after delete */
+		if (fdisk_is_label(cxt, DOS) && partno >= 4)
+			for (i = partno; i <= cxt->label->nparts_max; i++)
+				fdisk_mark_partition_changed(cxt, i);
+		else
+			fdisk_mark_partition_changed(cxt, partno);
+	}
+	return rc;
 }
 
 /**
@@ -505,12 +505,51 @@ static int table_add_freespace(
 	return rc;
 }
 
+/*
+ * Like table_add_freespace(), but if @append is set and the area is behind the
+ * last entry, then the area is added to the end of @tb without looking for the
+ * right place. This is the case when @tb contains only the free areas found so
+ * far, they are found in ascending order.
+ */
+static int table_append_freespace(
+			struct fdisk_context *cxt,
+			struct fdisk_table *tb,
+			fdisk_sector_t start,
+			fdisk_sector_t end,
+			struct fdisk_partition *parent,
+			int append)
+{
+	struct fdisk_partition *pa, *last;
+	int rc;
+
+	if (!append)
+		return table_add_freespace(cxt, tb, start, end, parent);
+
+	if (!list_empty(&tb->parts)) {
+		last = list_entry(tb->parts.prev, struct fdisk_partition, parts);
+		if (!fdisk_partition_has_end(last)
+		    || fdisk_partition_get_end(last) >= start)
+			return table_add_freespace(cxt, tb, start, end, parent);
+	}
+
+	rc = new_freespace(cxt, start, end, parent, &pa);
+	if (rc)
+		return -ENOMEM;
+	if (!pa)
+		return 0;
+
+	rc = fdisk_table_add_partition(tb, pa);
+	fdisk_unref_partition(pa);
+	return rc;
+}
+
 /* analyze @cont(ainer) in @parts and add all detected freespace into @tb, note
  * that @parts has to be sorted by partition starts */
 static int check_container_freespace(struct fdisk_context *cxt,
 				     struct fdisk_table *parts,
 				     struct fdisk_table *tb,
-				     struct fdisk_partition *cont)
+				     struct fdisk_partition *cont,
+				     int append)
 {
 	struct fdisk_iter itr;
 	struct fdisk_partition *pa;
@@ -548,7 +587,8 @@ static int check_container_freespace(struct fdisk_context *cxt,
 
 		lastplusoff = last + cxt->first_lba;
 		if (pa->start > lastplusoff && pa->start - lastplusoff > grain)
-			rc = table_add_freespace(cxt, tb, lastplusoff, pa->start, cont);
+			rc = table_append_freespace(cxt, tb, lastplusoff,
+						pa->start, cont, append);
 		if (rc)
 			goto done;
 		last = fdisk_partition_get_end(pa);
@@ -559,7 +599,7 @@ static int check_container_freespace(struct fdisk_context *cxt,
 	lastplusoff = last + cxt->first_lba;
 	if (lastplusoff < x && x - lastplusoff > grain) {
 		DBG(TAB, ul_debugobj(tb, "add remaining space in container 0x%p", cont));
-		rc = table_add_freespace(cxt, tb, lastplusoff, x, cont);
+		rc = table_append_freespace(cxt, tb, lastplusoff, x, cont, append);
 	}
 
 done:
@@ -583,7 +623,7 @@ done:
  */
 int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 {
-	int rc = 0;
+	int rc = 0, append;
 	size_t nparts = 0;
 	fdisk_sector_t last, grain;
 	struct fdisk_table *parts = NULL;
@@ -601,6 +641,9 @@ int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 	if (rc)
 		goto done;
 
+	/* don't search the place for every area if there is nothing else */
+	append = fdisk_table_is_empty(*tb);
+
 	fdisk_table_sort_partitions(parts, fdisk_partition_cmp_start);
 	fdisk_reset_iter(&itr, FDISK_ITER_FORWARD);
 	last = cxt->first_lba;
@@ -630,13 +673,13 @@ int fdisk_get_freespaces(struct fdisk_context *cxt, struct fdisk_table **tb)
 		    || (nparts == 0 &&
 		        (fdisk_align_lba(cxt, last, FDISK_ALIGN_UP) <
 			 pa->start))) {
-			rc = table_add_freespace(cxt, *tb,
+			rc = table_append_freespace(cxt, *tb,
 				last + (nparts == 0 ? 0 : 1),
-				pa->start - 1, NULL);
+				pa->start - 1, NULL, append);
 		}
 		/* add gaps between logical partitions */
 		if (fdisk_partition_is_container(pa))
-			rc = check_container_freespace(cxt, parts, *tb, pa);
+			rc = check_container_freespace(cxt, parts, *tb, pa, append);
 
 		if (fdisk_partition_has_end(pa)) {
 			fdisk_sector_t pa_end = fdisk_partition_get_end(pa);
@@ -119,6 +119,9 @@ int fdisk_do_wipe(struct fdisk_context *cxt)
 	if (!pr)
 		return -ENOMEM;
 
+	/* collect signatures from all areas, write and sync once */
+	blkid_probe_set_wipe_batch(pr, 1);
+
 	list_for_each(p, &cxt->wipes) {
 		struct fdisk_wipe *wp = list_entry(p, struct fdisk_wipe, wipes);
 		blkid_loff_t start = (blkid_loff_t) wp->start * cxt->sector_size,
@@ -130,6 +133,7 @@ int fdisk_do_wipe(struct fdisk_context *cxt)
 		rc = blkid_probe_set_device(pr, cxt->dev_fd, start, size);
 		if (rc) {
 			DBG(WIPE, ul_debugobj(wp, "blkid_probe_set_device() failed [rc=%d]", rc));
+			blkid_free_probe(pr);
 			return rc;
 		}
 
@@ -144,8 +148,11 @@ int fdisk_do_wipe(struct fdisk_context *cxt)
 		}
 	}
 
+	rc = blkid_probe_flush_wipes(pr);
+	DBG(WIPE, ul_debugobj(cxt, "wipes flushed [rc=%d]", rc));
+
 	blkid_free_probe(pr);
-	return 0;
+	return rc;
 }
 #endif
 
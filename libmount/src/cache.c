@@ -20,6 +20,10 @@
  * paths. The cache uses libblkid as a backend for TAGs resolution.
  *
  * All returned paths are always canonicalized.
+ *
+ * The cache entries are hashed (by path, tag or device name). The cached paths
+ * are never recomputed by default; see mnt_cache_enable_revalidation() for
+ * long-running processes.
  */
 #include <string.h>
 #include <stdlib.h>
@@ -34,21 +38,41 @@
 #include "mountP.h"
 #include "loopdev.h"
 #include "strutils.h"
+#include "sysfs.h"
+#include "env.h"
 
 /*
  * Canonicalized (resolved) paths & tags cache
  */
 #define MNT_CACHE_CHUNKSZ	128
+#define MNT_CACHE_MINBUCKETS	64
 
 #define MNT_CACHE_ISTAG		(1 << 1) /* entry is TAG */
 #define MNT_CACHE_ISPATH	(1 << 2) /* entry is path */
 #define MNT_CACHE_TAGREAD	(1 << 3) /* tag read by mnt_cache_read_tags() */
+#define MNT_CACHE_STALE		(1 << 4) /* path replaced by a new entry */
+
+/* lstat() result for a path component, zeroized for non-existing component */
+struct mnt_cache_stat {
+	dev_t			dev;
+	ino_t			ino;
+	struct timespec		mtime;
+};
 
 /* path cache entry */
 struct mnt_cache_entry {
 	char			*key;	/* search key (e.g. uncanonicalized path) */
 	char			*value;	/* value (e.g. canonicalized path) */
 	int			flag;
+
+	struct mnt_cache_stat	*stats;	/* key and value components */
+	size_t			nstats;
+};
+
+/* btrfs default subvolume cache entry */
+struct mnt_cache_btrfs {
+	char			*source;	/* mounted device */
+	uint64_t		default_id;
 };
 
 struct libmnt_cache {
@@ -57,6 +81,16 @@ struct libmnt_cache {
 	size_t			nallocs;
 	int			refcount;
 
+	/* hash chains: bucket -> first entry + 1, entry -> next entry + 1;
+	 * key chains for all entries, value (device name) chains for tags */
+	unsigned int		*heads;
+	unsigned int		*next;
+	unsigned int		*vheads;
+	unsigned int		*vnext;
+	size_t			nbuckets;
+
+	unsigned int		revalidate : 1;
+
 	/* blkid_evaluate_tag() works in two ways:
 	 *
 	 * 1/ all tags are evaluated by udev /dev/disk/by-* symlinks,
@@ -69,6 +103,9 @@ struct libmnt_cache {
 	blkid_cache		bc;
 
 	struct libmnt_table	*mountinfo;
+
+	struct mnt_cache_btrfs	*btrfs;		/* see __mnt_cache_get_btrfs_default() */
+	size_t			nbtrfs;
 };
 
 /**
@@ -95,20 +132,30 @@ struct libmnt_cache *mnt_new_cache(void)
  */
 void mnt_free_cache(struct libmnt_cache *cache)
 {
-	size_t i;
+	size_t i, hits = 0, misses = 0;
 
 	if (!cache)
 		return;
 
 	DBG(CACHE, ul_debugobj(cache, "free [refcount=%d]", cache->refcount));
+	ON_DBG(CACHE, ul_canonicalize_cache_stats(&hits, &misses));
+	DBG(CACHE, ul_debugobj(cache, "canonicalize: %zu hits, %zu misses", hits, misses));
 
 	for (i = 0; i < cache->nents; i++) {
 		struct mnt_cache_entry *e = &cache->ents[i];
 		if (e->value != e->key)
 			free(e->value);
 		free(e->key);
+		free(e->stats);
 	}
 	free(cache->ents);
+	free(cache->heads);
+	free(cache->next);
+	free(cache->vheads);
+	free(cache->vnext);
+	for (i = 0; i < cache->nbtrfs; i++)
+		free(cache->btrfs[i].source);
+	free(cache->btrfs);
 	if (cache->bc)
 		blkid_put_cache(cache->bc);
 	free(cache);
@@ -170,6 +217,109 @@ int mnt_cache_set_targets(struct libmnt_cache *cache,
 	return 0;
 }
 
+/**
+ * mnt_cache_enable_revalidation:
+ * @cache: cache pointer
+ * @enable: TRUE or FALSE
+ *
+ * Enables verification of the cached canonicalized paths. The cache keeps
+ * device, inode number and modification time of all components of the
+ * original and the canonicalized path for all newly cached paths, and checks
+ * them by lstat(2) before the cached path is returned. The path is
+ * canonicalized again if anything has been changed. This is useful for
+ * long-running processes which keep the cache for a long time.
+ *
+ * The strings returned by the cache before the revalidation are still valid
+ * (until the cache is deallocated). The paths from mnt_cache_set_targets()
+ * mountpoints are not verified.
+ *
+ * Returns: negative number in case of error, or 0 o success.
+ */
+int mnt_cache_enable_revalidation(struct libmnt_cache *cache, int enable)
+{
+	if (!cache)
+		return -EINVAL;
+	cache->revalidate = enable ? 1 : 0;
+	return 0;
+}
+
+static uint32_t cache_hash_str(uint32_t h, const char *str)
+{
+	for (; *str; str++)
+		h = (h ^ (unsigned char) *str) * 16777619U;
+	return h;
+}
+
+static uint32_t cache_hash_tag(const char *token, const char *value)
+{
+	uint32_t h = cache_hash_str(2166136261U, token);
+
+	return cache_hash_str(h * 16777619U, value);
+}
+
+static uint32_t cache_hash_devname(const char *devname)
+{
+	return cache_hash_str(2166136261U, devname);
+}
+
+static uint32_t entry_hash(struct mnt_cache_entry *e)
+{
+	if (e->flag & MNT_CACHE_ISTAG)
+		return cache_hash_tag(e->key, e->key + strlen(e->key) + 1);
+
+	return __mnt_tabidx_hash_path(e->key);
+}
+
+/* add entry to the end of the chain, so the chain is in the cache order */
+static void cache_link(unsigned int *heads, unsigned int *next,
+			size_t bucket, size_t i)
+{
+	unsigned int *p = &heads[bucket];
+
+	while (*p)
+		p = &next[*p - 1];
+	*p = i + 1;
+	next[i] = 0;
+}
+
+static void cache_link_entry(struct libmnt_cache *cache, size_t i)
+{
+	struct mnt_cache_entry *e = &cache->ents[i];
+	size_t mask = cache->nbuckets - 1;
+
+	cache_link(cache->heads, cache->next, entry_hash(e) & mask, i);
+
+	if (e->flag & MNT_CACHE_ISTAG)
+		cache_link(cache->vheads, cache->vnext,
+				cache_hash_devname(e->value) & mask, i);
+}
+
+static int cache_rehash(struct libmnt_cache *cache, size_t nbuckets)
+{
+	unsigned int *heads, *vheads;
+	size_t i;
+
+	heads = calloc(nbuckets, sizeof(unsigned int));
+	vheads = calloc(nbuckets, sizeof(unsigned int));
+	if (!heads || !vheads) {
+		free(heads);
+		free(vheads);
+		return -ENOMEM;
+	}
+
+	free(cache->heads);
+	free(cache->vheads);
+	cache->heads = heads;
+	cache->vheads = vheads;
+	cache->nbuckets = nbuckets;
+
+	for (i = 0; i < cache->nents; i++)
+		cache_link_entry(cache, i);
+
+	DBG(CACHE, ul_debugobj(cache, "rehash [entries=%zu, buckets=%zu]",
+				cache->nents, nbuckets));
+	return 0;
+}
 
 /* note that the @key could be the same pointer as @value */
 static int cache_add_entry(struct libmnt_cache *cache, char *key,
@@ -183,18 +333,40 @@ static int cache_add_entry(struct libmnt_cache *cache, char *key,
 
 	if (cache->nents == cache->nallocs) {
 		size_t sz = cache->nallocs + MNT_CACHE_CHUNKSZ;
+		unsigned int *x;
 
 		e = realloc(cache->ents, sz * sizeof(struct mnt_cache_entry));
 		if (!e)
 			return -ENOMEM;
 		cache->ents = e;
+
+		x = realloc(cache->next, sz * sizeof(unsigned int));
+		if (!x)
+			return -ENOMEM;
+		cache->next = x;
+
+		x = realloc(cache->vnext, sz * sizeof(unsigned int));
+		if (!x)
+			return -ENOMEM;
+		cache->vnext = x;
+
 		cache->nallocs = sz;
 	}
 
+	if (cache->nents >= cache->nbuckets) {
+		size_t nb = cache->nbuckets ? cache->nbuckets << 1
+					    : MNT_CACHE_MINBUCKETS;
+		if (cache_rehash(cache, nb))
+			return -ENOMEM;
+	}
+
 	e = &cache->ents[cache->nents];
 	e->key = key;
 	e->value = value;
 	e->flag = flag;
+	e->stats = NULL;
+	e->nstats = 0;
+	cache_link_entry(cache, cache->nents);
 	cache->nents++;
 
 	DBG(CACHE, ul_debugobj(cache, "add entry [%2zd] (%s): %s: %s",
@@ -240,22 +412,125 @@ static int cache_add_tag(struct libmnt_cache *cache, const char *tagname,
 }
 
 
+static int stat_prefix(const char *path, struct mnt_cache_stat *x, int verify)
+{
+	struct mnt_cache_stat st = { 0 };
+	struct stat sb;
+
+	if (lstat(path, &sb) == 0) {
+		st.dev = sb.st_dev;
+		st.ino = sb.st_ino;
+		st.mtime = sb.st_mtim;
+	}
+
+	if (!verify) {
+		*x = st;
+		return 0;
+	}
+	return x->dev == st.dev && x->ino == st.ino
+	       && x->mtime.tv_sec == st.mtime.tv_sec
+	       && x->mtime.tv_nsec == st.mtime.tv_nsec ? 0 : -1;
+}
+
+/*
+ * Calls lstat() for all prefixes of the @path ("/", "/a" and "/a/b" for
+ * "/a/b", or ".", "a" and "a/b" for "a/b") and saves (or verifies) the result
+ * to @stats. The @stats may be NULL to count the prefixes.
+ *
+ * Returns: number of the prefixes, or -1 if verification failed.
+ */
+static ssize_t stat_prefixes(const char *path, struct mnt_cache_stat *stats,
+			     int verify)
+{
+	char buf[PATH_MAX];
+	const char *p = path;
+	ssize_t n = 0;
+
+	if (stats && stat_prefix(*path == '/' ? "/" : ".", &stats[n], verify))
+		return -1;
+	n++;
+
+	while (*p) {
+		size_t len;
+
+		while (*p == '/')
+			p++;
+		if (!*p)
+			break;
+		while (*p && *p != '/')
+			p++;
+
+		len = p - path;
+		if (len >= sizeof(buf))
+			break;
+		if (stats) {
+			memcpy(buf, path, len);
+			buf[len] = '\0';
+			if (stat_prefix(buf, &stats[n], verify))
+				return -1;
+		}
+		n++;
+	}
+	return n;
+}
+
+static int cache_entry_set_stats(struct mnt_cache_entry *e)
+{
+	size_t nkey, nval = 0;
+
+	nkey = stat_prefixes(e->key, NULL, 0);
+	if (e->value != e->key)
+		nval = stat_prefixes(e->value, NULL, 0);
+
+	e->stats = malloc((nkey + nval) * sizeof(struct mnt_cache_stat));
+	if (!e->stats)
+		return -ENOMEM;
+	e->nstats = nkey + nval;
+
+	stat_prefixes(e->key, e->stats, 0);
+	if (nval)
+		stat_prefixes(e->value, e->stats + nkey, 0);
+	return 0;
+}
+
+static int cache_entry_is_valid(struct mnt_cache_entry *e)
+{
+	ssize_t n;
+
+	if (!e->stats)
+		return 1;	/* not verified entry */
+
+	n = stat_prefixes(e->key, e->stats, 1);
+	if (n >= 0 && e->value != e->key)
+		n = stat_prefixes(e->value, e->stats + n, 1);
+	return n >= 0;
+}
+
 /*
  * Returns cached canonicalized path or NULL.
  */
 static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 {
-	size_t i;
+	unsigned int i;
 
-	if (!cache || !path)
+	if (!cache || !path || !cache->nbuckets)
 		return NULL;
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_ISPATH))
+	i = cache->heads[__mnt_tabidx_hash_path(path) & (cache->nbuckets - 1)];
+
+	for (; i; i = cache->next[i - 1]) {
+		struct mnt_cache_entry *e = &cache->ents[i - 1];
+
+		if (!(e->flag & MNT_CACHE_ISPATH) || (e->flag & MNT_CACHE_STALE))
 			continue;
-		if (streq_paths(path, e->key))
-			return e->value;
+		if (!streq_paths(path, e->key))
+			continue;
+		if (cache->revalidate && !cache_entry_is_valid(e)) {
+			DBG(CACHE, ul_debugobj(cache, "stale entry: %s", e->key));
+			e->flag |= MNT_CACHE_STALE;
+			return NULL;
+		}
+		return e->value;
 	}
 	return NULL;
 }
@@ -266,16 +541,17 @@ static const char *cache_find_path(struct libmnt_cache *cache, const char *path)
 static const char *cache_find_tag(struct libmnt_cache *cache,
 			const char *token, const char *value)
 {
-	size_t i;
+	unsigned int i;
 	size_t tksz;
 
-	if (!cache || !token || !value)
+	if (!cache || !token || !value || !cache->nbuckets)
 		return NULL;
 
 	tksz = strlen(token);
+	i = cache->heads[cache_hash_tag(token, value) & (cache->nbuckets - 1)];
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	for (; i; i = cache->next[i - 1]) {
+		struct mnt_cache_entry *e = &cache->ents[i - 1];
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 		if (strcmp(token, e->key) == 0 &&
@@ -288,14 +564,19 @@ static const char *cache_find_tag(struct libmnt_cache *cache,
 static char *cache_find_tag_value(struct libmnt_cache *cache,
 			const char *devname, const char *token)
 {
-	size_t i;
+	unsigned int i;
 
 	assert(cache);
 	assert(devname);
 	assert(token);
 
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
+	if (!cache->nbuckets)
+		return NULL;
+
+	i = cache->vheads[cache_hash_devname(devname) & (cache->nbuckets - 1)];
+
+	for (; i; i = cache->vnext[i - 1]) {
+		struct mnt_cache_entry *e = &cache->ents[i - 1];
 		if (!(e->flag & MNT_CACHE_ISTAG))
 			continue;
 		if (strcmp(e->value, devname) == 0 &&	/* dev name */
@@ -330,13 +611,18 @@ int mnt_cache_read_tags(struct libmnt_cache *cache, const char *devname)
 	DBG(CACHE, ul_debugobj(cache, "tags for %s requested", devname));
 
 	/* check if device is already cached */
-	for (i = 0; i < cache->nents; i++) {
-		struct mnt_cache_entry *e = &cache->ents[i];
-		if (!(e->flag & MNT_CACHE_TAGREAD))
-			continue;
-		if (strcmp(e->value, devname) == 0)
-			/* tags have already been read */
-			return 0;
+	if (cache->nbuckets) {
+		unsigned int x = cache->vheads[cache_hash_devname(devname)
+						& (cache->nbuckets - 1)];
+
+		for (; x; x = cache->vnext[x - 1]) {
+			struct mnt_cache_entry *e = &cache->ents[x - 1];
+			if (!(e->flag & MNT_CACHE_TAGREAD))
+				continue;
+			if (strcmp(e->value, devname) == 0)
+				/* tags have already been read */
+				return 0;
+		}
 	}
 
 	pr =  blkid_new_probe_from_filename(devname);
@@ -442,12 +728,91 @@ char *mnt_cache_find_tag_value(struct libmnt_cache *cache,
 	return NULL;
 }
 
+/*
+ * The FS type from the udev database, udev probes all the block devices by
+ * libblkid after every change event. This is disabled by default, the
+ * database is updated asynchronously and it could be outdated just after
+ * mkfs; enabled by LIBMOUNT_FSTYPE_CACHE=udev.
+ *
+ * The database entry is ignored if the diskseq of the device does not match
+ * (the loop device or the media has been replaced) or the result was
+ * ambivalent.
+ */
+#define MNT_UDEV_DATA_PATH	"/run/udev/data"
+
+static int udev_fstype_enabled(void)
+{
+	static int enabled = -1;
+
+	if (enabled < 0) {
+		const char *str = safe_getenv("LIBMOUNT_FSTYPE_CACHE");
+		enabled = str && strcmp(str, "udev") == 0;
+	}
+	return enabled;
+}
+
+static char *udev_get_fstype(const char *devname)
+{
+	char path[sizeof(MNT_UDEV_DATA_PATH) + 32], buf[BUFSIZ];
+	char *type = NULL;
+	uint64_t seq = 0, sysseq = 0;
+	int has_seq = 0, ambi = 0;
+	struct stat st;
+	FILE *f;
+
+	if (stat(devname, &st) != 0 || !S_ISBLK(st.st_mode))
+		return NULL;
+
+	snprintf(path, sizeof(path), MNT_UDEV_DATA_PATH "/b%u:%u",
+			major(st.st_rdev), minor(st.st_rdev));
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f)
+		return NULL;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		const char *p;
+
+		if (strncmp(buf, "E:", 2) != 0)
+			continue;
+		rtrim_whitespace((unsigned char *) buf);
+		if ((p = startswith(buf + 2, "ID_FS_TYPE=")) && *p && !type)
+			type = strdup(p);
+		else if ((p = startswith(buf + 2, "DISKSEQ=")))
+			has_seq = ul_strtou64(p, &seq, 10) == 0;
+		else if (startswith(buf + 2, "ID_FS_AMBIVALENT="))
+			ambi = 1;
+	}
+	fclose(f);
+
+	if (type && has_seq) {
+		struct path_cxt *pc = ul_new_sysfs_path(st.st_rdev, NULL, NULL);
+
+		if (!pc || ul_path_read_u64(pc, &sysseq, "diskseq") != 0
+		    || sysseq != seq) {
+			free(type);
+			type = NULL;
+		}
+		ul_unref_path(pc);
+	}
+	if (ambi) {
+		free(type);
+		type = NULL;
+	}
+
+	DBG(CACHE, ul_debug("udev FS type for %s: %s", devname, type ? : "<none>"));
+	return type;
+}
+
 /**
  * mnt_get_fstype:
  * @devname: device name
  * @ambi: returns TRUE if probing result is ambivalent (optional argument)
  * @cache: cache for results or NULL
  *
+ * If LIBMOUNT_FSTYPE_CACHE=udev is set, the type is read from the udev
+ * database first and the device is probed only if the database does not
+ * know the device.
+ *
  * Returns: filesystem type or NULL in case of error. The result has to be
  * deallocated by free() if @cache is NULL.
  */
@@ -460,6 +825,24 @@ char *mnt_get_fstype(const char *devname, int *ambi, struct libmnt_cache *cache)
 
 	DBG(CACHE, ul_debugobj(cache, "get %s FS type", devname));
 
+	if (udev_fstype_enabled()
+	    && !(cache && cache_find_tag_value(cache, devname, "TYPE"))) {
+		type = udev_get_fstype(devname);
+		if (type && cache) {
+			char *dev = strdup(devname);
+
+			if (!dev || cache_add_tag(cache, "TYPE", type, dev, 0))
+				free(dev);
+			free(type);
+			type = cache_find_tag_value(cache, devname, "TYPE");
+		}
+		if (type) {
+			if (ambi)
+				*ambi = FALSE;
+			return type;
+		}
+	}
+
 	if (cache) {
 		char *val = NULL;
 		rc = __mnt_cache_find_tag_value(cache, devname, "TYPE", &val);
@@ -512,6 +895,12 @@ static char *canonicalize_path_and_cache(const char *path,
 		if (cache_add_entry(cache, key, value,
 				MNT_CACHE_ISPATH))
 			goto error;
+
+		/* not verified entry would be never recomputed, so don't
+		 * use it at all if stat data are not available */
+		if (cache->revalidate
+		    && cache_entry_set_stats(&cache->ents[cache->nents - 1]))
+			cache->ents[cache->nents - 1].flag |= MNT_CACHE_STALE;
 	}
 
 	return p;
@@ -696,7 +1085,99 @@ error:
 	return NULL;
 }
 
+/**
+ * mnt_cache_resolve_tags:
+ * @cache: paths cache
+ * @tb: table (e.g. fstab)
+ *
+ * Resolves the tags (e.g. LABEL=foo) of all @tb entries to the @cache by
+ * one blkid_evaluate_tags() call, so the libblkid cache is read only once
+ * and the devices are probed only once for all the entries. The swap areas
+ * and the entries with "noauto" option are ignored. The next
+ * mnt_resolve_spec() or mnt_resolve_tag() calls with the same @cache use the
+ * result. Usable before the operations with all entries, like mount -a or
+ * fsck -A.
+ *
+ * Returns: number of resolved tags or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_cache_resolve_tags(struct libmnt_cache *cache, struct libmnt_table *tb)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs, **fss = NULL;
+	char **tags = NULL, **res = NULL;
+	size_t i, n = 0, nfs;
+	int rc = 0;
+
+	if (!cache || !tb)
+		return -EINVAL;
 
+	nfs = mnt_table_get_nents(tb);
+	if (!nfs)
+		return 0;
+
+	fss = calloc(nfs, sizeof(struct libmnt_fs *));
+	tags = calloc(nfs, sizeof(char *));
+	res = calloc(nfs, sizeof(char *));
+	if (!fss || !tags || !res) {
+		rc = -ENOMEM;
+		goto done;
+	}
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (n < nfs && mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		const char *tag, *val, *o;
+
+		if (mnt_fs_get_tag(fs, &tag, &val) != 0
+		    || mnt_fs_is_swaparea(fs)
+		    || cache_find_tag(cache, tag, val))
+			continue;
+		o = mnt_fs_get_user_options(fs);
+		if (o && mnt_optstr_get_option(o, "noauto", NULL, NULL) == 0)
+			continue;
+		if (asprintf(&tags[n], "%s=%s", tag, val) < 0) {
+			tags[n] = NULL;
+			rc = -ENOMEM;
+			goto done;
+		}
+		for (i = 0; i < n; i++) {
+			if (strcmp(tags[i], tags[n]) == 0)
+				break;
+		}
+		if (i < n) {
+			free(tags[n]);		/* duplicate */
+			tags[n] = NULL;
+			continue;
+		}
+		fss[n++] = fs;
+	}
+	if (!n)
+		goto done;
+
+	DBG(CACHE, ul_debugobj(cache, "resolving %zu tags", n));
+
+	rc = blkid_evaluate_tags(&cache->bc, (const char **) tags, n, res);
+	if (rc < 0)
+		goto done;
+
+	for (i = 0; i < n; i++) {
+		const char *tag, *val;
+
+		if (res[i] && mnt_fs_get_tag(fss[i], &tag, &val) == 0
+		    && cache_add_tag(cache, tag, val, res[i], 0) == 0)
+			res[i] = NULL;		/* the cache owns it now */
+	}
+done:
+	for (i = 0; i < n; i++) {
+		free(tags[i]);
+		free(res[i]);
+	}
+	free(fss);
+	free(tags);
+	free(res);
+	return rc;
+}
 
 /**
  * mnt_resolve_spec:
@@ -724,6 +1205,47 @@ char *mnt_resolve_spec(const char *spec, struct libmnt_cache *cache)
 	return cn;
 }
 
+#ifdef HAVE_BTRFS_SUPPORT
+/*
+ * Returns the default subvolume ID of the btrfs filesystem on @source, @target
+ * is a mountpoint of the filesystem. The ID is the same for all the subvolumes
+ * mounted from @source, so the ioctl is called once per filesystem. The errors
+ * (UINT64_MAX) are not cached.
+ */
+uint64_t __mnt_cache_get_btrfs_default(struct libmnt_cache *cache,
+				       const char *source, const char *target)
+{
+	struct mnt_cache_btrfs *tmp;
+	uint64_t id;
+	size_t i;
+
+	if (!cache || !source)
+		return btrfs_get_default_subvol_id(target);
+
+	for (i = 0; i < cache->nbtrfs; i++) {
+		if (strcmp(cache->btrfs[i].source, source) == 0) {
+			DBG(CACHE, ul_debugobj(cache, "btrfs default for %s: cached", source));
+			return cache->btrfs[i].default_id;
+		}
+	}
+
+	id = btrfs_get_default_subvol_id(target);
+	if (id == UINT64_MAX)
+		return id;
+
+	tmp = realloc(cache->btrfs, (cache->nbtrfs + 1) * sizeof(*tmp));
+	if (!tmp)
+		return id;
+	cache->btrfs = tmp;
+	tmp = &cache->btrfs[cache->nbtrfs];
+	tmp->source = strdup(source);
+	if (!tmp->source)
+		return id;
+	tmp->default_id = id;
+	cache->nbtrfs++;
+	return id;
+}
+#endif /* HAVE_BTRFS_SUPPORT */
 
 #ifdef TEST_PROGRAM
 
@@ -735,6 +1257,8 @@ static int test_resolve_path(struct libmnt_test *ts, int argc, char *argv[])
 	cache = mnt_new_cache();
 	if (!cache)
 		return -ENOMEM;
+	if (argc > 1 && strcmp(argv[1], "--revalidate") == 0)
+		mnt_cache_enable_revalidation(cache, TRUE);
 
 	while(fgets(line, sizeof(line), stdin)) {
 		size_t sz = strlen(line);
@@ -826,12 +1350,34 @@ static int test_read_tags(struct libmnt_test *ts, int argc, char *argv[])
 
 }
 
+static int test_fstype(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_cache *cache;
+	char *type;
+	int ambi = 0;
+
+	if (argc < 2)
+		return -EINVAL;
+
+	cache = mnt_new_cache();
+	if (!cache)
+		return -ENOMEM;
+
+	type = mnt_get_fstype(argv[1], &ambi, cache);
+	printf("%s : %s%s\n", argv[1], type ? : "<none>",
+			ambi ? " (ambivalent)" : "");
+
+	mnt_unref_cache(cache);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test ts[] = {
-		{ "--resolve-path", test_resolve_path, "  resolve paths from stdin" },
+		{ "--resolve-path", test_resolve_path, "[--revalidate]  resolve paths from stdin" },
 		{ "--resolve-spec", test_resolve_spec, "  evaluate specs from stdin" },
 		{ "--read-tags", test_read_tags,       "  read devname or TAG from stdin (\"quit\" to exit)" },
+		{ "--fstype", test_fstype,             "<devname>  print FS type" },
 		{ NULL }
 	};
 
@@ -98,6 +98,8 @@ void mnt_free_context(struct libmnt_context *cxt)
 
 	free(cxt->fstype_pattern);
 	free(cxt->optstr_pattern);
+	mnt_unref_optmatcher(cxt->fstype_matcher);
+	mnt_unref_optmatcher(cxt->optstr_matcher);
 	free(cxt->tgt_prefix);
 
 	mnt_unref_table(cxt->fstab);
@@ -106,6 +108,7 @@ void mnt_free_context(struct libmnt_context *cxt)
 	mnt_unref_fs(cxt->fs_template);
 
 	mnt_context_clear_loopdev(cxt);
+	mnt_context_free_loopdev_index(cxt);
 	mnt_free_lock(cxt->lock);
 	mnt_free_update(cxt->update);
 
@@ -930,6 +933,8 @@ int mnt_context_set_fs(struct libmnt_context *cxt, struct libmnt_fs *fs)
 {
 	if (!cxt)
 		return -EINVAL;
+	if (fs && mnt_fs_unshare(fs))
+		return -ENOMEM;
 
 	DBG(CXT, ul_debugobj(cxt, "setting new FS"));
 	mnt_ref_fs(fs);			/* new */
@@ -1175,6 +1180,9 @@ int mnt_context_set_fstype_pattern(struct libmnt_context *cxt, const char *patte
 	}
 	free(cxt->fstype_pattern);
 	cxt->fstype_pattern = p;
+
+	mnt_unref_optmatcher(cxt->fstype_matcher);
+	cxt->fstype_matcher = NULL;
 	return 0;
 }
 
@@ -1200,9 +1208,37 @@ int mnt_context_set_options_pattern(struct libmnt_context *cxt, const char *patt
 	}
 	free(cxt->optstr_pattern);
 	cxt->optstr_pattern = p;
+
+	mnt_unref_optmatcher(cxt->optstr_matcher);
+	cxt->optstr_matcher = NULL;
 	return 0;
 }
 
+/*
+ * Returns 1 if @fs matches the fstype and options patterns (mount -a -t/-O),
+ * the patterns are compiled on the first call.
+ */
+int mnt_context_match_patterns(struct libmnt_context *cxt, struct libmnt_fs *fs)
+{
+	if (cxt->fstype_pattern) {
+		if (!cxt->fstype_matcher)
+			cxt->fstype_matcher = mnt_new_fstype_matcher(cxt->fstype_pattern);
+		if (!(cxt->fstype_matcher ?
+		      mnt_fs_match_optmatcher(fs, cxt->fstype_matcher) :
+		      mnt_fs_match_fstype(fs, cxt->fstype_pattern)))
+			return 0;
+	}
+	if (cxt->optstr_pattern) {
+		if (!cxt->optstr_matcher)
+			cxt->optstr_matcher = mnt_new_optmatcher(cxt->optstr_pattern);
+		if (!(cxt->optstr_matcher ?
+		      mnt_fs_match_optmatcher(fs, cxt->optstr_matcher) :
+		      mnt_fs_match_options(fs, cxt->optstr_pattern)))
+			return 0;
+	}
+	return 1;
+}
+
 /**
  * mnt_context_set_fstab:
  * @cxt: mount context
@@ -1257,6 +1293,7 @@ int mnt_context_get_fstab(struct libmnt_context *cxt, struct libmnt_table **tb)
 		cxt->fstab = mnt_new_table();
 		if (!cxt->fstab)
 			return -ENOMEM;
+		mnt_table_enable_arena(cxt->fstab, 1);
 		if (cxt->table_errcb)
 			mnt_table_set_parser_errcb(cxt->fstab, cxt->table_errcb);
 
@@ -1668,14 +1705,19 @@ int mnt_context_set_mflags(struct libmnt_context *cxt, unsigned long flags)
 
 	cxt->mountflags = flags;
 
-	if ((cxt->flags & MNT_FL_MOUNTOPTS_FIXED) && cxt->fs)
+	if ((cxt->flags & MNT_FL_MOUNTOPTS_FIXED) && cxt->fs) {
 		/*
 		 * the final mount options are already generated, refresh...
 		 */
+		int rc = mnt_fs_split_options(cxt->fs);
+
+		if (rc)
+			return rc;
 		return mnt_optstr_apply_flags(
 				&cxt->fs->vfs_optstr,
 				cxt->mountflags,
 				mnt_get_builtin_optmap(MNT_LINUX_MAP));
+	}
 
 	return 0;
 }
@@ -1894,6 +1936,7 @@ end:
 
 static int is_subdir_required(struct libmnt_context *cxt, int *rc)
 {
+	const char *o;
 	char *dir;
 	size_t sz;
 
@@ -1902,10 +1945,11 @@ static int is_subdir_required(struct libmnt_context *cxt, int *rc)
 
 	*rc = 0;
 
-	if (!cxt->fs
-	    || !cxt->fs->user_optstr
-	    || mnt_optstr_get_option(cxt->fs->user_optstr,
-				  "X-mount.subdir", &dir, &sz) != 0)
+	if (!cxt->fs)
+		return 0;
+
+	o = mnt_fs_get_user_options(cxt->fs);
+	if (!o || mnt_optstr_get_option(o, "X-mount.subdir", &dir, &sz) != 0)
 		return 0;
 
 	if (dir && *dir == '"')
@@ -1927,6 +1971,7 @@ static int is_subdir_required(struct libmnt_context *cxt, int *rc)
 
 static int is_mkdir_required(const char *tgt, struct libmnt_fs *fs, mode_t *mode, int *rc)
 {
+	const char *o;
 	char *mstr = NULL;
 	size_t mstr_sz = 0;
 	struct stat st;
@@ -1939,8 +1984,9 @@ static int is_mkdir_required(const char *tgt, struct libmnt_fs *fs, mode_t *mode
 	*mode = 0;
 	*rc = 0;
 
-	if (mnt_optstr_get_option(fs->user_optstr, "X-mount.mkdir", &mstr, &mstr_sz) != 0 &&
-	    mnt_optstr_get_option(fs->user_optstr, "x-mount.mkdir", &mstr, &mstr_sz) != 0)   	/* obsolete */
+	o = mnt_fs_get_user_options(fs);
+	if (mnt_optstr_get_option(o, "X-mount.mkdir", &mstr, &mstr_sz) != 0 &&
+	    mnt_optstr_get_option(o, "x-mount.mkdir", &mstr, &mstr_sz) != 0)   	/* obsolete */
 		return 0;
 
 	if (mnt_stat_mountpoint(tgt, &st) == 0)
@@ -2633,8 +2679,11 @@ int mnt_context_apply_fstab(struct libmnt_context *cxt)
 
 	} else if (isremount && !iscmdbind) {
 
-		/* remove "bind" from fstab (or no-op if not present) */
-		mnt_optstr_remove_option(&cxt->fs->optstr, "bind");
+		/* remove "bind" from fstab (or no-op if not present), the split
+		 * options are not affected */
+		rc = mnt_fs_split_options(cxt->fs);
+		if (!rc)
+			mnt_optstr_remove_option(&cxt->fs->optstr, "bind");
 	}
 	return rc;
 }
@@ -70,7 +70,8 @@ int mnt_context_is_loopdev(struct libmnt_context *cxt)
 		    st.st_size > 1024) {
 			DBG(LOOP, ul_debugobj(cxt, "automatically enabling loop= option"));
 			cxt->user_mountflags |= MNT_MS_LOOP;
-			mnt_optstr_append_option(&cxt->fs->user_optstr, "loop", NULL);
+			if (mnt_fs_split_options(cxt->fs) == 0)
+				mnt_optstr_append_option(&cxt->fs->user_optstr, "loop", NULL);
 			return 1;
 		}
 	}
@@ -235,6 +236,11 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 		if (rc)
 			goto done_no_deinit;
 
+		/* the index is kept for the next mounts (e.g. mount -a) */
+		if (!cxt->loopdev_idx)
+			cxt->loopdev_idx = loopdev_new_index();
+		loopcxt_set_index(&lc, cxt->loopdev_idx);
+
 		rc = loopcxt_find_overlap(&lc, backing_file, offset, sizelimit);
 		switch (rc) {
 		case 0: /* not found */
@@ -358,14 +364,20 @@ int mnt_context_setup_loopdev(struct libmnt_context *cxt)
 		if (!rc)
 			break;		/* success */
 
-		if (loopdev || rc != -EBUSY) {
-			DBG(LOOP, ul_debugobj(cxt, "failed to setup device"));
+		if (loopdev || (rc != -EBUSY && rc != -EAGAIN)
+		    || loopcxt_retry_setup(&lc) != 0) {
+			DBG(LOOP, ul_debugobj(cxt, "failed to setup device [attempts=%u]",
+						lc.setup_attempts));
 			rc = -MNT_ERR_LOOPDEV;
 			goto done;
 		}
 		DBG(LOOP, ul_debugobj(cxt, "device stolen...trying again"));
 	} while (1);
 
+	DBG(LOOP, ul_debugobj(cxt, "%s set up [attempts=%u, retries=%u]",
+				loopcxt_get_device(&lc),
+				lc.setup_attempts, lc.setup_retries));
+
 success:
 	if (!rc)
 		rc = mnt_fs_set_source(cxt->fs, loopcxt_get_device(&lc));
@@ -382,7 +394,8 @@ success:
 			 */
 			DBG(LOOP, ul_debugobj(cxt, "removing unnecessary loop= from utab"));
 			cxt->user_mountflags &= ~MNT_MS_LOOP;
-			mnt_optstr_remove_option(&cxt->fs->user_optstr, "loop");
+			if (mnt_fs_split_options(cxt->fs) == 0)
+				mnt_optstr_remove_option(&cxt->fs->user_optstr, "loop");
 		}
 
 		if (!(cxt->mountflags & MS_RDONLY) &&
@@ -462,3 +475,11 @@ int mnt_context_clear_loopdev(struct libmnt_context *cxt)
 	return 0;
 }
 
+void mnt_context_free_loopdev_index(struct libmnt_context *cxt)
+{
+	assert(cxt);
+
+	loopdev_free_index(cxt->loopdev_idx);
+	cxt->loopdev_idx = NULL;
+}
+
@@ -27,6 +27,8 @@
 #include "linux_version.h"
 #include "mountP.h"
 #include "strutils.h"
+#include "env.h"
+#include "ultrace.h"
 
 /*
  * Kernel supports only one MS_PROPAGATION flag change by one mount(2) syscall,
@@ -227,6 +229,10 @@ static int fix_optstr(struct libmnt_context *cxt)
 
 	fs = cxt->fs;
 
+	rc = mnt_fs_split_options(fs);
+	if (rc)
+		return rc;
+
 	DBG(CXT, ul_debugobj(cxt, "mount: fixing options, current "
 		"vfs: '%s' fs: '%s' user: '%s', optstr: '%s'",
 		fs->vfs_optstr, fs->fs_optstr, fs->user_optstr, fs->optstr));
@@ -368,6 +374,7 @@ static int fix_optstr(struct libmnt_context *cxt)
 	/* refresh merged optstr */
 	free(fs->optstr);
 	fs->optstr = NULL;
+	__mnt_fs_drop_optoks(fs);
 	fs->optstr = mnt_fs_strdup_options(fs);
 done:
 	cxt->flags |= MNT_FL_MOUNTOPTS_FIXED;
@@ -504,7 +511,7 @@ static int evaluate_permissions(struct libmnt_context *cxt)
 		if (cxt->user_mountflags & MNT_MS_USER) {
 			size_t valsz = 0;
 
-			if (!mnt_optstr_get_option(cxt->fs->user_optstr,
+			if (!mnt_optstr_get_option(mnt_fs_get_user_options(cxt->fs),
 					"user", NULL, &valsz) && valsz) {
 
 				DBG(CXT, ul_debugobj(cxt, "perms: user=<name> detected, ignore"));
@@ -776,6 +783,308 @@ static int do_mount_subdir(struct libmnt_context *cxt,
 	return rc;
 }
 
+#ifdef UL_HAVE_MOUNT_API
+/*
+ * The new mount API (fsopen(), fsconfig(), fsmount(), open_tree(),
+ * move_mount() and mount_setattr()). The mount is created detached, all the
+ * per-mount attributes and the propagation are applied by one mount_setattr()
+ * (or directly by fsmount()) and the mount is attached to the target at the
+ * end. The classic way needs an extra mount(2) for the "bind,<flags>" remount
+ * and for every propagation flag, and the mount is visible in the meantime.
+ *
+ * The mount(2) is still used for remount, move, propagation-only and helper
+ * operations, and always if LIBMOUNT_FORCE_MOUNT2=always is set.
+ */
+static int mount_api_unsupported;
+
+/* flags translated to fsconfig() (see configure_sb_flags()) or to mount
+ * attributes (see flags_to_mount_attr()) */
+#define MNT_MOUNT_API_FLAGS	(MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC | \
+				 MS_SYNCHRONOUS | MS_MANDLOCK | MS_DIRSYNC | \
+				 MS_NOSYMFOLLOW | MS_NOATIME | MS_NODIRATIME | \
+				 MS_RELATIME | MS_STRICTATIME | MS_LAZYTIME | \
+				 MS_SILENT)
+
+static int use_mount_api(struct libmnt_context *cxt, const char *type,
+			 unsigned long flags)
+{
+	const char *env;
+
+	if (mount_api_unsupported)
+		return 0;
+	if (flags & (MS_REMOUNT | MS_MOVE))
+		return 0;
+	if (!(flags & MS_BIND) && (!type || !*type || strcmp(type, "none") == 0))
+		return 0;
+
+	/* the bind mount(2) ignores all but MS_REC, for the regular mount the
+	 * rest (e.g. MS_POSIXACL or MS_I_VERSION) would be silently lost */
+	if (!(flags & MS_BIND) && (flags & ~MNT_MOUNT_API_FLAGS)) {
+		DBG(CXT, ul_debugobj(cxt, "new mount API: untranslated flags 0x%08lx",
+				flags & ~MNT_MOUNT_API_FLAGS));
+		return 0;
+	}
+
+	env = safe_getenv("LIBMOUNT_FORCE_MOUNT2");
+	if (env && strcmp(env, "always") == 0) {
+		DBG(CXT, ul_debugobj(cxt, "new mount API disabled by LIBMOUNT_FORCE_MOUNT2"));
+		return 0;
+	}
+	return 1;
+}
+
+static uint64_t flags_to_mount_attr(unsigned long flags)
+{
+	uint64_t attr = 0;
+
+	if (flags & MS_RDONLY)
+		attr |= MOUNT_ATTR_RDONLY;
+	if (flags & MS_NOSUID)
+		attr |= MOUNT_ATTR_NOSUID;
+	if (flags & MS_NODEV)
+		attr |= MOUNT_ATTR_NODEV;
+	if (flags & MS_NOEXEC)
+		attr |= MOUNT_ATTR_NOEXEC;
+	if (flags & MS_NODIRATIME)
+		attr |= MOUNT_ATTR_NODIRATIME;
+	if (flags & MS_NOSYMFOLLOW)
+		attr |= MOUNT_ATTR_NOSYMFOLLOW;
+
+	if (flags & MS_NOATIME)
+		attr |= MOUNT_ATTR_NOATIME;
+	else if (flags & MS_STRICTATIME)
+		attr |= MOUNT_ATTR_STRICTATIME;
+	else
+		attr |= MOUNT_ATTR_RELATIME;
+
+	return attr;
+}
+
+/* print kernel messages from the fs_context log to the debug output */
+static void debug_fs_context_log(struct libmnt_context *cxt, int fd)
+{
+	char buf[BUFSIZ];
+	ssize_t sz;
+
+	if (!(libmount_debug_mask & MNT_DEBUG_CXT))
+		return;
+	while ((sz = read(fd, buf, sizeof(buf) - 1)) > 0) {
+		buf[sz] = '\0';
+		DBG(CXT, ul_debugobj(cxt, "  kernel: %s", buf));
+	}
+}
+
+/* the superblock flags for fsconfig(), the rest is mount attributes */
+static int configure_sb_flags(int fd, unsigned long flags)
+{
+	static const struct {
+		unsigned long	flag;
+		const char	*name;
+	} sbflags[] = {
+		{ MS_RDONLY,		"ro" },
+		{ MS_SYNCHRONOUS,	"sync" },
+		{ MS_DIRSYNC,		"dirsync" },
+		{ MS_LAZYTIME,		"lazytime" },
+		{ MS_MANDLOCK,		"mand" },
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(sbflags); i++) {
+		if ((flags & sbflags[i].flag) &&
+		    ul_fsconfig(fd, UL_FSCONFIG_SET_FLAG, sbflags[i].name, NULL, 0))
+			return -errno;
+	}
+	return 0;
+}
+
+/* the FS specific options (cxt->mountdata) for fsconfig() */
+static int configure_fs_options(int fd, const char *data)
+{
+	char *opts = (char *) data;
+	char *name, *value;
+	size_t namesz, valsz;
+	int rc = 0;
+
+	if (!data)
+		return 0;
+
+	while (rc == 0 &&
+	       !mnt_optstr_next_option(&opts, &name, &namesz, &value, &valsz)) {
+		char *key, *val = NULL;
+
+		if (!namesz)
+			continue;
+		key = strndup(name, namesz);
+		if (!key)
+			return -ENOMEM;
+		if (value) {
+			/* the kernel expects unquoted value */
+			if (valsz >= 2 && *value == '"' && value[valsz - 1] == '"') {
+				value++;
+				valsz -= 2;
+			}
+			val = strndup(value, valsz);
+			if (!val) {
+				free(key);
+				return -ENOMEM;
+			}
+		}
+
+		if (val)
+			rc = ul_fsconfig(fd, UL_FSCONFIG_SET_STRING, key, val, 0);
+		else
+			rc = ul_fsconfig(fd, UL_FSCONFIG_SET_FLAG, key, NULL, 0);
+		if (rc)
+			rc = -errno;
+		free(key);
+		free(val);
+	}
+	return rc;
+}
+
+/* creates a new detached mount */
+static int fd_create_mount(struct libmnt_context *cxt, const char *src,
+			   const char *type, unsigned long flags, int *mfd)
+{
+	int fd, rc;
+
+	fd = ul_fsopen(type, UL_FSOPEN_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	rc = ul_fsconfig(fd, UL_FSCONFIG_SET_STRING, "source", src, 0) ? -errno : 0;
+	if (!rc)
+		rc = configure_sb_flags(fd, flags);
+	if (!rc)
+		rc = configure_fs_options(fd, cxt->mountdata);
+	if (!rc && ul_fsconfig(fd, UL_FSCONFIG_CMD_CREATE, NULL, NULL, 0))
+		rc = -errno;
+	if (!rc) {
+		*mfd = ul_fsmount(fd, UL_FSMOUNT_CLOEXEC, flags_to_mount_attr(flags));
+		if (*mfd < 0)
+			rc = -errno;
+	}
+	if (rc)
+		debug_fs_context_log(cxt, fd);
+	close(fd);
+	return rc;
+}
+
+/*
+ * Returns: 0 on success, >0 in case of syscall error (returns syscall errno),
+ * -ENOSYS if the new API is not usable, <0 in case of other errors.
+ */
+static int do_mount_fd(struct libmnt_context *cxt, const char *src,
+		       const char *target, const char *type,
+		       unsigned long flags)
+{
+	struct ul_mount_attr attr = { 0 }, prop = { 0 };
+	struct list_head *p;
+	unsigned int prop_flags = AT_EMPTY_PATH;
+	int mfd = -1, rc, applied = 0;
+
+	DBG(CXT, ul_debugobj(cxt, "new mount API "
+			"[source=%s, target=%s, type=%s,"
+			" mountflags=0x%08lx, mountdata=%s]",
+			src, target, type,
+			flags, cxt->mountdata ? "yes" : "<none>"));
+
+	if (flags & MS_BIND) {
+		unsigned int tree_flags = UL_OPEN_TREE_CLONE | UL_OPEN_TREE_CLOEXEC;
+
+		if (flags & MS_REC)
+			tree_flags |= AT_RECURSIVE;
+		mfd = ul_open_tree(AT_FDCWD, src, tree_flags);
+		rc = mfd < 0 ? -errno : 0;
+	} else
+		rc = fd_create_mount(cxt, src, type, flags, &mfd);
+
+	if (rc == -ENOSYS || rc == -EPERM) {
+		/* old kernel, or the syscalls are filtered out (seccomp);
+		 * mount(2) returns the right error if the permission is
+		 * really missing */
+		DBG(CXT, ul_debugobj(cxt, "new mount API unsupported [rc=%d]", rc));
+		if (rc == -ENOSYS)
+			mount_api_unsupported = 1;
+		return -ENOSYS;
+	}
+	if (rc)
+		goto syserr;
+
+	/*
+	 * The "bind,<flags>" attributes and the first propagation flag are
+	 * applied before the mount is attached. They need separate
+	 * mount_setattr() calls: the attributes are for the top-level mount
+	 * only (as the "bind,remount,<flags>" mount(2)), but MS_REC of the
+	 * propagation flag means AT_RECURSIVE. The kernel accepts only one
+	 * propagation type by one call.
+	 */
+	list_for_each(p, &cxt->addmounts) {
+		struct libmnt_addmount *ad =
+				list_entry(p, struct libmnt_addmount, mounts);
+
+		if ((ad->mountflags & MS_REMOUNT) && (ad->mountflags & MS_BIND)) {
+			attr.attr_set = flags_to_mount_attr(ad->mountflags);
+			attr.attr_clr = MOUNT_ATTR_RDONLY | MOUNT_ATTR_NOSUID |
+					MOUNT_ATTR_NODEV | MOUNT_ATTR_NOEXEC |
+					MOUNT_ATTR__ATIME | MOUNT_ATTR_NODIRATIME |
+					MOUNT_ATTR_NOSYMFOLLOW;
+		} else if (!prop.propagation) {
+			prop.propagation = ad->mountflags & MS_PROPAGATION;
+			if (ad->mountflags & MS_REC)
+				prop_flags |= AT_RECURSIVE;
+		}
+	}
+	if ((attr.attr_set || attr.attr_clr) &&
+	    ul_mount_setattr(mfd, "", AT_EMPTY_PATH, &attr)) {
+		rc = -errno;
+		goto syserr;
+	}
+	if (prop.propagation &&
+	    ul_mount_setattr(mfd, "", prop_flags, &prop)) {
+		rc = -errno;
+		goto syserr;
+	}
+
+	if (ul_move_mount(mfd, "", AT_FDCWD, target, UL_MOVE_MOUNT_F_EMPTY_PATH)) {
+		rc = -errno;
+		goto syserr;
+	}
+	DBG(CXT, ul_debugobj(cxt, "  new mount API success"));
+	cxt->syscall_status = 0;
+
+	/* the rest of the propagation flags, the mount is attached now */
+	list_for_each(p, &cxt->addmounts) {
+		struct libmnt_addmount *ad =
+				list_entry(p, struct libmnt_addmount, mounts);
+
+		prop.propagation = ad->mountflags & MS_PROPAGATION;
+		if (!prop.propagation)
+			continue;
+		if (!applied++)
+			continue;	/* the first one, already applied */
+
+		DBG(CXT, ul_debugobj(cxt, "mount_setattr() changing flag: 0x%08lx",
+				ad->mountflags));
+		if (ul_mount_setattr(mfd, "", AT_EMPTY_PATH |
+				(ad->mountflags & MS_REC ? AT_RECURSIVE : 0), &prop)) {
+			DBG(CXT, ul_debugobj(cxt, "mount_setattr() failed [errno=%d %m]", errno));
+			close(mfd);
+			return -MNT_ERR_APPLYFLAGS;
+		}
+	}
+	close(mfd);
+	return 0;
+
+syserr:
+	cxt->syscall_status = rc;
+	DBG(CXT, ul_debugobj(cxt, "new mount API failed [errno=%d %m]", -rc));
+	if (mfd >= 0)
+		close(mfd);
+	return -rc;
+}
+#endif /* UL_HAVE_MOUNT_API */
+
 /*
  * The default is to use fstype from cxt->fs, this could be overwritten by
  * @try_type argument. If @try_type is specified then mount with MS_SILENT.
@@ -861,6 +1170,17 @@ static int do_mount(struct libmnt_context *cxt, const char *try_type)
 			target = MNT_PATH_TMPTGT;
 		}
 
+#ifdef UL_HAVE_MOUNT_API
+		if (use_mount_api(cxt, type, flags)) {
+			rc = do_mount_fd(cxt, src, target, type, flags);
+			if (rc != -ENOSYS) {
+				if (rc)
+					goto done;
+				goto subdir;
+			}
+			rc = 0;
+		}
+#endif
 		DBG(CXT, ul_debugobj(cxt, "mount(2) "
 			"[source=%s, target=%s, type=%s,"
 			" mountflags=0x%08lx, mountdata=%s]",
@@ -887,7 +1207,9 @@ static int do_mount(struct libmnt_context *cxt, const char *try_type)
 			rc = -MNT_ERR_APPLYFLAGS;
 			goto done;
 		}
-
+#ifdef UL_HAVE_MOUNT_API
+subdir:
+#endif
 		/*
 		 * bind subdir to the real target, umount temporary target
 		 */
@@ -1361,13 +1683,22 @@ int mnt_context_mount(struct libmnt_context *cxt)
 		return -MNT_ERR_NAMESPACE;
 
 again:
+	/* the phase probes are "prepare", "update", "syscall" and "tabs" */
+	UL_PROBE1(libmount, mount__phase, "prepare");
 	rc = mnt_context_prepare_mount(cxt);
-	if (!rc)
+	if (!rc) {
+		UL_PROBE1(libmount, mount__phase, "update");
 		rc = mnt_context_prepare_update(cxt);
-	if (!rc)
+	}
+	if (!rc) {
+		UL_PROBE1(libmount, mount__phase, "syscall");
 		rc = mnt_context_do_mount(cxt);
-	if (!rc)
+	}
+	if (!rc) {
+		UL_PROBE1(libmount, mount__phase, "tabs");
 		rc = mnt_context_update_tabs(cxt);
+	}
+	UL_PROBE1(libmount, mount__done, rc);
 
 	/*
 	 * Read-only device or already read-only mounted FS.
@@ -1458,6 +1789,14 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	if (rc)
 		return rc;
 
+	/* the first entry, evaluate all LABEL=, UUID=, etc. at once */
+	if (!itr->head) {
+		struct libmnt_cache *cache = mnt_context_get_cache(cxt);
+
+		if (cache)
+			mnt_cache_resolve_tags(cache, fstab);
+	}
+
 	rc = mnt_table_next_fs(fstab, itr, fs);
 	if (rc != 0)
 		return rc;	/* more filesystems (or error) */
@@ -1476,13 +1815,8 @@ int mnt_context_next_mount(struct libmnt_context *cxt,
 	/* ignore noauto filesystems */
 	   (o && mnt_optstr_get_option(o, "noauto", NULL, NULL) == 0) ||
 
-	/* ignore filesystems which don't match options patterns */
-	   (cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
-					cxt->fstype_pattern)) ||
-
-	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
-					cxt->optstr_pattern))) {
+	/* ignore filesystems which don't match type or options patterns */
+	   !mnt_context_match_patterns(cxt, *fs)) {
 		if (ignored)
 			*ignored = 1;
 		DBG(CXT, ul_debugobj(cxt, "next-mount: not-match "
@@ -1637,13 +1971,8 @@ int mnt_context_next_remount(struct libmnt_context *cxt,
 
 	DBG(CXT, ul_debugobj(cxt, "next-remount: trying %s", tgt));
 
-	/* ignore filesystems which don't match options patterns */
-	if ((cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
-					cxt->fstype_pattern)) ||
-
-	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
-					cxt->optstr_pattern))) {
+	/* ignore filesystems which don't match type or options patterns */
+	if (!mnt_context_match_patterns(cxt, *fs)) {
 		if (ignored)
 			*ignored = 1;
 		DBG(CXT, ul_debugobj(cxt, "next-remount: not-match "
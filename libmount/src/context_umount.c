@@ -1183,13 +1183,8 @@ int mnt_context_next_umount(struct libmnt_context *cxt,
 	DBG(CXT, ul_debugobj(cxt, "next-umount: trying %s [fstype: %s, t-pattern: %s, options: %s, O-pattern: %s]", tgt,
 				 mnt_fs_get_fstype(*fs), cxt->fstype_pattern, mnt_fs_get_options(*fs), cxt->optstr_pattern));
 
-	/* ignore filesystems which don't match options patterns */
-	if ((cxt->fstype_pattern && !mnt_fs_match_fstype(*fs,
-					cxt->fstype_pattern)) ||
-
-	/* ignore filesystems which don't match type patterns */
-	   (cxt->optstr_pattern && !mnt_fs_match_options(*fs,
-					cxt->optstr_pattern))) {
+	/* ignore filesystems which don't match type or options patterns */
+	if (!mnt_context_match_patterns(cxt, *fs)) {
 		if (ignored)
 			*ignored = 1;
 
@@ -43,6 +43,24 @@ struct libmnt_fs *mnt_new_fs(void)
 	return fs;
 }
 
+/*
+ * Allocates @fs from @pool (see mnt_table_enable_arena()). The memory is
+ * deallocated with the pool, @fs holds the pool reference.
+ */
+struct libmnt_fs *__mnt_new_fs_from_pool(struct libmnt_strpool *pool)
+{
+	struct libmnt_fs *fs = __mnt_strpool_alloc(pool, sizeof(*fs));
+
+	if (!fs)
+		return NULL;
+
+	fs->refcount = 1;
+	INIT_LIST_HEAD(&fs->ents);
+	__mnt_ref_strpool(pool);
+	fs->arena = pool;
+	return fs;
+}
+
 /**
  * mnt_free_fs:
  * @fs: fs pointer
@@ -54,13 +72,103 @@ struct libmnt_fs *mnt_new_fs(void)
  */
 void mnt_free_fs(struct libmnt_fs *fs)
 {
+	struct libmnt_strpool *arena;
+
 	if (!fs)
 		return;
 
 	DBG(FS, ul_debugobj(fs, "free [refcount=%d]", fs->refcount));
 
+	arena = fs->arena;
 	mnt_reset_fs(fs);
-	free(fs);
+
+	if (arena)
+		__mnt_unref_strpool(arena);
+	else
+		free(fs);
+}
+
+/* forget the pooled strings, they are deallocated with the pool */
+static void drop_pooled(struct libmnt_fs *fs)
+{
+	if (fs->pooled & MNT_POOL_SOURCE)
+		fs->source = NULL;
+	if (fs->pooled & MNT_POOL_ROOT)
+		fs->root = NULL;
+	if (fs->pooled & MNT_POOL_TARGET)
+		fs->target = NULL;
+	if (fs->pooled & MNT_POOL_FSTYPE)
+		fs->fstype = NULL;
+	if (fs->pooled & MNT_POOL_OPTSTR)
+		fs->optstr = NULL;
+	if (fs->pooled & MNT_POOL_VFS_OPTSTR)
+		fs->vfs_optstr = NULL;
+	if (fs->pooled & MNT_POOL_FS_OPTSTR)
+		fs->fs_optstr = NULL;
+	if (fs->pooled & MNT_POOL_OPT_FIELDS)
+		fs->opt_fields = NULL;
+	if (fs->pooled & MNT_POOL_USER_OPTSTR)
+		fs->user_optstr = NULL;
+	fs->pooled = 0;
+}
+
+static int unshare_str(struct libmnt_fs *fs, char **str, unsigned int bit)
+{
+	char *p;
+
+	if (!(fs->pooled & bit) || !*str)
+		return 0;
+	p = strdup(*str);
+	if (!p)
+		return -ENOMEM;
+	*str = p;
+	fs->pooled &= ~bit;
+	return 0;
+}
+
+/*
+ * Replaces strings from the zero-copy parser (see tab_parse.c) with private
+ * copies and releases the string pool. The fs setters call this function
+ * (by mnt_fs_unshare()) before modifying @fs.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int __mnt_fs_unshare(struct libmnt_fs *fs)
+{
+	int rc;
+
+	assert(fs);
+
+	if (!fs->pooled)
+		goto done;
+
+	DBG(FS, ul_debugobj(fs, "unshare pooled strings"));
+
+	rc = unshare_str(fs, &fs->source, MNT_POOL_SOURCE);
+	if (!rc)
+		rc = unshare_str(fs, &fs->root, MNT_POOL_ROOT);
+	if (!rc)
+		rc = unshare_str(fs, &fs->target, MNT_POOL_TARGET);
+	if (!rc)
+		rc = unshare_str(fs, &fs->fstype, MNT_POOL_FSTYPE);
+	if (!rc)
+		rc = unshare_str(fs, &fs->optstr, MNT_POOL_OPTSTR);
+	if (!rc)
+		rc = unshare_str(fs, &fs->vfs_optstr, MNT_POOL_VFS_OPTSTR);
+	if (!rc)
+		rc = unshare_str(fs, &fs->fs_optstr, MNT_POOL_FS_OPTSTR);
+	if (!rc)
+		rc = unshare_str(fs, &fs->opt_fields, MNT_POOL_OPT_FIELDS);
+	if (!rc)
+		rc = unshare_str(fs, &fs->user_optstr, MNT_POOL_USER_OPTSTR);
+	if (rc)
+		return rc;
+	fs->pooled = 0;
+	__mnt_fs_drop_optoks(fs);	/* points to the pool */
+done:
+	__mnt_unref_strpool(fs->strpool);
+	fs->strpool = NULL;
+	return 0;
 }
 
 /**
@@ -69,35 +177,70 @@ void mnt_free_fs(struct libmnt_fs *fs)
  *
  * Resets (zeroize) @fs.
  */
+/*
+ * Returns the extension with the rarely used fields, allocates it if
+ * necessary. Returns NULL on error (ENOMEM).
+ */
+struct libmnt_fs_ext *__mnt_fs_get_ext(struct libmnt_fs *fs)
+{
+	if (!fs->ext)
+		fs->ext = calloc(1, sizeof(*fs->ext));
+	return fs->ext;
+}
+
+/* strdup_to_offset() for the extension, NULL does not allocate it */
+static int strdup_to_ext(struct libmnt_fs *fs, size_t offset, const char *str)
+{
+	if (!fs)
+		return -EINVAL;
+	if (!str && !fs->ext)
+		return 0;
+	if (!__mnt_fs_get_ext(fs))
+		return -ENOMEM;
+	return strdup_to_offset(fs->ext, offset, str);
+}
+
 void mnt_reset_fs(struct libmnt_fs *fs)
 {
+	struct libmnt_strpool *arena;
 	int ref;
 
 	if (!fs)
 		return;
 
 	ref = fs->refcount;
+	arena = fs->arena;
 
 	list_del(&fs->ents);
+	if (fs->pooled)
+		drop_pooled(fs);
+	__mnt_unref_strpool(fs->strpool);
+
 	free(fs->source);
-	free(fs->bindsrc);
-	free(fs->tagname);
-	free(fs->tagval);
 	free(fs->root);
-	free(fs->swaptype);
 	free(fs->target);
 	free(fs->fstype);
 	free(fs->optstr);
 	free(fs->vfs_optstr);
 	free(fs->fs_optstr);
 	free(fs->user_optstr);
-	free(fs->attrs);
 	free(fs->opt_fields);
-	free(fs->comment);
+
+	if (fs->ext) {
+		free(fs->ext->bindsrc);
+		free(fs->ext->tagname);
+		free(fs->ext->tagval);
+		free(fs->ext->attrs);
+		free(fs->ext->comment);
+		free(fs->ext->swaptype);
+		free(fs->ext->optoks);
+		free(fs->ext);
+	}
 
 	memset(fs, 0, sizeof(*fs));
 	INIT_LIST_HEAD(&fs->ents);
 	fs->refcount = ref;
+	fs->arena = arena;
 }
 
 /**
@@ -194,21 +337,24 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 		dest->tab	 = NULL;
 	}
 
+	__mnt_fs_drop_optoks(dest);
+
+	/* the split options are copied, the split does not modify optstr */
+	if (mnt_fs_split_options((struct libmnt_fs *) src)
+	    || mnt_fs_split_options(dest))
+		goto err;
+
 	dest->id         = src->id;
 	dest->parent     = src->parent;
 	dest->devno      = src->devno;
 	dest->tid        = src->tid;
+	dest->uniq_id    = src->uniq_id;
+	dest->stmnt_todo = src->stmnt_todo;
 
 	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, source)))
 		goto err;
-	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, tagname)))
-		goto err;
-	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, tagval)))
-		goto err;
 	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, root)))
 		goto err;
-	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, swaptype)))
-		goto err;
 	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, target)))
 		goto err;
 	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, fstype)))
@@ -221,17 +367,32 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 		goto err;
 	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, user_optstr)))
 		goto err;
-	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, attrs)))
-		goto err;
-	if (cpy_str_at_offset(dest, src, offsetof(struct libmnt_fs, bindsrc)))
-		goto err;
+
+	if (src->ext) {
+		const struct libmnt_fs_ext *s = src->ext;
+		struct libmnt_fs_ext *d = __mnt_fs_get_ext(dest);
+
+		if (!d)
+			goto err;
+		if (cpy_str_at_offset(d, s, offsetof(struct libmnt_fs_ext, tagname)))
+			goto err;
+		if (cpy_str_at_offset(d, s, offsetof(struct libmnt_fs_ext, tagval)))
+			goto err;
+		if (cpy_str_at_offset(d, s, offsetof(struct libmnt_fs_ext, swaptype)))
+			goto err;
+		if (cpy_str_at_offset(d, s, offsetof(struct libmnt_fs_ext, attrs)))
+			goto err;
+		if (cpy_str_at_offset(d, s, offsetof(struct libmnt_fs_ext, bindsrc)))
+			goto err;
+
+		d->size		= s->size;
+		d->usedsize	= s->usedsize;
+		d->priority	= s->priority;
+	}
 
 	dest->freq       = src->freq;
 	dest->passno     = src->passno;
 	dest->flags      = src->flags;
-	dest->size	 = src->size;
-	dest->usedsize   = src->usedsize;
-	dest->priority   = src->priority;
 
 	return dest;
 err:
@@ -254,6 +415,8 @@ struct libmnt_fs *mnt_copy_mtab_fs(const struct libmnt_fs *fs)
 	assert(fs);
 	if (!n)
 		return NULL;
+	if (mnt_fs_split_options((struct libmnt_fs *) fs))
+		goto err;
 
 	if (strdup_between_structs(n, fs, source))
 		goto err;
@@ -344,8 +507,10 @@ const char *mnt_fs_get_srcpath(struct libmnt_fs *fs)
 	if (!fs)
 		return NULL;
 
+	mnt_fs_try_statmount(fs, STATMOUNT_SB_SOURCE);
+
 	/* fstab-like fs */
-	if (fs->tagname)
+	if (mnt_fs_ext(fs, tagname))
 		return NULL;	/* the source contains a "NAME=value" */
 	return fs->source;
 }
@@ -359,7 +524,11 @@ const char *mnt_fs_get_srcpath(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_source(struct libmnt_fs *fs)
 {
-	return fs ? fs->source : NULL;
+	if (!fs)
+		return NULL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_SB_SOURCE);
+	return fs->source;
 }
 
 /*
@@ -379,15 +548,25 @@ int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 		t = v = NULL;
 	}
 
-	if (fs->source != source)
-		free(fs->source);
+	if (t && !__mnt_fs_get_ext(fs)) {
+		free(t);
+		free(v);
+		return -ENOMEM;
+	}
 
-	free(fs->tagname);
-	free(fs->tagval);
+	if (fs->pooled & MNT_POOL_SOURCE)
+		fs->pooled &= ~MNT_POOL_SOURCE;
+	else if (fs->source != source)
+		free(fs->source);
 
 	fs->source = source;
-	fs->tagname = t;
-	fs->tagval = v;
+
+	if (fs->ext) {
+		free(fs->ext->tagname);
+		free(fs->ext->tagval);
+		fs->ext->tagname = t;
+		fs->ext->tagval = v;
+	}
 	return 0;
 }
 
@@ -417,6 +596,8 @@ int mnt_fs_set_source(struct libmnt_fs *fs, const char *source)
 	rc = __mnt_fs_set_source_ptr(fs, p);
 	if (rc)
 		free(p);
+	else
+		__mnt_table_drop_index(fs->tab);
 	return rc;
 }
 
@@ -518,12 +699,12 @@ int mnt_fs_streq_target(struct libmnt_fs *fs, const char *path)
  */
 int mnt_fs_get_tag(struct libmnt_fs *fs, const char **name, const char **value)
 {
-	if (fs == NULL || !fs->tagname)
+	if (fs == NULL || !mnt_fs_ext(fs, tagname))
 		return -EINVAL;
 	if (name)
-		*name = fs->tagname;
+		*name = fs->ext->tagname;
 	if (value)
-		*value = fs->tagval;
+		*value = fs->ext->tagval;
 	return 0;
 }
 
@@ -535,7 +716,11 @@ int mnt_fs_get_tag(struct libmnt_fs *fs, const char **name, const char **value)
  */
 const char *mnt_fs_get_target(struct libmnt_fs *fs)
 {
-	return fs ? fs->target : NULL;
+	if (!fs)
+		return NULL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_MNT_POINT);
+	return fs->target;
 }
 
 /**
@@ -549,7 +734,16 @@ const char *mnt_fs_get_target(struct libmnt_fs *fs)
  */
 int mnt_fs_set_target(struct libmnt_fs *fs, const char *tgt)
 {
-	return strdup_to_struct_member(fs, target, tgt);
+	int rc;
+
+	if (fs && mnt_fs_unshare(fs))
+		return -ENOMEM;
+
+	rc = strdup_to_struct_member(fs, target, tgt);
+
+	if (!rc)
+		__mnt_table_drop_index(fs->tab);
+	return rc;
 }
 
 static int mnt_fs_get_flags(struct libmnt_fs *fs)
@@ -659,7 +853,11 @@ int mnt_fs_is_regularfs(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_fstype(struct libmnt_fs *fs)
 {
-	return fs ? fs->fstype : NULL;
+	if (!fs)
+		return NULL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_FS_TYPE);
+	return fs->fstype;
 }
 
 /* Used by the struct libmnt_file parser only */
@@ -667,7 +865,9 @@ int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 {
 	assert(fs);
 
-	if (fstype != fs->fstype)
+	if (fs->pooled & MNT_POOL_FSTYPE)
+		fs->pooled &= ~MNT_POOL_FSTYPE;
+	else if (fstype != fs->fstype)
 		free(fs->fstype);
 
 	fs->fstype = fstype;
@@ -795,6 +995,19 @@ char *mnt_fs_strdup_options(struct libmnt_fs *fs)
 	return res;
 }
 
+/*
+ * Drops the cached tokens, has to be called when fs->optstr is modified.
+ */
+void __mnt_fs_drop_optoks(struct libmnt_fs *fs)
+{
+	if (!fs->ext)
+		return;
+	free(fs->ext->optoks);
+	fs->ext->optoks = NULL;
+	fs->ext->noptoks = 0;
+	fs->ext->optoks_src = NULL;
+}
+
 /**
  * mnt_fs_get_options:
  * @fs: fstab/mtab/mountinfo entry pointer
@@ -803,7 +1016,11 @@ char *mnt_fs_strdup_options(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_options(struct libmnt_fs *fs)
 {
-	return fs ? fs->optstr : NULL;
+	if (!fs)
+		return NULL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_MNT_OPTS);
+	return fs->optstr;
 }
 
 /**
@@ -830,33 +1047,60 @@ const char *mnt_fs_get_optional_fields(struct libmnt_fs *fs)
  */
 int mnt_fs_set_options(struct libmnt_fs *fs, const char *optstr)
 {
-	char *v = NULL, *f = NULL, *u = NULL, *n = NULL;
+	char *n = NULL;
 
 	if (!fs)
 		return -EINVAL;
+	if (mnt_fs_unshare(fs))
+		return -ENOMEM;
 	if (optstr) {
-		int rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
-		if (rc)
-			return rc;
 		n = strdup(optstr);
-		if (!n) {
-			free(u);
-			free(v);
-			free(f);
+		if (!n)
 			return -ENOMEM;
-		}
 	}
 
 	free(fs->fs_optstr);
 	free(fs->vfs_optstr);
 	free(fs->user_optstr);
 	free(fs->optstr);
+	__mnt_fs_drop_optoks(fs);
+
+	/* the split is deferred to the first use, see mnt_fs_split_options() */
+	fs->fs_optstr = NULL;
+	fs->vfs_optstr = NULL;
+	fs->user_optstr = NULL;
+	fs->optstr = n;
+
+	if (n)
+		fs->flags |= MNT_FS_UNSPLIT;
+	else
+		fs->flags &= ~MNT_FS_UNSPLIT;
+	return 0;
+}
+
+/*
+ * Splits fs->optstr to VFS, FS and userspace options. The split is done on
+ * the first use of the split options, mnt_fs_set_options() and the parsers
+ * only set fs->optstr and MNT_FS_UNSPLIT.
+ *
+ * Use mnt_fs_split_options() macro.
+ */
+int __mnt_fs_split_options(struct libmnt_fs *fs)
+{
+	char *v = NULL, *f = NULL, *u = NULL;
+	int rc;
+
+	assert(fs->flags & MNT_FS_UNSPLIT);
+	assert(!fs->vfs_optstr && !fs->fs_optstr && !fs->user_optstr);
+
+	rc = mnt_split_optstr(fs->optstr, &u, &v, &f, 0, 0);
+	if (rc)
+		return rc;
 
 	fs->fs_optstr = f;
 	fs->vfs_optstr = v;
 	fs->user_optstr = u;
-	fs->optstr = n;
-
+	fs->flags &= ~MNT_FS_UNSPLIT;
 	return 0;
 }
 
@@ -881,6 +1125,11 @@ int mnt_fs_append_options(struct libmnt_fs *fs, const char *optstr)
 		return -EINVAL;
 	if (!optstr)
 		return 0;
+	if (mnt_fs_unshare(fs))
+		return -ENOMEM;
+	rc = mnt_fs_split_options(fs);
+	if (rc)
+		return rc;
 
 	rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
 	if (rc)
@@ -894,6 +1143,7 @@ int mnt_fs_append_options(struct libmnt_fs *fs, const char *optstr)
 		rc = mnt_optstr_append_option(&fs->user_optstr, u, NULL);
 	if (!rc)
 		rc = mnt_optstr_append_option(&fs->optstr, optstr, NULL);
+	__mnt_fs_drop_optoks(fs);
 
 	free(v);
 	free(f);
@@ -923,6 +1173,11 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
 		return -EINVAL;
 	if (!optstr)
 		return 0;
+	if (mnt_fs_unshare(fs))
+		return -ENOMEM;
+	rc = mnt_fs_split_options(fs);
+	if (rc)
+		return rc;
 
 	rc = mnt_split_optstr(optstr, &u, &v, &f, 0, 0);
 	if (rc)
@@ -936,6 +1191,7 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
 		rc = mnt_optstr_prepend_option(&fs->user_optstr, u, NULL);
 	if (!rc)
 		rc = mnt_optstr_prepend_option(&fs->optstr, optstr, NULL);
+	__mnt_fs_drop_optoks(fs);
 
 	free(v);
 	free(f);
@@ -952,7 +1208,13 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
  */
 const char *mnt_fs_get_fs_options(struct libmnt_fs *fs)
 {
-	return fs ? fs->fs_optstr : NULL;
+	if (!fs)
+		return NULL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_MNT_OPTS);
+	if (mnt_fs_split_options(fs))
+		return NULL;
+	return fs->fs_optstr;
 }
 
 /**
@@ -963,7 +1225,9 @@ const char *mnt_fs_get_fs_options(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_vfs_options(struct libmnt_fs *fs)
 {
-	return fs ? fs->vfs_optstr : NULL;
+	if (!fs || mnt_fs_split_options(fs))
+		return NULL;
+	return fs->vfs_optstr;
 }
 
 /**
@@ -1006,7 +1270,9 @@ char *mnt_fs_get_vfs_options_all(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_user_options(struct libmnt_fs *fs)
 {
-	return fs ? fs->user_optstr : NULL;
+	if (!fs || mnt_fs_split_options(fs))
+		return NULL;
+	return fs->user_optstr;
 }
 
 /**
@@ -1017,7 +1283,7 @@ const char *mnt_fs_get_user_options(struct libmnt_fs *fs)
  */
 const char *mnt_fs_get_attributes(struct libmnt_fs *fs)
 {
-	return fs ? fs->attrs : NULL;
+	return fs ? mnt_fs_ext(fs, attrs) : NULL;
 }
 
 /**
@@ -1037,7 +1303,7 @@ const char *mnt_fs_get_attributes(struct libmnt_fs *fs)
  */
 int mnt_fs_set_attributes(struct libmnt_fs *fs, const char *optstr)
 {
-	return strdup_to_struct_member(fs, attrs, optstr);
+	return strdup_to_ext(fs, offsetof(struct libmnt_fs_ext, attrs), optstr);
 }
 
 /**
@@ -1055,7 +1321,9 @@ int mnt_fs_append_attributes(struct libmnt_fs *fs, const char *optstr)
 		return -EINVAL;
 	if (!optstr)
 		return 0;
-	return mnt_optstr_append_option(&fs->attrs, optstr, NULL);
+	if (!__mnt_fs_get_ext(fs))
+		return -ENOMEM;
+	return mnt_optstr_append_option(&fs->ext->attrs, optstr, NULL);
 }
 
 /**
@@ -1073,7 +1341,9 @@ int mnt_fs_prepend_attributes(struct libmnt_fs *fs, const char *optstr)
 		return -EINVAL;
 	if (!optstr)
 		return 0;
-	return mnt_optstr_prepend_option(&fs->attrs, optstr, NULL);
+	if (!__mnt_fs_get_ext(fs))
+		return -ENOMEM;
+	return mnt_optstr_prepend_option(&fs->ext->attrs, optstr, NULL);
 }
 
 
@@ -1137,7 +1407,11 @@ int mnt_fs_set_passno(struct libmnt_fs *fs, int passno)
  */
 const char *mnt_fs_get_root(struct libmnt_fs *fs)
 {
-	return fs ? fs->root : NULL;
+	if (!fs)
+		return NULL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_MNT_ROOT);
+	return fs->root;
 }
 
 /**
@@ -1149,6 +1423,8 @@ const char *mnt_fs_get_root(struct libmnt_fs *fs)
  */
 int mnt_fs_set_root(struct libmnt_fs *fs, const char *path)
 {
+	if (fs && mnt_fs_unshare(fs))
+		return -ENOMEM;
 	return strdup_to_struct_member(fs, root, path);
 }
 
@@ -1160,7 +1436,7 @@ int mnt_fs_set_root(struct libmnt_fs *fs, const char *path)
  */
 const char *mnt_fs_get_swaptype(struct libmnt_fs *fs)
 {
-	return fs ? fs->swaptype : NULL;
+	return fs ? mnt_fs_ext(fs, swaptype) : NULL;
 }
 
 /**
@@ -1171,7 +1447,7 @@ const char *mnt_fs_get_swaptype(struct libmnt_fs *fs)
  */
 off_t mnt_fs_get_size(struct libmnt_fs *fs)
 {
-	return fs ? fs->size : 0;
+	return fs ? mnt_fs_ext(fs, size) : 0;
 }
 
 /**
@@ -1182,7 +1458,7 @@ off_t mnt_fs_get_size(struct libmnt_fs *fs)
  */
 off_t mnt_fs_get_usedsize(struct libmnt_fs *fs)
 {
-	return fs ? fs->usedsize : 0;
+	return fs ? mnt_fs_ext(fs, usedsize) : 0;
 }
 
 /**
@@ -1193,7 +1469,7 @@ off_t mnt_fs_get_usedsize(struct libmnt_fs *fs)
  */
 int mnt_fs_get_priority(struct libmnt_fs *fs)
 {
-	return fs ? fs->priority : 0;
+	return fs ? mnt_fs_ext(fs, priority) : 0;
 }
 
 /**
@@ -1209,7 +1485,9 @@ int mnt_fs_set_priority(struct libmnt_fs *fs, int prio)
 {
 	if (!fs)
 		return -EINVAL;
-	fs->priority = prio;
+	if (!__mnt_fs_get_ext(fs))
+		return -ENOMEM;
+	fs->ext->priority = prio;
 	return 0;
 }
 
@@ -1221,7 +1499,7 @@ int mnt_fs_set_priority(struct libmnt_fs *fs, int prio)
  */
 const char *mnt_fs_get_bindsrc(struct libmnt_fs *fs)
 {
-	return fs ? fs->bindsrc : NULL;
+	return fs ? mnt_fs_ext(fs, bindsrc) : NULL;
 }
 
 /**
@@ -1233,7 +1511,7 @@ const char *mnt_fs_get_bindsrc(struct libmnt_fs *fs)
  */
 int mnt_fs_set_bindsrc(struct libmnt_fs *fs, const char *src)
 {
-	return strdup_to_struct_member(fs, bindsrc, src);
+	return strdup_to_ext(fs, offsetof(struct libmnt_fs_ext, bindsrc), src);
 }
 
 /**
@@ -1258,6 +1536,22 @@ int mnt_fs_get_parent_id(struct libmnt_fs *fs)
 	return fs ? fs->parent : -EINVAL;
 }
 
+/**
+ * mnt_fs_get_uniq_id:
+ * @fs: filesystem instance
+ *
+ * The unique mount ID is not recycled by the kernel (unlike mnt_fs_get_id()).
+ * It's available for the entries from mnt_table_fetch_listmount() only.
+ *
+ * Returns: unique mount ID or zero if not available.
+ *
+ * Since: 2.39
+ */
+uint64_t mnt_fs_get_uniq_id(struct libmnt_fs *fs)
+{
+	return fs ? fs->uniq_id : 0;
+}
+
 /**
  * mnt_fs_get_devno:
  * @fs: /proc/self/mountinfo entry
@@ -1296,6 +1590,10 @@ int mnt_fs_get_option(struct libmnt_fs *fs, const char *name,
 
 	if (!fs)
 		return -EINVAL;
+
+	mnt_fs_try_statmount(fs, STATMOUNT_MNT_OPTS);
+	if (mnt_fs_split_options(fs))
+		return -ENOMEM;
 	if (fs->fs_optstr)
 		rc = mnt_optstr_get_option(fs->fs_optstr, name, value, valsz);
 	if (rc == 1 && fs->vfs_optstr)
@@ -1321,8 +1619,8 @@ int mnt_fs_get_attribute(struct libmnt_fs *fs, const char *name,
 
 	if (!fs)
 		return -EINVAL;
-	if (fs->attrs)
-		rc = mnt_optstr_get_option(fs->attrs, name, value, valsz);
+	if (mnt_fs_ext(fs, attrs))
+		rc = mnt_optstr_get_option(fs->ext->attrs, name, value, valsz);
 	return rc;
 }
 
@@ -1336,7 +1634,7 @@ const char *mnt_fs_get_comment(struct libmnt_fs *fs)
 {
 	if (!fs)
 		return NULL;
-	return fs->comment;
+	return mnt_fs_ext(fs, comment);
 }
 
 /**
@@ -1352,7 +1650,7 @@ const char *mnt_fs_get_comment(struct libmnt_fs *fs)
  */
 int mnt_fs_set_comment(struct libmnt_fs *fs, const char *comm)
 {
-	return strdup_to_struct_member(fs, comment, comm);
+	return strdup_to_ext(fs, offsetof(struct libmnt_fs_ext, comment), comm);
 }
 
 /**
@@ -1368,8 +1666,10 @@ int mnt_fs_append_comment(struct libmnt_fs *fs, const char *comm)
 {
 	if (!fs)
 		return -EINVAL;
+	if (!__mnt_fs_get_ext(fs))
+		return -ENOMEM;
 
-	return strappend(&fs->comment, comm);
+	return strappend(&fs->ext->comment, comm);
 }
 
 /**
@@ -1399,7 +1699,7 @@ int mnt_fs_match_target(struct libmnt_fs *fs, const char *target,
 {
 	int rc = 0;
 
-	if (!fs || !target || !fs->target)
+	if (!fs || !target || !mnt_fs_get_target(fs))
 		return 0;
 
 	/* 1) native paths */
@@ -1450,11 +1750,11 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
 	if (mnt_fs_streq_srcpath(fs, source) == 1)
 		return 1;
 
-	if (!source || !fs->source)
+	if (!source || !mnt_fs_get_source(fs))
 		return 0;
 
 	/* ... and tags */
-	if (fs->tagname && strcmp(source, fs->source) == 0)
+	if (mnt_fs_ext(fs, tagname) && strcmp(source, fs->source) == 0)
 		return 1;
 
 	if (!cache)
@@ -1516,7 +1816,7 @@ int mnt_fs_match_source(struct libmnt_fs *fs, const char *source,
  */
 int mnt_fs_match_fstype(struct libmnt_fs *fs, const char *types)
 {
-	return mnt_match_fstype(fs->fstype, types);
+	return mnt_match_fstype(mnt_fs_get_fstype(fs), types);
 }
 
 /**
@@ -1531,7 +1831,42 @@ int mnt_fs_match_fstype(struct libmnt_fs *fs, const char *types)
  */
 int mnt_fs_match_options(struct libmnt_fs *fs, const char *options)
 {
-	return mnt_match_options(mnt_fs_get_options(fs), options);
+	const char *optstr = mnt_fs_get_options(fs);
+
+	/* tokenized optstr is cached for repeated queries */
+	if (optstr && options && __mnt_fs_get_ext(fs)) {
+		struct libmnt_fs_ext *ext = fs->ext;
+
+		if (ext->optoks_src != optstr) {
+			__mnt_fs_drop_optoks(fs);
+			if (__mnt_optstr_tokenize(optstr, &ext->optoks, &ext->noptoks) == 0)
+				ext->optoks_src = optstr;
+		}
+		if (ext->optoks_src == optstr)
+			return __mnt_match_options_tokens(ext->optoks,
+							  ext->noptoks, options);
+	}
+	return mnt_match_options(optstr, options);
+}
+
+/**
+ * mnt_fs_match_optmatcher:
+ * @fs: filesystem
+ * @m: matcher from mnt_new_optmatcher() or mnt_new_fstype_matcher()
+ *
+ * Matches @fs options or @fs type (depends on @m) by the precompiled pattern.
+ *
+ * Returns: 1 if @fs is matching, else 0.
+ *
+ * Since: 2.39
+ */
+int mnt_fs_match_optmatcher(struct libmnt_fs *fs, struct libmnt_optmatcher *m)
+{
+	if (!fs || !m)
+		return 0;
+	if (__mnt_optmatcher_is_fstype(m))
+		return mnt_optmatcher_match(m, mnt_fs_get_fstype(fs));
+	return mnt_optmatcher_match(m, mnt_fs_get_options(fs));
 }
 
 /**
@@ -141,7 +141,8 @@ static void unlock_simplelock(struct libmnt_lock *ml)
 	}
 }
 
-static int lock_simplelock(struct libmnt_lock *ml)
+/* @op is LOCK_EX, LOCK_SH or LOCK_EX|LOCK_NB */
+static int lock_simplelock(struct libmnt_lock *ml, int op)
 {
 	const char *lfile;
 	int rc;
@@ -152,7 +153,9 @@ static int lock_simplelock(struct libmnt_lock *ml)
 
 	lfile = mnt_lock_get_lockfile(ml);
 
-	DBG(LOCKS, ul_debugobj(ml, "%s: locking", lfile));
+	DBG(LOCKS, ul_debugobj(ml, "%s: locking%s", lfile,
+				op & LOCK_SH ? " (shared)" :
+				op & LOCK_NB ? " (non-blocking)" : ""));
 
 	if (ml->sigblock) {
 		sigset_t sigs;
@@ -182,9 +185,9 @@ static int lock_simplelock(struct libmnt_lock *ml)
 		}
 	}
 
-	while (flock(ml->lockfile_fd, LOCK_EX) < 0) {
+	while (flock(ml->lockfile_fd, op) < 0) {
 		int errsv;
-		if ((errno == EAGAIN) || (errno == EINTR))
+		if (errno == EINTR || (errno == EAGAIN && !(op & LOCK_NB)))
 			continue;
 		errsv = errno;
 		close(ml->lockfile_fd);
@@ -217,7 +220,31 @@ int mnt_lock_file(struct libmnt_lock *ml)
 	if (!ml)
 		return -EINVAL;
 
-	return lock_simplelock(ml);
+	return lock_simplelock(ml, LOCK_EX);
+}
+
+/*
+ * The shared lock is used by the utab appends, the appends don't block each
+ * other, only the utab rewrite (exclusive lock).
+ */
+int mnt_lock_file_shared(struct libmnt_lock *ml)
+{
+	if (!ml)
+		return -EINVAL;
+
+	return lock_simplelock(ml, LOCK_SH);
+}
+
+/*
+ * Returns: 0 on success, -EAGAIN if the file is already locked, or negative
+ * number in case of error.
+ */
+int mnt_trylock_file(struct libmnt_lock *ml)
+{
+	if (!ml)
+		return -EINVAL;
+
+	return lock_simplelock(ml, LOCK_EX | LOCK_NB);
 }
 
 /**
@@ -33,18 +33,48 @@
  *   </programlisting>
  * </informalexample>
  *
+ * The fanotify monitor (see mnt_monitor_enable_fanotify()) reports also IDs
+ * of the attached and detached mount nodes, use mnt_monitor_next_mount_event()
+ * after the change and mnt_table_refresh_ids() to update a mount table.
  */
 
 #include "fileutils.h"
 #include "mountP.h"
 #include "pathnames.h"
 
+#include <inttypes.h>
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
 #include <sys/epoll.h>
 
+/* fanotify mount notification (Linux 6.15) */
+#ifndef FAN_REPORT_MNT
+# define FAN_REPORT_MNT		0x00004000
+#endif
+#ifndef FAN_MARK_MNTNS
+# define FAN_MARK_MNTNS		0x00000110
+#endif
+#ifndef FAN_MNT_ATTACH
+# define FAN_MNT_ATTACH		0x01000000
+# define FAN_MNT_DETACH		0x02000000
+#endif
+#ifndef FAN_EVENT_INFO_TYPE_MNT
+# define FAN_EVENT_INFO_TYPE_MNT	7
+#endif
+
+struct monitor_fanotify_info_mnt {
+	struct fanotify_event_info_header	hdr;
+	uint64_t				mnt_id;
+};
+
 
 struct monitor_opers;
 
+struct monitor_mntevent {
+	uint64_t		id;		/* unique mount ID */
+	int			event;		/* MNT_MONITOR_EVENT_* */
+};
+
 struct monitor_entry {
 	int			fd;		/* private entry file descriptor */
 	char			*path;		/* path to the monitored file */
@@ -56,6 +86,11 @@ struct monitor_entry {
 	unsigned int		enable : 1,
 				changed : 1;
 
+	/* fanotify monitor only */
+	struct monitor_mntevent	*mntevents;
+	size_t			nmntevents;
+	size_t			mntevents_pos;	/* next returned event */
+
 	struct list_head	ents;
 };
 
@@ -117,6 +152,7 @@ static void free_monitor_entry(struct monitor_entry *me)
 	if (me->fd >= 0)
 		close(me->fd);
 	free(me->path);
+	free(me->mntevents);
 	free(me);
 }
 
@@ -545,6 +581,264 @@ err:
 	return rc;
 }
 
+/*
+ * Fanotify monitor
+ */
+
+static int fanotify_monitor_close_fd(struct libmnt_monitor *mn __attribute__((__unused__)),
+				     struct monitor_entry *me)
+{
+	assert(me);
+
+	if (me->fd >= 0)
+		close(me->fd);
+	me->fd = -1;
+	return 0;
+}
+
+static int fanotify_monitor_get_fd(struct libmnt_monitor *mn,
+				   struct monitor_entry *me)
+{
+	int rc, ns = -1;
+
+	if (!me || me->enable == 0)	/* not-initialized or disabled */
+		return -EINVAL;
+	if (me->fd >= 0)
+		return me->fd;		/* already initialized */
+
+	assert(me->path);
+	DBG(MONITOR, ul_debugobj(mn, " open fanotify monitor for %s", me->path));
+
+	me->fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_MNT |
+			       FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY);
+	if (me->fd < 0)
+		goto err;
+
+	ns = open(me->path, O_RDONLY | O_CLOEXEC);
+	if (ns < 0)
+		goto err;
+
+	if (fanotify_mark(me->fd, FAN_MARK_ADD | FAN_MARK_MNTNS,
+			  FAN_MNT_ATTACH | FAN_MNT_DETACH, ns, NULL) < 0)
+		goto err;
+
+	close(ns);
+	return me->fd;
+err:
+	/* old kernels do not support the flags */
+	rc = errno == EINVAL ? -ENOSYS : -errno;
+	if (ns >= 0)
+		close(ns);
+	if (me->fd >= 0)
+		close(me->fd);
+	me->fd = -1;
+	DBG(MONITOR, ul_debugobj(mn, "failed to create fanotify monitor [rc=%d]", rc));
+	return rc;
+}
+
+static int fanotify_add_event(struct monitor_entry *me, uint64_t id, int event)
+{
+	struct monitor_mntevent *x;
+
+	x = realloc(me->mntevents, (me->nmntevents + 1) * sizeof(*x));
+	if (!x)
+		return -ENOMEM;
+	me->mntevents = x;
+	me->mntevents[me->nmntevents].id = id;
+	me->mntevents[me->nmntevents].event = event;
+	me->nmntevents++;
+	return 0;
+}
+
+/*
+ * drain fanotify buffer and read mount IDs
+ */
+static int fanotify_event_verify(struct libmnt_monitor *mn,
+				 struct monitor_entry *me)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+	int status = 0;
+
+	if (!me || me->fd < 0)
+		return 0;
+
+	DBG(MONITOR, ul_debugobj(mn, "drain and read fanotify events"));
+
+	/* the previous change has been already reported */
+	if (!me->changed) {
+		me->nmntevents = 0;
+		me->mntevents_pos = 0;
+	}
+
+	/* the me->fd is non-blocking */
+	do {
+		const struct fanotify_event_metadata *e;
+		ssize_t len;
+
+		len = read(me->fd, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+
+		for (e = (const struct fanotify_event_metadata *) buf;
+		     FAN_EVENT_OK(e, len);
+		     e = FAN_EVENT_NEXT(e, len)) {
+
+			const char *p = (const char *) e + e->metadata_len,
+				   *end = (const char *) e + e->event_len;
+
+			if (e->mask & FAN_Q_OVERFLOW) {
+				DBG(MONITOR, ul_debugobj(mn, " fanotify queue overflow"));
+				fanotify_add_event(me, 0, MNT_MONITOR_EVENT_OVERFLOW);
+				status = 1;
+				continue;
+			}
+			if (!(e->mask & (FAN_MNT_ATTACH | FAN_MNT_DETACH)))
+				continue;
+
+			while (p + sizeof(struct fanotify_event_info_header) <= end) {
+				const struct monitor_fanotify_info_mnt *info =
+					(const struct monitor_fanotify_info_mnt *) p;
+
+				if (info->hdr.len == 0)
+					break;
+				if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_MNT
+				    && info->hdr.len >= sizeof(*info)) {
+					DBG(MONITOR, ul_debugobj(mn, " fanotify event 0x%llx [id=%" PRIu64 "]",
+						(unsigned long long) e->mask, info->mnt_id));
+
+					/* move is reported as detach and attach */
+					if ((e->mask & FAN_MNT_DETACH)
+					    && fanotify_add_event(me, info->mnt_id,
+						    MNT_MONITOR_EVENT_DETACH) == 0)
+						status = 1;
+					if ((e->mask & FAN_MNT_ATTACH)
+					    && fanotify_add_event(me, info->mnt_id,
+						    MNT_MONITOR_EVENT_ATTACH) == 0)
+						status = 1;
+				}
+				p += info->hdr.len;
+			}
+		}
+	} while (1);
+
+	DBG(MONITOR, ul_debugobj(mn, "%s", status == 1 ? " success" : " nothing"));
+	return status;
+}
+
+/*
+ * fanotify monitor operations
+ */
+static const struct monitor_opers fanotify_opers = {
+	.op_get_fd		= fanotify_monitor_get_fd,
+	.op_close_fd		= fanotify_monitor_close_fd,
+	.op_event_verify	= fanotify_event_verify
+};
+
+/**
+ * mnt_monitor_enable_fanotify:
+ * @mn: monitor
+ * @enable: 0 or 1
+ *
+ * Enables or disables kernel VFS monitoring by fanotify mount notification
+ * for the current mount namespace. Unlike mnt_monitor_enable_kernel(), the
+ * monitor provides IDs of the attached and detached mount nodes, see
+ * mnt_monitor_next_mount_event(). The moved mount nodes are reported as
+ * detached and attached. Note that the changes of mount options or propagation
+ * are not reported.
+ *
+ * The fanotify file descriptor is created immediately (also if the top-level
+ * monitor does not exist yet) to verify that the kernel supports it. The
+ * monitor requires CAP_SYS_ADMIN in the user namespace of the mount namespace.
+ *
+ * Return: 0 on success, -ENOSYS if not supported by kernel and <0 on error
+ *
+ * Since: 2.39
+ */
+int mnt_monitor_enable_fanotify(struct libmnt_monitor *mn, int enable)
+{
+	struct monitor_entry *me;
+	int rc = 0;
+
+	if (!mn)
+		return -EINVAL;
+
+	me = monitor_get_entry(mn, MNT_MONITOR_TYPE_FANOTIFY);
+	if (me) {
+		rc = monitor_modify_epoll(mn, me, enable);
+		if (!enable)
+			fanotify_monitor_close_fd(mn, me);
+		return rc;
+	}
+	if (!enable)
+		return 0;
+
+	DBG(MONITOR, ul_debugobj(mn, "allocate new fanotify monitor"));
+
+	me = monitor_new_entry(mn);
+	if (!me)
+		goto err;
+
+	me->events = EPOLLIN;
+	me->type = MNT_MONITOR_TYPE_FANOTIFY;
+	me->opers = &fanotify_opers;
+	me->path = strdup("/proc/self/ns/mnt");
+	if (!me->path)
+		goto err;
+
+	me->enable = 1;
+	rc = fanotify_monitor_get_fd(mn, me);
+	if (rc < 0) {
+		free_monitor_entry(me);
+		return rc;
+	}
+
+	return monitor_modify_epoll(mn, me, TRUE);
+err:
+	rc = -errno;
+	free_monitor_entry(me);
+	DBG(MONITOR, ul_debugobj(mn, "failed to allocate fanotify monitor [rc=%d]", rc));
+	return rc;
+}
+
+/**
+ * mnt_monitor_next_mount_event:
+ * @mn: monitor
+ * @id: returns unique mount ID (see mnt_fs_get_uniq_id())
+ * @event: returns MNT_MONITOR_EVENT_* (optional argument)
+ *
+ * Returns the next mount node event for the last change detected by the
+ * fanotify monitor (see mnt_monitor_next_change() and MNT_MONITOR_TYPE_FANOTIFY).
+ * The events are available until the monitor reads the next change.
+ *
+ * MNT_MONITOR_EVENT_OVERFLOW (with zero @id) means that some events have been
+ * lost and the whole mount table has to be re-read.
+ *
+ * Returns: 0 on success, 1 no more events, <0 on error
+ *
+ * Since: 2.39
+ */
+int mnt_monitor_next_mount_event(struct libmnt_monitor *mn,
+				 uint64_t *id, int *event)
+{
+	struct monitor_entry *me;
+	struct monitor_mntevent *x;
+
+	if (!mn || !id)
+		return -EINVAL;
+
+	me = monitor_get_entry(mn, MNT_MONITOR_TYPE_FANOTIFY);
+	if (!me)
+		return -EINVAL;
+	if (me->mntevents_pos >= me->nmntevents)
+		return 1;
+
+	x = &me->mntevents[me->mntevents_pos++];
+	*id = x->id;
+	if (event)
+		*event = x->event;
+	return 0;
+}
+
 /*
  * Add/Remove monitor entry to/from monitor epoll.
  */
@@ -852,6 +1146,11 @@ static struct libmnt_monitor *create_test_monitor(int argc, char *argv[])
 				warn("failed to initialize kernel monitor");
 				goto err;
 			}
+		} else if (strcmp(argv[i], "fanotify") == 0) {
+			if (mnt_monitor_enable_fanotify(mn, TRUE)) {
+				warn("failed to initialize fanotify monitor");
+				goto err;
+			}
 		}
 	}
 	if (i == 1) {
@@ -955,11 +1254,24 @@ static int test_wait(struct libmnt_test *ts, int argc, char *argv[])
 
 	printf("waiting for changes...\n");
 	while (mnt_monitor_wait(mn, -1) > 0) {
+		int type = 0;
+
 		printf("notification detected\n");
 
-		while (mnt_monitor_next_change(mn, &filename, NULL) == 0)
+		while (mnt_monitor_next_change(mn, &filename, &type) == 0) {
+			uint64_t id;
+			int event;
+
 			printf(" %s: change detected\n", filename);
 
+			if (type != MNT_MONITOR_TYPE_FANOTIFY)
+				continue;
+			while (mnt_monitor_next_mount_event(mn, &id, &event) == 0)
+				printf("  %s: %" PRIu64 "\n",
+					event == MNT_MONITOR_EVENT_ATTACH ? "attach" :
+					event == MNT_MONITOR_EVENT_DETACH ? "detach" :
+					"overflow", id);
+		}
 	}
 	mnt_unref_monitor(mn);
 	return 0;
@@ -968,9 +1280,9 @@ static int test_wait(struct libmnt_test *ts, int argc, char *argv[])
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
-		{ "--epoll", test_epoll, "<userspace kernel ...>  monitor in epoll" },
-		{ "--epoll-clean", test_epoll_cleanup, "<userspace kernel ...>  monitor in epoll and clean events" },
-		{ "--wait",  test_wait,  "<userspace kernel ...>  monitor wait function" },
+		{ "--epoll", test_epoll, "<userspace kernel fanotify ...>  monitor in epoll" },
+		{ "--epoll-clean", test_epoll_cleanup, "<userspace kernel fanotify ...>  monitor in epoll and clean events" },
+		{ "--wait",  test_wait,  "<userspace kernel fanotify ...>  monitor wait function" },
 		{ NULL }
 	};
 
@@ -28,6 +28,7 @@
 #include "list.h"
 #include "debug.h"
 #include "libmount.h"
+#include "mount-api-utils.h"
 
 /*
  * Debug
@@ -138,6 +139,11 @@ extern int mnt_table_set_parser_fltrcb(	struct libmnt_table *tb,
 extern int __mnt_table_parse_mountinfo(struct libmnt_table *tb,
 					const char *filename,
 					struct libmnt_table *u_tb);
+extern int __mnt_kernel_fs_postparse(struct libmnt_table *tb,
+					struct libmnt_fs *fs, pid_t *tid,
+					const char *filename);
+extern int __mnt_table_merge_utab(struct libmnt_table *tb,
+					struct libmnt_table *u_tb);
 
 extern struct libmnt_fs *mnt_table_get_fs_root(struct libmnt_table *tb,
 					struct libmnt_fs *fs,
@@ -175,6 +181,41 @@ struct libmnt_iter {
 	} while(0)
 
 
+/*
+ * Option from options string, see __mnt_optstr_tokenize()
+ */
+struct libmnt_optoken {
+	const char	*name;
+	size_t		namesz;
+	const char	*value;		/* NULL if without value */
+	size_t		valsz;
+};
+
+/*
+ * The rarely used libmnt_fs fields (fstab tags and comments, utab and swaps
+ * specific data), allocated on demand by __mnt_fs_get_ext(). The kernel
+ * entries usually don't need it at all.
+ */
+struct libmnt_fs_ext {
+	char		*bindsrc;	/* utab, full path from fstab[1] for bind mounts */
+
+	char		*tagname;	/* fstab[1]: tag name - "LABEL", "UUID", ..*/
+	char		*tagval;	/*           tag value */
+
+	char		*attrs;		/* mount attributes */
+	char		*comment;	/* fstab comment */
+
+	/* /proc/swaps */
+	char		*swaptype;	/* swaps[2]: device type (partition, file, ...) */
+	off_t		size;		/* swaps[3]: swaparea size */
+	off_t		usedsize;	/* swaps[4]: used size */
+	int		priority;	/* swaps[5]: swap priority */
+
+	struct libmnt_optoken *optoks;	/* tokenized optstr (cache) */
+	size_t		noptoks;
+	const char	*optoks_src;	/* optstr used for optoks or NULL */
+};
+
 /*
  * This struct represents one entry in a fstab/mountinfo file.
  * (note that fstab[1] means the first column from fstab, and so on...)
@@ -186,15 +227,11 @@ struct libmnt_fs {
 	int		refcount;	/* reference counter */
 	int		id;		/* mountinfo[1]: ID */
 	int		parent;		/* mountinfo[2]: parent */
+	int		flags;		/* MNT_FS_* flags */
 	dev_t		devno;		/* mountinfo[3]: st_dev */
 
-	char		*bindsrc;	/* utab, full path from fstab[1] for bind mounts */
-
 	char		*source;	/* fstab[1], mountinfo[10], swaps[1]:
                                          * source dev, file, dir or TAG */
-	char		*tagname;	/* fstab[1]: tag name - "LABEL", "UUID", ..*/
-	char		*tagval;	/*           tag value */
-
 	char		*root;		/* mountinfo[4]: root of the mount within the FS */
 	char		*target;	/* mountinfo[5], fstab[2]: mountpoint */
 	char		*fstype;	/* mountinfo[9], fstab[3]: filesystem type */
@@ -204,25 +241,28 @@ struct libmnt_fs {
 	char		*opt_fields;	/* mountinfo[7]: optional fields */
 	char		*fs_optstr;	/* mountinfo[11]: fs-dependent options */
 	char		*user_optstr;	/* userspace mount options */
-	char		*attrs;		/* mount attributes */
 
 	int		freq;		/* fstab[5]: dump frequency in days */
 	int		passno;		/* fstab[6]: pass number on parallel fsck */
 
-	/* /proc/swaps */
-	char		*swaptype;	/* swaps[2]: device type (partition, file, ...) */
-	off_t		size;		/* swaps[3]: swaparea size */
-	off_t		usedsize;	/* swaps[4]: used size */
-	int		priority;	/* swaps[5]: swap priority */
-
-	int		flags;		/* MNT_FS_* flags */
 	pid_t		tid;		/* /proc/<tid>/mountinfo otherwise zero */
+	unsigned int	pooled;		/* MNT_POOL_* strings from strpool */
 
-	char		*comment;	/* fstab comment */
+	uint64_t	uniq_id;	/* statmount(): unique mount ID */
+	uint64_t	stmnt_todo;	/* statmount(): STATMOUNT_* not fetched yet */
+
+	struct libmnt_fs_ext *ext;	/* rarely used fields or NULL */
+
+	struct libmnt_strpool *strpool;	/* owner of the pooled strings */
+	struct libmnt_strpool *arena;	/* owner of the struct memory or NULL */
 
 	void		*userdata;	/* library independent data */
 };
 
+/* returns @_fs->ext->_member, or zero if @_fs has no extension */
+#define mnt_fs_ext(_fs, _member) \
+		((_fs)->ext ? (_fs)->ext->_member : 0)
+
 /*
  * fs flags
  */
@@ -231,6 +271,9 @@ struct libmnt_fs {
 #define MNT_FS_SWAP	(1 << 3) /* swap device */
 #define MNT_FS_KERNEL	(1 << 4) /* data from /proc/{mounts,self/mountinfo} */
 #define MNT_FS_MERGED	(1 << 5) /* already merged data from /run/mount/utab */
+#define MNT_FS_UTAB_DEL	(1 << 6) /* utab record: remove the entry (OP=del) */
+#define MNT_FS_UTAB_MOD	(1 << 7) /* utab record: modify the entry (OP=mod) */
+#define MNT_FS_UNSPLIT	(1 << 8) /* optstr not split to VFS, FS and user options yet */
 
 /*
  * fstab/mountinfo file
@@ -251,6 +294,14 @@ struct libmnt_table {
 	int		(*fltrcb)(struct libmnt_fs *fs, void *data);
 	void		*fltrcb_data;
 
+	int		listmount;	/* use listmount() for mnt_table_parse_mtab() */
+	uint64_t	stmnt_mask;	/* STATMOUNT_* fetched by listmount loader */
+
+	struct libmnt_tabidx	*idx;	/* lookup indexes (see tab_index.c) */
+
+	int		zerocopy;	/* use zero-copy parser */
+	int		arena;		/* allocate entries from strpool */
+	struct libmnt_strpool	*strpool; /* mountinfo buffers and interned strings */
 
 	struct list_head	ents;	/* list of entries (libmnt_fs) */
 	void		*userdata;
@@ -294,6 +345,8 @@ struct libmnt_context
 
 	char	*fstype_pattern;	/* for mnt_match_fstype() */
 	char	*optstr_pattern;	/* for mnt_match_options() */
+	struct libmnt_optmatcher *fstype_matcher;	/* compiled fstype_pattern */
+	struct libmnt_optmatcher *optstr_matcher;	/* compiled optstr_pattern */
 
 	char	*subdir;		/* X-mount.subdir= */
 
@@ -319,6 +372,7 @@ struct libmnt_context
 
 	int	optsmode;	/* fstab optstr mode MNT_OPTSMODE_{AUTO,FORCE,IGNORE} */
 	int	loopdev_fd;	/* open loopdev */
+	struct loopdev_index *loopdev_idx;	/* used loop devices, see lib/loopdev.c */
 
 	unsigned long	mountflags;	/* final mount(2) flags */
 	const void	*mountdata;	/* final mount(2) data, string or binary data */
@@ -403,6 +457,11 @@ extern const struct libmnt_optmap *mnt_optmap_get_entry(
 			     const struct libmnt_optmap **mapent);
 
 /* optstr.c */
+extern int __mnt_optstr_tokenize(const char *optstr,
+				 struct libmnt_optoken **toks, size_t *ntoks);
+extern int __mnt_match_options_tokens(const struct libmnt_optoken *toks,
+				      size_t ntoks, const char *pattern);
+extern int __mnt_optmatcher_is_fstype(const struct libmnt_optmatcher *m);
 extern int mnt_optstr_get_uid(const char *optstr, const char *name, uid_t *uid);
 extern int mnt_optstr_remove_option_at(char **optstr, char *begin, char *end);
 extern int mnt_optstr_fix_gid(char **optstr, char *value, size_t valsz, char **next);
@@ -410,17 +469,106 @@ extern int mnt_optstr_fix_uid(char **optstr, char *value, size_t valsz, char **n
 extern int mnt_optstr_fix_secontext(char **optstr, char *value, size_t valsz, char **next);
 extern int mnt_optstr_fix_user(char **optstr);
 
+/* tab_index.c */
+enum {
+	MNT_TABIDX_ID = 0,		/* mnt_fs_get_id() */
+	MNT_TABIDX_PARENT,		/* mnt_fs_get_parent_id() */
+	MNT_TABIDX_TARGET,		/* mnt_fs_get_target() */
+	MNT_TABIDX_SRCPATH,		/* mnt_fs_get_srcpath() */
+	MNT_TABIDX_DEVNO,		/* mnt_fs_get_devno() */
+
+	__MNT_TABIDX_MAX
+};
+
+struct libmnt_tabidx_iter {
+	int		key;		/* MNT_TABIDX_* */
+	unsigned int	next;		/* position of the next entry + 1 */
+};
+
+extern void __mnt_table_drop_index(struct libmnt_table *tb);
+extern uint32_t __mnt_tabidx_hash_path(const char *path);
+extern uint32_t __mnt_tabidx_hash_num(uint64_t num);
+extern int __mnt_table_index_init(struct libmnt_table *tb, int key, uint32_t hash,
+				  struct libmnt_tabidx_iter *it);
+extern struct libmnt_fs *__mnt_table_index_next(struct libmnt_table *tb,
+						struct libmnt_tabidx_iter *it);
+extern int __mnt_table_index_ntags(struct libmnt_table *tb);
+extern int __mnt_table_build_tree(struct libmnt_table *tb, int force);
+extern struct libmnt_fs *__mnt_table_tree_next_child(struct libmnt_table *tb,
+					int parent_id, int last_id);
+
+/* strpool.c */
+extern struct libmnt_strpool *__mnt_new_strpool(void);
+extern void __mnt_ref_strpool(struct libmnt_strpool *pool);
+extern void __mnt_unref_strpool(struct libmnt_strpool *pool);
+extern void *__mnt_strpool_alloc(struct libmnt_strpool *pool, size_t sz);
+extern int __mnt_strpool_add_buffer(struct libmnt_strpool *pool, char *buf);
+extern const char *__mnt_strpool_intern(struct libmnt_strpool *pool, const char *str);
+
+/* tab_diff.c */
+extern int __mnt_tabdiff_add_entry(struct libmnt_tabdiff *df,
+				   struct libmnt_fs *old, struct libmnt_fs *new,
+				   int oper);
+extern int __mnt_tabdiff_fs_change(struct libmnt_fs *old, struct libmnt_fs *new);
+
+/* tab_listmount.c */
+extern int mnt_fs_fetch_statmount(struct libmnt_fs *fs, uint64_t mask);
+extern int __mnt_table_refresh_listmount(struct libmnt_table *tb,
+					 struct libmnt_table *nt,
+					 struct libmnt_tabdiff *df);
+extern int __mnt_table_refresh_listmount_ids(struct libmnt_table *tb,
+					     struct libmnt_tabdiff *df,
+					     const uint64_t *ids, size_t nids);
+
+/* fetch not yet fetched fields (STATMOUNT_*) for fs from listmount loader */
+#ifdef UL_HAVE_STATMOUNT
+# define mnt_fs_try_statmount(_fs, _mask) \
+	do { \
+		if ((_fs)->stmnt_todo & (_mask)) \
+			mnt_fs_fetch_statmount((_fs), (_mask)); \
+	} while (0)
+#else
+# define mnt_fs_try_statmount(_fs, _mask)	do { } while (0)
+#endif
+
 /* fs.c */
 extern struct libmnt_fs *mnt_copy_mtab_fs(const struct libmnt_fs *fs);
 extern int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 			__attribute__((nonnull(1)));
 extern int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 			__attribute__((nonnull(1)));
+extern int __mnt_fs_unshare(struct libmnt_fs *fs);
+extern void __mnt_fs_drop_optoks(struct libmnt_fs *fs);
+extern struct libmnt_fs_ext *__mnt_fs_get_ext(struct libmnt_fs *fs);
+extern int __mnt_fs_split_options(struct libmnt_fs *fs);
+extern struct libmnt_fs *__mnt_new_fs_from_pool(struct libmnt_strpool *pool);
+
+/* libmnt_fs strings owned by fs->strpool */
+enum {
+	MNT_POOL_SOURCE		= (1 << 0),
+	MNT_POOL_ROOT		= (1 << 1),
+	MNT_POOL_TARGET		= (1 << 2),
+	MNT_POOL_FSTYPE		= (1 << 3),
+	MNT_POOL_OPTSTR		= (1 << 4),
+	MNT_POOL_VFS_OPTSTR	= (1 << 5),
+	MNT_POOL_FS_OPTSTR	= (1 << 6),
+	MNT_POOL_OPT_FIELDS	= (1 << 7),
+	MNT_POOL_USER_OPTSTR	= (1 << 8)
+};
+
+/* make private copies of the pooled strings before @fs modification */
+#define mnt_fs_unshare(_fs)	((_fs)->pooled ? __mnt_fs_unshare(_fs) : 0)
+
+/* split fs->optstr before access to fs->{vfs,fs,user}_optstr */
+#define mnt_fs_split_options(_fs) \
+		(((_fs)->flags & MNT_FS_UNSPLIT) ? __mnt_fs_split_options(_fs) : 0)
 
 /* context.c */
 extern struct libmnt_context *mnt_copy_context(struct libmnt_context *o);
 extern int mnt_context_utab_writable(struct libmnt_context *cxt);
 extern const char *mnt_context_get_writable_tabpath(struct libmnt_context *cxt);
+extern int mnt_context_match_patterns(struct libmnt_context *cxt,
+				      struct libmnt_fs *fs);
 
 extern int mnt_context_get_mountinfo(struct libmnt_context *cxt, struct libmnt_table **tb);
 extern int mnt_context_get_mountinfo_for_target(struct libmnt_context *cxt,
@@ -451,6 +599,7 @@ extern void mnt_free_addmount(struct libmnt_addmount *ad);
 extern int mnt_context_setup_loopdev(struct libmnt_context *cxt);
 extern int mnt_context_delete_loopdev(struct libmnt_context *cxt);
 extern int mnt_context_clear_loopdev(struct libmnt_context *cxt);
+extern void mnt_context_free_loopdev_index(struct libmnt_context *cxt);
 
 extern int mnt_fork_context(struct libmnt_context *cxt);
 
@@ -474,6 +623,10 @@ extern int mnt_context_is_veritydev(struct libmnt_context *cxt)
 extern int mnt_context_setup_veritydev(struct libmnt_context *cxt);
 extern int mnt_context_deferred_delete_veritydev(struct libmnt_context *cxt);
 
+/* lock.c */
+extern int mnt_lock_file_shared(struct libmnt_lock *ml);
+extern int mnt_trylock_file(struct libmnt_lock *ml);
+
 /* tab_update.c */
 extern int mnt_update_set_filename(struct libmnt_update *upd, const char *filename);
 extern int mnt_update_already_done(struct libmnt_update *upd,
@@ -482,6 +635,10 @@ extern int mnt_update_already_done(struct libmnt_update *upd,
 #if __linux__
 /* btrfs.c */
 extern uint64_t btrfs_get_default_subvol_id(const char *path);
+
+/* cache.c */
+extern uint64_t __mnt_cache_get_btrfs_default(struct libmnt_cache *cache,
+				const char *source, const char *target);
 #endif
 
 #endif /* _LIBMOUNT_PRIVATE_H */
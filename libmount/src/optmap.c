@@ -61,6 +61,9 @@
  *
  * For more details about option map struct see "struct mnt_optmap" in
  * mount/mount.h.
+ *
+ * The lookups in the built-in maps use a perfect hash, other maps are searched
+ * sequentially.
  */
 #include "mountP.h"
 #include "strutils.h"
@@ -196,6 +199,191 @@ static const struct libmnt_optmap userspace_opts_map[] =
    { NULL, 0, 0 }
 };
 
+/*
+ * Perfect hash for the built-in maps. The index is built on the first lookup;
+ * the hash seed is searched to get a collision-free table. The key is the
+ * option name without "=" or "[=]" suffix, the MNT_PREFIX entries are not
+ * hashed.
+ *
+ * Only one thread builds the index (the state is claimed by compare-and-swap)
+ * and the table is published by a release store, other threads use
+ * sequential search until the index is ready.
+ */
+#define OPTMAP_HASH_MAXSLOTS	1024
+
+enum {
+	OPTMAP_HASH_NONE = 0,
+	OPTMAP_HASH_BUILDING,
+	OPTMAP_HASH_READY,
+	OPTMAP_HASH_FAILED
+};
+
+struct optmap_hash {
+	const struct libmnt_optmap	*map;
+	uint32_t			seed;
+	uint32_t			mask;			/* number of slots - 1 */
+	uint16_t			slots[OPTMAP_HASH_MAXSLOTS];	/* entry index + 1 */
+	uint16_t			prefixes[8];		/* MNT_PREFIX entries (index + 1) */
+	int				state;			/* OPTMAP_HASH_* */
+};
+
+static struct optmap_hash optmap_hashes[] = {
+	{ .map = linux_flags_map },
+	{ .map = userspace_opts_map }
+};
+
+static inline size_t optmap_keysz(const char *name)
+{
+	return strcspn(name, "=[");
+}
+
+static inline uint32_t optmap_hash(const char *name, size_t namesz, uint32_t seed)
+{
+	uint32_t h = 2166136261U ^ seed;
+	size_t i;
+
+	for (i = 0; i < namesz; i++)
+		h = (h ^ (unsigned char) name[i]) * 16777619U;
+	return h ^ (h >> 15);
+}
+
+static int optmap_hash_try(struct optmap_hash *oh, uint32_t seed, uint32_t mask)
+{
+	const struct libmnt_optmap *ent;
+	size_t nprefixes = 0;
+
+	memset(oh->slots, 0, (mask + 1) * sizeof(oh->slots[0]));
+	memset(oh->prefixes, 0, sizeof(oh->prefixes));
+
+	for (ent = oh->map; ent->name; ent++) {
+		size_t idx = ent - oh->map, sz;
+		uint32_t k;
+
+		if (ent->mask & MNT_PREFIX) {
+			if (nprefixes == ARRAY_SIZE(oh->prefixes))
+				return -1;
+			oh->prefixes[nprefixes++] = idx + 1;
+			continue;
+		}
+		sz = optmap_keysz(ent->name);
+		k = optmap_hash(ent->name, sz, seed) & mask;
+
+		if (oh->slots[k]) {
+			const char *x = oh->map[oh->slots[k] - 1].name;
+
+			/* duplicate key, the first entry wins */
+			if (optmap_keysz(x) == sz && strncmp(x, ent->name, sz) == 0)
+				continue;
+			return 1;	/* collision */
+		}
+		oh->slots[k] = idx + 1;
+	}
+	return 0;
+}
+
+static struct optmap_hash *get_optmap_hash(const struct libmnt_optmap *map)
+{
+	struct optmap_hash *oh = NULL;
+	uint32_t mask, seed;
+	size_t i, n = 0;
+	int state;
+
+	for (i = 0; i < ARRAY_SIZE(optmap_hashes); i++) {
+		if (optmap_hashes[i].map == map) {
+			oh = &optmap_hashes[i];
+			break;
+		}
+	}
+	if (!oh)
+		return NULL;
+#ifdef __ATOMIC_ACQUIRE
+	state = __atomic_load_n(&oh->state, __ATOMIC_ACQUIRE);
+	if (state == OPTMAP_HASH_READY)
+		return oh;
+	if (state != OPTMAP_HASH_NONE
+	    || !__atomic_compare_exchange_n(&oh->state, &state,
+					    OPTMAP_HASH_BUILDING, 0,
+					    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		return state == OPTMAP_HASH_READY ? oh : NULL;
+#else
+	return NULL;	/* no safe way to publish the index */
+#endif
+	while (map[n].name)
+		n++;
+
+	/* sparse table (slots >= 4 * entries) keeps the seed search short */
+	for (mask = 15; mask + 1 < 4 * n; mask = (mask << 1) | 1);
+
+	for (; mask < OPTMAP_HASH_MAXSLOTS; mask = (mask << 1) | 1) {
+		for (seed = 0; seed < 1024; seed++) {
+			int rc = optmap_hash_try(oh, seed, mask);
+
+			if (rc < 0)
+				goto failed;
+			if (rc == 0) {
+				oh->seed = seed;
+				oh->mask = mask;
+				DBG(OPTIONS, ul_debug("optmap hash [entries=%zu, slots=%u, seed=%u]",
+							n, mask + 1, seed));
+				state = OPTMAP_HASH_READY;
+				goto done;
+			}
+		}
+	}
+failed:
+	DBG(OPTIONS, ul_debug("optmap hash failed, use sequential search"));
+	state = OPTMAP_HASH_FAILED;
+done:
+#ifdef __ATOMIC_RELEASE
+	__atomic_store_n(&oh->state, state, __ATOMIC_RELEASE);
+#endif
+	return state == OPTMAP_HASH_READY ? oh : NULL;
+}
+
+static inline int optmap_match_entry(const struct libmnt_optmap *ent,
+				     const char *name, size_t namelen)
+{
+	const char *p;
+
+	if (ent->mask & MNT_PREFIX)
+		return startswith(name, ent->name) != NULL;
+
+	if (strncmp(ent->name, name, namelen) != 0)
+		return 0;
+	p = ent->name + namelen;
+	return *p == '\0' || *p == '=' || *p == '[';
+}
+
+/*
+ * Returns the first entry (in the map order) which matches @name, the same
+ * as the sequential search.
+ */
+static const struct libmnt_optmap *optmap_hash_lookup(struct optmap_hash *oh,
+				const char *name, size_t namelen)
+{
+	const struct libmnt_optmap *ent = NULL;
+	uint32_t k;
+	size_t i;
+
+	k = optmap_hash(name, namelen, oh->seed) & oh->mask;
+	if (oh->slots[k]) {
+		const struct libmnt_optmap *x = &oh->map[oh->slots[k] - 1];
+
+		if (optmap_match_entry(x, name, namelen))
+			ent = x;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(oh->prefixes) && oh->prefixes[i]; i++) {
+		const struct libmnt_optmap *x = &oh->map[oh->prefixes[i] - 1];
+
+		if (ent && x > ent)
+			break;
+		if (optmap_match_entry(x, name, namelen))
+			return x;
+	}
+	return ent;
+}
+
 /**
  * mnt_get_builtin_map:
  * @id: map id -- MNT_LINUX_MAP or MNT_USERSPACE_MAP
@@ -243,21 +431,20 @@ const struct libmnt_optmap *mnt_optmap_get_entry(
 	for (i = 0; i < nmaps; i++) {
 		const struct libmnt_optmap *map = maps[i];
 		const struct libmnt_optmap *ent;
-		const char *p;
+		struct optmap_hash *oh = map ? get_optmap_hash(map) : NULL;
 
-		for (ent = map; ent && ent->name; ent++) {
-			if (ent->mask & MNT_PREFIX) {
-				if (startswith(name, ent->name)) {
-					if (mapent)
-						*mapent = ent;
-					return map;
-				}
-				continue;
+		if (oh) {
+			ent = optmap_hash_lookup(oh, name, namelen);
+			if (ent) {
+				if (mapent)
+					*mapent = ent;
+				return map;
 			}
-			if (strncmp(ent->name, name, namelen) != 0)
-				continue;
-			p = ent->name + namelen;
-			if (*p == '\0' || *p == '=' || *p == '[') {
+			continue;
+		}
+
+		for (ent = map; ent && ent->name; ent++) {
+			if (optmap_match_entry(ent, name, namelen)) {
 				if (mapent)
 					*mapent = ent;
 				return map;
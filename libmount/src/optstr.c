@@ -1047,6 +1047,126 @@ fail:
 	return rc;
 }
 
+/*
+ * Splits @optstr to the array of tokens, the tokens point to @optstr.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ */
+int __mnt_optstr_tokenize(const char *optstr,
+			  struct libmnt_optoken **toks, size_t *ntoks)
+{
+	struct libmnt_optoken *res = NULL;
+	char *str = (char *) optstr, *name, *val;
+	size_t namesz, valsz, n = 0, nalloc = 0;
+	int rc;
+
+	assert(optstr);
+	assert(toks);
+	assert(ntoks);
+
+	while ((rc = ul_optstr_next(&str, &name, &namesz, &val, &valsz)) == 0) {
+		if (n == nalloc) {
+			struct libmnt_optoken *x;
+
+			nalloc = nalloc ? nalloc * 2 : 8;
+			x = realloc(res, nalloc * sizeof(*res));
+			if (!x) {
+				rc = -ENOMEM;
+				break;
+			}
+			res = x;
+		}
+		res[n].name = name;
+		res[n].namesz = namesz;
+		res[n].value = val;
+		res[n].valsz = valsz;
+		n++;
+	}
+
+	if (rc < 0) {
+		free(res);
+		return rc;
+	}
+	*toks = res;
+	*ntoks = n;
+	return 0;
+}
+
+static int optoks_get_option(const struct libmnt_optoken *toks, size_t ntoks,
+			     const char *name, size_t namesz,
+			     char **value, size_t *valsz)
+{
+	size_t i;
+
+	for (i = 0; i < ntoks; i++) {
+		if (toks[i].namesz == namesz
+		    && strncmp(toks[i].name, name, namesz) == 0) {
+			*value = (char *) toks[i].value;
+			*valsz = toks[i].valsz;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* matches @optstr, or @toks if @use_toks is TRUE */
+static int match_options(const char *optstr, int use_toks,
+			 const struct libmnt_optoken *toks, size_t ntoks,
+			 const char *pattern)
+{
+	char *name, *pat = (char *) pattern;
+	char *buf = NULL, *patval;
+	size_t namesz = 0, patvalsz = 0;
+	int match = 1;
+
+	if (!use_toks) {
+		buf = malloc(strlen(pattern) + 1);
+		if (!buf)
+			return 0;
+	}
+
+	/* walk on pattern string
+	 */
+	while (match && !mnt_optstr_next_option(&pat, &name, &namesz,
+						&patval, &patvalsz)) {
+		char *val;
+		size_t sz;
+		int no = 0, rc;
+
+		if (*name == '+')
+			name++, namesz--;
+		else if ((no = (startswith(name, "no") != NULL)))
+			name += 2, namesz -= 2;
+
+		if (buf) {
+			xstrncpy(buf, name, namesz + 1);
+			rc = mnt_optstr_get_option(optstr, buf, &val, &sz);
+		} else
+			rc = optoks_get_option(toks, ntoks, name, namesz, &val, &sz);
+
+		/* check also value (if the pattern is "foo=value") */
+		if (rc == 0 && patvalsz > 0 &&
+		    (patvalsz != sz || strncmp(patval, val, sz) != 0))
+			rc = 1;
+
+		switch (rc) {
+		case 0:		/* found */
+			match = no == 0 ? 1 : 0;
+			break;
+		case 1:		/* not found */
+			match = no == 1 ? 1 : 0;
+			break;
+		default:	/* parse error */
+			match = 0;
+			break;
+		}
+
+	}
+
+	free(buf);
+	return match;
+}
+
 /**
  * mnt_match_options:
  * @optstr: options string
@@ -1079,60 +1199,386 @@ fail:
  */
 int mnt_match_options(const char *optstr, const char *pattern)
 {
-	char *name, *pat = (char *) pattern;
-	char *buf, *patval;
-	size_t namesz = 0, patvalsz = 0;
-	int match = 1;
-
 	if (!pattern && !optstr)
 		return 1;
 	if (!pattern)
 		return 0;
 
-	buf = malloc(strlen(pattern) + 1);
-	if (!buf)
+	return match_options(optstr, FALSE, NULL, 0, pattern);
+}
+
+/*
+ * The same as mnt_match_options(), but the options are already split to
+ * tokens by __mnt_optstr_tokenize().
+ */
+int __mnt_match_options_tokens(const struct libmnt_optoken *toks, size_t ntoks,
+			       const char *pattern)
+{
+	if (!pattern)
 		return 0;
+	return match_options(NULL, TRUE, toks, ntoks, pattern);
+}
 
-	/* walk on pattern string
-	 */
-	while (match && !mnt_optstr_next_option(&pat, &name, &namesz,
-						&patval, &patvalsz)) {
-		char *val;
-		size_t sz;
-		int no = 0, rc;
+/*
+ * Precompiled patterns, see mnt_new_optmatcher().
+ *
+ * The pattern is split to items only once, the names from the items are in a
+ * small open-addressing hash table. The options string is then walked only
+ * once for each filesystem and every option is looked up in the table, so the
+ * matching is linear to the length of the options string.
+ */
+enum {
+	MNT_OPTMATCHER_OPTIONS,
+	MNT_OPTMATCHER_FSTYPE
+};
+
+struct optmatcher_key {
+	const char	*name;
+	size_t		namesz;
+	int		result;		/* fstype: result if the type matches */
+};
+
+struct optmatcher_item {
+	size_t		key;		/* index to keys[] */
+	const char	*value;		/* "name=value" pattern */
+	size_t		valsz;
+	int		no;		/* "noname" pattern */
+};
+
+struct optmatcher_hit {
+	const char	*value;
+	size_t		valsz;
+	int		found;
+};
+
+struct libmnt_optmatcher {
+	int			refcount;
+	int			type;		/* MNT_OPTMATCHER_* */
+	int			no;		/* fstype: global "no" prefix */
+	char			*pattern;	/* keys point to this buffer */
+
+	struct optmatcher_key	*keys;
+	size_t			nkeys;
+
+	size_t			*slots;		/* hash, keys[] index + 1 or 0 */
+	size_t			nslots;		/* power of 2 */
+
+	struct optmatcher_item	*items;		/* options only */
+	size_t			nitems;
+};
+
+static size_t optmatcher_hash(const char *name, size_t namesz, int icase)
+{
+	size_t i, h = 2166136261U;
+
+	for (i = 0; i < namesz; i++) {
+		unsigned char c = (unsigned char) name[i];
+
+		h ^= icase ? (unsigned char) tolower(c) : c;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* returns index to keys[] or -1 */
+static ssize_t optmatcher_lookup(const struct libmnt_optmatcher *m,
+				 const char *name, size_t namesz)
+{
+	int icase = m->type == MNT_OPTMATCHER_FSTYPE;
+	size_t i = optmatcher_hash(name, namesz, icase) & (m->nslots - 1);
+
+	while (m->slots[i]) {
+		const struct optmatcher_key *k = &m->keys[m->slots[i] - 1];
+
+		if (k->namesz == namesz
+		    && (icase ? strncasecmp(k->name, name, namesz)
+			      : strncmp(k->name, name, namesz)) == 0)
+			return m->slots[i] - 1;
+		i = (i + 1) & (m->nslots - 1);
+	}
+	return -1;
+}
+
+/* adds the key if not in the matcher yet, returns index to keys[] */
+static ssize_t optmatcher_add_key(struct libmnt_optmatcher *m,
+				  const char *name, size_t namesz, int result)
+{
+	ssize_t k = optmatcher_lookup(m, name, namesz);
+	size_t i;
+
+	if (k >= 0)
+		return k;	/* the first item wins */
+
+	assert(m->nkeys < m->nslots / 2);
+
+	i = optmatcher_hash(name, namesz,
+			m->type == MNT_OPTMATCHER_FSTYPE) & (m->nslots - 1);
+	while (m->slots[i])
+		i = (i + 1) & (m->nslots - 1);
+
+	m->keys[m->nkeys].name = name;
+	m->keys[m->nkeys].namesz = namesz;
+	m->keys[m->nkeys].result = result;
+	m->slots[i] = ++m->nkeys;
+
+	return m->nkeys - 1;
+}
+
+static int optmatcher_compile_options(struct libmnt_optmatcher *m)
+{
+	char *p = m->pattern, *name, *val;
+	size_t namesz, valsz;
 
+	while (!mnt_optstr_next_option(&p, &name, &namesz, &val, &valsz)) {
+		struct optmatcher_item *it = &m->items[m->nitems++];
+
+		it->no = 0;
 		if (*name == '+')
 			name++, namesz--;
-		else if ((no = (startswith(name, "no") != NULL)))
+		else if ((it->no = (startswith(name, "no") != NULL)))
 			name += 2, namesz -= 2;
 
-		xstrncpy(buf, name, namesz + 1);
+		it->key = optmatcher_add_key(m, name, namesz, 0);
+		it->value = val;
+		it->valsz = valsz;
+	}
+	return 0;
+}
 
-		rc = mnt_optstr_get_option(optstr, buf, &val, &sz);
+/* see match_fstype(), the first item where the type matches wins */
+static int optmatcher_compile_fstype(struct libmnt_optmatcher *m)
+{
+	char *p = m->pattern;
 
-		/* check also value (if the pattern is "foo=value") */
-		if (rc == 0 && patvalsz > 0 &&
-		    (patvalsz != sz || strncmp(patval, val, sz) != 0))
-			rc = 1;
+	if (startswith(p, "no")) {
+		m->no = 1;
+		p += 2;
+	}
 
-		switch (rc) {
-		case 0:		/* found */
-			match = no == 0 ? 1 : 0;
-			break;
-		case 1:		/* not found */
-			match = no == 1 ? 1 : 0;
-			break;
-		default:	/* parse error */
-			match = 0;
-			break;
-		}
+	while (p) {
+		char *end = strchr(p, ',');
+		size_t sz = end ? (size_t) (end - p) : strlen(p);
+
+		if (startswith(p, "no") && sz >= 2)
+			optmatcher_add_key(m, p + 2, sz - 2, 0);
+		optmatcher_add_key(m, p, sz, !m->no);
+
+		p = end ? end + 1 : NULL;
+	}
+	return 0;
+}
+
+static struct libmnt_optmatcher *new_optmatcher(const char *pattern, int type)
+{
+	struct libmnt_optmatcher *m;
+	size_t nitems = 1;
+	const char *p;
 
+	if (!pattern) {
+		errno = EINVAL;
+		return NULL;
 	}
 
-	free(buf);
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+
+	m->refcount = 1;
+	m->type = type;
+	m->pattern = strdup(pattern);
+	if (!m->pattern)
+		goto fail;
+
+	/* upper limit, the commas could be also in quoted values */
+	for (p = pattern; *p; p++) {
+		if (*p == ',')
+			nitems++;
+	}
+	/* fstype items have two keys ("foo" and "nofoo" -> "foo") */
+	for (m->nslots = 8; m->nslots < 4 * nitems; m->nslots <<= 1);
+
+	m->keys = calloc(2 * nitems, sizeof(*m->keys));
+	m->slots = calloc(m->nslots, sizeof(*m->slots));
+	if (!m->keys || !m->slots)
+		goto fail;
+
+	if (type == MNT_OPTMATCHER_OPTIONS) {
+		m->items = calloc(nitems, sizeof(*m->items));
+		if (!m->items)
+			goto fail;
+		optmatcher_compile_options(m);
+	} else
+		optmatcher_compile_fstype(m);
+
+	DBG(OPTIONS, ul_debugobj(m, "new %s matcher '%s' [items=%zu, keys=%zu]",
+				type == MNT_OPTMATCHER_OPTIONS ? "options" : "fstype",
+				pattern, m->nitems, m->nkeys));
+	return m;
+fail:
+	mnt_unref_optmatcher(m);
+	errno = ENOMEM;
+	return NULL;
+}
+
+/**
+ * mnt_new_optmatcher:
+ * @pattern: comma delimited list of options
+ *
+ * Compiles the options @pattern for repeated matching by
+ * mnt_optmatcher_match() or mnt_fs_match_optmatcher(). The result is the same
+ * as for mnt_match_options(), but the pattern is parsed only once and every
+ * options string is walked only once, so it's useful to filter large tables.
+ *
+ * The matcher is never modified after the compilation, so it's possible to
+ * use it by more threads at the same time.
+ *
+ * Returns: new matcher or NULL in case of error (and errno is set).
+ *
+ * Since: 2.39
+ */
+struct libmnt_optmatcher *mnt_new_optmatcher(const char *pattern)
+{
+	return new_optmatcher(pattern, MNT_OPTMATCHER_OPTIONS);
+}
+
+/**
+ * mnt_new_fstype_matcher:
+ * @pattern: filesystem name or comma delimited list of names
+ *
+ * The same as mnt_new_optmatcher(), but for filesystem types patterns, see
+ * mnt_match_fstype().
+ *
+ * Returns: new matcher or NULL in case of error (and errno is set).
+ *
+ * Since: 2.39
+ */
+struct libmnt_optmatcher *mnt_new_fstype_matcher(const char *pattern)
+{
+	return new_optmatcher(pattern, MNT_OPTMATCHER_FSTYPE);
+}
+
+/**
+ * mnt_ref_optmatcher:
+ * @m: matcher pointer
+ *
+ * Increments reference counter.
+ *
+ * Since: 2.39
+ */
+void mnt_ref_optmatcher(struct libmnt_optmatcher *m)
+{
+	if (m)
+		m->refcount++;
+}
+
+/**
+ * mnt_unref_optmatcher:
+ * @m: matcher pointer
+ *
+ * De-increments reference counter, on zero the @m is automatically
+ * deallocated.
+ *
+ * Since: 2.39
+ */
+void mnt_unref_optmatcher(struct libmnt_optmatcher *m)
+{
+	if (m && --m->refcount <= 0) {
+		free(m->items);
+		free(m->slots);
+		free(m->keys);
+		free(m->pattern);
+		free(m);
+	}
+}
+
+int __mnt_optmatcher_is_fstype(const struct libmnt_optmatcher *m)
+{
+	return m->type == MNT_OPTMATCHER_FSTYPE;
+}
+
+static int optmatcher_match_options(const struct libmnt_optmatcher *m,
+				    const char *optstr)
+{
+	struct optmatcher_hit stackbuf[16], *hits = stackbuf;
+	char *str = (char *) optstr, *name, *val;
+	size_t namesz, valsz, i, nfound = 0;
+	int rc = -EINVAL, match = 1;
+
+	if (!m->nitems)
+		return 1;
+	if (m->nkeys > ARRAY_SIZE(stackbuf)) {
+		hits = calloc(m->nkeys, sizeof(*hits));
+		if (!hits)
+			return 0;
+	} else
+		memset(hits, 0, m->nkeys * sizeof(*hits));
+
+	/* the first instance of the option is used, as in mnt_optstr_get_option() */
+	while (str && nfound < m->nkeys
+	       && (rc = ul_optstr_next(&str, &name, &namesz, &val, &valsz)) == 0) {
+		ssize_t k = optmatcher_lookup(m, name, namesz);
+
+		if (k < 0 || hits[k].found)
+			continue;
+		hits[k].found = 1;
+		hits[k].value = val;
+		hits[k].valsz = valsz;
+		nfound++;
+	}
+
+	for (i = 0; match && i < m->nitems; i++) {
+		const struct optmatcher_item *it = &m->items[i];
+		const struct optmatcher_hit *hit = &hits[it->key];
+
+		if (hit->found) {
+			/* check also value (if the pattern is "foo=value") */
+			if (it->valsz > 0 &&
+			    (it->valsz != hit->valsz
+			     || strncmp(it->value, hit->value, it->valsz) != 0))
+				match = it->no;		/* not found */
+			else
+				match = !it->no;	/* found */
+		} else if (rc < 0)
+			match = 0;			/* parse error */
+		else
+			match = it->no;			/* not found */
+	}
+
+	if (hits != stackbuf)
+		free(hits);
 	return match;
 }
 
+static int optmatcher_match_fstype(const struct libmnt_optmatcher *m,
+				   const char *type)
+{
+	ssize_t k;
+
+	if (!type)
+		return m->no;
+
+	k = optmatcher_lookup(m, type, strlen(type));
+	return k >= 0 ? m->keys[k].result : m->no;
+}
+
+/**
+ * mnt_optmatcher_match:
+ * @m: matcher from mnt_new_optmatcher() or mnt_new_fstype_matcher()
+ * @str: options string or filesystem type
+ *
+ * Returns: 1 if @str is matching, else 0.
+ *
+ * Since: 2.39
+ */
+int mnt_optmatcher_match(struct libmnt_optmatcher *m, const char *str)
+{
+	if (!m)
+		return 0;
+	if (m->type == MNT_OPTMATCHER_FSTYPE)
+		return optmatcher_match_fstype(m, str);
+	return optmatcher_match_options(m, str);
+}
+
 #ifdef TEST_PROGRAM
 #include "xalloc.h"
 
@@ -1202,6 +1648,33 @@ static int test_split(struct libmnt_test *ts, int argc, char *argv[])
 	return rc;
 }
 
+static int test_lookup(struct libmnt_test *ts, int argc, char *argv[])
+{
+	const struct libmnt_optmap *maps[2];
+	int i;
+
+	if (argc < 2)
+		return -EINVAL;
+
+	maps[0] = mnt_get_builtin_optmap(MNT_LINUX_MAP);
+	maps[1] = mnt_get_builtin_optmap(MNT_USERSPACE_MAP);
+
+	for (i = 1; i < argc; i++) {
+		const struct libmnt_optmap *map, *ent = NULL;
+		const char *name = argv[i];
+		size_t namesz = strcspn(name, "=");
+
+		map = mnt_optmap_get_entry(maps, 2, name, namesz, &ent);
+		if (!map || !ent)
+			printf("%-20s not found\n", name);
+		else
+			printf("%-20s %-10s %-20s id=0x%08x mask=0x%02x\n", name,
+				map == maps[0] ? "linux" : "userspace",
+				ent->name, ent->id, ent->mask);
+	}
+	return 0;
+}
+
 static int test_flags(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char *optstr;
@@ -1344,6 +1817,35 @@ static int test_dedup(struct libmnt_test *ts, int argc, char *argv[])
 	return rc;
 }
 
+/* compares the matcher with mnt_match_options() and mnt_match_fstype() */
+static int test_matcher(struct libmnt_test *ts, int argc, char *argv[])
+{
+	int fstype = strcmp(argv[0], "--match-fstype") == 0;
+	int i;
+
+	if (argc < 3)
+		return -EINVAL;
+
+	for (i = 2; i < argc; i++) {
+		struct libmnt_optmatcher *m;
+		int res, exp;
+
+		m = fstype ? mnt_new_fstype_matcher(argv[i]) :
+			     mnt_new_optmatcher(argv[i]);
+		if (!m)
+			return -errno;
+
+		res = mnt_optmatcher_match(m, argv[1]);
+		exp = fstype ? mnt_match_fstype(argv[1], argv[i]) :
+			       mnt_match_options(argv[1], argv[i]);
+
+		printf("%-20s %s%s\n", argv[i], res ? "MATCH" : "NOT-MATCH",
+				res == exp ? "" : " (DIFFERENT)");
+		mnt_unref_optmatcher(m);
+	}
+	return 0;
+}
+
 static int test_fix(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char *optstr;
@@ -1390,8 +1892,11 @@ int main(int argc, char *argv[])
 		{ "--dedup",  test_dedup,  "<optstr> <name>            deduplicate name in optstr" },
 		{ "--split",  test_split,  "<optstr>                   split into FS, VFS and userspace" },
 		{ "--flags",  test_flags,  "<optstr>                   convert options to MS_* flags" },
+		{ "--lookup", test_lookup, "<name> [...]               search names in built-in maps" },
 		{ "--apply",  test_apply,  "--{linux,user} <optstr> <mask>    apply mask to optstr" },
 		{ "--fix",    test_fix,    "<optstr>                   fix uid=, gid=, user, and context=" },
+		{ "--match",  test_matcher,"<optstr> <pattern> [...]   match optstr by compiled patterns" },
+		{ "--match-fstype", test_matcher, "<type> <pattern> [...] match type by compiled patterns" },
 
 		{ NULL }
 	};
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * String pool for the zero-copy parser. The pool owns the file buffers (the
+ * parser keeps fields as slices of the buffers) and an arena with interned
+ * strings and (for mnt_table_enable_arena()) libmnt_fs entries. The pool is
+ * reference counted, every libmnt_fs with a string from the pool or
+ * allocated in the pool holds a reference, see __mnt_fs_unshare().
+ */
+#include "mountP.h"
+
+#define STRPOOL_CHUNKSZ		(16 * 1024)
+#define STRPOOL_MINSLOTS	256
+#define STRPOOL_ALIGN		16
+
+struct strpool_chunk {
+	struct strpool_chunk	*next;
+	size_t			used;
+	size_t			size;
+	char			data[] __attribute__((aligned(STRPOOL_ALIGN)));
+};
+
+struct libmnt_strpool {
+	int			refcount;
+
+	char			**bufs;		/* file buffers */
+	size_t			nbufs;
+
+	struct strpool_chunk	*chunks;	/* arena for interned strings */
+
+	const char		**slots;	/* open addressing hash */
+	size_t			nslots;		/* power of two */
+	size_t			nstrs;
+};
+
+struct libmnt_strpool *__mnt_new_strpool(void)
+{
+	struct libmnt_strpool *pool = calloc(1, sizeof(*pool));
+
+	if (!pool)
+		return NULL;
+	pool->refcount = 1;
+	DBG(TAB, ul_debugobj(pool, "strpool alloc"));
+	return pool;
+}
+
+static void free_strpool(struct libmnt_strpool *pool)
+{
+	size_t i;
+
+	DBG(TAB, ul_debugobj(pool, "strpool free [buffers=%zu, strings=%zu]",
+				pool->nbufs, pool->nstrs));
+
+	for (i = 0; i < pool->nbufs; i++)
+		free(pool->bufs[i]);
+	free(pool->bufs);
+
+	while (pool->chunks) {
+		struct strpool_chunk *ch = pool->chunks;
+
+		pool->chunks = ch->next;
+		free(ch);
+	}
+	free(pool->slots);
+	free(pool);
+}
+
+void __mnt_ref_strpool(struct libmnt_strpool *pool)
+{
+	if (pool)
+		pool->refcount++;
+}
+
+void __mnt_unref_strpool(struct libmnt_strpool *pool)
+{
+	if (pool) {
+		pool->refcount--;
+		if (pool->refcount <= 0)
+			free_strpool(pool);
+	}
+}
+
+/*
+ * Adds @buf to the pool; the pool takes over the buffer (also on error).
+ */
+int __mnt_strpool_add_buffer(struct libmnt_strpool *pool, char *buf)
+{
+	char **x;
+
+	assert(pool);
+
+	x = realloc(pool->bufs, (pool->nbufs + 1) * sizeof(char *));
+	if (!x) {
+		free(buf);
+		return -ENOMEM;
+	}
+	pool->bufs = x;
+	pool->bufs[pool->nbufs++] = buf;
+	return 0;
+}
+
+static uint32_t strpool_hash(const char *str)
+{
+	uint32_t h = 2166136261U;
+
+	for (; *str; str++)
+		h = (h ^ (unsigned char) *str) * 16777619U;
+	return h;
+}
+
+static int strpool_grow(struct libmnt_strpool *pool)
+{
+	size_t i, nslots = pool->nslots ? pool->nslots << 1 : STRPOOL_MINSLOTS;
+	const char **slots = calloc(nslots, sizeof(char *));
+
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < pool->nslots; i++) {
+		const char *str = pool->slots[i];
+		size_t k;
+
+		if (!str)
+			continue;
+		k = strpool_hash(str) & (nslots - 1);
+		while (slots[k])
+			k = (k + 1) & (nslots - 1);
+		slots[k] = str;
+	}
+
+	free(pool->slots);
+	pool->slots = slots;
+	pool->nslots = nslots;
+	return 0;
+}
+
+static char *strpool_alloc(struct libmnt_strpool *pool, size_t sz)
+{
+	struct strpool_chunk *ch = pool->chunks;
+
+	if (!ch || ch->size - ch->used < sz) {
+		size_t chsz = sz > STRPOOL_CHUNKSZ ? sz : STRPOOL_CHUNKSZ;
+
+		ch = malloc(sizeof(*ch) + chsz);
+		if (!ch)
+			return NULL;
+		ch->size = chsz;
+		ch->used = 0;
+		ch->next = pool->chunks;
+		pool->chunks = ch;
+	}
+
+	ch->used += sz;
+	return ch->data + ch->used - sz;
+}
+
+/*
+ * Allocates zeroized aligned memory for an object (e.g. struct libmnt_fs).
+ * The memory is deallocated together with the pool.
+ */
+void *__mnt_strpool_alloc(struct libmnt_strpool *pool, size_t sz)
+{
+	struct strpool_chunk *ch;
+	size_t pad;
+	char *p;
+
+	assert(pool);
+
+	ch = pool->chunks;
+	pad = ch ? (STRPOOL_ALIGN - ch->used % STRPOOL_ALIGN) % STRPOOL_ALIGN : 0;
+
+	if (ch && ch->size - ch->used >= sz + pad)
+		ch->used += pad;
+
+	p = strpool_alloc(pool, sz);
+	if (p)
+		memset(p, 0, sz);
+	return p;
+}
+
+/*
+ * Returns: pointer to the pool copy of @str or NULL in case of error. The
+ *          string is valid as long as the pool exists.
+ */
+const char *__mnt_strpool_intern(struct libmnt_strpool *pool, const char *str)
+{
+	size_t k, sz;
+	char *p;
+
+	assert(pool);
+
+	if (!str)
+		return NULL;
+
+	/* keep load factor below 3/4 */
+	if ((pool->nstrs + 1) * 4 > pool->nslots * 3 && strpool_grow(pool))
+		return NULL;
+
+	k = strpool_hash(str) & (pool->nslots - 1);
+	while (pool->slots[k]) {
+		if (strcmp(pool->slots[k], str) == 0)
+			return pool->slots[k];
+		k = (k + 1) & (pool->nslots - 1);
+	}
+
+	sz = strlen(str) + 1;
+	p = strpool_alloc(pool, sz);
+	if (!p)
+		return NULL;
+	memcpy(p, str, sz);
+
+	pool->slots[k] = p;
+	pool->nstrs++;
+	return p;
+}
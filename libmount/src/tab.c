@@ -116,6 +116,9 @@ int mnt_reset_table(struct libmnt_table *tb)
 	}
 
 	tb->nents = 0;
+
+	__mnt_unref_strpool(tb->strpool);
+	tb->strpool = NULL;
 	return 0;
 }
 
@@ -271,6 +274,59 @@ int mnt_table_with_comments(struct libmnt_table *tb)
 	return tb ? tb->comms : 0;
 }
 
+/**
+ * mnt_table_enable_zerocopy:
+ * @tb: pointer to table
+ * @enable: TRUE or FALSE
+ *
+ * Enables the zero-copy parser for mountinfo and fstab files. The parser reads
+ * the whole file to one buffer and the filesystem entries point to the buffer,
+ * the repeated strings (e.g. mount options) are shared by all entries in the
+ * table. The parser is not used if comments parsing is enabled.
+ *
+ * The buffer is deallocated when the last entry is deallocated, the entry
+ * makes a private copy of the strings before it is modified. It means that
+ * entries which survive the table (e.g. referenced by the application) keep
+ * the whole buffer in memory.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_enable_zerocopy(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->zerocopy = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * mnt_table_enable_arena:
+ * @tb: pointer to table
+ * @enable: TRUE or FALSE
+ *
+ * Enables allocation of the parsed filesystem entries from a table-scoped
+ * memory pool. The arena implies the zero-copy parser, see
+ * mnt_table_enable_zerocopy(). It makes parsing and deallocation of large
+ * tables cheaper, mostly useful for parse-then-discard use cases.
+ *
+ * The pool is deallocated when all its entries are deallocated, so it's still
+ * safe to keep a reference to an entry after the table is deallocated (see
+ * mnt_ref_fs()), but such entry keeps the whole pool in memory.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_enable_arena(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->arena = enable ? 1 : 0;
+	return 0;
+}
+
 /**
  * mnt_table_get_intro_comment:
  * @tb: pointer to tab
@@ -452,6 +508,7 @@ int mnt_table_add_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 	list_add_tail(&fs->ents, &tb->ents);
 	fs->tab = tb;
 	tb->nents++;
+	__mnt_table_drop_index(tb);
 
 	DBG(TAB, ul_debugobj(tb, "add entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -471,6 +528,7 @@ static int __table_insert_fs(
 
 	fs->tab = tb;
 	tb->nents++;
+	__mnt_table_drop_index(tb);
 
 	DBG(TAB, ul_debugobj(tb, "insert entry: %s %s",
 			mnt_fs_get_source(fs), mnt_fs_get_target(fs)));
@@ -542,6 +600,7 @@ int mnt_table_move_fs(struct libmnt_table *src, struct libmnt_table *dst,
 	/* remove from source */
 	list_del_init(&fs->ents);
 	src->nents--;
+	__mnt_table_drop_index(src);
 
 	/* insert to the destination */
 	return __table_insert_fs(dst, before, pos, fs);
@@ -569,15 +628,26 @@ int mnt_table_remove_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 
 	mnt_unref_fs(fs);
 	tb->nents--;
+	__mnt_table_drop_index(tb);
 	return 0;
 }
 
 static inline struct libmnt_fs *get_parent_fs(struct libmnt_table *tb, struct libmnt_fs *fs)
 {
+	struct libmnt_tabidx_iter it;
 	struct libmnt_iter itr;
 	struct libmnt_fs *x;
 	int parent_id = mnt_fs_get_parent_id(fs);
 
+	if (__mnt_table_index_init(tb, MNT_TABIDX_ID,
+				__mnt_tabidx_hash_num(parent_id), &it) == 0) {
+		while ((x = __mnt_table_index_next(tb, &it))) {
+			if (mnt_fs_get_id(x) == parent_id)
+				return x;
+		}
+		return NULL;
+	}
+
 	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
 	while (mnt_table_next_fs(tb, &itr, &x) == 0) {
 		if (mnt_fs_get_id(x) == parent_id)
@@ -642,6 +712,32 @@ int mnt_table_get_root_fs(struct libmnt_table *tb, struct libmnt_fs **root)
 	return *root ? 0 : -EINVAL;
 }
 
+/**
+ * mnt_table_build_tree:
+ * @tb: mountinfo file (/proc/self/mountinfo)
+ *
+ * Builds the parent->children relations of the table entries, so
+ * mnt_table_next_child_fs() does not have to walk the whole table for each
+ * call. The tree is built automatically by mnt_table_next_child_fs() for
+ * larger tables; this function allows to build it in advance (also for small
+ * tables) and to detect errors. The tree is dropped when the table is
+ * modified.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_build_tree(struct libmnt_table *tb)
+{
+	int rc;
+
+	if (!tb || !is_mountinfo(tb))
+		return -EINVAL;
+
+	rc = __mnt_table_build_tree(tb, 1);
+	return rc < 0 ? rc : 0;
+}
+
 /**
  * mnt_table_next_child_fs:
  * @tb: mountinfo file (/proc/self/mountinfo)
@@ -652,6 +748,9 @@ int mnt_table_get_root_fs(struct libmnt_table *tb, struct libmnt_fs **root)
  * Note that filesystems are returned in the order of mounting (according to
  * IDs in /proc/self/mountinfo).
  *
+ * The mount tree (see mnt_table_build_tree()) is built on the first call
+ * for larger tables.
+ *
  * Returns: 0 on success, negative number in case of error or 1 at the end of list.
  */
 int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
@@ -676,6 +775,11 @@ int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 
 	*chld = NULL;
 
+	if (__mnt_table_build_tree(tb, 0) == 0) {
+		*chld = __mnt_table_tree_next_child(tb, parent_id, lastchld_id);
+		goto done;
+	}
+
 	mnt_reset_iter(itr, MNT_ITER_FORWARD);
 	while(mnt_table_next_fs(tb, itr, &fs) == 0) {
 		int id;
@@ -696,7 +800,7 @@ int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 			chld_id = id;
 		}
 	}
-
+done:
 	if (!*chld)
 		return 1;	/* end of iterator */
 
@@ -734,9 +838,10 @@ int mnt_table_next_child_fs(struct libmnt_table *tb, struct libmnt_iter *itr,
 int mnt_table_over_fs(struct libmnt_table *tb, struct libmnt_fs *parent,
 		      struct libmnt_fs **child)
 {
+	struct libmnt_tabidx_iter it;
 	struct libmnt_iter itr;
 	struct libmnt_fs *fs = NULL;
-	int id;
+	int id, use_idx;
 	const char *tgt;
 
 	if (!tb || !parent || !is_mountinfo(tb))
@@ -749,7 +854,11 @@ int mnt_table_over_fs(struct libmnt_table *tb, struct libmnt_fs *parent,
 	id = mnt_fs_get_id(parent);
 	tgt = mnt_fs_get_target(parent);
 
-	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+	use_idx = __mnt_table_index_init(tb, MNT_TABIDX_PARENT,
+				__mnt_tabidx_hash_num(id), &it) == 0;
+
+	while (use_idx ? (fs = __mnt_table_index_next(tb, &it)) != NULL :
+			 mnt_table_next_fs(tb, &itr, &fs) == 0) {
 		if (mnt_fs_get_parent_id(fs) == id &&
 		    mnt_fs_streq_target(fs, tgt) == 1) {
 			if (child)
@@ -888,6 +997,7 @@ static int mnt_table_move_parent(struct libmnt_table *tb, int oldid, int newid)
 		if (fs->parent == oldid)
 			fs->parent = newid;
 	}
+	__mnt_table_drop_index(tb);
 	return 0;
 }
 
@@ -1048,6 +1158,33 @@ struct libmnt_fs *mnt_table_find_mountpoint(struct libmnt_table *tb,
  *
  * Returns: a tab entry or NULL.
  */
+static struct libmnt_fs *find_target(struct libmnt_table *tb, const char *path, int direction)
+{
+	struct libmnt_tabidx_iter it;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs = NULL, *res = NULL;
+
+	if (__mnt_table_index_init(tb, MNT_TABIDX_TARGET,
+				__mnt_tabidx_hash_path(path), &it) == 0) {
+		/* the index is in the table order, backward means the last one */
+		while ((fs = __mnt_table_index_next(tb, &it))) {
+			if (!mnt_fs_streq_target(fs, path))
+				continue;
+			res = fs;
+			if (direction == MNT_ITER_FORWARD)
+				break;
+		}
+		return res;
+	}
+
+	mnt_reset_iter(&itr, direction);
+	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (mnt_fs_streq_target(fs, path))
+			return fs;
+	}
+	return NULL;
+}
+
 struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *path, int direction)
 {
 	struct libmnt_iter itr;
@@ -1062,23 +1199,17 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	DBG(TAB, ul_debugobj(tb, "lookup TARGET: '%s'", path));
 
 	/* native @target */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, path))
-			return fs;
-	}
+	fs = find_target(tb, path, direction);
+	if (fs)
+		return fs;
 
 	/* try absolute path */
 	if (is_relative_path(path) && (cn = absolute_path(path))) {
 		DBG(TAB, ul_debugobj(tb, "lookup absolute TARGET: '%s'", cn));
-		mnt_reset_iter(&itr, direction);
-		while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_target(fs, cn)) {
-				free(cn);
-				return fs;
-			}
-		}
+		fs = find_target(tb, cn, direction);
 		free(cn);
+		if (fs)
+			return fs;
 	}
 
 	if (!tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
@@ -1087,11 +1218,9 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	DBG(TAB, ul_debugobj(tb, "lookup canonical TARGET: '%s'", cn));
 
 	/* canonicalized paths in struct libmnt_table */
-	mnt_reset_iter(&itr, direction);
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (mnt_fs_streq_target(fs, cn))
-			return fs;
-	}
+	fs = find_target(tb, cn, direction);
+	if (fs)
+		return fs;
 
 	/* non-canonical path in struct libmnt_table
 	 * -- note that mountpoint in /proc/self/mountinfo is already
@@ -1115,6 +1244,78 @@ struct libmnt_fs *mnt_table_find_target(struct libmnt_table *tb, const char *pat
 	return NULL;
 }
 
+/*
+ * Returns 1 if @fs source path is @path. For btrfs (if @subvol is set) only
+ * the default subvolume matches.
+ */
+static int match_srcpath(struct libmnt_table *tb,
+			 struct libmnt_fs *fs, const char *path,
+			 int subvol __attribute__((__unused__)))
+{
+	if (!mnt_fs_streq_srcpath(fs, path))
+		return 0;
+#ifdef HAVE_BTRFS_SUPPORT
+	if (subvol && fs->fstype && !strcmp(fs->fstype, "btrfs")) {
+		uint64_t default_id = __mnt_cache_get_btrfs_default(tb->cache,
+						path, mnt_fs_get_target(fs));
+		char *val;
+		size_t len;
+
+		if (default_id == UINT64_MAX)
+			DBG(TAB, ul_debug("not found btrfs volume setting"));
+
+		else if (mnt_fs_get_option(fs, "subvolid", &val, &len) == 0) {
+			uint64_t subvol_id;
+
+			if (mnt_parse_offset(val, len, &subvol_id)) {
+				DBG(TAB, ul_debugobj(tb, "failed to parse subvolid="));
+				return 0;
+			}
+			if (subvol_id != default_id)
+				return 0;
+		}
+	}
+#endif /* HAVE_BTRFS_SUPPORT */
+	return 1;
+}
+
+/* @ntags returns number of entries with source TAG (optional) */
+static struct libmnt_fs *find_srcpath(struct libmnt_table *tb, const char *path,
+				      int direction, int subvol, int *ntags)
+{
+	struct libmnt_tabidx_iter it;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs = NULL, *res = NULL;
+
+	if (__mnt_table_index_init(tb, MNT_TABIDX_SRCPATH,
+				__mnt_tabidx_hash_path(path), &it) == 0) {
+		if (ntags)
+			*ntags = __mnt_table_index_ntags(tb);
+
+		/* the index is in the table order, backward means the last one */
+		while ((fs = __mnt_table_index_next(tb, &it))) {
+			if (!match_srcpath(tb, fs, path, subvol))
+				continue;
+			res = fs;
+			if (direction == MNT_ITER_FORWARD)
+				break;
+		}
+		return res;
+	}
+
+	if (ntags)
+		*ntags = 0;
+
+	mnt_reset_iter(&itr, direction);
+	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (match_srcpath(tb, fs, path, subvol))
+			return fs;
+		if (ntags && mnt_fs_get_tag(fs, NULL, NULL) == 0)
+			(*ntags)++;
+	}
+	return NULL;
+}
+
 /**
  * mnt_table_find_srcpath:
  * @tb: tab pointer
@@ -1151,37 +1352,9 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 	DBG(TAB, ul_debugobj(tb, "lookup SRCPATH: '%s'", path));
 
 	/* native paths */
-	mnt_reset_iter(&itr, direction);
-
-	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-
-		if (mnt_fs_streq_srcpath(fs, path)) {
-#ifdef HAVE_BTRFS_SUPPORT
-			if (fs->fstype && !strcmp(fs->fstype, "btrfs")) {
-				uint64_t default_id = btrfs_get_default_subvol_id(mnt_fs_get_target(fs));
-				char *val;
-				size_t len;
-
-				if (default_id == UINT64_MAX)
-					DBG(TAB, ul_debug("not found btrfs volume setting"));
-
-				else if (mnt_fs_get_option(fs, "subvolid", &val, &len) == 0) {
-					uint64_t subvol_id;
-
-					if (mnt_parse_offset(val, len, &subvol_id)) {
-						DBG(TAB, ul_debugobj(tb, "failed to parse subvolid="));
-						continue;
-					}
-					if (subvol_id != default_id)
-						continue;
-				}
-			}
-#endif /* HAVE_BTRFS_SUPPORT */
-			return fs;
-		}
-		if (mnt_fs_get_tag(fs, NULL, NULL) == 0)
-			ntags++;
-	}
+	fs = find_srcpath(tb, path, direction, 1, &ntags);
+	if (fs)
+		return fs;
 
 	if (!path || !tb->cache || !(cn = mnt_resolve_path(path, tb->cache)))
 		return NULL;
@@ -1192,11 +1365,9 @@ struct libmnt_fs *mnt_table_find_srcpath(struct libmnt_table *tb, const char *pa
 
 	/* canonicalized paths in struct libmnt_table */
 	if (ntags < nents) {
-		mnt_reset_iter(&itr, direction);
-		while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-			if (mnt_fs_streq_srcpath(fs, cn))
-				return fs;
-		}
+		fs = find_srcpath(tb, cn, direction, 0, NULL);
+		if (fs)
+			return fs;
 	}
 
 	/* evaluated tag */
@@ -1283,9 +1454,9 @@ struct libmnt_fs *mnt_table_find_tag(struct libmnt_table *tb, const char *tag,
 	/* look up by TAG */
 	mnt_reset_iter(&itr, direction);
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
-		if (fs->tagname && fs->tagval &&
-		    strcmp(fs->tagname, tag) == 0 &&
-		    strcmp(fs->tagval, val) == 0)
+		if (mnt_fs_ext(fs, tagname) && fs->ext->tagval &&
+		    strcmp(fs->ext->tagname, tag) == 0 &&
+		    strcmp(fs->ext->tagval, val) == 0)
 			return fs;
 	}
 
@@ -1318,6 +1489,7 @@ struct libmnt_fs *mnt_table_find_target_with_option(
 			struct libmnt_table *tb, const char *path,
 			const char *option, const char *val, int direction)
 {
+	struct libmnt_tabidx_iter it;
 	struct libmnt_iter itr;
 	struct libmnt_fs *fs = NULL;
 	char *optval = NULL;
@@ -1330,6 +1502,24 @@ struct libmnt_fs *mnt_table_find_target_with_option(
 
 	DBG(TAB, ul_debugobj(tb, "lookup TARGET: '%s' with OPTION %s %s", path, option, val));
 
+	if (__mnt_table_index_init(tb, MNT_TABIDX_TARGET,
+				__mnt_tabidx_hash_path(path), &it) == 0) {
+		struct libmnt_fs *res = NULL;
+
+		/* the index is in the table order, backward means the last one */
+		while ((fs = __mnt_table_index_next(tb, &it))) {
+			if (!mnt_fs_streq_target(fs, path)
+			    || mnt_fs_get_option(fs, option, &optval, &optvalsz) != 0
+			    || optvalsz != valsz
+			    || strncmp(optval, val, optvalsz) != 0)
+				continue;
+			res = fs;
+			if (direction == MNT_ITER_FORWARD)
+				break;
+		}
+		return res;
+	}
+
 	/* look up by native @target with OPTION */
 	mnt_reset_iter(&itr, direction);
 	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
@@ -1429,6 +1619,7 @@ struct libmnt_fs *mnt_table_find_pair(struct libmnt_table *tb, const char *sourc
 struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 				       dev_t devno, int direction)
 {
+	struct libmnt_tabidx_iter it;
 	struct libmnt_fs *fs = NULL;
 	struct libmnt_iter itr;
 
@@ -1439,6 +1630,20 @@ struct libmnt_fs *mnt_table_find_devno(struct libmnt_table *tb,
 
 	DBG(TAB, ul_debugobj(tb, "lookup DEVNO: %d", (int) devno));
 
+	if (__mnt_table_index_init(tb, MNT_TABIDX_DEVNO,
+				__mnt_tabidx_hash_num(devno), &it) == 0) {
+		struct libmnt_fs *res = NULL;
+
+		while ((fs = __mnt_table_index_next(tb, &it))) {
+			if (mnt_fs_get_devno(fs) != devno)
+				continue;
+			res = fs;
+			if (direction == MNT_ITER_FORWARD)
+				break;
+		}
+		return res;
+	}
+
 	mnt_reset_iter(&itr, direction);
 
 	while(mnt_table_next_fs(tb, &itr, &fs) == 0) {
@@ -1514,9 +1719,26 @@ static int get_btrfs_fs_root(struct libmnt_table *tb, struct libmnt_fs *fs, char
 
 		DBG(BTRFS, ul_debug(" subvolid/subvol not found, checking default"));
 
-		default_id = btrfs_get_default_subvol_id(mnt_fs_get_target(fs));
-		if (default_id == UINT64_MAX)
+		target = mnt_resolve_target(mnt_fs_get_target(fs), tb->cache);
+		if (!target)
+			goto err;
+
+		/* The default is per filesystem, use the mounted source to
+		 * read it only once for all the mountpoints.
+		 */
+		f = mnt_table_find_target(tb, target, MNT_ITER_BACKWARD);
+		if (f && f->fstype && strcmp(f->fstype, "btrfs") == 0)
+			default_id = __mnt_cache_get_btrfs_default(tb->cache,
+						mnt_fs_get_srcpath(f),
+						mnt_fs_get_target(fs));
+		else
+			default_id = UINT64_MAX;
+
+		if (default_id == UINT64_MAX) {
+			if (!tb->cache)
+				free(target);
 			goto not_found;
+		}
 
 		/* Volume has default subvolume. Check if it matches to
 		 * the one in mountinfo.
@@ -1525,9 +1747,6 @@ static int get_btrfs_fs_root(struct libmnt_table *tb, struct libmnt_fs *fs, char
 		 * kernels, there is no reasonable way to detect which
 		 * subvolume was mounted.
 		 */
-		target = mnt_resolve_target(mnt_fs_get_target(fs), tb->cache);
-		if (!target)
-			goto err;
 
 		snprintf(default_id_str, sizeof(default_id_str), "%llu",
 				(unsigned long long int) default_id);
@@ -1909,7 +2128,8 @@ static int parser_errcb(struct libmnt_table *tb, const char *filename, int line)
 	return 1;	/* all errors are recoverable -- this is the default */
 }
 
-static struct libmnt_table *create_table(const char *file, int comments)
+static struct libmnt_table *create_table(const char *file, int comments,
+					 int zerocopy, int arena)
 {
 	struct libmnt_table *tb;
 
@@ -1920,6 +2140,8 @@ static struct libmnt_table *create_table(const char *file, int comments)
 		goto err;
 
 	mnt_table_enable_comments(tb, comments);
+	mnt_table_enable_zerocopy(tb, zerocopy);
+	mnt_table_enable_arena(tb, arena);
 	mnt_table_set_parser_errcb(tb, parser_errcb);
 
 	if (mnt_table_parse_file(tb, file) != 0)
@@ -1937,7 +2159,7 @@ static int test_copy_fs(struct libmnt_test *ts, int argc, char *argv[])
 	struct libmnt_fs *fs;
 	int rc = -1;
 
-	tb = create_table(argv[1], FALSE);
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!tb)
 		return -1;
 
@@ -1967,12 +2189,16 @@ static int test_parse(struct libmnt_test *ts, int argc, char *argv[])
 	struct libmnt_iter *itr = NULL;
 	struct libmnt_fs *fs;
 	int rc = -1;
-	int parse_comments = FALSE;
+	int parse_comments = FALSE, zerocopy = FALSE, arena = FALSE;
 
 	if (argc == 3 && !strcmp(argv[2], "--comments"))
 		parse_comments = TRUE;
+	else if (argc == 3 && !strcmp(argv[2], "--zerocopy"))
+		zerocopy = TRUE;
+	else if (argc == 3 && !strcmp(argv[2], "--arena"))
+		arena = TRUE;
 
-	tb = create_table(argv[1], parse_comments);
+	tb = create_table(argv[1], parse_comments, zerocopy, arena);
 	if (!tb)
 		return -1;
 
@@ -2012,7 +2238,7 @@ static int test_find_idx(struct libmnt_test *ts, int argc, char *argv[])
 
 	file = argv[1], what = argv[2];
 
-	tb = create_table(file, FALSE);
+	tb = create_table(file, FALSE, FALSE, FALSE);
 	if (!tb)
 		goto done;
 
@@ -2057,7 +2283,7 @@ static int test_find(struct libmnt_test *ts, int argc, char *argv[], int dr)
 
 	file = argv[1], find = argv[2], what = argv[3];
 
-	tb = create_table(file, FALSE);
+	tb = create_table(file, FALSE, FALSE, FALSE);
 	if (!tb)
 		goto done;
 
@@ -2101,7 +2327,7 @@ static int test_find_pair(struct libmnt_test *ts, int argc, char *argv[])
 	struct libmnt_cache *mpc = NULL;
 	int rc = -1;
 
-	tb = create_table(argv[1], FALSE);
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!tb)
 		return -1;
 	mpc = mnt_new_cache();
@@ -2161,7 +2387,7 @@ static int test_is_mounted(struct libmnt_test *ts, int argc, char *argv[])
 		return -1;
 	}
 
-	fstab = create_table(argv[1], FALSE);
+	fstab = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!fstab)
 		goto done;
 
@@ -2214,7 +2440,7 @@ static int test_uniq(struct libmnt_test *ts, int argc, char *argv[])
 		return -EINVAL;
 	}
 
-	tb = create_table(argv[1], FALSE);
+	tb = create_table(argv[1], FALSE, FALSE, FALSE);
 	if (!tb)
 		goto done;
 
@@ -2237,7 +2463,7 @@ done:
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
-	{ "--parse",    test_parse,        "<file> [--comments] parse and print tab" },
+	{ "--parse",    test_parse,        "<file> [--comments|--zerocopy|--arena] parse and print tab" },
 	{ "--find-forward",  test_find_fw, "<file> <source|target> <string>" },
 	{ "--find-backward", test_find_bw, "<file> <source|target> <string>" },
 	{ "--uniq-target",   test_uniq,    "<file>" },
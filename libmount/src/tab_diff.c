@@ -150,8 +150,8 @@ static int tabdiff_reset(struct libmnt_tabdiff *df)
 	return 0;
 }
 
-static int tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
-			     struct libmnt_fs *new, int oper)
+int __mnt_tabdiff_add_entry(struct libmnt_tabdiff *df, struct libmnt_fs *old,
+			    struct libmnt_fs *new, int oper)
 {
 	struct tabdiff_entry *de;
 
@@ -251,12 +251,12 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 	/* all mounted or umounted */
 	if (!no && nn) {
 		while(mnt_table_next_fs(new_tab, &itr, &fs) == 0)
-			tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
+			__mnt_tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
 		goto done;
 
 	} else if (no && !nn) {
 		while(mnt_table_next_fs(old_tab, &itr, &fs) == 0)
-			tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
+			__mnt_tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
 		goto done;
 	}
 
@@ -269,7 +269,7 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 		o_fs = mnt_table_find_pair(old_tab, src, tgt, MNT_ITER_FORWARD);
 		if (!o_fs)
 			/* 'fs' is not in the old table -- so newly mounted */
-			tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
+			__mnt_tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
 		else {
 			/* is modified? */
 			const char *v1 = mnt_fs_get_vfs_options(o_fs),
@@ -278,7 +278,7 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 				   *f2 = mnt_fs_get_fs_options(fs);
 
 			if ((v1 && v2 && strcmp(v1, v2) != 0) || (f1 && f2 && strcmp(f1, f2) != 0))
-				tabdiff_add_entry(df, o_fs, fs, MNT_TABDIFF_REMOUNT);
+				__mnt_tabdiff_add_entry(df, o_fs, fs, MNT_TABDIFF_REMOUNT);
 		}
 	}
 
@@ -298,7 +298,7 @@ int mnt_diff_tables(struct libmnt_tabdiff *df, struct libmnt_table *old_tab,
 				de->oper = MNT_TABDIFF_MOVE;
 				de->old_fs = fs;
 			} else
-				tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
+				__mnt_tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
 		}
 	}
 done:
@@ -306,29 +306,272 @@ done:
 	return df->nchanges;
 }
 
-#ifdef TEST_PROGRAM
+static inline int fs_strdiff(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a != b;
+	return strcmp(a, b) != 0;
+}
 
-static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
+/*
+ * Compares two versions of the same mount node. The fields are compared
+ * directly (without mnt_fs_get_*()) to avoid statmount() lazy fetching.
+ *
+ * Returns: MNT_TABDIFF_{MOVE,REMOUNT,PROPAGATION} or 0 if unchanged.
+ */
+int __mnt_tabdiff_fs_change(struct libmnt_fs *old, struct libmnt_fs *new)
 {
-	struct libmnt_table *tb_old, *tb_new;
-	struct libmnt_tabdiff *diff;
-	struct libmnt_iter *itr;
-	struct libmnt_fs *old, *new;
-	int rc = -1, change;
+	if (fs_strdiff(old->target, new->target))
+		return MNT_TABDIFF_MOVE;
+	if (mnt_fs_split_options(old) || mnt_fs_split_options(new))
+		return MNT_TABDIFF_REMOUNT;	/* ENOMEM, can't compare */
+	if (fs_strdiff(old->vfs_optstr, new->vfs_optstr)
+	    || fs_strdiff(old->fs_optstr, new->fs_optstr)
+	    || fs_strdiff(old->user_optstr, new->user_optstr))
+		return MNT_TABDIFF_REMOUNT;
+	if (fs_strdiff(old->opt_fields, new->opt_fields))
+		return MNT_TABDIFF_PROPAGATION;
+	return 0;
+}
 
-	tb_old = mnt_new_table_from_file(argv[1]);
-	tb_new = mnt_new_table_from_file(argv[2]);
-	diff = mnt_new_tabdiff();
-	itr = mnt_new_iter(MNT_ITER_FORWARD);
+static int cmp_fs_id(const void *a, const void *b)
+{
+	const struct libmnt_fs *x = *(struct libmnt_fs * const *) a,
+			       *y = *(struct libmnt_fs * const *) b;
 
-	if (!tb_old || !tb_new || !diff || !itr) {
-		warnx("failed to allocate resources");
+	return x->id - y->id;
+}
+
+static int cmp_key_id(const void *key, const void *b)
+{
+	const struct libmnt_fs *y = *(struct libmnt_fs * const *) b;
+
+	return *((const int *) key) - y->id;
+}
+
+/*
+ * Re-parses /proc/self/mountinfo and moves unchanged entries from @tb to @nt,
+ * the modified and new entries are added to @nt from the new table.
+ */
+static int refresh_mountinfo(struct libmnt_table *tb, struct libmnt_table *nt,
+			     struct libmnt_tabdiff *df)
+{
+	struct libmnt_table *pt;
+	struct libmnt_fs *fs, **olds = NULL;
+	struct libmnt_iter itr;
+	size_t nolds = 0;
+	int rc;
+
+	pt = mnt_new_table();
+	if (!pt)
+		return -ENOMEM;
+
+	mnt_table_set_cache(pt, tb->cache);
+	mnt_table_set_parser_errcb(pt, tb->errcb);
+	mnt_table_set_parser_fltrcb(pt, tb->fltrcb, tb->fltrcb_data);
+
+	rc = __mnt_table_parse_mountinfo(pt, NULL, NULL);
+	if (rc)
 		goto done;
+
+	/* old entries sorted by ID */
+	if (tb->nents) {
+		olds = malloc(tb->nents * sizeof(struct libmnt_fs *));
+		if (!olds) {
+			rc = -ENOMEM;
+			goto done;
+		}
+		mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+			olds[nolds++] = fs;
+		qsort(olds, nolds, sizeof(struct libmnt_fs *), cmp_fs_id);
 	}
 
-	rc = mnt_diff_tables(diff, tb_old, tb_new);
-	if (rc < 0)
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(pt, &itr, &fs) == 0) {
+		struct libmnt_fs **x = NULL, *o_fs = NULL;
+
+		if (nolds)
+			x = bsearch(&fs->id, olds, nolds,
+				    sizeof(struct libmnt_fs *), cmp_key_id);
+		/* the mount ID may be reused by kernel */
+		if (x && (*x)->tab == tb
+		    && !fs_strdiff(mnt_fs_get_root(*x), mnt_fs_get_root(fs))
+		    && !fs_strdiff(mnt_fs_get_source(*x), mnt_fs_get_source(fs)))
+			o_fs = *x;
+
+		if (o_fs) {
+			int oper = __mnt_tabdiff_fs_change(o_fs, fs);
+
+			if (!oper) {
+				/* unchanged, keep the old entry */
+				rc = mnt_table_move_fs(tb, nt, 0, NULL, o_fs);
+				if (rc)
+					goto done;
+				continue;
+			}
+			rc = __mnt_tabdiff_add_entry(df, o_fs, fs, oper);
+			if (!rc)
+				rc = mnt_table_remove_fs(tb, o_fs);
+		} else
+			rc = __mnt_tabdiff_add_entry(df, NULL, fs, MNT_TABDIFF_MOUNT);
+
+		if (!rc)
+			rc = mnt_table_move_fs(pt, nt, 0, NULL, fs);
+		if (rc)
+			goto done;
+	}
+done:
+	free(olds);
+	mnt_unref_table(pt);
+	return rc;
+}
+
+/**
+ * mnt_table_refresh:
+ * @tb: kernel mount table
+ * @df: diff handler or NULL
+ *
+ * Updates @tb (the kernel mount table of the current mount namespace, see
+ * mnt_table_parse_mtab()) to the current state. Unlike re-reading the whole
+ * table and mnt_diff_tables(), the unchanged entries are kept in @tb (so
+ * pointers and userdata remain valid), the modified entries are replaced by
+ * new entries and the unmounted entries are removed. The changes are stored
+ * in @df and the removed entries are accessible by mnt_tabdiff_next_change()
+ * until the next refresh.
+ *
+ * The table loaded by mnt_table_fetch_listmount() (or with
+ * mnt_table_enable_listmount()) is refreshed by listmount(2) and only a
+ * minimal statmount(2) is called for already known mount nodes. Otherwise
+ * /proc/self/mountinfo is parsed and the entries are compared by mount IDs.
+ *
+ * Returns: number of changes, negative number in case of error (the table is
+ *          reset in this case).
+ *
+ * Since: 2.39
+ */
+int mnt_table_refresh(struct libmnt_table *tb, struct libmnt_tabdiff *df)
+{
+	struct libmnt_tabdiff *tmp = NULL;
+	struct libmnt_table *nt;
+	struct libmnt_fs *fs;
+	struct libmnt_iter itr;
+	int rc = -ENOSYS;
+
+	if (!tb)
+		return -EINVAL;
+	if (!df) {
+		df = tmp = mnt_new_tabdiff();
+		if (!df)
+			return -ENOMEM;
+	}
+	tabdiff_reset(df);
+
+	nt = mnt_new_table();
+	if (!nt) {
+		rc = -ENOMEM;
 		goto done;
+	}
+	mnt_table_set_cache(nt, tb->cache);
+	mnt_table_set_parser_fltrcb(nt, tb->fltrcb, tb->fltrcb_data);
+	nt->fmt = MNT_FMT_MOUNTINFO;
+
+	DBG(DIFF, ul_debugobj(df, "refreshing table %p (%d entries)", tb, tb->nents));
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	if (mnt_table_next_fs(tb, &itr, &fs) == 0 ? fs->uniq_id != 0 : tb->listmount)
+		rc = __mnt_table_refresh_listmount(tb, nt, df);
+	if (rc == -ENOSYS)
+		rc = refresh_mountinfo(tb, nt, df);
+	if (rc) {
+		mnt_reset_table(tb);
+		goto done;
+	}
+
+	/* the rest has been unmounted */
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		rc = __mnt_tabdiff_add_entry(df, fs, NULL, MNT_TABDIFF_UMOUNT);
+		if (!rc)
+			rc = mnt_table_remove_fs(tb, fs);
+		if (rc) {
+			mnt_reset_table(tb);
+			goto done;
+		}
+	}
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(nt, &itr, &fs) == 0)
+		mnt_table_move_fs(nt, tb, 0, NULL, fs);
+
+	tb->fmt = MNT_FMT_MOUNTINFO;
+	rc = df->nchanges;
+
+	DBG(DIFF, ul_debugobj(df, "%d changes detected", df->nchanges));
+done:
+	mnt_unref_table(nt);
+	mnt_free_tabdiff(tmp);
+	return rc;
+}
+
+/**
+ * mnt_table_refresh_ids:
+ * @tb: kernel mount table loaded by listmount(2)
+ * @df: diff handler or NULL
+ * @ids: unique mount IDs
+ * @nids: number of @ids
+ *
+ * Like mnt_table_refresh(), but only the mount nodes specified by @ids are
+ * added, removed or updated; for example the IDs from the fanotify monitor
+ * (see mnt_monitor_next_mount_event()). The table has to be loaded by
+ * mnt_table_fetch_listmount() (or with mnt_table_enable_listmount()).
+ *
+ * The table may be partially updated in case of error.
+ *
+ * Returns: number of changes, -ENOSYS if the table is not loaded by
+ *          listmount(2) or the syscalls are not supported, other negative
+ *          number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_refresh_ids(struct libmnt_table *tb, struct libmnt_tabdiff *df,
+			  const uint64_t ids[], size_t nids)
+{
+	struct libmnt_tabdiff *tmp = NULL;
+	struct libmnt_fs *fs;
+	int rc;
+
+	if (!tb || (nids && !ids))
+		return -EINVAL;
+	if (mnt_table_first_fs(tb, &fs) == 0 ? fs->uniq_id == 0 : !tb->listmount)
+		return -ENOSYS;
+	if (!df) {
+		df = tmp = mnt_new_tabdiff();
+		if (!df)
+			return -ENOMEM;
+	}
+	tabdiff_reset(df);
+
+	DBG(DIFF, ul_debugobj(df, "refreshing %zu IDs in table %p", nids, tb));
+
+	rc = nids ? __mnt_table_refresh_listmount_ids(tb, df, ids, nids) : 0;
+	if (!rc)
+		rc = df->nchanges;
+
+	mnt_free_tabdiff(tmp);
+	return rc;
+}
+
+#ifdef TEST_PROGRAM
+#include "xalloc.h"
+
+
+static void print_changes(struct libmnt_tabdiff *diff, struct libmnt_iter *itr)
+{
+	struct libmnt_fs *old, *new;
+	int change;
+
+	mnt_reset_iter(itr, MNT_ITER_FORWARD);
 
 	while(mnt_tabdiff_next_change(diff, itr, &old, &new, &change) == 0) {
 
@@ -347,6 +590,11 @@ static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
 					mnt_fs_get_options(old),
 					mnt_fs_get_options(new));
 			break;
+		case MNT_TABDIFF_PROPAGATION:
+			printf("PROPAGATION changed from '%s' to '%s'\n",
+					mnt_fs_get_optional_fields(old),
+					mnt_fs_get_optional_fields(new));
+			break;
 		case MNT_TABDIFF_MOUNT:
 			printf("MOUNTED\n");
 			break;
@@ -354,7 +602,30 @@ static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
 			printf("unknown change!\n");
 		}
 	}
+}
 
+static int test_diff(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb_old, *tb_new;
+	struct libmnt_tabdiff *diff;
+	struct libmnt_iter *itr;
+	int rc = -1;
+
+	tb_old = mnt_new_table_from_file(argv[1]);
+	tb_new = mnt_new_table_from_file(argv[2]);
+	diff = mnt_new_tabdiff();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+
+	if (!tb_old || !tb_new || !diff || !itr) {
+		warnx("failed to allocate resources");
+		goto done;
+	}
+
+	rc = mnt_diff_tables(diff, tb_old, tb_new);
+	if (rc < 0)
+		goto done;
+
+	print_changes(diff, itr);
 	rc = 0;
 done:
 	mnt_unref_table(tb_old);
@@ -364,10 +635,79 @@ done:
 	return rc;
 }
 
+static int test_refresh(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	struct libmnt_tabdiff *diff;
+	struct libmnt_monitor *mn;
+	struct libmnt_iter *itr;
+	int rc = -1, fan = 0;
+
+	tb = mnt_new_table();
+	diff = mnt_new_tabdiff();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	mn = mnt_new_monitor();
+
+	if (!tb || !diff || !itr || !mn) {
+		warnx("failed to allocate resources");
+		goto done;
+	}
+	if (argc > 1 && strcmp(argv[1], "listmount") == 0)
+		mnt_table_enable_listmount(tb, 1);
+	else if (argc > 1 && strcmp(argv[1], "fanotify") == 0) {
+		mnt_table_enable_listmount(tb, 1);
+		fan = 1;
+	}
+
+	rc = fan ? mnt_monitor_enable_fanotify(mn, 1) :
+		   mnt_monitor_enable_kernel(mn, 1);
+	if (!rc)
+		rc = mnt_table_parse_mtab(tb, NULL);
+	if (rc)
+		goto done;
+
+	printf("waiting for changes (%d entries)...\n", mnt_table_get_nents(tb));
+
+	while (mnt_monitor_wait(mn, -1) > 0) {
+		uint64_t *ids = NULL, id;
+		size_t nids = 0;
+		int event, overflow = 0;
+
+		while (mnt_monitor_next_change(mn, NULL, NULL) == 0) {
+			while (fan && mnt_monitor_next_mount_event(mn, &id, &event) == 0) {
+				if (event == MNT_MONITOR_EVENT_OVERFLOW)
+					overflow = 1;
+				ids = xrealloc(ids, (nids + 1) * sizeof(uint64_t));
+				ids[nids++] = id;
+			}
+		}
+
+		if (fan && !overflow)
+			rc = mnt_table_refresh_ids(tb, diff, ids, nids);
+		else
+			rc = mnt_table_refresh(tb, diff);
+		free(ids);
+		if (rc < 0)
+			goto done;
+
+		printf("%d changes (%d entries)\n", rc, mnt_table_get_nents(tb));
+		print_changes(diff, itr);
+		fflush(stdout);
+	}
+	rc = 0;
+done:
+	mnt_unref_table(tb);
+	mnt_free_tabdiff(diff);
+	mnt_free_iter(itr);
+	mnt_unref_monitor(mn);
+	return rc;
+}
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
 		{ "--diff", test_diff, "<old> <new> prints change" },
+		{ "--refresh", test_refresh, "[listmount|fanotify] refresh mount table on changes" },
 		{ NULL }
 	};
 
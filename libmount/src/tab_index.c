@@ -0,0 +1,320 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * This file is part of libmount from util-linux project.
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * Hash indexes for libmnt_table lookups. The indexes are built on demand
+ * (separately for each key) and dropped when the table is modified. All
+ * entries with the same hash are chained in the table order, the caller has
+ * to compare the entries (hash collisions, trailing slashes, etc.).
+ *
+ * The mount tree is an array of the entries sorted by parent ID and ID, so
+ * children of a node are always in one continuous block.
+ */
+#include "mountP.h"
+
+/* smaller tables are searched by the list of the entries */
+#define MNT_TABIDX_MINENTS	8
+
+struct libmnt_tabidx {
+	struct libmnt_fs	**ents;		/* entries in the table order */
+	size_t			nents;
+	size_t			nbuckets;
+
+	unsigned int		built;		/* MNT_TABIDX_* bitmask */
+	int			ntags;		/* number of entries with source TAG */
+
+	/* per key: bucket -> first position + 1, position -> next position + 1 */
+	unsigned int		*heads[__MNT_TABIDX_MAX];
+	unsigned int		*next[__MNT_TABIDX_MAX];
+
+	struct libmnt_fs	**tree;		/* sorted by parent ID, ID */
+};
+
+void __mnt_table_drop_index(struct libmnt_table *tb)
+{
+	struct libmnt_tabidx *idx;
+	size_t i;
+
+	if (!tb || !tb->idx)
+		return;
+
+	idx = tb->idx;
+	for (i = 0; i < __MNT_TABIDX_MAX; i++) {
+		free(idx->heads[i]);
+		free(idx->next[i]);
+	}
+	free(idx->tree);
+	free(idx->ents);
+	free(idx);
+	tb->idx = NULL;
+}
+
+/* FNV-1a; the path is normalized the same way as streq_paths() compares */
+uint32_t __mnt_tabidx_hash_path(const char *path)
+{
+	uint32_t h = 2166136261U;
+	const char *p;
+
+	for (p = path; p && *p; p++) {
+		if (*p == '/' && (*(p + 1) == '/' || *(p + 1) == '\0'))
+			continue;
+		h = (h ^ (unsigned char) *p) * 16777619U;
+	}
+	return h;
+}
+
+uint32_t __mnt_tabidx_hash_num(uint64_t num)
+{
+	num ^= num >> 33;
+	num *= 0xff51afd7ed558ccdULL;
+	num ^= num >> 33;
+	return (uint32_t) num;
+}
+
+static uint32_t fs_key_hash(struct libmnt_fs *fs, int key)
+{
+	switch (key) {
+	case MNT_TABIDX_ID:
+		return __mnt_tabidx_hash_num(mnt_fs_get_id(fs));
+	case MNT_TABIDX_PARENT:
+		return __mnt_tabidx_hash_num(mnt_fs_get_parent_id(fs));
+	case MNT_TABIDX_TARGET:
+		return __mnt_tabidx_hash_path(mnt_fs_get_target(fs));
+	case MNT_TABIDX_SRCPATH:
+		return __mnt_tabidx_hash_path(mnt_fs_get_srcpath(fs));
+	case MNT_TABIDX_DEVNO:
+		return __mnt_tabidx_hash_num(mnt_fs_get_devno(fs));
+	}
+	return 0;
+}
+
+static struct libmnt_tabidx *get_index(struct libmnt_table *tb)
+{
+	struct libmnt_tabidx *idx;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	if (tb->idx)
+		return tb->idx;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return NULL;
+
+	idx->ents = malloc(tb->nents * sizeof(struct libmnt_fs *));
+	if (!idx->ents) {
+		free(idx);
+		return NULL;
+	}
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+		idx->ents[idx->nents++] = fs;
+
+	/* power of two, at least the number of entries */
+	idx->nbuckets = 16;
+	while (idx->nbuckets < idx->nents)
+		idx->nbuckets <<= 1;
+
+	tb->idx = idx;
+	return idx;
+}
+
+static int build_key(struct libmnt_table *tb, struct libmnt_tabidx *idx, int key)
+{
+	unsigned int *heads, *next;
+	size_t i;
+
+	heads = calloc(idx->nbuckets, sizeof(unsigned int));
+	next = calloc(idx->nents, sizeof(unsigned int));
+	if (!heads || !next) {
+		free(heads);
+		free(next);
+		return -ENOMEM;
+	}
+
+	/* backward, so the chains are in the table order */
+	for (i = idx->nents; i > 0; i--) {
+		struct libmnt_fs *fs = idx->ents[i - 1];
+		size_t b = fs_key_hash(fs, key) & (idx->nbuckets - 1);
+
+		next[i - 1] = heads[b];
+		heads[b] = i;
+
+		if (key == MNT_TABIDX_SRCPATH && mnt_fs_get_tag(fs, NULL, NULL) == 0)
+			idx->ntags++;
+	}
+
+	idx->heads[key] = heads;
+	idx->next[key] = next;
+	idx->built |= (1 << key);
+
+	DBG(TAB, ul_debugobj(tb, "index %d built [entries=%zu, buckets=%zu]",
+				key, idx->nents, idx->nbuckets));
+	return 0;
+}
+
+/*
+ * Initializes @it to iterate over entries with @key hashed to @hash. The
+ * index is built if necessary.
+ *
+ * Returns: 0 on success, 1 if the index is not available (small table, no
+ *          memory), the caller has to walk the table entries.
+ */
+int __mnt_table_index_init(struct libmnt_table *tb, int key, uint32_t hash,
+			   struct libmnt_tabidx_iter *it)
+{
+	struct libmnt_tabidx *idx;
+
+	assert(tb);
+	assert(it);
+	assert(key >= 0 && key < __MNT_TABIDX_MAX);
+
+	if (tb->nents < MNT_TABIDX_MINENTS)
+		return 1;
+
+	idx = get_index(tb);
+	if (!idx)
+		return 1;
+	if (!(idx->built & (1 << key)) && build_key(tb, idx, key) != 0)
+		return 1;
+
+	it->key = key;
+	it->next = idx->heads[key][hash & (idx->nbuckets - 1)];
+	return 0;
+}
+
+/*
+ * Returns: the next entry from the index chain (in the table order) or NULL.
+ */
+struct libmnt_fs *__mnt_table_index_next(struct libmnt_table *tb,
+					 struct libmnt_tabidx_iter *it)
+{
+	struct libmnt_tabidx *idx = tb->idx;
+	size_t pos;
+
+	if (!idx || !it->next)
+		return NULL;
+
+	pos = it->next - 1;
+	it->next = idx->next[it->key][pos];
+	return idx->ents[pos];
+}
+
+/*
+ * Returns: number of entries with source TAG (valid after the srcpath index
+ *          initialization).
+ */
+int __mnt_table_index_ntags(struct libmnt_table *tb)
+{
+	return tb->idx ? tb->idx->ntags : 0;
+}
+
+struct tree_ent {
+	struct libmnt_fs	*fs;
+	size_t			pos;		/* position in the table */
+};
+
+static int cmp_tree_ents(const void *a, const void *b)
+{
+	const struct tree_ent *x = a, *y = b;
+
+	if (x->fs->parent != y->fs->parent)
+		return x->fs->parent < y->fs->parent ? -1 : 1;
+	if (x->fs->id != y->fs->id)
+		return x->fs->id < y->fs->id ? -1 : 1;
+	/* keep the table order for duplicate IDs */
+	return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/*
+ * Builds the mount tree. Small tables are ignored if @force is not set.
+ *
+ * Returns: 0 on success, 1 if ignored, or negative errno.
+ */
+int __mnt_table_build_tree(struct libmnt_table *tb, int force)
+{
+	struct libmnt_tabidx *idx;
+	struct tree_ent *ents;
+	size_t i;
+
+	assert(tb);
+
+	if (tb->idx && tb->idx->tree)
+		return 0;
+	if (!tb->nents || (!force && tb->nents < MNT_TABIDX_MINENTS))
+		return 1;
+
+	idx = get_index(tb);
+	if (!idx)
+		return -ENOMEM;
+
+	ents = malloc(idx->nents * sizeof(struct tree_ent));
+	idx->tree = malloc(idx->nents * sizeof(struct libmnt_fs *));
+	if (!ents || !idx->tree) {
+		free(ents);
+		free(idx->tree);
+		idx->tree = NULL;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < idx->nents; i++) {
+		ents[i].fs = idx->ents[i];
+		ents[i].pos = i;
+	}
+	qsort(ents, idx->nents, sizeof(struct tree_ent), cmp_tree_ents);
+
+	for (i = 0; i < idx->nents; i++)
+		idx->tree[i] = ents[i].fs;
+	free(ents);
+
+	DBG(TAB, ul_debugobj(tb, "tree built [entries=%zu]", idx->nents));
+	return 0;
+}
+
+/*
+ * Returns the first child of @parent_id with ID greater than @last_id (or the
+ * first child at all if @last_id is zero), or NULL. The tree has to be
+ * already built.
+ */
+struct libmnt_fs *__mnt_table_tree_next_child(struct libmnt_table *tb,
+					      int parent_id, int last_id)
+{
+	struct libmnt_tabidx *idx = tb->idx;
+	size_t lo = 0, hi;
+
+	assert(idx);
+	assert(idx->tree);
+
+	hi = idx->nents;
+
+	/* the first entry greater than (parent_id, last_id) */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct libmnt_fs *fs = idx->tree[mid];
+
+		if (fs->parent < parent_id
+		    || (fs->parent == parent_id && last_id && fs->id <= last_id))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < idx->nents; lo++) {
+		struct libmnt_fs *fs = idx->tree[lo];
+
+		if (fs->parent != parent_id)
+			break;
+		/* the rootfs might be its own parent */
+		if (fs->id != parent_id)
+			return fs;
+	}
+	return NULL;
+}
@@ -0,0 +1,972 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * This file is part of libmount from util-linux project.
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * libmount is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * The mount table loader based on listmount(2) and statmount(2) syscalls
+ * (Linux 6.8+). The kernel table is enumerated by mount IDs and the wanted
+ * mount node information is fetched without generating and parsing the
+ * whole mountinfo file. The fields not requested by the statmount mask are
+ * fetched later on demand by mnt_fs_get_*() functions.
+ */
+#include <sys/mount.h>
+#include <inttypes.h>
+
+#include "mountP.h"
+#include "mangle.h"
+#include "pathnames.h"
+
+#ifdef UL_HAVE_STATMOUNT
+
+/* always fetched (cheap numeric fields, necessary for the tree) */
+#define STMNT_BASIC_MASK	(STATMOUNT_SB_BASIC | \
+				 STATMOUNT_MNT_BASIC | \
+				 STATMOUNT_PROPAGATE_FROM)
+
+/* everything what is available in mountinfo */
+#define STMNT_ALL_MASK		(STMNT_BASIC_MASK | \
+				 STATMOUNT_MNT_ROOT | \
+				 STATMOUNT_MNT_POINT | \
+				 STATMOUNT_FS_TYPE | \
+				 STATMOUNT_FS_SUBTYPE | \
+				 STATMOUNT_SB_SOURCE | \
+				 STATMOUNT_MNT_OPTS)
+
+/* the kernel has to support these to make the table compatible with mountinfo */
+#define STMNT_REQUIRED_MASK	(STMNT_ALL_MASK & ~STATMOUNT_FS_SUBTYPE)
+
+#define STMNT_BUFSIZ		4096
+#define STMNT_BUFSIZ_MAX	(1024 * 1024)
+#define LISTMOUNT_IDS		512
+
+#ifndef MS_SHARED
+# define MS_SHARED	(1 << 20)
+#endif
+#ifndef MS_SLAVE
+# define MS_SLAVE	(1 << 19)
+#endif
+#ifndef MS_UNBINDABLE
+# define MS_UNBINDABLE	(1 << 17)
+#endif
+
+#ifndef SB_RDONLY
+# define SB_RDONLY	(1 << 0)
+# define SB_SYNCHRONOUS	(1 << 4)
+# define SB_DIRSYNC	(1 << 7)
+# define SB_LAZYTIME	(1 << 25)
+#endif
+
+struct stmnt_buf {
+	struct ul_statmount	*sm;
+	size_t			size;
+};
+
+static void free_stmnt_buf(struct stmnt_buf *b)
+{
+	free(b->sm);
+	b->sm = NULL;
+	b->size = 0;
+}
+
+/*
+ * Calls statmount() for @id, the buffer is enlarged if necessary.
+ *
+ * Returns: 0 on success or negative errno.
+ */
+static int stmnt_fetch(struct stmnt_buf *b, uint64_t id, uint64_t mask)
+{
+	if (!b->sm) {
+		b->sm = malloc(STMNT_BUFSIZ);
+		if (!b->sm)
+			return -ENOMEM;
+		b->size = STMNT_BUFSIZ;
+	}
+
+	while (ul_statmount(id, mask, b->sm, b->size, 0) != 0) {
+		void *tmp;
+
+		if (errno != EOVERFLOW || b->size >= STMNT_BUFSIZ_MAX)
+			return -errno;
+
+		tmp = realloc(b->sm, b->size * 2);
+		if (!tmp)
+			return -ENOMEM;
+		b->sm = tmp;
+		b->size *= 2;
+	}
+	return 0;
+}
+
+static inline const char *stmnt_str(struct ul_statmount *sm, uint64_t flag, uint32_t off)
+{
+	return (sm->mask & flag) ? sm->str + off : NULL;
+}
+
+static char *stmnt_vfs_options(struct ul_statmount *sm)
+{
+	char buf[128];
+	uint64_t attr = sm->mnt_attr;
+
+	snprintf(buf, sizeof(buf), "%s%s%s%s%s%s%s%s%s",
+		attr & MOUNT_ATTR_RDONLY ? "ro" : "rw",
+		attr & MOUNT_ATTR_NOSUID ? ",nosuid" : "",
+		attr & MOUNT_ATTR_NODEV ? ",nodev" : "",
+		attr & MOUNT_ATTR_NOEXEC ? ",noexec" : "",
+		(attr & MOUNT_ATTR__ATIME) == MOUNT_ATTR_NOATIME ? ",noatime" : "",
+		attr & MOUNT_ATTR_NODIRATIME ? ",nodiratime" : "",
+		(attr & MOUNT_ATTR__ATIME) == MOUNT_ATTR_RELATIME ? ",relatime" : "",
+		attr & MOUNT_ATTR_NOSYMFOLLOW ? ",nosymfollow" : "",
+		attr & MOUNT_ATTR_IDMAP ? ",idmapped" : "");
+
+	return strdup(buf);
+}
+
+/* returns NULL (and errno=0) if there are no optional fields */
+static char *stmnt_opt_fields(struct ul_statmount *sm)
+{
+	char buf[128];
+	size_t sz = 0;
+
+	*buf = '\0';
+
+	if (sm->mnt_propagation & MS_SHARED)
+		sz += snprintf(buf + sz, sizeof(buf) - sz, "shared:%" PRIu64,
+				sm->mnt_peer_group);
+	if (sm->mnt_propagation & MS_SLAVE) {
+		sz += snprintf(buf + sz, sizeof(buf) - sz, "%smaster:%" PRIu64,
+				sz ? " " : "", sm->mnt_master);
+		if ((sm->mask & STATMOUNT_PROPAGATE_FROM)
+		    && sm->propagate_from && sm->propagate_from != sm->mnt_master)
+			sz += snprintf(buf + sz, sizeof(buf) - sz,
+				" propagate_from:%" PRIu64, sm->propagate_from);
+	}
+	if (sm->mnt_propagation & MS_UNBINDABLE)
+		snprintf(buf + sz, sizeof(buf) - sz, "%sunbindable", sz ? " " : "");
+
+	errno = 0;
+	return *buf ? strdup(buf) : NULL;
+}
+
+static char *stmnt_fs_options(struct ul_statmount *sm)
+{
+	const char *opts = stmnt_str(sm, STATMOUNT_MNT_OPTS, sm->mnt_opts);
+	char sbopts[64], *res = NULL;
+
+	snprintf(sbopts, sizeof(sbopts), "%s%s%s%s",
+		sm->sb_flags & SB_RDONLY ? "ro" : "rw",
+		sm->sb_flags & SB_SYNCHRONOUS ? ",sync" : "",
+		sm->sb_flags & SB_DIRSYNC ? ",dirsync" : "",
+		sm->sb_flags & SB_LAZYTIME ? ",lazytime" : "");
+
+	if (!opts || !*opts)
+		return strdup(sbopts);
+
+	if (asprintf(&res, "%s,%s", sbopts, opts) < 0)
+		return NULL;
+
+	unmangle_string(res);
+	return res;
+}
+
+static int stmnt_set_string(char **dest, const char *src)
+{
+	char *p = NULL;
+
+	if (src) {
+		p = strdup(src);
+		if (!p)
+			return -ENOMEM;
+	}
+	free(*dest);
+	*dest = p;
+	return 0;
+}
+
+/*
+ * Copies statmount() result @sm to @fs. Only fields in @mask are updated.
+ */
+static int stmnt_apply(struct libmnt_fs *fs, struct ul_statmount *sm, uint64_t mask)
+{
+	int rc = 0;
+
+	if (mnt_fs_unshare(fs))
+		return -ENOMEM;
+
+	if (mask & STATMOUNT_MNT_BASIC) {
+		char *p;
+
+		fs->uniq_id = sm->mnt_id;
+		fs->id = sm->mnt_id_old;
+		fs->parent = sm->mnt_parent_id_old;
+
+		p = stmnt_vfs_options(sm);
+		if (!p)
+			return -ENOMEM;
+		free(fs->vfs_optstr);
+		fs->vfs_optstr = p;
+
+		p = stmnt_opt_fields(sm);
+		if (!p && errno)
+			return -ENOMEM;
+		free(fs->opt_fields);
+		fs->opt_fields = p;
+	}
+
+	if (mask & STATMOUNT_SB_BASIC)
+		fs->devno = makedev(sm->sb_dev_major, sm->sb_dev_minor);
+
+	if (!rc && (mask & STATMOUNT_MNT_ROOT))
+		rc = stmnt_set_string(&fs->root,
+				stmnt_str(sm, STATMOUNT_MNT_ROOT, sm->mnt_root));
+	if (!rc && (mask & STATMOUNT_MNT_POINT))
+		rc = stmnt_set_string(&fs->target,
+				stmnt_str(sm, STATMOUNT_MNT_POINT, sm->mnt_point));
+
+	if (!rc && (mask & STATMOUNT_FS_TYPE)) {
+		const char *type = stmnt_str(sm, STATMOUNT_FS_TYPE, sm->fs_type);
+		const char *sub = stmnt_str(sm, STATMOUNT_FS_SUBTYPE, sm->fs_subtype);
+		char *p = NULL;
+
+		if (type && sub && *sub)
+			rc = asprintf(&p, "%s.%s", type, sub) < 0 ? -ENOMEM : 0;
+		else if (type && !(p = strdup(type)))
+			rc = -ENOMEM;
+		if (!rc)
+			rc = __mnt_fs_set_fstype_ptr(fs, p);
+		if (rc)
+			free(p);
+	}
+
+	if (!rc && (mask & STATMOUNT_SB_SOURCE)) {
+		const char *src = stmnt_str(sm, STATMOUNT_SB_SOURCE, sm->sb_source);
+		char *p = strdup(src ? src : "");
+
+		if (!p)
+			rc = -ENOMEM;
+		else if ((rc = __mnt_fs_set_source_ptr(fs, p)))
+			free(p);
+	}
+
+	if (!rc && (mask & STATMOUNT_MNT_OPTS)) {
+		char *p = stmnt_fs_options(sm);
+
+		if (!p)
+			rc = -ENOMEM;
+		else {
+			free(fs->fs_optstr);
+			fs->fs_optstr = p;
+		}
+	}
+
+	/* merge VFS and FS options to one string */
+	if (!rc && (mask & (STATMOUNT_MNT_BASIC | STATMOUNT_MNT_OPTS))) {
+		free(fs->optstr);
+		fs->optstr = NULL;	/* mnt_fs_strdup_options() returns optstr if defined */
+		__mnt_fs_drop_optoks(fs);
+
+		fs->optstr = mnt_fs_strdup_options(fs);
+		if (!fs->optstr)
+			rc = -ENOMEM;
+	}
+
+	return rc;
+}
+
+/*
+ * Fetches fields defined by @mask (STATMOUNT_*) for @fs loaded by
+ * mnt_table_fetch_listmount() when the fields have not been fetched yet. The
+ * function is called by mnt_fs_get_* functions.
+ *
+ * Returns: 0 on success or negative errno.
+ */
+int mnt_fs_fetch_statmount(struct libmnt_fs *fs, uint64_t mask)
+{
+	struct stmnt_buf b = { .sm = NULL };
+	int rc;
+
+	mask &= fs->stmnt_todo;
+	if (!mask || !fs->uniq_id)
+		return 0;
+
+	/* @mask dependences */
+	if (mask & STATMOUNT_FS_TYPE)
+		mask |= STATMOUNT_FS_SUBTYPE;
+	if (mask & STATMOUNT_MNT_OPTS)
+		mask |= STATMOUNT_SB_BASIC;
+
+	/* don't try it again, the mount node may be already gone */
+	fs->stmnt_todo &= ~mask;
+
+	DBG(FS, ul_debugobj(fs, "statmount lazy fetch [id=%" PRIu64 ", mask=0x%" PRIx64 "]",
+				fs->uniq_id, mask));
+
+	rc = stmnt_fetch(&b, fs->uniq_id, mask);
+	if (!rc)
+		rc = stmnt_apply(fs, b.sm,
+			mask & ~(STATMOUNT_SB_BASIC | STATMOUNT_MNT_BASIC |
+				 STATMOUNT_PROPAGATE_FROM));
+	free_stmnt_buf(&b);
+
+	if (rc)
+		DBG(FS, ul_debugobj(fs, "statmount lazy fetch failed [rc=%d]", rc));
+	return rc;
+}
+
+/*
+ * Allocates a new entry for statmount() result @sm and adds it to @tb. The
+ * entries filtered out by the table callback or not reachable from the
+ * current root are ignored.
+ *
+ * Returns: 0 on success, 1 if ignored, or negative errno.
+ */
+static int stmnt_add_fs(struct libmnt_table *tb, struct ul_statmount *sm,
+			uint64_t mask, pid_t *tid, struct libmnt_fs **res)
+{
+	struct libmnt_fs *fs;
+	int rc;
+
+	/* not reachable from the current root (see mountinfo) */
+	if ((mask & STATMOUNT_MNT_POINT) && !(sm->mask & STATMOUNT_MNT_POINT))
+		return 1;
+
+	fs = mnt_new_fs();
+	if (!fs)
+		return -ENOMEM;
+
+	fs->flags |= MNT_FS_KERNEL;
+	fs->stmnt_todo = STMNT_ALL_MASK & ~mask;
+
+	rc = stmnt_apply(fs, sm, mask);
+	if (rc == 0 && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
+		rc = 1;	/* filtered out by callback... */
+	if (rc == 0) {
+		rc = mnt_table_add_fs(tb, fs);
+		if (rc == 0) {
+			rc = __mnt_kernel_fs_postparse(tb, fs, tid,
+					_PATH_PROC_MOUNTINFO);
+			if (rc)
+				mnt_table_remove_fs(tb, fs);
+		}
+	}
+	if (rc == 0 && res)
+		*res = fs;
+
+	mnt_unref_fs(fs);
+	return rc;
+}
+
+/* the mask used for all entries by the table loader */
+static uint64_t stmnt_table_mask(struct libmnt_table *tb)
+{
+	uint64_t mask = (tb->stmnt_mask ? tb->stmnt_mask : STMNT_ALL_MASK)
+				| STMNT_BASIC_MASK;
+
+	if (mask & STATMOUNT_FS_TYPE)
+		mask |= STATMOUNT_FS_SUBTYPE;
+	return mask;
+}
+
+/* Returns: 0 if the kernel is able to replace mountinfo, or -ENOSYS */
+static int stmnt_check_supported(struct stmnt_buf *b)
+{
+	uint64_t id;
+	int rc;
+
+	/* the first ID is the root of the namespace */
+	if (ul_listmount(LSMT_ROOT, 0, &id, 1, 0) != 1)
+		return -ENOSYS;
+
+	rc = stmnt_fetch(b, id, STATMOUNT_SUPPORTED_MASK);
+	if (rc)
+		return rc == -ENOMEM ? rc : -ENOSYS;
+
+	if (!(b->sm->mask & STATMOUNT_SUPPORTED_MASK)
+	    || (b->sm->supported_mask & STMNT_REQUIRED_MASK) != STMNT_REQUIRED_MASK)
+		return -ENOSYS;
+
+	return 0;
+}
+
+/**
+ * mnt_table_fetch_listmount:
+ * @tb: mount table
+ *
+ * Reads the kernel table of the mounted filesystems (for the current mount
+ * namespace) by listmount(2) and statmount(2) syscalls. The table contains
+ * the same information as /proc/self/mountinfo, but only the fields defined
+ * by mnt_table_set_statmount_mask() are fetched immediately. The utab is not
+ * merged with the table.
+ *
+ * Returns: 0 on success, -ENOSYS if syscalls are not supported by the kernel,
+ *          or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_fetch_listmount(struct libmnt_table *tb)
+{
+	struct stmnt_buf b = { .sm = NULL };
+	uint64_t ids[LISTMOUNT_IDS], last = 0, mask;
+	pid_t tid = -1;
+	ssize_t n;
+	int rc;
+
+	if (!tb)
+		return -EINVAL;
+
+	rc = stmnt_check_supported(&b);
+	if (rc) {
+		DBG(TAB, ul_debugobj(tb, "listmount: unsupported by kernel"));
+		goto done;
+	}
+
+	mask = stmnt_table_mask(tb);
+
+	DBG(TAB, ul_debugobj(tb, "listmount: start [mask=0x%" PRIx64 "]", mask));
+	tb->fmt = MNT_FMT_MOUNTINFO;
+
+	do {
+		ssize_t i;
+
+		n = ul_listmount(LSMT_ROOT, last, ids, LISTMOUNT_IDS, 0);
+		if (n < 0) {
+			rc = -errno;
+			goto done;
+		}
+
+		for (i = 0; i < n; i++) {
+			last = ids[i];
+
+			rc = stmnt_fetch(&b, ids[i], mask);
+			if (rc == -ENOENT)
+				continue;	/* umounted in the meantime */
+			if (rc)
+				goto done;
+
+			rc = stmnt_add_fs(tb, b.sm, mask, &tid, NULL);
+			if (rc < 0)
+				goto done;
+			rc = 0;
+		}
+	} while (n == LISTMOUNT_IDS);
+
+	DBG(TAB, ul_debugobj(tb, "listmount: stop [entries=%d]", tb->nents));
+done:
+	free_stmnt_buf(&b);
+	return rc;
+}
+
+/* Reads all mount IDs of the current namespace to @ids array */
+static int list_mount_ids(uint64_t **ids, size_t *nids)
+{
+	uint64_t *list = NULL, last = 0;
+	size_t n = 0, sz = 0;
+	ssize_t rc;
+
+	do {
+		if (n + LISTMOUNT_IDS > sz) {
+			uint64_t *tmp = realloc(list,
+					(sz + LISTMOUNT_IDS) * sizeof(uint64_t));
+			if (!tmp) {
+				free(list);
+				return -ENOMEM;
+			}
+			list = tmp;
+			sz += LISTMOUNT_IDS;
+		}
+		rc = ul_listmount(LSMT_ROOT, last, list + n, LISTMOUNT_IDS, 0);
+		if (rc < 0) {
+			rc = -errno;
+			free(list);
+			return rc;
+		}
+		n += rc;
+		if (n)
+			last = list[n - 1];
+	} while (rc == LISTMOUNT_IDS);
+
+	*ids = list;
+	*nids = n;
+	return 0;
+}
+
+static int cmp_fs_uniq_id(const void *a, const void *b)
+{
+	const struct libmnt_fs *x = *(struct libmnt_fs * const *) a,
+			       *y = *(struct libmnt_fs * const *) b;
+
+	return x->uniq_id < y->uniq_id ? -1 : x->uniq_id > y->uniq_id;
+}
+
+static int cmp_key_uniq_id(const void *key, const void *b)
+{
+	const struct libmnt_fs *y = *(struct libmnt_fs * const *) b;
+	uint64_t id = *((const uint64_t *) key);
+
+	return id < y->uniq_id ? -1 : id > y->uniq_id;
+}
+
+/*
+ * Refreshes @tb by listmount(). The unchanged entries are moved from @tb to
+ * @nt, the modified and new entries are added to @nt and the changes are added
+ * to @df. The entries remaining in @tb are no longer mounted. Only the already
+ * fetched fields are compared for known mount nodes, so the statmount() mask
+ * is usually small.
+ *
+ * Returns: 0 on success, -ENOSYS if the syscalls are not supported, or
+ *          negative errno.
+ */
+int __mnt_table_refresh_listmount(struct libmnt_table *tb,
+				  struct libmnt_table *nt,
+				  struct libmnt_tabdiff *df)
+{
+	struct stmnt_buf b = { .sm = NULL };
+	struct libmnt_fs *fs, **olds = NULL;
+	struct libmnt_iter itr;
+	uint64_t *ids = NULL, mask;
+	size_t i, nids = 0, nolds = 0;
+	pid_t tid = -1;
+	int rc;
+
+	rc = stmnt_check_supported(&b);
+	if (rc)
+		goto done;
+	rc = list_mount_ids(&ids, &nids);
+	if (rc)
+		goto done;
+
+	mask = stmnt_table_mask(tb);
+
+	DBG(TAB, ul_debugobj(tb, "listmount refresh: %zu nodes [mask=0x%" PRIx64 "]",
+				nids, mask));
+
+	/* old entries sorted by unique ID */
+	if (tb->nents) {
+		olds = malloc(tb->nents * sizeof(struct libmnt_fs *));
+		if (!olds) {
+			rc = -ENOMEM;
+			goto done;
+		}
+		mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+			olds[nolds++] = fs;
+		qsort(olds, nolds, sizeof(struct libmnt_fs *), cmp_fs_uniq_id);
+	}
+
+	for (i = 0; i < nids; i++) {
+		struct libmnt_fs **x = NULL, *o_fs, *n_fs = NULL;
+		uint64_t m;
+		int oper;
+
+		if (nolds)
+			x = bsearch(&ids[i], olds, nolds,
+				    sizeof(struct libmnt_fs *), cmp_key_uniq_id);
+		o_fs = x && (*x)->tab == tb ? *x : NULL;
+
+		if (!o_fs) {
+			/* new mount node */
+			rc = stmnt_fetch(&b, ids[i], mask);
+			if (rc == -ENOENT)
+				continue;
+			if (!rc)
+				rc = stmnt_add_fs(nt, b.sm, mask, &tid, &n_fs);
+			if (rc == 0)
+				rc = __mnt_tabdiff_add_entry(df, NULL, n_fs,
+							MNT_TABDIFF_MOUNT);
+			if (rc < 0)
+				goto done;
+			rc = 0;
+			continue;
+		}
+
+		/* known mount node, fetch only what may be changed */
+		m = STMNT_BASIC_MASK |
+		    ((STATMOUNT_MNT_POINT | STATMOUNT_MNT_OPTS) & ~o_fs->stmnt_todo);
+
+		rc = stmnt_fetch(&b, ids[i], m);
+		if (rc == -ENOENT)
+			continue;		/* umounted */
+		if (rc)
+			goto done;
+		if ((m & STATMOUNT_MNT_POINT) && !(b.sm->mask & STATMOUNT_MNT_POINT))
+			continue;		/* moved out of the current root */
+
+		n_fs = mnt_copy_fs(NULL, o_fs);
+		if (!n_fs) {
+			rc = -ENOMEM;
+			goto done;
+		}
+		rc = stmnt_apply(n_fs, b.sm, m);
+		if (rc) {
+			mnt_unref_fs(n_fs);
+			goto done;
+		}
+
+		oper = __mnt_tabdiff_fs_change(o_fs, n_fs);
+		if (!oper) {
+			mnt_unref_fs(n_fs);
+			rc = mnt_table_move_fs(tb, nt, 0, NULL, o_fs);
+		} else {
+			rc = mnt_table_add_fs(nt, n_fs);
+			mnt_unref_fs(n_fs);
+			if (!rc)
+				rc = __mnt_tabdiff_add_entry(df, o_fs, n_fs, oper);
+			if (!rc)
+				rc = mnt_table_remove_fs(tb, o_fs);
+		}
+		if (rc)
+			goto done;
+	}
+
+	/* user specific information for the new entries */
+	if (tb->listmount)
+		rc = __mnt_table_merge_utab(nt, NULL);
+done:
+	DBG(TAB, ul_debugobj(tb, "listmount refresh done [rc=%d]", rc));
+	free(olds);
+	free(ids);
+	free_stmnt_buf(&b);
+	return rc;
+}
+
+static int cmp_ids(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Updates only @ids mount nodes in @tb. The modified entries are replaced in
+ * place, the new entries are added to the end of the table and the changes
+ * are added to @df.
+ *
+ * Returns: 0 on success, -ENOSYS if the syscalls are not supported, or
+ *          negative errno.
+ */
+int __mnt_table_refresh_listmount_ids(struct libmnt_table *tb,
+				      struct libmnt_tabdiff *df,
+				      const uint64_t *ids, size_t nids)
+{
+	struct stmnt_buf b = { .sm = NULL };
+	struct libmnt_table *nt = NULL;
+	struct libmnt_fs *fs, **olds = NULL;
+	struct libmnt_iter itr;
+	uint64_t *xids = NULL, mask;
+	size_t i, nxids = 0, nolds = 0;
+	pid_t tid = -1;
+	int rc;
+
+	rc = stmnt_check_supported(&b);
+	if (rc)
+		goto done;
+
+	/* sorted unique IDs (the same node may be reported more than once) */
+	xids = malloc(nids * sizeof(uint64_t));
+	nt = mnt_new_table();
+	if (!xids || !nt) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	memcpy(xids, ids, nids * sizeof(uint64_t));
+	qsort(xids, nids, sizeof(uint64_t), cmp_ids);
+	for (i = 0; i < nids; i++) {
+		if (!nxids || xids[nxids - 1] != xids[i])
+			xids[nxids++] = xids[i];
+	}
+
+	mnt_table_set_cache(nt, tb->cache);
+	mnt_table_set_parser_fltrcb(nt, tb->fltrcb, tb->fltrcb_data);
+	nt->fmt = MNT_FMT_MOUNTINFO;
+
+	mask = stmnt_table_mask(tb);
+
+	DBG(TAB, ul_debugobj(tb, "listmount refresh: %zu IDs [mask=0x%" PRIx64 "]",
+				nxids, mask));
+
+	if (tb->nents) {
+		olds = malloc(tb->nents * sizeof(struct libmnt_fs *));
+		if (!olds) {
+			rc = -ENOMEM;
+			goto done;
+		}
+		mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+			olds[nolds++] = fs;
+		qsort(olds, nolds, sizeof(struct libmnt_fs *), cmp_fs_uniq_id);
+	}
+
+	for (i = 0; i < nxids; i++) {
+		struct libmnt_fs **x = NULL, *o_fs, *n_fs = NULL;
+		uint64_t m;
+		int oper;
+
+		if (nolds)
+			x = bsearch(&xids[i], olds, nolds,
+				    sizeof(struct libmnt_fs *), cmp_key_uniq_id);
+		o_fs = x ? *x : NULL;
+
+		if (!o_fs) {
+			/* new mount node */
+			rc = stmnt_fetch(&b, xids[i], mask);
+			if (rc == -ENOENT)
+				continue;
+			if (!rc)
+				rc = stmnt_add_fs(nt, b.sm, mask, &tid, &n_fs);
+			if (rc == 0)
+				rc = __mnt_tabdiff_add_entry(df, NULL, n_fs,
+							MNT_TABDIFF_MOUNT);
+			if (rc < 0)
+				goto done;
+			rc = 0;
+			continue;
+		}
+
+		m = STMNT_BASIC_MASK |
+		    ((STATMOUNT_MNT_POINT | STATMOUNT_MNT_OPTS) & ~o_fs->stmnt_todo);
+
+		rc = stmnt_fetch(&b, xids[i], m);
+		if (rc == -ENOENT
+		    || (rc == 0 && (m & STATMOUNT_MNT_POINT)
+				&& !(b.sm->mask & STATMOUNT_MNT_POINT))) {
+			/* umounted or moved out of the current root */
+			rc = __mnt_tabdiff_add_entry(df, o_fs, NULL, MNT_TABDIFF_UMOUNT);
+			if (!rc)
+				rc = mnt_table_remove_fs(tb, o_fs);
+			if (rc)
+				goto done;
+			continue;
+		}
+		if (rc)
+			goto done;
+
+		n_fs = mnt_copy_fs(NULL, o_fs);
+		if (!n_fs) {
+			rc = -ENOMEM;
+			goto done;
+		}
+		rc = stmnt_apply(n_fs, b.sm, m);
+		oper = rc ? 0 : __mnt_tabdiff_fs_change(o_fs, n_fs);
+		if (oper) {
+			rc = mnt_table_insert_fs(tb, FALSE, o_fs, n_fs);
+			if (!rc)
+				rc = __mnt_tabdiff_add_entry(df, o_fs, n_fs, oper);
+			if (!rc)
+				rc = mnt_table_remove_fs(tb, o_fs);
+		}
+		mnt_unref_fs(n_fs);
+		if (rc)
+			goto done;
+	}
+
+	/* user specific information for the new entries */
+	if (tb->listmount)
+		rc = __mnt_table_merge_utab(nt, NULL);
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (rc == 0 && mnt_table_next_fs(nt, &itr, &fs) == 0)
+		rc = mnt_table_move_fs(nt, tb, FALSE, NULL, fs);
+done:
+	DBG(TAB, ul_debugobj(tb, "listmount IDs refresh done [rc=%d]", rc));
+	free(olds);
+	free(xids);
+	mnt_unref_table(nt);
+	free_stmnt_buf(&b);
+	return rc;
+}
+
+#else /* !UL_HAVE_STATMOUNT */
+
+int mnt_fs_fetch_statmount(struct libmnt_fs *fs __attribute__((__unused__)),
+			   uint64_t mask __attribute__((__unused__)))
+{
+	return 0;
+}
+
+int mnt_table_fetch_listmount(struct libmnt_table *tb __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+int __mnt_table_refresh_listmount(struct libmnt_table *tb __attribute__((__unused__)),
+				  struct libmnt_table *nt __attribute__((__unused__)),
+				  struct libmnt_tabdiff *df __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+
+int __mnt_table_refresh_listmount_ids(struct libmnt_table *tb __attribute__((__unused__)),
+				      struct libmnt_tabdiff *df __attribute__((__unused__)),
+				      const uint64_t *ids __attribute__((__unused__)),
+				      size_t nids __attribute__((__unused__)))
+{
+	return -ENOSYS;
+}
+#endif /* UL_HAVE_STATMOUNT */
+
+/**
+ * mnt_table_enable_listmount:
+ * @tb: mount table
+ * @enable: 1 or 0
+ *
+ * Enables listmount(2) and statmount(2) based loader for mnt_table_parse_mtab()
+ * when the default mount table is requested. The classic mountinfo parser is
+ * used if the syscalls are not supported by the kernel.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_enable_listmount(struct libmnt_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->listmount = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * mnt_table_set_statmount_mask:
+ * @tb: mount table
+ * @mask: STATMOUNT_* flags (see statmount(2)) or zero
+ *
+ * Defines what information is fetched by listmount based loader for all
+ * entries in the table. The rest of the information is fetched later by
+ * statmount(2) when requested by the mnt_fs_get_* functions. The basic
+ * information (IDs, device number, VFS options and propagation flags) is
+ * always fetched. Zero (default) means everything what is
+ * in /proc/self/mountinfo.
+ *
+ * Returns: 0 on success or negative number in case of error.
+ *
+ * Since: 2.39
+ */
+int mnt_table_set_statmount_mask(struct libmnt_table *tb, uint64_t mask)
+{
+	if (!tb)
+		return -EINVAL;
+	tb->stmnt_mask = mask;
+	return 0;
+}
+
+#ifdef TEST_PROGRAM
+static struct libmnt_fs *find_id(struct libmnt_table *tb, int id)
+{
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0) {
+		if (mnt_fs_get_id(fs) == id)
+			return fs;
+	}
+	return NULL;
+}
+
+static int test_compare(struct libmnt_test *ts __attribute__((__unused__)),
+			int argc __attribute__((__unused__)),
+			char *argv[] __attribute__((__unused__)))
+{
+	struct libmnt_table *a, *b;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	int rc, ndiffs = 0;
+
+	a = mnt_new_table();
+	b = mnt_new_table();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!a || !b || !itr)
+		return -ENOMEM;
+
+	rc = mnt_table_fetch_listmount(a);
+	if (rc == -ENOSYS) {
+		printf("listmount() not supported\n");
+		rc = 0;
+		goto done;
+	}
+	if (!rc)
+		rc = mnt_table_parse_file(b, _PATH_PROC_MOUNTINFO);
+	if (rc)
+		goto done;
+
+	while (mnt_table_next_fs(b, itr, &fs) == 0) {
+		struct libmnt_fs *x = find_id(a, mnt_fs_get_id(fs));
+
+#define cmp_str(_x, _y, _name) \
+		if (strcmp(_x ? _x : "", _y ? _y : "") != 0) { \
+			printf("id=%d: %s: '%s' != '%s'\n", mnt_fs_get_id(fs), \
+					_name, _x, _y); \
+			ndiffs++; \
+		}
+		if (!x) {
+			printf("id=%d: missing\n", mnt_fs_get_id(fs));
+			ndiffs++;
+			continue;
+		}
+		cmp_str(mnt_fs_get_target(x), mnt_fs_get_target(fs), "target");
+		cmp_str(mnt_fs_get_root(x), mnt_fs_get_root(fs), "root");
+		cmp_str(mnt_fs_get_source(x), mnt_fs_get_source(fs), "source");
+		cmp_str(mnt_fs_get_fstype(x), mnt_fs_get_fstype(fs), "fstype");
+		cmp_str(mnt_fs_get_options(x), mnt_fs_get_options(fs), "options");
+		cmp_str(mnt_fs_get_optional_fields(x), mnt_fs_get_optional_fields(fs), "fields");
+		if (mnt_fs_get_devno(x) != mnt_fs_get_devno(fs)) {
+			printf("id=%d: devno mismatch\n", mnt_fs_get_id(fs));
+			ndiffs++;
+		}
+	}
+	printf("%d entries, %d differences\n", mnt_table_get_nents(b), ndiffs);
+	rc = ndiffs ? 1 : 0;
+done:
+	mnt_free_iter(itr);
+	mnt_unref_table(a);
+	mnt_unref_table(b);
+	return rc;
+}
+
+static int test_fetch(struct libmnt_test *ts __attribute__((__unused__)),
+		      int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	int rc;
+
+	tb = mnt_new_table();
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!tb || !itr)
+		return -ENOMEM;
+
+	if (argc > 1)
+		mnt_table_set_statmount_mask(tb, strtoull(argv[1], NULL, 0));
+
+	rc = mnt_table_fetch_listmount(tb);
+	if (rc)
+		goto done;
+
+	while (mnt_table_next_fs(tb, itr, &fs) == 0)
+		printf("%d %d %s %s %s\n", mnt_fs_get_id(fs), mnt_fs_get_parent_id(fs),
+				mnt_fs_get_source(fs), mnt_fs_get_target(fs),
+				mnt_fs_get_fstype(fs));
+done:
+	mnt_free_iter(itr);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct libmnt_test tss[] = {
+	{ "--compare", test_compare, "compare listmount and mountinfo based tables" },
+	{ "--fetch",   test_fetch,   "[<mask>] read the table by listmount" },
+	{ NULL }
+	};
+
+	return mnt_run_test(tss, argc, argv);
+}
+#endif /* TEST_PROGRAM */
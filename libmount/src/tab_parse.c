@@ -26,6 +26,7 @@
 #include "mountP.h"
 #include "pathnames.h"
 #include "strutils.h"
+#include "ultrace.h"
 
 struct libmnt_parser {
 	FILE	*f;		/* fstab, swaps or mountinfo ... */
@@ -33,8 +34,18 @@ struct libmnt_parser {
 	char	*buf;		/* buffer (the current line content) */
 	size_t	bufsiz;		/* size of the buffer */
 	size_t	line;		/* current line */
+
+	char	*zc_next;	/* zero-copy: next line in tb->strpool buffer */
+	char	*zc_end;	/* zero-copy: end of the buffer */
 };
 
+static inline int parser_eof(struct libmnt_parser *pa)
+{
+	if (pa->zc_end)
+		return pa->zc_next >= pa->zc_end;
+	return feof(pa->f);
+}
+
 static void parser_cleanup(struct libmnt_parser *pa)
 {
 	if (!pa)
@@ -43,19 +54,32 @@ static void parser_cleanup(struct libmnt_parser *pa)
 	memset(pa, 0, sizeof(*pa));
 }
 
+/*
+ * The numbers are usually plain decimals, the libc strto*() functions are
+ * used only as a fallback for anything else (e.g. leading '+').
+ */
 static const char *next_s32(const char *s, int *num, int *rc)
 {
 	char *end = NULL;
+	const char *p;
+	int64_t x;
 
 	if (!s || !*s)
 		return s;
 
-	errno = 0;
 	*rc = -EINVAL;
-	*num = strtol(s, &end, 10);
-	if (end == NULL || s == end)
-	       return s;
-	if (errno == 0 && (*end == ' ' || *end == '\t' || *end == '\0'))
+	if (ul_parse_s64(s, &x, &p) == 0) {
+		*num = (int) x;
+		end = (char *) p;
+	} else {
+		errno = 0;
+		*num = strtol(s, &end, 10);
+		if (end == NULL || s == end)
+		       return s;
+		if (errno != 0)
+			return end;
+	}
+	if (*end == ' ' || *end == '\t' || *end == '\0')
 		*rc = 0;
 	return end;
 }
@@ -63,20 +87,46 @@ static const char *next_s32(const char *s, int *num, int *rc)
 static const char *next_u64(const char *s, uint64_t *num, int *rc)
 {
 	char *end = NULL;
+	const char *p;
 
 	if (!s || !*s)
 		return s;
 
-	errno = 0;
 	*rc = -EINVAL;
-	*num = (uint64_t) strtoumax(s, &end, 10);
-	if (end == NULL || s == end)
-	       return s;
-	if (errno == 0 && (*end == ' ' || *end == '\t' || *end == '\0'))
+	if (ul_parse_u64(s, num, &p) == 0)
+		end = (char *) p;
+	else {
+		errno = 0;
+		*num = (uint64_t) strtoumax(s, &end, 10);
+		if (end == NULL || s == end)
+		       return s;
+		if (errno != 0)
+			return end;
+	}
+	if (*end == ' ' || *end == '\t' || *end == '\0')
 		*rc = 0;
 	return end;
 }
 
+/* parses "maj:min" without sscanf() if possible */
+static int parse_devno(const char *s, dev_t *devno)
+{
+	uint64_t maj, min;
+	unsigned int ma, mi;
+	const char *p;
+
+	if (ul_parse_u64(s, &maj, &p) == 0 && *p == ':'
+	    && ul_parse_u64(p + 1, &min, NULL) == 0
+	    && maj <= UINT_MAX && min <= UINT_MAX) {
+		*devno = makedev(maj, min);
+		return 0;
+	}
+	if (sscanf(s, "%u:%u", &ma, &mi) != 2)
+		return -EINVAL;
+	*devno = makedev(ma, mi);
+	return 0;
+}
+
 static inline const char *skip_separator(const char *p)
 {
 	while (p && (*p == ' ' || *p == '\t'))
@@ -179,7 +229,6 @@ fail:
 static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 {
 	int rc = 0;
-	unsigned int maj, min;
 	char *p;
 
 	fs->flags |= MNT_FS_KERNEL;
@@ -203,11 +252,10 @@ static int mnt_parse_mountinfo_line(struct libmnt_fs *fs, const char *s)
 	s = skip_separator(s);
 
 	/* (3) maj:min */
-	if (sscanf(s, "%u:%u", &maj, &min) != 2) {
+	if (parse_devno(s, &fs->devno) != 0) {
 		DBG(TAB, ul_debug("tab parse error: [maj:min]"));
 		goto fail;
 	}
-	fs->devno = makedev(maj, min);
 	s = skip_nonspearator(s);
 	s = skip_separator(s);
 
@@ -299,6 +347,266 @@ fail:
 	return rc;
 }
 
+/*
+ * Returns the next field from @s, the field is terminated and unmangled in
+ * place, @s is moved behind the field.
+ */
+static char *next_field_inplace(char **s)
+{
+	char *p = (char *) skip_separator(*s);
+	char *end;
+
+	if (!p || !*p)
+		return NULL;
+
+	end = (char *) skip_nonspearator(p);
+	if (*end)
+		*end++ = '\0';
+	*s = end;
+
+	unmangle_string(p);
+	return p;
+}
+
+/*
+ * Interns the allocated @str; on success @str is deallocated and @dest points
+ * to the pool, otherwise @dest owns @str.
+ */
+static void set_interned(struct libmnt_table *tb, struct libmnt_fs *fs,
+			 char **dest, char *str, unsigned int bit)
+{
+	const char *x = str ? __mnt_strpool_intern(tb->strpool, str) : NULL;
+
+	if (x) {
+		free(str);
+		*dest = (char *) x;
+		fs->pooled |= bit;
+	} else
+		*dest = str;
+}
+
+/*
+ * Parses one line from {fs,m}tab in the tb->strpool buffer. The same as
+ * mnt_parse_table_line(), but the fields are slices of the line. The options
+ * are split on the first use, see mnt_fs_split_options().
+ */
+static int mnt_parse_table_line_zc(struct libmnt_table *tb,
+				   struct libmnt_fs *fs, char *s)
+{
+	int rc = 0;
+	char *src, *target, *type, *opts;
+
+	assert(tb->strpool);
+
+	fs->passno = fs->freq = 0;
+
+	/* (1) source, (2) target, (3) FS type */
+	src = next_field_inplace(&s);
+	target = next_field_inplace(&s);
+	type = next_field_inplace(&s);
+	if (!src || !target || !type) {
+		DBG(TAB, ul_debug("tab parse error: [source, target or fstype]"));
+		goto fail;
+	}
+
+	/* (4) options (optional) */
+	opts = next_field_inplace(&s);
+	if (opts) {
+		s = (char *) skip_separator(s);
+
+		/* (5) freq (optional) */
+		if (s && *s) {
+			s = (char *) next_s32(s, &fs->freq, &rc);
+			if (s && *s && rc) {
+				DBG(TAB, ul_debug("tab parse error: [freq]"));
+				goto fail;
+			}
+			s = (char *) skip_separator(s);
+		}
+
+		/* (6) passno (optional) */
+		if (s && *s) {
+			s = (char *) next_s32(s, &fs->passno, &rc);
+			if (s && *s && rc) {
+				DBG(TAB, ul_debug("tab parse error: [passno]"));
+				goto fail;
+			}
+		}
+	}
+
+	/* all fields parsed, attach them to @fs */
+	__mnt_ref_strpool(tb->strpool);
+	fs->strpool = tb->strpool;
+
+	rc = __mnt_fs_set_source_ptr(fs, src);
+	if (rc) {
+		DBG(TAB, ul_debug("tab parse error: [source]"));
+		goto fail;
+	}
+	fs->pooled |= MNT_POOL_SOURCE;
+	__mnt_fs_set_fstype_ptr(fs, type);
+	fs->pooled |= MNT_POOL_FSTYPE;
+	fs->target = target;
+	fs->pooled |= MNT_POOL_TARGET;
+
+	if (opts) {
+		fs->optstr = opts;
+		fs->pooled |= MNT_POOL_OPTSTR;
+		fs->flags |= MNT_FS_UNSPLIT;
+	}
+	return 0;
+fail:
+	if (rc == 0)
+		rc = -EINVAL;
+	DBG(TAB, ul_debug("tab parse error on: '%s' [rc=%d]", s, rc));
+	return rc;
+}
+
+/*
+ * Parses one line from a mountinfo file in the tb->strpool buffer. The same
+ * as mnt_parse_mountinfo_line(), but the strings are not allocated; the
+ * fields are slices of the line and the merged options string is interned.
+ */
+static int mnt_parse_mountinfo_line_zc(struct libmnt_table *tb,
+				       struct libmnt_fs *fs, char *s)
+{
+	int rc = 0;
+	char *root, *target, *vfs, *fields = NULL, *type, *src = NULL, *fsopts;
+	char *p, *end;
+
+	assert(tb->strpool);
+
+	fs->flags |= MNT_FS_KERNEL;
+
+	/* (1) id */
+	s = (char *) next_s32(s, &fs->id, &rc);
+	if (!s || !*s || rc) {
+		DBG(TAB, ul_debug("tab parse error: [id]"));
+		goto fail;
+	}
+
+	s = (char *) skip_separator(s);
+
+	/* (2) parent */
+	s = (char *) next_s32(s, &fs->parent, &rc);
+	if (!s || !*s || rc) {
+		DBG(TAB, ul_debug("tab parse error: [parent]"));
+		goto fail;
+	}
+
+	s = (char *) skip_separator(s);
+
+	/* (3) maj:min */
+	if (parse_devno(s, &fs->devno) != 0) {
+		DBG(TAB, ul_debug("tab parse error: [maj:min]"));
+		goto fail;
+	}
+	s = (char *) skip_nonspearator(s);
+
+	/* (4) mountroot, (5) target */
+	root = next_field_inplace(&s);
+	target = next_field_inplace(&s);
+	if (!root || !target) {
+		DBG(TAB, ul_debug("tab parse error: [mountroot or target]"));
+		goto fail;
+	}
+
+	/* (6) vfs options, (7) optional fields, terminated by " - " */
+	vfs = (char *) skip_separator(s);
+	end = (char *) skip_nonspearator(vfs);
+	if (end == vfs) {
+		DBG(TAB, ul_debug("tab parse error: [VFS options]"));
+		goto fail;
+	}
+	p = strstr(end, " - ");
+	if (!p) {
+		DBG(TAB, ul_debug("mountinfo parse error: separator not found"));
+		return -EINVAL;
+	}
+	if (p > end + 1) {
+		fields = end + 1;
+		*p = '\0';
+	}
+	s = p + 3;
+	*end = '\0';
+	unmangle_string(vfs);
+
+	/* (8) FS type */
+	type = (char *) skip_separator(s);
+	end = (char *) skip_nonspearator(type);
+	if (end == type || !*end) {
+		DBG(TAB, ul_debug("tab parse error: [fstype]"));
+		goto fail;
+	}
+
+	/* (9) source -- maybe empty string */
+	if (*(end + 1) != ' ') {
+		s = end + 1;
+		src = next_field_inplace(&s);
+		if (!src) {
+			DBG(TAB, ul_debug("tab parse error: [regular source]"));
+			goto fail;
+		}
+	} else
+		s = end + 1;
+	*end = '\0';
+	unmangle_string(type);
+
+	/* (10) fs options (fs specific) */
+	fsopts = next_field_inplace(&s);
+	if (!fsopts) {
+		DBG(TAB, ul_debug("tab parse error: [FS options]"));
+		goto fail;
+	}
+
+	/* all fields parsed, attach them to @fs */
+	__mnt_ref_strpool(tb->strpool);
+	fs->strpool = tb->strpool;
+
+	if (src) {
+		rc = __mnt_fs_set_source_ptr(fs, src);
+		if (!rc)
+			fs->pooled |= MNT_POOL_SOURCE;
+	} else
+		rc = mnt_fs_set_source(fs, "");
+	if (rc) {
+		DBG(TAB, ul_debug("tab parse error: [source]"));
+		goto fail;
+	}
+	rc = __mnt_fs_set_fstype_ptr(fs, type);
+	if (rc) {
+		DBG(TAB, ul_debug("tab parse error: [fstype]"));
+		goto fail;
+	}
+	fs->pooled |= MNT_POOL_FSTYPE;
+
+	fs->root = root;
+	fs->target = target;
+	fs->vfs_optstr = vfs;
+	fs->fs_optstr = fsopts;
+	fs->pooled |= MNT_POOL_ROOT | MNT_POOL_TARGET
+		    | MNT_POOL_VFS_OPTSTR | MNT_POOL_FS_OPTSTR;
+	if (fields) {
+		fs->opt_fields = fields;
+		fs->pooled |= MNT_POOL_OPT_FIELDS;
+	}
+
+	/* merge VFS and FS options to one string */
+	p = mnt_fs_strdup_options(fs);
+	if (!p) {
+		rc = -ENOMEM;
+		DBG(TAB, ul_debug("tab parse error: [merge VFS and FS options]"));
+		goto fail;
+	}
+	set_interned(tb, fs, &fs->optstr, p, MNT_POOL_OPTSTR);
+	return 0;
+fail:
+	if (rc == 0)
+		rc = -EINVAL;
+	DBG(TAB, ul_debug("tab parse error on: '%s' [rc=%d]", s, rc));
+	return rc;
+}
+
 /*
  * Parses one line from utab file
  */
@@ -335,9 +643,11 @@ static int mnt_parse_utab_line(struct libmnt_fs *fs, const char *s)
 			if (!fs->root)
 				goto enomem;
 
-		} else if (!fs->bindsrc && !strncmp(p, "BINDSRC=", 8)) {
-			fs->bindsrc = unmangle(p + 8, &end);
-			if (!fs->bindsrc)
+		} else if (!mnt_fs_ext(fs, bindsrc) && !strncmp(p, "BINDSRC=", 8)) {
+			if (!__mnt_fs_get_ext(fs))
+				goto enomem;
+			fs->ext->bindsrc = unmangle(p + 8, &end);
+			if (!fs->ext->bindsrc)
 				goto enomem;
 
 		} else if (!fs->user_optstr && !strncmp(p, "OPTS=", 5)) {
@@ -345,11 +655,21 @@ static int mnt_parse_utab_line(struct libmnt_fs *fs, const char *s)
 			if (!fs->user_optstr)
 				goto enomem;
 
-		} else if (!fs->attrs && !strncmp(p, "ATTRS=", 6)) {
-			fs->attrs = unmangle(p + 6, &end);
-			if (!fs->attrs)
+		} else if (!mnt_fs_ext(fs, attrs) && !strncmp(p, "ATTRS=", 6)) {
+			if (!__mnt_fs_get_ext(fs))
+				goto enomem;
+			fs->ext->attrs = unmangle(p + 6, &end);
+			if (!fs->ext->attrs)
 				goto enomem;
 
+		} else if (!strncmp(p, "OP=del ", 7)) {
+			fs->flags |= MNT_FS_UTAB_DEL;
+			end = p + 7;
+
+		} else if (!strncmp(p, "OP=mod ", 7)) {
+			fs->flags |= MNT_FS_UTAB_MOD;
+			end = p + 7;
+
 		} else {
 			/* unknown variable */
 			while (*p && *p != ' ') p++;
@@ -369,10 +689,15 @@ enomem:
  */
 static int mnt_parse_swaps_line(struct libmnt_fs *fs, const char *s)
 {
+	struct libmnt_fs_ext *ext;
 	uint64_t num;
 	int rc = 0;
 	char *p;
 
+	ext = __mnt_fs_get_ext(fs);
+	if (!ext)
+		return -ENOMEM;
+
 	/* (1) source */
 	p = unmangle(s, &s);
 	if (p) {
@@ -389,8 +714,8 @@ static int mnt_parse_swaps_line(struct libmnt_fs *fs, const char *s)
 	s = skip_separator(s);
 
 	/* (2) type */
-	fs->swaptype = unmangle(s, &s);
-	if (!fs->swaptype) {
+	ext->swaptype = unmangle(s, &s);
+	if (!ext->swaptype) {
 		DBG(TAB, ul_debug("tab parse error: [swaptype]"));
 		goto fail;
 	}
@@ -403,7 +728,7 @@ static int mnt_parse_swaps_line(struct libmnt_fs *fs, const char *s)
 		DBG(TAB, ul_debug("tab parse error: [size]"));
 		goto fail;
 	}
-	fs->size = num;
+	ext->size = num;
 
 	s = skip_separator(s);
 
@@ -413,12 +738,12 @@ static int mnt_parse_swaps_line(struct libmnt_fs *fs, const char *s)
 		DBG(TAB, ul_debug("tab parse error: [used size]"));
 		goto fail;
 	}
-	fs->usedsize = num;
+	ext->usedsize = num;
 
 	s = skip_separator(s);
 
 	/* (5) priority */
-	s = next_s32(s, &fs->priority, &rc);
+	s = next_s32(s, &ext->priority, &rc);
 	if (rc) {
 		DBG(TAB, ul_debug("tab parse error: [priority]"));
 		goto fail;
@@ -535,7 +860,7 @@ static int mnt_table_parse_next(struct libmnt_parser *pa,
 				struct libmnt_table *tb,
 				struct libmnt_fs *fs)
 {
-	char *s;
+	char *s, *buf;
 	int rc;
 
 	assert(tb);
@@ -545,6 +870,19 @@ static int mnt_table_parse_next(struct libmnt_parser *pa,
 	/* read the next non-blank non-comment line */
 next_line:
 	do {
+		if (pa->zc_end) {
+			/* zero-copy, the line is terminated in the buffer */
+			if (pa->zc_next >= pa->zc_end)
+				return -EINVAL;
+			pa->line++;
+			buf = pa->zc_next;
+			s = memchr(buf, '\n', pa->zc_end - buf);
+			if (!s)
+				s = pa->zc_end;
+			pa->zc_next = s + 1;
+			goto terminate;
+		}
+
 		if (getline(&pa->buf, &pa->bufsiz, pa->f) < 0)
 			return -EINVAL;
 		pa->line++;
@@ -553,6 +891,10 @@ next_line:
 			DBG(TAB, ul_debugobj(tb, "%s:%zu: no final newline",
 						pa->filename, pa->line));
 
+			/* utab record being appended right now */
+			if (tb->fmt == MNT_FMT_UTAB && feof(pa->f))
+				return -EINVAL;
+
 			/* Missing final newline?  Otherwise an extremely */
 			/* long line - assume file was corrupted */
 			if (feof(pa->f))
@@ -575,12 +917,14 @@ next_line:
 
 		}
 
+		buf = pa->buf;
 		if (!s)
 			goto err;
+terminate:
 		*s = '\0';
-		if (s > pa->buf && *(s - 1)  == '\r')
+		if (s > buf && *(s - 1)  == '\r')
 			*(--s) = '\0';
-		s = (char *) skip_blank(pa->buf);
+		s = (char *) skip_blank(buf);
 	} while (*s == '\0' || *s == '#');
 
 	if (tb->fmt == MNT_FMT_GUESS) {
@@ -591,10 +935,16 @@ next_line:
 
 	switch (tb->fmt) {
 	case MNT_FMT_FSTAB:
-		rc = mnt_parse_table_line(fs, s);
+		if (pa->zc_end)
+			rc = mnt_parse_table_line_zc(tb, fs, s);
+		else
+			rc = mnt_parse_table_line(fs, s);
 		break;
 	case MNT_FMT_MOUNTINFO:
-		rc = mnt_parse_mountinfo_line(fs, s);
+		if (pa->zc_end)
+			rc = mnt_parse_mountinfo_line_zc(tb, fs, s);
+		else
+			rc = mnt_parse_mountinfo_line(fs, s);
 		break;
 	case MNT_FMT_UTAB:
 		rc = mnt_parse_utab_line(fs, s);
@@ -623,6 +973,44 @@ err:
 	return tb->errcb ? tb->errcb(tb, pa->filename, pa->line) : 1;
 }
 
+/*
+ * The utab is append-only between rewrites (see tab_update.c), the OP=del
+ * and OP=mod records are applied to the last entry with the same target.
+ *
+ * Returns: 1 if the record has been applied, 0 if @fs has to be added.
+ */
+static int apply_utab_record(struct libmnt_table *tb, struct libmnt_fs *fs)
+{
+	struct libmnt_fs *cur = NULL, *x;
+	struct libmnt_iter itr;
+	const char *tgt = mnt_fs_get_target(fs);
+
+	if (!tgt)
+		return 1;
+
+	mnt_reset_iter(&itr, MNT_ITER_BACKWARD);
+	while (mnt_table_next_fs(tb, &itr, &x) == 0) {
+		if (mnt_fs_streq_target(x, tgt)) {
+			cur = x;
+			break;
+		}
+	}
+
+	if (fs->flags & MNT_FS_UTAB_DEL) {
+		if (cur)
+			mnt_table_remove_fs(tb, cur);
+		return 1;
+	}
+
+	fs->flags &= ~MNT_FS_UTAB_MOD;
+	if (!cur)
+		return 0;	/* not found, add new */
+
+	if (mnt_fs_set_attributes(cur, mnt_fs_get_attributes(fs)) == 0)
+		mnt_fs_set_options(cur, mnt_fs_get_user_options(fs));
+	return 1;
+}
+
 static pid_t path_to_tid(const char *filename)
 {
 	char *path = mnt_resolve_path(filename, NULL);
@@ -652,9 +1040,9 @@ done:
 	return tid;
 }
 
-static int kernel_fs_postparse(struct libmnt_table *tb,
-			       struct libmnt_fs *fs, pid_t *tid,
-			       const char *filename)
+int __mnt_kernel_fs_postparse(struct libmnt_table *tb,
+			      struct libmnt_fs *fs, pid_t *tid,
+			      const char *filename)
 {
 	int rc = 0;
 	const char *src = mnt_fs_get_srcpath(fs);
@@ -691,6 +1079,65 @@ static int kernel_fs_postparse(struct libmnt_table *tb,
 	return rc;
 }
 
+/*
+ * Reads the whole stream to one buffer owned by tb->strpool for the zero-copy
+ * mountinfo parser.
+ */
+static int parser_read_stream(struct libmnt_parser *pa, struct libmnt_table *tb)
+{
+	size_t sz = 0, bufsz = 0;
+	char *buf = NULL;
+	int rc;
+
+	if (!tb->strpool) {
+		tb->strpool = __mnt_new_strpool();
+		if (!tb->strpool)
+			return -ENOMEM;
+	}
+
+	do {
+		size_t n;
+
+		if (bufsz - sz < BUFSIZ) {
+			char *x;
+
+			bufsz = bufsz ? bufsz * 2 : 64 * 1024;
+			x = realloc(buf, bufsz);
+			if (!x) {
+				free(buf);
+				return -ENOMEM;
+			}
+			buf = x;
+		}
+		n = fread(buf + sz, 1, bufsz - sz - 1, pa->f);
+		if (n == 0)
+			break;
+		sz += n;
+	} while (1);
+
+	if (ferror(pa->f)) {
+		rc = errno ? -errno : -EIO;
+		free(buf);
+		return rc;
+	}
+	if (bufsz - sz > BUFSIZ) {
+		char *x = realloc(buf, sz + 1);	/* don't keep unused space */
+		if (x)
+			buf = x;
+	}
+	buf[sz] = '\0';
+
+	rc = __mnt_strpool_add_buffer(tb->strpool, buf);
+	if (rc)
+		return rc;
+
+	pa->zc_next = buf;
+	pa->zc_end = buf + sz;
+
+	DBG(TAB, ul_debugobj(tb, "%s: zero-copy parsing [size=%zu]", pa->filename, sz));
+	return 0;
+}
+
 /**
  * mnt_table_parse_stream:
  * @tb: tab pointer
@@ -705,11 +1152,15 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	int flags = 0;
 	pid_t tid = -1;
 	struct libmnt_parser pa = { .line = 0 };
+	struct ul_trace_span sp;
 
 	assert(tb);
 	assert(f);
 	assert(filename);
 
+	ul_trace_begin(&sp, "mount:parse");
+	UL_PROBE1(libmount, parse__begin, filename);
+
 	DBG(TAB, ul_debugobj(tb, "%s: start parsing [entries=%d, filter=%s]",
 				filename, mnt_table_get_nents(tb),
 				tb->fltrcb ? "yes" : "not"));
@@ -717,6 +1168,16 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	pa.filename = filename;
 	pa.f = f;
 
+	if ((tb->zerocopy || tb->arena) && !tb->comms) {
+		rc = parser_read_stream(&pa, tb);
+		if (rc)
+			goto err;
+	} else if (tb->arena && !tb->strpool) {
+		tb->strpool = __mnt_new_strpool();
+		if (!tb->strpool)
+			goto err;
+	}
+
 	/* necessary for /proc/mounts only, the /proc/self/mountinfo
 	 * parser sets the flag properly
 	 */
@@ -728,11 +1189,11 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	do {
 		struct libmnt_fs *fs;
 
-		if (feof(f)) {
+		if (parser_eof(&pa)) {
 			DBG(TAB, ul_debugobj(tb, "end-of-file"));
 			break;
 		}
-		fs = mnt_new_fs();
+		fs = tb->arena ? __mnt_new_fs_from_pool(tb->strpool) : mnt_new_fs();
 		if (!fs)
 			goto err;
 
@@ -742,13 +1203,17 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 		if (rc == 0 && tb->fltrcb && tb->fltrcb(fs, tb->fltrcb_data))
 			rc = 1;	/* filtered out by callback... */
 
+		if (rc == 0 && (fs->flags & (MNT_FS_UTAB_DEL | MNT_FS_UTAB_MOD))
+		    && apply_utab_record(tb, fs))
+			rc = 1;
+
 		/* add to the table */
 		if (rc == 0) {
 			rc = mnt_table_add_fs(tb, fs);
 			fs->flags |= flags;
 
 			if (rc == 0 && tb->fmt == MNT_FMT_MOUNTINFO) {
-				rc = kernel_fs_postparse(tb, fs, &tid, filename);
+				rc = __mnt_kernel_fs_postparse(tb, fs, &tid, filename);
 				if (rc)
 					mnt_table_remove_fs(tb, fs);
 			}
@@ -764,7 +1229,7 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 		}
 
 		/* fatal errors */
-		if (rc < 0 && !feof(f)) {
+		if (rc < 0 && !parser_eof(&pa)) {
 			DBG(TAB, ul_debugobj(tb, "fatal error"));
 			goto err;
 		}
@@ -773,10 +1238,14 @@ int mnt_table_parse_stream(struct libmnt_table *tb, FILE *f, const char *filenam
 	DBG(TAB, ul_debugobj(tb, "%s: stop parsing (%d entries)",
 				filename, mnt_table_get_nents(tb)));
 	parser_cleanup(&pa);
+	UL_PROBE3(libmount, parse__end, filename, mnt_table_get_nents(tb), 0);
+	ul_trace_end(&sp);
 	return 0;
 err:
 	DBG(TAB, ul_debugobj(tb, "%s: parse error (rc=%d)", filename, rc));
 	parser_cleanup(&pa);
+	UL_PROBE3(libmount, parse__end, filename, mnt_table_get_nents(tb), rc);
+	ul_trace_end(&sp);
 	return rc;
 }
 
@@ -1164,7 +1633,7 @@ static struct libmnt_fs *mnt_table_merge_user_fs(struct libmnt_table *tb, struct
 int __mnt_table_parse_mountinfo(struct libmnt_table *tb, const char *filename,
 			   struct libmnt_table *u_tb)
 {
-	int rc = 0, priv_utab = 0;
+	int rc = 0;
 	int explicit_file = filename ? 1 : 0;
 
 	assert(tb);
@@ -1179,6 +1648,15 @@ int __mnt_table_parse_mountinfo(struct libmnt_table *tb, const char *filename,
 	} else
 		tb->fmt = MNT_FMT_GUESS;
 
+	if (tb->listmount && tb->fmt == MNT_FMT_MOUNTINFO) {
+		rc = mnt_table_fetch_listmount(tb);
+		if (rc == 0)
+			goto utab;
+		if (rc != -ENOSYS)
+			return rc;
+		DBG(TAB, ul_debugobj(tb, "listmount unsupported, fallback to mountinfo"));
+	}
+
 	rc = mnt_table_parse_file(tb, filename);
 	if (rc) {
 		if (explicit_file)
@@ -1189,8 +1667,21 @@ int __mnt_table_parse_mountinfo(struct libmnt_table *tb, const char *filename,
 		return mnt_table_parse_file(tb, _PATH_PROC_MOUNTS);
 	}
 
+utab:
 	if (!is_mountinfo(tb))
 		return 0;
+
+	return __mnt_table_merge_utab(tb, u_tb);
+}
+
+/*
+ * Merges user specific information from /run/mount/utab (or from @u_tb) to
+ * the kernel mount table @tb. Already merged entries are ignored.
+ */
+int __mnt_table_merge_utab(struct libmnt_table *tb, struct libmnt_table *u_tb)
+{
+	int rc = 0, priv_utab = 0;
+
 	DBG(TAB, ul_debugobj(tb, "mountinfo parse: #2 read utab"));
 
 	if (mnt_table_get_nents(tb) == 0)
@@ -1233,6 +1724,7 @@ int __mnt_table_parse_mountinfo(struct libmnt_table *tb, const char *filename,
 		mnt_unref_table(u_tb);
 	return 0;
 }
+
 /**
  * mnt_table_parse_mtab:
  * @tb: table
@@ -19,6 +19,13 @@
  * userspace independently of system configuration. The userspace mount options
  * (e.g. user=) are stored in the /run/mount/utab file.
  *
+ * The file is rewritten under an exclusive lock for every change by default.
+ * With LIBMOUNT_UTAB_APPEND=yes the new entries and the changes are appended
+ * to the file (under a shared lock, so the concurrent mounts don't wait for
+ * each other), the file is rewritten (compacted) only for move and when it's
+ * mostly removed entries. It's opt-in, the older libmount versions don't
+ * understand the appended "OP=" records.
+ *
  * It's recommended to use high-level struct libmnt_context API.
  */
 #include <sys/file.h>
@@ -29,6 +36,11 @@
 #include "mangle.h"
 #include "pathnames.h"
 #include "strutils.h"
+#include "all-io.h"
+#include "env.h"
+
+/* don't try to compact smaller utab */
+#define MNT_UTAB_COMPACT_SIZE	(16 * 1024)
 
 struct libmnt_update {
 	char		*target;
@@ -645,6 +657,117 @@ leave:
 	return rc;
 }
 
+/*
+ * Appends one utab record by one write(). The @op is NULL for a new entry,
+ * "del" or "mod", see apply_utab_record() in tab_parse.c.
+ */
+static int append_record(struct libmnt_update *upd, struct libmnt_lock *lc,
+			 const char *op, struct libmnt_fs *fs)
+{
+	char *buf = NULL;
+	size_t sz = 0;
+	FILE *f;
+	int rc = 0, fd;
+
+	f = open_memstream(&buf, &sz);
+	if (!f)
+		return -errno;
+	if (op) {
+		fprintf(f, "OP=%s ", op);
+		if (strcmp(op, "del") == 0) {
+			char *p = mangle(mnt_fs_get_target(fs));
+
+			rc = p ? fprintf(f, "TARGET=%s\n", p) : -ENOMEM;
+			free(p);
+			if (rc > 0)
+				rc = 0;
+		} else
+			rc = fprintf_utab_fs(f, fs);
+	} else
+		rc = fprintf_utab_fs(f, fs);
+	if (fclose(f) != 0 && !rc)
+		rc = -errno;
+	if (rc)
+		goto done;
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: append %s record", upd->filename, op ? : "new"));
+
+	if (lc && mnt_lock_file_shared(lc) != 0) {
+		rc = -MNT_ERR_LOCK;
+		goto done;
+	}
+
+	fd = open(upd->filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd >= 0) {
+		struct stat st;
+
+		/* new file, don't depend on umask */
+		if (fstat(fd, &st) == 0 && st.st_size == 0)
+			fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+		rc = write_all(fd, buf, sz) ? -errno : 0;
+		close(fd);
+	} else
+		rc = -errno;
+
+	if (lc)
+		mnt_unlock_file(lc);
+done:
+	free(buf);
+	return rc;
+}
+
+/*
+ * Rewrites utab if it's mostly removed entries. It's skipped if anyone else
+ * uses the file right now, the next update will try it again.
+ */
+static void compact_table(struct libmnt_update *upd, struct libmnt_lock *lc)
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+	struct stat st;
+	char *buf = NULL;
+	size_t sz = 0;
+	FILE *f;
+
+	if (!lc || stat(upd->filename, &st) != 0
+	    || st.st_size < MNT_UTAB_COMPACT_SIZE)
+		return;
+	if (mnt_trylock_file(lc) != 0)
+		return;
+
+	tb = __mnt_new_table_from_file(upd->filename, MNT_FMT_UTAB, 1);
+	if (!tb)
+		goto done;
+
+	/* size of the compacted file */
+	f = open_memstream(&buf, &sz);
+	if (!f)
+		goto done;
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+		fprintf_utab_fs(f, fs);
+	fclose(f);
+
+	if (stat(upd->filename, &st) == 0 && (size_t) st.st_size > 2 * sz) {
+		DBG(UPDATE, ul_debugobj(upd, "%s: compacting %zu -> %zu bytes",
+				upd->filename, (size_t) st.st_size, sz));
+		update_table(upd, tb);
+	}
+done:
+	mnt_unlock_file(lc);
+	mnt_unref_table(tb);
+	free(buf);
+}
+
+static int utab_append_enabled(void)
+{
+	const char *env = safe_getenv("LIBMOUNT_UTAB_APPEND");
+
+	return env && strcmp(env, "yes") == 0;
+}
+
 static int add_file_entry(struct libmnt_table *tb, struct libmnt_update *upd)
 {
 	struct libmnt_fs *fs;
@@ -671,6 +794,9 @@ static int update_add_entry(struct libmnt_update *upd, struct libmnt_lock *lc)
 
 	DBG(UPDATE, ul_debugobj(upd, "%s: add entry", upd->filename));
 
+	if (utab_append_enabled())
+		return append_record(upd, lc, NULL, upd->fs);
+
 	if (lc)
 		rc = mnt_lock_file(lc);
 	if (rc)
@@ -689,13 +815,15 @@ static int update_add_entry(struct libmnt_update *upd, struct libmnt_lock *lc)
 static int update_remove_entry(struct libmnt_update *upd, struct libmnt_lock *lc)
 {
 	struct libmnt_table *tb;
-	int rc = 0;
+	int rc = 0, append = utab_append_enabled();
 
 	assert(upd);
 	assert(upd->target);
 
 	DBG(UPDATE, ul_debugobj(upd, "%s: remove entry", upd->filename));
 
+	/* exclusive lock also for append, the entry must not be removed (or
+	 * added again) by anyone else between the read and the "del" record */
 	if (lc)
 		rc = mnt_lock_file(lc);
 	if (rc)
@@ -704,7 +832,9 @@ static int update_remove_entry(struct libmnt_update *upd, struct libmnt_lock *lc
 	tb = __mnt_new_table_from_file(upd->filename, MNT_FMT_UTAB, 1);
 	if (tb) {
 		struct libmnt_fs *rem = mnt_table_find_target(tb, upd->target, MNT_ITER_BACKWARD);
-		if (rem) {
+		if (rem && append)
+			rc = append_record(upd, NULL, "del", rem);
+		else if (rem) {
 			mnt_table_remove_fs(tb, rem);
 			rc = update_table(upd, tb);
 		}
@@ -712,6 +842,9 @@ static int update_remove_entry(struct libmnt_update *upd, struct libmnt_lock *lc
 	if (lc)
 		mnt_unlock_file(lc);
 
+	if (!rc && append)
+		compact_table(upd, lc);
+
 	mnt_unref_table(tb);
 	return rc;
 }
@@ -792,6 +925,9 @@ static int update_modify_options(struct libmnt_update *upd, struct libmnt_lock *
 
 	DBG(UPDATE, ul_debugobj(upd, "%s: modify options", upd->filename));
 
+	if (utab_append_enabled())
+		return append_record(upd, lc, "mod", upd->fs);
+
 	fs = upd->fs;
 
 	if (lc)
@@ -889,7 +1025,7 @@ int mnt_update_already_done(struct libmnt_update *upd, struct libmnt_lock *lc)
 			mnt_lock_block_signals(lc, TRUE);
 	}
 	if (lc) {
-		rc = mnt_lock_file(lc);
+		rc = mnt_lock_file_shared(lc);
 		if (rc) {
 			rc = -MNT_ERR_LOCK;
 			goto done;
@@ -1044,6 +1180,27 @@ static int test_replace(struct libmnt_test *ts, int argc, char *argv[])
 	return rc;
 }
 
+/* prints utab with the appended changes applied */
+static int test_show(struct libmnt_test *ts __attribute__((unused)),
+		     int argc __attribute__((unused)),
+		     char *argv[] __attribute__((unused)))
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	tb = __mnt_new_table_from_file(mnt_get_utab_path(), MNT_FMT_UTAB, 1);
+	if (!tb)
+		return -1;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+		fprintf_utab_fs(stdout, fs);
+
+	mnt_unref_table(tb);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
@@ -1052,6 +1209,7 @@ int main(int argc, char *argv[])
 	{ "--move",   test_move,    "<old_target>  <target>        MS_MOVE mtab change" },
 	{ "--remount",test_remount, "<target>  <options>           MS_REMOUNT mtab change" },
 	{ "--replace",test_replace, "<src> <target>                Add a line to LIBMOUNT_FSTAB and replace the original file" },
+	{ "--show",   test_show,    "                              print utab with the changes applied" },
 	{ NULL }
 	};
 
@@ -32,6 +32,7 @@
 #include "statfs_magic.h"
 #include "sysfs.h"
 #include "namespace.h"
+#include "procsnap.h"
 
 /*
  * Return 1 if the file is not accessible or empty
@@ -503,7 +504,7 @@ static int get_filesystems(const char *filename, char ***filesystems, const char
 	FILE *f;
 	char line[129];
 
-	f = fopen(filename, "r" UL_CLOEXECSTR);
+	f = ul_procsnap_fopen(filename);
 	if (!f)
 		return 1;
 
@@ -125,23 +125,33 @@ fail:
 	return NULL;
 }
 
+static ssize_t read_column_data(FILE *f, char **str, size_t *len)
+{
+	ssize_t i = getline(str, len, f);
+	char *p;
+
+	if (i == -1)
+		return -1;
+
+	p = strrchr(*str, '\n');
+	if (p)
+		*p = '\0';
+
+	while ((p = strrchr(*str, '\\')) && *(p + 1) == 'n') {
+		*p = '\n';
+		memmove(p + 1, p + 2, i - (p + 2 - *str));
+	}
+	return i;
+}
+
 static int parse_column_data(FILE *f, struct libscols_table *tb, int col)
 {
 	size_t len = 0, nlines = 0;
-	int i;
 	char *str = NULL;
 
-	while ((i = getline(&str, &len, f)) != -1) {
+	while (read_column_data(f, &str, &len) != -1) {
 
 		struct libscols_line *ln;
-		char *p = strrchr(str, '\n');
-		if (p)
-			*p = '\0';
-
-		while ((p = strrchr(str, '\\')) && *(p + 1) == 'n') {
-			*p = '\n';
-			memmove(p + 1, p + 2, i - (p + 2 - str));
-		}
 
 		ln = scols_table_get_line(tb, nlines++);
 		if (!ln)
@@ -156,6 +166,43 @@ static int parse_column_data(FILE *f, struct libscols_table *tb, int col)
 
 }
 
+/* add lines one by one, all columns data for the line are set after
+ * scols_table_add_line() as required by streaming mode */
+static void stream_column_data(struct libscols_table *tb, int nlines,
+			       char **files, int nfiles)
+{
+	FILE **fs = xcalloc(nfiles, sizeof(FILE *));
+	size_t len = 0;
+	char *str = NULL;
+	int n, i;
+
+	for (i = 0; i < nfiles; i++) {
+		fs[i] = fopen(files[i], "r");
+		if (!fs[i])
+			err(EXIT_FAILURE, "%s: open failed", files[i]);
+	}
+
+	for (n = 0; n < nlines; n++) {
+		struct libscols_line *ln = scols_new_line();
+
+		if (!ln || scols_table_add_line(tb, ln))
+			err(EXIT_FAILURE, "failed to add a new line");
+
+		for (i = 0; i < nfiles; i++) {
+			if (read_column_data(fs[i], &str, &len) == -1)
+				continue;
+			if (*str && scols_line_set_data(ln, i, str) != 0)
+				err(EXIT_FAILURE, "failed to add output data");
+		}
+		scols_unref_line(ln);
+	}
+
+	for (i = 0; i < nfiles; i++)
+		fclose(fs[i]);
+	free(fs);
+	free(str);
+}
+
 static struct libscols_line *get_line_with_id(struct libscols_table *tb,
 						int col_id, const char *id)
 {
@@ -194,6 +241,25 @@ static void compose_tree(struct libscols_table *tb, int parent_col, int id_col)
 }
 
 
+static void apply_filter(struct libscols_table *tb, const char *expr)
+{
+	struct libscols_iter *itr;
+	struct libscols_line *ln;
+
+	if (scols_table_set_filter(tb, expr) != 0)
+		errx(EXIT_FAILURE, "%s", scols_table_get_filter_errmsg(tb));
+
+	itr = scols_new_iter(SCOLS_ITER_FORWARD);
+	if (!itr)
+		err(EXIT_FAILURE, "failed to allocate iterator");
+
+	while (scols_table_next_line(tb, itr, &ln) == 0) {
+		if (scols_table_filter_line(tb, ln) == 0)
+			scols_table_remove_line(tb, ln);
+	}
+	scols_free_iter(itr);
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -205,12 +271,15 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(" -c, --column <file>            column definition\n", out);
 	fputs(" -n, --nlines <num>             number of lines\n", out);
 	fputs(" -J, --json                     JSON output format\n", out);
+	fputs(" -B, --cbor                     CBOR output format\n", out);
 	fputs(" -r, --raw                      RAW output format\n", out);
 	fputs(" -E, --export                   use key=\"value\" output format\n", out);
 	fputs(" -C, --colsep <str>             set columns separator\n", out);
 	fputs(" -w, --width <num>              hardcode terminal width\n", out);
 	fputs(" -p, --tree-parent-column <n>   parent column\n", out);
 	fputs(" -i, --tree-id-column <n>       id column\n", out);
+	fputs(" -S, --streaming <n>            streaming output, <n> lines for widths\n", out);
+	fputs(" -Q, --filter <expr>            print only lines matching the expression\n", out);
 	fputs(" -h, --help                     this help\n", out);
 	fputs("\n", out);
 
@@ -221,7 +290,8 @@ int main(int argc, char *argv[])
 {
 	struct libscols_table *tb;
 	int c, n, nlines = 0;
-	int parent_col = -1, id_col = -1;
+	int parent_col = -1, id_col = -1, streaming = 0;
+	const char *filter = NULL;
 
 	static const struct option longopts[] = {
 		{ "maxout", 0, NULL, 'm' },
@@ -232,16 +302,22 @@ int main(int argc, char *argv[])
 		{ "tree-parent-column", 1, NULL, 'p' },
 		{ "tree-id-column",	1, NULL, 'i' },
 		{ "json",   0, NULL, 'J' },
+		{ "cbor",   0, NULL, 'B' },
 		{ "raw",    0, NULL, 'r' },
 		{ "export", 0, NULL, 'E' },
 		{ "colsep",  1, NULL, 'C' },
+		{ "streaming", 1, NULL, 'S' },
+		{ "filter", 1, NULL, 'Q' },
 		{ "help",   0, NULL, 'h' },
 		{ NULL, 0, NULL, 0 },
 	};
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
-		{ 'E', 'J', 'r' },
+		{ 'B', 'E', 'J', 'r' },
 		{ 'M', 'm' },
+		{ 'Q', 'S' },
+		{ 'S', 'i' },
+		{ 'S', 'p' },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -253,7 +329,7 @@ int main(int argc, char *argv[])
 	if (!tb)
 		err(EXIT_FAILURE, "failed to create output table");
 
-	while((c = getopt_long(argc, argv, "hCc:Ei:JMmn:p:rw:", longopts, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "BhCc:Ei:JMmn:p:Q:rS:w:", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -282,6 +358,10 @@ int main(int argc, char *argv[])
 			scols_table_enable_json(tb, 1);
 			scols_table_set_name(tb, "testtable");
 			break;
+		case 'B':
+			scols_table_enable_cbor(tb, 1);
+			scols_table_set_name(tb, "testtable");
+			break;
 		case 'm':
 			scols_table_enable_maxout(tb, TRUE);
 			break;
@@ -300,6 +380,15 @@ int main(int argc, char *argv[])
 		case 'n':
 			nlines = strtou32_or_err(optarg, "failed to parse number of lines");
 			break;
+		case 'Q':
+			filter = optarg;
+			break;
+		case 'S':
+			streaming = 1;
+			scols_table_enable_streaming(tb, TRUE);
+			scols_table_set_streaming_sample(tb,
+				strtou32_or_err(optarg, "failed to parse streaming sample"));
+			break;
 		case 'w':
 			scols_table_set_termforce(tb, SCOLS_TERMFORCE_ALWAYS);
 			scols_table_set_termwidth(tb, strtou32_or_err(optarg, "failed to parse terminal width"));
@@ -314,13 +403,16 @@ int main(int argc, char *argv[])
 	if (nlines <= 0)
 		errx(EXIT_FAILURE, "--nlines not set");
 
-	for (n = 0; n < nlines; n++) {
-		struct libscols_line *ln = scols_new_line();
+	scols_table_enable_colors(tb, isatty(STDOUT_FILENO));
 
-		if (!ln || scols_table_add_line(tb, ln))
-			err(EXIT_FAILURE, "failed to add a new line");
+	if (streaming) {
+		stream_column_data(tb, nlines, argv + optind, argc - optind);
+		goto done;
+	}
 
-		scols_unref_line(ln);
+	for (n = 0; n < nlines; n++) {
+		if (!scols_table_new_line(tb, NULL))
+			err(EXIT_FAILURE, "failed to add a new line");
 	}
 
 	n = 0;
@@ -336,11 +428,12 @@ int main(int argc, char *argv[])
 		n++;
 	}
 
+	if (filter)
+		apply_filter(tb, filter);
+
 	if (scols_table_is_tree(tb) && parent_col >= 0 && id_col >= 0)
 		compose_tree(tb, parent_col, id_col);
-
-	scols_table_enable_colors(tb, isatty(STDOUT_FILENO));
-
+done:
 	scols_print_table(tb);
 	scols_unref_table(tb);
 	return EXIT_SUCCESS;
@@ -0,0 +1,124 @@
+/*
+ * arena.c - memory for lines, cells and cells data of the table
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/*
+ * The lines created by scols_table_new_line() are allocated from a table
+ * arena, as well as their cells and data copied by scols_line_set_data().
+ * The memory is never returned to the arena, it's deallocated in bulk when
+ * the last user is gone. The arena is reference counted, every line from the
+ * arena keeps a reference, so the lines may survive the table.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "smartcolsP.h"
+
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+#define ARENA_ALIGN		16
+
+struct arena_chunk {
+	struct arena_chunk	*next;
+	size_t			size;	/* usable size of data[] */
+	size_t			used;
+	char			data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+struct libscols_arena {
+	int			refcount;
+	struct arena_chunk	*chunks;	/* the first is the current one */
+};
+
+struct libscols_arena *__scols_new_arena(void)
+{
+	struct libscols_arena *ar = calloc(1, sizeof(*ar));
+
+	if (ar)
+		ar->refcount = 1;
+	return ar;
+}
+
+void __scols_ref_arena(struct libscols_arena *ar)
+{
+	if (ar)
+		ar->refcount++;
+}
+
+void __scols_unref_arena(struct libscols_arena *ar)
+{
+	if (ar && --ar->refcount <= 0) {
+		while (ar->chunks) {
+			struct arena_chunk *ch = ar->chunks;
+
+			ar->chunks = ch->next;
+			free(ch);
+		}
+		free(ar);
+	}
+}
+
+static void *arena_alloc(struct libscols_arena *ar, size_t sz, size_t align)
+{
+	struct arena_chunk *ch = ar->chunks;
+	size_t off;
+
+	if (ch) {
+		off = (ch->used + align - 1) & ~(align - 1);
+		if (off + sz <= ch->size) {
+			ch->used = off + sz;
+			return ch->data + off;
+		}
+	}
+
+	/* large items have a private chunk, behind the current one */
+	if (sz > ARENA_CHUNK_SIZE / 4) {
+		ch = malloc(sizeof(struct arena_chunk) + sz);
+		if (!ch)
+			return NULL;
+		ch->size = ch->used = sz;
+		if (ar->chunks) {
+			ch->next = ar->chunks->next;
+			ar->chunks->next = ch;
+		} else {
+			ch->next = NULL;
+			ar->chunks = ch;
+		}
+		return ch->data;
+	}
+
+	ch = malloc(sizeof(struct arena_chunk) + ARENA_CHUNK_SIZE);
+	if (!ch)
+		return NULL;
+	ch->size = ARENA_CHUNK_SIZE;
+	ch->used = sz;
+	ch->next = ar->chunks;
+	ar->chunks = ch;
+	return ch->data;
+}
+
+/*
+ * Returns zeroized memory.
+ */
+void *__scols_arena_calloc(struct libscols_arena *ar, size_t sz)
+{
+	void *p = arena_alloc(ar, sz, ARENA_ALIGN);
+
+	if (p)
+		memset(p, 0, sz);
+	return p;
+}
+
+char *__scols_arena_strdup(struct libscols_arena *ar, const char *str)
+{
+	size_t sz = strlen(str) + 1;
+	char *p = arena_alloc(ar, sz, 1);
+
+	if (p)
+		memcpy(p, str, sz);
+	return p;
+}
@@ -32,41 +32,43 @@ static void dbg_columns(struct libscols_table *tb)
 		dbg_column(tb, cl);
 }
 
+/* returns 1 if the width is ignored as extreme */
+static int count_width(struct libscols_column *cl, size_t len)
+{
+	cl->width_max = max(len, cl->width_max);
+
+	if (cl->is_extreme && cl->width_avg && len > cl->width_avg * 2)
+		return 1;
+
+	if (scols_column_is_noextremes(cl)) {
+		cl->extreme_sum += len;
+		cl->extreme_count++;
+	}
+	cl->width = max(len, cl->width);
+	return 0;
+}
+
 static int count_cell_width(struct libscols_table *tb,
 		struct libscols_line *ln,
 		struct libscols_column *cl,
 		struct ul_buffer *buf)
 {
-	size_t len;
-	char *data;
 	int rc;
 
+	if (!scols_column_is_tree(cl)) {
+		count_width(cl, __scols_cell_width(tb, cl,
+				scols_line_get_column_cell(ln, cl)));
+		return 0;
+	}
+
 	rc = __cell_to_buffer(tb, ln, cl, buf);
 	if (rc)
 		return rc;
 
-	data = ul_buffer_get_data(buf, NULL, NULL);
-	if (!data)
-		len = 0;
-	else if (scols_column_is_customwrap(cl))
-		len = cl->wrap_chunksize(cl, data, cl->wrapfunc_data);
-	else if (scols_table_is_noencoding(tb))
-		len = mbs_width(data);
-	else
-		len = mbs_safe_width(data);
-
-	if (len == (size_t) -1)		/* ignore broken multibyte strings */
-		len = 0;
-	cl->width_max = max(len, cl->width_max);
-
-	if (cl->is_extreme && cl->width_avg && len > cl->width_avg * 2)
+	if (count_width(cl, __scols_data_width(tb, cl,
+				ul_buffer_get_data(buf, NULL, NULL))))
 		return 0;
 
-	if (scols_column_is_noextremes(cl)) {
-		cl->extreme_sum += len;
-		cl->extreme_count++;
-	}
-	cl->width = max(len, cl->width);
 	if (scols_column_is_tree(cl)) {
 		size_t treewidth = ul_buffer_get_safe_pointer_width(buf, SCOLS_BUFPTR_TREEEND);
 		cl->width_treeart = max(cl->width_treeart, treewidth);
@@ -123,7 +125,15 @@ static int count_column_width(struct libscols_table *tb,
 			cl->width_min = 1;
 	}
 
-	if (scols_table_is_tree(tb)) {
+	if (__scols_colstore_get_widths(tb, cl)) {
+		/* Count width from cached cells width */
+		const uint32_t *w = __scols_colstore_get_widths(tb, cl);
+		size_t i;
+
+		for (i = 0; i < tb->colstore.nlines; i++)
+			count_width(cl, w[i]);
+
+	} else if (scols_table_is_tree(tb)) {
 		/* Count width for tree */
 		rc = scols_walk_tree(tb, cl, walk_count_cell_width, (void *) buf);
 		if (rc)
@@ -203,6 +213,17 @@ int __scols_calculate(struct libscols_table *tb, struct ul_buffer *buf)
 	if (has_groups(tb))
 		group_ncolumns = 1;
 
+	/* generate lazy data before the (maybe threaded) colstore fill */
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		if (cl->datafunc && !scols_column_is_hidden(cl))
+			__scols_table_fill_cells(tb, cl);
+	}
+
+	rc = __scols_colstore_build(tb);
+	if (rc)
+		goto done;
+
 	/* set basic columns width
 	 */
 	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
@@ -446,6 +467,7 @@ int __scols_calculate(struct libscols_table *tb, struct ul_buffer *buf)
 		}
 	}
 done:
+	__scols_colstore_reset(tb);
 	tb->is_dummy_print = 0;
 	DBG(TAB, ul_debugobj(tb, "-----final width: %zu (rc=%d)-----", width, rc));
 	ON_DBG(TAB, dbg_columns(tb));
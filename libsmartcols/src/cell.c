@@ -24,6 +24,7 @@
 #include <string.h>
 #include <ctype.h>
 
+#include "mbsalign.h"
 #include "smartcolsP.h"
 
 /*
@@ -45,12 +46,43 @@ int scols_reset_cell(struct libscols_cell *ce)
 		return -EINVAL;
 
 	/*DBG(CELL, ul_debugobj(ce, "reset"));*/
-	free(ce->data);
+	if (!ce->data_in_arena)
+		free(ce->data);
 	free(ce->color);
+	if (ce->sortkey_type == SCOLS_SORTKEY_STRING)
+		free(ce->sortkey.str);
 	memset(ce, 0, sizeof(*ce));
 	return 0;
 }
 
+/*
+ * Caches the display width. The printable ASCII strings (without backslash) are
+ * never modified by mbs_safe_encode() and the width is the string length.
+ */
+static void cell_refresh_width(struct libscols_cell *ce)
+{
+	const unsigned char *p;
+
+	ce->width = 0;
+	ce->is_ascii = 0;
+
+	if (!ce->data)
+		return;
+
+	for (p = (unsigned char *) ce->data; *p; p++) {
+		if (*p < 0x20 || *p > 0x7e || *p == '\\')
+			break;
+	}
+	if (*p == '\0') {
+		ce->is_ascii = 1;
+		ce->width = p - (unsigned char *) ce->data;
+	} else {
+		size_t len = mbs_safe_width(ce->data);
+
+		ce->width = len == (size_t) -1 ? 0 : len;
+	}
+}
+
 /**
  * scols_cell_set_data:
  * @ce: a pointer to a struct libscols_cell instance
@@ -62,7 +94,37 @@ int scols_reset_cell(struct libscols_cell *ce)
  */
 int scols_cell_set_data(struct libscols_cell *ce, const char *data)
 {
-	return strdup_to_struct_member(ce, data, data);
+	char *p = NULL;
+
+	if (!ce)
+		return -EINVAL;
+	if (data) {
+		p = strdup(data);
+		if (!p)
+			return -ENOMEM;
+	}
+	return scols_cell_refer_data(ce, p);
+}
+
+/*
+ * Stores a copy of @data in the arena @ar. The cell must not outlive the
+ * arena, it's used for the table lines from the arena.
+ */
+int __scols_cell_set_arena_data(struct libscols_cell *ce,
+				struct libscols_arena *ar, const char *data)
+{
+	char *p = NULL;
+
+	if (data) {
+		p = __scols_arena_strdup(ar, data);
+		if (!p)
+			return -ENOMEM;
+	}
+	scols_cell_refer_data(ce, NULL);
+	ce->data = p;
+	ce->data_in_arena = p ? 1 : 0;
+	cell_refresh_width(ce);
+	return 0;
 }
 
 /**
@@ -75,14 +137,20 @@ int scols_cell_set_data(struct libscols_cell *ce, const char *data)
  * for situations when the data for the cell are already composed in allocated
  * memory (e.g. asprintf()) to avoid extra unnecessary strdup().
  *
+ * The display width of the data is cached in the cell, don't modify the
+ * data after this call.
+ *
  * Returns: 0, a negative value in case of an error.
  */
 int scols_cell_refer_data(struct libscols_cell *ce, char *data)
 {
 	if (!ce)
 		return -EINVAL;
-	free(ce->data);
+	if (!ce->data_in_arena)
+		free(ce->data);
 	ce->data = data;
+	ce->data_in_arena = 0;
+	cell_refresh_width(ce);
 	return 0;
 }
 
@@ -123,6 +191,152 @@ void *scols_cell_get_userdata(struct libscols_cell *ce)
 	return ce->userdata;
 }
 
+static void cell_reset_sortkey(struct libscols_cell *ce)
+{
+	if (ce->sortkey_type == SCOLS_SORTKEY_STRING)
+		free(ce->sortkey.str);
+	ce->sortkey.num = 0;
+	ce->sortkey_type = SCOLS_SORTKEY_NONE;
+}
+
+/**
+ * scols_cell_set_sortkey_u64:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: sort key
+ *
+ * Sets the value used by scols_sort_table() to order the lines rather than
+ * the cell data. If all the cells of the sort column have numeric keys of the
+ * same type the table is sorted by radix sort, the column cmpfunc is not
+ * required. The cells without key are ordered before the other cells.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_cell_set_sortkey_u64(struct libscols_cell *ce, uint64_t num)
+{
+	if (!ce)
+		return -EINVAL;
+	cell_reset_sortkey(ce);
+	ce->sortkey.num = num;
+	ce->sortkey_type = SCOLS_SORTKEY_U64;
+	return 0;
+}
+
+/**
+ * scols_cell_set_sortkey_i64:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: sort key
+ *
+ * See scols_cell_set_sortkey_u64().
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_cell_set_sortkey_i64(struct libscols_cell *ce, int64_t num)
+{
+	if (!ce)
+		return -EINVAL;
+	cell_reset_sortkey(ce);
+	/* flip the sign bit, the negative numbers are ordered first */
+	ce->sortkey.num = (uint64_t) num ^ (1ULL << 63);
+	ce->sortkey_type = SCOLS_SORTKEY_I64;
+	return 0;
+}
+
+/**
+ * scols_cell_set_sortkey_double:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @num: sort key
+ *
+ * See scols_cell_set_sortkey_u64(). Note that -0.0 is ordered before 0.0
+ * and NaN after infinity.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_cell_set_sortkey_double(struct libscols_cell *ce, double num)
+{
+	uint64_t x;
+
+	if (!ce)
+		return -EINVAL;
+	cell_reset_sortkey(ce);
+
+	/* IEEE 754 bits in the order of the values */
+	memcpy(&x, &num, sizeof(x));
+	if (x & (1ULL << 63))
+		x = ~x;
+	else
+		x |= 1ULL << 63;
+
+	ce->sortkey.num = x;
+	ce->sortkey_type = SCOLS_SORTKEY_DOUBLE;
+	return 0;
+}
+
+/**
+ * scols_cell_set_sortkey_string:
+ * @ce: a pointer to a struct libscols_cell instance
+ * @str: sort key or NULL
+ *
+ * Sets the string used by scols_sort_table() to order the lines. The string
+ * is converted by strxfrm(), so the lines are ordered by the LC_COLLATE
+ * locale without the locale aware comparison in the sort. NULL removes the
+ * sort key. See also scols_cell_set_sortkey_u64().
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_cell_set_sortkey_string(struct libscols_cell *ce, const char *str)
+{
+	char *key;
+	size_t sz;
+
+	if (!ce)
+		return -EINVAL;
+	cell_reset_sortkey(ce);
+	if (!str)
+		return 0;
+
+	sz = strxfrm(NULL, str, 0) + 1;
+	key = malloc(sz);
+	if (!key)
+		return -ENOMEM;
+	strxfrm(key, str, sz);
+
+	ce->sortkey.str = key;
+	ce->sortkey_type = SCOLS_SORTKEY_STRING;
+	return 0;
+}
+
+/*
+ * Compares the cells by the sort keys, the cells with different type of the
+ * key are ordered by the type, the cells without key first.
+ */
+int __scols_cmp_sortkeys(const struct libscols_cell *a,
+			 const struct libscols_cell *b)
+{
+	int ta = a ? a->sortkey_type : SCOLS_SORTKEY_NONE,
+	    tb = b ? b->sortkey_type : SCOLS_SORTKEY_NONE;
+
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+
+	switch (ta) {
+	case SCOLS_SORTKEY_NONE:
+		return 0;
+	case SCOLS_SORTKEY_STRING:
+		return strcmp(a->sortkey.str, b->sortkey.str);
+	default:
+		return a->sortkey.num == b->sortkey.num ? 0 :
+		       a->sortkey.num < b->sortkey.num ? -1 : 1;
+	}
+}
+
 /**
  * scols_cmpstr_cells:
  * @a: pointer to cell
@@ -251,6 +465,20 @@ int scols_cell_copy_content(struct libscols_cell *dest,
 		rc = scols_cell_set_color(dest, scols_cell_get_color(src));
 	if (!rc)
 		dest->userdata = src->userdata;
+	if (!rc) {
+		if (src->sortkey_type == SCOLS_SORTKEY_STRING) {
+			char *key = strdup(src->sortkey.str);
+
+			if (!key)
+				return -ENOMEM;
+			cell_reset_sortkey(dest);
+			dest->sortkey.str = key;
+		} else {
+			cell_reset_sortkey(dest);
+			dest->sortkey.num = src->sortkey.num;
+		}
+		dest->sortkey_type = src->sortkey_type;
+	}
 
 	DBG(CELL, ul_debugobj(src, "copy"));
 	return rc;
@@ -0,0 +1,239 @@
+/*
+ * colstore.c - column-major cache of the cells width
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/*
+ * The cells are stored per line, but the width calculation walks the table
+ * column by column (and two times for SCOLS_FL_NOEXTREMES columns). The store
+ * is filled by one pass over the lines (the line cells are contiguous) and
+ * then every column is evaluated from a sequential array of widths.
+ *
+ * The tree columns are not in the store, the width depends on the tree
+ * ascii art and it's calculated by scols_walk_tree().
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbsalign.h"
+#include "smartcolsP.h"
+
+/*
+ * Returns display width of @data in column @cl.
+ */
+size_t __scols_data_width(struct libscols_table *tb,
+			  struct libscols_column *cl,
+			  const char *data)
+{
+	size_t len;
+
+	if (!data)
+		return 0;
+	if (scols_column_is_customwrap(cl))
+		len = cl->wrap_chunksize(cl, data, cl->wrapfunc_data);
+	else if (scols_table_is_noencoding(tb))
+		len = mbs_width(data);
+	else
+		len = mbs_safe_width(data);
+
+	if (len == (size_t) -1)		/* ignore broken multibyte strings */
+		len = 0;
+	return len;
+}
+
+/*
+ * Returns display width of the cell @ce in column @cl, the width is cached in
+ * the cell if possible.
+ */
+size_t __scols_cell_width(struct libscols_table *tb,
+			  struct libscols_column *cl,
+			  struct libscols_cell *ce)
+{
+	if (!ce || !ce->data)
+		return 0;
+	if (scols_column_is_customwrap(cl)
+	    || (!ce->is_ascii && scols_table_is_noencoding(tb)))
+		return __scols_data_width(tb, cl, ce->data);
+
+	return ce->width;
+}
+
+void __scols_colstore_reset(struct libscols_table *tb)
+{
+	struct libscols_colstore *st = &tb->colstore;
+
+	free(st->width);
+	memset(st, 0, sizeof(*st));
+}
+
+static inline void colstore_set(struct libscols_table *tb,
+				struct libscols_column *cl,
+				struct libscols_line *ln, size_t n)
+{
+	struct libscols_colstore *st = &tb->colstore;
+	size_t len = __scols_cell_width(tb, cl, scols_line_get_cell(ln, cl->seqnum));
+
+	st->width[cl->seqnum * st->nlines + n] = len > UINT32_MAX ? UINT32_MAX : len;
+}
+
+struct colstore_job {
+	struct libscols_table	*tb;
+	struct libscols_column	**cols;
+	size_t			ncols;
+	struct libscols_line	**lines;
+	size_t			begin, end;	/* range in lines[] */
+};
+
+static void *colstore_fill_range(void *data)
+{
+	struct colstore_job *job = (struct colstore_job *) data;
+	size_t n, i;
+
+	for (n = job->begin; n < job->end; n++) {
+		for (i = 0; i < job->ncols; i++)
+			colstore_set(job->tb, job->cols[i], job->lines[n], n);
+	}
+	return NULL;
+}
+
+/*
+ * Fills the store by @nthreads threads. The custom wrap functions are
+ * callbacks, they are called from the current thread only.
+ */
+static int colstore_fill_parallel(struct libscols_table *tb,
+				  struct libscols_column **cols, size_t ncols,
+				  size_t nthreads)
+{
+	struct libscols_line **lines, *ln;
+	struct colstore_job *jobs;
+	struct libscols_iter itr;
+	size_t i, n = 0, npar = 0, chunk;
+
+	lines = malloc(tb->nlines * sizeof(struct libscols_line *));
+	jobs = calloc(nthreads, sizeof(struct colstore_job));
+	if (!lines || !jobs) {
+		free(lines);
+		free(jobs);
+		return -ENOMEM;
+	}
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_line(tb, &itr, &ln) == 0)
+		lines[n++] = ln;
+
+	/* move custom-wrap columns to the end of the array */
+	for (i = 0; i < ncols; i++) {
+		if (!scols_column_is_customwrap(cols[i])) {
+			struct libscols_column *x = cols[npar];
+
+			cols[npar++] = cols[i];
+			cols[i] = x;
+		}
+	}
+
+	chunk = (n + nthreads - 1) / nthreads;
+	for (i = 0; i < nthreads; i++) {
+		jobs[i].tb = tb;
+		jobs[i].cols = cols;
+		jobs[i].ncols = npar;
+		jobs[i].lines = lines;
+		jobs[i].begin = min(i * chunk, n);
+		jobs[i].end = min(jobs[i].begin + chunk, n);
+	}
+
+	DBG(TAB, ul_debugobj(tb, "colstore: filling by %zu threads", nthreads));
+	__scols_run_parallel(colstore_fill_range, jobs, nthreads, sizeof(*jobs));
+
+	if (npar < ncols) {
+		struct colstore_job job = {
+			.tb = tb,
+			.cols = cols + npar,
+			.ncols = ncols - npar,
+			.lines = lines,
+			.end = n
+		};
+		colstore_fill_range(&job);
+	}
+
+	free(lines);
+	free(jobs);
+	return 0;
+}
+
+/*
+ * Fills the store for all visible non-tree columns. The store is optional, if
+ * it cannot be allocated the width is calculated from the lines.
+ */
+int __scols_colstore_build(struct libscols_table *tb)
+{
+	struct libscols_colstore *st = &tb->colstore;
+	struct libscols_column *cl, **cols = NULL;
+	struct libscols_iter itr;
+	size_t i, ncols = 0, nthreads;
+
+	__scols_colstore_reset(tb);
+
+	if (!tb->nlines || !tb->ncols)
+		return 0;
+
+	cols = calloc(tb->ncols, sizeof(struct libscols_column *));
+	if (!cols)
+		return -ENOMEM;
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_column(tb, &itr, &cl) == 0) {
+		cl->in_colstore = 0;
+		if (scols_column_is_hidden(cl) || scols_column_is_tree(cl))
+			continue;
+		cols[ncols++] = cl;
+	}
+	if (!ncols)
+		goto done;
+
+	if (tb->nlines > SIZE_MAX / sizeof(uint32_t) / tb->ncols)
+		goto done;
+	st->width = calloc(tb->ncols * tb->nlines, sizeof(uint32_t));
+	if (!st->width)
+		goto done;
+
+	st->ncols = tb->ncols;
+	st->nlines = tb->nlines;
+
+	nthreads = __scols_nthreads(tb, tb->nlines);
+	if (!nthreads || colstore_fill_parallel(tb, cols, ncols, nthreads) != 0) {
+		struct libscols_line *ln;
+		size_t n = 0;
+
+		scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+		while (scols_table_next_line(tb, &itr, &ln) == 0) {
+			for (i = 0; i < ncols; i++)
+				colstore_set(tb, cols[i], ln, n);
+			n++;
+		}
+	}
+
+	for (i = 0; i < ncols; i++)
+		cols[i]->in_colstore = 1;
+
+	DBG(TAB, ul_debugobj(tb, "colstore: %zu lines, %zu columns", st->nlines, ncols));
+done:
+	free(cols);
+	return 0;
+}
+
+/*
+ * Returns array of the column cells width (in the lines order) or NULL.
+ */
+const uint32_t *__scols_colstore_get_widths(struct libscols_table *tb,
+					    struct libscols_column *cl)
+{
+	struct libscols_colstore *st = &tb->colstore;
+
+	if (!st->width || !cl->in_colstore || cl->seqnum >= st->ncols)
+		return NULL;
+	return st->width + cl->seqnum * st->nlines;
+}
@@ -455,6 +455,42 @@ int scols_column_set_cmpfunc(struct libscols_column *cl,
 	return 0;
 }
 
+/**
+ * scols_column_set_datafunc:
+ * @cl: a pointer to a struct libscols_column instance
+ * @datafunc: function to generate cell data
+ * @data: private data for @datafunc
+ *
+ * Sets function to generate the column cells data on demand. The function
+ * is called when the library needs the data of an empty cell for the first
+ * time -- for width calculation and output, sorting, filter evaluation or
+ * by scols_line_get_column_cell() and scols_line_get_column_data(). The
+ * returned string is used as by scols_cell_refer_data(), so it has to be
+ * allocated and it's deallocated by the library. NULL means no data.
+ *
+ * The function is never called for hidden columns (unless the column is
+ * used for sorting or filter) and for lines removed from the table before
+ * output, so the expensive data may be generated only for the lines and
+ * columns really printed.
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_column_set_datafunc(struct libscols_column *cl,
+			char *(*datafunc)(struct libscols_column *,
+					  struct libscols_line *,
+					  void *),
+			void *data)
+{
+	if (!cl)
+		return -EINVAL;
+
+	cl->datafunc = datafunc;
+	cl->datafunc_data = data;
+	return 0;
+}
+
 /**
  * scols_column_set_wrapfunc:
  * @cl: a pointer to a struct libscols_column instance
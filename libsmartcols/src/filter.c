@@ -0,0 +1,973 @@
+/*
+ * filter.c - lines filter expressions
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+
+/**
+ * SECTION: filter
+ * @title: Filter
+ * @short_description: lines filter expressions
+ *
+ * The filter expression is compiled by scols_table_set_filter() to a flat
+ * program for a simple stack machine. The program refers to the table
+ * columns, so the expression is evaluated for a line by
+ * scols_table_filter_line() without any parsing or columns lookup.
+ *
+ * The syntax is the same as for lsfd --filter:
+ *
+ *   expr:     expr || expr, expr && expr, !expr, (expr) or comparison
+ *   compare:  operand == operand, !=, <, <=, >, >=, =~ "regex", !~ "regex"
+ *   operand:  column name, "string", 'string', number, true or false
+ *
+ * The operators "or", "and", "not", "eq", "ne", "lt", "le", "gt" and "ge"
+ * are aliases. The column type is based on the column JSON type, a
+ * string column compared with a number is converted to a number.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <regex.h>
+
+#include "strutils.h"
+#include "smartcolsP.h"
+
+/* operand types */
+enum {
+	FT_STR,
+	FT_NUM,
+	FT_BOOL
+};
+
+/* instructions */
+enum {
+	FOP_COL_STR,		/* push column data */
+	FOP_COL_NUM,		/* push column data converted to number */
+	FOP_COL_BOOL,		/* push column data converted to boolean */
+	FOP_STR,		/* push string literal */
+	FOP_NUM,		/* push number or boolean literal */
+
+	FOP_STR_EQ,		/* pop two operands, push result */
+	FOP_STR_NE,
+	FOP_NUM_EQ,
+	FOP_NUM_NE,
+	FOP_NUM_LT,
+	FOP_NUM_LE,
+	FOP_NUM_GT,
+	FOP_NUM_GE,
+
+	FOP_REGEX,		/* replace the top string by the match result */
+	FOP_NREGEX,
+	FOP_NOT,		/* negate the top boolean */
+	FOP_JFALSE,		/* jump if the top is false, otherwise pop */
+	FOP_JTRUE		/* jump if the top is true, otherwise pop */
+};
+
+static const char *fop_names[] = {
+	[FOP_COL_STR]	= "col-str",
+	[FOP_COL_NUM]	= "col-num",
+	[FOP_COL_BOOL]	= "col-bool",
+	[FOP_STR]	= "str",
+	[FOP_NUM]	= "num",
+	[FOP_STR_EQ]	= "str-eq",
+	[FOP_STR_NE]	= "str-ne",
+	[FOP_NUM_EQ]	= "num-eq",
+	[FOP_NUM_NE]	= "num-ne",
+	[FOP_NUM_LT]	= "num-lt",
+	[FOP_NUM_LE]	= "num-le",
+	[FOP_NUM_GT]	= "num-gt",
+	[FOP_NUM_GE]	= "num-ge",
+	[FOP_REGEX]	= "regex",
+	[FOP_NREGEX]	= "nregex",
+	[FOP_NOT]	= "not",
+	[FOP_JFALSE]	= "jfalse",
+	[FOP_JTRUE]	= "jtrue"
+};
+
+struct filter_insn {
+	int op;
+	union {
+		size_t idx;			/* column, string, regex or jump target */
+		unsigned long long num;
+	} arg;
+};
+
+struct filter_value {
+	int valid;				/* data available */
+	union {
+		const char *str;
+		unsigned long long num;
+	} v;
+};
+
+/* tokens */
+enum {
+	TK_EOF,
+	TK_NAME,
+	TK_STR,
+	TK_NUM,
+	TK_TRUE,
+	TK_FALSE,
+	TK_OPEN,
+	TK_CLOSE,
+	TK_NOT,
+	TK_AND,
+	TK_OR,
+	TK_EQ,
+	TK_NE,
+	TK_LT,
+	TK_LE,
+	TK_GT,
+	TK_GE,
+	TK_REGEX,
+	TK_NREGEX
+};
+
+static const struct {
+	const char *name;
+	int token;
+} filter_keywords[] = {
+	{ "and", TK_AND },
+	{ "eq", TK_EQ },
+	{ "false", TK_FALSE },
+	{ "ge", TK_GE },
+	{ "gt", TK_GT },
+	{ "le", TK_LE },
+	{ "lt", TK_LT },
+	{ "ne", TK_NE },
+	{ "not", TK_NOT },
+	{ "or", TK_OR },
+	{ "true", TK_TRUE }
+};
+
+/* the column name may contain these chars too */
+#define FILTER_NAME_CHARS	":-_%"
+
+#define FILTER_ERRMSG_LEN	128
+
+struct libscols_filter {
+	struct filter_insn	*code;
+	size_t			ncode;
+	size_t			ncode_alloc;
+
+	struct libscols_column	**cols;		/* referenced columns */
+	size_t			ncols;
+	char			**strs;		/* string literals */
+	size_t			nstrs;
+	regex_t			**regs;		/* compiled regular expressions */
+	size_t			nregs;
+
+	struct filter_value	*stack;		/* evaluation stack */
+	size_t			stacksz;
+
+	/* parser */
+	struct libscols_table	*tb;
+	const char		*cursor;
+	int			token;
+	char			*tokstr;	/* TK_NAME and TK_STR value */
+	unsigned long long	toknum;		/* TK_NUM value */
+	size_t			depth;
+
+	char			errmsg[FILTER_ERRMSG_LEN];
+};
+
+/* parsed operand */
+struct filter_operand {
+	int	type;		/* FT_* */
+	ssize_t	insn;		/* the operand single push instruction or -1 */
+};
+
+#define filter_failed(_f)	(*(_f)->errmsg != '\0')
+
+static void filter_error(struct libscols_filter *fl, const char *fmt, const char *str)
+{
+	if (!filter_failed(fl))
+		snprintf(fl->errmsg, sizeof(fl->errmsg), fmt, str);
+}
+
+void __scols_filter_free(struct libscols_filter *fl)
+{
+	size_t i;
+
+	if (!fl)
+		return;
+
+	for (i = 0; i < fl->ncols; i++)
+		scols_unref_column(fl->cols[i]);
+	for (i = 0; i < fl->nstrs; i++)
+		free(fl->strs[i]);
+	for (i = 0; i < fl->nregs; i++) {
+		regfree(fl->regs[i]);
+		free(fl->regs[i]);
+	}
+	free(fl->cols);
+	free(fl->strs);
+	free(fl->regs);
+	free(fl->code);
+	free(fl->stack);
+	free(fl->tokstr);
+	free(fl);
+}
+
+static int array_add(void **ary, size_t *n, size_t sz, const void *item)
+{
+	char *tmp = realloc(*ary, (*n + 1) * sz);
+
+	if (!tmp)
+		return -ENOMEM;
+	memcpy(tmp + *n * sz, item, sz);
+	*ary = tmp;
+	(*n)++;
+	return 0;
+}
+
+/*
+ * Adds instruction, returns its index or -1 on error.
+ */
+static ssize_t filter_emit(struct libscols_filter *fl, int op, size_t idx)
+{
+	struct filter_insn *in;
+
+	if (fl->ncode == fl->ncode_alloc) {
+		size_t sz = fl->ncode_alloc ? fl->ncode_alloc * 2 : 16;
+
+		in = realloc(fl->code, sz * sizeof(struct filter_insn));
+		if (!in) {
+			filter_error(fl, "%s", "out of memory");
+			return -1;
+		}
+		fl->code = in;
+		fl->ncode_alloc = sz;
+	}
+
+	in = &fl->code[fl->ncode];
+	in->op = op;
+	in->arg.idx = idx;
+
+	switch (op) {
+	case FOP_COL_STR:
+	case FOP_COL_NUM:
+	case FOP_COL_BOOL:
+	case FOP_STR:
+	case FOP_NUM:
+		fl->depth++;
+		if (fl->depth > fl->stacksz)
+			fl->stacksz = fl->depth;
+		break;
+	case FOP_STR_EQ:
+	case FOP_STR_NE:
+	case FOP_NUM_EQ:
+	case FOP_NUM_NE:
+	case FOP_NUM_LT:
+	case FOP_NUM_LE:
+	case FOP_NUM_GT:
+	case FOP_NUM_GE:
+	case FOP_JFALSE:		/* the fall-through path pops */
+	case FOP_JTRUE:
+		fl->depth--;
+		break;
+	default:
+		break;
+	}
+
+	return fl->ncode++;
+}
+
+/*
+ * Tokenizer
+ */
+static int filter_read_str(struct libscols_filter *fl, char delim)
+{
+	const char *p = fl->cursor;
+	char *s;
+
+	s = fl->tokstr = malloc(strlen(p) + 1);
+	if (!s)
+		return -ENOMEM;
+
+	for (; *p && *p != delim; p++) {
+		if (*p == '\\' && *(p + 1)) {
+			p++;
+			switch (*p) {
+			case 'n':
+				*s++ = '\n';
+				continue;
+			case 't':
+				*s++ = '\t';
+				continue;
+			case '\\':
+			case '\'':
+			case '"':
+				break;
+			default:
+				*s++ = '\\';
+				break;
+			}
+		}
+		*s++ = *p;
+	}
+	*s = '\0';
+
+	if (*p != delim) {
+		filter_error(fl, "error: string literal is not terminated: %s",
+				fl->cursor - 1);
+		return -EINVAL;
+	}
+	fl->cursor = p + 1;
+	return TK_STR;
+}
+
+static int filter_read_token(struct libscols_filter *fl)
+{
+	const char *p;
+	char c;
+
+	free(fl->tokstr);
+	fl->tokstr = NULL;
+
+	while (isspace((unsigned char) *fl->cursor))
+		fl->cursor++;
+
+	p = fl->cursor;
+	c = *p;
+	if (c)
+		fl->cursor++;
+
+	switch (c) {
+	case '\0':
+		return TK_EOF;
+	case '(':
+		return TK_OPEN;
+	case ')':
+		return TK_CLOSE;
+	case '!':
+		if (*fl->cursor == '=' || *fl->cursor == '~')
+			return *fl->cursor++ == '=' ? TK_NE : TK_NREGEX;
+		return TK_NOT;
+	case '=':
+		if (*fl->cursor == '=' || *fl->cursor == '~')
+			return *fl->cursor++ == '=' ? TK_EQ : TK_REGEX;
+		break;
+	case '<':
+	case '>':
+		if (*fl->cursor == '=') {
+			fl->cursor++;
+			return c == '<' ? TK_LE : TK_GE;
+		}
+		return c == '<' ? TK_LT : TK_GT;
+	case '&':
+	case '|':
+		if (*fl->cursor == c) {
+			fl->cursor++;
+			return c == '&' ? TK_AND : TK_OR;
+		}
+		break;
+	case '"':
+	case '\'':
+		return filter_read_str(fl, c);
+	default:
+		if (isdigit((unsigned char) c)) {
+			uint64_t num;
+			size_t len = 1;
+
+			while (isalnum((unsigned char) p[len]))
+				len++;
+			fl->tokstr = strndup(p, len);
+			if (!fl->tokstr)
+				return -ENOMEM;
+			fl->cursor = p + len;
+			if (ul_strtou64(fl->tokstr, &num, 0) != 0) {
+				filter_error(fl, "error: failed to convert input to number: %s",
+						fl->tokstr);
+				return -EINVAL;
+			}
+			fl->toknum = num;
+			return TK_NUM;
+		}
+		if (isalpha((unsigned char) c) || c == '_') {
+			size_t i, len = 1;
+
+			while (isalnum((unsigned char) p[len])
+			       || strchr(FILTER_NAME_CHARS, p[len]))
+				len++;
+			fl->tokstr = strndup(p, len);
+			if (!fl->tokstr)
+				return -ENOMEM;
+			fl->cursor = p + len;
+
+			for (i = 0; i < ARRAY_SIZE(filter_keywords); i++) {
+				if (strcmp(fl->tokstr, filter_keywords[i].name) == 0)
+					return filter_keywords[i].token;
+			}
+			return TK_NAME;
+		}
+		break;
+	}
+
+	filter_error(fl, "error: unexpected character: %s", p);
+	return -EINVAL;
+}
+
+static int filter_next(struct libscols_filter *fl)
+{
+	int tk = filter_read_token(fl);
+
+	if (tk == -ENOMEM)
+		filter_error(fl, "%s", "out of memory");
+	fl->token = tk < 0 ? TK_EOF : tk;
+	return filter_failed(fl) ? -EINVAL : 0;
+}
+
+/*
+ * Parser, every function emits code for the parsed part of the expression.
+ */
+static int filter_parse_or(struct libscols_filter *fl, struct filter_operand *res);
+
+static const char *filter_type_name(int type)
+{
+	switch (type) {
+	case FT_NUM:
+		return "number";
+	case FT_BOOL:
+		return "boolean";
+	default:
+		return "string";
+	}
+}
+
+static int filter_add_column(struct libscols_filter *fl, struct libscols_column *cl)
+{
+	size_t i;
+
+	for (i = 0; i < fl->ncols; i++) {
+		if (fl->cols[i] == cl)
+			return i;
+	}
+	if (array_add((void **) &fl->cols, &fl->ncols, sizeof(cl), &cl) != 0)
+		return -ENOMEM;
+	scols_ref_column(cl);
+	return fl->ncols - 1;
+}
+
+static int filter_parse_primary(struct libscols_filter *fl, struct filter_operand *res)
+{
+	struct libscols_column *cl;
+	int idx, op;
+
+	res->insn = -1;
+
+	switch (fl->token) {
+	case TK_OPEN:
+		if (filter_next(fl) || filter_parse_or(fl, res))
+			return -EINVAL;
+		if (fl->token != TK_CLOSE) {
+			filter_error(fl, "error: unbalanced parenthesis: %s", fl->cursor);
+			return -EINVAL;
+		}
+		res->insn = -1;
+		return filter_next(fl);
+
+	case TK_NAME:
+		cl = scols_table_get_column_by_name(fl->tb, fl->tokstr);
+		if (!cl) {
+			filter_error(fl, "error: no such column: %s", fl->tokstr);
+			return -EINVAL;
+		}
+		idx = filter_add_column(fl, cl);
+		if (idx < 0) {
+			filter_error(fl, "%s", "out of memory");
+			return -ENOMEM;
+		}
+		switch (scols_column_get_json_type(cl)) {
+		case SCOLS_JSON_NUMBER:
+			res->type = FT_NUM;
+			op = FOP_COL_NUM;
+			break;
+		case SCOLS_JSON_BOOLEAN:
+			res->type = FT_BOOL;
+			op = FOP_COL_BOOL;
+			break;
+		default:
+			res->type = FT_STR;
+			op = FOP_COL_STR;
+			break;
+		}
+		res->insn = filter_emit(fl, op, idx);
+		break;
+
+	case TK_STR:
+		if (array_add((void **) &fl->strs, &fl->nstrs,
+			      sizeof(char *), &fl->tokstr) != 0) {
+			filter_error(fl, "%s", "out of memory");
+			return -ENOMEM;
+		}
+		fl->tokstr = NULL;		/* owned by fl->strs now */
+		res->type = FT_STR;
+		res->insn = filter_emit(fl, FOP_STR, fl->nstrs - 1);
+		break;
+
+	case TK_NUM:
+	case TK_TRUE:
+	case TK_FALSE:
+		res->type = fl->token == TK_NUM ? FT_NUM : FT_BOOL;
+		res->insn = filter_emit(fl, FOP_NUM, 0);
+		if (res->insn >= 0)
+			fl->code[res->insn].arg.num = fl->token == TK_NUM ? fl->toknum :
+						      fl->token == TK_TRUE ? 1 : 0;
+		break;
+
+	case TK_EOF:
+		filter_error(fl, "%s", "error: unexpected end of expression");
+		return -EINVAL;
+	default:
+		filter_error(fl, "error: unexpected token: %s", fl->cursor);
+		return -EINVAL;
+	}
+
+	if (res->insn < 0)
+		return -ENOMEM;
+	return filter_next(fl);
+}
+
+/* string column compared with a number is converted to number */
+static void filter_coerce(struct libscols_filter *fl, struct filter_operand *a, int type)
+{
+	if (a->type == FT_STR && type == FT_NUM
+	    && a->insn >= 0 && fl->code[a->insn].op == FOP_COL_STR) {
+		fl->code[a->insn].op = FOP_COL_NUM;
+		a->type = FT_NUM;
+	}
+}
+
+static int filter_parse_regex(struct libscols_filter *fl, struct filter_operand *res, int tk)
+{
+	struct filter_operand right;
+	struct filter_insn *in;
+	regex_t *re;
+	int rc;
+
+	if (res->type != FT_STR) {
+		filter_error(fl, "error: unexpected operand type for regular expression: %s",
+				filter_type_name(res->type));
+		return -EINVAL;
+	}
+	if (filter_next(fl) || filter_parse_primary(fl, &right))
+		return -EINVAL;
+
+	/* the pattern has to be a string literal, replace the push by regex */
+	in = &fl->code[fl->ncode - 1];
+	if (right.insn != (ssize_t) fl->ncode - 1 || in->op != FOP_STR) {
+		filter_error(fl, "%s", "error: regular expression has to be a string literal");
+		return -EINVAL;
+	}
+
+	re = malloc(sizeof(regex_t));
+	if (!re) {
+		filter_error(fl, "%s", "out of memory");
+		return -ENOMEM;
+	}
+	rc = regcomp(re, fl->strs[in->arg.idx], REG_NOSUB | REG_EXTENDED);
+	if (rc != 0) {
+		filter_error(fl, "error: could not compile regular expression: %s",
+				fl->strs[in->arg.idx]);
+		free(re);
+		return -EINVAL;
+	}
+	if (array_add((void **) &fl->regs, &fl->nregs, sizeof(re), &re) != 0) {
+		regfree(re);
+		free(re);
+		filter_error(fl, "%s", "out of memory");
+		return -ENOMEM;
+	}
+
+	in->op = tk == TK_REGEX ? FOP_REGEX : FOP_NREGEX;
+	in->arg.idx = fl->nregs - 1;
+	fl->depth--;			/* the literal is not pushed */
+
+	res->type = FT_BOOL;
+	res->insn = -1;
+	return 0;
+}
+
+static int filter_parse_compare(struct libscols_filter *fl, struct filter_operand *res)
+{
+	struct filter_operand right;
+	int tk, op;
+
+	if (filter_parse_primary(fl, res))
+		return -EINVAL;
+
+	tk = fl->token;
+	switch (tk) {
+	case TK_EQ:
+	case TK_NE:
+	case TK_LT:
+	case TK_LE:
+	case TK_GT:
+	case TK_GE:
+		break;
+	case TK_REGEX:
+	case TK_NREGEX:
+		return filter_parse_regex(fl, res, tk);
+	default:
+		return 0;
+	}
+
+	if (filter_next(fl) || filter_parse_primary(fl, &right))
+		return -EINVAL;
+
+	filter_coerce(fl, res, right.type);
+	filter_coerce(fl, &right, res->type);
+
+	if (res->type != right.type) {
+		snprintf(fl->errmsg, sizeof(fl->errmsg),
+			 "error: cannot compare %s with %s",
+			 filter_type_name(res->type), filter_type_name(right.type));
+		return -EINVAL;
+	}
+	if (res->type != FT_NUM && tk != TK_EQ && tk != TK_NE) {
+		filter_error(fl, "error: %s operands can be compared only by == and !=",
+				filter_type_name(res->type));
+		return -EINVAL;
+	}
+
+	if (res->type == FT_STR)
+		op = tk == TK_EQ ? FOP_STR_EQ : FOP_STR_NE;
+	else
+		op = FOP_NUM_EQ + (tk - TK_EQ);
+
+	res->type = FT_BOOL;
+	res->insn = -1;
+	return filter_emit(fl, op, 0) < 0 ? -ENOMEM : 0;
+}
+
+static int filter_check_bool(struct libscols_filter *fl, struct filter_operand *op)
+{
+	if (op->type == FT_BOOL)
+		return 0;
+	filter_error(fl, "error: boolean operand expected, got %s",
+			filter_type_name(op->type));
+	return -EINVAL;
+}
+
+static int filter_parse_not(struct libscols_filter *fl, struct filter_operand *res)
+{
+	if (fl->token != TK_NOT)
+		return filter_parse_compare(fl, res);
+
+	if (filter_next(fl) || filter_parse_not(fl, res) || filter_check_bool(fl, res))
+		return -EINVAL;
+	res->insn = -1;
+	return filter_emit(fl, FOP_NOT, 0) < 0 ? -ENOMEM : 0;
+}
+
+/*
+ * expr && expr and expr || expr; the right side is skipped if the left side
+ * decides the result.
+ */
+static int filter_parse_logical(struct libscols_filter *fl, struct filter_operand *res,
+				int tk, int (*parse_operand)(struct libscols_filter *,
+							     struct filter_operand *))
+{
+	if (parse_operand(fl, res))
+		return -EINVAL;
+
+	while (fl->token == tk) {
+		struct filter_operand right;
+		ssize_t jmp;
+
+		if (filter_check_bool(fl, res))
+			return -EINVAL;
+		jmp = filter_emit(fl, tk == TK_AND ? FOP_JFALSE : FOP_JTRUE, 0);
+		if (jmp < 0)
+			return -ENOMEM;
+		if (filter_next(fl) || parse_operand(fl, &right)
+		    || filter_check_bool(fl, &right))
+			return -EINVAL;
+		fl->code[jmp].arg.idx = fl->ncode;
+		res->insn = -1;
+	}
+	return 0;
+}
+
+static int filter_parse_and(struct libscols_filter *fl, struct filter_operand *res)
+{
+	return filter_parse_logical(fl, res, TK_AND, filter_parse_not);
+}
+
+static int filter_parse_or(struct libscols_filter *fl, struct filter_operand *res)
+{
+	return filter_parse_logical(fl, res, TK_OR, filter_parse_and);
+}
+
+static void filter_dump_code(struct libscols_filter *fl)
+{
+	size_t i;
+
+	for (i = 0; i < fl->ncode; i++) {
+		struct filter_insn *in = &fl->code[i];
+
+		switch (in->op) {
+		case FOP_COL_STR:
+		case FOP_COL_NUM:
+		case FOP_COL_BOOL:
+			ul_debug("  %3zu: %-8s %s", i, fop_names[in->op],
+				 scols_column_get_name(fl->cols[in->arg.idx]));
+			break;
+		case FOP_STR:
+			ul_debug("  %3zu: %-8s '%s'", i, fop_names[in->op],
+				 fl->strs[in->arg.idx]);
+			break;
+		case FOP_NUM:
+			ul_debug("  %3zu: %-8s %llu", i, fop_names[in->op], in->arg.num);
+			break;
+		case FOP_JFALSE:
+		case FOP_JTRUE:
+		case FOP_REGEX:
+		case FOP_NREGEX:
+			ul_debug("  %3zu: %-8s %zu", i, fop_names[in->op], in->arg.idx);
+			break;
+		default:
+			ul_debug("  %3zu: %s", i, fop_names[in->op]);
+			break;
+		}
+	}
+}
+
+static int filter_compile(struct libscols_filter *fl, const char *expr)
+{
+	struct filter_operand res;
+
+	fl->cursor = expr;
+
+	if (filter_next(fl))
+		return -EINVAL;
+	if (fl->token == TK_EOF) {
+		filter_error(fl, "%s", "error: empty expression");
+		return -EINVAL;
+	}
+	if (filter_parse_or(fl, &res))
+		return -EINVAL;
+	if (fl->token != TK_EOF) {
+		filter_error(fl, fl->token == TK_CLOSE ?
+				"error: unbalanced parenthesis: %s" :
+				"error: unexpected token: %s", fl->cursor);
+		return -EINVAL;
+	}
+	if (filter_check_bool(fl, &res))
+		return -EINVAL;
+
+	free(fl->tokstr);
+	fl->tokstr = NULL;
+
+	fl->stack = calloc(fl->stacksz, sizeof(struct filter_value));
+	if (!fl->stack) {
+		filter_error(fl, "%s", "out of memory");
+		return -ENOMEM;
+	}
+
+	DBG(FLTR, ul_debugobj(fl, "compiled '%s': %zu instructions, stack %zu",
+				expr, fl->ncode, fl->stacksz));
+	ON_DBG(FLTR, filter_dump_code(fl));
+	return 0;
+}
+
+/*
+ * Evaluates the program for the line @ln, returns 1 or 0.
+ */
+static int filter_eval(struct libscols_filter *fl, struct libscols_line *ln)
+{
+	struct filter_value *sp = fl->stack;	/* the first free item */
+	size_t ip = 0;
+
+	while (ip < fl->ncode) {
+		struct filter_insn *in = &fl->code[ip++];
+		struct filter_value *a = sp - 2, *b = sp - 1;
+		struct libscols_cell *ce;
+		const char *data;
+		uint64_t num;
+
+		switch (in->op) {
+		case FOP_COL_STR:
+		case FOP_COL_NUM:
+		case FOP_COL_BOOL:
+			ce = scols_line_get_column_cell(ln, fl->cols[in->arg.idx]);
+			data = ce ? scols_cell_get_data(ce) : NULL;
+
+			if (in->op == FOP_COL_STR) {
+				sp->v.str = data;
+				sp->valid = data != NULL;
+			} else if (in->op == FOP_COL_NUM) {
+				sp->valid = data && ul_strtou64(data, &num, 10) == 0;
+				sp->v.num = sp->valid ? num : 0;
+			} else {
+				sp->valid = 1;
+				sp->v.num = !data || !*data || *data == '0'
+					    || *data == 'N' || *data == 'n' ? 0 : 1;
+			}
+			sp++;
+			break;
+		case FOP_STR:
+			sp->valid = 1;
+			sp->v.str = fl->strs[in->arg.idx];
+			sp++;
+			break;
+		case FOP_NUM:
+			sp->valid = 1;
+			sp->v.num = in->arg.num;
+			sp++;
+			break;
+
+		case FOP_STR_EQ:
+		case FOP_STR_NE:
+			if (a->valid && b->valid) {
+				int eq = strcmp(a->v.str, b->v.str) == 0;
+				a->v.num = in->op == FOP_STR_EQ ? eq : !eq;
+			} else
+				a->v.num = 0;
+			a->valid = 1;
+			sp--;
+			break;
+		case FOP_NUM_EQ:
+		case FOP_NUM_NE:
+		case FOP_NUM_LT:
+		case FOP_NUM_LE:
+		case FOP_NUM_GT:
+		case FOP_NUM_GE:
+		{
+			unsigned long long x = a->v.num, y = b->v.num;
+			int r = 0;
+
+			if (a->valid && b->valid) {
+				switch (in->op) {
+				case FOP_NUM_EQ: r = x == y; break;
+				case FOP_NUM_NE: r = x != y; break;
+				case FOP_NUM_LT: r = x < y;  break;
+				case FOP_NUM_LE: r = x <= y; break;
+				case FOP_NUM_GT: r = x > y;  break;
+				case FOP_NUM_GE: r = x >= y; break;
+				}
+			}
+			a->v.num = r;
+			a->valid = 1;
+			sp--;
+			break;
+		}
+
+		case FOP_REGEX:
+		case FOP_NREGEX:
+			if (b->valid) {
+				int m = regexec(fl->regs[in->arg.idx], b->v.str, 0, NULL, 0) == 0;
+				b->v.num = in->op == FOP_REGEX ? m : !m;
+			} else
+				b->v.num = 0;
+			b->valid = 1;
+			break;
+		case FOP_NOT:
+			b->v.num = !b->v.num;
+			break;
+		case FOP_JFALSE:
+		case FOP_JTRUE:
+			if (!b->v.num == (in->op == FOP_JFALSE))
+				ip = in->arg.idx;
+			else
+				sp--;
+			break;
+		}
+	}
+
+	return fl->stack[0].v.num ? 1 : 0;
+}
+
+/**
+ * scols_table_set_filter:
+ * @tb: table
+ * @expr: filter expression or NULL
+ *
+ * Compiles the filter expression for the table, see scols_table_filter_line().
+ * The column names in the expression are resolved by
+ * scols_table_get_column_by_name(), so all the columns used in the
+ * expression have to be already in the table (the columns may be hidden).
+ * The NULL @expr removes the filter.
+ *
+ * The error message is available by scols_table_get_filter_errmsg().
+ *
+ * Returns: 0, a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_set_filter(struct libscols_table *tb, const char *expr)
+{
+	struct libscols_filter *fl;
+	int rc;
+
+	if (!tb)
+		return -EINVAL;
+
+	__scols_filter_free(tb->filter);
+	tb->filter = NULL;
+	*tb->filter_errmsg = '\0';
+
+	if (!expr)
+		return 0;
+
+	fl = calloc(1, sizeof(*fl));
+	if (!fl)
+		return -ENOMEM;
+
+	fl->tb = tb;
+	rc = filter_compile(fl, expr);
+	if (rc) {
+		DBG(TAB, ul_debugobj(tb, "filter: %s", fl->errmsg));
+		xstrncpy(tb->filter_errmsg, fl->errmsg, sizeof(tb->filter_errmsg));
+		__scols_filter_free(fl);
+		return rc;
+	}
+
+	tb->filter = fl;
+	return 0;
+}
+
+/**
+ * scols_table_get_filter_errmsg:
+ * @tb: table
+ *
+ * Returns: the last scols_table_set_filter() error message or NULL.
+ *
+ * Since: 2.39
+ */
+const char *scols_table_get_filter_errmsg(struct libscols_table *tb)
+{
+	return tb && *tb->filter_errmsg ? tb->filter_errmsg : NULL;
+}
+
+/**
+ * scols_table_filter_line:
+ * @tb: table
+ * @ln: line
+ *
+ * Evaluates the table filter for the line. The line does not have to be in
+ * the table, but the line cells have to be set for the columns used by the
+ * filter. The recommended way is to fill these cells, call this function
+ * and skip (or remove) the line before any other (more expensive) data are
+ * generated for the line.
+ *
+ * The filter uses a private evaluation stack, don't call this function for
+ * the same table from more threads at the same time.
+ *
+ * Returns: 1 if the line matches (or the table has no filter), 0 if not,
+ *          and a negative value in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_filter_line(struct libscols_table *tb, struct libscols_line *ln)
+{
+	if (!tb || !ln)
+		return -EINVAL;
+	if (!tb->filter)
+		return 1;
+	return filter_eval(tb->filter, ln);
+}
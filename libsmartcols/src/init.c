@@ -24,6 +24,7 @@ UL_DEBUG_DEFINE_MASKNAMES(libsmartcols) =
 	{ "buff", SCOLS_DEBUG_BUFF,	"output buffer utils" },
 	{ "cell", SCOLS_DEBUG_CELL,	"table cell utils" },
 	{ "col", SCOLS_DEBUG_COL,	"cols utils" },
+	{ "filter", SCOLS_DEBUG_FLTR,	"lines filter" },
 	{ "help", SCOLS_DEBUG_HELP,	"this help" },
 	{ "group", SCOLS_DEBUG_GROUP,	"lines grouping utils" },
 	{ "line", SCOLS_DEBUG_LINE,	"table line utils" },
@@ -35,14 +35,29 @@
  * Returns: a pointer to a new struct libscols_line instance.
  */
 struct libscols_line *scols_new_line(void)
+{
+	return __scols_new_line(NULL);
+}
+
+/*
+ * Allocates the line from the arena @ar (if not NULL), the line keeps
+ * reference to the arena.
+ */
+struct libscols_line *__scols_new_line(struct libscols_arena *ar)
 {
 	struct libscols_line *ln;
 
-	ln = calloc(1, sizeof(*ln));
-	if (!ln)
-		return NULL;
+	ln = ar ? __scols_arena_calloc(ar, sizeof(*ln)) : NULL;
+	if (ln) {
+		ln->arena = ar;
+		__scols_ref_arena(ar);
+	} else {
+		ln = calloc(1, sizeof(*ln));
+		if (!ln)
+			return NULL;
+	}
 
-	DBG(LINE, ul_debugobj(ln, "alloc"));
+	DBG(LINE, ul_debugobj(ln, "alloc%s", ln->arena ? " (arena)" : ""));
 	ln->refcount = 1;
 	INIT_LIST_HEAD(&ln->ln_lines);
 	INIT_LIST_HEAD(&ln->ln_children);
@@ -80,7 +95,10 @@ void scols_unref_line(struct libscols_line *ln)
 		scols_unref_group(ln->group);
 		scols_line_free_cells(ln);
 		free(ln->color);
-		free(ln);
+		if (ln->arena)
+			__scols_unref_arena(ln->arena);
+		else
+			free(ln);
 		return;
 	}
 }
@@ -103,7 +121,8 @@ void scols_line_free_cells(struct libscols_line *ln)
 	for (i = 0; i < ln->ncells; i++)
 		scols_reset_cell(&ln->cells[i]);
 
-	free(ln->cells);
+	if (!ln->arena)
+		free(ln->cells);
 	ln->ncells = 0;
 	ln->cells = NULL;
 }
@@ -136,6 +155,22 @@ int scols_line_alloc_cells(struct libscols_line *ln, size_t n)
 
 	DBG(LINE, ul_debugobj(ln, "alloc %zu cells", n));
 
+	if (ln->arena) {
+		/* the old array is not returned to the arena */
+		if (n < ln->ncells) {
+			ln->ncells = n;
+			return 0;
+		}
+		ce = __scols_arena_calloc(ln->arena, n * sizeof(struct libscols_cell));
+		if (!ce)
+			return -ENOMEM;
+		if (ln->ncells)
+			memcpy(ce, ln->cells, ln->ncells * sizeof(struct libscols_cell));
+		ln->cells = ce;
+		ln->ncells = n;
+		return 0;
+	}
+
 	ce = realloc(ln->cells, n * sizeof(struct libscols_cell));
 	if (!ce)
 		return -errno;
@@ -414,7 +449,9 @@ struct libscols_cell *scols_line_get_cell(struct libscols_line *ln,
  * @ln: a pointer to a struct libscols_line instance
  * @cl: pointer to cell
  *
- * Like scols_line_get_cell() by cell is referenced by column.
+ * Like scols_line_get_cell() by cell is referenced by column. If the column
+ * has a data function (see scols_column_set_datafunc()) and the cell is
+ * empty then the function is called to generate the data.
  *
  * Returns: the @n-th cell in @ln, NULL in case of an error.
  */
@@ -425,9 +462,29 @@ struct libscols_cell *scols_line_get_column_cell(
 	if (!ln || !cl)
 		return NULL;
 
+	if (cl->datafunc)
+		__scols_line_fill_cell(ln, cl);
 	return scols_line_get_cell(ln, cl->seqnum);
 }
 
+/*
+ * Calls the column data function (see scols_column_set_datafunc()) if the
+ * cell data are not set yet. The function is called only once for the cell.
+ */
+int __scols_line_fill_cell(struct libscols_line *ln, struct libscols_column *cl)
+{
+	struct libscols_cell *ce = scols_line_get_cell(ln, cl->seqnum);
+	char *data;
+
+	if (!ce || ce->data || ce->is_filled || !cl->datafunc)
+		return 0;
+
+	ce->is_filled = 1;
+	data = cl->datafunc(cl, ln, cl->datafunc_data);
+
+	return data ? scols_cell_refer_data(ce, data) : 0;
+}
+
 /**
  * scols_line_set_data:
  * @ln: a pointer to a struct libscols_line instance
@@ -442,6 +499,11 @@ int scols_line_set_data(struct libscols_line *ln, size_t n, const char *data)
 
 	if (!ce)
 		return -EINVAL;
+
+	/* only the first data, the arena does not reuse memory */
+	if (ln->arena && !ce->data)
+		return __scols_cell_set_arena_data(ce, ln->arena, data);
+
 	return scols_cell_set_data(ce, data);
 }
 
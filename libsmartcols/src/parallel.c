@@ -0,0 +1,64 @@
+/*
+ * parallel.c - helpers for scols_table_set_nthreads()
+ *
+ * Copyright (C) 2026 util-linux contributors
+ *
+ * This file may be redistributed under the terms of the
+ * GNU Lesser General Public License.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "smartcolsP.h"
+
+/*
+ * Returns number of threads for a job with @nitems items, zero or one means
+ * that the job should be done serially.
+ */
+size_t __scols_nthreads(struct libscols_table *tb, size_t nitems)
+{
+	size_t n;
+
+	if (tb->nthreads <= 1 || nitems < SCOLS_PARALLEL_MINITEMS * 2)
+		return 0;
+
+	n = nitems / SCOLS_PARALLEL_MINITEMS;
+	return n < tb->nthreads ? n : tb->nthreads;
+}
+
+/*
+ * Calls @fn for all @nargs items of the @args array (every item is @argsz
+ * bytes) and every call in a separate thread. The first item is processed by
+ * the current thread, and if a thread cannot be created then the item is also
+ * processed by the current thread.
+ */
+void __scols_run_parallel(void *(*fn)(void *), void *args, size_t nargs, size_t argsz)
+{
+	pthread_t *threads;
+	char *created;
+	size_t i;
+
+	if (!nargs)
+		return;
+
+	threads = calloc(nargs, sizeof(pthread_t));
+	created = calloc(nargs, sizeof(char));
+
+	for (i = 1; threads && created && i < nargs; i++) {
+		if (pthread_create(&threads[i], NULL, fn,
+				   (char *) args + i * argsz) == 0)
+			created[i] = 1;
+	}
+
+	fn(args);
+
+	for (i = 1; i < nargs; i++) {
+		if (created && created[i])
+			pthread_join(threads[i], NULL);
+		else
+			fn((char *) args + i * argsz);
+	}
+
+	free(threads);
+	free(created);
+}
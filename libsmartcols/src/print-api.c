@@ -1,4 +1,5 @@
 #include "smartcolsP.h"
+#include "ultrace.h"
 
 /**
  * scola_table_print_range:
@@ -114,10 +115,16 @@ static int do_print_table(struct libscols_table *tb, int *is_empty)
 		DBG(TAB, ul_debugobj(tb, "error -- no columns"));
 		return -EINVAL;
 	}
+	if (tb->stream_started)
+		return __scols_print_stream(tb, TRUE);
+
 	if (list_empty(&tb->tb_lines)) {
 		DBG(TAB, ul_debugobj(tb, "ignore -- no lines"));
-		if (scols_table_is_json(tb)) {
-			ul_jsonwrt_init(&tb->json, tb->out, 0);
+		if (is_jsonwrt_format(tb)) {
+			if (tb->format == SCOLS_FMT_CBOR)
+				ul_jsonwrt_init_cbor(&tb->json, tb->out);
+			else
+				ul_jsonwrt_init(&tb->json, tb->out, 0);
 			ul_jsonwrt_root_open(&tb->json);
 			ul_jsonwrt_array_open(&tb->json, tb->name ? tb->name : "");
 			ul_jsonwrt_array_close(&tb->json);
@@ -132,7 +139,7 @@ static int do_print_table(struct libscols_table *tb, int *is_empty)
 	if (rc)
 		return rc;
 
-	if (scols_table_is_json(tb)) {
+	if (is_jsonwrt_format(tb)) {
 		ul_jsonwrt_root_open(&tb->json);
 		ul_jsonwrt_array_open(&tb->json, tb->name ? tb->name : "");
 	}
@@ -149,7 +156,7 @@ static int do_print_table(struct libscols_table *tb, int *is_empty)
 	else
 		rc = __scols_print_table(tb, &buf);
 
-	if (scols_table_is_json(tb)) {
+	if (is_jsonwrt_format(tb)) {
 		ul_jsonwrt_array_close(&tb->json);
 		ul_jsonwrt_root_close(&tb->json);
 	}
@@ -168,11 +175,18 @@ done:
  */
 int scols_print_table(struct libscols_table *tb)
 {
+	struct ul_trace_span sp;
 	int empty = 0;
-	int rc = do_print_table(tb, &empty);
+	int rc;
 
-	if (rc == 0 && !empty && !scols_table_is_json(tb))
+	ul_trace_begin(&sp, "scols:print");
+	UL_PROBE1(libsmartcols, print__begin, tb);
+	rc = do_print_table(tb, &empty);
+
+	if (rc == 0 && !empty && !is_jsonwrt_format(tb))
 		fputc('\n', tb->out);
+	UL_PROBE2(libsmartcols, print__end, tb, rc);
+	ul_trace_end(&sp);
 	return rc;
 }
 
@@ -218,3 +232,73 @@ int scols_print_table_to_string(
 	return -ENOSYS;
 }
 #endif
+
+/**
+ * scols_print_table_diff:
+ * @tb: table
+ * @prev: previous output (or NULL), replaced by the current output
+ * @emit: function to output a line
+ * @data: private data for @emit
+ *
+ * Prints the table to a string and calls @emit for all output lines (@row
+ * is the line number, the header is the first line if printed) which are
+ * not the same as the line at the same position in @prev. If the previous
+ * output has more lines then @emit is called with NULL @line for the
+ * extra lines. The lines are not terminated by a line separator.
+ *
+ * This is designed for top-like tools which redraw the table on a terminal,
+ * @prev is usually kept between refreshes (the table itself may be
+ * recreated). Set *@prev to NULL to force a full redraw and free() it if no
+ * more necessary.
+ *
+ * Returns: 0, a negative value in case of an error or @emit return code.
+ *
+ * Since: 2.39
+ */
+int scols_print_table_diff(struct libscols_table *tb, char **prev,
+		int (*emit)(struct libscols_table *, size_t, const char *, void *),
+		void *data)
+{
+	char *cur = NULL, *p, *o;
+	size_t row = 0;
+	int rc;
+
+	if (!tb || !prev || !emit)
+		return -EINVAL;
+
+	rc = scols_print_table_to_string(tb, &cur);
+	if (rc) {
+		free(cur);
+		return rc;
+	}
+
+	p = cur;
+	o = *prev;
+
+	while (rc == 0 && ((p && *p) || (o && *o))) {
+		char *pe = p && *p ? strchrnul(p, '\n') : NULL;
+		char *oe = o && *o ? strchrnul(o, '\n') : NULL;
+		int same = pe && oe && pe - p == oe - o
+			   && memcmp(p, o, pe - p) == 0;
+
+		if (!same) {
+			char c = 0;
+
+			if (pe) {
+				c = *pe;
+				*pe = '\0';
+			}
+			rc = emit(tb, row, pe ? p : NULL, data);
+			if (pe)
+				*pe = c;
+		}
+		row++;
+		p = pe && *pe ? pe + 1 : NULL;
+		o = oe && *oe ? oe + 1 : NULL;
+	}
+
+	DBG(TAB, ul_debugobj(tb, "diff printed (%zu lines)", row));
+	free(*prev);
+	*prev = cur;
+	return rc;
+}
@@ -78,7 +78,7 @@ static int is_next_columns_empty(
 		if (scols_column_is_tree(cl))
 			return 0;
 
-		ce = scols_line_get_cell(ln, cl->seqnum);
+		ce = scols_line_get_column_cell(ln, cl);
 		if (ce)
 			data = scols_cell_get_data(ce);
 		if (data && *data)
@@ -87,17 +87,26 @@ static int is_next_columns_empty(
 	return 1;
 }
 
+/* the part of the children's prefix for @ln */
+const char *__scols_tree_art(struct libscols_table *tb, struct libscols_line *ln)
+{
+	return is_last_child(ln) ? "  " : vertical_symbol(tb);
+}
+
 /* returns pointer to the end of used data */
 static int tree_ascii_art_to_buffer(struct libscols_table *tb,
 				    struct libscols_line *ln,
 				    struct ul_buffer *buf)
 {
-	const char *art;
 	int rc;
 
 	assert(ln);
 	assert(buf);
 
+	/* the art of the ancestors cached by scols_walk_tree() */
+	if (ln == tb->walk_prefix_line)
+		return ul_buffer_append_data(buf, tb->walk_prefix, tb->walk_prefix_len);
+
 	if (!ln->parent)
 		return 0;
 
@@ -105,12 +114,7 @@ static int tree_ascii_art_to_buffer(struct libscols_table *tb,
 	if (rc)
 		return rc;
 
-	if (is_last_child(ln))
-		art = "  ";
-	else
-		art = vertical_symbol(tb);
-
-	return ul_buffer_append_string(buf, art);
+	return ul_buffer_append_string(buf, __scols_tree_art(tb, ln));
 }
 
 static int grpset_is_empty(	struct libscols_table *tb,
@@ -247,6 +251,30 @@ static int has_pending_data(struct libscols_table *tb)
 	return 0;
 }
 
+/*
+ * Writes @n padding symbols; the usual one byte symbol is written by one
+ * fwrite() rather than symbol by symbol.
+ */
+static void fputs_padding(struct libscols_table *tb, size_t n)
+{
+	const char *sym = cellpadding_symbol(tb);
+
+	if (sym[0] && !sym[1]) {
+		char pad[64];
+
+		memset(pad, sym[0], min(n, sizeof(pad)));
+		while (n) {
+			size_t sz = min(n, sizeof(pad));
+
+			fwrite(pad, 1, sz, tb->out);
+			n -= sz;
+		}
+	} else {
+		for (; n > 0; n--)
+			fputs(sym, tb->out);
+	}
+}
+
 static void fputs_color_reset(struct libscols_table *tb)
 {
 	if (tb->cur_color) {
@@ -376,8 +404,8 @@ done:
 	}
 
 	/* fill rest of cell with space */
-	for(; len_pad < cl->width; ++len_pad)
-		fputs(cellpadding_symbol(tb), tb->out);
+	if (len_pad < cl->width)
+		fputs_padding(tb, cl->width - len_pad);
 
 	fputs_color_cell_close(tb, cl, ln, ce);
 
@@ -477,7 +505,7 @@ static int print_pending_data(
 		struct libscols_cell *ce)
 {
 	size_t width = cl->width, bytes;
-	size_t len = width, i;
+	size_t len = width;
 	char *data;
 	char *nextchunk = NULL;
 
@@ -526,8 +554,8 @@ static int print_pending_data(
 	}
 
 	/* fill rest of cell with space */
-	for(i = len; i < width; i++)
-		fputs(cellpadding_symbol(tb), tb->out);
+	if (len < width)
+		fputs_padding(tb, width - len);
 
 	fputs_color_cell_close(tb, cl, ln, ce);
 
@@ -594,7 +622,7 @@ static int print_data(struct libscols_table *tb,
 		      struct libscols_cell *ce,	/* optional */
 		      struct ul_buffer *buf)
 {
-	size_t len = 0, i, width, bytes;
+	size_t len = 0, width, bytes;
 	char *data, *nextchunk;
 	const char *name = NULL;
 	int is_last;
@@ -614,7 +642,7 @@ static int print_data(struct libscols_table *tb,
 
 	is_last = is_last_column(cl);
 
-	if (is_last && scols_table_is_json(tb) &&
+	if (is_last && is_jsonwrt_format(tb) &&
 	    scols_table_is_tree(tb) && has_children(ln))
 		/* "children": [] is the real last value */
 		is_last = 0;
@@ -635,6 +663,7 @@ static int print_data(struct libscols_table *tb,
 		return 0;
 
 	case SCOLS_FMT_JSON:
+	case SCOLS_FMT_CBOR:
 		print_json_data(tb, cl, name, data);
 		return 0;
 
@@ -644,7 +673,11 @@ static int print_data(struct libscols_table *tb,
 
 	/* Encode. Note that 'len' and 'width' are number of cells, not bytes.
 	 */
-	if (scols_table_is_noencoding(tb))
+	if (ln && ce && ce->is_ascii && !scols_column_is_tree(cl)) {
+		/* the buffer contains only the cell data */
+		data = ul_buffer_get_data(buf, &bytes, NULL);
+		len = ce->width;
+	} else if (scols_table_is_noencoding(tb))
 		data = ul_buffer_get_data(buf, &bytes, &len);
 	else
 		data = ul_buffer_get_safe_data(buf, &bytes, &len, scols_column_get_safechars(cl));
@@ -696,8 +729,8 @@ static int print_data(struct libscols_table *tb,
 
 	if (data && *data) {
 		if (scols_column_is_right(cl)) {
-			for (i = len; i < width; i++)
-				fputs(cellpadding_symbol(tb), tb->out);
+			if (len < width)
+				fputs_padding(tb, width - len);
 			len = width;
 		}
 		fputs(data, tb->out);
@@ -717,8 +750,8 @@ static int print_data(struct libscols_table *tb,
 	}
 
 	/* fill rest of cell with space */
-	for(i = len; i < width; i++)
-		fputs(cellpadding_symbol(tb), tb->out);
+	if (len < width)
+		fputs_padding(tb, width - len);
 
 	fputs_color_cell_close(tb, cl, ln, ce);
 
@@ -749,7 +782,7 @@ int __cell_to_buffer(struct libscols_table *tb,
 
 	ul_buffer_reset_data(buf);
 
-	ce = scols_line_get_cell(ln, cl->seqnum);
+	ce = scols_line_get_column_cell(ln, cl);
 	data = ce ? scols_cell_get_data(ce) : NULL;
 
 	if (!scols_column_is_tree(cl))
@@ -758,13 +791,13 @@ int __cell_to_buffer(struct libscols_table *tb,
 	/*
 	 * Group stuff
 	 */
-	if (!scols_table_is_json(tb) && cl->is_groups)
+	if (!is_jsonwrt_format(tb) && cl->is_groups)
 		rc = groups_ascii_art_to_buffer(tb, ln, buf, 0);
 
 	/*
 	 * Tree stuff
 	 */
-	if (!rc && ln->parent && !scols_table_is_json(tb)) {
+	if (!rc && ln->parent && !is_jsonwrt_format(tb)) {
 		rc = tree_ascii_art_to_buffer(tb, ln->parent, buf);
 
 		if (!rc && is_last_child(ln))
@@ -773,7 +806,7 @@ int __cell_to_buffer(struct libscols_table *tb,
 			rc = ul_buffer_append_string(buf, branch_symbol(tb));
 	}
 
-	if (!rc && (ln->parent || cl->is_groups) && !scols_table_is_json(tb))
+	if (!rc && (ln->parent || cl->is_groups) && !is_jsonwrt_format(tb))
 		ul_buffer_save_pointer(buf, SCOLS_BUFPTR_TREEEND);
 
 	if (!rc && data)
@@ -797,6 +830,8 @@ static int print_line(struct libscols_table *tb,
 
 	DBG(LINE, ul_debugobj(ln, "     printing line"));
 
+	/* lock the stream only once for all the line */
+	flockfile(tb->out);
 	fputs_color_line_open(tb, ln);
 
 	/* regular line */
@@ -807,7 +842,7 @@ static int print_line(struct libscols_table *tb,
 		rc = __cell_to_buffer(tb, ln, cl, buf);
 		if (rc == 0)
 			rc = print_data(tb, cl, ln,
-					scols_line_get_cell(ln, cl->seqnum),
+					scols_line_get_column_cell(ln, cl),
 					buf);
 		if (rc == 0 && cl->pending_data)
 			pending = 1;
@@ -826,7 +861,7 @@ static int print_line(struct libscols_table *tb,
 			if (scols_column_is_hidden(cl))
 				continue;
 			if (cl->pending_data) {
-				rc = print_pending_data(tb, cl, ln, scols_line_get_cell(ln, cl->seqnum));
+				rc = print_pending_data(tb, cl, ln, scols_line_get_column_cell(ln, cl));
 				if (rc == 0 && cl->pending_data)
 					pending = 1;
 			} else
@@ -835,6 +870,7 @@ static int print_line(struct libscols_table *tb,
 		fputs_color_line_close(tb);
 	}
 
+	funlockfile(tb->out);
 	return 0;
 }
 
@@ -950,7 +986,7 @@ int __scols_print_header(struct libscols_table *tb, struct ul_buffer *buf)
 	if ((tb->header_printed == 1 && tb->header_repeat == 0) ||
 	    scols_table_is_noheadings(tb) ||
 	    scols_table_is_export(tb) ||
-	    scols_table_is_json(tb) ||
+	    is_jsonwrt_format(tb) ||
 	    list_empty(&tb->tb_lines))
 		return 0;
 
@@ -1011,12 +1047,12 @@ int __scols_print_range(struct libscols_table *tb,
 
 		int last = scols_iter_is_last(itr);
 
-		if (scols_table_is_json(tb))
+		if (is_jsonwrt_format(tb))
 			ul_jsonwrt_object_open(&tb->json, NULL);
 
 		rc = print_line(tb, ln, buf);
 
-		if (scols_table_is_json(tb))
+		if (is_jsonwrt_format(tb))
 			ul_jsonwrt_object_close(&tb->json);
 		else if (last == 0 && tb->no_linesep == 0) {
 			fputs(linesep(tb), tb->out);
@@ -1034,6 +1070,80 @@ int __scols_print_range(struct libscols_table *tb,
 
 }
 
+/*
+ * Streaming output: the first lines are used to calculate columns width and
+ * then all complete lines are printed and removed from the table. The last
+ * line is kept in the table as caller is probably still filling it. The
+ * @final prints all lines and terminates the output.
+ */
+int __scols_print_stream(struct libscols_table *tb, int final)
+{
+	struct libscols_line *ln;
+	int rc = 0;
+
+	assert(tb);
+
+	if (!tb->stream_started) {
+		size_t sample = tb->stream_sample ? tb->stream_sample : 1;
+
+		if (!final && tb->nlines <= sample)
+			return 0;
+
+		DBG(TAB, ul_debugobj(tb, "initialize streaming [sample=%zu]", sample));
+		tb->header_printed = 0;
+		rc = __scols_initialize_printing(tb, &tb->stream_buf);
+		if (rc)
+			return rc;
+		tb->stream_started = 1;
+
+		if (is_jsonwrt_format(tb)) {
+			ul_jsonwrt_root_open(&tb->json);
+			ul_jsonwrt_array_open(&tb->json, tb->name ? tb->name : "");
+		}
+		if (tb->format == SCOLS_FMT_HUMAN)
+			__scols_print_title(tb);
+
+		rc = __scols_print_header(tb, &tb->stream_buf);
+		if (rc)
+			goto done;
+	}
+
+	while (rc == 0 && !list_empty(&tb->tb_lines)) {
+		int last;
+
+		ln = list_entry(tb->tb_lines.next, struct libscols_line, ln_lines);
+		last = ln->ln_lines.next == &tb->tb_lines;
+		if (last && !final)
+			break;
+
+		if (is_jsonwrt_format(tb))
+			ul_jsonwrt_object_open(&tb->json, NULL);
+
+		rc = print_line(tb, ln, &tb->stream_buf);
+
+		if (is_jsonwrt_format(tb))
+			ul_jsonwrt_object_close(&tb->json);
+		else if (last == 0 && tb->no_linesep == 0) {
+			fputs(linesep(tb), tb->out);
+			tb->termlines_used++;
+		}
+		scols_table_remove_line(tb, ln);
+	}
+
+	if (!final && rc == 0)
+		return 0;
+
+	if (is_jsonwrt_format(tb)) {
+		ul_jsonwrt_array_close(&tb->json);
+		ul_jsonwrt_root_close(&tb->json);
+	}
+done:
+	DBG(TAB, ul_debugobj(tb, "finalize streaming [rc=%d]", rc));
+	__scols_cleanup_printing(tb, &tb->stream_buf);
+	tb->stream_started = 0;
+	return rc;
+}
+
 int __scols_print_table(struct libscols_table *tb, struct ul_buffer *buf)
 {
 	struct libscols_iter itr;
@@ -1053,7 +1163,7 @@ static int print_tree_line(struct libscols_table *tb,
 
 	DBG(LINE, ul_debugobj(ln, "   printing tree line"));
 
-	if (scols_table_is_json(tb))
+	if (is_jsonwrt_format(tb))
 		ul_jsonwrt_object_open(&tb->json, NULL);
 
 	rc = print_line(tb, ln, buf);
@@ -1061,7 +1171,7 @@ static int print_tree_line(struct libscols_table *tb,
 		return rc;
 
 	if (has_children(ln)) {
-		if (scols_table_is_json(tb))
+		if (is_jsonwrt_format(tb))
 			ul_jsonwrt_array_open(&tb->json, "children");
 		else {
 			/* between parent and child is separator */
@@ -1072,7 +1182,7 @@ static int print_tree_line(struct libscols_table *tb,
 		int last;
 
 		/* terminate all open last children for JSON */
-		if (scols_table_is_json(tb)) {
+		if (is_jsonwrt_format(tb)) {
 			do {
 				last = (is_child(ln) && is_last_child(ln)) ||
 				       (is_tree_root(ln) && is_last_tree_root(tb, ln));
@@ -1181,6 +1291,9 @@ int __scols_initialize_printing(struct libscols_table *tb, struct ul_buffer *buf
 	case SCOLS_FMT_RAW:
 		extra_bufsz += tb->ncols;			/* separator between columns */
 		break;
+	case SCOLS_FMT_CBOR:
+		ul_jsonwrt_init_cbor(&tb->json, tb->out);
+		break;
 	case SCOLS_FMT_JSON:
 		ul_jsonwrt_init(&tb->json, tb->out, 0);
 		extra_bufsz += tb->nlines * 3;		/* indentation */
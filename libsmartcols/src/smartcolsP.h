@@ -32,6 +32,7 @@
 #define SCOLS_DEBUG_COL		(1 << 5)
 #define SCOLS_DEBUG_BUFF	(1 << 6)
 #define SCOLS_DEBUG_GROUP	(1 << 7)
+#define SCOLS_DEBUG_FLTR	(1 << 8)
 #define SCOLS_DEBUG_ALL		0xFFFF
 
 UL_DEBUG_DECLARE_MASK(libsmartcols);
@@ -75,17 +76,45 @@ struct libscols_symbols {
 	char	*cell_padding;
 };
 
+struct libscols_arena;		/* see arena.c */
+
 /*
  * Table cells
  */
+enum {
+	SCOLS_SORTKEY_NONE = 0,
+	SCOLS_SORTKEY_U64,
+	SCOLS_SORTKEY_I64,
+	SCOLS_SORTKEY_DOUBLE,
+	SCOLS_SORTKEY_STRING
+};
+
 struct libscols_cell {
 	char	*data;
 	char	*color;
 	void    *userdata;
 	int	flags;
+	size_t	width;		/* mbs_safe_width() of data, see cell_refresh_width() */
+
+	union {
+		uint64_t	num;	/* numbers converted to unsigned order */
+		char		*str;	/* strxfrm() collation key */
+	} sortkey;		/* see scols_cell_set_sortkey_u64() */
+
+	unsigned int is_ascii :1,	/* printable ASCII only, the data are never encoded */
+		     is_filled :1,	/* column data function already called */
+		     data_in_arena :1,	/* data allocated from line arena */
+		     sortkey_type :3;	/* SCOLS_SORTKEY_* */
 };
 
+extern int __scols_cmp_sortkeys(const struct libscols_cell *a,
+				const struct libscols_cell *b);
+
 extern int scols_line_move_cells(struct libscols_line *ln, size_t newn, size_t oldn);
+extern int __scols_cell_set_arena_data(struct libscols_cell *ce,
+				struct libscols_arena *ar, const char *data);
+extern int __scols_line_fill_cell(struct libscols_line *ln, struct libscols_column *cl);
+extern void __scols_table_fill_cells(struct libscols_table *tb, struct libscols_column *cl);
 
 /*
  * Table column
@@ -125,6 +154,9 @@ struct libscols_column {
 			char *, void *);
 	void *wrapfunc_data;
 
+	char *(*datafunc)(struct libscols_column *,
+			  struct libscols_line *, void *);	/* lazy cell data */
+	void *datafunc_data;
 
 	struct libscols_cell	header;		/* column name with color etc. */
 	char	*shellvar;			/* raw colum name in shell compatible format */
@@ -134,7 +166,9 @@ struct libscols_column {
 	struct libscols_table	*table;
 
 	unsigned int	is_extreme : 1,		/* extreme width in the column */
-			is_groups  : 1;		/* print group chart */
+			is_groups  : 1,		/* print group chart */
+			in_colstore : 1,	/* width cached in table->colstore */
+			sort_by_keys : 1;	/* scols_sort_table() uses cells sort keys */
 
 };
 
@@ -190,13 +224,31 @@ struct libscols_line {
 	struct libscols_line	*parent;
 	struct libscols_group	*parent_group;	/* for group childs */
 	struct libscols_group	*group;		/* for group members */
+
+	struct libscols_arena	*arena;		/* the line and cells are from the arena */
 };
 
+extern struct libscols_line *__scols_new_line(struct libscols_arena *ar);
+
 enum {
 	SCOLS_FMT_HUMAN = 0,		/* default, human readable */
 	SCOLS_FMT_RAW,			/* space separated */
 	SCOLS_FMT_EXPORT,		/* COLNAME="data" ... */
-	SCOLS_FMT_JSON			/* http://en.wikipedia.org/wiki/JSON */
+	SCOLS_FMT_JSON,			/* http://en.wikipedia.org/wiki/JSON */
+	SCOLS_FMT_CBOR			/* RFC 8949, binary JSON data model */
+};
+
+/* JSON and CBOR output are both written by ul_jsonwrt */
+#define is_jsonwrt_format(_tb)	((_tb)->format == SCOLS_FMT_JSON || \
+				 (_tb)->format == SCOLS_FMT_CBOR)
+
+/*
+ * Column-major cache of the cells width, see colstore.c
+ */
+struct libscols_colstore {
+	size_t		nlines;
+	size_t		ncols;
+	uint32_t	*width;		/* ncols x nlines, column by column */
 };
 
 /*
@@ -226,6 +278,10 @@ struct libscols_table {
 
 	size_t			ngrpchlds_pending;	/* groups with not yet printed children */
 	struct libscols_line	*walk_last_tree_root;	/* last root, used by scols_walk_() */
+	struct libscols_line	*walk_prefix_line;	/* walk_prefix is tree art of this line */
+	char			*walk_prefix;		/* tree art of the ancestors, see walk.c */
+	size_t			walk_prefix_len;
+	size_t			walk_prefix_sz;
 
 	struct libscols_column	*dflt_sort_column;	/* default sort column, set by scols_sort_table() */
 
@@ -233,6 +289,7 @@ struct libscols_table {
 	struct libscols_cell	title;		/* optional table title (for humans) */
 
 	struct ul_jsonwrt	json;		/* JSON formatting */
+	struct libscols_colstore colstore;	/* used by __scols_calculate() */
 
 	int	format;		/* SCOLS_FMT_* */
 
@@ -241,6 +298,15 @@ struct libscols_table {
 
 	const char *cur_color;	/* current active color when printing */
 
+	size_t	nthreads;		/* scols_table_set_nthreads() */
+
+	size_t	stream_sample;		/* number of lines used to calculate widths */
+	struct ul_buffer stream_buf;	/* print buffer for streaming output */
+
+	struct libscols_arena *arena;	/* memory for lines, see arena.c */
+	struct libscols_filter *filter;	/* scols_table_set_filter() */
+	char	filter_errmsg[128];	/* scols_table_get_filter_errmsg() */
+
 	/* flags */
 	unsigned int	ascii		:1,	/* don't use unicode */
 			colors_wanted	:1,	/* enable colors */
@@ -257,7 +323,9 @@ struct libscols_table {
 			no_headings	:1,	/* don't print header */
 			no_encode	:1,	/* don't care about control and non-printable chars */
 			no_linesep	:1,	/* don't print line separator */
-			no_wrap		:1;	/* never wrap lines */
+			no_wrap		:1,	/* never wrap lines */
+			streaming	:1,	/* print lines in scols_table_add_line() */
+			stream_started	:1;	/* streaming output initialized */
 };
 
 #define IS_ITER_FORWARD(_i)	((_i)->direction == SCOLS_ITER_FORWARD)
@@ -325,6 +393,44 @@ extern int scols_walk_tree(struct libscols_table *tb,
                     void *data);
 extern int scols_walk_is_last(struct libscols_table *tb, struct libscols_line *ln);
 
+/*
+ * colstore.c
+ */
+extern size_t __scols_data_width(struct libscols_table *tb,
+				 struct libscols_column *cl,
+				 const char *data);
+extern size_t __scols_cell_width(struct libscols_table *tb,
+				 struct libscols_column *cl,
+				 struct libscols_cell *ce);
+extern int __scols_colstore_build(struct libscols_table *tb);
+extern void __scols_colstore_reset(struct libscols_table *tb);
+extern const uint32_t *__scols_colstore_get_widths(struct libscols_table *tb,
+						   struct libscols_column *cl);
+
+/*
+ * parallel.c
+ */
+#define SCOLS_PARALLEL_MINITEMS	4096	/* minimal number of items per thread */
+
+extern size_t __scols_nthreads(struct libscols_table *tb, size_t nitems);
+extern void __scols_run_parallel(void *(*fn)(void *), void *args,
+				 size_t nargs, size_t argsz);
+
+/*
+ * arena.c
+ */
+extern struct libscols_arena *__scols_new_arena(void);
+extern void __scols_ref_arena(struct libscols_arena *ar);
+extern void __scols_unref_arena(struct libscols_arena *ar);
+extern void *__scols_arena_calloc(struct libscols_arena *ar, size_t sz);
+extern char *__scols_arena_strdup(struct libscols_arena *ar, const char *str);
+
+/*
+ * filter.c
+ */
+struct libscols_filter;
+extern void __scols_filter_free(struct libscols_filter *fl);
+
 /*
  * calculate.c
  */
@@ -348,6 +454,8 @@ int __scols_print_range(struct libscols_table *tb,
                         struct ul_buffer *buf,
                         struct libscols_iter *itr,
                         struct libscols_line *end);
+int __scols_print_stream(struct libscols_table *tb, int final);
+const char *__scols_tree_art(struct libscols_table *tb, struct libscols_line *ln);
 
 static inline int is_tree_root(struct libscols_line *ln)
 {
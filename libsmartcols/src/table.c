@@ -134,6 +134,10 @@ void scols_unref_table(struct libscols_table *tb)
 		free(tb->linesep);
 		free(tb->colsep);
 		free(tb->name);
+		ul_buffer_free_data(&tb->stream_buf);
+		free(tb->walk_prefix);
+		__scols_filter_free(tb->filter);
+		__scols_unref_arena(tb->arena);
 		free(tb);
 		DBG(TAB, ul_debug("<- done"));
 	}
@@ -644,6 +648,9 @@ struct libscols_column *scols_table_get_column_by_name(
  * Note that this function calls scols_line_alloc_cells() if number
  * of the cells in the line is too small for @tb.
  *
+ * If streaming is enabled (see scols_table_enable_streaming()) the function
+ * also prints and removes from the table all lines before @ln.
+ *
  * Returns: 0, a negative value in case of an error.
  */
 int scols_table_add_line(struct libscols_table *tb, struct libscols_line *ln)
@@ -664,6 +671,9 @@ int scols_table_add_line(struct libscols_table *tb, struct libscols_line *ln)
 	list_add_tail(&ln->ln_lines, &tb->tb_lines);
 	ln->seqnum = tb->nlines++;
 	scols_ref_line(ln);
+
+	if (tb->streaming && !scols_table_is_tree(tb))
+		return __scols_print_stream(tb, FALSE);
 	return 0;
 }
 
@@ -752,6 +762,9 @@ int scols_table_next_line(struct libscols_table *tb,
  *   scols_table_add_line(tb, ln);
  *   scols_line_add_child(parent, ln);
  *
+ * but the line, the line cells and the data stored by scols_line_set_data()
+ * are allocated from a memory arena owned by the table. The arena memory
+ * is released in bulk when the table and all its lines are deallocated.
  *
  * Returns: newly allocate line
  */
@@ -763,7 +776,10 @@ struct libscols_line *scols_table_new_line(struct libscols_table *tb,
 	if (!tb)
 		return NULL;
 
-	ln = scols_new_line();
+	if (!tb->arena)
+		tb->arena = __scols_new_arena();
+
+	ln = __scols_new_line(tb->arena);
 	if (!ln)
 		return NULL;
 
@@ -1093,6 +1109,35 @@ int scols_table_enable_json(struct libscols_table *tb, int enable)
 	return 0;
 }
 
+/**
+ * scols_table_enable_cbor:
+ * @tb: table
+ * @enable: 1 or 0
+ *
+ * Enable/disable binary CBOR (RFC 8949) output format. The output uses the
+ * same structure as JSON output (see scols_table_enable_json()), the
+ * column types are specified by scols_column_set_json_type(). The objects
+ * and arrays are encoded as indefinite-length items, so the output can be
+ * streamed. The parsable output formats (export, raw, JSON, ...) are
+ * mutually exclusive.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_enable_cbor(struct libscols_table *tb, int enable)
+{
+	if (!tb)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "cbor: %s", enable ? "ENABLE" : "DISABLE"));
+	if (enable)
+		tb->format = SCOLS_FMT_CBOR;
+	else if (tb->format == SCOLS_FMT_CBOR)
+		tb->format = 0;
+	return 0;
+}
+
 /**
  * scols_table_enable_export:
  * @tb: table
@@ -1257,6 +1302,113 @@ int scols_table_enable_minout(struct libscols_table *tb, int enable)
 	return 0;
 }
 
+/**
+ * scols_table_enable_streaming:
+ * @tb: table
+ * @enable: 1 or 0
+ *
+ * Enable row-at-a-time output. The columns width is calculated from the
+ * header and from the first lines (see scols_table_set_streaming_sample())
+ * and then every line is printed when the next line is added by
+ * scols_table_add_line(). The printed lines are removed from the table, so
+ * the memory usage does not depend on the number of lines. The last line is
+ * printed by scols_print_table().
+ *
+ * Don't modify lines after next line has been added to the table. Trees,
+ * groups, sorting and header repeating are not supported in this mode.
+ * The data wider than the calculated column width are truncated or wrapped
+ * according to the column flags.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_enable_streaming(struct libscols_table *tb, int enable)
+{
+	if (!tb || tb->stream_started)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "streaming: %s", enable ? "ENABLE" : "DISABLE"));
+	tb->streaming = enable ? 1 : 0;
+	return 0;
+}
+
+/**
+ * scols_table_set_streaming_sample:
+ * @tb: table
+ * @nlines: number of lines
+ *
+ * Sets number of lines used to calculate columns width in streaming mode. The
+ * output starts when the table contains @nlines complete lines. The default
+ * (zero) is to use the first line only.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_set_streaming_sample(struct libscols_table *tb, size_t nlines)
+{
+	if (!tb || tb->stream_started)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "streaming sample: %zu", nlines));
+	tb->stream_sample = nlines;
+	return 0;
+}
+
+/**
+ * scols_table_is_streaming:
+ * @tb: table
+ *
+ * Returns: 1 if streaming output is enabled or 0
+ *
+ * Since: 2.39
+ */
+int scols_table_is_streaming(const struct libscols_table *tb)
+{
+	return tb->streaming;
+}
+
+/**
+ * scols_table_set_nthreads:
+ * @tb: table
+ * @nthreads: number of threads
+ *
+ * Allows to use up to @nthreads threads to calculate columns width and to
+ * sort the table lines by scols_sort_table(). The threads are used only for
+ * large tables, the output is always the same as without threads. The
+ * default is zero, do everything in the current thread.
+ *
+ * Note that the columns cmpfunc callbacks (see scols_column_set_cmpfunc())
+ * have to be thread-safe if more than one thread is allowed.
+ *
+ * Returns: 0 on success, negative number in case of an error.
+ *
+ * Since: 2.39
+ */
+int scols_table_set_nthreads(struct libscols_table *tb, size_t nthreads)
+{
+	if (!tb)
+		return -EINVAL;
+
+	DBG(TAB, ul_debugobj(tb, "threads: %zu", nthreads));
+	tb->nthreads = nthreads;
+	return 0;
+}
+
+/**
+ * scols_table_get_nthreads:
+ * @tb: table
+ *
+ * Returns: number of threads, see scols_table_set_nthreads().
+ *
+ * Since: 2.39
+ */
+size_t scols_table_get_nthreads(const struct libscols_table *tb)
+{
+	return tb->nthreads;
+}
+
 /**
  * scols_table_enable_nowrap:
  * @tb: table
@@ -1416,6 +1568,19 @@ int scols_table_is_raw(const struct libscols_table *tb)
 	return tb->format == SCOLS_FMT_RAW;
 }
 
+/**
+ * scols_table_is_cbor:
+ * @tb: table
+ *
+ * Returns: 1 if CBOR output format is enabled.
+ *
+ * Since: 2.39
+ */
+int scols_table_is_cbor(const struct libscols_table *tb)
+{
+	return tb->format == SCOLS_FMT_CBOR;
+}
+
 /**
  * scols_table_is_json:
  * @tb: table
@@ -1513,6 +1678,14 @@ const char *scols_table_get_line_separator(const struct libscols_table *tb)
 {
 	return tb->linesep;
 }
+static inline int cmp_cells(struct libscols_column *cl,
+			    struct libscols_cell *a, struct libscols_cell *b)
+{
+	if (cl->sort_by_keys)
+		return __scols_cmp_sortkeys(a, b);
+	return cl->cmpfunc(a, b, cl->cmpfunc_data);
+}
+
 /* for lines in the struct libscols_line->ln_lines list */
 static int cells_cmp_wrapper_lines(struct list_head *a, struct list_head *b, void *data)
 {
@@ -1529,7 +1702,7 @@ static int cells_cmp_wrapper_lines(struct list_head *a, struct list_head *b, voi
 	ca = scols_line_get_cell(ra, cl->seqnum);
 	cb = scols_line_get_cell(rb, cl->seqnum);
 
-	return cl->cmpfunc(ca, cb, cl->cmpfunc_data);
+	return cmp_cells(cl, ca, cb);
 }
 
 /* for lines in the struct libscols_line->ln_children list */
@@ -1548,7 +1721,7 @@ static int cells_cmp_wrapper_children(struct list_head *a, struct list_head *b,
 	ca = scols_line_get_cell(ra, cl->seqnum);
 	cb = scols_line_get_cell(rb, cl->seqnum);
 
-	return cl->cmpfunc(ca, cb, cl->cmpfunc_data);
+	return cmp_cells(cl, ca, cb);
 }
 
 
@@ -1579,12 +1752,193 @@ static int sort_line_children(struct libscols_line *ln, struct libscols_column *
 	return 0;
 }
 
+struct sort_job {
+	struct list_head	lines;
+	struct libscols_column	*cl;
+};
+
+static void *sort_job_lines(void *data)
+{
+	struct sort_job *job = (struct sort_job *) data;
+
+	list_sort(&job->lines, cells_cmp_wrapper_lines, job->cl);
+	return NULL;
+}
+
+/*
+ * Stable merge of the sorted @b into the sorted @a; @a lines precede @b lines
+ * in the original order, so they win for equal lines.
+ */
+static void merge_sorted_lines(struct list_head *a, struct list_head *b,
+			       struct libscols_column *cl)
+{
+	struct list_head *p = a->next;
+
+	while (!list_empty(b)) {
+		struct list_head *x = b->next;
+
+		while (p != a && cells_cmp_wrapper_lines(p, x, cl) <= 0)
+			p = p->next;
+		if (p == a) {
+			list_splice_tail(b, a);
+			INIT_LIST_HEAD(b);
+			break;
+		}
+		list_del(x);
+		list_add_tail(x, p);	/* before @p */
+	}
+}
+
+/*
+ * The lines are split to @nthreads parts, the parts are sorted in parallel
+ * by list_sort() and merged. The result is the same as list_sort() on whole
+ * table as both are stable.
+ */
+static int sort_lines_parallel(struct libscols_table *tb,
+			       struct libscols_column *cl, size_t nthreads)
+{
+	struct sort_job *jobs = calloc(nthreads, sizeof(struct sort_job));
+	size_t i, chunk;
+
+	if (!jobs)
+		return -ENOMEM;
+
+	chunk = (tb->nlines + nthreads - 1) / nthreads;
+	for (i = 0; i < nthreads; i++) {
+		size_t n;
+
+		INIT_LIST_HEAD(&jobs[i].lines);
+		jobs[i].cl = cl;
+
+		for (n = 0; n < chunk && !list_empty(&tb->tb_lines); n++) {
+			struct list_head *x = tb->tb_lines.next;
+
+			list_del(x);
+			list_add_tail(x, &jobs[i].lines);
+		}
+	}
+	/* paranoid, nlines does not match */
+	list_splice_tail(&tb->tb_lines, &jobs[nthreads - 1].lines);
+	INIT_LIST_HEAD(&tb->tb_lines);
+
+	DBG(TAB, ul_debugobj(tb, "sorting by %zu threads", nthreads));
+	__scols_run_parallel(sort_job_lines, jobs, nthreads, sizeof(*jobs));
+
+	for (i = 0; i < nthreads; i++)
+		merge_sorted_lines(&tb->tb_lines, &jobs[i].lines, cl);
+
+	free(jobs);
+	return 0;
+}
+
+struct sort_item {
+	uint64_t		key;
+	struct libscols_line	*ln;
+};
+
+/*
+ * LSD radix sort of the lines by the numeric sort keys (all of the same type),
+ * the bytes equal for all the keys are skipped. The sort is stable, the
+ * result is the same as list_sort() with __scols_cmp_sortkeys().
+ */
+static int sort_lines_radix(struct libscols_table *tb, struct libscols_column *cl)
+{
+	struct sort_item *items, *tmp, *a, *b;
+	size_t (*counts)[256];
+	size_t i, n = 0;
+	struct list_head *p;
+	int byte;
+
+	list_for_each(p, &tb->tb_lines)
+		n++;
+	if (n < 2)
+		return 0;
+
+	items = malloc(2 * n * sizeof(struct sort_item));
+	counts = calloc(8, sizeof(*counts));
+	if (!items || !counts) {
+		free(items);
+		free(counts);
+		return -ENOMEM;
+	}
+
+	i = 0;
+	list_for_each(p, &tb->tb_lines) {
+		struct libscols_line *ln = list_entry(p, struct libscols_line, ln_lines);
+		uint64_t key = scols_line_get_cell(ln, cl->seqnum)->sortkey.num;
+
+		items[i].key = key;
+		items[i].ln = ln;
+		for (byte = 0; byte < 8; byte++)
+			counts[byte][(key >> (byte * 8)) & 0xff]++;
+		i++;
+	}
+
+	a = items;
+	b = items + n;
+	for (byte = 0; byte < 8; byte++) {
+		size_t *cnt = counts[byte], sum = 0;
+		int shift = byte * 8;
+
+		if (cnt[(a[0].key >> shift) & 0xff] == n)
+			continue;		/* the same for all keys */
+		for (i = 0; i < 256; i++) {
+			size_t x = cnt[i];
+
+			cnt[i] = sum;
+			sum += x;
+		}
+		for (i = 0; i < n; i++)
+			b[cnt[(a[i].key >> shift) & 0xff]++] = a[i];
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	INIT_LIST_HEAD(&tb->tb_lines);
+	for (i = 0; i < n; i++)
+		list_add_tail(&a[i].ln->ln_lines, &tb->tb_lines);
+
+	free(items);
+	free(counts);
+	return 0;
+}
+
+/*
+ * Returns SCOLS_SORTKEY_* if all the lines have sort key of the same type in
+ * the column @cl, SCOLS_SORTKEY_NONE if there is no key, and -1 for mixed
+ * types or the lines without key.
+ */
+static int get_sortkeys_type(struct libscols_table *tb, struct libscols_column *cl)
+{
+	struct list_head *p;
+	size_t nkeys = 0, nlines = 0;
+	int type = SCOLS_SORTKEY_NONE;
+
+	list_for_each(p, &tb->tb_lines) {
+		struct libscols_line *ln = list_entry(p, struct libscols_line, ln_lines);
+		struct libscols_cell *ce = scols_line_get_cell(ln, cl->seqnum);
+		int x = ce ? (int) ce->sortkey_type : SCOLS_SORTKEY_NONE;
+
+		nlines++;
+		if (x == SCOLS_SORTKEY_NONE)
+			continue;
+		if (nkeys++ == 0)
+			type = x;
+		else if (x != type)
+			return -1;
+	}
+	if (nkeys == 0)
+		return SCOLS_SORTKEY_NONE;
+	return nkeys == nlines ? type : -1;
+}
+
 static int  __scols_sort_tree(struct libscols_table *tb, struct libscols_column *cl)
 {
 	struct libscols_line *ln;
 	struct libscols_iter itr;
 
-	if (!tb || !cl || !cl->cmpfunc)
+	if (!tb || !cl || (!cl->cmpfunc && !cl->sort_by_keys))
 		return -EINVAL;
 
 	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
@@ -1593,6 +1947,22 @@ static int  __scols_sort_tree(struct libscols_table *tb, struct libscols_column
 	return 0;
 }
 
+/*
+ * Generates data for all empty cells of the column @cl, see
+ * scols_column_set_datafunc().
+ */
+void __scols_table_fill_cells(struct libscols_table *tb, struct libscols_column *cl)
+{
+	struct libscols_iter itr;
+	struct libscols_line *ln;
+
+	DBG(TAB, ul_debugobj(tb, "generating data for %zu column", cl->seqnum));
+
+	scols_reset_iter(&itr, SCOLS_ITER_FORWARD);
+	while (scols_table_next_line(tb, &itr, &ln) == 0)
+		__scols_line_fill_cell(ln, cl);
+}
+
 /**
  * scols_sort_table:
  * @tb: table
@@ -1601,6 +1971,10 @@ static int  __scols_sort_tree(struct libscols_table *tb, struct libscols_column
  * Orders the table by the column. See also scols_column_set_cmpfunc(). If the
  * tree output is enabled then children in the tree are recursively sorted too.
  *
+ * If all the cells of the column have sort key (see scols_cell_set_sortkey_u64())
+ * then the keys are used rather than the column cmpfunc. The keys are also used
+ * if only some cells have the key and the cmpfunc is not defined.
+ *
  * The column @cl is saved as the default sort column to the @tb and the next time
  * is possible to call scols_sort_table(tb, NULL). The saved column is also used by
  * scols_sort_table_by_tree().
@@ -1609,15 +1983,34 @@ static int  __scols_sort_tree(struct libscols_table *tb, struct libscols_column
  */
 int scols_sort_table(struct libscols_table *tb, struct libscols_column *cl)
 {
+	size_t nthreads;
+	int type, sorted = 0;
+
 	if (!tb)
 		return -EINVAL;
 	if (!cl)
 		cl = tb->dflt_sort_column;
-	if (!cl || !cl->cmpfunc)
+	if (!cl)
 		return -EINVAL;
 
 	DBG(TAB, ul_debugobj(tb, "sorting table by %zu column", cl->seqnum));
-	list_sort(&tb->tb_lines, cells_cmp_wrapper_lines, cl);
+	if (cl->datafunc)
+		__scols_table_fill_cells(tb, cl);
+
+	type = get_sortkeys_type(tb, cl);
+	if (type == SCOLS_SORTKEY_NONE && !cl->cmpfunc)
+		return -EINVAL;
+	cl->sort_by_keys = type > 0 || (type < 0 && !cl->cmpfunc);
+
+	if (type > 0 && type != SCOLS_SORTKEY_STRING) {
+		DBG(TAB, ul_debugobj(tb, "sorting by numeric keys"));
+		sorted = sort_lines_radix(tb, cl) == 0;
+	}
+	if (!sorted) {
+		nthreads = __scols_nthreads(tb, tb->nlines);
+		if (!nthreads || sort_lines_parallel(tb, cl, nthreads) != 0)
+			list_sort(&tb->tb_lines, cells_cmp_wrapper_lines, cl);
+	}
 
 	if (scols_table_is_tree(tb))
 		__scols_sort_tree(tb, cl);
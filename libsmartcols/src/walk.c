@@ -1,5 +1,47 @@
 #include "smartcolsP.h"
 
+/*
+ * The tree art printed before the line is the same for all children of the
+ * parent, and the children's art differs by the parent's part only. The walk
+ * keeps the art of the ancestors in tb->walk_prefix, so the print does not
+ * have to go up to the root for every line. If the cache is not usable
+ * (e.g. ENOMEM) the walk_prefix_line is NULL and the art is generated from
+ * the tree.
+ */
+static void walk_prefix_push(struct libscols_table *tb, struct libscols_line *ln)
+{
+	const char *art;
+	size_t len;
+
+	if (ln->parent != tb->walk_prefix_line) {
+		tb->walk_prefix_line = NULL;
+		return;
+	}
+	if (!ln->parent) {
+		tb->walk_prefix_line = ln;	/* tree root, empty prefix */
+		tb->walk_prefix_len = 0;
+		return;
+	}
+
+	art = __scols_tree_art(tb, ln);
+	len = strlen(art);
+
+	if (tb->walk_prefix_len + len > tb->walk_prefix_sz) {
+		size_t sz = max(tb->walk_prefix_sz * 2, tb->walk_prefix_len + len + 64);
+		char *tmp = realloc(tb->walk_prefix, sz);
+
+		if (!tmp) {
+			tb->walk_prefix_line = NULL;
+			return;
+		}
+		tb->walk_prefix = tmp;
+		tb->walk_prefix_sz = sz;
+	}
+	memcpy(tb->walk_prefix + tb->walk_prefix_len, art, len);
+	tb->walk_prefix_len += len;
+	tb->walk_prefix_line = ln;
+}
+
 static int walk_line(struct libscols_table *tb,
 		     struct libscols_line *ln,
 		     struct libscols_column *cl,
@@ -24,9 +66,12 @@ static int walk_line(struct libscols_table *tb,
 
 	/* children */
 	if (rc == 0 && has_children(ln)) {
+		struct libscols_line *prefix_line = tb->walk_prefix_line;
+		size_t prefix_len = tb->walk_prefix_len;
 		struct list_head *p;
 
 		DBG(LINE, ul_debugobj(ln, " children walk"));
+		walk_prefix_push(tb, ln);
 
 		list_for_each(p, &ln->ln_branch) {
 			struct libscols_line *chld = list_entry(p,
@@ -36,6 +81,9 @@ static int walk_line(struct libscols_table *tb,
 			if (rc)
 				break;
 		}
+
+		tb->walk_prefix_line = prefix_line;
+		tb->walk_prefix_len = prefix_len;
 	}
 
 	DBG(LINE, ul_debugobj(ln, "<- walk line done [rc=%d]", rc));
@@ -96,6 +144,8 @@ int scols_walk_tree(struct libscols_table *tb,
 	tb->ngrpchlds_pending = 0;
 	tb->walk_last_tree_root = NULL;
 	tb->walk_last_done = 0;
+	tb->walk_prefix_line = NULL;
+	tb->walk_prefix_len = 0;
 
 	if (has_groups(tb))
 		scols_groups_reset_state(tb);
@@ -147,6 +197,7 @@ int scols_walk_tree(struct libscols_table *tb,
 
 	tb->ngrpchlds_pending = 0;
 	tb->walk_last_done = 0;
+	tb->walk_prefix_line = NULL;
 	DBG(TAB, ul_debugobj(tb, "<< walk end [rc=%d]", rc));
 	return rc;
 }
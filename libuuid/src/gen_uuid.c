@@ -64,6 +64,7 @@
 #endif
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
+#include <sys/mman.h>
 #endif
 #ifdef HAVE_SYS_SOCKIO_H
 #include <sys/sockio.h>
@@ -395,6 +396,294 @@ static int get_clock_cont(uint32_t *clock_high,
 	return 0;
 }
 
+#if defined(HAVE_TLS) && defined(__ATOMIC_ACQUIRE)
+# define HAVE_PROCESS_CLOCK 1
+#endif
+
+static int clock_mode = UUID_CLOCK_DEFAULT;
+
+#ifdef HAVE_PROCESS_CLOCK
+/*
+ * In-process clock (UUID_CLOCK_PROCESS mode).
+ *
+ * The threads do not lock the clock state file for every UUID, the timestamps
+ * are taken from a global atomic counter of 100ns ticks, and every thread
+ * claims PCLOCK_RANGE ticks at once. The clock state file is updated only
+ * when the process reserves the next PCLOCK_RESERVE ticks -- the file
+ * contains the end of the reservation, so other processes (in the default
+ * mode) use another clock sequence for the reserved ticks.
+ *
+ * The reservation (floor, end, clock sequence) is published by a sequence
+ * lock. A claim outside of the current reservation is refused and the caller
+ * falls back to get_clock(), the threads never wait for another thread.
+ */
+#define PCLOCK_RANGE	1000ULL		/* ticks claimed by a thread, 100us */
+#define PCLOCK_RESERVE	10000000ULL	/* ticks reserved in the state file, 1s */
+
+/* 100ns based time offset according to RFC 4122. 4.1.4. */
+#define PCLOCK_OFFSET	((((uint64_t) 0x01B21DD2) << 32) + 0x13814000)
+
+struct process_clock {
+	uint64_t	next;		/* next unclaimed tick */
+
+	unsigned int	gen;		/* sequence lock for the fields below */
+	pid_t		pid;		/* reservation owner, changed by fork() */
+	uint64_t	floor;		/* reserved ticks [floor, end) */
+	uint64_t	end;
+	uint16_t	clock_seq;
+	int		safe;		/* reservation in the clock state file */
+
+	pid_t		busy;		/* reservation in progress by PID */
+};
+
+static struct process_clock pclock;
+
+/*
+ * Opens and locks the clock state file, returns NULL if not possible.
+ */
+static FILE *pclock_open_state(void)
+{
+	mode_t save_umask;
+	FILE *f;
+	int fd;
+
+	save_umask = umask(0);
+	fd = open(LIBUUID_CLOCK_FILE, O_RDWR|O_CREAT|O_CLOEXEC, 0660);
+	(void) umask(save_umask);
+	if (fd < 0)
+		return NULL;
+
+	f = fdopen(fd, "r+" UL_CLOEXECSTR);
+	if (!f) {
+		close(fd);
+		return NULL;
+	}
+	while (flock(fd, LOCK_EX) < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			continue;
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+static int pclock_read_state(FILE *f, uint16_t *clock_seq, uint64_t *tick)
+{
+	unsigned int cl;
+	unsigned long tv1, tv2;
+	int a;
+
+	if (fscanf(f, "clock: %04x tv: %lu %lu adj: %d\n",
+		   &cl, &tv1, &tv2, &a) != 4)
+		return -1;
+
+	*clock_seq = cl & 0x3FFF;
+	*tick = tv1 * 10000000ULL + tv2 * 10 + a + PCLOCK_OFFSET;
+	return 0;
+}
+
+static void pclock_write_state(FILE *f, uint16_t clock_seq, uint64_t tick)
+{
+	int len;
+
+	tick -= PCLOCK_OFFSET;
+
+	rewind(f);
+	len = fprintf(f, "clock: %04x tv: %016ld %08ld adj: %08d\n",
+		      clock_seq, (long) (tick / 10000000),
+		      (long) (tick % 10000000 / 10), (int) (tick % 10));
+	fflush(f);
+	if (len > 0 && ftruncate(fileno(f), len) < 0) {
+		fprintf(f, "                   \n");
+		fflush(f);
+	}
+}
+
+/*
+ * Reserves the next ticks for the process. Only one thread does it, the
+ * others continue with the current reservation.
+ */
+static void pclock_reserve(pid_t pid)
+{
+	uint64_t now, next, floor, end, tick = 0;
+	uint16_t clock_seq, seq = 0;
+	pid_t busy = 0;
+	int init, have_state = 0, unchanged;
+	unsigned int gen;
+	FILE *f;
+
+	if (!__atomic_compare_exchange_n(&pclock.busy, &busy, pid, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		/* busy by another thread, or abandoned by the parent before fork() */
+		if (busy == pid
+		    || !__atomic_compare_exchange_n(&pclock.busy, &busy, pid, 0,
+						    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return;
+	}
+
+	init = pclock.pid != pid;
+	clock_seq = pclock.clock_seq;
+	floor = pclock.floor;
+	end = pclock.end;
+
+	now = get_clock_counter() + PCLOCK_OFFSET;
+	next = __atomic_load_n(&pclock.next, __ATOMIC_RELAXED);
+
+	f = pclock_open_state();
+	if (f)
+		have_state = pclock_read_state(f, &seq, &tick) == 0;
+
+	if (init)
+		unchanged = 0;
+	else if (f)
+		/* nobody else used the file after us */
+		unchanged = have_state && seq == clock_seq && tick == end;
+	else
+		unchanged = !pclock.safe;
+
+	if (unchanged)
+		end = max(next, now) + PCLOCK_RESERVE;
+	else {
+		uint16_t old = clock_seq;
+
+		if (have_state) {
+			clock_seq = seq;
+			if (tick >= now) {
+				do {
+					clock_seq = (clock_seq + 1) & 0x3FFF;
+				} while (clock_seq == CLOCK_SEQ_CONT);
+			}
+		} else if (init) {
+			do {
+				ul_random_get_bytes(&clock_seq, sizeof(clock_seq));
+				clock_seq &= 0x3FFF;
+			} while (clock_seq == CLOCK_SEQ_CONT
+				 || (pclock.pid && clock_seq == old));
+		}
+
+		/* move the counter after all ticks used by others */
+		floor = max(next, now + MAX_ADJUSTMENT);
+		if (have_state && floor <= tick)
+			floor = tick + 1;
+		while (next < floor
+		       && !__atomic_compare_exchange_n(&pclock.next, &next, floor, 0,
+						       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			;
+		floor = max(next, floor);
+		end = floor + PCLOCK_RESERVE;
+	}
+
+	if (f) {
+		pclock_write_state(f, clock_seq, end);
+		fclose(f);
+	}
+
+	gen = pclock.gen;
+	__atomic_store_n(&pclock.gen, gen + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&pclock.pid, pid, __ATOMIC_RELAXED);
+	__atomic_store_n(&pclock.floor, floor, __ATOMIC_RELAXED);
+	__atomic_store_n(&pclock.end, end, __ATOMIC_RELAXED);
+	__atomic_store_n(&pclock.clock_seq, clock_seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&pclock.safe, f ? 1 : 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&pclock.gen, gen + 2, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&pclock.busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Claims PCLOCK_RANGE ticks from the reservation, returns 0 on success.
+ */
+static int pclock_claim(pid_t pid, uint64_t *tick, uint16_t *clock_seq, int *safe)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		uint64_t floor, end, x;
+		unsigned int gen;
+		pid_t owner;
+
+		gen = __atomic_load_n(&pclock.gen, __ATOMIC_ACQUIRE);
+		owner = __atomic_load_n(&pclock.pid, __ATOMIC_RELAXED);
+		floor = __atomic_load_n(&pclock.floor, __ATOMIC_RELAXED);
+		end = __atomic_load_n(&pclock.end, __ATOMIC_RELAXED);
+		*clock_seq = __atomic_load_n(&pclock.clock_seq, __ATOMIC_RELAXED);
+		*safe = __atomic_load_n(&pclock.safe, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if ((gen & 1) || gen != __atomic_load_n(&pclock.gen, __ATOMIC_RELAXED))
+			return -1;	/* reservation in progress */
+		if (owner != pid) {
+			pclock_reserve(pid);
+			continue;
+		}
+
+		x = __atomic_fetch_add(&pclock.next, PCLOCK_RANGE, __ATOMIC_RELAXED);
+		if (x < floor || x + PCLOCK_RANGE > end) {
+			pclock_reserve(pid);
+			return -1;
+		}
+		if (x + PCLOCK_RANGE > end - PCLOCK_RESERVE / 2)
+			pclock_reserve(pid);
+		*tick = x;
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * Get clock from the in-process clock.
+ *
+ * Return -1 if there is no clock available, 1 if the clock is not reserved in
+ * the clock state file, otherwise return 0.
+ */
+static int get_clock_process(uint32_t *clock_high, uint32_t *clock_low,
+			     uint16_t *ret_clock_seq)
+{
+	THREAD_LOCAL uint64_t	next, end;
+	THREAD_LOCAL uint16_t	clock_seq;
+	THREAD_LOCAL int	safe;
+	THREAD_LOCAL pid_t	owner;
+	THREAD_LOCAL time_t	last_time;
+	pid_t pid = getpid();
+	time_t now = time(NULL);
+
+	if (next >= end || owner != pid || now > last_time + 1) {
+		if (pclock_claim(pid, &next, &clock_seq, &safe) != 0) {
+			end = 0;
+			return -1;
+		}
+		end = next + PCLOCK_RANGE;
+		owner = pid;
+		last_time = now;
+	}
+
+	*clock_high = next >> 32;
+	*clock_low = next;
+	*ret_clock_seq = clock_seq;
+	next++;
+
+	return safe ? 0 : 1;
+}
+
+static inline int use_process_clock(void)
+{
+	return __atomic_load_n(&clock_mode, __ATOMIC_RELAXED) == UUID_CLOCK_PROCESS;
+}
+#else
+static int get_clock_process(uint32_t *clock_high __attribute__((__unused__)),
+			     uint32_t *clock_low __attribute__((__unused__)),
+			     uint16_t *ret_clock_seq __attribute__((__unused__)))
+{
+	return -1;
+}
+
+static inline int use_process_clock(void)
+{
+	return 0;
+}
+#endif /* HAVE_PROCESS_CLOCK */
+
 #if defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H)
 
 /*
@@ -458,6 +747,142 @@ fail:
 	return -1;
 }
 
+#ifdef __ATOMIC_ACQUIRE
+/*
+ * The lease has to be created by uuidd: a regular file of the owner and
+ * group of the uuidd directory, not writable by others. Anything else may be
+ * corrupted by other users and the socket is used instead.
+ */
+static int lease_is_trusted(const struct stat *st)
+{
+	struct stat dir;
+
+	if (!S_ISREG(st->st_mode) || st->st_nlink != 1
+	    || (st->st_mode & (S_IWOTH | S_ISUID | S_ISGID))
+	    || (size_t) st->st_size < sizeof(struct uuidd_lease))
+		return 0;
+	if (stat(UUIDD_DIR, &dir) != 0 || !S_ISDIR(dir.st_mode))
+		return 0;
+	return st->st_uid == dir.st_uid && st->st_gid == dir.st_gid;
+}
+
+/*
+ * Maps the lease region published by uuidd --lease. The region is mapped
+ * once per process. If uuidd exits it invalidates the region and the mapping
+ * is abandoned (but not unmapped, other threads may still read it).
+ */
+static struct uuidd_lease *lease_map(void)
+{
+	static struct uuidd_lease *lease;
+	static time_t next_try;
+	struct uuidd_lease *ls, *expected = NULL;
+	struct stat st;
+	time_t now;
+	int fd;
+
+	ls = __atomic_load_n(&lease, __ATOMIC_ACQUIRE);
+	if (ls) {
+		if (__atomic_load_n(&ls->magic, __ATOMIC_ACQUIRE) == UUIDD_LEASE_MAGIC)
+			return ls;
+		__atomic_compare_exchange_n(&lease, &ls, NULL, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+	}
+
+	/* don't try open() for every UUID if uuidd does not provide the lease */
+	now = time(NULL);
+	if (now < __atomic_load_n(&next_try, __ATOMIC_RELAXED))
+		return NULL;
+	__atomic_store_n(&next_try, now + 1, __ATOMIC_RELAXED);
+
+	fd = open(UUIDD_LEASE_PATH, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || !lease_is_trusted(&st)) {
+		close(fd);
+		return NULL;
+	}
+	ls = mmap(NULL, sizeof(*ls), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ls == MAP_FAILED)
+		return NULL;
+
+	if (__atomic_load_n(&ls->magic, __ATOMIC_ACQUIRE) != UUIDD_LEASE_MAGIC) {
+		munmap(ls, sizeof(*ls));
+		return NULL;
+	}
+	if (!__atomic_compare_exchange_n(&lease, &expected, ls, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		munmap(ls, sizeof(*ls));
+		ls = expected;
+	}
+	return ls;
+}
+
+/*
+ * Leases up to @num time-based UUIDs from the uuidd shared memory window
+ * without any syscall. The first UUID is stored to @out and @num is updated
+ * to the number of leased UUIDs, the others are @out incremented by one.
+ *
+ * Returns 0 on success, -1 if the lease is not available or exhausted.
+ */
+static int get_uuid_via_lease(uuid_t out, int *num)
+{
+	struct uuidd_lease *ls = lease_map();
+	struct uuidd_lease_window *win;
+	uint64_t state, old, off, first[2], tm;
+	uint32_t gen, size;
+	struct uuid uu;
+	int n = *num;
+
+	if (!ls || n <= 0)
+		return -1;
+
+	state = __atomic_load_n(&ls->state, __ATOMIC_ACQUIRE);
+	gen = UUIDD_LEASE_GEN(state);
+	win = &ls->win[UUIDD_LEASE_WIN(state)];
+
+	if (__atomic_load_n(&win->gen, __ATOMIC_ACQUIRE) != gen)
+		return -1;
+	size = __atomic_load_n(&win->size, __ATOMIC_RELAXED);
+	first[0] = __atomic_load_n(&win->first[0], __ATOMIC_RELAXED);
+	first[1] = __atomic_load_n(&win->first[1], __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&win->gen, __ATOMIC_RELAXED) != gen)
+		return -1;
+
+	if (UUIDD_LEASE_OFFSET(state) >= size)
+		return -1;				/* exhausted */
+
+	old = __atomic_fetch_add(&ls->state, (uint64_t) n, __ATOMIC_ACQ_REL);
+	if ((old >> 48) != (state >> 48))
+		return -1;				/* replaced in meantime */
+	off = UUIDD_LEASE_OFFSET(old);
+	if (off >= size)
+		return -1;
+	if (off + n > size)
+		n = size - off;
+
+	memcpy(out, first, sizeof(first));
+	uuid_unpack(out, &uu);
+	tm = ((uint64_t) (uu.time_hi_and_version & 0x0FFF) << 48)
+		| ((uint64_t) uu.time_mid << 32) | uu.time_low;
+	tm += off;
+	uu.time_low = (uint32_t) tm;
+	uu.time_mid = (uint16_t) (tm >> 32);
+	uu.time_hi_and_version = ((tm >> 48) & 0x0FFF) | 0x1000;
+	uuid_pack(&uu, out);
+
+	*num = n;
+	return 0;
+}
+#else
+static int get_uuid_via_lease(uuid_t out __attribute__((__unused__)),
+			      int *num __attribute__((__unused__)))
+{
+	return -1;
+}
+#endif /* __ATOMIC_ACQUIRE */
+
 #else /* !defined(HAVE_UUIDD) && defined(HAVE_SYS_UN_H) */
 static int get_uuid_via_daemon(int op __attribute__((__unused__)),
 				uuid_t out __attribute__((__unused__)),
@@ -465,6 +890,12 @@ static int get_uuid_via_daemon(int op __attribute__((__unused__)),
 {
 	return -1;
 }
+
+static int get_uuid_via_lease(uuid_t out __attribute__((__unused__)),
+			      int *num __attribute__((__unused__)))
+{
+	return -1;
+}
 #endif
 
 static int __uuid_generate_time_internal(uuid_t out, int *num, uint32_t cont_offset)
@@ -492,6 +923,12 @@ static int __uuid_generate_time_internal(uuid_t out, int *num, uint32_t cont_off
 		uu.clock_seq = CLOCK_SEQ_CONT;
 		if (ret != 0)	/* fallback to previous implpementation */
 			ret = get_clock(&clock_mid, &uu.time_low, &uu.clock_seq, num);
+	} else if (!num && use_process_clock()) {
+		ret = get_clock_process(&clock_mid, &uu.time_low, &uu.clock_seq);
+		if (ret < 0)
+			ret = get_clock(&clock_mid, &uu.time_low, &uu.clock_seq, NULL);
+		else if (ret)
+			ret = -1;
 	} else {
 		ret = get_clock(&clock_mid, &uu.time_low, &uu.clock_seq, num);
 	}
@@ -516,12 +953,14 @@ int __uuid_generate_time_cont(uuid_t out, int *num, uint32_t cont_offset)
 /*
  * Generate time-based UUID and store it to @out
  *
- * Tries to guarantee uniqueness of the generated UUIDs by obtaining them from the uuidd daemon,
- * or, if uuidd is not usable, by using the global clock state counter (see get_clock()).
+ * Tries to guarantee uniqueness of the generated UUIDs by obtaining them from the uuidd daemon
+ * (the shared memory lease or the socket), or, if uuidd is not usable, by using the global clock state counter (see get_clock()).
  * If neither of these is possible (e.g. because of insufficient permissions), it generates
  * the UUID anyway, but returns -1. Otherwise, returns 0.
  */
 static int uuid_generate_time_generic(uuid_t out) {
+	if (use_process_clock())
+		return __uuid_generate_time(out, NULL);
 #ifdef HAVE_TLS
 	THREAD_LOCAL int		num = 0;
 	THREAD_LOCAL int		cache_size = 1;
@@ -544,7 +983,8 @@ static int uuid_generate_time_generic(uuid_t out) {
 			cache_size *= 10;
 		num = cache_size;
 
-		if (get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
+		if (get_uuid_via_lease(out, &num) == 0 ||
+		    get_uuid_via_daemon(UUIDD_OP_BULK_TIME_UUID,
 					out, &num) == 0) {
 			last_time = time(NULL);
 			uuid_unpack(out, &uu);
@@ -565,7 +1005,10 @@ static int uuid_generate_time_generic(uuid_t out) {
 		return 0;
 	}
 #else
-	if (get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0)
+	int num = 1;
+
+	if (get_uuid_via_lease(out, &num) == 0 ||
+	    get_uuid_via_daemon(UUIDD_OP_TIME_UUID, out, 0) == 0)
 		return 0;
 #endif
 
@@ -588,10 +1031,73 @@ int uuid_generate_time_safe(uuid_t out)
 	return uuid_generate_time_generic(out);
 }
 
+/*
+ * Set how uuid_generate_time() and uuid_generate_time_safe() synchronize the
+ * clock. The UUID_CLOCK_PROCESS mode does not use uuidd, the clock is shared
+ * by the threads of the process without locks (see pclock_reserve()).
+ *
+ * Returns 0 on success, -1 if the mode is not supported.
+ */
+int uuid_set_clock_mode(int mode)
+{
+	switch (mode) {
+	case UUID_CLOCK_DEFAULT:
+		break;
+#ifdef HAVE_PROCESS_CLOCK
+	case UUID_CLOCK_PROCESS:
+		break;
+#endif
+	default:
+		return -1;
+	}
+#ifdef HAVE_PROCESS_CLOCK
+	__atomic_store_n(&clock_mode, mode, __ATOMIC_RELAXED);
+#else
+	clock_mode = mode;
+#endif
+	return 0;
+}
+
+
+/*
+ * Single random UUIDs are taken from a per-thread pool of random bytes, so
+ * getrandom() is not called for every UUID. The pool is dropped in a forked
+ * child (detected by PID), otherwise the child would return the same UUIDs as
+ * the parent. Without TLS the pool would be shared by threads, so it's unused.
+ */
+#define UUID_POOL_SIZE	(16 * sizeof(uuid_t))
+
+static int random_get_uuid_bytes(unsigned char *out)
+{
+#ifdef HAVE_TLS
+	THREAD_LOCAL unsigned char	pool[UUID_POOL_SIZE];
+	THREAD_LOCAL size_t		pool_used = UUID_POOL_SIZE;
+	THREAD_LOCAL pid_t		pool_pid;
+	pid_t pid = getpid();
+
+	if (pool_used >= UUID_POOL_SIZE || pool_pid != pid) {
+		if (ul_random_get_bytes(pool, sizeof(pool))) {
+			pool_used = UUID_POOL_SIZE;
+			return -1;
+		}
+		pool_used = 0;
+		pool_pid = pid;
+	}
+	memcpy(out, pool + pool_used, sizeof(uuid_t));
+#ifdef HAVE_EXPLICIT_BZERO
+	explicit_bzero(pool + pool_used, sizeof(uuid_t));
+#else
+	memset(pool + pool_used, 0, sizeof(uuid_t));
+#endif
+	pool_used += sizeof(uuid_t);
+	return 0;
+#else
+	return ul_random_get_bytes(out, sizeof(uuid_t));
+#endif
+}
 
 int __uuid_generate_random(uuid_t out, int *num)
 {
-	uuid_t	buf;
 	struct uuid uu;
 	int i, n, r = 0;
 
@@ -600,10 +1106,14 @@ int __uuid_generate_random(uuid_t out, int *num)
 	else
 		n = *num;
 
+	/* entropy for the whole batch by one call */
+	if (n == 1)
+		r = random_get_uuid_bytes(out);
+	else if (ul_random_get_bytes(out, (size_t) n * sizeof(uuid_t)))
+		r = -1;
+
 	for (i = 0; i < n; i++) {
-		if (ul_random_get_bytes(buf, sizeof(buf)))
-			r = -1;
-		uuid_unpack(buf, &uu);
+		uuid_unpack(out, &uu);
 
 		uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
 		uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF)
@@ -636,6 +1146,129 @@ void uuid_generate(uuid_t out)
 		uuid_generate_time(out);
 }
 
+/*
+ * Generate time-based version 6 UUID (RFC 9562), it's the same as version 1,
+ * but the timestamp is stored from the most significant bits, so the UUIDs
+ * are sortable by time.
+ */
+void uuid_generate_time_v6(uuid_t out)
+{
+	struct uuid uu;
+	uint64_t clock_reg;
+
+	uuid_generate_time(out);
+	uuid_unpack(out, &uu);
+
+	clock_reg = ((uint64_t) (uu.time_hi_and_version & 0x0FFF) << 48)
+		    | ((uint64_t) uu.time_mid << 32) | uu.time_low;
+
+	uu.time_low = clock_reg >> 28;
+	uu.time_mid = clock_reg >> 12;
+	uu.time_hi_and_version = (clock_reg & 0x0FFF) | 0x6000;
+	uuid_pack(&uu, out);
+}
+
+/*
+ * Get Unix time in milliseconds (the upper 48 bits) and 1/4096 ms (the lower
+ * 12 bits) for @num UUIDs, returns the value for the first one.
+ *
+ * The value is strictly increasing in the process. If more UUIDs are
+ * requested within 1/4096 ms, the value is incremented anyway, so the
+ * timestamp may be a little ahead of the current time.
+ */
+static uint64_t get_clock_v7(int num)
+{
+#ifdef __ATOMIC_RELAXED
+	static uint64_t		last;
+#else
+	THREAD_LOCAL uint64_t	last;
+#endif
+	struct timeval tv;
+	uint64_t now, x;
+
+	gettimeofday(&tv, NULL);
+	now = ((uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000) << 12;
+	now |= (tv.tv_usec % 1000) * 4096 / 1000;
+
+#ifdef __ATOMIC_RELAXED
+	x = __atomic_load_n(&last, __ATOMIC_RELAXED);
+	do {
+		if (now <= x)
+			now = x + 1;
+	} while (!__atomic_compare_exchange_n(&last, &x, now + num - 1, 1,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+	x = last;
+	if (now <= x)
+		now = x + 1;
+	last = now + num - 1;
+#endif
+	return now;
+}
+
+/*
+ * Generate @num (or one if @num is NULL) time-ordered version 7 UUIDs. The
+ * UUIDs are strictly increasing, the rest of the UUID (62 bits) is random.
+ *
+ * Returns -1 if high-quality randomness is not available.
+ */
+int __uuid_generate_time_v7(uuid_t out, int *num)
+{
+	uint64_t clock_reg;
+	int i, n, r = 0;
+
+	if (!num || !*num)
+		n = 1;
+	else
+		n = *num;
+
+	if (n == 1)
+		r = random_get_uuid_bytes(out);
+	else if (ul_random_get_bytes(out, (size_t) n * sizeof(uuid_t)))
+		r = -1;
+
+	clock_reg = get_clock_v7(n);
+
+	for (i = 0; i < n; i++, clock_reg++) {
+		uint64_t ms = clock_reg >> 12;
+
+		out[0] = ms >> 40;
+		out[1] = ms >> 32;
+		out[2] = ms >> 24;
+		out[3] = ms >> 16;
+		out[4] = ms >> 8;
+		out[5] = ms;
+		out[6] = 0x70 | ((clock_reg >> 8) & 0x0F);
+		out[7] = clock_reg;
+		out[8] = (out[8] & 0x3F) | 0x80;
+		out += sizeof(uuid_t);
+	}
+
+	return r;
+}
+
+void uuid_generate_time_v7(uuid_t out)
+{
+	int num = 1;
+
+	__uuid_generate_time_v7(out, &num);
+}
+
+/*
+ * Generate @count version 7 UUIDs to the @out array, the UUIDs are strictly
+ * increasing.
+ */
+void uuid_generate_time_v7_many(uuid_t *out, size_t count)
+{
+	while (count > 0) {
+		int num = count > INT_MAX ? INT_MAX : (int) count;
+
+		__uuid_generate_time_v7(*out, &num);
+		out += num;
+		count -= num;
+	}
+}
+
 /*
  * Generate an MD5 hashed (predictable) UUID based on a well-known UUID
  * providing the namespace and an arbitrary binary string.
@@ -687,3 +1320,36 @@ void uuid_generate_sha1(uuid_t out, const uuid_t ns, const char *name, size_t le
 	uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF) | 0x5000;
 	uuid_pack(&uu, out);
 }
+
+/*
+ * Generate SHA1 hashed (predictable) UUIDs for @count names in the same
+ * namespace. The namespace is hashed only once; the names[i] (of lens[i]
+ * bytes) result is stored to out[i].
+ */
+void uuid_generate_sha1_many(uuid_t *out, const uuid_t ns,
+			     const char * const *names, const size_t *lens,
+			     size_t count)
+{
+	UL_SHA1_CTX nsctx;
+	size_t i;
+
+	ul_SHA1Init(&nsctx);
+	ul_SHA1Update(&nsctx, ns, sizeof(uuid_t));
+
+	for (i = 0; i < count; i++) {
+		UL_SHA1_CTX ctx = nsctx;
+		char hash[UL_SHA1LENGTH];
+		uuid_t buf;
+		struct uuid uu;
+
+		ul_SHA1Update(&ctx, (const unsigned char *)names[i], lens[i]);
+		ul_SHA1Final((unsigned char *)hash, &ctx);
+
+		memcpy(buf, hash, sizeof(buf));
+		uuid_unpack(buf, &uu);
+
+		uu.clock_seq = (uu.clock_seq & 0x3FFF) | 0x8000;
+		uu.time_hi_and_version = (uu.time_hi_and_version & 0x0FFF) | 0x5000;
+		uuid_pack(&uu, out[i]);
+	}
+}
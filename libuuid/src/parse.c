@@ -34,12 +34,178 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <string.h>
 
 #include "c.h"
 #include "uuidP.h"
 
+#if defined(__x86_64__) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <emmintrin.h>
+# define UUID_PARSE_SSE2	1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define UUID_PARSE_NEON	1
+#endif
+
+#if defined(UUID_PARSE_SSE2)
+/*
+ * Returns nibble values of 16 characters, @ok is 0xFF for hex digits in the
+ * input and zero for other characters.
+ */
+static inline __m128i hex_to_nibbles(__m128i c, __m128i *ok)
+{
+	const __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	const __m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+				       _mm_set1_epi8('a'));
+	/* unsigned x <= max by min_epu8() */
+	const __m128i isd = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	const __m128i isl = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+	*ok = _mm_or_si128(isd, isl);
+	return _mm_or_si128(_mm_and_si128(isd, d),
+			    _mm_and_si128(isl, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+/* merges pairs of nibbles to bytes in 16-bit lanes, "12" is 0x0012 */
+static inline __m128i nibbles_to_bytes(__m128i n)
+{
+	return _mm_or_si128(
+		_mm_and_si128(_mm_slli_epi16(n, 4), _mm_set1_epi16(0x00F0)),
+		_mm_srli_epi16(n, 8));
+}
+
+/*
+ * The string is read by three loads (chars 0-15, 16-31 and 20-35) and the
+ * bytes are moved to the place by the SSE2 byte shifts, there is no shuffle
+ * instruction in SSE2.
+ */
+static inline int parse_one(const char *in, uuid_t uu)
+{
+	const __m128i dash = _mm_set1_epi8('-');
+	const __m128i ca = _mm_loadu_si128((const __m128i *) in);
+	const __m128i cb = _mm_loadu_si128((const __m128i *) (in + 16));
+	const __m128i cc = _mm_loadu_si128((const __m128i *) (in + 20));
+	/* dashes at 8 and 13 (in ca), 18 (cb[2]) and 23 (cc[3], checked in cb) */
+	const __m128i dma = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0);
+	const __m128i dmb = _mm_setr_epi8(0, 0, -1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i dmc = _mm_setr_epi8(0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i a, b, c, oka, okb, okc, lo, hi;
+
+	a = hex_to_nibbles(ca, &oka);
+	b = hex_to_nibbles(cb, &okb);
+	c = hex_to_nibbles(cc, &okc);
+
+	oka = _mm_or_si128(_mm_andnot_si128(dma, oka),
+			   _mm_and_si128(dma, _mm_cmpeq_epi8(ca, dash)));
+	okb = _mm_or_si128(_mm_andnot_si128(dmb, okb),
+			   _mm_and_si128(dmb, _mm_cmpeq_epi8(cb, dash)));
+	okc = _mm_or_si128(okc, dmc);
+	if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(oka, okb), okc)) != 0xFFFF)
+		return -1;
+
+	/* bytes 0-3 are chars 0-7, 4-5 chars 9-12, 6 chars 14-15, 7 chars 16-17 */
+	lo = _mm_or_si128(
+		_mm_or_si128(
+			_mm_and_si128(nibbles_to_bytes(a),
+				      _mm_setr_epi16(-1, -1, -1, -1, 0, 0, 0, 0)),
+			_mm_and_si128(nibbles_to_bytes(_mm_srli_si128(a, 1)),
+				      _mm_setr_epi16(0, 0, 0, 0, -1, -1, 0, 0))),
+		_mm_or_si128(
+			_mm_and_si128(_mm_srli_si128(nibbles_to_bytes(a), 2),
+				      _mm_setr_epi16(0, 0, 0, 0, 0, 0, -1, 0)),
+			_mm_slli_si128(nibbles_to_bytes(b), 14)));
+
+	/* bytes 8-9 are chars 19-22, 10-15 chars 24-35 */
+	hi = _mm_or_si128(
+		_mm_and_si128(_mm_srli_si128(nibbles_to_bytes(_mm_srli_si128(b, 1)), 2),
+			      _mm_setr_epi16(-1, -1, 0, 0, 0, 0, 0, 0)),
+		_mm_and_si128(nibbles_to_bytes(c),
+			      _mm_setr_epi16(0, 0, -1, -1, -1, -1, -1, -1)));
+
+	_mm_storeu_si128((__m128i *) uu, _mm_packus_epi16(lo, hi));
+	return 0;
+}
+
+#else /* !UUID_PARSE_SSE2 */
+/*
+ * Copies the 32 hex digits of the UUID string (without dashes) to @hex,
+ * returns -1 if the dashes are not at the expected positions.
+ */
+static inline int uuid_str_to_hex(const char *in, char *hex)
+{
+	if (in[8] != '-' || in[13] != '-' || in[18] != '-' || in[23] != '-')
+		return -1;
+	memcpy(hex, in, 8);
+	memcpy(hex + 8, in + 9, 4);
+	memcpy(hex + 12, in + 14, 4);
+	memcpy(hex + 16, in + 19, 4);
+	memcpy(hex + 20, in + 24, 12);
+	return 0;
+}
+
+# if defined(UUID_PARSE_NEON)
+static inline uint8x16_t hex_to_nibbles(uint8x16_t c, uint8x16_t *ok)
+{
+	const uint8x16_t d = vsubq_u8(c, vdupq_n_u8('0'));
+	const uint8x16_t l = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+	const uint8x16_t isd = vcleq_u8(d, vdupq_n_u8(9));
+
+	*ok = vandq_u8(*ok, vorrq_u8(isd, vcleq_u8(l, vdupq_n_u8(5))));
+
+	return vbslq_u8(isd, d, vaddq_u8(l, vdupq_n_u8(10)));
+}
+
+static int hex_to_bin(const char *hex, unsigned char *out)
+{
+	uint8x16_t ok = vdupq_n_u8(0xFF);
+	uint8x16_t a = hex_to_nibbles(vld1q_u8((const uint8_t *) hex), &ok);
+	uint8x16_t b = hex_to_nibbles(vld1q_u8((const uint8_t *) hex + 16), &ok);
+
+	if (vminvq_u8(ok) != 0xFF)
+		return -1;
+
+	vst1q_u8(out, vorrq_u8(vshlq_n_u8(vuzp1q_u8(a, b), 4), vuzp2q_u8(a, b)));
+	return 0;
+}
+
+# else
+/* hex digit value + 1, zero for invalid characters */
+static const unsigned char hexdigits[256] = {
+	['0'] = 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+	['A'] = 11, 12, 13, 14, 15, 16,
+	['a'] = 11, 12, 13, 14, 15, 16
+};
+
+static int hex_to_bin(const char *hex, unsigned char *out)
+{
+	int i, bad = 0;
+
+	for (i = 0; i < 16; i++) {
+		int hi = hexdigits[(unsigned char) hex[i * 2]] - 1;
+		int lo = hexdigits[(unsigned char) hex[i * 2 + 1]] - 1;
+
+		bad |= hi | lo;
+		out[i] = (hi << 4) | lo;
+	}
+	return bad < 0 ? -1 : 0;
+}
+# endif
+
+/*
+ * The binary UUID is the hex digits in the string order (see uuid_pack()),
+ * so the digits are decoded directly to @uu.
+ */
+static inline int parse_one(const char *in, uuid_t uu)
+{
+	char hex[32];
+
+	if (uuid_str_to_hex(in, hex) != 0)
+		return -1;
+	return hex_to_bin(hex, uu);
+}
+#endif /* UUID_PARSE_SSE2 */
+
 int uuid_parse(const char *in, uuid_t uu)
 {
 	size_t len = strlen(in);
@@ -51,48 +217,31 @@ int uuid_parse(const char *in, uuid_t uu)
 
 int uuid_parse_range(const char *in_start, const char *in_end, uuid_t uu)
 {
-	struct uuid	uuid;
-	int		i;
-	const char	*cp;
-	char		buf[3];
+	uuid_t tmp;
 
 	if ((in_end - in_start) != 36)
 		return -1;
-	for (i=0, cp = in_start; i < 36; i++,cp++) {
-		if ((i == 8) || (i == 13) || (i == 18) ||
-		    (i == 23)) {
-			if (*cp == '-')
-				continue;
-			return -1;
-		}
-
-		if (!isxdigit(*cp))
-			return -1;
-	}
-	errno = 0;
-	uuid.time_low = strtoul(in_start, NULL, 16);
-
-	if (!errno)
-		uuid.time_mid = strtoul(in_start+9, NULL, 16);
-	if (!errno)
-		uuid.time_hi_and_version = strtoul(in_start+14, NULL, 16);
-	if (!errno)
-		uuid.clock_seq = strtoul(in_start+19, NULL, 16);
-	if (errno)
+	if (parse_one(in_start, tmp) != 0)
 		return -1;
 
-	cp = in_start+24;
-	buf[2] = 0;
-	for (i=0; i < 6; i++) {
-		buf[0] = *cp++;
-		buf[1] = *cp++;
+	memcpy(uu, tmp, sizeof(tmp));
+	return 0;
+}
+
+/*
+ * Parses @count UUID strings from @in, the strings are UUID_STR_LEN bytes
+ * apart (36 characters followed by any character, e.g. '\0' or '\n').
+ *
+ * Returns the number of parsed UUIDs, the parsing stops at the first invalid
+ * string.
+ */
+size_t uuid_parse_many(const char *in, size_t count, uuid_t *uu)
+{
+	size_t i;
 
-		errno = 0;
-		uuid.node[i] = strtoul(buf, NULL, 16);
-		if (errno)
-			return -1;
+	for (i = 0; i < count; i++, in += UUID_STR_LEN) {
+		if (parse_one(in, uu[i]) != 0)
+			break;
 	}
-
-	uuid_pack(&uuid, uu);
-	return 0;
+	return i;
 }
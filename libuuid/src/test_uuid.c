@@ -42,6 +42,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
 
 #include "c.h"
@@ -60,6 +62,23 @@ static int test_uuid(const char * uuid, int isValid)
 		printf(" but uuid_parse says %s\n", validStr[parsedOk]);
 		return 1;
 	}
+	if (strlen(uuid) == 36) {
+		uuid_t manyBits;
+		char str[UUID_STR_LEN];
+
+		if ((uuid_parse_many(uuid, 1, &manyBits) == 1) != parsedOk ||
+		    (parsedOk && uuid_compare(uuidBits, manyBits) != 0)) {
+			printf(" but uuid_parse_many disagrees\n");
+			return 1;
+		}
+		if (parsedOk) {
+			uuid_unparse_many(&manyBits, 1, str);
+			if (strcasecmp(str, uuid) != 0) {
+				printf(" but uuid_unparse_many returns %s\n", str);
+				return 1;
+			}
+		}
+	}
 	printf(", OK\n");
 	return 0;
 }
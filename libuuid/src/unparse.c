@@ -33,27 +33,94 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "c.h"
 
 #include "uuidP.h"
 
+#if defined(__x86_64__) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <emmintrin.h>
+# define UUID_UNPARSE_SSE2	1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define UUID_UNPARSE_NEON	1
+#endif
+
 static char const hexdigits_lower[16] = "0123456789abcdef";
 static char const hexdigits_upper[16] = "0123456789ABCDEF";
 
-static void uuid_fmt(const uuid_t uuid, char *buf, char const *restrict fmt)
+#ifdef UUID_UNPARSE_DEFAULT_UPPER
+# define hexdigits_default	hexdigits_upper
+#else
+# define hexdigits_default	hexdigits_lower
+#endif
+
+#if defined(UUID_UNPARSE_SSE2)
+/* converts 16 nibbles to hex digits, @fmt is the digits table */
+static inline __m128i nibbles_to_hex(__m128i n, char const *restrict fmt)
+{
+	/* distance between '9' + 1 and 'a' (or 'A') */
+	const __m128i alpha = _mm_set1_epi8(fmt[10] - '0' - 10);
+	const __m128i gt9 = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+
+	return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+			    _mm_and_si128(gt9, alpha));
+}
+
+static inline void bin_to_hex(const uuid_t uuid, char *hex, char const *restrict fmt)
+{
+	const __m128i v = _mm_loadu_si128((const __m128i *) uuid);
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	const __m128i lo = _mm_and_si128(v, mask);
+
+	_mm_storeu_si128((__m128i *) hex,
+			 nibbles_to_hex(_mm_unpacklo_epi8(hi, lo), fmt));
+	_mm_storeu_si128((__m128i *) (hex + 16),
+			 nibbles_to_hex(_mm_unpackhi_epi8(hi, lo), fmt));
+}
+
+#elif defined(UUID_UNPARSE_NEON)
+static inline void bin_to_hex(const uuid_t uuid, char *hex, char const *restrict fmt)
+{
+	const uint8x16_t tbl = vld1q_u8((const uint8_t *) fmt);
+	const uint8x16_t v = vld1q_u8(uuid);
+	const uint8x16_t hi = vshrq_n_u8(v, 4);
+	const uint8x16_t lo = vandq_u8(v, vdupq_n_u8(0x0F));
+
+	vst1q_u8((uint8_t *) hex, vqtbl1q_u8(tbl, vzip1q_u8(hi, lo)));
+	vst1q_u8((uint8_t *) hex + 16, vqtbl1q_u8(tbl, vzip2q_u8(hi, lo)));
+}
+
+#else
+static inline void bin_to_hex(const uuid_t uuid, char *hex, char const *restrict fmt)
 {
-	char *p = buf;
 	int i;
 
 	for (i = 0; i < 16; i++) {
-		if (i == 4 || i == 6 || i == 8 || i == 10) {
-			*p++ = '-';
-		}
-		size_t tmp = uuid[i];
-		*p++ = fmt[tmp >> 4];
-		*p++ = fmt[tmp & 15];
+		*hex++ = fmt[uuid[i] >> 4];
+		*hex++ = fmt[uuid[i] & 15];
 	}
-	*p = '\0';
+}
+#endif
+
+static void uuid_fmt(const uuid_t uuid, char *buf, char const *restrict fmt)
+{
+	char hex[32];
+
+	bin_to_hex(uuid, hex, fmt);
+
+	memcpy(buf, hex, 8);
+	buf[8] = '-';
+	memcpy(buf + 9, hex + 8, 4);
+	buf[13] = '-';
+	memcpy(buf + 14, hex + 12, 4);
+	buf[18] = '-';
+	memcpy(buf + 19, hex + 16, 4);
+	buf[23] = '-';
+	memcpy(buf + 24, hex + 20, 12);
+	buf[36] = '\0';
 }
 
 void uuid_unparse_lower(const uuid_t uu, char *out)
@@ -68,9 +135,17 @@ void uuid_unparse_upper(const uuid_t uu, char *out)
 
 void uuid_unparse(const uuid_t uu, char *out)
 {
-#ifdef UUID_UNPARSE_DEFAULT_UPPER
-	uuid_fmt(uu, out, hexdigits_upper);
-#else
-	uuid_fmt(uu, out, hexdigits_lower);
-#endif
+	uuid_fmt(uu, out, hexdigits_default);
+}
+
+/*
+ * Converts @count UUIDs to strings like uuid_unparse(), the strings are
+ * stored UUID_STR_LEN bytes apart (each terminated by '\0') to @out.
+ */
+void uuid_unparse_many(const uuid_t *uu, size_t count, char *out)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++, out += UUID_STR_LEN)
+		uuid_fmt(uu[i], out, hexdigits_default);
 }
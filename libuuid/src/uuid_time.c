@@ -59,15 +59,40 @@ time_t uuid_time(const uuid_t uu, struct timeval *ret_tv)
 	struct uuid		uuid;
 	uint32_t		high;
 	uint64_t		clock_reg;
+	int64_t			gregorian;
 
 	uuid_unpack(uu, &uuid);
 
-	high = uuid.time_mid | ((uuid.time_hi_and_version & 0xFFF) << 16);
-	clock_reg = uuid.time_low | ((uint64_t) high << 32);
+	switch (uuid.time_hi_and_version >> 12) {
+	case UUID_TYPE_DCE_TIME_V6:
+		clock_reg = ((uint64_t) uuid.time_low << 28)
+			    | ((uint64_t) uuid.time_mid << 12)
+			    | (uuid.time_hi_and_version & 0xFFF);
+		break;
+	case UUID_TYPE_DCE_TIME_V7:
+		/* Unix time in milliseconds; the following 12 bits may be
+		 * random (RFC 9562), so they are not used */
+		clock_reg = ((uint64_t) uuid.time_low << 16) | uuid.time_mid;
+		tv.tv_sec = clock_reg / 1000;
+		tv.tv_usec = (clock_reg % 1000) * 1000;
+		goto done;
+	default:
+		high = uuid.time_mid | ((uuid.time_hi_and_version & 0xFFF) << 16);
+		clock_reg = uuid.time_low | ((uint64_t) high << 32);
+		break;
+	}
 
-	clock_reg -= (((uint64_t) 0x01B21DD2) << 32) + 0x13814000;
-	tv.tv_sec = clock_reg / 10000000;
-	tv.tv_usec = (clock_reg % 10000000) / 10;
+	/* 100ns intervals since 1582-10-15, the time may be before 1970 */
+	gregorian = (int64_t) clock_reg
+		    - (int64_t) ((((uint64_t) 0x01B21DD2) << 32) + 0x13814000);
+	tv.tv_sec = gregorian / 10000000;
+	gregorian %= 10000000;
+	if (gregorian < 0) {
+		gregorian += 10000000;
+		tv.tv_sec--;
+	}
+	tv.tv_usec = gregorian / 10;
+done:
 
 	if (ret_tv)
 		*ret_tv = tv;
@@ -156,10 +181,16 @@ main(int argc, char **argv)
 	case 4:
 		printf(" (random)\n");
 		break;
+	case 6:
+		printf(" (time based, v6)\n");
+		break;
+	case 7:
+		printf(" (time based, v7)\n");
+		break;
 	default:
 		printf("\n");
 	}
-	if (type != 1) {
+	if (type != 1 && type != 6 && type != 7) {
 		printf("Warning: not a time-based UUID, so UUID time "
 		       "decoding will likely not work!\n");
 	}
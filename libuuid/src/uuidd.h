@@ -39,6 +39,7 @@
 #define UUIDD_SOCKET_PATH	UUIDD_DIR "/request"
 #define UUIDD_PIDFILE_PATH	UUIDD_DIR "/uuidd.pid"
 #define UUIDD_PATH		"/usr/sbin/uuidd"
+#define UUIDD_LEASE_PATH	UUIDD_DIR "/lease"
 
 #define UUIDD_OP_GETPID			0
 #define UUIDD_OP_GET_MAXOP		1
@@ -46,10 +47,42 @@
 #define UUIDD_OP_RANDOM_UUID		3
 #define UUIDD_OP_BULK_TIME_UUID		4
 #define UUIDD_OP_BULK_RANDOM_UUID	5
-#define UUIDD_MAX_OP			UUIDD_OP_BULK_RANDOM_UUID
+#define UUIDD_OP_BULK_TIME_V7_UUID	6
+#define UUIDD_OP_STATS			7
+#define UUIDD_MAX_OP			UUIDD_OP_STATS
+
+/*
+ * Shared memory lease of time-based UUIDs (uuidd --lease).
+ *
+ * The daemon publishes a window of @size consecutive time-based UUIDs
+ * starting at @first, clients lease ranges from the window by atomic add to
+ * the offset in @state. The windows are double-buffered, the daemon follows
+ * the sequence-lock rules: @gen is zero while the window is being modified,
+ * and the window is valid only if @gen matches the generation in @state.
+ */
+#define UUIDD_LEASE_MAGIC	0x55554c31		/* "UUL1" */
+#define UUIDD_LEASE_SIZE	(1 << 20)		/* UUIDs in a window */
+
+struct uuidd_lease_window {
+	uint32_t	gen;
+	uint32_t	size;
+	uint64_t	first[2];		/* uuid_t */
+};
+
+struct uuidd_lease {
+	uint32_t	magic;			/* zero when uuidd exits */
+	uint32_t	reserved;
+	uint64_t	state;			/* window:1 gen:15 offset:48 */
+	struct uuidd_lease_window win[2];
+};
+
+#define UUIDD_LEASE_WIN(_st)		((unsigned int) ((_st) >> 63))
+#define UUIDD_LEASE_GEN(_st)		((uint32_t) (((_st) >> 48) & 0x7FFF))
+#define UUIDD_LEASE_OFFSET(_st)		((_st) & (((uint64_t) 1 << 48) - 1))
 
 extern int __uuid_generate_time(uuid_t out, int *num);
 extern int __uuid_generate_time_cont(uuid_t out, int *num, uint32_t cont);
 extern int __uuid_generate_random(uuid_t out, int *num);
+extern int __uuid_generate_time_v7(uuid_t out, int *num);
 
 #endif /* _UUID_UUID_H */
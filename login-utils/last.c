@@ -41,6 +41,8 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <search.h>
 
 #include "c.h"
 #include "nls.h"
@@ -74,7 +76,11 @@
 # define LAST_TIMESTAMP_LEN 32
 #endif
 
-#define UCHUNKSIZE	16384	/* How much we read at once. */
+#define UCHUNKRECS	4096	/* How many records we read at once. */
+#define UREADAHEAD	64	/* How many records are announced to prefetch(). */
+
+#define DNS_THREADS	8	/* Concurrent reverse lookups. */
+#define DNS_TIMEOUT	5	/* How long we wait for one lookup (seconds). */
 
 struct last_control {
 	unsigned int lastb :1,	  /* Is this command 'lastb' */
@@ -177,94 +183,147 @@ static int which_time_format(const char *s)
 #endif
 
 /*
- *	Read one utmp entry, return in new format.
- *	Automatically reposition file pointer.
+ * The file is read backwards by big chunks of whole records. The kernel
+ * readahead does not help for backward reading, so the chunk before the
+ * current one is announced by posix_fadvise().
  */
-static int uread(FILE *fp, struct utmpx *u,  int *quit, const char *filename)
+struct ureader {
+	int		fd;
+	const char	*filename;
+	size_t		nrecs;		/* number of whole records in the file */
+	size_t		next;		/* records [0, next) are not read yet */
+
+	struct utmpx	*buf;		/* records [bufstart, bufstart + buflen) */
+	size_t		bufstart;
+	size_t		buflen;
+
+	/* called for records UREADAHEAD before they are returned */
+	void		(*prefetch)(const struct utmpx *u);
+};
+
+static void uread_open(struct ureader *ur, const char *filename)
 {
-	static int utsize;
-	static char buf[UCHUNKSIZE];
-	char tmp[1024];
-	static off_t fpos;
-	static int bpos;
-	off_t o;
-
-	if (quit == NULL && u != NULL) {
-		/*
-		 *	Normal read.
-		 */
-		return fread(u, sizeof(struct utmpx), 1, fp);
-	}
+	struct stat st;
 
-	if (u == NULL) {
-		/*
-		 *	Initialize and position.
-		 */
-		utsize = sizeof(struct utmpx);
-		fseeko(fp, 0, SEEK_END);
-		fpos = ftello(fp);
-		if (fpos == 0)
-			return 0;
-		o = ((fpos - 1) / UCHUNKSIZE) * UCHUNKSIZE;
-		if (fseeko(fp, o, SEEK_SET) < 0) {
-			warn(_("seek on %s failed"), filename);
-			return 0;
-		}
-		bpos = (int)(fpos - o);
-		if (fread(buf, bpos, 1, fp) != 1) {
-			warn(_("cannot read %s"), filename);
-			return 0;
+	memset(ur, 0, sizeof(*ur));
+	ur->filename = filename;
+	ur->fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (ur->fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), filename);
+	if (fstat(ur->fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+
+	/* an incomplete record at the end is being written just now */
+	ur->nrecs = st.st_size / sizeof(struct utmpx);
+	ur->next = ur->nrecs;
+	ur->buf = xmalloc(UCHUNKRECS * sizeof(struct utmpx));
+}
+
+static void uread_close(struct ureader *ur)
+{
+	close(ur->fd);
+	free(ur->buf);
+}
+
+/* reads @n records from index @idx, returns 0 on success */
+static int uread_records(struct ureader *ur, struct utmpx *u, size_t idx, size_t n)
+{
+	char *p = (char *) u;
+	size_t count = n * sizeof(struct utmpx);
+	off_t off = (off_t) idx * sizeof(struct utmpx);
+
+	while (count) {
+		ssize_t rc = pread(ur->fd, p, count, off);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			warn(_("cannot read %s"), ur->filename);
+			return -1;
 		}
-		fpos = o;
-		return 1;
+		p += rc;
+		off += rc;
+		count -= rc;
 	}
+	return 0;
+}
 
-	/*
-	 *	Read one struct. From the buffer if possible.
-	 */
-	bpos -= utsize;
-	if (bpos >= 0) {
-		memcpy(u, buf + bpos, sizeof(struct utmpx));
+/* reads the record @idx, returns 1 on success */
+static int uread_at(struct ureader *ur, size_t idx, struct utmpx *u)
+{
+	if (idx >= ur->nrecs)
+		return 0;
+	if (idx >= ur->bufstart && idx < ur->bufstart + ur->buflen) {
+		memcpy(u, &ur->buf[idx - ur->bufstart], sizeof(*u));
 		return 1;
 	}
+	return uread_records(ur, u, idx, 1) == 0;
+}
 
-	/*
-	 *	Oops we went "below" the buffer. We should be able to
-	 *	seek back UCHUNKSIZE bytes.
-	 */
-	fpos -= UCHUNKSIZE;
-	if (fpos < 0)
+/* reads the previous record, returns 1 on success or 0 at the begin of the file */
+static int uread_prev(struct ureader *ur, struct utmpx *u)
+{
+	if (ur->next == 0)
 		return 0;
+	ur->next--;
 
-	/*
-	 *	Copy whatever is left in the buffer.
-	 */
-	memcpy(tmp + (-bpos), buf, utsize + bpos);
-	if (fseeko(fp, fpos, SEEK_SET) < 0) {
-		warn(_("seek on %s failed"), filename);
-		return 0;
-	}
+	if (ur->next < ur->bufstart || ur->next >= ur->bufstart + ur->buflen) {
+		size_t start = ur->next + 1 > UCHUNKRECS ? ur->next + 1 - UCHUNKRECS : 0;
 
-	/*
-	 *	Read another UCHUNKSIZE bytes.
-	 */
-	if (fread(buf, UCHUNKSIZE, 1, fp) != 1) {
-		warn(_("cannot read %s"), filename);
-		return 0;
-	}
+		ur->buflen = 0;
+		if (uread_records(ur, ur->buf, start, ur->next + 1 - start) != 0) {
+			ur->next = 0;
+			return 0;
+		}
+		ur->bufstart = start;
+		ur->buflen = ur->next + 1 - start;
 
-	/*
-	 *	The end of the UCHUNKSIZE byte buffer should be the first
-	 *	few bytes of the current struct utmp.
-	 */
-	memcpy(tmp, buf + UCHUNKSIZE + bpos, -bpos);
-	bpos += UCHUNKSIZE;
+		if (ur->prefetch) {
+			size_t i;
 
-	memcpy(u, tmp, sizeof(struct utmpx));
+			for (i = 0; i < UREADAHEAD && i < ur->buflen; i++)
+				ur->prefetch(&ur->buf[ur->buflen - 1 - i]);
+		}
+#if defined(POSIX_FADV_WILLNEED) && defined(HAVE_POSIX_FADVISE)
+		if (start) {
+			size_t prev = start > UCHUNKRECS ? start - UCHUNKRECS : 0;
 
+			posix_fadvise(ur->fd, (off_t) prev * sizeof(struct utmpx),
+				      (off_t) (start - prev) * sizeof(struct utmpx),
+				      POSIX_FADV_WILLNEED);
+		}
+#endif
+	}
+
+	if (ur->prefetch && ur->next >= ur->bufstart + UREADAHEAD)
+		ur->prefetch(&ur->buf[ur->next - UREADAHEAD - ur->bufstart]);
+
+	memcpy(u, &ur->buf[ur->next - ur->bufstart], sizeof(*u));
 	return 1;
 }
 
+/*
+ * Skips the records newer than @until. The records are appended to the file,
+ * so they are sorted by time and binary search is possible.
+ */
+static void uread_skip_until(struct ureader *ur, time_t until)
+{
+	size_t lo = 0, hi = ur->nrecs;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct utmpx u;
+
+		if (!uread_at(ur, mid, &u))
+			return;
+		if (u.ut_tv.tv_sec > until)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	ur->next = lo;
+}
+
 #ifndef FUZZ_TARGET
 /*
  *	Print a short date.
@@ -340,6 +399,198 @@ static int dns_lookup(char *result, int size, int useip, int32_t *a)
 	return getnameinfo(sa, salen, result, size, NULL, 0, flags);
 }
 
+/*
+ * Reverse DNS cache for --dns. The addresses of the records read ahead are
+ * queued and resolved by the worker threads, so the lookups are done in
+ * parallel and before the records are printed. Every address is resolved
+ * only once.
+ */
+struct dns_entry {
+	int32_t			addr[4];
+	char			*name;		/* result or NULL */
+	int			rc;		/* getnameinfo() return code */
+	struct dns_entry	*next;		/* in the queue */
+	struct timespec		deadline;	/* DNS_TIMEOUT after queued */
+
+	unsigned int		done :1,	/* resolved */
+				timedout :1;	/* don't wait for it again */
+};
+
+static struct dns_cache {
+	void		*entries;		/* tsearch() tree */
+	struct dns_entry *head, *tail;		/* not resolved yet */
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	queued;			/* new entry in the queue */
+	pthread_cond_t	resolved;		/* an entry is done */
+	size_t		nthreads;
+	int		started;
+} dns = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.queued = PTHREAD_COND_INITIALIZER,
+	.resolved = PTHREAD_COND_INITIALIZER
+};
+
+static int cmp_dns_entries(const void *a, const void *b)
+{
+	return memcmp(((const struct dns_entry *) a)->addr,
+		      ((const struct dns_entry *) b)->addr,
+		      sizeof(((const struct dns_entry *) a)->addr));
+}
+
+static void *dns_worker(void *data __attribute__((__unused__)))
+{
+	pthread_mutex_lock(&dns.lock);
+	for (;;) {
+		struct dns_entry *ent;
+		char name[NI_MAXHOST];
+		int rc;
+
+		while (!dns.head)
+			pthread_cond_wait(&dns.queued, &dns.lock);
+		ent = dns.head;
+		dns.head = ent->next;
+		if (!dns.head)
+			dns.tail = NULL;
+		pthread_mutex_unlock(&dns.lock);
+
+		rc = dns_lookup(name, sizeof(name), 0, ent->addr);
+
+		pthread_mutex_lock(&dns.lock);
+		ent->rc = rc;
+		if (rc == 0)
+			ent->name = xstrdup(name);
+		ent->done = 1;
+		pthread_cond_broadcast(&dns.resolved);
+	}
+	return NULL;
+}
+
+static void dns_start_workers(void)
+{
+	pthread_attr_t attr;
+
+	if (dns.started)
+		return;
+	dns.started = 1;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (dns.nthreads = 0; dns.nthreads < DNS_THREADS; dns.nthreads++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, &attr, dns_worker, NULL) != 0)
+			break;
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/*
+ * Returns cache entry for @addr, the new entry is queued (at the begin of the
+ * queue if @urgent). Without the threads the address is resolved here. Must
+ * be called with locked cache.
+ */
+static struct dns_entry *dns_get_entry(const int32_t *addr, int urgent)
+{
+	struct dns_entry *ent = xcalloc(1, sizeof(*ent)), **node;
+
+	memcpy(ent->addr, addr, sizeof(ent->addr));
+	clock_gettime(CLOCK_REALTIME, &ent->deadline);
+	ent->deadline.tv_sec += DNS_TIMEOUT;
+	node = tsearch(ent, &dns.entries, cmp_dns_entries);
+	if (!node)
+		err(EXIT_FAILURE, _("failed to allocate memory"));
+	if (*node != ent) {
+		free(ent);
+		ent = *node;
+		if (!urgent || ent->done || dns.head == ent)
+			return ent;
+
+		/* move it before the prefetched entries */
+		{
+			struct dns_entry *p = dns.head;
+
+			while (p && p->next != ent)
+				p = p->next;
+			if (!p)
+				return ent;	/* being resolved */
+			p->next = ent->next;
+			if (dns.tail == ent)
+				dns.tail = p;
+		}
+	} else if (!dns.nthreads) {
+		char name[NI_MAXHOST];
+
+		ent->rc = dns_lookup(name, sizeof(name), 0, ent->addr);
+		if (ent->rc == 0)
+			ent->name = xstrdup(name);
+		ent->done = 1;
+		return ent;
+	}
+
+	if (urgent) {
+		ent->next = dns.head;
+		dns.head = ent;
+		if (!dns.tail)
+			dns.tail = ent;
+	} else {
+		ent->next = NULL;
+		if (dns.tail)
+			dns.tail->next = ent;
+		else
+			dns.head = ent;
+		dns.tail = ent;
+	}
+	pthread_cond_signal(&dns.queued);
+	return ent;
+}
+
+static void dns_prefetch(const struct utmpx *u)
+{
+	if (!u->ut_addr_v6[0] && !u->ut_addr_v6[1] &&
+	    !u->ut_addr_v6[2] && !u->ut_addr_v6[3])
+		return;
+
+	pthread_mutex_lock(&dns.lock);
+	dns_start_workers();
+	dns_get_entry((const int32_t *) u->ut_addr_v6, 0);
+	pthread_mutex_unlock(&dns.lock);
+}
+
+/*
+ * Like dns_lookup(), but cached. It waits DNS_TIMEOUT seconds at most since
+ * the address has been queued, so the stall is not multiplied by the number
+ * of the addresses when the resolver does not respond.
+ */
+static int dns_cached_lookup(char *result, size_t size, const int32_t *addr)
+{
+	struct dns_entry *ent;
+	int rc = 0;
+
+	pthread_mutex_lock(&dns.lock);
+	dns_start_workers();
+	ent = dns_get_entry(addr, 1);
+
+	if (!ent->done && !ent->timedout) {
+		while (!ent->done && rc != ETIMEDOUT)
+			rc = pthread_cond_timedwait(&dns.resolved, &dns.lock, &ent->deadline);
+		if (!ent->done)
+			ent->timedout = 1;
+	}
+
+	if (!ent->done)
+		rc = EAI_AGAIN;
+	else if (ent->rc == 0) {
+		xstrncpy(result, ent->name, size);
+		rc = 0;
+	} else
+		rc = ent->rc;
+
+	pthread_mutex_unlock(&dns.lock);
+	return rc;
+}
+
 static int time_formatter(int fmt, char *dst, size_t dlen, time_t *when)
 {
 	int ret = 0;
@@ -523,8 +774,10 @@ static int list(const struct last_control *ctl, struct utmpx *p, time_t logout_t
 	 *	Look up host with DNS if needed.
 	 */
 	r = -1;
-	if (ctl->usedns || ctl->useip)
-		r = dns_lookup(domain, sizeof(domain), ctl->useip, (int32_t*)p->ut_addr_v6);
+	if (ctl->useip)
+		r = dns_lookup(domain, sizeof(domain), 1, (int32_t*)p->ut_addr_v6);
+	else if (ctl->usedns)
+		r = dns_cached_lookup(domain, sizeof(domain), (int32_t*)p->ut_addr_v6);
 	if (r < 0)
 		mem2strcpy(domain, p->ut_host, sizeof(p->ut_host), sizeof(domain));
 
@@ -652,7 +905,7 @@ static int is_phantom(const struct last_control *ctl, struct utmpx *ut)
 static void process_wtmp_file(const struct last_control *ctl,
 			      const char *filename)
 {
-	FILE *fp;		/* File pointer of wtmp file */
+	struct ureader ur;	/* wtmp file reader */
 
 	struct utmpx ut;	/* Current utmp entry */
 	struct utmplist *ulist = NULL;	/* All entries */
@@ -691,42 +944,39 @@ static void process_wtmp_file(const struct last_control *ctl,
 	/*
 	 * Open the utmp file
 	 */
-	if ((fp = fopen(filename, "r")) == NULL)
-		err(EXIT_FAILURE, _("cannot open %s"), filename);
-
-	/*
-	 * Optimize the buffer size.
-	 */
-	setvbuf(fp, NULL, _IOFBF, UCHUNKSIZE);
+	uread_open(&ur, filename);
+	if (ctl->usedns && !ctl->useip)
+		ur.prefetch = dns_prefetch;
 
 	/*
 	 * Read first structure to capture the time field
 	 */
-	if (uread(fp, &ut, NULL, filename) == 1)
+	if (uread_at(&ur, 0, &ut) == 1)
 		begintime = ut.ut_tv.tv_sec;
 	else {
-		if (fstat(fileno(fp), &st) != 0)
+		if (fstat(ur.fd, &st) != 0)
 			err(EXIT_FAILURE, _("stat of %s failed"), filename);
 		begintime = st.st_ctime;
 		quit = 1;
 	}
 
 	/*
-	 * Go to end of file minus one structure
-	 * and/or initialize utmp reading code.
+	 * Don't read the records after --until at all.
 	 */
-	uread(fp, NULL, NULL, filename);
+	if (ctl->until)
+		uread_skip_until(&ur, ctl->until);
 
 	/*
 	 * Read struct after struct backwards from the file.
 	 */
 	while (!quit) {
 
-		if (uread(fp, &ut, &quit, filename) != 1)
+		if (uread_prev(&ur, &ut) != 1)
 			break;
 
+		/* all the remaining records are older */
 		if (ctl->since && ut.ut_tv.tv_sec < ctl->since)
-			continue;
+			break;
 
 		if (ctl->until && ctl->until < ut.ut_tv.tv_sec)
 			continue;
@@ -915,7 +1165,7 @@ static void process_wtmp_file(const struct last_control *ctl,
 		free(tmp);
 	}
 
-	fclose(fp);
+	uread_close(&ur);
 
 	for (p = ulist; p; p = next) {
 		next = p->next;
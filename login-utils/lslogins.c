@@ -32,6 +32,7 @@
 #include <paths.h>
 #include <time.h>
 #include <utmpx.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <err.h>
 #include <limits.h>
@@ -56,6 +57,7 @@
 #include "optutils.h"
 #include "pathnames.h"
 #include "fileutils.h"
+#include "all-io.h"
 #include "logindefs.h"
 #include "procfs.h"
 #include "timeutils.h"
@@ -256,14 +258,24 @@ static const struct lslogins_coldesc coldescs[] =
 struct lslogins_control {
 	struct utmpx *wtmp;
 	size_t wtmp_size;
+	void *wtmp_index;	/* the last wtmp record of every user */
 
 	struct utmpx *btmp;
 	size_t btmp_size;
+	void *btmp_index;	/* the last btmp record of every user */
 
 	int lastlogin_fd;
 
 	void *usertree;
 
+	/*
+	 * Data of all users read by one pass rather than by per-user lookups,
+	 * see read_nprocs(), read_sgroups() and read_shadow().
+	 */
+	void *nprocs;		/* struct uid_nprocs */
+	void *sgroups;		/* struct user_sgroups */
+	void *shadow;		/* struct user_shadow */
+
 	uid_t uid;
 	uid_t UID_MIN;
 	uid_t UID_MAX;
@@ -279,6 +291,9 @@ struct lslogins_control {
 	const char *journal_path;
 
 	unsigned int selinux_enabled : 1,
+		     nprocs_read : 1,			/* ctl->nprocs is ready */
+		     sgroups_read : 1,			/* ctl->sgroups is ready */
+		     shadow_read : 1,			/* ctl->shadow is ready */
 		     fail_on_unknown : 1,		/* fail if user does not exist */
 		     ulist_on : 1,
 		     shellvar : 1,
@@ -290,6 +305,9 @@ struct lslogins_control {
  * them for each call of fill_table() via twalk() */
 static struct libscols_table *tb;
 
+/* group names cache, see get_group() */
+static void *groupnames;
+
 /* columns[] array specifies all currently wanted output column. The columns
  * are defined by coldescs[] array and you can specify (on command line) each
  * column twice. That's enough, dynamically allocated array of the columns is
@@ -378,6 +396,55 @@ static char *gidtostr(gid_t gid)
 	return str_gid;
 }
 
+struct gid_name {
+	gid_t	gid;
+	char	*name;		/* NULL if the group does not exist */
+};
+
+static int cmp_gid_name(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct gid_name *) a)->gid,
+			   ((const struct gid_name *) b)->gid);
+}
+
+static void free_gid_name(void *data)
+{
+	struct gid_name *x = data;
+
+	free(x->name);
+	free(x);
+}
+
+/* adds @data to the tree, returns the already existing node data or @data */
+static void *tree_add(void *data, void **tree, int (*cmp)(const void *, const void *))
+{
+	void **node = tsearch(data, tree, cmp);
+
+	if (!node)
+		err(EXIT_FAILURE, _("failed to allocate memory"));
+	return *node;
+}
+
+/* returns the group name, every group is looked up only once */
+static const char *get_group(gid_t gid)
+{
+	struct gid_name key = { .gid = gid }, **node, *x;
+	struct group *grp;
+
+	node = tfind(&key, &groupnames, cmp_gid_name);
+	if (node)
+		return (*node)->name;
+
+	errno = 0;
+	grp = getgrgid(gid);
+
+	x = xcalloc(1, sizeof(*x));
+	x->gid = gid;
+	x->name = grp ? xstrdup(grp->gr_name) : NULL;
+	tree_add(x, &groupnames, cmp_gid_name);
+	return x->name;
+}
+
 static char *build_sgroups_string(gid_t *sgroups, size_t nsgroups, int want_names)
 {
 	size_t n = 0, maxlen, len;
@@ -395,12 +462,12 @@ again:
 		if (!want_names)
 			x = snprintf(p, len, "%u,", sgroups[n]);
 		else {
-			struct group *grp = getgrgid(sgroups[n]);
-			if (!grp) {
+			const char *name = get_group(sgroups[n]);
+			if (!name) {
 				free(res);
 				return NULL;
 			}
-			x = snprintf(p, len, "%s,", grp->gr_name);
+			x = snprintf(p, len, "%s,", name);
 		}
 
 		if (x < 0 || (size_t) x >= len) {
@@ -424,21 +491,49 @@ again:
 	return res;
 }
 
-static struct utmpx *get_last_wtmp(struct lslogins_control *ctl, const char *username)
+static int cmp_utmpx_user(const void *a, const void *b)
 {
-	size_t n = 0;
+	return strncmp(((const struct utmpx *) a)->ut_user,
+		       ((const struct utmpx *) b)->ut_user,
+		       sizeof(((const struct utmpx *) a)->ut_user));
+}
+
+/*
+ * Creates tree with the last record of every user. The records are walked
+ * from the end, so only the first record of the user is added.
+ */
+static void *index_utmpx(struct utmpx *records, size_t nrecords)
+{
+	void *tree = NULL;
+	size_t n = nrecords;
+
+	while (n-- > 0) {
+		if (!tsearch(records + n, &tree, cmp_utmpx_user))
+			err(EXIT_FAILURE, _("failed to allocate memory"));
+	}
+	return tree;
+}
 
-	if (!username)
+static void free_utmpx_node(void *node __attribute__((__unused__)))
+{
+	/* the records are freed with the whole array */
+}
+
+static struct utmpx *get_last_utmpx(void *index, const char *username)
+{
+	struct utmpx key, **node;
+
+	if (!username || !index)
 		return NULL;
 
-	n = ctl->wtmp_size - 1;
-	do {
-		if (!strncmp(username, ctl->wtmp[n].ut_user,
-		             sizeof(ctl->wtmp[0].ut_user)))
-			return ctl->wtmp + n;
-	} while (n--);
-	return NULL;
+	strncpy(key.ut_user, username, sizeof(key.ut_user));
+	node = tfind(&key, &index, cmp_utmpx_user);
+	return node ? *node : NULL;
+}
 
+static struct utmpx *get_last_wtmp(struct lslogins_control *ctl, const char *username)
+{
+	return get_last_utmpx(ctl->wtmp_index, username);
 }
 
 static int require_wtmp(void)
@@ -461,60 +556,44 @@ static int require_btmp(void)
 
 static struct utmpx *get_last_btmp(struct lslogins_control *ctl, const char *username)
 {
-	size_t n = 0;
-
-	if (!username)
-		return NULL;
-
-	n = ctl->btmp_size - 1;
-	do {
-		if (!strncmp(username, ctl->btmp[n].ut_user,
-		             sizeof(ctl->wtmp[0].ut_user)))
-			return ctl->btmp + n;
-	}while (n--);
-	return NULL;
-
+	return get_last_utmpx(ctl->btmp_index, username);
 }
 
+/*
+ * The whole file is read by one read() rather than by getutxent(), which
+ * locks the file and reads it record by record.
+ */
 static int parse_utmpx(const char *path, size_t *nrecords, struct utmpx **records)
 {
-	size_t i, imax = 0;
 	struct utmpx *ary = NULL;
 	struct stat st;
+	ssize_t sz = 0;
+	int fd;
 
 	*nrecords = 0;
 	*records = NULL;
 
-	if (utmpxname(path) < 0)
-		return -errno;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || fstat(fd, &st) != 0)
+		goto fail;
 
-	/* optimize allocation according to file size, the realloc() below is
-	 * just fallback only */
-	if (stat(path, &st) == 0 && (size_t) st.st_size >= sizeof(struct utmpx)) {
-		imax = st.st_size / sizeof(struct utmpx);
-		ary = xmalloc(imax * sizeof(struct utmpx));
-	}
+	/* an incomplete record at the end is being written just now */
+	if ((size_t) st.st_size >= sizeof(struct utmpx)) {
+		size_t imax = st.st_size / sizeof(struct utmpx);
 
-	for (i = 0; ; i++) {
-		struct utmpx *u;
-		errno = 0;
-		u = getutxent();
-		if (!u) {
-			if (errno)
-				goto fail;
-			break;
-		}
-		if (i == imax)
-			ary = xrealloc(ary, (imax *= 2) * sizeof(struct utmpx));
-		ary[i] = *u;
+		ary = xmalloc(imax * sizeof(struct utmpx));
+		sz = read_all(fd, (char *) ary, imax * sizeof(struct utmpx));
+		if (sz < 0)
+			goto fail;
 	}
+	close(fd);
 
-	*nrecords = i;
+	*nrecords = sz / sizeof(struct utmpx);
 	*records = ary;
-	endutxent();
 	return 0;
 fail:
-	endutxent();
+	if (fd >= 0)
+		close(fd);
 	free(ary);
 	if (errno) {
 		if (errno != EACCES)
@@ -549,7 +628,135 @@ static void get_lastlog(struct lslogins_control *ctl, uid_t uid, void *dst, int
 	}
 }
 
-static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
+struct uid_nprocs {
+	uid_t	uid;
+	int	nprocs;
+};
+
+struct user_sgroups {
+	char	*name;
+	gid_t	*gids;
+	size_t	ngids;
+};
+
+struct user_shadow {
+	struct spwd sp;
+};
+
+static int cmp_uid_nprocs(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct uid_nprocs *) a)->uid,
+			   ((const struct uid_nprocs *) b)->uid);
+}
+
+static int cmp_user_sgroups(const void *a, const void *b)
+{
+	return strcmp(((const struct user_sgroups *) a)->name,
+		      ((const struct user_sgroups *) b)->name);
+}
+
+static int cmp_user_shadow(const void *a, const void *b)
+{
+	return strcmp(((const struct user_shadow *) a)->sp.sp_namp,
+		      ((const struct user_shadow *) b)->sp.sp_namp);
+}
+
+static void free_user_sgroups(void *data)
+{
+	struct user_sgroups *x = data;
+
+	free(x->name);
+	free(x->gids);
+	free(x);
+}
+
+static void free_user_shadow(void *data)
+{
+	struct user_shadow *x = data;
+
+	free(x->sp.sp_namp);
+	free(x->sp.sp_pwdp);
+	free(x);
+}
+
+/* supplementary groups of all users by one getgrent() enumeration */
+static void read_sgroups(struct lslogins_control *ctl)
+{
+	struct group *grp;
+
+	ctl->sgroups_read = 1;
+
+	setgrent();
+	while ((grp = getgrent())) {
+		char **mem;
+
+		for (mem = grp->gr_mem; mem && *mem; mem++) {
+			struct user_sgroups key = { .name = *mem }, **node, *x;
+			size_t i;
+
+			node = tfind(&key, &ctl->sgroups, cmp_user_sgroups);
+			x = node ? *node : NULL;
+			if (!x) {
+				x = xcalloc(1, sizeof(*x));
+				x->name = xstrdup(*mem);
+				tree_add(x, &ctl->sgroups, cmp_user_sgroups);
+			}
+			for (i = 0; i < x->ngids; i++) {
+				if (x->gids[i] == grp->gr_gid)
+					break;
+			}
+			if (i < x->ngids)
+				continue;	/* duplicate */
+			x->gids = xrealloc(x->gids, (x->ngids + 1) * sizeof(gid_t));
+			x->gids[x->ngids++] = grp->gr_gid;
+		}
+	}
+	endgrent();
+}
+
+/* shadow entries of all users by one getspent() enumeration */
+static void read_shadow(struct lslogins_control *ctl)
+{
+	struct spwd *sp;
+
+	ctl->shadow_read = 1;
+
+	lckpwdf();
+	setspent();
+	while ((sp = getspent())) {
+		struct user_shadow *x = xcalloc(1, sizeof(*x));
+
+		x->sp = *sp;
+		x->sp.sp_namp = xstrdup(sp->sp_namp);
+		x->sp.sp_pwdp = sp->sp_pwdp ? xstrdup(sp->sp_pwdp) : NULL;
+		if (tree_add(x, &ctl->shadow, cmp_user_shadow) != x)
+			free_user_shadow(x);	/* duplicate */
+	}
+	endspent();
+	ulckpwdf();
+}
+
+static struct spwd *get_shadow(struct lslogins_control *ctl, const char *username)
+{
+	struct user_shadow key, **x;
+	struct spwd *shadow;
+
+	if (ctl->ulist_on) {
+		lckpwdf();
+		shadow = getspnam(username);
+		ulckpwdf();
+		return shadow;
+	}
+
+	if (!ctl->shadow_read)
+		read_shadow(ctl);
+	key.sp.sp_namp = (char *) username;
+	x = tfind(&key, &ctl->shadow, cmp_user_shadow);
+	return x ? &(*x)->sp : NULL;
+}
+
+static int get_sgroups(struct lslogins_control *ctl,
+		       gid_t **list, size_t *len, struct passwd *pwd)
 {
 	size_t n = 0;
 	int ngroups = 0;
@@ -557,16 +764,33 @@ static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
 	*len = 0;
 	*list = NULL;
 
-	/* first let's get a supp. group count */
-	getgrouplist(pwd->pw_name, pwd->pw_gid, *list, &ngroups);
-	if (!ngroups)
-		return -1;
+	if (!ctl->ulist_on) {
+		/* the same as getgrouplist(), but from read_sgroups() */
+		struct user_sgroups key = { .name = pwd->pw_name }, **x;
+		size_t i;
 
-	*list = xcalloc(1, ngroups * sizeof(gid_t));
+		if (!ctl->sgroups_read)
+			read_sgroups(ctl);
+		x = tfind(&key, &ctl->sgroups, cmp_user_sgroups);
 
-	/* now for the actual list of GIDs */
-	if (-1 == getgrouplist(pwd->pw_name, pwd->pw_gid, *list, &ngroups))
-		return -1;
+		*list = xcalloc(1, (1 + (x ? (*x)->ngids : 0)) * sizeof(gid_t));
+		(*list)[ngroups++] = pwd->pw_gid;
+		for (i = 0; x && i < (*x)->ngids; i++) {
+			if ((*x)->gids[i] != pwd->pw_gid)
+				(*list)[ngroups++] = (*x)->gids[i];
+		}
+	} else {
+		/* first let's get a supp. group count */
+		getgrouplist(pwd->pw_name, pwd->pw_gid, *list, &ngroups);
+		if (!ngroups)
+			return -1;
+
+		*list = xcalloc(1, ngroups * sizeof(gid_t));
+
+		/* now for the actual list of GIDs */
+		if (-1 == getgrouplist(pwd->pw_name, pwd->pw_gid, *list, &ngroups))
+			return -1;
+	}
 
 	*len = (size_t) ngroups;
 
@@ -584,23 +808,43 @@ static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
 }
 
 #ifdef __linux__
-static int get_nprocs(const uid_t uid)
+/* number of processes of all users by one /proc scan */
+static void read_nprocs(struct lslogins_control *ctl)
 {
-	DIR *dir;
-	struct dirent *d;
-	int nprocs = 0;
+	struct procfs_scan sc;
+	pid_t pid;
 
-	dir = opendir(_PATH_PROC);
-	if (!dir)
-		return 0;
+	ctl->nprocs_read = 1;
+
+	if (procfs_scan_open(&sc, NULL) != 0)
+		return;
 
-	while ((d = xreaddir(dir))) {
-		if (procfs_dirent_match_uid(dir, d, uid))
-			++nprocs;
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		struct uid_nprocs *x, *new;
+		uid_t uid;
+
+		if (procfs_scan_get_uid(&sc, &uid) != 0)
+			continue;
+
+		new = xcalloc(1, sizeof(*new));
+		new->uid = uid;
+		x = tree_add(new, &ctl->nprocs, cmp_uid_nprocs);
+		if (x != new)
+			free(new);
+		x->nprocs++;
 	}
 
-	closedir(dir);
-	return nprocs;
+	procfs_scan_close(&sc);
+}
+
+static int get_nprocs(struct lslogins_control *ctl, const uid_t uid)
+{
+	struct uid_nprocs key = { .uid = uid }, **x;
+
+	if (!ctl->nprocs_read)
+		read_nprocs(ctl);
+	x = tfind(&key, &ctl->nprocs, cmp_uid_nprocs);
+	return x ? (*x)->nprocs : 0;
 }
 #endif
 
@@ -694,7 +938,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 {
 	struct lslogins_user *user;
 	struct passwd *pwd;
-	struct group *grp;
+	const char *group;
 	struct spwd *shadow;
 	struct utmpx *user_wtmp = NULL, *user_btmp = NULL;
 	size_t n = 0;
@@ -726,8 +970,8 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 	}
 
 	errno = 0;
-	grp = getgrgid(pwd->pw_gid);
-	if (!grp)
+	group = get_group(pwd->pw_gid);
+	if (!group)
 		return NULL;
 
 	user = xcalloc(1, sizeof(struct lslogins_user));
@@ -737,9 +981,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 	if (ctl->btmp)
 		user_btmp = get_last_btmp(ctl, pwd->pw_name);
 
-	lckpwdf();
-	shadow = getspnam(pwd->pw_name);
-	ulckpwdf();
+	shadow = get_shadow(ctl, pwd->pw_name);
 
 	/* required  by tseach() stuff */
 	user->uid = pwd->pw_uid;
@@ -753,7 +995,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 			user->uid = pwd->pw_uid;
 			break;
 		case COL_GROUP:
-			user->group = xstrdup(grp->gr_name);
+			user->group = xstrdup(group);
 			break;
 		case COL_GID:
 			user->gid = pwd->pw_gid;
@@ -761,7 +1003,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 		case COL_SGROUPS:
 		case COL_SGIDS:
 			if (!user->nsgroups &&
-			    get_sgroups(&user->sgroups, &user->nsgroups, pwd) < 0)
+			    get_sgroups(ctl, &user->sgroups, &user->nsgroups, pwd) < 0)
 				err(EXIT_FAILURE, _("failed to get supplementary groups"));
 			break;
 		case COL_HOME:
@@ -916,7 +1158,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 		case COL_NPROCS:
 #ifdef __linux__
 
-			xasprintf(&user->nprocs, "%d", get_nprocs(pwd->pw_uid));
+			xasprintf(&user->nprocs, "%d", get_nprocs(ctl, pwd->pw_uid));
 #endif
 			break;
 		default:
@@ -1016,9 +1258,17 @@ static void free_ctl(struct lslogins_control *ctl)
 	if (!ctl)
 		return;
 
+	tdestroy(ctl->wtmp_index, free_utmpx_node);
+	tdestroy(ctl->btmp_index, free_utmpx_node);
 	free(ctl->wtmp);
 	free(ctl->btmp);
 
+	tdestroy(ctl->nprocs, free);
+	tdestroy(ctl->sgroups, free_user_sgroups);
+	tdestroy(ctl->shadow, free_user_shadow);
+	tdestroy(groupnames, free_gid_name);
+	groupnames = NULL;
+
 	while (n < ctl->ulsiz)
 		free(ctl->ulist[n++]);
 
@@ -1692,10 +1942,13 @@ int main(int argc, char *argv[])
 
 	if (require_wtmp()) {
 		parse_utmpx(path_wtmp, &ctl->wtmp_size, &ctl->wtmp);
+		ctl->wtmp_index = index_utmpx(ctl->wtmp, ctl->wtmp_size);
 		ctl->lastlogin_fd = open(path_lastlog, O_RDONLY, 0);
 	}
-	if (require_btmp())
+	if (require_btmp()) {
 		parse_utmpx(path_btmp, &ctl->btmp_size, &ctl->btmp);
+		ctl->btmp_index = index_utmpx(ctl->btmp, ctl->btmp_size);
+	}
 
 	if (logins || groups)
 		get_ulist(ctl, logins, groups);
@@ -36,6 +36,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/types.h>
 #ifdef HAVE_INOTIFY_INIT
 #include <sys/inotify.h>
 #endif
@@ -46,15 +47,68 @@
 #include "closestream.h"
 #include "timeutils.h"
 
+/* number of records read by one read() in dump() */
+#define UCHUNKRECS	4096
+
+/* buffer size for the text streams */
+#define TEXTBUFSZ	(1024 * 1024)
+
+static usec_t since;		/* dump records since the time, or 0 */
+static usec_t until;		/* dump records until the time, or 0 */
+
+#define isdigit2(_s)	(isdigit((_s)[0]) && isdigit((_s)[1]))
+#define atoi2(_s)	(((_s)[0] - '0') * 10 + ((_s)[1] - '0'))
+
+/*
+ * Converts the ISO timestamp, the date is converted by strptime() and timegm()
+ * only when it differs from the previous call, they are expensive to be used
+ * for every line. Returns -1 for the unexpected formats.
+ */
+static int strtotime_iso(const char *s_time, time_t *t)
+{
+	static char last_date[11];
+	static time_t last_day = -1;
+	const char *s = s_time + sizeof(last_date);
+	int h, m, sec;
+
+	if (strnlen(s_time, 19) < 19 || s_time[10] != 'T'
+	    || !isdigit2(s) || s[2] != ':' || !isdigit2(s + 3)
+	    || s[5] != ':' || !isdigit2(s + 6))
+		return -1;
+
+	h = atoi2(s);
+	m = atoi2(s + 3);
+	sec = atoi2(s + 6);
+	if (h > 23 || m > 59 || sec > 60)
+		return -1;
+
+	if (last_day == -1 || memcmp(last_date, s_time, sizeof(last_date)) != 0) {
+		struct tm tm;
+
+		memset(&tm, '\0', sizeof(struct tm));
+		if (!strptime(s_time, "%Y-%m-%dT", &tm))
+			return -1;
+		last_day = timegm(&tm);
+		memcpy(last_date, s_time, sizeof(last_date));
+	}
+
+	*t = last_day + h * 3600 + m * 60 + sec;
+	return 0;
+}
+
 static time_t strtotime(const char *s_time)
 {
 	struct tm tm;
+	time_t t;
 
 	memset(&tm, '\0', sizeof(struct tm));
 
 	if (s_time[0] == ' ' || s_time[0] == '\0')
 		return (time_t)0;
 
+	if (isdigit(s_time[0]) && strtotime_iso(s_time, &t) == 0)
+		return t;
+
 	if (isdigit(s_time[0])) {
 		/* [1998-09-01T01:00:00,000000+00:00]
 		 * Subseconds are parsed with strtousec().  Timezone is
@@ -95,11 +149,80 @@ static void xcleanse(char *s, int len)
 			*s = '?';
 }
 
+static inline void put_digits(char *p, unsigned long num, size_t ndigits)
+{
+	while (ndigits-- > 0) {
+		p[ndigits] = '0' + num % 10;
+		num /= 10;
+	}
+}
+
+/*
+ * The records are ordered by time, so the date is usually the same as for the
+ * previous record. The "YYYY-MM-DDT" part is generated by strtimeval_iso()
+ * once per day and the rest is rewritten in place. The timestamps are in
+ * UTC, so every day has 86400 seconds.
+ */
+static const char *time_to_string(struct timeval *tv)
+{
+	static char time_string[40];
+	static char *clock_string;	/* behind 'T' */
+	static time_t last_day = -1;
+	time_t day, sec;
+
+	if (tv->tv_sec < 0 || tv->tv_usec < 0 || tv->tv_usec > 999999)
+		goto slow;
+
+	day = tv->tv_sec / 86400;
+	sec = tv->tv_sec % 86400;
+
+	if (day != last_day || !clock_string) {
+		struct timeval x = { .tv_sec = day * 86400 };
+
+		if (strtimeval_iso(&x, ISO_TIMESTAMP_COMMA_GT, time_string,
+				   sizeof(time_string)) != 0)
+			goto slow;
+		clock_string = strchr(time_string, 'T');
+		if (!clock_string)
+			goto slow;
+		clock_string++;
+		last_day = day;
+	}
+
+	/* HH:MM:SS,UUUUUU */
+	put_digits(clock_string, sec / 3600, 2);
+	put_digits(clock_string + 3, sec / 60 % 60, 2);
+	put_digits(clock_string + 6, sec % 60, 2);
+	put_digits(clock_string + 9, tv->tv_usec, 6);
+	return time_string;
+slow:
+	clock_string = NULL;
+	if (strtimeval_iso(tv, ISO_TIMESTAMP_COMMA_GT, time_string,
+			   sizeof(time_string)) != 0)
+		return NULL;
+	return time_string;
+}
+
+/* adds "[str] " to @p, @str is padded to @width and limited to @max bytes */
+static char *put_field(char *p, const char *str, size_t max, size_t width)
+{
+	size_t len = strnlen(str, max);
+
+	*p++ = '[';
+	memcpy(p, str, len);
+	p += len;
+	for (; len < width; len++)
+		*p++ = ' ';
+	*p++ = ']';
+	*p++ = ' ';
+	return p;
+}
+
 static void print_utline(struct utmpx *ut, FILE *out)
 {
-	const char *addr_string;
+	const char *addr_string, *time_string;
 	char buffer[INET6_ADDRSTRLEN];
-	char time_string[40];
+	char line[512], *p;
 	struct timeval tv;
 
 	if (ut->ut_addr_v6[1] || ut->ut_addr_v6[2] || ut->ut_addr_v6[3])
@@ -110,21 +233,30 @@ static void print_utline(struct utmpx *ut, FILE *out)
 	tv.tv_sec = ut->ut_tv.tv_sec;
 	tv.tv_usec = ut->ut_tv.tv_usec;
 
-	if (strtimeval_iso(&tv, ISO_TIMESTAMP_COMMA_GT, time_string,
-			   sizeof(time_string)) != 0)
+	time_string = time_to_string(&tv);
+	if (!time_string)
 		return;
 	cleanse(ut->ut_id);
 	cleanse(ut->ut_user);
 	cleanse(ut->ut_line);
 	cleanse(ut->ut_host);
 
-	/*            type pid    id       user     line     host     addr    time */
-	fprintf(out, "[%d] [%05d] [%-4.4s] [%-*.*s] [%-*.*s] [%-*.*s] [%-15s] [%s]\n",
-	       ut->ut_type, ut->ut_pid, ut->ut_id,
-	       8, (int)sizeof(ut->ut_user), ut->ut_user,
-	       12, (int)sizeof(ut->ut_line), ut->ut_line,
-	       20, (int)sizeof(ut->ut_host), ut->ut_host,
-	       addr_string, time_string);
+	/* The line is composed in the buffer and written at once, it's
+	 * the same as
+	 *
+	 *    "[%d] [%05d] [%-4.4s] [%-*.*s] [%-*.*s] [%-*.*s] [%-15s] [%s]\n"
+	 *    type pid    id       user     line     host     addr    time
+	 */
+	p = line + snprintf(line, 32, "[%d] [%05d] ", ut->ut_type, ut->ut_pid);
+	p = put_field(p, ut->ut_id, sizeof(ut->ut_id), 4);
+	p = put_field(p, ut->ut_user, sizeof(ut->ut_user), 8);
+	p = put_field(p, ut->ut_line, sizeof(ut->ut_line), 12);
+	p = put_field(p, ut->ut_host, sizeof(ut->ut_host), 20);
+	p = put_field(p, addr_string ? addr_string : "", INET6_ADDRSTRLEN, 15);
+	p = put_field(p, time_string, 40, 0);
+	p[-1] = '\n';
+
+	fwrite(line, 1, p - line, out);
 }
 
 #ifdef HAVE_INOTIFY_INIT
@@ -214,15 +346,68 @@ static int follow_by_inotify(FILE *in, const char *filename, FILE *out)
 }
 #endif /* HAVE_INOTIFY_INIT */
 
+static inline usec_t utmpx_get_usec(const struct utmpx *ut)
+{
+	return (usec_t) ut->ut_tv.tv_sec * USEC_PER_SEC + ut->ut_tv.tv_usec;
+}
+
+/*
+ * Moves @in to the first record not older than --since. The records are
+ * appended to the file, so it's ordered by time and binary search is
+ * possible. Does nothing for pipes and other non-seekable input.
+ */
+static void skip_since(FILE *in)
+{
+	struct stat st;
+	size_t lo = 0, hi;
+
+	if (fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode))
+		return;
+
+	hi = st.st_size / sizeof(struct utmpx);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct utmpx ut;
+
+		if (pread(fileno(in), &ut, sizeof(ut),
+			  (off_t) mid * sizeof(ut)) != sizeof(ut))
+			return;
+		if (utmpx_get_usec(&ut) < since)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	ignore_result( fseeko(in, (off_t) lo * sizeof(struct utmpx), SEEK_SET) );
+}
+
 static FILE *dump(FILE *in, const char *filename, int follow, FILE *out)
 {
-	struct utmpx ut;
+	struct utmpx ut, *buf;
+	size_t i, n;
 
-	if (follow)
+	if (since)
+		skip_since(in);
+	else if (follow)
 		ignore_result( fseek(in, -10 * sizeof(ut), SEEK_END) );
 
-	while (fread(&ut, sizeof(ut), 1, in) == 1)
-		print_utline(&ut, out);
+	/* read many records at once, stdio reads them directly to @buf */
+	buf = xmalloc(UCHUNKRECS * sizeof(*buf));
+
+	while ((n = fread(buf, sizeof(*buf), UCHUNKRECS, in)) > 0) {
+		for (i = 0; i < n; i++) {
+			usec_t t = utmpx_get_usec(&buf[i]);
+
+			/* all the remaining records are newer */
+			if (until && t > until) {
+				free(buf);
+				return in;
+			}
+			if (since && t < since)
+				continue;
+			print_utline(&buf[i], out);
+		}
+	}
+	free(buf);
 
 	if (!follow)
 		return in;
@@ -324,6 +509,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --follow         output appended data as the file grows\n"), out);
 	fputs(_(" -r, --reverse        write back dumped data into utmp file\n"), out);
 	fputs(_(" -o, --output <file>  write to file instead of standard output\n"), out);
+	fputs(_("     --since <time>   dump the records since the specified time\n"), out);
+	fputs(_("     --until <time>   dump the records until the specified time\n"), out);
 	printf(USAGE_HELP_OPTIONS(22));
 
 	printf(USAGE_MAN_TAIL("utmpdump(1)"));
@@ -337,10 +524,16 @@ int main(int argc, char **argv)
 	int reverse = 0, follow = 0;
 	const char *filename = NULL;
 
+	enum {
+		OPT_SINCE = CHAR_MAX + 1,
+		OPT_UNTIL
+	};
 	static const struct option longopts[] = {
 		{ "follow",  no_argument,       NULL, 'f' },
 		{ "reverse", no_argument,       NULL, 'r' },
 		{ "output",  required_argument, NULL, 'o' },
+		{ "since",   required_argument, NULL, OPT_SINCE },
+		{ "until",   required_argument, NULL, OPT_UNTIL },
 		{ "help",    no_argument,       NULL, 'h' },
 		{ "version", no_argument,       NULL, 'V' },
 		{ NULL, 0, NULL, 0 }
@@ -368,6 +561,16 @@ int main(int argc, char **argv)
 				    optarg);
 			break;
 
+		case OPT_SINCE:
+			if (parse_timestamp(optarg, &since) < 0)
+				errx(EXIT_FAILURE, _("invalid since argument: %s"), optarg);
+			break;
+
+		case OPT_UNTIL:
+			if (parse_timestamp(optarg, &until) < 0)
+				errx(EXIT_FAILURE, _("invalid until argument: %s"), optarg);
+			break;
+
 		case 'h':
 			usage();
 		case 'V':
@@ -380,9 +583,15 @@ int main(int argc, char **argv)
 	if (!out)
 		out = stdout;
 
+	if (reverse && (since || until))
+		errx(EXIT_FAILURE, _("--since and --until are unsupported with --reverse"));
+	if (follow && until)
+		errx(EXIT_FAILURE, _("--until is unsupported with --follow"));
+
 	if (follow && (out != stdout || !isatty(STDOUT_FILENO))) {
 		setvbuf(out, NULL, _IOLBF, 0);
-	}
+	} else if (!follow)
+		setvbuf(out, NULL, _IOFBF, TEXTBUFSZ);
 
 	if (optind < argc) {
 		filename = argv[optind];
@@ -396,6 +605,10 @@ int main(int argc, char **argv)
 		in = stdin;
 	}
 
+	/* the text is parsed line by line */
+	if (reverse)
+		setvbuf(in, NULL, _IOFBF, TEXTBUFSZ);
+
 	if (reverse) {
 		fprintf(stderr, _("Utmp undump of %s\n"), filename);
 		undump(in, out);
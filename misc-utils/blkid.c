@@ -25,6 +25,7 @@
 #define OUTPUT_PRETTY_LIST	(1 << 3)		/* deprecated */
 #define OUTPUT_UDEV_LIST	(1 << 4)		/* deprecated */
 #define OUTPUT_EXPORT_LIST	(1 << 5)
+#define OUTPUT_NDJSON		(1 << 6)
 
 #define BLKID_EXIT_NOTFOUND	2	/* token or device not found */
 #define BLKID_EXIT_OTHER	4	/* bad usage or other error */
@@ -47,12 +48,16 @@
 #include "xalloc.h"
 
 #include "sysfs.h"
+#include "ulstats.h"
+#include "jsonwrt.h"
 
 struct blkid_control {
 	int output;
+	int jobs;
 	uintmax_t offset;
 	uintmax_t size;
 	char *show[128];
+	struct ul_jsonwrt json;		/* OUTPUT_NDJSON */
 	unsigned int
 		eval:1,
 		gc:1,
@@ -80,14 +85,16 @@ static void __attribute__((__noreturn__)) usage(void)
 			"                              cache file (-c /dev/null means no cache)\n"), out);
 	fputs(_(	" -d, --no-encoding          don't encode non-printing characters\n"), out);
 	fputs(_(	" -g, --garbage-collect      garbage collect the blkid cache\n"), out);
+	fputs(_(	" -j, --jobs <num>           probe all devices by <num> parallel threads\n"), out);
 	fputs(_(	" -o, --output <format>      output format; can be one of:\n"
-			"                              value, device, export or full; (default: full)\n"), out);
+			"                              value, device, export, ndjson or full; (default: full)\n"), out);
 	fputs(_(	" -k, --list-filesystems     list all known filesystems/RAIDs and exit\n"), out);
 	fputs(_(	" -s, --match-tag <tag>      show specified tag(s) (default show all tags)\n"), out);
 	fputs(_(	" -t, --match-token <token>  find device with a specific token (NAME=value pair)\n"), out);
 	fputs(_(	" -l, --list-one             look up only first device with token specified by -t\n"), out);
 	fputs(_(	" -L, --label <label>        convert LABEL to device name\n"), out);
 	fputs(_(	" -U, --uuid <uuid>          convert UUID to device name\n"), out);
+	fputs(_(	"     --stats[=<format>]     print statistics to stderr (text or json)\n"), out);
 	fputs(          "\n", out);
 	fputs(_(	"Low-level probing options:\n"), out);
 	fputs(_(	" -p, --probe                low-level superblocks probing (bypass cache)\n"), out);
@@ -314,7 +321,7 @@ static int has_item(const struct blkid_control *ctl, const char *item)
 	return 0;
 }
 
-static void print_value(const struct blkid_control *ctl, int num,
+static void print_value(struct blkid_control *ctl, int num,
 			const char *devname, const char *value,
 			const char *name, size_t valsz)
 {
@@ -325,6 +332,14 @@ static void print_value(const struct blkid_control *ctl, int num,
 	} else if (ctl->output & OUTPUT_UDEV_LIST) {
 		print_udev_format(name, value);
 
+	} else if (ctl->output & OUTPUT_NDJSON) {
+		if (num == 1) {
+			ul_jsonwrt_root_open(&ctl->json);
+			if (devname)
+				ul_jsonwrt_value_s(&ctl->json, "devname", devname);
+		}
+		ul_jsonwrt_value_s(&ctl->json, name, value);
+
 	} else if (ctl->output & OUTPUT_EXPORT_LIST) {
 		if (num == 1 && devname)
 			printf("DEVNAME=%s\n", devname);
@@ -344,7 +359,7 @@ static void print_value(const struct blkid_control *ctl, int num,
 	}
 }
 
-static void print_tags(const struct blkid_control *ctl, blkid_dev dev)
+static void print_tags(struct blkid_control *ctl, blkid_dev dev)
 {
 	blkid_tag_iterate	iter;
 	const char		*type, *value, *devname;
@@ -381,7 +396,9 @@ static void print_tags(const struct blkid_control *ctl, blkid_dev dev)
 	blkid_tag_iterate_end(iter);
 
 	if (num > 1) {
-		if (!(ctl->output & (OUTPUT_VALUE_ONLY | OUTPUT_UDEV_LIST |
+		if (ctl->output & OUTPUT_NDJSON)
+			ul_jsonwrt_root_close(&ctl->json);
+		else if (!(ctl->output & (OUTPUT_VALUE_ONLY | OUTPUT_UDEV_LIST |
 						OUTPUT_EXPORT_LIST)))
 			printf("\n");
 		first = 0;
@@ -559,8 +576,10 @@ static int lowprobe_device(blkid_probe pr, const char *devname,
 	if (first)
 		first = 0;
 
-	if (nvals >= 1 && !(ctl->output & (OUTPUT_VALUE_ONLY |
-					OUTPUT_UDEV_LIST | OUTPUT_EXPORT_LIST)))
+	if (num > 1 && (ctl->output & OUTPUT_NDJSON))
+		ul_jsonwrt_root_close(&ctl->json);
+	else if (nvals >= 1 && !(ctl->output & (OUTPUT_VALUE_ONLY |
+					OUTPUT_UDEV_LIST | OUTPUT_EXPORT_LIST | OUTPUT_NDJSON)))
 		printf("\n");
 done:
 	if (rc == -2) {
@@ -680,11 +699,15 @@ int main(int argc, char **argv)
 	unsigned int i;
 	int c;
 
+	enum {
+		OPT_STATS = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 		{ "cache-file",	      required_argument, NULL, 'c' },
 		{ "no-encoding",      no_argument,	 NULL, 'd' },
 		{ "no-part-details",  no_argument,       NULL, 'D' },
 		{ "garbage-collect",  no_argument,	 NULL, 'g' },
+		{ "jobs",	      required_argument, NULL, 'j' },
 		{ "output",	      required_argument, NULL, 'o' },
 		{ "list-filesystems", no_argument,	 NULL, 'k' },
 		{ "match-tag",	      required_argument, NULL, 's' },
@@ -699,6 +722,7 @@ int main(int argc, char **argv)
 		{ "offset",	      required_argument, NULL, 'O' },
 		{ "usages",	      required_argument, NULL, 'u' },
 		{ "match-types",      required_argument, NULL, 'n' },
+		{ "stats",	      optional_argument, NULL, OPT_STATS },
 		{ "version",	      no_argument,	 NULL, 'V' },
 		{ "help",	      no_argument,       NULL, 'h' },
 		{ NULL, 0, NULL, 0 }
@@ -718,7 +742,7 @@ int main(int argc, char **argv)
 	strutils_set_exitcode(BLKID_EXIT_OTHER);
 
 	while ((c = getopt_long (argc, argv,
-			    "c:DdgH:hilL:n:ko:O:ps:S:t:u:U:w:Vv", longopts, NULL)) != -1) {
+			    "c:DdgH:hij:lL:n:ko:O:ps:S:t:u:U:w:Vv", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, NULL, excl, excl_st);
 
@@ -760,6 +784,11 @@ int main(int argc, char **argv)
 		case 'g':
 			ctl.gc = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!ctl.jobs)
+				errx(BLKID_EXIT_OTHER, _("invalid jobs argument"));
+			break;
 		case 'k':
 		{
 			size_t idx = 0;
@@ -780,6 +809,8 @@ int main(int argc, char **argv)
 				ctl.output = OUTPUT_UDEV_LIST;
 			else if (!strcmp(optarg, "export"))
 				ctl.output = OUTPUT_EXPORT_LIST;
+			else if (!strcmp(optarg, "ndjson"))
+				ctl.output = OUTPUT_NDJSON;
 			else if (!strcmp(optarg, "full"))
 				ctl.output = 0;
 			else
@@ -824,6 +855,15 @@ int main(int argc, char **argv)
 		case 'w':
 			/* ignore - backward compatibility */
 			break;
+		case OPT_STATS:
+		{
+			int fmt = ul_stats_parse_format(optarg);
+
+			if (fmt < 0)
+				errx(BLKID_EXIT_OTHER, _("unsupported statistics format: %s"), optarg);
+			ul_stats_init(fmt);
+			break;
+		}
 		case 'h':
 			usage();
 			break;
@@ -834,6 +874,8 @@ int main(int argc, char **argv)
 
 	if (ctl.lowprobe_topology || ctl.lowprobe_superblocks)
 		ctl.lowprobe = 1;
+	if (ctl.output & OUTPUT_NDJSON)
+		ul_jsonwrt_init_compact(&ctl.json, stdout);
 
 	/* The rest of the args are device names */
 	if (optind < argc) {
@@ -894,6 +936,8 @@ int main(int argc, char **argv)
 		pretty_print_dev(NULL);
 	}
 
+	ul_stats_phase("probe");
+
 	if (ctl.lowprobe) {
 		/*
 		 * Low-level API
@@ -934,9 +978,15 @@ int main(int argc, char **argv)
 		}
 
 		for (i = 0; i < numdev; i++) {
-			err = lowprobe_device(pr, devices[i], &ctl);
-			if (err)
-				break;
+			int rc = lowprobe_device(pr, devices[i], &ctl);
+
+			/* ndjson output does not stop on the first failure */
+			if (!(ctl.output & OUTPUT_NDJSON)) {
+				err = rc;
+				if (err)
+					break;
+			} else if (i == 0 || (rc && !err))
+				err = rc;
 		}
 		blkid_free_probe(pr);
 	} else if (ctl.eval) {
@@ -972,8 +1022,12 @@ int main(int argc, char **argv)
 		blkid_dev_iterate	iter;
 		blkid_dev		dev;
 
-		blkid_probe_all(cache);
+		if (ctl.jobs > 1)
+			blkid_probe_all_parallel(cache, ctl.jobs);
+		else
+			blkid_probe_all(cache);
 
+		ul_stats_phase("print");
 		iter = blkid_dev_iterate_begin(cache);
 		blkid_dev_set_search(iter, search_type, search_value);
 		while (blkid_dev_next(iter, &dev) == 0) {
@@ -1000,6 +1054,7 @@ int main(int argc, char **argv)
 	}
 
 exit:
+	ul_stats_phase(NULL);
 	free(search_type);
 	free(search_value);
 	free_types_list(fltr_type);
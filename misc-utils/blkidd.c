@@ -0,0 +1,986 @@
+/*
+ * blkidd.c --- daemon to share blkid probing results
+ *
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * The daemon keeps libblkid cache in memory and answers NAME=value
+ * (LABEL, UUID, ...) queries from blkid_evaluate_tag(). The cached results
+ * are dropped when udev modifies /dev/disk/by-* symlinks or when a device
+ * node is added or removed from /dev. See include/blkidd.h for the protocol.
+ *
+ * The clients are served at once by one poll() loop, so a client which does
+ * not send its request does not block the others; it's dropped after
+ * BLKIDD_CLIENT_TIMEOUT. The tags are evaluated (and the devices probed) by
+ * a separate thread, the loop only queues the requests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include <blkid.h>
+
+#include "blkidd.h"
+#include "all-io.h"
+#include "c.h"
+#include "closestream.h"
+#include "strutils.h"
+#include "optutils.h"
+#include "nls.h"
+#include "monotonic.h"
+#include "xalloc.h"
+#include "list.h"
+
+#ifdef HAVE_LIBSYSTEMD
+# include <systemd/sd-daemon.h>
+#endif
+
+/* directories monitored by inotify to invalidate the cache */
+static const char *watched_dirs[] = {
+	"/dev",
+	"/dev/disk",
+	"/dev/disk/by-uuid",
+	"/dev/disk/by-label",
+	"/dev/disk/by-partuuid",
+	"/dev/disk/by-partlabel"
+};
+
+#define WATCHED_EVENTS	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* max. number of clients served at once, the oldest one is dropped when a
+ * new client does not fit */
+#define BLKIDD_MAX_CLIENTS	32
+
+/* request header: operation and data length */
+#define BLKIDD_HDRSZ	(sizeof(blkidd_prot_op_t) + sizeof(blkidd_prot_len_t))
+
+/* max. number of requests waiting for the evaluation thread, the next
+ * clients are disconnected (and libblkid evaluates the tags itself) */
+#define BLKIDD_MAX_QUEUE	256
+
+struct blkidd_client {
+	int		fd;		/* -1 for unused slot */
+	uid_t		uid;		/* SO_PEERCRED */
+	time_t		start;		/* accept() time, monotonic */
+	size_t		got;		/* received bytes */
+	char		buf[BLKIDD_HDRSZ + BLKIDD_MAX_DATA + 1];
+};
+
+/* request waiting for the evaluation thread */
+struct blkidd_request {
+	struct list_head	requests;
+	int			fd;		/* the client */
+	blkidd_prot_op_t	op;
+	blkidd_prot_len_t	len;
+	char			data[];		/* NUL terminated */
+};
+
+/* server loop control structure */
+struct blkidd_cxt_t {
+	const char	*cleanup_pidfile;
+	const char	*cleanup_socket;
+	uint32_t	timeout;
+
+	blkid_cache	cache;		/* in-memory cache, evaluation thread only */
+	int		inotify_fd;
+
+	pthread_mutex_t	lock;		/* protects queue and invalid */
+	pthread_cond_t	cond;		/* new request in the queue */
+	struct list_head queue;
+	size_t		nqueued;
+	int		invalid;	/* cache has to be dropped */
+
+	unsigned int	debug: 1,
+			quiet: 1,
+			no_fork: 1,
+			no_sock: 1;
+};
+
+struct blkidd_options_t {
+	const char	*pidfile_path;
+	const char	*socket_path;
+	const char	*tag;
+	unsigned int	do_kill:1,
+			do_invalidate:1,
+			no_pid:1,
+			s_flag:1;
+};
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	FILE *out = stdout;
+	fputs(USAGE_HEADER, out);
+	fprintf(out, _(" %s [options]\n"), program_invocation_short_name);
+	fputs(USAGE_SEPARATOR, out);
+	fputs(_("A daemon to share block device identification results.\n"), out);
+	fputs(USAGE_OPTIONS, out);
+	fputs(_(" -p, --pid <path>        path to pid file\n"), out);
+	fputs(_(" -s, --socket <path>     path to socket\n"), out);
+	fputs(_(" -T, --timeout <sec>     specify inactivity timeout\n"), out);
+	fputs(_(" -k, --kill              kill running daemon\n"), out);
+	fputs(_(" -t, --tag <NAME=value>  ask running daemon for device\n"), out);
+	fputs(_(" -i, --invalidate        ask running daemon to drop cached results\n"), out);
+	fputs(_(" -P, --no-pid            do not create pid file\n"), out);
+	fputs(_(" -F, --no-fork           do not daemonize using double-fork\n"), out);
+	fputs(_(" -S, --socket-activation do not create listening socket\n"), out);
+	fputs(_(" -d, --debug             run in debugging mode\n"), out);
+	fputs(_(" -q, --quiet             turn on quiet mode\n"), out);
+	fputs(USAGE_SEPARATOR, out);
+	printf(USAGE_HELP_OPTIONS(25));
+	printf(USAGE_MAN_TAIL("blkidd(8)"));
+	exit(EXIT_SUCCESS);
+}
+
+static void create_daemon(void)
+{
+	uid_t euid;
+
+	if (daemon(0, 0))
+		err(EXIT_FAILURE, "daemon");
+
+	euid = geteuid();
+	if (setreuid(euid, euid) < 0)
+		err(EXIT_FAILURE, "setreuid");
+}
+
+static int call_daemon(const char *socket_path, blkidd_prot_op_t op,
+		       const char *data, char *buf, size_t buflen,
+		       const char **err_context)
+{
+	blkidd_prot_len_t len = data ? strlen(data) : 0;
+	blkidd_prot_len_t reply_len = 0;
+	struct sockaddr_un srv_addr;
+	ssize_t ret;
+	int s;
+
+	if (len > BLKIDD_MAX_DATA) {
+		if (err_context)
+			*err_context = _("bad arguments");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		if (err_context)
+			*err_context = _("socket");
+		return -1;
+	}
+
+	srv_addr.sun_family = AF_UNIX;
+	assert(strlen(socket_path) < sizeof(srv_addr.sun_path));
+	xstrncpy(srv_addr.sun_path, socket_path, sizeof(srv_addr.sun_path));
+
+	if (connect(s, (const struct sockaddr *) &srv_addr,
+		    sizeof(struct sockaddr_un)) < 0) {
+		if (err_context)
+			*err_context = _("connect");
+		close(s);
+		return -1;
+	}
+
+	if (write_all(s, &op, sizeof(op)) != 0 ||
+	    write_all(s, &len, sizeof(len)) != 0 ||
+	    (len && write_all(s, data, len) != 0)) {
+		if (err_context)
+			*err_context = _("write");
+		close(s);
+		return -1;
+	}
+
+	ret = read_all(s, (char *) &reply_len, sizeof(reply_len));
+	if (ret != sizeof(reply_len)) {
+		if (err_context)
+			*err_context = _("read count");
+		close(s);
+		return -1;
+	}
+	if (reply_len < 0 && reply_len >= -4095) {
+		if (err_context)
+			*err_context = _("request refused");
+		close(s);
+		errno = -reply_len;
+		return -1;
+	}
+	if (reply_len < 0 || (size_t) reply_len > buflen) {
+		if (err_context)
+			*err_context = _("bad response length");
+		close(s);
+		return -1;
+	}
+	ret = read_all(s, buf, reply_len);
+	if (ret != reply_len) {
+		if (err_context)
+			*err_context = _("read");
+		ret = -1;
+	}
+	close(s);
+	return ret;
+}
+
+/*
+ * Exclusively create and open a pid file with path @pidfile_path
+ *
+ * Return file descriptor of the created pid_file.
+ */
+static int create_pidfile(struct blkidd_cxt_t *cxt, const char *pidfile_path)
+{
+	int		fd_pidfile;
+	struct flock	fl;
+
+	fd_pidfile = open(pidfile_path, O_CREAT | O_RDWR, 0664);
+	if (fd_pidfile < 0) {
+		if (!cxt->quiet)
+			warn(_("cannot open %s"), pidfile_path);
+		exit(EXIT_FAILURE);
+	}
+	cxt->cleanup_pidfile = pidfile_path;
+
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = 0;
+	fl.l_len = 0;
+	fl.l_pid = 0;
+	while (fcntl(fd_pidfile, F_SETLKW, &fl) < 0) {
+		if ((errno == EAGAIN) || (errno == EINTR))
+			continue;
+		if (!cxt->quiet)
+			warn(_("cannot lock %s"), pidfile_path);
+		exit(EXIT_FAILURE);
+	}
+
+	return fd_pidfile;
+}
+
+/*
+ * Create AF_UNIX, SOCK_STREAM socket and bind to @socket_path
+ *
+ * If @will_fork is true, then make sure the descriptor
+ * of the socket is >2, so that it won't be later closed
+ * during create_daemon().
+ */
+static int create_socket(struct blkidd_cxt_t *cxt,
+			 const char *socket_path, int will_fork)
+{
+	struct sockaddr_un	my_addr;
+	mode_t			save_umask;
+	int			s;
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		if (!cxt->quiet)
+			warn(_("couldn't create unix stream socket"));
+		exit(EXIT_FAILURE);
+	}
+
+	while (will_fork && s <= 2) {
+		s = dup(s);
+		if (s < 0)
+			err(EXIT_FAILURE, "dup");
+	}
+
+	my_addr.sun_family = AF_UNIX;
+	assert(strlen(socket_path) < sizeof(my_addr.sun_path));
+	xstrncpy(my_addr.sun_path, socket_path, sizeof(my_addr.sun_path));
+	unlink(socket_path);
+	/* everyone may ask, INVALIDATE is checked by SO_PEERCRED */
+	save_umask = umask(S_IXUSR | S_IXGRP | S_IXOTH);
+	if (bind(s, (const struct sockaddr *) &my_addr,
+		 sizeof(struct sockaddr_un)) < 0) {
+		if (!cxt->quiet)
+			warn(_("couldn't bind unix socket %s"), socket_path);
+		exit(EXIT_FAILURE);
+	}
+	umask(save_umask);
+	cxt->cleanup_socket = socket_path;
+
+	return s;
+}
+
+static void __attribute__((__noreturn__)) all_done(const struct blkidd_cxt_t *cxt, int ret)
+{
+	if (cxt->cleanup_pidfile)
+		unlink(cxt->cleanup_pidfile);
+	if (cxt->cleanup_socket)
+		unlink(cxt->cleanup_socket);
+	exit(ret);
+}
+
+static void handle_signal(const struct blkidd_cxt_t *cxt, int fd)
+{
+	struct signalfd_siginfo info;
+	ssize_t bytes;
+
+	bytes = read(fd, &info, sizeof(info));
+	if (bytes != sizeof(info)) {
+		if (errno == EAGAIN)
+			return;
+		warn(_("receiving signal failed"));
+		info.ssi_signo = 0;
+	}
+	if (info.ssi_signo == SIGPIPE)
+		return;		/* ignored */
+	all_done(cxt, EXIT_SUCCESS);
+}
+
+static void set_invalid(struct blkidd_cxt_t *cxt)
+{
+	pthread_mutex_lock(&cxt->lock);
+	cxt->invalid = 1;
+	pthread_mutex_unlock(&cxt->lock);
+}
+
+/* (re)adds watches; directories like /dev/disk/by-label may be created later */
+static void add_watches(struct blkidd_cxt_t *cxt)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(watched_dirs); i++) {
+		if (inotify_add_watch(cxt->inotify_fd, watched_dirs[i],
+				      WATCHED_EVENTS) < 0 && cxt->debug)
+			fprintf(stderr, _("cannot watch %s: %m\n"), watched_dirs[i]);
+	}
+}
+
+static void handle_inotify(struct blkidd_cxt_t *cxt)
+{
+	char buf[sizeof(struct inotify_event) + PATH_MAX]
+			__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	while (read(cxt->inotify_fd, buf, sizeof(buf)) > 0)
+		;
+	if (cxt->debug)
+		fprintf(stderr, _("devices changed, dropping cached results\n"));
+	set_invalid(cxt);
+	add_watches(cxt);
+}
+
+static blkid_cache get_cache(struct blkidd_cxt_t *cxt)
+{
+	int invalid;
+
+	pthread_mutex_lock(&cxt->lock);
+	invalid = cxt->invalid;
+	cxt->invalid = 0;
+	pthread_mutex_unlock(&cxt->lock);
+
+	if (cxt->cache && invalid) {
+		blkid_put_cache(cxt->cache);
+		cxt->cache = NULL;
+	}
+
+	/* in-memory only, the daemon does not write the cache file */
+	if (!cxt->cache && blkid_get_cache(&cxt->cache, "/dev/null") != 0) {
+		if (!cxt->quiet)
+			warnx(_("failed to allocate blkid cache"));
+		cxt->cache = NULL;
+	}
+	return cxt->cache;
+}
+
+static char *lookup(struct blkidd_cxt_t *cxt, blkid_cache cache, const char *tag)
+{
+	char *devname = cache ? blkid_get_devname(cache, tag, NULL) : NULL;
+
+	if (cxt->debug)
+		fprintf(stderr, _("evaluate %s: %s\n"), tag,
+				devname ? devname : _("not found"));
+	return devname;
+}
+
+static blkidd_prot_len_t evaluate(struct blkidd_cxt_t *cxt, const char *data,
+				  char *reply_buf, size_t bufsz)
+{
+	char *devname = lookup(cxt, get_cache(cxt), data);
+	blkidd_prot_len_t len = 0;
+
+	if (devname) {
+		len = strlen(devname) + 1;
+		if ((size_t) len > bufsz)
+			len = 0;
+		else
+			memcpy(reply_buf, devname, len);
+	}
+	free(devname);
+	return len;
+}
+
+/* replies a device name (or empty string) for every tag in @data */
+static blkidd_prot_len_t evaluate_all(struct blkidd_cxt_t *cxt, const char *data,
+				      size_t datasz, char *reply_buf, size_t bufsz)
+{
+	blkid_cache cache = get_cache(cxt);
+	const char *tag;
+	size_t ntags = 0, off = 0;
+
+	for (tag = data; tag < data + datasz; tag += strlen(tag) + 1)
+		ntags++;
+
+	for (tag = data; ntags > 0; tag += strlen(tag) + 1, ntags--) {
+		char *devname = lookup(cxt, cache, tag);
+		size_t len = devname ? strlen(devname) : 0;
+
+		/* keep space for the empty names of the other tags */
+		if (off + len + ntags > bufsz)
+			len = 0;
+		if (len)
+			memcpy(reply_buf + off, devname, len);
+		reply_buf[off + len] = '\0';
+		off += len + 1;
+		free(devname);
+	}
+	return off;
+}
+
+static void send_reply(struct blkidd_cxt_t *cxt, int fd,
+		       blkidd_prot_len_t reply_len, char *reply_buf)
+{
+	struct iovec iov[2];
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+	/* the reply is smaller than the socket buffer, the client which does
+	 * not read it is not waited for */
+	iov[0].iov_base = &reply_len;
+	iov[0].iov_len = sizeof(reply_len);
+	iov[1].iov_base = reply_buf;
+	iov[1].iov_len = reply_len > 0 ? (size_t) reply_len : 0;
+	if (sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 && cxt->debug)
+		fprintf(stderr, _("error writing to client\n"));
+}
+
+/*
+ * Evaluation thread -- the only user of the blkid cache. The clients which
+ * gave up in the meantime are not replied, but the results are cached for
+ * the next requests.
+ */
+static void *evaluate_thread(void *data)
+{
+	struct blkidd_cxt_t *cxt = (struct blkidd_cxt_t *) data;
+	char reply_buf[BLKIDD_MAX_DATA + 1];
+
+	while (1) {
+		struct blkidd_request *req;
+		blkidd_prot_len_t reply_len;
+
+		pthread_mutex_lock(&cxt->lock);
+		while (list_empty(&cxt->queue))
+			pthread_cond_wait(&cxt->cond, &cxt->lock);
+		req = list_entry(cxt->queue.next, struct blkidd_request, requests);
+		list_del(&req->requests);
+		cxt->nqueued--;
+		pthread_mutex_unlock(&cxt->lock);
+
+		if (req->op == BLKIDD_OP_EVALUATE_ALL)
+			reply_len = evaluate_all(cxt, req->data, req->len,
+						 reply_buf, BLKIDD_MAX_DATA);
+		else
+			reply_len = evaluate(cxt, req->data,
+					     reply_buf, BLKIDD_MAX_DATA);
+
+		send_reply(cxt, req->fd, reply_len, reply_buf);
+		close(req->fd);
+		free(req);
+	}
+	return NULL;
+}
+
+/* passes the client to the evaluation thread */
+static void queue_request(struct blkidd_cxt_t *cxt, struct blkidd_client *cl,
+			  blkidd_prot_op_t op)
+{
+	blkidd_prot_len_t len = cl->got - BLKIDD_HDRSZ;
+	struct blkidd_request *req;
+
+	pthread_mutex_lock(&cxt->lock);
+	if (cxt->nqueued >= BLKIDD_MAX_QUEUE) {
+		pthread_mutex_unlock(&cxt->lock);
+		if (cxt->debug)
+			fprintf(stderr, _("too many requests, dropping the client\n"));
+		return;
+	}
+
+	req = xmalloc(sizeof(*req) + len + 1);
+	req->fd = cl->fd;
+	req->op = op;
+	req->len = len;
+	memcpy(req->data, cl->buf + BLKIDD_HDRSZ, len + 1);
+
+	list_add_tail(&req->requests, &cxt->queue);
+	cxt->nqueued++;
+	pthread_cond_signal(&cxt->cond);
+	pthread_mutex_unlock(&cxt->lock);
+
+	cl->fd = -1;		/* owned by the request now */
+}
+
+static void client_close(struct blkidd_client *cl)
+{
+	if (cl->fd >= 0)
+		close(cl->fd);
+	cl->fd = -1;
+	cl->got = 0;
+}
+
+/* accepts a new client, the oldest one is dropped if there is no free slot */
+static struct blkidd_client *client_accept(struct blkidd_cxt_t *cxt, int s,
+					   struct blkidd_client *clients,
+					   size_t *nclients)
+{
+	struct blkidd_client *cl = NULL;
+	struct ucred cr;
+	socklen_t sz = sizeof(cr);
+	size_t i;
+	int ns;
+
+	ns = accept4(s, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (ns < 0) {
+		if (errno == EAGAIN || errno == EINTR || errno == ECONNABORTED)
+			return NULL;
+		err(EXIT_FAILURE, "accept");
+	}
+
+	for (i = 0; i < BLKIDD_MAX_CLIENTS; i++) {
+		if (clients[i].fd < 0) {
+			cl = &clients[i];
+			break;
+		}
+		if (!cl || clients[i].start < cl->start)
+			cl = &clients[i];
+	}
+	if (cl->fd >= 0) {
+		if (cxt->debug)
+			fprintf(stderr, _("too many clients, dropping the oldest one\n"));
+		client_close(cl);
+	} else
+		(*nclients)++;
+
+	cl->fd = ns;
+	cl->uid = (uid_t) -1;
+	if (getsockopt(ns, SOL_SOCKET, SO_PEERCRED, &cr, &sz) == 0)
+		cl->uid = cr.uid;
+	return cl;
+}
+
+/* returns size of the whole request, or -1 for invalid request */
+static ssize_t request_size(const struct blkidd_client *cl)
+{
+	blkidd_prot_len_t len;
+
+	if (cl->got < BLKIDD_HDRSZ)
+		return BLKIDD_HDRSZ;
+
+	memcpy(&len, cl->buf + sizeof(blkidd_prot_op_t), sizeof(len));
+	if (len < 0 || len > BLKIDD_MAX_DATA)
+		return -1;
+	return BLKIDD_HDRSZ + len;
+}
+
+/*
+ * Reads the available part of the request. Returns 1 if the request is
+ * complete, 0 if more data is expected, or -1 on error.
+ */
+static int client_read(struct blkidd_client *cl)
+{
+	ssize_t want = request_size(cl), ret;
+
+	if (want < 0)
+		return -1;
+
+	ret = read(cl->fd, cl->buf + cl->got, want - cl->got);
+	if (ret < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+	if (ret == 0)
+		return -1;
+	cl->got += ret;
+
+	want = request_size(cl);
+	if (want < 0)
+		return -1;
+	return cl->got == (size_t) want;
+}
+
+static void client_reply(struct blkidd_cxt_t *cxt, struct blkidd_client *cl,
+			 char *reply_buf, size_t bufsz)
+{
+	blkidd_prot_len_t reply_len;
+	blkidd_prot_op_t op;
+
+	memcpy(&op, cl->buf, sizeof(op));
+	cl->buf[cl->got] = '\0';
+
+	if (cxt->debug)
+		fprintf(stderr, _("operation %d\n"), op);
+
+	switch (op) {
+	case BLKIDD_OP_GETPID:
+		snprintf(reply_buf, bufsz, "%d", getpid());
+		reply_len = strlen(reply_buf) + 1;
+		break;
+	case BLKIDD_OP_EVALUATE:
+	case BLKIDD_OP_EVALUATE_ALL:
+		queue_request(cxt, cl, op);
+		return;
+	case BLKIDD_OP_INVALIDATE:
+		if (cl->uid != 0) {
+			if (cxt->debug)
+				fprintf(stderr, _("invalidate refused for UID %d\n"),
+						(int) cl->uid);
+			reply_len = -EPERM;
+			break;
+		}
+		set_invalid(cxt);
+		reply_len = 0;
+		break;
+	default:
+		if (cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), op);
+		return;
+	}
+
+	send_reply(cxt, cl->fd, reply_len, reply_buf);
+}
+
+static void server_loop(const char *socket_path, const char *pidfile_path,
+			struct blkidd_cxt_t *cxt)
+{
+	char			reply_buf[BLKIDD_MAX_DATA + 1];
+	struct blkidd_client	*clients;
+	size_t			i, nclients = 0;
+	int			s = 0, ret;
+	int			fd_pidfile = -1;
+	struct pollfd		pfd[3 + BLKIDD_MAX_CLIENTS];
+	sigset_t		sigmask;
+	int			sigfd;
+	pthread_t		thread;
+	enum {
+				POLLFD_SIGNAL = 0,
+				POLLFD_SOCKET,
+				POLLFD_INOTIFY,
+				POLLFD_CLIENTS		/* the first client */
+	};
+
+#ifdef HAVE_LIBSYSTEMD
+	if (!cxt->no_sock)	/* no_sock implies no_fork and no_pid */
+#endif
+	{
+		if (pidfile_path)
+			fd_pidfile = create_pidfile(cxt, pidfile_path);
+		ret = call_daemon(socket_path, BLKIDD_OP_GETPID, NULL, reply_buf,
+				  sizeof(reply_buf), NULL);
+		if (ret > 0) {
+			if (!cxt->quiet)
+				warnx(_("blkidd daemon is already running at pid %s"),
+					reply_buf);
+			exit(EXIT_FAILURE);
+		}
+
+		s = create_socket(cxt, socket_path,
+				  (!cxt->debug || !cxt->no_fork));
+		if (listen(s, SOMAXCONN) < 0) {
+			if (!cxt->quiet)
+				warn(_("couldn't listen on unix socket %s"), socket_path);
+			exit(EXIT_FAILURE);
+		}
+
+		if (!cxt->debug && !cxt->no_fork)
+			create_daemon();
+
+		if (pidfile_path) {
+			snprintf(reply_buf, sizeof(reply_buf), "%8d\n", getpid());
+			if (ftruncate(fd_pidfile, 0))
+				err(EXIT_FAILURE, _("could not truncate file: %s"), pidfile_path);
+			write_all(fd_pidfile, reply_buf, strlen(reply_buf));
+			if (fd_pidfile > 1 && close_fd(fd_pidfile) != 0)
+				err(EXIT_FAILURE, _("write failed: %s"), pidfile_path);
+		}
+	}
+
+#ifdef HAVE_LIBSYSTEMD
+	if (cxt->no_sock) {
+		const int r = sd_listen_fds(0);
+
+		if (r < 0) {
+			errno = r * -1;
+			err(EXIT_FAILURE, _("sd_listen_fds() failed"));
+		} else if (r == 0)
+			errx(EXIT_FAILURE,
+			     _("no file descriptors received, check systemctl status blkidd.socket"));
+		else if (1 < r)
+			errx(EXIT_FAILURE,
+			     _("too many file descriptors received, check blkidd.socket"));
+		s = SD_LISTEN_FDS_START + 0;
+	}
+#endif
+
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGHUP);
+	sigaddset(&sigmask, SIGINT);
+	sigaddset(&sigmask, SIGTERM);
+	sigaddset(&sigmask, SIGALRM);
+	sigaddset(&sigmask, SIGPIPE);
+	sigprocmask(SIG_BLOCK, &sigmask, NULL);
+	if ((sigfd = signalfd(-1, &sigmask, 0)) < 0)
+		err(EXIT_FAILURE, _("cannot set signal handler"));
+
+	cxt->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (cxt->inotify_fd < 0)
+		err(EXIT_FAILURE, _("cannot initialize inotify"));
+	add_watches(cxt);
+
+	/* the signals are blocked in the thread too */
+	pthread_mutex_init(&cxt->lock, NULL);
+	pthread_cond_init(&cxt->cond, NULL);
+	INIT_LIST_HEAD(&cxt->queue);
+	if (pthread_create(&thread, NULL, evaluate_thread, cxt) != 0)
+		err(EXIT_FAILURE, _("cannot create evaluation thread"));
+
+	pfd[POLLFD_SIGNAL].fd = sigfd;
+	pfd[POLLFD_SOCKET].fd = s;
+	pfd[POLLFD_INOTIFY].fd = cxt->inotify_fd;
+	pfd[POLLFD_SIGNAL].events = pfd[POLLFD_SOCKET].events =
+		pfd[POLLFD_INOTIFY].events = POLLIN | POLLERR | POLLHUP;
+
+	clients = xcalloc(BLKIDD_MAX_CLIENTS, sizeof(struct blkidd_client));
+	for (i = 0; i < BLKIDD_MAX_CLIENTS; i++) {
+		clients[i].fd = -1;
+		pfd[POLLFD_CLIENTS + i].fd = -1;	/* ignored by poll() */
+		pfd[POLLFD_CLIENTS + i].events = POLLIN;
+	}
+
+	while (1) {
+		struct timeval now;
+		int timeout = cxt->timeout ? (int) cxt->timeout * 1000 : -1;
+
+		/* wake up to drop the clients which don't send requests */
+		if (nclients && (timeout < 0 || timeout > 1000))
+			timeout = 1000;
+
+		ret = poll(pfd, ARRAY_SIZE(pfd), timeout);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			warn(_("poll failed"));
+			all_done(cxt, EXIT_FAILURE);
+		}
+		if (ret == 0 && !nclients) {	/* true when poll() times out */
+			if (cxt->debug)
+				fprintf(stderr, _("timeout [%d sec]\n"), cxt->timeout);
+			all_done(cxt, EXIT_SUCCESS);
+		}
+		if (pfd[POLLFD_SIGNAL].revents != 0)
+			handle_signal(cxt, sigfd);
+		if (pfd[POLLFD_INOTIFY].revents != 0)
+			handle_inotify(cxt);
+
+		gettime_monotonic(&now);
+
+		for (i = 0; i < BLKIDD_MAX_CLIENTS; i++) {
+			struct blkidd_client *cl = &clients[i];
+
+			if (cl->fd < 0)
+				continue;
+			ret = 0;
+			if (pfd[POLLFD_CLIENTS + i].revents != 0) {
+				ret = client_read(cl);
+				if (ret > 0)
+					client_reply(cxt, cl, reply_buf, sizeof(reply_buf));
+			}
+			if (ret == 0) {
+				if (now.tv_sec - cl->start < BLKIDD_CLIENT_TIMEOUT)
+					continue;	/* wait for the rest */
+				if (cxt->debug)
+					fprintf(stderr, _("client timeout\n"));
+			}
+
+			client_close(cl);
+			pfd[POLLFD_CLIENTS + i].fd = -1;
+			nclients--;
+		}
+
+		if (pfd[POLLFD_SOCKET].revents != 0) {
+			struct blkidd_client *cl = client_accept(cxt, s, clients, &nclients);
+
+			if (cl) {
+				cl->start = now.tv_sec;
+				pfd[POLLFD_CLIENTS + (cl - clients)].fd = cl->fd;
+			}
+		}
+	}
+}
+
+static void parse_options(int argc, char **argv, struct blkidd_cxt_t *cxt,
+			  struct blkidd_options_t *opts)
+{
+	const struct option longopts[] = {
+		{"pid", required_argument, NULL, 'p'},
+		{"socket", required_argument, NULL, 's'},
+		{"timeout", required_argument, NULL, 'T'},
+		{"kill", no_argument, NULL, 'k'},
+		{"tag", required_argument, NULL, 't'},
+		{"invalidate", no_argument, NULL, 'i'},
+		{"no-pid", no_argument, NULL, 'P'},
+		{"no-fork", no_argument, NULL, 'F'},
+		{"socket-activation", no_argument, NULL, 'S'},
+		{"debug", no_argument, NULL, 'd'},
+		{"quiet", no_argument, NULL, 'q'},
+		{"version", no_argument, NULL, 'V'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	const ul_excl_t excl[] = {
+		{ 'P', 'p' },
+		{ 'd', 'q' },
+		{ 'i', 'k', 't' },
+		{ 0 }
+	};
+	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "p:s:T:kt:iPFSdqVh", longopts, NULL)) != -1) {
+		err_exclusive_options(c, longopts, excl, excl_st);
+		switch (c) {
+		case 'd':
+			cxt->debug = 1;
+			break;
+		case 'i':
+			opts->do_invalidate = 1;
+			break;
+		case 'k':
+			opts->do_kill = 1;
+			break;
+		case 'p':
+			opts->pidfile_path = optarg;
+			break;
+		case 'P':
+			opts->no_pid = 1;
+			break;
+		case 'F':
+			cxt->no_fork = 1;
+			break;
+		case 'S':
+#ifdef HAVE_LIBSYSTEMD
+			cxt->no_sock = 1;
+			cxt->no_fork = 1;
+			opts->no_pid = 1;
+#else
+			errx(EXIT_FAILURE, _("blkidd has been built without "
+					     "support for socket activation"));
+#endif
+			break;
+		case 'q':
+			cxt->quiet = 1;
+			break;
+		case 's':
+			opts->socket_path = optarg;
+			opts->s_flag = 1;
+			break;
+		case 't':
+			if (!strchr(optarg, '='))
+				errx(EXIT_FAILURE, _("invalid tag: %s"), optarg);
+			opts->tag = optarg;
+			break;
+		case 'T':
+			cxt->timeout = strtou32_or_err(optarg,
+						_("failed to parse --timeout"));
+			break;
+
+		case 'V':
+			print_version(EXIT_SUCCESS);
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char	*err_context = NULL;
+	char		buf[BLKIDD_MAX_DATA + 1];
+	int		ret;
+
+	struct blkidd_cxt_t cxt = { .timeout = 0, .inotify_fd = -1 };
+	struct blkidd_options_t opts = { .socket_path = BLKIDD_SOCKET_PATH };
+
+	setlocale(LC_ALL, "");
+	bindtextdomain(PACKAGE, LOCALEDIR);
+	textdomain(PACKAGE);
+	close_stdout_atexit();
+
+	parse_options(argc, argv, &cxt, &opts);
+
+	if (strlen(opts.socket_path) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+		errx(EXIT_FAILURE, _("socket name too long: %s"), opts.socket_path);
+
+	if (!opts.no_pid && !opts.pidfile_path)
+		opts.pidfile_path = BLKIDD_PIDFILE_PATH;
+
+	/* the default directory does not have to exist yet */
+	if (!opts.tag && !opts.do_invalidate && !opts.do_kill &&
+	    !cxt.no_sock && !opts.s_flag &&
+	    mkdir(BLKIDD_DIR, 0755) != 0 && errno != EEXIST && !cxt.quiet)
+		warn(_("cannot create directory %s"), BLKIDD_DIR);
+
+	/* custom socket path and socket-activation make no sense */
+	if (opts.s_flag && cxt.no_sock && !cxt.quiet)
+		warnx(_("Both --socket-activation and --socket specified. "
+			"Ignoring --socket."));
+
+	if (opts.tag) {
+		ret = call_daemon(opts.socket_path, BLKIDD_OP_EVALUATE, opts.tag,
+				  buf, sizeof(buf), &err_context);
+		if (ret < 0)
+			err(EXIT_FAILURE, _("error calling blkidd daemon (%s)"),
+					err_context ? : _("unexpected error"));
+		if (ret == 0 || buf[ret - 1] != '\0')
+			return EXIT_FAILURE;
+		printf("%s\n", buf);
+		return EXIT_SUCCESS;
+	}
+
+	if (opts.do_invalidate) {
+		ret = call_daemon(opts.socket_path, BLKIDD_OP_INVALIDATE, NULL,
+				  buf, sizeof(buf), &err_context);
+		if (ret < 0)
+			err(EXIT_FAILURE, _("error calling blkidd daemon (%s)"),
+					err_context ? : _("unexpected error"));
+		return EXIT_SUCCESS;
+	}
+
+	if (opts.do_kill) {
+		ret = call_daemon(opts.socket_path, BLKIDD_OP_GETPID, NULL,
+				  buf, sizeof(buf), NULL);
+		if (0 < ret) {
+			pid_t pid;
+
+			pid = (pid_t)strtou32_or_err(buf, _("failed to parse pid"));
+			ret = kill(pid, SIGTERM);
+			if (ret < 0) {
+				if (!cxt.quiet)
+					warn(_("couldn't kill blkidd running "
+						  "at pid %d"), pid);
+				return EXIT_FAILURE;
+			}
+			if (!cxt.quiet)
+				printf(_("Killed blkidd running at pid %d.\n"), pid);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	server_loop(opts.socket_path, opts.pidfile_path, &cxt);
+	return EXIT_SUCCESS;
+}
@@ -25,12 +25,31 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <search.h>
+
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+/* the syscall numbers are the same on all architectures since v5.1 (except
+ * alpha), so cachestat() is usable also with old kernel headers */
+# if !defined(SYS_cachestat) && defined(__linux__) && !defined(__alpha__)
+#  define SYS_cachestat 451
+# endif
+# ifdef SYS_cachestat
+#  define USE_CACHESTAT 1
+# endif
+#endif
 
 #include "c.h"
 #include "nls.h"
 #include "closestream.h"
 #include "xalloc.h"
 #include "strutils.h"
+#include "monotonic.h"
+#include "optutils.h"
 
 #include "libsmartcols.h"
 
@@ -42,6 +61,23 @@
    e.g. 128MB on x86_64. ( = N_PAGES_IN_WINDOW * 4096 ). */
 #define N_PAGES_IN_WINDOW ((size_t)(32 * 1024))
 
+#ifdef USE_CACHESTAT
+/* the same as struct cachestat_range and struct cachestat from linux/mman.h
+ * (since Linux 6.5) */
+struct ul_cachestat_range {
+	uint64_t off;
+	uint64_t len;		/* 0 means to the end of the file */
+};
+#endif
+
+struct ul_cachestat {
+	uint64_t nr_cache;
+	uint64_t nr_dirty;
+	uint64_t nr_writeback;
+	uint64_t nr_evicted;
+	uint64_t nr_recently_evicted;
+};
+
 
 struct colinfo {
 	const char *name;
@@ -54,7 +90,15 @@ enum {
 	COL_PAGES,
 	COL_SIZE,
 	COL_FILE,
-	COL_RES
+	COL_RES,
+	COL_DIRTY_PAGES,
+	COL_DIRTY,
+	COL_WRITEBACK_PAGES,
+	COL_WRITEBACK,
+	COL_EVICTED_PAGES,
+	COL_EVICTED,
+	COL_RECENTLY_EVICTED_PAGES,
+	COL_RECENTLY_EVICTED
 };
 
 static struct colinfo infos[] = {
@@ -62,6 +106,14 @@ static struct colinfo infos[] = {
 	[COL_RES]    = { "RES",      5, SCOLS_FL_RIGHT, N_("file data resident in memory in bytes")},
 	[COL_SIZE]   = { "SIZE",     5, SCOLS_FL_RIGHT, N_("size of the file")},
 	[COL_FILE]   = { "FILE",     4, 0, N_("file name")},
+	[COL_DIRTY_PAGES] = { "DIRTY_PAGES", 1, SCOLS_FL_RIGHT, N_("number of dirty pages")},
+	[COL_DIRTY]  = { "DIRTY",    5, SCOLS_FL_RIGHT, N_("number of dirty bytes")},
+	[COL_WRITEBACK_PAGES] = { "WRITEBACK_PAGES", 1, SCOLS_FL_RIGHT, N_("number of pages marked for writeback")},
+	[COL_WRITEBACK] = { "WRITEBACK", 5, SCOLS_FL_RIGHT, N_("number of bytes marked for writeback")},
+	[COL_EVICTED_PAGES] = { "EVICTED_PAGES", 1, SCOLS_FL_RIGHT, N_("number of evicted pages")},
+	[COL_EVICTED] = { "EVICTED", 5, SCOLS_FL_RIGHT, N_("number of evicted bytes")},
+	[COL_RECENTLY_EVICTED_PAGES] = { "RECENTLY_EVICTED_PAGES", 1, SCOLS_FL_RIGHT, N_("number of recently evicted pages")},
+	[COL_RECENTLY_EVICTED] = { "RECENTLY_EVICTED", 5, SCOLS_FL_RIGHT, N_("number of recently evicted bytes")},
 };
 
 static int columns[ARRAY_SIZE(infos) * 2] = {-1};
@@ -72,10 +124,39 @@ struct fincore_control {
 
 	struct libscols_table *tb;		/* output */
 
+	size_t jobs;				/* --jobs threads */
+	int summary;				/* SUMMARY_* */
+	int no_cachestat;			/* cachestat() not supported, atomic */
+
+	int action;				/* ACTION_* */
+	uint64_t action_bytes;			/* processed by action, atomic */
+
 	unsigned int bytes : 1,
 		     noheadings : 1,
 		     raw : 1,
-		     json : 1;
+		     json : 1,
+		     recursive : 1;
+};
+
+enum {
+	SUMMARY_NONE = 0,
+	SUMMARY_DIR,		/* totals per directory (with subdirectories) */
+	SUMMARY_FS		/* totals per filesystem */
+};
+
+enum {
+	ACTION_NONE = 0,
+	ACTION_WARM,		/* read the files to page cache */
+	ACTION_EVICT		/* drop the clean pages from page cache */
+};
+
+/* per-file result */
+struct fincore_state {
+	const char *name;
+	struct stat stat;
+	struct ul_cachestat cstat;	/* only nr_cache without cachestat() */
+
+	unsigned int has_cstat : 1;	/* all the cstat counters are valid */
 };
 
 
@@ -106,14 +187,31 @@ static const struct colinfo *get_column_info(int num)
 	return &infos[ get_column_id(num) ];
 }
 
+static char *pages_to_string(struct fincore_control *ctl, uint64_t pages,
+			     int in_bytes)
+{
+	char *tmp;
+
+	if (!in_bytes)
+		xasprintf(&tmp, "%ju", (uintmax_t) pages);
+	else {
+		uintmax_t res = (uintmax_t) pages * ctl->pagesize;
+
+		if (ctl->bytes)
+			xasprintf(&tmp, "%ju", res);
+		else
+			tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, res);
+	}
+	return tmp;
+}
+
 static int add_output_data(struct fincore_control *ctl,
-			   const char *name,
-			   off_t file_size,
-			   off_t count_incore)
+			   struct fincore_state *st)
 {
 	size_t i;
 	char *tmp;
 	struct libscols_line *ln;
+	off_t file_size = st->stat.st_size;
 
 	assert(ctl);
 	assert(ctl->tb);
@@ -127,23 +225,46 @@ static int add_output_data(struct fincore_control *ctl,
 
 		switch(get_column_id(i)) {
 		case COL_FILE:
-			rc = scols_line_set_data(ln, i, name);
+			rc = scols_line_set_data(ln, i, st->name);
 			break;
 		case COL_PAGES:
-			xasprintf(&tmp, "%jd",  (intmax_t) count_incore);
+		case COL_RES:
+			tmp = pages_to_string(ctl, st->cstat.nr_cache,
+					      get_column_id(i) == COL_RES);
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
-		case COL_RES:
-		{
-			uintmax_t res = (uintmax_t) count_incore * ctl->pagesize;
-
-			if (ctl->bytes)
-				xasprintf(&tmp, "%ju", res);
-			else
-				tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, res);
+		case COL_DIRTY_PAGES:
+		case COL_DIRTY:
+			if (!st->has_cstat)
+				break;
+			tmp = pages_to_string(ctl, st->cstat.nr_dirty,
+					      get_column_id(i) == COL_DIRTY);
+			rc = scols_line_refer_data(ln, i, tmp);
+			break;
+		case COL_WRITEBACK_PAGES:
+		case COL_WRITEBACK:
+			if (!st->has_cstat)
+				break;
+			tmp = pages_to_string(ctl, st->cstat.nr_writeback,
+					      get_column_id(i) == COL_WRITEBACK);
+			rc = scols_line_refer_data(ln, i, tmp);
+			break;
+		case COL_EVICTED_PAGES:
+		case COL_EVICTED:
+			if (!st->has_cstat)
+				break;
+			tmp = pages_to_string(ctl, st->cstat.nr_evicted,
+					      get_column_id(i) == COL_EVICTED);
+			rc = scols_line_refer_data(ln, i, tmp);
+			break;
+		case COL_RECENTLY_EVICTED_PAGES:
+		case COL_RECENTLY_EVICTED:
+			if (!st->has_cstat)
+				break;
+			tmp = pages_to_string(ctl, st->cstat.nr_recently_evicted,
+					      get_column_id(i) == COL_RECENTLY_EVICTED);
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
-		}
 		case COL_SIZE:
 			if (ctl->bytes)
 				xasprintf(&tmp, "%jd", (intmax_t) file_size);
@@ -162,36 +283,75 @@ static int add_output_data(struct fincore_control *ctl,
 	return 0;
 }
 
+/* count the resident pages, only the least significant bit of each byte of
+ * the vector is defined; counts 8 pages by one popcount */
+static uint64_t count_resident(const unsigned char *vec, size_t n)
+{
+	uint64_t count = 0;
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+		uint64_t x;
+
+		memcpy(&x, vec + i, sizeof(x));
+		count += __builtin_popcountll(x & 0x0101010101010101ULL);
+	}
+	for (; i < n; i++)
+		count += vec[i] & 0x1;
+
+	return count;
+}
+
 static int do_mincore(struct fincore_control *ctl,
 		      void *window, const size_t len,
 		      const char *name,
-		      off_t *count_incore)
+		      void *data)
 {
-	static unsigned char vec[N_PAGES_IN_WINDOW];
-	int n = (len / ctl->pagesize) + ((len % ctl->pagesize)? 1: 0);
+	static __thread unsigned char vec[N_PAGES_IN_WINDOW];
+	size_t n = (len / ctl->pagesize) + ((len % ctl->pagesize)? 1: 0);
+	uint64_t *count_incore = data;
 
 	if (mincore (window, len, vec) < 0) {
 		warn(_("failed to do mincore: %s"), name);
 		return -errno;
 	}
 
-	while (n > 0)
-	{
-		if (vec[--n] & 0x1)
-		{
-			vec[n] = 0;
-			(*count_incore)++;
-		}
-	}
+	*count_incore += count_resident(vec, n);
+	return 0;
+}
 
+/* reads the window to page cache, returns after the pages are read */
+static int do_warm(struct fincore_control *ctl,
+		   void *window, const size_t len,
+		   const char *name,
+		   void *data __attribute__((__unused__)))
+{
+	const volatile unsigned char *p = window;
+	size_t i;
+
+#ifdef MADV_POPULATE_READ
+	if (madvise(window, len, MADV_POPULATE_READ) == 0)
+		return 0;
+	if (errno != EINVAL) {
+		warn(_("failed to populate pages: %s"), name);
+		return -errno;
+	}
+#endif
+	/* kernel without MADV_POPULATE_READ (since Linux 5.14) */
+	for (i = 0; i < len; i += ctl->pagesize)
+		(void) p[i];
 	return 0;
 }
 
-static int fincore_fd (struct fincore_control *ctl,
-		       int fd,
-		       const char *name,
-		       off_t file_size,
-		       off_t *count_incore)
+/* calls @fn for the file mapped by windows with protection @prot */
+static int for_each_window(struct fincore_control *ctl,
+			   int fd,
+			   const char *name,
+			   off_t file_size,
+			   int prot,
+			   int (*fn)(struct fincore_control *, void *,
+				     const size_t, const char *, void *),
+			   void *data)
 {
 	size_t window_size = N_PAGES_IN_WINDOW * ctl->pagesize;
 	off_t file_offset, len;
@@ -204,55 +364,597 @@ static int fincore_fd (struct fincore_control *ctl,
 		if (len >= (off_t) window_size)
 			len = window_size;
 
-		window = mmap(window, len, PROT_NONE, MAP_PRIVATE, fd, file_offset);
+		window = mmap(window, len, prot, MAP_PRIVATE, fd, file_offset);
 		if (window == MAP_FAILED) {
 			rc = -EINVAL;
 			warn(_("failed to do mmap: %s"), name);
 			break;
 		}
 
-		rc = do_mincore(ctl, window, len, name, count_incore);
+		rc = fn(ctl, window, len, name, data);
+		munmap (window, len);
 		if (rc)
 			break;
+	}
 
-		munmap (window, len);
+	return rc;
+}
+
+static int mincore_fd (struct fincore_control *ctl,
+		       int fd,
+		       const char *name,
+		       off_t file_size,
+		       uint64_t *count_incore)
+{
+	return for_each_window(ctl, fd, name, file_size, PROT_NONE,
+			       do_mincore, count_incore);
+}
+
+/*
+ * Warms up (--warm) or evicts (--evict) the file. Only the clean pages are
+ * evicted, the dirty pages stay in page cache until they are written back.
+ */
+static int action_fd(struct fincore_control *ctl,
+		     int fd,
+		     struct fincore_state *st)
+{
+	int rc = 0;
+
+	switch (ctl->action) {
+	case ACTION_WARM:
+		rc = for_each_window(ctl, fd, st->name, st->stat.st_size,
+				     PROT_READ, do_warm, NULL);
+		break;
+	case ACTION_EVICT:
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+		rc = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		if (rc) {
+			errno = rc;
+			warn(_("failed to evict: %s"), st->name);
+			rc = -rc;
+		}
+#endif
+		break;
+	default:
+		return 0;
 	}
 
+	if (rc == 0)
+		__atomic_add_fetch(&ctl->action_bytes, st->stat.st_size,
+				   __ATOMIC_RELAXED);
 	return rc;
 }
 
+#ifdef USE_CACHESTAT
+static inline int ul_cachestat(int fd, struct ul_cachestat_range *range,
+			       struct ul_cachestat *cstat, unsigned int flags)
+{
+	return syscall(SYS_cachestat, fd, range, cstat, flags);
+}
+#endif
+
+/*
+ * Uses cachestat() (since Linux 6.5), one syscall for the whole file, and
+ * falls back to mincore() on the mapped file.
+ */
+static int fincore_fd (struct fincore_control *ctl,
+		       int fd,
+		       struct fincore_state *st)
+{
+#ifdef USE_CACHESTAT
+	if (!__atomic_load_n(&ctl->no_cachestat, __ATOMIC_RELAXED)) {
+		struct ul_cachestat_range range = { 0, 0 };
+
+		if (ul_cachestat(fd, &range, &st->cstat, 0) == 0) {
+			st->has_cstat = 1;
+			return 0;
+		}
+		if (errno == ENOSYS)	/* don't try again */
+			__atomic_store_n(&ctl->no_cachestat, 1, __ATOMIC_RELAXED);
+		else if (errno != EOPNOTSUPP) {
+			warn(_("failed to do cachestat: %s"), st->name);
+			return -errno;
+		}
+	}
+#endif
+	return mincore_fd(ctl, fd, st->name, st->stat.st_size,
+			  &st->cstat.nr_cache);
+}
+
 /*
  * Returns: <0 on error, 0 success, 1 ignore.
  */
 static int fincore_name(struct fincore_control *ctl,
-			const char *name,
-			struct stat *sb,
-			off_t *count_incore)
+			struct fincore_state *st)
 {
 	int fd;
 	int rc = 0;
 
-	if ((fd = open (name, O_RDONLY)) < 0) {
-		warn(_("failed to open: %s"), name);
+	if ((fd = open (st->name, O_RDONLY)) < 0) {
+		warn(_("failed to open: %s"), st->name);
 		return -errno;
 	}
 
-	if (fstat (fd, sb) < 0) {
-		warn(_("failed to do fstat: %s"), name);
+	if (fstat (fd, &st->stat) < 0) {
+		warn(_("failed to do fstat: %s"), st->name);
 		close (fd);
 		return -errno;
 	}
 
-	if (S_ISDIR(sb->st_mode))
+	if (S_ISDIR(st->stat.st_mode))
 		rc = 1;			/* ignore */
 
-	else if (sb->st_size)
-		rc = fincore_fd(ctl, fd, name, sb->st_size, count_incore);
+	else if (st->stat.st_size) {
+		if (ctl->action)
+			rc = action_fd(ctl, fd, st);
+		if (rc == 0)
+			rc = fincore_fd(ctl, fd, st);
+	}
 
 	close (fd);
 	return rc;
 }
 
+/*
+ * Recursive mode (--recursive)
+ *
+ * The directories are read by --jobs threads from a shared stack of
+ * directories. The results are passed to the main thread, which owns the
+ * output table (or the summary trees) and prints the rows as they come, so
+ * the order of the rows is not stable with more threads.
+ */
+struct walk_entry {
+	char *name;
+	size_t rootlen;			/* length of the command line argument */
+	struct walk_entry *next;
+};
+
+struct walk_result {
+	struct fincore_state st;	/* st.name is allocated */
+	size_t rootlen;
+	int rc;				/* fincore_name() result */
+	unsigned int is_dir : 1;
+	struct walk_result *next;
+};
+
+struct fincore_walk {
+	struct fincore_control *ctl;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* new directories or results */
+
+	struct walk_entry *dirs;	/* directories to read */
+	size_t npending;		/* queued or being read directories */
+
+	struct walk_result *results;	/* for the main thread */
+	struct walk_result **results_tail;
+
+	void *totals;			/* tsearch() tree of struct fincore_state */
+	int rc;
+};
+
+static struct walk_result *new_result(char *name, size_t rootlen)
+{
+	struct walk_result *res = xcalloc(1, sizeof(*res));
+
+	res->st.name = name;
+	res->rootlen = rootlen;
+	return res;
+}
+
+static void free_result(struct walk_result *res)
+{
+	free((char *) res->st.name);
+	free(res);
+}
+
+/*
+ * Reads directory @ent. The subdirectories are returned in @dirs and the
+ * checked files (and the directory itself) in @results.
+ */
+static void walk_read_dir(struct fincore_control *ctl, struct walk_entry *ent,
+			  struct walk_entry **dirs, struct walk_result **results)
+{
+	struct walk_result *res;
+	struct dirent *d;
+	DIR *dir;
+	int fd;
+
+	fd = open(ent->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 || !(dir = fdopendir(fd))) {
+		warn(_("failed to open: %s"), ent->name);
+		if (fd >= 0)
+			close(fd);
+		res = new_result(xstrdup(ent->name), ent->rootlen);
+		res->rc = -errno;
+		res->next = *results;
+		*results = res;
+		return;
+	}
+
+	res = new_result(xstrdup(ent->name), ent->rootlen);
+	res->is_dir = 1;
+	if (fstat(fd, &res->st.stat) != 0)
+		res->rc = 1;	/* should not happen; ignore */
+	res->next = *results;
+	*results = res;
+
+	while ((d = readdir(dir))) {
+		struct stat sb;
+		char *name;
+
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+			continue;
+		if (d->d_type != DT_UNKNOWN && d->d_type != DT_DIR
+		    && d->d_type != DT_REG)
+			continue;
+		if (fstatat(fd, d->d_name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+			continue;	/* removed in the meantime */
+
+		xasprintf(&name, "%s%s%s", ent->name,
+			  ent->name[strlen(ent->name) - 1] == '/' ? "" : "/",
+			  d->d_name);
+
+		if (S_ISDIR(sb.st_mode)) {
+			struct walk_entry *sub = xcalloc(1, sizeof(*sub));
+
+			sub->name = name;
+			sub->rootlen = ent->rootlen;
+			sub->next = *dirs;
+			*dirs = sub;
+		} else if (S_ISREG(sb.st_mode)) {
+			res = new_result(name, ent->rootlen);
+			res->rc = fincore_name(ctl, &res->st);
+			res->next = *results;
+			*results = res;
+		} else
+			free(name);
+	}
+	closedir(dir);
+}
+
+/* adds results and subdirectories, called with locked walk->lock */
+static void walk_add(struct fincore_walk *walk, struct walk_entry *dirs,
+		     struct walk_result *results)
+{
+	while (dirs) {
+		struct walk_entry *next = dirs->next;
+
+		dirs->next = walk->dirs;
+		walk->dirs = dirs;
+		walk->npending++;
+		dirs = next;
+	}
+	while (results) {
+		struct walk_result *next = results->next;
+
+		results->next = NULL;
+		*walk->results_tail = results;
+		walk->results_tail = &results->next;
+		results = next;
+	}
+}
+
+static void *walk_worker(void *arg)
+{
+	struct fincore_walk *walk = arg;
+
+	pthread_mutex_lock(&walk->lock);
+	for (;;) {
+		struct walk_entry *ent, *dirs = NULL;
+		struct walk_result *results = NULL;
+
+		while (!walk->dirs && walk->npending)
+			pthread_cond_wait(&walk->cond, &walk->lock);
+		if (!walk->dirs)
+			break;		/* all done */
+
+		ent = walk->dirs;
+		walk->dirs = ent->next;
+		pthread_mutex_unlock(&walk->lock);
+
+		walk_read_dir(walk->ctl, ent, &dirs, &results);
+		free(ent->name);
+		free(ent);
+
+		pthread_mutex_lock(&walk->lock);
+		walk_add(walk, dirs, results);
+		walk->npending--;
+		pthread_cond_broadcast(&walk->cond);
+	}
+	pthread_mutex_unlock(&walk->lock);
+	return NULL;
+}
+
+static int cmp_totals_dir(const void *a, const void *b)
+{
+	return strcmp(((const struct fincore_state *) a)->name,
+		      ((const struct fincore_state *) b)->name);
+}
+
+static int cmp_totals_fs(const void *a, const void *b)
+{
+	dev_t x = ((const struct fincore_state *) a)->stat.st_dev,
+	      y = ((const struct fincore_state *) b)->stat.st_dev;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* returns the totals for @name (or @dev), creates a new if necessary */
+static struct fincore_state *get_total(struct fincore_walk *walk,
+				       const char *name, size_t namesz, dev_t dev)
+{
+	struct fincore_state key = { .name = NULL }, *tot, **node;
+	int (*cmp)(const void *, const void *) = cmp_totals_fs;
+	char *keyname = NULL;
+
+	if (walk->ctl->summary == SUMMARY_DIR) {
+		key.name = keyname = xstrndup(name, namesz);
+		cmp = cmp_totals_dir;
+	}
+	key.stat.st_dev = dev;
+
+	node = tfind(&key, &walk->totals, cmp);
+	if (node) {
+		free(keyname);
+		return *node;
+	}
+
+	tot = xcalloc(1, sizeof(*tot));
+	tot->name = keyname ? keyname : xstrndup(name, namesz);
+	tot->stat.st_dev = dev;
+	tot->has_cstat = 1;
+
+	if (!tsearch(tot, &walk->totals, cmp))
+		err(EXIT_FAILURE, _("failed to allocate summary"));
+	return tot;
+}
+
+static void add_to_total(struct fincore_state *tot, const struct fincore_state *st)
+{
+	tot->stat.st_size += st->stat.st_size;
+	tot->cstat.nr_cache += st->cstat.nr_cache;
+	tot->cstat.nr_dirty += st->cstat.nr_dirty;
+	tot->cstat.nr_writeback += st->cstat.nr_writeback;
+	tot->cstat.nr_evicted += st->cstat.nr_evicted;
+	tot->cstat.nr_recently_evicted += st->cstat.nr_recently_evicted;
+	tot->has_cstat &= st->has_cstat;
+}
+
+/* returns length of the parent directory path of @name with length @len */
+static size_t parent_len(const char *name, size_t len)
+{
+	while (len > 0 && name[len - 1] != '/')
+		len--;
+	if (len > 1)
+		len--;		/* not for "/" */
+	return len;
+}
+
+/* adds the file to the totals of all directories up to the root */
+static void add_to_dir_totals(struct fincore_walk *walk, struct walk_result *res)
+{
+	const char *name = res->st.name;
+	size_t len = strlen(name);
+
+	if (res->is_dir) {
+		get_total(walk, name, len, 0);	/* empty directories too */
+		return;
+	}
+	if (len <= res->rootlen) {
+		/* file on command line */
+		add_output_data(walk->ctl, &res->st);
+		return;
+	}
+	do {
+		len = parent_len(name, len);
+		add_to_total(get_total(walk, name, len, 0), &res->st);
+	} while (len > res->rootlen);
+}
+
+static void add_to_fs_totals(struct fincore_walk *walk, struct walk_result *res)
+{
+	const char *name = res->st.name;
+	struct fincore_state *tot = get_total(walk, name, strlen(name),
+					      res->st.stat.st_dev);
+
+	/* the filesystem is named by the top-most directory */
+	if (res->is_dir && (strlen(name) < strlen(tot->name)
+			    || (strlen(name) == strlen(tot->name)
+				&& strcmp(name, tot->name) < 0))) {
+		free((char *) tot->name);
+		tot->name = xstrdup(name);
+	}
+	if (!res->is_dir)
+		add_to_total(tot, &res->st);
+}
+
+/* handles the results in the main thread */
+static void walk_output(struct fincore_walk *walk, struct walk_result *res)
+{
+	while (res) {
+		struct walk_result *next = res->next;
+
+		if (res->rc < 0)
+			walk->rc = EXIT_FAILURE;
+		else if (res->rc == 0 || res->is_dir) {
+			switch (walk->ctl->summary) {
+			case SUMMARY_DIR:
+				add_to_dir_totals(walk, res);
+				break;
+			case SUMMARY_FS:
+				add_to_fs_totals(walk, res);
+				break;
+			default:
+				if (!res->is_dir)
+					add_output_data(walk->ctl, &res->st);
+				break;
+			}
+		}
+		free_result(res);
+		res = next;
+	}
+}
+
+/* checks the file @name given on command line */
+static void walk_file(struct fincore_walk *walk, const char *name)
+{
+	struct walk_result *res = new_result(xstrdup(name), strlen(name));
+
+	res->rc = fincore_name(walk->ctl, &res->st);
+	walk_output(walk, res);
+}
+
+/* checks all files in the directory @name given on command line */
+static void walk_dir(struct fincore_walk *walk, const char *name)
+{
+	struct fincore_control *ctl = walk->ctl;
+	struct walk_entry *ent = xcalloc(1, sizeof(*ent));
+	pthread_t *threads = NULL;
+	size_t i, nthreads = 0;
+
+	ent->name = xstrdup(name);
+	ent->rootlen = strlen(ent->name);
+	while (ent->rootlen > 1 && ent->name[ent->rootlen - 1] == '/')
+		ent->name[--ent->rootlen] = '\0';
+
+	pthread_mutex_lock(&walk->lock);
+	walk_add(walk, ent, NULL);
+
+	if (ctl->jobs > 1) {
+		threads = xcalloc(ctl->jobs, sizeof(pthread_t));
+		for (i = 0; i < ctl->jobs; i++) {
+			if (pthread_create(&threads[nthreads], NULL,
+					   walk_worker, walk) != 0) {
+				warn(_("failed to create thread"));
+				break;
+			}
+			nthreads++;
+		}
+	}
+
+	while (walk->npending || walk->results) {
+		struct walk_result *res = walk->results;
+
+		if (res) {
+			walk->results = NULL;
+			walk->results_tail = &walk->results;
+			pthread_mutex_unlock(&walk->lock);
+
+			walk_output(walk, res);
+
+			pthread_mutex_lock(&walk->lock);
+		} else if (nthreads)
+			pthread_cond_wait(&walk->cond, &walk->lock);
+		else {
+			/* no threads, read the directories in this thread */
+			struct walk_entry *dirs = NULL;
+			struct walk_result *results = NULL;
+
+			ent = walk->dirs;
+			walk->dirs = ent->next;
+			walk_read_dir(ctl, ent, &dirs, &results);
+			free(ent->name);
+			free(ent);
+			walk_add(walk, dirs, results);
+			walk->npending--;
+		}
+	}
+	pthread_mutex_unlock(&walk->lock);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+static struct fincore_control *totals_ctl;
+
+static void totals_output(const void *nodep, const VISIT which,
+			  const int depth __attribute__((__unused__)))
+{
+	if (which == postorder || which == leaf)
+		add_output_data(totals_ctl, *(struct fincore_state **) nodep);
+}
+
+static void free_total(void *data)
+{
+	struct fincore_state *tot = data;
+
+	free((char *) tot->name);
+	free(tot);
+}
+
+/*
+ * Checks the files and directories from command line.
+ *
+ * Returns: EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int fincore_walk(struct fincore_control *ctl, char **names, size_t nnames)
+{
+	struct fincore_walk walk = {
+		.ctl = ctl,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.rc = EXIT_SUCCESS
+	};
+	size_t i;
+
+	walk.results_tail = &walk.results;
+
+	for (i = 0; i < nnames; i++) {
+		struct stat sb;
+
+		if (ctl->recursive && stat(names[i], &sb) == 0
+		    && S_ISDIR(sb.st_mode))
+			walk_dir(&walk, names[i]);
+		else
+			walk_file(&walk, names[i]);
+	}
+
+	if (walk.totals) {
+		totals_ctl = ctl;
+		twalk(walk.totals, totals_output);
+		tdestroy(walk.totals, free_total);
+	}
+	return walk.rc;
+}
+
+static char *bytes_to_string(struct fincore_control *ctl, uint64_t bytes)
+{
+	char *tmp;
+
+	if (ctl->bytes)
+		xasprintf(&tmp, "%ju", (uintmax_t) bytes);
+	else
+		tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, bytes);
+	return tmp;
+}
+
+/* prints the throughput of --warm or --evict since @start to stderr */
+static void action_report(struct fincore_control *ctl, struct timeval *start)
+{
+	struct timeval end, delta;
+	uint64_t bytes = __atomic_load_n(&ctl->action_bytes, __ATOMIC_RELAXED);
+	double sec;
+	char *size, *rate;
+
+	gettime_monotonic(&end);
+	timersub(&end, start, &delta);
+	sec = delta.tv_sec + delta.tv_usec / 1000000.0;
+
+	size = bytes_to_string(ctl, bytes);
+	rate = bytes_to_string(ctl, sec > 0 ? (uint64_t) (bytes / sec) : bytes);
+
+	if (ctl->action == ACTION_WARM)
+		fprintf(stderr, _("warmed %s in %.3f seconds (%s/s)\n"),
+			size, sec, rate);
+	else
+		fprintf(stderr, _("evicted %s in %.3f seconds (%s/s)\n"),
+			size, sec, rate);
+	free(size);
+	free(rate);
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -267,6 +969,11 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -n, --noheadings      don't print headings\n"), out);
 	fputs(_(" -o, --output <list>   output columns\n"), out);
 	fputs(_(" -r, --raw             use raw output format\n"), out);
+	fputs(_(" -R, --recursive       check all files in directories recursively\n"), out);
+	fputs(_(" -j, --jobs <num>      number of threads to read directories\n"), out);
+	fputs(_(" -s, --summary <mode>  print totals per directory (dir) or filesystem (fs)\n"), out);
+	fputs(_(" -w, --warm            read the files to page cache before counting\n"), out);
+	fputs(_(" -e, --evict           drop the files from page cache before counting\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(23));
@@ -285,11 +992,13 @@ int main(int argc, char ** argv)
 {
 	int c;
 	size_t i;
-	int rc = EXIT_SUCCESS;
+	int rc;
 	char *outarg = NULL;
+	struct timeval start;
 
 	struct fincore_control ctl = {
-		.pagesize = getpagesize()
+		.pagesize = getpagesize(),
+		.jobs = 1
 	};
 
 	static const struct option longopts[] = {
@@ -300,15 +1009,29 @@ int main(int argc, char ** argv)
 		{ "help",	no_argument, NULL, 'h' },
 		{ "json",       no_argument, NULL, 'J' },
 		{ "raw",        no_argument, NULL, 'r' },
+		{ "recursive",  no_argument, NULL, 'R' },
+		{ "jobs",       required_argument, NULL, 'j' },
+		{ "summary",    required_argument, NULL, 's' },
+		{ "warm",       no_argument, NULL, 'w' },
+		{ "evict",      no_argument, NULL, 'e' },
 		{ NULL, 0, NULL, 0 },
 	};
 
+	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
+		{ 'e', 'w' },
+		{ 0 }
+	};
+	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
+
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long (argc, argv, "bno:JrVh", longopts, NULL)) != -1) {
+	while ((c = getopt_long (argc, argv, "bej:no:JrRs:wVh", longopts, NULL)) != -1) {
+
+		err_exclusive_options(c, longopts, excl, excl_st);
+
 		switch (c) {
 		case 'b':
 			ctl.bytes = 1;
@@ -325,6 +1048,32 @@ int main(int argc, char ** argv)
 		case 'r':
 			ctl.raw = 1;
 			break;
+		case 'R':
+			ctl.recursive = 1;
+			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
+		case 's':
+			if (strcmp(optarg, "dir") == 0)
+				ctl.summary = SUMMARY_DIR;
+			else if (strcmp(optarg, "fs") == 0)
+				ctl.summary = SUMMARY_FS;
+			else
+				errx(EXIT_FAILURE, _("unsupported summary mode: %s"), optarg);
+			break;
+		case 'w':
+			ctl.action = ACTION_WARM;
+			break;
+		case 'e':
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+			ctl.action = ACTION_EVICT;
+			break;
+#else
+			errx(EXIT_FAILURE, _("--evict is not supported on this system"));
+#endif
 		case 'V':
 			print_version(EXIT_SUCCESS);
 		case 'h':
@@ -361,6 +1110,12 @@ int main(int argc, char ** argv)
 	if (ctl.json)
 		scols_table_set_name(ctl.tb, "fincore");
 
+	/* don't keep rows of all files in memory */
+	if (ctl.recursive && !ctl.summary) {
+		scols_table_enable_streaming(ctl.tb, 1);
+		scols_table_set_streaming_sample(ctl.tb, 64);
+	}
+
 	for (i = 0; i < ncolumns; i++) {
 		const struct colinfo *col = get_column_info(i);
 		struct libscols_column *cl;
@@ -378,6 +1133,10 @@ int main(int argc, char ** argv)
 				break;
 			case COL_SIZE:
 			case COL_RES:
+			case COL_DIRTY:
+			case COL_WRITEBACK:
+			case COL_EVICTED:
+			case COL_RECENTLY_EVICTED:
 				if (!ctl.bytes)
 					break;
 				/* fallthrough */
@@ -388,25 +1147,14 @@ int main(int argc, char ** argv)
 		}
 	}
 
-	for(; optind < argc; optind++) {
-		char *name = argv[optind];
-		struct stat sb;
-		off_t count_incore = 0;
-
-		switch (fincore_name(&ctl, name, &sb, &count_incore)) {
-		case 0:
-			add_output_data(&ctl, name, sb.st_size, count_incore);
-			break;
-		case 1:
-			break; /* ignore */
-		default:
-			rc = EXIT_FAILURE;
-			break;
-		}
-	}
+	gettime_monotonic(&start);
+	rc = fincore_walk(&ctl, argv + optind, argc - optind);
 
 	scols_print_table(ctl.tb);
 	scols_unref_table(ctl.tb);
 
+	if (ctl.action)
+		action_report(&ctl, &start);
+
 	return rc;
 }
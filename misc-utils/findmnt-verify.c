@@ -16,17 +16,35 @@
 #include "xalloc.h"
 #include "pathnames.h"
 #include "match.h"
+#include "procsnap.h"
+#include "jobs.h"
 
 #include "findmnt.h"
 
+/* on-disk FS type probed in advance by verify_prefetch() */
+struct verify_probe {
+	const char	*devname;	/* resolved source, owned by the cache */
+	char		*type;
+	int		ambi;
+	int		errsv;		/* errno from the probe */
+};
+
+struct verify_prefetch {
+	struct verify_probe	*probes;	/* sorted by devname */
+	size_t			nprobes;
+	size_t			next;		/* next probe for workers */
+};
+
 struct verify_context {
 	struct libmnt_fs	*fs;
 	struct libmnt_table	*tb;
 
-	char	**fs_ary;
+	char	**fs_ary;	/* sorted, see sort_filesystems() */
 	size_t	fs_num;
 	size_t  fs_alloc;
 
+	struct verify_prefetch	pf;
+
 	int	nwarnings;
 	int	nerrors;
 
@@ -277,6 +295,29 @@ static int verify_swaparea(struct verify_context *vfy)
 	return 0;
 }
 
+static int cmp_filesystems(const void *a, const void *b)
+{
+	return strcasecmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* sorts the list for is_supported_filesystem() and removes duplicates */
+static void sort_filesystems(struct verify_context *vfy)
+{
+	size_t i, n = 0;
+
+	if (!vfy->fs_num)
+		return;
+
+	qsort(vfy->fs_ary, vfy->fs_num, sizeof(char *), cmp_filesystems);
+	for (i = 1; i < vfy->fs_num; i++) {
+		if (strcasecmp(vfy->fs_ary[n], vfy->fs_ary[i]) == 0)
+			free(vfy->fs_ary[i]);
+		else
+			vfy->fs_ary[++n] = vfy->fs_ary[i];
+	}
+	vfy->fs_num = n + 1;
+}
+
 static int is_supported_filesystem(struct verify_context *vfy, const char *name)
 {
 	size_t n;
@@ -284,6 +325,12 @@ static int is_supported_filesystem(struct verify_context *vfy, const char *name)
 	if (!vfy->fs_num)
 		return 0;
 
+	/* simple name */
+	if (!strchr(name, ',') && strncmp(name, "no", 2) != 0)
+		return bsearch(&name, vfy->fs_ary, vfy->fs_num,
+				sizeof(char *), cmp_filesystems) != NULL;
+
+	/* list of names or negated list */
 	for (n = 0; n < vfy->fs_num; n++ ) {
 		if (match_fstype(vfy->fs_ary[n], name))
 			return 1;
@@ -296,11 +343,8 @@ static int add_filesystem(struct verify_context *vfy, const char *name)
 {
 	#define MYCHUNK	16
 
-	if (is_supported_filesystem(vfy, name))
-		return 0;
-
-	if (vfy->fs_alloc == 0 || vfy->fs_num + 1 <= vfy->fs_alloc) {
-		vfy->fs_alloc = ((vfy->fs_alloc + 1 + MYCHUNK) / MYCHUNK) * MYCHUNK;
+	if (vfy->fs_num == vfy->fs_alloc) {
+		vfy->fs_alloc += MYCHUNK;
 		vfy->fs_ary = xrealloc(vfy->fs_ary, vfy->fs_alloc * sizeof(char *));
 	}
 
@@ -316,7 +360,7 @@ static int read_proc_filesystems(struct verify_context *vfy)
 	FILE *f;
 	char buf[80], *cp, *t;
 
-	f = fopen("/proc/filesystems", "r");
+	f = ul_procsnap_fopen(_PATH_PROC_FILESYSTEMS);
 	if (!f)
 		return -errno;
 
@@ -407,11 +451,103 @@ static int read_kernel_filesystems(struct verify_context *vfy)
 	return rc;
 }
 
+static int cmp_probes(const void *a, const void *b)
+{
+	return strcmp(((const struct verify_probe *) a)->devname,
+		      ((const struct verify_probe *) b)->devname);
+}
+
+static struct verify_probe *find_probe(struct verify_context *vfy, const char *devname)
+{
+	struct verify_probe key = { .devname = devname };
+
+	if (!vfy->pf.nprobes)
+		return NULL;
+	return bsearch(&key, vfy->pf.probes, vfy->pf.nprobes,
+			sizeof(struct verify_probe), cmp_probes);
+}
+
+static void *prefetch_worker(void *arg)
+{
+	struct verify_prefetch *pf = arg;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&pf->next, 1, __ATOMIC_RELAXED)) < pf->nprobes) {
+		struct verify_probe *pr = &pf->probes[i];
+
+		/* without cache, the libmount cache is not thread-safe */
+		errno = 0;
+		pr->type = mnt_get_fstype(pr->devname, &pr->ambi, NULL);
+		pr->errsv = errno;
+	}
+	return NULL;
+}
+
+/*
+ * Probes the on-disk FS types of all the sources by @njobs threads, the
+ * results are used by verify_fstype(). The LABEL= and UUID= are resolved by
+ * one libblkid call, the messages are still printed in the fstab order.
+ */
+static void verify_prefetch(struct verify_context *vfy, unsigned int njobs)
+{
+	struct verify_prefetch *pf = &vfy->pf;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	size_t i, n;
+
+	mnt_cache_resolve_tags(cache, vfy->tb);
+
+	if (njobs < 2)
+		return;
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		return;
+
+	while (mnt_table_next_fs(vfy->tb, itr, &fs) == 0) {
+		const char *src;
+
+		if (mnt_fs_is_pseudofs(fs) || mnt_fs_is_netfs(fs))
+			continue;
+		src = mnt_resolve_spec(mnt_fs_get_source(fs), cache);
+		if (!src)
+			continue;
+		if (pf->nprobes % 64 == 0)
+			pf->probes = xrealloc(pf->probes,
+				(pf->nprobes + 64) * sizeof(struct verify_probe));
+		memset(&pf->probes[pf->nprobes], 0, sizeof(struct verify_probe));
+		pf->probes[pf->nprobes++].devname = src;
+	}
+	mnt_free_iter(itr);
+
+	if (!pf->nprobes)
+		return;
+
+	/* remove duplicates */
+	qsort(pf->probes, pf->nprobes, sizeof(struct verify_probe), cmp_probes);
+	for (i = 1, n = 0; i < pf->nprobes; i++) {
+		if (strcmp(pf->probes[n].devname, pf->probes[i].devname) != 0)
+			pf->probes[++n] = pf->probes[i];
+	}
+	pf->nprobes = n + 1;
+
+	ul_run_jobs(min((size_t) njobs, pf->nprobes), prefetch_worker, pf, 0);
+}
+
+static void free_prefetch(struct verify_context *vfy)
+{
+	size_t i;
+
+	for (i = 0; i < vfy->pf.nprobes; i++)
+		free(vfy->pf.probes[i].type);
+	free(vfy->pf.probes);
+}
+
 static int verify_fstype(struct verify_context *vfy)
 {
 	char *src = mnt_resolve_spec(mnt_fs_get_source(vfy->fs), cache);
 	char *realtype = NULL;
 	const char *type;
+	struct verify_probe *probe = NULL;
 	int ambi = 0, isauto = 0, isswap = 0;
 
 	if (!src)
@@ -445,8 +581,15 @@ static int verify_fstype(struct verify_context *vfy)
 			verify_warn(vfy, _("%s seems unsupported by the current kernel"), type);
 	}
 
-	errno = 0;
-	realtype = mnt_get_fstype(src, &ambi, cache);
+	probe = find_probe(vfy, src);
+	if (probe) {
+		realtype = probe->type;
+		ambi = probe->ambi;
+		errno = probe->errsv;
+	} else {
+		errno = 0;
+		realtype = mnt_get_fstype(src, &ambi, cache);
+	}
 
 	if (!realtype) {
 		const char *reson = errno ? strerror(errno) : _("reason unknown");
@@ -478,7 +621,8 @@ static int verify_fstype(struct verify_context *vfy)
 done:
 	if (!cache) {
 		free(src);
-		free(realtype);
+		if (!probe)
+			free(realtype);
 	}
 	return 0;
 }
@@ -516,7 +660,7 @@ static int verify_filesystem(struct verify_context *vfy)
 	return rc;
 }
 
-int verify_table(struct libmnt_table *tb)
+int verify_table(struct libmnt_table *tb, unsigned int njobs)
 {
 	struct verify_context vfy = { .nerrors = 0 };
 	struct libmnt_iter *itr;
@@ -535,9 +679,13 @@ int verify_table(struct libmnt_table *tb)
 	if (has_read_fs == 0) {
 		read_proc_filesystems(&vfy);
 		read_kernel_filesystems(&vfy);
+		sort_filesystems(&vfy);
 		has_read_fs = 1;
 	}
 
+	if (check_order && cache)
+		verify_prefetch(&vfy, njobs);
+
 	while (rc == 0 && (vfy.fs = get_next_fs(tb, itr))) {
 		vfy.target_printed = 0;
 		vfy.no_fsck = 0;
@@ -580,6 +728,7 @@ done:
 
 
 	free_proc_filesystems(&vfy);
+	free_prefetch(&vfy);
 
 	return rc != 0 ? rc : vfy.nerrors + parse_nerrors;
 }
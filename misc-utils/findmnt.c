@@ -48,6 +48,8 @@
 #include "optutils.h"
 #include "mangle.h"
 #include "buffer.h"
+#include "ulstats.h"
+#include "jsonwrt.h"
 
 #include "findmnt.h"
 
@@ -793,6 +795,7 @@ static struct libscols_line *add_line(struct libscols_table *table, struct libmn
 	}
 
 	scols_line_set_userdata(line, fs);
+	mnt_fs_set_userdata(fs, line);
 	return line;
 }
 
@@ -814,25 +817,11 @@ static struct libscols_line *add_tabdiff_line(struct libscols_table *table, stru
 	return line;
 }
 
-static int has_line(struct libscols_table *table, struct libmnt_fs *fs)
+/* add_line() links @fs with the output line */
+static int has_line(struct libscols_table *table __attribute__((__unused__)),
+		    struct libmnt_fs *fs)
 {
-	struct libscols_line *ln;
-	struct libscols_iter *itr;
-	int rc = 0;
-
-	itr = scols_new_iter(SCOLS_ITER_FORWARD);
-	if (!itr)
-		return 0;
-
-	while (scols_table_next_line(table, itr, &ln) == 0) {
-		if ((struct libmnt_fs *) scols_line_get_userdata(ln) == fs) {
-			rc = 1;
-			break;
-		}
-	}
-
-	scols_free_iter(itr);
-	return rc;
+	return mnt_fs_get_userdata(fs) != NULL;
 }
 
 /* reads filesystems from @tb (libmount) and fillin @table (output table) */
@@ -848,6 +837,8 @@ static int create_treenode(struct libscols_table *table, struct libmnt_table *tb
 		/* first call, get root FS */
 		if (mnt_table_get_root_fs(tb, &fs))
 			goto leave;
+		if (mnt_table_build_tree(tb))
+			goto leave;
 		parent_line = NULL;
 		first = 1;
 
@@ -928,6 +919,7 @@ static struct libmnt_table *parse_tabfiles(char **files,
 		return NULL;
 	}
 	mnt_table_set_parser_errcb(tb, parser_errcb);
+	mnt_table_enable_arena(tb, 1);
 
 	do {
 		/* NULL means that libmount will use default paths */
@@ -941,6 +933,14 @@ static struct libmnt_table *parse_tabfiles(char **files,
 			rc = mnt_table_parse_mtab(tb, path);
 			break;
 		case TABTYPE_KERNEL:
+			if (!path && (flags & FL_LISTMOUNT)) {
+				rc = mnt_table_fetch_listmount(tb);
+				if (rc != -ENOSYS) {
+					path = "listmount";
+					break;
+				}
+				rc = 0;		/* fallback to mountinfo */
+			}
 			if (!path)
 				path = access(_PATH_PROC_MOUNTINFO, R_OK) == 0 ?
 					      _PATH_PROC_MOUNTINFO :
@@ -1030,12 +1030,12 @@ static int match_func(struct libmnt_fs *fs,
 	const char *m;
 	void *md;
 
-	m = get_match(COL_FSTYPE);
-	if (m && !mnt_fs_match_fstype(fs, m))
+	md = get_match_data(COL_FSTYPE);
+	if (md && !mnt_fs_match_optmatcher(fs, md))
 		return rc;
 
-	m = get_match(COL_OPTIONS);
-	if (m && !mnt_fs_match_options(fs, m))
+	md = get_match_data(COL_OPTIONS);
+	if (md && !mnt_fs_match_optmatcher(fs, md))
 		return rc;
 
 	md = get_match_data(COL_MAJMIN);
@@ -1190,20 +1190,86 @@ static int poll_match(struct libmnt_fs *fs)
 	return rc;
 }
 
+/*
+ * Prints every output line as one compact JSON object terminated by newline
+ * (--output-format ndjson). The values follow the JSON types of the columns.
+ */
+static void print_ndjson(struct libscols_table *table)
+{
+	struct libscols_iter *itr = scols_new_iter(SCOLS_ITER_FORWARD);
+	struct libscols_line *ln;
+	struct ul_jsonwrt json;
+
+	if (!itr)
+		err(EXIT_FAILURE, _("failed to allocate output table iterator"));
+
+	ul_jsonwrt_init_compact(&json, scols_table_get_stream(table));
+
+	while (scols_table_next_line(table, itr, &ln) == 0) {
+		size_t i;
+
+		ul_jsonwrt_root_open(&json);
+		for (i = 0; i < ncolumns; i++) {
+			struct libscols_column *cl = scols_table_get_column(table, i);
+			struct libscols_cell *ce = scols_line_get_cell(ln, i);
+			const char *name = scols_column_get_name(cl);
+			const char *data = ce ? scols_cell_get_data(ce) : NULL;
+
+			if (!data || !*data) {
+				ul_jsonwrt_value_null(&json, name);
+				continue;
+			}
+			switch (scols_column_get_json_type(cl)) {
+			case SCOLS_JSON_NUMBER:
+				ul_jsonwrt_value_raw(&json, name, data);
+				break;
+			case SCOLS_JSON_ARRAY_STRING:
+			{
+				char *str = xstrdup(data), *p, *save = NULL;
+
+				ul_jsonwrt_array_open(&json, name);
+				for (p = strtok_r(str, "\n", &save); p;
+				     p = strtok_r(NULL, "\n", &save))
+					ul_jsonwrt_value_s(&json, NULL, p);
+				ul_jsonwrt_array_close(&json);
+				free(str);
+				break;
+			}
+			default:
+				ul_jsonwrt_value_s(&json, name, data);
+				break;
+			}
+		}
+		ul_jsonwrt_root_close(&json);
+	}
+	scols_free_iter(itr);
+}
+
+/*
+ * Without @tabfile the kernel mount table of the current namespace is
+ * monitored and @tb is refreshed by mnt_table_refresh(); the unchanged
+ * entries are kept and only the changed entries are compared. An alternative
+ * mountinfo file is re-read and compared as a whole.
+ */
 static int poll_table(struct libmnt_table *tb, const char *tabfile,
 		  int timeout, struct libscols_table *table, int direction)
 {
 	FILE *f = NULL;
-	int rc = -1;
+	int rc = -1, refresh = !tabfile;
 	struct libmnt_iter *itr = NULL;
-	struct libmnt_table *tb_new;
+	struct libmnt_table *tb_new = NULL;
 	struct libmnt_tabdiff *diff = NULL;
 	struct pollfd fds[1];
 
-	tb_new = mnt_new_table();
-	if (!tb_new) {
-		warn(_("failed to initialize libmount table"));
-		goto done;
+	if (!tabfile)
+		tabfile = _PATH_PROC_MOUNTINFO;
+
+	if (!refresh) {
+		tb_new = mnt_new_table();
+		if (!tb_new) {
+			warn(_("failed to initialize libmount table"));
+			goto done;
+		}
 	}
 
 	itr = mnt_new_iter(direction);
@@ -1220,15 +1286,19 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	/* cache is unnecessary to detect changes */
 	mnt_table_set_cache(tb, NULL);
-	mnt_table_set_cache(tb_new, NULL);
 
+	/* the file is used for poll() only if refreshed by libmount */
 	f = fopen(tabfile, "r");
 	if (!f) {
 		warn(_("cannot open %s"), tabfile);
 		goto done;
 	}
 
-	mnt_table_set_parser_errcb(tb_new, parser_errcb);
+	if (tb_new) {
+		mnt_table_set_cache(tb_new, NULL);
+		mnt_table_set_parser_errcb(tb_new, parser_errcb);
+		mnt_table_enable_arena(tb_new, 1);
+	}
 
 	fds[0].fd = fileno(f);
 	fds[0].events = POLLPRI;
@@ -1246,10 +1316,14 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 			goto done;
 		}
 
-		rewind(f);
-		rc = mnt_table_parse_stream(tb_new, f, tabfile);
-		if (!rc)
-			rc = mnt_diff_tables(diff, tb, tb_new);
+		if (refresh)
+			rc = mnt_table_refresh(tb, diff);
+		else {
+			rewind(f);
+			rc = mnt_table_parse_stream(tb_new, f, tabfile);
+			if (!rc)
+				rc = mnt_diff_tables(diff, tb, tb_new);
+		}
 		if (rc < 0)
 			goto done;
 
@@ -1270,7 +1344,10 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 				break;
 		}
 
-		if (count) {
+		if (count && (flags & FL_NDJSON)) {
+			print_ndjson(table);
+			fflush(stdout);
+		} else if (count) {
 			rc = scols_table_print_range(table, NULL, NULL);
 			if (rc == 0)
 				fputc('\n', scols_table_get_stream(table));
@@ -1279,14 +1356,16 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 				goto done;
 		}
 
-		/* swap tables */
-		tmp = tb;
-		tb = tb_new;
-		tb_new = tmp;
+		if (!refresh) {
+			/* swap tables */
+			tmp = tb;
+			tb = tb_new;
+			tb_new = tmp;
+			mnt_reset_table(tb_new);
+		}
 
 		/* remove already printed lines to reduce memory usage */
 		scols_table_remove_lines(table);
-		mnt_reset_table(tb_new);
 
 		if (count && (flags & FL_FIRSTONLY))
 			break;
@@ -1330,8 +1409,10 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -s, --fstab            search in static table of filesystems\n"), out);
 	fputs(_(" -m, --mtab             search in table of mounted filesystems\n"
 		"                          (includes user space mount options)\n"), out);
-	fputs(_(" -k, --kernel           search in kernel table of mounted\n"
-		"                          filesystems (default)\n"), out);
+	fputs(_(" -k, --kernel[=<method>]\n"
+		"                         search in kernel table of mounted\n"
+		"                          filesystems (default); <method> is\n"
+		"                          'mountinfo' (default) or 'listmount'\n"), out);
 	fputc('\n', out);
 	fputs(_(" -p, --poll[=<list>]    monitor changes in table of mounted filesystems\n"), out);
 	fputs(_(" -w, --timeout <num>    upper limit in milliseconds that --poll will block\n"), out);
@@ -1356,9 +1437,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -O, --options <list>   limit the set of filesystems by mount options\n"), out);
 	fputs(_(" -o, --output <list>    the output columns to be shown\n"), out);
 	fputs(_("     --output-all       output all available columns\n"), out);
+	fputs(_("     --output-format <name>\n"
+		"                        output format (json, ndjson, cbor, raw or pairs)\n"), out);
 	fputs(_(" -P, --pairs            use key=\"value\" output format\n"), out);
 	fputs(_("     --pseudo           print only pseudo-filesystems\n"), out);
 	fputs(_("     --shadowed         print only filesystems over-mounted by another filesystem\n"), out);
+	fputs(_("     --stats[=<format>] print statistics to stderr (text or json)\n"), out);
 	fputs(_(" -R, --submounts        print all submounts for the matching filesystems\n"), out);
 	fputs(_(" -r, --raw              use raw output format\n"), out);
 	fputs(_("     --real             print only real filesystems\n"), out);
@@ -1376,6 +1460,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputc('\n', out);
 	fputs(_(" -x, --verify           verify mount table content (default is fstab)\n"), out);
 	fputs(_("     --verbose          print more details\n"), out);
+	fputs(_("     --jobs <num>       number of threads to probe devices for --verify\n"), out);
 	fputs(_("     --vfs-all          print all VFS options\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -1397,6 +1482,7 @@ int main(int argc, char *argv[])
 	int direction = MNT_ITER_FORWARD;
 	int verify = 0;
 	int c, rc = -1, timeout = -1;
+	unsigned int njobs = 1;
 	int ntabfiles = 0, tabtype = 0;
 	char *outarg = NULL;
 	size_t i;
@@ -1411,7 +1497,10 @@ int main(int argc, char *argv[])
 		FINDMNT_OPT_PSEUDO,
 		FINDMNT_OPT_REAL,
 		FINDMNT_OPT_VFS_ALL,
-		FINDMNT_OPT_SHADOWED
+		FINDMNT_OPT_SHADOWED,
+		FINDMNT_OPT_OUTPUT_FORMAT,
+		FINDMNT_OPT_STATS,
+		FINDMNT_OPT_JOBS
 	};
 
 	static const struct option longopts[] = {
@@ -1427,7 +1516,7 @@ int main(int argc, char *argv[])
 		{ "help",	    no_argument,       NULL, 'h'		 },
 		{ "invert",	    no_argument,       NULL, 'i'		 },
 		{ "json",	    no_argument,       NULL, 'J'		 },
-		{ "kernel",	    no_argument,       NULL, 'k'		 },
+		{ "kernel",	    optional_argument, NULL, 'k'		 },
 		{ "list",	    no_argument,       NULL, 'l'		 },
 		{ "mountpoint",	    required_argument, NULL, 'M'		 },
 		{ "mtab",	    no_argument,       NULL, 'm'		 },
@@ -1436,6 +1525,7 @@ int main(int argc, char *argv[])
 		{ "options",	    required_argument, NULL, 'O'		 },
 		{ "output",	    required_argument, NULL, 'o'		 },
 		{ "output-all",	    no_argument,       NULL, FINDMNT_OPT_OUTPUT_ALL },
+		{ "output-format",  required_argument, NULL, FINDMNT_OPT_OUTPUT_FORMAT },
 		{ "poll",	    optional_argument, NULL, 'p'		 },
 		{ "pairs",	    no_argument,       NULL, 'P'		 },
 		{ "raw",	    no_argument,       NULL, 'r'		 },
@@ -1458,6 +1548,8 @@ int main(int argc, char *argv[])
 		{ "pseudo",	    no_argument,       NULL, FINDMNT_OPT_PSEUDO	 },
 		{ "vfs-all",	    no_argument,       NULL, FINDMNT_OPT_VFS_ALL },
 		{ "shadowed",       no_argument,       NULL, FINDMNT_OPT_SHADOWED },
+		{ "stats",          optional_argument, NULL, FINDMNT_OPT_STATS },
+		{ "jobs",           required_argument, NULL, FINDMNT_OPT_JOBS },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -1470,6 +1562,7 @@ int main(int argc, char *argv[])
 		{ 'P','l','r','x' },		/* pairs,list,raw,verify */
 		{ 'p','x' },			/* poll,verify */
 		{ 'm','p','s' },		/* mtab,poll,fstab */
+		{ 'J', 'P', 'r', FINDMNT_OPT_OUTPUT_FORMAT },
 		{ FINDMNT_OPT_PSEUDO, FINDMNT_OPT_REAL },
 		{ 0 }
 	};
@@ -1547,8 +1640,29 @@ int main(int argc, char *argv[])
 				columns[ncolumns++] = i;
 			}
 			break;
+		case FINDMNT_OPT_OUTPUT_FORMAT:
+			if (strcmp(optarg, "json") == 0)
+				flags |= FL_JSON;
+			else if (strcmp(optarg, "cbor") == 0)
+				flags |= FL_JSON | FL_CBOR;
+			else if (strcmp(optarg, "ndjson") == 0) {
+				flags &= ~FL_TREE;
+				flags |= FL_JSON | FL_NDJSON;
+			}
+			else if (strcmp(optarg, "raw") == 0) {
+				flags &= ~FL_TREE;
+				flags |= FL_RAW;
+			} else if (strcmp(optarg, "pairs") == 0) {
+				flags &= ~FL_TREE;
+				flags |= FL_EXPORT;
+			} else
+				errx(EXIT_FAILURE, _("unsupported output format: %s"), optarg);
+			break;
 		case 'O':
 			set_match(COL_OPTIONS, optarg);
+			set_match_data(COL_OPTIONS, mnt_new_optmatcher(optarg));
+			if (!get_match_data(COL_OPTIONS))
+				err(EXIT_FAILURE, _("failed to compile options pattern"));
 			break;
 		case 'p':
 			if (optarg) {
@@ -1575,9 +1689,20 @@ int main(int argc, char *argv[])
 			break;
 		case 'k':		/* kernel (mountinfo) */
 			tabtype = TABTYPE_KERNEL;
+			if (optarg) {
+				if (strcmp(optarg, "listmount") == 0)
+					flags |= FL_LISTMOUNT;
+				else if (strcmp(optarg, "mountinfo") == 0)
+					flags &= ~FL_LISTMOUNT;
+				else
+					errx(EXIT_FAILURE, _("unknown kernel method: %s"), optarg);
+			}
 			break;
 		case 't':
 			set_match(COL_FSTYPE, optarg);
+			set_match_data(COL_FSTYPE, mnt_new_fstype_matcher(optarg));
+			if (!get_match_data(COL_FSTYPE))
+				err(EXIT_FAILURE, _("failed to compile types pattern"));
 			break;
 		case 'r':
 			flags &= ~FL_TREE;	/* disable the default */
@@ -1642,6 +1767,20 @@ int main(int argc, char *argv[])
 		case FINDMNT_OPT_SHADOWED:
 			flags |= FL_SHADOWED;
 			break;
+		case FINDMNT_OPT_STATS:
+		{
+			int fmt = ul_stats_parse_format(optarg);
+
+			if (fmt < 0)
+				errx(EXIT_FAILURE, _("unsupported statistics format: %s"), optarg);
+			ul_stats_init(fmt);
+			break;
+		}
+		case FINDMNT_OPT_JOBS:
+			njobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!njobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'h':
 			usage();
 		case 'V':
@@ -1720,6 +1859,7 @@ int main(int argc, char *argv[])
 	 */
 	mnt_init_debug(0);
 
+	ul_stats_phase("collect");
 	tb = parse_tabfiles(tabfiles, ntabfiles, tabtype);
 	if (!tb)
 		goto leave;
@@ -1731,7 +1871,7 @@ int main(int argc, char *argv[])
 	if (istree && force_tree)
 		flags |= FL_TREE;
 
-	if ((flags & FL_TREE) && (ntabfiles > 1 || !istree))
+	if ((flags & FL_TREE) && (ntabfiles > 1 || !istree || (flags & FL_NDJSON)))
 		flags &= ~FL_TREE;
 
 	if (!(flags & FL_NOCACHE)) {
@@ -1750,7 +1890,7 @@ int main(int argc, char *argv[])
 		mnt_table_uniq_fs(tb, MNT_UNIQ_KEEPTREE, uniq_fs_target_cmp);
 
 	if (verify) {
-		rc = verify_table(tb);
+		rc = verify_table(tb, njobs);
 		goto leave;
 	}
 
@@ -1767,6 +1907,8 @@ int main(int argc, char *argv[])
 	scols_table_enable_export(table,     !!(flags & FL_EXPORT));
 	scols_table_enable_shellvar(table,   !!(flags & FL_SHELLVAR));
 	scols_table_enable_json(table,       !!(flags & FL_JSON));
+	if (flags & FL_CBOR)
+		scols_table_enable_cbor(table, 1);
 	scols_table_enable_ascii(table,      !!(flags & FL_ASCII));
 	scols_table_enable_noheadings(table, !!(flags & FL_NOHEADINGS));
 
@@ -1828,9 +1970,10 @@ int main(int argc, char *argv[])
 	/*
 	 * Fill in data to the output table
 	 */
+	ul_stats_phase("format");
 	if (flags & FL_POLL) {
 		/* poll mode (accept the first tabfile only) */
-		rc = poll_table(tb, tabfiles ? *tabfiles : _PATH_PROC_MOUNTINFO, timeout, table, direction);
+		rc = poll_table(tb, tabfiles ? *tabfiles : NULL, timeout, table, direction);
 
 	} else if ((flags & FL_TREE) && !(flags & FL_SUBMOUNTS)) {
 		/* whole tree */
@@ -1857,8 +2000,14 @@ int main(int argc, char *argv[])
 	/*
 	 * Print the output table for non-poll modes
 	 */
-	if (!rc && !(flags & FL_POLL))
-		scols_print_table(table);
+	if (!rc && !(flags & FL_POLL)) {
+		ul_stats_phase("print");
+		if (flags & FL_NDJSON)
+			print_ndjson(table);
+		else
+			scols_print_table(table);
+	}
+	ul_stats_phase(NULL);
 leave:
 	scols_unref_table(table);
 
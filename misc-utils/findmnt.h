@@ -3,6 +3,7 @@
 
 /* flags */
 enum {
+	FL_NDJSON	= (1 << 0),	/* JSON object per line, requires FL_JSON */
 	FL_EVALUATE	= (1 << 1),
 	FL_CANONICALIZE = (1 << 2),
 	FL_FIRSTONLY	= (1 << 3),
@@ -24,6 +25,8 @@ enum {
 	FL_SHADOWED	= (1 << 20),
 	FL_DELETED      = (1 << 21),
 	FL_SHELLVAR     = (1 << 22),
+	FL_LISTMOUNT    = (1 << 23),
+	FL_CBOR		= (1 << 24),	/* binary JSON, requires FL_JSON */
 
 	/* basic table settings */
 	FL_ASCII	= (1 << 25),
@@ -40,6 +43,6 @@ extern int parse_nerrors;
 
 extern int is_listall_mode(void);
 extern struct libmnt_fs *get_next_fs(struct libmnt_table *tb, struct libmnt_iter *itr);
-extern int verify_table(struct libmnt_table *tb);
+extern int verify_table(struct libmnt_table *tb, unsigned int njobs);
 
 #endif /* UTIL_LINUX_FINDMNT_H */
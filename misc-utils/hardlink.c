@@ -32,10 +32,12 @@
 #include <sys/resource.h>	/* getrlimit, getrusage */
 #include <fcntl.h>		/* posix_fadvise */
 #include <ftw.h>		/* ftw */
-#include <search.h>		/* tsearch() and friends */
+#include <search.h>		/* tsearch() and friends (digest cache) */
 #include <signal.h>		/* SIG*, sigaction */
 #include <getopt.h>		/* getopt_long() */
 #include <ctype.h>		/* tolower() */
+#include <dirent.h>		/* opendir(), readdir() */
+#include <pthread.h>		/* --threads */
 #include <sys/ioctl.h>
 
 #if defined(HAVE_LINUX_FIEMAP_H) && defined(HAVE_SYS_VFS_H)
@@ -53,9 +55,12 @@
 #include "monotonic.h"
 #include "optutils.h"
 #include "fileeq.h"
+#include "fileutils.h"
+#include "closestream.h"
 
 #ifdef USE_REFLINK
 # include "statfs_magic.h"
+# include "xxhash.h"
 #endif
 
 #include <regex.h>		/* regcomp(), regexec() */
@@ -79,20 +84,49 @@ static int reflinks_skip;
 
 static struct ul_fileeq fileeq;
 
+/**
+ * struct file_stat - The used subset of struct stat
+ *
+ * Keep the per-file record small, hardlink has to keep all the files in
+ * memory.
+ */
+struct file_stat {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+	nlink_t nlink;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+};
+
 /**
  * struct file - Information about a file
- * @st:       The stat buffer associated with the file
+ * @st:       The stat information associated with the file
+ * @data:     The content comparison data, allocated by file_data()
  * @next:     Next file with the same size
+ * @merged:   The file is already planned to be linked to another file
+ * @extents_checked: @extents_fp and @extents_shared are valid
+ * @extents_shared:  All extents of the file are shared
+ * @extents_fp: The fingerprint of the file extents, see get_extents_fp()
  * @basename: The offset off the basename in the filename
  * @path:     The path of the file
  *
  * This contains all information we need about a file.
  */
 struct file {
-	struct stat st;
-	struct ul_fileeq_data data;
+	struct file_stat st;
+	struct ul_fileeq_data *data;
 
 	struct file *next;
+	unsigned int merged:1;
+#ifdef USE_REFLINK
+	unsigned int extents_checked:1,
+		     extents_shared:1;
+	uint64_t extents_fp;
+#endif
 	struct link {
 		struct link *next;
 		int basename;
@@ -127,6 +161,8 @@ enum log_level {
  * @linked: The number of files replaced by a hardlink to a master
  * @xattr_comparisons: The number of extended attribute comparisons
  * @comparisons: The number of comparisons
+ * @cached_digests: The number of files with data from the digest cache
+ * @memory: The memory used by the files and links
  * @saved: The (exaggerated) amount of space saved
  * @start_time: The time we started at
  */
@@ -137,10 +173,15 @@ static struct statistics {
 	size_t xattr_comparisons;
 	size_t comparisons;
 	size_t ignored_reflinks;
+	size_t cached_digests;
+	size_t memory;
 	double saved;
 	struct timeval start_time;
 } stats;
 
+/* the counters are updated also by the --threads workers */
+#define stats_inc(_x)	__atomic_add_fetch(&stats._x, 1, __ATOMIC_RELAXED)
+
 
 struct hdl_regex {
 	regex_t re;		/* POSIX compatible regex handler */
@@ -164,6 +205,8 @@ struct hdl_regex {
  * @dry_run: Specifies whether hardlink should not link files (default = FALSE)
  * @min_size: Minimum size of files to consider. (default = 1 byte)
  * @max_size: Maximum size of files to consider, 0 means umlimited. (default = 0 byte)
+ * @threads: Number of threads to scan and compare files (default = 1)
+ * @digest_cache: File to save and load the files digests (default = NULL)
  */
 static struct options {
 	struct hdl_regex *include;
@@ -184,6 +227,8 @@ static struct options {
 	uintmax_t max_size;
 	size_t io_size;
 	size_t cache_size;
+	size_t threads;
+	const char *digest_cache;
 } opts = {
 	/* default setting */
 #ifdef USE_FILEEQ_CRYPTOAPI
@@ -197,17 +242,50 @@ static struct options {
 	.respect_xattrs = FALSE,
 	.keep_oldest = FALSE,
 	.min_size = 1,
-	.cache_size = 10*1024*1024
+	.cache_size = 10*1024*1024,
+	.threads = 1
+};
+
+/**
+ * struct file_table - Hash table of files
+ * @slots: The table, open addressing with linear probing
+ * @size:  The number of slots, power of 2
+ * @used:  The number of used slots
+ * @hash:  The hash function
+ * @equal: The key comparison function
+ *
+ * The table is enlarged to keep at least 30% of the slots free.
+ */
+struct file_table {
+	struct file **slots;
+	size_t size;
+	size_t used;
+
+	uint64_t (*hash)(const struct file *);
+	int (*equal)(const struct file *, const struct file *);
 };
 
+static uint64_t hash_nodes(const struct file *);
+static int equal_nodes(const struct file *, const struct file *);
+static uint64_t hash_nodes_ino(const struct file *);
+static int equal_nodes_ino(const struct file *, const struct file *);
+
 /*
  * files
  *
- * A binary tree of files, managed using tsearch(). To see which nodes
- * are considered equal, see compare_nodes()
+ * The lists of files with the same size (and device); the table contains the
+ * list heads. To see which files are considered equal, see equal_nodes().
  */
-static void *files;
-static void *files_by_ino;
+static struct file_table files = {
+	.hash = hash_nodes,
+	.equal = equal_nodes
+};
+
+/* all known inodes, see equal_nodes_ino() */
+static struct file_table files_by_ino = {
+	.hash = hash_nodes_ino,
+	.equal = equal_nodes_ino
+};
 
 /*
  * last_signal
@@ -217,6 +295,9 @@ static void *files_by_ino;
  */
 static int last_signal;
 
+/* the thread that handles signals, owns the tables and links the files */
+static pthread_t main_thread;
+
 
 #define is_log_enabled(_level)  (quiet == 0 && (_level) <= (unsigned int)opts.verbosity)
 
@@ -233,10 +314,12 @@ static void jlog(enum log_level level, const char *format, ...)
 	if (!is_log_enabled(level))
 		return;
 
+	flockfile(stdout);
 	va_start(args, format);
 	vfprintf(stdout, format, args);
 	va_end(args);
 	fputc('\n', stdout);
+	funlockfile(stdout);
 }
 
 /**
@@ -289,53 +372,137 @@ static int match_any_regex(struct hdl_regex *pregs, const char *what)
 	return FALSE;
 }
 
+/* mix two 64-bit values to one hash (the splitmix64 finalizer) */
+static inline uint64_t hash_u64_pair(uint64_t a, uint64_t b)
+{
+	uint64_t x = a * 0x9e3779b97f4a7c15ULL ^ b;
+
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
 /**
- * compare_nodes - Node comparison function
- * @_a: The first node (a #struct file)
- * @_b: The second node (a #struct file)
+ * equal_nodes - Node comparison function
+ * @a: The first node
+ * @b: The second node
  *
- * Compare the two nodes for the binary tree.
+ * Returns: %TRUE if the files belong to the same list in the files table.
  */
-static int compare_nodes(const void *_a, const void *_b)
+static int equal_nodes(const struct file *a, const struct file *b)
 {
-	const struct file *a = _a;
-	const struct file *b = _b;
-	int diff = 0;
-
-	if (diff == 0)
-		diff = CMP(a->st.st_dev, b->st.st_dev);
-	if (diff == 0)
-		diff = CMP(a->st.st_size, b->st.st_size);
+	return a->st.dev == b->st.dev && a->st.size == b->st.size;
+}
 
-	return diff;
+static uint64_t hash_nodes(const struct file *a)
+{
+	return hash_u64_pair(a->st.dev, a->st.size);
 }
 
 /**
- * compare_nodes_ino - Node comparison function
- * @_a: The first node (a #struct file)
- * @_b: The second node (a #struct file)
+ * equal_nodes_ino - Node comparison function
+ * @a: The first node
+ * @b: The second node
  *
- * Compare the two nodes for the binary tree.
+ * Returns: %TRUE if the files are the same inode.
  */
-static int compare_nodes_ino(const void *_a, const void *_b)
+static int equal_nodes_ino(const struct file *a, const struct file *b)
 {
-	const struct file *a = _a;
-	const struct file *b = _b;
-	int diff = 0;
-
-	if (diff == 0)
-		diff = CMP(a->st.st_dev, b->st.st_dev);
-	if (diff == 0)
-		diff = CMP(a->st.st_ino, b->st.st_ino);
+	if (a->st.dev != b->st.dev || a->st.ino != b->st.ino)
+		return FALSE;
 
 	/* If opts.respect_name is used, we will restrict a struct file to
 	 * contain only links with the same basename to keep the rest simple.
 	 */
-	if (diff == 0 && opts.respect_name)
-		diff = strcmp(a->links->path + a->links->basename,
-			      b->links->path + b->links->basename);
+	if (opts.respect_name)
+		return strcmp(a->links->path + a->links->basename,
+			      b->links->path + b->links->basename) == 0;
+	return TRUE;
+}
 
-	return diff;
+static uint64_t hash_nodes_ino(const struct file *a)
+{
+	return hash_u64_pair(a->st.dev, a->st.ino);
+}
+
+static struct file **file_table_slot(struct file_table *t, const struct file *fil)
+{
+	size_t mask = t->size - 1;
+	size_t i = t->hash(fil) & mask;
+
+	while (t->slots[i] && !t->equal(t->slots[i], fil))
+		i = (i + 1) & mask;
+
+	return &t->slots[i];
+}
+
+static void file_table_grow(struct file_table *t)
+{
+	struct file **old = t->slots;
+	size_t i, oldsize = t->size;
+
+	t->size = oldsize ? oldsize * 2 : 1024;
+	t->slots = xcalloc(t->size, sizeof(struct file *));
+
+	for (i = 0; i < oldsize; i++) {
+		if (old[i])
+			*file_table_slot(t, old[i]) = old[i];
+	}
+	free(old);
+}
+
+/**
+ * file_table_insert - Add a file to the table
+ * @t:   The table
+ * @fil: The file
+ *
+ * Like tsearch(), returns the slot with @fil or with an already present equal
+ * file. The slot is valid until the next insert.
+ */
+static struct file **file_table_insert(struct file_table *t, struct file *fil)
+{
+	struct file **slot;
+
+	if ((t->used + 1) * 10 > t->size * 7)
+		file_table_grow(t);
+
+	slot = file_table_slot(t, fil);
+	if (!*slot) {
+		*slot = fil;
+		t->used++;
+	}
+	return slot;
+}
+
+static void file_stat_init(struct file_stat *fst, const struct stat *st)
+{
+	memset(fst, 0, sizeof(*fst));
+	fst->dev = st->st_dev;
+	fst->ino = st->st_ino;
+	fst->size = st->st_size;
+	fst->nlink = st->st_nlink;
+	fst->mode = st->st_mode;
+	fst->uid = st->st_uid;
+	fst->gid = st->st_gid;
+	fst->mtime.tv_sec = st->st_mtime;
+	fst->ctime.tv_sec = st->st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	fst->mtime.tv_nsec = st->st_mtim.tv_nsec;
+	fst->ctime.tv_nsec = st->st_ctim.tv_nsec;
+#endif
+}
+
+/* returns the data for content comparison, allocated on demand */
+static struct ul_fileeq_data *file_data(struct file *fil)
+{
+	if (!fil->data) {
+		fil->data = xmalloc(sizeof(struct ul_fileeq_data));
+		ul_fileeq_data_init(fil->data);
+	}
+	return fil->data;
 }
 
 /**
@@ -361,6 +528,9 @@ static void print_stats(void)
 #endif
 	jlog(JLOG_SUMMARY, _("%-25s %zu files"), _("Compared:"),
 	     stats.comparisons);
+	if (opts.digest_cache)
+		jlog(JLOG_SUMMARY, _("%-25s %zu files"), _("Cached digests:"),
+		     stats.cached_digests);
 #ifdef USE_REFLINK
 	if (reflinks_skip)
 		jlog(JLOG_SUMMARY, _("%-25s %zu files"), _("Skipped reflinks:"),
@@ -373,6 +543,18 @@ static void print_stats(void)
 	jlog(JLOG_SUMMARY, "%-25s %s", _("Saved:"), ssz);
 	free(ssz);
 
+	{
+		size_t mem = stats.memory
+			   + (files.size + files_by_ino.size) * sizeof(struct file *);
+
+		ssz = size_to_human_string(SIZE_SUFFIX_3LETTER |
+					   SIZE_SUFFIX_SPACE |
+					   SIZE_DECIMAL_2DIGITS, mem);
+		jlog(JLOG_SUMMARY, _("%-25s %s (%zu bytes per file)"), _("Memory:"),
+		     ssz, stats.files ? mem / stats.files : 0);
+		free(ssz);
+	}
+
 	jlog(JLOG_SUMMARY, _("%-25s %"PRId64".%06"PRId64" seconds"), _("Duration:"),
 	     (int64_t)delta.tv_sec, (int64_t)delta.tv_usec);
 }
@@ -380,11 +562,19 @@ static void print_stats(void)
 /**
  * handle_interrupt - Handle a signal
  *
+ * The --threads workers only check for SIGINT and SIGTERM, other signals are
+ * handled later by the main thread.
+ *
  * Returns: %TRUE on SIGINT, SIGTERM; %FALSE on all other signals.
  */
 static int handle_interrupt(void)
 {
-	switch (last_signal) {
+	int sig = __atomic_load_n(&last_signal, __ATOMIC_RELAXED);
+
+	if (!pthread_equal(pthread_self(), main_thread))
+		return sig == SIGINT || sig == SIGTERM;
+
+	switch (sig) {
 	case SIGINT:
 	case SIGTERM:
 		return TRUE;
@@ -394,7 +584,7 @@ static int handle_interrupt(void)
 		break;
 	}
 
-	last_signal = 0;
+	__atomic_store_n(&last_signal, 0, __ATOMIC_RELAXED);
 	return FALSE;
 }
 
@@ -510,7 +700,7 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
 	jlog(JLOG_VERBOSE1, _("Comparing xattrs of %s to %s"), a->links->path,
 	     b->links->path);
 
-	stats.xattr_comparisons++;
+	stats_inc(xattr_comparisons);
 
 	len_a = llistxattr_or_die(a->links->path, NULL, 0);
 	len_b = llistxattr_or_die(b->links->path, NULL, 0);
@@ -600,15 +790,15 @@ static int file_xattrs_equal(const struct file *a, const struct file *b)
  */
 static int file_may_link_to(const struct file *a, const struct file *b)
 {
-	return (a->st.st_size != 0 &&
-		a->st.st_size == b->st.st_size &&
+	return (a->st.size != 0 &&
+		a->st.size == b->st.size &&
 		a->links != NULL && b->links != NULL &&
-		a->st.st_dev == b->st.st_dev &&
-		a->st.st_ino != b->st.st_ino &&
-		(!opts.respect_mode || a->st.st_mode == b->st.st_mode) &&
-		(!opts.respect_owner || a->st.st_uid == b->st.st_uid) &&
-		(!opts.respect_owner || a->st.st_gid == b->st.st_gid) &&
-		(!opts.respect_time || a->st.st_mtime == b->st.st_mtime) &&
+		a->st.dev == b->st.dev &&
+		a->st.ino != b->st.ino &&
+		(!opts.respect_mode || a->st.mode == b->st.mode) &&
+		(!opts.respect_owner || a->st.uid == b->st.uid) &&
+		(!opts.respect_owner || a->st.gid == b->st.gid) &&
+		(!opts.respect_time || a->st.mtime.tv_sec == b->st.mtime.tv_sec) &&
 		(!opts.respect_name
 		 || strcmp(a->links->path + a->links->basename,
 			   b->links->path + b->links->basename) == 0) &&
@@ -627,22 +817,400 @@ static int file_may_link_to(const struct file *a, const struct file *b)
 static int file_compare(const struct file *a, const struct file *b)
 {
 	int res = 0;
-	if (a->st.st_dev == b->st.st_dev && a->st.st_ino == b->st.st_ino)
+	if (a->st.dev == b->st.dev && a->st.ino == b->st.ino)
 		return 0;
 
 	if (res == 0 && opts.maximise)
-		res = CMP(a->st.st_nlink, b->st.st_nlink);
+		res = CMP(a->st.nlink, b->st.nlink);
 	if (res == 0 && opts.minimise)
-		res = CMP(b->st.st_nlink, a->st.st_nlink);
+		res = CMP(b->st.nlink, a->st.nlink);
 	if (res == 0)
-		res = opts.keep_oldest ? CMP(b->st.st_mtime, a->st.st_mtime)
-		    : CMP(a->st.st_mtime, b->st.st_mtime);
+		res = opts.keep_oldest ? CMP(b->st.mtime.tv_sec, a->st.mtime.tv_sec)
+		    : CMP(a->st.mtime.tv_sec, b->st.mtime.tv_sec);
 	if (res == 0)
-		res = CMP(b->st.st_ino, a->st.st_ino);
+		res = CMP(b->st.ino, a->st.ino);
 
 	return res;
 }
 
+/*
+ * Digest cache (--digest-cache)
+ *
+ * The intro and the block digests of the compared files are saved to a file
+ * and reused by the next run for the files which have not been modified since
+ * that time. The file is identified by device, inode, size, mtime and ctime.
+ * The entries for the files not seen by the current run are checked by
+ * lstat() on save and the stale entries are dropped.
+ *
+ * The cache file is in the native byte order; it's a cache, a file from
+ * another system is ignored.
+ */
+#define DCACHE_MAGIC	"HLDCACHE"
+#define DCACHE_VERSION	1
+
+struct dcache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t recsiz;		/* sizeof(struct dcache_record) */
+};
+
+struct dcache_record {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+	uint64_t readsiz;
+	uint32_t ndigests;
+	uint16_t digsiz;
+	uint8_t is_eof;
+	uint8_t methodlen;
+	uint32_t pathlen;
+	unsigned char intro[UL_FILEEQ_INTROSIZ];
+	/* followed by method name, path and digests */
+};
+
+struct dcache_entry {
+	struct dcache_record rec;
+	char *method;
+	char *path;
+	unsigned char *digests;
+	unsigned int used:1;		/* seen by this run */
+};
+
+static struct dcache {
+	const char *filename;
+	void *entries;			/* tsearch() tree */
+	pthread_mutex_t lock;		/* used by --threads workers */
+	FILE *out;			/* used by dcache_writer() */
+} dcache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static int compare_dcache_entries(const void *_a, const void *_b)
+{
+	const struct dcache_entry *a = _a;
+	const struct dcache_entry *b = _b;
+	int diff = CMP(a->rec.dev, b->rec.dev);
+
+	if (diff == 0)
+		diff = CMP(a->rec.ino, b->rec.ino);
+	if (diff == 0)
+		diff = strcmp(a->method, b->method);
+	return diff;
+}
+
+static void dcache_record_init(struct dcache_record *rec, const struct file_stat *st)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->dev = st->dev;
+	rec->ino = st->ino;
+	rec->size = st->size;
+	rec->mtime_sec = st->mtime.tv_sec;
+	rec->mtime_nsec = st->mtime.tv_nsec;
+	rec->ctime_sec = st->ctime.tv_sec;
+	rec->ctime_nsec = st->ctime.tv_nsec;
+}
+
+/* returns TRUE if the entry describes the file with stat @st */
+static int dcache_is_valid(const struct dcache_entry *ent, const struct file_stat *st)
+{
+	struct dcache_record rec;
+
+	dcache_record_init(&rec, st);
+
+	return rec.dev == ent->rec.dev && rec.ino == ent->rec.ino
+	       && rec.size == ent->rec.size
+	       && rec.mtime_sec == ent->rec.mtime_sec
+	       && rec.mtime_nsec == ent->rec.mtime_nsec
+	       && rec.ctime_sec == ent->rec.ctime_sec
+	       && rec.ctime_nsec == ent->rec.ctime_nsec;
+}
+
+static void dcache_free_entry(void *data)
+{
+	struct dcache_entry *ent = data;
+
+	free(ent->method);
+	free(ent->path);
+	free(ent->digests);
+	free(ent);
+}
+
+static void dcache_load(const char *filename)
+{
+	struct dcache_header hdr;
+	FILE *f;
+
+	dcache.filename = filename;
+
+	f = fopen(filename, "r" UL_CLOEXECSTR);
+	if (!f) {
+		if (errno != ENOENT)
+			warn(_("cannot open %s"), filename);
+		return;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1
+	    || memcmp(hdr.magic, DCACHE_MAGIC, sizeof(hdr.magic)) != 0
+	    || hdr.version != DCACHE_VERSION
+	    || hdr.recsiz != sizeof(struct dcache_record)) {
+		warnx(_("%s: unsupported digest cache format, ignore"), filename);
+		goto done;
+	}
+
+	for (;;) {
+		struct dcache_entry *ent = xcalloc(1, sizeof(*ent));
+		struct dcache_entry **node;
+		size_t dsz;
+
+		if (fread(&ent->rec, sizeof(ent->rec), 1, f) != 1) {
+			free(ent);
+			break;		/* EOF */
+		}
+
+		dsz = (size_t) ent->rec.ndigests * ent->rec.digsiz;
+		if (ent->rec.methodlen == 0 || ent->rec.pathlen == 0
+		    || ent->rec.pathlen > PATH_MAX
+		    || dsz > 64 * 1024 * 1024)
+			goto corrupted;
+
+		ent->method = xcalloc(1, ent->rec.methodlen + 1);
+		ent->path = xcalloc(1, ent->rec.pathlen + 1);
+		if (dsz)
+			ent->digests = xmalloc(dsz);
+
+		if (fread(ent->method, ent->rec.methodlen, 1, f) != 1
+		    || fread(ent->path, ent->rec.pathlen, 1, f) != 1
+		    || (dsz && fread(ent->digests, dsz, 1, f) != 1))
+			goto corrupted;
+
+		node = tsearch(ent, &dcache.entries, compare_dcache_entries);
+		if (!node)
+			err(EXIT_FAILURE, _("cannot allocate digest cache"));
+		if (*node != ent)
+			dcache_free_entry(ent);		/* duplicate */
+		continue;
+corrupted:
+		warnx(_("%s: corrupted digest cache, ignore the rest"), filename);
+		dcache_free_entry(ent);
+		break;
+	}
+done:
+	fclose(f);
+}
+
+/**
+ * dcache_restore - Use cached data for the file
+ * @eq:  The comparator, ready for the file size
+ * @fil: The file with just associated data
+ */
+static void dcache_restore(struct ul_fileeq *eq, struct file *fil)
+{
+	struct dcache_entry key = { .method = (char *) opts.method }, **node;
+	struct ul_fileeq_digests dg = { 0 };
+	int found = 0;
+
+	if (!dcache.filename)
+		return;
+
+	key.rec.dev = fil->st.dev;
+	key.rec.ino = fil->st.ino;
+
+	pthread_mutex_lock(&dcache.lock);
+
+	node = tfind(&key, &dcache.entries, compare_dcache_entries);
+	if (node && dcache_is_valid(*node, &fil->st)) {
+		struct dcache_entry *ent = *node;
+
+		dg.intro = ent->rec.intro;
+		dg.digests = ent->digests;
+		dg.ndigests = ent->rec.ndigests;
+		dg.digsiz = ent->rec.digsiz;
+		dg.readsiz = ent->rec.readsiz;
+		dg.is_eof = ent->rec.is_eof;
+		ent->used = 1;
+
+		/* copied while locked, a worker may replace the entry */
+		found = ul_fileeq_data_set_digests(eq, fil->data, &dg) == 0;
+		if (found)
+			stats_inc(cached_digests);
+	}
+
+	pthread_mutex_unlock(&dcache.lock);
+
+	if (found)
+		jlog(JLOG_VERBOSE2, _("Using cached digests for %s"), fil->links->path);
+}
+
+/**
+ * dcache_update - Remember data read from the file
+ * @eq:  The comparator used for the file
+ * @fil: The file with associated data
+ */
+static void dcache_update(struct ul_fileeq *eq, struct file *fil)
+{
+	struct dcache_entry *ent, **node;
+	struct ul_fileeq_digests dg;
+	size_t dsz;
+
+	if (!dcache.filename || !fil->links || !fil->data
+	    || ul_fileeq_data_get_digests(eq, fil->data, &dg) != 0)
+		return;
+
+	ent = xcalloc(1, sizeof(*ent));
+	dcache_record_init(&ent->rec, &fil->st);
+	memcpy(ent->rec.intro, dg.intro, sizeof(ent->rec.intro));
+	ent->rec.readsiz = dg.readsiz;
+	ent->rec.ndigests = dg.ndigests;
+	ent->rec.digsiz = dg.digsiz;
+	ent->rec.is_eof = dg.is_eof;
+	ent->method = xstrdup(opts.method);
+	ent->path = xstrdup(fil->links->path);
+	ent->rec.methodlen = strlen(ent->method);
+	ent->rec.pathlen = strlen(ent->path);
+	ent->used = 1;
+
+	dsz = dg.ndigests * dg.digsiz;
+	if (dsz) {
+		ent->digests = xmalloc(dsz);
+		memcpy(ent->digests, dg.digests, dsz);
+	}
+
+	pthread_mutex_lock(&dcache.lock);
+
+	node = tsearch(ent, &dcache.entries, compare_dcache_entries);
+	if (!node)
+		err(EXIT_FAILURE, _("cannot allocate digest cache"));
+	if (*node != ent) {
+		struct dcache_entry *old = *node;
+
+		/* keep the old entry if it has more for the same file */
+		if (dcache_is_valid(old, &fil->st)
+		    && old->rec.readsiz == ent->rec.readsiz
+		    && old->rec.ndigests > ent->rec.ndigests) {
+			old->used = 1;
+			dcache_free_entry(ent);
+		} else {
+			*node = ent;
+			dcache_free_entry(old);
+		}
+	}
+
+	pthread_mutex_unlock(&dcache.lock);
+}
+
+/* the file @fil has been replaced by a link, its inode may be reused */
+static void dcache_forget(struct file *fil)
+{
+	struct dcache_entry key = { .method = (char *) opts.method }, **node;
+
+	if (!dcache.filename)
+		return;
+
+	key.rec.dev = fil->st.dev;
+	key.rec.ino = fil->st.ino;
+
+	pthread_mutex_lock(&dcache.lock);
+	node = tfind(&key, &dcache.entries, compare_dcache_entries);
+	if (node) {
+		struct dcache_entry *ent = *node;
+
+		tdelete(&key, &dcache.entries, compare_dcache_entries);
+		dcache_free_entry(ent);
+	}
+	pthread_mutex_unlock(&dcache.lock);
+}
+
+/* release the content comparison data of the file */
+static void file_data_free(struct ul_fileeq *eq, struct file *fil)
+{
+	if (!fil->data)
+		return;
+	if (ul_fileeq_data_associated(fil->data))
+		dcache_update(eq, fil);
+	ul_fileeq_data_deinit(fil->data);
+	free(fil->data);
+	fil->data = NULL;
+}
+
+static void dcache_writer(const void *nodep, const VISIT which, const int depth)
+{
+	struct dcache_entry *ent = *(struct dcache_entry **)nodep;
+	size_t dsz = (size_t) ent->rec.ndigests * ent->rec.digsiz;
+
+	(void)depth;
+
+	if (which != leaf && which != postorder)
+		return;
+
+	/* prune entries of deleted or modified files */
+	if (!ent->used) {
+		struct file_stat fst;
+		struct stat st;
+
+		if (lstat(ent->path, &st) != 0 || !S_ISREG(st.st_mode))
+			return;
+		file_stat_init(&fst, &st);
+		if (!dcache_is_valid(ent, &fst))
+			return;
+	}
+
+	if (fwrite(&ent->rec, sizeof(ent->rec), 1, dcache.out) != 1
+	    || fwrite(ent->method, ent->rec.methodlen, 1, dcache.out) != 1
+	    || fwrite(ent->path, ent->rec.pathlen, 1, dcache.out) != 1
+	    || (dsz && fwrite(ent->digests, dsz, 1, dcache.out) != 1))
+		return;		/* checked by ferror() */
+}
+
+static void dcache_save(void)
+{
+	struct dcache_header hdr = {
+		.magic = DCACHE_MAGIC,
+		.version = DCACHE_VERSION,
+		.recsiz = sizeof(struct dcache_record)
+	};
+	char *tmp = NULL;
+	int fd;
+
+	if (!dcache.filename)
+		return;
+
+	xasprintf(&tmp, "%s.XXXXXX", dcache.filename);
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0) {
+		warn(_("cannot create %s"), tmp);
+		goto done;
+	}
+	dcache.out = fdopen(fd, "w");
+	if (!dcache.out) {
+		close(fd);
+		goto failed;
+	}
+
+	fwrite(&hdr, sizeof(hdr), 1, dcache.out);
+	twalk(dcache.entries, dcache_writer);
+
+	if (close_stream(dcache.out) != 0) {
+		dcache.out = NULL;
+		goto failed;
+	}
+	dcache.out = NULL;
+
+	if (rename(tmp, dcache.filename) != 0)
+		goto failed;
+	goto done;
+failed:
+	warn(_("cannot write %s"), dcache.filename);
+	unlink(tmp);
+done:
+	free(tmp);
+	tdestroy(dcache.entries, dcache_free_entry);
+	dcache.entries = NULL;
+}
+
 #ifdef USE_REFLINK
 static inline int do_link(struct file *a, struct file *b,
 			  const char *new_name, int reflink)
@@ -653,9 +1221,9 @@ static inline int do_link(struct file *a, struct file *b,
 		dest = open(new_name, O_CREAT|O_WRONLY|O_TRUNC, 0600);
 		if (dest < 0)
 			goto fallback;
-		if (fchmod(dest, b->st.st_mode) != 0)
+		if (fchmod(dest, b->st.mode) != 0)
 			goto fallback;
-		if (fchown(dest, b->st.st_uid, b->st.st_gid) != 0)
+		if (fchown(dest, b->st.uid, b->st.gid) != 0)
 			goto fallback;
 		src = open(a->links->path, O_RDONLY);
 		if (src < 0)
@@ -709,7 +1277,7 @@ static int file_link(struct file *a, struct file *b, int reflink)
 	if (is_log_enabled(JLOG_INFO)) {
 		char *ssz = size_to_human_string(SIZE_SUFFIX_3LETTER |
 				   SIZE_SUFFIX_SPACE |
-				   SIZE_DECIMAL_2DIGITS, a->st.st_size);
+				   SIZE_DECIMAL_2DIGITS, a->st.size);
 		jlog(JLOG_INFO, _("%s%sLinking %s to %s (-%s)"),
 		     opts.dry_run ? _("[DryRun] ") : "",
 		     reflink ? "Ref" : "",
@@ -736,17 +1304,19 @@ static int file_link(struct file *a, struct file *b, int reflink)
 		free(new_path);
 		if (failed)
 			return FALSE;
+
+		dcache_forget(b);
 	}
 
 	/* Update statistics */
 	stats.linked++;
 
 	/* Increase the link count of this file, and set stat() of other file */
-	a->st.st_nlink++;
-	b->st.st_nlink--;
+	a->st.nlink++;
+	b->st.nlink--;
 
-	if (b->st.st_nlink == 0)
-		stats.saved += a->st.st_size;
+	if (b->st.nlink == 0)
+		stats.saved += a->st.size;
 
 	/* Move the link from file b to a */
 	{
@@ -778,17 +1348,15 @@ static int has_fpath(struct file *node, const char *path)
 
 
 /**
- * inserter - Callback function for nftw()
- * @fpath: The path of the file being visited
+ * insert_file - Add a regular file to the tables
+ * @fpath: The path of the file
  * @sb:    The stat information of the file
- * @typeflag: The type flag
- * @ftwbuf:   Contains current level of nesting and offset of basename
+ * @base:  The offset of the basename in @fpath
  *
- * Called by nftw() for the files. See the manual page for nftw() for
- * further information.
+ * Filters the file by the command line options and adds it to the by-inode
+ * and by-size tables. Must be called by the main thread only.
  */
-static int inserter(const char *fpath, const struct stat *sb,
-		    int typeflag, struct FTW *ftwbuf)
+static int insert_file(const char *fpath, const struct stat *sb, int base)
 {
 	struct file *fil;
 	struct file **node;
@@ -796,13 +1364,6 @@ static int inserter(const char *fpath, const struct stat *sb,
 	int included;
 	int excluded;
 
-	if (handle_interrupt())
-		return 1;
-	if (typeflag == FTW_DNR || typeflag == FTW_NS)
-		warn(_("cannot read %s"), fpath);
-	if (typeflag != FTW_F || !S_ISREG(sb->st_mode))
-		return 0;
-
 	included = match_any_regex(opts.include, fpath);
 	excluded = match_any_regex(opts.exclude, fpath);
 
@@ -832,39 +1393,36 @@ static int inserter(const char *fpath, const struct stat *sb,
 
 	fil = xcalloc(1, sizeof(*fil));
 	fil->links = xcalloc(1, sizeof(struct link) + pathlen);
+	stats.memory += sizeof(*fil) + sizeof(struct link) + pathlen;
 
-	fil->st = *sb;
-	fil->links->basename = ftwbuf->base;
+	file_stat_init(&fil->st, sb);
+	fil->links->basename = base;
 	fil->links->next = NULL;
 
 	memcpy(fil->links->path, fpath, pathlen);
 
-	node = tsearch(fil, &files_by_ino, compare_nodes_ino);
-
-	if (node == NULL)
-		goto fail;
+	node = file_table_insert(&files_by_ino, fil);
 
 	if (*node != fil) {
 		/* Already known inode, add link to inode information */
-		assert((*node)->st.st_dev == sb->st_dev);
-		assert((*node)->st.st_ino == sb->st_ino);
+		assert((*node)->st.dev == sb->st_dev);
+		assert((*node)->st.ino == sb->st_ino);
 
 		if (has_fpath(*node, fpath)) {
 			jlog(JLOG_VERBOSE1,
 				_("Skipped %s (specified more than once)"), fpath);
 			free(fil->links);
+			stats.memory -= sizeof(struct link) + pathlen;
 		} else {
 			fil->links->next = (*node)->links;
 			(*node)->links = fil->links;
 		}
 
 		free(fil);
+		stats.memory -= sizeof(*fil);
 	} else {
 		/* New inode, insert into by-size table */
-		node = tsearch(fil, &files, compare_nodes);
-
-		if (node == NULL)
-			goto fail;
+		node = file_table_insert(&files, fil);
 
 		if (*node != fil) {
 			struct file *l;
@@ -888,17 +1446,36 @@ static int inserter(const char *fpath, const struct stat *sb,
 	}
 
 	return 0;
+}
 
- fail:
-	warn(_("cannot continue"));	/* probably ENOMEM */
-	return 0;
+/**
+ * inserter - Callback function for nftw()
+ * @fpath: The path of the file being visited
+ * @sb:    The stat information of the file
+ * @typeflag: The type flag
+ * @ftwbuf:   Contains current level of nesting and offset of basename
+ *
+ * Called by nftw() for the files. See the manual page for nftw() for
+ * further information.
+ */
+static int inserter(const char *fpath, const struct stat *sb,
+		    int typeflag, struct FTW *ftwbuf)
+{
+	if (handle_interrupt())
+		return 1;
+	if (typeflag == FTW_DNR || typeflag == FTW_NS)
+		warn(_("cannot read %s"), fpath);
+	if (typeflag != FTW_F || !S_ISREG(sb->st_mode))
+		return 0;
+
+	return insert_file(fpath, sb, ftwbuf->base);
 }
 
 #ifdef USE_REFLINK
 static int is_reflink_compatible(dev_t devno, const char *filename)
 {
-	static dev_t last_dev = 0;
-	static int last_status = 0;
+	static __thread dev_t last_dev = 0;
+	static __thread int last_status = 0;
 
 	if (last_dev != devno) {
 		struct statfs vfs;
@@ -921,68 +1498,97 @@ static int is_reflink_compatible(dev_t devno, const char *filename)
 	return last_status;
 }
 
-static int is_reflink(struct file *xa, struct file *xb)
+/**
+ * read_extents_fp - Calculate the fingerprint of the file extents
+ * @filename: The file
+ * @fp:       Returns the fingerprint
+ *
+ * Returns: 1 if all extents of the file are shared, 0 otherwise (@fp is
+ * undefined).
+ */
+static int read_extents_fp(const char *filename, uint64_t *fp)
 {
-	int last = 0, rc = 0;
-	char abuf[BUFSIZ] = { 0 },
-	     bbuf[BUFSIZ] = { 0 };
-
-	struct fiemap *amap = (struct fiemap *) abuf,
-		      *bmap = (struct fiemap *) bbuf;
-
-	int af = open(xa->links->path, O_RDONLY),
-	    bf = open(xb->links->path, O_RDONLY);
+	char buf[BUFSIZ] = { 0 };
+	struct fiemap *map = (struct fiemap *) buf;
+	uint64_t hash = 0;
+	int fd, last = 0, rc = 0;
 
-	if (af < 0 || bf < 0)
-		goto done;
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return 0;
 
 	do {
 		size_t i;
 
-		amap->fm_length = ~0ULL;
-		amap->fm_flags = FIEMAP_FLAG_SYNC;
-		amap->fm_extent_count =	(sizeof(abuf) - sizeof(*amap)) / sizeof(struct fiemap_extent);
+		map->fm_length = ~0ULL;
+		map->fm_flags = FIEMAP_FLAG_SYNC;
+		map->fm_extent_count = (sizeof(buf) - sizeof(*map)) / sizeof(struct fiemap_extent);
 
-		bmap->fm_length = ~0ULL;
-		bmap->fm_flags = FIEMAP_FLAG_SYNC;
-		bmap->fm_extent_count =	(sizeof(bbuf) - sizeof(*bmap)) / sizeof(struct fiemap_extent);
-
-		if (ioctl(af, FS_IOC_FIEMAP, (unsigned long) amap) < 0)
-			goto done;
-		if (ioctl(bf, FS_IOC_FIEMAP, (unsigned long) bmap) < 0)
-			goto done;
-
-		if (amap->fm_mapped_extents != bmap->fm_mapped_extents)
+		if (ioctl(fd, FS_IOC_FIEMAP, (unsigned long) map) < 0)
 			goto done;
+		if (map->fm_mapped_extents == 0)
+			break;
 
-		for (i = 0; i < amap->fm_mapped_extents; i++) {
-			struct fiemap_extent *a = &amap->fm_extents[i];
-			struct fiemap_extent *b = &bmap->fm_extents[i];
+		for (i = 0; i < map->fm_mapped_extents; i++) {
+			struct fiemap_extent *e = &map->fm_extents[i];
+			uint64_t ext[3] = { e->fe_logical, e->fe_physical, e->fe_length };
 
-			if (a->fe_logical != b->fe_logical ||
-			    a->fe_length !=  b->fe_length ||
-			    a->fe_physical != b->fe_physical)
-				goto done;
-			if (!(a->fe_flags & FIEMAP_EXTENT_SHARED) ||
-			    !(b->fe_flags & FIEMAP_EXTENT_SHARED))
+			if (!(e->fe_flags & FIEMAP_EXTENT_SHARED))
 				goto done;
-			if (a->fe_flags & FIEMAP_EXTENT_LAST)
+
+			hash = ul_xxh64(ext, sizeof(ext), hash);
+			if (e->fe_flags & FIEMAP_EXTENT_LAST)
 				last = 1;
 		}
 
-		bmap->fm_start = amap->fm_start =
-			amap->fm_extents[amap->fm_mapped_extents - 1].fe_logical +
-			amap->fm_extents[amap->fm_mapped_extents - 1].fe_length;
+		map->fm_start =
+			map->fm_extents[map->fm_mapped_extents - 1].fe_logical +
+			map->fm_extents[map->fm_mapped_extents - 1].fe_length;
 	} while (last == 0);
 
-	rc = 1;
+	/* a file without extents (sparse) does not share anything */
+	rc = hash != 0;
+	*fp = hash;
 done:
-	if (af >= 0)
-		close(af);
-	if (bf >= 0)
-		close(bf);
+	close(fd);
 	return rc;
 }
+
+/**
+ * get_extents_fp - Get the fingerprint of the file extents
+ * @fil: The file
+ * @fp:  Returns the fingerprint
+ *
+ * The fingerprint is a hash of the logical and physical positions of all file
+ * extents. It's read only once for the file, so the FIEMAP pre-pass costs one
+ * ioctl() per file rather than per pair of compared files.
+ *
+ * Returns: 1 if all extents of the file are shared, 0 otherwise.
+ */
+static int get_extents_fp(struct file *fil, uint64_t *fp)
+{
+	if (!fil->extents_checked) {
+		fil->extents_shared = read_extents_fp(fil->links->path,
+						      &fil->extents_fp);
+		fil->extents_checked = 1;
+	}
+	*fp = fil->extents_fp;
+	return fil->extents_shared;
+}
+
+/*
+ * The files with the same fingerprint of all shared extents are already
+ * reflinks, no data have to be read to know that they are equal. (A hash
+ * collision would only skip one possible link.)
+ */
+static int is_reflink(struct file *xa, struct file *xb)
+{
+	uint64_t a, b;
+
+	return get_extents_fp(xa, &a)
+	       && get_extents_fp(xb, &b)
+	       && a == b;
+}
 #endif /* USE_REFLINK */
 
 static inline size_t count_nodes(struct file *x)
@@ -996,33 +1602,55 @@ static inline size_t count_nodes(struct file *x)
 }
 
 /**
- * visitor - Callback for twalk()
- * @nodep: Pointer to a pointer to a #struct file
- * @which: At which point this visit is (preorder, postorder, endorder)
- * @depth: The depth of the node in the tree
- *
- * Visit the nodes in the binary tree. For each node, call hardlinker()
- * on each #struct file in the linked list of #struct file instances located
- * at that node.
+ * struct link_plan - Files to be linked together
+ * @master: The file to link to
+ * @other:  The file to be replaced
+ * @reflink: Whether to create a reflink rather than a hardlink
  */
-static void visitor(const void *nodep, const VISIT which, const int depth)
-{
-	struct file *master = *(struct file **)nodep;
-	struct file *begin = master;
+struct link_plan {
+	struct file *master;
 	struct file *other;
+	int reflink;
+};
 
-	(void)depth;
+/**
+ * struct size_group - Files with the same size
+ * @head:   The first #struct file in the list
+ * @plans:  The links to create, result of compare_group()
+ * @nplans: The number of links
+ * @next:   Next compared group (used by compare_parallel())
+ */
+struct size_group {
+	struct file *head;
 
-	if (which != leaf && which != endorder)
-		return;
+	struct link_plan *plans;
+	size_t nplans;
+
+	struct size_group *next;
+};
+
+/**
+ * compare_group - Find equal files in a group
+ * @eq:  The content comparator
+ * @grp: The group of files
+ *
+ * Compare the files in the group and add to @grp->plans each file which can
+ * be replaced by a link to another file. This function does not modify the
+ * filesystem and does not touch any other group, so it may be called for more
+ * groups in parallel.
+ */
+static void compare_group(struct ul_fileeq *eq, struct size_group *grp)
+{
+	struct file *master, *other;
+	size_t maxplans = 0;
 
-	for (; master != NULL; master = master->next) {
+	for (master = grp->head; master != NULL; master = master->next) {
 		size_t nnodes, memsiz;
 		int may_reflink = 0;
 
 		if (handle_interrupt())
-			exit(EXIT_FAILURE);
-		if (master->links == NULL)
+			break;
+		if (master->links == NULL || master->merged)
 			continue;
 
 		/* calculate per file max memory use */
@@ -1030,29 +1658,30 @@ static void visitor(const void *nodep, const VISIT which, const int depth)
 		if (!nnodes)
 			continue;
 
-		/* per-file cache size */
-		memsiz = opts.cache_size / nnodes;
-		/*                                filesiz,      readsiz,      memsiz */
-		ul_fileeq_set_size(&fileeq, master->st.st_size, opts.io_size, memsiz);
+		/* per-file cache size, the cache is shared by all threads */
+		memsiz = opts.cache_size / opts.threads / nnodes;
+		/*                            filesiz,      readsiz,      memsiz */
+		ul_fileeq_set_size(eq, master->st.size, opts.io_size, memsiz);
 
 #ifdef USE_REFLINK
 		if (reflink_mode || reflinks_skip) {
 			may_reflink =
 				reflink_mode == REFLINK_ALWAYS ? 1 :
-				is_reflink_compatible(master->st.st_dev,
+				is_reflink_compatible(master->st.dev,
 							    master->links->path);
 		}
 #endif
 		for (other = master->next; other != NULL; other = other->next) {
-			int eq;
+			struct link_plan *plan;
+			int eq_content;
 
 			if (handle_interrupt())
-				exit(EXIT_FAILURE);
+				break;
 
 			assert(other != other->next);
-			assert(other->st.st_size == master->st.st_size);
+			assert(other->st.size == master->st.size);
 
-			if (!other->links)
+			if (!other->links || other->merged)
 				continue;
 
 			/* check file attributes, etc. */
@@ -1065,46 +1694,646 @@ static void visitor(const void *nodep, const VISIT which, const int depth)
 			if (may_reflink && reflinks_skip && is_reflink(master, other)) {
 				jlog(JLOG_VERBOSE2,
 				     _("Skipped (already reflink) %s"), other->links->path);
-				stats.ignored_reflinks++;
+				stats_inc(ignored_reflinks);
 				continue;
 			}
 #endif
 			/* initialize content comparison */
-			if (!ul_fileeq_data_associated(&master->data))
-				ul_fileeq_data_set_file(&master->data, master->links->path);
-			if (!ul_fileeq_data_associated(&other->data))
-				ul_fileeq_data_set_file(&other->data, other->links->path);
+			if (!ul_fileeq_data_associated(file_data(master))) {
+				ul_fileeq_data_set_file(master->data, master->links->path);
+				dcache_restore(eq, master);
+			}
+			if (!ul_fileeq_data_associated(file_data(other))) {
+				ul_fileeq_data_set_file(other->data, other->links->path);
+				dcache_restore(eq, other);
+			}
 
 			/* compare files */
-			eq = ul_fileeq(&fileeq, &master->data, &other->data);
+			eq_content = ul_fileeq(eq, master->data, other->data);
 
 			/* reduce number of open files, keep only master open */
-			ul_fileeq_data_close_file(&other->data);
+			ul_fileeq_data_close_file(other->data);
 
-			stats.comparisons++;
+			stats_inc(comparisons);
 
-			if (!eq) {
+			if (!eq_content) {
 				jlog(JLOG_VERBOSE2,
 				     _("Skipped (content mismatch) %s"), other->links->path);
 				continue;
 			}
 
-			/* link files */
-			if (!file_link(master, other, may_reflink) && errno == EMLINK) {
-				ul_fileeq_data_deinit(&master->data);
-				master = other;
+			/* remember the link, the file is not a master anymore */
+			if (grp->nplans == maxplans) {
+				maxplans = maxplans ? maxplans * 2 : 8;
+				grp->plans = xrealloc(grp->plans,
+						maxplans * sizeof(struct link_plan));
 			}
+			plan = &grp->plans[grp->nplans++];
+			plan->master = master;
+			plan->other = other;
+			plan->reflink = may_reflink;
+			other->merged = 1;
 		}
 
 		/* don't keep master data in memory */
-		ul_fileeq_data_deinit(&master->data);
+		file_data_free(eq, master);
 	}
 
 	/* final cleanup */
-	for (other = begin; other != NULL; other = other->next) {
-		if (ul_fileeq_data_associated(&other->data))
-			ul_fileeq_data_deinit(&other->data);
+	for (other = grp->head; other != NULL; other = other->next)
+		file_data_free(eq, other);
+}
+
+/**
+ * link_group - Create the links planned by compare_group()
+ * @grp: The group of files
+ *
+ * Must be called by the main thread only.
+ */
+static void link_group(struct size_group *grp)
+{
+	struct file *full = NULL, *replacement = NULL;
+	size_t i;
+
+	for (i = 0; i < grp->nplans; i++) {
+		struct link_plan *plan = &grp->plans[i];
+		struct file *master = plan->master;
+
+		if (handle_interrupt())
+			exit(EXIT_FAILURE);
+
+		/* the master cannot have more links, continue with the last
+		 * file linked to it (the files have the same content) */
+		if (master == full)
+			master = replacement;
+
+		if (!file_link(master, plan->other, plan->reflink) && errno == EMLINK) {
+			full = plan->master;
+			replacement = plan->other;
+		}
+	}
+
+	free(grp->plans);
+	grp->plans = NULL;
+	grp->nplans = 0;
+}
+
+/**
+ * collect_groups - Get the lists of files to compare
+ * @ngroups: Returns the number of groups
+ *
+ * Returns: array of groups (lists with more than one file) from the files
+ * table, or NULL if there is nothing to compare.
+ */
+static struct size_group *collect_groups(size_t *ngroups)
+{
+	struct size_group *groups = NULL;
+	size_t i, n = 0, max = 0;
+
+	for (i = 0; i < files.size; i++) {
+		struct file *head = files.slots[i];
+
+		if (!head || !head->next)
+			continue;	/* nothing to compare */
+
+		if (n == max) {
+			max = max ? max * 2 : 1024;
+			groups = xrealloc(groups, max * sizeof(struct size_group));
+		}
+		memset(&groups[n], 0, sizeof(struct size_group));
+		groups[n++].head = head;
 	}
+
+	*ngroups = n;
+	return groups;
+}
+
+/* sort by device and size, the output does not depend on the hash */
+static int cmp_groups_by_key(const void *_a, const void *_b)
+{
+	const struct size_group *a = _a, *b = _b;
+	int diff = CMP(a->head->st.dev, b->head->st.dev);
+
+	if (diff == 0)
+		diff = CMP(a->head->st.size, b->head->st.size);
+	return diff;
+}
+
+/**
+ * compare_serial - Compare and link the files
+ *
+ * For each list of files with the same size compare the files and link the
+ * equal files.
+ */
+static void compare_serial(void)
+{
+	struct size_group *groups;
+	size_t i, ngroups;
+
+	groups = collect_groups(&ngroups);
+	if (!groups)
+		return;
+
+	qsort(groups, ngroups, sizeof(struct size_group), cmp_groups_by_key);
+
+	for (i = 0; i < ngroups; i++) {
+		compare_group(&fileeq, &groups[i]);
+		if (handle_interrupt())
+			exit(EXIT_FAILURE);
+		link_group(&groups[i]);
+	}
+	free(groups);
+}
+
+/*
+ * Threads pool
+ *
+ * The workers run with all signals blocked, the signals are handled by the
+ * main thread. The main thread waits for the results by pool_wait(), which
+ * returns after a while also if there is no result to handle SIGUSR1.
+ */
+struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t result;		/* signaled to the main thread */
+	pthread_t *tids;
+	size_t nthreads;
+	size_t nrunning;
+};
+
+static void pool_start(struct pool *pool, void *(*fn)(void *), void **args)
+{
+	sigset_t all, old;
+	size_t i;
+	int rc;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->result, NULL);
+	pool->tids = xcalloc(opts.threads, sizeof(pthread_t));
+	pool->nthreads = 0;
+	pool->nrunning = opts.threads;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+
+	for (i = 0; i < opts.threads; i++) {
+		rc = pthread_create(&pool->tids[i], NULL, fn, args[i]);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, _("failed to create thread"));
+		}
+		pool->nthreads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/* called by a worker before it returns */
+static void pool_worker_done(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->nrunning--;
+	pthread_cond_signal(&pool->result);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* called with locked pool->lock */
+static void pool_wait(struct pool *pool)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += 100 * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(&pool->result, &pool->lock, &ts);
+}
+
+static void pool_join(struct pool *pool)
+{
+	size_t i;
+
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->tids[i], NULL);
+
+	free(pool->tids);
+	pthread_cond_destroy(&pool->result);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/*
+ * Parallel scan
+ *
+ * Every thread has a queue of directories. The thread takes directories from
+ * the tail of its own queue (depth-first) and if the queue is empty it steals
+ * directories from the head of the other queues. The regular files are passed
+ * in batches to the main thread, which filters them and inserts them to the
+ * tables by insert_file().
+ */
+#define SCAN_BATCH	256
+
+struct scan_entry {
+	struct scan_entry *next;
+	struct stat st;
+	int basename;
+	char path[];
+};
+
+struct scan_queue {
+	pthread_mutex_t lock;
+	char **dirs;
+	size_t head;	/* first queued directory */
+	size_t tail;	/* after the last queued directory */
+	size_t size;	/* allocated dirs[] */
+};
+
+struct scan_thread {
+	size_t idx;
+	struct scan_queue queue;
+
+	struct scan_entry *batch;	/* not yet passed to the main thread */
+	size_t nbatch;
+};
+
+static struct scan_control {
+	struct pool pool;		/* lock protects also @found */
+	struct scan_thread *threads;
+
+	pthread_cond_t work;		/* idle workers wait for directories */
+	size_t nidle;			/* waiting workers */
+	size_t nqueued;			/* directories in the queues */
+	size_t pending;			/* queued and being read directories */
+
+	struct scan_entry *found;	/* files for the main thread */
+} scan;
+
+static void scan_push(struct scan_thread *th, char *dir)
+{
+	struct scan_queue *q = &th->queue;
+
+	__atomic_add_fetch(&scan.pending, 1, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail == q->size) {
+		if (q->head > q->size / 2) {
+			/* reuse space left by stolen directories */
+			memmove(q->dirs, q->dirs + q->head,
+				(q->tail - q->head) * sizeof(char *));
+			q->tail -= q->head;
+			q->head = 0;
+		} else {
+			q->size = q->size ? q->size * 2 : 64;
+			q->dirs = xrealloc(q->dirs, q->size * sizeof(char *));
+		}
+	}
+	q->dirs[q->tail++] = dir;
+	pthread_mutex_unlock(&q->lock);
+
+	__atomic_add_fetch(&scan.nqueued, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&scan.nidle, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&scan.pool.lock);
+		pthread_cond_signal(&scan.work);
+		pthread_mutex_unlock(&scan.pool.lock);
+	}
+}
+
+static char *scan_pop(struct scan_queue *q, int steal)
+{
+	char *dir = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail) {
+		dir = steal ? q->dirs[q->head++] : q->dirs[--q->tail];
+		if (q->head == q->tail)
+			q->head = q->tail = 0;
+		__atomic_sub_fetch(&scan.nqueued, 1, __ATOMIC_SEQ_CST);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return dir;
+}
+
+/* returns the next directory or NULL when all is done */
+static char *scan_next(struct scan_thread *th)
+{
+	size_t i;
+	char *dir;
+
+	for (;;) {
+		dir = scan_pop(&th->queue, 0);
+		for (i = 1; !dir && i < opts.threads; i++)
+			dir = scan_pop(&scan.threads[(th->idx + i) % opts.threads].queue, 1);
+		if (dir)
+			return dir;
+
+		pthread_mutex_lock(&scan.pool.lock);
+		__atomic_add_fetch(&scan.nidle, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&scan.nqueued, __ATOMIC_SEQ_CST) == 0
+		       && __atomic_load_n(&scan.pending, __ATOMIC_SEQ_CST) != 0)
+			pthread_cond_wait(&scan.work, &scan.pool.lock);
+		__atomic_sub_fetch(&scan.nidle, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&scan.pool.lock);
+
+		if (__atomic_load_n(&scan.pending, __ATOMIC_SEQ_CST) == 0)
+			return NULL;
+	}
+}
+
+static void scan_flush(struct scan_thread *th)
+{
+	struct scan_entry *last;
+
+	if (!th->batch)
+		return;
+
+	for (last = th->batch; last->next; last = last->next);
+
+	pthread_mutex_lock(&scan.pool.lock);
+	last->next = scan.found;
+	scan.found = th->batch;
+	pthread_cond_signal(&scan.pool.result);
+	pthread_mutex_unlock(&scan.pool.lock);
+
+	th->batch = NULL;
+	th->nbatch = 0;
+}
+
+static void scan_dir(struct scan_thread *th, const char *dir)
+{
+	struct dirent *d;
+	size_t dirlen = strlen(dir);
+	DIR *dp;
+
+	/* don't add '/' after "/" */
+	if (dirlen && dir[dirlen - 1] == '/')
+		dirlen--;
+
+	dp = opendir(dir);
+	if (!dp) {
+		warn(_("cannot read %s"), dir);
+		return;
+	}
+
+	while ((d = readdir(dp))) {
+		struct scan_entry *ent;
+		size_t namelen;
+		struct stat st;
+
+		if (handle_interrupt())
+			break;
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		/* symlinks, devices, ... are never followed */
+		if (d->d_type != DT_UNKNOWN && d->d_type != DT_REG
+		    && d->d_type != DT_DIR)
+			continue;
+#endif
+		namelen = strlen(d->d_name);
+		ent = xmalloc(sizeof(*ent) + dirlen + 1 + namelen + 1);
+		memcpy(ent->path, dir, dirlen);
+		ent->path[dirlen] = '/';
+		memcpy(ent->path + dirlen + 1, d->d_name, namelen + 1);
+
+		if (fstatat(dirfd(dp), d->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+			warn(_("cannot read %s"), ent->path);
+			free(ent);
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			scan_push(th, xstrdup(ent->path));
+			free(ent);
+		} else if (S_ISREG(st.st_mode)) {
+			ent->st = st;
+			ent->basename = dirlen + 1;
+			ent->next = th->batch;
+			th->batch = ent;
+			if (++th->nbatch >= SCAN_BATCH)
+				scan_flush(th);
+		} else
+			free(ent);
+	}
+
+	closedir(dp);
+}
+
+static void *scan_worker(void *arg)
+{
+	struct scan_thread *th = (struct scan_thread *) arg;
+	char *dir;
+
+	while ((dir = scan_next(th))) {
+		if (!handle_interrupt())
+			scan_dir(th, dir);
+		free(dir);
+
+		if (__atomic_sub_fetch(&scan.pending, 1, __ATOMIC_SEQ_CST) == 0) {
+			/* all done, wake up idle workers */
+			pthread_mutex_lock(&scan.pool.lock);
+			pthread_cond_broadcast(&scan.work);
+			pthread_mutex_unlock(&scan.pool.lock);
+		}
+	}
+
+	scan_flush(th);
+	pool_worker_done(&scan.pool);
+	return NULL;
+}
+
+/* insert found files to the tables, called with locked scan.pool.lock */
+static void scan_insert_found(void)
+{
+	struct scan_entry *ent = scan.found;
+
+	scan.found = NULL;
+	pthread_mutex_unlock(&scan.pool.lock);
+
+	while (ent) {
+		struct scan_entry *next = ent->next;
+
+		if (!handle_interrupt())
+			insert_file(ent->path, &ent->st, ent->basename);
+		free(ent);
+		ent = next;
+	}
+
+	pthread_mutex_lock(&scan.pool.lock);
+}
+
+/**
+ * scan_parallel - Scan the files by opts.threads threads
+ * @paths: The directories and files specified on command line
+ * @npaths: The number of @paths
+ *
+ * The parallel version of nftw() and inserter().
+ */
+static void scan_parallel(char **paths, size_t npaths)
+{
+	void **args;
+	size_t i;
+
+	scan.threads = xcalloc(opts.threads, sizeof(struct scan_thread));
+	args = xcalloc(opts.threads, sizeof(void *));
+	pthread_cond_init(&scan.work, NULL);
+
+	for (i = 0; i < opts.threads; i++) {
+		scan.threads[i].idx = i;
+		pthread_mutex_init(&scan.threads[i].queue.lock, NULL);
+		args[i] = &scan.threads[i];
+	}
+
+	for (i = 0; i < npaths; i++) {
+		char *path = realpath(paths[i], NULL);
+		struct stat st;
+		char *base;
+
+		if (!path) {
+			warn(_("cannot get realpath: %s"), paths[i]);
+			continue;
+		}
+		if (lstat(path, &st) != 0) {
+			warn(_("cannot read %s"), path);
+			free(path);
+		} else if (S_ISDIR(st.st_mode)) {
+			/* distribute the directories to the threads */
+			scan_push(&scan.threads[i % opts.threads], path);
+		} else {
+			if (S_ISREG(st.st_mode)) {
+				base = strrchr(path, '/');
+				insert_file(path, &st, base ? base - path + 1 : 0);
+			}
+			free(path);
+		}
+	}
+
+	pool_start(&scan.pool, scan_worker, args);
+
+	pthread_mutex_lock(&scan.pool.lock);
+	while (scan.pool.nrunning || scan.found) {
+		if (scan.found)
+			scan_insert_found();
+		else {
+			pool_wait(&scan.pool);
+			/* SIGUSR1; on SIGINT the workers stop, wait for them */
+			handle_interrupt();
+		}
+	}
+	pthread_mutex_unlock(&scan.pool.lock);
+
+	pool_join(&scan.pool);
+
+	for (i = 0; i < opts.threads; i++) {
+		pthread_mutex_destroy(&scan.threads[i].queue.lock);
+		free(scan.threads[i].queue.dirs);
+	}
+	pthread_cond_destroy(&scan.work);
+	free(scan.threads);
+	free(args);
+
+	if (handle_interrupt())
+		exit(EXIT_FAILURE);
+}
+
+/*
+ * Parallel comparison
+ *
+ * The groups of files with the same size are compared by the workers, each
+ * with its own comparator. The results are linked by the main thread.
+ */
+static struct compare_control {
+	struct pool pool;		/* lock protects also @done */
+
+	struct size_group *groups;
+	size_t ngroups;
+	size_t next;			/* next group to compare */
+
+	struct size_group *done;		/* compared groups for the main thread */
+} cmp;
+
+/* the largest amount of data first, to not finish by one huge group */
+static int cmp_groups(const void *_a, const void *_b)
+{
+	const struct size_group *a = _a, *b = _b;
+	double sa = (double) a->head->st.size * count_nodes(a->head),
+	       sb = (double) b->head->st.size * count_nodes(b->head);
+
+	return CMP(sb, sa);
+}
+
+static void *compare_worker(void *arg __attribute__((__unused__)))
+{
+	struct ul_fileeq eq;
+
+	if (ul_fileeq_init(&eq, opts.method) != 0)
+		err(EXIT_FAILURE, _("failed to initialize files comparior"));
+
+	while (!handle_interrupt()) {
+		size_t i = __atomic_fetch_add(&cmp.next, 1, __ATOMIC_RELAXED);
+		struct size_group *grp;
+
+		if (i >= cmp.ngroups)
+			break;
+
+		grp = &cmp.groups[i];
+		compare_group(&eq, grp);
+
+		pthread_mutex_lock(&cmp.pool.lock);
+		grp->next = cmp.done;
+		cmp.done = grp;
+		pthread_cond_signal(&cmp.pool.result);
+		pthread_mutex_unlock(&cmp.pool.lock);
+	}
+
+	ul_fileeq_deinit(&eq);
+	pool_worker_done(&cmp.pool);
+	return NULL;
+}
+
+/**
+ * compare_parallel - Compare and link the files by opts.threads threads
+ *
+ * The parallel version of compare_serial().
+ */
+static void compare_parallel(void)
+{
+	void **args;
+
+	cmp.groups = collect_groups(&cmp.ngroups);
+	if (!cmp.groups)
+		return;
+
+	qsort(cmp.groups, cmp.ngroups, sizeof(struct size_group), cmp_groups);
+
+	args = xcalloc(opts.threads, sizeof(void *));
+	pool_start(&cmp.pool, compare_worker, args);
+
+	pthread_mutex_lock(&cmp.pool.lock);
+	while (cmp.pool.nrunning || cmp.done) {
+		struct size_group *grp = cmp.done;
+
+		if (!grp) {
+			pool_wait(&cmp.pool);
+			if (handle_interrupt())
+				exit(EXIT_FAILURE);
+			continue;
+		}
+
+		cmp.done = NULL;
+		pthread_mutex_unlock(&cmp.pool.lock);
+
+		for (; grp; grp = grp->next)
+			link_group(grp);
+
+		pthread_mutex_lock(&cmp.pool.lock);
+	}
+	pthread_mutex_unlock(&cmp.pool.lock);
+
+	pool_join(&cmp.pool);
+	free(cmp.groups);
+	free(args);
 }
 
 /**
@@ -1151,6 +2380,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -b, --io-size <size>       I/O buffer size for file reading\n"
 	        "                              (speedup, using more RAM)\n"), out);
 	fputs(_(" -r, --cache-size <size>    memory limit for cached file content data\n"), out);
+	fputs(_(" -j, --threads <num>        number of threads to scan and compare files\n"), out);
+	fputs(_("     --digest-cache <file>  reuse content digests of unmodified files\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(28));
@@ -1168,9 +2399,10 @@ static int parse_options(int argc, char *argv[])
 {
 	enum {
 		OPT_REFLINK = CHAR_MAX + 1,
-		OPT_SKIP_RELINKS
+		OPT_SKIP_RELINKS,
+		OPT_DIGEST_CACHE
 	};
-	static const char optstr[] = "VhvnfpotXcmMOx:y:i:r:S:s:b:q";
+	static const char optstr[] = "VhvnfpotXcmMOx:y:i:r:S:s:b:qj:";
 	static const struct option long_options[] = {
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
@@ -1197,6 +2429,8 @@ static int parse_options(int argc, char *argv[])
 		{"content", no_argument, NULL, 'c'},
 		{"quiet", no_argument, NULL, 'q'},
 		{"cache-size", required_argument, NULL, 'r'},
+		{"threads", required_argument, NULL, 'j'},
+		{"digest-cache", required_argument, NULL, OPT_DIGEST_CACHE},
 		{NULL, 0, NULL, 0}
 	};
 	static const ul_excl_t excl[] = {
@@ -1272,6 +2506,14 @@ static int parse_options(int argc, char *argv[])
 		case 'b':
 			opts.io_size = strtosize_or_err(optarg, _("failed to parse I/O size"));
 			break;
+		case 'j':
+			opts.threads = strtou32_or_err(optarg, _("failed to parse number of threads"));
+			if (!opts.threads)
+				errx(EXIT_FAILURE, _("number of threads must be greater than zero"));
+			break;
+		case OPT_DIGEST_CACHE:
+			opts.digest_cache = optarg;
+			break;
 #ifdef USE_REFLINK
 		case OPT_REFLINK:
 			reflink_mode = REFLINK_AUTO;
@@ -1349,6 +2591,8 @@ int main(int argc, char *argv[])
 	sigaction(SIGINT, &sa, NULL);
 	sigaction(SIGUSR1, &sa, NULL);
 
+	main_thread = pthread_self();
+
 	/* Localize messages, number formatting, and anything else. */
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -1381,22 +2625,32 @@ int main(int argc, char *argv[])
 			opts.io_size = 1024*1024;
 	}
 
+	if (opts.digest_cache)
+		dcache_load(opts.digest_cache);
+
 	stats.started = TRUE;
 
 	jlog(JLOG_VERBOSE2, _("Scanning [device/inode/links]:"));
-	for (; optind < argc; optind++) {
-		char *path = realpath(argv[optind], NULL);
+	if (opts.threads > 1) {
+		scan_parallel(argv + optind, argc - optind);
+		compare_parallel();
+	} else {
+		for (; optind < argc; optind++) {
+			char *path = realpath(argv[optind], NULL);
 
-		if (!path) {
-			warn(_("cannot get realpath: %s"), argv[optind]);
-			continue;
+			if (!path) {
+				warn(_("cannot get realpath: %s"), argv[optind]);
+				continue;
+			}
+			if (nftw(path, inserter, 20, FTW_PHYS) == -1)
+				warn(_("cannot process %s"), path);
+			free(path);
 		}
-		if (nftw(path, inserter, 20, FTW_PHYS) == -1)
-			warn(_("cannot process %s"), path);
-		free(path);
+
+		compare_serial();
 	}
 
-	twalk(files, visitor);
+	dcache_save();
 
 	ul_fileeq_deinit(&fileeq);
 	return 0;
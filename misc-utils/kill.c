@@ -90,6 +90,7 @@ struct kill_control {
 #endif
 #ifdef UL_HAVE_PIDFD
 	struct list_head follow_ups;
+	int pidfd;			/* ctl->pid or -1 */
 #endif
 	unsigned int
 		check_all:1,
@@ -394,7 +395,9 @@ static int kill_with_timeout(const struct kill_control *ctl)
 	info.si_value.sival_int =
 	    ctl->use_sigval != 0 ? ctl->use_sigval : ctl->numsig;
 
-	if ((pfd = pidfd_open(ctl->pid, 0)) < 0)
+	if (ctl->pidfd >= 0)
+		pfd = ctl->pidfd;
+	else if ((pfd = pidfd_open(ctl->pid, 0)) < 0)
 		err(EXIT_FAILURE, _("pidfd_open() failed: %d"), ctl->pid);
 	p.fd = pfd;
 	p.events = POLLIN;
@@ -434,6 +437,8 @@ static int kill_verbose(const struct kill_control *ctl)
 #ifdef UL_HAVE_PIDFD
 	if (ctl->timeout) {
 		rc = kill_with_timeout(ctl);
+	} else if (ctl->pidfd >= 0 && !ctl->use_sigval) {
+		rc = pidfd_send_signal(ctl->pidfd, ctl->numsig, NULL, 0);
 	} else
 #endif
 #ifdef HAVE_SIGQUEUE
@@ -448,6 +453,76 @@ static int kill_verbose(const struct kill_control *ctl)
 	return rc;
 }
 
+struct kill_target {
+	pid_t pid;
+	int pidfd;
+};
+
+/*
+ * Sends the signal to all processes with the name ctl->arg. The processes are
+ * collected first and signaled after the /proc scan. The pidfd of the process
+ * is opened when the process matches and the name is checked again, so the
+ * signal is never sent to another process which reused the PID.
+ *
+ * Returns the number of the signaled processes, @nerrs is incremented for
+ * every failed one.
+ */
+static size_t kill_by_name(struct kill_control *ctl, int *nerrs)
+{
+	struct kill_target *targets = NULL;
+	struct procfs_scan sc;
+	size_t i, ntargets = 0;
+	uid_t uid = !ctl->check_all ? getuid() : 0;
+	pid_t pid;
+
+	if (procfs_scan_open(&sc, NULL) != 0)
+		return 0;
+
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		int pidfd = -1;
+
+		if (!ctl->check_all &&
+		    !procfs_scan_match_uid(&sc, uid))
+			continue;
+		if (!procfs_scan_match_name(&sc, ctl->arg))
+			continue;
+#ifdef UL_HAVE_PIDFD
+		if (!ctl->do_pid) {
+			pidfd = pidfd_open(pid, 0);
+			if (pidfd < 0 && errno == ESRCH)
+				continue;		/* already gone */
+			if (pidfd >= 0 && !procfs_scan_match_name(&sc, ctl->arg)) {
+				close(pidfd);		/* PID reused */
+				continue;
+			}
+		}
+#endif
+		if ((ntargets % 64) == 0)
+			targets = xrealloc(targets,
+					(ntargets + 64) * sizeof(struct kill_target));
+		targets[ntargets].pid = pid;
+		targets[ntargets].pidfd = pidfd;
+		ntargets++;
+	}
+	procfs_scan_close(&sc);
+
+	for (i = 0; i < ntargets; i++) {
+		ctl->pid = targets[i].pid;
+#ifdef UL_HAVE_PIDFD
+		ctl->pidfd = targets[i].pidfd;
+#endif
+		if (kill_verbose(ctl) != 0)
+			(*nerrs)++;
+		if (targets[i].pidfd >= 0)
+			close(targets[i].pidfd);
+	}
+#ifdef UL_HAVE_PIDFD
+	ctl->pidfd = -1;
+#endif
+	free(targets);
+	return ntargets;
+}
+
 int main(int argc, char **argv)
 {
 	struct kill_control ctl = { .numsig = SIGTERM };
@@ -460,6 +535,7 @@ int main(int argc, char **argv)
 
 #ifdef UL_HAVE_PIDFD
 	INIT_LIST_HEAD(&ctl.follow_ups);
+	ctl.pidfd = -1;
 #endif
 	argv = parse_arguments(argc, argv, &ctl);
 
@@ -474,35 +550,13 @@ int main(int argc, char **argv)
 				nerrs++;
 			ct++;
 		} else {
-			int found = 0;
-			struct dirent *d;
-			DIR *dir = opendir(_PATH_PROC);
-			uid_t uid = !ctl.check_all ? getuid() : 0;
-
-			if (!dir)
-				continue;
-
-			while ((d = xreaddir(dir))) {
-				if (!ctl.check_all &&
-				    !procfs_dirent_match_uid(dir, d, uid))
-					continue;
-				if (ctl.arg &&
-				    !procfs_dirent_match_name(dir, d, ctl.arg))
-					continue;
-				if (procfs_dirent_get_pid(d, &ctl.pid) != 0)
-					continue;
-
-				if (kill_verbose(&ctl) != 0)
-					nerrs++;
-				ct++;
-				found = 1;
-			}
+			size_t n = kill_by_name(&ctl, &nerrs);
 
-			closedir(dir);
-			if (!found) {
+			if (!n) {
 				nerrs++, ct++;
 				warnx(_("cannot find process \"%s\""), ctl.arg);
-			}
+			} else
+				ct += n;
 		}
 	}
 
@@ -53,6 +53,7 @@
 #include <pwd.h>
 #include <signal.h>
 #include <sys/uio.h>
+#include <poll.h>
 
 #include "all-io.h"
 #include "c.h"
@@ -64,6 +65,7 @@
 #include "strv.h"
 #include "list.h"
 #include "pwdutils.h"
+#include "monotonic.h"
 
 #define	SYSLOG_NAMES
 #include <syslog.h>
@@ -101,7 +103,8 @@ enum {
 	OPT_ID,
 	OPT_STRUCTURED_DATA_ID,
 	OPT_STRUCTURED_DATA_PARAM,
-	OPT_OCTET_COUNT
+	OPT_OCTET_COUNT,
+	OPT_QUEUE_SIZE
 };
 
 /* rfc5424 structured data */
@@ -112,11 +115,41 @@ struct structured_data {
 	struct list_head	sds;
 };
 
+/*
+ * The messages from stdin are collected and sent by one sendmmsg() (datagram
+ * sockets) or one send() (stream sockets). The batch is sent when full or
+ * before logger waits for more input.
+ *
+ * With --queue-size the batch is a queue of up to ctl->queue_size bytes. The
+ * socket is non-blocking, the messages which cannot be sent now stay in the
+ * queue, and the connection is reopened in the background with growing
+ * delays. The messages which do not fit into the queue are dropped.
+ */
+#define LOGGER_BATCH_MSGS	256
+#define LOGGER_BATCH_BYTES	(64 * 1024)
+
+#define LOGGER_RETRY_MAX	60	/* max. seconds between reconnects */
+#define LOGGER_DRAIN_TIMEOUT	5	/* seconds to send the queue on exit */
+
+struct logger_batch {
+	char	*buf;			/* the messages as sent */
+	size_t	len;
+	size_t	size;
+	size_t	*ends;			/* end offsets of the messages */
+	size_t	nmsgs;
+	size_t	nends;			/* allocated ends[] */
+
+	size_t	pos;			/* sent bytes (stream sockets in queue) */
+	size_t	new_msgs;		/* added since the last send */
+	size_t	new_bytes;
+};
+
 struct logger_ctl {
 	int fd;
 	int pri;
 	pid_t pid;			/* zero when unwanted */
 	char *hdr;			/* the syslog header (based on protocol) */
+	char *hostname;			/* cached for the headers */
 	char const *tag;
 	char *login;
 	char *msgid;
@@ -129,6 +162,13 @@ struct logger_ctl {
 	struct list_head reserved_sds;	/* standard rfc5424 structured data */
 
 	void (*syslogfp)(struct logger_ctl *ctl);
+	struct logger_batch *batch;	/* stdin messages to send, or NULL */
+
+	size_t queue_size;		/* --queue-size or 0 */
+	struct timeval retry_time;	/* next reconnect in the queue mode */
+	unsigned int retry_delay;	/* seconds */
+	size_t dropped;			/* messages not sent in the queue mode */
+	size_t failures;		/* failed connections in the queue mode */
 
 	unsigned int
 			unix_socket_errors:1,	/* whether to report or not errors */
@@ -143,6 +183,7 @@ struct logger_ctl {
 };
 
 #define is_connected(_ctl)	((_ctl)->fd >= 0)
+static void __logger_open(struct logger_ctl *ctl);
 static void logger_reopen(struct logger_ctl *ctl);
 
 /*
@@ -284,7 +325,9 @@ static int unix_socket(struct logger_ctl *ctl, const char *path, int *socket_typ
 	return fd;
 }
 
-static int inet_socket(const char *servername, const char *port, int *socket_type)
+/* the @nonblock socket may be still connecting, the errors are not fatal */
+static int inet_socket(const char *servername, const char *port, int *socket_type,
+		       int nonblock)
 {
 	int fd, errcode, i, type = -1;
 	struct addrinfo hints, *res;
@@ -308,14 +351,20 @@ static int inet_socket(const char *servername, const char *port, int *socket_typ
 			continue;
 		hints.ai_family = AF_UNSPEC;
 		errcode = getaddrinfo(servername, p, &hints, &res);
-		if (errcode != 0)
+		if (errcode != 0) {
+			if (nonblock)
+				return -1;
 			errx(EXIT_FAILURE, _("failed to resolve name %s port %s: %s"),
 			     servername, p, gai_strerror(errcode));
-		if ((fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) == -1) {
+		}
+		if ((fd = socket(res->ai_family,
+				 res->ai_socktype | (nonblock ? SOCK_NONBLOCK : 0),
+				 res->ai_protocol)) == -1) {
 			freeaddrinfo(res);
 			continue;
 		}
-		if (connect(fd, res->ai_addr, res->ai_addrlen) == -1) {
+		if (connect(fd, res->ai_addr, res->ai_addrlen) == -1
+		    && !(nonblock && errno == EINPROGRESS)) {
 			freeaddrinfo(res);
 			close(fd);
 			continue;
@@ -325,8 +374,11 @@ static int inet_socket(const char *servername, const char *port, int *socket_typ
 		break;
 	}
 
-	if (i == 0)
+	if (i == 0) {
+		if (nonblock)
+			return -1;
 		errx(EXIT_FAILURE, _("failed to connect to %s port %s"), servername, p);
+	}
 
 	/* replace ALL_TYPES with the real TYPE_* */
 	if (type > 0 && type != *socket_type)
@@ -435,6 +487,319 @@ static char const *rfc3164_current_time(void)
 #define iovec_memcmp(ary, idx, str, len)		\
 		memcmp((ary)[(idx) - 1].iov_base, str, len)
 
+#ifdef SCM_CREDENTIALS
+union logger_cmsg {
+	struct cmsghdr cmh;
+	char   control[CMSG_SPACE(sizeof(struct ucred))];
+};
+
+/* syslog/journald may follow local socket credentials rather
+ * than in the message PID. If we use --id as root than we can
+ * force kernel to accept another valid PID than the real logger(1)
+ * PID.
+ */
+static void set_credentials(struct logger_ctl *ctl, struct msghdr *message,
+			    union logger_cmsg *cbuf)
+{
+	struct cmsghdr *cmhp;
+	struct ucred *cred;
+
+	if (!ctl->pid || ctl->server || ctl->pid == getpid()
+	    || geteuid() != 0 || kill(ctl->pid, 0) != 0)
+		return;
+
+	message->msg_control = cbuf->control;
+	message->msg_controllen = CMSG_SPACE(sizeof(struct ucred));
+
+	cmhp = CMSG_FIRSTHDR(message);
+	cmhp->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+	cmhp->cmsg_level = SOL_SOCKET;
+	cmhp->cmsg_type = SCM_CREDENTIALS;
+	cred = (struct ucred *) CMSG_DATA(cmhp);
+
+	cred->pid = ctl->pid;
+}
+#endif
+
+/* Note that logger(1) maybe executed for long time (as pipe
+ * reader) and connection endpoint (syslogd) may be restarted.
+ *
+ * The libc syslog() function reconnects on failed send().
+ * Let's do the same to be robust.    [kzak -- Oct 2017]
+ *
+ * MSG_NOSIGNAL is POSIX.1-2008 compatible, but it for example
+ * not supported by apple-darwin15.6.0.
+ */
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+static size_t iovec_length(const struct iovec *iov, int iovlen)
+{
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < iovlen; i++)
+		len += iov[i].iov_len;
+	return len;
+}
+
+static void batch_add(struct logger_batch *b, const struct iovec *iov, int iovlen)
+{
+	size_t len = iovec_length(iov, iovlen);
+	int i;
+
+	if (b->nmsgs == b->nends) {
+		b->nends = max(b->nends * 2, (size_t) LOGGER_BATCH_MSGS);
+		b->ends = xrealloc(b->ends, b->nends * sizeof(size_t));
+	}
+	if (b->len + len > b->size) {
+		b->size = max(b->size * 2, b->len + len);
+		b->buf = xrealloc(b->buf, b->size);
+	}
+	for (i = 0; i < iovlen; i++) {
+		memcpy(b->buf + b->len, iov[i].iov_base, iov[i].iov_len);
+		b->len += iov[i].iov_len;
+	}
+	b->ends[b->nmsgs++] = b->len;
+	b->new_msgs++;
+	b->new_bytes += len;
+}
+
+#define batch_start(_b, _i)	((_i) ? (_b)->ends[(_i) - 1] : 0)
+
+/* removes the first @n messages */
+static void batch_remove(struct logger_batch *b, size_t n)
+{
+	size_t i, off;
+
+	if (!n)
+		return;
+	off = b->ends[n - 1];
+	memmove(b->buf, b->buf + off, b->len - off);
+	for (i = n; i < b->nmsgs; i++)
+		b->ends[i - n] = b->ends[i] - off;
+	b->nmsgs -= n;
+	b->len -= off;
+	b->pos = b->pos > off ? b->pos - off : 0;
+}
+
+/* sends the messages from @first, returns number of the sent messages */
+static ssize_t batch_send_dgram(struct logger_ctl *ctl, size_t first,
+				void *control, size_t controllen, int flags)
+{
+	struct logger_batch *b = ctl->batch;
+	struct mmsghdr msgs[LOGGER_BATCH_MSGS];
+	struct iovec iovs[LOGGER_BATCH_MSGS];
+	size_t i, n = min(b->nmsgs - first, (size_t) LOGGER_BATCH_MSGS);
+
+	memset(msgs, 0, n * sizeof(struct mmsghdr));
+	for (i = 0; i < n; i++) {
+		size_t start = batch_start(b, first + i);
+
+		iovs[i].iov_base = b->buf + start;
+		iovs[i].iov_len = b->ends[first + i] - start;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = control;
+		msgs[i].msg_hdr.msg_controllen = controllen;
+	}
+	return sendmmsg(ctl->fd, msgs, n, MSG_NOSIGNAL | flags);
+}
+
+/* sends the rest of the batch from @pos, returns number of the sent bytes */
+static ssize_t batch_send_stream(struct logger_ctl *ctl, size_t pos,
+				 void *control, size_t controllen, int flags)
+{
+	struct logger_batch *b = ctl->batch;
+	struct iovec iov = {
+		.iov_base = b->buf + pos,
+		.iov_len = b->len - pos
+	};
+	struct msghdr message = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = controllen
+	};
+
+	return sendmsg(ctl->fd, &message, MSG_NOSIGNAL | flags);
+}
+
+/* closes the connection, the next attempt is delayed twice as long */
+static void queue_disconnect(struct logger_ctl *ctl)
+{
+	struct timeval now, delay = { .tv_sec = 0 };
+
+	if (is_connected(ctl))
+		close(ctl->fd);
+	ctl->fd = -1;
+	ctl->failures++;
+
+	ctl->retry_delay = ctl->retry_delay ?
+			min(ctl->retry_delay * 2, (unsigned int) LOGGER_RETRY_MAX) : 1;
+	delay.tv_sec = ctl->retry_delay;
+	gettime_monotonic(&now);
+	timeradd(&now, &delay, &ctl->retry_time);
+}
+
+/* milliseconds to @tv for poll(), rounded up */
+static int ms_until(const struct timeval *tv)
+{
+	struct timeval now, diff;
+
+	gettime_monotonic(&now);
+	if (!timercmp(&now, tv, <))
+		return 0;
+	timersub(tv, &now, &diff);
+	return diff.tv_sec * 1000 + (diff.tv_usec + 999) / 1000;
+}
+
+/* sends the queued messages as far as possible without blocking */
+static void queue_send(struct logger_ctl *ctl)
+{
+	struct logger_batch *b = ctl->batch;
+	size_t done = 0;
+
+	b->new_msgs = b->new_bytes = 0;
+	if (!b->nmsgs)
+		return;
+	if (!is_connected(ctl)) {
+		if (ms_until(&ctl->retry_time) > 0)
+			return;
+		__logger_open(ctl);
+		if (!is_connected(ctl)) {
+			queue_disconnect(ctl);
+			return;
+		}
+	}
+
+	while (done < b->nmsgs) {
+		ssize_t rc;
+
+		if (ctl->socket_type == TYPE_TCP)
+			rc = batch_send_stream(ctl, b->pos, NULL, 0, MSG_DONTWAIT);
+		else
+			rc = batch_send_dgram(ctl, done, NULL, 0, MSG_DONTWAIT);
+		if (rc > 0) {
+			if (ctl->socket_type == TYPE_TCP) {
+				b->pos += rc;
+				while (done < b->nmsgs && b->ends[done] <= b->pos)
+					done++;
+			} else
+				done += rc;
+			ctl->retry_delay = 0;
+			continue;
+		}
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+			       || errno == EINTR))
+			break;
+		queue_disconnect(ctl);
+		/* the message is sent whole to the new connection */
+		b->pos = batch_start(b, done);
+		break;
+	}
+	batch_remove(b, done);
+}
+
+/*
+ * Sends the queue until it is empty, @infd is readable, or @deadline (if not
+ * NULL) is reached.
+ */
+static void queue_wait(struct logger_ctl *ctl, int infd,
+		       const struct timeval *deadline)
+{
+	struct logger_batch *b = ctl->batch;
+
+	while (b->nmsgs) {
+		struct pollfd fds[2];
+		int timeout = -1, rc;
+		nfds_t nfds = 0;
+
+		if (is_connected(ctl)) {
+			fds[nfds].fd = ctl->fd;
+			fds[nfds++].events = POLLOUT;
+		} else
+			timeout = ms_until(&ctl->retry_time);
+		if (deadline) {
+			int left = ms_until(deadline);
+
+			if (!left)
+				break;
+			timeout = timeout < 0 ? left : min(timeout, left);
+		}
+		if (infd >= 0) {
+			fds[nfds].fd = infd;
+			fds[nfds++].events = POLLIN;
+		}
+
+		rc = poll(fds, nfds, timeout);
+		if (rc < 0 && errno != EINTR)
+			break;
+		if (rc > 0 && infd >= 0 && fds[nfds - 1].revents)
+			break;
+		queue_send(ctl);
+	}
+}
+
+/*
+ * Sends the batch. Like for the single messages, the connection is reopened
+ * on error and the failed message is sent again once.
+ */
+static void logger_flush(struct logger_ctl *ctl)
+{
+	struct logger_batch *b = ctl->batch;
+	struct msghdr message = { 0 };
+	size_t done = 0, pos = 0;
+	int retry = 0;
+#ifdef SCM_CREDENTIALS
+	union logger_cmsg cbuf;
+
+	if (b && b->nmsgs)
+		set_credentials(ctl, &message, &cbuf);
+#endif
+	if (!b)
+		return;
+	if (ctl->queue_size) {
+		queue_send(ctl);
+		return;
+	}
+
+	while (done < b->nmsgs) {
+		ssize_t rc = -1;
+
+		if (is_connected(ctl) && ctl->socket_type == TYPE_TCP)
+			rc = batch_send_stream(ctl, pos, message.msg_control,
+					       message.msg_controllen, 0);
+		else if (is_connected(ctl))
+			rc = batch_send_dgram(ctl, done, message.msg_control,
+					      message.msg_controllen, 0);
+		if (rc > 0) {
+			if (ctl->socket_type == TYPE_TCP) {
+				pos += rc;
+				while (done < b->nmsgs && b->ends[done] <= pos)
+					done++;
+			} else
+				done += rc;
+			retry = 0;
+			continue;
+		}
+		if (!retry) {
+			logger_reopen(ctl);
+			retry = 1;
+		} else {
+			warn(_("send message failed"));
+			done++;
+			retry = 0;
+		}
+		/* the message is sent whole to the new connection */
+		pos = batch_start(b, done);
+	}
+	b->nmsgs = 0;
+	b->len = 0;
+	b->new_msgs = b->new_bytes = 0;
+}
+
 /* writes generated buffer to desired destination. For TCP syslog,
  * we use RFC6587 octet-stuffing (unless octet-counting is selected).
  * This is not great, but doing full blown RFC5425 (TLS) looks like
@@ -448,7 +813,7 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 	char *octet = NULL;
 
 	/* initial connect failed? */
-	if (!ctl->noact && !is_connected(ctl))
+	if (!ctl->noact && !ctl->queue_size && !is_connected(ctl))
 		logger_reopen(ctl);
 
 	/* 1) octen count */
@@ -463,61 +828,40 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 	/* 3) message */
 	iovec_add_string(iov, iovlen, msg, 0);
 
-	if (!ctl->noact && is_connected(ctl)) {
+	if (!ctl->noact && (is_connected(ctl) || ctl->queue_size)) {
 		struct msghdr message = { 0 };
 #ifdef SCM_CREDENTIALS
-		struct cmsghdr *cmhp;
-		struct ucred *cred;
-		union {
-			struct cmsghdr cmh;
-			char   control[CMSG_SPACE(sizeof(struct ucred))];
-		} cbuf;
+		union logger_cmsg cbuf;
 #endif
 
 		/* 4) add extra \n to make sure message is terminated */
 		if ((ctl->socket_type == TYPE_TCP) && !ctl->octet_count)
 			iovec_add_string(iov, iovlen, "\n", 1);
 
-		message.msg_iov = iov;
-		message.msg_iovlen = iovlen;
-
+		if (ctl->queue_size && ctl->batch->len
+		    + iovec_length(iov, iovlen) > ctl->queue_size) {
+			/* make room for the message, or drop it */
+			queue_send(ctl);
+			if (ctl->batch->len + iovec_length(iov, iovlen) > ctl->queue_size)
+				ctl->dropped++;
+			else
+				batch_add(ctl->batch, iov, iovlen);
+		} else if (ctl->batch) {
+			batch_add(ctl->batch, iov, iovlen);
+			if (ctl->batch->new_msgs == LOGGER_BATCH_MSGS
+			    || ctl->batch->new_bytes >= LOGGER_BATCH_BYTES)
+				logger_flush(ctl);
+		} else {
+			message.msg_iov = iov;
+			message.msg_iovlen = iovlen;
 #ifdef SCM_CREDENTIALS
-		/* syslog/journald may follow local socket credentials rather
-		 * than in the message PID. If we use --id as root than we can
-		 * force kernel to accept another valid PID than the real logger(1)
-		 * PID.
-		 */
-		if (ctl->pid && !ctl->server && ctl->pid != getpid()
-		    && geteuid() == 0 && kill(ctl->pid, 0) == 0) {
-
-			message.msg_control = cbuf.control;
-			message.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
-
-			cmhp = CMSG_FIRSTHDR(&message);
-			cmhp->cmsg_len = CMSG_LEN(sizeof(struct ucred));
-			cmhp->cmsg_level = SOL_SOCKET;
-			cmhp->cmsg_type = SCM_CREDENTIALS;
-			cred = (struct ucred *) CMSG_DATA(cmhp);
-
-			cred->pid = ctl->pid;
-		}
-#endif
-		/* Note that logger(1) maybe executed for long time (as pipe
-		 * reader) and connection endpoint (syslogd) may be restarted.
-		 *
-		 * The libc syslog() function reconnects on failed send().
-		 * Let's do the same to be robust.    [kzak -- Oct 2017]
-		 *
-		 * MSG_NOSIGNAL is POSIX.1-2008 compatible, but it for example
-		 * not supported by apple-darwin15.6.0.
-		 */
-#ifndef MSG_NOSIGNAL
-# define MSG_NOSIGNAL 0
+			set_credentials(ctl, &message, &cbuf);
 #endif
-		if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0) {
-			logger_reopen(ctl);
-			if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0)
-				warn(_("send message failed"));
+			if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0) {
+				logger_reopen(ctl);
+				if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0)
+					warn(_("send message failed"));
+			}
 		}
 	}
 
@@ -532,20 +876,27 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 	free(octet);
 }
 
+/* the header is regenerated on priority changes, the hostname is not */
+static const char *logger_hostname(struct logger_ctl *ctl)
+{
+	if (!ctl->hostname)
+		ctl->hostname = logger_xgethostname();
+	return ctl->hostname;
+}
+
 #define NILVALUE "-"
 static void syslog_rfc3164_header(struct logger_ctl *const ctl)
 {
 	char pid[30], *hostname;
+	const char *host;
 
 	*pid = '\0';
 	if (ctl->pid)
 		snprintf(pid, sizeof(pid), "[%d]", ctl->pid);
 
-	if ((hostname = logger_xgethostname())) {
-		char *dot = strchr(hostname, '.');
-		if (dot)
-			*dot = '\0';
-	} else
+	if ((host = logger_hostname(ctl)))
+		hostname = xstrndup(host, strcspn(host, "."));
+	else
 		hostname = xstrdup(NILVALUE);
 
 	xasprintf(&ctl->hdr, "<%d>%.15s %s %.200s%s: ",
@@ -810,8 +1161,9 @@ static void syslog_rfc5424_header(struct logger_ctl *const ctl)
 		time = xstrdup(NILVALUE);
 
 	if (ctl->rfc5424_host) {
-		if (!(hostname = logger_xgethostname()))
-			hostname = xstrdup(NILVALUE);
+		const char *host = logger_hostname(ctl);
+
+		hostname = xstrdup(host ? host : NILVALUE);
 		/* Arbitrary looking 'if (var < strlen()) checks originate from
 		 * RFC 5424 - 6 Syslog Message Format definition.  */
 		if (255 < strlen(hostname))
@@ -924,7 +1276,8 @@ static void generate_syslog_header(struct logger_ctl *const ctl)
 static void __logger_open(struct logger_ctl *ctl)
 {
 	if (ctl->server) {
-		ctl->fd = inet_socket(ctl->server, ctl->port, &ctl->socket_type);
+		ctl->fd = inet_socket(ctl->server, ctl->port, &ctl->socket_type,
+				      ctl->queue_size != 0);
 	} else {
 		if (!ctl->unix_socket)
 			ctl->unix_socket = _PATH_DEVLOG;
@@ -938,6 +1291,12 @@ static void logger_open(struct logger_ctl *ctl)
 {
 	__logger_open(ctl);
 
+	if (ctl->queue_size && !ctl->noact) {
+		ctl->batch = xcalloc(1, sizeof(struct logger_batch));
+		if (!is_connected(ctl))
+			queue_disconnect(ctl);
+	}
+
 	if (!ctl->syslogfp)
 		ctl->syslogfp = ctl->server ? syslog_rfc5424_header :
 					      syslog_local_header;
@@ -992,6 +1351,42 @@ static void logger_command_line(struct logger_ctl *ctl, char **argv)
 	free(buf);
 }
 
+/*
+ * stdin is read by large read() calls, the batch of messages is sent before
+ * logger waits for more input, so the messages are not delayed.
+ */
+struct logger_input {
+	char	*buf;
+	size_t	pos;
+	size_t	len;
+	unsigned int eof : 1;
+};
+
+#define LOGGER_INPUT_SIZE	(64 * 1024)
+
+static int logger_getchar(struct logger_ctl *ctl, struct logger_input *in)
+{
+	if (in->pos == in->len) {
+		ssize_t rc;
+
+		if (in->eof)
+			return EOF;
+		logger_flush(ctl);
+		if (ctl->queue_size && ctl->batch)
+			queue_wait(ctl, fileno(stdin), NULL);
+		do {
+			rc = read(fileno(stdin), in->buf, LOGGER_INPUT_SIZE);
+		} while (rc < 0 && errno == EINTR);
+		if (rc <= 0) {
+			in->eof = 1;
+			return EOF;
+		}
+		in->pos = 0;
+		in->len = rc;
+	}
+	return (unsigned char) in->buf[in->pos++];
+}
+
 static void logger_stdin(struct logger_ctl *ctl)
 {
 	/* note: we re-generate the syslog header for each log message to
@@ -1001,17 +1396,21 @@ static void logger_stdin(struct logger_ctl *ctl)
 	int default_priority = ctl->pri;
 	int last_pri = default_priority;
 	char *buf = xmalloc(ctl->max_message_size + 2 + 2);
+	struct logger_input in = { .buf = xmalloc(LOGGER_INPUT_SIZE) };
 	int pri;
 	int c;
 	size_t i;
 
-	c = getchar();
+	if (!ctl->noact && !ctl->batch)
+		ctl->batch = xcalloc(1, sizeof(struct logger_batch));
+
+	c = logger_getchar(ctl, &in);
 	while (c != EOF) {
 		i = 0;
 		if (ctl->prio_prefix && c == '<') {
 			pri = 0;
 			buf[i++] = c;
-			while (isdigit(c = getchar()) && pri <= 191) {
+			while (isdigit(c = logger_getchar(ctl, &in)) && pri <= 191) {
 				buf[i++] = c;
 				pri = pri * 10 + c - '0';
 			}
@@ -1031,12 +1430,12 @@ static void logger_stdin(struct logger_ctl *ctl)
 				last_pri = ctl->pri;
 			}
 			if (c != EOF && c != '\n')
-				c = getchar();
+				c = logger_getchar(ctl, &in);
 		}
 
 		while (c != EOF && c != '\n' && i < ctl->max_message_size) {
 			buf[i++] = c;
-			c = getchar();
+			c = logger_getchar(ctl, &in);
 		}
 		buf[i] = '\0';
 
@@ -1044,17 +1443,40 @@ static void logger_stdin(struct logger_ctl *ctl)
 			write_output(ctl, buf);
 
 		if (c == '\n')	/* discard line terminator */
-			c = getchar();
+			c = logger_getchar(ctl, &in);
 	}
 
+	logger_flush(ctl);
+	free(in.buf);
 	free(buf);
 }
 
-static void logger_close(const struct logger_ctl *ctl)
+static void logger_close(struct logger_ctl *ctl)
 {
+	if (ctl->queue_size && ctl->batch) {
+		struct timeval now, deadline, timeout = {
+			.tv_sec = LOGGER_DRAIN_TIMEOUT
+		};
+
+		gettime_monotonic(&now);
+		timeradd(&now, &timeout, &deadline);
+		queue_send(ctl);
+		queue_wait(ctl, -1, &deadline);
+
+		ctl->dropped += ctl->batch->nmsgs;
+		if (ctl->dropped)
+			warnx(_("%zu messages dropped, %zu failed connections"),
+			      ctl->dropped, ctl->failures);
+	}
+	if (ctl->batch) {
+		free(ctl->batch->buf);
+		free(ctl->batch->ends);
+		free(ctl->batch);
+	}
 	if (ctl->fd != -1 && close(ctl->fd) != 0)
 		err(EXIT_FAILURE, _("close failed"));
 	free(ctl->hdr);
+	free(ctl->hostname);
 	free(ctl->login);
 }
 
@@ -1083,6 +1505,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -P, --port <port>        use this port for UDP or TCP connection\n"), out);
 	fputs(_(" -T, --tcp                use TCP only\n"), out);
 	fputs(_(" -d, --udp                use UDP only\n"), out);
+	fputs(_("     --queue-size <size>  do not block, queue up to <size> bytes of messages\n"), out);
 	fputs(_("     --rfc3164            use the obsolete BSD syslog protocol\n"), out);
 	fputs(_("     --rfc5424[=<snip>]   use the syslog protocol (the default for remote);\n"
 		"                            <snip> can be notime, or notq, and/or nohost\n"), out);
@@ -1160,6 +1583,7 @@ int main(int argc, char **argv)
 		{ "skip-empty",	   no_argument,	      0, 'e'		   },
 		{ "sd-id",         required_argument, 0, OPT_STRUCTURED_DATA_ID          },
 		{ "sd-param",      required_argument, 0, OPT_STRUCTURED_DATA_PARAM       },
+		{ "queue-size",    required_argument, 0, OPT_QUEUE_SIZE    },
 #ifdef HAVE_LIBSYSTEMD
 		{ "journald",	   optional_argument, 0, OPT_JOURNALD	   },
 #endif
@@ -1226,6 +1650,12 @@ int main(int argc, char **argv)
 		case 'P':
 			ctl.port = optarg;
 			break;
+		case OPT_QUEUE_SIZE:
+			ctl.queue_size = strtosize_or_err(optarg,
+				_("failed to parse queue size"));
+			if (!ctl.queue_size)
+				errx(EXIT_FAILURE, _("invalid queue size"));
+			break;
 		case OPT_OCTET_COUNT:
 			ctl.octet_count = 1;
 			break;
@@ -1285,6 +1715,8 @@ int main(int argc, char **argv)
 	argv += optind;
 	if (stdout_reopened && argc)
 		warnx(_("--file <file> and <message> are mutually exclusive, message is ignored"));
+	if (ctl.queue_size && !ctl.server)
+		errx(EXIT_FAILURE, _("--queue-size requires --server"));
 #ifdef HAVE_LIBSYSTEMD
 	if (jfd) {
 		int ret = journald_entry(&ctl, jfd);
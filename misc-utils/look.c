@@ -54,11 +54,12 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "nls.h"
-#include "xalloc.h"
 #include "pathnames.h"
 #include "closestream.h"
 
@@ -67,11 +68,11 @@
 #define	LESS		(-1)
 
 static int dflag, fflag;
-/* uglified the source a bit with globals, so that we only need
-   to allocate comparbuf once */
 static int stringlen;
 static char *string;
-static char *comparbuf;
+static unsigned char fold[256];		/* case folding for -f */
+static unsigned char alnum[256];	/* chars compared with -d */
+static size_t pagesize;
 
 static char *binary_search (char *, char *);
 static int compare (char *, char *);
@@ -163,6 +164,8 @@ main(int argc, char *argv[])
 #endif
 			err(EXIT_FAILURE, "%s", file);
 	back = front + sb.st_size;
+	pagesize = getpagesize();
+	madvise(front, (size_t) sb.st_size, MADV_RANDOM);
 	return look(front, back);
 }
 
@@ -172,6 +175,11 @@ look(char *front, char *back)
 	int ch;
 	char *readp, *writep;
 
+	for (ch = 0; ch < 256; ch++) {
+		fold[ch] = fflag ? tolower(ch) : ch;
+		alnum[ch] = isalnum((char) ch) || isblank((char) ch);
+	}
+
 	/* Reformat string to avoid doing it multiple times later. */
 	if (dflag) {
 		for (readp = writep = string; (ch = *readp++) != 0;) {
@@ -183,16 +191,12 @@ look(char *front, char *back)
 	} else
 		stringlen = strlen(string);
 
-	comparbuf = xmalloc(stringlen+1);
-
 	front = binary_search(front, back);
 	front = linear_search(front, back);
 
 	if (front)
 		print_from(front, back);
 
-	free(comparbuf);
-
 	return (front ? 0 : 1);
 }
 
@@ -234,13 +238,32 @@ look(char *front, char *back)
 #define	SKIP_PAST_NEWLINE(p, back) \
 	while (p < back && *p++ != '\n')
 
+/*
+ * Returns the first line after halfway point from front to back. In large
+ * ranges the halfway point is rounded down to the page boundary, so the probe
+ * usually reads only one page.
+ */
+static char *
+probe(char *front, char *back)
+{
+	char *p = front + (back - front) / 2;
+
+	if ((size_t) (back - front) > 4 * pagesize) {
+		char *x = (char *) ((uintptr_t) p & ~((uintptr_t) pagesize - 1));
+
+		if (x > front)
+			p = x;
+	}
+	SKIP_PAST_NEWLINE(p, back);
+	return p;
+}
+
 static char *
 binary_search(char *front, char *back)
 {
 	char *p;
 
-	p = front + (back - front) / 2;
-	SKIP_PAST_NEWLINE(p, back);
+	p = probe(front, back);
 
 	/*
 	 * If the file changes underneath us, make sure we don't
@@ -251,8 +274,7 @@ binary_search(char *front, char *back)
 			front = p;
 		else
 			back = p;
-		p = front + (back - front) / 2;
-		SKIP_PAST_NEWLINE(p, back);
+		p = probe(front, back);
 	}
 	return (front);
 }
@@ -285,26 +307,59 @@ linear_search(char *front, char *back)
 	return (NULL);
 }
 
+/*
+ * Find the end of the matching lines, starting at the matching line at front.
+ *
+ * The matching lines are adjacent in the sorted file. The distance of the
+ * probe is doubled while the line there still matches (galloping), then
+ * the last range is narrowed by binary search as above. Returns the
+ * beginning of the first line which does not match, or back.
+ */
+static char *
+match_end(char *front, char *back)
+{
+	char *end = back, *p;
+	size_t step = pagesize;
+
+	/* front is always a matching line, end is not or it's back */
+	while ((size_t) (back - front) > step) {
+		p = front + step;
+		SKIP_PAST_NEWLINE(p, back);
+		if (p >= back)
+			break;
+		if (compare(p, back) != EQUAL) {
+			end = p;
+			break;
+		}
+		front = p;
+		step *= 2;
+	}
+
+	while ((p = probe(front, end)) < end) {
+		if (compare(p, back) == EQUAL)
+			front = p;
+		else
+			end = p;
+	}
+
+	while (front < end && compare(front, back) == EQUAL)
+		SKIP_PAST_NEWLINE(front, end);
+	return front;
+}
+
 /*
  * Print as many lines as match string, starting at front.
  */
 static void
 print_from(char *front, char *back)
 {
-	int eol;
-
-	while (front < back && compare(front, back) == EQUAL) {
-		if (compare(front, back) == EQUAL) {
-			eol = 0;
-			while (front < back && !eol) {
-				if (putchar(*front) == EOF)
-					err(EXIT_FAILURE, "stdout");
-				if (*front++ == '\n')
-					eol = 1;
-			}
-		} else
-			SKIP_PAST_NEWLINE(front, back);
-	}
+	char *end = match_end(front, back);
+	char *start = (char *) ((uintptr_t) front & ~((uintptr_t) pagesize - 1));
+
+	madvise(start, end - start, MADV_SEQUENTIAL);
+
+	if (fwrite(front, 1, end - front, stdout) != (size_t) (end - front))
+		err(EXIT_FAILURE, "stdout");
 }
 
 /*
@@ -320,34 +375,29 @@ print_from(char *front, char *back)
  * The string "string" is null terminated.  The string "s2" is '\n' terminated
  * (or "s2end" terminated).
  *
- * We use strcasecmp etc, since it knows how to ignore case also
- * in other locales.
+ * The chars are folded by the fold[] table, which is tolower() for -f, the
+ * same as strncasecmp() does in the current locale.
  */
 static int
 compare(char *s2, char *s2end) {
-	int i;
-	char *p;
-
-	/* copy, ignoring things that should be ignored */
-	p = comparbuf;
-	i = stringlen;
-	while(s2 < s2end && *s2 != '\n' && i) {
-		if (!dflag || isalnum(*s2) || isblank(*s2))
-		{
-			*p++ = *s2;
+	const unsigned char *s = (const unsigned char *) s2,
+			    *end = (const unsigned char *) s2end,
+			    *p = (const unsigned char *) string;
+	int i = stringlen;
+
+	while (i && s < end && *s != '\n') {
+		if (!dflag || alnum[*s]) {
+			int diff = fold[*s] - fold[*p];
+
+			if (diff)
+				return diff > 0 ? LESS : GREATER;
+			p++;
 			i--;
 		}
-		s2++;
+		s++;
 	}
-	*p = 0;
-
-	/* and compare */
-	if (fflag)
-		i = strncasecmp(comparbuf, string, stringlen);
-	else
-		i = strncmp(comparbuf, string, stringlen);
-
-	return ((i > 0) ? LESS : (i < 0) ? GREATER : EQUAL);
+	/* s2 is shorter than string */
+	return i ? GREATER : EQUAL;
 }
 
 static void __attribute__((__noreturn__)) usage(void)
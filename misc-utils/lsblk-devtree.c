@@ -98,6 +98,8 @@ static int device_remove_dependences(struct lsblk_device *dev)
 
 void lsblk_unref_device(struct lsblk_device *dev)
 {
+	size_t i;
+
 	if (!dev)
 		return;
 
@@ -114,6 +116,10 @@ void lsblk_unref_device(struct lsblk_device *dev)
 		free(dev->filename);
 		free(dev->dedupkey);
 
+		for (i = 0; i < dev->ncoldata; i++)
+			free(dev->coldata[i]);
+		free(dev->coldata);
+
 		ul_unref_path(dev->sysfs);
 
 		DBG(DEV, ul_debugobj(dev, " >> dealloc [%s]", dev->name));
@@ -341,8 +341,9 @@ struct lsblk_devprop *lsblk_device_get_properties(struct lsblk_device *dev)
 	if (lsblk->sysroot)
 		return get_properties_by_file(dev);
 
-	p = get_properties_by_udev(dev);
-	if (!p)
+	if (lsblk->sources & LSBLK_SRC_UDEV)
+		p = get_properties_by_udev(dev);
+	if (!p && (lsblk->sources & LSBLK_SRC_BLKID))
 		p = get_properties_by_blkid(dev);
 	return p;
 }
@@ -52,6 +52,8 @@
 #include "fileutils.h"
 #include "loopdev.h"
 #include "buffer.h"
+#include "ulstats.h"
+#include "jobs.h"
 
 #include "lsblk.h"
 
@@ -142,7 +144,8 @@ enum {
 	LSBLK_EXPORT =		(1 << 3),
 	LSBLK_TREE =		(1 << 4),
 	LSBLK_JSON =		(1 << 5),
-	LSBLK_SHELLVAR =	(1 << 6)
+	LSBLK_SHELLVAR =	(1 << 6),
+	LSBLK_CBOR =		(1 << 7)	/* binary JSON, requires LSBLK_JSON */
 };
 
 /* Types used for qsort() and JSON */
@@ -351,6 +354,45 @@ static int column_id_to_number(int id)
 	return -1;
 }
 
+/*
+ * Returns LSBLK_SRC_* data sources used by the column. The sysfs is always
+ * used, the others are opened only if an output, sort or de-duplication
+ * column needs them.
+ */
+static int column_sources(int id)
+{
+	switch (id) {
+	case COL_FSTYPE:
+	case COL_FSVERSION:
+	case COL_LABEL:
+	case COL_UUID:
+	case COL_PTUUID:
+	case COL_PTTYPE:
+	case COL_PARTTYPE:
+	case COL_PARTTYPENAME:
+	case COL_PARTLABEL:
+	case COL_PARTUUID:
+	case COL_PARTFLAGS:
+		return LSBLK_SRC_UDEV | LSBLK_SRC_BLKID;
+	case COL_WWN:
+	case COL_IDLINK:
+	case COL_ID:
+	case COL_MODEL:		/* sysfs fallback */
+	case COL_SERIAL:	/* sysfs fallback */
+		return LSBLK_SRC_UDEV;
+	case COL_FSSIZE:
+	case COL_FSAVAIL:
+	case COL_FSUSED:
+	case COL_FSUSEPERC:
+	case COL_TARGET:
+	case COL_TARGETS:
+	case COL_FSROOTS:
+		return LSBLK_SRC_MNT;
+	default:
+		return 0;
+	}
+}
+
 /* Checks for DM prefix in the device name */
 static int is_dm(const char *name)
 {
@@ -588,21 +630,6 @@ static char *mk_dm_name(const char *name)
 	return p;
 }
 
-/* stores data to scols cell userdata (invisible and independent on output)
- * to make the original values accessible for sort functions
- */
-static void set_sortdata_u64(struct libscols_line *ln, int col, uint64_t x)
-{
-	struct libscols_cell *ce = scols_line_get_cell(ln, col);
-	uint64_t *data;
-
-	if (!ce)
-		return;
-	data = xmalloc(sizeof(uint64_t));
-	*data = x;
-	scols_cell_set_userdata(ce, data);
-}
-
 /* do not modify *data on any error */
 static void str2u64(const char *str, uint64_t *data)
 {
@@ -619,26 +646,6 @@ static void str2u64(const char *str, uint64_t *data)
 	*data = num;
 }
 
-static void unref_sortdata(struct libscols_table *tb)
-{
-	struct libscols_iter *itr;
-	struct libscols_line *ln;
-
-	if (!tb || !lsblk->sort_col)
-		return;
-	itr = scols_new_iter(SCOLS_ITER_FORWARD);
-	if (!itr)
-		return;
-	while (scols_table_next_line(tb, itr, &ln) == 0) {
-		struct libscols_cell *ce = scols_line_get_column_cell(ln,
-								lsblk->sort_col);
-		void *data = scols_cell_get_userdata(ce);
-		free(data);
-	}
-
-	scols_free_iter(itr);
-}
-
 static char *get_vfs_attribute(struct lsblk_device *dev, int id)
 {
 	char *sizestr;
@@ -1174,6 +1181,215 @@ static char *device_get_data(
 	return str;
 }
 
+/*
+ * The column data are generated on demand by device_column_data() (see
+ * scols_column_set_datafunc()), except sort column and columns which depend
+ * on the device parent as defined in the tree.
+ */
+static int is_lazy_column(int id)
+{
+	return id != lsblk->sort_id && id != COL_PKNAME && id != COL_RM;
+}
+
+/*
+ * Columns with data read from the device sysfs directory only (or from the
+ * whole-disk directory for partitions), see prefetch_devices().
+ */
+static int is_sysfs_column(int id)
+{
+	switch (id) {
+	case COL_RA:
+	case COL_RO:
+	case COL_HOTPLUG:
+	case COL_ROTA:
+	case COL_RAND:
+	case COL_REV:
+	case COL_VENDOR:
+	case COL_START:
+	case COL_STATE:
+	case COL_ALIOFF:
+	case COL_MINIO:
+	case COL_OPTIO:
+	case COL_PHYSEC:
+	case COL_LOGSEC:
+	case COL_SCHED:
+	case COL_RQ_SIZE:
+	case COL_TYPE:
+	case COL_HCTL:
+	case COL_TRANSPORT:
+	case COL_SUBSYS:
+	case COL_DALIGN:
+	case COL_DGRAN:
+	case COL_DMAX:
+	case COL_DZERO:
+	case COL_WSAME:
+	case COL_ZONED:
+	case COL_ZONE_SZ:
+	case COL_ZONE_WGRAN:
+	case COL_ZONE_APP:
+	case COL_ZONE_NR:
+	case COL_ZONE_OMAX:
+	case COL_ZONE_AMAX:
+	case COL_DAX:
+	case COL_MQ:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static char *device_column_data(struct libscols_column *cl __attribute__((__unused__)),
+				struct libscols_line *ln, void *data)
+{
+	struct lsblk_device *dev = scols_line_get_userdata(ln);
+	struct lsblk_device *disk;
+	int id = (int) (uintptr_t) data;
+	int dev_open, disk_open = 0;
+	char *str;
+
+	if (!dev)
+		return NULL;
+
+	/* already read by prefetch_devices(); the device may be printed more than once */
+	if (dev->coldata && is_sysfs_column(id)) {
+		int n = column_id_to_number(id);
+
+		str = dev->coldata[n] ? xstrdup(dev->coldata[n]) : NULL;
+		DBG(DEV, ul_debugobj(dev, " prefetched data[%d]=\"%s\"", id, str));
+		return str;
+	}
+
+	/* keep number of open files as without lazy data */
+	disk = dev->wholedisk;
+	dev_open = ul_path_isopen_dirfd(dev->sysfs);
+	if (disk)
+		disk_open = ul_path_isopen_dirfd(disk->sysfs);
+
+	str = device_get_data(dev, NULL, id, NULL);
+	DBG(DEV, ul_debugobj(dev, " lazy data[%d]=\"%s\"", id, str));
+
+	if (!dev_open)
+		ul_path_close_dirfd(dev->sysfs);
+	if (disk && !disk_open)
+		ul_path_close_dirfd(disk->sysfs);
+	return str;
+}
+
+/*
+ * Parallel sysfs reading (--jobs)
+ *
+ * The device tree is built serially (the dependencies, udev, blkid and
+ * libmount are not thread-safe). The lazy columns with sysfs data only are
+ * then read for all the devices by the threads, and device_column_data()
+ * returns the data. A work item is a whole-disk with its partitions, as the
+ * partitions share the sysfs handler of the whole-disk.
+ */
+struct prefetcher {
+	struct lsblk_device **devs;	/* devices sorted by whole-disk */
+	size_t ndevs;
+	size_t *items;			/* first device of the item in devs[] */
+	size_t nitems;
+	int *cols;			/* numbers of the columns to read */
+	size_t ncols;
+	size_t next;			/* next item to read, atomic */
+};
+
+static struct lsblk_device *prefetch_disk(struct lsblk_device *dev)
+{
+	return dev->wholedisk ? dev->wholedisk : dev;
+}
+
+/* sorts by whole-disk, the whole-disk before its partitions */
+static int cmp_prefetch_devices(const void *a, const void *b)
+{
+	struct lsblk_device *x = *(struct lsblk_device **) a;
+	struct lsblk_device *y = *(struct lsblk_device **) b;
+	int rc = cmp_numbers((uintptr_t) prefetch_disk(x),
+			     (uintptr_t) prefetch_disk(y));
+
+	if (rc == 0)
+		rc = cmp_numbers(device_is_partition(x), device_is_partition(y));
+	return rc;
+}
+
+static void *prefetch_worker(void *arg)
+{
+	struct prefetcher *pf = arg;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&pf->next, 1, __ATOMIC_RELAXED)) < pf->nitems) {
+		size_t k, first = pf->items[i];
+		size_t end = i + 1 < pf->nitems ? pf->items[i + 1] : pf->ndevs;
+		struct lsblk_device *disk = prefetch_disk(pf->devs[first]);
+		int disk_open = ul_path_isopen_dirfd(disk->sysfs);
+
+		for (k = first; k < end; k++) {
+			struct lsblk_device *dev = pf->devs[k];
+			int dev_open = ul_path_isopen_dirfd(dev->sysfs);
+			size_t c;
+
+			dev->ncoldata = ncolumns;
+			dev->coldata = xcalloc(ncolumns, sizeof(char *));
+
+			for (c = 0; c < pf->ncols; c++) {
+				int n = pf->cols[c];
+
+				dev->coldata[n] = device_get_data(dev, NULL,
+							get_column_id(n), NULL);
+			}
+
+			/* keep number of open files as without prefetch */
+			if (dev != disk && !dev_open)
+				ul_path_close_dirfd(dev->sysfs);
+		}
+		if (!disk_open)
+			ul_path_close_dirfd(disk->sysfs);
+	}
+	return NULL;
+}
+
+static void prefetch_devices(struct lsblk_devtree *tr)
+{
+	struct prefetcher pf = { .ndevs = 0 };
+	struct lsblk_device *dev;
+	struct lsblk_iter itr;
+	size_t i;
+
+	pf.cols = xcalloc(ncolumns, sizeof(int));
+	for (i = 0; i < ncolumns; i++) {
+		int id = get_column_id(i);
+
+		if (is_lazy_column(id) && is_sysfs_column(id)
+		    && column_id_to_number(id) == (int) i)
+			pf.cols[pf.ncols++] = i;
+	}
+	if (!pf.ncols)
+		goto done;
+
+	lsblk_reset_iter(&itr, LSBLK_ITER_FORWARD);
+	while (lsblk_devtree_next_device(tr, &itr, &dev) == 0) {
+		if (pf.ndevs % 64 == 0)
+			pf.devs = xrealloc(pf.devs, (pf.ndevs + 64) * sizeof(dev));
+		pf.devs[pf.ndevs++] = dev;
+	}
+	if (pf.ndevs < 2)
+		goto done;
+
+	qsort(pf.devs, pf.ndevs, sizeof(dev), cmp_prefetch_devices);
+
+	pf.items = xcalloc(pf.ndevs, sizeof(size_t));
+	for (i = 0; i < pf.ndevs; i++) {
+		if (i == 0 || prefetch_disk(pf.devs[i]) != prefetch_disk(pf.devs[i - 1]))
+			pf.items[pf.nitems++] = i;
+	}
+
+	ul_run_jobs(min(lsblk->jobs, pf.nitems), prefetch_worker, &pf, 0);
+done:
+	free(pf.items);
+	free(pf.devs);
+	free(pf.cols);
+}
+
 /*
  * Adds data for all wanted columns about the device to the smartcols table
  */
@@ -1211,6 +1427,7 @@ static void device_to_scols(
 		err(EXIT_FAILURE, _("failed to allocate output line"));
 
 	dev->is_printed = 1;
+	scols_line_set_userdata(ln, dev);
 
 	if (link_group) {
 		struct lsblk_device *p;
@@ -1238,6 +1455,8 @@ static void device_to_scols(
 		char *data;
 		int id = get_column_id(i);
 
+		if (is_lazy_column(id))
+			continue;
 		if (lsblk->sort_id != id)
 			data = device_get_data(dev, parent, id, NULL);
 		else {
@@ -1245,7 +1464,8 @@ static void device_to_scols(
 
 			data = device_get_data(dev, parent, id, &sortdata);
 			if (data && sortdata != (uint64_t) -1)
-				set_sortdata_u64(ln, i, sortdata);
+				scols_cell_set_sortkey_u64(
+					scols_line_get_cell(ln, i), sortdata);
 		}
 		DBG(DEV, ul_debugobj(dev, " refer data[%zu]=\"%s\"", i, data));
 		if (data && scols_line_refer_data(ln, i, data))
@@ -1896,25 +2116,6 @@ static void parse_includes(const char *str0)
 	}
 }
 
-/*
- * see set_sortdata_u64() and columns initialization in main()
- */
-static int cmp_u64_cells(struct libscols_cell *a,
-			 struct libscols_cell *b,
-			 __attribute__((__unused__)) void *data)
-{
-	uint64_t *adata = (uint64_t *) scols_cell_get_userdata(a),
-		 *bdata = (uint64_t *) scols_cell_get_userdata(b);
-
-	if (adata == NULL && bdata == NULL)
-		return 0;
-	if (adata == NULL)
-		return -1;
-	if (bdata == NULL)
-		return 1;
-	return *adata == *bdata ? 0 : *adata >= *bdata ? 1 : -1;
-}
-
 static void device_set_dedupkey(
 			struct lsblk_device *dev,
 			struct lsblk_device *parent,
@@ -1982,13 +2183,18 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -e, --exclude <list> exclude devices by major number (default: RAM disks)\n"), out);
 	fputs(_(" -f, --fs             output info about filesystems\n"), out);
 	fputs(_(" -i, --ascii          use ascii characters only\n"), out);
+	fputs(_(" -j, --jobs <num>     number of threads to read sysfs attributes\n"), out);
 	fputs(_(" -l, --list           use list format output\n"), out);
 	fputs(_(" -m, --perms          output info about permissions\n"), out);
 	fputs(_(" -n, --noheadings     don't print headings\n"), out);
 	fputs(_(" -o, --output <list>  output columns\n"), out);
+	fputs(_("     --output-format <name>\n"
+		"                      output format (json, cbor, raw or pairs)\n"), out);
 	fputs(_(" -p, --paths          print complete device path\n"), out);
 	fputs(_(" -r, --raw            use raw output format\n"), out);
 	fputs(_(" -s, --inverse        inverse dependencies\n"), out);
+	fputs(_("     --stats[=<format>]\n"
+		"                      print statistics to stderr (text or json)\n"), out);
 	fputs(_(" -t, --topology       output info about topology\n"), out);
 	fputs(_(" -w, --width <num>    specifies output width as number of characters\n"), out);
 	fputs(_(" -x, --sort <column>  sort output by <column>\n"), out);
@@ -2021,7 +2227,8 @@ int main(int argc, char *argv[])
 		.sort_id = -1,
 		.dedup_id = -1,
 		.flags = LSBLK_TREE,
-		.tree_id = COL_NAME
+		.tree_id = COL_NAME,
+		.jobs = 1
 	};
 	struct lsblk_devtree *tr = NULL;
 	int c, status = EXIT_FAILURE;
@@ -2031,7 +2238,9 @@ int main(int argc, char *argv[])
 	int force_tree = 0, has_tree_col = 0;
 
 	enum {
-		OPT_SYSROOT = CHAR_MAX + 1
+		OPT_SYSROOT = CHAR_MAX + 1,
+		OPT_OUTPUT_FORMAT,
+		OPT_STATS
 	};
 
 	static const struct option longopts[] = {
@@ -2046,11 +2255,13 @@ int main(int argc, char *argv[])
 		{ "json",       no_argument,       NULL, 'J' },
 		{ "output",     required_argument, NULL, 'o' },
 		{ "output-all", no_argument,       NULL, 'O' },
+		{ "output-format", required_argument, NULL, OPT_OUTPUT_FORMAT },
 		{ "merge",      no_argument,       NULL, 'M' },
 		{ "perms",      no_argument,       NULL, 'm' },
 		{ "noheadings",	no_argument,       NULL, 'n' },
 		{ "list",       no_argument,       NULL, 'l' },
 		{ "ascii",	no_argument,       NULL, 'i' },
+		{ "jobs",       required_argument, NULL, 'j' },
 		{ "raw",        no_argument,       NULL, 'r' },
 		{ "inverse",	no_argument,       NULL, 's' },
 		{ "fs",         no_argument,       NULL, 'f' },
@@ -2063,6 +2274,7 @@ int main(int argc, char *argv[])
 		{ "nvme",       no_argument,       NULL, 'N' },
 		{ "virtio",     no_argument,       NULL, 'v' },
 		{ "sort",	required_argument, NULL, 'x' },
+		{ "stats",      optional_argument, NULL, OPT_STATS },
 		{ "sysroot",    required_argument, NULL, OPT_SYSROOT },
 		{ "shell",      no_argument,       NULL, 'y' },
 		{ "tree",       optional_argument, NULL, 'T' },
@@ -2074,7 +2286,7 @@ int main(int argc, char *argv[])
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'D','O' },
 		{ 'I','e' },
-		{ 'J', 'P', 'r' },
+		{ 'J', 'P', 'r', OPT_OUTPUT_FORMAT },
 		{ 'O','S' },
 		{ 'O','f' },
 		{ 'O','m' },
@@ -2095,7 +2307,7 @@ int main(int argc, char *argv[])
 	lsblk_init_debug();
 
 	while((c = getopt_long(argc, argv,
-				"AabdDzE:e:fhJlNnMmo:OpPiI:rstVvST::w:x:y",
+				"AabdDzE:e:fhJj:lNnMmo:OpPiI:rstVvST::w:x:y",
 				longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
@@ -2246,9 +2458,32 @@ int main(int argc, char *argv[])
 				lsblk->tree_id = column_name_to_id(optarg, strlen(optarg));
 			}
 			break;
+		case OPT_OUTPUT_FORMAT:
+			if (strcmp(optarg, "json") == 0)
+				lsblk->flags |= LSBLK_JSON;
+			else if (strcmp(optarg, "cbor") == 0)
+				lsblk->flags |= LSBLK_JSON | LSBLK_CBOR;
+			else if (strcmp(optarg, "raw") == 0) {
+				lsblk->flags &= ~LSBLK_TREE;
+				lsblk->flags |= LSBLK_RAW;
+			} else if (strcmp(optarg, "pairs") == 0) {
+				lsblk->flags &= ~LSBLK_TREE;
+				lsblk->flags |= LSBLK_EXPORT;
+			} else
+				errx(EXIT_FAILURE, _("unsupported output format: %s"), optarg);
+			break;
 		case OPT_SYSROOT:
 			lsblk->sysroot = optarg;
 			break;
+		case OPT_STATS:
+		{
+			int fmt = ul_stats_parse_format(optarg);
+
+			if (fmt < 0)
+				errx(EXIT_FAILURE, _("unsupported statistics format: %s"), optarg);
+			ul_stats_init(fmt);
+			break;
+		}
 		case 'E':
 			lsblk->dedup_id = column_name_to_id(optarg, strlen(optarg));
 			if (lsblk->dedup_id >= 0)
@@ -2258,6 +2493,11 @@ int main(int argc, char *argv[])
 		case 'w':
 			width = strtou32_or_err(optarg, _("invalid output width number argument"));
 			break;
+		case 'j':
+			lsblk->jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!lsblk->jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'x':
 			lsblk->flags &= ~LSBLK_TREE; /* disable the default */
 			lsblk->sort_id = column_name_to_id(optarg, strlen(optarg));
@@ -2319,7 +2559,11 @@ int main(int argc, char *argv[])
 		lsblk->dedup_hidden = 1;
 	}
 
-	lsblk_mnt_init();
+	for (i = 0; i < ncolumns; i++)
+		lsblk->sources |= column_sources(get_column_id(i));
+
+	if (lsblk->sources & LSBLK_SRC_MNT)
+		lsblk_mnt_init();
 	scols_init_debug(0);
 	ul_path_init_debug();
 
@@ -2333,6 +2577,8 @@ int main(int argc, char *argv[])
 	scols_table_enable_shellvar(lsblk->table, !!(lsblk->flags & LSBLK_SHELLVAR));
 	scols_table_enable_ascii(lsblk->table, !!(lsblk->flags & LSBLK_ASCII));
 	scols_table_enable_json(lsblk->table, !!(lsblk->flags & LSBLK_JSON));
+	if (lsblk->flags & LSBLK_CBOR)
+		scols_table_enable_cbor(lsblk->table, 1);
 	scols_table_enable_noheadings(lsblk->table, !!(lsblk->flags & LSBLK_NOHEADINGS));
 
 	if (lsblk->flags & LSBLK_JSON)
@@ -2376,12 +2622,15 @@ int main(int argc, char *argv[])
 		}
 		if (!lsblk->sort_col && lsblk->sort_id == id) {
 			lsblk->sort_col = cl;
-			scols_column_set_cmpfunc(cl,
-				ci->type == COLTYPE_NUM     ? cmp_u64_cells :
-				ci->type == COLTYPE_SIZE    ? cmp_u64_cells :
-			        ci->type == COLTYPE_SORTNUM ? cmp_u64_cells : scols_cmpstr_cells,
-				NULL);
+			/* the numbers are sorted by the cells sort keys */
+			if (ci->type != COLTYPE_NUM && ci->type != COLTYPE_SIZE
+			    && ci->type != COLTYPE_SORTNUM)
+				scols_column_set_cmpfunc(cl, scols_cmpstr_cells, NULL);
 		}
+		if (is_lazy_column(id))
+			scols_column_set_datafunc(cl, device_column_data,
+						  (void *) (uintptr_t) id);
+
 		/* multi-line cells (now used for MOUNTPOINTS) */
 		if (fl & SCOLS_FL_WRAP) {
 			scols_column_set_wrapfunc(cl,
@@ -2417,6 +2666,8 @@ int main(int argc, char *argv[])
 	if (!tr)
 		err(EXIT_FAILURE, _("failed to allocate device tree"));
 
+	ul_stats_phase("collect");
+
 	if (optind == argc) {
 		int rc = lsblk->inverse ?
 			process_all_devices_inverse(tr) :
@@ -2442,6 +2693,12 @@ int main(int argc, char *argv[])
 		lsblk_devtree_deduplicate_devices(tr);
 	}
 
+	if (lsblk->jobs > 1) {
+		ul_stats_phase("probe");
+		prefetch_devices(tr);
+	}
+
+	ul_stats_phase("format");
 	devtree_to_scols(tr, lsblk->table);
 
 	if (lsblk->sort_col)
@@ -2449,12 +2706,11 @@ int main(int argc, char *argv[])
 	if (lsblk->force_tree_order)
 		scols_sort_table_by_tree(lsblk->table);
 
+	ul_stats_phase("print");
 	scols_print_table(lsblk->table);
+	ul_stats_phase(NULL);
 
 leave:
-	if (lsblk->sort_col)
-		unref_sortdata(lsblk->table);
-
 	scols_unref_table(lsblk->table);
 
 	lsblk_mnt_deinit();
@@ -32,6 +32,13 @@ UL_DEBUG_DECLARE_MASK(lsblk);
 #define UL_DEBUG_CURRENT_MASK	UL_DEBUG_MASK(lsblk)
 #include "debugobj.h"
 
+/* data sources required by the output columns, see lsblk->sources */
+enum {
+	LSBLK_SRC_UDEV	= (1 << 1),	/* udev database */
+	LSBLK_SRC_BLKID	= (1 << 2),	/* libblkid probing */
+	LSBLK_SRC_MNT	= (1 << 3),	/* mountinfo and swaps */
+};
+
 struct lsblk {
 	struct libscols_table *table;	/* output table */
 	struct libscols_column *sort_col;/* sort output by this column */
@@ -44,6 +51,8 @@ struct lsblk {
 
 	const char *sysroot;
 	int flags;			/* LSBLK_* */
+	int sources;			/* LSBLK_SRC_* */
+	size_t jobs;			/* --jobs threads */
 
 	unsigned int all_devices:1;	/* print all devices, including empty */
 	unsigned int bytes:1;		/* print SIZE in bytes */
@@ -126,6 +135,9 @@ struct lsblk_device {
 
 	struct statvfs fsstat;	/* statvfs() result */
 
+	char **coldata;		/* prefetched column data (--jobs) */
+	size_t ncoldata;	/* number of items in coldata[] */
+
 	int npartitions;	/* # of partitions this device has */
 	int nholders;		/* # of devices mapped directly to this device
 				 * /sys/block/.../holders */
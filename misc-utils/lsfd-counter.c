@@ -45,6 +45,16 @@ bool lsfd_counter_accumulate(struct lsfd_counter *counter, struct libscols_line
 	return false;
 }
 
+/* reverts lsfd_counter_accumulate() for the line which is gone */
+bool lsfd_counter_subtract(struct lsfd_counter *counter, struct libscols_line *ln)
+{
+	if (counter->value && lsfd_filter_apply(counter->filter, ln)) {
+		counter->value--;
+		return true;
+	}
+	return false;
+}
+
 const char *lsfd_counter_name(struct lsfd_counter *counter)
 {
 	return counter->name;
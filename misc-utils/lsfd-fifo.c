@@ -138,11 +138,20 @@ static void fifo_initialize_content(struct file *file)
 	list_add(&fifo->endpoint.endpoints, &ipc->endpoints);
 }
 
+static void fifo_free_content(struct file *file)
+{
+	struct fifo *fifo = (struct fifo *)file;
+
+	/* the IPC may be used by the other files, e.g. in --watch mode */
+	if (fifo->endpoint.ipc)
+		list_del(&fifo->endpoint.endpoints);
+}
+
 const struct file_class fifo_class = {
 	.super = &file_class,
 	.size = sizeof(struct fifo),
 	.fill_column = fifo_fill_column,
 	.initialize_content = fifo_initialize_content,
-	.free_content = NULL,
+	.free_content = fifo_free_content,
 	.get_ipc_class = fifo_get_ipc_class,
 };
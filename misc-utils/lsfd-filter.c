@@ -939,6 +939,13 @@ static void node_free(struct node *node)
 	free(node);
 }
 
+static bool str_to_boolean(const char *data)
+{
+	return !*data ? false :
+		*data == '0' ? false :
+		*data == 'N' || *data == 'n' ? false : true;
+}
+
 static bool node_apply(struct node *node, struct parameter *params, struct libscols_line *ln)
 {
 	if (!node)
@@ -961,9 +968,7 @@ static bool node_apply(struct node *node, struct parameter *params, struct libsc
 			const char *data = scols_line_get_column_data(ln, params[PINDEX(node)].cl);
 			if (data == NULL)
 				return false;
-			params[PINDEX(node)].val.boolean = !*data ? false :
-				*data == '0' ? false :
-				*data == 'N' || *data == 'n' ? false : true;
+			params[PINDEX(node)].val.boolean = str_to_boolean(data);
 			params[PINDEX(node)].has_value = true;
 		}
 		return params[PINDEX(node)].val.boolean;
@@ -1384,6 +1389,90 @@ void lsfd_filter_free(struct lsfd_filter *filter)
 	free(filter);
 }
 
+bool lsfd_filter_has_column(struct lsfd_filter *filter, int col_id)
+{
+	if (!filter || GOT_ERROR(filter))
+		return false;
+	if (col_id < 0 || col_id >= filter->nparams)
+		return false;
+	return filter->parameters[col_id].cl != NULL;
+}
+
+#define NODE_NO_COLUMN		-1
+#define NODE_MANY_COLUMNS	-2
+
+/* returns the column referred by @node, NODE_NO_COLUMN or NODE_MANY_COLUMNS */
+static int node_get_column(struct node *node)
+{
+	int a, b;
+
+	switch (node->type) {
+	case NODE_OP1:
+		return node_get_column(((struct node_op1 *)node)->arg);
+	case NODE_OP2:
+		a = node_get_column(((struct node_op2 *)node)->args[0]);
+		b = node_get_column(((struct node_op2 *)node)->args[1]);
+		if (a == NODE_NO_COLUMN)
+			return b;
+		if (b == NODE_NO_COLUMN || a == b)
+			return a;
+		return NODE_MANY_COLUMNS;
+	default:
+		return PINDEX(node) < 0 ? NODE_NO_COLUMN : PINDEX(node);
+	}
+}
+
+/* applies the terms of the top-level conjunction which refer only @col_id */
+static bool node_check_column(struct node *node, struct parameter *params, int col_id)
+{
+	if (node->type == NODE_OP2
+	    && ((struct node_op2 *)node)->opclass == &op2_classes[OP2_AND]) {
+		struct node_op2 *node_op2 = (struct node_op2 *)node;
+
+		return node_check_column(node_op2->args[0], params, col_id)
+		       && node_check_column(node_op2->args[1], params, col_id);
+	}
+	if (node_get_column(node) != col_id)
+		return true;	/* depends on other columns */
+
+	return node_apply(node, params, NULL);
+}
+
+bool lsfd_filter_check_column(struct lsfd_filter *filter, int col_id, const char *data)
+{
+	struct parameter *params;
+	bool rc;
+
+	if (!lsfd_filter_has_column(filter, col_id))
+		return true;
+
+	/* private parameters, the function is called by more threads */
+	params = xcalloc(filter->nparams, sizeof(struct parameter));
+	parameter_init(params + col_id, filter->parameters[col_id].cl);
+
+	/* without data, the terms are evaluated as for an empty cell */
+	if (data) {
+		struct parameter *p = params + col_id;
+
+		switch (scols_column_get_json_type(p->cl)) {
+		case SCOLS_JSON_STRING:
+			p->val.str = data;
+			break;
+		case SCOLS_JSON_NUMBER:
+			p->val.num = strtoull(data, NULL, 10);
+			break;
+		case SCOLS_JSON_BOOLEAN:
+			p->val.boolean = str_to_boolean(data);
+			break;
+		}
+		p->has_value = true;
+	}
+
+	rc = node_check_column(filter->node, params, col_id);
+	free(params);
+	return rc;
+}
+
 bool lsfd_filter_apply(struct lsfd_filter *filter, struct libscols_line * ln)
 {
 	int i;
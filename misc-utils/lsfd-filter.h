@@ -37,6 +37,15 @@ const char *lsfd_filter_get_errmsg(struct lsfd_filter *filter);
 void lsfd_filter_free(struct lsfd_filter *filter);
 bool lsfd_filter_apply(struct lsfd_filter *filter, struct libscols_line *ln);
 
+/* Return true if the filter refers to the column. */
+bool lsfd_filter_has_column(struct lsfd_filter *filter, int col_id);
+
+/* Apply only the terms of the top-level conjunction of the filter which
+ * refer to no other column than @col_id, as if the column had @data (NULL
+ * for an empty cell). Returning false means no line with the data can be
+ * accepted by the filter, so the line does not have to be made at all. */
+bool lsfd_filter_check_column(struct lsfd_filter *filter, int col_id, const char *data);
+
 /* Dumping AST. */
 void lsfd_filter_dump(struct lsfd_filter *filter, FILE *stream);
 
@@ -21,6 +21,16 @@
 
 #include <sys/types.h>
 #include <sys/xattr.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+# include <linux/netlink.h>
+# include <linux/sock_diag.h>
+# include <linux/unix_diag.h>
+# include <linux/inet_diag.h>
+#endif
 
 #include "xalloc.h"
 #include "nls.h"
@@ -76,6 +86,266 @@ static bool sock_fill_column(struct proc *proc __attribute__((__unused__)),
 	return true;
 }
 
+/*
+ * Protocol names
+ *
+ * The name of the protocol is available only by getxattr() on the path of
+ * the socket in /proc. If there are many sockets, the AF_UNIX, TCP and UDP
+ * sockets of the network namespace of lsfd are enumerated by
+ * NETLINK_SOCK_DIAG, and the name is read only for the first socket of each
+ * kind (family, type and protocol); the other sockets of the kind share it.
+ * The inodes of sockets are unique in the system, so the sockets of the
+ * other network namespaces are simply not found in the table.
+ */
+#define SOCK_DIAG_THRESHOLD	64	/* getxattr() calls before the dump */
+#define SOCK_MAX_KINDS		16
+
+struct sock_kind {
+	int family;
+	int type;
+	int protocol;
+	char *protoname;		/* NULL until read */
+};
+
+struct sock_entry {
+	ino_t ino;			/* 0 for empty slot */
+	struct sock_kind *kind;
+};
+
+static struct sock_table {
+	pthread_mutex_t lock;		/* used by --jobs threads */
+	size_t nlookups;
+	bool loaded;			/* the dump is done (or failed) */
+
+	struct sock_entry *entries;	/* open addressing */
+	size_t size;			/* power of 2 */
+	size_t count;
+
+	struct sock_kind kinds[SOCK_MAX_KINDS];
+	size_t nkinds;
+} sock_table = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static inline size_t sock_hash(ino_t ino, size_t size)
+{
+	return ((uint64_t) ino * 0x9E3779B97F4A7C15ULL >> 32) & (size - 1);
+}
+
+static struct sock_kind *get_sock_kind(ino_t ino)
+{
+	size_t i;
+
+	if (!sock_table.count)
+		return NULL;
+
+	for (i = sock_hash(ino, sock_table.size);
+	     sock_table.entries[i].ino;
+	     i = (i + 1) & (sock_table.size - 1)) {
+		if (sock_table.entries[i].ino == ino)
+			return sock_table.entries[i].kind;
+	}
+	return NULL;
+}
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+static void insert_sock_entry(struct sock_entry *entries, size_t size,
+			      ino_t ino, struct sock_kind *kind)
+{
+	size_t i;
+
+	for (i = sock_hash(ino, size);
+	     entries[i].ino && entries[i].ino != ino;
+	     i = (i + 1) & (size - 1))
+		;
+	entries[i].ino = ino;
+	entries[i].kind = kind;
+}
+
+static void add_sock_entry(ino_t ino, int family, int type, int protocol)
+{
+	struct sock_kind *kind = NULL;
+	size_t i;
+
+	if (!ino)
+		return;
+
+	for (i = 0; i < sock_table.nkinds; i++) {
+		kind = &sock_table.kinds[i];
+		if (kind->family == family && kind->type == type
+		    && kind->protocol == protocol)
+			break;
+	}
+	if (i == sock_table.nkinds) {
+		if (i == SOCK_MAX_KINDS)
+			return;
+		kind = &sock_table.kinds[sock_table.nkinds++];
+		kind->family = family;
+		kind->type = type;
+		kind->protocol = protocol;
+	}
+
+	if ((sock_table.count + 1) * 2 > sock_table.size) {
+		size_t size = sock_table.size ? sock_table.size * 2 : 1024;
+		struct sock_entry *entries = xcalloc(size, sizeof(*entries));
+
+		for (i = 0; i < sock_table.size; i++) {
+			if (sock_table.entries[i].ino)
+				insert_sock_entry(entries, size,
+						  sock_table.entries[i].ino,
+						  sock_table.entries[i].kind);
+		}
+		free(sock_table.entries);
+		sock_table.entries = entries;
+		sock_table.size = size;
+	}
+
+	insert_sock_entry(sock_table.entries, sock_table.size, ino, kind);
+	sock_table.count++;
+}
+
+/* sends @req and calls add_sock_entry() for the sockets in the reply */
+static int sock_diag_dump(int nl, void *req, size_t reqsz, int type, int protocol)
+{
+	char buf[32 * 1024] __attribute__((__aligned__(NLMSG_ALIGNTO)));
+	struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+
+	if (sendto(nl, req, reqsz, 0, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+		return -errno;
+
+	for (;;) {
+		ssize_t len = recv(nl, buf, sizeof(buf), 0);
+		struct nlmsghdr *h;
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		for (h = (struct nlmsghdr *) buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (h->nlmsg_type == NLMSG_ERROR)
+				return -EINVAL;
+
+			if (protocol == 0) {
+				struct unix_diag_msg *m = NLMSG_DATA(h);
+
+				add_sock_entry(m->udiag_ino, AF_UNIX,
+					       m->udiag_type, 0);
+			} else {
+				struct inet_diag_msg *m = NLMSG_DATA(h);
+
+				add_sock_entry(m->idiag_inode, m->idiag_family,
+					       type, protocol);
+			}
+		}
+		if (len == 0)
+			return 0;
+	}
+}
+
+static void load_sock_table(void)
+{
+	static const struct {
+		int family, type, protocol;
+	} inets[] = {
+		{ AF_INET,  SOCK_STREAM, IPPROTO_TCP },
+		{ AF_INET6, SOCK_STREAM, IPPROTO_TCP },
+		{ AF_INET,  SOCK_DGRAM,  IPPROTO_UDP },
+		{ AF_INET6, SOCK_DGRAM,  IPPROTO_UDP },
+	};
+	struct {
+		struct nlmsghdr nlh;
+		struct unix_diag_req r;
+	} ureq = {
+		.nlh = {
+			.nlmsg_len = sizeof(ureq),
+			.nlmsg_type = SOCK_DIAG_BY_FAMILY,
+			.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP
+		},
+		.r = {
+			.sdiag_family = AF_UNIX,
+			.udiag_states = -1
+		}
+	};
+	size_t i;
+	int nl;
+
+	nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+	if (nl < 0)
+		return;
+
+	sock_diag_dump(nl, &ureq, sizeof(ureq), SOCK_STREAM, 0);
+
+	for (i = 0; i < ARRAY_SIZE(inets); i++) {
+		struct {
+			struct nlmsghdr nlh;
+			struct inet_diag_req_v2 r;
+		} ireq = {
+			.nlh = {
+				.nlmsg_len = sizeof(ireq),
+				.nlmsg_type = SOCK_DIAG_BY_FAMILY,
+				.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP
+			},
+			.r = {
+				.sdiag_family = inets[i].family,
+				.sdiag_protocol = inets[i].protocol,
+				.idiag_states = -1
+			}
+		};
+		sock_diag_dump(nl, &ireq, sizeof(ireq),
+			       inets[i].type, inets[i].protocol);
+	}
+
+	close(nl);
+}
+#else
+static void load_sock_table(void)
+{
+}
+#endif /* HAVE_LINUX_SOCK_DIAG_H */
+
+static char *read_protoname(const char *path)
+{
+	char buf[256];
+	ssize_t len;
+
+	len = getxattr(path, "system.sockprotoname", buf, sizeof(buf) - 1);
+	if (len <= 0)
+		return NULL;
+	buf[len] = '\0';
+	return xstrdup(buf);
+}
+
+static char *get_protoname(const char *path, ino_t ino)
+{
+	struct sock_kind *kind;
+	char *name = NULL;
+
+	pthread_mutex_lock(&sock_table.lock);
+	if (!sock_table.loaded && ++sock_table.nlookups > SOCK_DIAG_THRESHOLD) {
+		load_sock_table();
+		sock_table.loaded = true;
+	}
+	kind = get_sock_kind(ino);
+	if (kind && kind->protoname)
+		name = xstrdup(kind->protoname);
+	pthread_mutex_unlock(&sock_table.lock);
+
+	if (name)
+		return name;
+
+	name = read_protoname(path);
+	if (name && kind) {
+		pthread_mutex_lock(&sock_table.lock);
+		if (!kind->protoname)
+			kind->protoname = xstrdup(name);
+		pthread_mutex_unlock(&sock_table.lock);
+	}
+	return name;
+}
+
 static void init_sock_content(struct file *file)
 {
 	int fd;
@@ -87,8 +357,6 @@ static void init_sock_content(struct file *file)
 	if (fd >= 0 || fd == -ASSOC_MEM || fd == -ASSOC_SHM) {
 		struct sock *sock = (struct sock *)file;
 		char path[PATH_MAX] = {'\0'};
-		char buf[256];
-		ssize_t len;
 
 		assert(file->proc);
 
@@ -100,11 +368,7 @@ static void init_sock_content(struct file *file)
 				file->map_start,
 				file->map_end);
 
-		len = getxattr(path, "system.sockprotoname", buf, sizeof(buf) - 1);
-		if (len > 0) {
-			buf[len] = '\0';
-			sock->protoname = xstrdup(buf);
-		}
+		sock->protoname = get_protoname(path, file->stat.st_ino);
 	}
 }
 
@@ -117,9 +381,19 @@ static void free_sock_content(struct file *file)
 	}
 }
 
+static void sock_class_finalize(void)
+{
+	size_t i;
+
+	for (i = 0; i < sock_table.nkinds; i++)
+		free(sock_table.kinds[i].protoname);
+	free(sock_table.entries);
+}
+
 const struct file_class sock_class = {
 	.super = &file_class,
 	.size = sizeof(struct sock),
+	.finalize_class = sock_class_finalize,
 	.fill_column = sock_fill_column,
 	.initialize_content = init_sock_content,
 	.free_content = free_sock_content,
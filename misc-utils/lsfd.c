@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <linux/sched.h>
 #include <sys/syscall.h>
@@ -54,6 +55,10 @@ static int kcmp(pid_t pid1, pid_t pid2, int type,
 #include "fileutils.h"
 #include "idcache.h"
 #include "pathnames.h"
+#include "procsnap.h"
+#include "all-io.h"
+#include "ulstats.h"
+#include "jobs.h"
 
 #include "libsmartcols.h"
 
@@ -73,12 +78,16 @@ struct nodev {
 struct nodev_table {
 #define NODEV_TABLE_SIZE 97
 	struct list_head tables[NODEV_TABLE_SIZE];
+	pthread_mutex_t lock;		/* also for mnt_namespaces */
+};
+static struct nodev_table nodev_table = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
 };
-static struct nodev_table nodev_table;
 
 struct name_manager {
 	struct idcache *cache;
 	unsigned long next_id;
+	pthread_mutex_t lock;
 };
 
 /*
@@ -97,12 +106,20 @@ static struct list_head blkdrvs;
  * IPC table
  */
 
-#define IPC_TABLE_SIZE 997
+/* the table grows when the chains are longer than IPC_TABLE_LOAD on average */
+#define IPC_TABLE_MIN_SIZE	1024
+#define IPC_TABLE_LOAD		2
+
 struct ipc_table {
-	struct list_head tables[IPC_TABLE_SIZE];
+	struct list_head *tables;
+	size_t size;		/* number of slots, power of 2 */
+	size_t count;		/* number of IPCs */
+	pthread_mutex_t lock;
 };
 
-static struct ipc_table ipc_table;
+static struct ipc_table ipc_table = {
+	.lock = PTHREAD_MUTEX_INITIALIZER
+};
 
 /*
  * Column related stuffs
@@ -294,15 +311,21 @@ static struct counter_spec default_counter_specs[] = {
 struct lsfd_control {
 	struct libscols_table *tb;		/* output */
 	struct list_head procs;			/* list of all processes */
+	size_t jobs;				/* --jobs threads */
 
 	unsigned int	noheadings : 1,
 			raw : 1,
 			json : 1,
 			notrunc : 1,
 			threads : 1,
+			pushdown : 1,		/* check filter during collection */
+			watch : 1,		/* --watch */
+			watch_nfds : 1,		/* size of /proc/#/fd is the number of fds */
 			show_main : 1,		/* print main table */
 			show_summary : 1;	/* print summary/counters */
 
+	struct timeval interval;		/* --watch interval */
+
 	struct lsfd_filter *filter;
 	struct lsfd_counter **counters;		/* NULL terminated array. */
 };
@@ -473,9 +496,18 @@ static void file_set_path(struct file *file, struct stat *sb, const char *name,
 	file->stat = *sb;
 }
 
+/* called by --jobs threads; the classes with IPC share the IPC table, so
+ * their content is initialized with the table locked */
 static void file_init_content(struct file *file)
 {
-	if (file->class && file->class->initialize_content)
+	if (!file->class || !file->class->initialize_content)
+		return;
+
+	if (file->class->get_ipc_class) {
+		pthread_mutex_lock(&ipc_table.lock);
+		file->class->initialize_content(file);
+		pthread_mutex_unlock(&ipc_table.lock);
+	} else
 		file->class->initialize_content(file);
 }
 
@@ -515,42 +547,154 @@ static void free_proc(struct proc *proc)
 	free(proc);
 }
 
-static void read_fdinfo(struct file *file, FILE *fdinfo)
+/*
+ * The /proc/#/fd and /proc/#/fdinfo directories of the process, opened once
+ * and used for all its file descriptors. The content of the fdinfo files is
+ * read into one buffer.
+ */
+struct fd_reader {
+	int fd_dir;
+	int fdinfo_dir;
+	char *buf;
+	size_t bufsz;
+};
+
+static void parse_fdinfo_line(struct file *file, char *buf)
 {
-	char buf[1024];
+	const struct file_class *class;
+	char *val = strchr(buf, ':');
+
+	if (!val)
+		return;
+	*val++ = '\0';	/* terminate key */
 
-	while (fgets(buf, sizeof(buf), fdinfo)) {
-		const struct file_class *class;
-		char *val = strchr(buf, ':');
+	val = (char *) skip_space(val);
+	rtrim_whitespace((unsigned char *) val);
 
-		if (!val)
-			continue;
-		*val++ = '\0';	/* terminate key */
+	class = file->class;
+	while (class) {
+		if (class->handle_fdinfo
+		    && class->handle_fdinfo(file, buf, val))
+			break;
+		class = class->super;
+	}
+}
+
+static void read_fdinfo(struct file *file, struct fd_reader *rd, const char *name)
+{
+	size_t len = 0;
+	ssize_t n;
+	char *line, *next;
+	int fd;
 
-		val = (char *) skip_space(val);
-		rtrim_whitespace((unsigned char *) val);
+	fd = openat(rd->fdinfo_dir, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
 
-		class = file->class;
-		while (class) {
-			if (class->handle_fdinfo
-			    && class->handle_fdinfo(file, buf, val))
-				break;
-			class = class->super;
+	do {
+		if (rd->bufsz - len < BUFSIZ) {
+			rd->bufsz += BUFSIZ;
+			rd->buf = xrealloc(rd->buf, rd->bufsz);
 		}
+		n = read_all(fd, rd->buf + len, rd->bufsz - len - 1);
+		if (n > 0)
+			len += n;
+	} while (n > 0 && len == rd->bufsz - 1);
+
+	close(fd);
+	rd->buf[len] = '\0';
+
+	for (line = rd->buf; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		parse_fdinfo_line(file, line);
+	}
+}
+
+/* the mode of the fd symlink itself is the access mode of the file */
+static int read_fd_mode(struct fd_reader *rd, const char *name, mode_t *mode)
+{
+	struct stat sb;
+#ifdef HAVE_STATX
+	struct statx stx;
+
+	if (statx(rd->fd_dir, name, AT_SYMLINK_NOFOLLOW, STATX_MODE, &stx) == 0) {
+		*mode = stx.stx_mode;
+		return 0;
 	}
+	if (errno != ENOSYS)
+		return -errno;
+#endif
+	if (fstatat(rd->fd_dir, name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+		return -errno;
+	*mode = sb.st_mode;
+	return 0;
 }
 
-static struct file *collect_file_symlink(struct path_cxt *pc,
+static void fill_column(struct proc *proc,
+			struct file *file,
+			struct libscols_line *ln,
+			int column_id,
+			size_t column_index);
+
+/*
+ * Filter pushdown
+ *
+ * The terms of the top-level conjunction of the filter which refer only to
+ * PID, COMMAND, FD or TYPE are checked during the collection, so the
+ * processes and files which cannot be accepted are not read at all. It's
+ * not used if a column depends on the other files (ENDPOINTS).
+ */
+static bool pushdown_check(struct lsfd_control *ctl, int column_id, const char *data)
+{
+	if (!ctl->pushdown)
+		return true;
+	return lsfd_filter_check_column(ctl->filter, column_id, data);
+}
+
+/* checks the type of just stat()ed @file, before its content is read */
+static bool pushdown_check_type(struct lsfd_control *ctl, struct file *file)
+{
+	struct libscols_line *ln;
+	struct libscols_cell *ce;
+	bool rc;
+
+	if (!ctl->pushdown || !lsfd_filter_has_column(ctl->filter, COL_TYPE))
+		return true;
+
+	ln = scols_new_line();
+	if (!ln || scols_line_alloc_cells(ln, 1) != 0)
+		err(EXIT_FAILURE, _("failed to allocate output line"));
+
+	fill_column(file->proc, file, ln, COL_TYPE, 0);
+	ce = scols_line_get_cell(ln, 0);
+	rc = pushdown_check(ctl, COL_TYPE, ce ? scols_cell_get_data(ce) : NULL);
+
+	scols_unref_line(ln);
+	return rc;
+}
+
+/*
+ * Collects the file of symlink @name in the directory @dir. The @rd is used
+ * for the file-descriptor based associations.
+ */
+static struct file *collect_file_symlink(struct lsfd_control *ctl,
+					 int dir,
 					 struct proc *proc,
 					 const char *name,
-					 int assoc)
+					 int assoc,
+					 struct fd_reader *rd)
 {
 	char sym[PATH_MAX] = { '\0' };
 	struct stat sb;
 	struct file *f, *prev;
+	ssize_t len;
 
-	if (ul_path_readlink(pc, sym, sizeof(sym), name) < 0)
+	len = readlinkat(dir, name, sym, sizeof(sym) - 1);
+	if (len < 0)
 		return NULL;
+	sym[len] = '\0';
 
 	/* The /proc/#/{fd,ns} often contains the same file (e.g. /dev/tty)
 	 * more than once. Let's try to reuse the previous file if the real
@@ -561,30 +705,31 @@ static struct file *collect_file_symlink(struct path_cxt *pc,
 		f = copy_file(prev);
 		f->association = assoc;
 	} else {
-		if (ul_path_stat(pc, &sb, 0, name) < 0)
+		if (fstatat(dir, name, &sb, 0) < 0)
 			return NULL;
 
 		f = new_file(proc, stat2class(&sb));
 		file_set_path(f, &sb, sym, assoc);
 	}
 
-	file_init_content(f);
-
 	if (is_association(f, NS_MNT))
 		proc->ns_mnt = f->stat.st_ino;
 
-	else if (assoc >= 0) {
-		/* file-descriptor based association */
-		FILE *fdinfo;
+	if (!pushdown_check_type(ctl, f)) {
+		list_del(&f->files);
+		free_file(f);
+		return NULL;
+	}
 
-		if (ul_path_stat(pc, &sb, AT_SYMLINK_NOFOLLOW, name) == 0)
-			f->mode = sb.st_mode;
+	file_init_content(f);
 
-		fdinfo = ul_path_fopenf(pc, "r", "fdinfo/%d", assoc);
-		if (fdinfo) {
-			read_fdinfo(f, fdinfo);
-			fclose(fdinfo);
-		}
+	if (assoc >= 0 && rd) {
+		/* file-descriptor based association */
+		mode_t mode = 0;
+
+		if (read_fd_mode(rd, name, &mode) == 0)
+			f->mode = mode;
+		read_fdinfo(f, rd, name);
 	}
 
 	return f;
@@ -592,24 +737,48 @@ static struct file *collect_file_symlink(struct path_cxt *pc,
 
 /* read symlinks from /proc/#/fd
  */
-static void collect_fd_files(struct path_cxt *pc, struct proc *proc)
+static void collect_fd_files(struct lsfd_control *ctl, struct path_cxt *pc, struct proc *proc)
 {
-	DIR *sub = NULL;
-	struct dirent *d = NULL;
-	char path[sizeof("fd/") + sizeof(stringify_value(UINT64_MAX))];
+	struct fd_reader rd = { .fd_dir = -1, .fdinfo_dir = -1 };
+	struct dirent *d;
+	DIR *sub;
+	int dir;
+
+	dir = ul_path_get_dirfd(pc);
+	if (dir < 0)
+		return;
+
+	rd.fd_dir = openat(dir, "fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (rd.fd_dir < 0)
+		return;
+	sub = fdopendir(rd.fd_dir);
+	if (!sub) {
+		close(rd.fd_dir);
+		return;
+	}
+	rd.fdinfo_dir = openat(dir, "fdinfo", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (rd.fdinfo_dir < 0)
+		goto done;
 
-	while (ul_path_next_dirent(pc, &sub, "fd", &d) == 0) {
+	while ((d = xreaddir(sub))) {
 		uint64_t num;
 
 		if (ul_strtou64(d->d_name, &num, 10) != 0)	/* only numbers */
 			continue;
+		if (!pushdown_check(ctl, COL_FD, d->d_name))
+			continue;
 
-		snprintf(path, sizeof(path), "fd/%ju", (uintmax_t) num);
-		collect_file_symlink(pc, proc, path, num);
+		collect_file_symlink(ctl, rd.fd_dir, proc, d->d_name, num, &rd);
 	}
+
+	close(rd.fdinfo_dir);
+done:
+	closedir(sub);
+	free(rd.buf);
 }
 
-static void parse_maps_line(struct path_cxt *pc, char *buf, struct proc *proc)
+static void parse_maps_line(struct lsfd_control *ctl, struct path_cxt *pc,
+			    char *buf, struct proc *proc)
 {
 	uint64_t start, end, offset, ino;
 	unsigned long major, minor;
@@ -678,6 +847,12 @@ static void parse_maps_line(struct path_cxt *pc, char *buf, struct proc *proc)
 		file_set_path(f, &sb, sym, -assoc);
 	}
 
+	if (!pushdown_check_type(ctl, f)) {
+		list_del(&f->files);
+		free_file(f);
+		return;
+	}
+
 	if (modestr[0] == 'r')
 		f->mode |= S_IRUSR;
 	if (modestr[1] == 'w')
@@ -692,7 +867,7 @@ static void parse_maps_line(struct path_cxt *pc, char *buf, struct proc *proc)
 	file_init_content(f);
 }
 
-static void collect_mem_files(struct path_cxt *pc, struct proc *proc)
+static void collect_mem_files(struct lsfd_control *ctl, struct path_cxt *pc, struct proc *proc)
 {
 	FILE *fp;
 	char buf[BUFSIZ];
@@ -702,43 +877,52 @@ static void collect_mem_files(struct path_cxt *pc, struct proc *proc)
 		return;
 
 	while (fgets(buf, sizeof(buf), fp))
-		parse_maps_line(pc, buf, proc);
+		parse_maps_line(ctl, pc, buf, proc);
 
 	fclose(fp);
 }
 
-static void collect_outofbox_files(struct path_cxt *pc,
+static void collect_outofbox_files(struct lsfd_control *ctl,
+				   struct path_cxt *pc,
 				   struct proc *proc,
 				   enum association assocs[],
 				   const char *names[],
 				   size_t count)
 {
 	size_t i;
+	int dir = ul_path_get_dirfd(pc);
 
-	for (i = 0; i < count; i++)
-		collect_file_symlink(pc, proc, names[assocs[i]], assocs[i] * -1);
+	if (dir < 0)
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (!names[assocs[i]])	/* e.g. exe by collect_execve_file() */
+			continue;
+		collect_file_symlink(ctl, dir, proc, names[assocs[i]],
+				     assocs[i] * -1, NULL);
+	}
 }
 
-static void collect_execve_file(struct path_cxt *pc, struct proc *proc)
+static void collect_execve_file(struct lsfd_control *ctl, struct path_cxt *pc, struct proc *proc)
 {
 	enum association assocs[] = { ASSOC_EXE };
 	const char *names[] = {
 		[ASSOC_EXE]  = "exe",
 	};
-	collect_outofbox_files(pc, proc, assocs, names, ARRAY_SIZE(assocs));
+	collect_outofbox_files(ctl, pc, proc, assocs, names, ARRAY_SIZE(assocs));
 }
 
-static void collect_fs_files(struct path_cxt *pc, struct proc *proc)
+static void collect_fs_files(struct lsfd_control *ctl, struct path_cxt *pc, struct proc *proc)
 {
 	enum association assocs[] = { ASSOC_EXE, ASSOC_CWD, ASSOC_ROOT };
 	const char *names[] = {
 		[ASSOC_CWD]  = "cwd",
 		[ASSOC_ROOT] = "root",
 	};
-	collect_outofbox_files(pc, proc, assocs, names, ARRAY_SIZE(assocs));
+	collect_outofbox_files(ctl, pc, proc, assocs, names, ARRAY_SIZE(assocs));
 }
 
-static void collect_namespace_files(struct path_cxt *pc, struct proc *proc)
+static void collect_namespace_files(struct lsfd_control *ctl, struct path_cxt *pc, struct proc *proc)
 {
 	enum association assocs[] = {
 		ASSOC_NS_CGROUP,
@@ -764,7 +948,7 @@ static void collect_namespace_files(struct path_cxt *pc, struct proc *proc)
 		[ASSOC_NS_USER]   = "ns/user",
 		[ASSOC_NS_UTS]    = "ns/uts",
 	};
-	collect_outofbox_files(pc, proc, assocs, names, ARRAY_SIZE(assocs));
+	collect_outofbox_files(ctl, pc, proc, assocs, names, ARRAY_SIZE(assocs));
 }
 
 static struct nodev *new_nodev(unsigned long minor, const char *filesystem)
@@ -848,10 +1032,41 @@ static void add_nodevs(FILE *mnt)
 	}
 }
 
+static struct list_head *new_ipc_slots(size_t size)
+{
+	struct list_head *tables = xmalloc(size * sizeof(struct list_head));
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		INIT_LIST_HEAD(tables + i);
+	return tables;
+}
+
 static void initialize_ipc_table(void)
 {
-	for (int i = 0; i < IPC_TABLE_SIZE; i++)
-		INIT_LIST_HEAD(ipc_table.tables + i);
+	ipc_table.size = IPC_TABLE_MIN_SIZE;
+	ipc_table.count = 0;
+	ipc_table.tables = new_ipc_slots(ipc_table.size);
+}
+
+static void grow_ipc_table(void)
+{
+	size_t i, size = ipc_table.size * 2;
+	struct list_head *tables = new_ipc_slots(size);
+
+	for (i = 0; i < ipc_table.size; i++) {
+		struct list_head *e, *next;
+
+		list_for_each_safe(e, next, &ipc_table.tables[i]) {
+			struct ipc *ipc = list_entry(e, struct ipc, ipcs);
+
+			list_del(&ipc->ipcs);
+			list_add(&ipc->ipcs, &tables[ipc->hash & (size - 1)]);
+		}
+	}
+	free(ipc_table.tables);
+	ipc_table.tables = tables;
+	ipc_table.size = size;
 }
 
 static void free_ipc(struct ipc *ipc)
@@ -863,13 +1078,15 @@ static void free_ipc(struct ipc *ipc)
 
 static void finalize_ipc_table(void)
 {
-	for (int i = 0; i < IPC_TABLE_SIZE; i++)
+	for (size_t i = 0; i < ipc_table.size; i++)
 		list_free(&ipc_table.tables[i], struct ipc, ipcs, free_ipc);
+	free(ipc_table.tables);
+	ipc_table.tables = NULL;
 }
 
 struct ipc *get_ipc(struct file *file)
 {
-	int slot;
+	size_t slot;
 	struct list_head *e;
 	struct ipc_class *ipc_class;
 
@@ -880,7 +1097,7 @@ struct ipc *get_ipc(struct file *file)
 	if (!ipc_class)
 		return NULL;
 
-	slot = ipc_class->get_hash(file) % IPC_TABLE_SIZE;
+	slot = ipc_class->get_hash(file) & (ipc_table.size - 1);
 	list_for_each (e, &ipc_table.tables[slot]) {
 		struct ipc *ipc = list_entry(e, struct ipc, ipcs);
 		if (ipc->class != ipc_class)
@@ -893,8 +1110,11 @@ struct ipc *get_ipc(struct file *file)
 
 void add_ipc(struct ipc *ipc, unsigned int hash)
 {
-	int slot = hash % IPC_TABLE_SIZE;
-	list_add(&ipc->ipcs, &ipc_table.tables[slot]);
+	if (++ipc_table.count > ipc_table.size * IPC_TABLE_LOAD)
+		grow_ipc_table();
+
+	ipc->hash = hash;
+	list_add(&ipc->ipcs, &ipc_table.tables[hash & (ipc_table.size - 1)]);
 }
 
 static void fill_column(struct proc *proc,
@@ -914,15 +1134,23 @@ static void fill_column(struct proc *proc,
 	}
 }
 
-static void convert_file(struct proc *proc,
+/* fills the columns used (or not used) by the filter */
+static void convert_file(struct lsfd_control *ctl,
+		     struct proc *proc,
 		     struct file *file,
-		     struct libscols_line *ln)
+		     struct libscols_line *ln,
+		     bool filter_columns)
 
 {
 	size_t i;
 
-	for (i = 0; i < ncolumns; i++)
-		fill_column(proc, file, ln, get_column_id(i), i);
+	for (i = 0; i < ncolumns; i++) {
+		int id = get_column_id(i);
+
+		/* the first column is EVENT in --watch mode */
+		if (lsfd_filter_has_column(ctl->filter, id) == filter_columns)
+			fill_column(proc, file, ln, id, ctl->watch ? i + 1 : i);
+	}
 }
 
 static void convert(struct list_head *procs, struct lsfd_control *ctl)
@@ -941,13 +1169,16 @@ static void convert(struct list_head *procs, struct lsfd_control *ctl)
 			if (!ln)
 				err(EXIT_FAILURE, _("failed to allocate output line"));
 
-			convert_file(proc, file, ln);
+			/* the other columns only for the accepted lines */
+			convert_file(ctl, proc, file, ln, true);
 
 			if (!lsfd_filter_apply(ctl->filter, ln)) {
 				scols_table_remove_line(ctl->tb, ln);
 				continue;
 			}
 
+			convert_file(ctl, proc, file, ln, false);
+
 			if (!ctl->counters)
 				continue;
 
@@ -1082,7 +1313,7 @@ static void initialize_devdrvs(void)
 	INIT_LIST_HEAD(&chrdrvs);
 	INIT_LIST_HEAD(&blkdrvs);
 
-	devices_fp = fopen("/proc/devices", "r");
+	devices_fp = ul_procsnap_fopen(_PATH_PROC_DEVICES);
 	if (devices_fp) {
 		read_devices(&chrdrvs, &blkdrvs, devices_fp);
 		fclose(devices_fp);
@@ -1125,12 +1356,14 @@ struct name_manager *new_name_manager(void)
 		err(EXIT_FAILURE, _("failed to allocate an idcache"));
 
 	nm->next_id = 1;	/* 0 is never issued as id. */
+	pthread_mutex_init(&nm->lock, NULL);
 	return nm;
 }
 
 void free_name_manager(struct name_manager *nm)
 {
 	free_idcache(nm->cache);
+	pthread_mutex_destroy(&nm->lock);
 	free(nm);
 }
 
@@ -1138,7 +1371,9 @@ const char *get_name(struct name_manager *nm, unsigned long id)
 {
 	struct identry *e;
 
+	pthread_mutex_lock(&nm->lock);
 	e = get_id(nm->cache, id);
+	pthread_mutex_unlock(&nm->lock);
 
 	return e? e->name: NULL;
 }
@@ -1146,7 +1381,9 @@ const char *get_name(struct name_manager *nm, unsigned long id)
 unsigned long add_name(struct name_manager *nm, const char *name)
 {
 	struct identry *e = NULL, *tmp;
+	unsigned long id;
 
+	pthread_mutex_lock(&nm->lock);
 	for (tmp = nm->cache->ent; tmp; tmp = tmp->next) {
 		if (strcmp(tmp->name, name) == 0) {
 			e = tmp;
@@ -1154,23 +1391,25 @@ unsigned long add_name(struct name_manager *nm, const char *name)
 		}
 	}
 
-	if (e)
-		return e->id;
-
-	e = xmalloc(sizeof(struct identry));
-	e->name = xstrdup(name);
-	e->id = nm->next_id++;
-	e->next = nm->cache->ent;
-	nm->cache->ent = e;
+	if (!e) {
+		e = add_identry(nm->cache, nm->next_id++, name);
+		if (!e)
+			err_oom();
+	}
+	id = e->id;
+	pthread_mutex_unlock(&nm->lock);
 
-	return e->id;
+	return id;
 }
 
+/* reads the process @pid (and its threads) to @procs */
 static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
-			 pid_t pid, struct proc *leader)
+			 pid_t pid, struct proc *leader,
+			 struct list_head *procs)
 {
 	char buf[BUFSIZ];
 	struct proc *proc;
+	bool assocs;
 
 	if (procfs_process_init_path(pc, pid) != 0)
 		return;
@@ -1199,14 +1438,28 @@ static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
 		free(pat);
 	}
 
-	collect_execve_file(pc, proc);
+	/* the threads of the process may be accepted by the filter */
+	if (!pushdown_check(ctl, COL_COMMAND, proc->command))
+		goto done;
 
-	if (proc->pid == proc->leader->pid
-	    || kcmp(proc->leader->pid, proc->pid, KCMP_FS, 0, 0) != 0)
-		collect_fs_files(pc, proc);
+	/* the files without file descriptor have no FD */
+	assocs = pushdown_check(ctl, COL_FD, NULL);
+	if (assocs) {
+		collect_execve_file(ctl, pc, proc);
+
+		if (proc->pid == proc->leader->pid
+		    || kcmp(proc->leader->pid, proc->pid, KCMP_FS, 0, 0) != 0)
+			collect_fs_files(ctl, pc, proc);
+
+		collect_namespace_files(ctl, pc, proc);
+	} else {
+		struct stat sb;
 
-	collect_namespace_files(pc, proc);
+		if (ul_path_stat(pc, &sb, 0, "ns/mnt") == 0)
+			proc->ns_mnt = sb.st_ino;
+	}
 
+	pthread_mutex_lock(&nodev_table.lock);
 	if (proc->ns_mnt == 0 || !has_mnt_ns(proc->ns_mnt)) {
 		FILE *mnt = ul_path_fopen(pc, "r", "mountinfo");
 		if (mnt) {
@@ -1216,21 +1469,23 @@ static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
 			fclose(mnt);
 		}
 	}
+	pthread_mutex_unlock(&nodev_table.lock);
 
 	/* If kcmp is not available,
 	 * there is no way to no whether threads share resources.
 	 * In such cases, we must pay the costs: call collect_mem_files()
 	 * and collect_fd_files().
 	 */
-	if (proc->pid == proc->leader->pid
-	    || kcmp(proc->leader->pid, proc->pid, KCMP_VM, 0, 0) != 0)
-		collect_mem_files(pc, proc);
+	if (assocs
+	    && (proc->pid == proc->leader->pid
+		|| kcmp(proc->leader->pid, proc->pid, KCMP_VM, 0, 0) != 0))
+		collect_mem_files(ctl, pc, proc);
 
 	if (proc->pid == proc->leader->pid
 	    || kcmp(proc->leader->pid, proc->pid, KCMP_FILES, 0, 0) != 0)
-		collect_fd_files(pc, proc);
-
-	list_add_tail(&proc->procs, &ctl->procs);
+		collect_fd_files(ctl, pc, proc);
+done:
+	list_add_tail(&proc->procs, procs);
 
 	/* The tasks collecting overwrites @pc by /proc/<task-pid>/. Keep it as
 	 * the last path based operation in read_process()
@@ -1242,7 +1497,7 @@ static void read_process(struct lsfd_control *ctl, struct path_cxt *pc,
 		while (procfs_process_next_tid(pc, &sub, &tid) == 0) {
 			if (tid == pid)
 				continue;
-			read_process(ctl, pc, tid, proc);
+			read_process(ctl, pc, tid, proc, procs);
 		}
 	}
 
@@ -1301,31 +1556,99 @@ static bool member_pids(const pid_t pid, const pid_t pids[], const int count)
 	return bsearch(&pid, pids, count, sizeof(pid_t), pidcmp)? true: false;
 }
 
-static void collect_processes(struct lsfd_control *ctl, const pid_t pids[], int n_pids)
+/*
+ * Parallel /proc scanning (--jobs)
+ *
+ * The PIDs are read from /proc first. The processes are read by the threads
+ * to per-PID lists, which are merged in the order of /proc, so the output
+ * does not depend on the number of threads.
+ */
+struct collector {
+	struct lsfd_control *ctl;
+	pid_t *pids;
+	struct list_head *procs;	/* per-PID lists of struct proc */
+	size_t npids;
+	size_t next;			/* next PID to read, atomic */
+};
+
+static void *collect_worker(void *arg)
 {
-	DIR *dir;
-	struct dirent *d;
-	struct path_cxt *pc = NULL;
+	struct collector *co = arg;
+	struct path_cxt *pc;
+	size_t i;
 
 	pc = ul_new_path(NULL);
 	if (!pc)
 		err(EXIT_FAILURE, _("failed to alloc procfs handler"));
 
-	dir = opendir(_PATH_PROC);
-	if (!dir)
-		err(EXIT_FAILURE, _("failed to open /proc"));
+	while ((i = __atomic_fetch_add(&co->next, 1, __ATOMIC_RELAXED)) < co->npids)
+		read_process(co->ctl, pc, co->pids[i], NULL, &co->procs[i]);
+
+	ul_unref_path(pc);
+	return NULL;
+}
+
+/* returns the PIDs in /proc to read, @pids are the PIDs given by --pid */
+static pid_t *read_pids(struct lsfd_control *ctl, const pid_t pids[], int n_pids,
+			size_t *count)
+{
+	struct procfs_scan sc;
+	pid_t *res = NULL, pid;
+	size_t n = 0, nmax = 0;
 
-	while ((d = readdir(dir))) {
-		pid_t pid;
+	if (procfs_scan_open(&sc, NULL) != 0)
+		err(EXIT_FAILURE, _("failed to open /proc"));
 
-		if (procfs_dirent_get_pid(d, &pid) != 0)
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		if (n_pids != 0 && !member_pids(pid, pids, n_pids))
 			continue;
-		if (n_pids == 0 || member_pids(pid, pids, n_pids))
-			read_process(ctl, pc, pid, 0);
+		if (!pushdown_check(ctl, COL_PID, procfs_scan_get_pidstr(&sc)))
+			continue;
+		if (n == nmax) {
+			nmax = nmax ? nmax * 2 : 256;
+			res = xrealloc(res, nmax * sizeof(pid_t));
+		}
+		res[n++] = pid;
 	}
+	procfs_scan_close(&sc);
 
-	closedir(dir);
-	ul_unref_path(pc);
+	*count = n;
+	return res;
+}
+
+/* reads the processes @pids to the lists @procs, by --jobs threads */
+static void read_processes(struct lsfd_control *ctl, pid_t *pids,
+			   struct list_head *procs, size_t count)
+{
+	struct collector co = {
+		.ctl = ctl,
+		.pids = pids,
+		.procs = procs,
+		.npids = count
+	};
+
+	ul_run_jobs(min(ctl->jobs, co.npids), collect_worker, &co, 0);
+}
+
+static void collect_processes(struct lsfd_control *ctl, const pid_t pids[], int n_pids)
+{
+	struct list_head *procs;
+	pid_t *list;
+	size_t i, count;
+
+	list = read_pids(ctl, pids, n_pids, &count);
+
+	procs = xcalloc(count, sizeof(struct list_head));
+	for (i = 0; i < count; i++)
+		INIT_LIST_HEAD(&procs[i]);
+
+	read_processes(ctl, list, procs, count);
+
+	for (i = 0; i < count; i++)
+		list_splice_tail(&procs[i], &ctl->procs);
+
+	free(procs);
+	free(list);
 }
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -1344,12 +1667,16 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -r, --raw             use raw output format\n"), out);
 	fputs(_(" -u, --notruncate      don't truncate text in columns\n"), out);
 	fputs(_(" -p, --pid  <pid(s)>   collect information only specified processes\n"), out);
+	fputs(_(" -j, --jobs <num>      number of threads to read processes\n"), out);
+	fputs(_(" -w, --watch <secs>    print added and removed files every <secs> seconds\n"), out);
 	fputs(_(" -Q, --filter <expr>   apply display filter\n"), out);
 	fputs(_("     --debug-filter    dump the internal data structure of filter and exit\n"), out);
 	fputs(_(" -C, --counter <name>:<expr>\n"
 		"                       define custom counter for --summary output\n"), out);
 	fputs(_("     --dump-counters   dump counter definitions\n"), out);
 	fputs(_("     --summary[=when]  print summary information (only, append, or never)\n"), out);
+	fputs(_("     --stats[=<format>]\n"
+		"                       print statistics to stderr (text or json)\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(23));
@@ -1579,6 +1906,298 @@ static void emit_summary(struct lsfd_control *ctl, struct lsfd_counter **counter
 	scols_unref_table(tb);
 }
 
+/*
+ * Watch mode (--watch)
+ *
+ * The processes are kept in memory between the intervals. A process is read
+ * again only if its start time or the number of its file descriptors has
+ * changed, and the files added and removed since the previous interval are
+ * printed as events. The counters of --summary are updated by the events.
+ */
+struct watch_entry {
+	pid_t pid;
+	unsigned long long starttime;
+	off_t nfds;			/* size of /proc/#/fd */
+	struct list_head procs;		/* the process and its threads */
+	unsigned int changed : 1;
+};
+
+static int watch_entry_cmp(const void *a, const void *b)
+{
+	return pidcmp(&((const struct watch_entry *)a)->pid,
+		      &((const struct watch_entry *)b)->pid);
+}
+
+static void watch_read_state(struct path_cxt *pc, struct watch_entry *ent)
+{
+	char buf[BUFSIZ];
+	struct stat sb;
+	char *p;
+
+	if (procfs_process_init_path(pc, ent->pid) != 0)
+		return;
+
+	/* See proc(5), the start time is the 22nd field. */
+	if (procfs_process_get_stat(pc, buf, sizeof(buf)) > 0
+	    && (p = strrchr(buf, ')')))
+		sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+			      "%*u %*u %*d %*d %*d %*d %*d %*d %llu",
+		       &ent->starttime);
+
+	if (ul_path_stat(pc, &sb, 0, "fd") == 0)
+		ent->nfds = sb.st_size;
+
+	ul_path_close_dirfd(pc);
+}
+
+/*
+ * Reads the processes to a new array of entries sorted by PID. The processes
+ * not changed since @old are moved from there.
+ */
+static struct watch_entry *watch_scan(struct lsfd_control *ctl,
+				      struct path_cxt *pc,
+				      const pid_t pids[], int n_pids,
+				      struct watch_entry *old, size_t nold,
+				      size_t *count)
+{
+	struct watch_entry *ents;
+	struct list_head *procs;
+	pid_t *list, *todo;
+	size_t i, j, n, ntodo = 0;
+
+	list = read_pids(ctl, pids, n_pids, &n);
+	if (n > 1)
+		sort_pids(list, n);
+
+	ents = xcalloc(n ? n : 1, sizeof(struct watch_entry));
+	todo = xcalloc(n ? n : 1, sizeof(pid_t));
+
+	for (i = 0; i < n; i++) {
+		struct watch_entry *ent = &ents[i], *prev;
+
+		ent->pid = list[i];
+		INIT_LIST_HEAD(&ent->procs);
+		watch_read_state(pc, ent);
+
+		prev = old ? bsearch(ent, old, nold, sizeof(*old), watch_entry_cmp) : NULL;
+		if (prev && ctl->watch_nfds
+		    && prev->starttime == ent->starttime
+		    && prev->nfds == ent->nfds) {
+			list_splice_tail(&prev->procs, &ent->procs);
+			INIT_LIST_HEAD(&prev->procs);
+		} else {
+			ent->changed = 1;
+			todo[ntodo++] = ent->pid;
+		}
+	}
+
+	procs = xcalloc(ntodo ? ntodo : 1, sizeof(struct list_head));
+	for (i = 0; i < ntodo; i++)
+		INIT_LIST_HEAD(&procs[i]);
+
+	read_processes(ctl, todo, procs, ntodo);
+
+	for (i = 0, j = 0; i < ntodo; i++) {
+		while (ents[j].pid != todo[i])
+			j++;
+		list_splice_tail(&procs[i], &ents[j].procs);
+	}
+
+	free(procs);
+	free(todo);
+	free(list);
+
+	*count = n;
+	return ents;
+}
+
+static struct file **watch_get_files(struct list_head *procs, size_t *count)
+{
+	struct file **files = NULL;
+	struct list_head *p, *f;
+	size_t n = 0, nmax = 0;
+
+	list_for_each (p, procs) {
+		struct proc *proc = list_entry(p, struct proc, procs);
+
+		list_for_each (f, &proc->files) {
+			if (n == nmax) {
+				nmax = nmax ? nmax * 2 : 64;
+				files = xrealloc(files, nmax * sizeof(struct file *));
+			}
+			files[n++] = list_entry(f, struct file, files);
+		}
+	}
+
+	*count = n;
+	return files;
+}
+
+/* the files are the same if they differ only in the state (position etc.) */
+static int watch_file_cmp(const void *a, const void *b)
+{
+	const struct file *fa = *(const struct file **)a;
+	const struct file *fb = *(const struct file **)b;
+	int diff = cmp_numbers(fa->proc->pid, fb->proc->pid);
+
+	if (!diff)
+		diff = cmp_numbers(fa->association, fb->association);
+	if (!diff)
+		diff = cmp_numbers(fa->map_start, fb->map_start);
+	if (!diff)
+		diff = cmp_numbers(fa->stat.st_dev, fb->stat.st_dev);
+	if (!diff)
+		diff = cmp_numbers(fa->stat.st_ino, fb->stat.st_ino);
+	if (!diff)
+		diff = strcmp(fa->name ? fa->name : "", fb->name ? fb->name : "");
+	return diff;
+}
+
+static void watch_add_event(struct lsfd_control *ctl, struct file *file, bool added)
+{
+	struct libscols_line *ln = scols_table_new_line(ctl->tb, NULL);
+	struct lsfd_counter **counter;
+
+	if (!ln)
+		err(EXIT_FAILURE, _("failed to allocate output line"));
+
+	convert_file(ctl, file->proc, file, ln, true);
+
+	if (!lsfd_filter_apply(ctl->filter, ln)) {
+		scols_table_remove_line(ctl->tb, ln);
+		return;
+	}
+
+	convert_file(ctl, file->proc, file, ln, false);
+	if (scols_line_set_data(ln, 0, added ? "added" : "removed"))
+		err(EXIT_FAILURE, _("failed to add output data"));
+
+	for (counter = ctl->counters; counter && *counter; counter++) {
+		if (added)
+			lsfd_counter_accumulate(*counter, ln);
+		else
+			lsfd_counter_subtract(*counter, ln);
+	}
+
+	if (!ctl->show_main)
+		scols_table_remove_line(ctl->tb, ln);
+}
+
+/* adds events for the files in @new and not in @old and vice versa */
+static void watch_diff(struct lsfd_control *ctl,
+		       struct list_head *old, struct list_head *new)
+{
+	struct file **a, **b;
+	size_t na, nb, i = 0, j = 0;
+
+	a = watch_get_files(old, &na);
+	b = watch_get_files(new, &nb);
+
+	if (na)
+		qsort(a, na, sizeof(struct file *), watch_file_cmp);
+	if (nb)
+		qsort(b, nb, sizeof(struct file *), watch_file_cmp);
+
+	while (i < na || j < nb) {
+		int diff = i == na ? 1 :
+			   j == nb ? -1 : watch_file_cmp(&a[i], &b[j]);
+
+		if (diff < 0)
+			watch_add_event(ctl, a[i++], false);
+		else if (diff > 0)
+			watch_add_event(ctl, b[j++], true);
+		else
+			i++, j++;
+	}
+
+	free(a);
+	free(b);
+}
+
+static void watch_free(struct watch_entry *ents, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		list_free(&ents[i].procs, struct proc, procs, free_proc);
+	free(ents);
+}
+
+static void watch_emit(struct lsfd_control *ctl)
+{
+	if (ctl->show_main && scols_table_get_nlines(ctl->tb)) {
+		emit(ctl);
+		scols_table_remove_lines(ctl->tb);
+	}
+	if (ctl->show_summary && ctl->counters)
+		emit_summary(ctl, ctl->counters);
+
+	fflush(stdout);
+}
+
+/* runs until interrupted or until all the processes given by --pid are gone */
+static void watch_processes(struct lsfd_control *ctl, const pid_t pids[], int n_pids)
+{
+	struct watch_entry *ents, *old;
+	struct list_head none;
+	struct path_cxt *pc;
+	struct stat sb;
+	size_t i, j, count, nold;
+
+	INIT_LIST_HEAD(&none);
+
+	pc = ul_new_path(NULL);
+	if (!pc)
+		err(EXIT_FAILURE, _("failed to alloc procfs handler"));
+
+	/* since Linux 6.2 */
+	ctl->watch_nfds = stat(_PATH_PROC "/self/fd", &sb) == 0 && sb.st_size > 0;
+
+	/* the initial state, only the counters are printed */
+	ents = watch_scan(ctl, pc, pids, n_pids, NULL, 0, &count);
+	for (i = 0; i < count; i++)
+		watch_diff(ctl, &none, &ents[i].procs);
+	scols_table_remove_lines(ctl->tb);
+	if (ctl->show_summary && ctl->counters)
+		emit_summary(ctl, ctl->counters);
+	fflush(stdout);
+
+	while (!(n_pids && count == 0)) {
+		struct timespec ts = {
+			.tv_sec = ctl->interval.tv_sec,
+			.tv_nsec = ctl->interval.tv_usec * 1000
+		};
+
+		while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+
+		old = ents;
+		nold = count;
+		ents = watch_scan(ctl, pc, pids, n_pids, old, nold, &count);
+
+		/* both arrays are sorted by PID */
+		for (i = 0, j = 0; i < nold || j < count; ) {
+			int diff = i == nold ? 1 :
+				   j == count ? -1 : watch_entry_cmp(&old[i], &ents[j]);
+
+			if (diff < 0)
+				watch_diff(ctl, &old[i++].procs, &none);
+			else if (diff > 0)
+				watch_diff(ctl, &none, &ents[j++].procs);
+			else {
+				if (ents[j].changed)
+					watch_diff(ctl, &old[i].procs, &ents[j].procs);
+				i++, j++;
+			}
+		}
+
+		watch_free(old, nold);
+		watch_emit(ctl);
+	}
+
+	watch_free(ents, count);
+	ul_unref_path(pc);
+}
+
 int main(int argc, char *argv[])
 {
 	int c;
@@ -1592,7 +2211,8 @@ int main(int argc, char *argv[])
 	struct list_head counter_specs;
 
 	struct lsfd_control ctl = {
-		.show_main = 1
+		.show_main = 1,
+		.jobs = 1
 	};
 
 	INIT_LIST_HEAD(&counter_specs);
@@ -1601,6 +2221,7 @@ int main(int argc, char *argv[])
 		OPT_DEBUG_FILTER = CHAR_MAX + 1,
 		OPT_SUMMARY,
 		OPT_DUMP_COUNTERS,
+		OPT_STATS,
 	};
 	static const struct option longopts[] = {
 		{ "noheadings", no_argument, NULL, 'n' },
@@ -1612,11 +2233,14 @@ int main(int argc, char *argv[])
 		{ "threads",    no_argument, NULL, 'l' },
 		{ "notruncate", no_argument, NULL, 'u' },
 		{ "pid",        required_argument, NULL, 'p' },
+		{ "jobs",       required_argument, NULL, 'j' },
+		{ "watch",      required_argument, NULL, 'w' },
 		{ "filter",     required_argument, NULL, 'Q' },
 		{ "debug-filter",no_argument, NULL, OPT_DEBUG_FILTER },
 		{ "summary",    optional_argument, NULL,  OPT_SUMMARY },
 		{ "counter",    required_argument, NULL, 'C' },
 		{ "dump-counters",no_argument, NULL, OPT_DUMP_COUNTERS },
+		{ "stats",      optional_argument, NULL, OPT_STATS },
 		{ NULL, 0, NULL, 0 },
 	};
 
@@ -1625,7 +2249,7 @@ int main(int argc, char *argv[])
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "no:JrVhluQ:p:C:s", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "no:JrVhluQ:p:j:w:C:s", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'n':
 			ctl.noheadings = 1;
@@ -1648,6 +2272,16 @@ int main(int argc, char *argv[])
 		case 'p':
 			parse_pids(optarg, &pids, &n_pids);
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
+		case 'w':
+			strtotimeval_or_err(optarg, &ctl.interval,
+					    _("invalid watch interval"));
+			ctl.watch = 1;
+			break;
 		case 'Q':
 			append_filter_expr(&filter_expr, optarg, true);
 			break;
@@ -1675,6 +2309,15 @@ int main(int argc, char *argv[])
 		case OPT_DUMP_COUNTERS:
 			dump_counters = true;
 			break;
+		case OPT_STATS:
+		{
+			int fmt = ul_stats_parse_format(optarg);
+
+			if (fmt < 0)
+				errx(EXIT_FAILURE, _("unsupported statistics format: %s"), optarg);
+			ul_stats_init(fmt);
+			break;
+		}
 		case 'V':
 			print_version(EXIT_SUCCESS);
 		case 'h':
@@ -1713,6 +2356,15 @@ int main(int argc, char *argv[])
 	if (ctl.json)
 		scols_table_set_name(ctl.tb, "lsfd");
 
+	/* the events of --watch, filled by watch_add_event() */
+	if (ctl.watch) {
+		struct libscols_column *cl = scols_table_new_column(ctl.tb,
+							"EVENT", 0, 0);
+		if (!cl)
+			err(EXIT_FAILURE, _("failed to allocate output column"));
+		scols_column_set_json_type(cl, SCOLS_JSON_STRING);
+	}
+
 	/* create output columns */
 	for (i = 0; i < ncolumns; i++) {
 		const struct colinfo *col = get_column_info(i);
@@ -1753,6 +2405,15 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	/* ENDPOINTS needs all the files of the IPC, not only the accepted */
+	if (ctl.filter) {
+		ctl.pushdown = 1;
+		for (i = 0; i < ncolumns; i++) {
+			if (get_column_id(i) == COL_ENDPOINTS)
+				ctl.pushdown = 0;
+		}
+	}
+
 	if (n_pids > 0)
 		sort_pids(pids, n_pids);
 
@@ -1762,18 +2423,28 @@ int main(int argc, char *argv[])
 	initialize_devdrvs();
 	initialize_ipc_table();
 
+	if (ctl.watch) {
+		watch_processes(&ctl, pids, n_pids);
+		free(pids);
+		goto done;
+	}
+
+	ul_stats_phase("collect");
 	collect_processes(&ctl, pids, n_pids);
 	free(pids);
 
+	ul_stats_phase("format");
 	convert(&ctl.procs, &ctl);
 
 	/* print */
+	ul_stats_phase("print");
 	if (ctl.show_main)
 		emit(&ctl);
 
 	if (ctl.show_summary && ctl.counters)
 		emit_summary(&ctl, ctl.counters);
-
+	ul_stats_phase(NULL);
+done:
 	/* cleanup */
 	delete(&ctl.procs, &ctl);
 
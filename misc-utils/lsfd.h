@@ -151,6 +151,7 @@ struct ipc {
 	const struct ipc_class *class;
 	struct list_head endpoints;
 	struct list_head ipcs;
+	unsigned int hash;
 };
 
 struct ipc_endpoint {
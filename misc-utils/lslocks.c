@@ -24,10 +24,12 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <getopt.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <dirent.h>
+#include <search.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -88,6 +90,7 @@ static struct colinfo infos[] = {
 
 static int columns[ARRAY_SIZE(infos) * 2];
 static size_t ncolumns;
+static size_t nvisible;		/* the rest of columns[] is used by filter only */
 
 static pid_t pid = 0;
 
@@ -100,6 +103,8 @@ static int raw;
 static int json;
 static int bytes;
 
+static const char *filter;
+
 struct lock {
 	struct list_head locks;
 
@@ -116,8 +121,36 @@ struct lock {
 		     blocked   :1;
 	uint64_t size;
 	int id;
+	pid_t blocker;		/* PID of the blocking lock or 0 */
+};
+
+/*
+ * The file descriptors of a process, sorted by inode. The fd directory of
+ * the process is read once, when the path of its first lock is needed.
+ */
+struct proc_fd {
+	ino_t	inode;
+	size_t	idx;		/* readdir() order */
+	int	fd;
+	off_t	size;
+	char	*path;		/* readlink() result or NULL */
+	unsigned int resolved :1;
+};
+
+struct lock_proc {
+	pid_t	pid;
+	char	*cmdname;
+
+	struct proc_fd *fds;
+	size_t	nfds;
+	struct proc_fd failed;	/* the first fd fstatat() failed for */
+	unsigned int has_fds :1,
+		     has_failed :1,
+		     no_fddir :1;
 };
 
+static void *procs;		/* tsearch() tree of struct lock_proc */
+
 static void rem_lock(struct lock *lock)
 {
 	if (!lock)
@@ -161,65 +194,172 @@ static char *get_fallback_filename(dev_t dev)
 	return res;
 }
 
+static int cmp_procs(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct lock_proc *) a)->pid,
+			   ((const struct lock_proc *) b)->pid);
+}
+
+static int cmp_proc_fds(const void *a0, const void *b0)
+{
+	const struct proc_fd *a = a0, *b = b0;
+	int rc = cmp_numbers(a->inode, b->inode);
+
+	return rc ? rc : cmp_numbers(a->idx, b->idx);
+}
+
+static void free_proc(void *data)
+{
+	struct lock_proc *pr = data;
+	size_t i;
+
+	for (i = 0; i < pr->nfds; i++)
+		free(pr->fds[i].path);
+	free(pr->failed.path);
+	free(pr->fds);
+	free(pr->cmdname);
+	free(pr);
+}
+
+static struct lock_proc *get_proc(pid_t lock_pid)
+{
+	struct lock_proc key = { .pid = lock_pid }, *pr;
+	void **node;
+
+	node = tfind(&key, &procs, cmp_procs);
+	if (node)
+		return *node;
+
+	pr = xcalloc(1, sizeof(*pr));
+	pr->pid = lock_pid;
+	pr->cmdname = pid_get_cmdname(lock_pid);
+	if (!tsearch(pr, &procs, cmp_procs))
+		err_oom();
+	return pr;
+}
+
 /*
- * Return the absolute path of a file from
- * a given inode number (and its size)
+ * We know the pid so we don't have to
+ * iterate the *entire* filesystem searching
+ * for the damn file.
  */
-static char *get_filename_sz(ino_t inode, pid_t lock_pid, size_t *size)
+static void read_proc_fds(struct lock_proc *pr)
 {
-	struct stat sb;
+	char path[PATH_MAX];
 	struct dirent *dp;
+	size_t idx = 0, nalloc = 0;
 	DIR *dirp;
-	size_t len;
 	int fd;
-	char path[PATH_MAX], sym[PATH_MAX], *ret = NULL;
 
-	*size = 0;
-	memset(path, 0, sizeof(path));
-	memset(sym, 0, sizeof(sym));
+	pr->has_fds = 1;
 
-	/*
-	 * We know the pid so we don't have to
-	 * iterate the *entire* filesystem searching
-	 * for the damn file.
-	 */
-	snprintf(path, sizeof(path), "/proc/%d/fd/", lock_pid);
-	if (!(dirp = opendir(path)))
-		return NULL;
-
-	if ((len = strlen(path)) >= (sizeof(path) - 2))
-		goto out;
-
-	if ((fd = dirfd(dirp)) < 0 )
-		goto out;
+	snprintf(path, sizeof(path), "/proc/%d/fd/", pr->pid);
+	if (!(dirp = opendir(path)) || (fd = dirfd(dirp)) < 0) {
+		pr->no_fddir = 1;
+		if (dirp)
+			closedir(dirp);
+		return;
+	}
 
 	while ((dp = readdir(dirp))) {
-		if (!strcmp(dp->d_name, ".") ||
-		    !strcmp(dp->d_name, ".."))
-			continue;
+		struct proc_fd *f;
+		struct stat sb;
+		long num;
 
 		errno = 0;
 
 		/* care only for numerical descriptors */
-		if (!strtol(dp->d_name, (char **) NULL, 10) || errno)
+		num = strtol(dp->d_name, (char **) NULL, 10);
+		if (!num || errno)
 			continue;
 
-		if (!fstatat(fd, dp->d_name, &sb, 0)
-		    && inode != sb.st_ino)
+		if (fstatat(fd, dp->d_name, &sb, 0) != 0) {
+			/* used for any inode, as if the fd matched */
+			if (!pr->has_failed) {
+				pr->has_failed = 1;
+				pr->failed.idx = idx;
+				pr->failed.fd = num;
+			}
+			idx++;
 			continue;
+		}
 
-		if ((len = readlinkat(fd, dp->d_name, sym, sizeof(sym) - 1)) < 1)
-			goto out;
+		if (pr->nfds == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 64;
+			pr->fds = xrealloc(pr->fds, nalloc * sizeof(struct proc_fd));
+		}
+		f = &pr->fds[pr->nfds++];
+		memset(f, 0, sizeof(*f));
+		f->inode = sb.st_ino;
+		f->idx = idx++;
+		f->fd = num;
+		f->size = sb.st_size;
+	}
+	closedir(dirp);
+
+	if (pr->nfds)
+		qsort(pr->fds, pr->nfds, sizeof(struct proc_fd), cmp_proc_fds);
+}
+
+/* returns the first fd in readdir() order with the inode */
+static struct proc_fd *find_proc_fd(struct lock_proc *pr, ino_t inode)
+{
+	struct proc_fd *f = NULL;
+	size_t lo = 0, hi = pr->nfds;
 
-		*size = sb.st_size;
-		sym[len] = '\0';
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
 
-		ret = xstrdup(sym);
-		break;
+		if (pr->fds[mid].inode < inode)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-out:
-	closedir(dirp);
-	return ret;
+	if (lo < pr->nfds && pr->fds[lo].inode == inode)
+		f = &pr->fds[lo];
+
+	if (pr->has_failed && (!f || pr->failed.idx < f->idx))
+		f = &pr->failed;
+	return f;
+}
+
+/*
+ * Return the absolute path of a file from
+ * a given inode number (and its size)
+ */
+static char *get_filename_sz(ino_t inode, pid_t lock_pid, size_t *size)
+{
+	struct lock_proc *pr = get_proc(lock_pid);
+	struct proc_fd *f;
+
+	*size = 0;
+
+	if (!pr->has_fds)
+		read_proc_fds(pr);
+	if (pr->no_fddir)
+		return NULL;
+
+	f = find_proc_fd(pr, inode);
+	if (!f)
+		return NULL;
+
+	if (!f->resolved) {
+		char path[PATH_MAX], sym[PATH_MAX];
+		ssize_t len;
+
+		snprintf(path, sizeof(path), "/proc/%d/fd/%d", lock_pid, f->fd);
+		len = readlink(path, sym, sizeof(sym) - 1);
+		if (len > 0) {
+			sym[len] = '\0';
+			f->path = xstrdup(sym);
+		}
+		f->resolved = 1;
+	}
+	if (!f->path)
+		return NULL;
+
+	*size = f->size;
+	return xstrdup(f->path);
 }
 
 /*
@@ -244,6 +384,8 @@ static int get_local_locks(struct list_head *locks)
 	char buf[PATH_MAX], *tok = NULL;
 	size_t sz;
 	struct lock *l;
+	int last_id = 0;		/* the last listed lock which is not blocked */
+	pid_t last_pid = 0;
 
 	if (!(fp = fopen(_PATH_PROC_LOCKS, "r")))
 		return -1;
@@ -286,12 +428,6 @@ static int get_local_locks(struct list_head *locks)
 				 * to the list, no need to worry now. OFD locks use -1 PID.
 				 */
 				l->pid = strtos32_or_err(tok, _("failed to parse pid"));
-				if (l->pid > 0) {
-					l->cmdname = pid_get_cmdname(l->pid);
-					if (!l->cmdname)
-						l->cmdname = xstrdup(_("(unknown)"));
-				} else
-					l->cmdname = xstrdup(_("(undefined)"));
 				break;
 
 			case 5: /* device major:minor and inode number */
@@ -314,14 +450,50 @@ static int get_local_locks(struct list_head *locks)
 			}
 		}
 
+		/* the blocking lock precedes its waiters with the same ID */
+		if (l->blocked && l->id && l->id == last_id)
+			l->blocker = last_pid;
+
+		/*
+		 * If user passed a pid, the other locks are used only for
+		 * BLOCKER, their path is needed only to know if they're
+		 * ignored.
+		 */
+		if (pid && pid != l->pid) {
+			if (!l->blocked) {
+				char *path = no_inaccessible ?
+					get_filename_sz(l->inode, l->pid, &sz) : NULL;
+
+				last_id = !no_inaccessible || path ? l->id : 0;
+				last_pid = l->pid;
+				free(path);
+			}
+			rem_lock(l);
+			continue;
+		}
+
 		l->path = get_filename_sz(l->inode, l->pid, &sz);
 
 		/* no permissions -- ignore */
 		if (!l->path && no_inaccessible) {
+			if (!l->blocked)
+				last_id = 0;
 			rem_lock(l);
 			continue;
 		}
 
+		if (!l->blocked) {
+			last_id = l->id;
+			last_pid = l->pid;
+		}
+
+		if (l->pid > 0) {
+			struct lock_proc *pr = get_proc(l->pid);
+
+			l->cmdname = xstrdup(pr->cmdname ? pr->cmdname : _("(unknown)"));
+		} else
+			l->cmdname = xstrdup(_("(undefined)"));
+
 		if (!l->path) {
 			/* probably no permission to peek into l->pid's path */
 			l->path = get_fallback_filename(l->dev);
@@ -367,21 +539,36 @@ static inline struct colinfo *get_column_info(unsigned num)
 	return &infos[ get_column_id(num) ];
 }
 
-static pid_t get_blocker(int id, struct list_head *locks)
+/*
+ * Adds hidden columns for the column names used in the filter expression.
+ */
+static void add_filter_columns(const char *expr)
 {
-	struct list_head *p;
+	size_t i, k;
 
-	list_for_each(p, locks) {
-		struct lock *l = list_entry(p, struct lock, locks);
+	for (i = 0; i < ARRAY_SIZE(infos); i++) {
+		size_t len = strlen(infos[i].name);
+		const char *p;
 
-		if (l->id == id && !l->blocked)
-			return l->pid;
-	}
+		for (k = 0; k < ncolumns; k++) {
+			if (columns[k] == (int) i)
+				break;
+		}
+		if (k < ncolumns)
+			continue;
 
-	return 0;
+		for (p = expr; (p = strcasestr(p, infos[i].name)); p += len) {
+			if ((p == expr || !isalnum((unsigned char) *(p - 1)))
+			    && !isalnum((unsigned char) *(p + len))) {
+				if (ncolumns < ARRAY_SIZE(columns))
+					columns[ncolumns++] = i;
+				break;
+			}
+		}
+	}
 }
 
-static void add_scols_line(struct libscols_table *table, struct lock *l, struct list_head *locks)
+static void add_scols_line(struct libscols_table *table, struct lock *l)
 {
 	size_t i;
 	struct libscols_line *line;
@@ -445,12 +632,9 @@ static void add_scols_line(struct libscols_table *table, struct lock *l, struct
 			xasprintf(&str, "%s", l->path ? l->path : notfnd);
 			break;
 		case COL_BLOCKER:
-		{
-			pid_t bl = l->blocked && l->id ?
-						get_blocker(l->id, locks) : 0;
-			if (bl)
-				xasprintf(&str, "%d", (int) bl);
-		}
+			if (l->blocker)
+				xasprintf(&str, "%d", (int) l->blocker);
+			break;
 		default:
 			break;
 		}
@@ -458,6 +642,9 @@ static void add_scols_line(struct libscols_table *table, struct lock *l, struct
 		if (str && scols_line_refer_data(line, i, str))
 			err(EXIT_FAILURE, _("failed to add output data"));
 	}
+
+	if (filter && scols_table_filter_line(table, line) == 0)
+		scols_table_remove_line(table, line);
 }
 
 static int show_locks(struct list_head *locks)
@@ -482,44 +669,42 @@ static int show_locks(struct list_head *locks)
 		struct libscols_column *cl;
 		struct colinfo *col = get_column_info(i);
 
-		cl = scols_table_new_column(table, col->name, col->whint, col->flags);
+		cl = scols_table_new_column(table, col->name, col->whint,
+				col->flags | (i >= nvisible ? SCOLS_FL_HIDDEN : 0));
 		if (!cl)
 			err(EXIT_FAILURE, _("failed to allocate output column"));
 
-		if (json) {
-			int id = get_column_id(i);
-
-			switch (id) {
-			case COL_SIZE:
-				if (!bytes)
-					break;
-				/* fallthrough */
-			case COL_PID:
-			case COL_START:
-			case COL_END:
-			case COL_BLOCKER:
-			case COL_INODE:
-				scols_column_set_json_type(cl, SCOLS_JSON_NUMBER);
-				break;
-			case COL_M:
-				scols_column_set_json_type(cl, SCOLS_JSON_BOOLEAN);
-				break;
-			default:
-				scols_column_set_json_type(cl, SCOLS_JSON_STRING);
+		/* the type is used by filter too */
+		switch (get_column_id(i)) {
+		case COL_SIZE:
+			if (!bytes)
 				break;
-			}
+			/* fallthrough */
+		case COL_PID:
+		case COL_START:
+		case COL_END:
+		case COL_BLOCKER:
+		case COL_INODE:
+			scols_column_set_json_type(cl, SCOLS_JSON_NUMBER);
+			break;
+		case COL_M:
+			scols_column_set_json_type(cl, SCOLS_JSON_BOOLEAN);
+			break;
+		default:
+			scols_column_set_json_type(cl, SCOLS_JSON_STRING);
+			break;
 		}
-
 	}
 
+	if (filter && scols_table_set_filter(table, filter) != 0)
+		errx(EXIT_FAILURE, _("failed to parse filter: %s"),
+				scols_table_get_filter_errmsg(table));
+
 	/* prepare data for output */
 	list_for_each(p, locks) {
 		struct lock *l = list_entry(p, struct lock, locks);
 
-		if (pid && pid != l->pid)
-			continue;
-
-		add_scols_line(table, l, locks);
+		add_scols_line(table, l);
 	}
 
 	/* destroy the list */
@@ -555,6 +740,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -o, --output <list>    define which output columns to use\n"), out);
 	fputs(_("     --output-all       output all columns\n"), out);
 	fputs(_(" -p, --pid <pid>        display only locks held by this process\n"), out);
+	fputs(_(" -Q, --filter <expr>    display only locks matching the expression\n"), out);
 	fputs(_(" -r, --raw              use the raw output format\n"), out);
 	fputs(_(" -u, --notruncate       don't truncate text in columns\n"), out);
 
@@ -583,6 +769,7 @@ int main(int argc, char *argv[])
 		{ "bytes",      no_argument,       NULL, 'b' },
 		{ "json",       no_argument,       NULL, 'J' },
 		{ "pid",	required_argument, NULL, 'p' },
+		{ "filter",	required_argument, NULL, 'Q' },
 		{ "help",	no_argument,       NULL, 'h' },
 		{ "output",     required_argument, NULL, 'o' },
 		{ "output-all",	no_argument,       NULL, OPT_OUTPUT_ALL },
@@ -605,7 +792,7 @@ int main(int argc, char *argv[])
 	close_stdout_atexit();
 
 	while ((c = getopt_long(argc, argv,
-				"biJp:o:nruhV", long_opts, NULL)) != -1) {
+				"biJp:o:nQ:ruhV", long_opts, NULL)) != -1) {
 
 		err_exclusive_options(c, long_opts, excl, excl_st);
 
@@ -625,6 +812,9 @@ int main(int argc, char *argv[])
 		case 'o':
 			outarg = optarg;
 			break;
+		case 'Q':
+			filter = optarg;
+			break;
 		case OPT_OUTPUT_ALL:
 			for (ncolumns = 0; ncolumns < ARRAY_SIZE(infos); ncolumns++)
 				columns[ncolumns] = ncolumns;
@@ -667,6 +857,10 @@ int main(int argc, char *argv[])
 					 &ncolumns, column_name_to_id) < 0)
 		return EXIT_FAILURE;
 
+	nvisible = ncolumns;
+	if (filter)
+		add_filter_columns(filter);
+
 	scols_init_debug(0);
 
 	rc = get_local_locks(&locks);
@@ -675,5 +869,6 @@ int main(int argc, char *argv[])
 		rc = show_locks(&locks);
 
 	mnt_unref_table(tab);
+	tdestroy(procs, free_proc);
 	return rc;
 }
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/param.h>
@@ -70,6 +71,43 @@ struct namei {
 #endif
 };
 
+/*
+ * The items are looked up by openat(O_PATH|O_NOFOLLOW) relative to the parent
+ * directory and the results are cached by the parent directory (dev, ino) and
+ * the name, so the common parts of the paths are resolved only once.
+ */
+struct namei_entry {
+	dev_t		dev;		/* parent directory */
+	ino_t		ino;
+	char		*name;
+
+	struct stat	st;		/* item lstat() */
+	int		noent;		/* errno or 0 */
+	char		*link;		/* symlink content */
+	ssize_t		linksz;
+
+	int		resolved;	/* the symlink target is known */
+	int		target_noent;	/* errno or 0 */
+	dev_t		target_dev;
+	ino_t		target_ino;
+
+	struct namei_entry *next;
+};
+
+struct namei_walk {
+	int	fd;		/* O_PATH fd of the current directory or -1 */
+	int	has_id;		/* the directory dev and ino are known */
+	dev_t	dev;
+	ino_t	ino;
+
+	struct namei_entry *last;	/* the previous item */
+	unsigned int	more : 1;	/* the item is not the last in the path */
+};
+
+static struct namei_entry **entries;	/* hash table */
+static size_t nentries, nbuckets;
+static struct namei_entry *uncached;	/* items without the known parent */
+
 static int flags;
 static struct idcache *gcache;	/* groupnames */
 static struct idcache *ucache;	/* usernames */
@@ -90,15 +128,11 @@ free_namei(struct namei *nm)
 }
 
 static void
-readlink_to_namei(struct namei *nm, const char *path)
+readlink_to_namei(struct namei *nm, const char *path,
+		  const char *sym, ssize_t sz)
 {
-	char sym[PATH_MAX];
-	ssize_t sz;
 	int isrel = 0;
 
-	sz = readlink(path, sym, sizeof(sym));
-	if (sz < 1)
-		err(EXIT_FAILURE, _("failed to read symlink: %s"), path);
 	if (*sym != '/') {
 		char *p = strrchr(path, '/');
 
@@ -125,6 +159,248 @@ readlink_to_namei(struct namei *nm, const char *path)
 	nm->abslink[sz] = '\0';
 }
 
+static size_t entry_hash(dev_t dev, ino_t ino, const char *name)
+{
+	size_t h = (size_t) dev * 31 + (size_t) ino;
+
+	for (; *name; name++)
+		h = h * 33 + (unsigned char) *name;
+	return h;
+}
+
+static struct namei_entry *
+lookup_entry(dev_t dev, ino_t ino, const char *name)
+{
+	struct namei_entry *e;
+
+	if (!nbuckets)
+		return NULL;
+
+	e = entries[entry_hash(dev, ino, name) & (nbuckets - 1)];
+	for (; e; e = e->next) {
+		if (e->ino == ino && e->dev == dev && strcmp(e->name, name) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+static void add_entry(struct namei_entry *e)
+{
+	struct namei_entry **b;
+
+	if (nentries >= nbuckets) {
+		size_t i, sz = nbuckets ? nbuckets * 2 : 1024;
+		struct namei_entry **tb = xcalloc(sz, sizeof(*tb));
+
+		for (i = 0; i < nbuckets; i++) {
+			while (entries[i]) {
+				struct namei_entry *x = entries[i];
+
+				entries[i] = x->next;
+				b = &tb[entry_hash(x->dev, x->ino, x->name) & (sz - 1)];
+				x->next = *b;
+				*b = x;
+			}
+		}
+		free(entries);
+		entries = tb;
+		nbuckets = sz;
+	}
+
+	b = &entries[entry_hash(e->dev, e->ino, e->name) & (nbuckets - 1)];
+	e->next = *b;
+	*b = e;
+	nentries++;
+}
+
+static void free_entry(struct namei_entry *e)
+{
+	free(e->name);
+	free(e->link);
+	free(e);
+}
+
+static void free_entries(void)
+{
+	size_t i;
+
+	for (i = 0; i < nbuckets; i++) {
+		while (entries[i]) {
+			struct namei_entry *next = entries[i]->next;
+
+			free_entry(entries[i]);
+			entries[i] = next;
+		}
+	}
+	free(entries);
+
+	while (uncached) {
+		struct namei_entry *next = uncached->next;
+
+		free_entry(uncached);
+		uncached = next;
+	}
+}
+
+static void walk_set_fd(struct namei_walk *wk, int fd)
+{
+	if (wk->fd >= 0 && wk->fd != fd)
+		close(wk->fd);
+	wk->fd = fd;
+}
+
+static void walk_init(struct namei_walk *wk)
+{
+	memset(wk, 0, sizeof(*wk));
+	wk->fd = -1;
+}
+
+/* the walk continues in the root directory */
+static void walk_root(struct namei_walk *wk, const struct stat *st)
+{
+	walk_set_fd(wk, -1);
+	wk->last = NULL;
+	wk->has_id = 1;
+	wk->dev = st->st_dev;
+	wk->ino = st->st_ino;
+}
+
+/*
+ * Opens the directory of @fname by the path prefix.  This is used after the
+ * cached items, the kernel resolves the prefix as lstat() of the whole path.
+ */
+static int walk_open_dir(struct namei_walk *wk, const char *path, const char *fname)
+{
+	char *dir = fname == path ? xstrdup(".") : xstrndup(path, fname - path);
+	int fd = open(dir, O_PATH | O_CLOEXEC);
+
+	if (fd >= 0 && !wk->has_id) {
+		struct stat st;
+
+		if (fstat(fd, &st) != 0)
+			err(EXIT_FAILURE, _("stat of %s failed"), dir);
+		wk->has_id = 1;
+		wk->dev = st.st_dev;
+		wk->ino = st.st_ino;
+	}
+	free(dir);
+	walk_set_fd(wk, fd);
+	return fd;
+}
+
+/*
+ * Makes the previous item the current directory.  The fd of the directory is
+ * opened relative to its parent only if the parent fd is already open.
+ */
+static void walk_enter_last(struct namei_walk *wk, const char *path, const char *fname)
+{
+	struct namei_entry *e = wk->last;
+	struct stat st;
+	int fd = -1;
+
+	if (!e)
+		return;
+	wk->last = NULL;
+
+	if (e->noent) {
+		wk->has_id = 0;
+		walk_set_fd(wk, -1);
+		return;
+	}
+
+	if (wk->fd >= 0)
+		fd = openat(wk->fd, e->name, O_PATH | O_CLOEXEC |
+				(S_ISLNK(e->st.st_mode) ? 0 : O_NOFOLLOW));
+
+	if (S_ISLNK(e->st.st_mode) && !e->resolved) {
+		char *dir = NULL;
+		int rc;
+
+		if (fd >= 0)
+			rc = fstat(fd, &st);
+		else {
+			dir = xstrndup(path, fname - path);
+			rc = stat(dir, &st);
+		}
+		if (rc == 0) {
+			e->target_dev = st.st_dev;
+			e->target_ino = st.st_ino;
+		} else
+			e->target_noent = errno;
+		e->resolved = 1;
+		free(dir);
+	}
+
+	if (S_ISLNK(e->st.st_mode)) {
+		wk->has_id = !e->target_noent;
+		wk->dev = e->target_dev;
+		wk->ino = e->target_ino;
+	} else {
+		wk->has_id = 1;
+		wk->dev = e->st.st_dev;
+		wk->ino = e->st.st_ino;
+	}
+	walk_set_fd(wk, fd);
+}
+
+static void walk_readlink(struct namei_entry *e, int dirfd, const char *name,
+			  const char *path)
+{
+	char sym[PATH_MAX];
+
+	e->linksz = readlinkat(dirfd, name, sym, sizeof(sym));
+	if (e->linksz < 1)
+		err(EXIT_FAILURE, _("failed to read symlink: %s"), path);
+	e->link = xmalloc(e->linksz);
+	memcpy(e->link, sym, e->linksz);
+}
+
+/* returns lstat() result for the item @fname, @path is terminated after it */
+static struct namei_entry *walk_item(struct namei_walk *wk, const char *path,
+				     const char *fname)
+{
+	struct namei_entry *e;
+
+	walk_enter_last(wk, path, fname);
+
+	if (wk->has_id) {
+		e = lookup_entry(wk->dev, wk->ino, fname);
+		if (e)
+			goto done;
+	}
+
+	/* the walk continues by the fd of the directory */
+	if (wk->fd < 0 && wk->more)
+		walk_open_dir(wk, path, fname);
+
+	e = xcalloc(1, sizeof(*e));
+	e->name = xstrdup(fname);
+
+	if (wk->fd >= 0) {
+		if (fstatat(wk->fd, fname, &e->st, AT_SYMLINK_NOFOLLOW) != 0)
+			e->noent = errno;
+		else if (S_ISLNK(e->st.st_mode))
+			walk_readlink(e, wk->fd, fname, path);
+	} else {
+		if (lstat(path, &e->st) != 0)
+			e->noent = errno;
+		else if (S_ISLNK(e->st.st_mode))
+			walk_readlink(e, AT_FDCWD, path, path);
+	}
+
+	if (wk->has_id) {
+		e->dev = wk->dev;
+		e->ino = wk->ino;
+		add_entry(e);
+	} else {
+		e->next = uncached;
+		uncached = e;
+	}
+done:
+	wk->last = e;
+	return e;
+}
+
 static struct stat *
 dotdot_stat(const char *dirname, struct stat *st)
 {
@@ -149,9 +425,11 @@ dotdot_stat(const char *dirname, struct stat *st)
 }
 
 static struct namei *
-new_namei(struct namei *parent, const char *path, const char *fname, int lev)
+new_namei(struct namei_walk *wk, struct namei *parent, const char *path,
+	  const char *fname, int lev)
 {
 	struct namei *nm;
+	struct namei_entry *e;
 
 	if (!fname)
 		return NULL;
@@ -165,15 +443,31 @@ new_namei(struct namei *parent, const char *path, const char *fname, int lev)
 #ifdef HAVE_LIBSELINUX
 	/* Don't use is_selinux_enabled() here. We need info about a context
 	 * also on systems where SELinux is (temporary) disabled */
-	nm->context_len = lgetfilecon(path, &nm->context);
+	if (flags & NAMEI_CONTEXT)
+		nm->context_len = lgetfilecon(path, &nm->context);
 #endif
-	if (lstat(path, &nm->st) != 0) {
-		nm->noent = errno;
-		return nm;
+	if (wk) {
+		e = walk_item(wk, path, fname);
+		if (e->noent) {
+			nm->noent = e->noent;
+			return nm;
+		}
+		nm->st = e->st;
+		if (S_ISLNK(nm->st.st_mode))
+			readlink_to_namei(nm, path, e->link, e->linksz);
+	} else {
+		/* root directory */
+		static struct stat root_st;
+		static int root_noent = -1;
+
+		if (root_noent < 0)
+			root_noent = lstat(path, &root_st) != 0 ? errno : 0;
+		if (root_noent) {
+			nm->noent = root_noent;
+			return nm;
+		}
+		nm->st = root_st;
 	}
-
-	if (S_ISLNK(nm->st.st_mode))
-		readlink_to_namei(nm, path);
 	if (flags & NAMEI_OWNERS) {
 		add_uid(ucache, nm->st.st_uid);
 		add_gid(gcache, nm->st.st_gid);
@@ -199,6 +493,7 @@ static struct namei *
 add_namei(struct namei *parent, const char *orgpath, int start, struct namei **last)
 {
 	struct namei *nm = NULL, *first = NULL;
+	struct namei_walk wk;
 	char *fname, *end, *path;
 	int level = 0;
 
@@ -210,23 +505,27 @@ add_namei(struct namei *parent, const char *orgpath, int start, struct namei **l
 	}
 	path = xstrdup(orgpath);
 	fname = path + start;
+	walk_init(&wk);
 
 	/* root directory */
 	if (*fname == '/') {
 		while (*fname == '/')
 			fname++; /* eat extra '/' */
-		first = nm = new_namei(nm, "/", "/", level);
+		first = nm = new_namei(NULL, nm, "/", "/", level);
+		if (!nm->noent)
+			walk_root(&wk, &nm->st);
 	}
 
 	for (end = fname; fname && end; ) {
 		/* set end of filename */
 		if (*fname) {
 			end = strchr(fname, '/');
+			wk.more = end && end[strspn(end, "/")];
 			if (end)
 				*end = '\0';
 
 			/* create a new entry */
-			nm = new_namei(nm, path, fname, level);
+			nm = new_namei(&wk, nm, path, fname, level);
 		} else
 			end = NULL;
 		if (!first)
@@ -243,6 +542,7 @@ add_namei(struct namei *parent, const char *orgpath, int start, struct namei **l
 	if (last)
 		*last = nm;
 
+	walk_set_fd(&wk, -1);
 	free(path);
 
 	return first;
@@ -485,6 +785,7 @@ main(int argc, char **argv)
 
 	free_idcache(ucache);
 	free_idcache(gcache);
+	free_entries();
 
 	return rc;
 }
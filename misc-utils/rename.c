@@ -32,6 +32,9 @@ for i in $@; do N=`echo "$i" | sed "s/$FROM/$TO/g"`; mv "$i" "$N"; done
 #include <termios.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 
 #include "nls.h"
 #include "xalloc.h"
@@ -39,6 +42,21 @@ for i in $@; do N=`echo "$i" | sed "s/$FROM/$TO/g"`; mv "$i" "$N"; done
 #include "closestream.h"
 #include "optutils.h"
 #include "rpmatch.h"
+#include "strutils.h"
+#include "jobs.h"
+
+#ifndef RENAME_NOREPLACE
+# define RENAME_NOREPLACE (1 << 0)
+#endif
+
+#if !defined(HAVE_RENAMEAT2) && defined(SYS_renameat2)
+static int renameat2(int olddirfd, const char *oldpath, int newdirfd,
+		     const char *newpath, unsigned int flags)
+{
+	return syscall(SYS_renameat2, olddirfd, oldpath, newdirfd, newpath, flags);
+}
+# define HAVE_RENAMEAT2 1
+#endif
 
 #define RENAME_EXIT_SOMEOK	2
 #define RENAME_EXIT_NOTHING	4
@@ -48,6 +66,64 @@ static int tty_cbreak = 0;
 static int all = 0;
 static int last = 0;
 
+/*
+ * The files are accessed relative to the fd of their directory. The
+ * directory is opened once for all consecutive files in it.
+ */
+struct rename_dir {
+	char	*path;		/* the directory of the fd */
+	size_t	len;
+	int	fd;		/* O_PATH fd or -1 */
+};
+
+#define RENAME_DIR_INIT	{ .fd = -1 }
+
+static void close_dir(struct rename_dir *dir)
+{
+	if (dir->fd >= 0)
+		close(dir->fd);
+	free(dir->path);
+	dir->path = NULL;
+	dir->len = 0;
+	dir->fd = -1;
+}
+
+/* returns the length of the directory of @s (without the last slash) */
+static size_t dir_length(const char *s)
+{
+	const char *file = strrchr(s, '/');
+
+	if (!file || !file[1])
+		return 0;	/* no directory or "dir/", use the whole path */
+	return file == s ? 1 : (size_t) (file - s);
+}
+
+/*
+ * Returns the fd of the directory of @s and the file name in @name. The
+ * whole path and AT_FDCWD are returned if the directory cannot be opened, so
+ * the errors are reported for the path.
+ */
+static int open_dir(struct rename_dir *dir, const char *s, const char **name)
+{
+	size_t len = dir_length(s);
+
+	*name = s;
+	if (!len)
+		return AT_FDCWD;
+
+	if (!dir->path || dir->len != len || strncmp(dir->path, s, len) != 0) {
+		close_dir(dir);
+		dir->path = xstrndup(s, len);
+		dir->len = len;
+		dir->fd = open(dir->path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	}
+	if (dir->fd < 0)
+		return AT_FDCWD;
+
+	*name = strrchr(s, '/') + 1;
+	return dir->fd;
+}
+
 static int string_replace(char *from, char *to, char *s, char *orig, char **newname)
 {
 	char *p, *q, *where;
@@ -122,25 +198,20 @@ static int ask(char *name)
 	return 1;
 }
 
-static int do_symlink(char *from, char *to, char *s, int verbose, int noact,
-                      int nooverwrite, int interactive)
+static int do_symlink(struct rename_dir *dir, char *from, char *to, char *s,
+                      int verbose, int noact, int nooverwrite, int interactive)
 {
 	char *newname = NULL, *target = NULL;
-	int ret = 1;
+	const char *name;
+	int ret = 1, fd;
 	ssize_t ssz;
 	struct stat sb;
 
-	if ( faccessat(AT_FDCWD, s, F_OK, AT_SYMLINK_NOFOLLOW) != 0 &&
-	     errno != EINVAL )
-	   /* Skip if AT_SYMLINK_NOFOLLOW is not supported; lstat() below will
-	      detect the access error */
-	{
-		warn(_("%s: not accessible"), s);
-		return 2;
-	}
+	fd = open_dir(dir, s, &name);
 
-	if (lstat(s, &sb) == -1) {
-		warn(_("stat of %s failed"), s);
+	/* the same errors as faccessat(F_OK, AT_SYMLINK_NOFOLLOW) */
+	if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+		warn(_("%s: not accessible"), s);
 		return 2;
 	}
 	if (!S_ISLNK(sb.st_mode)) {
@@ -149,7 +220,7 @@ static int do_symlink(char *from, char *to, char *s, int verbose, int noact,
 	}
 	target = xmalloc(sb.st_size + 1);
 
-	ssz = readlink(s, target, sb.st_size + 1);
+	ssz = readlinkat(fd, name, target, sb.st_size + 1);
 	if (ssz < 0) {
 		warn(_("%s: readlink failed"), s);
 		free(target);
@@ -171,15 +242,17 @@ static int do_symlink(char *from, char *to, char *s, int verbose, int noact,
 		ret = 0;
 	}
 
-	if (ret == 1) {
-		if (!noact && 0 > unlink(s)) {
+	if (ret == 1 && !noact) {
+		if (0 > unlinkat(fd, name, 0)) {
 			warn(_("%s: unlink failed"), s);
 			ret = 2;
 		}
-		else if (!noact && symlink(newname, s) != 0) {
+		else if (symlinkat(newname, fd, name) != 0) {
 			warn(_("%s: symlinking to %s failed"), s, newname);
 			ret = 2;
 		}
+		/* the link may be in the path of the next directory */
+		close_dir(dir);
 	}
 	if (verbose && (noact || ret == 1))
 		printf("%s: `%s' -> `%s'\n", s, target, newname);
@@ -188,39 +261,40 @@ static int do_symlink(char *from, char *to, char *s, int verbose, int noact,
 	return ret;
 }
 
-static int do_file(char *from, char *to, char *s, int verbose, int noact,
-                   int nooverwrite, int interactive)
+static int do_file(struct rename_dir *dir, char *from, char *to, char *s,
+                   int verbose, int noact, int nooverwrite, int interactive)
 {
 	char *newname = NULL, *file=NULL;
-	int ret = 1;
+	const char *name = s, *newbase;
+	int ret = 1, fd = AT_FDCWD;
 	struct stat sb;
+#ifdef HAVE_RENAMEAT2
+	int noreplace = nooverwrite;
+#endif
 
-	if ( faccessat(AT_FDCWD, s, F_OK, AT_SYMLINK_NOFOLLOW) != 0 &&
-	     errno != EINVAL )
-	   /* Skip if AT_SYMLINK_NOFOLLOW is not supported; lstat() below will
-	      detect the access error */
-	{
-		warn(_("%s: not accessible"), s);
-		return 2;
-	}
-
-	if (lstat(s, &sb) == -1) {
-		warn(_("stat of %s failed"), s);
-		return 2;
-	}
 	if (strchr(from, '/') == NULL && strchr(to, '/') == NULL) {
+		fd = open_dir(dir, s, &name);
 		file = strrchr(s, '/');
                 /* We're going to search for `from` in `file`. If `from` is
                    empty, we don't want it to match before the '/'. */
 		if (file != NULL)
 			file++;
 	}
+
+	/* the same errors as faccessat(F_OK, AT_SYMLINK_NOFOLLOW) */
+	if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+		warn(_("%s: not accessible"), s);
+		return 2;
+	}
 	if (file == NULL)
 		file = s;
 	if (string_replace(from, to, file, s, &newname) != 0)
 		return 0;
 
-	if ((nooverwrite || interactive) && access(newname, F_OK) != 0)
+	/* the directory is the same, only the file name is replaced */
+	newbase = newname + (name - s);
+
+	if ((nooverwrite || interactive) && faccessat(fd, newbase, F_OK, 0) != 0)
 		nooverwrite = interactive = 0;
 
 	if (nooverwrite || (interactive && (noact || ask(newname) != 0))) {
@@ -228,9 +302,28 @@ static int do_file(char *from, char *to, char *s, int verbose, int noact,
 			printf(_("Skipping existing file: `%s'\n"), newname);
 		ret = 0;
 	}
-	else if (!noact && rename(s, newname) != 0) {
-		warn(_("%s: rename to %s failed"), s, newname);
-		ret = 2;
+	else if (!noact) {
+		int rc;
+
+#ifdef HAVE_RENAMEAT2
+		/* the file may be created after the check above */
+		rc = noreplace ? renameat2(fd, name, fd, newbase, RENAME_NOREPLACE) : -1;
+		if (rc != 0 && noreplace && errno == EEXIST) {
+			if (verbose)
+				printf(_("Skipping existing file: `%s'\n"), newname);
+			free(newname);
+			return 0;
+		}
+		/* not supported by the kernel or filesystem */
+		if (!noreplace || (rc != 0 && (errno == EINVAL || errno == ENOSYS)))
+#endif
+			rc = renameat(fd, name, fd, newbase);
+		if (rc != 0) {
+			warn(_("%s: rename to %s failed"), s, newname);
+			ret = 2;
+		} else if (S_ISDIR(sb.st_mode))
+			/* the directory may be in the path of the next files */
+			close_dir(dir);
 	}
 	if (verbose && (noact || ret == 1))
 		printf("`%s' -> `%s'\n", s, newname);
@@ -238,6 +331,90 @@ static int do_file(char *from, char *to, char *s, int verbose, int noact,
 	return ret;
 }
 
+typedef int (*rename_fn)(struct rename_dir *dir, char *from, char *to, char *s,
+			 int verbose, int noact, int nooverwrite, int interactive);
+
+/*
+ * --jobs: the files are grouped by directories, the groups are renamed by a
+ * pool of threads. The files of a group are renamed in the command line
+ * order by one thread.
+ */
+struct rename_file {
+	char	*name;
+	size_t	dirlen;
+	size_t	idx;		/* command line order */
+};
+
+struct rename_jobs {
+	rename_fn do_rename;
+	char *from, *to;
+	int verbose, noact, nooverwrite;
+
+	struct rename_file *files;
+	size_t nfiles;
+	size_t *groups;		/* index of the first file of every group */
+	size_t ngroups;
+	size_t next;		/* the next group to rename */
+	int ret;
+};
+
+static int cmp_rename_files(const void *a0, const void *b0)
+{
+	const struct rename_file *a = a0, *b = b0;
+	int rc = cmp_numbers(a->dirlen, b->dirlen);
+
+	if (!rc)
+		rc = strncmp(a->name, b->name, a->dirlen);
+	if (!rc)
+		rc = cmp_numbers(a->idx, b->idx);
+	return rc;
+}
+
+static void *rename_worker(void *data)
+{
+	struct rename_jobs *jb = data;
+	struct rename_dir dir = RENAME_DIR_INIT;
+	size_t g;
+	int ret = 0;
+
+	while ((g = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->ngroups) {
+		size_t i, end = g + 1 < jb->ngroups ? jb->groups[g + 1] : jb->nfiles;
+
+		for (i = jb->groups[g]; i < end; i++)
+			ret |= jb->do_rename(&dir, jb->from, jb->to, jb->files[i].name,
+					jb->verbose, jb->noact, jb->nooverwrite, 0);
+	}
+	close_dir(&dir);
+	__atomic_fetch_or(&jb->ret, ret, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static int run_jobs(struct rename_jobs *jb, char **files, size_t nfiles, size_t njobs)
+{
+	size_t i;
+
+	jb->files = xcalloc(nfiles, sizeof(struct rename_file));
+	jb->nfiles = nfiles;
+	for (i = 0; i < nfiles; i++) {
+		jb->files[i].name = files[i];
+		jb->files[i].dirlen = dir_length(files[i]);
+		jb->files[i].idx = i;
+	}
+	qsort(jb->files, nfiles, sizeof(struct rename_file), cmp_rename_files);
+
+	jb->groups = xcalloc(nfiles, sizeof(size_t));
+	for (i = 0; i < nfiles; i++) {
+		if (i == 0 || cmp_numbers(jb->files[i].dirlen, jb->files[i - 1].dirlen)
+		    || strncmp(jb->files[i].name, jb->files[i - 1].name, jb->files[i].dirlen))
+			jb->groups[jb->ngroups++] = i;
+	}
+
+	ul_run_jobs(min(njobs, jb->ngroups), rename_worker, jb, 0);
+	free(jb->groups);
+	free(jb->files);
+	return jb->ret;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -257,6 +434,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -l, --last          replace only the last occurrence\n"), out);
 	fputs(_(" -o, --no-overwrite  don't overwrite existing files\n"), out);
 	fputs(_(" -i, --interactive   prompt before overwrite\n"), out);
+	fputs(_(" -j, --jobs <num>    rename files in <num> directories in parallel\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(21));
 	printf(USAGE_MAN_TAIL("rename(1)"));
@@ -267,9 +445,10 @@ int main(int argc, char **argv)
 {
 	char *from, *to;
 	int i, c, ret = 0, verbose = 0, noact = 0, nooverwrite = 0, interactive = 0;
+	size_t jobs = 0;
 	struct termios tio;
-	int (*do_rename)(char *from, char *to, char *s, int verbose, int noact,
-	                 int nooverwrite, int interactive) = do_file;
+	struct rename_dir dir = RENAME_DIR_INIT;
+	rename_fn do_rename = do_file;
 
 	static const struct option longopts[] = {
 		{"verbose", no_argument, NULL, 'v'},
@@ -281,10 +460,12 @@ int main(int argc, char **argv)
 		{"no-overwrite", no_argument, NULL, 'o'},
 		{"interactive", no_argument, NULL, 'i'},
 		{"symlink", no_argument, NULL, 's'},
+		{"jobs", required_argument, NULL, 'j'},
 		{NULL, 0, NULL, 0}
 	};
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'a','l' },
+		{ 'i','j' },
 		{ 'i','o' },
 		{ 0 }
 	};
@@ -295,7 +476,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "vsVhnaloi", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "vsVhnaloij:", longopts, NULL)) != -1) {
 		err_exclusive_options(c, longopts, excl, excl_st);
 		switch (c) {
 		case 'n':
@@ -319,6 +500,9 @@ int main(int argc, char **argv)
 		case 's':
 			do_rename = do_symlink;
 			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -351,8 +535,24 @@ int main(int argc, char **argv)
 			tty_cbreak = 1;
 	}
 
-	for (i = 2; i < argc; i++)
-		ret |= do_rename(from, to, argv[i], verbose, noact, nooverwrite, interactive);
+	/* the files are renamed only in their directories */
+	if (jobs > 1 && argc > 3 && (do_rename == do_symlink ||
+	    (strchr(from, '/') == NULL && strchr(to, '/') == NULL))) {
+		struct rename_jobs jb = {
+			.do_rename = do_rename,
+			.from = from,
+			.to = to,
+			.verbose = verbose,
+			.noact = noact,
+			.nooverwrite = nooverwrite
+		};
+		ret = run_jobs(&jb, argv + 2, argc - 2, jobs);
+	} else {
+		for (i = 2; i < argc; i++)
+			ret |= do_rename(&dir, from, to, argv[i], verbose, noact,
+					 nooverwrite, interactive);
+		close_dir(&dir);
+	}
 
 	switch (ret) {
 	case 0:
@@ -22,11 +22,18 @@
  * to overwrite the built-in default then use:
  *
  *	make uuidd uuidgen runstatedir=/var/run
+ *
+ * The benchmark mode (-b) does not check for duplicates, it calls the
+ * requested generators from 1, 2, 4, ... up to -t threads and reports
+ * UUIDs/sec and per-call latency percentiles, for example:
+ *
+ *	test_uuidd -b -O time,random -t 8 -o 100000 -J
  */
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/shm.h>
 #include <sys/types.h>
@@ -37,6 +44,7 @@
 #include "xalloc.h"
 #include "strutils.h"
 #include "nls.h"
+#include "jsonwrt.h"
 
 #define LOG(level,args) if (loglev >= level) { fprintf args; }
 
@@ -72,6 +80,37 @@ typedef struct objectentry object_t;
 static int shmem_id;
 static object_t *objects;
 
+/* benchmark mode */
+struct bench_op {
+	const char	*name;
+	void		(*generate)(uuid_t out);
+};
+
+static void bench_time_safe(uuid_t out)
+{
+	uuid_generate_time_safe(out);
+}
+
+static const struct bench_op bench_ops[] = {
+	{ "time",	uuid_generate_time },
+	{ "time-safe",	bench_time_safe },
+	{ "random",	uuid_generate_random },
+	{ "v6",		uuid_generate_time_v6 },
+	{ "v7",		uuid_generate_time_v7 },
+};
+
+struct bench_thread {
+	pthread_t		tid;
+	const struct bench_op	*op;
+	pthread_barrier_t	*barrier;
+	uint64_t		start;		/* first and last call timestamps */
+	uint64_t		end;
+	uint64_t		*lat;		/* per call latency in nsec */
+};
+
+static int bench_enabled[ARRAY_SIZE(bench_ops)];
+static int bench_json;
+
 
 static void __attribute__((__noreturn__)) usage(void)
 {
@@ -81,8 +120,16 @@ static void __attribute__((__noreturn__)) usage(void)
 	printf("  -t <num>     number of nthreads (default:%zu)\n", nthreads);
 	printf("  -o <num>     number of nobjects (default:%zu)\n", nobjects);
 	printf("  -l <level>   log level (default:%zu)\n", loglev);
+	printf("  -c           use in-process clock (UUID_CLOCK_PROCESS)\n");
+	printf("  -b           benchmark mode, -o is number of calls per thread\n");
+	printf("  -O <list>    benchmarked generators (default: all)\n");
+	printf("  -J           use JSON output format for benchmark\n");
 	printf("  -h           display help\n");
 
+	printf("\n Available generators for -O:\n");
+	for (size_t i = 0; i < ARRAY_SIZE(bench_ops); i++)
+		printf("  %s\n", bench_ops[i].name);
+
 	exit(EXIT_SUCCESS);
 }
 
@@ -264,14 +311,184 @@ static void object_dump(size_t idx, object_t *obj)
 	fprintf(stderr, "}\n");
 }
 
+static int bench_name_to_id(const char *name, size_t namesz)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_ops); i++) {
+		const char *cn = bench_ops[i].name;
+
+		if (!strncmp(name, cn, namesz) && !*(cn + namesz))
+			return i;
+	}
+	warnx("unknown generator: %s", name);
+	return -1;
+}
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *bench_thread_body(void *arg)
+{
+	struct bench_thread *th = (struct bench_thread *) arg;
+	uuid_t uu;
+	size_t i;
+
+	pthread_barrier_wait(th->barrier);
+
+	th->start = th->end = bench_now();
+	for (i = 0; i < nobjects; i++) {
+		uint64_t start = th->end;
+
+		th->op->generate(uu);
+		th->end = bench_now();
+		th->lat[i] = th->end - start;
+	}
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* nearest-rank percentile of sorted @lat, @per is in 1/1000 */
+static uint64_t bench_percentile(const uint64_t *lat, size_t n, size_t per)
+{
+	size_t rank = (n * per + 999) / 1000;
+
+	return lat[rank ? rank - 1 : 0];
+}
+
+static void bench_run(const struct bench_op *op, size_t nthr,
+		      struct ul_jsonwrt *json)
+{
+	struct bench_thread *threads;
+	pthread_barrier_t barrier;
+	uint64_t *lat, start, end, elapsed, rate;
+	size_t i, total = nthr * nobjects;
+	int rc;
+
+	threads = xcalloc(nthr, sizeof(struct bench_thread));
+	lat = xcalloc(total, sizeof(uint64_t));
+
+	rc = pthread_barrier_init(&barrier, NULL, nthr + 1);
+	if (rc) {
+		errno = rc;
+		err(EXIT_FAILURE, "pthread_barrier_init failed");
+	}
+
+	for (i = 0; i < nthr; i++) {
+		struct bench_thread *th = &threads[i];
+
+		th->op = op;
+		th->barrier = &barrier;
+		th->lat = lat + i * nobjects;
+		rc = pthread_create(&th->tid, NULL, &bench_thread_body, th);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, "pthread_create failed");
+		}
+	}
+
+	pthread_barrier_wait(&barrier);
+
+	/* wall time from the first started to the last finished call */
+	start = UINT64_MAX, end = 0;
+	for (i = 0; i < nthr; i++) {
+		struct bench_thread *th = &threads[i];
+
+		rc = pthread_join(th->tid, NULL);
+		if (rc) {
+			errno = rc;
+			err(EXIT_FAILURE, "pthread_join failed");
+		}
+		start = min(start, th->start);
+		end = max(end, th->end);
+	}
+	elapsed = end - start;
+	pthread_barrier_destroy(&barrier);
+
+	qsort(lat, total, sizeof(uint64_t), cmp_u64);
+	rate = elapsed ? (uint64_t) (total * 1000000000.0 / elapsed) : 0;
+
+	if (json) {
+		ul_jsonwrt_object_open(json, NULL);
+		ul_jsonwrt_value_s(json, "op", op->name);
+		ul_jsonwrt_value_u64(json, "threads", nthr);
+		ul_jsonwrt_value_u64(json, "calls_per_thread", nobjects);
+		ul_jsonwrt_value_u64(json, "uuids", total);
+		ul_jsonwrt_value_u64(json, "elapsed_ns", elapsed);
+		ul_jsonwrt_value_u64(json, "uuids_per_sec", rate);
+		ul_jsonwrt_value_u64(json, "p50_ns", bench_percentile(lat, total, 500));
+		ul_jsonwrt_value_u64(json, "p99_ns", bench_percentile(lat, total, 990));
+		ul_jsonwrt_value_u64(json, "p999_ns", bench_percentile(lat, total, 999));
+		ul_jsonwrt_value_u64(json, "max_ns", lat[total - 1]);
+		ul_jsonwrt_object_close(json);
+	} else
+		printf("%-10s %7zu %12ju %10ju %10ju %10ju %10ju\n",
+			op->name, nthr, (uintmax_t) rate,
+			(uintmax_t) bench_percentile(lat, total, 500),
+			(uintmax_t) bench_percentile(lat, total, 990),
+			(uintmax_t) bench_percentile(lat, total, 999),
+			(uintmax_t) lat[total - 1]);
+
+	free(lat);
+	free(threads);
+}
+
+static int benchmark(void)
+{
+	struct ul_jsonwrt json;
+	size_t i, nthr;
+
+	if (!nobjects || !nthreads)
+		errx(EXIT_FAILURE, "benchmark requires non-zero -t and -o");
+
+	if (bench_json) {
+		ul_jsonwrt_init(&json, stdout, 0);
+		ul_jsonwrt_root_open(&json);
+		ul_jsonwrt_array_open(&json, "benchmark");
+	} else
+		printf("%-10s %7s %12s %10s %10s %10s %10s\n",
+			"OP", "THREADS", "UUIDS/SEC", "P50-NS",
+			"P99-NS", "P999-NS", "MAX-NS");
+
+	for (i = 0; i < ARRAY_SIZE(bench_ops); i++) {
+		if (!bench_enabled[i])
+			continue;
+		for (nthr = 1; ; nthr *= 2) {
+			if (nthr > nthreads)
+				nthr = nthreads;
+			bench_run(&bench_ops[i], nthr, bench_json ? &json : NULL);
+			if (nthr == nthreads)
+				break;
+		}
+	}
+
+	if (bench_json) {
+		ul_jsonwrt_array_close(&json);
+		ul_jsonwrt_root_close(&json);
+	}
+	return EXIT_SUCCESS;
+}
+
 #define MSG_TRY_HELP "Try '-h' for help."
 
 int main(int argc, char *argv[])
 {
 	size_t i, nfailed = 0, nignored = 0;
-	int c;
+	int c, bench = 0;
+	const char *bench_list = NULL;
 
-	while (((c = getopt(argc, argv, "p:t:o:l:h")) != -1)) {
+	while (((c = getopt(argc, argv, "p:t:o:l:chbO:J")) != -1)) {
 		switch (c) {
 		case 'p':
 			nprocesses = strtou32_or_err(optarg, "invalid nprocesses number argument");
@@ -285,6 +502,19 @@ int main(int argc, char *argv[])
 		case 'l':
 			loglev = strtou32_or_err(optarg, "invalid log level argument");
 			break;
+		case 'c':
+			if (uuid_set_clock_mode(UUID_CLOCK_PROCESS) != 0)
+				errx(EXIT_FAILURE, "in-process clock is not supported");
+			break;
+		case 'b':
+			bench = 1;
+			break;
+		case 'O':
+			bench_list = optarg;
+			break;
+		case 'J':
+			bench_json = 1;
+			break;
 		case 'h':
 			usage();
 			break;
@@ -297,6 +527,23 @@ int main(int argc, char *argv[])
 	if (optind != argc)
 		errx(EXIT_FAILURE, "bad usage\n" MSG_TRY_HELP);
 
+	if (bench) {
+		if (!bench_list) {
+			for (i = 0; i < ARRAY_SIZE(bench_ops); i++)
+				bench_enabled[i] = 1;
+		} else {
+			int ids[ARRAY_SIZE(bench_ops)];
+			int n = string_to_idarray(bench_list, ids,
+						  ARRAY_SIZE(ids), bench_name_to_id);
+			if (n < 0)
+				errx(EXIT_FAILURE, "invalid generators list: %s",
+						bench_list);
+			while (n-- > 0)
+				bench_enabled[ids[n]] = 1;
+		}
+		return benchmark();
+	}
+
 	if (loglev == 1)
 		fprintf(stderr, "requested: %zu processes, %zu threads, %zu objects per thread (%zu objects = %zu bytes)\n",
 				nprocesses, nthreads, nobjects,
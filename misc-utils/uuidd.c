@@ -23,6 +23,8 @@
  * | reply length (4 bytes) | uuid reply (16 bytes) | number (4 bytes) time bulk |
  *   or
  * | reply length (4 bytes) | pid or maxop number string length in ascii (up to 7 bytes) |
+ *   or
+ * | reply length (4 bytes) | statistics, multi-line string in ascii |
  */
 
 #include <stdio.h>
@@ -40,7 +42,10 @@
 #include <string.h>
 #include <getopt.h>
 #include <sys/signalfd.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #include "uuid.h"
 #include "uuidd.h"
@@ -67,17 +72,34 @@ enum {
 	UUIDD_PROT_BUFSZ = ((sizeof(uuidd_prot_num_t)) + (sizeof(uuid_t) * 63))
 };
 
+/* requests latency histogram, bucket N is for [2^(N-1), 2^N) usec */
+#define UUIDD_STATS_NBUCKETS	22
+
+struct uuidd_stats {
+	uint64_t	nrequests[UUIDD_MAX_OP + 1];
+	uint64_t	nerrors;
+	uint64_t	latency[UUIDD_STATS_NBUCKETS];
+	uint64_t	lease_windows;		/* published lease windows */
+	uint64_t	lease_uuids;		/* UUIDs leased from the windows */
+};
+
 /* server loop control structure */
 struct uuidd_cxt_t {
 	const char	*cleanup_pidfile;
 	const char	*cleanup_socket;
+	const char	*cleanup_lease;
+	struct uuidd_lease *lease;
 	uint32_t	timeout;
 	uint32_t	cont_clock_offset;
+	uint32_t	nworkers;
+
+	struct uuidd_stats stats;
 
 	unsigned int	debug: 1,
 			quiet: 1,
 			no_fork: 1,
-			no_sock: 1;
+			no_sock: 1,
+			do_lease: 1;
 };
 
 struct uuidd_options_t {
@@ -86,10 +108,54 @@ struct uuidd_options_t {
 	uuidd_prot_num_t num;
 	uuidd_prot_op_t	 do_type;
 	unsigned int	 do_kill:1,
+			 do_stats:1,
 			 no_pid:1,
 			 s_flag:1;
 };
 
+/* client connection */
+struct uuidd_conn {
+	int			fd;
+	struct timeval		start;		/* accepted */
+	struct uuidd_conn	*next;		/* in workers queue */
+
+	char			req[sizeof(uuidd_prot_op_t) + sizeof(uuidd_prot_num_t)];
+	size_t			reqsz;		/* received bytes of req[] */
+	uuidd_prot_op_t		op;
+	uuidd_prot_num_t	num;
+
+	int32_t			reply_len;
+	char			out[sizeof(int32_t) + UUIDD_PROT_BUFSZ];
+	size_t			sent;		/* sent bytes of out[] */
+
+	unsigned int		in_epoll:1;
+};
+
+/* worker threads for random UUIDs */
+struct uuidd_workers {
+	struct uuidd_cxt_t	*cxt;
+	size_t			nthreads;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct uuidd_conn	*todo, *todo_last;
+	struct uuidd_conn	*done;
+	int			wakefd;		/* eventfd to wake up the server loop */
+};
+
+struct uuidd_server {
+	struct uuidd_cxt_t	*cxt;
+	struct uuidd_workers	workers;
+	int			efd;		/* epoll */
+	int			sock;
+	int			sigfd;
+};
+
+#define UUIDD_NWORKERS_DEFAULT	4
+#define UUIDD_NWORKERS_MAX	64
+
+/* how often (msec) to check the shared memory lease window */
+#define UUIDD_LEASE_INTERVAL	100
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -104,7 +170,11 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -k, --kill              kill running daemon\n"), out);
 	fputs(_(" -r, --random            test random-based generation\n"), out);
 	fputs(_(" -t, --time              test time-based generation\n"), out);
+	fputs(_(" -7, --time-v7           test time-ordered (version 7) generation\n"), out);
 	fputs(_(" -n, --uuids <num>       request number of uuids\n"), out);
+	fputs(_("     --stats             print statistics of running daemon\n"), out);
+	fputs(_(" -w, --workers <num>     number of threads for random UUIDs\n"), out);
+	fputs(_(" -L, --lease             publish time-based UUIDs in shared memory\n"), out);
 	fputs(_(" -P, --no-pid            do not create pid file\n"), out);
 	fputs(_(" -F, --no-fork           do not daemonize using double-fork\n"), out);
 	fputs(_(" -S, --socket-activation do not create listening socket\n"), out);
@@ -118,6 +188,13 @@ static void __attribute__((__noreturn__)) usage(void)
 	exit(EXIT_SUCCESS);
 }
 
+static inline int is_bulk_op(uuidd_prot_op_t op)
+{
+	return op == UUIDD_OP_BULK_TIME_UUID
+	       || op == UUIDD_OP_BULK_RANDOM_UUID
+	       || op == UUIDD_OP_BULK_TIME_V7_UUID;
+}
+
 static void create_daemon(void)
 {
 	uid_t euid;
@@ -140,8 +217,7 @@ static int call_daemon(const char *socket_path, uuidd_prot_op_t op, char *buf,
 	int32_t reply_len = 0;
 	struct sockaddr_un srv_addr;
 
-	if (((op == UUIDD_OP_BULK_TIME_UUID) ||
-	     (op == UUIDD_OP_BULK_RANDOM_UUID)) && !num) {
+	if (is_bulk_op(op) && !num) {
 		if (err_context)
 			*err_context = _("bad arguments");
 		errno = EINVAL;
@@ -166,14 +242,14 @@ static int call_daemon(const char *socket_path, uuidd_prot_op_t op, char *buf,
 		return -1;
 	}
 
-	if (op == UUIDD_OP_BULK_RANDOM_UUID) {
+	if ((op == UUIDD_OP_BULK_RANDOM_UUID) ||
+	    (op == UUIDD_OP_BULK_TIME_V7_UUID)) {
 		if ((buflen - sizeof(*num)) < (size_t)((*num) * sizeof(uuid_t)))
 			*num = (buflen - sizeof(*num)) / sizeof(uuid_t);
 	}
 	op_buf[0] = op;
 	op_len = sizeof(op);
-	if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-	    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
+	if (is_bulk_op(op)) {
 		memcpy(op_buf + sizeof(op), num, sizeof(*num));
 		op_len += sizeof(*num);
 	}
@@ -207,7 +283,8 @@ static int call_daemon(const char *socket_path, uuidd_prot_op_t op, char *buf,
 		else
 			*num = -1;
 	}
-	if ((ret > 0) && (op == UUIDD_OP_BULK_RANDOM_UUID)) {
+	if ((ret > 0) && ((op == UUIDD_OP_BULK_RANDOM_UUID) ||
+			  (op == UUIDD_OP_BULK_TIME_V7_UUID))) {
 		if (sizeof(*num) <= (size_t) reply_len)
 			memcpy(buf, num, sizeof(*num));
 		else
@@ -305,8 +382,102 @@ static int create_socket(struct uuidd_cxt_t *uuidd_cxt,
 	return s;
 }
 
+/*
+ * Publishes a new window of time-based UUIDs in the shared memory lease if
+ * the current window is half consumed (or always if @force is true). The new
+ * window is written to the inactive buffer and then activated by the state
+ * update; the clients add to the state offset to lease the UUIDs.
+ */
+static void lease_refill(struct uuidd_cxt_t *uuidd_cxt, int force)
+{
+	struct uuidd_lease *ls = uuidd_cxt->lease;
+	struct uuidd_lease_window *cur, *win;
+	uint64_t state, used, first[2];
+	uint32_t gen;
+	int num = UUIDD_LEASE_SIZE;
+	uuid_t uu;
+
+	state = __atomic_load_n(&ls->state, __ATOMIC_ACQUIRE);
+	cur = &ls->win[UUIDD_LEASE_WIN(state)];
+	used = min(UUIDD_LEASE_OFFSET(state), (uint64_t) cur->size);
+	if (!force && used < cur->size / 2)
+		return;
+
+	__uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
+	memcpy(first, uu, sizeof(first));
+
+	gen = UUIDD_LEASE_GEN(state) + 1;
+	if (gen > UUIDD_LEASE_GEN(~0ULL))
+		gen = 1;
+
+	win = &ls->win[!UUIDD_LEASE_WIN(state)];
+	__atomic_store_n(&win->gen, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&win->size, (uint32_t) num, __ATOMIC_RELAXED);
+	__atomic_store_n(&win->first[0], first[0], __ATOMIC_RELAXED);
+	__atomic_store_n(&win->first[1], first[1], __ATOMIC_RELAXED);
+	__atomic_store_n(&win->gen, gen, __ATOMIC_RELEASE);
+
+	/* the old window is abandoned, clients cannot lease from it anymore */
+	state = __atomic_exchange_n(&ls->state,
+			((uint64_t) !UUIDD_LEASE_WIN(state) << 63) | ((uint64_t) gen << 48),
+			__ATOMIC_ACQ_REL);
+	used = min(UUIDD_LEASE_OFFSET(state), (uint64_t) cur->size);
+
+	uuidd_cxt->stats.lease_windows++;
+	uuidd_cxt->stats.lease_uuids += used;
+
+	if (uuidd_cxt->debug) {
+		char str[UUID_STR_LEN];
+
+		uuid_unparse(uu, str);
+		fprintf(stderr, _("lease: %s and %d subsequent UUIDs\n"), str, num - 1);
+	}
+}
+
+/*
+ * Creates the shared memory lease at @lease_path. The clients update the
+ * state, so the region is writable by the daemon's user and group (usually
+ * uuidd); other users cannot open it and use the socket.
+ */
+static void create_lease(struct uuidd_cxt_t *uuidd_cxt, const char *lease_path)
+{
+	struct uuidd_lease	*ls;
+	int			fd;
+
+	unlink(lease_path);
+	fd = open(lease_path, O_CREAT | O_EXCL | O_RDWR | O_NOFOLLOW | O_CLOEXEC,
+		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+	if (fd < 0) {
+		if (!uuidd_cxt->quiet)
+			warn(_("cannot open %s"), lease_path);
+		exit(EXIT_FAILURE);
+	}
+	uuidd_cxt->cleanup_lease = lease_path;
+
+	/* the umask may drop the group bits, set the mode explicitly */
+	if (fchown(fd, (uid_t) -1, getegid()) != 0 ||
+	    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) != 0)
+		err(EXIT_FAILURE, _("cannot set permissions on %s"), lease_path);
+
+	if (ftruncate(fd, sizeof(*ls)) != 0)
+		err(EXIT_FAILURE, _("could not truncate file: %s"), lease_path);
+	ls = mmap(NULL, sizeof(*ls), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ls == MAP_FAILED)
+		err(EXIT_FAILURE, _("cannot map %s"), lease_path);
+	close(fd);
+
+	uuidd_cxt->lease = ls;
+	lease_refill(uuidd_cxt, 1);
+	__atomic_store_n(&ls->magic, UUIDD_LEASE_MAGIC, __ATOMIC_RELEASE);
+}
+
 static void __attribute__((__noreturn__)) all_done(const struct uuidd_cxt_t *uuidd_cxt, int ret)
 {
+	if (uuidd_cxt->lease)	/* force clients to use the socket */
+		__atomic_store_n(&uuidd_cxt->lease->magic, 0, __ATOMIC_RELEASE);
+	if (uuidd_cxt->cleanup_lease)
+		unlink(uuidd_cxt->cleanup_lease);
 	if (uuidd_cxt->cleanup_pidfile)
 		unlink(uuidd_cxt->cleanup_pidfile);
 	if (uuidd_cxt->cleanup_socket)
@@ -341,28 +512,411 @@ static void timeout_handler(int sig __attribute__((__unused__)),
 		errx(EXIT_FAILURE, _("timed out"));
 }
 
+/*
+ * Writes statistics as a string to @buf, returns the string length.
+ */
+static size_t format_stats(const struct uuidd_cxt_t *uuidd_cxt, char *buf, size_t bufsz)
+{
+	const struct uuidd_stats *st = &uuidd_cxt->stats;
+	uint64_t total = 0;
+	size_t i, len = 0;
+
+#define stats_printf(_fmt, ...) do { \
+		int _x = snprintf(buf + len, bufsz - len, _fmt, __VA_ARGS__); \
+		if (_x > 0 && (size_t) _x < bufsz - len) \
+			len += _x; \
+	} while (0)
+
+	for (i = 0; i < ARRAY_SIZE(st->nrequests); i++)
+		total += st->nrequests[i];
+
+	stats_printf("requests: %" PRIu64 "\n", total);
+	stats_printf("errors: %" PRIu64 "\n", st->nerrors);
+	for (i = 0; i < ARRAY_SIZE(st->nrequests); i++) {
+		if (st->nrequests[i])
+			stats_printf("op %zu: %" PRIu64 "\n", i, st->nrequests[i]);
+	}
+	if (uuidd_cxt->lease) {
+		const struct uuidd_lease *ls = uuidd_cxt->lease;
+		uint64_t state = __atomic_load_n(&ls->state, __ATOMIC_ACQUIRE);
+		uint64_t size = ls->win[UUIDD_LEASE_WIN(state)].size;
+
+		stats_printf("lease windows: %" PRIu64 "\n", st->lease_windows);
+		stats_printf("lease uuids: %" PRIu64 "\n", st->lease_uuids +
+			     min(UUIDD_LEASE_OFFSET(state), size));
+	}
+	for (i = 0; i < UUIDD_STATS_NBUCKETS - 1; i++)
+		stats_printf("latency < %" PRIu64 " us: %" PRIu64 "\n",
+			     (uint64_t) 1 << i, st->latency[i]);
+	stats_printf("latency >= %" PRIu64 " us: %" PRIu64 "\n",
+		     (uint64_t) 1 << (i - 1), st->latency[i]);
+#undef stats_printf
+	return len;
+}
+
+/*
+ * Builds reply for the request in @cn, returns -1 for invalid requests.
+ */
+static int process_request(const struct uuidd_cxt_t *uuidd_cxt, struct uuidd_conn *cn)
+{
+	char			*reply_buf = cn->out + sizeof(cn->reply_len), *cp;
+	uuidd_prot_num_t	num = cn->num;
+	char			str[UUID_STR_LEN];
+	uuid_t			uu;
+	int			i, ret;
+
+	switch (cn->op) {
+	case UUIDD_OP_GETPID:
+		snprintf(reply_buf, UUIDD_PROT_BUFSZ, "%d", getpid());
+		cn->reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_GET_MAXOP:
+		snprintf(reply_buf, UUIDD_PROT_BUFSZ, "%d", UUIDD_MAX_OP);
+		cn->reply_len = strlen(reply_buf) + 1;
+		break;
+	case UUIDD_OP_TIME_UUID:
+		num = 1;
+		ret = __uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
+		if (ret < 0 && !uuidd_cxt->quiet)
+			warnx(_("failed to open/lock clock counter"));
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated time UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		cn->reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_RANDOM_UUID:
+		num = 1;
+		ret = __uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
+		if (ret < 0 && !uuidd_cxt->quiet)
+			warnx(_("failed to open/lock clock counter"));
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, _("Generated random UUID: %s\n"), str);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		cn->reply_len = sizeof(uu);
+		break;
+	case UUIDD_OP_BULK_TIME_UUID:
+		ret = __uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
+		if (ret < 0 && !uuidd_cxt->quiet)
+			warnx(_("failed to open/lock clock counter"));
+		if (uuidd_cxt->debug) {
+			uuid_unparse(uu, str);
+			fprintf(stderr, P_("Generated time UUID %s "
+					   "and %d following\n",
+					   "Generated time UUID %s "
+					   "and %d following\n", num - 1),
+			       str, num - 1);
+		}
+		memcpy(reply_buf, uu, sizeof(uu));
+		cn->reply_len = sizeof(uu);
+		memcpy(reply_buf + cn->reply_len, &num, sizeof(num));
+		cn->reply_len += sizeof(num);
+		break;
+	case UUIDD_OP_BULK_RANDOM_UUID:
+	case UUIDD_OP_BULK_TIME_V7_UUID:
+		if (num < 0)
+			num = 1;
+		if ((UUIDD_PROT_BUFSZ - sizeof(num)) < (size_t) (sizeof(uu) * num))
+			num = (UUIDD_PROT_BUFSZ - sizeof(num)) / sizeof(uu);
+		if (cn->op == UUIDD_OP_BULK_TIME_V7_UUID)
+			__uuid_generate_time_v7((unsigned char *) reply_buf +
+					       sizeof(num), &num);
+		else
+			__uuid_generate_random((unsigned char *) reply_buf +
+					      sizeof(num), &num);
+		cn->reply_len = sizeof(num) + (sizeof(uu) * num);
+		memcpy(reply_buf, &num, sizeof(num));
+		if (uuidd_cxt->debug) {
+			fprintf(stderr, P_("Generated %d UUID:\n",
+					   "Generated %d UUIDs:\n", num), num);
+			cp = reply_buf + sizeof(num);
+			for (i = 0; i < num; i++) {
+				uuid_unparse((unsigned char *)cp, str);
+				fprintf(stderr, "\t%s\n", str);
+				cp += sizeof(uu);
+			}
+		}
+		break;
+	case UUIDD_OP_STATS:
+		cn->reply_len = format_stats(uuidd_cxt, reply_buf,
+					     UUIDD_PROT_BUFSZ) + 1;
+		break;
+	default:
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), cn->op);
+		return -1;
+	}
+
+	memcpy(cn->out, &cn->reply_len, sizeof(cn->reply_len));
+	return 0;
+}
+
+/*
+ * The random UUIDs are generated by worker threads, the other operations
+ * (time-based UUIDs) in the main thread only.
+ */
+static void *worker_thread(void *data)
+{
+	struct uuidd_workers *wk = (struct uuidd_workers *) data;
+	const uint64_t one = 1;
+
+	while (1) {
+		struct uuidd_conn *cn;
+
+		pthread_mutex_lock(&wk->lock);
+		while (!wk->todo)
+			pthread_cond_wait(&wk->cond, &wk->lock);
+		cn = wk->todo;
+		wk->todo = cn->next;
+		if (!wk->todo)
+			wk->todo_last = NULL;
+		pthread_mutex_unlock(&wk->lock);
+
+		process_request(wk->cxt, cn);
+
+		pthread_mutex_lock(&wk->lock);
+		cn->next = wk->done;
+		wk->done = cn;
+		pthread_mutex_unlock(&wk->lock);
+
+		if (write(wk->wakefd, &one, sizeof(one)) != sizeof(one))
+			warn(_("cannot notify server loop"));
+	}
+	return NULL;
+}
+
+static void start_workers(struct uuidd_workers *wk, struct uuidd_cxt_t *uuidd_cxt)
+{
+	size_t i;
+
+	memset(wk, 0, sizeof(*wk));
+	wk->cxt = uuidd_cxt;
+	wk->wakefd = -1;
+	if (!uuidd_cxt->nworkers)
+		return;
+
+	wk->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wk->wakefd < 0)
+		err(EXIT_FAILURE, _("cannot create eventfd"));
+	pthread_mutex_init(&wk->lock, NULL);
+	pthread_cond_init(&wk->cond, NULL);
+
+	for (i = 0; i < uuidd_cxt->nworkers; i++) {
+		pthread_t th;
+
+		if (pthread_create(&th, NULL, worker_thread, wk) != 0) {
+			warn(_("cannot create worker thread"));
+			break;
+		}
+		pthread_detach(th);
+		wk->nthreads++;
+	}
+	if (uuidd_cxt->debug)
+		fprintf(stderr, _("%zu worker threads\n"), wk->nthreads);
+}
+
+static void queue_request(struct uuidd_workers *wk, struct uuidd_conn *cn)
+{
+	pthread_mutex_lock(&wk->lock);
+	cn->next = NULL;
+	if (wk->todo_last)
+		wk->todo_last->next = cn;
+	else
+		wk->todo = cn;
+	wk->todo_last = cn;
+	pthread_cond_signal(&wk->cond);
+	pthread_mutex_unlock(&wk->lock);
+}
+
+static void update_stats(struct uuidd_stats *st, const struct timeval *start)
+{
+	struct timeval now, diff;
+	uint64_t usec;
+	size_t i = 0;
+
+	gettime_monotonic(&now);
+	timersub(&now, start, &diff);
+	usec = (uint64_t) diff.tv_sec * 1000000 + diff.tv_usec;
+
+	while (usec && i < UUIDD_STATS_NBUCKETS - 1) {
+		usec >>= 1;
+		i++;
+	}
+	st->latency[i]++;
+}
+
+static void close_conn(struct uuidd_server *srv, struct uuidd_conn *cn)
+{
+	if (cn->in_epoll)
+		epoll_ctl(srv->efd, EPOLL_CTL_DEL, cn->fd, NULL);
+	close(cn->fd);
+	free(cn);
+}
+
+static void send_reply(struct uuidd_server *srv, struct uuidd_conn *cn)
+{
+	size_t len = sizeof(cn->reply_len) + cn->reply_len;
+
+	while (cn->sent < len) {
+		ssize_t ret = write(cn->fd, cn->out + cn->sent, len - cn->sent);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == EAGAIN) {
+			struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = cn };
+
+			if (!cn->in_epoll) {
+				if (epoll_ctl(srv->efd, EPOLL_CTL_ADD, cn->fd, &ev) != 0)
+					break;
+				cn->in_epoll = 1;
+			}
+			return;
+		}
+		if (ret <= 0)
+			break;
+		cn->sent += ret;
+	}
+
+	if (cn->sent == len)
+		update_stats(&srv->cxt->stats, &cn->start);
+	else
+		srv->cxt->stats.nerrors++;
+	close_conn(srv, cn);
+}
+
+static void read_request(struct uuidd_server *srv, struct uuidd_conn *cn)
+{
+	struct uuidd_cxt_t *uuidd_cxt = srv->cxt;
+	size_t need = sizeof(cn->op);
+	ssize_t len;
+
+	if (cn->reqsz >= sizeof(cn->op) && is_bulk_op(cn->op))
+		need += sizeof(cn->num);
+
+	while (cn->reqsz < need) {
+		len = read(cn->fd, cn->req + cn->reqsz, need - cn->reqsz);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 && errno == EAGAIN)
+			return;
+		if (len <= 0) {
+			if (!cn->reqsz && len < 0)
+				warn(_("read failed"));
+			else if (!cn->reqsz)
+				warnx(_("error reading from client, len = %d"), 0);
+			goto fail;
+		}
+		cn->reqsz += len;
+
+		if (cn->reqsz == sizeof(cn->op)) {
+			memcpy(&cn->op, cn->req, sizeof(cn->op));
+			if (is_bulk_op(cn->op))
+				need += sizeof(cn->num);
+		}
+	}
+
+	if (is_bulk_op(cn->op)) {
+		memcpy(&cn->num, cn->req + sizeof(cn->op), sizeof(cn->num));
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("operation %d, incoming num = %d\n"),
+			       cn->op, cn->num);
+	} else if (uuidd_cxt->debug)
+		fprintf(stderr, _("operation %d\n"), cn->op);
+
+	if (cn->op > UUIDD_MAX_OP) {
+		if (uuidd_cxt->debug)
+			fprintf(stderr, _("Invalid operation %d\n"), cn->op);
+		goto fail;
+	}
+	uuidd_cxt->stats.nrequests[cn->op]++;
+
+	epoll_ctl(srv->efd, EPOLL_CTL_DEL, cn->fd, NULL);
+	cn->in_epoll = 0;
+
+	if (cn->op == UUIDD_OP_BULK_RANDOM_UUID && srv->workers.nthreads) {
+		queue_request(&srv->workers, cn);
+		return;
+	}
+	if (process_request(uuidd_cxt, cn) != 0)
+		goto fail;
+	send_reply(srv, cn);
+	return;
+fail:
+	uuidd_cxt->stats.nerrors++;
+	close_conn(srv, cn);
+}
+
+static void accept_clients(struct uuidd_server *srv)
+{
+	while (1) {
+		struct epoll_event ev = { .events = EPOLLIN };
+		struct uuidd_conn *cn;
+		int ns;
+
+		ns = accept(srv->sock, NULL, NULL);
+		if (ns < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != ECONNABORTED)
+				warn(_("accept failed"));
+			return;
+		}
+		if (fcntl(ns, F_SETFL, O_NONBLOCK) != 0
+		    || !(cn = calloc(1, sizeof(*cn)))) {
+			close(ns);
+			continue;
+		}
+		cn->fd = ns;
+		gettime_monotonic(&cn->start);
+
+		ev.data.ptr = cn;
+		if (epoll_ctl(srv->efd, EPOLL_CTL_ADD, ns, &ev) != 0) {
+			close(ns);
+			free(cn);
+			continue;
+		}
+		cn->in_epoll = 1;
+	}
+}
+
+static void finish_requests(struct uuidd_server *srv)
+{
+	struct uuidd_conn *cn;
+	uint64_t count;
+
+	if (read(srv->workers.wakefd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		warn(_("cannot read eventfd"));
+
+	pthread_mutex_lock(&srv->workers.lock);
+	cn = srv->workers.done;
+	srv->workers.done = NULL;
+	pthread_mutex_unlock(&srv->workers.lock);
+
+	while (cn) {
+		struct uuidd_conn *next = cn->next;
+
+		send_reply(srv, cn);
+		cn = next;
+	}
+}
+
 static void server_loop(const char *socket_path, const char *pidfile_path,
 			struct uuidd_cxt_t *uuidd_cxt)
 {
-	struct sockaddr_un	from_addr;
-	socklen_t		fromlen;
-	int32_t			reply_len = 0;
+	struct uuidd_server	srv = { .cxt = uuidd_cxt };
+	struct epoll_event	ev, events[16];
 	uuid_t			uu;
-	char			reply_buf[UUIDD_PROT_BUFSZ], *cp;
-	uuidd_prot_op_t 	op;
-	char			str[UUID_STR_LEN];
-	int			i, ns, len;
-	uuidd_prot_num_t	num;		/* intentionally uninitialized */
+	char			reply_buf[UUIDD_PROT_BUFSZ];
+	uuidd_prot_num_t	num;
 	int			s = 0;
 	int			fd_pidfile = -1;
-	int			ret;
-	struct pollfd		pfd[2];
+	int			i, ret;
 	sigset_t		sigmask;
 	int			sigfd;
-	enum {
-				POLLFD_SIGNAL = 0,
-				POLLFD_SOCKET
-	};
+	struct timeval		last_event;
 
 #ifdef HAVE_LIBSYSTEMD
 	if (!uuidd_cxt->no_sock)	/* no_sock implies no_fork and no_pid */
@@ -438,10 +992,6 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 	if ((sigfd = signalfd(-1, &sigmask, 0)) < 0)
 		err(EXIT_FAILURE, _("cannot set signal handler"));
 
-	pfd[POLLFD_SIGNAL].fd = sigfd;
-	pfd[POLLFD_SOCKET].fd = s;
-	pfd[POLLFD_SIGNAL].events = pfd[POLLFD_SOCKET].events = POLLIN | POLLERR | POLLHUP;
-
 	num = 1;
 	if (uuidd_cxt->cont_clock_offset) {
 		/* trigger initialization */
@@ -451,130 +1001,80 @@ static void server_loop(const char *socket_path, const char *pidfile_path,
 				uuidd_cxt->cont_clock_offset);
 	}
 
+	if (uuidd_cxt->do_lease)
+		create_lease(uuidd_cxt, UUIDD_LEASE_PATH);
+
+	srv.sock = s;
+	srv.sigfd = sigfd;
+	srv.efd = epoll_create1(EPOLL_CLOEXEC);
+	if (srv.efd < 0)
+		err(EXIT_FAILURE, _("cannot create epoll"));
+	if (fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK) != 0)
+		err(EXIT_FAILURE, _("cannot set non-blocking socket"));
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &srv.sigfd;
+	if (epoll_ctl(srv.efd, EPOLL_CTL_ADD, sigfd, &ev) != 0)
+		err(EXIT_FAILURE, _("epoll_ctl failed"));
+	ev.data.ptr = &srv.sock;
+	if (epoll_ctl(srv.efd, EPOLL_CTL_ADD, s, &ev) != 0)
+		err(EXIT_FAILURE, _("epoll_ctl failed"));
+
+	start_workers(&srv.workers, uuidd_cxt);
+	if (srv.workers.nthreads) {
+		ev.data.ptr = &srv.workers.wakefd;
+		if (epoll_ctl(srv.efd, EPOLL_CTL_ADD, srv.workers.wakefd, &ev) != 0)
+			err(EXIT_FAILURE, _("epoll_ctl failed"));
+	}
+
+	gettime_monotonic(&last_event);
+
 	while (1) {
-		ret = poll(pfd, ARRAY_SIZE(pfd),
+		ret = epoll_wait(srv.efd, events, ARRAY_SIZE(events),
+				uuidd_cxt->lease ? UUIDD_LEASE_INTERVAL :
 				uuidd_cxt->timeout ?
 					(int) uuidd_cxt->timeout * 1000 : -1);
 		if (ret < 0) {
-			if (errno == EAGAIN)
+			if (errno == EAGAIN || errno == EINTR)
 				continue;
-			warn(_("poll failed"));
+			warn(_("epoll_wait failed"));
 			all_done(uuidd_cxt, EXIT_FAILURE);
 		}
-		if (ret == 0) {		/* true when poll() times out */
+		if (uuidd_cxt->lease) {
+			struct timeval now;
+
+			lease_refill(uuidd_cxt, 0);
+			gettime_monotonic(&now);
+			if (ret > 0)
+				last_event = now;
+			else if (!uuidd_cxt->timeout
+				 || now.tv_sec - last_event.tv_sec < (time_t) uuidd_cxt->timeout)
+				continue;
+		}
+		if (ret == 0) {		/* true when epoll_wait() times out */
 			if (uuidd_cxt->debug)
 				fprintf(stderr, _("timeout [%d sec]\n"), uuidd_cxt->timeout);
 			all_done(uuidd_cxt, EXIT_SUCCESS);
 		}
-		if (pfd[POLLFD_SIGNAL].revents != 0)
-			handle_signal(uuidd_cxt, sigfd);
-		if (pfd[POLLFD_SOCKET].revents == 0)
-			continue;
-		fromlen = sizeof(from_addr);
-		ns = accept(s, (struct sockaddr *) &from_addr, &fromlen);
-		if (ns < 0) {
-			if ((errno == EAGAIN) || (errno == EINTR))
-				continue;
-			err(EXIT_FAILURE, "accept");
-		}
-		len = read(ns, &op, sizeof(op));
-		if (len != sizeof(op)) {
-			if (len < 0)
-				warn(_("read failed"));
-			else
-				warnx(_("error reading from client, len = %d"),
-						len);
-			goto shutdown_socket;
-		}
-		if ((op == UUIDD_OP_BULK_TIME_UUID) ||
-		    (op == UUIDD_OP_BULK_RANDOM_UUID)) {
-			if (read_all(ns, (char *) &num, sizeof(num)) != sizeof(num))
-				goto shutdown_socket;
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("operation %d, incoming num = %d\n"),
-				       op, num);
-		} else if (uuidd_cxt->debug)
-			fprintf(stderr, _("operation %d\n"), op);
-
-		switch (op) {
-		case UUIDD_OP_GETPID:
-			snprintf(reply_buf, sizeof(reply_buf), "%d", getpid());
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_GET_MAXOP:
-			snprintf(reply_buf, sizeof(reply_buf), "%d", UUIDD_MAX_OP);
-			reply_len = strlen(reply_buf) + 1;
-			break;
-		case UUIDD_OP_TIME_UUID:
-			num = 1;
-			ret = __uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
-			if (ret < 0 && !uuidd_cxt->quiet)
-				warnx(_("failed to open/lock clock counter"));
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated time UUID: %s\n"), str);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_RANDOM_UUID:
-			num = 1;
-			ret = __uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
-			if (ret < 0 && !uuidd_cxt->quiet)
-				warnx(_("failed to open/lock clock counter"));
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, _("Generated random UUID: %s\n"), str);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			break;
-		case UUIDD_OP_BULK_TIME_UUID:
-			ret = __uuid_generate_time_cont(uu, &num, uuidd_cxt->cont_clock_offset);
-			if (ret < 0 && !uuidd_cxt->quiet)
-				warnx(_("failed to open/lock clock counter"));
-			if (uuidd_cxt->debug) {
-				uuid_unparse(uu, str);
-				fprintf(stderr, P_("Generated time UUID %s "
-						   "and %d following\n",
-						   "Generated time UUID %s "
-						   "and %d following\n", num - 1),
-				       str, num - 1);
-			}
-			memcpy(reply_buf, uu, sizeof(uu));
-			reply_len = sizeof(uu);
-			memcpy(reply_buf + reply_len, &num, sizeof(num));
-			reply_len += sizeof(num);
-			break;
-		case UUIDD_OP_BULK_RANDOM_UUID:
-			if (num < 0)
-				num = 1;
-			if ((sizeof(reply_buf) - sizeof(num)) < (size_t) (sizeof(uu) * num))
-				num = (sizeof(reply_buf) - sizeof(num)) / sizeof(uu);
-			__uuid_generate_random((unsigned char *) reply_buf +
-					      sizeof(num), &num);
-			reply_len = sizeof(num) + (sizeof(uu) * num);
-			memcpy(reply_buf, &num, sizeof(num));
-			if (uuidd_cxt->debug) {
-				fprintf(stderr, P_("Generated %d UUID:\n",
-						   "Generated %d UUIDs:\n", num), num);
-				cp = reply_buf + sizeof(num);
-				for (i = 0; i < num; i++) {
-					uuid_unparse((unsigned char *)cp, str);
-					fprintf(stderr, "\t%s\n", str);
-					cp += sizeof(uu);
-				}
+
+		for (i = 0; i < ret; i++) {
+			void *ptr = events[i].data.ptr;
+
+			if (ptr == &srv.sigfd)
+				handle_signal(uuidd_cxt, sigfd);
+			else if (ptr == &srv.sock)
+				accept_clients(&srv);
+			else if (ptr == &srv.workers.wakefd)
+				finish_requests(&srv);
+			else {
+				struct uuidd_conn *cn = (struct uuidd_conn *) ptr;
+
+				if (cn->reply_len)
+					send_reply(&srv, cn);
+				else
+					read_request(&srv, cn);
 			}
-			break;
-		default:
-			if (uuidd_cxt->debug)
-				fprintf(stderr, _("Invalid operation %d\n"), op);
-			goto shutdown_socket;
 		}
-		write_all(ns, (char *) &reply_len, sizeof(num));
-		write_all(ns, reply_buf, reply_len);
-	shutdown_socket:
-		close(ns);
 	}
 }
 
@@ -607,6 +1107,9 @@ static uint32_t parse_cont_clock(char *arg)
 static void parse_options(int argc, char **argv, struct uuidd_cxt_t *uuidd_cxt,
 			  struct uuidd_options_t *uuidd_opts)
 {
+	enum {
+		OPT_STATS = CHAR_MAX + 1
+	};
 	const struct option longopts[] = {
 		{"pid", required_argument, NULL, 'p'},
 		{"socket", required_argument, NULL, 's'},
@@ -614,7 +1117,11 @@ static void parse_options(int argc, char **argv, struct uuidd_cxt_t *uuidd_cxt,
 		{"kill", no_argument, NULL, 'k'},
 		{"random", no_argument, NULL, 'r'},
 		{"time", no_argument, NULL, 't'},
+		{"time-v7", no_argument, NULL, '7'},
 		{"uuids", required_argument, NULL, 'n'},
+		{"stats", no_argument, NULL, OPT_STATS},
+		{"workers", required_argument, NULL, 'w'},
+		{"lease", no_argument, NULL, 'L'},
 		{"no-pid", no_argument, NULL, 'P'},
 		{"no-fork", no_argument, NULL, 'F'},
 		{"socket-activation", no_argument, NULL, 'S'},
@@ -628,13 +1135,13 @@ static void parse_options(int argc, char **argv, struct uuidd_cxt_t *uuidd_cxt,
 	const ul_excl_t excl[] = {
 		{ 'P', 'p' },
 		{ 'd', 'q' },
-		{ 'r', 't' },
+		{ '7', 'r', 't' },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
 	int c;
 
-	while ((c = getopt_long(argc, argv, "p:s:T:krtn:PFSC::dqVh", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "p:s:T:krt7n:w:LPFSC::dqVh", longopts, NULL)) != -1) {
 		err_exclusive_options(c, longopts, excl, excl_st);
 		switch (c) {
 		case 'C':
@@ -649,6 +1156,9 @@ static void parse_options(int argc, char **argv, struct uuidd_cxt_t *uuidd_cxt,
 		case 'k':
 			uuidd_opts->do_kill = 1;
 			break;
+		case 'L':
+			uuidd_cxt->do_lease = 1;
+			break;
 		case 'n':
 			uuidd_opts->num = (uuidd_prot_num_t) strtou16_or_err(optarg,
 						_("failed to parse --uuids"));
@@ -685,10 +1195,21 @@ static void parse_options(int argc, char **argv, struct uuidd_cxt_t *uuidd_cxt,
 		case 't':
 			uuidd_opts->do_type = UUIDD_OP_TIME_UUID;
 			break;
+		case '7':
+			uuidd_opts->do_type = UUIDD_OP_BULK_TIME_V7_UUID;
+			break;
 		case 'T':
 			uuidd_cxt->timeout = strtou32_or_err(optarg,
 						_("failed to parse --timeout"));
 			break;
+		case 'w':
+			uuidd_cxt->nworkers = str2num_or_err(optarg, 10,
+						_("failed to parse --workers"),
+						0, UUIDD_NWORKERS_MAX);
+			break;
+		case OPT_STATS:
+			uuidd_opts->do_stats = 1;
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -708,7 +1229,8 @@ static void parse_options(int argc, char **argv, struct uuidd_cxt_t *uuidd_cxt,
 			uuidd_opts->do_type = UUIDD_OP_BULK_TIME_UUID;
 			break;
 		}
-	}
+	} else if (uuidd_opts->do_type == UUIDD_OP_BULK_TIME_V7_UUID)
+		uuidd_opts->num = 1;	/* no single v7 operation */
 }
 
 int main(int argc, char **argv)
@@ -717,7 +1239,8 @@ int main(int argc, char **argv)
 	char		*cp;
 	int		ret;
 
-	struct uuidd_cxt_t uuidd_cxt = { .timeout = 0, .cont_clock_offset = 0 };
+	struct uuidd_cxt_t uuidd_cxt = { .timeout = 0, .cont_clock_offset = 0,
+					 .nworkers = UUIDD_NWORKERS_DEFAULT };
 	struct uuidd_options_t uuidd_opts = { .socket_path = UUIDD_SOCKET_PATH };
 
 	setlocale(LC_ALL, "");
@@ -792,6 +1315,20 @@ int main(int argc, char **argv)
 		return EXIT_SUCCESS;
 	}
 
+	if (uuidd_opts.do_stats) {
+		char buf[UUIDD_PROT_BUFSZ];
+
+		ret = call_daemon(uuidd_opts.socket_path, UUIDD_OP_STATS, buf,
+				  sizeof(buf), 0, &err_context);
+		if (ret < 0)
+			err(EXIT_FAILURE, _("error calling uuidd daemon (%s)"),
+					err_context ? : _("unexpected error"));
+		if (ret == 0 || buf[ret - 1] != '\0')
+			unexpected_size(ret);
+		fputs(buf, stdout);
+		return EXIT_SUCCESS;
+	}
+
 	if (uuidd_opts.do_kill) {
 		char buf[16];
 
@@ -31,6 +31,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -r, --random        generate random-based uuid\n"), out);
 	fputs(_(" -t, --time          generate time-based uuid\n"), out);
+	fputs(_(" -6, --time-v6       generate time-based uuid, version 6\n"), out);
+	fputs(_(" -7, --time-v7       generate time-ordered uuid, version 7\n"), out);
 	fputs(_(" -n, --namespace ns  generate hash-based uuid in this namespace\n"), out);
 	printf(_("                       available namespaces: %s\n"), "@dns @url @oid @x500");
 	fputs(_(" -N, --name name     generate hash-based uuid from this name\n"), out);
@@ -92,6 +94,8 @@ main (int argc, char *argv[])
 	static const struct option longopts[] = {
 		{"random", no_argument, NULL, 'r'},
 		{"time", no_argument, NULL, 't'},
+		{"time-v6", no_argument, NULL, '6'},
+		{"time-v7", no_argument, NULL, '7'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
 		{"namespace", required_argument, NULL, 'n'},
@@ -107,7 +111,7 @@ main (int argc, char *argv[])
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "rtVhn:N:msx", longopts, NULL)) != -1)
+	while ((c = getopt_long(argc, argv, "rt67Vhn:N:msx", longopts, NULL)) != -1)
 		switch (c) {
 		case 't':
 			do_type = UUID_TYPE_DCE_TIME;
@@ -115,6 +119,12 @@ main (int argc, char *argv[])
 		case 'r':
 			do_type = UUID_TYPE_DCE_RANDOM;
 			break;
+		case '6':
+			do_type = UUID_TYPE_DCE_TIME_V6;
+			break;
+		case '7':
+			do_type = UUID_TYPE_DCE_TIME_V7;
+			break;
 		case 'n':
 			namespace = optarg;
 			break;
@@ -172,6 +182,12 @@ main (int argc, char *argv[])
 	case UUID_TYPE_DCE_RANDOM:
 		uuid_generate_random(uu);
 		break;
+	case UUID_TYPE_DCE_TIME_V6:
+		uuid_generate_time_v6(uu);
+		break;
+	case UUID_TYPE_DCE_TIME_V7:
+		uuid_generate_time_v7(uu);
+		break;
 	case UUID_TYPE_DCE_MD5:
 	case UUID_TYPE_DCE_SHA1:
 		if (namespace[0] == '@' && namespace[1] != '\0') {
@@ -138,11 +138,18 @@ static const struct colinfo *get_column_info(int num)
 	return &infos[get_column_id(num)];
 }
 
-static void fill_table_row(struct libscols_table *tb, char const *const uuid)
+/* number of UUIDs parsed by one uuid_parse_many() call in stdin mode */
+#define UUIDPARSE_BATCH		256
+
+/*
+ * Adds line for the string @uuid, @buf is the parsed UUID or NULL if the
+ * string is invalid.
+ */
+static void fill_table_row(struct libscols_table *tb, char const *const uuid,
+			   const unsigned char *buf)
 {
 	static struct libscols_line *ln;
 	size_t i;
-	uuid_t buf;
 	int invalid = 0;
 	int variant = -1, type = -1;
 
@@ -153,7 +160,7 @@ static void fill_table_row(struct libscols_table *tb, char const *const uuid)
 	if (!ln)
 		errx(EXIT_FAILURE, _("failed to allocate output line"));
 
-	if (uuid_parse(uuid, buf))
+	if (!buf)
 		invalid = 1;
 	else {
 		variant = uuid_variant(buf);
@@ -213,6 +220,12 @@ static void fill_table_row(struct libscols_table *tb, char const *const uuid)
 			case UUID_TYPE_DCE_SHA1:
 				str = xstrdup(_("sha1-based"));
 				break;
+			case UUID_TYPE_DCE_TIME_V6:
+				str = xstrdup(_("time-v6"));
+				break;
+			case UUID_TYPE_DCE_TIME_V7:
+				str = xstrdup(_("time-v7"));
+				break;
 			default:
 				str = xstrdup(_("unknown"));
 			}
@@ -222,7 +235,10 @@ static void fill_table_row(struct libscols_table *tb, char const *const uuid)
 				str = xstrdup(_("invalid"));
 				break;
 			}
-			if (variant == UUID_VARIANT_DCE && type == UUID_TYPE_DCE_TIME) {
+			if (variant == UUID_VARIANT_DCE
+			    && (type == UUID_TYPE_DCE_TIME
+				|| type == UUID_TYPE_DCE_TIME_V6
+				|| type == UUID_TYPE_DCE_TIME_V7)) {
 				struct timeval tv;
 				char date_buf[ISO_BUFSIZ];
 
@@ -240,6 +256,28 @@ static void fill_table_row(struct libscols_table *tb, char const *const uuid)
 	}
 }
 
+/*
+ * Adds lines for @count strings from @strs, the strings are UUID_STR_LEN
+ * bytes apart.
+ */
+static void fill_table_batch(struct libscols_table *tb, const char *strs, size_t count)
+{
+	uuid_t bufs[UUIDPARSE_BATCH];
+	size_t i = 0, n;
+
+	assert(count <= UUIDPARSE_BATCH);
+
+	while (i < count) {
+		n = uuid_parse_many(strs + i * UUID_STR_LEN, count - i, bufs + i);
+		for (; n > 0; n--, i++)
+			fill_table_row(tb, strs + i * UUID_STR_LEN, bufs[i]);
+		if (i < count) {
+			fill_table_row(tb, strs + i * UUID_STR_LEN, NULL);
+			i++;
+		}
+	}
+}
+
 static void print_output(struct control const *const ctrl, int argc,
 			 char **argv)
 {
@@ -267,14 +305,26 @@ static void print_output(struct control const *const ctrl, int argc,
 			    _("failed to initialize output column"));
 	}
 
-	for (i = 0; i < (size_t) argc; i++)
-		fill_table_row(tb, argv[i]);
+	for (i = 0; i < (size_t) argc; i++) {
+		uuid_t buf;
 
-	if (i == 0) {
-		char uuid[UUID_STR_LEN];
+		fill_table_row(tb, argv[i],
+			       uuid_parse(argv[i], buf) == 0 ? buf : NULL);
+	}
 
-		while (scanf(" %36[^ \t\n]%*c", uuid) && !feof(stdin))
-			fill_table_row(tb, uuid);
+	if (i == 0) {
+		char *uuids = xmalloc(UUIDPARSE_BATCH * UUID_STR_LEN);
+		size_t n = 0;
+
+		while (scanf(" %36[^ \t\n]%*c", uuids + n * UUID_STR_LEN)
+		       && !feof(stdin)) {
+			if (++n == UUIDPARSE_BATCH) {
+				fill_table_batch(tb, uuids, n);
+				n = 0;
+			}
+		}
+		fill_table_batch(tb, uuids, n);
+		free(uuids);
 	}
 	scols_print_table(tb);
 	scols_unref_table(tb);
@@ -48,12 +48,14 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <time.h>
 
 #include "xalloc.h"
 #include "nls.h"
 #include "c.h"
 #include "closestream.h"
 #include "canonicalize.h"
+#include "fileutils.h"
 
 #include "debug.h"
 
@@ -67,6 +69,7 @@ UL_DEBUG_DEFINE_MASKNAMES(whereis) = UL_DEBUG_EMPTY_MASKNAMES;
 #define WHEREIS_DEBUG_SEARCH	(1 << 5)
 #define WHEREIS_DEBUG_STATIC	(1 << 6)
 #define WHEREIS_DEBUG_LIST	(1 << 7)
+#define WHEREIS_DEBUG_CACHE	(1 << 8)
 #define WHEREIS_DEBUG_ALL	0xFFFF
 
 #define DBG(m, x)       __UL_DBG(whereis, WHEREIS_DEBUG_, m, x)
@@ -86,16 +89,57 @@ enum {
 	ALL_DIRS = BIN_DIR | MAN_DIR | SRC_DIR
 };
 
+/* hash index entry, see listing_build_index() */
+struct wh_entry {
+	size_t	name;		/* offset in wh_listing->names */
+	size_t	next;		/* index + 1 of the next entry or 0 */
+};
+
+/*
+ * Content of a directory.  The directories are read only once and all names
+ * are looked up in the hash index; the listings are also stored in the
+ * persistent cache (see $WHEREIS_CACHE) and reused while the directory mtime
+ * is the same.
+ */
+struct wh_listing {
+	char	*path;
+	dev_t	st_dev;
+	ino_t	st_ino;
+	struct timespec mtime;
+
+	char	*names;		/* NUL separated names in readdir() order */
+	size_t	namesz;
+	size_t	nnames;
+
+	size_t	nbuckets;	/* power of 2 or 0 if the index is not built */
+	size_t	*buckets;	/* index + 1 of the first entry or 0 */
+	struct wh_entry *entries;
+	size_t	nentries;
+
+	unsigned int	nlookups;	/* the index is built for the second one */
+	unsigned int	fresh : 1,	/* read from the directory */
+			obsolete : 1;	/* replaced by the fresh listing */
+
+	struct wh_listing *next;
+};
+
 /* directories */
 struct wh_dirlist {
 	int	type;
 	dev_t	st_dev;
 	ino_t	st_ino;
+	struct timespec mtime;
 	char	*path;
 
+	struct wh_listing *listing;
+	unsigned int	unreadable : 1;
+
 	struct wh_dirlist *next;
 };
 
+/* all listings read in this run or loaded from the cache */
+static struct wh_listing *listings;
+
 static const char *bindirs[] = {
 	"/usr/bin",
 	"/usr/sbin",
@@ -213,6 +257,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f         terminate <dirs> argument list\n"), out);
 	fputs(_(" -u         search for unusual entries\n"), out);
 	fputs(_(" -l         output effective lookup paths\n"), out);
+	fputs(_(" -n         read names from standard input\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(16));
@@ -245,6 +290,7 @@ static void dirlist_add_dir(struct wh_dirlist **ls0, int type, const char *dir)
 	ls = xcalloc(1, sizeof(*ls));
 	ls->st_ino = st.st_ino;
 	ls->st_dev = st.st_dev;
+	ls->mtime = st.st_mtim;
 	ls->type = type;
 	ls->path = canonicalize_path(dir);
 
@@ -427,34 +473,351 @@ static int filename_equal(const char *cp, const char *dp, int type)
 	return 0;
 }
 
-static void findin(const char *dir, const char *pattern, int *count,
-		   char **wait, int type)
+/* the names are hashed by the part before the first dot */
+static size_t listing_hash(const char *p)
 {
-	DIR *dirp;
+	size_t h = 5381;
+
+	for (; *p && *p != '.'; p++)
+		h = h * 33 + (unsigned char) *p;
+	return h;
+}
+
+static void listing_add_entry(struct wh_listing *li, const char *key, size_t name)
+{
+	size_t *head = &li->buckets[listing_hash(key) & (li->nbuckets - 1)];
+
+	/* the same name with an other key in the same bucket */
+	if (*head && li->entries[*head - 1].name == name)
+		return;
+
+	li->entries[li->nentries].name = name;
+	li->entries[li->nentries].next = *head;
+	*head = ++li->nentries;
+}
+
+/*
+ * Every name which matches the pattern (see filename_equal()) starts with the
+ * pattern, or with "s." and the pattern, so it has the same part before the
+ * first dot as the pattern.  The names with "s." prefixes are in the index
+ * also without the prefixes.  The entries in the bucket lists are in
+ * readdir() order.
+ */
+static void listing_build_index(struct wh_listing *li)
+{
+	size_t *offsets, i, n = 0, off;
+
+	offsets = xmalloc(max(li->nnames, (size_t) 1) * sizeof(size_t));
+	for (i = 0, off = 0; i < li->nnames; i++) {
+		const char *p = li->names + off;
+
+		offsets[i] = off;
+		for (n++; p[0] == 's' && p[1] == '.'; p += 2)
+			n++;
+		off += strlen(li->names + off) + 1;
+	}
+
+	li->nbuckets = 16;
+	while (li->nbuckets < li->nnames)
+		li->nbuckets <<= 1;
+	li->buckets = xcalloc(li->nbuckets, sizeof(size_t));
+	li->entries = xmalloc(max(n, (size_t) 1) * sizeof(struct wh_entry));
+
+	for (i = li->nnames; i > 0; i--) {
+		const char *p = li->names + offsets[i - 1];
+
+		listing_add_entry(li, p, offsets[i - 1]);
+		for (; p[0] == 's' && p[1] == '.'; p += 2)
+			listing_add_entry(li, p + 2, offsets[i - 1]);
+	}
+	free(offsets);
+
+	DBG(CACHE, ul_debugobj(li, "%s: indexed %zu names", li->path, li->nnames));
+}
+
+static void listing_add_name(struct wh_listing *li, const char *name, size_t *bufsz)
+{
+	size_t len = strlen(name) + 1;
+
+	if (li->namesz + len > *bufsz) {
+		*bufsz = max(*bufsz * 2, li->namesz + len);
+		li->names = xrealloc(li->names, *bufsz);
+	}
+	memcpy(li->names + li->namesz, name, len);
+	li->namesz += len;
+	li->nnames++;
+}
+
+static void free_listing(struct wh_listing *li)
+{
+	free(li->path);
+	free(li->names);
+	free(li->buckets);
+	free(li->entries);
+	free(li);
+}
+
+static int is_same_listing(const struct wh_listing *li, const struct wh_dirlist *ls)
+{
+	return li->st_dev == ls->st_dev && li->st_ino == ls->st_ino
+	       && li->mtime.tv_sec == ls->mtime.tv_sec
+	       && li->mtime.tv_nsec == ls->mtime.tv_nsec
+	       && strcmp(li->path, ls->path) == 0;
+}
+
+/*
+ * Returns the listing of the directory, the directory is read only if there
+ * is no listing with the same mtime.  The mtime is from dirlist_add_dir(), so
+ * the listing is never newer than the mtime.
+ */
+static struct wh_listing *dirlist_get_listing(struct wh_dirlist *ls)
+{
+	struct wh_listing *li;
 	struct dirent *dp;
+	size_t bufsz = 0;
+	DIR *dirp;
 
-	dirp = opendir(dir);
-	if (dirp == NULL)
+	if (ls->listing || ls->unreadable)
+		return ls->listing;
+
+	for (li = listings; li; li = li->next) {
+		if (!li->obsolete && is_same_listing(li, ls)) {
+			DBG(CACHE, ul_debugobj(li, "%s: use listing", li->path));
+			goto done;
+		}
+	}
+
+	dirp = opendir(ls->path);
+	if (!dirp) {
+		ls->unreadable = 1;
+		return NULL;
+	}
+
+	/* the old listings of the directory are not saved to the cache */
+	for (li = listings; li; li = li->next) {
+		if (strcmp(li->path, ls->path) == 0)
+			li->obsolete = 1;
+	}
+
+	li = xcalloc(1, sizeof(*li));
+	li->path = xstrdup(ls->path);
+	li->st_dev = ls->st_dev;
+	li->st_ino = ls->st_ino;
+	li->mtime = ls->mtime;
+	li->fresh = 1;
+
+	while ((dp = readdir(dirp)) != NULL)
+		listing_add_name(li, dp->d_name, &bufsz);
+	closedir(dirp);
+
+	li->next = listings;
+	listings = li;
+
+	DBG(CACHE, ul_debugobj(li, "%s: read %zu names", li->path, li->nnames));
+done:
+	ls->listing = li;
+	return li;
+}
+
+/*
+ * The cache file format:
+ *
+ *	<path> <dev> <ino> <mtime sec> <mtime nsec> <number of names>
+ *	<name>
+ *	...
+ *
+ * The directories with '\n' in the path or in a name are not saved.
+ */
+#define WHEREIS_CACHE_MAGIC	"# whereis cache 1"
+
+static void load_cache(const char *filename)
+{
+	char *line = NULL;
+	size_t linesz = 0;
+	ssize_t len;
+	FILE *f;
+
+	f = fopen(filename, "r" UL_CLOEXECSTR);
+	if (!f)
 		return;
 
-	DBG(SEARCH, ul_debug("find '%s' in '%s'", pattern, dir));
+	DBG(CACHE, ul_debug("loading %s", filename));
 
-	while ((dp = readdir(dirp)) != NULL) {
-		if (!filename_equal(pattern, dp->d_name, type))
+	len = getline(&line, &linesz, f);
+	if (len <= 0 || strcmp(line, WHEREIS_CACHE_MAGIC "\n") != 0)
+		goto done;
+
+	while ((len = getline(&line, &linesz, f)) > 0) {
+		struct wh_listing *li;
+		unsigned long long dev, ino, nnames;
+		long long sec;
+		long nsec;
+		size_t bufsz = 0, i;
+		int pathlen = 0;
+
+		if (line[len - 1] != '\n')
+			break;
+		line[len - 1] = '\0';
+		if (sscanf(line, "%*s%n %llu %llu %lld %ld %llu",
+			   &pathlen, &dev, &ino, &sec, &nsec, &nnames) != 5)
+			break;
+
+		li = xcalloc(1, sizeof(*li));
+		li->path = xstrndup(line, pathlen);
+		li->st_dev = dev;
+		li->st_ino = ino;
+		li->mtime.tv_sec = sec;
+		li->mtime.tv_nsec = nsec;
+
+		for (i = 0; i < nnames; i++) {
+			len = getline(&line, &linesz, f);
+			if (len <= 0 || line[len - 1] != '\n')
+				break;
+			line[len - 1] = '\0';
+			listing_add_name(li, line, &bufsz);
+		}
+		if (i < nnames) {
+			free_listing(li);
+			break;
+		}
+		li->next = listings;
+		listings = li;
+	}
+done:
+	free(line);
+	fclose(f);
+}
+
+static int is_savable_listing(const struct wh_listing *li, time_t now)
+{
+	const char *p;
+
+	if (li->obsolete || strchr(li->path, '\n') || strchr(li->path, ' '))
+		return 0;
+
+	/* the directory may be modified again within the mtime granularity */
+	if (li->mtime.tv_sec + 2 > now)
+		return 0;
+
+	for (p = li->names; p < li->names + li->namesz; p += strlen(p) + 1) {
+		if (strchr(p, '\n'))
+			return 0;
+	}
+	return 1;
+}
+
+/* writes the cache if any directory has been read */
+static void save_cache(const char *filename)
+{
+	struct wh_listing *li;
+	char *tmpname = NULL, *dir, *p;
+	time_t now = time(NULL);
+	FILE *f;
+
+	for (li = listings; li; li = li->next) {
+		if (li->fresh)
+			break;
+	}
+	if (!li)
+		return;
+
+	DBG(CACHE, ul_debug("saving %s", filename));
+
+	dir = xstrdup(filename);
+	if (!stripoff_last_component(dir)) {
+		free(dir);
+		dir = xstrdup(".");
+	}
+	f = xfmkstemp(&tmpname, *dir ? dir : "/", ".whereis");
+	free(dir);
+	if (!f)
+		goto err;
+
+	fputs(WHEREIS_CACHE_MAGIC "\n", f);
+	for (li = listings; li; li = li->next) {
+		if (!is_savable_listing(li, now))
 			continue;
+		fprintf(f, "%s %llu %llu %lld %ld %zu\n", li->path,
+			(unsigned long long) li->st_dev,
+			(unsigned long long) li->st_ino,
+			(long long) li->mtime.tv_sec, (long) li->mtime.tv_nsec,
+			li->nnames);
+		for (p = li->names; p < li->names + li->namesz; p += strlen(p) + 1) {
+			fputs(p, f);
+			fputc('\n', f);
+		}
+	}
+	if (close_stream(f) != 0) {
+		unlink(tmpname);
+		goto err;
+	}
+	if (chmod(tmpname, 0644) != 0 || rename(tmpname, filename) != 0) {
+		unlink(tmpname);
+		goto err;
+	}
+	free(tmpname);
+	return;
+err:
+	warn(_("cannot write %s"), filename);
+	free(tmpname);
+}
 
-		if (uflag && *count == 0)
-			xasprintf(wait, "%s/%s", dir, dp->d_name);
+static void free_listings(void)
+{
+	while (listings) {
+		struct wh_listing *next = listings->next;
 
-		else if (uflag && *count == 1 && *wait) {
-			printf("%s: %s %s/%s", pattern, *wait, dir,  dp->d_name);
-			free(*wait);
-			*wait = NULL;
-		} else
-			printf(" %s/%s", dir, dp->d_name);
-		++(*count);
+		free_listing(listings);
+		listings = next;
 	}
-	closedir(dirp);
+}
+
+static void findin_name(struct wh_dirlist *ls, const char *name,
+			const char *pattern, int *count, char **wait)
+{
+	if (!filename_equal(pattern, name, ls->type))
+		return;
+
+	if (uflag && *count == 0)
+		xasprintf(wait, "%s/%s", ls->path, name);
+
+	else if (uflag && *count == 1 && *wait) {
+		printf("%s: %s %s/%s", pattern, *wait, ls->path, name);
+		free(*wait);
+		*wait = NULL;
+	} else
+		printf(" %s/%s", ls->path, name);
+	++(*count);
+}
+
+static void findin(struct wh_dirlist *ls, const char *pattern, int *count,
+		   char **wait)
+{
+	struct wh_listing *li;
+	const char *name;
+	size_t e;
+
+	li = dirlist_get_listing(ls);
+	if (!li)
+		return;
+
+	DBG(SEARCH, ul_debug("find '%s' in '%s'", pattern, ls->path));
+
+	/* the index is not worth it for one name */
+	if (li->nlookups++ == 0) {
+		for (name = li->names; name < li->names + li->namesz;
+		     name += strlen(name) + 1)
+			findin_name(ls, name, pattern, count, wait);
+		return;
+	}
+
+	if (!li->nbuckets)
+		listing_build_index(li);
+
+	e = li->buckets[listing_hash(pattern) & (li->nbuckets - 1)];
+	for (; e; e = li->entries[e - 1].next)
+		findin_name(ls, li->names + li->entries[e - 1].name,
+			    pattern, count, wait);
 }
 
 static void lookup(const char *pattern, struct wh_dirlist *ls, int want)
@@ -480,7 +843,7 @@ static void lookup(const char *pattern, struct wh_dirlist *ls, int want)
 
 	for (; ls; ls = ls->next) {
 		if ((ls->type & want) && ls->path)
-			findin(ls->path, patbuf, &count, &wait, ls->type);
+			findin(ls, patbuf, &count, &wait);
 	}
 
 	free(wait);
@@ -489,6 +852,22 @@ static void lookup(const char *pattern, struct wh_dirlist *ls, int want)
 		putchar('\n');
 }
 
+/* reads names from stdin, one per line */
+static void lookup_stdin(struct wh_dirlist *ls, int want)
+{
+	char *line = NULL;
+	size_t linesz = 0;
+	ssize_t len;
+
+	while ((len = getline(&line, &linesz, stdin)) > 0) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len)
+			lookup(line, ls, want);
+	}
+	free(line);
+}
+
 static void list_dirlist(struct wh_dirlist *ls)
 {
 	while (ls) {
@@ -517,6 +896,7 @@ int main(int argc, char **argv)
 	struct wh_dirlist *ls = NULL;
 	int want = ALL_DIRS;
 	int i, want_resetable = 0, opt_f_missing = 0;
+	const char *cachefile;
 
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -536,6 +916,12 @@ int main(int argc, char **argv)
 
 	whereis_init_debug();
 
+	cachefile = getenv("WHEREIS_CACHE");
+	if (cachefile && *cachefile)
+		load_cache(cachefile);
+	else
+		cachefile = NULL;
+
 	construct_dirlist(&ls, BIN_DIR, bindirs);
 	construct_dirlist_from_env("PATH", &ls, BIN_DIR);
 
@@ -635,6 +1021,11 @@ int main(int argc, char **argv)
 			case 'l':
 				list_dirlist(ls);
 				break;
+			case 'n':
+				lookup_stdin(ls, want);
+				want_resetable = 1;
+				opt_f_missing = 0;
+				break;
 
 			case 'V':
 				print_version(EXIT_SUCCESS);
@@ -651,6 +1042,9 @@ int main(int argc, char **argv)
 	}
 
 	free_dirlist(&ls, ALL_DIRS);
+	if (cachefile)
+		save_cache(cachefile);
+	free_listings();
 	if (opt_f_missing)
 		errx(EXIT_FAILURE, _("option -f is missing"));
 	return EXIT_SUCCESS;
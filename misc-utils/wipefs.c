@@ -43,6 +43,7 @@
 #include "closestream.h"
 #include "optutils.h"
 #include "blkdev.h"
+#include "jobs.h"
 
 struct wipe_desc {
 	loff_t		offset;		/* magic string offset */
@@ -70,6 +71,7 @@ struct wipe_control {
 	struct wipe_desc *offsets;		/* -o <offset> -o <offset> ... */
 
 	size_t		ndevs;			/* number of devices to probe */
+	size_t		jobs;			/* --jobs */
 
 	char		**reread;		/* devices to BLKRRPART */
 	size_t		nrereads;		/* size of reread */
@@ -398,16 +400,18 @@ new_probe(const char *devname, int mode)
 	return pr;
 error:
 	blkid_free_probe(pr);
-	err(EXIT_FAILURE, _("error: %s: probing initialization failed"), devname);
+	warn(_("error: %s: probing initialization failed"), devname);
+	return NULL;
 }
 
-static struct wipe_desc *read_offsets(struct wipe_control *ctl)
+static int read_offsets(struct wipe_control *ctl, struct wipe_desc **res)
 {
 	blkid_probe pr = new_probe(ctl->devname, 0);
 	struct wipe_desc *wp0 = NULL;
 
+	*res = NULL;
 	if (!pr)
-		return NULL;
+		return -1;
 
 	while (blkid_do_probe(pr) == 0) {
 		size_t len = 0;
@@ -424,7 +428,8 @@ static struct wipe_desc *read_offsets(struct wipe_control *ctl)
 	}
 
 	blkid_free_probe(pr);
-	return wp0;
+	*res = wp0;
+	return 0;
 }
 
 static void free_wipe(struct wipe_desc *wp)
@@ -443,32 +448,39 @@ static void free_wipe(struct wipe_desc *wp)
 	}
 }
 
-static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
+static int do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
 			struct wipe_desc *w)
 {
+	char *msg = NULL, *hex, *p;
 	size_t i;
 
-	if (blkid_do_wipe(pr, ctl->noact) != 0)
-		err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+	if (blkid_do_wipe(pr, ctl->noact) != 0) {
+		warn(_("%s: failed to erase %s magic string at offset 0x%08jx"),
 		     ctl->devname, w->type, (intmax_t)w->offset);
+		return -1;
+	}
 
 	if (ctl->quiet)
-		return;
-
-	printf(P_("%s: %zd byte was erased at offset 0x%08jx (%s): ",
-		  "%s: %zd bytes were erased at offset 0x%08jx (%s): ",
-		  w->len),
-	       ctl->devname, w->len, (intmax_t)w->offset, w->type);
-
-	for (i = 0; i < w->len; i++) {
-		printf("%02x", w->magic[i]);
-		if (i + 1 < w->len)
-			fputc(' ', stdout);
-	}
-	putchar('\n');
+		return 0;
+
+	xasprintf(&msg, P_("%s: %zd byte was erased at offset 0x%08jx (%s): ",
+			   "%s: %zd bytes were erased at offset 0x%08jx (%s): ",
+			   w->len),
+		  ctl->devname, w->len, (intmax_t)w->offset, w->type);
+
+	p = hex = xmalloc(w->len * 3 + 1);
+	*p = '\0';
+	for (i = 0; i < w->len; i++)
+		p += sprintf(p, i + 1 < w->len ? "%02x " : "%02x", w->magic[i]);
+
+	/* by one call, the line is not mixed with output from other --jobs */
+	printf("%s%s\n", msg, hex);
+	free(msg);
+	free(hex);
+	return 0;
 }
 
-static void do_backup(struct wipe_desc *wp, const char *base)
+static int do_backup(struct wipe_desc *wp, const char *base)
 {
 	char *fname = NULL;
 	int fd;
@@ -478,13 +490,17 @@ static void do_backup(struct wipe_desc *wp, const char *base)
 	fd = open(fname, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
 	if (fd < 0)
 		goto err;
-	if (write_all(fd, wp->magic, wp->len) != 0)
+	if (write_all(fd, wp->magic, wp->len) != 0) {
+		close(fd);
 		goto err;
+	}
 	close(fd);
 	free(fname);
-	return;
+	return 0;
 err:
-	err(EXIT_FAILURE, _("%s: failed to create a signature backup"), fname);
+	warn(_("%s: failed to create a signature backup"), fname);
+	free(fname);
+	return -1;
 }
 
 #ifdef BLKRRPART
@@ -514,9 +530,13 @@ static void rereadpt(int fd, const char *devname)
 }
 #endif
 
+/*
+ * Returns 0 on success, <0 on error. The errors are reported here, nothing is
+ * fatal as the function is also called from --jobs threads.
+ */
 static int do_wipe(struct wipe_control *ctl)
 {
-	int mode = O_RDWR, reread = 0, need_force = 0;
+	int mode = O_RDWR, reread = 0, need_force = 0, rc = 0;
 	blkid_probe pr;
 	char *backup = NULL;
 	struct wipe_desc *w;
@@ -526,7 +546,7 @@ static int do_wipe(struct wipe_control *ctl)
 
 	pr = new_probe(ctl->devname, mode);
 	if (!pr)
-		return -errno;
+		return -1;
 
 	if (blkdev_lock(blkid_probe_get_fd(pr),
 			ctl->devname, ctl->lockmode) != 0) {
@@ -535,15 +555,18 @@ static int do_wipe(struct wipe_control *ctl)
 	}
 
 	if (ctl->backup) {
+		/* $HOME is checked in main() */
 		const char *home = getenv ("HOME");
 		char *tmp = xstrdup(ctl->devname);
 
-		if (!home)
-			errx(EXIT_FAILURE, _("failed to create a signature backup, $HOME undefined"));
 		xasprintf (&backup, "%s/wipefs-%s-", home, basename(tmp));
 		free(tmp);
 	}
 
+	/* all signatures are written by blkid_probe_flush_wipes() */
+	if (!ctl->noact)
+		blkid_probe_set_wipe_batch(pr, 1);
+
 	while (blkid_do_probe(pr) == 0) {
 		int wiped = 0;
 		size_t len = 0;
@@ -563,9 +586,12 @@ static int do_wipe(struct wipe_control *ctl)
 			goto done;
 		}
 
-		if (backup)
-			do_backup(wp, backup);
-		do_wipe_real(ctl, pr, wp);
+		if ((backup && do_backup(wp, backup) != 0)
+		    || do_wipe_real(ctl, pr, wp) != 0) {
+			free_wipe(wp);
+			rc = -1;
+			goto out;
+		}
 		if (wp->is_parttable)
 			reread = 1;
 		wiped = 1;
@@ -593,9 +619,18 @@ static int do_wipe(struct wipe_control *ctl)
 	if (need_force)
 		warnx(_("Use the --force option to force erase."));
 
-	if (fsync(blkid_probe_get_fd(pr)) != 0)
-		err(EXIT_FAILURE, _("%s: cannot flush modified buffers"),
-				ctl->devname);
+	rc = blkid_probe_flush_wipes(pr);
+	if (rc != 0) {
+		errno = -rc;
+		warn(_("%s: failed to erase signatures"), ctl->devname);
+		goto out;
+	}
+
+	if (fsync(blkid_probe_get_fd(pr)) != 0) {
+		warn(_("%s: cannot flush modified buffers"), ctl->devname);
+		rc = -errno;
+		goto out;
+	}
 
 #ifdef BLKRRPART
 	if (reread && (mode & O_EXCL)) {
@@ -615,15 +650,141 @@ static int do_wipe(struct wipe_control *ctl)
 	}
 #endif
 
-	if (close(blkid_probe_get_fd(pr)) != 0)
-		err(EXIT_FAILURE, _("%s: close device failed"), ctl->devname);
-
+out:
+	if (close(blkid_probe_get_fd(pr)) != 0 && !rc) {
+		warn(_("%s: close device failed"), ctl->devname);
+		rc = -errno;
+	}
 	blkid_free_probe(pr);
 	free(backup);
-	return 0;
+	return rc;
 }
 
 
+/*
+ * --jobs: the devices are probed (or wiped) by a pool of threads, every
+ * device with its own copy of the control struct. The devices are grouped by
+ * whole-disk, the groups are processed in parallel and the devices within a
+ * group one by one in order of the command line, so a disk and its
+ * partitions are never opened (O_EXCL) at the same time. The listing is
+ * printed in order of the devices on the command line when all is done.
+ */
+struct wipe_job {
+	struct wipe_control ctl;
+	struct wipe_desc *offsets;	/* read_offsets() result */
+	dev_t disk;			/* whole-disk or 0 if unknown */
+	size_t idx;			/* order on the command line */
+	int rc;
+};
+
+struct wipe_jobs {
+	struct wipe_job *jobs;
+	size_t *groups;		/* first job of the group, ngroups + 1 items */
+	size_t ngroups;
+	size_t next;		/* next group to process */
+	unsigned int wipe : 1;
+};
+
+static dev_t get_wholedisk(const char *devname)
+{
+	struct stat st;
+	dev_t disk = 0;
+
+	if (stat(devname, &st) != 0 || !S_ISBLK(st.st_mode))
+		return 0;
+	if (blkid_devno_to_wholedisk(st.st_rdev, NULL, 0, &disk) != 0)
+		return 0;
+	return disk;
+}
+
+static int cmp_jobs_by_disk(const void *a0, const void *b0)
+{
+	const struct wipe_job *a = a0, *b = b0;
+	int rc = cmp_numbers(a->disk, b->disk);
+
+	return rc ? rc : cmp_numbers(a->idx, b->idx);
+}
+
+static int cmp_jobs_by_idx(const void *a0, const void *b0)
+{
+	const struct wipe_job *a = a0, *b = b0;
+
+	return cmp_numbers(a->idx, b->idx);
+}
+
+static void *wipe_worker(void *data)
+{
+	struct wipe_jobs *jb = data;
+	size_t g, i;
+
+	while ((g = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->ngroups) {
+		for (i = jb->groups[g]; i < jb->groups[g + 1]; i++) {
+			struct wipe_job *job = &jb->jobs[i];
+
+			if (jb->wipe)
+				job->rc = do_wipe(&job->ctl);
+			else
+				job->rc = read_offsets(&job->ctl, &job->offsets);
+		}
+	}
+	return NULL;
+}
+
+static int run_jobs(struct wipe_control *ctl, char **devices, size_t ndevs, int wipe)
+{
+	struct wipe_jobs jb = { .wipe = wipe ? 1 : 0 };
+	size_t i;
+	int rc = 0;
+
+	jb.jobs = xcalloc(ndevs, sizeof(struct wipe_job));
+	for (i = 0; i < ndevs; i++) {
+		jb.jobs[i].ctl = *ctl;
+		jb.jobs[i].ctl.devname = devices[i];
+		jb.jobs[i].ctl.reread = NULL;
+		jb.jobs[i].ctl.nrereads = 0;
+		jb.jobs[i].disk = get_wholedisk(devices[i]);
+		jb.jobs[i].idx = i;
+	}
+
+	qsort(jb.jobs, ndevs, sizeof(struct wipe_job), cmp_jobs_by_disk);
+
+	jb.groups = xcalloc(ndevs + 1, sizeof(size_t));
+	for (i = 0; i < ndevs; i++) {
+		/* unknown whole-disk is never shared */
+		if (i == 0 || !jb.jobs[i].disk || jb.jobs[i].disk != jb.jobs[i - 1].disk)
+			jb.groups[jb.ngroups++] = i;
+	}
+	jb.groups[jb.ngroups] = ndevs;
+
+	ul_run_jobs(min(ctl->jobs, jb.ngroups), wipe_worker, &jb, 0);
+	free(jb.groups);
+
+	qsort(jb.jobs, ndevs, sizeof(struct wipe_job), cmp_jobs_by_idx);
+
+	for (i = 0; i < ndevs; i++) {
+		struct wipe_job *job = &jb.jobs[i];
+		size_t k;
+
+		if (job->rc)
+			rc = job->rc;
+		if (job->offsets) {
+			ctl->devname = job->ctl.devname;
+			add_to_output(ctl, job->offsets);
+			free_wipe(job->offsets);
+		}
+
+		/* postponed re-read of the partition tables */
+		for (k = 0; k < job->ctl.nrereads; k++) {
+			if (!ctl->reread)
+				ctl->reread = xcalloc(ndevs, sizeof(char *));
+			ctl->reread[ctl->nrereads++] = job->ctl.reread[k];
+		}
+		free(job->ctl.reread);
+	}
+	free(jb.jobs);
+	return rc;
+}
+
 static void __attribute__((__noreturn__))
 usage(void)
 {
@@ -640,6 +801,7 @@ usage(void)
 	puts(_(" -b, --backup        create a signature backup in $HOME"));
 	puts(_(" -f, --force         force erasure"));
 	puts(_(" -i, --noheadings    don't print headings"));
+	puts(_(" -j, --jobs <num>    process <num> devices in parallel"));
 	puts(_(" -J, --json          use JSON output format"));
 	puts(_(" -n, --no-act        do everything except the actual write() call"));
 	puts(_(" -o, --offset <num>  offset to erase, in bytes"));
@@ -668,7 +830,7 @@ int
 main(int argc, char **argv)
 {
 	struct wipe_control ctl = { .devname = NULL };
-	int c;
+	int c, rc = 0;
 	size_t i;
 	char *outarg = NULL;
 	enum {
@@ -688,6 +850,7 @@ main(int argc, char **argv)
 	    { "version",   no_argument,       NULL, 'V' },
 	    { "json",      no_argument,       NULL, 'J'},
 	    { "noheadings",no_argument,       NULL, 'i'},
+	    { "jobs",      required_argument, NULL, 'j'},
 	    { "output",    required_argument, NULL, 'O'},
 	    { NULL,        0, NULL, 0 }
 	};
@@ -703,7 +866,7 @@ main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "abfhiJnO:o:pqt:V", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "abfhij:JnO:o:pqt:V", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -723,6 +886,9 @@ main(int argc, char **argv)
 		case 'i':
 			ctl.no_headings = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case 'O':
 			outarg = optarg;
 			break;
@@ -795,11 +961,18 @@ main(int argc, char **argv)
 
 		init_output(&ctl);
 
+		if (ctl.jobs > 1 && argc - optind > 1) {
+			blkid_init_debug(0);
+			rc = run_jobs(&ctl, argv + optind, argc - optind, 0);
+			optind = argc;
+		}
+
 		while (optind < argc) {
 			struct wipe_desc *wp;
 
 			ctl.devname = argv[optind++];
-			wp = read_offsets(&ctl);
+			if (read_offsets(&ctl, &wp) != 0)
+				rc = -1;
 			if (wp)
 				add_to_output(&ctl, wp);
 			free_wipe(wp);
@@ -811,9 +984,19 @@ main(int argc, char **argv)
 		 */
 		ctl.ndevs = argc - optind;
 
+		if (ctl.backup && !getenv("HOME"))
+			errx(EXIT_FAILURE, _("failed to create a signature backup, $HOME undefined"));
+
+		if (ctl.jobs > 1 && ctl.ndevs > 1) {
+			blkid_init_debug(0);
+			rc = run_jobs(&ctl, argv + optind, ctl.ndevs, 1);
+			optind = argc;
+		}
+
 		while (optind < argc) {
 			ctl.devname = argv[optind++];
-			do_wipe(&ctl);
+			if (do_wipe(&ctl) != 0)
+				rc = -1;
 			ctl.ndevs--;
 		}
 
@@ -833,5 +1016,5 @@ main(int argc, char **argv)
 		free(ctl.reread);
 #endif
 	}
-	return EXIT_SUCCESS;
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -35,6 +35,7 @@
 #include "strutils.h"
 #include "procfs.h"
 #include "sched_attr.h"
+#include "sched_targets.h"
 
 
 /* control struct */
@@ -47,7 +48,13 @@ struct chrt_ctl {
 	uint64_t deadline;
 	uint64_t period;
 
+	struct sched_targets targets;		/* bulk mode tasks */
+	size_t	ntasks;
+	size_t	nfailed;
+
 	unsigned int all_tasks : 1,		/* all threads of the PID */
+		     bulk : 1,			/* more tasks, don't exit on error */
+		     dry_run : 1,		/* --dry-run */
 		     reset_on_fork : 1,		/* SCHED_RESET_ON_FORK or SCHED_FLAG_RESET_ON_FORK */
 		     altered : 1,		/* sched_set**() used */
 		     verbose : 1;		/* verbose output */
@@ -61,10 +68,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Set policy:\n"
 	" chrt [options] <priority> <command> [<arg>...]\n"
-	" chrt [options] --pid <priority> <pid>\n"), out);
+	" chrt [options] --pid <priority> <pid>[,<pid>...]\n"
+	" chrt [options] --pgrp|--uid|--cgroup <id> <priority>\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Get policy:\n"
-	" chrt [options] -p <pid>\n"), out);
+	" chrt [options] -p <pid>[,<pid>...]\n"
+	" chrt [options] --pgrp|--uid|--cgroup <id>\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Policy options:\n"), out);
@@ -86,7 +95,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("Other options:\n"), out);
 	fputs(_(" -a, --all-tasks      operate on all the tasks (threads) for a given pid\n"), out);
 	fputs(_(" -m, --max            show min and max valid priorities\n"), out);
-	fputs(_(" -p, --pid            operate on existing given pid\n"), out);
+	fputs(_(" -p, --pid            operate on existing given pid, a comma-separated\n"
+		"                        list or \"-\" to read the PIDs from stdin\n"), out);
+	fputs(_("     --pgrp <pgid>    operate on the processes of the process group\n"), out);
+	fputs(_("     --uid <uid>      operate on the processes of the user\n"), out);
+	fputs(_("     --cgroup <path>  operate on the processes of the cgroup\n"), out);
+	fputs(_("     --dry-run        show the tasks to change, but don't change them\n"), out);
 	fputs(_(" -v, --verbose        display status information\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -150,6 +164,8 @@ static void show_sched_pid_info(struct chrt_ctl *ctl, pid_t pid)
 		if (sched_getattr(pid, &sa, sizeof(sa), 0) != 0) {
 			if (errno == ENOSYS)
 				goto fallback;
+			if (ctl->bulk && errno == ESRCH)
+				return;		/* exited in the meantime */
 			err(EXIT_FAILURE, _("failed to get pid %d's policy"), pid);
 		}
 
@@ -171,12 +187,16 @@ fallback:
 		struct sched_param sp;
 
 		policy = sched_getscheduler(pid);
+		if (policy == -1 && ctl->bulk && errno == ESRCH)
+			return;
 		if (policy == -1)
 			err(EXIT_FAILURE, _("failed to get pid %d's policy"), pid);
 
-		if (sched_getparam(pid, &sp) != 0)
+		if (sched_getparam(pid, &sp) != 0) {
+			if (ctl->bulk && errno == ESRCH)
+				return;
 			err(EXIT_FAILURE, _("failed to get pid %d's attributes"), pid);
-		else
+		} else
 			prio = sp.sched_priority;
 # ifdef SCHED_RESET_ON_FORK
 		if (policy & SCHED_RESET_ON_FORK)
@@ -213,7 +233,12 @@ fallback:
 
 static void show_sched_info(struct chrt_ctl *ctl)
 {
-	if (ctl->all_tasks) {
+	if (ctl->bulk) {
+		pid_t tid;
+
+		while (sched_targets_next(&ctl->targets, ctl->all_tasks, &tid) == 0)
+			show_sched_pid_info(ctl, tid);
+	} else if (ctl->all_tasks) {
 #ifdef __linux__
 		DIR *sub = NULL;
 		pid_t tid;
@@ -319,9 +344,36 @@ static int set_sched_one(struct chrt_ctl *ctl, pid_t pid)
 }
 #endif /* HAVE_SCHED_SETATTR */
 
+/* all the tasks are tried, the errors are reported by main() */
+static void set_sched_bulk(struct chrt_ctl *ctl)
+{
+	pid_t tid;
+
+	/* for show_sched_pid_info() */
+	ctl->altered = !ctl->dry_run;
+
+	while (sched_targets_next(&ctl->targets, ctl->all_tasks, &tid) == 0) {
+		ctl->ntasks++;
+		if (ctl->dry_run) {
+			show_sched_pid_info(ctl, tid);
+			continue;
+		}
+		if (set_sched_one(ctl, tid) == -1) {
+			if (errno != ESRCH) {
+				warn(_("failed to set pid %d's policy"), tid);
+				ctl->nfailed++;
+			}
+		} else if (ctl->verbose)
+			show_sched_pid_info(ctl, tid);
+	}
+}
+
 static void set_sched(struct chrt_ctl *ctl)
 {
-	if (ctl->all_tasks) {
+	if (ctl->bulk) {
+		set_sched_bulk(ctl);
+		return;
+	} else if (ctl->all_tasks) {
 #ifdef __linux__
 		DIR *sub = NULL;
 		pid_t tid;
@@ -347,7 +399,17 @@ static void set_sched(struct chrt_ctl *ctl)
 int main(int argc, char **argv)
 {
 	struct chrt_ctl _ctl = { .pid = -1, .policy = SCHED_RR }, *ctl = &_ctl;
-	int c;
+	const char *pidlist = NULL, *cgroup = NULL;
+	pid_t pgrp = -1;
+	uid_t uid = (uid_t) -1;
+	int c, nargs;
+
+	enum {
+		OPT_PGRP = CHAR_MAX + 1,
+		OPT_UID,
+		OPT_CGROUP,
+		OPT_DRY_RUN
+	};
 
 	static const struct option longopts[] = {
 		{ "all-tasks",  no_argument, NULL, 'a' },
@@ -366,6 +428,10 @@ int main(int argc, char **argv)
 		{ "reset-on-fork",  no_argument,       NULL, 'R' },
 		{ "verbose",	no_argument, NULL, 'v' },
 		{ "version",	no_argument, NULL, 'V' },
+		{ "pgrp",	required_argument, NULL, OPT_PGRP },
+		{ "uid",	required_argument, NULL, OPT_UID },
+		{ "cgroup",	required_argument, NULL, OPT_CGROUP },
+		{ "dry-run",	no_argument, NULL, OPT_DRY_RUN },
 		{ NULL,		no_argument, NULL, 0 }
 	};
 
@@ -409,6 +475,12 @@ int main(int argc, char **argv)
 			ctl->policy = SCHED_OTHER;
 			break;
 		case 'p':
+			/* "-" or comma-separated list for more PIDs */
+			if (strcmp(argv[argc - 1], "-") == 0
+			    || strchr(argv[argc - 1], ',')) {
+				pidlist = argv[argc - 1];
+				break;
+			}
 			errno = 0;
 			ctl->pid = strtos32_or_err(argv[argc - 1], _("invalid PID argument"));
 			break;
@@ -427,6 +499,18 @@ int main(int argc, char **argv)
 		case 'D':
 			ctl->deadline = strtou64_or_err(optarg, _("invalid deadline argument"));
 			break;
+		case OPT_PGRP:
+			pgrp = strtos32_or_err(optarg, _("invalid PGID argument"));
+			break;
+		case OPT_UID:
+			uid = strtou32_or_err(optarg, _("invalid UID argument"));
+			break;
+		case OPT_CGROUP:
+			cgroup = optarg;
+			break;
+		case OPT_DRY_RUN:
+			ctl->dry_run = 1;
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -437,15 +521,48 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (((ctl->pid > -1) && argc - optind < 1) ||
-	    ((ctl->pid == -1) && argc - optind < 2)) {
+	/* --dry-run is supported in the bulk mode only, one PID is a list too */
+	if (ctl->dry_run && ctl->pid > -1) {
+		pidlist = argv[argc - 1];
+		ctl->pid = -1;
+	}
+
+	nargs = argc - optind;
+	if (pidlist || pgrp != -1 || uid != (uid_t) -1 || cgroup) {
+		if (!!pidlist + (pgrp != -1) + (uid != (uid_t) -1) + !!cgroup > 1
+		    || ctl->pid > -1)
+			errx(EXIT_FAILURE, _("can handle only one of pid list, pgrp, uid or cgroup at once"));
+		if (!pidlist)
+			nargs++;	/* no PID argument */
+		ctl->bulk = 1;
+	} else if (ctl->dry_run)
+		errx(EXIT_FAILURE, _("--dry-run requires --pid, --pgrp, --uid or --cgroup"));
+
+	if (((ctl->pid > -1 || ctl->bulk) && nargs < 1) ||
+	    ((ctl->pid == -1 && !ctl->bulk) && nargs < 2)) {
 		warnx(_("bad usage"));
 		errtryhelp(EXIT_FAILURE);
-}
+	}
 
-	if ((ctl->pid > -1) && (ctl->verbose || argc - optind == 1)) {
+	if (ctl->bulk) {
+		/* all the PIDs are read before any change */
+		if (pidlist)
+			sched_targets_add_list(&ctl->targets, pidlist);
+		else if (pgrp != -1)
+			sched_targets_add_pgrp(&ctl->targets, pgrp);
+		else if (uid != (uid_t) -1)
+			sched_targets_add_uid(&ctl->targets, uid);
+		else
+			sched_targets_add_cgroup(&ctl->targets, cgroup, ctl->all_tasks);
+
+		if (nargs == 1) {
+			show_sched_info(ctl);
+			sched_targets_free(&ctl->targets);
+			return EXIT_SUCCESS;
+		}
+	} else if ((ctl->pid > -1) && (ctl->verbose || nargs == 1)) {
 		show_sched_info(ctl);
-		if (argc - optind == 1)
+		if (nargs == 1)
 			return EXIT_SUCCESS;
 	}
 
@@ -480,6 +597,19 @@ int main(int argc, char **argv)
 		     ctl->priority);
 	set_sched(ctl);
 
+	if (ctl->bulk) {
+		sched_targets_free(&ctl->targets);
+		if (ctl->dry_run)
+			printf(P_("%zu task would be changed\n",
+				  "%zu tasks would be changed\n", ctl->ntasks), ctl->ntasks);
+		if (ctl->nfailed) {
+			warnx(P_("failed for %zu of %zu task", "failed for %zu of %zu tasks",
+				 ctl->ntasks), ctl->nfailed, ctl->ntasks);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 	if (ctl->verbose)
 		show_sched_info(ctl);
 
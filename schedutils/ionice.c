@@ -20,8 +20,10 @@
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "sched_targets.h"
 
 static int tolerant;
+static int bulk;	/* the processes may exit in the meantime */
 
 static inline int ioprio_set(int which, int who, int ioprio)
 {
@@ -74,9 +76,11 @@ static void ioprio_print(int pid, int who)
 {
 	int ioprio = ioprio_get(who, pid);
 
-	if (ioprio == -1)
+	if (ioprio == -1) {
+		if (bulk && errno == ESRCH)
+			return;
 		err(EXIT_FAILURE, _("ioprio_get failed"));
-	else {
+	} else {
 		int ioclass = IOPRIO_PRIO_CLASS(ioprio);
 		const char *name = _("unknown");
 
@@ -96,7 +100,7 @@ static void ioprio_setid(int which, int ioclass, int data, int who)
 	int rc = ioprio_set(who, which,
 			    IOPRIO_PRIO_VALUE(ioclass, data));
 
-	if (rc == -1 && !tolerant)
+	if (rc == -1 && !tolerant && !(bulk && errno == ESRCH))
 		err(EXIT_FAILURE, _("ioprio_set failed"));
 }
 
@@ -107,6 +111,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fprintf(out,  _(" %1$s [options] -p <pid>...\n"
 			" %1$s [options] -P <pgid>...\n"
 			" %1$s [options] -u <uid>...\n"
+			" %1$s [options] --cgroup <path>\n"
 			" %1$s [options] <command>\n"), program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -121,6 +126,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -P, --pgid <pgrp>...   act on already running processes in these groups\n"), out);
 	fputs(_(" -t, --ignore           ignore failures\n"), out);
 	fputs(_(" -u, --uid <uid>...     act on already running processes owned by these users\n"), out);
+	fputs(_("     --cgroup <path>    act on already running processes in the cgroup\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(24));
@@ -134,9 +140,14 @@ int main(int argc, char **argv)
 {
 	int data = 4, set = 0, ioclass = IOPRIO_CLASS_BE, c;
 	int which = 0, who = 0;
-	const char *invalid_msg = NULL;
+	const char *invalid_msg = NULL, *cgroup = NULL;
+
+	enum {
+		OPT_CGROUP = CHAR_MAX + 1
+	};
 
 	static const struct option longopts[] = {
+		{ "cgroup",    required_argument, NULL, OPT_CGROUP },
 		{ "classdata", required_argument, NULL, 'n' },
 		{ "class",     required_argument, NULL, 'c' },
 		{ "help",      no_argument,       NULL, 'h' },
@@ -173,29 +184,35 @@ int main(int argc, char **argv)
 			set |= 2;
 			break;
 		case 'p':
-			if (who)
+			if (who || cgroup)
 				errx(EXIT_FAILURE,
-				     _("can handle only one of pid, pgid or uid at once"));
+				     _("can handle only one of pid, pgid, uid or cgroup at once"));
 			invalid_msg = _("invalid PID argument");
 			which = strtos32_or_err(optarg, invalid_msg);
 			who = IOPRIO_WHO_PROCESS;
 			break;
 		case 'P':
-			if (who)
+			if (who || cgroup)
 				errx(EXIT_FAILURE,
-				     _("can handle only one of pid, pgid or uid at once"));
+				     _("can handle only one of pid, pgid, uid or cgroup at once"));
 			invalid_msg = _("invalid PGID argument");
 			which = strtos32_or_err(optarg, invalid_msg);
 			who = IOPRIO_WHO_PGRP;
 			break;
 		case 'u':
-			if (who)
+			if (who || cgroup)
 				errx(EXIT_FAILURE,
-				     _("can handle only one of pid, pgid or uid at once"));
+				     _("can handle only one of pid, pgid, uid or cgroup at once"));
 			invalid_msg = _("invalid UID argument");
 			which = strtos32_or_err(optarg, invalid_msg);
 			who = IOPRIO_WHO_USER;
 			break;
+		case OPT_CGROUP:
+			if (who)
+				errx(EXIT_FAILURE,
+				     _("can handle only one of pid, pgid, uid or cgroup at once"));
+			cgroup = optarg;
+			break;
 		case 't':
 			tolerant = 1;
 			break;
@@ -228,7 +245,29 @@ int main(int argc, char **argv)
 			break;
 	}
 
-	if (!set && !which && optind == argc)
+	if (cgroup) {
+		/*
+		 * ionice [-c CLASS] --cgroup PATH
+		 */
+		struct sched_targets tg = { 0 };
+		pid_t pid;
+
+		if (optind < argc) {
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
+		/* all the PIDs are read before any change */
+		sched_targets_add_cgroup(&tg, cgroup, 0);
+		bulk = 1;
+
+		while (sched_targets_next(&tg, 0, &pid) == 0) {
+			if (set)
+				ioprio_setid(pid, ioclass, data, IOPRIO_WHO_PROCESS);
+			else
+				ioprio_print(pid, IOPRIO_WHO_PROCESS);
+		}
+		sched_targets_free(&tg);
+	} else if (!set && !which && optind == argc)
 		/*
 		 * ionice without options, print the current ioprio
 		 */
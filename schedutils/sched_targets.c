@@ -0,0 +1,172 @@
+/*
+ * sched_targets.c - list of the tasks for chrt, taskset and uclampset
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "c.h"
+#include "nls.h"
+#include "pathnames.h"
+#include "procfs.h"
+#include "strutils.h"
+#include "xalloc.h"
+
+#include "sched_targets.h"
+
+static void add_pid(struct sched_targets *tg, pid_t pid)
+{
+	if (tg->npids % 64 == 0)
+		tg->pids = xrealloc(tg->pids, (tg->npids + 64) * sizeof(pid_t));
+	tg->pids[tg->npids++] = pid;
+}
+
+/* PIDs separated by commas or white spaces */
+static void add_pids(struct sched_targets *tg, char *str)
+{
+	char *tok, *save = NULL;
+
+	for (tok = strtok_r(str, ", \t\n", &save); tok;
+	     tok = strtok_r(NULL, ", \t\n", &save))
+		add_pid(tg, (pid_t) str2num_or_err(tok, 10,
+					_("invalid PID argument"), 1, INT32_MAX));
+}
+
+static void read_pids(struct sched_targets *tg, FILE *f)
+{
+	char *line = NULL;
+	size_t sz = 0;
+
+	while (getline(&line, &sz, f) >= 0)
+		add_pids(tg, line);
+	free(line);
+}
+
+/* comma-separated list, or "-" to read the PIDs from standard input */
+void sched_targets_add_list(struct sched_targets *tg, const char *list)
+{
+	char *str;
+
+	if (strcmp(list, "-") == 0) {
+		read_pids(tg, stdin);
+		return;
+	}
+	str = xstrdup(list);
+	add_pids(tg, str);
+	free(str);
+}
+
+/*
+ * Reads the processes of the cgroup, or all the threads if @threads is true.
+ * The cgroup v1 has no cgroup.threads, the "tasks" file is used instead.
+ */
+void sched_targets_add_cgroup(struct sched_targets *tg, const char *path,
+			      int threads)
+{
+	char *fn;
+	FILE *f;
+
+	if (*path == '/')
+		xasprintf(&fn, "%s/%s", path,
+				threads ? "cgroup.threads" : "cgroup.procs");
+	else
+		xasprintf(&fn, "%s/%s/%s", _PATH_SYS_CGROUP, path,
+				threads ? "cgroup.threads" : "cgroup.procs");
+
+	f = fopen(fn, "r" UL_CLOEXECSTR);
+	if (!f && threads && errno == ENOENT) {
+		char *v1 = xstrdup(fn);
+
+		strcpy(strrchr(v1, '/') + 1, "tasks");
+		f = fopen(v1, "r" UL_CLOEXECSTR);
+		free(v1);
+	}
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), fn);
+
+	read_pids(tg, f);
+	fclose(f);
+	free(fn);
+
+	if (threads)
+		tg->threads = 1;
+}
+
+void sched_targets_add_pgrp(struct sched_targets *tg, pid_t pgrp)
+{
+	struct procfs_scan sc;
+	pid_t pid;
+
+	if (procfs_scan_open(&sc, NULL) != 0)
+		err(EXIT_FAILURE, _("cannot open %s"), _PATH_PROC);
+
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		if (getpgid(pid) == pgrp)
+			add_pid(tg, pid);
+	}
+	procfs_scan_close(&sc);
+}
+
+void sched_targets_add_uid(struct sched_targets *tg, uid_t uid)
+{
+	struct procfs_scan sc;
+	pid_t pid;
+
+	if (procfs_scan_open(&sc, NULL) != 0)
+		err(EXIT_FAILURE, _("cannot open %s"), _PATH_PROC);
+
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		if (procfs_scan_match_uid(&sc, uid))
+			add_pid(tg, pid);
+	}
+	procfs_scan_close(&sc);
+}
+
+/*
+ * Returns the next PID, or the next thread of the PIDs if @all_tasks is true.
+ *
+ * Returns: 0 on success, 1 at the end of the list.
+ */
+int sched_targets_next(struct sched_targets *tg, int all_tasks, pid_t *tid)
+{
+	if (!all_tasks || tg->threads) {
+		if (tg->idx >= tg->npids)
+			return 1;
+		*tid = tg->pids[tg->idx++];
+		return 0;
+	}
+
+	for (;;) {
+		if (tg->pc) {
+			if (procfs_process_next_tid(tg->pc, &tg->sub, tid) == 0)
+				return 0;
+			ul_unref_path(tg->pc);
+			tg->pc = NULL;
+			tg->sub = NULL;
+		}
+		if (tg->idx >= tg->npids)
+			return 1;
+		/* a process that has exited has no threads */
+		tg->pc = ul_new_procfs_path(tg->pids[tg->idx++], NULL);
+	}
+}
+
+void sched_targets_free(struct sched_targets *tg)
+{
+	if (tg->sub)
+		closedir(tg->sub);
+	ul_unref_path(tg->pc);
+	free(tg->pids);
+	memset(tg, 0, sizeof(*tg));
+}
@@ -0,0 +1,44 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef UTIL_LINUX_SCHED_TARGETS_H
+#define UTIL_LINUX_SCHED_TARGETS_H
+
+#include <dirent.h>
+#include <sys/types.h>
+
+#include "path.h"
+
+/*
+ * List of the tasks for the bulk mode of the schedutils. The PIDs are
+ * collected before any change; sched_targets_next() returns them one by
+ * one, or all their threads.
+ */
+struct sched_targets {
+	pid_t		*pids;
+	size_t		npids;
+
+	size_t		idx;		/* sched_targets_next() position */
+	struct path_cxt	*pc;		/* the current process for threads */
+	DIR		*sub;
+
+	unsigned int	threads:1;	/* the PIDs are threads already */
+};
+
+extern void sched_targets_add_list(struct sched_targets *tg, const char *list);
+extern void sched_targets_add_cgroup(struct sched_targets *tg, const char *path,
+				     int threads);
+extern void sched_targets_add_pgrp(struct sched_targets *tg, pid_t pgrp);
+extern void sched_targets_add_uid(struct sched_targets *tg, uid_t uid);
+
+extern int sched_targets_next(struct sched_targets *tg, int all_tasks, pid_t *tid);
+extern void sched_targets_free(struct sched_targets *tg);
+
+#endif /* UTIL_LINUX_SCHED_TARGETS_H */
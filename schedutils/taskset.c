@@ -28,12 +28,14 @@
 #include <string.h>
 
 #include "cpuset.h"
+#include "cputopo.h"
 #include "nls.h"
 #include "strutils.h"
 #include "xalloc.h"
 #include "procfs.h"
 #include "c.h"
 #include "closestream.h"
+#include "sched_targets.h"
 
 struct taskset {
 	pid_t		pid;		/* task PID */
@@ -41,15 +43,24 @@ struct taskset {
 	size_t		setsize;
 	char		*buf;		/* buffer for conversion from mask to string */
 	size_t		buflen;
+	size_t		ntasks;		/* number of tasks (bulk mode) */
+	size_t		nfailed;	/* number of failed tasks (bulk mode) */
+	cpu_set_t	**groups;	/* --spread groups of the new mask */
+	size_t		ngroups;
 	unsigned int	use_list:1,	/* use list rather than masks */
-			get_only:1;	/* print the mask, but not modify */
+			get_only:1,	/* print the mask, but not modify */
+			bulk:1;		/* more tasks, don't exit on error */
 };
 
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
 	fprintf(out,
-		_("Usage: %s [options] [mask | cpu-list] [pid|cmd [args...]]\n\n"),
+		_("Usage: %s [options] [mask | cpu-list] [pid|cmd [args...]]\n"),
+		program_invocation_short_name);
+	fprintf(out,
+		_(" %s [options] --cgroup <path> [mask | cpu-list]\n\n"),
 		program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -61,6 +72,9 @@ static void __attribute__((__noreturn__)) usage(void)
 		" -a, --all-tasks         operate on all the tasks (threads) for a given pid\n"
 		" -p, --pid               operate on existing given pid\n"
 		" -c, --cpu-list          display and specify cpus in list format\n"
+		"     --cgroup <path>     operate on all the processes of the cgroup\n"
+		"     --spread <level>    spread the tasks over the cores, caches, nodes\n"
+		"                           or sockets of the mask\n"
 		));
 	printf(USAGE_HELP_OPTIONS(25));
 
@@ -74,6 +88,9 @@ static void __attribute__((__noreturn__)) usage(void)
 		"    %1$s -p 03 700\n"
 		"List format uses a comma-separated list instead of a mask:\n"
 		"    %1$s -pc 0,3,7-11 700\n"
+		"More PIDs may be separated by commas or read from standard input:\n"
+		"    %1$s -ap 03 700,701,702\n"
+		"    pgrep nginx | %1$s -apc 0-3 -\n"
 		"Ranges in list format can take a stride argument:\n"
 		"    e.g. 0-31:2 is equivalent to mask 0x55555555\n"),
 		program_invocation_short_name);
@@ -102,22 +119,38 @@ static void print_affinity(struct taskset *ts, int isnew)
 	printf(msg, ts->pid ? ts->pid : getpid(), str);
 }
 
-static void __attribute__((__noreturn__)) err_affinity(pid_t pid, int set)
+/* exits, or in the bulk mode only reports the error */
+static void err_affinity(struct taskset *ts, int set)
 {
+	pid_t pid = ts->pid ? ts->pid : getpid();
 	char *msg;
 
 	msg = set ? _("failed to set pid %d's affinity") :
 		    _("failed to get pid %d's affinity");
 
-	err(EXIT_FAILURE, msg, pid ? pid : getpid());
+	if (!ts->bulk)
+		err(EXIT_FAILURE, msg, pid);
+
+	/* the task has exited in the meantime */
+	if (errno == ESRCH)
+		return;
+	warn(msg, pid);
+	ts->nfailed++;
 }
 
 static void do_taskset(struct taskset *ts, size_t setsize, cpu_set_t *set)
 {
+	/* every task gets the next group of the CPUs */
+	if (ts->ngroups)
+		set = ts->groups[ts->ntasks % ts->ngroups];
+	ts->ntasks++;
+
 	/* read the current mask */
 	if (ts->pid) {
-		if (sched_getaffinity(ts->pid, ts->setsize, ts->set) < 0)
-			err_affinity(ts->pid, 0);
+		if (sched_getaffinity(ts->pid, ts->setsize, ts->set) < 0) {
+			err_affinity(ts, 0);
+			return;
+		}
 		print_affinity(ts, FALSE);
 	}
 
@@ -125,30 +158,56 @@ static void do_taskset(struct taskset *ts, size_t setsize, cpu_set_t *set)
 		return;
 
 	/* set new mask */
-	if (sched_setaffinity(ts->pid, setsize, set) < 0)
-		err_affinity(ts->pid, 1);
+	if (sched_setaffinity(ts->pid, setsize, set) < 0) {
+		err_affinity(ts, 1);
+		return;
+	}
 
 	/* re-read the current mask */
 	if (ts->pid) {
-		if (sched_getaffinity(ts->pid, ts->setsize, ts->set) < 0)
-			err_affinity(ts->pid, 0);
+		if (sched_getaffinity(ts->pid, ts->setsize, ts->set) < 0) {
+			err_affinity(ts, 0);
+			return;
+		}
 		print_affinity(ts, TRUE);
 	}
 }
 
+static void do_taskset_all(struct taskset *ts, pid_t pid,
+			   size_t setsize, cpu_set_t *set)
+{
+	DIR *sub = NULL;
+	struct path_cxt *pc = ul_new_procfs_path(pid, NULL);
+
+	while (pc && procfs_process_next_tid(pc, &sub, &ts->pid) == 0)
+		do_taskset(ts, setsize, set);
+
+	ul_unref_path(pc);
+}
+
 int main(int argc, char **argv)
 {
 	cpu_set_t *new_set;
 	pid_t pid = 0;
-	int c, all_tasks = 0;
+	int c, all_tasks = 0, nargs;
 	int ncpus;
 	size_t new_setsize, nbits;
 	struct taskset ts;
-
+	struct sched_targets tg = { .npids = 0 };
+	char *pidlist = NULL;
+	const char *cgroup = NULL;
+	int spread = -1;
+
+	enum {
+		OPT_CGROUP = CHAR_MAX + 1,
+		OPT_SPREAD
+	};
 	static const struct option longopts[] = {
 		{ "all-tasks",	0, NULL, 'a' },
 		{ "pid",	0, NULL, 'p' },
 		{ "cpu-list",	0, NULL, 'c' },
+		{ "cgroup",	1, NULL, OPT_CGROUP },
+		{ "spread",	1, NULL, OPT_SPREAD },
 		{ "help",	0, NULL, 'h' },
 		{ "version",	0, NULL, 'V' },
 		{ NULL,		0, NULL,  0  }
@@ -167,12 +226,25 @@ int main(int argc, char **argv)
 			all_tasks = 1;
 			break;
 		case 'p':
-			pid = strtos32_or_err(argv[argc - 1],
-					    _("invalid PID argument"));
+			/* "-" or comma-separated list for more PIDs */
+			if (strcmp(argv[argc - 1], "-") == 0
+			    || strchr(argv[argc - 1], ','))
+				pidlist = argv[argc - 1];
+			else
+				pid = strtos32_or_err(argv[argc - 1],
+						_("invalid PID argument"));
 			break;
 		case 'c':
 			ts.use_list = 1;
 			break;
+		case OPT_CGROUP:
+			cgroup = optarg;
+			break;
+		case OPT_SPREAD:
+			spread = cputopo_name_to_level(optarg);
+			if (spread < 0)
+				errx(EXIT_FAILURE, _("unsupported --spread level: %s"), optarg);
+			break;
 
 		case 'V':
 			print_version(EXIT_SUCCESS);
@@ -183,11 +255,21 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if ((!pid && argc - optind < 2)
-	    || (pid && (argc - optind < 1 || argc - optind > 2))) {
+	nargs = argc - optind;
+	if (cgroup) {
+		if (pid || pidlist) {
+			warnx(_("--cgroup and --pid are mutually exclusive"));
+			errtryhelp(EXIT_FAILURE);
+		}
+		nargs++;	/* no PID argument */
+	}
+	if ((!pid && !pidlist && !cgroup && nargs < 2)
+	    || ((pid || pidlist || cgroup) && (nargs < 1 || nargs > 2))) {
 		warnx(_("bad usage"));
 		errtryhelp(EXIT_FAILURE);
 	}
+	if (pidlist || cgroup)
+		ts.bulk = 1;
 
 	ncpus = get_max_number_of_cpus();
 	if (ncpus <= 0)
@@ -215,10 +297,12 @@ int main(int argc, char **argv)
 	if (!new_set)
 		err(EXIT_FAILURE, _("cpuset_alloc failed"));
 
-	if (argc - optind == 1)
+	if (nargs == 1) {
+		if (spread >= 0)
+			errx(EXIT_FAILURE, _("--spread requires a new mask"));
 		ts.get_only = 1;
 
-	else if (ts.use_list) {
+	} else if (ts.use_list) {
 		if (cpulist_parse(argv[optind], new_set, new_setsize, 0))
 			errx(EXIT_FAILURE, _("failed to parse CPU list: %s"),
 			     argv[optind]);
@@ -227,14 +311,27 @@ int main(int argc, char **argv)
 		     argv[optind]);
 	}
 
-	if (all_tasks && pid) {
-		DIR *sub = NULL;
-		struct path_cxt *pc = ul_new_procfs_path(pid, NULL);
+	if (spread >= 0) {
+		ssize_t n = cputopo_split(NULL, spread, new_set, ncpus, &ts.groups);
+
+		if (n < 0)
+			errx(EXIT_FAILURE, _("failed to read CPU topology"));
+		ts.ngroups = n;
+	}
+
+	if (ts.bulk) {
+		/* all the PIDs are read before any change */
+		if (cgroup)
+			sched_targets_add_cgroup(&tg, cgroup, all_tasks);
+		else
+			sched_targets_add_list(&tg, pidlist);
 
-		while (pc && procfs_process_next_tid(pc, &sub, &ts.pid) == 0)
+		while (sched_targets_next(&tg, all_tasks, &ts.pid) == 0)
 			do_taskset(&ts, new_setsize, new_set);
+		sched_targets_free(&tg);
 
-		ul_unref_path(pc);
+	} else if (all_tasks && pid) {
+		do_taskset_all(&ts, pid, new_setsize, new_set);
 	} else {
 		ts.pid = pid;
 		do_taskset(&ts, new_setsize, new_set);
@@ -243,8 +340,15 @@ int main(int argc, char **argv)
 	free(ts.buf);
 	cpuset_free(ts.set);
 	cpuset_free(new_set);
+	cputopo_free_groups(ts.groups, ts.ngroups);
+
+	if (ts.nfailed) {
+		warnx(P_("failed for %zu of %zu task", "failed for %zu of %zu tasks",
+			 ts.ntasks), ts.nfailed, ts.ntasks);
+		return EXIT_FAILURE;
+	}
 
-	if (!pid) {
+	if (!pid && !ts.bulk) {
 		argv += optind + 1;
 		execvp(argv[0], argv);
 		errexec(argv[0]);
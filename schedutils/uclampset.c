@@ -29,7 +29,9 @@
 #include "pathnames.h"
 #include "procfs.h"
 #include "sched_attr.h"
+#include "sched_targets.h"
 #include "strutils.h"
+#include "xalloc.h"
 
 #define NOT_SET		-2U
 
@@ -38,7 +40,13 @@ struct uclampset {
 	unsigned int util_max;
 
 	pid_t pid;
+	struct sched_targets targets;		/* bulk mode tasks */
+	size_t ntasks;
+	size_t nfailed;
+
 	unsigned int	all_tasks:1,		/* all threads of the PID */
+			bulk:1,			/* more tasks, don't exit on error */
+			dry_run:1,		/* --dry-run */
 			system:1,
 			util_min_set:1,		/* indicates -m option was passed */
 			util_max_set:1,		/* indicates -M option was passed */
@@ -54,7 +62,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_HEADER, out);
 	fprintf(out,
 		_(" %1$s [options]\n"
-		  " %1$s [options] --pid <pid> | --system | <command> <arg>...\n"),
+		  " %1$s [options] --pid <pid> | --system | <command> <arg>...\n"
+		  " %1$s [options] --pid <pid>,<pid>... | --pgrp|--uid|--cgroup <id>\n"),
 		program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -64,7 +73,12 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -m <value>           util_min value to set\n"), out);
 	fputs(_(" -M <value>           util_max value to set\n"), out);
 	fputs(_(" -a, --all-tasks      operate on all the tasks (threads) for a given pid\n"), out);
-	fputs(_(" -p, --pid <pid>      operate on existing given pid\n"), out);
+	fputs(_(" -p, --pid <pid>      operate on existing given pid, a comma-separated\n"
+		"                        list or \"-\" to read the PIDs from stdin\n"), out);
+	fputs(_("     --pgrp <pgid>    operate on the processes of the process group\n"), out);
+	fputs(_("     --uid <uid>      operate on the processes of the user\n"), out);
+	fputs(_("     --cgroup <path>  operate on the processes of the cgroup\n"), out);
+	fputs(_("     --dry-run        show the tasks to change, but don't change them\n"), out);
 	fputs(_(" -s, --system         operate on system\n"), out);
 	fputs(_(" -R, --reset-on-fork  set reset-on-fork flag\n"), out);
 	fputs(_(" -v, --verbose        display status information\n"), out);
@@ -79,7 +93,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	exit(EXIT_SUCCESS);
 }
 
-static void show_uclamp_pid_info(pid_t pid, char *cmd)
+static void show_uclamp_pid_info(struct uclampset *ctl, pid_t pid, char *cmd)
 {
 	struct sched_attr sa;
 	char *comm;
@@ -88,8 +102,11 @@ static void show_uclamp_pid_info(pid_t pid, char *cmd)
 	if (!pid)
 		pid = getpid();
 
-	if (sched_getattr(pid, &sa, sizeof(sa), 0) != 0)
+	if (sched_getattr(pid, &sa, sizeof(sa), 0) != 0) {
+		if (ctl->bulk && errno == ESRCH)
+			return;		/* exited in the meantime */
 		err(EXIT_FAILURE, _("failed to get pid %d's uclamp values"), pid);
+	}
 
 	if (cmd)
 		comm = cmd;
@@ -133,6 +150,11 @@ static void show_uclamp_info(struct uclampset *ctl)
 {
 	if (ctl->system) {
 		show_uclamp_system_info();
+	} else if (ctl->bulk) {
+		pid_t tid;
+
+		while (sched_targets_next(&ctl->targets, ctl->all_tasks, &tid) == 0)
+			show_uclamp_pid_info(ctl, tid, NULL);
 	} else if (ctl->all_tasks) {
 		DIR *sub = NULL;
 		pid_t tid;
@@ -142,11 +164,11 @@ static void show_uclamp_info(struct uclampset *ctl)
 			err(EXIT_FAILURE, _("cannot obtain the list of tasks"));
 
 		while (procfs_process_next_tid(pc, &sub, &tid) == 0)
-			show_uclamp_pid_info(tid, NULL);
+			show_uclamp_pid_info(ctl, tid, NULL);
 
 		ul_unref_path(pc);
 	} else {
-		show_uclamp_pid_info(ctl->pid, ctl->cmd);
+		show_uclamp_pid_info(ctl, ctl->pid, ctl->cmd);
 	}
 }
 
@@ -154,8 +176,11 @@ static int set_uclamp_one(struct uclampset *ctl, pid_t pid)
 {
 	struct sched_attr sa;
 
-	if (sched_getattr(pid, &sa, sizeof(sa), 0) != 0)
+	if (sched_getattr(pid, &sa, sizeof(sa), 0) != 0) {
+		if (ctl->bulk)
+			return -1;
 		err(EXIT_FAILURE, _("failed to get pid %d's uclamp values"), pid);
+	}
 
 	if (ctl->util_min_set)
 		sa.sched_util_min = ctl->util_min;
@@ -173,9 +198,32 @@ static int set_uclamp_one(struct uclampset *ctl, pid_t pid)
 	return sched_setattr(pid, &sa, 0);
 }
 
+/* all the tasks are tried, the errors are reported by main() */
+static void set_uclamp_bulk(struct uclampset *ctl)
+{
+	pid_t tid;
+
+	while (sched_targets_next(&ctl->targets, ctl->all_tasks, &tid) == 0) {
+		ctl->ntasks++;
+		if (ctl->dry_run) {
+			show_uclamp_pid_info(ctl, tid, NULL);
+			continue;
+		}
+		if (set_uclamp_one(ctl, tid) == -1) {
+			if (errno != ESRCH) {
+				warn(_("failed to set pid %d's uclamp values"), tid);
+				ctl->nfailed++;
+			}
+		} else if (ctl->verbose)
+			show_uclamp_pid_info(ctl, tid, NULL);
+	}
+}
+
 static void set_uclamp_pid(struct uclampset *ctl)
 {
-	if (ctl->all_tasks) {
+	if (ctl->bulk) {
+		set_uclamp_bulk(ctl);
+	} else if (ctl->all_tasks) {
 		DIR *sub = NULL;
 		pid_t tid;
 		struct path_cxt *pc = ul_new_procfs_path(ctl->pid, NULL);
@@ -228,8 +276,18 @@ int main(int argc, char **argv)
 		.cmd = NULL
 	};
 	struct uclampset *ctl = &_ctl;
+	const char *pidlist = NULL, *cgroup = NULL;
+	pid_t pgrp = -1;
+	uid_t uid = (uid_t) -1;
 	int c;
 
+	enum {
+		OPT_PGRP = CHAR_MAX + 1,
+		OPT_UID,
+		OPT_CGROUP,
+		OPT_DRY_RUN
+	};
+
 	static const struct option longopts[] = {
 		{ "all-tasks",		no_argument, NULL, 'a' },
 		{ "pid",		required_argument, NULL, 'p' },
@@ -238,6 +296,10 @@ int main(int argc, char **argv)
 		{ "help",		no_argument, NULL, 'h' },
 		{ "verbose",		no_argument, NULL, 'v' },
 		{ "version",		no_argument, NULL, 'V' },
+		{ "pgrp",		required_argument, NULL, OPT_PGRP },
+		{ "uid",		required_argument, NULL, OPT_UID },
+		{ "cgroup",		required_argument, NULL, OPT_CGROUP },
+		{ "dry-run",		no_argument, NULL, OPT_DRY_RUN },
 		{ NULL,			no_argument, NULL, 0 }
 	};
 
@@ -253,6 +315,11 @@ int main(int argc, char **argv)
 			ctl->all_tasks = 1;
 			break;
 		case 'p':
+			/* "-" or comma-separated list for more PIDs */
+			if (strcmp(optarg, "-") == 0 || strchr(optarg, ',')) {
+				pidlist = optarg;
+				break;
+			}
 			errno = 0;
 			ctl->pid = strtos32_or_err(optarg, _("invalid PID argument"));
 			break;
@@ -275,6 +342,18 @@ int main(int argc, char **argv)
 			ctl->util_max_set = 1;
 			validate_util(ctl->util_max);
 			break;
+		case OPT_PGRP:
+			pgrp = strtos32_or_err(optarg, _("invalid PGID argument"));
+			break;
+		case OPT_UID:
+			uid = strtou32_or_err(optarg, _("invalid UID argument"));
+			break;
+		case OPT_CGROUP:
+			cgroup = optarg;
+			break;
+		case OPT_DRY_RUN:
+			ctl->dry_run = 1;
+			break;
 		case 'V':
 			print_version(EXIT_SUCCESS);
 			/* fallthrough */
@@ -290,25 +369,55 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	/* --dry-run is supported in the bulk mode only, one PID is a list too */
+	if (ctl->dry_run && ctl->pid > -1) {
+		char *str;
+
+		xasprintf(&str, "%d", ctl->pid);
+		sched_targets_add_list(&ctl->targets, str);
+		free(str);
+		ctl->pid = -1;
+		ctl->bulk = 1;
+	}
+
+	if (pidlist || pgrp != -1 || uid != (uid_t) -1 || cgroup) {
+		if (!!pidlist + (pgrp != -1) + (uid != (uid_t) -1) + !!cgroup > 1
+		    || ctl->pid > -1 || ctl->bulk || ctl->system)
+			errx(EXIT_FAILURE, _("can handle only one of pid list, pgrp, uid or cgroup at once"));
+		ctl->bulk = 1;
+
+		/* all the PIDs are read before any change */
+		if (pidlist)
+			sched_targets_add_list(&ctl->targets, pidlist);
+		else if (pgrp != -1)
+			sched_targets_add_pgrp(&ctl->targets, pgrp);
+		else if (uid != (uid_t) -1)
+			sched_targets_add_uid(&ctl->targets, uid);
+		else
+			sched_targets_add_cgroup(&ctl->targets, cgroup, ctl->all_tasks);
+	} else if (ctl->dry_run && !ctl->bulk)
+		errx(EXIT_FAILURE, _("--dry-run requires --pid, --pgrp, --uid or --cgroup"));
+
 	/* all_tasks implies --pid */
-	if (ctl->all_tasks && ctl->pid == -1) {
+	if (ctl->all_tasks && ctl->pid == -1 && !ctl->bulk) {
 		errno = EINVAL;
 		err(EXIT_FAILURE, _("missing -p option"));
 	}
 
 	if (!ctl->util_min_set && !ctl->util_max_set) {
 		/* -p or -s must be passed */
-		if (!ctl->system && ctl->pid == -1) {
+		if (!ctl->system && ctl->pid == -1 && !ctl->bulk) {
 			usage();
 			exit(EXIT_FAILURE);
 		}
 
 		show_uclamp_info(ctl);
+		sched_targets_free(&ctl->targets);
 		return EXIT_SUCCESS;
 	}
 
 	/* ensure there's a command to execute if no -s or -p */
-	if (!ctl->system && ctl->pid == -1) {
+	if (!ctl->system && ctl->pid == -1 && !ctl->bulk) {
 		if (argc <= optind) {
 			errno = EINVAL;
 			err(EXIT_FAILURE, _("no cmd to execute"));
@@ -326,6 +435,19 @@ int main(int argc, char **argv)
 	else
 		set_uclamp_pid(ctl);
 
+	if (ctl->bulk) {
+		sched_targets_free(&ctl->targets);
+		if (ctl->dry_run)
+			printf(P_("%zu task would be changed\n",
+				  "%zu tasks would be changed\n", ctl->ntasks), ctl->ntasks);
+		if (ctl->nfailed) {
+			warnx(P_("failed for %zu of %zu task", "failed for %zu of %zu tasks",
+				 ctl->ntasks), ctl->nfailed, ctl->ntasks);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 	if (ctl->verbose)
 		show_uclamp_info(ctl);
 
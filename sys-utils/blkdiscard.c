@@ -32,6 +32,8 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -46,7 +48,11 @@
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "xalloc.h"
 #include "monotonic.h"
+#include "jobs.h"
+#include "sysfs.h"
+#include "randutils.h"
 
 #ifndef BLKDISCARD
 # define BLKDISCARD	_IO(0x12,119)
@@ -66,7 +72,53 @@ enum {
 	ACT_SECURE
 };
 
-static void print_stats(int act, char *path, uint64_t stats[])
+/* the smallest stripe used by --jobs when --step is not specified */
+#define BLKDISCARD_MIN_STRIPE	(64ULL * 1024 * 1024)
+
+/*
+ * --jobs: the range is split to stripes aligned to the discard granularity,
+ * the stripes are processed by the threads in parallel.
+ */
+struct discard_jobs {
+	int fd;
+	int act;
+	uint64_t start, end;	/* the whole range */
+	uint64_t stripe;	/* stripe size */
+	uint64_t first;		/* index of the first stripe */
+	uint64_t nstripes;
+	uint64_t next;		/* next stripe, relative to @first */
+	uint64_t done;		/* discarded bytes */
+	int errsv;		/* errno of the first failed ioctl */
+};
+
+/* the size of the reads used by --verify */
+#define BLKDISCARD_VERIFY_BUFSIZ	(1024 * 1024)
+
+/*
+ * --verify: the range is read back by O_DIRECT reads of
+ * BLKDISCARD_VERIFY_BUFSIZ bytes. If only a sample is requested, the range
+ * is split to @nsamples strata of the same size and one random block is
+ * read from each of them.
+ */
+struct verify_jobs {
+	int fd;
+	uint64_t start, end;	/* the whole range */
+	size_t bufsz;
+	size_t align;		/* buffer alignment */
+	uint64_t nblocks;	/* blocks of @bufsz in the range */
+	uint64_t nsamples;	/* blocks to read */
+	uint64_t seed;
+	uint64_t next;		/* next sample */
+	uint64_t nread;		/* bytes read */
+	uint64_t nbad;		/* blocks with non-zero data */
+	uint64_t badoff;	/* the first non-zero byte */
+	int errsv;		/* errno of the first failed read */
+	pthread_mutex_t lock;	/* protects @badoff */
+};
+
+/* @elapsed is used to print the aggregate throughput */
+static void print_stats(int act, char *path, uint64_t stats[],
+			const struct timeval *elapsed)
 {
 	switch (act) {
 	case ACT_ZEROOUT:
@@ -79,6 +131,236 @@ static void print_stats(int act, char *path, uint64_t stats[])
 			path, stats[1], stats[0]);
 		break;
 	}
+
+	if (elapsed) {
+		double secs = elapsed->tv_sec + (double) elapsed->tv_usec / 1000000;
+
+		if (secs > 0)
+			printf(_("%s: %.3f seconds, %.2f GB/s\n"), path, secs,
+				(double) stats[1] / secs / 1000000000);
+	}
+}
+
+static int discard_range(int fd, int act, uint64_t range[2])
+{
+	int rc = -1;
+
+	switch (act) {
+	case ACT_ZEROOUT:
+		rc = ioctl(fd, BLKZEROOUT, range);
+		break;
+	case ACT_SECURE:
+		rc = ioctl(fd, BLKSECDISCARD, range);
+		break;
+	case ACT_DISCARD:
+		rc = ioctl(fd, BLKDISCARD, range);
+		break;
+	}
+	return rc;
+}
+
+static void __attribute__((__noreturn__)) discard_failed(int act, char *path)
+{
+	switch (act) {
+	case ACT_ZEROOUT:
+		err(EXIT_FAILURE, _("%s: BLKZEROOUT ioctl failed"), path);
+	case ACT_SECURE:
+		err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
+	case ACT_DISCARD:
+	default:
+		err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
+	}
+}
+
+/* returns queue/discard_granularity of the device or 0 */
+static uint64_t get_discard_granularity(dev_t devno)
+{
+	struct path_cxt *pc, *disk_pc = NULL;
+	uint64_t dg = 0;
+	dev_t disk = 0;
+
+	pc = ul_new_sysfs_path(devno, NULL, NULL);
+	if (!pc)
+		return 0;
+
+	/* the queue attributes are provided for whole-disks only */
+	if (sysfs_blkdev_get_wholedisk(pc, NULL, 0, &disk) == 0
+	    && disk && disk != devno) {
+		disk_pc = ul_new_sysfs_path(disk, NULL, NULL);
+		if (disk_pc)
+			sysfs_blkdev_set_parent(pc, disk_pc);
+	}
+
+	if (ul_path_read_u64(pc, &dg, "queue/discard_granularity") != 0)
+		dg = 0;
+
+	ul_unref_path(pc);
+	ul_unref_path(disk_pc);
+	return dg;
+}
+
+/* splitmix64, good enough to pick the samples */
+static uint64_t sample_hash(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static uint64_t verify_sample_block(struct verify_jobs *jb, uint64_t k)
+{
+	uint64_t lo, hi;
+
+	if (jb->nsamples == jb->nblocks)
+		return k;
+
+	lo = (long double) k * jb->nblocks / jb->nsamples;
+	hi = (long double) (k + 1) * jb->nblocks / jb->nsamples;
+	if (hi <= lo)
+		return lo;
+	return lo + sample_hash(jb->seed ^ k) % (hi - lo);
+}
+
+static void *verify_worker(void *data)
+{
+	struct verify_jobs *jb = data;
+	unsigned char *buf;
+	uint64_t k;
+
+	if (posix_memalign((void **) &buf, jb->align, jb->bufsz) != 0) {
+		int zero = 0;
+
+		__atomic_compare_exchange_n(&jb->errsv, &zero, ENOMEM,
+				0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	while (!__atomic_load_n(&jb->errsv, __ATOMIC_RELAXED)
+	       && (k = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->nsamples) {
+		uint64_t off = jb->start + verify_sample_block(jb, k) * jb->bufsz;
+		size_t sz = min((uint64_t) jb->bufsz, jb->end - off), done = 0, bad;
+
+		while (done < sz) {
+			ssize_t rc = pread(jb->fd, buf + done, sz - done, off + done);
+
+			if (rc <= 0) {
+				int zero = 0;
+
+				__atomic_compare_exchange_n(&jb->errsv, &zero,
+						rc < 0 && errno ? errno : EIO,
+						0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+				goto done;
+			}
+			done += rc;
+		}
+		__atomic_fetch_add(&jb->nread, sz, __ATOMIC_RELAXED);
+
+		bad = ul_nonzero_offset(buf, sz);
+		if (bad < sz) {
+			pthread_mutex_lock(&jb->lock);
+			if (!jb->nbad++ || off + bad < jb->badoff)
+				jb->badoff = off + bad;
+			pthread_mutex_unlock(&jb->lock);
+		}
+	}
+done:
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Reads back the range [@start, @end) or its @ratio by @jobs threads.
+ * Returns 0 if all read data are zeroes, 1 if not, or exits on error.
+ */
+static int verify_zeroes(char *path, int secsize, uint64_t start, uint64_t end,
+			 double ratio, size_t jobs)
+{
+	struct verify_jobs jb = {
+		.start = start,
+		.end = end,
+		.bufsz = BLKDISCARD_VERIFY_BUFSIZ,
+		.lock = PTHREAD_MUTEX_INITIALIZER
+	};
+	struct timeval begin, now, elapsed;
+	long pagesz = sysconf(_SC_PAGESIZE);
+	double secs;
+
+	jb.fd = open(path, O_RDONLY | O_DIRECT);
+	if (jb.fd < 0 && errno == EINVAL)
+		jb.fd = open(path, O_RDONLY);	/* O_DIRECT unsupported */
+	if (jb.fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), path);
+
+	jb.align = max((size_t) secsize, pagesz > 0 ? (size_t) pagesz : 4096);
+	jb.bufsz = ((jb.bufsz + jb.align - 1) / jb.align) * jb.align;
+	jb.nblocks = (end - start + jb.bufsz - 1) / jb.bufsz;
+	jb.nsamples = (uint64_t) ((long double) jb.nblocks * ratio);
+	if (jb.nsamples == 0 && jb.nblocks)
+		jb.nsamples = 1;
+	if (jb.nsamples > jb.nblocks)
+		jb.nsamples = jb.nblocks;
+	ul_random_get_bytes(&jb.seed, sizeof(jb.seed));
+
+	gettime_monotonic(&begin);
+
+	ul_run_jobs(min((uint64_t) jobs, jb.nsamples), verify_worker, &jb, 0);
+	close(jb.fd);
+
+	if (jb.errsv) {
+		errno = jb.errsv;
+		err(EXIT_FAILURE, _("%s: verification read failed"), path);
+	}
+
+	gettime_monotonic(&now);
+	timersub(&now, &begin, &elapsed);
+	secs = elapsed.tv_sec + (double) elapsed.tv_usec / 1000000;
+
+	printf(_("%s: Verified %" PRIu64 " bytes (%.1f%% of the range), %.3f seconds, %.2f GB/s\n"),
+		path, jb.nread,
+		end > start ? (double) jb.nread * 100 / (end - start) : 100.0,
+		secs, secs > 0 ? (double) jb.nread / secs / 1000000000 : 0.0);
+
+	if (jb.nbad) {
+		warnx(_("%s: non-zero data in %" PRIu64 " of %" PRIu64 " blocks read, "
+			"the first at the offset %" PRIu64),
+			path, jb.nbad, jb.nsamples, jb.badoff);
+		return 1;
+	}
+	return 0;
+}
+
+static void *discard_worker(void *data)
+{
+	struct discard_jobs *jb = data;
+	uint64_t i;
+
+	while (!__atomic_load_n(&jb->errsv, __ATOMIC_RELAXED)
+	       && (i = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->nstripes) {
+		uint64_t range[2];
+
+		range[0] = max((jb->first + i) * jb->stripe, jb->start);
+		range[1] = min((jb->first + i + 1) * jb->stripe, jb->end) - range[0];
+
+		if (discard_range(jb->fd, jb->act, range) != 0) {
+			int zero = 0;
+
+			__atomic_compare_exchange_n(&jb->errsv, &zero, errno ? errno : EIO,
+					0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			break;
+		}
+		__atomic_fetch_add(&jb->done, range[1], __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/* returns 0 on success, or -1 and errno of the first failed ioctl */
+static int discard_parallel(struct discard_jobs *jb, size_t jobs)
+{
+	ul_run_jobs(min((uint64_t) jobs, jb->nstripes), discard_worker, jb, 0);
+
+	errno = jb->errsv;
+	return jb->errsv ? -1 : 0;
 }
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -93,11 +375,14 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -f, --force         disable all checking\n"), out);
+	fputs(_(" -j, --jobs <num>    discard <num> stripes of the range in parallel\n"), out);
 	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"), out);
 	fputs(_(" -l, --length <num>  length of bytes to discard from the offset\n"), out);
 	fputs(_(" -p, --step <num>    size of the discard iterations within the offset\n"), out);
 	fputs(_(" -s, --secure        perform secure discard\n"), out);
 	fputs(_(" -z, --zeroout       zero-fill rather than discard\n"), out);
+	fputs(_("     --verify[=<ratio>]\n"
+		"                     read back (a sample of) the zero-filled range\n"), out);
 	fputs(_(" -v, --verbose       print aligned length and offset\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -152,21 +437,28 @@ int main(int argc, char **argv)
 {
 	char *path;
 	int c, fd, verbose = 0, secsize, force = 0;
-	uint64_t end, blksize, step, range[2], stats[2];
+	uint64_t start, end, blksize, step, range[2], stats[2];
+	size_t jobs = 0;
+	double verify = 0;
 	struct stat sb;
 	struct timeval now = { 0 }, last = { 0 };
 	int act = ACT_DISCARD;
 
+	enum {
+		OPT_VERIFY = CHAR_MAX + 1
+	};
 	static const struct option longopts[] = {
 	    { "help",      no_argument,       NULL, 'h' },
 	    { "version",   no_argument,       NULL, 'V' },
 	    { "offset",    required_argument, NULL, 'o' },
 	    { "force",     no_argument,       NULL, 'f' },
+	    { "jobs",      required_argument, NULL, 'j' },
 	    { "length",    required_argument, NULL, 'l' },
 	    { "step",      required_argument, NULL, 'p' },
 	    { "secure",    no_argument,       NULL, 's' },
 	    { "verbose",   no_argument,       NULL, 'v' },
 	    { "zeroout",   no_argument,       NULL, 'z' },
+	    { "verify",    optional_argument, NULL, OPT_VERIFY },
 	    { NULL, 0, NULL, 0 }
 	};
 
@@ -179,11 +471,14 @@ int main(int argc, char **argv)
 	range[1] = ULLONG_MAX;
 	step = 0;
 
-	while ((c = getopt_long(argc, argv, "hfVsvo:l:p:z", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hfj:Vsvo:l:p:z", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'f':
 			force = 1;
 			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case 'l':
 			range[1] = strtosize_or_err(optarg,
 					_("failed to parse length"));
@@ -205,6 +500,14 @@ int main(int argc, char **argv)
 		case 'z':
 			act = ACT_ZEROOUT;
 			break;
+		case OPT_VERIFY:
+			verify = 1;
+			if (optarg) {
+				verify = strtod_or_err(optarg, _("invalid verify ratio"));
+				if (verify <= 0 || verify > 1)
+					errx(EXIT_FAILURE, _("verify ratio must be greater than 0 and at most 1"));
+			}
+			break;
 
 		case 'h':
 			usage();
@@ -215,6 +518,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (verify > 0 && act != ACT_ZEROOUT)
+		errx(EXIT_FAILURE, _("--verify can be used with --zeroout only"));
+
 	if (optind == argc)
 		errx(EXIT_FAILURE, _("no device specified"));
 
@@ -283,27 +589,58 @@ int main(int argc, char **argv)
 	}
 #endif /* HAVE_LIBBLKID */
 
+	start = range[0];
 	stats[0] = range[0], stats[1] = 0;
 	gettime_monotonic(&last);
 
+	if (jobs > 1) {
+		struct discard_jobs jb = {
+			.fd = fd,
+			.act = act,
+			.start = range[0],
+			.end = end
+		};
+		uint64_t align = secsize;
+
+		if (act != ACT_ZEROOUT) {
+			uint64_t dg = get_discard_granularity(sb.st_rdev);
+
+			if (dg > align && dg % secsize == 0)
+				align = dg;
+		}
+
+		/* stripes are aligned to the granularity, the first and the
+		 * last one may be shorter */
+		jb.stripe = step;
+		if (!jb.stripe)
+			jb.stripe = max((end - range[0]) / (jobs * 4), (uint64_t) BLKDISCARD_MIN_STRIPE);
+		jb.stripe = ((jb.stripe + align - 1) / align) * align;
+
+		if (end > range[0]) {
+			jb.first = range[0] / jb.stripe;
+			jb.nstripes = (end - 1) / jb.stripe - jb.first + 1;
+		}
+
+		if (discard_parallel(&jb, jobs) != 0)
+			discard_failed(act, path);
+
+		if (verbose && jb.done) {
+			struct timeval elapsed;
+
+			gettime_monotonic(&now);
+			timersub(&now, &last, &elapsed);
+			stats[1] = jb.done;
+			print_stats(act, path, stats, &elapsed);
+		}
+		goto done;
+	}
+
 	for (/* nothing */; range[0] < end; range[0] += range[1]) {
 		if (range[0] + range[1] > end)
 			range[1] = end - range[0];
 
-		switch (act) {
-		case ACT_ZEROOUT:
-			if (ioctl(fd, BLKZEROOUT, &range))
-				 err(EXIT_FAILURE, _("%s: BLKZEROOUT ioctl failed"), path);
-			break;
-		case ACT_SECURE:
-			if (ioctl(fd, BLKSECDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
-			break;
-		case ACT_DISCARD:
-			if (ioctl(fd, BLKDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
-			break;
-		}
+		if (discard_range(fd, act, range) != 0)
+			discard_failed(act, path);
 
 		stats[1] += range[1];
 
@@ -312,7 +649,7 @@ int main(int argc, char **argv)
 			gettime_monotonic(&now);
 			if (now.tv_sec > last.tv_sec &&
 			    (now.tv_usec >= last.tv_usec || now.tv_sec > last.tv_sec + 1)) {
-				print_stats(act, path, stats);
+				print_stats(act, path, stats, NULL);
 				stats[0] += stats[1], stats[1] = 0;
 				last = now;
 			}
@@ -320,8 +657,11 @@ int main(int argc, char **argv)
 	}
 
 	if (verbose && stats[1])
-		print_stats(act, path, stats);
-
+		print_stats(act, path, stats, NULL);
+done:
 	close(fd);
+
+	if (verify > 0 && verify_zeroes(path, secsize, start, end, verify, jobs) != 0)
+		return EXIT_FAILURE;
 	return EXIT_SUCCESS;
 }
@@ -29,6 +29,7 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <errno.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -44,6 +45,7 @@
 #include "blkdev.h"
 #include "sysfs.h"
 #include "optutils.h"
+#include "jobs.h"
 
 /*
  * These ioctls are defined in linux/blkzoned.h starting with kernel 5.5.
@@ -81,6 +83,7 @@ struct blkzone_control {
 	uint64_t offset;
 	uint64_t length;
 	uint32_t count;
+	uint32_t jobs;
 
 	unsigned int force : 1;
 	unsigned int verbose : 1;
@@ -95,6 +98,10 @@ static const struct blkzone_command commands[] = {
 		.name = "capacity",
 		.handler = blkzone_report,
 		.help = N_("Report sum of zone capacities for the given device")
+	},{
+		.name = "summary",
+		.handler = blkzone_report,
+		.help = N_("Report number of zones per type and condition")
 	},{
 		.name = "reset",
 		.handler = blkzone_action,
@@ -206,6 +213,7 @@ done:
  * blkzone report
  */
 #define DEF_REPORT_LEN		(1U << 12) /* 4k zones per report (256k kzalloc) */
+#define MAX_REPORT_LEN		(1U << 16) /* 64k zones per report (4M) */
 
 static const char *type_text[] = {
 	"RESERVED",
@@ -226,13 +234,74 @@ static const char *condition_str[] = {
 	"of"  /* Offline */
 };
 
+/* blkzone summary */
+struct zone_summary {
+	uint64_t nzones;
+	uint64_t types[ARRAY_SIZE(type_text)];
+	uint64_t conds[ARRAY_SIZE(condition_str)];
+	uint64_t seq_capacity;		/* capacity of the write pointer zones */
+	uint64_t seq_written;		/* data below the write pointers */
+};
+
+static void summary_add_zone(struct zone_summary *sum, const struct blk_zone *entry,
+			     uint64_t cap)
+{
+	unsigned int cond = entry->cond & (ARRAY_SIZE(condition_str) - 1);
+
+	sum->nzones++;
+	if (entry->type < ARRAY_SIZE(type_text))
+		sum->types[entry->type]++;
+	sum->conds[cond]++;
+
+	switch (entry->cond) {
+	case BLK_ZONE_COND_EMPTY:
+	case BLK_ZONE_COND_IMP_OPEN:
+	case BLK_ZONE_COND_EXP_OPEN:
+	case BLK_ZONE_COND_CLOSED:
+		sum->seq_capacity += cap;
+		sum->seq_written += min((uint64_t) (entry->wp - entry->start), cap);
+		break;
+	case BLK_ZONE_COND_FULL:
+		sum->seq_capacity += cap;
+		sum->seq_written += cap;
+		break;
+	default:
+		/* conventional, read-only and offline zones have no usable
+		 * write pointer */
+		break;
+	}
+}
+
+static void summary_print(struct zone_summary *sum)
+{
+	size_t i;
+
+	printf(_("zones: %"PRIu64"\n"), sum->nzones);
+	for (i = 0; i < ARRAY_SIZE(type_text); i++) {
+		if (sum->types[i])
+			printf(_("  type %u(%s): %"PRIu64"\n"),
+				(unsigned int) i, type_text[i], sum->types[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(condition_str); i++) {
+		if (sum->conds[i])
+			printf(_("  zcond %2u(%s): %"PRIu64"\n"),
+				(unsigned int) i, condition_str[i], sum->conds[i]);
+	}
+	printf(_("written: 0x%09"PRIx64" of 0x%09"PRIx64" sectors (%.1f%%)\n"),
+		sum->seq_written, sum->seq_capacity,
+		sum->seq_capacity ?
+			(double) sum->seq_written * 100 / sum->seq_capacity : 0.0);
+}
+
 static int blkzone_report(struct blkzone_control *ctl)
 {
 	bool only_capacity_sum = !strcmp(ctl->command->name, "capacity");
+	bool only_summary = !strcmp(ctl->command->name, "summary");
+	struct zone_summary summary = { .nzones = 0 };
 	uint64_t capacity_sum = 0;
 	struct blk_zone_report *zi;
 	unsigned long zonesize;
-	uint32_t i, nr_zones;
+	uint32_t i, nr_zones, report_len = DEF_REPORT_LEN;
 	int fd;
 
 	fd = init_device(ctl, O_RDONLY);
@@ -253,11 +322,12 @@ static int blkzone_report(struct blkzone_control *ctl)
 		nr_zones = 1 + (ctl->total_sectors - ctl->offset) / zonesize;
 
 	zi = xmalloc(sizeof(struct blk_zone_report) +
-		     (DEF_REPORT_LEN * sizeof(struct blk_zone)));
+		     (report_len * sizeof(struct blk_zone)));
 
 	while (nr_zones && ctl->offset < ctl->total_sectors) {
+		uint32_t asked;
 
-		zi->nr_zones = min(nr_zones, DEF_REPORT_LEN);
+		zi->nr_zones = asked = min(nr_zones, report_len);
 		zi->sector = ctl->offset;
 
 		if (ioctl(fd, BLKREPORTZONE, zi) == -1)
@@ -298,6 +368,8 @@ static int blkzone_report(struct blkzone_control *ctl)
 
 			if (only_capacity_sum) {
 				capacity_sum += cap;
+			} else if (only_summary) {
+				summary_add_zone(&summary, entry, cap);
 			} else if (has_zone_capacity(zi)) {
 				printf(_("  start: 0x%09"PRIx64", len 0x%06"PRIx64
 					", cap 0x%06"PRIx64", wptr 0x%06"PRIx64
@@ -320,10 +392,23 @@ static int blkzone_report(struct blkzone_control *ctl)
 			ctl->offset = start + len;
 		}
 
+		/*
+		 * The report has been filled up and more zones are
+		 * requested, use a larger buffer to reduce the number of
+		 * the ioctls on devices with many zones.
+		 */
+		if (zi->nr_zones == asked && asked == report_len
+		    && nr_zones > report_len && report_len < MAX_REPORT_LEN) {
+			report_len = min(report_len * 4, MAX_REPORT_LEN);
+			zi = xrealloc(zi, sizeof(struct blk_zone_report) +
+				      (report_len * sizeof(struct blk_zone)));
+		}
 	}
 
 	if (only_capacity_sum)
 		printf(_("0x%09"PRIx64"\n"), capacity_sum);
+	else if (only_summary)
+		summary_print(&summary);
 
 	free(zi);
 	close(fd);
@@ -331,6 +416,64 @@ static int blkzone_report(struct blkzone_control *ctl)
 	return 0;
 }
 
+/*
+ * blkzone reset, open, close, and finish with --jobs: the range is split to
+ * groups of whole zones and the groups are processed in parallel.
+ */
+struct zone_jobs {
+	int fd;
+	unsigned long ioctl_cmd;
+	uint64_t start, end;		/* the whole range */
+	uint64_t group;			/* sectors per group */
+	uint64_t ngroups;
+	uint64_t next;			/* next group */
+	int errsv;			/* errno of the first failed ioctl */
+};
+
+static void *zone_worker(void *data)
+{
+	struct zone_jobs *jb = data;
+	uint64_t i;
+
+	while (!__atomic_load_n(&jb->errsv, __ATOMIC_RELAXED)
+	       && (i = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->ngroups) {
+		struct blk_zone_range za;
+
+		za.sector = jb->start + i * jb->group;
+		za.nr_sectors = min(jb->group, jb->end - (uint64_t) za.sector);
+
+		if (ioctl(jb->fd, jb->ioctl_cmd, &za) == -1) {
+			int zero = 0;
+
+			__atomic_compare_exchange_n(&jb->errsv, &zero, errno ? errno : EIO,
+					0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int zone_action_parallel(struct blkzone_control *ctl, int fd,
+				struct blk_zone_range *za, unsigned long zonesize)
+{
+	struct zone_jobs jb = {
+		.fd = fd,
+		.ioctl_cmd = ctl->command->ioctl_cmd,
+		.start = za->sector,
+		.end = za->sector + za->nr_sectors
+	};
+	uint64_t nzones = (za->nr_sectors + zonesize - 1) / zonesize;
+
+	/* a few groups per job to balance the zones of different state */
+	jb.group = max((uint64_t) 1, nzones / ((uint64_t) ctl->jobs * 4)) * zonesize;
+	jb.ngroups = (za->nr_sectors + jb.group - 1) / jb.group;
+
+	ul_run_jobs(min((uint64_t) ctl->jobs, jb.ngroups), zone_worker, &jb, 0);
+
+	errno = jb.errsv;
+	return jb.errsv ? -1 : 0;
+}
+
 /*
  * blkzone reset, open, close, and finish.
  */
@@ -374,7 +517,9 @@ static int blkzone_action(struct blkzone_control *ctl)
 	za.sector = ctl->offset;
 	za.nr_sectors = zlen;
 
-	if (ioctl(fd, ctl->command->ioctl_cmd, &za) == -1)
+	if ((ctl->jobs > 1 && zlen > zonesize ?
+			zone_action_parallel(ctl, fd, &za, zonesize) :
+			ioctl(fd, ctl->command->ioctl_cmd, &za)) == -1)
 		err(EXIT_FAILURE, _("%s: %s ioctl failed"),
 		    ctl->devname, ctl->command->ioctl_name);
 	else if (ctl->verbose)
@@ -407,6 +552,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -l, --length <sectors> maximum sectors to act (in 512-byte sectors)\n"), out);
 	fputs(_(" -c, --count <number>   maximum number of zones\n"), out);
 	fputs(_(" -f, --force            enforce on block devices used by the system\n"), out);
+	fputs(_(" -j, --jobs <number>    act on zones by <number> threads in parallel\n"), out);
 	fputs(_(" -v, --verbose          display more details\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(24));
@@ -431,6 +577,7 @@ int main(int argc, char **argv)
 	    { "length",  required_argument, NULL, 'l' }, /* max of sectors to operate on */
 	    { "offset",  required_argument, NULL, 'o' }, /* starting LBA */
 	    { "force",   no_argument,       NULL, 'f' },
+	    { "jobs",    required_argument, NULL, 'j' },
 	    { "verbose", no_argument,       NULL, 'v' },
 	    { "version", no_argument,       NULL, 'V' },
 	    { NULL, 0, NULL, 0 }
@@ -455,7 +602,7 @@ int main(int argc, char **argv)
 		argc--;
 	}
 
-	while ((c = getopt_long(argc, argv, "hc:l:o:fvV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hc:j:l:o:fvV", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -475,6 +622,10 @@ int main(int argc, char **argv)
 		case 'f':
 			ctl.force = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg,
+					_("invalid number of jobs"));
+			break;
 		case 'v':
 			ctl.verbose = 1;
 			break;
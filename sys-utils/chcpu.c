@@ -42,6 +42,7 @@
 #include "path.h"
 #include "closestream.h"
 #include "optutils.h"
+#include "monotonic.h"
 
 #define EXCL_ERROR "--{configure,deconfigure,disable,dispatch,enable}"
 
@@ -52,6 +53,7 @@
 
 static cpu_set_t *onlinecpus;
 static int maxcpus;
+static int show_timing;		/* --timing */
 
 #define is_cpu_online(cpu) (CPU_ISSET_S((cpu), CPU_ALLOC_SIZE(maxcpus), onlinecpus))
 #define num_online_cpus()  (CPU_COUNT_S(CPU_ALLOC_SIZE(maxcpus), onlinecpus))
@@ -64,8 +66,22 @@ enum {
 	CMD_CPU_RESCAN,
 	CMD_CPU_DISPATCH_HORIZONTAL,
 	CMD_CPU_DISPATCH_VERTICAL,
+	CMD_CPU_SMT,
 };
 
+/* values of the smt/control file which may be written */
+static const char *smt_modes[] = { "on", "off", "forceoff" };
+
+/* milliseconds since @start */
+static double elapsed_ms(const struct timeval *start)
+{
+	struct timeval now, delta;
+
+	gettime_monotonic(&now);
+	timersub(&now, start, &delta);
+	return delta.tv_sec * 1000.0 + delta.tv_usec / 1000.0;
+}
+
 /* returns:   0 = success
  *          < 0 = failure
  *          > 0 = partial success
@@ -76,6 +92,7 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 	int online, rc;
 	int configured = -1;
 	int fails = 0;
+	struct timeval start;
 
 	for (cpu = 0; cpu < maxcpus; cpu++) {
 		if (!CPU_ISSET_S(cpu, setsize, cpu_set))
@@ -102,6 +119,7 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 		}
 		if (ul_path_accessf(sys, F_OK, "cpu%d/configure", cpu) == 0)
 			ul_path_readf_s32(sys, &configured, "cpu%d/configure", cpu);
+		gettime_monotonic(&start);
 		if (enable) {
 			rc = ul_path_writef_string(sys, "1", "cpu%d/online", cpu);
 			if (rc != 0 && configured == 0) {
@@ -110,7 +128,9 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 			} else if (rc != 0) {
 				warn(_("CPU %u enable failed"), cpu);
 				fails++;
-			} else
+			} else if (show_timing)
+				printf(_("CPU %u enabled in %.3f ms\n"), cpu, elapsed_ms(&start));
+			else
 				printf(_("CPU %u enabled\n"), cpu);
 		} else {
 			if (onlinecpus && num_online_cpus() == 1) {
@@ -123,7 +143,10 @@ static int cpu_enable(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsize,
 				warn(_("CPU %u disable failed"), cpu);
 				fails++;
 			} else {
-				printf(_("CPU %u disabled\n"), cpu);
+				if (show_timing)
+					printf(_("CPU %u disabled in %.3f ms\n"), cpu, elapsed_ms(&start));
+				else
+					printf(_("CPU %u disabled\n"), cpu);
 				if (onlinecpus)
 					CPU_CLR_S(cpu, setsize, onlinecpus);
 			}
@@ -164,6 +187,35 @@ static int cpu_set_dispatch(struct path_cxt *sys, int mode)
 	return 0;
 }
 
+/*
+ * All the SMT siblings are switched by the kernel at once, that's much faster
+ * than to disable or enable them one by one.
+ */
+static int cpu_set_smt(struct path_cxt *sys, const char *mode)
+{
+	struct timeval start;
+	char cur[32];
+
+	if (ul_path_read_buffer(sys, cur, sizeof(cur), "smt/control") <= 0)
+		errx(EXIT_FAILURE, _("This system does not support SMT control"));
+	if (strcmp(cur, mode) == 0) {
+		printf(_("SMT is already %s\n"), mode);
+		return 0;
+	}
+	if (strcmp(cur, "notsupported") == 0 || strcmp(cur, "notimplemented") == 0)
+		errx(EXIT_FAILURE, _("This system does not support SMT control"));
+
+	gettime_monotonic(&start);
+	if (ul_path_write_string(sys, mode, "smt/control") != 0)
+		err(EXIT_FAILURE, _("Failed to set SMT to %s"), mode);
+
+	if (show_timing)
+		printf(_("SMT set to %s in %.3f ms\n"), mode, elapsed_ms(&start));
+	else
+		printf(_("SMT set to %s\n"), mode);
+	return 0;
+}
+
 /* returns:   0 = success
  *          < 0 = failure
  *          > 0 = partial success
@@ -173,6 +225,7 @@ static int cpu_configure(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsiz
 	int cpu;
 	int rc, current;
 	int fails = 0;
+	struct timeval start;
 
 	for (cpu = 0; cpu < maxcpus; cpu++) {
 		if (!CPU_ISSET_S(cpu, setsize, cpu_set))
@@ -202,19 +255,24 @@ static int cpu_configure(struct path_cxt *sys, cpu_set_t *cpu_set, size_t setsiz
 			fails++;
 			continue;
 		}
+		gettime_monotonic(&start);
 		if (configure) {
 			rc = ul_path_writef_string(sys, "1", "cpu%d/configure", cpu);
 			if (rc != 0) {
 				warn(_("CPU %u configure failed"), cpu);
 				fails++;
-			} else
+			} else if (show_timing)
+				printf(_("CPU %u configured in %.3f ms\n"), cpu, elapsed_ms(&start));
+			else
 				printf(_("CPU %u configured\n"), cpu);
 		} else {
 			rc = ul_path_writef_string(sys, "0", "cpu%d/configure", cpu);
 			if (rc != 0) {
 				warn(_("CPU %u deconfigure failed"), cpu);
 				fails++;
-			} else
+			} else if (show_timing)
+				printf(_("CPU %u deconfigured in %.3f ms\n"), cpu, elapsed_ms(&start));
+			else
 				printf(_("CPU %u deconfigured\n"), cpu);
 		}
 	}
@@ -252,6 +310,8 @@ static void __attribute__((__noreturn__)) usage(void)
 		" -g, --deconfigure <cpu-list>  deconfigure cpus\n"
 		" -p, --dispatch <mode>         set dispatching mode\n"
 		" -r, --rescan                  trigger rescan of cpus\n"
+		"     --smt <mode>              set SMT of all cores (on, off or forceoff)\n"
+		"     --timing                  print time of each change\n"
 		), stdout);
 	printf(USAGE_HELP_OPTIONS(31));
 
@@ -264,9 +324,16 @@ int main(int argc, char *argv[])
 	struct path_cxt *sys = NULL;	/* _PATH_SYS_CPU handler */
 	cpu_set_t *cpu_set = NULL;
 	size_t setsize;
+	struct timeval start;
+	const char *smt = NULL;
 	int cmd = -1;
 	int c, rc;
 
+	enum {
+		OPT_SMT = CHAR_MAX + 1,
+		OPT_TIMING
+	};
+
 	static const struct option longopts[] = {
 		{ "configure",	required_argument, NULL, 'c' },
 		{ "deconfigure",required_argument, NULL, 'g' },
@@ -275,12 +342,14 @@ int main(int argc, char *argv[])
 		{ "enable",	required_argument, NULL, 'e' },
 		{ "help",	no_argument,       NULL, 'h' },
 		{ "rescan",	no_argument,       NULL, 'r' },
+		{ "smt",	required_argument, NULL, OPT_SMT },
+		{ "timing",	no_argument,       NULL, OPT_TIMING },
 		{ "version",	no_argument,       NULL, 'V' },
 		{ NULL,		0, NULL, 0 }
 	};
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
-		{ 'c','d','e','g','p' },
+		{ 'c','d','e','g','p', OPT_SMT },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -341,6 +410,23 @@ int main(int argc, char *argv[])
 		case 'r':
 			cmd = CMD_CPU_RESCAN;
 			break;
+		case OPT_SMT:
+		{
+			size_t i;
+
+			for (i = 0; i < ARRAY_SIZE(smt_modes); i++) {
+				if (strcmp(optarg, smt_modes[i]) == 0)
+					break;
+			}
+			if (i == ARRAY_SIZE(smt_modes))
+				errx(EXIT_FAILURE, _("unsupported argument: %s"), optarg);
+			smt = smt_modes[i];
+			cmd = CMD_CPU_SMT;
+			break;
+		}
+		case OPT_TIMING:
+			show_timing = 1;
+			break;
 
 		case 'h':
 			usage();
@@ -356,6 +442,8 @@ int main(int argc, char *argv[])
 		errtryhelp(EXIT_FAILURE);
 	}
 
+	gettime_monotonic(&start);
+
 	switch (cmd) {
 	case CMD_CPU_ENABLE:
 		rc = cpu_enable(sys, cpu_set, maxcpus, 1);
@@ -378,11 +466,17 @@ int main(int argc, char *argv[])
 	case CMD_CPU_DISPATCH_VERTICAL:
 		rc = cpu_set_dispatch(sys, 1);
 		break;
+	case CMD_CPU_SMT:
+		rc = cpu_set_smt(sys, smt);
+		break;
 	default:
 		rc = -EINVAL;
 		break;
 	}
 
+	if (show_timing && cmd >= CMD_CPU_ENABLE && cmd <= CMD_CPU_DECONFIGURE)
+		printf(_("Total time: %.3f ms\n"), elapsed_ms(&start));
+
 	CPU_FREE(cpu_set);
 	ul_unref_path(sys);
 
@@ -23,6 +23,7 @@
 #include <getopt.h>
 #include <assert.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include "c.h"
 #include "nls.h"
@@ -31,25 +32,62 @@
 #include "strv.h"
 #include "optutils.h"
 #include "closestream.h"
+#include "jobs.h"
+#include "monotonic.h"
 #include "xalloc.h"
 
 /* partial success, otherwise we return regular EXIT_{SUCCESS,FAILURE} */
 #define CHMEM_EXIT_SOMEOK		64
 
 #define _PATH_SYS_MEMORY		"/sys/devices/system/memory"
+#define _PATH_SYS_NODE			"/sys/devices/system/node"
+
+enum zone_id {
+	ZONE_DMA = 0,
+	ZONE_DMA32,
+	ZONE_NORMAL,
+	ZONE_HIGHMEM,
+	ZONE_MOVABLE,
+	ZONE_DEVICE,
+	ZONE_NR
+};
+
+/* changed blocks per zone, for --verbose */
+struct chmem_zone_stat {
+	uint64_t	nblocks;
+	struct timeval	done;		/* when the last block was changed */
+};
 
 struct chmem_desc {
 	struct path_cxt	*sysmem;	/* _PATH_SYS_MEMORY handler */
 	struct dirent	**dirs;
+	uint64_t	*indexes;	/* block numbers of the dirs */
 	int		ndirs;
 	uint64_t	block_size;
 	uint64_t	start;
 	uint64_t	end;
 	uint64_t	size;
+	int		zone_id;
+	size_t		jobs;		/* --jobs */
+
+	/* the blocks to change (indexes to dirs), grouped by NUMA node */
+	size_t		*blocks;
+	size_t		*groups;	/* first block of the group, ngroups + 1 items */
+	size_t		ngroups;
+	size_t		nextgroup;	/* next group for a worker */
+
+	pthread_mutex_t	lock;		/* the counters below and the output */
+	pthread_cond_t	cond;
+	uint64_t	todo;		/* blocks not changed yet */
+	uint64_t	inflight;	/* size mode: blocks being changed */
+	struct timeval	start_time;
+	struct chmem_zone_stat zones[ZONE_NR + 1];	/* + unknown zone */
+
 	unsigned int	use_blocks : 1;
 	unsigned int	is_size	   : 1;
 	unsigned int	verbose	   : 1;
 	unsigned int	have_zones : 1;
+	unsigned int	enable	   : 1;
 };
 
 enum {
@@ -58,13 +96,9 @@ enum {
 	CMD_NONE
 };
 
-enum zone_id {
-	ZONE_DMA = 0,
-	ZONE_DMA32,
-	ZONE_NORMAL,
-	ZONE_HIGHMEM,
-	ZONE_MOVABLE,
-	ZONE_DEVICE,
+/* values of the auto_online_blocks file */
+static const char *auto_online_policies[] = {
+	"offline", "online", "online_kernel", "online_movable"
 };
 
 static char *zone_names[] = {
@@ -101,168 +135,371 @@ static void idxtostr(struct chmem_desc *desc, uint64_t idx, char *buf, size_t bu
 		 idx, start, end);
 }
 
-static int chmem_size(struct chmem_desc *desc, int enable, int zone_id)
+static int filter(const struct dirent *de)
+{
+	if (strncmp("memory", de->d_name, 6) != 0)
+		return 0;
+	return isdigit_string(de->d_name + 6);
+}
+
+/* result of chmem_block() */
+enum {
+	BLOCK_CHANGED = 0,
+	BLOCK_ALREADY,		/* already in the requested state */
+	BLOCK_MISMATCH,		/* the requested zone is not valid for the block */
+	BLOCK_FAILED		/* errno is set */
+};
+
+/* the first of the valid zones is the current one (or the default) */
+static int first_zone_id(char *zones)
 {
-	char *name, *onoff, line[BUFSIZ], str[BUFSIZ];
-	uint64_t size, index;
-	const char *zn;
-	int i, rc;
+	zones[strcspn(zones, " \n")] = '\0';
+	return zone_name_to_id(zones);
+}
 
-	size = desc->size;
-	onoff = enable ? "online" : "offline";
-	i = enable ? 0 : desc->ndirs - 1;
+static int chmem_block(struct chmem_desc *desc, struct path_cxt *sysmem,
+		       const char *name, int *zone)
+{
+	char line[BUFSIZ];
+	const char *onoff = desc->enable ? "online" : "offline";
+	int zone_id = desc->zone_id;
 
-	if (enable && zone_id >= 0) {
+	if (desc->enable && zone_id >= 0) {
 		if (zone_id == ZONE_MOVABLE)
 			onoff = "online_movable";
 		else
 			onoff = "online_kernel";
 	}
+	*zone = -1;
+
+	if (ul_path_readf_buffer(sysmem, line, sizeof(line), "%s/state", name) > 0
+	    && strncmp(onoff, line, 6) == 0)
+		return BLOCK_ALREADY;
+
+	if (desc->have_zones) {
+		ul_path_readf_buffer(sysmem, line, sizeof(line), "%s/valid_zones", name);
+		if (zone_id >= 0) {
+			const char *zn = zone_names[zone_id];
+
+			if (desc->enable && !strcasestr(line, zn))
+				return BLOCK_MISMATCH;
+			if (!desc->enable && strncasecmp(line, zn, strlen(zn)) != 0)
+				return BLOCK_MISMATCH;
+			*zone = zone_id;
+		} else if (desc->enable && strcasestr(line, zone_names[ZONE_MOVABLE])) {
+			/* By default, use zone Movable for online, if valid */
+			onoff = "online_movable";
+			*zone = ZONE_MOVABLE;
+		} else
+			*zone = first_zone_id(line);
+	}
 
-	for (; i >= 0 && i < desc->ndirs && size; i += enable ? 1 : -1) {
-		name = desc->dirs[i]->d_name;
-		index = strtou64_or_err(name + 6, _("Failed to parse index"));
-
-		if (ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/state", name) > 0
-		    && strncmp(onoff, line, 6) == 0)
-			continue;
-
-		if (desc->have_zones) {
-			ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/valid_zones", name);
-			if (zone_id >= 0) {
-				zn = zone_names[zone_id];
-				if (enable && !strcasestr(line, zn))
-					continue;
-				if (!enable && strncasecmp(line, zn, strlen(zn)) != 0)
-					continue;
-			} else if (enable) {
-				/* By default, use zone Movable for online, if valid */
-				if (strcasestr(line, zone_names[ZONE_MOVABLE]))
-					onoff = "online_movable";
-				else
-					onoff = "online";
-			}
-		}
+	if (ul_path_writef_string(sysmem, onoff, "%s/state", name) != 0)
+		return BLOCK_FAILED;
+	return BLOCK_CHANGED;
+}
 
-		idxtostr(desc, index, str, sizeof(str));
-		rc = ul_path_writef_string(desc->sysmem, onoff, "%s/state", name);
-		if (rc != 0 && desc->verbose) {
+/* called with desc->lock held */
+static void report_block(struct chmem_desc *desc, uint64_t index, int rc)
+{
+	char str[BUFSIZ];
+	int enable = desc->enable;
+
+	idxtostr(desc, index, str, sizeof(str));
+
+	switch (rc) {
+	case BLOCK_CHANGED:
+		if (desc->verbose && enable)
+			fprintf(stdout, _("%s enabled\n"), str);
+		else if (desc->verbose)
+			fprintf(stdout, _("%s disabled\n"), str);
+		break;
+	case BLOCK_ALREADY:
+		/* the size mode looks for the blocks to change */
+		if (desc->is_size)
+			break;
+		if (desc->verbose && enable)
+			fprintf(stdout, _("%s already enabled\n"), str);
+		else if (desc->verbose)
+			fprintf(stdout, _("%s already disabled\n"), str);
+		break;
+	case BLOCK_MISMATCH:
+		if (desc->is_size)
+			break;
+		if (enable)
+			warnx(_("%s enable failed: Zone mismatch"), str);
+		else
+			warnx(_("%s disable failed: Zone mismatch"), str);
+		break;
+	case BLOCK_FAILED:
+		if (!desc->is_size) {
 			if (enable)
-				fprintf(stdout, _("%s enable failed\n"), str);
+				warn(_("%s enable failed"), str);
 			else
-				fprintf(stdout, _("%s disable failed\n"), str);
-		} else if (rc == 0 && desc->verbose) {
+				warn(_("%s disable failed"), str);
+		} else if (desc->verbose) {
 			if (enable)
-				fprintf(stdout, _("%s enabled\n"), str);
+				fprintf(stdout, _("%s enable failed\n"), str);
 			else
-				fprintf(stdout, _("%s disabled\n"), str);
+				fprintf(stdout, _("%s disable failed\n"), str);
 		}
-		if (rc == 0)
-			size--;
+		break;
 	}
-	if (size) {
-		uint64_t bytes;
-		char *sizestr;
+}
 
-		bytes = (desc->size - size) * desc->block_size;
-		sizestr = size_to_human_string(SIZE_SUFFIX_1LETTER, bytes);
-		if (enable)
-			warnx(_("Could only enable %s of memory"), sizestr);
-		else
-			warnx(_("Could only disable %s of memory"), sizestr);
-		free(sizestr);
+/*
+ * The size mode changes any desc->size blocks. A worker reserves a block
+ * before the change and returns it on failure; if the last blocks are
+ * reserved by the other workers, wait for the result.
+ */
+static int reserve_block(struct chmem_desc *desc)
+{
+	int rc;
+
+	pthread_mutex_lock(&desc->lock);
+	while (desc->todo == 0 && desc->inflight)
+		pthread_cond_wait(&desc->cond, &desc->lock);
+	rc = desc->todo > 0;
+	if (rc) {
+		desc->todo--;
+		desc->inflight++;
+	}
+	pthread_mutex_unlock(&desc->lock);
+	return rc;
+}
+
+/* called with desc->lock held */
+static void account_block(struct chmem_desc *desc, int rc, int zone)
+{
+	if (desc->is_size) {
+		desc->inflight--;
+		if (rc != BLOCK_CHANGED)
+			desc->todo++;
+		pthread_cond_broadcast(&desc->cond);
+	} else if (rc == BLOCK_CHANGED || rc == BLOCK_ALREADY)
+		desc->todo--;
+
+	if (rc == BLOCK_CHANGED) {
+		struct chmem_zone_stat *st = &desc->zones[zone < 0 ?
+						ZONE_NR : (size_t) zone];
+		st->nblocks++;
+		gettime_monotonic(&st->done);
 	}
-	return size == 0 ? 0 : size == desc->size ? -1 : 1;
 }
 
-static int chmem_range(struct chmem_desc *desc, int enable, int zone_id)
+static void *chmem_worker(void *data)
 {
-	char *name, *onoff, line[BUFSIZ], str[BUFSIZ];
-	uint64_t index, todo;
-	const char *zn;
-	int i, rc;
+	struct chmem_desc *desc = data;
+	struct path_cxt *sysmem;
+	size_t g, i;
 
-	todo = desc->end - desc->start + 1;
-	onoff = enable ? "online" : "offline";
+	/* the path buffer of the handler is not thread-safe */
+	sysmem = ul_new_path(_PATH_SYS_MEMORY);
+	if (!sysmem)
+		err(EXIT_FAILURE, _("failed to initialize %s handler"), _PATH_SYS_MEMORY);
 
-	if (enable && zone_id >= 0) {
-		if (zone_id == ZONE_MOVABLE)
-			onoff = "online_movable";
+	while ((g = __atomic_fetch_add(&desc->nextgroup, 1, __ATOMIC_RELAXED)) < desc->ngroups) {
+		for (i = desc->groups[g]; i < desc->groups[g + 1]; i++) {
+			size_t n = desc->blocks[i];
+			int rc, zone, errsv;
+
+			if (desc->is_size && !reserve_block(desc))
+				break;
+
+			rc = chmem_block(desc, sysmem, desc->dirs[n]->d_name, &zone);
+			errsv = errno;
+
+			pthread_mutex_lock(&desc->lock);
+			errno = errsv;
+			report_block(desc, desc->indexes[n], rc);
+			account_block(desc, rc, zone);
+			pthread_mutex_unlock(&desc->lock);
+		}
+	}
+
+	ul_unref_path(sysmem);
+	return NULL;
+}
+
+static ssize_t find_block(struct chmem_desc *desc, uint64_t index)
+{
+	size_t lo = 0, hi = desc->ndirs;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (desc->indexes[mid] == index)
+			return mid;
+		if (desc->indexes[mid] < index)
+			lo = mid + 1;
 		else
-			onoff = "online_kernel";
+			hi = mid;
 	}
+	return -1;
+}
 
-	for (i = 0; i < desc->ndirs; i++) {
-		name = desc->dirs[i]->d_name;
-		index = strtou64_or_err(name + 6, _("Failed to parse index"));
-		if (index < desc->start)
-			continue;
-		if (index > desc->end)
-			break;
-		idxtostr(desc, index, str, sizeof(str));
-		if (ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/state", name) > 0
-		    && strncmp(onoff, line, 6) == 0) {
-			if (desc->verbose && enable)
-				fprintf(stdout, _("%s already enabled\n"), str);
-			else if (desc->verbose && !enable)
-				fprintf(stdout, _("%s already disabled\n"), str);
-			todo--;
+/* the memory blocks are linked from the NUMA node directories */
+static void read_nodes(struct chmem_desc *desc, int *nodes)
+{
+	struct path_cxt *sysnode;
+	struct dirent *d;
+	DIR *dir = NULL;
+
+	sysnode = ul_new_path(_PATH_SYS_NODE);
+	if (!sysnode)
+		return;
+
+	while (ul_path_next_dirent(sysnode, &dir, NULL, &d) == 0) {
+		struct dirent *md;
+		DIR *mdir = NULL;
+		int node;
+
+		if (strncmp(d->d_name, "node", 4) != 0
+		    || !isdigit_string(d->d_name + 4))
 			continue;
-		}
+		node = atoi(d->d_name + 4);
 
-		if (desc->have_zones) {
-			ul_path_readf_buffer(desc->sysmem, line, sizeof(line), "%s/valid_zones", name);
-			if (zone_id >= 0) {
-				zn = zone_names[zone_id];
-				if (enable && !strcasestr(line, zn)) {
-					warnx(_("%s enable failed: Zone mismatch"), str);
-					continue;
-				}
-				if (!enable && strncasecmp(line, zn, strlen(zn)) != 0) {
-					warnx(_("%s disable failed: Zone mismatch"), str);
-					continue;
-				}
-			} else if (enable) {
-				/* By default, use zone Movable for online, if valid */
-				if (strcasestr(line, zone_names[ZONE_MOVABLE]))
-					onoff = "online_movable";
-				else
-					onoff = "online";
-			}
+		while (ul_path_next_dirent(sysnode, &mdir, d->d_name, &md) == 0) {
+			ssize_t n;
+
+			if (!filter(md))
+				continue;
+			n = find_block(desc, strtou64_or_err(md->d_name + 6,
+						_("Failed to parse index")));
+			if (n >= 0)
+				nodes[n] = node;
 		}
+	}
+	ul_unref_path(sysnode);
+}
 
-		rc = ul_path_writef_string(desc->sysmem, onoff, "%s/state", name);
-		if (rc != 0) {
-			if (enable)
-				warn(_("%s enable failed"), str);
-			else
-				warn(_("%s disable failed"), str);
-		} else if (desc->verbose) {
-			if (enable)
-				fprintf(stdout, _("%s enabled\n"), str);
-			else
-				fprintf(stdout, _("%s disabled\n"), str);
+/*
+ * Sorts the blocks to groups by NUMA node, the groups are changed in parallel
+ * with --jobs. Without --jobs all the blocks are one group.
+ */
+static void chmem_groups(struct chmem_desc *desc)
+{
+	int *nodes = xmalloc(desc->ndirs * sizeof(int));
+	int i, minnode = 0, maxnode = 0;
+	size_t nblocks = 0, g;
+
+	for (i = 0; i < desc->ndirs; i++)
+		nodes[i] = -1;
+	if (desc->jobs > 1)
+		read_nodes(desc, nodes);
+	for (i = 0; i < desc->ndirs; i++) {
+		minnode = min(minnode, nodes[i]);
+		maxnode = max(maxnode, nodes[i]);
+	}
+
+	desc->blocks = xcalloc(desc->ndirs ? desc->ndirs : 1, sizeof(size_t));
+	desc->groups = xcalloc(maxnode - minnode + 2, sizeof(size_t));
+
+	for (g = 0; g <= (size_t) (maxnode - minnode); g++) {
+		int node = minnode + g;
+
+		desc->groups[desc->ngroups++] = nblocks;
+
+		/* the size mode disables the highest blocks first */
+		for (i = 0; i < desc->ndirs; i++) {
+			int n = desc->is_size && !desc->enable ?
+						desc->ndirs - 1 - i : i;
+
+			if (nodes[n] != node)
+				continue;
+			if (!desc->is_size && (desc->indexes[n] < desc->start
+					       || desc->indexes[n] > desc->end))
+				continue;
+			desc->blocks[nblocks++] = n;
 		}
-		if (rc == 0)
-			todo--;
 	}
-	return todo == 0 ? 0 : todo == desc->end - desc->start + 1 ? -1 : 1;
+	desc->groups[desc->ngroups] = nblocks;
+	free(nodes);
 }
 
-static int filter(const struct dirent *de)
+static void print_times(struct chmem_desc *desc)
 {
-	if (strncmp("memory", de->d_name, 6) != 0)
-		return 0;
-	return isdigit_string(de->d_name + 6);
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(desc->zones); i++) {
+		struct chmem_zone_stat *st = &desc->zones[i];
+		struct timeval delta;
+		char *sizestr;
+		double secs;
+
+		if (!st->nblocks)
+			continue;
+
+		timersub(&st->done, &desc->start_time, &delta);
+		secs = delta.tv_sec + delta.tv_usec / 1E6;
+		sizestr = size_to_human_string(SIZE_SUFFIX_1LETTER,
+					       st->nblocks * desc->block_size);
+
+		if (i < ZONE_NR && desc->enable)
+			printf(_("Zone %s: %s enabled in %.3f seconds\n"),
+			       zone_names[i], sizestr, secs);
+		else if (i < ZONE_NR)
+			printf(_("Zone %s: %s disabled in %.3f seconds\n"),
+			       zone_names[i], sizestr, secs);
+		else if (desc->enable)
+			printf(_("%s enabled in %.3f seconds\n"), sizestr, secs);
+		else
+			printf(_("%s disabled in %.3f seconds\n"), sizestr, secs);
+		free(sizestr);
+	}
+}
+
+static int chmem_run(struct chmem_desc *desc)
+{
+	uint64_t total;
+
+	chmem_groups(desc);
+
+	total = desc->is_size ? desc->size : desc->end - desc->start + 1;
+	desc->todo = total;
+	pthread_mutex_init(&desc->lock, NULL);
+	pthread_cond_init(&desc->cond, NULL);
+	gettime_monotonic(&desc->start_time);
+
+	ul_run_jobs(min(desc->jobs, desc->ngroups), chmem_worker, desc, 0);
+
+	if (desc->verbose)
+		print_times(desc);
+
+	if (desc->is_size && desc->todo) {
+		uint64_t bytes;
+		char *sizestr;
+
+		bytes = (desc->size - desc->todo) * desc->block_size;
+		sizestr = size_to_human_string(SIZE_SUFFIX_1LETTER, bytes);
+		if (desc->enable)
+			warnx(_("Could only enable %s of memory"), sizestr);
+		else
+			warnx(_("Could only disable %s of memory"), sizestr);
+		free(sizestr);
+	}
+
+	pthread_cond_destroy(&desc->cond);
+	pthread_mutex_destroy(&desc->lock);
+	free(desc->blocks);
+	free(desc->groups);
+
+	return desc->todo == 0 ? 0 : desc->todo == total ? -1 : 1;
 }
 
 static void read_info(struct chmem_desc *desc)
 {
 	char line[128];
 
+	int i;
+
 	desc->ndirs = scandir(_PATH_SYS_MEMORY, &desc->dirs, filter, versionsort);
 	if (desc->ndirs <= 0)
 		goto fail;
+	desc->indexes = xmalloc(desc->ndirs * sizeof(uint64_t));
+	for (i = 0; i < desc->ndirs; i++)
+		desc->indexes[i] = strtou64_or_err(desc->dirs[i]->d_name + 6,
+					_("Failed to parse index"));
 	ul_path_read_buffer(desc->sysmem, line, sizeof(line), "block_size_bytes");
 
 	errno = 0;
@@ -338,6 +575,7 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputs(USAGE_HEADER, out);
 	fprintf(out, _(" %s [options] [SIZE|RANGE|BLOCKRANGE]\n"), program_invocation_short_name);
+	fprintf(out, _(" %s --auto-online <policy>\n"), program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_("Set a particular size or range of memory online or offline.\n"), out);
@@ -347,7 +585,11 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -d, --disable      disable memory\n"), out);
 	fputs(_(" -b, --blocks       use memory blocks\n"), out);
 	fputs(_(" -z, --zone <name>  select memory zone (see below)\n"), out);
-	fputs(_(" -v, --verbose      verbose output\n"), out);
+	fputs(_(" -j, --jobs <num>   change blocks of <num> NUMA nodes in parallel\n"), out);
+	fputs(_("     --auto-online <policy>\n"
+		"                    set the policy for newly added memory blocks\n"
+		"                      (offline, online, online_kernel or online_movable)\n"), out);
+	fputs(_(" -v, --verbose      verbose output and elapsed time per zone\n"), out);
 	printf(USAGE_HELP_OPTIONS(20));
 
 	fputs(_("\nSupported zones:\n"), out);
@@ -364,13 +606,20 @@ int main(int argc, char **argv)
 	struct chmem_desc _desc = { 0 }, *desc = &_desc;
 	int cmd = CMD_NONE, zone_id = -1;
 	char *zone = NULL;
+	const char *auto_online = NULL;
 	int c, rc;
 
+	enum {
+		OPT_AUTO_ONLINE = CHAR_MAX + 1
+	};
+
 	static const struct option longopts[] = {
+		{"auto-online",	required_argument,	NULL, OPT_AUTO_ONLINE},
 		{"block",	no_argument,		NULL, 'b'},
 		{"disable",	no_argument,		NULL, 'd'},
 		{"enable",	no_argument,		NULL, 'e'},
 		{"help",	no_argument,		NULL, 'h'},
+		{"jobs",	required_argument,	NULL, 'j'},
 		{"verbose",	no_argument,		NULL, 'v'},
 		{"version",	no_argument,		NULL, 'V'},
 		{"zone",	required_argument,	NULL, 'z'},
@@ -394,8 +643,9 @@ int main(int argc, char **argv)
 		err(EXIT_FAILURE, _("failed to initialize %s handler"), _PATH_SYS_MEMORY);
 
 	read_info(desc);
+	desc->jobs = 1;
 
-	while ((c = getopt_long(argc, argv, "bdehvVz:", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "bdehj:vVz:", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -409,12 +659,30 @@ int main(int argc, char **argv)
 		case 'b':
 			desc->use_blocks = 1;
 			break;
+		case 'j':
+			desc->jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!desc->jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'v':
 			desc->verbose = 1;
 			break;
 		case 'z':
 			zone = xstrdup(optarg);
 			break;
+		case OPT_AUTO_ONLINE:
+		{
+			size_t i;
+
+			for (i = 0; i < ARRAY_SIZE(auto_online_policies); i++) {
+				if (strcmp(optarg, auto_online_policies[i]) == 0)
+					break;
+			}
+			if (i == ARRAY_SIZE(auto_online_policies))
+				errx(EXIT_FAILURE, _("unsupported auto-online policy: %s"), optarg);
+			auto_online = auto_online_policies[i];
+			break;
+		}
 
 		case 'h':
 			usage();
@@ -425,6 +693,21 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/*
+	 * The kernel onlines the hotplugged memory itself with the policy,
+	 * that's much faster than to online the blocks one by one later.
+	 */
+	if (auto_online) {
+		if (ul_path_write_string(desc->sysmem, auto_online, "auto_online_blocks") != 0)
+			err(EXIT_FAILURE, _("failed to set auto-online policy"));
+		if (desc->verbose)
+			printf(_("Auto-online policy set to %s\n"), auto_online);
+		if (argc == optind && cmd == CMD_NONE) {
+			ul_unref_path(desc->sysmem);
+			return EXIT_SUCCESS;
+		}
+	}
+
 	if ((argc == 1) || (argc != optind + 1) || (cmd == CMD_NONE)) {
 		warnx(_("bad usage"));
 		errtryhelp(EXIT_FAILURE);
@@ -447,10 +730,9 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if (desc->is_size)
-		rc = chmem_size(desc, cmd == CMD_MEMORY_ENABLE ? 1 : 0, zone_id);
-	else
-		rc = chmem_range(desc, cmd == CMD_MEMORY_ENABLE ? 1 : 0, zone_id);
+	desc->enable = cmd == CMD_MEMORY_ENABLE ? 1 : 0;
+	desc->zone_id = zone_id;
+	rc = chmem_run(desc);
 
 	ul_unref_path(desc->sysmem);
 
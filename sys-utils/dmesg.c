@@ -20,6 +20,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
 
 #include "c.h"
 #include "colors.h"
@@ -36,6 +38,8 @@
 #include "mangle.h"
 #include "pager.h"
 #include "jsonwrt.h"
+#include "fileutils.h"
+#include "pathnames.h"
 
 /* Close the log.  Currently a NOP. */
 #define SYSLOG_ACTION_CLOSE          0
@@ -180,6 +184,11 @@ struct dmesg_control {
 	int		kmsg;		/* /dev/kmsg file descriptor */
 	ssize_t		kmsg_first_read;/* initial read() return code */
 	char		kmsg_buf[BUFSIZ];/* buffer to read kmsg data */
+	uint64_t	kmsg_next_seq;	/* expected sequence number or 0 */
+
+	const char	*cursor_file;	/* --cursor-file */
+	uint64_t	cursor_seq;	/* last already read sequence number */
+	char		boot_id[40];	/* boot_id of the running kernel */
 
 	time_t		since;		/* filter records by time */
 	time_t		until;		/* filter records by time */
@@ -194,7 +203,7 @@ struct dmesg_control {
 	size_t		pagesize;
 	unsigned int	time_fmt;	/* time format */
 
-	struct ul_jsonwrt jfmt;		/* -J formatting */
+	struct ul_jsonwrt jfmt;		/* -J and --output-format formatting */
 
 	unsigned int	follow:1,	/* wait for new messages */
 			end:1,		/* seek to the of buffer */
@@ -206,6 +215,8 @@ struct dmesg_control {
 			pager:1,	/* pipe output into a pager */
 			color:1,	/* colorize messages */
 			json:1,		/* JSON output */
+			json_stream:1,	/* object per record (ndjson, cbor) */
+			has_cursor:1,	/* cursor_seq is valid */
 			force_prefix:1;	/* force timestamp and decode prefix
 					   on each line */
 	int		indent;		/* due to timestamps if newline */
@@ -218,6 +229,7 @@ struct dmesg_record {
 	int		level;
 	int		facility;
 	struct timeval  tv;
+	uint64_t	seq;		/* kmsg sequence number */
 
 	const char	*next;		/* buffer with next unparsed record */
 	size_t		next_size;	/* size of the next buffer */
@@ -230,6 +242,7 @@ struct dmesg_record {
 		(_r)->level = -1; \
 		(_r)->tv.tv_sec = 0; \
 		(_r)->tv.tv_usec = 0; \
+		(_r)->seq = 0; \
 	} while (0)
 
 static int read_kmsg(struct dmesg_control *ctl);
@@ -287,6 +300,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -f, --facility <list>       restrict output to defined facilities\n"), out);
 	fputs(_(" -H, --human                 human readable output\n"), out);
 	fputs(_(" -J, --json                  use JSON output format\n"), out);
+	fputs(_("     --output-format <name>  output format (json, ndjson or cbor)\n"), out);
+	fputs(_("     --cursor-file <file>    read only records not read by the previous run\n"), out);
 	fputs(_(" -k, --kernel                display kernel messages\n"), out);
 	fprintf(out,
 	      _(" -L, --color[=<when>]        colorize messages (%s, %s or %s)\n"), "auto", "always", "never");
@@ -945,6 +960,7 @@ static void print_record(struct dmesg_control *ctl,
 	}
 
 	if (ctl->json) {
+		/* the streaming formats are initialized in main() */
 		if (!ul_jsonwrt_is_ready(&ctl->jfmt)) {
 			ul_jsonwrt_init(&ctl->jfmt, stdout, 0);
 			ul_jsonwrt_root_open(&ctl->jfmt);
@@ -1014,6 +1030,7 @@ static void print_record(struct dmesg_control *ctl,
 		break;
 	case DMESG_TIMEFTM_TIME:
 		ctl->indent = snprintf(tsbuf, sizeof(tsbuf),
+				      ctl->json_stream ? "%ld.%06ld" :
 				      ctl->json ? "%5ld.%06ld" : "[%5ld.%06ld] ",
 				      (long)rec->tv.tv_sec,
 				      (long)rec->tv.tv_usec);
@@ -1046,6 +1063,8 @@ full_output:
 		} else
 			ul_jsonwrt_value_u64(&ctl->jfmt, "pri", LOG_MAKEPRI(rec->facility, rec->level));
 	}
+	if (ctl->json_stream && ctl->method == DMESG_METHOD_KMSG)
+		ul_jsonwrt_value_u64(&ctl->jfmt, "seq", rec->seq);
 
 	/* Output the timestamp buffer */
 	if (*tsbuf) {
@@ -1132,6 +1151,71 @@ done:
 		putchar('\n');
 }
 
+/*
+ * Returns offset of the first record which starts at @off or later in the
+ * syslog buffer. The records start at the begin of the buffer or by "<"
+ * after a newline.
+ */
+static size_t next_syslog_record(const char *buf, size_t size, size_t off)
+{
+	const char *p, *end = buf + size;
+
+	if (off == 0)
+		return 0;
+
+	for (p = buf + off - 1; p < end; p++) {
+		p = memchr(p, '\n', end - p);
+		if (!p || p + 1 >= end)
+			break;
+		if (*(p + 1) == '<')
+			return p + 1 - buf;
+	}
+	return size;
+}
+
+/* parses only the "<faclev>[timestamp]" prefix of the record at @off */
+static int get_syslog_record_time(const char *buf, size_t size, size_t off,
+				  struct dmesg_record *rec)
+{
+	const char *p = buf + off, *end = buf + size;
+
+	INIT_DMESG_RECORD(rec);
+
+	if (p < end && *p == '<')
+		p = skip_item(p, end, ">");
+	if (p + 1 >= end || *p != '[')
+		return -1;
+
+	return parse_syslog_timestamp(p + 1, &rec->tv) == p + 1 ? -1 : 0;
+}
+
+/*
+ * Returns offset of the first record after --since. The buffer is sorted by
+ * time, so the record is found by binary search and only the timestamps of
+ * the probed records are parsed. The records without a timestamp are
+ * considered to be before --since (see accept_record()).
+ */
+static size_t find_syslog_since(struct dmesg_control *ctl,
+				const char *buf, size_t size)
+{
+	size_t lo = 0, hi = size;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		size_t off = next_syslog_record(buf, size, mid);
+		struct dmesg_record rec;
+
+		if (off < size
+		    && (get_syslog_record_time(buf, size, off, &rec) != 0
+			|| ctl->since >= record_time(ctl, &rec)))
+			lo = off + 1;		/* all in mid..off are before */
+		else
+			hi = mid;
+	}
+
+	return next_syslog_record(buf, size, lo);
+}
+
 /*
  * Prints the 'buf' kernel ring buffer; the messages are filtered out according
  * to 'levels' and 'facilities' bitarrays.
@@ -1140,14 +1224,34 @@ static void print_buffer(struct dmesg_control *ctl,
 			const char *buf, size_t size)
 {
 	struct dmesg_record rec = { .next = buf, .next_size = size };
+	int has_time = !is_timefmt(ctl, NONE);
 
 	if (ctl->raw) {
 		raw_print(ctl, buf, size);
 		return;
 	}
 
-	while (get_next_syslog_record(ctl, &rec) == 0)
+	if (ctl->since && has_time) {
+		size_t start = find_syslog_since(ctl, buf, size);
+
+		rec.next = buf + start;
+		rec.next_size = size - start;
+
+		/* unmap the skipped file data */
+		if (ctl->mmap_buff && start >= ctl->pagesize) {
+			size_t sz = start - start % ctl->pagesize;
+
+			munmap(ctl->mmap_buff, sz);
+			ctl->mmap_buff += sz;
+		}
+	}
+
+	while (get_next_syslog_record(ctl, &rec) == 0) {
+		/* all the next records are after --until too */
+		if (ctl->until && has_time && ctl->until <= record_time(ctl, &rec))
+			break;
 		print_record(ctl, &rec);
+	}
 }
 
 static ssize_t read_kmsg_one(struct dmesg_control *ctl)
@@ -1163,19 +1267,22 @@ static ssize_t read_kmsg_one(struct dmesg_control *ctl)
 	return size;
 }
 
+/* the output is flushed when all available records are printed */
+#define KMSG_OUTBUF_SIZE	(64 * 1024)
+
 static int init_kmsg(struct dmesg_control *ctl)
 {
-	int mode = O_RDONLY;
-
-	if (!ctl->follow)
-		mode |= O_NONBLOCK;
-	else
-		setlinebuf(stdout);
-
-	ctl->kmsg = open("/dev/kmsg", mode);
+	/* follow mode polls, so records are drained without blocking */
+	ctl->kmsg = open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
 	if (ctl->kmsg < 0)
 		return -1;
 
+	if (ctl->follow) {
+		static char outbuf[KMSG_OUTBUF_SIZE];
+
+		setvbuf(stdout, outbuf, _IOFBF, sizeof(outbuf));
+	}
+
 	/*
 	 * Seek after the last record available at the time
 	 * the last SYSLOG_ACTION_CLEAR was issued.
@@ -1192,6 +1299,8 @@ static int init_kmsg(struct dmesg_control *ctl)
 	 * read_kmsg().
 	 */
 	ctl->kmsg_first_read = read_kmsg_one(ctl);
+	if (ctl->kmsg_first_read < 0 && errno == EAGAIN && ctl->follow)
+		ctl->kmsg_first_read = 0;	/* no record yet, wait for it */
 	if (ctl->kmsg_first_read < 0) {
 		close(ctl->kmsg);
 		ctl->kmsg = -1;
@@ -1240,6 +1349,7 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 		goto mesg;
 
 	/* B) sequence number */
+	rec->seq = strtoull(p, NULL, 10);
 	p = skip_item(p, end, ",;");
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
@@ -1288,6 +1398,142 @@ mesg:
 	return 0;
 }
 
+/*
+ * The kernel returns EPIPE and skips to the oldest record if the records
+ * have been overwritten before we read them. The lost records are reported
+ * by the gap in the sequence numbers.
+ */
+static void check_kmsg_seq(struct dmesg_control *ctl, struct dmesg_record *rec)
+{
+	if (ctl->kmsg_next_seq && rec->seq > ctl->kmsg_next_seq) {
+		uint64_t n = rec->seq - ctl->kmsg_next_seq;
+
+		fflush(stdout);
+		warnx(P_("%ju message lost (kernel log buffer overrun)",
+			 "%ju messages lost (kernel log buffer overrun)", n),
+			(uintmax_t) n);
+	}
+	ctl->kmsg_next_seq = rec->seq + 1;
+}
+
+/*
+ * --cursor-file
+ *
+ * The file contains the boot ID and the sequence number of the last record
+ * read from /dev/kmsg. The sequence numbers start from zero on every boot,
+ * so the cursor from another boot is ignored.
+ *
+ * It's not possible to seek in /dev/kmsg by sequence number, the already
+ * read records are skipped without parsing and printing.
+ */
+static void read_boot_id(struct dmesg_control *ctl)
+{
+	FILE *f = fopen(_PATH_PROC_BOOT_ID, "r" UL_CLOEXECSTR);
+
+	if (!f || !fgets(ctl->boot_id, sizeof(ctl->boot_id), f))
+		*ctl->boot_id = '\0';
+	else
+		rtrim_whitespace((unsigned char *) ctl->boot_id);
+	if (f)
+		fclose(f);
+}
+
+static void load_kmsg_cursor(struct dmesg_control *ctl)
+{
+	char id[sizeof(ctl->boot_id)];
+	uintmax_t seq;
+	FILE *f;
+
+	read_boot_id(ctl);
+
+	f = fopen(ctl->cursor_file, "r" UL_CLOEXECSTR);
+	if (!f) {
+		if (errno != ENOENT)
+			err(EXIT_FAILURE, _("cannot open %s"), ctl->cursor_file);
+		return;
+	}
+	if (fscanf(f, "%39s %ju", id, &seq) != 2)
+		warnx(_("%s: unsupported cursor format, ignore"), ctl->cursor_file);
+	else if (*ctl->boot_id && strcmp(id, ctl->boot_id) == 0) {
+		ctl->cursor_seq = seq;
+		ctl->kmsg_next_seq = seq + 1;
+		ctl->has_cursor = 1;
+	}
+	fclose(f);
+}
+
+/* the file is replaced by rename(), a collector never reads partial cursor */
+static void save_kmsg_cursor(struct dmesg_control *ctl)
+{
+	char *tmp = NULL;
+	FILE *f;
+	int fd;
+
+	if (!ctl->cursor_file || !ctl->kmsg_next_seq || !*ctl->boot_id)
+		return;
+	if (ctl->has_cursor && ctl->cursor_seq == ctl->kmsg_next_seq - 1)
+		return;			/* nothing new */
+
+	xasprintf(&tmp, "%s.XXXXXX", ctl->cursor_file);
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0) {
+		warn(_("cannot create %s"), tmp);
+		goto done;
+	}
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		goto failed;
+	}
+	fprintf(f, "%s %ju\n", ctl->boot_id, (uintmax_t) ctl->kmsg_next_seq - 1);
+	if (close_stream(f) != 0 || rename(tmp, ctl->cursor_file) != 0)
+		goto failed;
+
+	ctl->cursor_seq = ctl->kmsg_next_seq - 1;
+	ctl->has_cursor = 1;
+	goto done;
+failed:
+	warn(_("cannot write %s"), ctl->cursor_file);
+	unlink(tmp);
+done:
+	free(tmp);
+}
+
+/* returns the sequence number of the unparsed record in @buf */
+static uint64_t get_kmsg_record_seq(const char *buf)
+{
+	const char *p = strchr(buf, ',');
+
+	return p ? strtoull(p + 1, NULL, 10) : 0;
+}
+
+/* flushes the output, the cursor is saved only if all is written */
+static int flush_kmsg_output(struct dmesg_control *ctl)
+{
+	if (fflush(stdout) != 0)
+		return -1;
+	save_kmsg_cursor(ctl);
+	return 0;
+}
+
+/* flushes the output and waits for a new record, returns 0 on success */
+static int wait_kmsg(struct dmesg_control *ctl)
+{
+	struct pollfd fd = { .fd = ctl->kmsg, .events = POLLIN };
+
+	if (flush_kmsg_output(ctl) != 0) {
+		if (errno != EPIPE)
+			err(EXIT_FAILURE, _("write failed"));
+		exit(EXIT_SUCCESS);
+	}
+
+	while (poll(&fd, 1, -1) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	return 0;
+}
+
 /*
  * Note that each read() call for /dev/kmsg returns always one record. It means
  * that we don't have to read whole message buffer before the records parsing.
@@ -1295,12 +1541,16 @@ mesg:
  * So this function does not compose one huge buffer (like read_syslog_buffer())
  * and print_buffer() is unnecessary. All is done in this function.
  *
+ * In follow mode all the available records are read and printed into the
+ * stdout buffer, the buffer is flushed before we wait for more records.
+ *
  * Returns 0 on success, -1 on error.
  */
 static int read_kmsg(struct dmesg_control *ctl)
 {
 	struct dmesg_record rec;
 	ssize_t sz;
+	int skip = ctl->has_cursor;
 
 	if (ctl->method != DMESG_METHOD_KMSG || ctl->kmsg < 0)
 		return -1;
@@ -1312,13 +1562,29 @@ static int read_kmsg(struct dmesg_control *ctl)
 	 */
 	sz = ctl->kmsg_first_read;
 
-	while (sz > 0) {
-		*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
+	for (;;) {
+		while (sz > 0) {
+			*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
+
+			if (skip && get_kmsg_record_seq(ctl->kmsg_buf) <= ctl->cursor_seq)
+				;	/* read by the previous run */
+			else if (parse_kmsg_record(ctl, &rec,
+					      ctl->kmsg_buf, (size_t) sz) == 0) {
+				check_kmsg_seq(ctl, &rec);
+				print_record(ctl, &rec);
+				skip = 0;
+			}
 
-		if (parse_kmsg_record(ctl, &rec,
-				      ctl->kmsg_buf, (size_t) sz) == 0)
-			print_record(ctl, &rec);
+			sz = read_kmsg_one(ctl);
+		}
 
+		if (!ctl->follow || (sz < 0 && errno != EAGAIN)) {
+			if (ctl->cursor_file && flush_kmsg_output(ctl) != 0)
+				err(EXIT_FAILURE, _("write failed"));
+			break;
+		}
+		if (wait_kmsg(ctl) != 0)
+			break;
 		sz = read_kmsg_one(ctl);
 	}
 
@@ -1373,6 +1639,7 @@ int main(int argc, char *argv[])
 	int  console_level = 0;
 	int  klog_rc = 0;
 	int  delta = 0;
+	int  cbor = 0;
 	ssize_t n;
 	static struct dmesg_control ctl = {
 		.filename = NULL,
@@ -1387,7 +1654,9 @@ int main(int argc, char *argv[])
 		OPT_TIME_FORMAT = CHAR_MAX + 1,
 		OPT_NOESC,
 		OPT_SINCE,
-		OPT_UNTIL
+		OPT_UNTIL,
+		OPT_OUTPUT_FORMAT,
+		OPT_CURSOR_FILE
 	};
 
 	static const struct option longopts[] = {
@@ -1414,9 +1683,11 @@ int main(int argc, char *argv[])
 		{ "reltime",       no_argument,       NULL, 'e' },
 		{ "show-delta",    no_argument,	      NULL, 'd' },
 		{ "ctime",         no_argument,       NULL, 'T' },
+		{ "cursor-file",   required_argument, NULL, OPT_CURSOR_FILE },
 		{ "noescape",      no_argument,       NULL, OPT_NOESC },
 		{ "notime",        no_argument,       NULL, 't' },
 		{ "nopager",       no_argument,       NULL, 'P' },
+		{ "output-format", required_argument, NULL, OPT_OUTPUT_FORMAT },
 		{ "until",         required_argument, NULL, OPT_UNTIL },
 		{ "userspace",     no_argument,       NULL, 'u' },
 		{ "version",       no_argument,	      NULL, 'V' },
@@ -1551,6 +1822,20 @@ int main(int argc, char *argv[])
 		case OPT_NOESC:
 			ctl.noesc = 1;
 			break;
+		case OPT_OUTPUT_FORMAT:
+			ctl.json = 1;
+			ctl.json_stream = 0;
+			cbor = 0;
+			if (strcmp(optarg, "ndjson") == 0)
+				ctl.json_stream = 1;
+			else if (strcmp(optarg, "cbor") == 0)
+				ctl.json_stream = cbor = 1;
+			else if (strcmp(optarg, "json") != 0)
+				errx(EXIT_FAILURE, _("unsupported output format: %s"), optarg);
+			break;
+		case OPT_CURSOR_FILE:
+			ctl.cursor_file = optarg;
+			break;
 		case OPT_SINCE:
 		{
 			usec_t p;
@@ -1588,6 +1873,11 @@ int main(int argc, char *argv[])
 		ctl.raw = 0;
 		ctl.noesc = 1;
 		nopager = 1;
+
+		if (cbor)
+			ul_jsonwrt_init_cbor(&ctl.jfmt, stdout);
+		else if (ctl.json_stream)
+			ul_jsonwrt_init_compact(&ctl.jfmt, stdout);
 	}
 
 	if ((is_timefmt(&ctl, RELTIME) ||
@@ -1630,6 +1920,11 @@ int main(int argc, char *argv[])
 	case SYSLOG_ACTION_READ_CLEAR:
 		if (ctl.method == DMESG_METHOD_KMSG && init_kmsg(&ctl) != 0)
 			ctl.method = DMESG_METHOD_SYSLOG;
+		if (ctl.cursor_file) {
+			if (ctl.method != DMESG_METHOD_KMSG)
+				errx(EXIT_FAILURE, _("--cursor-file is supported for /dev/kmsg only"));
+			load_kmsg_cursor(&ctl);
+		}
 
 		if (ctl.raw
 		    && ctl.method != DMESG_METHOD_KMSG
@@ -1649,7 +1944,7 @@ int main(int argc, char *argv[])
 			free(buf);
 		if (ctl.kmsg >= 0)
 			close(ctl.kmsg);
-		if (ctl.json && ul_jsonwrt_is_ready(&ctl.jfmt)) {
+		if (ctl.json && !ctl.json_stream && ul_jsonwrt_is_ready(&ctl.jfmt)) {
 			ul_jsonwrt_array_close(&ctl.jfmt);
 			ul_jsonwrt_root_close(&ctl.jfmt);
 		}
@@ -72,6 +72,7 @@
 #include "closestream.h"
 #include "xalloc.h"
 #include "optutils.h"
+#include "jobs.h"
 
 static int verbose;
 static char *filename;
@@ -90,6 +91,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -c, --collapse-range remove a range from the file\n"), out);
 	fputs(_(" -d, --dig-holes      detect zeroes and replace with holes\n"), out);
 	fputs(_(" -i, --insert-range   insert a hole at range, shifting existing data\n"), out);
+	fputs(_(" -j, --jobs <num>     dig holes in <num> stripes of the range in parallel\n"), out);
 	fputs(_(" -l, --length <num>   length for range operations, in bytes\n"), out);
 	fputs(_(" -n, --keep-size      maintain the apparent size of the file\n"), out);
 	fputs(_(" -o, --offset <num>   offset for range operations, in bytes\n"), out);
@@ -151,135 +153,198 @@ static void xposix_fallocate(int fd, off_t offset, off_t length)
 }
 #endif
 
-/* The real buffer size has to be bufsize + sizeof(uintptr_t) */
-static int is_nul(void *buf, size_t bufsize)
-{
-	typedef uintptr_t word;
-	void const *vp;
-	char const *cbuf = buf, *cp;
-	word const *wp = buf;
-
-	/* set sentinel */
-	memset((char *) buf + bufsize, '\1', sizeof(word));
-
-	/* Find first nonzero *word*, or the word with the sentinel.  */
-	while (*wp++ == 0)
-		continue;
-
-	/* Find the first nonzero *byte*, or the sentinel.  */
-	vp = wp - 1;
-	cp = vp;
+/* the size of the reads used by --dig-holes */
+#define DIG_BUFSIZ	(4 * 1024 * 1024)
 
-	while (*cp++ == 0)
-		continue;
+/* the stripe used by --jobs, multiple of DIG_BUFSIZ */
+#define DIG_STRIPE	(64 * DIG_BUFSIZ)
 
-	return cbuf + bufsize < cp;
+/*
+ * --dig-holes: the range is split to stripes, the data areas of every stripe
+ * (see SEEK_DATA and SEEK_HOLE) are read by DIG_BUFSIZ reads and the runs of
+ * zeroed filesystem blocks are punched out. The stripes are processed by
+ * --jobs threads in parallel.
+ */
+struct dig_jobs {
+	int fd;
+	off_t start, end;	/* the whole range */
+	off_t blksz;		/* filesystem I/O block size */
+	uint64_t first;		/* index of the first stripe */
+	uint64_t nstripes;
+	uint64_t next;		/* next stripe, relative to @first */
+	uint64_t done;		/* punched bytes */
+	int errsv;		/* errno of the first failed call */
+	int failed_read;	/* the first failed call is pread() */
+};
+
+static int punch_hole(int fd, off_t offset, off_t length)
+{
+#ifdef HAVE_FALLOCATE
+	return fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE, offset, length);
+#else
+	return syscall(SYS_fallocate, fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+			offset, length);
+#endif
 }
 
-static void dig_holes(int fd, off_t file_off, off_t len)
+/*
+ * Digs holes in the data area [@off, @end). If @eod is true, the area ends by
+ * a hole or EOF, and the last hole is extended to the block boundary.
+ *
+ * Returns 0 on success, 1 if pread() failed, or -1 if fallocate() failed.
+ */
+static int dig_area(struct dig_jobs *jb, unsigned char *buf,
+		    off_t off, off_t end, int eod)
 {
-	off_t file_end = len ? file_off + len : 0;
 	off_t hole_start = 0, hole_sz = 0;
-	uintmax_t ct = 0;
-	size_t  bufsz;
-	char *buf;
-	struct stat st;
+
 #if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-	off_t cache_start = file_off;
-	/*
-	 * We don't want to call POSIX_FADV_DONTNEED to discard cached
-	 * data in PAGE_SIZE steps. IMHO it's overkill (too many syscalls).
-	 *
-	 * Let's assume that 1MiB (on system with 4K page size) is just
-	 * a good compromise.
-	 *					    -- kzak Feb-2014
-	 */
-	const size_t cachesz = getpagesize() * 256;
+	(void) posix_fadvise(jb->fd, off, end - off, POSIX_FADV_SEQUENTIAL);
 #endif
+	while (off < end) {
+		size_t sz = min((off_t) DIG_BUFSIZ, end - off), done = 0;
+		ssize_t rsz = pread(jb->fd, buf, sz, off);
+
+		if (rsz < 0)
+			return 1;
+		if (rsz == 0)
+			break;		/* truncated meanwhile */
+		sz = rsz;
+
+		/* all the blocks before the first non-zero byte are zeroed */
+		while (done < sz) {
+			size_t nz = done + ul_nonzero_offset(buf + done, sz - done);
+			off_t data;
+
+			if (nz == sz) {
+				if (!hole_sz)
+					hole_start = off + done;
+				hole_sz += sz - done;
+				break;
+			}
+			data = ((off + nz) / jb->blksz) * jb->blksz;
+			if (data > off + (off_t) done) {
+				if (!hole_sz)
+					hole_start = off + done;
+				hole_sz += data - (off + done);
+			}
+			if (hole_sz) {
+				if (punch_hole(jb->fd, hole_start, hole_sz) != 0)
+					return -1;
+				__atomic_fetch_add(&jb->done, hole_sz, __ATOMIC_RELAXED);
+				hole_sz = 0;
+			}
+			/* skip the rest of the block with the data */
+			done = min((off_t) sz, data + jb->blksz - off);
+		}
 
-	if (fstat(fd, &st) != 0)
-		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
+		/* discard cached data */
+		(void) posix_fadvise(jb->fd, off, sz, POSIX_FADV_DONTNEED);
+#endif
+		off += sz;
+	}
 
-	bufsz = st.st_blksize;
+	if (hole_sz) {
+		off_t punch_sz = hole_sz;
 
-	if (lseek(fd, file_off, SEEK_SET) < 0)
-		err(EXIT_FAILURE, _("seek on %s failed"), filename);
+		if (eod && off >= end)
+			punch_sz += jb->blksz;		/* meet block boundary */
+		if (punch_hole(jb->fd, hole_start, punch_sz) != 0)
+			return -1;
+		__atomic_fetch_add(&jb->done, hole_sz, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
 
-	/* buffer + extra space for is_nul() sentinel */
-	buf = xmalloc(bufsz + sizeof(uintptr_t));
-	while (file_end == 0 || file_off < file_end) {
-		/*
-		 * Detect data area (skip holes)
-		 */
-		off_t end, off;
+/* digs holes in the data areas of the range [@off, @end), see dig_area() */
+static int dig_stripe(struct dig_jobs *jb, unsigned char *buf, off_t off, off_t end)
+{
+	while (off < end) {
+		off_t data, hole;
+		int rc;
 
-		off = lseek(fd, file_off, SEEK_DATA);
-		if ((off == -1 && errno == ENXIO) ||
-		    (file_end && off >= file_end))
+		data = lseek(jb->fd, off, SEEK_DATA);
+		if (data < 0 && errno == ENXIO)
 			break;
+		if (data < 0 || data >= end)
+			return data < 0 ? -1 : 0;
 
-		end = lseek(fd, off, SEEK_HOLE);
-		if (file_end && end > file_end)
-			end = file_end;
+		hole = lseek(jb->fd, data, SEEK_HOLE);
+		if (hole < 0)
+			return -1;
 
-		if (off < 0 || end < 0)
-			break;
+		rc = dig_area(jb, buf, data, min(hole, end), hole <= end);
+		if (rc)
+			return rc;
+		off = hole;
+	}
+	return 0;
+}
 
-#if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
-		(void) posix_fadvise(fd, off, end, POSIX_FADV_SEQUENTIAL);
-#endif
-		/*
-		 * Dig holes in the area
-		 */
-		while (off < end) {
-			ssize_t rsz = pread(fd, buf, bufsz, off);
-			if (rsz < 0 && errno)
-				err(EXIT_FAILURE, _("%s: read failed"), filename);
-			if (end && rsz > 0 && off > end - rsz)
-				rsz = end - off;
-			if (rsz <= 0)
-				break;
+static void *dig_worker(void *data)
+{
+	struct dig_jobs *jb = data;
+	unsigned char *buf;
+	uint64_t i;
 
-			if (is_nul(buf, rsz)) {
-				if (!hole_sz)				/* new hole detected */
-					hole_start = off;
-				hole_sz += rsz;
-			 } else if (hole_sz) {
-				xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-					   hole_start, hole_sz);
-				ct += hole_sz;
-				hole_sz = hole_start = 0;
-			}
+	if (posix_memalign((void **) &buf, getpagesize(), DIG_BUFSIZ) != 0) {
+		int zero = 0;
 
-#if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
-			/* discard cached data */
-			if (off - cache_start > (off_t) cachesz) {
-				size_t clen = off - cache_start;
+		__atomic_compare_exchange_n(&jb->errsv, &zero, ENOMEM,
+				0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		return NULL;
+	}
 
-				clen = (clen / cachesz) * cachesz;
-				(void) posix_fadvise(fd, cache_start, clen, POSIX_FADV_DONTNEED);
-				cache_start = cache_start + clen;
-			}
-#endif
-			off += rsz;
-		}
-		if (hole_sz) {
-			off_t alloc_sz = hole_sz;
-			if (off >= end)
-				alloc_sz += st.st_blksize;		/* meet block boundary */
-			xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-					hole_start, alloc_sz);
-			ct += hole_sz;
+	while (!__atomic_load_n(&jb->errsv, __ATOMIC_RELAXED)
+	       && (i = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->nstripes) {
+		off_t off = max((off_t) (jb->first + i) * DIG_STRIPE, jb->start);
+		off_t end = min((off_t) (jb->first + i + 1) * DIG_STRIPE, jb->end);
+		int rc = dig_stripe(jb, buf, off, end);
+
+		if (rc) {
+			int zero = 0;
+
+			if (__atomic_compare_exchange_n(&jb->errsv, &zero, errno ? errno : EIO,
+					0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				jb->failed_read = rc > 0;
+			break;
 		}
-		file_off = off;
 	}
-
 	free(buf);
+	return NULL;
+}
+
+static void dig_holes(int fd, off_t file_off, off_t len, size_t jobs)
+{
+	struct dig_jobs jb = { .fd = fd, .start = file_off };
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+
+	jb.blksz = st.st_blksize > 0 ? st.st_blksize : 4096;
+	jb.end = len ? min(file_off + len, st.st_size) : st.st_size;
+	/* the stripes are aligned to DIG_STRIPE */
+	jb.first = jb.start / DIG_STRIPE;
+	jb.nstripes = jb.end > jb.start ?
+			(jb.end + DIG_STRIPE - 1) / DIG_STRIPE - jb.first : 0;
+
+	ul_run_jobs(min((uint64_t) jobs, jb.nstripes), dig_worker, &jb, 0);
+
+	if (jb.errsv) {
+		errno = jb.errsv;
+		if (jb.failed_read)
+			err(EXIT_FAILURE, _("%s: read failed"), filename);
+		if (errno == ENOMEM)
+			err_oom();
+		err(EXIT_FAILURE, _("fallocate failed"));
+	}
 
 	if (verbose) {
-		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, ct);
+		char *str = size_to_human_string(SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE, jb.done);
 		fprintf(stdout, _("%s: %s (%ju bytes) converted to sparse holes.\n"),
-				filename, str, ct);
+				filename, str, (uintmax_t) jb.done);
 		free(str);
 	}
 }
@@ -291,6 +356,7 @@ int main(int argc, char **argv)
 	int	mode = 0;
 	int	dig = 0;
 	int posix = 0;
+	size_t jobs = 0;
 	loff_t	length = -2LL;
 	loff_t	offset = 0;
 
@@ -302,6 +368,7 @@ int main(int argc, char **argv)
 	    { "collapse-range", no_argument,       NULL, 'c' },
 	    { "dig-holes",      no_argument,       NULL, 'd' },
 	    { "insert-range",   no_argument,       NULL, 'i' },
+	    { "jobs",           required_argument, NULL, 'j' },
 	    { "zero-range",     no_argument,       NULL, 'z' },
 	    { "offset",         required_argument, NULL, 'o' },
 	    { "length",         required_argument, NULL, 'l' },
@@ -323,7 +390,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "hvVncpdizxl:o:", longopts, NULL))
+	while ((c = getopt_long(argc, argv, "hvVncpdij:zxl:o:", longopts, NULL))
 			!= -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
@@ -338,6 +405,9 @@ int main(int argc, char **argv)
 		case 'i':
 			mode |= FALLOC_FL_INSERT_RANGE;
 			break;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case 'l':
 			length = cvtnum(optarg);
 			break;
@@ -396,6 +466,8 @@ int main(int argc, char **argv)
 	}
 	if (offset < 0)
 		errx(EXIT_FAILURE, _("invalid offset value specified"));
+	if (jobs && !dig)
+		errx(EXIT_FAILURE, _("--jobs can be used with --dig-holes only"));
 
 	/* O_CREAT makes sense only for the default fallocate(2) behavior
 	 * when mode is no specified and new space is allocated */
@@ -405,7 +477,7 @@ int main(int argc, char **argv)
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
 
 	if (dig)
-		dig_holes(fd, offset, length);
+		dig_holes(fd, offset, length, jobs);
 	else {
 #ifdef HAVE_POSIX_FALLOCATE
 		if (posix)
@@ -26,6 +26,9 @@
 #include "nls.h"
 #include "closestream.h"
 #include "optutils.h"
+#include "xalloc.h"
+#include "jobs.h"
+#include "monotonic.h"
 
 enum fs_operation {
 	NOOP,
@@ -33,19 +36,75 @@ enum fs_operation {
 	UNFREEZE
 };
 
+struct freeze_fs {
+	const char *path;
+	int fd;
+	dev_t devno;
+	int errsv;		/* errno of the failed ioctl */
+	unsigned int done : 1;	/* ioctl succeeded */
+};
+
+/*
+ * All the filesystems are opened in advance, the ioctls are issued by the
+ * threads at once when all of them are ready, so the first filesystem does
+ * not stay frozen while the others are processed.
+ */
+struct freeze_jobs {
+	struct freeze_fs *fss;
+	size_t nfss;
+	size_t next;		/* next filesystem */
+	unsigned long request;	/* FIFREEZE or FITHAW */
+	struct timeval begin;	/* the first ioctl */
+};
+
+static void *freeze_worker(void *data)
+{
+	struct freeze_jobs *jb = data;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->nfss) {
+		struct freeze_fs *fs = &jb->fss[i];
+
+		if (i == 0)
+			gettime_monotonic(&jb->begin);
+
+		if (ioctl(fs->fd, jb->request, 0) == 0)
+			fs->done = 1;
+		else
+			fs->errsv = errno;
+	}
+	return NULL;
+}
+
+/* issues @request for all the filesystems, returns the elapsed time */
+static void freeze_parallel(struct freeze_jobs *jb, unsigned long request,
+			    struct timeval *elapsed)
+{
+	struct timeval end;
+
+	jb->request = request;
+	jb->next = 0;
+
+	ul_run_jobs(jb->nfss, freeze_worker, jb, UL_JOBS_SYNCSTART);
+
+	gettime_monotonic(&end);
+	timersub(&end, &jb->begin, elapsed);
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
 	fputs(USAGE_HEADER, out);
 	fprintf(out,
-	      _(" %s [options] <mountpoint>\n"), program_invocation_short_name);
+	      _(" %s [options] <mountpoint>...\n"), program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
-	fputs(_("Suspend access to a filesystem.\n"), out);
+	fputs(_("Suspend access to filesystems.\n"), out);
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -f, --freeze      freeze the filesystem\n"), out);
 	fputs(_(" -u, --unfreeze    unfreeze the filesystem\n"), out);
+	fputs(_(" -v, --verbose     print how long the operation took\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(19));
 	printf(USAGE_MAN_TAIL("fsfreeze(8)"));
@@ -55,15 +114,17 @@ static void __attribute__((__noreturn__)) usage(void)
 
 int main(int argc, char **argv)
 {
-	int fd = -1, c;
+	struct freeze_jobs jb = { .nfss = 0 };
+	struct timeval elapsed;
+	int c, verbose = 0;
 	int action = NOOP, rc = EXIT_FAILURE;
-	char *path;
-	struct stat sb;
+	size_t i, k, nfailed = 0;
 
 	static const struct option longopts[] = {
 	    { "help",      no_argument, NULL, 'h' },
 	    { "freeze",    no_argument, NULL, 'f' },
 	    { "unfreeze",  no_argument, NULL, 'u' },
+	    { "verbose",   no_argument, NULL, 'v' },
 	    { "version",   no_argument, NULL, 'V' },
 	    { NULL, 0, NULL, 0 }
 	};
@@ -79,7 +140,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "hfuV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hfuvV", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -90,6 +151,9 @@ int main(int argc, char **argv)
 		case 'u':
 			action = UNFREEZE;
 			break;
+		case 'v':
+			verbose = 1;
+			break;
 
 		case 'h':
 			usage();
@@ -104,39 +168,82 @@ int main(int argc, char **argv)
 		errx(EXIT_FAILURE, _("neither --freeze or --unfreeze specified"));
 	if (optind == argc)
 		errx(EXIT_FAILURE, _("no filename specified"));
-	path = argv[optind++];
 
-	if (optind != argc) {
-		warnx(_("unexpected number of arguments"));
-		errtryhelp(EXIT_FAILURE);
-	}
+	/* open all, nothing is frozen if any of them is unusable */
+	jb.fss = xcalloc(argc - optind, sizeof(struct freeze_fs));
+	for (i = optind; i < (size_t) argc; i++) {
+		struct freeze_fs *fs = &jb.fss[jb.nfss];
+		struct stat sb;
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0)
-		err(EXIT_FAILURE, _("cannot open %s"), path);
+		fs->path = argv[i];
+		fs->fd = open(fs->path, O_RDONLY);
+		if (fs->fd < 0) {
+			warn(_("cannot open %s"), fs->path);
+			goto done;
+		}
+		jb.nfss++;
 
-	if (fstat(fd, &sb) == -1) {
-		warn(_("stat of %s failed"), path);
-		goto done;
-	}
+		if (fstat(fs->fd, &sb) == -1) {
+			warn(_("stat of %s failed"), fs->path);
+			goto done;
+		}
+		if (!S_ISDIR(sb.st_mode)) {
+			warnx(_("%s: is not a directory"), fs->path);
+			goto done;
+		}
 
-	if (!S_ISDIR(sb.st_mode)) {
-		warnx(_("%s: is not a directory"), path);
-		goto done;
+		fs->devno = sb.st_dev;
+
+		/* the same filesystem more than once */
+		for (k = 0; k < jb.nfss - 1; k++) {
+			if (jb.fss[k].devno == fs->devno) {
+				close(fs->fd);
+				jb.nfss--;
+				break;
+			}
+		}
 	}
 
 	switch (action) {
 	case FREEZE:
-		if (ioctl(fd, FIFREEZE, 0)) {
-			warn(_("%s: freeze failed"), path);
+		freeze_parallel(&jb, FIFREEZE, &elapsed);
+		for (i = 0; i < jb.nfss; i++) {
+			if (!jb.fss[i].done) {
+				errno = jb.fss[i].errsv;
+				warn(_("%s: freeze failed"), jb.fss[i].path);
+				nfailed++;
+			}
+		}
+		if (nfailed) {
+			/* all or nothing, thaw the frozen ones */
+			for (i = 0; i < jb.nfss; i++) {
+				if (jb.fss[i].done && ioctl(jb.fss[i].fd, FITHAW, 0))
+					warn(_("%s: unfreeze failed"), jb.fss[i].path);
+			}
 			goto done;
 		}
+		if (verbose)
+			printf(P_("%zu filesystem frozen in %ld.%06ld seconds\n",
+				  "%zu filesystems frozen in %ld.%06ld seconds\n",
+				  jb.nfss),
+				jb.nfss, (long) elapsed.tv_sec, (long) elapsed.tv_usec);
 		break;
 	case UNFREEZE:
-		if (ioctl(fd, FITHAW, 0)) {
-			warn(_("%s: unfreeze failed"), path);
-			goto done;
+		freeze_parallel(&jb, FITHAW, &elapsed);
+		for (i = 0; i < jb.nfss; i++) {
+			if (!jb.fss[i].done) {
+				errno = jb.fss[i].errsv;
+				warn(_("%s: unfreeze failed"), jb.fss[i].path);
+				nfailed++;
+			}
 		}
+		if (nfailed)
+			goto done;
+		if (verbose)
+			printf(P_("%zu filesystem unfrozen in %ld.%06ld seconds\n",
+				  "%zu filesystems unfrozen in %ld.%06ld seconds\n",
+				  jb.nfss),
+				jb.nfss, (long) elapsed.tv_sec, (long) elapsed.tv_usec);
 		break;
 	default:
 		abort();
@@ -144,7 +251,8 @@ int main(int argc, char **argv)
 
 	rc = EXIT_SUCCESS;
 done:
-	close(fd);
+	for (i = 0; i < jb.nfss; i++)
+		close(jb.fss[i].fd);
+	free(jb.fss);
 	return rc;
 }
-
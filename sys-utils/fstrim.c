@@ -47,6 +47,8 @@
 #include "sysfs.h"
 #include "optutils.h"
 #include "statfs_magic.h"
+#include "monotonic.h"
+#include "jobs.h"
 
 #include <libmount.h>
 
@@ -62,6 +64,9 @@ struct fstrim_range {
 
 struct fstrim_control {
 	struct fstrim_range range;
+	size_t jobs;			/* --jobs */
+	uint64_t step;			/* --step, max. bytes per FITRIM */
+	uint64_t max_rate;		/* --max-rate, trimmed bytes per second */
 
 	unsigned int verbose : 1,
 		     quiet_unsupp : 1,
@@ -85,11 +90,95 @@ static int is_directory(const char *path, int silent)
 	return 1;
 }
 
+/*
+ * The --step FITRIM calls should not block the other I/O for longer than
+ * this; the step is halved when a call takes longer, and doubled (up to
+ * --step) when it takes less than a quarter of it.
+ */
+#define FSTRIM_STEP_LATENCY	(100 * 1000)		/* usec */
+#define FSTRIM_STEP_MIN		(1024 * 1024)		/* bytes */
+
+static uint64_t timeval_to_usec(const struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/*
+ * Calls FITRIM for the @range in chunks of ctl->step bytes, and sleeps
+ * between the chunks to keep the trimmed bytes under ctl->max_rate. The
+ * number of all trimmed bytes is returned in @range->len.
+ */
+static int fitrim_step_by_step(struct fstrim_control *ctl, int fd,
+			       struct fstrim_range *range)
+{
+	struct statfs vfs;
+	struct timeval begin;
+	uint64_t pos = range->start, end, fsend = 0;
+	uint64_t maxstep, step, trimmed = 0;
+
+	/* without --step, one second of --max-rate */
+	maxstep = ctl->step ? ctl->step : max(ctl->max_rate, (uint64_t) FSTRIM_STEP_MIN);
+	step = maxstep;
+
+	end = range->len > ULLONG_MAX - range->start ?
+			ULLONG_MAX : range->start + range->len;
+
+	/* only estimation, the kernel stops at the real end of the filesystem */
+	if (fstatfs(fd, &vfs) == 0)
+		fsend = (uint64_t) vfs.f_blocks * vfs.f_bsize;
+
+	gettime_monotonic(&begin);
+
+	while (pos < end) {
+		struct fstrim_range chunk = { .start = pos, .minlen = range->minlen };
+		struct timeval t0, t1, delta;
+		uint64_t usec;
+		int last = fsend && (pos >= fsend || step >= fsend - pos);
+
+		/* the last chunk covers the rest of the filesystem */
+		if (last)
+			chunk.len = end - pos;
+		else
+			chunk.len = min(step, end - pos);
+
+		gettime_monotonic(&t0);
+		if (ioctl(fd, FITRIM, &chunk))
+			return -1;
+		gettime_monotonic(&t1);
+
+		trimmed += chunk.len;
+		if (last)
+			break;
+		pos += min(step, end - pos);
+
+		timersub(&t1, &t0, &delta);
+		usec = timeval_to_usec(&delta);
+		if (usec > FSTRIM_STEP_LATENCY)
+			step = max(step / 2, (uint64_t) FSTRIM_STEP_MIN);
+		else if (usec < FSTRIM_STEP_LATENCY / 4 && step < maxstep)
+			step = min(step * 2, maxstep);
+
+		if (ctl->max_rate) {
+			/* when the trimmed bytes should be done */
+			uint64_t want = trimmed * 1000000 / ctl->max_rate;
+
+			timersub(&t1, &begin, &delta);
+			usec = timeval_to_usec(&delta);
+			if (want > usec)
+				xusleep(min(want - usec, (uint64_t) 10 * 1000000));
+		}
+	}
+
+	range->len = trimmed;
+	return 0;
+}
+
 /* returns: 0 = success, 1 = unsupported, < 0 = error */
 static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const char *devname)
 {
 	int fd = -1, rc;
 	struct fstrim_range range;
+	struct timeval start, end, delta;
 	char *rpath = realpath(path, NULL);
 
 	if (!rpath) {
@@ -116,8 +205,11 @@ static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const
 		goto done;
 	}
 
+	gettime_monotonic(&start);
 	errno = 0;
-	if (ioctl(fd, FITRIM, &range)) {
+	if (ctl->step || ctl->max_rate ?
+			fitrim_step_by_step(ctl, fd, &range) :
+			ioctl(fd, FITRIM, &range)) {
 		switch (errno) {
 		case EBADF:
 		case ENOTTY:
@@ -133,18 +225,23 @@ static int fstrim_filesystem(struct fstrim_control *ctl, const char *path, const
 		goto done;
 	}
 
+	gettime_monotonic(&end);
+	timersub(&end, &start, &delta);
+
 	if (ctl->verbose) {
 		char *str = size_to_human_string(
 				SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
 				(uint64_t) range.len);
 		if (devname)
 			/* TRANSLATORS: The standard value here is a very large number. */
-			printf(_("%s: %s (%" PRIu64 " bytes) trimmed on %s\n"),
-				path, str, (uint64_t) range.len, devname);
+			printf(_("%s: %s (%" PRIu64 " bytes) trimmed on %s in %"PRId64".%03d s\n"),
+				path, str, (uint64_t) range.len, devname,
+				(int64_t) delta.tv_sec, (int) (delta.tv_usec / 1000));
 		else
 			/* TRANSLATORS: The standard value here is a very large number. */
-			printf(_("%s: %s (%" PRIu64 " bytes) trimmed\n"),
-				path, str, (uint64_t) range.len);
+			printf(_("%s: %s (%" PRIu64 " bytes) trimmed in %"PRId64".%03d s\n"),
+				path, str, (uint64_t) range.len,
+				(int64_t) delta.tv_sec, (int) (delta.tv_usec / 1000));
 
 		free(str);
 	}
@@ -157,7 +254,7 @@ done:
 	return rc;
 }
 
-static int has_discard(const char *devname, struct path_cxt **wholedisk)
+static int has_discard(const char *devname, struct path_cxt **wholedisk, dev_t *diskno)
 {
 	struct path_cxt *pc = NULL;
 	uint64_t dg = 0;
@@ -181,6 +278,7 @@ static int has_discard(const char *devname, struct path_cxt **wholedisk)
 	rc = sysfs_blkdev_get_wholedisk(pc, NULL, 0, &disk);
 	if (rc != 0 || !disk)
 		goto fail;
+	*diskno = disk;
 
 	if (dev != disk) {
 		/* Partition, try reuse whole-disk context if valid for the
@@ -210,6 +308,81 @@ fail:
 	return 1;
 }
 
+/*
+ * --jobs: the filesystems are grouped by whole-disk, the groups are trimmed
+ * in parallel and the filesystems within a group one by one.
+ */
+struct fstrim_task {
+	const char *tgt;
+	const char *src;
+	dev_t disk;		/* whole-disk or 0 if unknown */
+	size_t idx;		/* order in the table */
+	int rc;
+};
+
+struct fstrim_jobs {
+	struct fstrim_control *ctl;
+	struct fstrim_task *tasks;
+	size_t *groups;		/* first task of the group, ngroups + 1 items */
+	size_t ngroups;
+	size_t next;		/* next group to trim */
+};
+
+static void fstrim_task_run(struct fstrim_control *ctl, struct fstrim_task *task)
+{
+	/*
+	 * We're able to detect that the device supports discard, but
+	 * things also depend on filesystem or device mapping, for
+	 * example LUKS (by default) does not support FSTRIM.
+	 *
+	 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
+	 * from discard ioctl.
+	 */
+	task->rc = fstrim_filesystem(ctl, task->tgt, task->src);
+	if (task->rc == 1 && !ctl->quiet_unsupp)
+		warnx(_("%s: the discard operation is not supported"), task->tgt);
+}
+
+static int cmp_tasks_by_disk(const void *a0, const void *b0)
+{
+	const struct fstrim_task *a = a0, *b = b0;
+	int rc = cmp_numbers(a->disk, b->disk);
+
+	return rc ? rc : cmp_numbers(a->idx, b->idx);
+}
+
+static void *fstrim_worker(void *data)
+{
+	struct fstrim_jobs *jb = data;
+	size_t g, i;
+
+	while ((g = __atomic_fetch_add(&jb->next, 1, __ATOMIC_RELAXED)) < jb->ngroups) {
+		for (i = jb->groups[g]; i < jb->groups[g + 1]; i++)
+			fstrim_task_run(jb->ctl, &jb->tasks[i]);
+	}
+	return NULL;
+}
+
+static void fstrim_tasks_parallel(struct fstrim_control *ctl,
+				  struct fstrim_task *tasks, size_t ntasks)
+{
+	struct fstrim_jobs jb = { .ctl = ctl, .tasks = tasks };
+	size_t i;
+
+	qsort(tasks, ntasks, sizeof(*tasks), cmp_tasks_by_disk);
+
+	jb.groups = xcalloc(ntasks + 1, sizeof(size_t));
+	for (i = 0; i < ntasks; i++) {
+		/* unknown whole-disk is never shared */
+		if (i == 0 || !tasks[i].disk || tasks[i].disk != tasks[i - 1].disk)
+			jb.groups[jb.ngroups++] = i;
+	}
+	jb.groups[jb.ngroups] = ntasks;
+
+	ul_run_jobs(min(ctl->jobs, jb.ngroups), fstrim_worker, &jb, 0);
+	free(jb.groups);
+}
+
 static int is_unwanted_fs(struct libmnt_fs *fs, const char *tgt)
 {
 	struct statfs vfs;
@@ -279,11 +452,17 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 	struct libmnt_table *tab;
 	struct libmnt_cache *cache = NULL;
 	struct path_cxt *wholedisk = NULL;
+	struct fstrim_task *tasks;
+	dev_t *disks;
+	size_t i, ntasks = 0;
 	int cnt = 0, cnt_err = 0;
 	int fstab = 0;
 
-	tab = mnt_new_table_from_file(filename);
+	tab = mnt_new_table();
 	if (!tab)
+		err(MNT_EX_FAIL, _("failed to initialize libmount table"));
+	mnt_table_enable_arena(tab, 1);
+	if (mnt_table_parse_file(tab, filename) != 0)
 		err(MNT_EX_FAIL, _("failed to parse %s"), filename);
 
 	if (mnt_table_is_empty(tab)) {
@@ -325,6 +504,10 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 	if (!itr)
 		err(MNT_EX_FAIL, _("failed to initialize libmount iterator"));
 
+	/* whole-disk for each entry, used by --jobs */
+	disks = xcalloc(mnt_table_get_nents(tab) + 1, sizeof(dev_t));
+	i = 0;
+
 	/* Remove useless entries and canonicalize the table */
 	while (mnt_table_next_fs(tab, itr, &fs) == 0) {
 		const char *src = mnt_fs_get_srcpath(fs),
@@ -365,11 +548,13 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 			continue;	/* overlaying mount */
 		}
 
+		disks[i] = 0;
 		if (!is_directory(tgt, 1) ||
-		    !has_discard(src, &wholedisk)) {
+		    !has_discard(src, &wholedisk, &disks[i])) {
 			mnt_table_remove_fs(tab, fs);
 			continue;
 		}
+		mnt_fs_set_userdata(fs, &disks[i++]);
 	}
 
 	/* de-duplicate by source */
@@ -377,28 +562,32 @@ static int fstrim_all_from_file(struct fstrim_control *ctl, const char *filename
 
 	mnt_reset_iter(itr, MNT_ITER_BACKWARD);
 
-	/* Do FITRIM */
+	tasks = xcalloc(mnt_table_get_nents(tab) + 1, sizeof(*tasks));
 	while (mnt_table_next_fs(tab, itr, &fs) == 0) {
-		const char *src = mnt_fs_get_srcpath(fs),
-			   *tgt = mnt_fs_get_target(fs);
-		int rc;
+		struct fstrim_task *task = &tasks[ntasks];
+		dev_t *disk = mnt_fs_get_userdata(fs);
 
-		cnt++;
+		task->tgt = mnt_fs_get_target(fs);
+		task->src = mnt_fs_get_srcpath(fs);
+		task->disk = disk ? *disk : 0;
+		task->idx = ntasks++;
+	}
 
-		/*
-		 * We're able to detect that the device supports discard, but
-		 * things also depend on filesystem or device mapping, for
-		 * example LUKS (by default) does not support FSTRIM.
-		 *
-		 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
-		 * from discard ioctl.
-		 */
-		rc = fstrim_filesystem(ctl, tgt, src);
-		if (rc < 0)
-		       cnt_err++;
-		else if (rc == 1 && !ctl->quiet_unsupp)
-			warnx(_("%s: the discard operation is not supported"), tgt);
+	/* Do FITRIM */
+	if (ctl->jobs > 1 && ntasks > 1)
+		fstrim_tasks_parallel(ctl, tasks, ntasks);
+	else {
+		for (i = 0; i < ntasks; i++)
+			fstrim_task_run(ctl, &tasks[i]);
+	}
+
+	for (i = 0; i < ntasks; i++) {
+		cnt++;
+		if (tasks[i].rc < 0)
+			cnt_err++;
 	}
+	free(tasks);
+	free(disks);
 	mnt_free_iter(itr);
 
 	ul_unref_path(wholedisk);
@@ -462,7 +651,10 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -m, --minimum <num>      the minimum extent length to discard\n"), out);
 	fputs(_(" -v, --verbose            print number of discarded bytes\n"), out);
 	fputs(_("     --quiet-unsupported  suppress error messages if trim unsupported\n"), out);
+	fputs(_("     --step <num>         discard at most <num> bytes by one FITRIM call\n"), out);
+	fputs(_("     --max-rate <num>     discard at most <num> bytes per second\n"), out);
 	fputs(_(" -n, --dry-run            does everything, but trim\n"), out);
+	fputs(_(" -j, --jobs <num>         trim filesystems on <num> whole-disks in parallel\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(21));
@@ -483,7 +675,9 @@ int main(int argc, char **argv)
 			.range = { .len = ULLONG_MAX }
 	};
 	enum {
-		OPT_QUIET_UNSUPP = CHAR_MAX + 1
+		OPT_QUIET_UNSUPP = CHAR_MAX + 1,
+		OPT_STEP,
+		OPT_MAX_RATE
 	};
 
 	static const struct option longopts[] = {
@@ -498,6 +692,9 @@ int main(int argc, char **argv)
 	    { "verbose",   no_argument,       NULL, 'v' },
 	    { "quiet-unsupported", no_argument,       NULL, OPT_QUIET_UNSUPP },
 	    { "dry-run",   no_argument,       NULL, 'n' },
+	    { "jobs",      required_argument, NULL, 'j' },
+	    { "step",      required_argument, NULL, OPT_STEP },
+	    { "max-rate",  required_argument, NULL, OPT_MAX_RATE },
 	    { NULL, 0, NULL, 0 }
 	};
 
@@ -512,7 +709,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "AahI:l:m:no:Vv", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "AahI:j:l:m:no:Vv", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -532,6 +729,9 @@ int main(int argc, char **argv)
 		case 'n':
 			ctl.dryrun = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case 'l':
 			ctl.range.len = strtosize_or_err(optarg,
 					_("failed to parse length"));
@@ -550,6 +750,19 @@ int main(int argc, char **argv)
 		case OPT_QUIET_UNSUPP:
 			ctl.quiet_unsupp = 1;
 			break;
+		case OPT_STEP:
+			ctl.step = strtosize_or_err(optarg,
+					_("failed to parse step size"));
+			if (ctl.step < FSTRIM_STEP_MIN)
+				errx(EXIT_FAILURE, _("step size must be at least %d bytes"),
+						FSTRIM_STEP_MIN);
+			break;
+		case OPT_MAX_RATE:
+			ctl.max_rate = strtosize_or_err(optarg,
+					_("failed to parse maximal rate"));
+			if (!ctl.max_rate)
+				errx(EXIT_FAILURE, _("failed to parse maximal rate"));
+			break;
 		case 'h':
 			usage();
 		case 'V':
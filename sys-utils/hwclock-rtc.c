@@ -8,8 +8,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <poll.h>
 #include <sys/ioctl.h>
-#include <sys/select.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
@@ -304,25 +304,30 @@ static int synchronize_to_clock_tick_rtc(const struct hwclock_control *ctl)
 		 * update interrupt comes and a bootscript with a
 		 * hwclock call hangs
 		 */
-		fd_set rfds;
-		struct timeval tv;
+		struct pollfd pfd = { .fd = rtc_fd, .events = POLLIN };
+		struct timeval begin = { 0 }, now = { 0 };
+		double left = 10.0;
 
 		/*
 		 * Wait up to ten seconds for the next update
-		 * interrupt
+		 * interrupt, the signals do not extend the limit
 		 */
-		FD_ZERO(&rfds);
-		FD_SET(rtc_fd, &rfds);
-		tv.tv_sec = 10;
-		tv.tv_usec = 0;
-		rc = select(rtc_fd + 1, &rfds, NULL, NULL, &tv);
+		gettime_monotonic(&begin);
+		do {
+			rc = poll(&pfd, 1, (int) (left * 1000) + 1);
+			if (rc >= 0 || errno != EINTR)
+				break;
+			gettime_monotonic(&now);
+			left = 10.0 - time_diff(now, begin);
+		} while (left > 0);
+
 		if (0 < rc)
 			ret = 0;
-		else if (rc == 0) {
-			warnx(_("select() to %s to wait for clock tick timed out"),
+		else if (rc == 0 || left <= 0) {
+			warnx(_("poll() to %s to wait for clock tick timed out"),
 			      rtc_dev_name);
 		} else
-			warn(_("select() to %s to wait for clock tick failed"),
+			warn(_("poll() to %s to wait for clock tick failed"),
 			     rtc_dev_name);
 		/* Turn off update interrupts */
 		rc = ioctl(rtc_fd, RTC_UIE_OFF, 0);
@@ -1067,8 +1067,11 @@ manipulate_clock(const struct hwclock_control *ctl, const time_t set_time,
 		 * anything between the follow three statements.
 		 * Synchronization failure MUST exit, because all drift
 		 * operations are invalid without it.
+		 *
+		 * The --fast skips the synchronization, it is allowed only
+		 * for the functions which don't update the drift.
 		 */
-		if (synchronize_to_clock_tick(ctl))
+		if (!ctl->fast && synchronize_to_clock_tick(ctl))
 			return EXIT_FAILURE;
 		read_hardware_clock(ctl, &hclock_valid, &hclocktime.tv_sec);
 		gettimeofday(&read_time, NULL);
@@ -1087,6 +1090,12 @@ manipulate_clock(const struct hwclock_control *ctl, const time_t set_time,
 				     hclocktime.tv_sec, &tdrift);
 		if (!ctl->show)
 			hclocktime = time_inc(tdrift, hclocktime.tv_sec);
+		/*
+		 * Not synchronized, the RTC has been read at an unknown
+		 * moment of its second; the middle halves the maximal error.
+		 */
+		if (ctl->fast)
+			hclocktime = time_inc(hclocktime, 0.5);
 
 		startup_hclocktime =
 		 time_inc(hclocktime, time_diff(startup_time, read_time));
@@ -1231,6 +1240,7 @@ usage(void)
 	puts(_("     --epoch <year>              epoch input for --setepoch"));
 #endif
 	puts(_("     --update-drift              update the RTC drift factor"));
+	puts(_("     --fast                      do not wait for the RTC clock tick"));
 	printf(_(
 	       "     --noadjfile                 do not use %1$s\n"), _PATH_ADJTIME);
 	printf(_(
@@ -1280,6 +1290,7 @@ int main(int argc, char **argv)
 		OPT_DELAY,
 		OPT_DIRECTISA,
 		OPT_EPOCH,
+		OPT_FAST,
 		OPT_GET,
 		OPT_GETEPOCH,
 		OPT_NOADJFILE,
@@ -1328,6 +1339,7 @@ int main(int argc, char **argv)
 		{ "predict",      no_argument,       NULL, OPT_PREDICT    },
 		{ "get",          no_argument,       NULL, OPT_GET        },
 		{ "update-drift", no_argument,       NULL, OPT_UPDATE     },
+		{ "fast",         no_argument,       NULL, OPT_FAST       },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -1337,6 +1349,7 @@ int main(int argc, char **argv)
 		  OPT_SET, OPT_SETEPOCH, OPT_SYSTZ },
 		{ 'l', 'u' },
 		{ OPT_ADJFILE, OPT_NOADJFILE },
+		{ OPT_FAST, OPT_UPDATE },
 		{ OPT_NOADJFILE, OPT_UPDATE },
 		{ 0 }
 	};
@@ -1474,6 +1487,9 @@ int main(int argc, char **argv)
 		case OPT_UPDATE:
 			ctl.update = 1;		/* --update-drift */
 			break;
+		case OPT_FAST:
+			ctl.fast = 1;		/* --fast */
+			break;
 #ifdef __linux__
 		case 'f':
 			ctl.rtc_dev_name = optarg;	/* --rtc */
@@ -1502,6 +1518,11 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	if (ctl.fast && ctl.adjust) {
+		warnx(_("--fast cannot be used with --adjust"));
+		exit(EXIT_FAILURE);
+	}
+
 	if (ctl.noadjfile && !ctl.utc && !ctl.local_opt) {
 		warnx(_("With --noadjfile, you must specify "
 			"either --utc or --localtime"));
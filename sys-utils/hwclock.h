@@ -52,6 +52,7 @@ struct hwclock_control {
 		get:1,
 		set:1,
 		update:1,
+		fast:1,
 		universal:1,	/* will store hw_clock_is_utc() return value */
 		verbose:1;
 };
@@ -199,7 +199,7 @@ int main (int argc, char **argv)
 
 static void do_shm (char format, int unit)
 {
-	struct passwd *pw;
+	const char *user;
 	struct shm_data *shmds, *shmdsp;
 
 	switch (format) {
@@ -316,11 +316,11 @@ static void do_shm (char format, int unit)
 			ipc_print_perms(stdout, &shmdsp->shm_perm);
 			continue;
 		}
-		pw = getpwuid(shmdsp->shm_perm.uid);
+		user = ipc_get_username(shmdsp->shm_perm.uid);
 		switch (format) {
 		case TIME:
-			if (pw)
-				printf ("%-10d %-10.10s", shmdsp->shm_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-10d %-10.10s", shmdsp->shm_perm.id, user);
 			else
 				printf ("%-10d %-10u", shmdsp->shm_perm.id, shmdsp->shm_perm.uid);
 			/* ctime uses static buffer: use separate calls */
@@ -332,8 +332,8 @@ static void do_shm (char format, int unit)
 			       ? ctime64(&shmdsp->shm_ctim) + 4 : _("Not set"));
 			break;
 		case PID:
-			if (pw)
-				printf ("%-10d %-10.10s", shmdsp->shm_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-10d %-10.10s", shmdsp->shm_perm.id, user);
 			else
 				printf ("%-10d %-10u", shmdsp->shm_perm.id, shmdsp->shm_perm.uid);
 			printf (" %-10u %-10u\n",
@@ -342,8 +342,8 @@ static void do_shm (char format, int unit)
 
 		default:
 			printf("0x%08x ", shmdsp->shm_perm.key);
-			if (pw)
-				printf ("%-10d %-10.10s", shmdsp->shm_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-10d %-10.10s", shmdsp->shm_perm.id, user);
 			else
 				printf ("%-10d %-10u", shmdsp->shm_perm.id, shmdsp->shm_perm.uid);
 			printf (" %-10o ", shmdsp->shm_perm.mode & 0777);
@@ -366,7 +366,7 @@ static void do_shm (char format, int unit)
 
 static void do_sem (char format)
 {
-	struct passwd *pw;
+	const char *user;
 	struct sem_data *semds, *semdsp;
 
 	switch (format) {
@@ -434,11 +434,11 @@ static void do_sem (char format)
 			ipc_print_perms(stdout, &semdsp->sem_perm);
 			continue;
 		}
-		pw = getpwuid(semdsp->sem_perm.uid);
+		user = ipc_get_username(semdsp->sem_perm.uid);
 		switch (format) {
 		case TIME:
-			if (pw)
-				printf ("%-8d %-10.10s", semdsp->sem_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-8d %-10.10s", semdsp->sem_perm.id, user);
 			else
 				printf ("%-8d %-10u", semdsp->sem_perm.id, semdsp->sem_perm.uid);
 			printf ("  %-26.24s", semdsp->sem_otime
@@ -451,8 +451,8 @@ static void do_sem (char format)
 
 		default:
 			printf("0x%08x ", semdsp->sem_perm.key);
-			if (pw)
-				printf ("%-10d %-10.10s", semdsp->sem_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-10d %-10.10s", semdsp->sem_perm.id, user);
 			else
 				printf ("%-10d %-10u", semdsp->sem_perm.id, semdsp->sem_perm.uid);
 			printf (" %-10o %-10ju\n",
@@ -467,7 +467,7 @@ static void do_sem (char format)
 
 static void do_msg (char format, int unit)
 {
-	struct passwd *pw;
+	const char *user;
 	struct msg_data *msgds, *msgdsp;
 
 	switch (format) {
@@ -541,11 +541,11 @@ static void do_msg (char format, int unit)
 			ipc_print_perms(stdout, &msgdsp->msg_perm);
 			continue;
 		}
-		pw = getpwuid(msgdsp->msg_perm.uid);
+		user = ipc_get_username(msgdsp->msg_perm.uid);
 		switch (format) {
 		case TIME:
-			if (pw)
-				printf ("%-8d %-10.10s", msgdsp->msg_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-8d %-10.10s", msgdsp->msg_perm.id, user);
 			else
 				printf ("%-8d %-10u", msgdsp->msg_perm.id, msgdsp->msg_perm.uid);
 			printf (" %-20.16s", msgdsp->q_stime
@@ -556,8 +556,8 @@ static void do_msg (char format, int unit)
 				? ctime64(&msgdsp->q_ctime) + 4 : _("Not set"));
 			break;
 		case PID:
-			if (pw)
-				printf ("%-8d %-10.10s", msgdsp->msg_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-8d %-10.10s", msgdsp->msg_perm.id, user);
 			else
 				printf ("%-8d %-10u", msgdsp->msg_perm.id, msgdsp->msg_perm.uid);
 			printf ("  %5d     %5d\n",
@@ -566,8 +566,8 @@ static void do_msg (char format, int unit)
 
 		default:
 			printf( "0x%08x ",msgdsp->msg_perm.key );
-			if (pw)
-				printf ("%-10d %-10.10s", msgdsp->msg_perm.id, pw->pw_name);
+			if (user)
+				printf ("%-10d %-10.10s", msgdsp->msg_perm.id, user);
 			else
 				printf ("%-10d %-10u", msgdsp->msg_perm.id, msgdsp->msg_perm.uid);
 			printf (" %-10o ", msgdsp->msg_perm.mode & 0777);
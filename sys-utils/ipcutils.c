@@ -1,4 +1,7 @@
 #include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <search.h>
 
 #include "c.h"
 #include "nls.h"
@@ -97,67 +100,133 @@ int ipc_shm_get_limits(struct ipc_limits *lim)
 	return 0;
 }
 
-int ipc_shm_get_info(int id, struct shm_data **shmds)
+/*
+ * The /proc/sysvipc/ files may have hundreds of thousands of lines, so the
+ * file is read to one buffer and the lines are split to the fields in place.
+ */
+static char *ipc_proc_read(const char *path)
 {
-	FILE *f;
-	int i = 0, maxid, j;
-	char buf[BUFSIZ];
-	struct shm_data *p;
-	struct shmid_ds dummy;
+	size_t sz = 64 * 1024, len = 0;
+	char *buf;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	buf = xmalloc(sz);
+	for (;;) {
+		ssize_t rc = read(fd, buf + len, sz - len - 1);
+
+		if (rc < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (rc < 0) {
+			free(buf);
+			buf = NULL;
+			break;
+		}
+		if (rc == 0) {
+			buf[len] = '\0';
+			break;
+		}
+		len += rc;
+		if (len == sz - 1) {
+			sz *= 2;
+			buf = xrealloc(buf, sz);
+		}
+	}
+	close(fd);
+	return buf;
+}
 
-	p = *shmds = xcalloc(1, sizeof(struct shm_data));
-	p->next = NULL;
+/* splits the next line of @*str to at most @max fields, returns the number
+ * of the fields */
+static size_t ipc_proc_next_line(char **str, char **fields, size_t max)
+{
+	char *p = *str;
+	size_t n = 0;
+
+	for (;;) {
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (!*p || *p == '\n')
+			break;
+		if (n < max)
+			fields[n++] = p;
+		while (*p && *p != ' ' && *p != '\t' && *p != '\n')
+			p++;
+		if (*p == ' ' || *p == '\t')
+			*p++ = '\0';
+	}
+	if (*p == '\n')
+		*p++ = '\0';
+	*str = p;
+	return n;
+}
 
-	f = fopen(_PATH_PROC_SYSV_SHM, "r");
-	if (!f)
+#define ipc_fld_int(_s)	((int) strtol(_s, NULL, 10))
+#define ipc_fld_oct(_s)	((unsigned int) strtoul(_s, NULL, 8))
+#define ipc_fld_u32(_s)	((unsigned int) strtoul(_s, NULL, 10))
+#define ipc_fld_u64(_s)	((uint64_t) strtoull(_s, NULL, 10))
+#define ipc_fld_s64(_s)	((int64_t) strtoll(_s, NULL, 10))
+
+/**
+ * ipc_shm_foreach - Call @fn for every shared memory segment
+ * @id: the segment ID or -1 for all the segments
+ * @fn: callback, returns non-zero to stop
+ * @data: callback data
+ *
+ * The segment is decoded only if it matches @id.
+ *
+ * Returns the number of the segments passed to @fn.
+ */
+int ipc_shm_foreach(int id, ipc_shm_callback fn, void *data)
+{
+	struct shm_data shm;
+	struct shmid_ds dummy;
+	char *buf, *p, *f[16];
+	int i = 0, maxid, j;
+
+	buf = ipc_proc_read(_PATH_PROC_SYSV_SHM);
+	if (!buf)
 		goto shm_fallback;
 
-	while (fgetc(f) != '\n');		/* skip header */
-
-	while (fgets(buf, sizeof(buf), f) != NULL) {
-		/* scan for the first 14-16 columns (e.g. Linux 2.6.32 has 14) */
-		p->shm_rss = 0xdead;
-		p->shm_swp = 0xdead;
-		if (sscanf(buf,
-			  "%d %d  %o %"SCNu64 " %u %u  "
-			  "%"SCNu64 " %u %u %u %u %"SCNi64 " %"SCNi64 " %"SCNi64
-			  " %"SCNu64 " %"SCNu64 "\n",
-			   &p->shm_perm.key,
-			   &p->shm_perm.id,
-			   &p->shm_perm.mode,
-			   &p->shm_segsz,
-			   &p->shm_cprid,
-			   &p->shm_lprid,
-			   &p->shm_nattch,
-			   &p->shm_perm.uid,
-			   &p->shm_perm.gid,
-			   &p->shm_perm.cuid,
-			   &p->shm_perm.cgid,
-			   &p->shm_atim,
-			   &p->shm_dtim,
-			   &p->shm_ctim,
-			   &p->shm_rss,
-			   &p->shm_swp) < 14)
-			continue; /* invalid line, skipped */
+	p = buf;
+	ipc_proc_next_line(&p, f, 0);		/* skip header */
 
-		if (id > -1) {
-			/* ID specified */
-			if (id == p->shm_perm.id) {
-				i = 1;
-				break;
-			}
+	while (*p) {
+		/* the first 14-16 columns (e.g. Linux 2.6.32 has 14) */
+		size_t n = ipc_proc_next_line(&p, f, ARRAY_SIZE(f));
+
+		if (n < 14)
+			continue; /* invalid line, skipped */
+		if (id > -1 && ipc_fld_int(f[1]) != id)
 			continue;
-		}
 
-		p->next = xcalloc(1, sizeof(struct shm_data));
-		p = p->next;
-		p->next = NULL;
+		memset(&shm, 0, sizeof(shm));
+		shm.shm_perm.key = ipc_fld_int(f[0]);
+		shm.shm_perm.id = ipc_fld_int(f[1]);
+		shm.shm_perm.mode = ipc_fld_oct(f[2]);
+		shm.shm_segsz = ipc_fld_u64(f[3]);
+		shm.shm_cprid = ipc_fld_u32(f[4]);
+		shm.shm_lprid = ipc_fld_u32(f[5]);
+		shm.shm_nattch = ipc_fld_u64(f[6]);
+		shm.shm_perm.uid = ipc_fld_u32(f[7]);
+		shm.shm_perm.gid = ipc_fld_u32(f[8]);
+		shm.shm_perm.cuid = ipc_fld_u32(f[9]);
+		shm.shm_perm.cgid = ipc_fld_u32(f[10]);
+		shm.shm_atim = ipc_fld_s64(f[11]);
+		shm.shm_dtim = ipc_fld_s64(f[12]);
+		shm.shm_ctim = ipc_fld_s64(f[13]);
+		shm.shm_rss = n > 14 ? ipc_fld_u64(f[14]) : 0xdead;
+		shm.shm_swp = n > 15 ? ipc_fld_u64(f[15]) : 0xdead;
+
 		i++;
+		if (fn(&shm, data) || id > -1)
+			break;
 	}
 
-	if (i == 0)
-		free(*shmds);
-	fclose(f);
+	free(buf);
 	return i;
 
 	/* Fallback; /proc or /sys file(s) missing. */
@@ -175,33 +244,67 @@ shm_fallback:
 		}
 
 		i++;
-		p->shm_perm.key = ipcp->KEY;
-		p->shm_perm.id = shmid;
-		p->shm_perm.mode = ipcp->mode;
-		p->shm_segsz = shmseg.shm_segsz;
-		p->shm_cprid = shmseg.shm_cpid;
-		p->shm_lprid = shmseg.shm_lpid;
-		p->shm_nattch = shmseg.shm_nattch;
-		p->shm_perm.uid = ipcp->uid;
-		p->shm_perm.gid = ipcp->gid;
-		p->shm_perm.cuid = ipcp->cuid;
-		p->shm_perm.cgid = ipcp->cuid;
-		p->shm_atim = shmseg.shm_atime;
-		p->shm_dtim = shmseg.shm_dtime;
-		p->shm_ctim = shmseg.shm_ctime;
-		p->shm_rss = 0xdead;
-		p->shm_swp = 0xdead;
-
-		if (id < 0) {
-			p->next = xcalloc(1, sizeof(struct shm_data));
-			p = p->next;
-			p->next = NULL;
-		} else
+		memset(&shm, 0, sizeof(shm));
+		shm.shm_perm.key = ipcp->KEY;
+		shm.shm_perm.id = shmid;
+		shm.shm_perm.mode = ipcp->mode;
+		shm.shm_segsz = shmseg.shm_segsz;
+		shm.shm_cprid = shmseg.shm_cpid;
+		shm.shm_lprid = shmseg.shm_lpid;
+		shm.shm_nattch = shmseg.shm_nattch;
+		shm.shm_perm.uid = ipcp->uid;
+		shm.shm_perm.gid = ipcp->gid;
+		shm.shm_perm.cuid = ipcp->cuid;
+		shm.shm_perm.cgid = ipcp->cuid;
+		shm.shm_atim = shmseg.shm_atime;
+		shm.shm_dtim = shmseg.shm_dtime;
+		shm.shm_ctim = shmseg.shm_ctime;
+		shm.shm_rss = 0xdead;
+		shm.shm_swp = 0xdead;
+
+		if (fn(&shm, data) || id > -1)
 			break;
 	}
 
-	if (i == 0)
-		free(*shmds);
+	return i;
+}
+
+struct shm_collector {
+	struct shm_data *head, *tail;
+};
+
+static int shm_collect(struct shm_data *shm, void *data)
+{
+	struct shm_collector *c = data;
+	struct shm_data *x = xmalloc(sizeof(*x));
+
+	*x = *shm;
+	x->next = NULL;
+	if (c->tail)
+		c->tail->next = x;
+	else
+		c->head = x;
+	c->tail = x;
+	return 0;
+}
+
+/*
+ * Returns the list of the segments, the list of all segments (@id is -1) is
+ * terminated by an empty element.
+ */
+int ipc_shm_get_info(int id, struct shm_data **shmds)
+{
+	struct shm_collector c = { NULL, NULL };
+	int i;
+
+	i = ipc_shm_foreach(id, shm_collect, &c);
+	if (i < 1) {
+		*shmds = NULL;
+		return 0;
+	}
+	if (id < 0)
+		shm_collect(&(struct shm_data) { .next = NULL }, &c);
+	*shmds = c.head;
 	return i;
 }
 
@@ -245,58 +348,57 @@ static void get_sem_elements(struct sem_data *p)
 	}
 }
 
-int ipc_sem_get_info(int id, struct sem_data **semds)
+/**
+ * ipc_sem_foreach - Call @fn for every semaphore set
+ * @id: the set ID or -1 for all the sets
+ * @fn: callback, returns non-zero to stop
+ * @data: callback data
+ *
+ * The elements of the set are not read, see ipc_sem_get_info().
+ *
+ * Returns the number of the sets passed to @fn.
+ */
+int ipc_sem_foreach(int id, ipc_sem_callback fn, void *data)
 {
-	FILE *f;
-	int i = 0, maxid, j;
-	struct sem_data *p;
+	struct sem_data sem;
 	struct seminfo dummy;
 	union semun arg;
+	char *buf, *p, *f[10];
+	int i = 0, maxid, j;
 
-	p = *semds = xcalloc(1, sizeof(struct sem_data));
-	p->next = NULL;
-
-	f = fopen(_PATH_PROC_SYSV_SEM, "r");
-	if (!f)
+	buf = ipc_proc_read(_PATH_PROC_SYSV_SEM);
+	if (!buf)
 		goto sem_fallback;
 
-	while (fgetc(f) != '\n') ;	/* skip header */
-
-	while (feof(f) == 0) {
-		if (fscanf(f,
-			   "%d %d  %o %" SCNu64 " %u %u %u %u %"
-			    SCNi64 " %" SCNi64 "\n",
-			   &p->sem_perm.key,
-			   &p->sem_perm.id,
-			   &p->sem_perm.mode,
-			   &p->sem_nsems,
-			   &p->sem_perm.uid,
-			   &p->sem_perm.gid,
-			   &p->sem_perm.cuid,
-			   &p->sem_perm.cgid,
-			   &p->sem_otime,
-			   &p->sem_ctime) != 10)
-			continue;
+	p = buf;
+	ipc_proc_next_line(&p, f, 0);		/* skip header */
+
+	while (*p) {
+		size_t n = ipc_proc_next_line(&p, f, ARRAY_SIZE(f));
 
-		if (id > -1) {
-			/* ID specified */
-			if (id == p->sem_perm.id) {
-				get_sem_elements(p);
-				i = 1;
-				break;
-			}
+		if (n < 10)
 			continue;
-		}
+		if (id > -1 && ipc_fld_int(f[1]) != id)
+			continue;
+
+		memset(&sem, 0, sizeof(sem));
+		sem.sem_perm.key = ipc_fld_int(f[0]);
+		sem.sem_perm.id = ipc_fld_int(f[1]);
+		sem.sem_perm.mode = ipc_fld_oct(f[2]);
+		sem.sem_nsems = ipc_fld_u64(f[3]);
+		sem.sem_perm.uid = ipc_fld_u32(f[4]);
+		sem.sem_perm.gid = ipc_fld_u32(f[5]);
+		sem.sem_perm.cuid = ipc_fld_u32(f[6]);
+		sem.sem_perm.cgid = ipc_fld_u32(f[7]);
+		sem.sem_otime = ipc_fld_s64(f[8]);
+		sem.sem_ctime = ipc_fld_s64(f[9]);
 
-		p->next = xcalloc(1, sizeof(struct sem_data));
-		p = p->next;
-		p->next = NULL;
 		i++;
+		if (fn(&sem, data) || id > -1)
+			break;
 	}
 
-	if (i == 0)
-		free(*semds);
-	fclose(f);
+	free(buf);
 	return i;
 
 	/* Fallback; /proc or /sys file(s) missing. */
@@ -316,30 +418,63 @@ sem_fallback:
 		}
 
 		i++;
-		p->sem_perm.key = ipcp->KEY;
-		p->sem_perm.id = semid;
-		p->sem_perm.mode = ipcp->mode;
-		p->sem_nsems = semseg.sem_nsems;
-		p->sem_perm.uid = ipcp->uid;
-		p->sem_perm.gid = ipcp->gid;
-		p->sem_perm.cuid = ipcp->cuid;
-		p->sem_perm.cgid = ipcp->cuid;
-		p->sem_otime = semseg.sem_otime;
-		p->sem_ctime = semseg.sem_ctime;
-
-		if (id < 0) {
-			p->next = xcalloc(1, sizeof(struct sem_data));
-			p = p->next;
-			p->next = NULL;
-			i++;
-		} else {
-			get_sem_elements(p);
+		memset(&sem, 0, sizeof(sem));
+		sem.sem_perm.key = ipcp->KEY;
+		sem.sem_perm.id = semid;
+		sem.sem_perm.mode = ipcp->mode;
+		sem.sem_nsems = semseg.sem_nsems;
+		sem.sem_perm.uid = ipcp->uid;
+		sem.sem_perm.gid = ipcp->gid;
+		sem.sem_perm.cuid = ipcp->cuid;
+		sem.sem_perm.cgid = ipcp->cuid;
+		sem.sem_otime = semseg.sem_otime;
+		sem.sem_ctime = semseg.sem_ctime;
+
+		if (fn(&sem, data) || id > -1)
 			break;
-		}
 	}
 
-	if (i == 0)
-		free(*semds);
+	return i;
+}
+
+struct sem_collector {
+	struct sem_data *head, *tail;
+};
+
+static int sem_collect(struct sem_data *sem, void *data)
+{
+	struct sem_collector *c = data;
+	struct sem_data *x = xmalloc(sizeof(*x));
+
+	*x = *sem;
+	x->next = NULL;
+	if (c->tail)
+		c->tail->next = x;
+	else
+		c->head = x;
+	c->tail = x;
+	return 0;
+}
+
+/*
+ * Returns the list of the semaphore sets, the list of all sets (@id is -1) is
+ * terminated by an empty element. The elements are read for the @id set only.
+ */
+int ipc_sem_get_info(int id, struct sem_data **semds)
+{
+	struct sem_collector c = { NULL, NULL };
+	int i;
+
+	i = ipc_sem_foreach(id, sem_collect, &c);
+	if (i < 1) {
+		*semds = NULL;
+		return 0;
+	}
+	if (id < 0)
+		sem_collect(&(struct sem_data) { .next = NULL }, &c);
+	else
+		get_sem_elements(c.head);
+	*semds = c.head;
 	return i;
 }
 
@@ -353,63 +488,63 @@ void ipc_sem_free_info(struct sem_data *semds)
 	}
 }
 
-int ipc_msg_get_info(int id, struct msg_data **msgds)
+/**
+ * ipc_msg_foreach - Call @fn for every message queue
+ * @id: the queue ID or -1 for all the queues
+ * @fn: callback, returns non-zero to stop
+ * @data: callback data
+ *
+ * Returns the number of the queues passed to @fn.
+ */
+int ipc_msg_foreach(int id, ipc_msg_callback fn, void *data)
 {
-	FILE *f;
-	int i = 0, maxid, j;
-	struct msg_data *p;
+	struct msg_data msg;
 	struct msqid_ds dummy;
 	struct msqid_ds msgseg;
+	char *buf, *p, *f[14];
+	int i = 0, maxid, j;
 
-	p = *msgds = xcalloc(1, sizeof(struct msg_data));
-	p->next = NULL;
-
-	f = fopen(_PATH_PROC_SYSV_MSG, "r");
-	if (!f)
+	buf = ipc_proc_read(_PATH_PROC_SYSV_MSG);
+	if (!buf)
 		goto msg_fallback;
 
-	while (fgetc(f) != '\n') ;	/* skip header */
-
-	while (feof(f) == 0) {
-		if (fscanf(f,
-			   "%d %d  %o  %" SCNu64 " %" SCNu64
-			   " %u %u %u %u %u %u %" SCNi64 " %" SCNi64 " %" SCNi64 "\n",
-			   &p->msg_perm.key,
-			   &p->msg_perm.id,
-			   &p->msg_perm.mode,
-			   &p->q_cbytes,
-			   &p->q_qnum,
-			   &p->q_lspid,
-			   &p->q_lrpid,
-			   &p->msg_perm.uid,
-			   &p->msg_perm.gid,
-			   &p->msg_perm.cuid,
-			   &p->msg_perm.cgid,
-			   &p->q_stime,
-			   &p->q_rtime,
-			   &p->q_ctime) != 14)
-			continue;
+	p = buf;
+	ipc_proc_next_line(&p, f, 0);		/* skip header */
+
+	while (*p) {
+		size_t n = ipc_proc_next_line(&p, f, ARRAY_SIZE(f));
 
-		if (id > -1) {
-			/* ID specified */
-			if (id == p->msg_perm.id) {
-				if (msgctl(id, IPC_STAT, &msgseg) != -1)
-					p->q_qbytes = msgseg.msg_qbytes;
-				i = 1;
-				break;
-			}
+		if (n < 14)
+			continue;
+		if (id > -1 && ipc_fld_int(f[1]) != id)
 			continue;
-		}
 
-		p->next = xcalloc(1, sizeof(struct msg_data));
-		p = p->next;
-		p->next = NULL;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_perm.key = ipc_fld_int(f[0]);
+		msg.msg_perm.id = ipc_fld_int(f[1]);
+		msg.msg_perm.mode = ipc_fld_oct(f[2]);
+		msg.q_cbytes = ipc_fld_u64(f[3]);
+		msg.q_qnum = ipc_fld_u64(f[4]);
+		msg.q_lspid = ipc_fld_u32(f[5]);
+		msg.q_lrpid = ipc_fld_u32(f[6]);
+		msg.msg_perm.uid = ipc_fld_u32(f[7]);
+		msg.msg_perm.gid = ipc_fld_u32(f[8]);
+		msg.msg_perm.cuid = ipc_fld_u32(f[9]);
+		msg.msg_perm.cgid = ipc_fld_u32(f[10]);
+		msg.q_stime = ipc_fld_s64(f[11]);
+		msg.q_rtime = ipc_fld_s64(f[12]);
+		msg.q_ctime = ipc_fld_s64(f[13]);
+
+		/* the queue limit is not in /proc */
+		if (id > -1 && msgctl(id, IPC_STAT, &msgseg) != -1)
+			msg.q_qbytes = msgseg.msg_qbytes;
+
 		i++;
+		if (fn(&msg, data) || id > -1)
+			break;
 	}
 
-	if (i == 0)
-		free(*msgds);
-	fclose(f);
+	free(buf);
 	return i;
 
 	/* Fallback; /proc or /sys file(s) missing. */
@@ -426,32 +561,66 @@ msg_fallback:
 		}
 
 		i++;
-		p->msg_perm.key = ipcp->KEY;
-		p->msg_perm.id = msgid;
-		p->msg_perm.mode = ipcp->mode;
-		p->q_cbytes = msgseg.msg_cbytes;
-		p->q_qnum = msgseg.msg_qnum;
-		p->q_lspid = msgseg.msg_lspid;
-		p->q_lrpid = msgseg.msg_lrpid;
-		p->msg_perm.uid = ipcp->uid;
-		p->msg_perm.gid = ipcp->gid;
-		p->msg_perm.cuid = ipcp->cuid;
-		p->msg_perm.cgid = ipcp->cgid;
-		p->q_stime = msgseg.msg_stime;
-		p->q_rtime = msgseg.msg_rtime;
-		p->q_ctime = msgseg.msg_ctime;
-		p->q_qbytes = msgseg.msg_qbytes;
-
-		if (id < 0) {
-			p->next = xcalloc(1, sizeof(struct msg_data));
-			p = p->next;
-			p->next = NULL;
-		} else
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_perm.key = ipcp->KEY;
+		msg.msg_perm.id = msgid;
+		msg.msg_perm.mode = ipcp->mode;
+		msg.q_cbytes = msgseg.msg_cbytes;
+		msg.q_qnum = msgseg.msg_qnum;
+		msg.q_lspid = msgseg.msg_lspid;
+		msg.q_lrpid = msgseg.msg_lrpid;
+		msg.msg_perm.uid = ipcp->uid;
+		msg.msg_perm.gid = ipcp->gid;
+		msg.msg_perm.cuid = ipcp->cuid;
+		msg.msg_perm.cgid = ipcp->cgid;
+		msg.q_stime = msgseg.msg_stime;
+		msg.q_rtime = msgseg.msg_rtime;
+		msg.q_ctime = msgseg.msg_ctime;
+		msg.q_qbytes = msgseg.msg_qbytes;
+
+		if (fn(&msg, data) || id > -1)
 			break;
 	}
 
-	if (i == 0)
-		free(*msgds);
+	return i;
+}
+
+struct msg_collector {
+	struct msg_data *head, *tail;
+};
+
+static int msg_collect(struct msg_data *msg, void *data)
+{
+	struct msg_collector *c = data;
+	struct msg_data *x = xmalloc(sizeof(*x));
+
+	*x = *msg;
+	x->next = NULL;
+	if (c->tail)
+		c->tail->next = x;
+	else
+		c->head = x;
+	c->tail = x;
+	return 0;
+}
+
+/*
+ * Returns the list of the message queues, the list of all queues (@id is -1)
+ * is terminated by an empty element.
+ */
+int ipc_msg_get_info(int id, struct msg_data **msgds)
+{
+	struct msg_collector c = { NULL, NULL };
+	int i;
+
+	i = ipc_msg_foreach(id, msg_collect, &c);
+	if (i < 1) {
+		*msgds = NULL;
+		return 0;
+	}
+	if (id < 0)
+		msg_collect(&(struct msg_data) { .next = NULL }, &c);
+	*msgds = c.head;
 	return i;
 }
 
@@ -464,30 +633,88 @@ void ipc_msg_free_info(struct msg_data *msgds)
 	}
 }
 
+/*
+ * The owners are usually the same for many IPC resources, the names are
+ * cached to avoid getpwuid() and getgrgid() for every line.
+ */
+struct ipc_idname {
+	unsigned int id;
+	char *name;			/* NULL if unknown */
+};
+
+static void *ipc_usernames;		/* tsearch() trees */
+static void *ipc_groupnames;
+
+static int ipc_cmp_idnames(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct ipc_idname *) a)->id,
+			   ((const struct ipc_idname *) b)->id);
+}
+
+static struct ipc_idname *ipc_lookup_idname(void **tree, unsigned int id)
+{
+	struct ipc_idname key = { .id = id }, *x, **node;
+
+	node = tfind(&key, tree, ipc_cmp_idnames);
+	if (node)
+		return *node;
+
+	x = xcalloc(1, sizeof(*x));
+	x->id = id;
+	if (tsearch(x, tree, ipc_cmp_idnames) == NULL)
+		errx(EXIT_FAILURE, _("failed to allocate memory"));
+	return x;
+}
+
+/* returns the user name or NULL, the name is cached, don't free it */
+const char *ipc_get_username(uid_t uid)
+{
+	struct ipc_idname *x = ipc_lookup_idname(&ipc_usernames, uid);
+
+	if (!x->name) {
+		struct passwd *pw = getpwuid(uid);
+
+		x->name = xstrdup(pw ? pw->pw_name : "");
+	}
+	return *x->name ? x->name : NULL;
+}
+
+/* returns the group name or NULL, the name is cached, don't free it */
+const char *ipc_get_groupname(gid_t gid)
+{
+	struct ipc_idname *x = ipc_lookup_idname(&ipc_groupnames, gid);
+
+	if (!x->name) {
+		struct group *gr = getgrgid(gid);
+
+		x->name = xstrdup(gr ? gr->gr_name : "");
+	}
+	return *x->name ? x->name : NULL;
+}
+
 void ipc_print_perms(FILE *f, struct ipc_stat *is)
 {
-	struct passwd *pw;
-	struct group *gr;
+	const char *name;
 
 	fprintf(f, "%-10d %-10o", is->id, is->mode & 0777);
 
-	if ((pw = getpwuid(is->cuid)))
-		fprintf(f, " %-10s", pw->pw_name);
+	if ((name = ipc_get_username(is->cuid)))
+		fprintf(f, " %-10s", name);
 	else
 		fprintf(f, " %-10u", is->cuid);
 
-	if ((gr = getgrgid(is->cgid)))
-		fprintf(f, " %-10s", gr->gr_name);
+	if ((name = ipc_get_groupname(is->cgid)))
+		fprintf(f, " %-10s", name);
 	else
 		fprintf(f, " %-10u", is->cgid);
 
-	if ((pw = getpwuid(is->uid)))
-		fprintf(f, " %-10s", pw->pw_name);
+	if ((name = ipc_get_username(is->uid)))
+		fprintf(f, " %-10s", name);
 	else
 		fprintf(f, " %-10u", is->uid);
 
-	if ((gr = getgrgid(is->gid)))
-		fprintf(f, " %-10s\n", gr->gr_name);
+	if ((name = ipc_get_groupname(is->gid)))
+		fprintf(f, " %-10s\n", name);
 	else
 		fprintf(f, " %-10u\n", is->gid);
 }
@@ -118,6 +118,8 @@ struct ipc_stat {
 	unsigned int	mode;
 };
 
+extern const char *ipc_get_username(uid_t uid);
+extern const char *ipc_get_groupname(gid_t gid);
 extern void ipc_print_perms(FILE *f, struct ipc_stat *is);
 extern void ipc_print_size(int unit, char *msg, uint64_t size, const char *end, int width);
 
@@ -139,6 +141,9 @@ struct shm_data {
 	struct shm_data  *next;
 };
 
+typedef int (*ipc_shm_callback)(struct shm_data *, void *);
+
+extern int ipc_shm_foreach(int id, ipc_shm_callback fn, void *data);
 extern int ipc_shm_get_info(int id, struct shm_data **shmds);
 extern void ipc_shm_free_info(struct shm_data *shmds);
 
@@ -161,6 +166,9 @@ struct sem_data {
 	struct sem_data *next;
 };
 
+typedef int (*ipc_sem_callback)(struct sem_data *, void *);
+
+extern int ipc_sem_foreach(int id, ipc_sem_callback fn, void *data);
 extern int ipc_sem_get_info(int id, struct sem_data **semds);
 extern void ipc_sem_free_info(struct sem_data *semds);
 
@@ -181,6 +189,9 @@ struct msg_data {
 	struct msg_data *next;
 };
 
+typedef int (*ipc_msg_callback)(struct msg_data *, void *);
+
+extern int ipc_msg_foreach(int id, ipc_msg_callback fn, void *data);
 extern int ipc_msg_get_info(int id, struct msg_data **msgds);
 extern void ipc_msg_free_info(struct msg_data *msgds);
 
@@ -21,6 +21,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
 #include <stdbool.h>
@@ -238,112 +239,197 @@ static bool cpu_in_list(int cpu, size_t setsize, cpu_set_t *cpuset)
 	return CPU_ISSET_S(cpu, setsize, cpuset);
 }
 
-/*
- * irqinfo - parse the system's interrupts
- */
-static struct irq_stat *get_irqinfo(int softirq, size_t setsize, cpu_set_t *cpuset)
+static struct irq_stat *new_irqstat(int softirq)
 {
-	FILE *irqfile;
-	char *line = NULL, *tmp;
-	size_t len = 0;
+	const char *path = softirq ? _PATH_PROC_SOFTIRQS : _PATH_PROC_INTERRUPTS;
 	struct irq_stat *stat;
-	struct irq_info *curr;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		warn(_("cannot open %s"), path);
+		return NULL;
+	}
 
-	/* NAME + ':' + 11 bytes/cpu + IRQ_NAME_LEN */
 	stat = xcalloc(1, sizeof(*stat));
+	stat->fd = fd;
+	stat->softirq = softirq ? 1 : 0;
 
-	stat->irq_info = xmalloc(sizeof(*stat->irq_info) * IRQ_INFO_LEN);
+	stat->irq_info = xcalloc(IRQ_INFO_LEN, sizeof(*stat->irq_info));
 	stat->nr_irq_info = IRQ_INFO_LEN;
 
-	if (softirq)
-		irqfile = fopen(_PATH_PROC_SOFTIRQS, "r");
-	else
-		irqfile = fopen(_PATH_PROC_INTERRUPTS, "r");
-	if (!irqfile) {
-		warn(_("cannot open %s"), _PATH_PROC_INTERRUPTS);
-		goto free_stat;
+	stat->bufsz = BUFSIZ;
+	stat->buf = xmalloc(stat->bufsz);
+	return stat;
+}
+
+/* reads the whole file, the buffer is enlarged when necessary */
+static int read_irqfile(struct irq_stat *stat)
+{
+	ssize_t rc;
+
+	while ((rc = pread(stat->fd, stat->buf, stat->bufsz - 1, 0)) >= 0
+	       && (size_t) rc == stat->bufsz - 1) {
+		stat->bufsz *= 2;
+		stat->buf = xrealloc(stat->buf, stat->bufsz);
 	}
+	if (rc < 0)
+		return -errno;
 
-	/* read header firstly */
-	if (getline(&line, &len, irqfile) < 0) {
-		warn(_("cannot read %s"), _PATH_PROC_INTERRUPTS);
-		goto close_file;
+	stat->buf[rc] = '\0';
+	return 0;
+}
+
+/* returns position after the number or NULL if there is no number at @p */
+static char *parse_count(char *p, unsigned long *count)
+{
+	const char *end;
+	uint64_t n;
+
+	while (*p == ' ')
+		p++;
+	if (ul_parse_u64(p, &n, &end) != 0)
+		return NULL;
+
+	*count = n;
+	return (char *) end;
+}
+
+/* returns the next line of the buffer, the current one is terminated */
+static char *next_line(char *line)
+{
+	char *p = strchr(line, '\n');
+
+	if (!p)
+		return NULL;
+	*p++ = '\0';
+	return p;
+}
+
+/*
+ * irqinfo - parse the system's interrupts
+ *
+ * The entries are updated in place and the deltas are computed against the
+ * previous update. The list of the interrupts is usually the same for all
+ * updates, an entry with a different name at the same position is replaced
+ * and it has no delta.
+ */
+static int update_irqinfo(struct irq_stat *stat, size_t setsize, cpu_set_t *cpuset)
+{
+	const char *path = stat->softirq ? _PATH_PROC_SOFTIRQS : _PATH_PROC_INTERRUPTS;
+	char *line, *next, *tmp;
+	size_t nr_cpu = 0, nr = 0, i;
+	int nodelta;
+
+	if (read_irqfile(stat) != 0) {
+		warn(_("cannot read %s"), path);
+		return -1;
 	}
 
-	tmp = line;
-	while ((tmp = strstr(tmp, "CPU")) != NULL) {
-		tmp += 3;	/* skip this "CPU", find next */
-		stat->nr_active_cpu++;
+	/* read header firstly */
+	line = stat->buf;
+	next = next_line(line);
+	for (tmp = line; (tmp = strstr(tmp, "CPU")) != NULL; tmp += 3)
+		nr_cpu++;
+
+	/* the deltas are meaningless for a different set of CPUs */
+	nodelta = !stat->updated || nr_cpu != stat->nr_active_cpu;
+	if (nr_cpu != stat->nr_active_cpu) {
+		free(stat->cpus);
+		stat->cpus = xcalloc(max(nr_cpu, (size_t) 1), sizeof(struct irq_cpu));
+		stat->nr_active_cpu = nr_cpu;
 	}
+	for (i = 0; i < nr_cpu; i++) {
+		struct irq_cpu *cpu = &stat->cpus[i];
 
-	stat->cpus =  xcalloc(stat->nr_active_cpu, sizeof(struct irq_cpu));
+		cpu->delta = cpu->total;	/* previous value */
+		cpu->total = 0;
+	}
+	stat->total_irq = 0;
+	stat->delta_irq = 0;
 
-	/* parse each line of _PATH_PROC_INTERRUPTS */
-	while (getline(&line, &len, irqfile) >= 0) {
-		unsigned long count;
-		size_t index;
-		int length;
+	/* parse each line */
+	for (line = next; line && *line; line = next) {
+		struct irq_info *curr;
+		unsigned long prev = 0;
+		int fresh = 1;
+		char *irq;
 
+		next = next_line(line);
 		tmp = strchr(line, ':');
 		if (!tmp)
 			continue;
+		*tmp++ = '\0';
+		for (irq = line; isspace((unsigned char) *irq); irq++);
 
-		length = strlen(line);
-
-		curr = stat->irq_info + stat->nr_irq++;
-		memset(curr, 0, sizeof(*curr));
-		*tmp = '\0';
-		curr->irq = xstrdup(line);
-		ltrim_whitespace((unsigned char *)curr->irq);
+		if (nr == stat->nr_irq_info) {
+			stat->nr_irq_info *= 2;
+			stat->irq_info = xrealloc(stat->irq_info,
+						  sizeof(*stat->irq_info) * stat->nr_irq_info);
+		}
+		curr = &stat->irq_info[nr];
+		if (nr < stat->nr_irq && strcmp(curr->irq, irq) == 0) {
+			prev = curr->total;
+			fresh = 0;
+		} else {
+			if (nr < stat->nr_irq) {
+				free(curr->irq);
+				free(curr->name);
+			}
+			memset(curr, 0, sizeof(*curr));
+			curr->irq = xstrdup(irq);
+		}
+		nr++;
 
-		tmp += 1;
-		for (index = 0; (index < stat->nr_active_cpu) && (tmp - line < length); index++) {
-			struct irq_cpu *cpu = &stat->cpus[index];
+		curr->total = 0;
+		for (i = 0; i < nr_cpu; i++) {
+			unsigned long count;
+			char *end = parse_count(tmp, &count);
 
-			if (sscanf(tmp, " %10lu", &count) != 1)
-				continue;
-			if (cpu_in_list(index, setsize, cpuset)) {
+			if (!end)
+				break;
+			tmp = end;
+			if (cpu_in_list(i, setsize, cpuset)) {
 				curr->total += count;
-				cpu->total += count;
+				stat->cpus[i].total += count;
 				stat->total_irq += count;
 			}
-
-			tmp += 11;
 		}
+		curr->delta = nodelta || fresh ? 0 : curr->total - prev;
+		stat->delta_irq += curr->delta;
 
 		/* softirq always has no desc, add additional desc for softirq */
-		if (softirq)
-			get_softirq_desc(curr);
-		else {
-			if (tmp - line < length) {
-				/* strip all space before desc */
-				while (isspace(*tmp))
-					tmp++;
-				tmp = remove_repeated_spaces(tmp);
-				rtrim_whitespace((unsigned char *)tmp);
-				curr->name = xstrdup(tmp);
-			} else /* no irq name string, we have to set '\0' here */
-				curr->name = xstrdup("");
+		if (stat->softirq) {
+			if (!curr->name)
+				get_softirq_desc(curr);
+			continue;
 		}
 
-		if (stat->nr_irq == stat->nr_irq_info) {
-			stat->nr_irq_info *= 2;
-			stat->irq_info = xrealloc(stat->irq_info,
-						  sizeof(*stat->irq_info) * stat->nr_irq_info);
+		/* strip all space before desc */
+		while (isspace((unsigned char) *tmp))
+			tmp++;
+		tmp = remove_repeated_spaces(tmp);
+		rtrim_whitespace((unsigned char *)tmp);
+		if (!curr->name || strcmp(curr->name, tmp) != 0) {
+			free(curr->name);
+			curr->name = xstrdup(tmp);
 		}
 	}
-	fclose(irqfile);
-	free(line);
-	return stat;
 
- close_file:
-	fclose(irqfile);
- free_stat:
-	free(stat->irq_info);
-	free(stat->cpus);
-	free(stat);
-	free(line);
-	return NULL;
+	for (i = nr; i < stat->nr_irq; i++) {
+		free(stat->irq_info[i].name);
+		free(stat->irq_info[i].irq);
+	}
+	stat->nr_irq = nr;
+
+	for (i = 0; i < nr_cpu; i++) {
+		struct irq_cpu *cpu = &stat->cpus[i];
+
+		cpu->delta = nodelta ? 0 : cpu->total - cpu->delta;
+	}
+
+	stat->updated = 1;
+	return 0;
 }
 
 void free_irqstat(struct irq_stat *stat)
@@ -358,6 +444,9 @@ void free_irqstat(struct irq_stat *stat)
 		free(stat->irq_info[i].irq);
 	}
 
+	if (stat->fd >= 0)
+		close(stat->fd);
+	free(stat->buf);
 	free(stat->irq_info);
 	free(stat->cpus);
 	free(stat);
@@ -433,7 +522,6 @@ void set_sort_func_by_key(struct irq_output *out, char c)
 }
 
 struct libscols_table *get_scols_cpus_table(struct irq_output *out,
-					struct irq_stat *prev,
 					struct irq_stat *curr,
 					size_t setsize,
 					cpu_set_t *cpuset)
@@ -444,15 +532,6 @@ struct libscols_table *get_scols_cpus_table(struct irq_output *out,
 	char colname[sizeof("cpu") + sizeof(stringify_value(LONG_MAX))];
 	size_t i, j;
 
-	if (prev) {
-		for (i = 0; i < curr->nr_active_cpu; i++) {
-			struct irq_cpu *pre = &prev->cpus[i];
-			struct irq_cpu *cur = &curr->cpus[i];
-
-			cur->delta = cur->total - pre->total;
-		}
-	}
-
 	table = scols_new_table();
 	if (!table) {
 		warn(_("failed to initialize output table"));
@@ -521,52 +600,46 @@ struct libscols_table *get_scols_cpus_table(struct irq_output *out,
 	return NULL;
 }
 
+/*
+ * Reads the interrupts and returns the output table. The @xstat is updated in
+ * place, it's allocated if *@xstat is NULL. The DELTA column and the deltas
+ * are relative to the previous call with the same @xstat.
+ */
 struct libscols_table *get_scols_table(struct irq_output *out,
-					      struct irq_stat *prev,
 					      struct irq_stat **xstat,
 					      int softirq,
 					      size_t setsize,
 					      cpu_set_t *cpuset)
 {
-	struct libscols_table *table;
+	struct libscols_table *table = NULL;
 	struct irq_info *result;
 	struct irq_stat *stat;
 	size_t size;
 	size_t i;
 
 	/* the stats */
-	stat = get_irqinfo(softirq, setsize, cpuset);
-	if (!stat)
-		return NULL;
+	stat = xstat ? *xstat : NULL;
+	if (!stat) {
+		stat = new_irqstat(softirq);
+		if (!stat)
+			return NULL;
+	}
+	if (update_irqinfo(stat, setsize, cpuset) != 0)
+		goto done;
 
 	size = sizeof(*stat->irq_info) * stat->nr_irq;
-	result = xmalloc(size);
+	result = xmalloc(size ? size : 1);
 	memcpy(result, stat->irq_info, size);
 
-	if (prev) {
-		stat->delta_irq = 0;
-		for (i = 0; i < stat->nr_irq; i++) {
-			struct irq_info *cur = &result[i];
-			struct irq_info *pre = &prev->irq_info[i];
-
-			cur->delta = cur->total - pre->total;
-			stat->delta_irq += cur->delta;
-		}
-	}
 	sort_result(out, result, stat->nr_irq);
 
 	table = new_scols_table(out);
-	if (!table) {
-		free(result);
-		free_irqstat(stat);
-		return NULL;
+	if (table) {
+		for (i = 0; i < stat->nr_irq; i++)
+			add_scols_line(out, &result[i], table);
 	}
-
-	for (i = 0; i < stat->nr_irq; i++)
-		add_scols_line(out, &result[i], table);
-
 	free(result);
-
+ done:
 	if (xstat)
 		*xstat = stat;
 	else
@@ -35,6 +35,13 @@ struct irq_stat {
 	size_t nr_active_cpu;		/* number of active cpu */
 	unsigned long total_irq;	/* total irqs */
 	unsigned long delta_irq;	/* delta irqs */
+
+	int fd;				/* /proc/interrupts or /proc/softirqs */
+	char *buf;			/* content of the file */
+	size_t bufsz;
+
+	unsigned int softirq:1,
+		     updated:1;		/* read at least once */
 };
 
 
@@ -62,14 +69,12 @@ void set_sort_func_by_name(struct irq_output *out, const char *name);
 void set_sort_func_by_key(struct irq_output *out, const char c);
 
 struct libscols_table *get_scols_table(struct irq_output *out,
-                                              struct irq_stat *prev,
                                               struct irq_stat **xstat,
                                               int softirq,
                                               size_t setsize,
                                               cpu_set_t *cpuset);
 
 struct libscols_table *get_scols_cpus_table(struct irq_output *out,
-                                        struct irq_stat *prev,
                                         struct irq_stat *curr,
                                         size_t setsize,
                                         cpu_set_t *cpuset);
@@ -83,7 +83,11 @@ struct irqtop_ctl {
 	char		*hostname;
 
 	struct itimerspec timer;
-	struct irq_stat	*prev_stat;
+	struct irq_stat	*stat;		/* updated in place by every refresh */
+
+	char		*prev_cpus;	/* previous output, see scols_print_table_diff() */
+	char		*prev_irqs;
+	int		irqs_row;	/* screen position of irqs table */
 	size_t setsize;
 	cpu_set_t *cpuset;
 
@@ -106,15 +110,48 @@ static void parse_input(struct irqtop_ctl *ctl, struct irq_output *out, char c)
 	}
 }
 
+/* forget the previous output, the next update redraws all screen */
+static void reset_screen(struct irqtop_ctl *ctl)
+{
+	free(ctl->prev_cpus);
+	free(ctl->prev_irqs);
+	ctl->prev_cpus = ctl->prev_irqs = NULL;
+	clear();
+}
+
+struct screen_area {
+	int	row;		/* the first row */
+	int	header;		/* the first line is table header */
+};
+
+/* scols_print_table_diff() callback, redraws one changed line */
+static int draw_line(struct libscols_table *tb __attribute__((__unused__)),
+		     size_t row, const char *line, void *data)
+{
+	struct screen_area *area = (struct screen_area *) data;
+
+	if (move(area->row + row, 0) == ERR)
+		return 0;		/* out of screen */
+	if (line) {
+		if (area->header && row == 0)
+			attron(A_REVERSE);
+		addstr(line);
+		if (area->header && row == 0)
+			attroff(A_REVERSE);
+	}
+	clrtoeol();
+	return 0;
+}
+
 static int update_screen(struct irqtop_ctl *ctl, struct irq_output *out)
 {
 	struct libscols_table *table, *cpus = NULL;
-	struct irq_stat *stat;
 	time_t now = time(NULL);
-	char timestr[64], *data, *data0, *p;
+	char timestr[64];
+	struct screen_area area = { .row = 2 };
 
 	/* make irqs table */
-	table = get_scols_table(out, ctl->prev_stat, &stat, ctl->softirq, ctl->setsize,
+	table = get_scols_table(out, &ctl->stat, ctl->softirq, ctl->setsize,
 				ctl->cpuset);
 	if (!table) {
 		ctl->request_exit = 1;
@@ -126,7 +163,7 @@ static int update_screen(struct irqtop_ctl *ctl, struct irq_output *out)
 
 	/* make cpus table */
 	if (ctl->cpustat_mode != IRQTOP_CPUSTAT_DISABLE) {
-		cpus = get_scols_cpus_table(out, ctl->prev_stat, stat, ctl->setsize,
+		cpus = get_scols_cpus_table(out, ctl->stat, ctl->setsize,
 					    ctl->cpuset);
 		scols_table_reduce_termwidth(cpus, 1);
 		if (ctl->cpustat_mode == IRQTOP_CPUSTAT_AUTO)
@@ -136,38 +173,40 @@ static int update_screen(struct irqtop_ctl *ctl, struct irq_output *out)
 	/* print header */
 	move(0, 0);
 	strtime_iso(&now, ISO_TIMESTAMP, timestr, sizeof(timestr));
-	wprintw(ctl->win, _("irqtop | total: %ld delta: %ld | %s | %s\n\n"),
-			   stat->total_irq, stat->delta_irq, ctl->hostname, timestr);
+	wprintw(ctl->win, _("irqtop | total: %ld delta: %ld | %s | %s"),
+			   ctl->stat->total_irq, ctl->stat->delta_irq, ctl->hostname, timestr);
+	clrtoeol();
 
-	/* print cpus table or not by -c option */
+	/* print cpus table or not by -c option; only the changed lines are
+	 * redrawn */
 	if (cpus) {
-		scols_print_table_to_string(cpus, &data);
-		wprintw(ctl->win, "%s\n\n", data);
-		free(data);
+		char *p;
+
+		scols_print_table_diff(cpus, &ctl->prev_cpus, draw_line, &area);
+		area.row++;
+		for (p = ctl->prev_cpus; p && *p; p++) {
+			if (*p == '\n')
+				area.row++;
+		}
+		area.row++;		/* empty line */
+		scols_unref_table(cpus);
 	}
 
-	/* print irqs table */
-	scols_print_table_to_string(table, &data0);
-	data = data0;
-
-	p = strchr(data, '\n');
-	if (p) {
-		/* print header in reverse mode */
-		*p = '\0';
-		attron(A_REVERSE);
-		wprintw(ctl->win, "%s\n", data);
-		attroff(A_REVERSE);
-		data = p + 1;
+	/* the irqs table moved, redraw all */
+	if (area.row != ctl->irqs_row) {
+		ctl->irqs_row = area.row;
+		free(ctl->prev_irqs);
+		ctl->prev_irqs = NULL;
+		move(area.row - 1, 0);
+		clrtobot();
 	}
 
-	wprintw(ctl->win, "%s", data);
-	free(data0);
+	/* print irqs table, header in reverse mode */
+	area.header = !scols_table_is_noheadings(table);
+	scols_print_table_diff(table, &ctl->prev_irqs, draw_line, &area);
 
 	/* clean up */
 	scols_unref_table(table);
-	if (ctl->prev_stat)
-		free_irqstat(ctl->prev_stat);
-	ctl->prev_stat = stat;
 	return 0;
 }
 
@@ -236,6 +275,7 @@ static int event_loop(struct irqtop_ctl *ctl, struct irq_output *out)
 #if HAVE_RESIZETERM
 					resizeterm(ctl->rows, ctl->cols);
 #endif
+					reset_screen(ctl);
 				}
 				else {
 					ctl->request_exit = 1;
@@ -408,7 +448,9 @@ int main(int argc, char **argv)
 	ctl.hostname = xgethostname();
 	event_loop(&ctl, &out);
 
-	free_irqstat(ctl.prev_stat);
+	free_irqstat(ctl.stat);
+	free(ctl.prev_cpus);
+	free(ctl.prev_irqs);
 	free(ctl.hostname);
 	cpuset_free(ctl.cpuset);
 
@@ -26,6 +26,7 @@
 #include "xalloc.h"
 #include "canonicalize.h"
 #include "pathnames.h"
+#include "jobs.h"
 
 enum {
 	A_CREATE = 1,		/* setup a new device */
@@ -37,6 +38,7 @@ enum {
 	A_SET_CAPACITY,		/* set device capacity */
 	A_SET_DIRECT_IO,	/* set accessing backing file by direct io */
 	A_SET_BLOCKSIZE,	/* set logical block size of the loop device */
+	A_BATCH,		/* setup devices for files from a file */
 };
 
 enum {
@@ -414,6 +416,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -c, --set-capacity <loopdev>  resize the device\n"), out);
 	fputs(_(" -j, --associated <file>       list all devices associated with <file>\n"), out);
 	fputs(_(" -L, --nooverlap               avoid possible conflict between devices\n"), out);
+	fputs(_("     --batch <file>            set up devices for all files listed in <file>\n"), out);
 
 	/* commands options */
 	fputs(USAGE_SEPARATOR, out);
@@ -424,6 +427,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -r, --read-only               set up a read-only loop device\n"), out);
 	fputs(_("     --direct-io[=<on|off>]    open backing file with O_DIRECT\n"), out);
 	fputs(_("     --show                    print device name after setup (with -f)\n"), out);
+	fputs(_("     --jobs <num>              number of parallel setups (with --batch)\n"), out);
 	fputs(_(" -v, --verbose                 verbose mode\n"), out);
 
 	/* output options */
@@ -476,7 +480,7 @@ static int create_loop(struct loopdev_cxt *lc,
 		       uint64_t blocksize)
 {
 	int hasdev = loopcxt_has_device(lc);
-	int rc = 0, ntries = 0;
+	int rc = 0;
 
 	/* losetup --find --noverlap file.img */
 	if (!hasdev && nooverlap) {
@@ -573,11 +577,9 @@ static int create_loop(struct loopdev_cxt *lc,
 		if (rc == 0)
 			break;			/* success */
 
-		if ((errno == EBUSY || errno == EAGAIN) && !hasdev && ntries < 64) {
-			xusleep(200000);
-			ntries++;
+		if ((errno == EBUSY || errno == EAGAIN) && !hasdev
+		    && loopcxt_retry_setup(lc) == 0)
 			continue;
-		}
 
 		/* errors */
 		errpre = hasdev && loopcxt_get_fd(lc) < 0 ?
@@ -589,6 +591,176 @@ static int create_loop(struct loopdev_cxt *lc,
 	return rc;
 }
 
+/*
+ * losetup --batch <file>
+ *
+ * The <file> contains lines "<file> [<offset> [<sizelimit> [<flags>]]]",
+ * where "-" means the default from the command line and flags is a comma
+ * separated list of "ro", "partscan", "dio" and "nodio". All the devices are
+ * set up by one process, every thread keeps its loopcxt for all its files.
+ */
+struct batch_loop {
+	char		*file;
+	uint64_t	offset;
+	uint64_t	sizelimit;
+	int		flags;		/* LOOPDEV_FL_{OFFSET,SIZELIMIT} */
+	int		lo_flags;	/* LO_FLAGS_* */
+
+	char		*device;	/* result */
+	int		rc;
+};
+
+struct batch_setup {
+	struct batch_loop *loops;
+	size_t		nloops;
+	size_t		next;		/* next loop to set up, atomic */
+	uint64_t	blocksize;
+};
+
+static int parse_batch_flags(const char *str, int *lo_flags)
+{
+	char *buf = xstrdup(str), *tok, *save = NULL;
+	int rc = 0;
+
+	for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (strcmp(tok, "ro") == 0)
+			*lo_flags |= LO_FLAGS_READ_ONLY;
+		else if (strcmp(tok, "partscan") == 0)
+			*lo_flags |= LO_FLAGS_PARTSCAN;
+		else if (strcmp(tok, "dio") == 0)
+			*lo_flags |= LO_FLAGS_DIRECT_IO;
+		else if (strcmp(tok, "nodio") == 0)
+			*lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		else {
+			rc = -EINVAL;
+			break;
+		}
+	}
+	free(buf);
+	return rc;
+}
+
+static void read_batch(struct batch_setup *bs, const char *filename,
+		       int lo_flags, int flags, uint64_t offset, uint64_t sizelimit)
+{
+	FILE *f = stdin;
+	char *line = NULL;
+	size_t sz = 0, nalloc = 0;
+	unsigned int lineno = 0;
+
+	if (strcmp(filename, "-") != 0) {
+		f = fopen(filename, "r" UL_CLOEXECSTR);
+		if (!f)
+			err(EXIT_FAILURE, _("cannot open %s"), filename);
+	}
+
+	while (getline(&line, &sz, f) != -1) {
+		char *fields[4] = { NULL }, *p, *save = NULL;
+		struct batch_loop *bl;
+		size_t i = 0;
+
+		lineno++;
+		for (p = strtok_r(line, " \t\n", &save); p;
+		     p = strtok_r(NULL, " \t\n", &save)) {
+			if (*p == '#')
+				break;
+			if (i == ARRAY_SIZE(fields))
+				errx(EXIT_FAILURE, _("%s:%u: too many fields"),
+						filename, lineno);
+			fields[i++] = p;
+		}
+		if (!i)
+			continue;	/* empty line or comment */
+
+		if (bs->nloops == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 32;
+			bs->loops = xrealloc(bs->loops, nalloc * sizeof(struct batch_loop));
+		}
+		bl = &bs->loops[bs->nloops++];
+		memset(bl, 0, sizeof(*bl));
+
+		bl->file = xstrdup(fields[0]);
+		bl->lo_flags = lo_flags;
+		bl->flags = flags;
+		bl->offset = offset;
+		bl->sizelimit = sizelimit;
+
+		if (fields[1] && strcmp(fields[1], "-") != 0) {
+			if (strtosize(fields[1], &bl->offset))
+				errx(EXIT_FAILURE, _("%s:%u: failed to parse offset"),
+						filename, lineno);
+			bl->flags |= LOOPDEV_FL_OFFSET;
+		}
+		if (fields[2] && strcmp(fields[2], "-") != 0) {
+			if (strtosize(fields[2], &bl->sizelimit))
+				errx(EXIT_FAILURE, _("%s:%u: failed to parse size"),
+						filename, lineno);
+			bl->flags |= LOOPDEV_FL_SIZELIMIT;
+		}
+		if (fields[3] && strcmp(fields[3], "-") != 0
+		    && parse_batch_flags(fields[3], &bl->lo_flags))
+			errx(EXIT_FAILURE, _("%s:%u: unsupported flags: %s"),
+					filename, lineno, fields[3]);
+	}
+
+	free(line);
+	if (f != stdin)
+		fclose(f);
+}
+
+static void *batch_worker(void *data)
+{
+	struct batch_setup *bs = data;
+	struct loopdev_cxt lc;
+	size_t i;
+
+	if (loopcxt_init(&lc, 0))
+		err(EXIT_FAILURE, _("failed to initialize loopcxt"));
+
+	while ((i = __atomic_fetch_add(&bs->next, 1, __ATOMIC_RELAXED)) < bs->nloops) {
+		struct batch_loop *bl = &bs->loops[i];
+
+		/* forget the previous device, create_loop() would reuse it */
+		ignore_result( loopcxt_set_device(&lc, NULL) );
+
+		bl->rc = create_loop(&lc, 0, bl->lo_flags, bl->flags, bl->file,
+				     bl->offset, bl->sizelimit, bs->blocksize);
+		if (bl->rc == 0)
+			bl->device = loopcxt_strdup_device(&lc);
+	}
+
+	loopcxt_deinit(&lc);
+	return NULL;
+}
+
+static int setup_batch(const char *filename, size_t jobs,
+		       int lo_flags, int flags, uint64_t offset,
+		       uint64_t sizelimit, uint64_t blocksize)
+{
+	struct batch_setup bs = { .blocksize = blocksize };
+	size_t i;
+	int nfails = 0;
+
+	read_batch(&bs, filename, lo_flags, flags, offset, sizelimit);
+
+	ul_run_jobs(min(jobs, bs.nloops), batch_worker, &bs, 0);
+
+	for (i = 0; i < bs.nloops; i++) {
+		struct batch_loop *bl = &bs.loops[i];
+
+		if (bl->rc == 0) {
+			printf("%s %s\n", bl->device, bl->file);
+			warn_size(bl->file, bl->sizelimit, bl->offset, bl->flags);
+		} else
+			nfails++;
+		free(bl->device);
+		free(bl->file);
+	}
+	free(bs.loops);
+
+	return nfails ? -1 : 0;
+}
+
 int main(int argc, char **argv)
 {
 	struct loopdev_cxt lc;
@@ -596,8 +768,9 @@ int main(int argc, char **argv)
 	char *file = NULL;
 	uint64_t offset = 0, sizelimit = 0, blocksize = 0;
 	int res = 0, showdev = 0, lo_flags = 0;
-	char *outarg = NULL;
+	char *outarg = NULL, *batchfile = NULL;
 	int list = 0;
+	size_t jobs = 1;
 	unsigned long use_dio = 0, set_dio = 0, set_blocksize = 0;
 
 	enum {
@@ -605,10 +778,13 @@ int main(int argc, char **argv)
 		OPT_SHOW,
 		OPT_RAW,
 		OPT_DIO,
-		OPT_OUTPUT_ALL
+		OPT_OUTPUT_ALL,
+		OPT_BATCH,
+		OPT_JOBS
 	};
 	static const struct option longopts[] = {
 		{ "all",          no_argument,       NULL, 'a'           },
+		{ "batch",        required_argument, NULL, OPT_BATCH     },
 		{ "set-capacity", required_argument, NULL, 'c'           },
 		{ "detach",       required_argument, NULL, 'd'           },
 		{ "detach-all",   no_argument,       NULL, 'D'           },
@@ -616,6 +792,7 @@ int main(int argc, char **argv)
 		{ "nooverlap",    no_argument,       NULL, 'L'           },
 		{ "help",         no_argument,       NULL, 'h'           },
 		{ "associated",   required_argument, NULL, 'j'           },
+		{ "jobs",         required_argument, NULL, OPT_JOBS      },
 		{ "json",         no_argument,       NULL, 'J'           },
 		{ "list",         no_argument,       NULL, 'l'           },
 		{ "sector-size",  required_argument, NULL, 'b'      },
@@ -635,10 +812,11 @@ int main(int argc, char **argv)
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
-		{ 'D','a','c','d','f','j' },
-		{ 'D','c','d','f','l' },
-		{ 'D','c','d','f','O' },
+		{ 'D','a','c','d','f','j',OPT_BATCH },
+		{ 'D','c','d','f','l',OPT_BATCH },
+		{ 'D','c','d','f','O',OPT_BATCH },
 		{ 'J',OPT_RAW },
+		{ 'L',OPT_BATCH },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -660,6 +838,15 @@ int main(int argc, char **argv)
 		case 'a':
 			act = A_SHOW;
 			break;
+		case OPT_BATCH:
+			act = A_BATCH;
+			batchfile = optarg;
+			break;
+		case OPT_JOBS:
+			jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'b':
 			set_blocksize = 1;
 			blocksize = strtosize_or_err(optarg, _("failed to parse logical block size"));
@@ -829,14 +1016,17 @@ int main(int argc, char **argv)
 		file = argv[optind++];
 	}
 
-	if (act != A_CREATE &&
+	if (act == A_BATCH && optind < argc)
+		errx(EXIT_FAILURE, _("unexpected arguments"));
+
+	if (act != A_CREATE && act != A_BATCH &&
 	    (sizelimit || lo_flags || showdev))
 		errx(EXIT_FAILURE,
 			_("the options %s are allowed during loop device setup only"),
 			"--{sizelimit,partscan,read-only,show}");
 
 	if ((flags & LOOPDEV_FL_OFFSET) &&
-	    act != A_CREATE && (act != A_SHOW || !file))
+	    act != A_CREATE && act != A_BATCH && (act != A_SHOW || !file))
 		errx(EXIT_FAILURE, _("the option --offset is not allowed in this context"));
 
 	if (outarg && string_add_to_idarray(outarg, columns, ARRAY_SIZE(columns),
@@ -853,6 +1043,10 @@ int main(int argc, char **argv)
 			warn_size(file, sizelimit, offset, flags);
 		}
 		break;
+	case A_BATCH:
+		res = setup_batch(batchfile, jobs, lo_flags, flags,
+				  offset, sizelimit, blocksize);
+		break;
 	case A_DELETE:
 		res = delete_loop(&lc);
 		while (optind < argc) {
@@ -138,9 +138,9 @@ static void fprintf_cputypes(FILE *f, struct lscpu_cxt *cxt)
 
 enum {
 	CPUINFO_LINE_UNKNOWN,	/* unknown line */
-	CPUINFO_LINE_CPUTYPE,	/* line found in type_patterns[] */
-	CPUINFO_LINE_CPU,	/* line found in cpu_patterns[] */
-	CPUINFO_LINE_CACHE	/* line found in cache_pattern[] */
+	CPUINFO_LINE_CPUTYPE,	/* lscpu_cputype field */
+	CPUINFO_LINE_CPU,	/* lscpu_cpu field */
+	CPUINFO_LINE_CACHE	/* extra cache line */
 };
 
 /* Describes /proc/cpuinfo fields */
@@ -188,9 +188,33 @@ enum {
 		.offset = offsetof(struct lscpu_cputype, _member), \
 	}
 
-static const struct cpuinfo_pattern type_patterns[] =
+/*
+ * /proc/cpuinfo to lscpu_cpu conversion
+ */
+#define DEF_PAT_CPU(_str, _id, _member) \
+	{ \
+		.id = (_id), \
+		.domain = CPUINFO_LINE_CPU, \
+		.pattern = (_str), \
+		.offset = offsetof(struct lscpu_cpu, _member), \
+	}
+
+/*
+ * /proc/cpuinfo to lscpu_cache conversion
+ */
+#define DEF_PAT_CACHE(_str, _id) \
+	{ \
+		.id = (_id), \
+		.domain = CPUINFO_LINE_CACHE, \
+		.pattern = (_str) \
+	}
+
+/*
+ * All the fields in one table, so every line is resolved by one lookup.
+ */
+static const struct cpuinfo_pattern patterns[] =
 {
-	/* Sort by fields name! */
+	/* Sort by fields name (strcmp() order)! */
 	DEF_PAT_CPUTYPE( "ASEs implemented",	PAT_FLAGS,	flags),		/* mips */
 	DEF_PAT_CPUTYPE( "BogoMIPS",		PAT_BOGOMIPS,	bogomips),	/* aarch64 */
 	DEF_PAT_CPUTYPE( "CPU implementer",	PAT_IMPLEMENTER,vendor),	/* ARM and aarch64 */
@@ -199,16 +223,23 @@ static const struct cpuinfo_pattern type_patterns[] =
 	DEF_PAT_CPUTYPE( "CPU variant",		PAT_VARIANT,	stepping),	/* aarch64 */
 	DEF_PAT_CPUTYPE( "Features",		PAT_FEATURES,	flags),		/* aarch64 */
 	DEF_PAT_CPUTYPE( "address sizes",	PAT_ADDRESS_SIZES,	addrsz),/* x86 */
+	DEF_PAT_CPU(     "bogomips",		PAT_BOGOMIPS_CPU, bogomips),
 	DEF_PAT_CPUTYPE( "bogomips per cpu",	PAT_BOGOMIPS,	bogomips),	/* s390 */
+	DEF_PAT_CACHE(   "cache",		PAT_CACHE),
 	DEF_PAT_CPUTYPE( "cpu",			PAT_CPU,	modelname),	/* ppc, sparc */
+	DEF_PAT_CPU(     "cpu MHz",		PAT_MHZ,	mhz),
+	DEF_PAT_CPU(     "cpu MHz dynamic",	PAT_MHZ_DYNAMIC, dynamic_mhz),	/* s390 */
+	DEF_PAT_CPU(     "cpu MHz static",	PAT_MHZ_STATIC,	static_mhz),	/* s390 */
 	DEF_PAT_CPUTYPE( "cpu family",		PAT_FAMILY,	family),
 	DEF_PAT_CPUTYPE( "cpu model",		PAT_MODEL,	model),		/* mips */
+	DEF_PAT_CPU(     "cpu number",		PAT_PROCESSOR,	logical_id),	/* s390 */
 	DEF_PAT_CPUTYPE( "family",		PAT_FAMILY,	family),
 	DEF_PAT_CPUTYPE( "features",		PAT_FEATURES,	flags),		/* s390 */
 	DEF_PAT_CPUTYPE( "flags",		PAT_FLAGS,	flags),		/* x86 */
 	DEF_PAT_CPUTYPE( "max thread id",	PAT_MAX_THREAD_ID, mtid),	/* s390 */
 	DEF_PAT_CPUTYPE( "model",		PAT_MODEL,	model),
 	DEF_PAT_CPUTYPE( "model name",		PAT_MODEL_NAME,	modelname),
+	DEF_PAT_CPU(     "processor",		PAT_PROCESSOR,	logical_id),
 	DEF_PAT_CPUTYPE( "revision",		PAT_REVISION,	revision),
 	DEF_PAT_CPUTYPE( "stepping",		PAT_STEPPING,	stepping),
 	DEF_PAT_CPUTYPE( "type",		PAT_TYPE,	flags),		/* sparc64 */
@@ -216,53 +247,21 @@ static const struct cpuinfo_pattern type_patterns[] =
 	DEF_PAT_CPUTYPE( "vendor_id",		PAT_VENDOR,	vendor),	/* s390 */
 };
 
-/*
- * /proc/cpuinfo to lscpu_cpu conversion
- */
-#define DEF_PAT_CPU(_str, _id, _member) \
-	{ \
-		.id = (_id), \
-		.domain = CPUINFO_LINE_CPU, \
-		.pattern = (_str), \
-		.offset = offsetof(struct lscpu_cpu, _member), \
-	}
-
-static const struct cpuinfo_pattern cpu_patterns[] =
-{
-	/* Sort by fields name! */
-	DEF_PAT_CPU( "bogomips",	PAT_BOGOMIPS_CPU, bogomips),
-	DEF_PAT_CPU( "cpu MHz",		PAT_MHZ,          mhz),
-	DEF_PAT_CPU( "cpu MHz dynamic",	PAT_MHZ_DYNAMIC,  dynamic_mhz),	/* s390 */
-	DEF_PAT_CPU( "cpu MHz static",	PAT_MHZ_STATIC,   static_mhz),	/* s390 */
-	DEF_PAT_CPU( "cpu number",	PAT_PROCESSOR,    logical_id),	/* s390 */
-	DEF_PAT_CPU( "processor",	PAT_PROCESSOR,    logical_id),
-
+/* field name as found in the line, not terminated */
+struct cpuinfo_key {
+	const char *name;
+	size_t namesz;
 };
 
-/*
- * /proc/cpuinfo to lscpu_cache conversion
- */
-#define DEF_PAT_CACHE(_str, _id) \
-	{ \
-		.id = (_id), \
-		.domain = CPUINFO_LINE_CACHE, \
-		.pattern = (_str) \
-	}
-
-static const struct cpuinfo_pattern cache_patterns[] =
+static int cmp_pattern(const void *k0, const void *p0)
 {
-	/* Sort by fields name! */
-	DEF_PAT_CACHE("cache",	PAT_CACHE),
-};
-
-#define CPUTYPE_PATTERN_BUFSZ	32
+	const struct cpuinfo_key *k = (const struct cpuinfo_key *) k0;
+	const struct cpuinfo_pattern *p = (const struct cpuinfo_pattern *) p0;
+	int rc = strncmp(k->name, p->pattern, k->namesz);
 
-static int cmp_pattern(const void *a0, const void *b0)
-{
-	const struct cpuinfo_pattern
-		*a = (const struct cpuinfo_pattern *) a0,
-		*b = (const struct cpuinfo_pattern *) b0;
-	return strcmp(a->pattern, b->pattern);
+	if (rc == 0 && p->pattern[k->namesz])
+		rc = -1;	/* the key is a prefix of the pattern */
+	return rc;
 }
 
 struct cpuinfo_parser {
@@ -287,49 +286,56 @@ static int is_different_cputype(struct lscpu_cputype *ct, size_t offset, const c
 	return 0;
 }
 
-/* canonicalize @str -- remove number at the end return the
+/* canonicalize @key -- remove number at the end return the
  * number by @keynum. This is usable for example for "processor 5" or "cache1"
  * cpuinfo lines */
-static char *key_cleanup(char *str, int *keynum)
+static void key_cleanup(struct cpuinfo_key *key, int *keynum)
 {
-	size_t sz = rtrim_whitespace((unsigned char *)str);
+	const char *str = key->name;
+	size_t sz = key->namesz;
 	size_t i;
 
+	while (sz && isspace((unsigned char) str[sz - 1]))
+		sz--;
+	key->namesz = sz;
 	if (!sz)
-		return str;
+		return;
 
 	for (i = sz; i > 0; i--) {
-		if (!isdigit(str[i - 1]))
+		if (!isdigit((unsigned char) str[i - 1]))
 			break;
 	}
 
 	if (i < sz) {
-		char *end = NULL, *p = str + i;
+		char *end = NULL;
+		const char *p = str + i;
 		int n;
 
 		errno = 0;
 		n = strtol(p, &end, 10);
 		if (errno || !end || end == p)
-			return str;
+			return;
 
 		*keynum = n;
-		str[i] = '\0';
-		rtrim_whitespace((unsigned char *)str);
+		while (i && isspace((unsigned char) str[i - 1]))
+			i--;
+		key->namesz = i;
 	}
-	return str;
 }
 
+/* The line is not modified nor copied, only the value is right-trimmed. */
 static const struct cpuinfo_pattern *cpuinfo_parse_line(char *str, char **value, int *keynum)
 {
-	struct cpuinfo_pattern key = { .id = 0 }, *pat;
-	char *p, *v;
-	char buf[CPUTYPE_PATTERN_BUFSZ] = { 0 };
+	const struct cpuinfo_pattern *pat;
+	struct cpuinfo_key key;
+	const char *p;
+	char *v;
 
 	DBG(GATHER, ul_debug("parse \"%s\"", str));
 
 	if (!str || !*str)
 		return NULL;
-	p = (char *) skip_blank(str);
+	p = skip_blank(str);
 	if (!p || !*p)
 		return NULL;
 
@@ -337,9 +343,9 @@ static const struct cpuinfo_pattern *cpuinfo_parse_line(char *str, char **value,
 	if (!v || !*v)
 		return NULL;
 
-	/* prepare name of the field */
-	xstrncpy(buf, p, sizeof(buf));
-	buf[v - p] = '\0';
+	/* name of the field */
+	key.name = p;
+	key.namesz = v - p;
 	v++;
 
 	/* prepare value */
@@ -347,30 +353,15 @@ static const struct cpuinfo_pattern *cpuinfo_parse_line(char *str, char **value,
 	if (!v || !*v)
 		return NULL;
 
-	key.pattern = key_cleanup(buf, keynum);
-	/* CPU-type */
-	if ((pat = bsearch(&key, type_patterns,
-			ARRAY_SIZE(type_patterns),
-			sizeof(struct cpuinfo_pattern),
-			cmp_pattern)))
-		goto found;
-
-	/* CPU */
-	if ((pat = bsearch(&key, cpu_patterns,
-			ARRAY_SIZE(cpu_patterns),
-			sizeof(struct cpuinfo_pattern),
-			cmp_pattern)))
-		goto found;
-
-	/* CACHE */
-	if ((pat = bsearch(&key, cache_patterns,
-			ARRAY_SIZE(cache_patterns),
-			sizeof(struct cpuinfo_pattern),
-			cmp_pattern)))
-		goto found;
-
-	return NULL;
-found:
+	key_cleanup(&key, keynum);
+	if (!key.namesz)
+		return NULL;
+
+	pat = bsearch(&key, patterns, ARRAY_SIZE(patterns),
+			sizeof(struct cpuinfo_pattern), cmp_pattern);
+	if (!pat)
+		return NULL;
+
 	rtrim_whitespace((unsigned char *) v);
 	*value = v;
 	return pat;
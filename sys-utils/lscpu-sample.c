@@ -0,0 +1,367 @@
+/*
+ * lscpu --sample -- print per-socket and per-core utilization and frequency
+ *                   periodically
+ *
+ * All the files are opened only once, every sample rereads them by pread().
+ * The utilization is computed from /proc/stat counters of the CPUs, the
+ * frequency is cpufreq/scaling_cur_freq averaged over the CPUs of the core
+ * or socket.
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libsmartcols.h>
+
+#include "lscpu.h"
+#include "strutils.h"
+
+struct sample_cpu {
+	struct lscpu_cpu *cpu;
+
+	int	freq_fd;		/* cpuN/cpufreq/scaling_cur_freq or -1 */
+	float	mhz;			/* current frequency or 0 */
+
+	uint64_t busy, total;		/* counters from /proc/stat */
+	uint64_t dbusy, dtotal;		/* difference to the previous sample */
+
+	unsigned int has_stat : 1;	/* found in /proc/stat */
+};
+
+struct sampler {
+	struct lscpu_cxt *cxt;
+
+	struct sample_cpu *cpus;	/* online CPUs sorted by socket and core */
+	size_t ncpus;
+	struct sample_cpu **byid;	/* indexed by logical ID */
+
+	int	stat_fd;		/* /proc/stat */
+	char	*buf;			/* /proc/stat content */
+	size_t	bufsz;
+
+	size_t	setbufsz;
+	char	*setbuf;		/* for cpulist_create() */
+	cpu_set_t *set;
+};
+
+enum {
+	COL_SAMPLE_NAME,
+	COL_SAMPLE_CPUS,
+	COL_SAMPLE_MHZ,
+	COL_SAMPLE_UTIL
+};
+
+static int cmp_sample_cpus(const void *a0, const void *b0)
+{
+	const struct lscpu_cpu
+		*a = ((const struct sample_cpu *) a0)->cpu,
+		*b = ((const struct sample_cpu *) b0)->cpu;
+	int rc = cmp_numbers(a->socketid, b->socketid);
+
+	if (!rc)
+		rc = cmp_numbers(a->coreid, b->coreid);
+	if (!rc)
+		rc = cmp_numbers(a->logical_id, b->logical_id);
+	return rc;
+}
+
+static void sampler_init(struct sampler *sm, struct lscpu_cxt *cxt)
+{
+	size_t i;
+
+	memset(sm, 0, sizeof(*sm));
+	sm->cxt = cxt;
+
+	sm->stat_fd = ul_path_open(cxt->procfs, O_RDONLY | O_CLOEXEC, "stat");
+	if (sm->stat_fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), "/proc/stat");
+
+	sm->bufsz = 4096 + 256 * cxt->npossibles;
+	sm->buf = xmalloc(sm->bufsz);
+
+	sm->cpus = xcalloc(cxt->npossibles ? cxt->npossibles : 1, sizeof(struct sample_cpu));
+	sm->byid = xcalloc(cxt->maxcpus, sizeof(struct sample_cpu *));
+
+	for (i = 0; i < cxt->npossibles; i++) {
+		struct lscpu_cpu *cpu = cxt->cpus[i];
+		struct sample_cpu *sc;
+
+		if (!cpu || !is_cpu_online(cxt, cpu))
+			continue;
+		sc = &sm->cpus[sm->ncpus++];
+		sc->cpu = cpu;
+		sc->freq_fd = ul_path_openf(cxt->syscpu, O_RDONLY | O_CLOEXEC,
+					"cpu%d/cpufreq/scaling_cur_freq", cpu->logical_id);
+	}
+
+	qsort(sm->cpus, sm->ncpus, sizeof(struct sample_cpu), cmp_sample_cpus);
+	for (i = 0; i < sm->ncpus; i++)
+		sm->byid[sm->cpus[i].cpu->logical_id] = &sm->cpus[i];
+
+	sm->set = cpuset_alloc(cxt->maxcpus, NULL, NULL);
+	if (!sm->set)
+		err(EXIT_FAILURE, _("failed to callocate cpu set"));
+	sm->setbufsz = 7 * cxt->maxcpus;
+	sm->setbuf = xmalloc(sm->setbufsz);
+}
+
+static void sampler_deinit(struct sampler *sm)
+{
+	size_t i;
+
+	for (i = 0; i < sm->ncpus; i++) {
+		if (sm->cpus[i].freq_fd >= 0)
+			close(sm->cpus[i].freq_fd);
+	}
+	if (sm->stat_fd >= 0)
+		close(sm->stat_fd);
+
+	cpuset_free(sm->set);
+	free(sm->setbuf);
+	free(sm->cpus);
+	free(sm->byid);
+	free(sm->buf);
+}
+
+/* reads whole /proc/stat, the buffer is enlarged when necessary */
+static int sampler_read_stat(struct sampler *sm)
+{
+	ssize_t rc;
+
+	while ((rc = pread(sm->stat_fd, sm->buf, sm->bufsz - 1, 0)) >= 0
+	       && (size_t) rc == sm->bufsz - 1) {
+		sm->bufsz *= 2;
+		sm->buf = xrealloc(sm->buf, sm->bufsz);
+	}
+	if (rc < 0)
+		return -errno;
+
+	sm->buf[rc] = '\0';
+	return 0;
+}
+
+/*
+ * The line is "cpuN user nice system idle iowait irq softirq steal ...", the
+ * guest times are already included in user and nice.
+ */
+static void sampler_parse_stat_line(struct sampler *sm, const char *line)
+{
+	struct sample_cpu *sc;
+	uint64_t val[8] = { 0 }, busy, total;
+	char *end = NULL;
+	unsigned long id;
+	size_t i;
+
+	errno = 0;
+	id = strtoul(line + 3, &end, 10);
+	if (errno || end == line + 3 || id >= (unsigned long) sm->cxt->maxcpus)
+		return;
+	sc = sm->byid[id];
+	if (!sc)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(val); i++) {
+		const char *p = end;
+
+		val[i] = strtoull(p, &end, 10);
+		if (end == p)
+			break;
+	}
+
+	total = val[0] + val[1] + val[2] + val[3] + val[4] + val[5] + val[6] + val[7];
+	busy = total - val[3] - val[4];		/* without idle and iowait */
+
+	if (sc->has_stat && total >= sc->total && busy >= sc->busy) {
+		sc->dbusy = busy - sc->busy;
+		sc->dtotal = total - sc->total;
+	} else
+		sc->dbusy = sc->dtotal = 0;
+
+	sc->busy = busy;
+	sc->total = total;
+	sc->has_stat = 1;
+}
+
+static void sampler_read(struct sampler *sm)
+{
+	char *p;
+	size_t i;
+
+	for (i = 0; i < sm->ncpus; i++) {
+		struct sample_cpu *sc = &sm->cpus[i];
+		char buf[32], *end = NULL;
+		ssize_t rc;
+		long khz;
+
+		sc->mhz = 0;
+		if (sc->freq_fd < 0)
+			continue;
+		rc = pread(sc->freq_fd, buf, sizeof(buf) - 1, 0);
+		if (rc <= 0)
+			continue;
+		buf[rc] = '\0';
+
+		errno = 0;
+		khz = strtol(buf, &end, 10);
+		if (!errno && end != buf && khz > 0)
+			sc->mhz = (float) khz / 1000;
+	}
+
+	if (sampler_read_stat(sm) != 0) {
+		warn(_("cannot read %s"), "/proc/stat");
+		return;
+	}
+
+	for (p = sm->buf; p && *p; ) {
+		if (strncmp(p, "cpu", 3) == 0 && isdigit((unsigned char) p[3]))
+			sampler_parse_stat_line(sm, p);
+		else if (p != sm->buf && strncmp(p, "cpu", 3) != 0)
+			break;			/* all "cpu" lines are at the begin */
+		p = strchr(p, '\n');
+		if (p)
+			p++;
+	}
+}
+
+/* adds line for the CPUs sm->cpus[start..end-1] */
+static struct libscols_line *sampler_add_line(struct sampler *sm,
+				struct libscols_table *tb,
+				struct libscols_line *parent,
+				const char *name, size_t start, size_t end)
+{
+	struct libscols_line *ln;
+	uint64_t dbusy = 0, dtotal = 0;
+	float mhz = 0;
+	size_t i, nmhz = 0;
+	char *p;
+
+	ln = scols_table_new_line(tb, parent);
+	if (!ln)
+		err(EXIT_FAILURE, _("failed to allocate output line"));
+
+	CPU_ZERO_S(sm->cxt->setsize, sm->set);
+	for (i = start; i < end; i++) {
+		struct sample_cpu *sc = &sm->cpus[i];
+
+		CPU_SET_S(sc->cpu->logical_id, sm->cxt->setsize, sm->set);
+		dbusy += sc->dbusy;
+		dtotal += sc->dtotal;
+		if (sc->mhz > 0) {
+			mhz += sc->mhz;
+			nmhz++;
+		}
+	}
+
+	if (scols_line_set_data(ln, COL_SAMPLE_NAME, name))
+		err(EXIT_FAILURE, _("failed to add output data"));
+
+	p = cpulist_create(sm->setbuf, sm->setbufsz, sm->set, sm->cxt->setsize);
+	if (p && scols_line_set_data(ln, COL_SAMPLE_CPUS, p))
+		err(EXIT_FAILURE, _("failed to add output data"));
+
+	if (nmhz) {
+		xasprintf(&p, "%.4f", mhz / nmhz);
+		if (scols_line_refer_data(ln, COL_SAMPLE_MHZ, p))
+			err(EXIT_FAILURE, _("failed to add output data"));
+	}
+	if (dtotal) {
+		xasprintf(&p, "%.1f", (double) dbusy * 100 / dtotal);
+		if (scols_line_refer_data(ln, COL_SAMPLE_UTIL, p))
+			err(EXIT_FAILURE, _("failed to add output data"));
+	}
+	return ln;
+}
+
+static char *sampler_id_name(const char *prefix, int id)
+{
+	char *name;
+
+	if (id < 0)
+		xasprintf(&name, "%s -", prefix);
+	else
+		xasprintf(&name, "%s %d", prefix, id);
+	return name;
+}
+
+static void sampler_print(struct sampler *sm)
+{
+	struct libscols_table *tb;
+	size_t sock, core;
+
+	tb = scols_new_table();
+	if (!tb)
+		err(EXIT_FAILURE, _("failed to allocate output table"));
+	if (sm->cxt->json) {
+		scols_table_enable_json(tb, 1);
+		scols_table_set_name(tb, "cpusample");
+	}
+
+	if (!scols_table_new_column(tb, "NAME", 0, SCOLS_FL_TREE)
+	    || !scols_table_new_column(tb, "CPUS", 0, 0)
+	    || !scols_table_new_column(tb, "MHZ", 0, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "UTIL%", 0, SCOLS_FL_RIGHT))
+		err(EXIT_FAILURE, _("failed to allocate output column"));
+
+	for (sock = 0; sock < sm->ncpus; ) {
+		struct libscols_line *ln;
+		int sockid = sm->cpus[sock].cpu->socketid;
+		size_t end = sock;
+		char *name;
+
+		while (end < sm->ncpus && sm->cpus[end].cpu->socketid == sockid)
+			end++;
+
+		name = sampler_id_name(_("socket"), sockid);
+		ln = sampler_add_line(sm, tb, NULL, name, sock, end);
+		free(name);
+
+		for (core = sock; core < end; ) {
+			int coreid = sm->cpus[core].cpu->coreid;
+			size_t cend = core;
+
+			while (cend < end && sm->cpus[cend].cpu->coreid == coreid)
+				cend++;
+
+			name = sampler_id_name(_("core"), coreid);
+			sampler_add_line(sm, tb, ln, name, core, cend);
+			free(name);
+			core = cend;
+		}
+		sock = end;
+	}
+
+	scols_print_table(tb);
+	scols_unref_table(tb);
+	fflush(stdout);
+}
+
+/* runs until interrupted or until the output fails */
+int lscpu_sample(struct lscpu_cxt *cxt, const struct timeval *interval)
+{
+	struct sampler sm;
+	int first = 1;
+
+	sampler_init(&sm, cxt);
+	sampler_read(&sm);
+
+	while (!ferror(stdout)) {
+		struct timespec ts = {
+			.tv_sec = interval->tv_sec,
+			.tv_nsec = interval->tv_usec * 1000
+		};
+
+		while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+
+		sampler_read(&sm);
+		if (!first && !cxt->json)
+			fputc('\n', stdout);
+		sampler_print(&sm);
+		first = 0;
+	}
+
+	sampler_deinit(&sm);
+	return -EIO;
+}
@@ -8,6 +8,8 @@
 #include <stdio.h>
 
 #include "lscpu.h"
+#include "fileutils.h"
+#include "closestream.h"
 
 /* add @set to the @ary, unnecessary set is deallocated. */
 static int add_cpuset_to_array(cpu_set_t **ary, size_t *items, cpu_set_t *set, size_t setsize)
@@ -619,11 +621,175 @@ float lsblk_cputype_get_scalmhz(struct lscpu_cxt *cxt, struct lscpu_cputype *ct)
 	return fcur / fmax * 100;
 }
 
+/*
+ * Topology cache (--topology-cache)
+ *
+ * The CPU caches are the most expensive part of the topology (about ten
+ * attributes for every cache of every CPU), but they change only on CPU
+ * hotplug. They are saved to the file and reused while the boot ID and the
+ * lists of possible, present and online CPUs (the stamp) are the same. The
+ * other attributes are always read from /sys.
+ */
+#define TOPOCACHE_MAGIC		"lscpu-topology-cache 1"
+#define TOPOCACHE_NFIELDS	12
+
+static char *topocache_get_stamp(struct lscpu_cxt *cxt)
+{
+	struct ul_path_attr attrs[] = {
+		{ .path = "possible" }, { .path = "present" }, { .path = "online" }
+	};
+	char boot[64], arena[BUFSIZ], *stamp = NULL;
+
+	if (ul_path_read_buffer(cxt->procfs, boot, sizeof(boot),
+				"sys/kernel/random/boot_id") <= 0)
+		return NULL;
+	if (ul_path_read_many(cxt->syscpu, attrs, ARRAY_SIZE(attrs),
+			      arena, sizeof(arena)) != ARRAY_SIZE(attrs))
+		return NULL;
+
+	xasprintf(&stamp, "%s %s %s %s", boot,
+			attrs[0].data, attrs[1].data, attrs[2].data);
+	return stamp;
+}
+
+static char *topocache_field(char *str)
+{
+	return strcmp(str, "-") == 0 ? NULL : xstrdup(str);
+}
+
+static int topocache_parse_line(struct lscpu_cxt *cxt, char *line)
+{
+	char *fields[TOPOCACHE_NFIELDS], *p, *save = NULL;
+	struct lscpu_cache *ca;
+	size_t n = 0;
+
+	for (p = strtok_r(line, " \n", &save); p && n < ARRAY_SIZE(fields);
+	     p = strtok_r(NULL, " \n", &save))
+		fields[n++] = p;
+	if (n != ARRAY_SIZE(fields) || p)
+		return -EINVAL;
+
+	cxt->ncaches++;
+	cxt->caches = xrealloc(cxt->caches, cxt->ncaches * sizeof(*cxt->caches));
+	ca = &cxt->caches[cxt->ncaches - 1];
+	memset(ca, 0, sizeof(*ca));
+
+	ca->name = xstrdup(fields[0]);
+	ca->type = xstrdup(fields[1]);
+	ca->allocation_policy = topocache_field(fields[10]);
+	ca->write_policy = topocache_field(fields[11]);
+
+	if (ul_strtos32(fields[2], &ca->id, 10) != 0
+	    || ul_strtos32(fields[3], &ca->level, 10) != 0
+	    || ul_strtou64(fields[4], &ca->size, 10) != 0
+	    || ul_strtou32(fields[5], &ca->ways_of_associativity, 10) != 0
+	    || ul_strtou32(fields[6], &ca->physical_line_partition, 10) != 0
+	    || ul_strtou32(fields[7], &ca->number_of_sets, 10) != 0
+	    || ul_strtou32(fields[8], &ca->coherency_line_size, 10) != 0)
+		return -EINVAL;
+
+	if (strcmp(fields[9], "-") != 0) {
+		ca->sharedmap = cpuset_alloc(cxt->maxcpus, NULL, NULL);
+		if (!ca->sharedmap)
+			return -ENOMEM;
+		if (cpumask_parse(fields[9], ca->sharedmap, cxt->setsize) != 0)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static int topocache_load(struct lscpu_cxt *cxt, const char *stamp)
+{
+	char *line = NULL;
+	size_t sz = 0;
+	int rc = -EINVAL;
+	FILE *f;
+
+	f = fopen(cxt->topocache, "r" UL_CLOEXECSTR);
+	if (!f)
+		return -errno;
+
+	if (getline(&line, &sz, f) < 0
+	    || strcmp(line, TOPOCACHE_MAGIC "\n") != 0
+	    || getline(&line, &sz, f) < 0
+	    || strncmp(line, "stamp ", 6) != 0
+	    || strncmp(line + 6, stamp, strlen(stamp)) != 0
+	    || strcmp(line + 6 + strlen(stamp), "\n") != 0)
+		goto done;
+
+	rc = 0;
+	while (rc == 0 && getline(&line, &sz, f) >= 0)
+		rc = topocache_parse_line(cxt, line);
+done:
+	if (rc != 0 || cxt->ncaches == 0) {
+		lscpu_free_caches(cxt->caches, cxt->ncaches);
+		cxt->caches = NULL;
+		cxt->ncaches = 0;
+		rc = rc ? rc : -EINVAL;
+	}
+	DBG(GATHER, ul_debugobj(cxt, "topology cache %s: %s", cxt->topocache,
+				rc == 0 ? "used" : "ignored"));
+	free(line);
+	fclose(f);
+	return rc;
+}
+
+/* the file is replaced by rename(), so readers never see a partial cache */
+static void topocache_save(struct lscpu_cxt *cxt, const char *stamp)
+{
+	size_t i, masksz = cxt->setsize * 2 + 1;
+	char *tmp = NULL, *mask;
+	FILE *f = NULL;
+	int fd;
+
+	xasprintf(&tmp, "%s.XXXXXX", cxt->topocache);
+	fd = mkstemp_cloexec(tmp);
+	if (fd < 0)
+		goto done;
+	if (fchmod(fd, 0644) != 0 || !(f = fdopen(fd, "w"))) {
+		close(fd);
+		goto failed;
+	}
+
+	mask = xmalloc(masksz);
+	fprintf(f, TOPOCACHE_MAGIC "\nstamp %s\n", stamp);
+
+	for (i = 0; i < cxt->ncaches; i++) {
+		struct lscpu_cache *ca = &cxt->caches[i];
+
+		fprintf(f, "%s %s %d %d %" PRIu64 " %u %u %u %u %s %s %s\n",
+			ca->name, ca->type, ca->id, ca->level, ca->size,
+			ca->ways_of_associativity, ca->physical_line_partition,
+			ca->number_of_sets, ca->coherency_line_size,
+			ca->sharedmap ? cpumask_create(mask, masksz,
+					ca->sharedmap, cxt->setsize) : "-",
+			ca->allocation_policy ? ca->allocation_policy : "-",
+			ca->write_policy ? ca->write_policy : "-");
+	}
+	free(mask);
+
+	if (close_stream(f) != 0 || rename(tmp, cxt->topocache) != 0)
+		goto failed;
+
+	DBG(GATHER, ul_debugobj(cxt, "topology cache %s: saved", cxt->topocache));
+	goto done;
+failed:
+	unlink(tmp);
+done:
+	free(tmp);
+}
+
 int lscpu_read_topology(struct lscpu_cxt *cxt)
 {
 	size_t i;
-	int rc = 0;
+	int rc = 0, cached = 0;
+	char *stamp = NULL;
 
+	if (cxt->topocache && !cxt->prefix) {
+		stamp = topocache_get_stamp(cxt);
+		if (stamp)
+			cached = topocache_load(cxt, stamp) == 0;
+	}
 
 	for (i = 0; i < cxt->ncputypes; i++)
 		rc += cputype_read_topology(cxt, cxt->cputypes[i]);
@@ -645,11 +811,16 @@ int lscpu_read_topology(struct lscpu_cxt *cxt)
 			rc = read_configure(cxt, cpu);
 		if (!rc)
 			rc = read_mhz(cxt, cpu);
-		if (!rc)
+		if (!rc && !cached)
 			rc = read_caches(cxt, cpu);
 	}
 
 	lscpu_sort_caches(cxt->caches, cxt->ncaches);
+
+	if (stamp && !cached && rc == 0)
+		topocache_save(cxt, stamp);
+	free(stamp);
+
 	DBG(GATHER, ul_debugobj(cxt, " L1d: %zu", lscpu_get_cache_full_size(cxt, "L1d", NULL)));
 	DBG(GATHER, ul_debugobj(cxt, " L1i: %zu", lscpu_get_cache_full_size(cxt, "L1i", NULL)));
 	DBG(GATHER, ul_debugobj(cxt, " L2: %zu", lscpu_get_cache_full_size(cxt, "L2", NULL)));
@@ -1183,6 +1183,10 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -y, --physical          print physical instead of logical IDs\n"), out);
 	fputs(_("     --hierarchic[=when] use subsections in summary (auto, never, always)\n"), out);
 	fputs(_("     --output-all        print all available columns for -e, -p or -C\n"), out);
+	fputs(_("     --topology-cache[=<file>]\n"
+		"                         reuse CPU caches from <file> until CPU hotplug\n"), out);
+	fputs(_("     --sample <secs>     print per-socket and per-core utilization and MHz\n"
+		"                         every <secs> seconds\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(25));
 
@@ -1207,9 +1211,12 @@ int main(int argc, char *argv[])
 	int cpu_modifier_specified = 0;
 	char *outarg = NULL;
 	size_t i, ncolumns = 0;
+	struct timeval interval = { 0 };
 	enum {
 		OPT_OUTPUT_ALL = CHAR_MAX + 1,
 		OPT_HIERARCHIC,
+		OPT_TOPOCACHE,
+		OPT_SAMPLE,
 	};
 	static const struct option longopts[] = {
 		{ "all",        no_argument,       NULL, 'a' },
@@ -1227,11 +1234,13 @@ int main(int argc, char *argv[])
 		{ "version",	no_argument,	   NULL, 'V' },
 		{ "output-all",	no_argument,	   NULL, OPT_OUTPUT_ALL },
 		{ "hierarchic", optional_argument, NULL, OPT_HIERARCHIC },
+		{ "topology-cache", optional_argument, NULL, OPT_TOPOCACHE },
+		{ "sample",	required_argument, NULL, OPT_SAMPLE },
 		{ NULL,		0, NULL, 0 }
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
-		{ 'C','e','p' },
+		{ 'C','e','p', OPT_SAMPLE },
 		{ 'a','b','c' },
 		{ 0 }
 	};
@@ -1310,6 +1319,16 @@ int main(int argc, char *argv[])
 			} else
 				hierarchic = 1;
 			break;
+		case OPT_TOPOCACHE:
+			cxt->topocache = optarg ? optarg : _PATH_LSCPU_TOPOCACHE;
+			break;
+		case OPT_SAMPLE:
+			strtotimeval_or_err(optarg, &interval,
+					    _("invalid sample interval"));
+			if (!timerisset(&interval))
+				errx(EXIT_FAILURE, _("invalid sample interval"));
+			cxt->mode = LSCPU_OUTPUT_SAMPLE;
+			break;
 		case 'h':
 			usage();
 		case 'V':
@@ -1328,7 +1347,8 @@ int main(int argc, char *argv[])
 			columns[ncolumns++] = i;
 	}
 
-	if (cpu_modifier_specified && cxt->mode == LSCPU_OUTPUT_SUMMARY) {
+	if (cpu_modifier_specified && (cxt->mode == LSCPU_OUTPUT_SUMMARY ||
+				       cxt->mode == LSCPU_OUTPUT_SAMPLE)) {
 		fprintf(stderr,
 			_("%s: options --all, --online and --offline may only "
 			  "be used with options --extended or --parse.\n"),
@@ -1452,6 +1472,9 @@ int main(int argc, char *argv[])
 
 		print_cpus_parsable(cxt, columns, ncolumns);
 		break;
+	case LSCPU_OUTPUT_SAMPLE:
+		lscpu_sample(cxt, &interval);
+		break;
 	}
 
 	lscpu_free_context(cxt);
@@ -1,6 +1,8 @@
 #ifndef LSCPU_H
 #define LSCPU_H
 
+#include <sys/time.h>
+
 #include "c.h"
 #include "nls.h"
 #include "cpuset.h"
@@ -33,6 +35,7 @@ UL_DEBUG_DECLARE_MASK(lscpu);
 #define _PATH_SYS_NODE		_PATH_SYS_SYSTEM "/node"
 #define _PATH_SYS_DMI		"/sys/firmware/dmi/tables/DMI"
 #define _PATH_ACPI_PPTT		"/sys/firmware/acpi/tables/PPTT"
+#define _PATH_LSCPU_TOPOCACHE	_PATH_RUNSTATEDIR "/lscpu-topology.cache"
 
 struct lscpu_cache {
 	int		id;		/* unique identifier */
@@ -196,13 +199,15 @@ enum {
 	LSCPU_OUTPUT_SUMMARY = 0,	/* default */
 	LSCPU_OUTPUT_CACHES,
 	LSCPU_OUTPUT_PARSABLE,
-	LSCPU_OUTPUT_READABLE
+	LSCPU_OUTPUT_READABLE,
+	LSCPU_OUTPUT_SAMPLE		/* --sample */
 };
 
 struct lscpu_cxt {
 	int maxcpus;		/* size in bits of kernel cpu mask */
 	size_t setsize;
 	const char *prefix;	/* path to /sys and /proc snapshot or NULL */
+	const char *topocache;	/* --topology-cache file or NULL */
 
 	struct path_cxt	*syscpu; /* _PATH_SYS_CPU path handler */
 	struct path_cxt *procfs; /* /proc path handler */
@@ -299,6 +304,8 @@ struct lscpu_cpu *lscpu_cpus_loopup_by_type(struct lscpu_cxt *cxt, struct lscpu_
 
 void lscpu_decode_arm(struct lscpu_cxt *cxt);
 
+int lscpu_sample(struct lscpu_cxt *cxt, const struct timeval *interval);
+
 int lookup(char *line, char *pattern, char **value);
 
 void *get_mem_chunk(size_t base, size_t len, const char *devmem);
@@ -26,6 +26,7 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <search.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -107,7 +108,12 @@ enum {
 		COL_LIMIT,
 		COL_USED,
 		COL_USEPERC,
-	COLDESC_IDX_SUM_LAST = COL_USEPERC
+	COLDESC_IDX_SUM_LAST = COL_USEPERC,
+
+	/* per-owner summary (--summary) */
+	COLDESC_IDX_OWN_FIRST,
+		COL_COUNT = COLDESC_IDX_OWN_FIRST,
+	COLDESC_IDX_OWN_LAST = COL_COUNT
 };
 
 /* not all columns apply to all options, so we specify a legal range for each */
@@ -189,6 +195,9 @@ static const struct lsipc_coldesc coldescs[] =
 	[COL_USED]      = { "USED",     N_("Currently used"), N_("Used"), 1, SCOLS_FL_RIGHT },
 	[COL_USEPERC]	= { "USE%",     N_("Currently use percentage"), N_("Use"), 1, SCOLS_FL_RIGHT },
 	[COL_LIMIT]     = { "LIMIT",    N_("System-wide limit"), N_("Limit"), 1, SCOLS_FL_RIGHT },
+
+	/* cols for per-owner summary */
+	[COL_COUNT]	= { "COUNT",	N_("Number of resources"), N_("Resources"), 1, SCOLS_FL_RIGHT },
 };
 
 
@@ -247,20 +256,18 @@ static const struct lsipc_coldesc *get_column_desc(int num)
 	return &coldescs[ get_column_id(num) ];
 }
 
-static char *get_username(struct passwd **pw, uid_t id)
+static char *get_username(uid_t id)
 {
-	if (!*pw || (*pw)->pw_uid != id)
-		*pw = getpwuid(id);
+	const char *name = ipc_get_username(id);
 
-	return *pw ? xstrdup((*pw)->pw_name) : NULL;
+	return name ? xstrdup(name) : NULL;
 }
 
-static char *get_groupname(struct group **gr, gid_t id)
+static char *get_groupname(gid_t id)
 {
-	if (!*gr || (*gr)->gr_gid != id)
-		*gr = getgrgid(id);
+	const char *name = ipc_get_groupname(id);
 
-	return *gr ? xstrdup((*gr)->gr_name) : NULL;
+	return name ? xstrdup(name) : NULL;
 }
 
 static int parse_time_mode(const char *s)
@@ -301,6 +308,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -s, --semaphores  semaphores\n"), out);
 	fputs(_(" -g, --global      info about system-wide usage (may be used with -m, -q and -s)\n"), out);
 	fputs(_(" -i, --id <id>     print details on resource identified by <id>\n"), out);
+	fputs(_("     --summary     totals per owner (may be used with -m, -q and -s)\n"), out);
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_("     --noheadings         don't print headings\n"), out);
@@ -342,6 +350,10 @@ static void __attribute__((__noreturn__)) usage(void)
 	for (i = COLDESC_IDX_SUM_FIRST; i <= COLDESC_IDX_SUM_LAST; i++)
 		fprintf(out, " %14s  %s\n", coldescs[i].name, _(coldescs[i].help));
 
+	fprintf(out, _("\nPer-owner summary columns (--summary):\n"));
+	for (i = COLDESC_IDX_OWN_FIRST; i <= COLDESC_IDX_OWN_LAST; i++)
+		fprintf(out, " %14s  %s\n", coldescs[i].name, _(coldescs[i].help));
+
 	printf(USAGE_MAN_TAIL("lsipc(1)"));
 	exit(EXIT_SUCCESS);
 }
@@ -547,8 +559,6 @@ static void setup_sem_elements_columns(struct libscols_table *tb)
 static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 {
 	struct libscols_line *ln;
-	struct passwd *pw = NULL, *cpw = NULL;
-	struct group *gr = NULL, *cgr = NULL;
 	struct sem_data *semds, *semdsp;
 	char *arg = NULL;
 
@@ -578,7 +588,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_OWNER:
-				arg = get_username(&pw, semdsp->sem_perm.uid);
+				arg = get_username(semdsp->sem_perm.uid);
 				if (!arg)
 					xasprintf(&arg, "%u", semdsp->sem_perm.uid);
 				rc = scols_line_refer_data(ln, n, arg);
@@ -597,7 +607,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CUSER:
-				arg = get_username(&cpw, semdsp->sem_perm.cuid);
+				arg = get_username(semdsp->sem_perm.cuid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -606,7 +616,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CGROUP:
-				arg = get_groupname(&cgr, semdsp->sem_perm.cgid);
+				arg = get_groupname(semdsp->sem_perm.cgid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -615,7 +625,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_USER:
-				arg = get_username(&pw, semdsp->sem_perm.uid);
+				arg = get_username(semdsp->sem_perm.uid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -624,7 +634,7 @@ static void do_sem(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_GROUP:
-				arg = get_groupname(&gr, semdsp->sem_perm.gid);
+				arg = get_groupname(semdsp->sem_perm.gid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -741,8 +751,6 @@ static void do_sem_global(struct lsipc_control *ctl, struct libscols_table *tb)
 static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 {
 	struct libscols_line *ln;
-	struct passwd *pw = NULL;
-	struct group *gr = NULL;
 	struct msg_data *msgds, *msgdsp;
 	char *arg = NULL;
 
@@ -760,14 +768,6 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 		if (!ln)
 			err(EXIT_FAILURE, _("failed to allocate output line"));
 
-		/* no need to call getpwuid() for the same user */
-		if (!(pw && pw->pw_uid == msgdsp->msg_perm.uid))
-			pw = getpwuid(msgdsp->msg_perm.uid);
-
-		/* no need to call getgrgid() for the same user */
-		if (!(gr && gr->gr_gid == msgdsp->msg_perm.gid))
-			gr = getgrgid(msgdsp->msg_perm.gid);
-
 		for (n = 0; n < ncolumns; n++) {
 			int rc = 0;
 
@@ -781,7 +781,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_OWNER:
-				arg = get_username(&pw, msgdsp->msg_perm.uid);
+				arg = get_username(msgdsp->msg_perm.uid);
 				if (!arg)
 					xasprintf(&arg, "%u", msgdsp->msg_perm.uid);
 				rc = scols_line_refer_data(ln, n, arg);
@@ -800,7 +800,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CUSER:
-				arg = get_username(&pw, msgdsp->msg_perm.cuid);
+				arg = get_username(msgdsp->msg_perm.cuid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -809,7 +809,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CGROUP:
-				arg = get_groupname(&gr, msgdsp->msg_perm.cgid);
+				arg = get_groupname(msgdsp->msg_perm.cgid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -818,7 +818,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_USER:
-				arg = get_username(&pw, msgdsp->msg_perm.uid);
+				arg = get_username(msgdsp->msg_perm.uid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -827,7 +827,7 @@ static void do_msg(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_GROUP:
-				arg = get_groupname(&gr,msgdsp->msg_perm.gid);
+				arg = get_groupname(msgdsp->msg_perm.gid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -904,8 +904,6 @@ static void do_msg_global(struct lsipc_control *ctl, struct libscols_table *tb)
 static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 {
 	struct libscols_line *ln;
-	struct passwd *pw = NULL;
-	struct group *gr = NULL;
 	struct shm_data *shmds, *shmdsp;
 	char *arg = NULL;
 
@@ -937,7 +935,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_OWNER:
-				arg = get_username(&pw, shmdsp->shm_perm.uid);
+				arg = get_username(shmdsp->shm_perm.uid);
 				if (!arg)
 					xasprintf(&arg, "%u", shmdsp->shm_perm.uid);
 				rc = scols_line_refer_data(ln, n, arg);
@@ -956,7 +954,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CUSER:
-				arg = get_username(&pw, shmdsp->shm_perm.cuid);
+				arg = get_username(shmdsp->shm_perm.cuid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -965,7 +963,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_CGROUP:
-				arg = get_groupname(&gr, shmdsp->shm_perm.cgid);
+				arg = get_groupname(shmdsp->shm_perm.cgid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -974,7 +972,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_USER:
-				arg = get_username(&pw, shmdsp->shm_perm.uid);
+				arg = get_username(shmdsp->shm_perm.uid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -983,7 +981,7 @@ static void do_shm(int id, struct lsipc_control *ctl, struct libscols_table *tb)
 				rc = scols_line_refer_data(ln, n, arg);
 				break;
 			case COL_GROUP:
-				arg = get_groupname(&gr, shmdsp->shm_perm.gid);
+				arg = get_groupname(shmdsp->shm_perm.gid);
 				if (arg)
 					rc = scols_line_refer_data(ln, n, arg);
 				break;
@@ -1100,10 +1098,156 @@ static void do_shm_global(struct lsipc_control *ctl, struct libscols_table *tb)
 	global_set_data(ctl, tb, "SHMMIN", _("Min size of shared memory segment (bytes)"), 0, lim.shmmin, 0, 1);
 }
 
+/*
+ * Per-owner summary (--summary). The resources are not stored, every resource
+ * only updates the totals of its owner.
+ */
+struct owner_summary {
+	uid_t uid;
+	uint64_t count;
+	uint64_t bytes;		/* SIZE or USEDBYTES */
+	uint64_t msgs;
+	uint64_t nsems;
+};
+
+struct summary {
+	void *tree;			/* tsearch() tree of owner_summary */
+	struct owner_summary **owners;
+	size_t nowners;
+};
+
+static int cmp_owner_summaries(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct owner_summary *) a)->uid,
+			   ((const struct owner_summary *) b)->uid);
+}
+
+static int cmp_owner_summary_ptrs(const void *a, const void *b)
+{
+	return cmp_owner_summaries(*(const struct owner_summary **) a,
+				   *(const struct owner_summary **) b);
+}
+
+static struct owner_summary *summary_get_owner(struct summary *sum, uid_t uid)
+{
+	struct owner_summary key = { .uid = uid }, *x, **node;
+
+	node = tfind(&key, &sum->tree, cmp_owner_summaries);
+	if (node)
+		return *node;
+
+	x = xcalloc(1, sizeof(*x));
+	x->uid = uid;
+	if (!tsearch(x, &sum->tree, cmp_owner_summaries))
+		err_oom();
+
+	sum->owners = xrealloc(sum->owners, (sum->nowners + 1) * sizeof(x));
+	sum->owners[sum->nowners++] = x;
+	return x;
+}
+
+static int summary_add_shm(struct shm_data *shm, void *data)
+{
+	struct owner_summary *x = summary_get_owner(data, shm->shm_perm.uid);
+
+	x->count++;
+	x->bytes += shm->shm_segsz;
+	return 0;
+}
+
+static int summary_add_msg(struct msg_data *msg, void *data)
+{
+	struct owner_summary *x = summary_get_owner(data, msg->msg_perm.uid);
+
+	x->count++;
+	x->bytes += msg->q_cbytes;
+	x->msgs += msg->q_qnum;
+	return 0;
+}
+
+static int summary_add_sem(struct sem_data *sem, void *data)
+{
+	struct owner_summary *x = summary_get_owner(data, sem->sem_perm.uid);
+
+	x->count++;
+	x->nsems += sem->sem_nsems;
+	return 0;
+}
+
+static void summary_free_node(void *node __attribute__((__unused__)))
+{
+}
+
+static void do_summary(struct lsipc_control *ctl, struct libscols_table *tb,
+		       int msg, int shm, int sem)
+{
+	struct summary sum = { NULL };
+	size_t i;
+
+	if (msg) {
+		scols_table_set_name(tb, "messages");
+		ipc_msg_foreach(-1, summary_add_msg, &sum);
+	} else if (shm) {
+		scols_table_set_name(tb, "sharedmemory");
+		ipc_shm_foreach(-1, summary_add_shm, &sum);
+	} else if (sem) {
+		scols_table_set_name(tb, "semaphores");
+		ipc_sem_foreach(-1, summary_add_sem, &sum);
+	}
+
+	if (sum.nowners)
+		qsort(sum.owners, sum.nowners, sizeof(struct owner_summary *),
+		      cmp_owner_summary_ptrs);
+
+	for (i = 0; i < sum.nowners; i++) {
+		struct owner_summary *x = sum.owners[i];
+		struct libscols_line *ln;
+		size_t n;
+
+		ln = scols_table_new_line(tb, NULL);
+		if (!ln)
+			err(EXIT_FAILURE, _("failed to allocate output line"));
+
+		for (n = 0; n < ncolumns; n++) {
+			char *arg = NULL;
+
+			switch (get_column_id(n)) {
+			case COL_OWNER:
+				arg = get_username(x->uid);
+				if (!arg)
+					xasprintf(&arg, "%u", x->uid);
+				break;
+			case COL_COUNT:
+				xasprintf(&arg, "%ju", x->count);
+				break;
+			case COL_SIZE:
+			case COL_USEDBYTES:
+				if (ctl->bytes)
+					xasprintf(&arg, "%ju", x->bytes);
+				else
+					arg = size_to_human_string(SIZE_SUFFIX_1LETTER, x->bytes);
+				break;
+			case COL_MSGS:
+				xasprintf(&arg, "%ju", x->msgs);
+				break;
+			case COL_NSEMS:
+				xasprintf(&arg, "%ju", x->nsems);
+				break;
+			}
+			if (arg && scols_line_refer_data(ln, n, arg) != 0)
+				err(EXIT_FAILURE, _("failed to set data"));
+		}
+		free(x);
+	}
+
+	tdestroy(sum.tree, summary_free_node);
+	free(sum.owners);
+}
+
 int main(int argc, char *argv[])
 {
 	int opt, msg = 0, sem = 0, shm = 0, id = -1;
-	int show_time = 0, show_creat = 0, global = 0;
+	int show_time = 0, show_creat = 0, global = 0, summary = 0;
 	size_t i;
 	struct lsipc_control *ctl = xcalloc(1, sizeof(struct lsipc_control));
 	static struct libscols_table *tb;
@@ -1113,7 +1257,8 @@ int main(int argc, char *argv[])
 	enum {
 		OPT_NOTRUNC = CHAR_MAX + 1,
 		OPT_NOHEAD,
-		OPT_TIME_FMT
+		OPT_TIME_FMT,
+		OPT_SUMMARY
 	};
 
 	static const struct option longopts[] = {
@@ -1134,6 +1279,7 @@ int main(int argc, char *argv[])
 		{ "raw",            no_argument,	NULL, 'r' },
 		{ "semaphores",     no_argument,	NULL, 's' },
 		{ "shmems",         no_argument,	NULL, 'm' },
+		{ "summary",        no_argument,	NULL, OPT_SUMMARY },
 		{ "time",           no_argument,	NULL, 't' },
 		{ "time-format",    required_argument,	NULL, OPT_TIME_FMT },
 		{ "version",        no_argument,	NULL, 'V' },
@@ -1239,6 +1385,9 @@ int main(int argc, char *argv[])
 		case OPT_TIME_FMT:
 			ctl->time_mode = parse_time_mode(optarg);
 			break;
+		case OPT_SUMMARY:
+			summary = 1;
+			break;
 		case 'J':
 			ctl->outmode = OUT_JSON;
 			break;
@@ -1261,12 +1410,33 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (summary) {
+		if (msg + shm + sem == 0)
+			errx(EXIT_FAILURE, _("--summary requires --shmems, --queues or --semaphores"));
+		if (show_time || show_creat || global || outarg || id != -1)
+			errx(EXIT_FAILURE, _("--summary is mutually exclusive with --creator, --global, --id, --output and --time"));
+	}
+
 	/* default is global */
 	if (msg + shm + sem == 0) {
 		msg = shm = sem = global = 1;
 		if (show_time || show_creat || id != -1)
 			errx(EXIT_FAILURE, _("--global is mutually exclusive with --creator, --id and --time"));
 	}
+	if (summary) {
+		/* the columns are fixed, replace the defaults of the resource */
+		ncolumns = 0;
+		add_column(columns, ncolumns++, COL_OWNER);
+		add_column(columns, ncolumns++, COL_COUNT);
+		if (shm)
+			add_column(columns, ncolumns++, COL_SIZE);
+		if (msg) {
+			add_column(columns, ncolumns++, COL_USEDBYTES);
+			add_column(columns, ncolumns++, COL_MSGS);
+		}
+		if (sem)
+			add_column(columns, ncolumns++, COL_NSEMS);
+	}
 	if (global) {
 		add_column(columns, ncolumns++, COL_RESOURCE);
 		add_column(columns, ncolumns++, COL_DESC);
@@ -1328,6 +1498,10 @@ int main(int argc, char *argv[])
 	if (global)
 		scols_table_set_name(tb, "ipclimits");
 
+	if (summary) {
+		do_summary(ctl, tb, msg, shm, sem);
+		msg = shm = sem = 0;
+	}
 	if (msg) {
 		if (global)
 			do_msg_global(ctl, tb);
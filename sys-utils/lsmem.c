@@ -35,6 +35,7 @@
 #include <libsmartcols.h>
 
 #define _PATH_SYS_MEMORY		"/sys/devices/system/memory"
+#define _PATH_SYS_NODE			"/sys/devices/system/node"
 
 #define MEMORY_STATE_ONLINE		0
 #define MEMORY_STATE_OFFLINE		1
@@ -65,10 +66,13 @@ struct memory_block {
 
 struct lsmem {
 	struct path_cxt		*sysmem;		/* _PATH_SYS_MEMORY directory handler */
-	struct dirent		**dirs;
-	int			ndirs;
+	const char		*prefix;		/* --sysroot */
+	uint64_t		*indexes;		/* sorted numbers of the memory blocks */
+	size_t			nindexes;
+	int			*nodes;			/* nodes of the indexes[] or NULL */
 	struct memory_block	*blocks;
 	int			nblocks;
+	int			blocks_alloc;
 	uint64_t		block_size;
 	uint64_t		mem_online;
 	uint64_t		mem_offline;
@@ -88,7 +92,10 @@ struct lsmem {
 				split_by_state : 1,
 				split_by_removable : 1,
 				split_by_zones : 1,
-				have_zones : 1;
+				have_zones : 1,
+				want_node : 1,		/* attributes to read */
+				want_removable : 1,
+				want_zones : 1;
 };
 
 
@@ -227,6 +234,30 @@ static void set_split_policy(struct lsmem *l, int cols[], size_t ncols)
 	}
 }
 
+/* the state is always read for the summary */
+static void set_wanted_attrs(struct lsmem *l)
+{
+	size_t i;
+
+	l->want_node = l->have_nodes && l->split_by_node;
+	l->want_removable = l->split_by_removable;
+	l->want_zones = l->have_zones && l->split_by_zones;
+
+	for (i = 0; i < ncolumns; i++) {
+		switch (get_column_id(i)) {
+		case COL_NODE:
+			l->want_node = l->have_nodes;
+			break;
+		case COL_REMOVABLE:
+			l->want_removable = 1;
+			break;
+		case COL_ZONES:
+			l->want_zones = l->have_zones;
+			break;
+		}
+	}
+}
+
 static void add_scols_line(struct lsmem *lsmem, struct memory_block *blk)
 {
 	size_t i;
@@ -332,12 +363,14 @@ static void print_summary(struct lsmem *lsmem)
 	}
 }
 
-static int memory_block_get_node(struct lsmem *lsmem, char *name)
+static int memory_block_get_node(struct lsmem *lsmem, uint64_t index)
 {
+	char name[sizeof("memory") + sizeof(stringify_value(UINT64_MAX))];
 	struct dirent *de;
 	DIR *dir;
 	int node;
 
+	snprintf(name, sizeof(name), "memory%"PRIu64, index);
 	dir = ul_path_opendir(lsmem->sysmem, name);
 	if (!dir)
 		err(EXIT_FAILURE, _("Failed to open %s"), name);
@@ -358,54 +391,149 @@ static int memory_block_get_node(struct lsmem *lsmem, char *name)
 	return node;
 }
 
-static int memory_block_read_attrs(struct lsmem *lsmem, char *name,
+static ssize_t find_index(struct lsmem *lsmem, uint64_t index)
+{
+	size_t lo = 0, hi = lsmem->nindexes;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (lsmem->indexes[mid] == index)
+			return mid;
+		if (lsmem->indexes[mid] < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+/*
+ * The memory blocks are linked from the node directories, one scan of the
+ * nodes is much cheaper than to scan each memory block directory for the
+ * node link. Returns -1 if the nodes are not available (e.g. in the dumps
+ * of /sys/devices/system/memory only).
+ */
+static int read_nodes(struct lsmem *lsmem)
+{
+	struct path_cxt *sysnode;
+	struct dirent *d;
+	DIR *dir = NULL;
+	size_t i;
+	int rc;
+
+	sysnode = ul_new_path(_PATH_SYS_NODE);
+	if (!sysnode)
+		err(EXIT_FAILURE, _("failed to initialize %s handler"), _PATH_SYS_NODE);
+	if (lsmem->prefix && ul_path_set_prefix(sysnode, lsmem->prefix) != 0)
+		err(EXIT_FAILURE, _("invalid argument to --sysroot"));
+
+	lsmem->nodes = xmalloc(lsmem->nindexes * sizeof(int));
+	for (i = 0; i < lsmem->nindexes; i++)
+		lsmem->nodes[i] = -1;
+
+	while ((rc = ul_path_next_dirent(sysnode, &dir, NULL, &d)) == 0) {
+		struct dirent *md;
+		DIR *mdir = NULL;
+		int node;
+
+		if (strncmp("node", d->d_name, 4) != 0
+		    || !isdigit_string(d->d_name + 4))
+			continue;
+		node = strtol(d->d_name + 4, NULL, 10);
+
+		while (ul_path_next_dirent(sysnode, &mdir, d->d_name, &md) == 0) {
+			ssize_t n;
+
+			if (strncmp("memory", md->d_name, 6) != 0
+			    || !isdigit_string(md->d_name + 6))
+				continue;
+			n = find_index(lsmem, strtoumax(md->d_name + 6, NULL, 10));
+			if (n >= 0)
+				lsmem->nodes[n] = node;
+		}
+	}
+	ul_unref_path(sysnode);
+
+	if (rc < 0) {
+		free(lsmem->nodes);
+		lsmem->nodes = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* reads only the attributes required for the output and the split policy */
+static int memory_block_read_attrs(struct lsmem *lsmem, size_t n,
 				    struct memory_block *blk)
 {
-	char *line = NULL;
-	int i, x = 0, rc = 0;
+	enum { ATTR_STATE, ATTR_REMOVABLE, ATTR_ZONES };
+	char paths[3][sizeof("memory/valid_zones") + sizeof(stringify_value(UINT64_MAX))];
+	struct ul_path_attr attrs[3];
+	int pos[3] = { -1, -1, -1 };
+	char arena[BUFSIZ];
+	const char *line;
+	size_t nattrs = 0;
+	int i;
 
 	memset(blk, 0, sizeof(*blk));
 
-	errno = 0;
 	blk->count = 1;
 	blk->state = MEMORY_STATE_UNKNOWN;
-	blk->index = strtoumax(name + 6, NULL, 10); /* get <num> of "memory<num>" */
-
-	if (errno)
-		rc = -errno;
+	blk->index = lsmem->indexes[n];
+
+	/* read all the attributes by one call */
+	pos[ATTR_STATE] = nattrs++;
+	snprintf(paths[pos[ATTR_STATE]], sizeof(paths[0]),
+			"memory%"PRIu64"/state", blk->index);
+	if (lsmem->want_removable) {
+		pos[ATTR_REMOVABLE] = nattrs++;
+		snprintf(paths[pos[ATTR_REMOVABLE]], sizeof(paths[0]),
+				"memory%"PRIu64"/removable", blk->index);
+	}
+	if (lsmem->want_zones) {
+		pos[ATTR_ZONES] = nattrs++;
+		snprintf(paths[pos[ATTR_ZONES]], sizeof(paths[0]),
+				"memory%"PRIu64"/valid_zones", blk->index);
+	}
+	for (i = 0; (size_t) i < nattrs; i++)
+		attrs[i].path = paths[i];
 
-	if (ul_path_readf_s32(lsmem->sysmem, &x, "%s/removable", name) == 0)
-		blk->removable = x == 1;
+	ul_path_read_many(lsmem->sysmem, attrs, nattrs, arena, sizeof(arena));
 
-	if (ul_path_readf_string(lsmem->sysmem, &line, "%s/state", name) > 0 && line) {
+	line = attrs[pos[ATTR_STATE]].data;
+	if (line && *line) {
 		if (strcmp(line, "offline") == 0)
 			blk->state = MEMORY_STATE_OFFLINE;
 		else if (strcmp(line, "online") == 0)
 			blk->state = MEMORY_STATE_ONLINE;
 		else if (strcmp(line, "going-offline") == 0)
 			blk->state = MEMORY_STATE_GOING_OFFLINE;
-		free(line);
 	}
 
-	if (lsmem->have_nodes)
-		blk->node = memory_block_get_node(lsmem, name);
+	if (pos[ATTR_REMOVABLE] >= 0) {
+		line = attrs[pos[ATTR_REMOVABLE]].data;
+		if (line && *line)
+			blk->removable = strtol(line, NULL, 10) == 1;
+	}
+
+	if (lsmem->want_node)
+		blk->node = lsmem->nodes ? lsmem->nodes[n] :
+				memory_block_get_node(lsmem, blk->index);
 
 	blk->nr_zones = 0;
-	if (lsmem->have_zones
-	    && ul_path_readf_string(lsmem->sysmem, &line, "%s/valid_zones", name) > 0
-	    && line) {
-
-		char *token = strtok(line, " ");
+	if (pos[ATTR_ZONES] >= 0 && attrs[pos[ATTR_ZONES]].data
+	    && *attrs[pos[ATTR_ZONES]].data) {
+		char *token = strtok(attrs[pos[ATTR_ZONES]].data, " ");
 
 		for (i = 0; token && i < MAX_NR_ZONES; i++) {
 			blk->zones[i] = zone_name_to_id(token);
 			blk->nr_zones++;
 			token = strtok(NULL, " ");
 		}
-		free(line);
 	}
 
-	return rc;
+	return 0;
 }
 
 static int is_mergeable(struct lsmem *lsmem, struct memory_block *blk)
@@ -442,21 +570,18 @@ static int is_mergeable(struct lsmem *lsmem, struct memory_block *blk)
 
 static void free_info(struct lsmem *lsmem)
 {
-	int i;
-
 	if (!lsmem)
 		return;
 	free(lsmem->blocks);
-	for (i = 0; i < lsmem->ndirs; i++)
-		free(lsmem->dirs[i]);
-	free(lsmem->dirs);
+	free(lsmem->indexes);
+	free(lsmem->nodes);
 }
 
 static void read_info(struct lsmem *lsmem)
 {
 	struct memory_block blk;
 	char buf[128];
-	int i;
+	size_t i;
 
 	if (ul_path_read_buffer(lsmem->sysmem, buf, sizeof(buf), "block_size_bytes") <= 0)
 		err(EXIT_FAILURE, _("failed to read memory block size"));
@@ -466,8 +591,12 @@ static void read_info(struct lsmem *lsmem)
 	if (errno)
 		err(EXIT_FAILURE, _("failed to read memory block size"));
 
-	for (i = 0; i < lsmem->ndirs; i++) {
-		memory_block_read_attrs(lsmem, lsmem->dirs[i]->d_name, &blk);
+	/* the node links are needed for the output or the split policy only */
+	if (lsmem->want_node)
+		read_nodes(lsmem);
+
+	for (i = 0; i < lsmem->nindexes; i++) {
+		memory_block_read_attrs(lsmem, i, &blk);
 		if (blk.state == MEMORY_STATE_ONLINE)
 			lsmem->mem_online += lsmem->block_size;
 		else
@@ -476,33 +605,47 @@ static void read_info(struct lsmem *lsmem)
 			lsmem->blocks[lsmem->nblocks - 1].count++;
 			continue;
 		}
-		lsmem->nblocks++;
-		lsmem->blocks = xrealloc(lsmem->blocks, lsmem->nblocks * sizeof(blk));
-		*&lsmem->blocks[lsmem->nblocks - 1] = blk;
+		if (lsmem->nblocks == lsmem->blocks_alloc) {
+			lsmem->blocks_alloc = lsmem->blocks_alloc ? lsmem->blocks_alloc * 2 : 64;
+			lsmem->blocks = xrealloc(lsmem->blocks,
+					lsmem->blocks_alloc * sizeof(blk));
+		}
+		lsmem->blocks[lsmem->nblocks++] = blk;
 	}
 }
 
-static int memory_block_filter(const struct dirent *de)
+static int cmp_indexes(const void *a, const void *b)
 {
-	if (strncmp("memory", de->d_name, 6) != 0)
-		return 0;
-	return isdigit_string(de->d_name + 6);
+	return cmp_numbers(*(const uint64_t *) a, *(const uint64_t *) b);
 }
 
+/* the block numbers only, that's cheaper than scandir() with versionsort() */
 static void read_basic_info(struct lsmem *lsmem)
 {
-	char dir[PATH_MAX];
+	struct dirent *d;
+	DIR *dir = NULL;
+	size_t alloc = 0;
+	int rc;
 
 	if (ul_path_access(lsmem->sysmem, F_OK, "block_size_bytes") != 0)
 		errx(EXIT_FAILURE, _("This system does not support memory blocks"));
 
-	ul_path_get_abspath(lsmem->sysmem, dir, sizeof(dir), NULL);
+	while ((rc = ul_path_next_dirent(lsmem->sysmem, &dir, NULL, &d)) == 0) {
+		if (strncmp("memory", d->d_name, 6) != 0
+		    || !isdigit_string(d->d_name + 6))
+			continue;
+		if (lsmem->nindexes == alloc) {
+			alloc = alloc ? alloc * 2 : 256;
+			lsmem->indexes = xrealloc(lsmem->indexes, alloc * sizeof(uint64_t));
+		}
+		lsmem->indexes[lsmem->nindexes++] = strtoumax(d->d_name + 6, NULL, 10);
+	}
+	if (rc < 0 || !lsmem->nindexes)
+		err(EXIT_FAILURE, _("Failed to read %s"), _PATH_SYS_MEMORY);
 
-	lsmem->ndirs = scandir(dir, &lsmem->dirs, memory_block_filter, versionsort);
-	if (lsmem->ndirs <= 0)
-		err(EXIT_FAILURE, _("Failed to read %s"), dir);
+	qsort(lsmem->indexes, lsmem->nindexes, sizeof(uint64_t), cmp_indexes);
 
-	if (memory_block_get_node(lsmem, lsmem->dirs[0]->d_name) != -1)
+	if (memory_block_get_node(lsmem, lsmem->indexes[0]) != -1)
 		lsmem->have_nodes = 1;
 
 	/* The valid_zones sysmem attribute was introduced with kernel 3.18 */
@@ -667,6 +810,7 @@ int main(int argc, char **argv)
 		err(EXIT_FAILURE, _("failed to initialize %s handler"), _PATH_SYS_MEMORY);
 	if (prefix && ul_path_set_prefix(lsmem->sysmem, prefix) != 0)
 		err(EXIT_FAILURE, _("invalid argument to --sysroot"));
+	lsmem->prefix = prefix;
 	if (!ul_path_is_accessible(lsmem->sysmem))
 		err(EXIT_FAILURE, _("cannot open %s"), _PATH_SYS_MEMORY);
 
@@ -754,6 +898,7 @@ int main(int argc, char **argv)
 	 * Read data and print output
 	 */
 	read_basic_info(lsmem);
+	set_wanted_attrs(lsmem);
 	read_info(lsmem);
 
 	if (lsmem->want_table) {
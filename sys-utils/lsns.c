@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <search.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -57,6 +59,7 @@
 #include "namespace.h"
 #include "idcache.h"
 #include "fileutils.h"
+#include "all-io.h"
 
 #include "debug.h"
 
@@ -202,6 +205,9 @@ struct lsns {
 	struct list_head processes;
 	struct list_head namespaces;
 
+	void	*ns_index;	/* tsearch() tree, namespaces by inode */
+	void	*proc_index;	/* tsearch() tree, processes by PID */
+
 	pid_t	fltr_pid;	/* filter out by PID */
 	ino_t	fltr_ns;	/* filter out by namespace */
 	int	fltr_types[ARRAY_SIZE(ns_names)];
@@ -212,7 +218,8 @@ struct lsns {
 		     tree	: 2,
 		     no_trunc	: 1,
 		     no_headings: 1,
-		     no_wrap    : 1;
+		     no_wrap    : 1,
+		     related    : 1;	/* parent and owner namespaces needed */
 
 
 	struct libmnt_table *tab;
@@ -221,10 +228,16 @@ struct lsns {
 struct netnsid_cache {
 	ino_t ino;
 	int   id;
-	struct list_head netnsids;
+	int   fd;		/* ns/net of the pending request or -1 */
 };
 
-static struct list_head netnsids_cache;
+static void *netnsids_cache;	/* tsearch() tree */
+
+/* the RTM_GETNSID requests are sent in batches, the responses are received
+ * after the whole batch is sent */
+#define NETNSID_BATCH	64
+static struct netnsid_cache *netnsids_pending[NETNSID_BATCH];
+static size_t netnsids_npending;
 
 static int netlink_fd = -1;
 
@@ -285,7 +298,7 @@ static inline const struct colinfo *get_column_info(unsigned num)
 	return &infos[ get_column_id(num) ];
 }
 
-static int get_ns_ino(int dir, const char *nsname, ino_t *ino, ino_t *pino, ino_t *oino)
+static int get_ns_ino(int dir, const char *nsname, ino_t *ino)
 {
 	struct stat st;
 	char path[16];
@@ -295,13 +308,28 @@ static int get_ns_ino(int dir, const char *nsname, ino_t *ino, ino_t *pino, ino_
 	if (fstatat(dir, path, &st, 0) != 0)
 		return -errno;
 	*ino = st.st_ino;
+	return 0;
+}
 
+/*
+ * Reads parent and owner namespaces. It's expensive (open and ioctls), so it's
+ * called only if the relations are required and only once for each namespace.
+ */
+static int get_ns_related(int dir __attribute__((__unused__)),
+			  const char *nsname __attribute__((__unused__)),
+			  ino_t *pino, ino_t *oino)
+{
 	*pino = 0;
 	*oino = 0;
 
 #ifdef USE_NS_GET_API
+	struct stat st;
+	char path[16];
 	int fd, pfd, ofd;
-	fd = openat(dir, path, 0);
+
+	snprintf(path, sizeof(path), "ns/%s", nsname);
+
+	fd = openat(dir, path, O_RDONLY | O_CLOEXEC);
 	if (fd < 0)
 		return -errno;
 	if (strcmp(nsname, "pid") == 0 || strcmp(nsname, "user") == 0) {
@@ -339,61 +367,47 @@ static int get_ns_ino(int dir, const char *nsname, ino_t *ino, ino_t *pino, ino_
 	return 0;
 }
 
-static int parse_proc_stat(FILE *fp, pid_t *pid, char *state, pid_t *ppid)
+/* parses "pid (comm) state ppid ..." from /proc/#/stat */
+static int parse_proc_stat(char *line, pid_t *pid, char *state, pid_t *ppid)
 {
-	char *line = NULL, *p;
-	size_t len = 0;
-	int rc;
+	char *p = strrchr(line, ')');
 
-	if (getline(&line, &len, fp) < 0) {
-		rc = -errno;
-		goto error;
-	}
-
-	p = strrchr(line, ')');
 	if (p == NULL ||
 	    sscanf(line, "%d (", pid) != 1 ||
-	    sscanf(p, ") %c %d*[^\n]", state, ppid) != 2) {
-		rc = -EINVAL;
-		goto error;
-	}
-	rc = 0;
-
-error:
-	free(line);
-	return rc;
+	    sscanf(p, ") %c %d", state, ppid) != 2)
+		return -EINVAL;
+	return 0;
 }
 
 #ifdef HAVE_LINUX_NET_NAMESPACE_H
-static int netnsid_cache_find(ino_t netino, int *netnsid)
+static int cmp_netnsid_cache(const void *a, const void *b)
 {
-	struct list_head *p;
+	return cmp_numbers(((const struct netnsid_cache *) a)->ino,
+			   ((const struct netnsid_cache *) b)->ino);
+}
 
-	list_for_each(p, &netnsids_cache) {
-		struct netnsid_cache *e = list_entry(p,
-						     struct netnsid_cache,
-						     netnsids);
-		if (e->ino == netino) {
-			*netnsid = e->id;
-			return 1;
-		}
-	}
+static struct netnsid_cache *netnsid_cache_find(ino_t netino)
+{
+	struct netnsid_cache key = { .ino = netino }, **e;
 
-	return 0;
+	e = tfind(&key, &netnsids_cache, cmp_netnsid_cache);
+	return e ? *e : NULL;
 }
 
-static void netnsid_cache_add(ino_t netino, int netnsid)
+static struct netnsid_cache *netnsid_cache_add(ino_t netino)
 {
 	struct netnsid_cache *e;
 
 	e = xcalloc(1, sizeof(*e));
 	e->ino = netino;
-	e->id  = netnsid;
-	INIT_LIST_HEAD(&e->netnsids);
-	list_add(&e->netnsids, &netnsids_cache);
+	e->id  = LSNS_NETNS_UNUSABLE;
+	e->fd = -1;
+	if (!tsearch(e, &netnsids_cache, cmp_netnsid_cache))
+		err(EXIT_FAILURE, _("failed to allocate netnsid cache"));
+	return e;
 }
 
-static int get_netnsid_via_netlink_send_request(int target_fd)
+static int get_netnsid_via_netlink_send_request(int target_fd, uint32_t seq)
 {
 	unsigned char req[NLMSG_SPACE(sizeof(struct rtgenmsg))
 			  + RTA_SPACE(sizeof(int32_t))];
@@ -404,9 +418,11 @@ static int get_netnsid_via_netlink_send_request(int target_fd)
 		(req + NLMSG_SPACE(sizeof(struct rtgenmsg)));
 	int32_t *fd = RTA_DATA(rta);
 
+	memset(req, 0, sizeof(req));
 	nlh->nlmsg_len = sizeof(req);
 	nlh->nlmsg_flags = NLM_F_REQUEST;
 	nlh->nlmsg_type = RTM_GETNSID;
+	nlh->nlmsg_seq = seq;
 	rt->rtgen_family = AF_UNSPEC;
 	rta->rta_type = NETNSA_FD;
 	rta->rta_len = RTA_SPACE(sizeof(int32_t));
@@ -417,120 +433,188 @@ static int get_netnsid_via_netlink_send_request(int target_fd)
 	return 0;
 }
 
-static int get_netnsid_via_netlink_recv_response(int *netnsid)
+/*
+ * Receives one datagram with responses, every request gets RTM_NEWNSID or
+ * NLMSG_ERROR with the sequence number (index in netnsids_pending[] + 1).
+ * Returns the number of the responses or -1.
+ */
+static int get_netnsid_via_netlink_recv_responses(void)
 {
-	unsigned char res[NLMSG_SPACE(sizeof(struct rtgenmsg))
-			  + ((RTA_SPACE(sizeof(int32_t))
-			      < RTA_SPACE(sizeof(struct nlmsgerr)))
-			     ? RTA_SPACE(sizeof(struct nlmsgerr))
-			     : RTA_SPACE(sizeof(int32_t)))];
-	int rtalen;
-	ssize_t reslen;
-
+	unsigned char res[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
 	struct nlmsghdr *nlh;
-	struct rtattr *rta;
+	ssize_t reslen;
+	int count = 0;
 
 	reslen = recv(netlink_fd, res, sizeof(res), 0);
 	if (reslen < 0)
 		return -1;
 
-	nlh = (struct nlmsghdr *)res;
-	if (!(NLMSG_OK(nlh, (size_t)reslen)
-	      && nlh->nlmsg_type == RTM_NEWNSID))
-		return -1;
-
-	rtalen = NLMSG_PAYLOAD(nlh, sizeof(struct rtgenmsg));
-	rta = (struct rtattr *)(res + NLMSG_SPACE(sizeof(struct rtgenmsg)));
-	if (!(RTA_OK(rta, rtalen)
-	      && rta->rta_type == NETNSA_NSID))
-		return -1;
+	for (nlh = (struct nlmsghdr *) res; NLMSG_OK(nlh, (size_t) reslen);
+	     nlh = NLMSG_NEXT(nlh, reslen)) {
+		struct netnsid_cache *e;
+		struct rtattr *rta;
+		int rtalen;
 
-	*netnsid = *(int *)RTA_DATA(rta);
+		if (nlh->nlmsg_seq == 0 || nlh->nlmsg_seq > netnsids_npending)
+			continue;
+		e = netnsids_pending[nlh->nlmsg_seq - 1];
+		count++;
+
+		if (nlh->nlmsg_type != RTM_NEWNSID)
+			continue;	/* NLMSG_ERROR, keep it unusable */
+
+		rtalen = NLMSG_PAYLOAD(nlh, sizeof(struct rtgenmsg));
+		rta = (struct rtattr *) ((char *) NLMSG_DATA(nlh)
+					 + NLMSG_ALIGN(sizeof(struct rtgenmsg)));
+		for (; RTA_OK(rta, rtalen); rta = RTA_NEXT(rta, rtalen)) {
+			if (rta->rta_type == NETNSA_NSID) {
+				e->id = *(int *) RTA_DATA(rta);
+				break;
+			}
+		}
+	}
 
-	return 0;
+	return count;
 }
 
-static int get_netnsid_via_netlink(int dir, const char *path)
+/* sends the pending requests and waits for all the responses */
+static void netnsid_flush(void)
 {
-	int netnsid;
-	int target_fd;
+	size_t i;
+	int nsent = 0;
 
-	if (netlink_fd < 0)
-		return LSNS_NETNS_UNUSABLE;
+	for (i = 0; i < netnsids_npending; i++) {
+		if (get_netnsid_via_netlink_send_request(
+				netnsids_pending[i]->fd, i + 1) == 0)
+			nsent++;
+	}
 
-	target_fd = openat(dir, path, O_RDONLY);
-	if (target_fd < 0)
-		return LSNS_NETNS_UNUSABLE;
+	while (nsent > 0) {
+		int rc = get_netnsid_via_netlink_recv_responses();
 
-	if (get_netnsid_via_netlink_send_request(target_fd) < 0) {
-		netnsid = LSNS_NETNS_UNUSABLE;
-		goto out;
+		if (rc < 0)
+			break;
+		nsent -= rc;
 	}
 
-	if (get_netnsid_via_netlink_recv_response(&netnsid) < 0) {
-		netnsid = LSNS_NETNS_UNUSABLE;
-		goto out;
+	for (i = 0; i < netnsids_npending; i++) {
+		close(netnsids_pending[i]->fd);
+		netnsids_pending[i]->fd = -1;
 	}
-
- out:
-	close(target_fd);
-	return netnsid;
+	netnsids_npending = 0;
 }
 
-static int get_netnsid(int dir, ino_t netino)
+/* requests netnsid of ns/net in the /proc/PID directory @dir */
+static void netnsid_request(int dir, ino_t netino)
 {
-	int netnsid;
+	struct netnsid_cache *e;
 
-	if (!netnsid_cache_find(netino, &netnsid)) {
-		netnsid = get_netnsid_via_netlink(dir, "ns/net");
-		netnsid_cache_add(netino, netnsid);
-	}
+	if (netlink_fd < 0 || netino == 0 || netnsid_cache_find(netino))
+		return;
+
+	e = netnsid_cache_add(netino);
+	e->fd = openat(dir, "ns/net", O_RDONLY | O_CLOEXEC);
+	if (e->fd < 0)
+		return;
+
+	netnsids_pending[netnsids_npending++] = e;
+	if (netnsids_npending == NETNSID_BATCH)
+		netnsid_flush();
+}
+
+static int get_netnsid(ino_t netino)
+{
+	struct netnsid_cache *e = netnsid_cache_find(netino);
 
-	return netnsid;
+	return e ? e->id : LSNS_NETNS_UNUSABLE;
 }
 #else
-static int get_netnsid(int dir __attribute__((__unused__)),
-		       ino_t netino __attribute__((__unused__)))
+static void netnsid_request(int dir __attribute__((__unused__)),
+			    ino_t netino __attribute__((__unused__)))
+{
+}
+
+static void netnsid_flush(void)
+{
+}
+
+static int get_netnsid(ino_t netino __attribute__((__unused__)))
 {
 	return LSNS_NETNS_UNUSABLE;
 }
 #endif /* HAVE_LINUX_NET_NAMESPACE_H */
 
-static int read_process(struct lsns *ls, pid_t pid)
+static int cmp_namespace_ids(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct lsns_namespace *) a)->id,
+			   ((const struct lsns_namespace *) b)->id);
+}
+
+static int cmp_process_pids(const void *a, const void *b)
+{
+	return cmp_numbers(((const struct lsns_process *) a)->pid,
+			   ((const struct lsns_process *) b)->pid);
+}
+
+static struct lsns_namespace *get_namespace(struct lsns *ls, ino_t ino)
+{
+	struct lsns_namespace key = { .id = ino }, **ns;
+
+	ns = tfind(&key, &ls->ns_index, cmp_namespace_ids);
+	return ns ? *ns : NULL;
+}
+
+static struct lsns_process *get_process(struct lsns *ls, pid_t pid)
+{
+	struct lsns_process key = { .pid = pid }, **proc;
+
+	proc = tfind(&key, &ls->proc_index, cmp_process_pids);
+	return proc ? *proc : NULL;
+}
+
+static void add_process_namespaces(struct lsns *ls, struct lsns_process *proc);
+
+static int read_process(struct lsns *ls, int procfd, pid_t pid)
 {
 	struct lsns_process *p = NULL;
 	char buf[BUFSIZ];
-	DIR *dir;
-	int rc = 0, fd;
-	FILE *f = NULL;
+	int rc = 0, dir, fd;
+	ssize_t sz;
 	size_t i;
 	struct stat st;
 
 	DBG(PROC, ul_debug("reading %d", (int) pid));
 
-	snprintf(buf, sizeof(buf), "/proc/%d", pid);
-	dir = opendir(buf);
-	if (!dir)
+	snprintf(buf, sizeof(buf), "%d", pid);
+	dir = openat(procfd, buf, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir < 0)
 		return -errno;
 
 	p = xcalloc(1, sizeof(*p));
 	p->netnsid = LSNS_NETNS_UNUSABLE;
 
-	if (fstat(dirfd(dir), &st) == 0) {
+	if (fstat(dir, &st) == 0) {
 		p->uid = st.st_uid;
 		add_uid(uid_cache, st.st_uid);
 	}
 
-	fd = openat(dirfd(dir), "stat", O_RDONLY);
+	fd = openat(dir, "stat", O_RDONLY | O_CLOEXEC);
 	if (fd < 0) {
 		rc = -errno;
 		goto done;
 	}
-	if (!(f = fdopen(fd, "r"))) {
+	sz = read_all(fd, buf, sizeof(buf) - 1);
+	if (sz < 0)
 		rc = -errno;
+	close(fd);
+	if (sz <= 0) {
+		if (!rc)
+			rc = -ENOENT;	/* empty, the process is gone */
 		goto done;
 	}
-	rc = parse_proc_stat(f, &p->pid, &p->state, &p->ppid);
+	buf[sz] = '\0';
+
+	rc = parse_proc_stat(buf, &p->pid, &p->state, &p->ppid);
 	if (rc < 0)
 		goto done;
 	rc = 0;
@@ -541,12 +625,21 @@ static int read_process(struct lsns *ls, pid_t pid)
 		if (!ls->fltr_types[i])
 			continue;
 
-		rc = get_ns_ino(dirfd(dir), ns_names[i], &p->ns_ids[i],
-				&p->ns_pids[i], &p->ns_oids[i]);
+		rc = get_ns_ino(dir, ns_names[i], &p->ns_ids[i]);
+		if (!rc && ls->related) {
+			struct lsns_namespace *ns = get_namespace(ls, p->ns_ids[i]);
+
+			if (ns) {
+				p->ns_pids[i] = ns->related_id[RELA_PARENT];
+				p->ns_oids[i] = ns->related_id[RELA_OWNER];
+			} else
+				rc = get_ns_related(dir, ns_names[i],
+						&p->ns_pids[i], &p->ns_oids[i]);
+		}
 		if (rc && rc != -EACCES && rc != -ENOENT)
 			goto done;
 		if (i == LSNS_ID_NET)
-			p->netnsid = get_netnsid(dirfd(dir), p->ns_ids[i]);
+			netnsid_request(dir, p->ns_ids[i]);
 		rc = 0;
 	}
 
@@ -554,10 +647,12 @@ static int read_process(struct lsns *ls, pid_t pid)
 
 	DBG(PROC, ul_debugobj(p, "new pid=%d", p->pid));
 	list_add_tail(&p->processes, &ls->processes);
+	if (!tsearch(p, &ls->proc_index, cmp_process_pids))
+		err(EXIT_FAILURE, _("failed to allocate memory"));
+
+	add_process_namespaces(ls, p);
 done:
-	if (f)
-		fclose(f);
-	closedir(dir);
+	close(dir);
 	if (rc)
 		free(p);
 	return rc;
@@ -565,61 +660,29 @@ done:
 
 static int read_processes(struct lsns *ls)
 {
-	DIR *dir;
-	struct dirent *d;
-	int rc = 0;
+	struct procfs_scan sc;
+	pid_t pid = 0;
+	int rc;
 
 	DBG(PROC, ul_debug("opening /proc"));
 
-	dir = opendir(_PATH_PROC);
-	if (!dir)
-		return -errno;
-
-	while ((d = xreaddir(dir))) {
-		pid_t pid = 0;
-
-		if (procfs_dirent_get_pid(d, &pid) != 0)
-			continue;
+	rc = procfs_scan_open(&sc, NULL);
+	if (rc)
+		return rc;
 
-		/* TODO: use ul_new_procfs_path(pid, NULL) to read files from /proc/pid/
-		 */
-		rc = read_process(ls, pid);
+	while (procfs_scan_next(&sc, &pid) == 0) {
+		rc = read_process(ls, procfs_scan_get_dirfd(&sc), pid);
 		if (rc && rc != -EACCES && rc != -ENOENT)
 			break;
 		rc = 0;
 	}
+	netnsid_flush();
 
 	DBG(PROC, ul_debug("closing /proc"));
-	closedir(dir);
+	procfs_scan_close(&sc);
 	return rc;
 }
 
-static struct lsns_namespace *get_namespace(struct lsns *ls, ino_t ino)
-{
-	struct list_head *p;
-
-	list_for_each(p, &ls->namespaces) {
-		struct lsns_namespace *ns = list_entry(p, struct lsns_namespace, namespaces);
-
-		if (ns->id == ino)
-			return ns;
-	}
-	return NULL;
-}
-
-static int namespace_has_process(struct lsns_namespace *ns, pid_t pid)
-{
-	struct list_head *p;
-
-	list_for_each(p, &ns->processes) {
-		struct lsns_process *proc = list_entry(p, struct lsns_process, ns_siblings[ns->type]);
-
-		if (proc->pid == pid)
-			return 1;
-	}
-	return 0;
-}
-
 static struct lsns_namespace *add_namespace(struct lsns *ls, int type, ino_t ino,
 					    ino_t parent_ino, ino_t owner_ino)
 {
@@ -639,32 +702,38 @@ static struct lsns_namespace *add_namespace(struct lsns *ls, int type, ino_t ino
 	ns->related_id[RELA_OWNER] = owner_ino;
 
 	list_add_tail(&ns->namespaces, &ls->namespaces);
+	if (!tsearch(ns, &ls->ns_index, cmp_namespace_ids))
+		err(EXIT_FAILURE, _("failed to allocate memory"));
 	return ns;
 }
 
-static int add_process_to_namespace(struct lsns *ls, struct lsns_namespace *ns, struct lsns_process *proc)
+static void add_process_to_namespace(struct lsns_namespace *ns, struct lsns_process *proc)
 {
-	struct list_head *p;
-
 	DBG(NS, ul_debugobj(ns, "add process [%p] pid=%d to %s[%ju]",
 		proc, proc->pid, ns_names[ns->type], (uintmax_t)ns->id));
 
-	list_for_each(p, &ls->processes) {
-		struct lsns_process *xproc = list_entry(p, struct lsns_process, processes);
-
-		if (xproc->pid == proc->ppid)		/* my parent */
-			proc->parent = xproc;
-		else if (xproc->ppid == proc->pid)	/* my child */
-			xproc->parent = proc;
-	}
-
 	list_add_tail(&proc->ns_siblings[ns->type], &ns->processes);
 	ns->nprocs++;
 
 	if (!ns->proc || ns->proc->pid > proc->pid)
 		ns->proc = proc;
+}
 
-	return 0;
+static void add_process_namespaces(struct lsns *ls, struct lsns_process *proc)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(proc->ns_ids); i++) {
+		struct lsns_namespace *ns;
+
+		if (proc->ns_ids[i] == 0)
+			continue;
+		ns = get_namespace(ls, proc->ns_ids[i]);
+		if (!ns)
+			ns = add_namespace(ls, i, proc->ns_ids[i],
+					   proc->ns_pids[i], proc->ns_oids[i]);
+		add_process_to_namespace(ns, proc);
+	}
 }
 
 static int cmp_namespaces(struct list_head *a, struct list_head *b,
@@ -811,24 +880,12 @@ static void read_related_namespaces(struct lsns *ls)
 
 	list_for_each(p, &ls->namespaces) {
 		struct lsns_namespace *ns = list_entry(p, struct lsns_namespace, namespaces);
-		struct list_head *pp;
-		list_for_each(pp, &ls->namespaces) {
-			struct lsns_namespace *pns = list_entry(pp, struct lsns_namespace, namespaces);
-			if (ns->type == LSNS_ID_USER
-			    || ns->type == LSNS_ID_PID) {
-				if (ns->related_id[RELA_PARENT] == pns->id)
-					ns->related_ns[RELA_PARENT] = pns;
-				if (ns->related_id[RELA_OWNER] == pns->id)
-					ns->related_ns[RELA_OWNER] = pns;
-				if (ns->related_ns[RELA_PARENT] && ns->related_ns[RELA_OWNER])
-					break;
-			} else {
-				if (ns->related_id[RELA_OWNER] == pns->id) {
-					ns->related_ns[RELA_OWNER] = pns;
-					break;
-				}
-			}
-		}
+
+		if (ns->type == LSNS_ID_USER || ns->type == LSNS_ID_PID)
+			ns->related_ns[RELA_PARENT] = get_namespace(ls,
+						ns->related_id[RELA_PARENT]);
+		ns->related_ns[RELA_OWNER] = get_namespace(ls,
+						ns->related_id[RELA_OWNER]);
 
 		/* lsns scans /proc/[0-9]+ for finding namespaces.
 		 * So if a namespace has no process, lsns cannot
@@ -860,6 +917,10 @@ static void read_related_namespaces(struct lsns *ls)
 
 #endif /* USE_NS_GET_API */
 
+/*
+ * The namespaces are already collected by read_processes(), this function
+ * links the processes and the namespaces together.
+ */
 static int read_namespaces(struct lsns *ls)
 {
 	struct list_head *p;
@@ -867,21 +928,11 @@ static int read_namespaces(struct lsns *ls)
 	DBG(NS, ul_debug("reading namespace"));
 
 	list_for_each(p, &ls->processes) {
-		size_t i;
-		struct lsns_namespace *ns;
 		struct lsns_process *proc = list_entry(p, struct lsns_process, processes);
 
-		for (i = 0; i < ARRAY_SIZE(proc->ns_ids); i++) {
-			if (proc->ns_ids[i] == 0)
-				continue;
-			if (!(ns = get_namespace(ls, proc->ns_ids[i]))) {
-				ns = add_namespace(ls, i, proc->ns_ids[i],
-						   proc->ns_pids[i], proc->ns_oids[i]);
-				if (!ns)
-					return -ENOMEM;
-			}
-			add_process_to_namespace(ls, ns, proc);
-		}
+		proc->parent = get_process(ls, proc->ppid);
+		if (ls->fltr_types[LSNS_ID_NET])
+			proc->netnsid = get_netnsid(proc->ns_ids[LSNS_ID_NET]);
 	}
 
 #ifdef USE_NS_GET_API
@@ -1138,6 +1189,7 @@ static void show_namespace(struct lsns *ls, struct libscols_table *tab,
 static int show_namespaces(struct lsns *ls)
 {
 	struct libscols_table *tab;
+	struct lsns_process *fltr_proc = NULL;
 	struct list_head *p;
 	int rc = 0;
 
@@ -1145,10 +1197,14 @@ static int show_namespaces(struct lsns *ls)
 	if (!tab)
 		return -ENOMEM;
 
+	if (ls->fltr_pid != 0)
+		fltr_proc = get_process(ls, ls->fltr_pid);
+
 	list_for_each(p, &ls->namespaces) {
 		struct lsns_namespace *ns = list_entry(p, struct lsns_namespace, namespaces);
 
-		if (ls->fltr_pid != 0 && !namespace_has_process(ns, ls->fltr_pid))
+		if (ls->fltr_pid != 0
+		    && (!fltr_proc || fltr_proc->ns_ids[ns->type] != ns->id))
 			continue;
 
 		if (!ns->ns_outline)
@@ -1204,11 +1260,16 @@ static void free_lsns_process(struct lsns_process *lsns_p)
 	free(lsns_p);
 }
 
-static void free_netnsid_caches(struct netnsid_cache *cache)
+static void free_netnsid_caches(void *cache)
 {
 	free(cache);
 }
 
+/* the index nodes are freed by the lists */
+static void free_index_node(void *data __attribute__((__unused__)))
+{
+}
+
 static void free_lsns_namespace(struct lsns_namespace *lsns_n)
 {
 	free(lsns_n);
@@ -1216,8 +1277,11 @@ static void free_lsns_namespace(struct lsns_namespace *lsns_n)
 
 static void free_all(struct lsns *ls)
 {
+	tdestroy(ls->proc_index, free_index_node);
+	tdestroy(ls->ns_index, free_index_node);
+	tdestroy(netnsids_cache, free_netnsid_caches);
+
 	list_free(&ls->processes, struct lsns_process, processes, free_lsns_process);
-	list_free(&netnsids_cache, struct netnsid_cache, netnsids, free_netnsid_caches);
 	list_free(&ls->namespaces, struct lsns_namespace, namespaces, free_lsns_namespace);
 }
 
@@ -1304,7 +1368,6 @@ int main(int argc, char *argv[])
 
 	INIT_LIST_HEAD(&ls.processes);
 	INIT_LIST_HEAD(&ls.namespaces);
-	INIT_LIST_HEAD(&netnsids_cache);
 
 	while ((c = getopt_long(argc, argv,
 				"Jlp:o:nruhVt:T::W", long_opts, NULL)) != -1) {
@@ -1436,6 +1499,11 @@ int main(int argc, char *argv[])
 			err(MNT_EX_FAIL, _("failed to parse %s"), _PATH_PROC_MOUNTINFO);
 	}
 
+#ifdef USE_NS_GET_API
+	if (ls.tree == LSNS_TREE_OWNER || ls.tree == LSNS_TREE_PARENT
+	    || has_column(COL_PNS) || has_column(COL_ONS))
+		ls.related = 1;
+#endif
 	r = read_processes(&ls);
 	if (!r)
 		r = read_namespaces(&ls);
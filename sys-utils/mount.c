@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <stdarg.h>
 #include <libmount.h>
 #include <ctype.h>
@@ -231,6 +232,217 @@ static int mount_all(struct libmnt_context *cxt)
 }
 
 
+/*
+ * mount -a --parallel
+ *
+ * The fstab entries are mounted by forked workers (every worker has its own
+ * copy of the context). An entry has to wait for all the previous entries
+ * with the related mountpoint (parent, child or the same directory) and for
+ * the previous entry with the mountpoint where the source path lives (bind
+ * mounts, loop images). The relative order of the related entries is the
+ * same as for the sequential mount -a.
+ */
+enum {
+	JOB_WAITING = 0,
+	JOB_RUNNING,
+	JOB_DONE
+};
+
+/* worker exit status for ignored entries (MNT_EX_* are smaller) */
+#define JOB_EX_IGNORED	0x80
+
+struct mount_job {
+	struct libmnt_fs	*fs;
+	pid_t			pid;
+	int			state;
+
+	size_t			*deps;		/* indexes of the previous jobs */
+	size_t			ndeps;
+};
+
+/* Returns: 1 if @path is @dir or a path below @dir */
+static int is_subpath(const char *path, const char *dir)
+{
+	size_t len;
+
+	if (!path || !dir || *path != '/' || *dir != '/')
+		return 0;
+
+	len = strlen(dir);
+	while (len && dir[len - 1] == '/')
+		len--;
+
+	return strncmp(path, dir, len) == 0
+		&& (path[len] == '/' || path[len] == '\0');
+}
+
+static int jobs_related(struct mount_job *prev, struct mount_job *job)
+{
+	const char *a = mnt_fs_get_target(prev->fs),
+		   *b = mnt_fs_get_target(job->fs);
+
+	return is_subpath(b, a)
+		|| is_subpath(a, b)
+		|| is_subpath(mnt_fs_get_srcpath(job->fs), a);
+}
+
+static int job_is_ready(struct mount_job *jobs, size_t i)
+{
+	size_t k;
+
+	for (k = 0; k < jobs[i].ndeps; k++) {
+		if (jobs[jobs[i].deps[k]].state != JOB_DONE)
+			return 0;
+	}
+	return 1;
+}
+
+static void __attribute__((__noreturn__))
+		run_job(struct libmnt_context *cxt, struct libmnt_table *fstab,
+			struct libmnt_iter *itr, struct mount_job *job)
+{
+	struct libmnt_fs *fs;
+	int mntrc, ignored, rc;
+	const char *tgt;
+
+	mnt_table_set_iter(fstab, itr, job->fs);
+
+	if (mnt_context_next_mount(cxt, itr, &fs, &mntrc, &ignored) != 0)
+		exit(MNT_EX_SYSERR);
+
+	tgt = mnt_fs_get_target(fs);
+
+	if (ignored) {
+		if (mnt_context_is_verbose(cxt))
+			printf(ignored == 1 ? _("%-25s: ignored\n") :
+					      _("%-25s: already mounted\n"),
+					tgt);
+		exit(JOB_EX_IGNORED);
+	}
+
+	rc = mk_exit_code(cxt, mntrc);
+	if (rc == MNT_EX_SUCCESS && mnt_context_get_status(cxt)
+	    && mnt_context_is_verbose(cxt))
+		printf("%-25s: successfully mounted\n", tgt);
+	exit(rc);
+}
+
+static int mount_all_parallel(struct libmnt_context *cxt, size_t nworkers)
+{
+	struct libmnt_table *fstab;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	struct mount_job *jobs;
+	size_t i, k, njobs = 0, nrunning = 0;
+	int rc, nsucc = 0, nerrs = 0;
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr) {
+		warn(_("failed to initialize libmount iterator"));
+		return MNT_EX_SYSERR;
+	}
+
+	rc = mnt_context_get_fstab(cxt, &fstab);
+	if (rc) {
+		mnt_free_iter(itr);
+		return mk_exit_code(cxt, rc);
+	}
+
+	/* build the dependencies */
+	jobs = xcalloc(mnt_table_get_nents(fstab) + 1, sizeof(struct mount_job));
+
+	while (mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		struct mount_job *job = &jobs[njobs];
+
+		job->fs = fs;
+		for (k = 0; k < njobs; k++) {
+			if (!jobs_related(&jobs[k], job))
+				continue;
+			job->deps = xrealloc(job->deps,
+					(job->ndeps + 1) * sizeof(size_t));
+			job->deps[job->ndeps++] = k;
+		}
+		njobs++;
+	}
+
+	for (i = 0; i < njobs || nrunning; ) {
+		int status = 0;
+		pid_t pid;
+
+		/* start all ready jobs */
+		for (k = i; k < njobs && nrunning < nworkers; k++) {
+			struct mount_job *job = &jobs[k];
+
+			if (job->state != JOB_WAITING || !job_is_ready(jobs, k))
+				continue;
+
+			fflush(stdout);
+			fflush(stderr);
+
+			job->pid = fork();
+			switch (job->pid) {
+			case -1:
+				warn(_("fork failed"));
+				job->state = JOB_DONE;
+				nerrs++;
+				continue;
+			case 0:
+				run_job(cxt, fstab, itr, job);
+			default:
+				job->state = JOB_RUNNING;
+				nrunning++;
+				break;
+			}
+		}
+
+		/* skip already finished jobs */
+		while (i < njobs && jobs[i].state == JOB_DONE)
+			i++;
+		if (!nrunning)
+			continue;
+
+		do {
+			errno = 0;
+			pid = waitpid(-1, &status, 0);
+		} while (pid == -1 && errno == EINTR);
+
+		if (pid == -1) {
+			warn(_("waitpid failed"));
+			break;
+		}
+
+		for (k = 0; k < njobs; k++) {
+			struct mount_job *job = &jobs[k];
+
+			if (job->state != JOB_RUNNING || job->pid != pid)
+				continue;
+			job->state = JOB_DONE;
+			nrunning--;
+
+			if (!WIFEXITED(status))
+				nerrs++;
+			else if (WEXITSTATUS(status) == MNT_EX_SUCCESS)
+				nsucc++;
+			else if (WEXITSTATUS(status) != JOB_EX_IGNORED)
+				nerrs++;
+			break;
+		}
+	}
+
+	if (nerrs == 0)
+		rc = MNT_EX_SUCCESS;		/* all success */
+	else if (nsucc == 0)
+		rc = MNT_EX_FAIL;		/* all failed */
+	else
+		rc = MNT_EX_SOMEOK;		/* some success, some failed */
+
+	for (i = 0; i < njobs; i++)
+		free(jobs[i].deps);
+	free(jobs);
+	mnt_free_iter(itr);
+	return rc;
+}
+
 /*
  * mount -a -o remount
  */
@@ -406,6 +618,7 @@ static struct libmnt_table *append_fstab(struct libmnt_context *cxt,
 			err(MNT_EX_SYSERR, _("failed to initialize libmount table"));
 
 		mnt_table_set_parser_errcb(fstab, table_parser_errcb);
+		mnt_table_enable_arena(fstab, 1);
 		mnt_context_set_fstab(cxt, fstab);
 
 		mnt_unref_table(fstab);	/* reference is handled by @cxt now */
@@ -496,6 +709,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	" -c, --no-canonicalize   don't canonicalize paths\n"
 	" -f, --fake              dry run; skip the mount(2) syscall\n"
 	" -F, --fork              fork off for each device (use with -a)\n"
+	"     --parallel[=<num>]  mount independent filesystems in parallel (use with -a)\n"
 	" -T, --fstab <path>      alternative file to /etc/fstab\n"));
 	fprintf(out, _(
 	" -i, --internal-only     don't call the mount.<type> helpers\n"));
@@ -634,6 +848,7 @@ int main(int argc, char **argv)
 	int oper = 0, is_move = 0;
 	int propa = 0;
 	int optmode = 0, optmode_mode = 0, optmode_src = 0;
+	size_t parallel = 0;
 
 	enum {
 		MOUNT_OPT_SHARED = CHAR_MAX + 1,
@@ -650,7 +865,8 @@ int main(int argc, char **argv)
 		MOUNT_OPT_OPTMODE,
 		MOUNT_OPT_OPTSRC,
 		MOUNT_OPT_OPTSRC_FORCE,
-		MOUNT_OPT_ONLYONCE
+		MOUNT_OPT_ONLYONCE,
+		MOUNT_OPT_PARALLEL
 	};
 
 	static const struct option longopts[] = {
@@ -658,6 +874,7 @@ int main(int argc, char **argv)
 		{ "fake",             no_argument,       NULL, 'f'                   },
 		{ "fstab",            required_argument, NULL, 'T'                   },
 		{ "fork",             no_argument,       NULL, 'F'                   },
+		{ "parallel",         optional_argument, NULL, MOUNT_OPT_PARALLEL    },
 		{ "help",             no_argument,       NULL, 'h'                   },
 		{ "no-mtab",          no_argument,       NULL, 'n'                   },
 		{ "read-only",        no_argument,       NULL, 'r'                   },
@@ -699,6 +916,7 @@ int main(int argc, char **argv)
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'B','M','R' },			/* bind,move,rbind */
+		{ 'F', MOUNT_OPT_PARALLEL },	/* fork,parallel */
 		{ 'L','U', MOUNT_OPT_SOURCE },	/* label,uuid,source */
 		{ 0 }
 	};
@@ -898,6 +1116,17 @@ int main(int argc, char **argv)
 		case MOUNT_OPT_ONLYONCE:
 			mnt_context_enable_onlyonce(cxt, 1);
 			break;
+		case MOUNT_OPT_PARALLEL:
+			if (optarg)
+				parallel = strtou32_or_err(optarg,
+						_("invalid parallel argument"));
+			else {
+				long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+				parallel = ncpus > 0 ? (size_t) ncpus : 1;
+			}
+			if (!parallel)
+				errx(MNT_EX_USAGE, _("invalid parallel argument"));
+			break;
 		case 'h':
 			mnt_free_context(cxt);
 			usage();
@@ -964,6 +1193,8 @@ int main(int argc, char **argv)
 		 */
 		if (has_remount_flag(cxt))
 			rc = remount_all(cxt);
+		else if (parallel)
+			rc = mount_all_parallel(cxt, parallel);
 		else
 			rc = mount_all(cxt);
 		goto done;
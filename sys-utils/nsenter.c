@@ -42,6 +42,7 @@
 #include "namespace.h"
 #include "exec_shell.h"
 #include "optutils.h"
+#include "pidfd-utils.h"
 
 static struct namespace_file {
 	int nstype;
@@ -148,6 +149,51 @@ static void open_namespace_fd(int nstype, const char *path)
 	assert(nsfile->nstype);
 }
 
+static void open_namespace_fds(int namespaces)
+{
+	struct namespace_file *nsfile;
+
+	for (nsfile = namespace_files; nsfile->nstype; nsfile++)
+		if (nsfile->nstype & namespaces)
+			open_namespace_fd(nsfile->nstype, NULL);
+}
+
+/* returns true if any namespace has been specified by file */
+static bool has_namespace_fds(void)
+{
+	struct namespace_file *nsfile;
+
+	for (nsfile = namespace_files; nsfile->nstype; nsfile++)
+		if (nsfile->fd >= 0)
+			return true;
+	return false;
+}
+
+/*
+ * Enters all @namespaces of the target process by one setns() call with the
+ * pidfd (since Linux 5.8). The kernel enters the namespaces atomically (all or
+ * nothing) and in the right order, the /proc/PID/ns files are not used at all.
+ */
+static int enter_target_pidfd(int namespaces)
+{
+#ifdef UL_HAVE_PIDFD
+	int fd, rc;
+
+	fd = pidfd_open(namespace_target_pid, 0);
+	if (fd < 0)
+		return -errno;
+
+	rc = setns(fd, namespaces);
+	if (rc)
+		rc = -errno;
+	close(fd);
+	return rc;
+#else
+	(void) namespaces;
+	return -ENOSYS;
+#endif
+}
+
 static int get_ns_ino(const char *path, ino_t *ino)
 {
 	struct stat st;
@@ -262,7 +308,7 @@ int main(int argc, char *argv[])
 	struct namespace_file *nsfile;
 	int c, pass, namespaces = 0, setgroups_nerrs = 0, preserve_cred = 0;
 	bool do_rd = false, do_wd = false, force_uid = false, force_gid = false;
-	bool do_all = false;
+	bool do_all = false, use_pidfd = false;
 	int do_fork = -1; /* unknown yet */
 	char *wdns = NULL;
 	uid_t uid = 0;
@@ -411,16 +457,20 @@ int main(int argc, char *argv[])
 	}
 
 	/*
-	 * Open remaining namespace and directory descriptors.
+	 * Open directory descriptors and remaining namespace descriptors. If
+	 * all the namespaces are from the target process, try to enter them
+	 * by pidfd and open the namespace files only if it's not supported.
 	 */
-	for (nsfile = namespace_files; nsfile->nstype; nsfile++)
-		if (nsfile->nstype & namespaces)
-			open_namespace_fd(nsfile->nstype, NULL);
 	if (do_rd)
 		open_target_fd(&root_fd, "root", NULL);
 	if (do_wd)
 		open_target_fd(&wd_fd, "cwd", NULL);
 
+	if (namespaces && namespace_target_pid && !has_namespace_fds())
+		use_pidfd = true;
+	else
+		open_namespace_fds(namespaces);
+
 	/*
 	 * Update namespaces variable to contain all requested namespaces
 	 */
@@ -441,6 +491,15 @@ int main(int argc, char *argv[])
 			setgroups_nerrs++;
 	}
 
+	if (use_pidfd) {
+		if (enter_target_pidfd(namespaces) == 0) {
+			if ((namespaces & CLONE_NEWPID) && do_fork == -1)
+				do_fork = 1;
+		} else
+			/* old kernel, nothing entered, use the files */
+			open_namespace_fds(namespaces);
+	}
+
 	/*
 	 * Now that we know which namespaces we want to enter, enter
 	 * them.  Do this in two passes, not entering the user
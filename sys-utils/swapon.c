@@ -23,6 +23,8 @@
 #include "strutils.h"
 #include "optutils.h"
 #include "closestream.h"
+#include "monotonic.h"
+#include "jobs.h"
 
 #include "swapheader.h"
 #include "swapprober.h"
@@ -124,6 +126,7 @@ struct swapon_ctl {
 	int ncolumns;				/* number of columns */
 
 	struct swap_prop props;		/* global settings for all devices */
+	size_t jobs;			/* --jobs for --all */
 
 	unsigned int
 		all:1,			/* turn on all swap devices */
@@ -673,10 +676,22 @@ static int do_swapon(const struct swapon_ctl *ctl,
 			flags |= prop->discard;
 	}
 
-	if (ctl->verbose)
+	if (ctl->verbose) {
+		struct timeval start, end;
+
 		printf(_("swapon %s\n"), dev.path);
 
-	status = swapon(dev.path, flags);
+		gettime_monotonic(&start);
+		status = swapon(dev.path, flags);
+		gettime_monotonic(&end);
+
+		timersub(&end, &start, &end);
+		if (status == 0)
+			printf(_("swapon %s: activated in %ld.%06ld seconds\n"),
+				dev.path, (long) end.tv_sec, (long) end.tv_usec);
+	} else
+		status = swapon(dev.path, flags);
+
 	if (status < 0)
 		warn(_("%s: swapon failed"), dev.path);
 
@@ -735,11 +750,103 @@ static int parse_options(struct swap_prop *props, const char *options)
 }
 
 
+/* --all entry, the device is resolved and not active yet */
+struct swapon_entry {
+	char *device;
+	struct swap_prop prop;
+	size_t idx;			/* fstab order */
+	int status;
+};
+
+struct swapon_group {
+	const struct swapon_ctl *ctl;
+	struct swapon_entry *ents;
+	size_t nents;
+	size_t next;			/* next entry to activate */
+};
+
+static void *swapon_group_worker(void *data)
+{
+	struct swapon_group *gr = data;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&gr->next, 1, __ATOMIC_RELAXED)) < gr->nents) {
+		struct swapon_entry *ent = &gr->ents[i];
+
+		ent->status = do_swapon(gr->ctl, &ent->prop, ent->device, TRUE);
+	}
+	return NULL;
+}
+
+/* activates all entries of the group concurrently */
+static int swapon_group(const struct swapon_ctl *ctl,
+			struct swapon_entry *ents, size_t nents)
+{
+	struct swapon_group gr = { .ctl = ctl, .ents = ents, .nents = nents };
+	size_t i;
+	int status = 0;
+
+	ul_run_jobs(min(ctl->jobs, nents), swapon_group_worker, &gr, 0);
+
+	for (i = 0; i < nents; i++)
+		status |= ents[i].status;
+	return status;
+}
+
+/* higher priority first, without priority last, then in fstab order */
+static int cmp_swapon_entries(const void *a0, const void *b0)
+{
+	const struct swapon_entry *a = a0, *b = b0;
+
+	if (a->prop.priority != b->prop.priority) {
+		if (a->prop.priority < 0 || b->prop.priority < 0)
+			return a->prop.priority < 0 ? 1 : -1;
+		return cmp_numbers(b->prop.priority, a->prop.priority);
+	}
+	return cmp_numbers(a->idx, b->idx);
+}
+
+/*
+ * The areas without priority get decreasing priorities from kernel in order
+ * of activation, so they are activated one by one in fstab order. The areas
+ * with the same priority are activated concurrently by --jobs threads, and
+ * the groups are activated from the highest priority.
+ */
+static int swapon_entries(const struct swapon_ctl *ctl,
+			  struct swapon_entry *ents, size_t nents)
+{
+	size_t i, end;
+	int status = 0;
+
+	if (ctl->jobs <= 1) {
+		for (i = 0; i < nents; i++)
+			status |= do_swapon(ctl, &ents[i].prop, ents[i].device, TRUE);
+		return status;
+	}
+
+	qsort(ents, nents, sizeof(*ents), cmp_swapon_entries);
+
+	for (i = 0; i < nents; i = end) {
+		int prio = ents[i].prop.priority;
+
+		for (end = i + 1; end < nents && prio >= 0
+				  && ents[end].prop.priority == prio; end++);
+
+		if (ctl->verbose && end - i > 1)
+			printf(_("swapon: activating %zu areas with priority %d\n"),
+				end - i, prio);
+		status |= swapon_group(ctl, &ents[i], end - i);
+	}
+	return status;
+}
+
 static int swapon_all(struct swapon_ctl *ctl)
 {
 	struct libmnt_table *tb = get_fstab();
 	struct libmnt_iter *itr;
 	struct libmnt_fs *fs;
+	struct swapon_entry *ents = NULL;
+	size_t i, nents = 0;
 	int status = 0;
 
 	if (!tb)
@@ -789,11 +896,21 @@ static int swapon_all(struct swapon_ctl *ctl)
 			continue;
 		}
 
-		/* swapon */
-		status |= do_swapon(ctl, &prop, device, TRUE);
+		ents = xrealloc(ents, (nents + 1) * sizeof(*ents));
+		ents[nents].device = xstrdup(device);
+		ents[nents].prop = prop;
+		ents[nents].idx = nents;
+		ents[nents].status = 0;
+		nents++;
 	}
-
 	mnt_free_iter(itr);
+
+	/* swapon */
+	status |= swapon_entries(ctl, ents, nents);
+
+	for (i = 0; i < nents; i++)
+		free(ents[i].device);
+	free(ents);
 	return status;
 }
 
@@ -814,6 +931,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -d, --discard[=<policy>] enable swap discards, if supported by device\n"), out);
 	fputs(_(" -e, --ifexists           silently skip devices that do not exist\n"), out);
 	fputs(_(" -f, --fixpgsz            reinitialize the swap space if necessary\n"), out);
+	fputs(_(" -j, --jobs <num>         enable up to <num> swaps at once (with --all)\n"), out);
 	fputs(_(" -o, --options <list>     comma-separated list of swap options\n"), out);
 	fputs(_(" -p, --priority <prio>    specify the priority of the swap device\n"), out);
 	fputs(_(" -s, --summary            display summary about used swap devices (DEPRECATED)\n"), out);
@@ -870,6 +988,7 @@ int main(int argc, char *argv[])
 		{ "options",    optional_argument, NULL, 'o'               },
 		{ "summary",    no_argument,       NULL, 's'               },
 		{ "fixpgsz",    no_argument,       NULL, 'f'               },
+		{ "jobs",       required_argument, NULL, 'j'               },
 		{ "all",        no_argument,       NULL, 'a'               },
 		{ "help",       no_argument,       NULL, 'h'               },
 		{ "verbose",    no_argument,       NULL, 'v'               },
@@ -904,7 +1023,7 @@ int main(int argc, char *argv[])
 	mnt_init_debug(0);
 	mntcache = mnt_new_cache();
 
-	while ((c = getopt_long(argc, argv, "ahd::efo:p:svVL:U:",
+	while ((c = getopt_long(argc, argv, "ahd::efj:o:p:svVL:U:",
 				long_opts, NULL)) != -1) {
 
 		err_exclusive_options(c, long_opts, excl, excl_st);
@@ -946,6 +1065,9 @@ int main(int argc, char *argv[])
 		case 'f':
 			ctl.fix_page_size = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			break;
 		case 's':		/* status report */
 			status = display_summary();
 			return status;
@@ -333,6 +333,187 @@ done:
 	return rc;
 }
 
+/*
+ * The fast way for umount --recursive: the subtree is computed once from
+ * the mountinfo parent IDs and unmounted bottom-up by the entries of the
+ * table, without mountinfo reparsing for every umount. The filesystems
+ * removed in the meantime by the mount propagation fail, these failures
+ * are verified by one mountinfo reparse at the end. For --lazy, only the top
+ * of the subtree is detached, the kernel detaches all the children.
+ */
+struct umount_subtree {
+	struct libmnt_fs	**ents;		/* bottom-up order */
+	size_t			nents;
+};
+
+static void subtree_add(struct umount_subtree *st, struct libmnt_fs *fs)
+{
+	if ((st->nents & 127) == 0)
+		st->ents = xrealloc(st->ents, (st->nents + 128) * sizeof(*st->ents));
+	st->ents[st->nents++] = fs;
+}
+
+/* the same order as umount_do_recurse() */
+static int subtree_collect(struct libmnt_table *tb, struct libmnt_fs *fs,
+			   struct umount_subtree *st)
+{
+	struct libmnt_fs *child, *over = NULL;
+	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_BACKWARD);
+	int rc;
+
+	if (!itr)
+		err(MNT_EX_SYSERR, _("libmount iterator allocation failed"));
+
+	if (mnt_table_over_fs(tb, fs, &over) == 0 && over) {
+		rc = subtree_collect(tb, over, st);
+		if (rc)
+			goto done;
+	}
+
+	for (;;) {
+		rc = mnt_table_next_child_fs(tb, itr, fs, &child);
+		if (rc < 0) {
+			warnx(_("failed to get child fs of %s"),
+					mnt_fs_get_target(fs));
+			goto done;
+		} else if (rc == 1)
+			break;		/* no more children */
+
+		if (over && child == over)
+			continue;
+
+		rc = subtree_collect(tb, child, st);
+		if (rc)
+			goto done;
+	}
+
+	subtree_add(st, fs);
+	rc = 0;
+done:
+	mnt_free_iter(itr);
+	return rc;
+}
+
+/*
+ * Returns 1 if the umount failed because @fs is possibly not mounted anymore
+ * (EINVAL, or the mountpoint does not exist), the error is not reported and
+ * it's up to subtree_verify().
+ */
+static int umount_fs(struct libmnt_context *cxt, struct libmnt_fs *fs, int *xrc)
+{
+	int rc;
+
+	if (mnt_context_set_fs(cxt, fs))
+		err(MNT_EX_SYSERR, _("failed to set umount target"));
+
+	rc = mnt_context_umount(cxt);
+	if (rc && (!mnt_context_syscall_called(cxt)
+		   || mnt_context_get_syscall_errno(cxt) == EINVAL
+		   || mnt_context_get_syscall_errno(cxt) == ENOENT)) {
+		mnt_reset_context(cxt);
+		*xrc = MNT_EX_SUCCESS;
+		return 1;
+	}
+
+	*xrc = mk_exit_code(cxt, rc);
+	if (*xrc == MNT_EX_SUCCESS && mnt_context_is_verbose(cxt))
+		success_message(cxt);
+
+	mnt_reset_context(cxt);
+	return 0;
+}
+
+static int cmp_ids(const void *a, const void *b)
+{
+	int x = *(const int *) a, y = *(const int *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* umount the @st entries still in mountinfo by the regular way */
+static int subtree_verify(struct libmnt_context *cxt, struct umount_subtree *st)
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	int *ids, rc = MNT_EX_SUCCESS;
+	size_t i, nids = 0;
+
+	tb = new_mountinfo(cxt);
+	if (!tb)
+		return MNT_EX_SOFTWARE;
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		err(MNT_EX_SYSERR, _("libmount iterator allocation failed"));
+
+	ids = xcalloc(mnt_table_get_nents(tb) + 1, sizeof(int));
+	while (mnt_table_next_fs(tb, itr, &fs) == 0)
+		ids[nids++] = mnt_fs_get_id(fs);
+	qsort(ids, nids, sizeof(int), cmp_ids);
+
+	for (i = 0; i < st->nents && rc == MNT_EX_SUCCESS; i++) {
+		int id = mnt_fs_get_id(st->ents[i]);
+
+		if (bsearch(&id, ids, nids, sizeof(int), cmp_ids))
+			rc = umount_one_if_mounted(cxt, mnt_fs_get_target(st->ents[i]));
+	}
+
+	free(ids);
+	mnt_free_iter(itr);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+static int umount_subtree(struct libmnt_context *cxt,
+		struct libmnt_table *tb, struct libmnt_fs *fs)
+{
+	struct umount_subtree st = { .nents = 0 };
+	int rc = MNT_EX_SUCCESS, verify = 0;
+	size_t i;
+
+	/* the permissions are evaluated against the current mountinfo */
+	if (mnt_context_is_restricted(cxt))
+		return umount_do_recurse(cxt, tb, fs);
+
+	if (subtree_collect(tb, fs, &st) != 0) {
+		free(st.ents);
+		return MNT_EX_SOFTWARE;
+	}
+
+	if (mnt_context_is_lazy(cxt)) {
+		struct libmnt_fs *over, *stack[64];
+		size_t nstack = 0;
+
+		/* detach the overmounts from the top, umount2() with the path
+		 * always detaches the topmost filesystem */
+		for (over = fs; over && nstack < ARRAY_SIZE(stack); ) {
+			stack[nstack++] = over;
+			if (mnt_table_over_fs(tb, over, &over) != 0)
+				break;
+		}
+		for (i = nstack; i > 0; i--) {
+			if (umount_fs(cxt, stack[i - 1], &rc) == 0
+			    && rc != MNT_EX_SUCCESS)
+				break;
+		}
+		verify = rc == MNT_EX_SUCCESS;
+	} else {
+		for (i = 0; i < st.nents; i++) {
+			if (umount_fs(cxt, st.ents[i], &rc) == 1)
+				verify = 1;
+			else if (rc != MNT_EX_SUCCESS)
+				break;
+		}
+	}
+
+	if (verify)
+		rc = subtree_verify(cxt, &st);
+
+	free(st.ents);
+	return rc;
+}
+
 static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 {
 	struct libmnt_table *tb;
@@ -348,7 +529,7 @@ static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 
 	fs = mnt_table_find_target(tb, spec, MNT_ITER_BACKWARD);
 	if (fs)
-		rc = umount_do_recurse(cxt, tb, fs);
+		rc = umount_subtree(cxt, tb, fs);
 	else {
 		rc = MNT_EX_USAGE;
 		if (!quiet)
@@ -412,7 +593,7 @@ static int umount_alltargets(struct libmnt_context *cxt, const char *spec, int r
 			continue;
 		mnt_context_disable_swapmatch(cxt, 1);
 		if (rec)
-			rc = umount_do_recurse(cxt, tb, fs);
+			rc = umount_subtree(cxt, tb, fs);
 		else
 			rc = umount_one_if_mounted(cxt, mnt_fs_get_target(fs));
 
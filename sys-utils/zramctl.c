@@ -25,6 +25,9 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include <libsmartcols.h>
 
@@ -532,6 +535,309 @@ print_table:
 	scols_unref_table(tb);
 }
 
+/*
+ * Watch mode (--watch)
+ *
+ * The mm_stat, bd_stat and io_stat files are reread every interval, the
+ * counters are printed as the difference to the previous read.
+ */
+enum {
+	W_MM_ORIG_DATA_SIZE = 0,
+	W_MM_COMPR_DATA_SIZE,
+	W_MM_MEM_USED_TOTAL,
+	W_MM_MEM_LIMIT,
+	W_MM_MEM_USED_MAX,
+	W_MM_SAME_PAGES,
+	W_MM_PAGES_COMPACTED,
+	W_MM_HUGE_PAGES,
+	__W_MM_MAX
+};
+
+enum {
+	W_BD_COUNT = 0,
+	W_BD_READS,
+	W_BD_WRITES,
+	__W_BD_MAX
+};
+
+enum {
+	W_IO_FAILED_READS = 0,
+	W_IO_FAILED_WRITES,
+	__W_IO_MAX
+};
+
+#define ZRAM_BD_UNIT	4096	/* bd_stat counts in 4K units */
+
+struct zram_sample {
+	char		devname[32];
+	uint64_t	mm[__W_MM_MAX];
+	uint64_t	bd[__W_BD_MAX];
+	uint64_t	io[__W_IO_MAX];
+	size_t		nmm, nbd, nio;	/* number of fields read */
+};
+
+/* reads up to @nvals numbers from the sysfs file @name */
+static size_t read_stat_file(struct path_cxt *sysfs, const char *name,
+			     uint64_t *vals, size_t nvals)
+{
+	char *str = NULL, *p, *end;
+	size_t n = 0;
+
+	if (ul_path_read_string(sysfs, &str, name) <= 0 || !str)
+		return 0;
+
+	for (p = str; n < nvals; p = end) {
+		errno = 0;
+		vals[n] = strtoull(p, &end, 10);
+		if (errno || end == p)
+			break;
+		n++;
+	}
+	free(str);
+	return n;
+}
+
+static void zram_read_sample(struct zram *z, struct zram_sample *sm)
+{
+	struct path_cxt *sysfs = zram_get_sysfs(z);
+
+	memset(sm, 0, sizeof(*sm));
+	xstrncpy(sm->devname, z->devname, sizeof(sm->devname));
+	if (!sysfs)
+		return;
+
+	sm->nmm = read_stat_file(sysfs, "mm_stat", sm->mm, ARRAY_SIZE(sm->mm));
+	sm->nbd = read_stat_file(sysfs, "bd_stat", sm->bd, ARRAY_SIZE(sm->bd));
+	sm->nio = read_stat_file(sysfs, "io_stat", sm->io, ARRAY_SIZE(sm->io));
+}
+
+/* reads samples of @z or of all used devices, returns number of samples */
+static size_t read_samples(struct zram *z, struct zram_sample **samples)
+{
+	struct zram_sample *sms = NULL;
+	size_t n = 0;
+	DIR *dir;
+	struct dirent *d;
+
+	if (z) {
+		sms = xcalloc(1, sizeof(*sms));
+		zram_read_sample(z, &sms[n++]);
+		*samples = sms;
+		return n;
+	}
+
+	z = new_zram(NULL);
+	if (!(dir = opendir(_PATH_DEV)))
+		err(EXIT_FAILURE, _("cannot open %s"), _PATH_DEV);
+
+	while ((d = readdir(dir))) {
+		int num;
+
+		if (sscanf(d->d_name, "zram%d", &num) != 1)
+			continue;
+		zram_set_devname(z, NULL, num);
+		if (!zram_exist(z) || !zram_used(z))
+			continue;
+		sms = xrealloc(sms, (n + 1) * sizeof(*sms));
+		zram_read_sample(z, &sms[n++]);
+	}
+	closedir(dir);
+	free_zram(z);
+
+	*samples = sms;
+	return n;
+}
+
+static const struct zram_sample *find_sample(const struct zram_sample *sms,
+					     size_t n, const char *devname)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(sms[i].devname, devname) == 0)
+			return &sms[i];
+	}
+	return NULL;
+}
+
+static char *sample_size(uint64_t num)
+{
+	char *str;
+
+	if (inbytes)
+		xasprintf(&str, "%ju", (uintmax_t) num);
+	else
+		str = size_to_human_string(SIZE_SUFFIX_1LETTER, num);
+	return str;
+}
+
+/* returns increment of the counter, 0 if the counter has been reset */
+static uint64_t sample_delta(uint64_t cur, uint64_t old)
+{
+	return cur >= old ? cur - old : 0;
+}
+
+static uint64_t sample_rate(uint64_t cur, uint64_t old, double secs)
+{
+	return (uint64_t) (sample_delta(cur, old) / secs);
+}
+
+enum {
+	COL_WATCH_NAME = 0,
+	COL_WATCH_DATA,
+	COL_WATCH_COMPR,
+	COL_WATCH_RATIO,
+	COL_WATCH_TOTAL,
+	COL_WATCH_COMPACTED,
+	COL_WATCH_HUGE,
+	COL_WATCH_WB_READ,
+	COL_WATCH_WB_WRITE,
+	COL_WATCH_FAILED
+};
+
+static void print_samples(const struct zram_sample *sms, size_t n,
+			  const struct zram_sample *old, size_t nold,
+			  double secs)
+{
+	struct libscols_table *tb;
+	size_t i;
+
+	tb = scols_new_table();
+	if (!tb)
+		err(EXIT_FAILURE, _("failed to allocate output table"));
+
+	scols_table_enable_raw(tb, raw);
+	scols_table_enable_noheadings(tb, no_headings);
+
+	if (!scols_table_new_column(tb, "NAME", 0.25, 0)
+	    || !scols_table_new_column(tb, "DATA", 5, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "COMPR", 5, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "RATIO", 3, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "TOTAL", 5, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "COMPACTED", 3, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "HUGE", 3, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "WB-READ/s", 5, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "WB-WRITE/s", 5, SCOLS_FL_RIGHT)
+	    || !scols_table_new_column(tb, "FAILED", 3, SCOLS_FL_RIGHT))
+		err(EXIT_FAILURE, _("failed to initialize output column"));
+
+	for (i = 0; i < n; i++) {
+		const struct zram_sample *sm = &sms[i];
+		const struct zram_sample *prev = find_sample(old, nold, sm->devname);
+		struct libscols_line *ln;
+		char *str;
+
+		ln = scols_table_new_line(tb, NULL);
+		if (!ln)
+			err(EXIT_FAILURE, _("failed to allocate output line"));
+
+		if (scols_line_set_data(ln, COL_WATCH_NAME, sm->devname))
+			err(EXIT_FAILURE, _("failed to add output data"));
+
+		if (sm->nmm > W_MM_MEM_USED_TOTAL) {
+			scols_line_refer_data(ln, COL_WATCH_DATA,
+					sample_size(sm->mm[W_MM_ORIG_DATA_SIZE]));
+			scols_line_refer_data(ln, COL_WATCH_COMPR,
+					sample_size(sm->mm[W_MM_COMPR_DATA_SIZE]));
+			scols_line_refer_data(ln, COL_WATCH_TOTAL,
+					sample_size(sm->mm[W_MM_MEM_USED_TOTAL]));
+			if (sm->mm[W_MM_COMPR_DATA_SIZE]) {
+				xasprintf(&str, "%.2f",
+					(double) sm->mm[W_MM_ORIG_DATA_SIZE]
+						 / sm->mm[W_MM_COMPR_DATA_SIZE]);
+				scols_line_refer_data(ln, COL_WATCH_RATIO, str);
+			}
+		}
+		if (sm->nmm > W_MM_HUGE_PAGES) {
+			xasprintf(&str, "%ju", (uintmax_t) sm->mm[W_MM_HUGE_PAGES]);
+			scols_line_refer_data(ln, COL_WATCH_HUGE, str);
+		}
+
+		if (!prev)
+			continue;	/* no rates for the first sample */
+
+		if (sm->nmm > W_MM_PAGES_COMPACTED && prev->nmm > W_MM_PAGES_COMPACTED) {
+			xasprintf(&str, "%ju", (uintmax_t) sample_delta(
+					sm->mm[W_MM_PAGES_COMPACTED],
+					prev->mm[W_MM_PAGES_COMPACTED]));
+			scols_line_refer_data(ln, COL_WATCH_COMPACTED, str);
+		}
+		if (sm->nbd == __W_BD_MAX && prev->nbd == __W_BD_MAX) {
+			scols_line_refer_data(ln, COL_WATCH_WB_READ,
+				sample_size(sample_rate(sm->bd[W_BD_READS],
+						prev->bd[W_BD_READS], secs) * ZRAM_BD_UNIT));
+			scols_line_refer_data(ln, COL_WATCH_WB_WRITE,
+				sample_size(sample_rate(sm->bd[W_BD_WRITES],
+						prev->bd[W_BD_WRITES], secs) * ZRAM_BD_UNIT));
+		}
+		if (sm->nio == __W_IO_MAX && prev->nio == __W_IO_MAX) {
+			xasprintf(&str, "%ju", (uintmax_t) (
+				sample_delta(sm->io[W_IO_FAILED_READS],
+					     prev->io[W_IO_FAILED_READS]) +
+				sample_delta(sm->io[W_IO_FAILED_WRITES],
+					     prev->io[W_IO_FAILED_WRITES])));
+			scols_line_refer_data(ln, COL_WATCH_FAILED, str);
+		}
+	}
+
+	scols_print_table(tb);
+	scols_unref_table(tb);
+	fflush(stdout);
+}
+
+/* runs until interrupted or until the output fails */
+static void watch(struct zram *z, const struct timeval *interval)
+{
+	struct zram_sample *old = NULL, *cur = NULL;
+	size_t nold, ncur;
+	double secs = interval->tv_sec + (double) interval->tv_usec / 1000000;
+	int first = 1;
+
+	nold = read_samples(z, &old);
+
+	while (!ferror(stdout)) {
+		struct timespec ts = {
+			.tv_sec = interval->tv_sec,
+			.tv_nsec = interval->tv_usec * 1000
+		};
+
+		while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+
+		ncur = read_samples(z, &cur);
+		if (!first)
+			fputc('\n', stdout);
+		print_samples(cur, ncur, old, nold, secs);
+		first = 0;
+
+		free(old);
+		old = cur;
+		nold = ncur;
+		cur = NULL;
+	}
+	free(old);
+}
+
+/* the list is in order of priority, the first algorithm has priority 1 */
+static int zram_set_recomp_algorithms(struct zram *z, const char *list)
+{
+	char **algs = strv_split(list, ",");
+	size_t i;
+	int rc = 0;
+
+	if (!algs)
+		return -EINVAL;
+
+	for (i = 0; rc == 0 && algs[i]; i++) {
+		char *str;
+
+		xasprintf(&str, "algo=%s priority=%zu", algs[i], i + 1);
+		rc = zram_set_strparm(z, "recomp_algorithm", str);
+		free(str);
+	}
+	strv_free(algs);
+	return rc;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -540,7 +846,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_HEADER, out);
 	fprintf(out, _(	" %1$s [options] <device>\n"
 			" %1$s -r <device> [...]\n"
-			" %1$s [options] -f | <device> -s <size>\n"),
+			" %1$s [options] -f | <device> -s <size>\n"
+			" %1$s --mark-idle <age> | --writeback <type> <device> [...]\n"),
 			program_invocation_short_name);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -557,6 +864,15 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -r, --reset               reset all specified devices\n"), out);
 	fputs(_(" -s, --size <size>         device size\n"), out);
 	fputs(_(" -t, --streams <number>    number of compression streams\n"), out);
+	fputs(_(" -w, --watch <secs>        print statistics every <secs> seconds\n"), out);
+	fputs(_("     --backing-dev <dev>   device for writeback of idle or incompressible pages\n"), out);
+	fputs(_("     --recompress-algorithm <list>\n"
+		"                           secondary algorithms for recompression\n"), out);
+	fputs(_("     --writeback-limit <size>\n"
+		"                           limit on the amount of data written back\n"), out);
+	fputs(_("     --mark-idle <age>     mark pages idle, all or older than <age> seconds\n"), out);
+	fputs(_("     --writeback <type>    write idle, huge, huge_idle or incompressible pages\n"
+		"                           to the backing device\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(27));
@@ -581,19 +897,28 @@ enum {
 	A_STATUS,
 	A_CREATE,
 	A_FINDONLY,
-	A_RESET
+	A_RESET,
+	A_WATCH,
+	A_WRITEBACK
 };
 
 int main(int argc, char **argv)
 {
-	uintmax_t size = 0, nstreams = 0;
-	char *algorithm = NULL;
+	uintmax_t size = 0, nstreams = 0, wblimit = 0;
+	char *algorithm = NULL, *backing_dev = NULL, *recomp = NULL;
+	char *idle = NULL, *wbtype = NULL;
 	int rc = 0, c, find = 0, act = A_NONE;
 	struct zram *zram = NULL;
+	struct timeval interval = { 0 };
 
 	enum {
 		OPT_RAW = CHAR_MAX + 1,
-		OPT_LIST_TYPES
+		OPT_LIST_TYPES,
+		OPT_BACKING_DEV,
+		OPT_RECOMP_ALG,
+		OPT_WB_LIMIT,
+		OPT_MARK_IDLE,
+		OPT_WRITEBACK
 	};
 
 	static const struct option longopts[] = {
@@ -609,12 +934,18 @@ int main(int argc, char **argv)
 		{ "size",      required_argument, NULL, 's' },
 		{ "streams",   required_argument, NULL, 't' },
 		{ "version",   no_argument, NULL, 'V' },
+		{ "watch",     required_argument, NULL, 'w' },
+		{ "backing-dev", required_argument, NULL, OPT_BACKING_DEV },
+		{ "recompress-algorithm", required_argument, NULL, OPT_RECOMP_ALG },
+		{ "writeback-limit", required_argument, NULL, OPT_WB_LIMIT },
+		{ "mark-idle", required_argument, NULL, OPT_MARK_IDLE },
+		{ "writeback", required_argument, NULL, OPT_WRITEBACK },
 		{ NULL, 0, NULL, 0 }
 	};
 
 	static const ul_excl_t excl[] = {
-		{ 'f', 'o', 'r' },
-		{ 'o', 'r', 's' },
+		{ 'f', 'o', 'r', 'w' },
+		{ 'o', 'r', 's', 'w' },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -624,7 +955,7 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	close_stdout_atexit();
 
-	while ((c = getopt_long(argc, argv, "a:bfho:nrs:t:V", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "a:bfho:nrs:t:Vw:", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -659,6 +990,30 @@ int main(int argc, char **argv)
 		case 'r':
 			act = A_RESET;
 			break;
+		case 'w':
+			strtotimeval_or_err(optarg, &interval,
+					    _("invalid watch interval"));
+			if (!timerisset(&interval))
+				errx(EXIT_FAILURE, _("invalid watch interval"));
+			act = A_WATCH;
+			break;
+		case OPT_BACKING_DEV:
+			backing_dev = optarg;
+			break;
+		case OPT_RECOMP_ALG:
+			recomp = optarg;
+			break;
+		case OPT_WB_LIMIT:
+			wblimit = strtosize_or_err(optarg, _("failed to parse writeback limit"));
+			break;
+		case OPT_MARK_IDLE:
+			if (strcmp(optarg, "all") != 0)
+				strtou64_or_err(optarg, _("failed to parse idle age"));
+			idle = optarg;
+			break;
+		case OPT_WRITEBACK:
+			wbtype = optarg;
+			break;
 		case OPT_RAW:
 			raw = 1;
 			break;
@@ -678,15 +1033,24 @@ int main(int argc, char **argv)
 	if (find && optind < argc)
 		errx(EXIT_FAILURE, _("option --find is mutually exclusive "
 				     "with <device>"));
+	if (idle || wbtype) {
+		if (act != A_NONE || find)
+			errx(EXIT_FAILURE, _("options --mark-idle and --writeback "
+					     "cannot be combined with other actions"));
+		act = A_WRITEBACK;
+	}
 	if (act == A_NONE)
 		act = find ? A_FINDONLY : A_STATUS;
 
-	if (act != A_RESET && optind + 1 < argc)
+	if (act != A_RESET && act != A_WRITEBACK && optind + 1 < argc)
 		errx(EXIT_FAILURE, _("only one <device> at a time is allowed"));
 
-	if ((act == A_STATUS || act == A_FINDONLY) && (algorithm || nstreams))
+	if (act != A_CREATE && (algorithm || nstreams))
 		errx(EXIT_FAILURE, _("options --algorithm and --streams "
 				     "must be combined with --size"));
+	if (act != A_CREATE && (backing_dev || recomp || wblimit))
+		errx(EXIT_FAILURE, _("options --backing-dev, --recompress-algorithm "
+				     "and --writeback-limit must be combined with --size"));
 
 	ul_path_init_debug();
 	ul_sysfs_init_debug();
@@ -711,6 +1075,33 @@ int main(int argc, char **argv)
 		status(zram);
 		free_zram(zram);
 		break;
+	case A_WATCH:
+		if (optind < argc) {
+			zram = new_zram(argv[optind++]);
+			if (!zram_exist(zram))
+				err(EXIT_FAILURE, "%s", zram->devname);
+		}
+		watch(zram, &interval);
+		free_zram(zram);
+		break;
+	case A_WRITEBACK:
+		if (optind == argc)
+			errx(EXIT_FAILURE, _("no device specified"));
+		while (optind < argc) {
+			zram = new_zram(argv[optind]);
+			if (!zram_exist(zram))
+				err(EXIT_FAILURE, "%s", zram->devname);
+			if (idle && zram_set_strparm(zram, "idle", idle)) {
+				warn(_("%s: failed to mark pages idle"), zram->devname);
+				rc = 1;
+			} else if (wbtype && zram_set_strparm(zram, "writeback", wbtype)) {
+				warn(_("%s: failed to write back pages"), zram->devname);
+				rc = 1;
+			}
+			free_zram(zram);
+			optind++;
+		}
+		break;
 	case A_RESET:
 		if (optind == argc)
 			errx(EXIT_FAILURE, _("no device specified"));
@@ -757,9 +1148,24 @@ int main(int argc, char **argv)
 		    zram_set_strparm(zram, "comp_algorithm", algorithm))
 			err(EXIT_FAILURE, _("%s: failed to set algorithm"), zram->devname);
 
+		if (recomp && zram_set_recomp_algorithms(zram, recomp))
+			err(EXIT_FAILURE, _("%s: failed to set recompression algorithms"),
+				zram->devname);
+
+		if (backing_dev &&
+		    zram_set_strparm(zram, "backing_dev", backing_dev))
+			err(EXIT_FAILURE, _("%s: failed to set backing device"), zram->devname);
+
 		if (zram_set_u64parm(zram, "disksize", size))
 			err(EXIT_FAILURE, _("%s: failed to set disksize (%ju bytes)"),
 				zram->devname, size);
+
+		/* the limit is in 4K units */
+		if (wblimit &&
+		    (zram_set_u64parm(zram, "writeback_limit_enable", 1) ||
+		     zram_set_u64parm(zram, "writeback_limit",
+				      (wblimit + ZRAM_BD_UNIT - 1) / ZRAM_BD_UNIT)))
+			err(EXIT_FAILURE, _("%s: failed to set writeback limit"), zram->devname);
 		if (find)
 			printf("%s\n", zram->devname);
 		free_zram(zram);
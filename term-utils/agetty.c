@@ -34,7 +34,6 @@
 #include <pwd.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-#include <ifaddrs.h>
 #include <net/if.h>
 #include <sys/utsname.h>
 
@@ -1636,6 +1635,273 @@ done:
 }
 
 #ifdef AGETTY_RELOAD
+/*
+ * The interfaces and addresses for the \4 and \6 escapes. The cache is
+ * loaded by a netlink dump and then updated by the messages from netlink_fd,
+ * so the issue file is re-evaluated without a new scan of all interfaces.
+ * It is usable only while netlink_fd is open.
+ */
+struct nl_link {
+	int		index;
+	unsigned int	flags;			/* IFF_* */
+	char		name[IFNAMSIZ];
+};
+
+struct nl_addr {
+	int		index;			/* interface index */
+	sa_family_t	family;
+	unsigned char	prefixlen;
+	unsigned char	scope;			/* RT_SCOPE_* */
+	char		label[IFNAMSIZ];	/* IPv4 label (e.g. "eth0:1") */
+	union {
+		struct in_addr	in;
+		struct in6_addr	in6;
+	} addr;
+};
+
+static struct {
+	struct nl_link	*links;			/* sorted by index */
+	size_t		nlinks;
+	struct nl_addr	*addrs;			/* in kernel order */
+	size_t		naddrs;
+	unsigned int	loaded : 1;
+} addrcache;
+
+/* the flags used to select the "best" interface */
+#define NL_LINK_FLAGS	(IFF_UP | IFF_RUNNING | IFF_LOOPBACK)
+
+static char netlink_buf[32 * 1024];
+
+static void *grow_array(void *arr, size_t nmemb, size_t size)
+{
+	if (nmemb % 16 == 0) {
+		arr = realloc(arr, (nmemb + 16) * size);
+		if (!arr)
+			log_err(_("failed to allocate memory: %m"));
+	}
+	return arr;
+}
+
+static int cmp_link_index(const void *a, const void *b)
+{
+	int x = *((const int *) a), y = ((const struct nl_link *) b)->index;
+
+	return x < y ? -1 : x > y;
+}
+
+static struct nl_link *addrcache_get_link(int index)
+{
+	return bsearch(&index, addrcache.links, addrcache.nlinks,
+		       sizeof(struct nl_link), cmp_link_index);
+}
+
+static void addrcache_reset(void)
+{
+	addrcache.nlinks = 0;
+	addrcache.naddrs = 0;
+	addrcache.loaded = 0;
+}
+
+/* returns the RTMGRP_* group of the message if the cache has been changed */
+static uint32_t addrcache_update_link(struct nlmsghdr *h)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(h);
+	struct rtattr *rta = IFLA_RTA(ifi);
+	int len = IFLA_PAYLOAD(h);
+	const char *name = NULL;
+	struct nl_link *l;
+	size_t i;
+
+	if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+		return 0;
+
+	l = addrcache_get_link(ifi->ifi_index);
+
+	if (h->nlmsg_type == RTM_DELLINK) {
+		if (!l)
+			return 0;
+		for (i = 0; i < addrcache.naddrs; ) {
+			if (addrcache.addrs[i].index == ifi->ifi_index)
+				memmove(&addrcache.addrs[i], &addrcache.addrs[i + 1],
+					(--addrcache.naddrs - i) * sizeof(struct nl_addr));
+			else
+				i++;
+		}
+		i = l - addrcache.links;
+		memmove(l, l + 1, (--addrcache.nlinks - i) * sizeof(*l));
+		return RTMGRP_LINK;
+	}
+
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_IFNAME)
+			name = RTA_DATA(rta);
+	}
+	if (!name)
+		return 0;
+
+	if (l) {
+		if ((l->flags & NL_LINK_FLAGS) == (ifi->ifi_flags & NL_LINK_FLAGS)
+		    && strncmp(l->name, name, sizeof(l->name)) == 0)
+			return 0;
+	} else {
+		addrcache.links = grow_array(addrcache.links, addrcache.nlinks,
+					     sizeof(struct nl_link));
+		for (i = addrcache.nlinks; i > 0; i--) {
+			if (addrcache.links[i - 1].index < ifi->ifi_index)
+				break;
+		}
+		l = &addrcache.links[i];
+		memmove(l + 1, l, (addrcache.nlinks++ - i) * sizeof(*l));
+		l->index = ifi->ifi_index;
+	}
+	l->flags = ifi->ifi_flags;
+	xstrncpy(l->name, name, sizeof(l->name));
+	return RTMGRP_LINK;
+}
+
+static uint32_t addrcache_update_addr(struct nlmsghdr *h)
+{
+	struct ifaddrmsg *ifa = NLMSG_DATA(h);
+	struct rtattr *rta = IFA_RTA(ifa);
+	int len = IFA_PAYLOAD(h);
+	struct nl_addr new = { .index = (int) ifa->ifa_index }, *a;
+	void *local = NULL, *address = NULL;
+	uint32_t group;
+	size_t i, sz;
+
+	if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+		return 0;
+
+	switch (ifa->ifa_family) {
+	case AF_INET:
+		group = RTMGRP_IPV4_IFADDR;
+		sz = sizeof(struct in_addr);
+		break;
+	case AF_INET6:
+		group = RTMGRP_IPV6_IFADDR;
+		sz = sizeof(struct in6_addr);
+		break;
+	default:
+		return 0;
+	}
+
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case IFA_LOCAL:
+			local = RTA_DATA(rta);
+			break;
+		case IFA_ADDRESS:
+			address = RTA_DATA(rta);
+			break;
+		case IFA_LABEL:
+			xstrncpy(new.label, RTA_DATA(rta), sizeof(new.label));
+			break;
+		}
+	}
+	/* the same as getifaddrs(), IFA_ADDRESS is the peer on point-to-point */
+	if (!local)
+		local = address;
+	if (!local)
+		return 0;
+
+	new.family = ifa->ifa_family;
+	new.prefixlen = ifa->ifa_prefixlen;
+	new.scope = ifa->ifa_scope;
+	memcpy(&new.addr, local, sz);
+
+	for (i = 0, a = addrcache.addrs; i < addrcache.naddrs; i++, a++) {
+		if (a->index == new.index && a->family == new.family
+		    && a->prefixlen == new.prefixlen
+		    && memcmp(&a->addr, &new.addr, sz) == 0)
+			break;
+	}
+
+	if (h->nlmsg_type == RTM_DELADDR) {
+		if (i == addrcache.naddrs)
+			return 0;
+		memmove(a, a + 1, (--addrcache.naddrs - i) * sizeof(*a));
+		return group;
+	}
+
+	if (i < addrcache.naddrs) {
+		if (strcmp(a->label, new.label) == 0)
+			return 0;
+	} else {
+		addrcache.addrs = grow_array(addrcache.addrs, addrcache.naddrs,
+					     sizeof(struct nl_addr));
+		/* The dump is in the kernel order. The new addresses are
+		 * sorted in the same way: by interface, by scope, and the
+		 * latest IPv4 address is the last, the latest IPv6 the first.
+		 */
+		for (i = addrcache.naddrs; addrcache.loaded && i > 0; i--) {
+			a = &addrcache.addrs[i - 1];
+			if (a->family != new.family)
+				continue;
+			if (a->index < new.index)
+				break;
+			if (a->index == new.index &&
+			    (new.family == AF_INET ? a->scope <= new.scope :
+						     a->scope < new.scope))
+				break;
+		}
+		a = &addrcache.addrs[i];
+		memmove(a + 1, a, (addrcache.naddrs++ - i) * sizeof(*a));
+	}
+	*a = new;
+	return group;
+}
+
+static uint32_t addrcache_update(struct nlmsghdr *h)
+{
+	switch (h->nlmsg_type) {
+	case RTM_NEWLINK:
+	case RTM_DELLINK:
+		return addrcache_update_link(h);
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		return addrcache_update_addr(h);
+	}
+	return 0;
+}
+
+static int addrcache_dump(int sock, int type)
+{
+	struct {
+		struct nlmsghdr nh;
+		struct rtgenmsg gen;
+	} req = {
+		.nh = {
+			.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg)),
+			.nlmsg_type = type,
+			.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+			.nlmsg_seq = type
+		},
+		.gen = { .rtgen_family = AF_UNSPEC }
+	};
+
+	if (send(sock, &req, req.nh.nlmsg_len, 0) < 0)
+		return -errno;
+
+	while (1) {
+		struct nlmsghdr *h;
+		ssize_t rc = recv(sock, netlink_buf, sizeof(netlink_buf), 0);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			return -EIO;
+
+		for (h = (struct nlmsghdr *) netlink_buf;
+		     NLMSG_OK(h, (size_t) rc); h = NLMSG_NEXT(h, rc)) {
+			if (h->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (h->nlmsg_type == NLMSG_ERROR)
+				return -EIO;
+			addrcache_update(h);
+		}
+	}
+}
+
 static void open_netlink(void)
 {
 	struct sockaddr_nl addr = { 0, };
@@ -1648,7 +1914,9 @@ static void open_netlink(void)
 	if (sock >= 0) {
 		addr.nl_family = AF_NETLINK;
 		addr.nl_pid = getpid();
-		addr.nl_groups = netlink_groups;
+		/* all the changes for the address cache, the issue file is
+		 * reloaded only for the @netlink_groups */
+		addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
 		if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
 			close(sock);
 		else
@@ -1658,14 +1926,13 @@ static void open_netlink(void)
 
 static int process_netlink_msg(int *triggered)
 {
-	char buf[4096];
 	struct sockaddr_nl snl;
 	struct nlmsghdr *h;
 	int rc;
 
 	struct iovec iov = {
-		.iov_base = buf,
-		.iov_len = sizeof(buf)
+		.iov_base = netlink_buf,
+		.iov_len = sizeof(netlink_buf)
 	};
 	struct msghdr msg = {
 		.msg_name = &snl,
@@ -1681,6 +1948,12 @@ static int process_netlink_msg(int *triggered)
 	if (rc < 0) {
 		if (errno == EWOULDBLOCK || errno == EAGAIN)
 			return 0;
+		if (errno == ENOBUFS) {
+			/* Overrun, some changes are lost */
+			addrcache.loaded = 0;
+			*triggered = 1;
+			return 1;
+		}
 
 		/* Failure, just stop listening for changes */
 		close(netlink_fd);
@@ -1688,7 +1961,9 @@ static int process_netlink_msg(int *triggered)
 		return 0;
 	}
 
-	for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, (unsigned int)rc); h = NLMSG_NEXT(h, rc)) {
+	for (h = (struct nlmsghdr *)netlink_buf; NLMSG_OK(h, (unsigned int)rc); h = NLMSG_NEXT(h, rc)) {
+		uint32_t group;
+
 		if (h->nlmsg_type == NLMSG_DONE ||
 		    h->nlmsg_type == NLMSG_ERROR) {
 			close(netlink_fd);
@@ -1696,8 +1971,10 @@ static int process_netlink_msg(int *triggered)
 			return 0;
 		}
 
-		*triggered = 1;
-		break;
+		group = addrcache_update(h);
+		if ((group & netlink_groups) ||
+		    (group == RTMGRP_LINK && netlink_groups))
+			*triggered = 1;
 	}
 
 	return 1;
@@ -1710,6 +1987,38 @@ static int process_netlink(void)
 	return triggered;
 }
 
+/*
+ * Returns 0 if the cache is ready. It is reused as long as the changes are
+ * received from netlink_fd, otherwise it is loaded again for every request.
+ */
+static int addrcache_load(void)
+{
+	int sock, rc;
+
+	/* listen before the dump, no change gets lost */
+	open_netlink();
+	if (addrcache.loaded && netlink_fd >= 0) {
+		/* apply the pending changes */
+		process_netlink();
+		if (addrcache.loaded && netlink_fd >= 0)
+			return 0;
+	}
+
+	addrcache_reset();
+	sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sock < 0)
+		return -errno;
+
+	rc = addrcache_dump(sock, RTM_GETLINK);
+	if (!rc)
+		rc = addrcache_dump(sock, RTM_GETADDR);
+	close(sock);
+
+	if (!rc)
+		addrcache.loaded = 1;
+	return rc;
+}
+
 static int wait_for_term_input(int fd)
 {
 	char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
@@ -2609,6 +2918,7 @@ static void log_warn(const char *fmt, ...)
 	va_end(ap);
 }
 
+#ifdef AGETTY_RELOAD
 static void print_addr(struct issue *ie, sa_family_t family, void *addr)
 {
 	char buff[INET6_ADDRSTRLEN + 1];
@@ -2623,51 +2933,38 @@ static void print_addr(struct issue *ie, sa_family_t family, void *addr)
  * found the "best" interface then prints at least host IP.
  */
 static void output_iface_ip(struct issue *ie,
-			    struct ifaddrs *addrs,
 			    const char *iface,
 			    sa_family_t family)
 {
-	struct ifaddrs *p;
 	struct addrinfo hints, *info = NULL;
 	char *host = NULL;
 	void *addr = NULL;
+	size_t i;
 
-	if (!addrs)
-		return;
-
-	for (p = addrs; p; p = p->ifa_next) {
+	for (i = 0; i < addrcache.naddrs; i++) {
+		struct nl_addr *a = &addrcache.addrs[i];
+		struct nl_link *l;
 
-		if (!p->ifa_name ||
-		    !p->ifa_addr ||
-		    p->ifa_addr->sa_family != family)
+		if (a->family != family)
+			continue;
+		l = addrcache_get_link(a->index);
+		if (!l)
 			continue;
 
 		if (iface) {
 			/* Filter out by interface name */
-		       if (strcmp(p->ifa_name, iface) != 0)
+			if (strcmp(*a->label ? a->label : l->name, iface) != 0)
 				continue;
 		} else {
 			/* Select the "best" interface */
-			if ((p->ifa_flags & IFF_LOOPBACK) ||
-			    !(p->ifa_flags & IFF_UP) ||
-			    !(p->ifa_flags & IFF_RUNNING))
+			if ((l->flags & IFF_LOOPBACK) ||
+			    !(l->flags & IFF_UP) ||
+			    !(l->flags & IFF_RUNNING))
 				continue;
 		}
 
-		addr = NULL;
-		switch (p->ifa_addr->sa_family) {
-		case AF_INET:
-			addr = &((struct sockaddr_in *)	p->ifa_addr)->sin_addr;
-			break;
-		case AF_INET6:
-			addr = &((struct sockaddr_in6 *) p->ifa_addr)->sin6_addr;
-			break;
-		}
-
-		if (addr) {
-			print_addr(ie, family, addr);
-			return;
-		}
+		print_addr(ie, family, &a->addr);
+		return;
 	}
 
 	if (iface)
@@ -2696,6 +2993,7 @@ static void output_iface_ip(struct issue *ie,
 	}
 	free(host);
 }
+#endif /* AGETTY_RELOAD */
 
 /*
  * parses \x{argument}, if not argument specified then returns NULL, the @fd
@@ -2880,23 +3178,20 @@ static void output_special_char(struct issue *ie,
 	case '6':
 	{
 		sa_family_t family = c == '4' ? AF_INET : AF_INET6;
-		struct ifaddrs *addrs = NULL;
 		char iface[128];
 
-		if (getifaddrs(&addrs))
-			break;
-
-		if (get_escape_argument(fp, iface, sizeof(iface)))
-			output_iface_ip(ie, addrs, iface, family);
-		else
-			output_iface_ip(ie, addrs, NULL, family);
-
-		freeifaddrs(addrs);
-
 		if (c == '4')
 			netlink_groups |= RTMGRP_IPV4_IFADDR;
 		else
 			netlink_groups |= RTMGRP_IPV6_IFADDR;
+
+		if (addrcache_load() != 0)
+			break;
+
+		if (get_escape_argument(fp, iface, sizeof(iface)))
+			output_iface_ip(ie, iface, family);
+		else
+			output_iface_ip(ie, NULL, family);
 		break;
 	}
 #endif
@@ -69,6 +69,8 @@ struct replay_setup {
 	struct timeval		delay_min;
 	double			delay_div;
 
+	struct timeval		elapsed;	/* recorded time of the current step */
+
 	char			default_type;	/* type for REPLAY_TIMING_SIMPLE */
 	int			crmode;
 };
@@ -224,6 +226,13 @@ int replay_set_timing_file(struct replay_setup *stp, const char *filename)
 	return rc;
 }
 
+/* returns time from the session start to the current step (as recorded) */
+struct timeval *replay_get_elapsed(struct replay_setup *setup)
+{
+	assert(setup);
+	return &setup->elapsed;
+}
+
 const char *replay_get_timing_file(struct replay_setup *setup)
 {
 	assert(setup);
@@ -462,6 +471,7 @@ int replay_get_next_step(struct replay_setup *stp, char *streams, struct replay_
 done:
 	if (timerisset(&ignored_delay))
 		timerinc(&step->delay, &ignored_delay);
+	timerinc(&stp->elapsed, &step->delay);
 
 	DBG(TIMING, ul_debug("reading next step done [rc=%d delay=%"PRId64".%06"PRId64
 			     "(ignored=%"PRId64".%06"PRId64") size=%zu]",
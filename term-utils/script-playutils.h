@@ -34,6 +34,7 @@ int replay_set_crmode(struct replay_setup *stp, int mode);
 int replay_set_timing_file(struct replay_setup *stp, const char *filename);
 const char *replay_get_timing_file(struct replay_setup *setup);
 int replay_get_timing_line(struct replay_setup *setup);
+struct timeval *replay_get_elapsed(struct replay_setup *setup);
 int replay_associate_log(struct replay_setup *stp, const char *streams, const char *filename);
 
 int replay_set_delay_min(struct replay_setup *stp, const struct timeval *tv);
@@ -103,6 +103,14 @@ enum {
 	SCRIPT_FMT_TIMING_MULTI,	/* (advanced) multiple streams in format "<type> <delta> <offset|etc> */
 };
 
+/*
+ * The logs are written by large buffers, the buffered data are flushed
+ * SCRIPT_FLUSH_DELAY after the first unflushed write (or after each write
+ * with --flush).
+ */
+#define SCRIPT_LOG_BUFSIZ	(64 * 1024)
+#define SCRIPT_FLUSH_DELAY	1	/* seconds */
+
 struct script_log {
 	FILE	*fp;			/* file pointer (handler) */
 	int	format;			/* SCRIPT_FMT_* */
@@ -146,6 +154,7 @@ struct script_control {
 	 flush:1,		/* flush after each write */
 	 quiet:1,		/* suppress most output */
 	 force:1,		/* write output to links */
+	 flush_pending:1,	/* flush by mainloop callback scheduled */
 	 isterm:1;		/* is child process running as terminal */
 };
 
@@ -386,6 +395,8 @@ static int log_start(struct script_control *ctl,
 		warn(_("cannot open %s"), log->filename);
 		return -errno;
 	}
+	if (!ctl->flush)
+		setvbuf(log->fp, NULL, _IOFBF, SCRIPT_LOG_BUFSIZ);
 
 	/* write header, etc. */
 	switch (log->format) {
@@ -683,6 +694,17 @@ static int callback_log_stream_activity(void *data, int fd, char *buf, size_t bu
 
 	ctl->outsz += ssz;
 
+	/* flush the buffered data later, see callback_flush_logs() */
+	if (ssz > 0 && !ctl->flush && !ctl->flush_pending
+	    && ul_pty_get_child(ctl->pty) > 0) {
+		struct timeval now, delay = { .tv_sec = SCRIPT_FLUSH_DELAY }, tv;
+
+		gettime_monotonic(&now);
+		timeradd(&now, &delay, &tv);
+		ul_pty_set_mainloop_time(ctl->pty, &tv);
+		ctl->flush_pending = 1;
+	}
+
 	/* check output limit */
 	if (ctl->maxsz != 0 && ctl->outsz >= ctl->maxsz) {
 		if (!ctl->quiet)
@@ -727,6 +749,11 @@ static int callback_flush_logs(void *data)
 	struct script_control *ctl = (struct script_control *) data;
 	size_t i;
 
+	if (ctl->flush_pending) {
+		ul_pty_set_mainloop_time(ctl->pty, NULL);
+		ctl->flush_pending = 0;
+	}
+
 	for (i = 0; i < ctl->out.nlogs; i++) {
 		int rc = log_flush(ctl, ctl->out.logs[i]);
 		if (rc)
@@ -935,6 +962,7 @@ int main(int argc, char **argv)
 	cb->log_stream_activity = callback_log_stream_activity;
 	cb->log_signal = callback_log_signal;
 	cb->flush_logs = callback_flush_logs;
+	cb->mainloop = callback_flush_logs;
 
 	if (!ctl.quiet) {
 		printf(_("Script started"));
@@ -29,6 +29,7 @@
 #include <getopt.h>
 #include <sys/time.h>
 #include <termios.h>
+#include <poll.h>
 
 #include "c.h"
 #include "xalloc.h"
@@ -36,8 +37,18 @@
 #include "nls.h"
 #include "strutils.h"
 #include "optutils.h"
+#include "monotonic.h"
 #include "script-playutils.h"
 
+/* keys to control the replay on terminal */
+enum {
+	REPLAY_KEY_NONE = 0,
+	REPLAY_KEY_PAUSE,	/* space */
+	REPLAY_KEY_FASTER,	/* '+' or up arrow */
+	REPLAY_KEY_SLOWER,	/* '-' or down arrow */
+	REPLAY_KEY_SKIP		/* right arrow */
+};
+
 static void __attribute__((__noreturn__))
 usage(void)
 {
@@ -66,6 +77,7 @@ usage(void)
 	fputs(_("     --summary           display overview about recorded session and exit\n"), out);
 	fputs(_(" -d, --divisor <num>     speed up or slow down execution with time divisor\n"), out);
 	fputs(_(" -m, --maxdelay <num>    wait at most this many seconds between updates\n"), out);
+	fputs(_("     --seek <num>        replay the first <num> seconds without delays\n"), out);
 	fputs(_(" -x, --stream <name>     stream type (out, in, signal or info)\n"), out);
 	fputs(_(" -c, --cr-mode <type>    CR char mode (auto, never, always)\n"), out);
 	printf(USAGE_HELP_OPTIONS(25));
@@ -108,6 +120,110 @@ delay_for(struct timeval *delay)
 #endif
 }
 
+/* returns the key at @buf[*i], *i is moved to the last char of the key */
+static int
+get_key(const char *buf, size_t len, size_t *i)
+{
+	switch (buf[*i]) {
+	case ' ':
+		return REPLAY_KEY_PAUSE;
+	case '+':
+		return REPLAY_KEY_FASTER;
+	case '-':
+		return REPLAY_KEY_SLOWER;
+	case '\033':
+		if (*i + 2 >= len || buf[*i + 1] != '[')
+			break;
+		*i += 2;
+		switch (buf[*i]) {
+		case 'A':
+			return REPLAY_KEY_FASTER;
+		case 'B':
+			return REPLAY_KEY_SLOWER;
+		case 'C':
+			return REPLAY_KEY_SKIP;
+		}
+		break;
+	}
+	return REPLAY_KEY_NONE;
+}
+
+/*
+ * Like delay_for(), but reads the keys from terminal meanwhile. The speed
+ * changes are applied to the rest of the delay as well as to the next steps.
+ * Returns -1 if stdin is not usable for the keys.
+ */
+static int
+delay_for_keys(struct replay_setup *setup, struct timeval *delay, double *divi)
+{
+	struct timeval left = *delay, mark, now, diff;
+	int paused = 0;
+
+	gettime_monotonic(&mark);
+
+	while (paused || timerisset(&left)) {
+		struct pollfd fd = { .fd = STDIN_FILENO, .events = POLLIN };
+		char buf[64];
+		ssize_t len = 0;
+		size_t i;
+		int rc;
+
+		rc = poll(&fd, 1, paused ? -1 :
+			(int) (left.tv_sec * 1000 + (left.tv_usec + 999) / 1000));
+		if (rc < 0 && errno != EINTR)
+			break;
+		if (rc > 0 && !(fd.revents & POLLIN)) {
+			delay_for(&left);
+			return -1;
+		}
+		if (rc > 0)
+			len = read(STDIN_FILENO, buf, sizeof(buf));
+
+		gettime_monotonic(&now);
+		if (!paused) {
+			timersub(&now, &mark, &diff);
+			if (timercmp(&diff, &left, <))
+				timersub(&left, &diff, &left);
+			else
+				timerclear(&left);
+		}
+		mark = now;
+
+		for (i = 0; len > 0 && i < (size_t) len; i++) {
+			int key = get_key(buf, len, &i);
+
+			switch (key) {
+			case REPLAY_KEY_PAUSE:
+				paused = !paused;
+				break;
+			case REPLAY_KEY_FASTER:
+			case REPLAY_KEY_SLOWER:
+			{
+				uint64_t usec = (uint64_t) left.tv_sec * 1000000
+						+ left.tv_usec;
+
+				if (key == REPLAY_KEY_FASTER) {
+					usec /= 2;
+					*divi *= 2;
+				} else {
+					usec *= 2;
+					*divi /= 2;
+				}
+				replay_set_delay_div(setup, *divi);
+				left.tv_sec = (time_t) (usec / 1000000);
+				left.tv_usec = (suseconds_t) (usec % 1000000);
+				DBG(TIMING, ul_debug("speed changed, divisor %f", *divi));
+				break;
+			}
+			case REPLAY_KEY_SKIP:
+				timerclear(&left);
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
 static void
 appendchr(char *buf, size_t bufsz, int c)
 {
@@ -142,9 +258,9 @@ int
 main(int argc, char *argv[])
 {
 	static const struct timeval mindelay = { .tv_sec = 0, .tv_usec = 100 };
-	struct timeval maxdelay;
+	struct timeval maxdelay, seek;
 
-	int isterm;
+	int isterm, keys;
 	struct termios saved;
 
 	struct replay_setup *setup = NULL;
@@ -158,7 +274,8 @@ main(int argc, char *argv[])
 	int diviopt = FALSE, idx;
 	int ch, rc, crmode = REPLAY_CRMODE_AUTO, summary = 0;
 	enum {
-		OPT_SUMMARY = CHAR_MAX + 1
+		OPT_SUMMARY = CHAR_MAX + 1,
+		OPT_SEEK
 	};
 
 	static const struct option longopts[] = {
@@ -171,6 +288,7 @@ main(int argc, char *argv[])
 		{ "typescript",	required_argument,	0, 's' },
 		{ "divisor",	required_argument,	0, 'd' },
 		{ "maxdelay",	required_argument,	0, 'm' },
+		{ "seek",	required_argument,	0, OPT_SEEK },
 		{ "stream",     required_argument,	0, 'x' },
 		{ "summary",    no_argument,            0, OPT_SUMMARY },
 		{ "version",	no_argument,		0, 'V' },
@@ -195,6 +313,7 @@ main(int argc, char *argv[])
 
 	replay_init_debug();
 	timerclear(&maxdelay);
+	timerclear(&seek);
 
 	while ((ch = getopt_long(argc, argv, "B:c:I:O:T:t:s:d:m:x:Vh", longopts, NULL)) != -1) {
 
@@ -244,6 +363,9 @@ main(int argc, char *argv[])
 			else
 				errx(EXIT_FAILURE, _("unsupported stream name: '%s'"), optarg);
 			break;
+		case OPT_SEEK:
+			strtotimeval_or_err(optarg, &seek, _("failed to parse seek argument"));
+			break;
 		case OPT_SUMMARY:
 			summary = 1;
 			break;
@@ -308,6 +430,9 @@ main(int argc, char *argv[])
 	replay_set_delay_min(setup, &mindelay);
 
 	isterm = setterm(&saved);
+	keys = isterm && !summary && isatty(STDIN_FILENO);
+	if (divi == 0)
+		divi = 1;
 
 	do {
 		rc = replay_get_next_step(setup, streams, &step);
@@ -317,7 +442,14 @@ main(int argc, char *argv[])
 		if (!summary) {
 			struct timeval *delay = replay_step_get_delay(step);
 
-			if (delay && timerisset(delay))
+			/* fast-forward to the --seek time */
+			if (timerisset(&seek)
+			    && timercmp(replay_get_elapsed(setup), &seek, <))
+				delay = NULL;
+
+			if (delay && timerisset(delay) && keys)
+				keys = delay_for_keys(setup, delay, &divi) == 0;
+			else if (delay && timerisset(delay))
 				delay_for(delay);
 		}
 		rc = replay_emit_step_data(setup, step, STDOUT_FILENO);
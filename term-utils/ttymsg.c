@@ -42,45 +42,179 @@
 
 #include <sys/types.h>
 #include <sys/param.h>
-#include <sys/uio.h>
-#include <signal.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <errno.h>
 #include <paths.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "c.h"
 #include "nls.h"
 #include "closestream.h"
 #include "pathnames.h"
+#include "xalloc.h"
 #include "ttymsg.h"
 
 #define ERR_BUFLEN	(MAXNAMLEN + 1024)
 
+/* a terminal where the message does not fit to the tty buffer */
+struct ttymsg_tty {
+	char	*device;
+	int	fd;
+	size_t	off;		/* already written bytes */
+};
+
+struct ttymsg {
+	const char	*data;
+	size_t		len;
+	int64_t		deadline;	/* milliseconds, monotonic */
+
+	struct ttymsg_tty *ttys;	/* pending terminals */
+	size_t		nttys;
+	size_t		szttys;		/* allocated @ttys */
+	size_t		maxttys;	/* limit by RLIMIT_NOFILE */
+
+	char		errbuf[ERR_BUFLEN];
+};
+
+static int64_t now_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Returns 0 if the message is complete (or the line went away), 1 if the
+ * write would block, or -1 on error.
+ */
+static int write_tty(struct ttymsg *tm, struct ttymsg_tty *tty)
+{
+	while (tty->off < tm->len) {
+		ssize_t ret = write(tty->fd, tm->data + tty->off, tm->len - tty->off);
+
+		if (ret > 0) {
+			tty->off += ret;
+			continue;
+		}
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == EAGAIN)
+			return 1;
+		/*
+		 * We get ENODEV on a slip line if we're running as root,
+		 * and EIO if the line just went away.
+		 */
+		if (ret < 0 && (errno == ENODEV || errno == EIO))
+			return 0;
+		return -1;
+	}
+	return 0;
+}
+
+static void drop_tty(struct ttymsg *tm, size_t i)
+{
+	close(tm->ttys[i].fd);
+	free(tm->ttys[i].device);
+	tm->ttys[i] = tm->ttys[--tm->nttys];
+}
+
 /*
- * Display the contents of a uio structure on a terminal.  Used by wall(1),
- * syslogd(8), and talkd(8).  Forks and finishes in child if write would block,
- * waiting up to tmout seconds.  Returns pointer to error string on unexpected
- * error; string is not newline-terminated.  Various "normal" errors are
- * ignored (exclusive-use, lack of permission, etc.).
+ * Writes to the pending terminals as they become writable, until all of
+ * them are complete (or just one if @all is false) or the timeout expires.
  */
-char *
-ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout) {
-	static char device[MAXNAMLEN];
-	static char errbuf[ERR_BUFLEN];
-	size_t cnt, left;
-	ssize_t wret;
-	struct iovec localiov[6];
-	int fd, forked = 0;
-	ssize_t	len = 0;
-
-	if (iovcnt > ARRAY_SIZE(localiov)) {
-		snprintf(errbuf, sizeof(errbuf), _("internal error: too many iov's"));
-		return errbuf;
+static void wait_ttys(struct ttymsg *tm, int all)
+{
+	struct pollfd *pfds;
+	size_t i, n;
+
+	if (!tm->nttys)
+		return;
+	pfds = xcalloc(tm->nttys, sizeof(struct pollfd));
+
+	while (tm->nttys) {
+		int64_t left = tm->deadline - now_msec();
+		int rc, done = 0;
+
+		if (left <= 0)
+			break;
+
+		n = tm->nttys;
+		for (i = 0; i < n; i++) {
+			pfds[i].fd = tm->ttys[i].fd;
+			pfds[i].events = POLLOUT;
+			pfds[i].revents = 0;
+		}
+		rc = poll(pfds, n, left > INT_MAX ? INT_MAX : (int) left);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0) {
+			warn(_("poll failed"));
+			break;
+		}
+
+		/* backward, drop_tty() moves the last one to the index */
+		for (i = n; i > 0; i--) {
+			struct ttymsg_tty *tty = &tm->ttys[i - 1];
+
+			if (!pfds[i - 1].revents)
+				continue;
+			rc = write_tty(tm, tty);
+			if (rc == 1)
+				continue;
+			if (rc < 0)
+				warn("%s", tty->device);
+			drop_tty(tm, i - 1);
+			done++;
+		}
+		if (done && !all)
+			break;
 	}
+	free(pfds);
+}
+
+/*
+ * Starts a broadcast of the message @data to the terminals, the message has
+ * to be valid until ttymsg_finish(). The terminals which cannot accept the
+ * whole message at once are written to as they become writable, at most
+ * @tmout seconds from now.
+ */
+struct ttymsg *ttymsg_new(const char *data, size_t len, int tmout)
+{
+	struct ttymsg *tm = xcalloc(1, sizeof(*tm));
+	struct rlimit rl;
+
+	tm->data = data;
+	tm->len = len;
+	tm->deadline = now_msec() + (int64_t) tmout * 1000;
+
+	/* keep some descriptors for the caller */
+	tm->maxttys = 64;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY
+	    && rl.rlim_cur > 16)
+		tm->maxttys = rl.rlim_cur - 16;
+
+	return tm;
+}
+
+/*
+ * Writes the message to the terminal @line (e.g. "pts/1"). Returns pointer
+ * to error string on unexpected error; string is not newline-terminated.
+ * Various "normal" errors are ignored (exclusive-use, lack of permission,
+ * etc.).
+ */
+char *ttymsg_add(struct ttymsg *tm, const char *line)
+{
+	struct ttymsg_tty tty = { .off = 0 };
+	char device[MAXNAMLEN];
+	int len, rc;
 
 	/* The old code here rejected the line argument when it contained a '/',
 	   saying: "A slash may be an attempt to break security...".
@@ -91,102 +225,101 @@ ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout) {
 
 	len = snprintf(device, sizeof(device), "%s%s", _PATH_DEV, line);
 	if (len < 0 || (size_t)len >= sizeof(device)) {
-		snprintf(errbuf, sizeof(errbuf), _("excessively long line arg"));
-		return errbuf;
+		snprintf(tm->errbuf, sizeof(tm->errbuf), _("excessively long line arg"));
+		return tm->errbuf;
 	}
 
+	/* no free descriptor, wait for a pending terminal */
+	if (tm->nttys >= tm->maxttys)
+		wait_ttys(tm, 0);
+	if (tm->nttys >= tm->maxttys)
+		goto timeout;
+
 	/*
 	 * open will fail on slip lines or exclusive-use lines
 	 * if not running as root; not an error.
 	 */
-	if ((fd = open(device, O_WRONLY|O_NONBLOCK, 0)) < 0) {
+	tty.fd = open(device, O_WRONLY|O_NONBLOCK|O_CLOEXEC, 0);
+	if (tty.fd < 0 && (errno == EMFILE || errno == ENFILE) && tm->nttys) {
+		wait_ttys(tm, 0);
+		tty.fd = open(device, O_WRONLY|O_NONBLOCK|O_CLOEXEC, 0);
+	}
+	if (tty.fd < 0) {
 		if (errno == EBUSY || errno == EACCES)
 			return NULL;
 
-		len = snprintf(errbuf, sizeof(errbuf), "%s: %m", device);
-		if (len < 0 || (size_t)len >= sizeof(errbuf))
-			snprintf(errbuf, sizeof(errbuf), _("open failed"));
-		return errbuf;
+		len = snprintf(tm->errbuf, sizeof(tm->errbuf), "%s: %m", device);
+		if (len < 0 || (size_t)len >= sizeof(tm->errbuf))
+			snprintf(tm->errbuf, sizeof(tm->errbuf), _("open failed"));
+		return tm->errbuf;
 	}
 
-	for (cnt = left = 0; cnt < iovcnt; ++cnt)
-		left += iov[cnt].iov_len;
-
-	for (;;) {
-		wret = writev(fd, iov, iovcnt);
-		if (wret >= (ssize_t) left)
-			break;
-		if (wret >= 0) {
-			left -= wret;
-			if (iov != localiov) {
-				memmove(localiov, iov,
-				    iovcnt * sizeof(struct iovec));
-				iov = localiov;
-			}
-			for (cnt = 0; wret >= (ssize_t) iov->iov_len; ++cnt) {
-				wret -= iov->iov_len;
-				++iov;
-				--iovcnt;
-			}
-			if (wret) {
-				iov->iov_base = (char *) iov->iov_base + wret;
-				iov->iov_len -= wret;
-			}
-			continue;
+	rc = write_tty(tm, &tty);
+	if (rc == 1) {
+		if (now_msec() >= tm->deadline) {
+			close(tty.fd);
+			goto timeout;
 		}
-		if (errno == EWOULDBLOCK) {
-			int cpid, flags;
-			sigset_t sigmask;
-
-			if (forked) {
-				close(fd);
-				_exit(EXIT_FAILURE);
-			}
-			cpid = fork();
-			if (cpid < 0) {
-				len = snprintf(errbuf, sizeof(errbuf), _("fork: %m"));
-				if (len < 0 || (size_t)len >= sizeof(errbuf))
-					snprintf(errbuf, sizeof(errbuf), _("cannot fork"));
-				close(fd);
-				return errbuf;
-			}
-			if (cpid) {	/* parent */
-				close(fd);
-				return NULL;
-			}
-			forked++;
-			/* wait at most tmout seconds */
-			signal(SIGALRM, SIG_DFL);
-			signal(SIGTERM, SIG_DFL); /* XXX */
-			sigemptyset(&sigmask);
-			sigprocmask (SIG_SETMASK, &sigmask, NULL);
-			alarm((u_int)tmout);
-			flags = fcntl(fd, F_GETFL);
-			fcntl(flags, F_SETFL, (long) (flags & ~O_NONBLOCK));
-			continue;
+		if (tm->nttys == tm->szttys) {
+			tm->szttys = tm->szttys ? tm->szttys * 2 : 16;
+			tm->ttys = xrealloc(tm->ttys,
+					tm->szttys * sizeof(struct ttymsg_tty));
 		}
-		/*
-		 * We get ENODEV on a slip line if we're running as root,
-		 * and EIO if the line just went away.
-		 */
-		if (errno == ENODEV || errno == EIO)
-			break;
-		if (close_fd(fd) != 0)
-			warn(_("write failed: %s"), device);
-		if (forked)
-			_exit(EXIT_FAILURE);
-
-		len = snprintf(errbuf, sizeof(errbuf), "%s: %m", device);
-		if (len < 0 || (size_t)len >= sizeof(errbuf))
-			snprintf(errbuf, sizeof(errbuf),
-					_("%s: BAD ERROR, message is "
-					  "far too long"), device);
-		return errbuf;
+		tty.device = xstrdup(device);
+		tm->ttys[tm->nttys++] = tty;
+		return NULL;
+	}
+	if (rc == 0) {
+		close(tty.fd);
+		return NULL;
 	}
 
-	close(fd);
+	if (close_fd(tty.fd) != 0)
+		warn(_("write failed: %s"), device);
+
+	len = snprintf(tm->errbuf, sizeof(tm->errbuf), "%s: %m", device);
+	if (len < 0 || (size_t)len >= sizeof(tm->errbuf))
+		snprintf(tm->errbuf, sizeof(tm->errbuf),
+				_("%s: BAD ERROR, message is "
+				  "far too long"), device);
+	return tm->errbuf;
+timeout:
+	snprintf(tm->errbuf, sizeof(tm->errbuf), _("%s: write timed out"), device);
+	return tm->errbuf;
+}
+
+/*
+ * Finishes the broadcast and frees @tm. If some terminals are pending, one
+ * child process is forked to wait for all of them, so the caller does not
+ * wait for a stopped terminal. The terminals where the message is not
+ * complete after the timeout are reported by the child.
+ */
+void ttymsg_finish(struct ttymsg *tm)
+{
+	pid_t pid = -1;
+
+	if (!tm)
+		return;
+
+	if (tm->nttys) {
+		pid = fork();
+		if (pid < 0)
+			warn(_("fork failed"));
+	}
+	if (pid <= 0) {
+		/* child, or wait in the foreground if fork() failed */
+		wait_ttys(tm, 1);
+		while (tm->nttys) {
+			warnx(_("%s: write timed out"), tm->ttys[0].device);
+			drop_tty(tm, 0);
+		}
+	} else {
+		while (tm->nttys)
+			drop_tty(tm, 0);
+	}
+	free(tm->ttys);
+	free(tm);
 
-	if (forked)
+	if (pid == 0)
 		_exit(EXIT_SUCCESS);
-	return NULL;
 }
@@ -1,6 +1,10 @@
 #ifndef UTIL_LINUX_TERM_TTYMSG_H
 #define UTIL_LINUX_TERM_TTYMSG_H
 
-char *ttymsg(struct iovec *iov, size_t iovcnt, char *line, int tmout);
+struct ttymsg;
+
+extern struct ttymsg *ttymsg_new(const char *data, size_t len, int tmout);
+extern char *ttymsg_add(struct ttymsg *tm, const char *line);
+extern void ttymsg_finish(struct ttymsg *tm);
 
 #endif /* UTIL_LINUX_TERM_TTYMSG_H */
@@ -181,7 +181,7 @@ static int is_gr_member(const char *login, const struct group_workspace *buf)
 int main(int argc, char **argv)
 {
 	int ch;
-	struct iovec iov;
+	struct ttymsg *tm;
 	struct utmpx *utmpptr;
 	char *p;
 	char line[sizeof(utmpptr->ut_line) + 1];
@@ -244,8 +244,7 @@ int main(int argc, char **argv)
 
 	mbuf = makemsg(fname, mvec, mvecsz, &mbufsize, print_banner);
 
-	iov.iov_base = mbuf;
-	iov.iov_len = mbufsize;
+	tm = ttymsg_new(mbuf, mbufsize, timeout);
 	while((utmpptr = getutxent())) {
 		if (!utmpptr->ut_user[0])
 			continue;
@@ -265,10 +264,11 @@ int main(int argc, char **argv)
 			continue;
 
 		mem2strcpy(line, utmpptr->ut_line, sizeof(utmpptr->ut_line), sizeof(line));
-		if ((p = ttymsg(&iov, 1, line, timeout)) != NULL)
+		if ((p = ttymsg_add(tm, line)) != NULL)
 			warnx("%s", p);
 	}
 	endutxent();
+	ttymsg_finish(tm);
 	free(mbuf);
 	free_group_workspace(group_buf);
 	exit(EXIT_SUCCESS);
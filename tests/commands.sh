@@ -4,6 +4,7 @@ TS_TESTUSER=${TS_TESTUSER:-"nobody"}
 # helpers
 TS_HELPER_BYTESWAP="${ts_helpersdir}test_byteswap"
 TS_HELPER_CPUSET="${ts_helpersdir}test_cpuset"
+TS_HELPER_CPUTOPO="${ts_helpersdir}test_cputopo"
 TS_HELPER_DMESG="${ts_helpersdir}test_dmesg"
 TS_HELPER_ISLOCAL="${ts_helpersdir}test_islocal"
 TS_HELPER_ISMOUNTED="${ts_helpersdir}test_ismounted"
@@ -27,12 +28,15 @@ TS_HELPER_PYLIBMOUNT_TAB="$top_srcdir/libmount/python/test_mount_tab.py"
 TS_HELPER_PYLIBMOUNT_UPDATE="$top_srcdir/libmount/python/test_mount_tab_update.py"
 TS_HELPER_LOGGER="${ts_helpersdir}test_logger"
 TS_HELPER_LOGINDEFS="${ts_helpersdir}test_logindefs"
+TS_HELPER_CRC32="${ts_helpersdir}test_crc32"
 TS_HELPER_MD5="${ts_helpersdir}test_md5"
 TS_HELPER_SHA1="${ts_helpersdir}test_sha1"
+TS_HELPER_XXHASH="${ts_helpersdir}test_xxhash"
 TS_HELPER_MKFS_MINIX="${ts_helpersdir}test_mkfs_minix"
 TS_HELPER_MORE=${TS_HELPER_MORE-"${ts_helpersdir}test_more"}
 TS_HELPER_PARTITIONS="${ts_helpersdir}sample-partitions"
 TS_HELPER_PATHS="${ts_helpersdir}test_pathnames"
+TS_HELPER_REGEXUTILS="${ts_helpersdir}test_regexutils"
 TS_HELPER_SCRIPT="${ts_helpersdir}test_script"
 TS_HELPER_SIGRECEIVE="${ts_helpersdir}test_sigreceive"
 TS_HELPER_STRERROR="${ts_helpersdir}test_strerror"
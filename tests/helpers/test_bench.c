@@ -0,0 +1,542 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Micro-benchmarks of the shared libraries. Every benchmark is calibrated to
+ * run for about --time seconds; the result is the time per operation (and
+ * the throughput for the checksums), as text or as JSON for the regression
+ * tracking.
+ */
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <blkid.h>
+#include <libmount.h>
+#include <libsmartcols.h>
+#include <uuid.h>
+
+#include "c.h"
+#include "crc32.h"
+#include "crc32c.h"
+#include "md5.h"
+#include "nls.h"
+#include "sha1.h"
+#include "strutils.h"
+#include "xxhash.h"
+
+#define BENCH_BUFSZ	(64 * 1024)
+
+struct bench {
+	const char	*name;
+	void		*(*init)(size_t size);	/* returns the data for run() */
+	void		(*run)(void *data, size_t loops);
+	void		(*deinit)(void *data);
+	size_t		size;		/* entries, rows or bytes for init() */
+	unsigned int	bytes:1;	/* size is in bytes, print throughput */
+};
+
+static unsigned char *buffer;
+static volatile uint64_t sink;	/* the results go here, not optimized out */
+
+static double get_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *init_buffer(size_t size)
+{
+	size_t i;
+
+	if (!buffer) {
+		buffer = malloc(BENCH_BUFSZ);
+		if (!buffer)
+			err(EXIT_FAILURE, "malloc failed");
+		for (i = 0; i < BENCH_BUFSZ; i++)
+			buffer[i] = i * 31;
+	}
+	return size <= BENCH_BUFSZ ? buffer : NULL;
+}
+
+/* a temporary file, unlinked */
+static FILE *new_tmpfile(void)
+{
+	FILE *f = tmpfile();
+
+	if (!f)
+		err(EXIT_FAILURE, "cannot create temporary file");
+	return f;
+}
+
+static void deinit_file(void *data)
+{
+	fclose(data);
+}
+
+/*
+ * checksums
+ */
+static void run_crc32(void *data, size_t loops)
+{
+	uint32_t crc = ~0U;
+
+	while (loops--)
+		crc = ul_crc32(crc, data, BENCH_BUFSZ);
+	sink += crc;
+}
+
+static void run_crc32c(void *data, size_t loops)
+{
+	uint32_t crc = ~0U;
+
+	while (loops--)
+		crc = crc32c(crc, data, BENCH_BUFSZ);
+	sink += crc;
+}
+
+static void run_sha1(void *data, size_t loops)
+{
+	unsigned char digest[UL_SHA1LENGTH];
+	UL_SHA1_CTX ctx;
+
+	while (loops--) {
+		ul_SHA1Init(&ctx);
+		ul_SHA1Update(&ctx, data, BENCH_BUFSZ);
+		ul_SHA1Final(digest, &ctx);
+		sink += digest[0];
+	}
+}
+
+static void run_md5(void *data, size_t loops)
+{
+	unsigned char digest[UL_MD5LENGTH];
+	struct UL_MD5Context ctx;
+
+	while (loops--) {
+		ul_MD5Init(&ctx);
+		ul_MD5Update(&ctx, data, BENCH_BUFSZ);
+		ul_MD5Final(digest, &ctx);
+		sink += digest[0];
+	}
+}
+
+static void run_xxh64(void *data, size_t loops)
+{
+	while (loops--)
+		sink += ul_xxh64(data, BENCH_BUFSZ, 0);
+}
+
+/*
+ * lib/strutils.c
+ */
+static void run_strtosize(void *data __attribute__((__unused__)), size_t loops)
+{
+	static const char *const sizes[] = { "512", "4K", "10MiB", "1.5GB", "2T" };
+	uintmax_t x;
+
+	while (loops--) {
+		strtosize(sizes[loops % ARRAY_SIZE(sizes)], &x);
+		sink += x;
+	}
+}
+
+static void run_strtou64(void *data __attribute__((__unused__)), size_t loops)
+{
+	static const char *const nums[] = { "0", "42", "4096", "18446744073709551615" };
+	uint64_t x;
+
+	while (loops--) {
+		ul_strtou64(nums[loops % ARRAY_SIZE(nums)], &x, 10);
+		sink += x;
+	}
+}
+
+static void run_strtox64(void *data __attribute__((__unused__)), size_t loops)
+{
+	static const char *const nums[] = { "0", "ff", "8000", "ffffffffffffffff" };
+	uint64_t x;
+
+	while (loops--) {
+		ul_strtou64(nums[loops % ARRAY_SIZE(nums)], &x, 16);
+		sink += x;
+	}
+}
+
+/* the numeric fields of /proc/PID/stat (after the command name) */
+static void *init_procstat(size_t size)
+{
+	char *line = malloc(size * 21 + 1), *p = line;
+	size_t i;
+
+	if (!line)
+		err(EXIT_FAILURE, "malloc failed");
+	for (i = 0; i < size; i++)
+		p += sprintf(p, "%s%ju", i ? " " : "",
+			     (uintmax_t) (i * 2654435761U) >> (i % 24));
+	return line;
+}
+
+static void run_procstat_strtoll(void *data, size_t loops)
+{
+	while (loops--) {
+		char *p = data;
+
+		while (*p) {
+			sink += strtoll(p, &p, 10);
+			if (*p == ' ')
+				p++;
+		}
+	}
+}
+
+static void run_procstat_parse(void *data, size_t loops)
+{
+	while (loops--) {
+		const char *p = data;
+		int64_t x;
+
+		while (ul_parse_s64(p, &x, &p) == 0) {
+			sink += x;
+			if (*p == ' ')
+				p++;
+		}
+	}
+}
+
+static void run_parse_range(void *data __attribute__((__unused__)), size_t loops)
+{
+	static const char *const ranges[] = { "1:10", "5:", ":100", "42" };
+	int lo, hi;
+
+	while (loops--) {
+		parse_range(ranges[loops % ARRAY_SIZE(ranges)], &lo, &hi, 0);
+		sink += lo + hi;
+	}
+}
+
+/*
+ * libuuid
+ */
+static void run_uuid_random(void *data __attribute__((__unused__)), size_t loops)
+{
+	uuid_t uu;
+
+	while (loops--) {
+		uuid_generate_random(uu);
+		sink += uu[0];
+	}
+}
+
+static void run_uuid_time(void *data __attribute__((__unused__)), size_t loops)
+{
+	uuid_t uu;
+
+	while (loops--) {
+		uuid_generate_time(uu);
+		sink += uu[0];
+	}
+}
+
+static void run_uuid_unparse_parse(void *data __attribute__((__unused__)), size_t loops)
+{
+	char str[UUID_STR_LEN];
+	uuid_t uu, x;
+
+	uuid_generate_random(uu);
+	while (loops--) {
+		uuid_unparse(uu, str);
+		uuid_parse(str, x);
+		sink += x[0];
+	}
+}
+
+/*
+ * libblkid, probing of the synthetic images
+ */
+static void *init_image(size_t size, int swap)
+{
+	FILE *f = new_tmpfile();
+
+	if (ftruncate(fileno(f), size) != 0)
+		err(EXIT_FAILURE, "cannot resize image");
+	if (swap) {
+		/* swap v1 header, see libblkid/src/superblocks/swap.c */
+		uint32_t hdr[2] = { 1, size / 4096 - 1 };
+
+		if (pwrite(fileno(f), hdr, sizeof(hdr), 1024) != sizeof(hdr)
+		    || pwrite(fileno(f), "SWAPSPACE2", 10, 4096 - 10) != 10)
+			err(EXIT_FAILURE, "cannot write image");
+	}
+	return f;
+}
+
+static void *init_empty_image(size_t size)
+{
+	return init_image(size, 0);
+}
+
+static void *init_swap_image(size_t size)
+{
+	return init_image(size, 1);
+}
+
+static void run_blkid_probe(void *data, size_t loops)
+{
+	int fd = fileno(data);
+
+	while (loops--) {
+		blkid_probe pr = blkid_new_probe();
+
+		if (!pr || blkid_probe_set_device(pr, fd, 0, 0) != 0)
+			errx(EXIT_FAILURE, "cannot initialize probe");
+		blkid_probe_enable_partitions(pr, 1);
+		sink += blkid_do_safeprobe(pr);
+		blkid_free_probe(pr);
+	}
+}
+
+/*
+ * libmount, parsing of a synthetic mountinfo
+ */
+static void *init_mountinfo(size_t size)
+{
+	FILE *f = new_tmpfile();
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		fprintf(f, "%zu 1 0:%zu / /mnt/bench/%zu rw,relatime shared:%zu "
+			   "- tmpfs tmpfs rw,size=1024k,mode=755\n",
+			   i + 2, i + 40, i, i + 1);
+	if (fflush(f) != 0)
+		err(EXIT_FAILURE, "cannot write mountinfo");
+	return f;
+}
+
+static void run_mountinfo(void *data, size_t loops)
+{
+	while (loops--) {
+		struct libmnt_table *tb = mnt_new_table();
+
+		rewind(data);
+		if (!tb || mnt_table_parse_stream(tb, data, "mountinfo") != 0)
+			errx(EXIT_FAILURE, "cannot parse mountinfo");
+		sink += mnt_table_get_nents(tb);
+		mnt_unref_table(tb);
+	}
+}
+
+/*
+ * libsmartcols, printing of a table with 8 columns
+ */
+#define BENCH_NCOLS	8
+
+static void *init_table(size_t size)
+{
+	struct libscols_table *tb = scols_new_table();
+	size_t i, j;
+
+	if (!tb)
+		err(EXIT_FAILURE, "cannot create table");
+	for (j = 0; j < BENCH_NCOLS; j++) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "COL%zu", j);
+		if (!scols_table_new_column(tb, name, 0, j % 2 ? SCOLS_FL_RIGHT : 0))
+			err(EXIT_FAILURE, "cannot create column");
+	}
+	for (i = 0; i < size; i++) {
+		struct libscols_line *ln = scols_table_new_line(tb, NULL);
+
+		if (!ln)
+			err(EXIT_FAILURE, "cannot create line");
+		for (j = 0; j < BENCH_NCOLS; j++) {
+			char cell[32];
+
+			snprintf(cell, sizeof(cell), "cell-%zu-%zu", i, j * i);
+			if (scols_line_set_data(ln, j, cell))
+				err(EXIT_FAILURE, "cannot set data");
+		}
+	}
+	return tb;
+}
+
+static void deinit_table(void *data)
+{
+	scols_unref_table(data);
+}
+
+static void run_table(void *data, size_t loops, int json)
+{
+	FILE *out = fopen("/dev/null", "w");
+
+	if (!out)
+		err(EXIT_FAILURE, "cannot open /dev/null");
+	scols_table_set_stream(data, out);
+	scols_table_enable_json(data, json);
+	while (loops--)
+		scols_print_table(data);
+	fclose(out);
+}
+
+static void run_table_text(void *data, size_t loops)
+{
+	run_table(data, loops, 0);
+}
+
+static void run_table_json(void *data, size_t loops)
+{
+	run_table(data, loops, 1);
+}
+
+static const struct bench benchmarks[] = {
+	{ "crc32",		init_buffer, run_crc32, NULL, BENCH_BUFSZ, 1 },
+	{ "crc32c",		init_buffer, run_crc32c, NULL, BENCH_BUFSZ, 1 },
+	{ "sha1",		init_buffer, run_sha1, NULL, BENCH_BUFSZ, 1 },
+	{ "md5",		init_buffer, run_md5, NULL, BENCH_BUFSZ, 1 },
+	{ "xxh64",		init_buffer, run_xxh64, NULL, BENCH_BUFSZ, 1 },
+	{ "strtosize",		NULL, run_strtosize },
+	{ "strtou64",		NULL, run_strtou64 },
+	{ "strtox64",		NULL, run_strtox64 },
+	{ "procstat-strtoll",	init_procstat, run_procstat_strtoll, free, 52 },
+	{ "procstat-parse",	init_procstat, run_procstat_parse, free, 52 },
+	{ "parse-range",	NULL, run_parse_range },
+	{ "uuid-random",	NULL, run_uuid_random },
+	{ "uuid-time",		NULL, run_uuid_time },
+	{ "uuid-unparse-parse",	NULL, run_uuid_unparse_parse },
+	{ "blkid-empty",	init_empty_image, run_blkid_probe, deinit_file, 1 << 20 },
+	{ "blkid-swap",		init_swap_image, run_blkid_probe, deinit_file, 1 << 20 },
+	{ "mountinfo-100",	init_mountinfo, run_mountinfo, deinit_file, 100 },
+	{ "mountinfo-10000",	init_mountinfo, run_mountinfo, deinit_file, 10000 },
+	{ "scols-text-1000",	init_table, run_table_text, deinit_table, 1000 },
+	{ "scols-json-1000",	init_table, run_table_json, deinit_table, 1000 },
+};
+
+/* doubles the loops until the run takes at least @mintime seconds */
+static double run_bench(const struct bench *b, void *data, double mintime,
+			size_t *loops)
+{
+	double sec;
+
+	for (*loops = 1; ; *loops *= 2) {
+		double start = get_sec();
+
+		b->run(data, *loops);
+		sec = get_sec() - start;
+		if (sec >= mintime || *loops >= SIZE_MAX / 2)
+			break;
+	}
+	return sec;
+}
+
+static int wanted(const char *name, int argc, char **argv)
+{
+	int i;
+
+	if (!argc)
+		return 1;
+	for (i = 0; i < argc; i++) {
+		if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	size_t i;
+
+	fprintf(stdout, " %s [--json] [--time <sec>] [--list] [<name-prefix> ...]\n",
+			program_invocation_short_name);
+	fputs(" Benchmarks:\n", stdout);
+	for (i = 0; i < ARRAY_SIZE(benchmarks); i++)
+		fprintf(stdout, "  %s\n", benchmarks[i].name);
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	double mintime = 0.2;
+	int c, json = 0, first = 1;
+	size_t i;
+
+	static const struct option longopts[] = {
+		{ "json", no_argument,       NULL, 'J' },
+		{ "time", required_argument, NULL, 't' },
+		{ "list", no_argument,       NULL, 'l' },
+		{ "help", no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+
+	while ((c = getopt_long(argc, argv, "Jt:lh", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'J':
+			json = 1;
+			break;
+		case 't':
+			mintime = strtod(optarg, NULL);
+			if (mintime <= 0)
+				errx(EXIT_FAILURE, "invalid time: %s", optarg);
+			break;
+		case 'l':
+			for (i = 0; i < ARRAY_SIZE(benchmarks); i++)
+				printf("%s\n", benchmarks[i].name);
+			return EXIT_SUCCESS;
+		case 'h':
+			usage();
+		default:
+			errtryhelp(EXIT_FAILURE);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (json)
+		fputs("{\"benchmarks\": [\n", stdout);
+
+	for (i = 0; i < ARRAY_SIZE(benchmarks); i++) {
+		const struct bench *b = &benchmarks[i];
+		void *data = NULL;
+		size_t loops;
+		double sec, ns;
+
+		if (!wanted(b->name, argc, argv))
+			continue;
+		if (b->init)
+			data = b->init(b->size);
+
+		sec = run_bench(b, data, mintime, &loops);
+		ns = sec * 1e9 / loops;
+
+		if (b->deinit)
+			b->deinit(data);
+
+		if (json) {
+			printf("%s  {\"name\": \"%s\", \"loops\": %zu, \"ns_per_op\": %.1f",
+				first ? "" : ",\n", b->name, loops, ns);
+			if (b->bytes)
+				printf(", \"mib_per_sec\": %.1f",
+					(double) b->size * loops / (1 << 20) / sec);
+			fputc('}', stdout);
+		} else {
+			printf("%-20s %14.1f ns/op", b->name, ns);
+			if (b->bytes)
+				printf(" %10.1f MiB/s",
+					(double) b->size * loops / (1 << 20) / sec);
+			fputc('\n', stdout);
+		}
+		fflush(stdout);
+		first = 0;
+	}
+
+	if (json)
+		fputs("\n]}\n", stdout);
+
+	free(buffer);
+	return EXIT_SUCCESS;
+}
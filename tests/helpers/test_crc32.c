@@ -0,0 +1,181 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Checks and benchmarks crc32 and crc32c implementations.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "c.h"
+#include "crc32.h"
+#include "crc32c.h"
+
+struct crc_impl {
+	const char *name;
+	uint32_t (*fn)(uint32_t, const void *, size_t);
+	int (*supported)(void);
+};
+
+static uint32_t crc32_bytewise(uint32_t crc, const void *buf, size_t len)
+{
+	return ul_crc32_bytewise(crc, buf, len);
+}
+static uint32_t crc32_slice8(uint32_t crc, const void *buf, size_t len)
+{
+	return ul_crc32_slice8(crc, buf, len);
+}
+static uint32_t crc32_hw(uint32_t crc, const void *buf, size_t len)
+{
+	return ul_crc32_hw(crc, buf, len);
+}
+static uint32_t crc32_default(uint32_t crc, const void *buf, size_t len)
+{
+	return ul_crc32(crc, buf, len);
+}
+
+static const struct crc_impl crc32_impls[] = {
+	{ "crc32-bytewise", crc32_bytewise },
+	{ "crc32-slice8", crc32_slice8 },
+	{ "crc32-hw", crc32_hw, ul_crc32_has_hw },
+	{ "crc32", crc32_default },
+};
+
+static const struct crc_impl crc32c_impls[] = {
+	{ "crc32c-bytewise", crc32c_bytewise },
+	{ "crc32c-slice8", crc32c_slice8 },
+	{ "crc32c-hw", crc32c_hw, crc32c_has_hw },
+	{ "crc32c", crc32c },
+};
+
+/* all implementations have to return the same result */
+static int check_impls(const struct crc_impl *impls, size_t nimpls,
+		       const unsigned char *buf, size_t bufsz)
+{
+	size_t off, len, i;
+	int rc = 0;
+
+	for (off = 0; off < 8; off++) {
+		for (len = 0; off + len <= bufsz; len = len < 64 ? len + 1 : len * 3) {
+			uint32_t ref = impls[0].fn(~0U, buf + off, len);
+
+			for (i = 1; i < nimpls; i++) {
+				uint32_t x = impls[i].fn(~0U, buf + off, len);
+
+				if (x != ref) {
+					fprintf(stderr, "%s: offset %zu length %zu: %08x != %08x\n",
+							impls[i].name, off, len, x, ref);
+					rc = 1;
+				}
+			}
+		}
+	}
+	return rc;
+}
+
+static double get_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_impls(const struct crc_impl *impls, size_t nimpls,
+			const unsigned char *buf, size_t bufsz, size_t loops)
+{
+	size_t i, n;
+
+	for (i = 0; i < nimpls; i++) {
+		uint32_t crc = ~0U;
+		double start, sec;
+
+		if (impls[i].supported && !impls[i].supported()) {
+			printf("%-16s unsupported\n", impls[i].name);
+			continue;
+		}
+		start = get_sec();
+		for (n = 0; n < loops; n++)
+			crc = impls[i].fn(crc, buf, bufsz);
+		sec = get_sec() - start;
+
+		printf("%-16s %10.1f MiB/s  (%08x)\n", impls[i].name,
+			sec > 0 ? ((double) bufsz * loops) / (1 << 20) / sec : 0.0,
+			crc);
+	}
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	fprintf(stdout, " %s [--check | --bench [<size> [<loops>]]]\n",
+			program_invocation_short_name);
+	fputs("  without options prints crc32 and crc32c of stdin\n", stdout);
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *buf;
+	size_t bufsz = 64 * 1024, i;
+
+	if (argc > 1 && strcmp(argv[1], "--help") == 0)
+		usage();
+
+	if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+		int rc;
+
+		buf = malloc(bufsz);
+		if (!buf)
+			err(EXIT_FAILURE, "malloc failed");
+		srandom(1);
+		for (i = 0; i < bufsz; i++)
+			buf[i] = random();
+
+		rc = check_impls(crc32_impls, ARRAY_SIZE(crc32_impls), buf, bufsz);
+		rc |= check_impls(crc32c_impls, ARRAY_SIZE(crc32c_impls), buf, bufsz);
+		free(buf);
+		return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		size_t loops = 0;
+
+		if (argc > 2)
+			bufsz = strtoul(argv[2], NULL, 10);
+		if (argc > 3)
+			loops = strtoul(argv[3], NULL, 10);
+		if (!bufsz)
+			errx(EXIT_FAILURE, "invalid size");
+		if (!loops)
+			loops = max((size_t) 1, (size_t) (256 << 20) / bufsz);
+
+		buf = malloc(bufsz);
+		if (!buf)
+			err(EXIT_FAILURE, "malloc failed");
+		for (i = 0; i < bufsz; i++)
+			buf[i] = i * 31;
+
+		printf("buffer size %zu, %zu loops\n", bufsz, loops);
+		bench_impls(crc32_impls, ARRAY_SIZE(crc32_impls), buf, bufsz, loops);
+		bench_impls(crc32c_impls, ARRAY_SIZE(crc32c_impls), buf, bufsz, loops);
+		free(buf);
+		return EXIT_SUCCESS;
+	}
+
+	/* checksum of stdin */
+	{
+		unsigned char data[BUFSIZ];
+		uint32_t c1 = ~0U, c2 = ~0U;
+		size_t sz;
+
+		while ((sz = fread(data, 1, sizeof(data), stdin)) > 0) {
+			c1 = ul_crc32(c1, data, sz);
+			c2 = crc32c(c2, data, sz);
+		}
+		printf("crc32: %08x crc32c: %08x\n", c1 ^ ~0U, c2 ^ ~0U);
+	}
+	return EXIT_SUCCESS;
+}
@@ -763,6 +763,7 @@ int main(int argc, char **argv)
 	struct fdesc fdescs[MAX_N];
 	bool quiet = false;
 	bool cont  = false;
+	sigset_t sigset, oldset;
 
 	pid[0] = getpid();
 	pid[1] = -1;
@@ -842,6 +843,12 @@ int main(int argc, char **argv)
 
 	signal(SIGCONT, do_nothing);
 
+	/* block SIGCONT until sigsuspend() to not miss it when the caller
+	 * is quick to send it after reading our pid */
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGCONT);
+	sigprocmask(SIG_BLOCK, &sigset, &oldset);
+
 	if (!quiet) {
 		printf("%d", pid[0]);
 		if (pid[1] != -1)
@@ -851,7 +858,8 @@ int main(int argc, char **argv)
 	}
 
 	if (!cont)
-		pause();
+		sigsuspend(&oldset);
+	sigprocmask(SIG_SETMASK, &oldset, NULL);
 
 	for (int i = 0; i < factory->N + factory->EX_N; i++)
 		if (fdescs[i].fd >= 0)
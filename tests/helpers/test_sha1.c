@@ -1,16 +1,46 @@
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "sha1.h"
 
-int main(void)
+/* compare the generic transform with the dispatched (hardware) one */
+static int check_transform(void)
+{
+	unsigned char block[64];
+	uint32_t s1[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	uint32_t s2[5];
+	int i, n;
+
+	memcpy(s2, s1, sizeof(s2));
+
+	for (n = 0; n < 1024; n++) {
+		for (i = 0; i < 64; i++)
+			block[i] = (unsigned char) (n * 131 + i * 7);
+
+		ul_SHA1Transform_generic(s1, block);
+		ul_SHA1Transform(s2, block);
+
+		if (memcmp(s1, s2, sizeof(s1)) != 0) {
+			printf("transform mismatch at block %d\n", n);
+			return 1;
+		}
+	}
+	printf("transform: ok\n");
+	return 0;
+}
+
+int main(int argc, char *argv[])
 {
 	int i, ret;
 	UL_SHA1_CTX ctx;
 	unsigned char digest[UL_SHA1LENGTH];
 	unsigned char buf[BUFSIZ];
 
+	if (argc > 1 && strcmp(argv[1], "--check") == 0)
+		return check_transform();
+
 	ul_SHA1Init( &ctx );
 
 	while(!feof(stdin) && !ferror(stdin)) {
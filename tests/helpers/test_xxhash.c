@@ -0,0 +1,94 @@
+/*
+ * No copyright is claimed.  This code is in the public domain; do with
+ * it what you wish.
+ *
+ * Prints XXH64 of stdin, or benchmarks the implementation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "c.h"
+#include "xxhash.h"
+
+static double get_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void __attribute__((__noreturn__)) usage(void)
+{
+	fprintf(stdout, " %s [--bench [<size> [<loops>]]]\n",
+			program_invocation_short_name);
+	fputs("  without options prints xxh64 of stdin\n", stdout);
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *buf;
+	size_t bufsz = 64 * 1024, i;
+
+	if (argc > 1 && strcmp(argv[1], "--help") == 0)
+		usage();
+
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		size_t loops = 0, n;
+		uint64_t h = 0;
+		double start, sec;
+
+		if (argc > 2)
+			bufsz = strtoul(argv[2], NULL, 10);
+		if (argc > 3)
+			loops = strtoul(argv[3], NULL, 10);
+		if (!bufsz)
+			errx(EXIT_FAILURE, "invalid size");
+		if (!loops)
+			loops = max((size_t) 1, (size_t) (1024 << 20) / bufsz);
+
+		buf = malloc(bufsz);
+		if (!buf)
+			err(EXIT_FAILURE, "malloc failed");
+		for (i = 0; i < bufsz; i++)
+			buf[i] = i * 31;
+
+		start = get_sec();
+		for (n = 0; n < loops; n++)
+			h = ul_xxh64(buf, bufsz, h);
+		sec = get_sec() - start;
+
+		printf("buffer size %zu, %zu loops\n", bufsz, loops);
+		printf("%-16s %10.1f MiB/s  (%016" PRIx64 ")\n", "xxh64",
+			sec > 0 ? ((double) bufsz * loops) / (1 << 20) / sec : 0.0,
+			h);
+		free(buf);
+		return EXIT_SUCCESS;
+	}
+
+	/* hash of stdin */
+	{
+		size_t sz = 0, maxsz = BUFSIZ;
+		size_t rsz;
+
+		buf = malloc(maxsz);
+		if (!buf)
+			err(EXIT_FAILURE, "malloc failed");
+		while ((rsz = fread(buf + sz, 1, maxsz - sz, stdin)) > 0) {
+			sz += rsz;
+			if (sz == maxsz) {
+				maxsz *= 2;
+				buf = realloc(buf, maxsz);
+				if (!buf)
+					err(EXIT_FAILURE, "realloc failed");
+			}
+		}
+		printf("xxh64: %016" PRIx64 "\n", ul_xxh64(buf, sz, 0));
+		free(buf);
+	}
+	return EXIT_SUCCESS;
+}
@@ -56,6 +56,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -90,6 +91,9 @@
 /* number of lines to allocate */
 #define	NALLOC			64
 
+/* size of the output buffer, see col_putchar() */
+#define	OUTBUF_SIZE		(64 * 1024)
+
 #if HAS_FEATURE_ADDRESS_SANITIZER || defined(FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION)
 # define COL_DEALLOCATE_ON_EXIT
 #endif
@@ -189,10 +193,36 @@ static void __attribute__((__noreturn__)) usage(void)
 	exit(EXIT_SUCCESS);
 }
 
-static inline void col_putchar(wchar_t ch)
+static char outbuf[OUTBUF_SIZE];
+static size_t outlen;
+
+static void col_flush(void)
 {
-	if (putwchar(ch) == WEOF)
+	if (outlen && fwrite(outbuf, 1, outlen, stdout) != outlen)
 		err(EXIT_FAILURE, _("write failed"));
+	outlen = 0;
+}
+
+/*
+ * The characters are converted to multibyte and collected in outbuf[], which
+ * is written by one fwrite() when full.  The stdout stream is byte oriented.
+ */
+static inline void col_putchar(wchar_t ch)
+{
+	if (OUTBUF_SIZE - outlen < MB_LEN_MAX)
+		col_flush();
+#ifdef HAVE_WIDECHAR
+	if ((unsigned long) ch >= 0x80) {
+		static mbstate_t st;
+		size_t n = wcrtomb(outbuf + outlen, ch, &st);
+
+		if (n == (size_t) -1)
+			err(EXIT_FAILURE, _("write failed"));
+		outlen += n;
+		return;
+	}
+#endif
+	outbuf[outlen++] = ch;
 }
 
 /*
@@ -342,10 +372,11 @@ static void flush_line(struct col_ctl *ctl, struct col_line *l)
 static struct col_line *alloc_line(struct col_ctl *ctl)
 {
 	struct col_line *l;
-	size_t i;
+	struct col_char *c;
+	size_t i, lsize;
 
 	if (!ctl->line_freelist) {
-		l = xmalloc(sizeof(struct col_line) * NALLOC);
+		l = xcalloc(NALLOC, sizeof(struct col_line));
 #ifdef COL_DEALLOCATE_ON_EXIT
 		if (ctl->alloc_root == NULL) {
 			ctl->alloc_root = xcalloc(1, sizeof(struct col_alloc));
@@ -365,7 +396,12 @@ static struct col_line *alloc_line(struct col_ctl *ctl)
 	l = ctl->line_freelist;
 	ctl->line_freelist = l->l_next;
 
+	/* reuse the characters buffer of the freed line */
+	c = l->l_line;
+	lsize = l->l_lsize;
 	memset(l, 0, sizeof(struct col_line));
+	l->l_line = c;
+	l->l_lsize = lsize;
 	return l;
 }
 
@@ -382,12 +418,11 @@ static void flush_lines(struct col_ctl *ctl, ssize_t nflush)
 	while (0 <= --nflush) {
 		l = ctl->lines;
 		ctl->lines = l->l_next;
-		if (l->l_line) {
+		if (l->l_line_len) {
 			flush_blanks(ctl);
 			flush_line(ctl, l);
 		}
 		ctl->nblank_lines++;
-		free(l->l_line);
 		free_line(ctl, l);
 	}
 	if (ctl->lines)
@@ -592,7 +627,11 @@ static void free_line_allocations(struct col_alloc *root)
 	struct col_alloc *next;
 
 	while (root) {
+		size_t i;
+
 		next = root->next;
+		for (i = 0; i < NALLOC; i++)
+			free(root->l[i].l_line);
 		free(root->l);
 		free(root);
 		root = next;
@@ -697,6 +736,7 @@ int main(int argc, char **argv)
 	for (; ctl.l->l_next; ctl.l = ctl.l->l_next)
 		lns.this_line++;
 	if (lns.max_line == 0 && lns.cur_col == 0) {
+		col_flush();
 #ifdef COL_DEALLOCATE_ON_EXIT
 		free_line_allocations(ctl.alloc_root);
 #endif
@@ -716,6 +756,7 @@ int main(int argc, char **argv)
 		/* missing a \n on the last line? */
 		ctl.nblank_lines = 2;
 	flush_blanks(&ctl);
+	col_flush();
 #ifdef COL_DEALLOCATE_ON_EXIT
 	free_line_allocations(ctl.alloc_root);
 #endif
@@ -42,6 +42,7 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include "nls.h"
 #include "c.h"
@@ -65,6 +66,13 @@ enum {
 	COLUMN_MODE_SIMPLE
 };
 
+/* cells of the line(s) split in the input buffer */
+struct column_cells {
+	char	**data;
+	size_t	ncells;
+	size_t	size;
+};
+
 struct column_control {
 	int	mode;		/* COLUMN_MODE_* */
 	size_t	termwidth;	/* -1 uninilialized, 0 unlimited, >0 width (default is 80) */
@@ -88,12 +96,16 @@ struct column_control {
 	const char *tree_parent;
 
 	wchar_t *input_separator;
+	char *input_separator_bytes;	/* ASCII-only separator or NULL */
 	const char *output_separator;
 
 	wchar_t	**ents;		/* input entries */
 	size_t	nents;		/* number of entries */
 	size_t	maxlength;	/* longest input record (line) */
 	size_t  maxncols;	/* maximal number of input columns */
+	size_t	jobs;		/* --jobs */
+
+	struct column_cells *cells;	/* for add_bytes_line_to_table() */
 
 	unsigned int greedy :1,
 		     json :1,
@@ -101,7 +113,8 @@ struct column_control {
 		     hide_unnamed :1,
 		     maxout : 1,
 		     keep_empty_lines :1,	/* --keep-empty-lines */
-		     tab_noheadings :1;
+		     tab_noheadings :1,
+		     utf8 :1;			/* UTF-8 locale */
 };
 
 static size_t width(const wchar_t *str)
@@ -194,6 +207,102 @@ static wchar_t *local_wcstok(struct column_control const *const ctl, wchar_t *p,
 	return result;
 }
 
+/* the same as local_wcstok(), but for the input in bytes */
+static char *local_strtok(struct column_control const *const ctl, char *p,
+			  char **state)
+{
+	char *result = NULL;
+
+	if (ctl->greedy)
+		return strtok_r(p, ctl->input_separator_bytes, state);
+	if (!p) {
+		if (!*state)
+			return NULL;
+		p = *state;
+	}
+	result = p;
+	p = strpbrk(result, ctl->input_separator_bytes);
+	if (!p)
+		*state = NULL;
+	else {
+		*p = '\0';
+		*state = p + 1;
+	}
+	return result;
+}
+
+static int is_ascii_string(const char *s)
+{
+	for (; *s; s++) {
+		if ((unsigned char) *s >= 0x80)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Returns true if the line may be split into cells without conversion to wide
+ * chars. It's the case for the ASCII separator and the ASCII line, and for
+ * a valid UTF-8 line in the UTF-8 locale, where the ASCII bytes are never
+ * part of a multibyte sequence.
+ */
+static int is_bytes_input(struct column_control const *const ctl, const char *s)
+{
+	const unsigned char *p = (const unsigned char *) s;
+
+	if (!ctl->input_separator_bytes)
+		return 0;
+
+	while (*p) {
+		size_t i, len;
+		unsigned int c;
+
+		if (*p < 0x80) {
+			p++;
+			continue;
+		}
+		if (!ctl->utf8)
+			return 0;
+
+		if (*p >= 0xC2 && *p <= 0xDF)
+			len = 2, c = *p & 0x1F;
+		else if (*p >= 0xE0 && *p <= 0xEF)
+			len = 3, c = *p & 0x0F;
+		else if (*p >= 0xF0 && *p <= 0xF4)
+			len = 4, c = *p & 0x07;
+		else
+			return 0;
+
+		for (i = 1; i < len; i++) {
+			if ((p[i] & 0xC0) != 0x80)
+				return 0;
+			c = (c << 6) | (p[i] & 0x3F);
+		}
+		/* overlong forms, surrogates and out of range */
+		if ((len == 3 && c < 0x800)
+		    || (len == 4 && (c < 0x10000 || c > 0x10FFFF))
+		    || (c >= 0xD800 && c <= 0xDFFF))
+			return 0;
+		p += len;
+	}
+	return 1;
+}
+
+static void set_input_separator(struct column_control *ctl, const char *str)
+{
+	free(ctl->input_separator);
+	free(ctl->input_separator_bytes);
+	ctl->input_separator_bytes = NULL;
+
+	ctl->input_separator = mbs_to_wcs(str);
+	if (!ctl->input_separator)
+		err(EXIT_FAILURE, _("failed to use input separator"));
+
+	/* stateful encodings may use ASCII bytes in shift sequences */
+	if (is_ascii_string(str) && mblen(NULL, 0) == 0)
+		ctl->input_separator_bytes = xstrdup(str);
+}
+
 static char **split_or_error(const char *str, const char *errmsg)
 {
 	char **res = strv_split(str, ",");
@@ -224,6 +333,8 @@ static void init_table(struct column_control *ctl)
 		scols_table_enable_noencoding(ctl->tab, 1);
 
 	scols_table_enable_maxout(ctl->tab, ctl->maxout ? 1 : 0);
+	if (ctl->jobs > 1)
+		scols_table_set_nthreads(ctl->tab, ctl->jobs);
 
 	if (ctl->tab_columns) {
 		char **opts;
@@ -504,10 +615,30 @@ static void modify_table(struct column_control *ctl)
 }
 
 
+static struct libscols_line *get_table_line(struct column_control *ctl,
+					     struct libscols_line *ln, size_t n)
+{
+	if (scols_table_get_ncols(ctl->tab) < n + 1) {
+		if (scols_table_is_json(ctl->tab) && !ctl->hide_unnamed)
+			errx(EXIT_FAILURE, _("line %zu: for JSON the name of the "
+				"column %zu is required"),
+				scols_table_get_nlines(ctl->tab) + 1,
+				n + 1);
+		scols_table_new_column(ctl->tab, NULL, 0,
+				ctl->hide_unnamed ? SCOLS_FL_HIDDEN : 0);
+	}
+	if (!ln) {
+		ln = scols_table_new_line(ctl->tab, NULL);
+		if (!ln)
+			err(EXIT_FAILURE, _("failed to allocate output line"));
+	}
+	return ln;
+}
+
 static int add_line_to_table(struct column_control *ctl, wchar_t *wcs0)
 {
 	wchar_t *wcdata, *sv = NULL, *wcs = wcs0;
-	size_t n = 0, nchars = 0;
+	size_t n = 0, nchars = 0, len = wcslen(wcs0);
 	struct libscols_line *ln = NULL;
 
 	if (!ctl->tab)
@@ -516,27 +647,14 @@ static int add_line_to_table(struct column_control *ctl, wchar_t *wcs0)
 		char *data;
 
 		if (ctl->maxncols && n + 1 == ctl->maxncols)
-			wcdata = wcs0 + nchars;
+			wcdata = wcs0 + min(nchars, len);
 		else
 			wcdata = local_wcstok(ctl, wcs, &sv);
 
 		if (!wcdata)
 			break;
-		if (scols_table_get_ncols(ctl->tab) < n + 1) {
-			if (scols_table_is_json(ctl->tab) && !ctl->hide_unnamed)
-				errx(EXIT_FAILURE, _("line %zu: for JSON the name of the "
-					"column %zu is required"),
-					scols_table_get_nlines(ctl->tab) + 1,
-					n + 1);
-			scols_table_new_column(ctl->tab, NULL, 0,
-					ctl->hide_unnamed ? SCOLS_FL_HIDDEN : 0);
-		}
-		if (!ln) {
-			ln = scols_table_new_line(ctl->tab, NULL);
-			if (!ln)
-				err(EXIT_FAILURE, _("failed to allocate output line"));
-		}
 
+		ln = get_table_line(ctl, ln, n);
 		nchars += wcslen(wcdata) + 1;
 
 		data = wcs_to_mbs(wcdata);
@@ -553,6 +671,69 @@ static int add_line_to_table(struct column_control *ctl, wchar_t *wcs0)
 	return 0;
 }
 
+/*
+ * The same as add_line_to_table(), but the line is split in place and the
+ * cells are appended to @cells.
+ */
+static void split_bytes_line(struct column_control const *const ctl, char *str0,
+			     struct column_cells *cells)
+{
+	char *data, *sv = NULL, *str = str0;
+	size_t n = 0, nchars = 0, len = strlen(str0);
+
+	do {
+		/* the rest of the line, or empty if all has been used */
+		if (ctl->maxncols && n + 1 == ctl->maxncols)
+			data = str0 + min(nchars, len);
+		else
+			data = local_strtok(ctl, str, &sv);
+
+		if (!data)
+			break;
+
+		nchars += strlen(data) + 1;
+
+		if (cells->ncells == cells->size) {
+			cells->size = cells->size ? cells->size * 2 : 64;
+			cells->data = xrealloc(cells->data,
+					cells->size * sizeof(char *));
+		}
+		cells->data[cells->ncells++] = data;
+		n++;
+		str = NULL;
+		if (ctl->maxncols && n == ctl->maxncols)
+			break;
+	} while (1);
+}
+
+/* the cells are copied to the table, @data may be freed later */
+static int add_cells_to_table(struct column_control *ctl, char **data, size_t ncells)
+{
+	struct libscols_line *ln = NULL;
+	size_t n;
+
+	if (!ctl->tab)
+		init_table(ctl);
+
+	for (n = 0; n < ncells; n++) {
+		ln = get_table_line(ctl, ln, n);
+		if (scols_line_set_data(ln, n, data[n]))
+			err(EXIT_FAILURE, _("failed to add output data"));
+	}
+	return 0;
+}
+
+static int add_bytes_line_to_table(struct column_control *ctl, char *str)
+{
+	if (!ctl->cells)
+		ctl->cells = xcalloc(1, sizeof(struct column_cells));
+
+	ctl->cells->ncells = 0;
+	split_bytes_line(ctl, str, ctl->cells);
+
+	return add_cells_to_table(ctl, ctl->cells->data, ctl->cells->ncells);
+}
+
 static int add_emptyline_to_table(struct column_control *ctl)
 {
 	if (!ctl->tab)
@@ -574,6 +755,207 @@ static void add_entry(struct column_control *ctl, size_t *maxents, wchar_t *wcs)
 	ctl->nents++;
 }
 
+/* converts the line to wide chars, broken sequences are encoded to \\x<hex> */
+static wchar_t *line_to_wcs(const char *buf)
+{
+	wchar_t *wcs = mbs_to_wcs(buf);
+
+	if (!wcs) {
+		size_t tmpsz = 0;
+		char *tmp = mbs_invalid_encode(buf, &tmpsz);
+
+		if (!tmp)
+			err(EXIT_FAILURE, _("read failed"));
+		wcs = mbs_to_wcs(tmp);
+		free(tmp);
+	}
+	return wcs;
+}
+
+/*
+ * Parallel table input (--jobs)
+ *
+ * The whole input is read to one buffer, split to chunks at line boundaries
+ * and the chunks are split to lines and cells by the threads. The table is
+ * not thread-safe, so the cells are added to the table in the input order by
+ * the main thread. The lines which are not possible to split in bytes are
+ * converted to wide chars by the main thread too.
+ */
+#define COLUMN_CHUNK_MINSZ	(256 * 1024)
+
+enum {
+	CHUNK_LINE_EMPTY,	/* for --keep-empty-lines */
+	CHUNK_LINE_CELLS,	/* split to cells */
+	CHUNK_LINE_WIDE		/* use add_line_to_table() */
+};
+
+struct column_chunk_line {
+	int	type;
+	char	*str;		/* CHUNK_LINE_WIDE */
+	size_t	ncells;		/* CHUNK_LINE_CELLS */
+};
+
+struct column_chunk {
+	struct column_control *ctl;
+	char	*begin;
+	char	*end;
+
+	struct column_chunk_line *lines;
+	size_t	nlines;
+	size_t	size;
+
+	struct column_cells cells;
+};
+
+static void *split_chunk(void *arg)
+{
+	struct column_chunk *ch = arg;
+	char *p = ch->begin;
+
+	while (p < ch->end) {
+		struct column_chunk_line *ln;
+		char *str, *nl = memchr(p, '\n', ch->end - p);
+
+		if (nl)
+			*nl = '\0';
+		else
+			*ch->end = '\0';
+
+		str = (char *) skip_space(p);
+		if (*str || ch->ctl->keep_empty_lines) {
+			if (ch->nlines == ch->size) {
+				ch->size = ch->size ? ch->size * 2 : 1024;
+				ch->lines = xrealloc(ch->lines,
+						ch->size * sizeof(*ch->lines));
+			}
+			ln = &ch->lines[ch->nlines++];
+			memset(ln, 0, sizeof(*ln));
+
+			if (!*str)
+				ln->type = CHUNK_LINE_EMPTY;
+			else if (is_bytes_input(ch->ctl, p)) {
+				size_t n = ch->cells.ncells;
+
+				split_bytes_line(ch->ctl, p, &ch->cells);
+				ln->type = CHUNK_LINE_CELLS;
+				ln->ncells = ch->cells.ncells - n;
+			} else {
+				ln->type = CHUNK_LINE_WIDE;
+				ln->str = p;
+			}
+		}
+		if (!nl)
+			break;
+		p = nl + 1;
+	}
+	return NULL;
+}
+
+/* reads all @fp to the buffer, the buffer is terminated by an extra byte */
+static char *read_all_input(FILE *fp, size_t *len)
+{
+	size_t sz = 1024 * 1024, n = 0;
+	char *buf = xmalloc(sz);
+
+	while (1) {
+		size_t rc = fread(buf + n, 1, sz - n - 1, fp);
+
+		n += rc;
+		if (n < sz - 1) {
+			if (ferror(fp))
+				err(EXIT_FAILURE, _("read failed"));
+			if (feof(fp))
+				break;
+			continue;
+		}
+		sz *= 2;
+		buf = xrealloc(buf, sz);
+	}
+	buf[n] = '\0';
+	*len = n;
+	return buf;
+}
+
+static int read_input_parallel(struct column_control *ctl, FILE *fp)
+{
+	struct column_chunk *chunks;
+	pthread_t *threads;
+	char *created;
+	size_t i, k, len = 0, nchunks;
+	char *buf, *p;
+	int rc = 0;
+
+	buf = read_all_input(fp, &len);
+	if (!len)
+		goto done;
+
+	nchunks = min(ctl->jobs, len / COLUMN_CHUNK_MINSZ + 1);
+	chunks = xcalloc(nchunks, sizeof(struct column_chunk));
+	threads = xcalloc(nchunks, sizeof(pthread_t));
+	created = xcalloc(nchunks, sizeof(char));
+
+	for (p = buf, i = 0; i < nchunks; i++) {
+		char *end = buf + len;
+
+		if (i + 1 < nchunks) {
+			char *mid = max(p, buf + len / nchunks * (i + 1));
+
+			end = memchr(mid, '\n', buf + len - mid);
+			end = end ? end + 1 : buf + len;
+		}
+		chunks[i].ctl = ctl;
+		chunks[i].begin = p;
+		chunks[i].end = end;
+		p = end;
+	}
+
+	/* the main thread splits the first chunk */
+	for (i = 1; i < nchunks; i++) {
+		if (pthread_create(&threads[i], NULL, split_chunk, &chunks[i]) == 0)
+			created[i] = 1;
+	}
+	split_chunk(&chunks[0]);
+
+	for (i = 0; i < nchunks; i++) {
+		struct column_chunk *ch = &chunks[i];
+		char **data;
+
+		if (created[i])
+			pthread_join(threads[i], NULL);
+		else if (i > 0)
+			split_chunk(ch);
+
+		for (data = ch->cells.data, k = 0; rc == 0 && k < ch->nlines; k++) {
+			struct column_chunk_line *ln = &ch->lines[k];
+			wchar_t *wcs;
+
+			switch (ln->type) {
+			case CHUNK_LINE_EMPTY:
+				rc = add_emptyline_to_table(ctl);
+				break;
+			case CHUNK_LINE_CELLS:
+				rc = add_cells_to_table(ctl, data, ln->ncells);
+				data += ln->ncells;
+				break;
+			case CHUNK_LINE_WIDE:
+				wcs = line_to_wcs(ln->str);
+				rc = add_line_to_table(ctl, wcs);
+				free(wcs);
+				break;
+			}
+		}
+		free(ch->lines);
+		free(ch->cells.data);
+	}
+
+	free(created);
+	free(threads);
+	free(chunks);
+done:
+	free(buf);
+	return rc;
+}
+
 static int read_input(struct column_control *ctl, FILE *fp)
 {
 	wchar_t *empty = NULL;
@@ -582,6 +964,9 @@ static int read_input(struct column_control *ctl, FILE *fp)
 	size_t maxents = 0;
 	int rc = 0;
 
+	if (ctl->jobs > 1 && ctl->mode == COLUMN_MODE_TABLE)
+		return read_input_parallel(ctl, fp);
+
 	/* Read input */
 	do {
 		char *str, *p;
@@ -612,20 +997,13 @@ static int read_input(struct column_control *ctl, FILE *fp)
 			continue;
 		}
 
-		wcs = mbs_to_wcs(buf);
-		if (!wcs) {
-			/*
-			 * Convert broken sequences to \x<hex> and continue.
-			 */
-			size_t tmpsz = 0;
-			char *tmp = mbs_invalid_encode(buf, &tmpsz);
-
-			if (!tmp)
-				err(EXIT_FAILURE, _("read failed"));
-			wcs = mbs_to_wcs(tmp);
-			free(tmp);
+		if (ctl->mode == COLUMN_MODE_TABLE && is_bytes_input(ctl, buf)) {
+			rc = add_bytes_line_to_table(ctl, buf);
+			continue;
 		}
 
+		wcs = line_to_wcs(buf);
+
 		switch (ctl->mode) {
 		case COLUMN_MODE_TABLE:
 			rc = add_line_to_table(ctl, wcs);
@@ -649,6 +1027,7 @@ static int read_input(struct column_control *ctl, FILE *fp)
 }
 
 
+
 static void columnate_fillrows(struct column_control *ctl)
 {
 	size_t chcnt, col, cnt, endcol, numcols;
@@ -744,6 +1123,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -T, --table-truncate <columns>   truncate text in the columns when necessary\n"), out);
 	fputs(_(" -W, --table-wrap <columns>       wrap text in the columns when necessary\n"), out);
 	fputs(_(" -L, --keep-empty-lines           don't ignore empty lines\n"), out);
+	fputs(_(" -j, --jobs <num>                 number of threads to split the table input\n"), out);
 	fputs(_(" -J, --json                       use JSON output format for table\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -781,6 +1161,7 @@ int main(int argc, char **argv)
 		{ "columns",             required_argument, NULL, 'c' }, /* deprecated */
 		{ "fillrows",            no_argument,       NULL, 'x' },
 		{ "help",                no_argument,       NULL, 'h' },
+		{ "jobs",                required_argument, NULL, 'j' },
 		{ "json",                no_argument,       NULL, 'J' },
 		{ "keep-empty-lines",    no_argument,       NULL, 'L' },
 		{ "output-separator",    required_argument, NULL, 'o' },
@@ -821,9 +1202,12 @@ int main(int argc, char **argv)
 	close_stdout_atexit();
 
 	ctl.output_separator = "  ";
-	ctl.input_separator = mbs_to_wcs("\t ");
+#ifdef HAVE_WIDECHAR
+	ctl.utf8 = strcmp(nl_langinfo(CODESET), "UTF-8") == 0;
+#endif
+	set_input_separator(&ctl, "\t ");
 
-	while ((c = getopt_long(argc, argv, "C:c:dE:eH:hi:Jl:LN:n:mO:o:p:R:r:s:T:tVW:x", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "C:c:dE:eH:hi:j:Jl:LN:n:mO:o:p:R:r:s:T:tVW:x", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -854,6 +1238,11 @@ int main(int argc, char **argv)
 		case 'i':
 			ctl.tree_id = optarg;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'J':
 			ctl.json = 1;
 			ctl.mode = COLUMN_MODE_TABLE;
@@ -891,10 +1280,7 @@ int main(int argc, char **argv)
 			ctl.tree = optarg;
 			break;
 		case 's':
-			free(ctl.input_separator);
-			ctl.input_separator = mbs_to_wcs(optarg);
-			if (!ctl.input_separator)
-				err(EXIT_FAILURE, _("failed to use input separator"));
+			set_input_separator(&ctl, optarg);
 			ctl.greedy = 0;
 			break;
 		case 'T':
@@ -987,6 +1373,11 @@ int main(int argc, char **argv)
 	}
 
 	free(ctl.input_separator);
+	free(ctl.input_separator_bytes);
+	if (ctl.cells) {
+		free(ctl.cells->data);
+		free(ctl.cells);
+	}
 
 	return eval == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
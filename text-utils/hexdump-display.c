@@ -40,12 +40,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "hexdump.h"
 #include "xalloc.h"
 #include "c.h"
 #include "nls.h"
 #include "colors.h"
 
+#define READ_BUFSZ	(256 * 1024)
+#define LINE_MAXSZ	160		/* builtin format output line */
+#define BATCH_LINES	(16 * 1024)	/* lines formatted by --jobs at once */
+#define BATCH_JOB_MINLINES 1024		/* don't start threads for less lines */
+
 static void doskip(const char *, int, struct hexdump *);
 static u_char *get(struct hexdump *);
 
@@ -237,6 +243,280 @@ static void bpad(struct hexdump_pr *pr)
 		;
 }
 
+/*
+ * The builtin formats are not interpreted by print(), the output line is
+ * composed from lookup tables and written at once. The output has to be the
+ * same as from the format strings in parse_args().
+ */
+static char hex2[256][2];		/* "%02x" */
+static char oct3[256][3];		/* "%03o" */
+static char prt[256];			/* "%_p" */
+
+static void init_builtin(void)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		hex2[i][0] = digits[i >> 4];
+		hex2[i][1] = digits[i & 0xf];
+		oct3[i][0] = digits[i >> 6];
+		oct3[i][1] = digits[(i >> 3) & 7];
+		oct3[i][2] = digits[i & 7];
+		prt[i] = isprint(i) ? i : '.';
+	}
+}
+
+/* writes @val in @base with at least @ndigits digits */
+static char *put_number(char *p, unsigned long long val, unsigned int base,
+			int ndigits)
+{
+	static const char digits[] = "0123456789abcdef";
+	char tmp[sizeof(val) * 3];
+	int n = 0;
+
+	do {
+		tmp[n++] = digits[val % base];
+		val /= base;
+	} while (val);
+	while (n < ndigits)
+		tmp[n++] = '0';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/*
+ * Writes the output line for the 16 bytes at @bp to @line, the bytes from
+ * @nbytes are padding. Returns the line size.
+ */
+static size_t format_builtin(int builtin, off_t addr, int nbytes,
+			     const unsigned char *bp, char *line)
+{
+	char *p = line;
+	int i;
+
+	switch (builtin) {
+	case HEX_FMT_CANONICAL:
+		p = put_number(p, addr, 16, 8);
+		*p++ = ' ';
+		for (i = 0; i < 16; i++) {
+			*p++ = ' ';
+			if (i == 8)
+				*p++ = ' ';
+			if (i < nbytes)
+				memcpy(p, hex2[bp[i]], 2);
+			else
+				memset(p, ' ', 2);
+			p += 2;
+		}
+		memcpy(p, "  |", 3);
+		p += 3;
+		for (i = 0; i < nbytes; i++)
+			*p++ = prt[bp[i]];
+		*p++ = '|';
+		break;
+	case HEX_FMT_1B_OCTAL:
+		p = put_number(p, addr, 16, 7);
+		for (i = 0; i < 16; i++) {
+			*p++ = ' ';
+			if (i < nbytes)
+				memcpy(p, oct3[bp[i]], 3);
+			else
+				memset(p, ' ', 3);
+			p += 3;
+		}
+		break;
+	default:
+	    {
+		/* two-byte units, as "%04x ", "  %05u ", " %06o " and "   %04x " */
+		const char *prefix = "";
+		unsigned int base = 16;
+		int ndigits = 4;
+
+		switch (builtin) {
+		case HEX_FMT_2B_DEC:
+			prefix = "  ";
+			base = 10;
+			ndigits = 5;
+			break;
+		case HEX_FMT_2B_OCTAL:
+			prefix = " ";
+			base = 8;
+			ndigits = 6;
+			break;
+		case HEX_FMT_2B_HEX:
+			prefix = "   ";
+			break;
+		}
+
+		p = put_number(p, addr, 16, 7);
+		for (i = 0; i < 16; i += 2) {
+			unsigned short val;	/* u_int16_t */
+
+			*p++ = ' ';
+			p = stpcpy(p, prefix);
+			if (i < nbytes) {
+				memcpy(&val, bp + i, sizeof(val));
+				if (base == 16) {
+					memcpy(p, hex2[val >> 8], 2);
+					memcpy(p + 2, hex2[val & 0xff], 2);
+					p += 4;
+				} else
+					p = put_number(p, val, base, ndigits);
+			} else {
+				memset(p, ' ', ndigits);
+				p += ndigits;
+			}
+		}
+		break;
+	    }
+	}
+	*p++ = '\n';
+	return p - line;
+}
+
+/* the last block is zero-padded, the padding is printed as spaces */
+static int block_nbytes(void)
+{
+	return eaddress && eaddress - address < 16 ? eaddress - address : 16;
+}
+
+static void display_builtin(struct hexdump *hex, const unsigned char *bp)
+{
+	char line[LINE_MAXSZ];
+	size_t sz;
+
+	sz = format_builtin(hex->builtin, address, block_nbytes(), bp, line);
+	fwrite(line, 1, sz, stdout);
+}
+
+/*
+ * --jobs: the blocks from get() are collected to a batch, the threads format
+ * parts of the batch to their own buffers and the buffers are written in the
+ * input order. The duplicate blocks are already squeezed by get(), the "*"
+ * lines are kept in the batch.
+ */
+struct hex_line {
+	off_t address;
+	int nbytes;			/* bytes of data, the rest is padding */
+	int star;			/* "*" line before this line */
+	unsigned char data[16];
+};
+
+struct hex_job {
+	int builtin;
+	struct hex_line *lines;
+	size_t nlines;
+	char *buf;			/* output */
+	size_t bufsz;
+};
+
+static struct hex_line *batch;		/* NULL if not parallel */
+static size_t batch_nlines;
+static int batch_star;			/* "*" after the last line */
+static struct hex_job *jobs;
+static size_t njobs;
+
+static void *format_lines(void *data)
+{
+	struct hex_job *job = data;
+	char *p = job->buf;
+	size_t i;
+
+	for (i = 0; i < job->nlines; i++) {
+		struct hex_line *ln = &job->lines[i];
+
+		if (ln->star)
+			p = stpcpy(p, "*\n");
+		p += format_builtin(job->builtin, ln->address, ln->nbytes,
+				    ln->data, p);
+	}
+	job->bufsz = p - job->buf;
+	return NULL;
+}
+
+static void init_batch(struct hexdump *hex)
+{
+	size_t i;
+
+	njobs = hex->jobs;
+	batch = xcalloc(BATCH_LINES, sizeof(struct hex_line));
+	jobs = xcalloc(njobs, sizeof(struct hex_job));
+	for (i = 0; i < njobs; i++) {
+		jobs[i].builtin = hex->builtin;
+		jobs[i].buf = xmalloc((BATCH_LINES / njobs + 1) * (LINE_MAXSZ + 2));
+	}
+}
+
+static void flush_batch(void)
+{
+	pthread_t *threads = xcalloc(njobs, sizeof(pthread_t));
+	char *created = xcalloc(njobs, 1);
+	size_t i, n, start = 0;
+
+	/* the main thread formats the first part */
+	n = min(njobs, batch_nlines / BATCH_JOB_MINLINES + 1);
+	for (i = 0; i < n; i++) {
+		size_t end = batch_nlines * (i + 1) / n;
+
+		jobs[i].lines = batch + start;
+		jobs[i].nlines = end - start;
+		start = end;
+		if (i > 0 && pthread_create(&threads[i], NULL,
+					    format_lines, &jobs[i]) == 0)
+			created[i] = 1;
+	}
+	for (i = 0; i < n; i++) {
+		if (created[i])
+			pthread_join(threads[i], NULL);
+		else
+			format_lines(&jobs[i]);
+		fwrite(jobs[i].buf, 1, jobs[i].bufsz, stdout);
+	}
+	batch_nlines = 0;
+	free(threads);
+	free(created);
+}
+
+static void add_batch_line(const unsigned char *bp)
+{
+	struct hex_line *ln = &batch[batch_nlines++];
+
+	ln->address = address;
+	ln->nbytes = block_nbytes();
+	ln->star = batch_star;
+	memcpy(ln->data, bp, sizeof(ln->data));
+	batch_star = 0;
+
+	if (batch_nlines == BATCH_LINES)
+		flush_batch();
+}
+
+static void free_batch(void)
+{
+	size_t i;
+
+	if (batch_nlines)
+		flush_batch();
+	if (batch_star)
+		fputs("*\n", stdout);
+	for (i = 0; i < njobs; i++)
+		free(jobs[i].buf);
+	free(jobs);
+	free(batch);
+	batch = NULL;
+}
+
+/* duplicate blocks are replaced by one "*" line */
+static void print_squeeze(void)
+{
+	if (batch)
+		batch_star = 1;
+	else
+		printf("*\n");
+}
+
 void display(struct hexdump *hex)
 {
 	register struct list_head *fs;
@@ -249,7 +529,21 @@ void display(struct hexdump *hex)
 	unsigned char savech = 0, *savebp;
 	struct list_head *p, *q, *r;
 
+	if (hex->builtin) {
+		init_builtin();
+		if (hex->jobs > 1)
+			init_batch(hex);
+	}
+
 	while ((bp = get(hex)) != NULL) {
+		if (batch) {
+			add_batch_line(bp);
+			continue;
+		}
+		if (hex->builtin) {
+			display_builtin(hex, bp);
+			continue;
+		}
 		fs = &hex->fshead; savebp = bp; saveaddress = address;
 
 		list_for_each(p, fs) {
@@ -289,6 +583,8 @@ void display(struct hexdump *hex)
 			address = saveaddress;
 		}
 	}
+	if (batch)
+		free_batch();
 	if (endfu) {
 		/*
 		 * if eaddress not set, error or file size was multiple of
@@ -354,7 +650,7 @@ get(struct hexdump *hex)
 			if (!need && vflag != ALL &&
 			    !memcmp(curp, savp, nread)) {
 				if (vflag != DUP)
-					printf("*\n");
+					print_squeeze();
 				goto retnul;
 			}
 			if (need > 0)
@@ -385,7 +681,7 @@ get(struct hexdump *hex)
 				return(curp);
 			}
 			if (vflag == WAIT)
-				printf("*\n");
+				print_squeeze();
 			vflag = DUP;
 			address += hex->blocksize;
 			need = hex->blocksize;
@@ -423,6 +719,8 @@ int next(char **argv, struct hexdump *hex)
 				return(0);
 			statok = 0;
 		}
+		/* get() reads one block at a time, let stdio read more */
+		setvbuf(stdin, NULL, _IOFBF, READ_BUFSZ);
 		if (hex->skip)
 			doskip(statok ? *_argv : "stdin", statok, hex);
 		if (*_argv)
@@ -56,6 +56,12 @@
 
 void hex_free(struct hexdump *);
 
+/* the builtin format is usable only if it's the only one */
+static void set_builtin(struct hexdump *hex, int fmt)
+{
+	hex->builtin = list_empty(&hex->fshead) ? fmt : HEX_FMT_NONE;
+}
+
 int
 parse_args(int argc, char **argv, struct hexdump *hex)
 {
@@ -73,6 +79,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		{"two-bytes-hex", no_argument, NULL, 'x'},
 		{"format", required_argument, NULL, 'e'},
 		{"format-file", required_argument, NULL, 'f'},
+		{"jobs", required_argument, NULL, 'j'},
 		{"color", optional_argument, NULL, 'L'},
 		{"length", required_argument, NULL, 'n'},
 		{"skip", required_argument, NULL, 's'},
@@ -84,36 +91,48 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 
 	if (!strcmp(program_invocation_short_name, "hd")) {
 		/* Canonical format */
+		set_builtin(hex, HEX_FMT_CANONICAL);
 		add_fmt("\"%08.8_Ax\n\"", hex);
 		add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 		add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
 	}
 
-	while ((ch = getopt_long(argc, argv, "bcCde:f:L::n:os:vxhV", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "bcCde:f:j:L::n:os:vxhV", longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'b':
+			set_builtin(hex, HEX_FMT_1B_OCTAL);
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"", hex);
 			break;
 		case 'c':
+			set_builtin(hex, HEX_FMT_NONE);
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"", hex);
 			break;
 		case 'C':
+			set_builtin(hex, HEX_FMT_CANONICAL);
 			add_fmt("\"%08.8_Ax\n\"", hex);
 			add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 			add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
 			break;
 		case 'd':
+			set_builtin(hex, HEX_FMT_2B_DEC);
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"", hex);
 			break;
 		case 'e':
+			set_builtin(hex, HEX_FMT_NONE);
 			add_fmt(optarg, hex);
 			break;
 		case 'f':
+			set_builtin(hex, HEX_FMT_NONE);
 			addfile(optarg, hex);
 			break;
+		case 'j':
+			hex->jobs = strtou32_or_err(optarg, _("invalid number of jobs"));
+			if (!hex->jobs)
+				errx(EXIT_FAILURE, _("invalid number of jobs"));
+			break;
 		case 'L':
 			colormode = UL_COLORMODE_AUTO;
 			if (optarg)
@@ -124,6 +143,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 			hex->length = strtosize_or_err(optarg, _("failed to parse length"));
 			break;
 		case 'o':
+			set_builtin(hex, HEX_FMT_2B_OCTAL);
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"", hex);
 			break;
@@ -134,6 +154,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 			vflag = ALL;
 			break;
 		case 'x':
+			set_builtin(hex, HEX_FMT_2B_HEX);
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"", hex);
 			break;
@@ -148,6 +169,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	}
 
 	if (list_empty(&hex->fshead)) {
+		set_builtin(hex, HEX_FMT_DEFAULT);
 		add_fmt(hex_offt, hex);
 		add_fmt("\"%07.7_ax \" 8/2 \"%04x \" \"\\n\"", hex);
 	}
@@ -176,6 +198,7 @@ void __attribute__((__noreturn__)) usage(void)
 	        "                             %s\n", USAGE_COLORS_DEFAULT);
 	fputs(_(" -e, --format <format>     format string to be used for displaying data\n"), out);
 	fputs(_(" -f, --format-file <file>  file that contains format strings\n"), out);
+	fputs(_(" -j, --jobs <num>          number of threads for -b, -C, -d, -o and -x\n"), out);
 	fputs(_(" -n, --length <length>     interpret only length bytes of input\n"), out);
 	fputs(_(" -s, --skip <offset>       skip offset bytes from the beginning\n"), out);
 	fputs(_(" -v, --no-squeezing        output identical lines\n"), out);
@@ -218,6 +241,8 @@ int main(int argc, char **argv)
 	/* rewrite the rules, do syntax checking */
 	list_for_each(p, &hex->fshead)
 		rewrite_rules(list_entry(p, struct hexdump_fs, fslist), hex);
+	if (hex->blocksize != 16)
+		hex->builtin = HEX_FMT_NONE;
 
 	next(argv, hex);
 	display(hex);
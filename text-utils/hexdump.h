@@ -86,12 +86,25 @@ struct hexdump_fs {			/* format strings */
 	int bcnt;
 };
 
+/* builtin formats printed without the format list */
+enum {
+  HEX_FMT_NONE = 0,			/* -e, -f or more formats */
+  HEX_FMT_DEFAULT,			/* no format option */
+  HEX_FMT_1B_OCTAL,			/* -b */
+  HEX_FMT_CANONICAL,			/* -C */
+  HEX_FMT_2B_DEC,			/* -d */
+  HEX_FMT_2B_OCTAL,			/* -o */
+  HEX_FMT_2B_HEX			/* -x */
+};
+
 struct hexdump {
   struct list_head fshead;				/* head of format strings */
   ssize_t blocksize;			/* data block size */
   int exitval;				/* final exit value */
   ssize_t length;			/* max bytes to read */
   off_t skip;				/* bytes to skip */
+  int builtin;				/* HEX_FMT_* */
+  unsigned int jobs;			/* threads for the builtin formats */
 };
 
 extern struct hexdump_fu *endfu;
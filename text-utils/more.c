@@ -56,6 +56,7 @@
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/file.h>
 #include <sys/ttydefaults.h>
 #include <sys/wait.h>
@@ -65,6 +66,7 @@
 #include <sys/signalfd.h>
 #include <paths.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #if defined(HAVE_NCURSESW_TERM_H)
 # include <ncursesw/term.h>
@@ -85,6 +87,7 @@
 #include "closestream.h"
 #include "rpmatch.h"
 #include "env.h"
+#include "regexutils.h"
 
 #ifdef TEST_PROGRAM
 # define NON_INTERACTIVE_MORE 1
@@ -107,6 +110,10 @@
 #define INIT_BUF	80
 #define COMMAND_BUF	200
 #define REGERR_BUF	NUM_COLUMNS
+#define WINDOW_SZ	(16 * 1024 * 1024)	/* mapped part of the file */
+#define LINE_INDEX_STEP	1024		/* lines between line index entries */
+#define SEARCH_POLL_MAX	100		/* max. ms between checks for a key */
+#define SEARCH_PROGRESS_DELAY 500	/* ms before the search progress is shown */
 
 #define TERM_AUTO_RIGHT_MARGIN    "am"
 #define TERM_BACKSPACE            "cub1"
@@ -162,6 +169,12 @@ struct more_control {
 	FILE *current_file;		/* currently open input file */
 	off_t file_position;		/* file position */
 	off_t file_size;		/* file size */
+	char *window;			/* mapped part of the file or NULL */
+	off_t window_start;		/* offset of the window in the file */
+	size_t window_len;		/* size of the window */
+	off_t *line_index;		/* offsets of every LINE_INDEX_STEP-th line */
+	size_t line_index_num;		/* number of line_index entries */
+	size_t line_index_sz;		/* allocated line_index entries */
 	int argv_position;		/* argv[] position */
 	int lines_per_screen;		/* screen size in lines */
 	int d_scroll_len;		/* number of lines scrolled by 'd' */
@@ -391,6 +404,130 @@ static int more_ungetc(struct more_control *ctl, int c)
 	return ret;
 }
 
+/*
+ * The regular files are mapped by windows, so the lines are counted and the
+ * literal patterns are searched in the mapping instead of more_getc() char
+ * by char. The offset of every LINE_INDEX_STEP-th line is remembered when
+ * the lines are counted from the begin of the file, and skip_backwards()
+ * then starts from the nearest remembered line rather than from the begin
+ * of the file. The output is still read by more_getc().
+ */
+static void unmap_window(struct more_control *ctl)
+{
+	if (ctl->window)
+		munmap(ctl->window, ctl->window_len);
+	ctl->window = NULL;
+	ctl->window_len = 0;
+}
+
+static void free_line_index(struct more_control *ctl)
+{
+	unmap_window(ctl);
+	free(ctl->line_index);
+	ctl->line_index = NULL;
+	ctl->line_index_num = ctl->line_index_sz = 0;
+}
+
+static void add_line_index(struct more_control *ctl, long line, off_t pos)
+{
+	if (line % LINE_INDEX_STEP
+	    || (size_t) line / LINE_INDEX_STEP != ctl->line_index_num)
+		return;
+	if (ctl->line_index_num == ctl->line_index_sz) {
+		ctl->line_index_sz = ctl->line_index_sz ? ctl->line_index_sz * 2 : 64;
+		ctl->line_index = xrealloc(ctl->line_index,
+				ctl->line_index_sz * sizeof(off_t));
+	}
+	ctl->line_index[ctl->line_index_num++] = pos;
+}
+
+/* returns file data at @pos and sets @len to the number of the bytes, or NULL at EOF */
+static const char *map_window(struct more_control *ctl, off_t pos, size_t *len)
+{
+	if (!ctl->window || pos < ctl->window_start
+	    || pos >= ctl->window_start + (off_t) ctl->window_len) {
+		off_t start;
+		size_t sz;
+
+		if (pos >= ctl->file_size) {
+			struct stat st;
+
+			/* the file may grow */
+			if (fstat(fileno(ctl->current_file), &st) != 0
+			    || pos >= st.st_size)
+				return NULL;
+			ctl->file_size = st.st_size;
+		}
+		unmap_window(ctl);
+
+		start = pos - pos % getpagesize();
+		sz = min((off_t) WINDOW_SZ, ctl->file_size - start);
+		ctl->window = mmap(NULL, sz, PROT_READ, MAP_PRIVATE,
+				   fileno(ctl->current_file), start);
+		if (ctl->window == MAP_FAILED) {
+			ctl->window = NULL;
+			return NULL;
+		}
+		ctl->window_start = start;
+		ctl->window_len = sz;
+	}
+	*len = ctl->window_start + ctl->window_len - pos;
+	return ctl->window + (pos - ctl->window_start);
+}
+
+/* returns offset of the first newline in the range from @pos to @end, or -1 */
+static off_t find_newline(struct more_control *ctl, off_t pos, off_t end)
+{
+	const char *p, *nl;
+	size_t len;
+
+	while (pos < end && (p = map_window(ctl, pos, &len))) {
+		if ((off_t) len > end - pos)
+			len = end - pos;
+		nl = memchr(p, '\n', len);
+		if (nl)
+			return pos + (nl - p);
+		pos += len;
+	}
+	return -1;
+}
+
+/*
+ * Moves @pos over @nlines lines and returns the number of the lines, the
+ * last line without newline is not counted. If @line is not negative then
+ * it's number of the line at @pos and the lines are added to the index.
+ */
+static long count_lines(struct more_control *ctl, off_t *pos, long line, long nlines)
+{
+	long n = 0;
+
+	while (n < nlines) {
+		off_t nl = find_newline(ctl, *pos, ctl->file_size);
+
+		if (nl < 0) {
+			*pos = max(*pos, ctl->file_size);
+			break;
+		}
+		*pos = nl + 1;
+		n++;
+		if (line >= 0)
+			add_line_index(ctl, line + n, *pos);
+	}
+	return n;
+}
+
+/* moves to the begin of the @line and returns the line number, smaller at EOF */
+static long seek_line(struct more_control *ctl, long line)
+{
+	size_t i = min((size_t) line / LINE_INDEX_STEP, ctl->line_index_num - 1);
+	off_t pos = ctl->line_index[i];
+	long n = i * LINE_INDEX_STEP;
+
+	n += count_lines(ctl, &pos, n, line - n);
+	more_fseek(ctl, pos);
+	return n;
+}
+
 static void print_separator(const int c, int n)
 {
 	while (n--)
@@ -451,6 +588,7 @@ static void checkf(struct more_control *ctl, char *fs)
 	ctl->current_line = 0;
 	ctl->file_position = 0;
 	ctl->file_size = 0;
+	free_line_index(ctl);
 	fflush(NULL);
 
 	ctl->current_file = fopen(fs, "r");
@@ -476,6 +614,8 @@ static void checkf(struct more_control *ctl, char *fs)
 		return;
 	}
 	fcntl(fileno(ctl->current_file), F_SETFD, FD_CLOEXEC);
+	if (S_ISREG(st.st_mode))
+		add_line_index(ctl, 0, 0);
 	c = more_getc(ctl);
 	ctl->clear_first = (c == '\f');
 	more_ungetc(ctl, c);
@@ -1318,6 +1458,12 @@ static void skip_lines(struct more_control *ctl)
 {
 	int c;
 
+	if (ctl->line_index && ctl->current_line == 0 && ctl->file_position == 0
+	    && ctl->next_jump > 0) {
+		ctl->current_line = seek_line(ctl, ctl->next_jump);
+		ctl->next_jump -= ctl->current_line;
+		return;
+	}
 	while (ctl->next_jump > 0) {
 		while ((c = more_getc(ctl)) != '\n')
 			if (c == EOF)
@@ -1399,6 +1545,223 @@ static int more_poll(struct more_control *ctl, int timeout)
 	return 0;
 }
 
+/* returns TRUE if regcomp() without REG_EXTENDED would match the string itself */
+static int is_literal_pattern(const char *pattern)
+{
+	return *pattern && !strpbrk(pattern, "\\.[*^$");
+}
+
+/*
+ * The search in the mapped file runs in a thread, the main thread waits for
+ * the result and a key press which cancels the search.
+ */
+struct more_search {
+	struct more_control *ctl;
+	regex_t *re;			/* NULL if the literal is the whole pattern */
+	char literal[COMMAND_BUF];	/* string which is in every match */
+	size_t litlen;
+	char *buf;			/* line for regexec() */
+	size_t bufsz;
+	off_t start;			/* begin of the search */
+	off_t total;			/* file size for the progress */
+	int n;				/* nth occurrence */
+
+	int percent;			/* progress, atomic */
+	int cancel;			/* set by the main thread, atomic */
+	int done;			/* set by the search thread, atomic */
+
+	/* result as in search() */
+	int found;
+	int lncount;
+	off_t line3;
+	long nlines;			/* lines to the end of the found line */
+};
+
+static void set_search_progress(struct more_search *sr, off_t pos)
+{
+	if (sr->total > 0)
+		__atomic_store_n(&sr->percent,
+				 (int) (min(pos, sr->total) * 100 / sr->total),
+				 __ATOMIC_RELAXED);
+}
+
+/* returns offset of the literal in the file from @pos, or -1 */
+static off_t find_pattern(struct more_search *sr, off_t pos)
+{
+	const char *p, *x;
+	size_t len;
+
+	while (!__atomic_load_n(&sr->cancel, __ATOMIC_RELAXED)
+	       && (p = map_window(sr->ctl, pos, &len))) {
+		if (len < sr->litlen) {
+			/* the literal may cross the end of the window */
+			if (sr->ctl->window_start == pos - pos % getpagesize())
+				break;
+			unmap_window(sr->ctl);
+			continue;
+		}
+		x = memmem(p, len, sr->literal, sr->litlen);
+		if (x)
+			return pos + (x - p);
+		pos += len - sr->litlen + 1;
+		set_search_progress(sr, pos);
+	}
+	return -1;
+}
+
+/*
+ * Returns TRUE if the regex matches the line from @pos to @end. The long
+ * lines are split to pieces of line_buf size as read_line() does.
+ */
+static int line_matches(struct more_search *sr, off_t pos, off_t end)
+{
+	while (pos < end) {
+		size_t sz = min((off_t) sr->bufsz - 1, end - pos), n = 0;
+
+		while (n < sz) {
+			const char *p;
+			size_t len;
+
+			p = map_window(sr->ctl, pos + n, &len);
+			if (!p)
+				return 0;
+			len = min(len, sz - n);
+			memcpy(sr->buf + n, p, len);
+			n += len;
+		}
+		sr->buf[sz] = '\0';
+		if (regexec(sr->re, sr->buf, 0, NULL, 0) == 0)
+			return 1;
+		pos += sz;
+	}
+	return 0;
+}
+
+/*
+ * The same as the regexec() loop in search(), but only the lines with the
+ * literal found by memmem() in the mapped file are tested by regexec(). The
+ * lines are counted the same way.
+ */
+static void *search_thread(void *data)
+{
+	struct more_search *sr = data;
+	struct more_control *ctl = sr->ctl;
+	off_t pos = sr->start;			/* begin of the line */
+	off_t prev1 = pos, prev2 = pos;		/* begin of the previous lines */
+	long nlines = 0;
+	int n = sr->n;
+
+	while (1) {
+		off_t hit = find_pattern(sr, pos), nl;
+
+		if (hit < 0)
+			break;
+		while ((nl = find_newline(ctl, pos, hit)) >= 0) {
+			prev2 = prev1;
+			prev1 = pos;
+			pos = nl + 1;
+			nlines++;
+		}
+		nl = find_newline(ctl, hit, ctl->file_size);
+		if ((!sr->re || line_matches(sr, pos, nl < 0 ? ctl->file_size : nl))
+		    && --n == 0) {
+			sr->found = 1;
+			sr->lncount = nlines + 1;
+			sr->line3 = prev2;
+			sr->nlines = nlines + (nl >= 0);
+			break;
+		}
+		if (nl < 0)
+			break;
+		prev2 = prev1;
+		prev1 = pos;
+		pos = nl + 1;
+		nlines++;
+		set_search_progress(sr, pos);
+	}
+	__atomic_store_n(&sr->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/*
+ * Runs the search thread and waits for it. The progress is shown on the
+ * prompt line if the search is slow. Returns 1 if found, 0 if not found and
+ * -1 if the search has been interrupted by a key.
+ */
+static int run_search(struct more_control *ctl, struct more_search *sr)
+{
+	pthread_t thread;
+	int timeout = 1, waited = 0, shown = 0, rc;
+
+	if (pthread_create(&thread, NULL, search_thread, sr) != 0) {
+		search_thread(sr);
+		return sr->found;
+	}
+	while (!__atomic_load_n(&sr->done, __ATOMIC_ACQUIRE)) {
+		if (more_poll(ctl, timeout) == 0) {
+			__atomic_store_n(&sr->cancel, 1, __ATOMIC_RELAXED);
+			read_user_input(ctl);
+			break;
+		}
+		waited += timeout;
+		timeout = min(timeout * 2, SEARCH_POLL_MAX);
+		if (waited >= SEARCH_PROGRESS_DELAY) {
+			putchar('\r');
+			if (ctl->erase_line)
+				putp(ctl->erase_line);
+			ctl->prompt_len = printf(_("...searching %d%%"),
+				__atomic_load_n(&sr->percent, __ATOMIC_RELAXED));
+			fflush(stdout);
+			shown = 1;
+		}
+	}
+	pthread_join(thread, NULL);
+
+	if (shown)
+		erase_to_col(ctl, 0);
+	rc = __atomic_load_n(&sr->cancel, __ATOMIC_RELAXED) ? -1 : sr->found;
+	if (rc > 0)
+		ctl->current_line += sr->nlines;
+	return rc;
+}
+
+/*
+ * Prepares search in the mapped file if the literal part of the regex is
+ * usable for memmem(). Returns 0 on success.
+ */
+static int init_search(struct more_control *ctl, struct more_search *sr,
+		       const char *pattern, regex_t *re, int n)
+{
+	memset(sr, 0, sizeof(*sr));
+
+	if (!ctl->line_index || ctl->no_tty_in)
+		return -1;
+	if (is_literal_pattern(pattern)) {
+		sr->litlen = strlen(pattern);
+		if (sr->litlen >= sizeof(sr->literal))
+			return -1;
+		memcpy(sr->literal, pattern, sr->litlen + 1);
+	} else {
+#ifdef HAVE_WIDECHAR
+		/* the bytes of the literal may be part of other chars */
+		if (MB_CUR_MAX > 1 && strcmp(nl_langinfo(CODESET), "UTF-8") != 0)
+			return -1;
+#endif
+		sr->litlen = ul_regex_literal(pattern, sr->literal,
+					      sizeof(sr->literal));
+		if (!sr->litlen)
+			return -1;
+		sr->re = re;
+		sr->bufsz = ctl->line_sz;
+		sr->buf = xmalloc(sr->bufsz);
+	}
+	sr->ctl = ctl;
+	sr->start = ctl->file_position;
+	sr->total = ctl->file_size;
+	sr->n = n;
+	return 0;
+}
+
 /* Search for nth occurrence of regular expression contained in buf in
  * the file */
 static void search(struct more_control *ctl, char buf[], int n)
@@ -1406,9 +1769,10 @@ static void search(struct more_control *ctl, char buf[], int n)
 	off_t startline = ctl->file_position;
 	off_t line1 = startline;
 	off_t line2 = startline;
-	off_t line3;
+	off_t line3 = startline;
 	int lncount;
-	int saveln, rc;
+	int saveln, rc, found = 0;
+	struct more_search sr;
 	regex_t re;
 
 	if (buf != ctl->previous_search) {
@@ -1428,50 +1792,60 @@ static void search(struct more_control *ctl, char buf[], int n)
 		more_error(ctl, s);
 		return;
 	}
-	while (!feof(ctl->current_file)) {
-		line3 = line2;
-		line2 = line1;
-		line1 = ctl->file_position;
-		read_line(ctl);
-		lncount++;
-		if (regexec(&re, ctl->line_buf, 0, NULL, 0) == 0 && --n == 0) {
-			if ((1 < lncount && ctl->no_tty_in) || 3 < lncount) {
-				putchar('\n');
-				if (ctl->clear_line_ends)
+	if (init_search(ctl, &sr, buf, &re, n) == 0) {
+		found = run_search(ctl, &sr);
+		lncount = sr.lncount;
+		line3 = sr.line3;
+		free(sr.buf);
+	} else {
+		while (!feof(ctl->current_file)) {
+			line3 = line2;
+			line2 = line1;
+			line1 = ctl->file_position;
+			read_line(ctl);
+			lncount++;
+			if (regexec(&re, ctl->line_buf, 0, NULL, 0) == 0 && --n == 0) {
+				found = 1;
+				break;
+			}
+			more_poll(ctl, 1);
+		}
+	}
+	if (found > 0) {
+		if ((1 < lncount && ctl->no_tty_in) || 3 < lncount) {
+			putchar('\n');
+			if (ctl->clear_line_ends)
+				putp(ctl->erase_line);
+			fputs(_("...skipping\n"), stdout);
+		}
+		if (!ctl->no_tty_in) {
+			ctl->current_line -= (lncount < 3 ? lncount : 3);
+			more_fseek(ctl, line3);
+			if (ctl->no_scroll) {
+				if (ctl->clear_line_ends) {
+					putp(ctl->go_home);
 					putp(ctl->erase_line);
-				fputs(_("...skipping\n"), stdout);
+				} else
+					more_clear_screen(ctl);
 			}
-			if (!ctl->no_tty_in) {
-				ctl->current_line -= (lncount < 3 ? lncount : 3);
-				more_fseek(ctl, line3);
-				if (ctl->no_scroll) {
-					if (ctl->clear_line_ends) {
-						putp(ctl->go_home);
-						putp(ctl->erase_line);
-					} else
-						more_clear_screen(ctl);
-				}
-			} else {
-				erase_to_col(ctl, 0);
-				if (ctl->no_scroll) {
-					if (ctl->clear_line_ends) {
-						putp(ctl->go_home);
-						putp(ctl->erase_line);
-					} else
-						more_clear_screen(ctl);
-				}
-				puts(ctl->line_buf);
+		} else {
+			erase_to_col(ctl, 0);
+			if (ctl->no_scroll) {
+				if (ctl->clear_line_ends) {
+					putp(ctl->go_home);
+					putp(ctl->erase_line);
+				} else
+					more_clear_screen(ctl);
 			}
-			break;
+			puts(ctl->line_buf);
 		}
-		more_poll(ctl, 1);
 	}
 	/* Move ctrl+c signal handling back to more_key_command(). */
 	signal(SIGINT, SIG_DFL);
 	sigaddset(&ctl->sigset, SIGINT);
 	sigprocmask(SIG_BLOCK, &ctl->sigset, NULL);
 	regfree(&re);
-	if (feof(ctl->current_file)) {
+	if (found <= 0 || feof(ctl->current_file)) {
 		if (!ctl->no_tty_in) {
 			ctl->current_line = saveln;
 			more_fseek(ctl, startline);
@@ -1479,6 +1853,10 @@ static void search(struct more_control *ctl, char buf[], int n)
 			fputs(_("\nPattern not found\n"), stdout);
 			more_exit(ctl);
 		}
+		if (found < 0) {
+			more_error(ctl, _("Search interrupted"));
+			return;
+		}
 notfound:
 		more_error(ctl, _("Pattern not found"));
 	}
@@ -1601,6 +1979,14 @@ static int skip_forwards(struct more_control *ctl, int nlines, cc_t comchar)
 		putp(ctl->erase_line);
 	putchar('\n');
 
+	if (ctl->line_index) {
+		off_t pos = ctl->file_position;
+		long n = count_lines(ctl, &pos, -1, nlines);
+
+		more_fseek(ctl, pos);
+		ctl->current_line += n;
+		return n == nlines;
+	}
 	while (nlines > 0) {
 		while ((c = more_getc(ctl)) != '\n')
 			if (c == EOF)
@@ -1940,6 +2326,7 @@ static void display_file(struct more_control *ctl, int left)
 			screen(ctl, left);
 	}
 	fflush(NULL);
+	free_line_index(ctl);
 	fclose(ctl->current_file);
 	ctl->current_file = NULL;
 	ctl->screen_start.line_num = ctl->screen_start.row_num = 0;
@@ -81,6 +81,7 @@
 #include "all-io.h"
 #include "closestream.h"
 #include "strutils.h"
+#include "regexutils.h"
 
 #define	READBUF		LINE_MAX	/* size of input buffer */
 #define CMDBUF		255		/* size of command buffer */
@@ -132,6 +133,7 @@ static struct termios otio;		/* old termios settings */
 static int tinfostat = -1;		/* terminfo routines initialized */
 static int searchdisplay = TOP;	/* matching line position */
 static regex_t re;			/* regular expression to search for */
+static char reliteral[256];		/* string in every match of re or "" */
 static int remembered;			/* have a remembered search string */
 static int cflag;			/* clear screen before each page */
 static int eflag;			/* suppress (EOF) */
@@ -880,6 +882,26 @@ static char *makepat(void)
 	return p;
 }
 
+/* Remember the literal part of the search pattern. */
+static void setliteral(const char *pattern)
+{
+	*reliteral = '\0';
+#ifdef HAVE_WIDECHAR
+	/* the bytes of the literal may be part of other chars */
+	if (MB_CUR_MAX > 1 && strcmp(nl_langinfo(CODESET), "UTF-8") != 0)
+		return;
+#endif
+	ul_regex_literal(pattern, reliteral, sizeof(reliteral));
+}
+
+/* Test the line against the remembered search pattern. */
+static int matchline(const char *s)
+{
+	if (*reliteral && !strstr(s, reliteral))
+		return 0;
+	return regexec(&re, s, 0, NULL, 0) == 0;
+}
+
 /* Process errors that occurred in temporary file operations. */
 static void __attribute__((__noreturn__)) tmperr(FILE *f, const char *ftype)
 {
@@ -957,6 +979,7 @@ static void pgfile(FILE *f, const char *name)
 			goto newcmd;
 		}
 		remembered = 1;
+		setliteral(searchfor);
 	}
 
 	for (line = startline;;) {
@@ -1035,7 +1058,7 @@ static void pgfile(FILE *f, const char *name)
 			}
 			line++;
 			colb(b);
-			if (regexec(&re, b, 0, NULL, 0) == 0) {
+			if (matchline(b)) {
 				searchcount--;
 			}
 			if (searchcount == 0) {
@@ -1125,6 +1148,7 @@ static void pgfile(FILE *f, const char *name)
 						goto newcmd;
 					}
 					remembered = 1;
+					setliteral(p);
 				} else if (remembered == 0) {
 					mesg(_("No remembered search string"));
 					goto newcmd;
@@ -1151,6 +1175,7 @@ static void pgfile(FILE *f, const char *name)
 						goto newcmd;
 					}
 					remembered = 1;
+					setliteral(p);
 				} else if (remembered == 0) {
 					mesg(_("No remembered search string"));
 					goto newcmd;
@@ -1169,7 +1194,7 @@ static void pgfile(FILE *f, const char *name)
 					if (fgets(b, READBUF, fbuf) == NULL)
 						tmperr(fbuf, "buffer");
 					colb(b);
-					if (regexec(&re, b, 0, NULL, 0) == 0)
+					if (matchline(b))
 						searchcount--;
 					if (searchcount == 0)
 						goto found_bw;
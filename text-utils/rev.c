@@ -57,6 +57,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <getopt.h>
+#include <stdint.h>
 
 #include "nls.h"
 #include "xalloc.h"
@@ -96,13 +97,214 @@ static void reverse_str(wchar_t *str, size_t n)
 	}
 }
 
+/*
+ * The multibyte path below works on bytes, the line is converted to wide
+ * chars only if it contains non-ASCII bytes. The ASCII bytes have to be
+ * single characters and the encoding must be stateless, otherwise (e.g.
+ * ISO-2022) the wide char path is used for all the input.
+ */
+#define REV_BUFSIZ	(128 * 1024)
+
+struct rev_buffer {
+	char	*data;
+	size_t	size;
+	size_t	len;
+};
+
+static inline int is_ascii(const char *p, size_t len)
+{
+	uint64_t acc = 0, x;
+	size_t i = 0;
+
+	for (; i + sizeof(x) <= len; i += sizeof(x)) {
+		memcpy(&x, p + i, sizeof(x));
+		acc |= x;
+	}
+	for (; i < len; i++)
+		acc |= (unsigned char) p[i];
+
+	return (acc & 0x8080808080808080ULL) == 0;
+}
+
+static inline uint64_t swap_bytes(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap64(x);
+#else
+	x = ((x & 0x00FF00FF00FF00FFULL) << 8) | ((x >> 8) & 0x00FF00FF00FF00FFULL);
+	x = ((x & 0x0000FFFF0000FFFFULL) << 16) | ((x >> 16) & 0x0000FFFF0000FFFFULL);
+	return (x << 32) | (x >> 32);
+#endif
+}
+
+/* reverses ASCII @src to @dst, 8 bytes by one step */
+static void reverse_bytes(char *dst, const char *src, size_t len)
+{
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+		uint64_t x;
+
+		memcpy(&x, src + len - i - sizeof(x), sizeof(x));
+		x = swap_bytes(x);
+		memcpy(dst + i, &x, sizeof(x));
+	}
+	for (; i < len; i++)
+		dst[i] = src[len - 1 - i];
+}
+
+#ifdef HAVE_WIDECHAR
+/* reverses multibyte @src to @dst, returns -1 on invalid sequence */
+static int reverse_chars(char *dst, const char *src, size_t len)
+{
+	mbstate_t st;
+	size_t i = 0;
+
+	memset(&st, 0, sizeof(st));
+
+	while (i < len) {
+		size_t n = mbrlen(src + i, len - i, &st);
+
+		if (n == (size_t) -1 || n == (size_t) -2)
+			return -1;
+		if (n == 0)
+			n = 1;		/* L'\0' */
+		memcpy(dst + len - i - n, src + i, n);
+		i += n;
+	}
+	return 0;
+}
+#endif /* HAVE_WIDECHAR */
+
+static void rev_flush(struct rev_buffer *out)
+{
+	if (out->len)
+		fwrite(out->data, 1, out->len, stdout);
+	out->len = 0;
+}
+
+/* adds reversed @line to the output buffer, @len is without newline */
+static int rev_line(struct rev_buffer *out, const char *line, size_t len, int nl)
+{
+	char *dst;
+
+	if (out->size - out->len < len + 1) {
+		rev_flush(out);
+		if (out->size < len + 1) {
+			out->size = len + 1;
+			out->data = xrealloc(out->data, out->size);
+		}
+	}
+	dst = out->data + out->len;
+
+#ifdef HAVE_WIDECHAR
+	if (!is_ascii(line, len)) {
+		if (reverse_chars(dst, line, len) != 0)
+			return -1;
+	} else
+#endif
+		reverse_bytes(dst, line, len);
+
+	if (nl)
+		dst[len++] = '\n';
+	out->len += len;
+	return 0;
+}
+
+/* returns -errno on error, @line is the number of the processed lines */
+static int rev_bytes(FILE *fp, struct rev_buffer *in, struct rev_buffer *out,
+		     uintmax_t *line)
+{
+	size_t start = 0;
+	int eof = 0;
+
+	in->len = 0;
+
+	while (!eof) {
+		size_t n;
+
+		/* move incomplete line to the begin of the buffer */
+		if (start) {
+			memmove(in->data, in->data + start, in->len - start);
+			in->len -= start;
+			start = 0;
+		}
+		if (in->len == in->size) {
+			in->size *= 2;
+			in->data = xrealloc(in->data, in->size);
+		}
+
+		n = fread(in->data + in->len, 1, in->size - in->len, fp);
+		if (n == 0) {
+			if (ferror(fp))
+				return -errno;
+			eof = 1;
+		}
+		in->len += n;
+
+		while (start < in->len) {
+			char *p = in->data + start;
+			char *nl = memchr(p, '\n', in->len - start);
+			size_t len;
+
+			if (!nl && !eof)
+				break;		/* incomplete line */
+
+			len = nl ? (size_t) (nl - p) : in->len - start;
+			if (rev_line(out, p, len, nl != NULL) != 0) {
+				rev_flush(out);
+				return -EILSEQ;
+			}
+			start += len + (nl ? 1 : 0);
+			(*line)++;
+		}
+	}
+
+	rev_flush(out);
+	return 0;
+}
+
+static int rev_wide(FILE *fp, wchar_t **buf, size_t *bufsiz, uintmax_t *line)
+{
+	size_t len;
+
+	while (fgetws(*buf, *bufsiz, fp)) {
+		len = wcslen(*buf);
+
+		if (len == 0)
+			continue;
+
+		/* This is my hack from setpwnam.c -janl */
+		while ((*buf)[len-1] != '\n' && !feof(fp)) {
+			/* Extend input buffer if it failed getting the whole line */
+			/* So now we double the buffer size */
+			*bufsiz *= 2;
+
+			*buf = xrealloc(*buf, *bufsiz * sizeof(wchar_t));
+
+			/* And fill the rest of the buffer */
+			if (!fgetws(&(*buf)[len], *bufsiz/2, fp))
+				break;
+
+			len = wcslen(*buf);
+		}
+		if ((*buf)[len - 1] == '\n')
+			(*buf)[len--] = '\0';
+		reverse_str(*buf, len);
+		fputws(*buf, stdout);
+		(*line)++;
+	}
+	return ferror(fp) ? -errno : 0;
+}
+
 int main(int argc, char *argv[])
 {
 	char const *filename = "stdin";
-	wchar_t *buf;
-	size_t len, bufsiz = BUFSIZ;
+	wchar_t *buf = NULL;
+	size_t bufsiz = BUFSIZ;
+	struct rev_buffer in = { NULL }, out = { NULL };
 	FILE *fp = stdin;
-	int ch, rval = EXIT_SUCCESS;
+	int ch, rc, wide, rval = EXIT_SUCCESS;
 	uintmax_t line;
 
 	static const struct option longopts[] = {
@@ -132,7 +334,20 @@ int main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	buf = xmalloc(bufsiz * sizeof(wchar_t));
+#ifdef HAVE_WIDECHAR
+	/* stateful encoding */
+	wide = mblen(NULL, 0) != 0;
+#else
+	wide = 0;
+#endif
+
+	if (wide)
+		buf = xmalloc(bufsiz * sizeof(wchar_t));
+	else {
+		in.size = out.size = REV_BUFSIZ;
+		in.data = xmalloc(in.size);
+		out.data = xmalloc(out.size);
+	}
 
 	do {
 		if (*argv) {
@@ -146,33 +361,12 @@ int main(int argc, char *argv[])
 		}
 
 		line = 0;
-		while (fgetws(buf, bufsiz, fp)) {
-			len = wcslen(buf);
-
-			if (len == 0)
-				continue;
-
-			/* This is my hack from setpwnam.c -janl */
-			while (buf[len-1] != '\n' && !feof(fp)) {
-				/* Extend input buffer if it failed getting the whole line */
-				/* So now we double the buffer size */
-				bufsiz *= 2;
-
-				buf = xrealloc(buf, bufsiz * sizeof(wchar_t));
-
-				/* And fill the rest of the buffer */
-				if (!fgetws(&buf[len], bufsiz/2, fp))
-					break;
-
-				len = wcslen(buf);
-			}
-			if (buf[len - 1] == '\n')
-				buf[len--] = '\0';
-			reverse_str(buf, len);
-			fputws(buf, stdout);
-			line++;
-		}
-		if (ferror(fp)) {
+		if (wide)
+			rc = rev_wide(fp, &buf, &bufsiz, &line);
+		else
+			rc = rev_bytes(fp, &in, &out, &line);
+		if (rc) {
+			errno = -rc;
 			warn("%s: %ju", filename, line);
 			rval = EXIT_FAILURE;
 		}
@@ -181,6 +375,7 @@ int main(int argc, char *argv[])
 	} while(*argv);
 
 	free(buf);
+	free(in.data);
+	free(out.data);
 	return rval;
 }
-
@@ -70,6 +70,9 @@
 #define	HREV	'8'
 #define	FREV	'7'
 
+/* size of the output buffer, see ul_putwchar() */
+#define	OUTBUF_SIZE	(64 * 1024)
+
 enum {
 	NORMAL_CHARSET	    = 0,	/* Must be zero, see initbuf() */
 	ALTERNATIVE_CHARSET = 1 << 0,	/* Reverse */
@@ -79,19 +82,25 @@ enum {
 	BOLD		    = 1 << 4,	/* Bold */
 };
 
+/* terminfo string as expanded by tputs() */
+struct term_seq {
+	char *str;
+	size_t len;
+};
+
 struct term_caps {
-	char *curs_up;
-	char *curs_right;
-	char *curs_left;
-	char *enter_standout;
-	char *exit_standout;
-	char *enter_underline;
-	char *exit_underline;
-	char *enter_dim;
-	char *enter_bold;
-	char *enter_reverse;
-	char *under_char;
-	char *exit_attributes;
+	struct term_seq curs_up;
+	struct term_seq curs_right;
+	struct term_seq curs_left;
+	struct term_seq enter_standout;
+	struct term_seq exit_standout;
+	struct term_seq enter_underline;
+	struct term_seq exit_underline;
+	struct term_seq enter_dim;
+	struct term_seq enter_bold;
+	struct term_seq enter_reverse;
+	struct term_seq under_char;
+	struct term_seq exit_attributes;
 };
 
 struct ul_char {
@@ -112,9 +121,13 @@ struct ul_ctl {
 	unsigned int
 		indicated_opt:1,
 		must_use_uc:1,
-		must_overstrike:1;
+		must_overstrike:1,
+		flush_lines:1;		/* output is a terminal */
 };
 
+static char outbuf[OUTBUF_SIZE];
+static size_t outlen;
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -168,42 +181,83 @@ static void init_buffer(struct ul_ctl *ctl)
 	ctl->mode &= ALTERNATIVE_CHARSET;
 }
 
+static struct term_seq *expanded_seq;
+
+static int expand_putc(int c)
+{
+	struct term_seq *seq = expanded_seq;
+
+	seq->str = xrealloc(seq->str, seq->len + 1);
+	seq->str[seq->len++] = c;
+	return c;
+}
+
+/*
+ * The capabilities are expanded by tputs() only once, the output is then
+ * copied to the output buffer by print_line().
+ */
+static void init_seq(struct term_seq *seq, const char *str)
+{
+	seq->str = NULL;
+	seq->len = 0;
+	if (!str || str == (char *) -1)
+		return;
+
+	expanded_seq = seq;
+	tputs(str, STDOUT_FILENO, expand_putc);
+	if (!seq->str)
+		seq->str = xstrdup("");
+}
+
+static void copy_seq(struct term_seq *seq, const struct term_seq *src)
+{
+	if (!src->str) {
+		seq->str = NULL;
+		seq->len = 0;
+		return;
+	}
+	seq->str = xmalloc(src->len + 1);
+	memcpy(seq->str, src->str, src->len);
+	seq->len = src->len;
+}
+
 static void init_term_caps(struct ul_ctl *ctl, struct term_caps *const tcs)
 {
-	tcs->curs_up		= tigetstr("cuu1");
-	tcs->curs_right		= tigetstr("cuf1");
-	tcs->curs_left		= tigetstr("cub1");
-	if (tcs->curs_left == NULL)
-		tcs->curs_left = "\b";
-
-	tcs->enter_standout	= tigetstr("smso");
-	tcs->exit_standout	= tigetstr("rmso");
-	tcs->enter_underline	= tigetstr("smul");
-	tcs->exit_underline	= tigetstr("rmul");
-	tcs->enter_dim		= tigetstr("dim");
-	tcs->enter_bold		= tigetstr("bold");
-	tcs->enter_reverse	= tigetstr("rev");
-	tcs->exit_attributes	= tigetstr("sgr0");
-
-	if (!tcs->enter_bold && tcs->enter_reverse)
-		tcs->enter_bold	= tcs->enter_reverse;
-
-	if (!tcs->enter_bold && tcs->enter_standout)
-		tcs->enter_bold	= tcs->enter_standout;
-
-	if (!tcs->enter_underline && tcs->enter_standout) {
-		tcs->enter_underline = tcs->enter_standout;
-		tcs->exit_underline = tcs->exit_standout;
+	init_seq(&tcs->curs_up, tigetstr("cuu1"));
+	init_seq(&tcs->curs_right, tigetstr("cuf1"));
+	init_seq(&tcs->curs_left, tigetstr("cub1"));
+	if (tcs->curs_left.str == NULL)
+		init_seq(&tcs->curs_left, "\b");
+
+	init_seq(&tcs->enter_standout, tigetstr("smso"));
+	init_seq(&tcs->exit_standout, tigetstr("rmso"));
+	init_seq(&tcs->enter_underline, tigetstr("smul"));
+	init_seq(&tcs->exit_underline, tigetstr("rmul"));
+	init_seq(&tcs->enter_dim, tigetstr("dim"));
+	init_seq(&tcs->enter_bold, tigetstr("bold"));
+	init_seq(&tcs->enter_reverse, tigetstr("rev"));
+	init_seq(&tcs->exit_attributes, tigetstr("sgr0"));
+
+	if (!tcs->enter_bold.str && tcs->enter_reverse.str)
+		copy_seq(&tcs->enter_bold, &tcs->enter_reverse);
+
+	if (!tcs->enter_bold.str && tcs->enter_standout.str)
+		copy_seq(&tcs->enter_bold, &tcs->enter_standout);
+
+	if (!tcs->enter_underline.str && tcs->enter_standout.str) {
+		copy_seq(&tcs->enter_underline, &tcs->enter_standout);
+		free(tcs->exit_underline.str);
+		copy_seq(&tcs->exit_underline, &tcs->exit_standout);
 	}
 
-	if (!tcs->enter_dim && tcs->enter_standout)
-		tcs->enter_dim = tcs->enter_standout;
+	if (!tcs->enter_dim.str && tcs->enter_standout.str)
+		copy_seq(&tcs->enter_dim, &tcs->enter_standout);
 
-	if (!tcs->enter_reverse && tcs->enter_standout)
-		tcs->enter_reverse = tcs->enter_standout;
+	if (!tcs->enter_reverse.str && tcs->enter_standout.str)
+		copy_seq(&tcs->enter_reverse, &tcs->enter_standout);
 
-	if (!tcs->exit_attributes && tcs->exit_standout)
-		tcs->exit_attributes = tcs->exit_standout;
+	if (!tcs->exit_attributes.str && tcs->exit_standout.str)
+		copy_seq(&tcs->exit_attributes, &tcs->exit_standout);
 
 	/*
 	 * Note that we use REVERSE for the alternate character set,
@@ -212,32 +266,83 @@ static void init_term_caps(struct ul_ctl *ctl, struct term_caps *const tcs)
 	 * the typical as/ae is more of a graphics set, not the greek
 	 * letters the 37 has.
 	 */
-	tcs->under_char = tigetstr("uc");
-	ctl->must_use_uc = (tcs->under_char && !tcs->enter_underline);
+	init_seq(&tcs->under_char, tigetstr("uc"));
+	ctl->must_use_uc = (tcs->under_char.str && !tcs->enter_underline.str);
 
-	if ((tigetflag("os") && tcs->enter_bold == NULL) ||
-	    (tigetflag("ul") && tcs->enter_underline == NULL
-			     && tcs->under_char == NULL))
+	if ((tigetflag("os") && tcs->enter_bold.str == NULL) ||
+	    (tigetflag("ul") && tcs->enter_underline.str == NULL
+			     && tcs->under_char.str == NULL))
 		ctl->must_overstrike = 1;
 }
 
+static void free_term_caps(struct term_caps *const tcs)
+{
+	free(tcs->curs_up.str);
+	free(tcs->curs_right.str);
+	free(tcs->curs_left.str);
+	free(tcs->enter_standout.str);
+	free(tcs->exit_standout.str);
+	free(tcs->enter_underline.str);
+	free(tcs->exit_underline.str);
+	free(tcs->enter_dim.str);
+	free(tcs->enter_bold.str);
+	free(tcs->enter_reverse.str);
+	free(tcs->under_char.str);
+	free(tcs->exit_attributes.str);
+}
+
 static void sig_handler(int signo __attribute__((__unused__)))
 {
 	_exit(EXIT_SUCCESS);
 }
 
-static int ul_putwchar(int c)
+static void ul_flush(void)
 {
-	if (putwchar(c) == WEOF)
-		return EOF;
-	return c;
+	if (outlen && fwrite(outbuf, 1, outlen, stdout) != outlen)
+		err(EXIT_FAILURE, _("write failed"));
+	outlen = 0;
 }
 
-static void print_line(char *line)
+/*
+ * The output is collected in outbuf[] and written by one fwrite() when the
+ * buffer is full or at the end of the line on terminal.  The stdout stream is
+ * byte oriented.
+ */
+static inline void ul_putwchar(wint_t c)
 {
-	if (line == NULL)
+	if (OUTBUF_SIZE - outlen < MB_LEN_MAX)
+		ul_flush();
+#ifdef HAVE_WIDECHAR
+	if ((unsigned long) c >= 0x80) {
+		static mbstate_t st;
+		size_t n = wcrtomb(outbuf + outlen, c, &st);
+
+		if (n == (size_t) -1)
+			err(EXIT_FAILURE, _("write failed"));
+		outlen += n;
 		return;
-	tputs(line, STDOUT_FILENO, ul_putwchar);
+	}
+#endif
+	outbuf[outlen++] = c;
+}
+
+static void ul_putws(const wchar_t *s)
+{
+	for (; *s; s++)
+		ul_putwchar(*s);
+}
+
+static void print_line(const struct term_seq *seq)
+{
+	if (seq->len > OUTBUF_SIZE - outlen)
+		ul_flush();
+	if (seq->len > OUTBUF_SIZE) {
+		if (fwrite(seq->str, 1, seq->len, stdout) != seq->len)
+			err(EXIT_FAILURE, _("write failed"));
+		return;
+	}
+	memcpy(outbuf + outlen, seq->str, seq->len);
+	outlen += seq->len;
 }
 
 static void ul_setmode(struct ul_ctl *ctl, struct term_caps const *const tcs,
@@ -253,40 +358,40 @@ static void ul_setmode(struct ul_ctl *ctl, struct term_caps const *const tcs,
 			case NORMAL_CHARSET:
 				break;
 			case UNDERLINE:
-				print_line(tcs->exit_underline);
+				print_line(&tcs->exit_underline);
 				break;
 			default:
 				/* This includes standout */
-				print_line(tcs->exit_attributes);
+				print_line(&tcs->exit_attributes);
 				break;
 			}
 			break;
 		case ALTERNATIVE_CHARSET:
-			print_line(tcs->enter_reverse);
+			print_line(&tcs->enter_reverse);
 			break;
 		case SUPERSCRIPT:
 			/*
 			 * This only works on a few terminals.
 			 * It should be fixed.
 			 */
-			print_line(tcs->enter_underline);
-			print_line(tcs->enter_dim);
+			print_line(&tcs->enter_underline);
+			print_line(&tcs->enter_dim);
 			break;
 		case SUBSCRIPT:
-			print_line(tcs->enter_dim);
+			print_line(&tcs->enter_dim);
 			break;
 		case UNDERLINE:
-			print_line(tcs->enter_underline);
+			print_line(&tcs->enter_underline);
 			break;
 		case BOLD:
-			print_line(tcs->enter_bold);
+			print_line(&tcs->enter_bold);
 			break;
 		default:
 			/*
 			 * We should have some provision here for multiple modes
 			 * on at once.  This will have to come later.
 			 */
-			print_line(tcs->enter_standout);
+			print_line(&tcs->enter_standout);
 			break;
 		}
 	}
@@ -314,8 +419,8 @@ static void indicate_attribute(struct ul_ctl *ctl)
 	for (*p = ' '; *p == ' '; p--)
 		*p = 0;
 
-	fputws(buf, stdout);
-	putwchar('\n');
+	ul_putws(buf);
+	ul_putwchar('\n');
 	free(buf);
 }
 
@@ -324,12 +429,12 @@ static void output_char(struct ul_ctl *ctl, struct term_caps const *const tcs,
 {
 	int i;
 
-	putwchar(c);
+	ul_putwchar(c);
 	if (ctl->must_use_uc && (ctl->current_mode & UNDERLINE)) {
 		for (i = 0; i < width; i++)
-			print_line(tcs->curs_left);
+			print_line(&tcs->curs_left);
 		for (i = 0; i < width; i++)
-			print_line(tcs->under_char);
+			print_line(&tcs->under_char);
 	}
 }
 
@@ -363,18 +468,18 @@ static void overstrike(struct ul_ctl *ctl)
 		}
 	}
 
-	putwchar('\r');
+	ul_putwchar('\r');
 	for (*p = ' '; *p == ' '; p--)
 		*p = 0;
-	fputws(buf, stdout);
+	ul_putws(buf);
 
 	if (had_bold) {
-		putwchar('\r');
+		ul_putwchar('\r');
 		for (p = buf; *p; p++)
-			putwchar(*p == '_' ? ' ' : *p);
-		putwchar('\r');
+			ul_putwchar(*p == '_' ? ' ' : *p);
+		ul_putwchar('\r');
 		for (p = buf; *p; p++)
-			putwchar(*p == '_' ? ' ' : *p);
+			ul_putwchar(*p == '_' ? ' ' : *p);
 	}
 	free(buf);
 }
@@ -394,7 +499,7 @@ static void flush_line(struct ul_ctl *ctl, struct term_caps const *const tcs)
 		}
 		if (ctl->buf[i].c_char == '\0') {
 			if (ctl->up_line)
-				print_line(tcs->curs_right);
+				print_line(&tcs->curs_right);
 			else
 				output_char(ctl, tcs, ' ', 1);
 		} else
@@ -406,10 +511,13 @@ static void flush_line(struct ul_ctl *ctl, struct term_caps const *const tcs)
 		ul_setmode(ctl, tcs, NORMAL_CHARSET);
 	if (ctl->must_overstrike && had_mode)
 		overstrike(ctl);
-	putwchar('\n');
+	ul_putwchar('\n');
 	if (ctl->indicated_opt && had_mode)
 		indicate_attribute(ctl);
-	fflush(stdout);
+	if (ctl->flush_lines) {
+		ul_flush();
+		fflush(stdout);
+	}
 	if (ctl->up_line)
 		ctl->up_line--;
 	init_buffer(ctl);
@@ -430,8 +538,8 @@ static void reverse(struct ul_ctl *ctl, struct term_caps const *const tcs)
 {
 	ctl->up_line++;
 	forward(ctl, tcs);
-	print_line(tcs->curs_up);
-	print_line(tcs->curs_up);
+	print_line(&tcs->curs_up);
+	print_line(&tcs->curs_up);
 	ctl->up_line++;
 }
 
@@ -524,7 +632,7 @@ static void filter(struct ul_ctl *ctl, struct term_caps const *const tcs, FILE *
 			continue;
 		case '\f':
 			flush_line(ctl, tcs);
-			putwchar('\f');
+			ul_putwchar('\f');
 			continue;
 		default:
 			if (!iswprint(c))
@@ -627,6 +735,7 @@ int main(int argc, char **argv)
 
 	init_term_caps(&ctl, &tcs);
 	init_buffer(&ctl);
+	ctl.flush_lines = isatty(STDOUT_FILENO);
 
 	if (optind == argc)
 		filter(&ctl, &tcs, stdin);
@@ -640,7 +749,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	ul_flush();
 	free(ctl.buf);
+	free_term_caps(&tcs);
 	del_curterm(cur_term);
 	return EXIT_SUCCESS;
 }